@@ -3,6 +3,16 @@ set(INSTALL_MBEDTLS_HEADERS OFF CACHE BOOL "Install mbed TLS headers.")
 set(ENABLE_PROGRAMS OFF CACHE BOOL "Build mbed TLS programs.")
 set(ENABLE_TESTING OFF CACHE BOOL "Build mbed TLS tests.")
 
+# Custom mbed TLS config file, e.g. to plug in hardware accelerated implementations (MBEDTLS_AES_ALT,
+# MBEDTLS_SHA256_ALT, MBEDTLS_ECP_ALT..) or tune MBEDTLS_ECP_WINDOW_SIZE for the host.
+# Used by both mbed TLS and rsid, so both see the same structures.
+# AES-NI is enabled by the default config and detected at runtime.
+set(RSID_MBEDTLS_CONFIG_FILE "" CACHE FILEPATH "Custom mbed TLS config file (MBEDTLS_CONFIG_FILE)")
+if(RSID_MBEDTLS_CONFIG_FILE)
+    message(STATUS "mbed TLS config file: ${RSID_MBEDTLS_CONFIG_FILE}")
+    add_definitions("-DMBEDTLS_CONFIG_FILE=\"${RSID_MBEDTLS_CONFIG_FILE}\"")
+endif()
+
 add_subdirectory("${THIRD_PARTY_DIRECTORY}/mbedtls-2.25.0")
 
 add_library(mbedtls::mbedtls ALIAS mbedtls)
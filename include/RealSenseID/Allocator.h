@@ -0,0 +1,103 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseIDExports.h"
+#include <cstddef>
+
+/**
+ *  The library's buffers (preview frames and conversion buffers, firmware update receive buffer, matcher gallery
+ *  matrices) are allocated through a replaceable allocator, so embedded hosts can place them in arenas or pools, and
+ *  counted, to verify that steady state operation does not allocate.
+ */
+namespace RealSenseID
+{
+/**
+ * Memory source of the library's buffers (SetAllocator()). Must be thread safe.
+ */
+class RSID_API Allocator
+{
+public:
+    virtual ~Allocator() = default;
+
+    // size bytes aligned to alignment (a power of 2). return nullptr on failure.
+    virtual void* Allocate(size_t size, size_t alignment) = 0;
+
+    // free a block returned by Allocate() with the same size and alignment
+    virtual void Deallocate(void* ptr, size_t size, size_t alignment) = 0;
+};
+
+/**
+ * Allocate the library's buffers from the given allocator (nullptr - the default heap).
+ * A block is always freed by the allocator it came from, so the allocator may be replaced at any time, but must
+ * outlive its blocks (e.g. until the FaceAuthenticator / Preview / HostGallery objects using it are destroyed).
+ * @param allocator[in] the allocator, not owned.
+ */
+RSID_API void SetAllocator(Allocator* allocator);
+
+/**
+ * Allocations of the library's buffers since the library was loaded (or since the last ResetAllocationStats()).
+ */
+struct RSID_API AllocationStats
+{
+    unsigned long long allocations = 0;
+    unsigned long long deallocations = 0;
+    unsigned long long bytes_allocated = 0; // total of the allocations
+    unsigned long long bytes_in_use = 0;    // currently allocated (not reset)
+    unsigned long long peak_bytes_in_use = 0;
+};
+
+/**
+ * Get the allocation counters.
+ * @param stats[out] the counters.
+ */
+RSID_API void GetAllocationStats(AllocationStats& stats);
+
+/**
+ * Zero the allocation counters (the peaks, also those of GetMemoryStats(), restart from the bytes in use).
+ */
+RSID_API void ResetAllocationStats();
+
+/**
+ * Subsystems whose memory is reported by GetMemoryStats()
+ */
+enum class MemoryCategory
+{
+    PreviewFrames = 0,     // preview frame pools (the image buffers of PreviewConfig::bufferCount)
+    PreviewConversion = 1, // StreamConverter's decode and conversion buffers
+    Packets = 2,           // large packets of the bulk transfers
+    SerialBuffers = 3,     // serial receive rings and the firmware update receive buffer
+    Logging = 4,           // async log delivery queue
+    Gallery = 5,           // matcher galleries, prefilters and indices
+    Operations = 6,        // FaceAuthenticator's per operation arenas
+    Other = 7,
+    Count = 8
+};
+
+/**
+ * Bytes held by a subsystem, and the most it held since the library was loaded (or ResetAllocationStats()).
+ */
+struct RSID_API MemoryUsage
+{
+    unsigned long long bytes_in_use = 0;
+    unsigned long long peak_bytes_in_use = 0;
+};
+
+/**
+ * Memory of the library's buffers by subsystem, to size hosts (e.g. for large galleries or several cameras).
+ * Includes the buffers of the allocator (SetAllocator()) and the large fixed buffers held otherwise (serial rings,
+ * packets, log queue, gallery indices). Small objects and bookkeeping are not included.
+ */
+struct RSID_API MemoryStats
+{
+    MemoryUsage categories[static_cast<int>(MemoryCategory::Count)]; // by MemoryCategory
+    MemoryUsage total;                                              // peak_bytes_in_use is that of the sum
+};
+
+/**
+ * Get the memory of the library's buffers.
+ * @param stats[out] the memory by subsystem.
+ */
+RSID_API void GetMemoryStats(MemoryStats& stats);
+} // namespace RealSenseID
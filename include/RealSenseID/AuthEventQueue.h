@@ -0,0 +1,83 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/RealSenseIDExports.h"
+#include "RealSenseID/AuthenticationCallback.h"
+#include "RealSenseID/AuthenticateStatus.h"
+#include "RealSenseID/FaceRect.h"
+#include <cstddef>
+#include <vector>
+
+namespace RealSenseID
+{
+class AuthEventQueueImpl;
+
+/**
+ * Type of an authentication event.
+ */
+enum class AuthEventType
+{
+    FaceDetected,
+    Hint,
+    Result
+};
+
+/**
+ * Authentication event, as delivered to the AuthenticationCallback.
+ */
+struct AuthEvent
+{
+    static constexpr size_t MAX_FACES = 10;
+
+    AuthEventType type = AuthEventType::Result;
+    AuthenticateStatus status = AuthenticateStatus::Success; // Hint and Result
+    char user_id[31] = {0};                                  // Result (valid only if status is Success)
+    unsigned int ts = 0;                                     // FaceDetected
+    size_t n_faces = 0;                                      // FaceDetected
+    FaceRect faces[MAX_FACES];                               // FaceDetected. First item is the selected one
+};
+
+/**
+ * Authentication callback that queues the events, for the application to poll them from its own thread (e.g. a face
+ * boxes overlay drawn in the ui loop).
+ * The queue is a fixed size ring allocated on construction. Queueing and polling allocate nothing.
+ * Events arriving when the queue is full are dropped (and counted).
+ *
+ * Events are queued by a single authentication at a time and polled by a single thread.
+ */
+class RSID_API AuthEventQueue : public AuthenticationCallback
+{
+public:
+    /**
+     * @param[in] capacity Max number of queued events (rounded up to a power of 2).
+     */
+    explicit AuthEventQueue(size_t capacity = 64);
+    ~AuthEventQueue();
+
+    AuthEventQueue(const AuthEventQueue&) = delete;
+    AuthEventQueue& operator=(const AuthEventQueue&) = delete;
+
+    /**
+     * Take the oldest event, without waiting.
+     *
+     * @param[out] event The event.
+     * @return true if an event was taken, false if the queue is empty.
+     */
+    bool Poll(AuthEvent& event);
+
+    /**
+     * @return Number of events dropped so far because the queue was full.
+     */
+    size_t Dropped() const;
+
+    void OnResult(const AuthenticateStatus status, const char* userId) override;
+    void OnHint(const AuthenticateStatus hint) override;
+    void OnFaceDetected(const FaceRect* faces, const size_t n_faces, const unsigned int ts) override;
+    void OnFaceDetected(const std::vector<FaceRect>& faces, const unsigned int ts) override;
+
+private:
+    AuthEventQueueImpl* _impl = nullptr;
+};
+} // namespace RealSenseID
@@ -0,0 +1,31 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseIDExports.h"
+
+namespace RealSenseID
+{
+/**
+ * Timing of the authentication loops (AuthenticateLoop, ExtractFaceprintsForAuthLoop).
+ * Get the defaults with FaceAuthenticator::GetAuthLoopPolicy(), modify and set them back.
+ */
+struct RSID_API AuthLoopPolicy
+{
+    // wait after an attempt in which a face was detected (0 - retry immediately)
+    unsigned int interval_with_face_ms = 0;
+
+    // wait after the first attempt with no face.
+    // each further attempt with no face doubles the wait, up to max_interval_no_face_ms.
+    unsigned int min_interval_no_face_ms = 0;
+    unsigned int max_interval_no_face_ms = 0;
+
+    // ExtractFaceprintsForAuthLoop only: deliver each OnResult on a worker thread, so the next attempt's request goes
+    // out as soon as the faceprints arrived while the callback (e.g. the 1:N match) handles them. The results stay in
+    // order, one at a time: an attempt's OnResult waits for the previous one to return. The other callbacks of the
+    // next attempt (and the OnTiming of the same one) run on the loop's thread meanwhile. The loop returns after the
+    // last OnResult. Takes effect from the next loop.
+    bool pipelined_results = false;
+};
+} // namespace RealSenseID
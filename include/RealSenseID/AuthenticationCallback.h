@@ -5,7 +5,9 @@
 
 #include "AuthenticateStatus.h"
 #include "FaceRect.h"
-#include<vector>
+#include "OperationTiming.h"
+#include <cstddef>
+#include <vector>
 
 namespace RealSenseID
 {
@@ -44,5 +46,27 @@ public:
     {
         //default empty impl for backward compatibilty
     }
+
+    /**
+     * Allocation free variant of OnFaceDetected(), which the authentication calls instead.
+     * The default implementation passes the faces to OnFaceDetected() above as a vector.
+     *
+     * @param[in] faces Array of n_faces detected faces. Valid only during the call.
+     * @param[in] n_faces Number of detected faces.
+     */
+    virtual void OnFaceDetected(const FaceRect* faces, const size_t n_faces, const unsigned int ts)
+    {
+        OnFaceDetected(std::vector<FaceRect>(faces, faces + n_faces), ts);
+    }
+
+    /**
+     * Called once when the operation ends with the device's reply, after the result, with the timing breakdown of the
+     * operation. Not called when the session or the serial line fail.
+     *
+     * @param[in] timing Timing of the operation's stages.
+     */
+    virtual void OnTiming(const OperationTiming& timing)
+    {
+    }
 };
 } // namespace RealSenseID
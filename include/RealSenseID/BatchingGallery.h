@@ -0,0 +1,66 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/RealSenseIDExports.h"
+#include "RealSenseID/GalleryBackend.h"
+#include "RealSenseID/Faceprints.h"
+#include "RealSenseID/Status.h"
+#include <cstddef>
+
+namespace RealSenseID
+{
+class BatchingGalleryImpl;
+
+/**
+ * Shared match engine for several devices authenticating against the same gallery, e.g. a gateway with a
+ * FaceAuthenticator per device, all calling AuthenticateWithGallery() with this gallery.
+ *
+ * Probes that arrive within a short window are matched in a single batched pass over the wrapped gallery (see
+ * HostGallery::MatchBatch()), instead of a full gallery scan per device. Each caller gets the results of its own
+ * probes, the same as calling the wrapped gallery directly.
+ *
+ * The first probe to arrive waits at most the window for others to join, and never longer than the last pass took:
+ * joining a batch saves at most one pass, so a short pass is not delayed by a longer wait. A batch starts early when
+ * it reaches max_probes. A single caller is matched without waiting (until a pass is measured).
+ * Probes that fail validation are matched on their own, so they do not fail the batch of other callers.
+ * Thread safe.
+ */
+class RSID_API BatchingGallery : public GalleryBackend
+{
+public:
+    static constexpr unsigned int DefaultWindowMicros = 2000;
+    static constexpr size_t DefaultMaxProbes = 32;
+
+    /**
+     * @param[in] gallery Gallery matched by the batches (e.g. HostGallery or RemoteGallery). Must outlive this object.
+     * @param[in] window_micros Max time the first probe of a batch waits for others, in micros (0 - no wait, batches
+     * form only while a pass is running).
+     * @param[in] max_probes Max number of probes in a batch (at least 1).
+     */
+    explicit BatchingGallery(GalleryBackend& gallery, unsigned int window_micros = DefaultWindowMicros,
+                             size_t max_probes = DefaultMaxProbes);
+    ~BatchingGallery() override;
+
+    BatchingGallery(const BatchingGallery&) = delete;
+    BatchingGallery& operator=(const BatchingGallery&) = delete;
+
+    /**
+     * Prefetch the wrapped gallery.
+     */
+    void Prefetch() const override;
+
+    /**
+     * Match several faceprints against the wrapped gallery, together with the probes of other callers.
+     * results[i] and updated_faceprints[i] are what the wrapped gallery's MatchBatch() returns for new_faceprints[i].
+     *
+     * @return Status (Status::Ok on success, Status::Error on invalid arguments or if the batch failed).
+     */
+    Status MatchBatch(const Faceprints* new_faceprints, size_t number_of_probes, HostGalleryMatch* results,
+                      Faceprints* updated_faceprints) override;
+
+private:
+    BatchingGalleryImpl* _impl = nullptr;
+};
+} // namespace RealSenseID
@@ -70,6 +70,14 @@ public:
      */
     Status QuerySerialNumber(std::string& serial);
 
+    /**
+     * Enable or disable caching of QueryFirmwareVersion() and QuerySerialNumber() results (disabled by default).
+     * The cache is dropped on Connect(), Disconnect() and Reboot().
+     *
+     * @param[in] enable True to cache the query results.
+     */
+    void SetQueryCache(bool enable);
+
     /**
      * Send ping packet to device
      * @return SerialStatus::Success if device responded with a valid ping response.
@@ -5,7 +5,9 @@
 
 #include "RealSenseID/RealSenseIDExports.h"
 #include "RealSenseID/SerialConfig.h"
+#include "RealSenseID/Status.h"
 
+#include <functional>
 #include <vector>
 
 namespace RealSenseID
@@ -21,4 +23,53 @@ struct RSID_API DeviceInfo
 std::vector<DeviceInfo> RSID_API DiscoverDevices();
 std::vector<int> RSID_API DiscoverCapture();
 
+/**
+ * Identity of the device at a serial port (ProbeDevices()).
+ */
+struct RSID_API ProbedDevice
+{
+    static constexpr std::size_t MaxBufferSize = 256;
+
+    char serialPort[MaxBufferSize];
+    Status status;                       // Status::Ok if the device answered both queries
+    char serialNumber[MaxBufferSize];    // as DeviceController::QuerySerialNumber() (empty on failure)
+    char firmwareVersion[MaxBufferSize]; // as DeviceController::QueryFirmwareVersion() (empty on failure)
+};
+
+/**
+ * Identify the devices at the given ports (e.g. of DiscoverDevices()): connects to all the ports concurrently and
+ * queries the serial number and firmware version of each device, so identifying many devices takes about as long as
+ * one (a port with no answering device fails within its read timeout, not the long receive timeout of a command).
+ * The ports must not be in use by another connection.
+ *
+ * The identities are cached per port: ports identified by an earlier call are not probed again, unless use_cache is
+ * false. Failures are not cached, and the cache is dropped whenever the device watcher (StartDeviceWatcher()) sees
+ * the devices change.
+ * @param devices[in] ports to probe.
+ * @param use_cache[in] false to probe all the ports (and refresh their cached identities).
+ * @return the identity of each port, in the order of devices.
+ */
+std::vector<ProbedDevice> RSID_API ProbeDevices(const std::vector<DeviceInfo>& devices, bool use_cache = true);
+
+/**
+ * Called by the device watcher's thread with the current serial devices and capture devices.
+ */
+using DevicesChangedCallback =
+    std::function<void(const std::vector<DeviceInfo>& devices, const std::vector<int>& capture_numbers)>;
+
+/**
+ * Watch for devices being plugged in and out (kernel uevents on Linux, device interface notifications on Windows).
+ * While watching, DiscoverDevices() and DiscoverCapture() return cached lists instead of scanning the system,
+ * so they can be polled cheaply. Replaces a running watcher.
+ * @param callback[in] called once with the current devices and after every change (may be empty).
+ *                     It must not call StartDeviceWatcher() or StopDeviceWatcher().
+ * @return True on success, false if the watcher is not supported on this platform or failed to start.
+ */
+RSID_API bool StartDeviceWatcher(DevicesChangedCallback callback);
+
+/**
+ * Stop watching. DiscoverDevices() and DiscoverCapture() scan the system again.
+ */
+RSID_API void StopDeviceWatcher();
+
 } // namespace RealSenseID
@@ -11,6 +11,7 @@
 namespace RealSenseID
 {
 class Faceprints;
+struct HostGalleryMatch;
 
 /**
  * User defined callback for faceprints extraction.
@@ -29,6 +30,20 @@ public:
      */
     virtual void OnResult(const EnrollStatus status, const Faceprints* faceprints) = 0;
 
+    /**
+     * Variant of OnResult() with the duplicate check, which the faceprints extraction with a gallery calls instead.
+     * The default implementation passes the status and faceprints to OnResult() above.
+     *
+     * @param[in] status Final enroll status.
+     * @param[in] faceprints Pointer to the requested faceprints which were just extracted from the device
+     * @param[in] duplicate The gallery user the faceprints matched, if any (nullptr if none, or on failure). Valid only
+     * during the call.
+     */
+    virtual void OnResult(const EnrollStatus status, const Faceprints* faceprints, const HostGalleryMatch* duplicate)
+    {
+        OnResult(status, faceprints);
+    }
+
     /**
      * Called to inform the client whenever progress to enrollment has been made.
      *
@@ -52,6 +67,18 @@ public:
     {
         // default empty impl for backward compatibilty
     }
+
+    /**
+     * Allocation free variant of OnFaceDetected(), which the faceprints extraction calls instead.
+     * The default implementation passes the faces to OnFaceDetected() above as a vector.
+     *
+     * @param[in] faces Array of n_faces detected faces. Valid only during the call.
+     * @param[in] n_faces Number of detected faces.
+     */
+    virtual void OnFaceDetected(const FaceRect* faces, const size_t n_faces, const unsigned int ts)
+    {
+        OnFaceDetected(std::vector<FaceRect>(faces, faces + n_faces), ts);
+    }
 };
 
 } // namespace RealSenseID
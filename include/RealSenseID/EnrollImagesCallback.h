@@ -0,0 +1,41 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/EnrollStatus.h"
+
+namespace RealSenseID
+{
+class Faceprints;
+
+/**
+ * Stored face image for FaceAuthenticator::ExtractFaceprintsFromImages(): the bytes of a JPEG file (e.g. a badge
+ * photo).
+ */
+struct StoredImage
+{
+    const unsigned char* buffer = nullptr;
+    unsigned int size = 0;
+};
+
+/**
+ * User defined callback for the faceprints extraction of stored images.
+ * Called with the result of each image as it arrives from the device.
+ */
+class EnrollImagesCallback
+{
+public:
+    virtual ~EnrollImagesCallback() = default;
+
+    /**
+     * Called once for each image, in the order of the images.
+     *
+     * @param[in] image_index Index of the image in the images array.
+     * @param[in] status Success, or the reason the image has no faceprints (e.g. EnrollStatus::NoFaceDetected, or
+     *                   EnrollStatus::Failure for an image that is not a valid JPEG or is too large).
+     * @param[in] faceprints The image's faceprints if status is Success, nullptr otherwise. Valid only during the call.
+     */
+    virtual void OnResult(const unsigned int image_index, const EnrollStatus status, const Faceprints* faceprints) = 0;
+};
+} // namespace RealSenseID
@@ -49,5 +49,17 @@ public:
     {
         //default empty impl for backward compatibilty
     }
+
+    /**
+     * Allocation free variant of OnFaceDetected(), which the enrollment calls instead.
+     * The default implementation passes the faces to OnFaceDetected() above as a vector.
+     *
+     * @param[in] faces Array of n_faces detected faces. Valid only during the call.
+     * @param[in] n_faces Number of detected faces.
+     */
+    virtual void OnFaceDetected(const FaceRect* faces, const size_t n_faces, const unsigned int ts)
+    {
+        OnFaceDetected(std::vector<FaceRect>(faces, faces + n_faces), ts);
+    }
 };
 } // namespace RealSenseID
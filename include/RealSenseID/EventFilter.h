@@ -0,0 +1,31 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseIDExports.h"
+
+namespace RealSenseID
+{
+/**
+ * Events of the device operations (enroll, authenticate, the faceprints extractions and their loops) the application
+ * wants delivered (FaceAuthenticator::SetEventFilter()). Results are always delivered.
+ * The filter is sent to the device with the session start, and a device supporting it does not send the events
+ * filtered out, which leaves the serial link to the result. With other devices the events are dropped on the host,
+ * so the callbacks get the same events either way.
+ */
+struct RSID_API EventFilter
+{
+    // OnHint of the callbacks
+    bool hints = true;
+
+    // OnProgress of the enrollment callbacks
+    bool progress = true;
+
+    // OnFaceDetected of the callbacks
+    bool faces = true;
+
+    // with faces: at most one OnFaceDetected per interval (0 - all of them)
+    unsigned int face_interval_ms = 0;
+};
+} // namespace RealSenseID
@@ -0,0 +1,51 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseIDExports.h"
+#include <functional>
+
+/**
+ *  The library's background work (the preview capture, decode and delivery loops, the serial readers and reactor,
+ *  the async operation and keep alive loops, the firmware update reader, the matcher's update and persistence loops)
+ *  runs on threads the library starts, one per loop. A host that manages its threads itself (e.g. a service with many
+ *  devices) can run the loops on its own thread pool or event loop threads instead with SetExecutor().
+ */
+namespace RealSenseID
+{
+/**
+ * Runs the library's background loops (SetExecutor()). Must be thread safe.
+ */
+class RSID_API Executor
+{
+public:
+    virtual ~Executor() = default;
+
+    /**
+     * Run the task on a thread of the executor, soon. Must not run it in the calling thread.
+     * A task is one of the library's loops: it blocks its thread until the object that started it stops it (e.g.
+     * the preview until StopPreview(), the serial reader until disconnect), so the executor must be able to run all
+     * the loops of the objects in use at the same time, each on a thread of its own.
+     * A task that has not started when its object stops it is run by the stopping thread instead (it returns
+     * promptly, as it was stopped), so a queued task never blocks the stop. The executor's task then does nothing.
+     * @param task[in] the loop, returns when stopped. does not throw.
+     */
+    virtual void Execute(std::function<void()> task) = 0;
+};
+
+/**
+ * Run the library's background loops on the given executor (nullptr - a thread of the library for each loop).
+ * Applies to the loops started afterwards, so set it before connecting and starting the preview. The executor must
+ * outlive the objects that started loops on it (FaceAuthenticator, DeviceController, Preview, FwUpdater,
+ * DeviceWatcher, HostGallery).
+ * The real-time mode's scheduling (SetRealTimeConfig()) applies to the executor's threads that run I/O loops.
+ * @param executor[in] the executor, not owned.
+ */
+RSID_API void SetExecutor(Executor* executor);
+
+/**
+ * The current executor, nullptr if none.
+ */
+RSID_API Executor* GetExecutor();
+} // namespace RealSenseID
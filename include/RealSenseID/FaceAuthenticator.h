@@ -5,16 +5,28 @@
 
 #include "RealSenseID/DeviceConfig.h"
 #include "RealSenseID/AuthenticationCallback.h"
+#include "RealSenseID/AuthLoopPolicy.h"
+#include "RealSenseID/KeepAlivePolicy.h"
 #include "RealSenseID/AuthFaceprintsExtractionCallback.h"
 #include "RealSenseID/EnrollFaceprintsExtractionCallback.h"
 #include "RealSenseID/EnrollmentCallback.h"
+#include "RealSenseID/EnrollImagesCallback.h"
+#include "RealSenseID/EventFilter.h"
 #include "RealSenseID/Faceprints.h"
+#include "RealSenseID/FaceprintsExportCallback.h"
+#include "RealSenseID/GalleryAuthCallback.h"
+#include "RealSenseID/HostGallery.h"
+#include "RealSenseID/UserIdsCallback.h"
+#include "RealSenseID/UsersChangesCallback.h"
+#include "RealSenseID/UsersCursor.h"
+#include "RealSenseID/UsersExportCallback.h"
 #include "RealSenseID/UserFaceprints.h"
 #include "RealSenseID/SerialConfig.h"
 #include "RealSenseID/SignatureCallback.h"
 #include "RealSenseID/Status.h"
 #include "RealSenseID/MatchResultHost.h"
 #include <cstddef>
+#include <future>
 
 #ifdef ANDROID
 #include "RealSenseID/AndroidSerialConfig.h"
@@ -27,6 +39,14 @@ class FaceAuthenticatorImpl;
 /**
  * Face authenticator class.
  * Provides face authentication operations using the device.
+ *
+ * Thread safety: one instance may be used from several threads, e.g. a door controller authenticating on one thread
+ * while another syncs the users. The device exchanges of the operations are serialized: an operation waits for the
+ * one holding the device to complete, including its callbacks made during the exchange (an authentication loop holds
+ * it until canceled). Work done on the host after the exchange runs concurrently with the next operation's exchange:
+ * the gallery matching and result callback of AuthenticateWithGallery(), and MatchFaceprints(). Cancel() may be
+ * called from any thread and stops the operation holding the device. Connect() and Disconnect() wait for it too.
+ * A callback must not wait on an operation called from another thread (it holds the device).
  */
 class RSID_API FaceAuthenticator
 {
@@ -68,6 +88,69 @@ public:
      */
     void Disconnect();
 
+    /**
+     * Serial link settings of the connection: measured and chosen on Connect() if SerialConfig::calibrate_link is
+     * set, the port's defaults otherwise.
+     *
+     * @return SerialLinkProfile of the current connection (calibrated is false if not connected).
+     */
+    SerialLinkProfile GetLinkProfile() const;
+
+    /**
+     * Enable or disable persistent session mode (disabled by default).
+     * By default every operation starts a new session with the device (in secure mode a new key exchange).
+     * In persistent session mode the session stays open across operations and is renegotiated only after
+     * a communication error, when its sequence numbers run out, on CloseSession(), Pair(), Unpair(), Connect()
+     * or Disconnect().
+     *
+     * @param[in] enable True to keep the session open across operations.
+     */
+    void SetPersistentSession(bool enable);
+
+    /**
+     * Enable or disable the packed faceprints messages in GetUsersFaceprints(), SetUsersFaceprints() and the exports
+     * (disabled by default). The faceprints are then sent bit-packed, in about 30% fewer bytes. Enable only with
+     * firmware that supports them. A device that rejects or does not answer the first packed request gets the full
+     * descriptors from then on (until the next Connect()).
+     *
+     * @param[in] enable True to use the packed faceprints messages.
+     */
+    void SetPackedTransfers(bool enable);
+
+    /**
+     * Enable or disable large packets for the bulk transfers (disabled by default). The sessions then offer them to
+     * the device, and the user ids and faceprints exports and imports send many users per packet when the device
+     * takes them. A device without them answers none, and the session stays on regular packets.
+     * Applies from the next session start.
+     *
+     * @param[in] enable True to offer large packets.
+     */
+    void SetLargePayloads(bool enable);
+
+    /**
+     * Enable or disable message batches (disabled by default). The sessions then offer them to the device, and
+     * several small messages (pipelined requests, hints and progress) travel in one packet, paying the framing and in
+     * the secure session the encryption once. A device without them answers none. Applies from the next session start.
+     *
+     * @param[in] enable True to offer message batches.
+     */
+    void SetMessageBatches(bool enable);
+
+    /**
+     * Close the current session. The next operation starts a new one.
+     */
+    void CloseSession();
+
+    /**
+     * Enable or disable caching of QueryNumberOfUsers() and QueryDeviceConfig() results (disabled by default).
+     * A cached answer is returned without a device round trip. The cache is dropped by this instance's Enroll(),
+     * RemoveUser(), RemoveAll(), SetDeviceConfig() and SetUsersFaceprints(), and on Connect() or Disconnect().
+     * Changes made to the device by other clients (or another FaceAuthenticator) are not seen while cached.
+     *
+     * @param[in] enable True to cache the query results.
+     */
+    void SetQueryCache(bool enable);
+
 #ifdef RSID_SECURE
     /**
      * Send updated host ecdsa key to device, sign it with previous ecdsa key (at first pair can sign with dummy key)
@@ -124,12 +207,68 @@ public:
     /**
      * Start Authentication Loop.
      * Starts infinite authentication loop. Call Cancel to stop it.
+     * The attempts run in one session (no session handshake per attempt) and wait between them per the
+     * AuthLoopPolicy.
      *
      * @param[in] callback User defined callback object to handle the process updates.
      * @return Status (Status::Ok on success).
      */
     Status AuthenticateLoop(AuthenticationCallback& callback);
 
+    /**
+     * Set the timing of the authentication loops.
+     * Takes effect from the next wait of a running loop.
+     *
+     * @param[in] policy Loop intervals. min_interval_no_face_ms must not exceed max_interval_no_face_ms.
+     * @return Status (Status::Ok on success).
+     */
+    Status SetAuthLoopPolicy(const AuthLoopPolicy& policy);
+
+    /**
+     * Current timing of the authentication loops.
+     *
+     * @return The loop policy (the defaults unless changed with SetAuthLoopPolicy).
+     */
+    AuthLoopPolicy GetAuthLoopPolicy() const;
+
+    /**
+     * Set the connection keep-alive (off by default).
+     * Once the connection has been idle for the policy's idle time, a background thread queues a ping of the device
+     * on the async operations queue (at the lowest priority, see the async operations below). A failed ping is found
+     * within the ping timeout, instead of by the next operation's receive timeout. The serial port is then reopened
+     * (with backoff while it fails) and, in persistent session mode, the session is started again, so the next
+     * operation does not pay for the reconnect. Only a connection made by a SerialConfig can be reopened.
+     * The keep-alive waits for the operations of other threads like they wait for each other.
+     *
+     * @param[in] policy Keep-alive timing. min_backoff_ms must be positive and not exceed max_backoff_ms.
+     * @return Status (Status::Ok on success).
+     */
+    Status SetKeepAlivePolicy(const KeepAlivePolicy& policy);
+
+    /**
+     * Current connection keep-alive.
+     *
+     * @return The keep-alive policy (off unless changed with SetKeepAlivePolicy).
+     */
+    KeepAlivePolicy GetKeepAlivePolicy() const;
+
+    /**
+     * Set which events of the enroll, authenticate and faceprints extraction operations reach the callbacks (all by
+     * default). The filter is sent to the device with the next session start, so the filtered events are not sent
+     * over the serial link at all; events of a device without the filter are dropped on the host.
+     * Takes effect from the next operation.
+     *
+     * @param[in] filter The events to deliver.
+     */
+    void SetEventFilter(const EventFilter& filter);
+
+    /**
+     * Current event filter.
+     *
+     * @return The event filter (all events unless changed with SetEventFilter).
+     */
+    EventFilter GetEventFilter() const;
+
     /**
      * Cancel currently running operation.
      *
@@ -178,6 +317,36 @@ public:
      */
     Status QueryUserIds(char** user_ids, unsigned int& number_of_users_in_out);
 
+    /**
+     * Query the device about all enrolled users, into a single buffer.
+     *
+     * @param[out] user_ids pre-allocated buffer of number_of_users_in_out * MAX_USERID_LENGTH bytes. user i's id is
+     * the null terminated string at user_ids + i * MAX_USERID_LENGTH.
+     * @param[in/out] number of users to retrieve.
+     * @return Status (Status::Ok on success).
+     */
+    Status QueryUserIdsToBuffer(char* user_ids, unsigned int& number_of_users_in_out);
+
+    /**
+     * Query the device about all enrolled users, handing each id to the callback as it arrives.
+     * Nothing is allocated for the listing.
+     *
+     * @param[in] callback Called with the id of each user, in DB order.
+     * @param[in/out] number of users to retrieve.
+     * @return Status (Status::Ok on success).
+     */
+    Status QueryUserIds(UserIdsCallback& callback, unsigned int& number_of_users_in_out);
+
+    /**
+     * Query the ids of the next page of users from the cursor on (see ExportUsers() with a cursor).
+     *
+     * @param[in/out] cursor Position of the listing. Default constructed to start from the first user.
+     * @param[in] page_size Maximum number of ids to query in this call (not zero).
+     * @param[in] callback Called with the DB index and id of each user, in DB order.
+     * @return Status (Status::Ok on success, also when the cursor was already done).
+     */
+    Status QueryUserIds(UsersCursor& cursor, unsigned int page_size, UserIdsCallback& callback);
+
     /**
      * Query the device about the number of enrolled users.
      *
@@ -209,6 +378,35 @@ public:
      */
     Status ExtractFaceprintsForEnroll(EnrollFaceprintsExtractionCallback& callback);
 
+    /**
+     * Extract faceprints using enrollment flow, as above, and check that the enrollee is not in the gallery already.
+     * The gallery is searched in the background as soon as the faceprints arrive, while the device ends the
+     * operation, so the check adds little to the enrollment time. The callback's OnResult() variant with the
+     * duplicate is called with the verdict (the gallery user the enrollee matched, if any). The gallery is not
+     * changed: the matched user gets no adaptive update.
+     *
+     * @param[in] gallery Users gallery to look for the enrollee in.
+     * @param[in] callback User defined callback to handle the process updates.
+     * @return Status (Status::Ok on success).
+     */
+    Status ExtractFaceprintsForEnroll(HostGallery& gallery, EnrollFaceprintsExtractionCallback& callback);
+
+    /**
+     * Extract faceprints from stored face images (e.g. badge photos) for host mode enrollment, without the camera.
+     * The images are JPEG files. They are prepared on the host in parallel (the metadata the device does not need is
+     * dropped) and each is uploaded while the device extracts the previous one, so a batch takes about the device's
+     * extraction time per image.
+     * An image without faceprints does not stop the batch, a communication error does.
+     * Requires a device firmware with image enrollment, Status::Error otherwise.
+     *
+     * @param[in] images Array of number_of_images images.
+     * @param[in] number_of_images Number of images in the array.
+     * @param[in] callback Called with the result of each image, in order.
+     * @return Status (Status::Ok on success).
+     */
+    Status ExtractFaceprintsFromImages(const StoredImage* images, unsigned int number_of_images,
+                                       EnrollImagesCallback& callback);
+
     /**
      * Attempt to extract faceprints using authentication flow.
      * Starts the authentication procedure, which starts the camera, captures frames, extracts faceprints,
@@ -224,12 +422,31 @@ public:
     /**
      * Attempt faceprints extraction in a loop using authentication flow.
      * Starts infinite authentication loop. Call Cancel to stop it.
+     * The attempts run in one session (no session handshake per attempt) and wait between them per the
+     * AuthLoopPolicy. For a steady faceprints stream to a host gallery, set interval_with_face_ms to 0: the next
+     * extraction then starts as soon as the previous one returned faceprints. With pipelined_results set too, it
+     * starts while the callback still matches the previous faceprints.
      *
      * @param[in] callback User defined callback object to handle the process updates.
      * @return Status (Status::Ok on success).
      */
     Status ExtractFaceprintsForAuthLoop(AuthFaceprintsExtractionCallback& callback);
 
+    /**
+     * Authenticate all the faces of a frame against a host gallery.
+     * Extracts the faceprints using authentication flow, collecting those of all the faces the device reports
+     * (up to 5 with DeviceConfig::FaceSelectionPolicy::All, one otherwise), then matches them against the gallery
+     * in a single batch (in parallel if the gallery was created with search threads, or across the nodes of a
+     * RemoteGallery).
+     * The callback's OnResult() is called once, with the result of each face together with its rectangle.
+     *
+     * @param[in] gallery Users gallery (HostGallery or RemoteGallery). Adaptive updates of matched users are applied
+     * to it.
+     * @param[in] callback User defined callback object to handle the results.
+     * @return Status (Status::Ok on success).
+     */
+    Status AuthenticateWithGallery(GalleryBackend& gallery, GalleryAuthCallback& callback);
+
     /**
      * Match two faceprints to each other.
      * Calculates a score for how similar the two faceprints are, and returns a prediction for whether the
@@ -254,14 +471,157 @@ public:
      */
     Status GetUsersFaceprints(Faceprints* user_features, unsigned int&num_of_users);
 
+    /**
+     * Export the features descriptor of each user in the device's DB through the callback.
+     * Requests are pipelined, so the export does not wait for a full round trip per user,
+     * and no array for all users has to be allocated. Stops on the first error.
+     *
+     * @param[in] callback Called with the faceprints of each user, in DB order.
+     * @param[out] num_of_users Number of users exported from the device.
+     * @return Status (Status::Ok on success).
+     */
+    Status GetUsersFaceprints(FaceprintsExportCallback& callback, unsigned int& num_of_users);
+
+    /**
+     * Export the id and the faceprints of each user in the device's DB together, in a single pass over the DB: no
+     * QueryUserIds() is needed to know whose faceprints they are. Uses the large packets of the session when the
+     * device supports the combined message; otherwise the ids are queried first and the faceprints exported by index.
+     * Stops on the first error.
+     *
+     * @param[in] callback Called with the id and faceprints of each user, in DB order.
+     * @param[out] num_of_users Number of users exported from the device.
+     * @return Status (Status::Ok on success).
+     */
+    Status ExportUsers(UsersExportCallback& callback, unsigned int& num_of_users);
+
+    /**
+     * Export the next page of users, as ExportUsers() does, from the cursor on: at most page_size users, so a DB of any
+     * size (also past 65535 users) is synced incrementally, with host memory bounded by the page size. Advances the
+     * cursor past each user delivered, also when the page fails, so calling again resumes the export.
+     *
+     * @param[in/out] cursor Position of the export. Default constructed to start from the first user.
+     * @param[in] page_size Maximum number of users to export in this call (not zero).
+     * @param[in] callback Called with the DB index, id and faceprints of each user, in DB order.
+     * @return Status (Status::Ok on success, also when the cursor was already done).
+     */
+    Status ExportUsers(UsersCursor& cursor, unsigned int page_size, UsersExportCallback& callback);
+
+    /**
+     * Export the faceprints of the next page of users from the cursor on, as ExportUsers() with a cursor does.
+     *
+     * @param[in/out] cursor Position of the export. Default constructed to start from the first user.
+     * @param[in] page_size Maximum number of users to export in this call (not zero).
+     * @param[in] callback Called with the DB index and faceprints of each user, in DB order.
+     * @return Status (Status::Ok on success, also when the cursor was already done).
+     */
+    Status GetUsersFaceprints(UsersCursor& cursor, unsigned int page_size, FaceprintsExportCallback& callback);
+
+    /**
+     * Current revision of the device's DB, as tracked by this instance.
+     * The revision is incremented by every DB change made through this instance (enroll, authenticate - which may
+     * update the adaptive descriptors, remove, SetUsersFaceprints). Changes made otherwise are not tracked.
+     *
+     * @return The current revision.
+     */
+    unsigned int GetUsersRevision() const;
+
+    /**
+     * Get only the users changed since the given revision, instead of exporting all users.
+     * Take the revision with GetUsersRevision() right after a full export, then call this with the last returned
+     * revision. Fails if the changes since the revision are unknown (e.g. revision from before the last Connect()),
+     * in which case do a full export again.
+     *
+     * @param[in] since_revision Revision of the host's copy of the DB.
+     * @param[in] callback Called with the changes since the revision.
+     * @param[out] revision Revision of the DB after the changes.
+     * @return Status (Status::Ok on success).
+     */
+    Status GetChangedUsersFaceprints(unsigned int since_revision, UsersChangesCallback& callback,
+                                     unsigned int& revision);
+
+    /**
+     * Get the users that differ between the device's DB and a host gallery, e.g. for a periodic consistency check,
+     * without exporting all users. The checksum trees of the device's DB and of the gallery (see
+     * HostGallery::GetChecksums()) are compared from the root down, fetching only the digests of the nodes that
+     * differ, then the faceprints of the users that differ. Matching copies take a single request.
+     * Apply the calls to bring the gallery up to date with the device: OnUserRemoved() for a user that is only in
+     * the gallery, OnUserChanged() for a user that is not in the gallery or has other faceprints in it.
+     * OnAllUsersRemoved() is not called. A device without the checksums query is compared by exporting all users.
+     *
+     * @param[in] gallery Host copy of the device's DB.
+     * @param[in] callback Called with the differences.
+     * @return Status (Status::Ok on success).
+     */
+    Status GetDifferingUsersFaceprints(const HostGallery& gallery, UsersChangesCallback& callback);
+
     /**
      * Insert each user entry from the array into the device's database.
+     * Requests are pipelined: several users are sent before their acks are collected.
+     * A large DB is imported with bounded host memory by calling this with a page of users at a time, between
+     * BeginBulkUpdate() and CommitBulkUpdate().
      * @param[in] Array of user IDs and feature descriptors.
      * @param[in] Number of users in the array.
      * @return Status (Status::Ok on success).
      */
     Status SetUsersFaceprints (UserFaceprints * user_features, unsigned int num_of_users);
 
+    /**
+     * Begin a bulk update of the device's DB, e.g. provisioning many users in batches to report progress.
+     * Until CommitBulkUpdate(), SetUsersFaceprints() does not persist the DB to flash (the Standby() it otherwise
+     * ends with), and the session stays open between the calls. The users are in the device's DB right away, but
+     * those set since BeginBulkUpdate() may be lost if the device resets before the commit.
+     *
+     * @return Status (Status::Ok on success, Status::Error if a bulk update is already open).
+     */
+    Status BeginBulkUpdate();
+
+    /**
+     * End the bulk update: persist the device's DB with a single Standby() if any users were set since
+     * BeginBulkUpdate(), then close the session (unless in persistent session mode).
+     *
+     * @return Status (Status::Ok on success, Status::Error if no bulk update is open or the Standby() failed).
+     */
+    Status CommitBulkUpdate();
+
+    /**
+     * Async versions of the operations above.
+     * Operations are queued and run one after the other on this instance's worker thread, so the caller is not
+     * blocked and can queue several operations (e.g. QueryNumberOfUsersAsync() followed by AuthenticateAsync()).
+     * The returned future becomes ready with the operation's status.
+     *
+     * Callbacks and output arguments must stay valid until the future is ready. User ids are copied.
+     * Cancel() may be called from any thread to stop the running operation.
+     * Blocking operations called while async ones are pending take turns with them on the device (see thread
+     * safety above).
+     * Operations still queued when the instance is destroyed are abandoned (their futures throw
+     * std::future_error).
+     *
+     * Queued operations run by priority, and in queuing order within a priority:
+     *   1. Enroll, Authenticate, AuthenticateLoop, ExtractFaceprintsForAuth (someone is at the camera)
+     *   2. RemoveUser, RemoveAll, Standby, GetUsersFaceprints, SetUsersFaceprints (administration)
+     *   3. QueryNumberOfUsers, QueryUserIds (monitoring)
+     * Cancel() is not queued. GetUsersFaceprintsAsync() and SetUsersFaceprintsAsync() run in steps of a few users and
+     * go back to the queue between the steps, so a higher priority operation waits for one step only, and long
+     * operations of the same priority take turns. Operations that change the DB may run between the steps of an
+     * export (the DB indices of the users reported after them may be off). The export's first step reads the number
+     * of users. An AuthenticateLoopAsync() keeps the line until canceled.
+     *
+     * QueryNumberOfUsersAsync() and QueryUserIdsAsync() calls made while one of the same kind is still queued share
+     * its device exchange (a call made once the exchange has started queues the next one). QueryUserIdsAsync() reads
+     * all the ids and hands each caller up to its number_of_users_in_out of them.
+     */
+    std::future<Status> EnrollAsync(EnrollmentCallback& callback, const char* user_id);
+    std::future<Status> AuthenticateAsync(AuthenticationCallback& callback);
+    std::future<Status> AuthenticateLoopAsync(AuthenticationCallback& callback);
+    std::future<Status> RemoveUserAsync(const char* user_id);
+    std::future<Status> RemoveAllAsync();
+    std::future<Status> QueryNumberOfUsersAsync(unsigned int& number_of_users);
+    std::future<Status> QueryUserIdsAsync(UserIdsCallback& callback, unsigned int& number_of_users_in_out);
+    std::future<Status> StandbyAsync();
+    std::future<Status> ExtractFaceprintsForAuthAsync(AuthFaceprintsExtractionCallback& callback);
+    std::future<Status> GetUsersFaceprintsAsync(FaceprintsExportCallback& callback, unsigned int& num_of_users);
+    std::future<Status> SetUsersFaceprintsAsync(UserFaceprints* user_features, unsigned int num_of_users);
+
 private:
     FaceAuthenticatorImpl* _impl = nullptr;
 };
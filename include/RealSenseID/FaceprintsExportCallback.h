@@ -0,0 +1,27 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+namespace RealSenseID
+{
+class Faceprints;
+
+/**
+ * User defined callback for faceprints export.
+ * Called with the faceprints of each user as they arrive from the device.
+ */
+class FaceprintsExportCallback
+{
+public:
+    virtual ~FaceprintsExportCallback() = default;
+
+    /**
+     * Called once for each exported user, in the device's DB order.
+     *
+     * @param[in] user_index Index of the user in the device's DB.
+     * @param[in] faceprints The user's faceprints. Valid only during the call.
+     */
+    virtual void OnFaceprints(const unsigned int user_index, const Faceprints& faceprints) = 0;
+};
+} // namespace RealSenseID
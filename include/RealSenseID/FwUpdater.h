@@ -27,6 +27,29 @@ public:
     {
         const char* port = nullptr; // serial port to perform the update on
         bool force_full = false;    // if true update all modules and blocks regardless of crc checks
+        // if true send each block while the device still writes the previous one. requires device support
+        bool pipeline_blocks = false;
+        // if true offer the device compressed blocks (lz4). if it accepts, each changed block is compressed on the
+        // host ahead of the transfer and sent compressed, for less time on slow links. requires device support,
+        // devices without it are updated uncompressed.
+        bool compress_blocks = false;
+        // if true each module's block size is chosen by the link: the largest on a clean link, smaller ones after
+        // failed blocks, so a retry costs less. requires device support, devices without it use the default size.
+        // not used with journal_path.
+        bool adaptive_block_size = false;
+        // if true and the device already runs the firmware file's modules (same versions, all active), the update is
+        // skipped after a single version query: no per module exchange, activation or reboot. ignored with
+        // force_full.
+        bool skip_up_to_date = false;
+        // if true the blocks are sent at a faster baud rate (460800), if the device and the host port take it.
+        // requires device support, devices without it are updated at 115200.
+        bool fast_baud_rate = false;
+        // if set, the blocks confirmed by the device are recorded in this file, and an interrupted update of the
+        // same firmware file to the same device continues from the first unconfirmed block
+        const char* journal_path = nullptr;
+        // the device's key in the journal (e.g. from DeviceController::QuerySerialNumber). if not set the port is
+        // used. UpdateFleet always uses the port.
+        const char* serial_number = nullptr;
 #ifdef ANDROID
         AndroidSerialConfig android_config;
 #endif
@@ -48,6 +71,31 @@ public:
         virtual void OnProgress(float progress) = 0;
     };
 
+    /**
+     * User defined callback for fleet firmware update events (see UpdateFleet).
+     * Called from the update threads, possibly for several devices at the same time.
+     */
+    struct FleetEventHandler
+    {
+        virtual ~FleetEventHandler() = default;
+
+        /**
+         * Called to inform the client of a device's firmware update progress.
+         *
+         * @param[in] port Serial port of the device.
+         * @param[in] progress Current firmware update progress of the device, range: 0.0f - 1.0f.
+         */
+        virtual void OnProgress(const char* port, float progress) = 0;
+
+        /**
+         * Called once the update of a device is done.
+         *
+         * @param[in] port Serial port of the device.
+         * @param[in] status Status::Ok if the device was updated successfully.
+         */
+        virtual void OnDeviceDone(const char* port, Status status) = 0;
+    };
+
     FwUpdater() = default;
     ~FwUpdater() = default;
 
@@ -60,6 +108,18 @@ public:
      */
     bool ExtractFwVersion(const char* binPath, std::string& outFwVersion, std::string& outRecognitionVersion) const;
 
+    /**
+     * Checks whether a device runs the firmware package, by the device's firmware version string. For deciding which
+     * devices to update without opening an update connection to them.
+     *
+     * @param[in] binPath Path to the firmware binary file.
+     * @param[in] deviceFirmwareVersion Version string of the device, as returned by
+     *            DeviceController::QueryFirmwareVersion ("OPFW:x.y.z|RECOG:x.y.z|...").
+     * @param[in] excludeRecognition Ignore the recognition module, as an update excluding it would.
+     * @return True if the device reports each module of the package with the package's version.
+     */
+    bool IsUpToDate(const char* binPath, const char* deviceFirmwareVersion, bool excludeRecognition) const;
+
     /**
      * Performs a firmware update.
      *
@@ -70,5 +130,23 @@ public:
      * @return True if extraction succeeded and false otherwise.
      */
     Status Update(EventHandler* handler, Settings settings, const char* binPath, bool excludeRecognition) const;
+
+#ifndef ANDROID
+    /**
+     * Performs a firmware update of several devices concurrently.
+     * The firmware file is parsed and loaded once, and shared by all updates.
+     *
+     * @param[in] handler Responsible for handling events triggered during the updates.
+     * @param[in] settings Firmware update settings, for all devices. The port is ignored.
+     * @param[in] binPath Path to the firmware binary file.
+     * @param[in] excludeRecognition Skip recognition module update in case of database incompatibility.
+     * @param[in] ports Serial ports of the devices to update.
+     * @param[in] numberOfPorts Number of ports.
+     * @param[in] maxParallel Maximum number of devices updated at the same time.
+     * @return Status::Ok if all devices were updated successfully.
+     */
+    Status UpdateFleet(FleetEventHandler* handler, Settings settings, const char* binPath, bool excludeRecognition,
+                       const char* const* ports, unsigned int numberOfPorts, unsigned int maxParallel) const;
+#endif
 };
 } // namespace RealSenseID
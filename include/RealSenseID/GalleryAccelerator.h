@@ -0,0 +1,61 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace RealSenseID
+{
+/**
+ * User defined accelerator (e.g. a GPU compute kernel) scanning the users of a HostGallery, plugged in with
+ * HostGallery::SetAccelerator().
+ * The accelerator keeps its own copy of the gallery's search vectors, resident in its memory: a row of VectorLength
+ * 16 bit features per user, in gallery order. The gallery brings it up to date with its changes before each match.
+ * For a match, the accelerator shortlists the rows that score best against each probe of the batch. Only the
+ * shortlisted users are then scored on the CPU, with the fixed-point score of the CPU search, and the matching
+ * decision, thresholds and adaptive updates stay on the CPU. The result is the one of the CPU search whenever its
+ * matched user is in the shortlist.
+ * Called from the matching threads, one call at a time.
+ */
+class GalleryAccelerator
+{
+public:
+    static constexpr size_t VectorLength = 256;
+
+    virtual ~GalleryAccelerator() = default;
+
+    /**
+     * Resize the copy to number_of_rows rows. New rows are written by SetRows() before the next Search().
+     *
+     * @param[in] number_of_rows Number of users in the gallery.
+     * @return true on success. On failure the gallery is scanned on the CPU, and all its rows are sent again before
+     * the next Search().
+     */
+    virtual bool Resize(size_t number_of_rows) = 0;
+
+    /**
+     * Write rows of the copy.
+     *
+     * @param[in] first_row Index of the first row.
+     * @param[in] number_of_rows Number of rows.
+     * @param[in] vectors number_of_rows * VectorLength features, row by row.
+     * @return true on success, as above.
+     */
+    virtual bool SetRows(size_t first_row, size_t number_of_rows, const int16_t* vectors) = 0;
+
+    /**
+     * Shortlist the rows with the highest normalized correlation (the dot product over the product of the two
+     * vector lengths) with each probe.
+     *
+     * @param[in] probes number_of_probes * VectorLength features, probe by probe.
+     * @param[in] number_of_probes Number of probes.
+     * @param[in] shortlist_size Rows to shortlist per probe (at most the number of rows).
+     * @param[out] shortlist number_of_probes * shortlist_size row indices: the shortlist of each probe, in any order.
+     * @return true on success. On failure the probes are matched on the CPU.
+     */
+    virtual bool Search(const int16_t* probes, size_t number_of_probes, size_t shortlist_size,
+                        uint32_t* shortlist) = 0;
+};
+} // namespace RealSenseID
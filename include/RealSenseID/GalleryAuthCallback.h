@@ -0,0 +1,77 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/AuthenticateStatus.h"
+#include "RealSenseID/FaceRect.h"
+#include "RealSenseID/GalleryBackend.h"
+#include "RealSenseID/OperationTiming.h"
+#include <cstddef>
+
+namespace RealSenseID
+{
+class Faceprints;
+
+/**
+ * Host mode authentication result of a single face.
+ */
+struct GalleryFaceResult
+{
+    FaceRect face;                                           // the face's rectangle (zeros if the device sent none)
+    AuthenticateStatus status = AuthenticateStatus::Failure; // faceprints extraction status on the device
+    HostGalleryMatch match;                                  // gallery match (valid only if status is Success)
+    const Faceprints* updated_faceprints = nullptr;          // matched user's updated faceprints if
+                                                             // match.result.should_update, to be saved by the host
+};
+
+/**
+ * User defined callback for host mode authentication of all the faces in a frame.
+ */
+class GalleryAuthCallback
+{
+public:
+    virtual ~GalleryAuthCallback() = default;
+
+    /**
+     * Called once, with the results of all the faces of the frame.
+     *
+     * @param[in] results Array of n_results results, in the order of the detected faces (the first is the selected
+     * one). Valid only during the call.
+     * @param[in] n_results Number of results (0 if no face was detected).
+     * @param[in] ts Timestamp of the frame.
+     */
+    virtual void OnResult(const GalleryFaceResult* results, const size_t n_results, const unsigned int ts) = 0;
+
+    /**
+     * Called when the device detects the faces, before their faceprints arrive (the device computes them meanwhile,
+     * for hundreds of millis). The gallery is prefetched in the background at this point; the application may warm
+     * its own data for the frame's faces too. Should return quickly, the faceprints are received after the call.
+     *
+     * @param[in] faces Array of n_faces detected faces. First item is the selected one.
+     */
+    virtual void OnFaceDetected(const FaceRect* faces, const size_t n_faces, const unsigned int ts)
+    {
+    }
+
+    /**
+     * Called to inform the client of problems encountered during the authentication operation.
+     *
+     * @param[in] hint Hint for the problem encountered.
+     */
+    virtual void OnHint(const AuthenticateStatus hint)
+    {
+    }
+
+    /**
+     * Called once when the operation ends with the device's reply, after the results, with the timing breakdown of
+     * the operation (host_match_us is the time of the gallery match). Not called when the session or the serial line
+     * fail.
+     *
+     * @param[in] timing Timing of the operation's stages.
+     */
+    virtual void OnTiming(const OperationTiming& timing)
+    {
+    }
+};
+} // namespace RealSenseID
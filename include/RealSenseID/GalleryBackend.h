@@ -0,0 +1,54 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/RealSenseIDExports.h"
+#include "RealSenseID/Faceprints.h"
+#include "RealSenseID/MatchResultHost.h"
+#include "RealSenseID/Status.h"
+#include <cstddef>
+
+namespace RealSenseID
+{
+/**
+ * Result of a gallery match.
+ */
+struct HostGalleryMatch
+{
+    MatchResultHost result;
+    char user_id[31] = {0}; // matched user id with null char (valid only if result.success)
+};
+
+/**
+ * Users gallery searched by FaceAuthenticator::AuthenticateWithGallery() in host mode.
+ * Implemented by HostGallery (native memory) and RemoteGallery (shards served by GalleryNode instances).
+ */
+class RSID_API GalleryBackend
+{
+public:
+    virtual ~GalleryBackend() = default;
+
+    /**
+     * Warm the gallery ahead of a match. Called from a background thread when the faces are detected, while the
+     * device computes their faceprints. Does nothing by default.
+     */
+    virtual void Prefetch() const
+    {
+    }
+
+    /**
+     * Match several faceprints against the gallery.
+     * If results[i].result.should_update is set, the matched user was updated in the gallery and its updated
+     * faceprints are written to updated_faceprints[i].
+     *
+     * @param[in] new_faceprints Array of number_of_probes probe faceprints.
+     * @param[in] number_of_probes Number of probes.
+     * @param[out] results Array of number_of_probes results.
+     * @param[out] updated_faceprints Array of number_of_probes updated faceprints.
+     * @return Status (Status::Ok on success, Status::Error on invalid arguments or if any of the probes failed).
+     */
+    virtual Status MatchBatch(const Faceprints* new_faceprints, size_t number_of_probes, HostGalleryMatch* results,
+                              Faceprints* updated_faceprints) = 0;
+};
+} // namespace RealSenseID
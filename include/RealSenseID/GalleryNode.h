@@ -0,0 +1,65 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/RealSenseIDExports.h"
+#include "RealSenseID/Status.h"
+#include <cstddef>
+
+namespace RealSenseID
+{
+class GalleryNodeImpl;
+
+/**
+ * One shard of a distributed users gallery, searched by RemoteGallery clients on other hosts.
+ * The node keeps the users the clients route to it (by user id hash) in native memory and serves the requests the
+ * clients send through their GalleryTransport: add / remove users, top-K search of probes and adaptive updates.
+ * Thread safe.
+ */
+class RSID_API GalleryNode
+{
+public:
+    GalleryNode();
+    ~GalleryNode();
+
+    GalleryNode(const GalleryNode&) = delete;
+    GalleryNode& operator=(const GalleryNode&) = delete;
+
+    /**
+     * Handle a request received from a RemoteGallery and write its reply, to be returned to the client.
+     *
+     * @param[in] request Request bytes.
+     * @param[in] request_size Request size.
+     * @param[out] reply Buffer of GalleryTransport::MaxMessageSize bytes for the reply.
+     * @param[out] reply_size Reply size.
+     * @return Status (Status::Ok if a reply was written, Status::Error on a malformed request - no reply).
+     */
+    Status HandleRequest(const unsigned char* request, size_t request_size, unsigned char* reply,
+                         size_t& reply_size);
+
+    /**
+     * @return Number of users in the node.
+     */
+    size_t Size() const;
+
+    /**
+     * Save the node's users to a gallery file.
+     *
+     * @param[in] path File path.
+     * @return Status (Status::Ok on success, Status::Error on failure).
+     */
+    Status Save(const char* path) const;
+
+    /**
+     * Replace the node's users with a gallery file written by Save() (memory mapped, see HostGallery::Load()).
+     *
+     * @param[in] path File path.
+     * @return Status (Status::Ok on success, Status::Error on failure).
+     */
+    Status Load(const char* path);
+
+private:
+    GalleryNodeImpl* _impl = nullptr;
+};
+} // namespace RealSenseID
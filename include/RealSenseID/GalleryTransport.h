@@ -0,0 +1,37 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/Status.h"
+#include <cstddef>
+
+namespace RealSenseID
+{
+/**
+ * User defined link from a RemoteGallery to one of its GalleryNode instances (e.g. a tcp connection, or any rpc
+ * the application uses between its hosts).
+ * The request is delivered to GalleryNode::HandleRequest() on the node's host, and its reply returned.
+ * Messages are opaque binary buffers of up to MaxMessageSize bytes; they carry their own size and checksum.
+ */
+class GalleryTransport
+{
+public:
+    static constexpr size_t MaxMessageSize = 4096;
+
+    virtual ~GalleryTransport() = default;
+
+    /**
+     * Send a request to the node and wait for its reply.
+     * Called concurrently for the different nodes of a RemoteGallery (never for the same node).
+     *
+     * @param[in] request Request bytes.
+     * @param[in] request_size Request size.
+     * @param[out] reply Buffer of MaxMessageSize bytes for the reply.
+     * @param[out] reply_size Reply size.
+     * @return Status (Status::Ok if the reply was received).
+     */
+    virtual Status Call(const unsigned char* request, size_t request_size, unsigned char* reply,
+                        size_t& reply_size) = 0;
+};
+} // namespace RealSenseID
@@ -0,0 +1,319 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/RealSenseIDExports.h"
+#include "RealSenseID/GalleryBackend.h"
+#include "RealSenseID/GalleryAccelerator.h"
+#include "RealSenseID/Faceprints.h"
+#include "RealSenseID/Status.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace RealSenseID
+{
+class HostGalleryImpl;
+
+/**
+ * Pair of users found by HostGallery::FindDuplicates().
+ */
+struct HostGalleryDuplicate
+{
+    char user_id[31] = {0};       // user id with null char
+    char other_user_id[31] = {0}; // the other user of the pair, with null char
+    match_calc_t score = 0;       // score of user_id's faceprints matched against other_user_id's
+};
+
+/**
+ * Checksum of a user in the gallery, see HostGallery::GetBucketChecksums().
+ */
+struct HostGalleryUserChecksum
+{
+    char user_id[31] = {0}; // user id with null char
+    uint64_t checksum = 0;  // checksum of the user id and faceprints
+};
+
+/**
+ * Memory placement of the gallery search data, for large galleries on multi-socket servers.
+ * Applied by Load(). Adding or removing users moves the search data back to ordinary memory until the next Load()
+ * (adaptive updates keep it in place). A gallery file loaded with placement is copied to memory.
+ */
+struct HostGalleryPlacement
+{
+    // pin the search threads over all the cpus, and place each shard of the gallery in the memory of the NUMA node
+    // of the thread that searches it (the thread first touches it). Each shard is then always searched by the same
+    // thread, and the calling thread only waits for the search threads.
+    bool numa_shards = false;
+
+    // back the descriptor matrix with 2 MB pages, for fewer TLB misses in the scans (transparent huge pages on
+    // linux, large pages on windows when the process has the lock pages in memory privilege)
+    bool huge_pages = false;
+};
+
+/**
+ * Users database for host mode matching, kept in native memory.
+ * Matches a probe against all the users in a single call (instead of matching it to each user separately).
+ * Adaptive updates of a matched user are applied to the gallery and also returned to the caller, to be saved in its
+ * own database.
+ * Thread safe.
+ */
+class RSID_API HostGallery : public GalleryBackend
+{
+public:
+    HostGallery();
+
+    /**
+     * @param[in] search_threads Threads searching large galleries (including the calling thread). Each match is
+     * split to shards of the gallery searched in parallel, with the same results as the sequential search.
+     */
+    explicit HostGallery(unsigned int search_threads);
+
+    /**
+     * Gallery with a hot tier, for skewed access where a few users make most of the matches.
+     * Users matched often are copied to a small hot tier, which is searched first. The whole gallery is searched
+     * only if no hot user matches, so a match of a frequent user costs a search of hot_users entries.
+     * A hot match is always a match of the whole gallery search too. Only if several users match the probe, the
+     * hot one is returned rather than the first one in the gallery.
+     *
+     * @param[in] search_threads Threads searching large galleries, as above.
+     * @param[in] hot_users Max number of users in the hot tier (0 - no hot tier).
+     */
+    HostGallery(unsigned int search_threads, size_t hot_users);
+
+    /**
+     * Gallery with placed search data, as above.
+     *
+     * @param[in] search_threads Threads searching large galleries, as above.
+     * @param[in] hot_users Max number of users in the hot tier (0 - no hot tier).
+     * @param[in] placement Memory placement of the search data.
+     */
+    HostGallery(unsigned int search_threads, size_t hot_users, const HostGalleryPlacement& placement);
+    ~HostGallery() override;
+
+    HostGallery(const HostGallery&) = delete;
+    HostGallery& operator=(const HostGallery&) = delete;
+
+    /**
+     * Add user to the gallery, or replace its faceprints if the user is already in it.
+     *
+     * @param[in] user_id Null terminated user id (up to 30 chars).
+     * @param[in] faceprints User's faceprints.
+     * @return Status (Status::Ok on success, Status::Error on invalid user id or invalid faceprints).
+     */
+    Status Add(const char* user_id, const Faceprints& faceprints);
+
+    /**
+     * Remove user from the gallery.
+     * Takes constant time: the user is found through a hash index of the user ids, and the last user in the gallery
+     * takes its place (so the gallery order changes).
+     *
+     * @param[in] user_id Null terminated user id.
+     * @return Status (Status::Ok on success, Status::Error if the user is not in the gallery).
+     */
+    Status Remove(const char* user_id);
+
+    /**
+     * Remove all users from the gallery.
+     */
+    void Clear();
+
+    /**
+     * @return Number of users in the gallery.
+     */
+    size_t Size() const;
+
+    /**
+     * Save the gallery to a gallery file.
+     *
+     * @param[in] path File path. Written to path + ".tmp" first and renamed over path when complete.
+     * @return Status (Status::Ok on success, Status::Error on failure).
+     */
+    Status Save(const char* path) const;
+
+    /**
+     * Replace the gallery contents with a gallery file written by Save().
+     * The file is memory mapped and searched in place, so users that are rarely matched stay on disk until needed.
+     * The first change to the gallery (add / remove / adaptive update) copies it to memory.
+     *
+     * @param[in] path File path.
+     * @return Status (Status::Ok on success, Status::Error if the file is missing, corrupted or from an incompatible
+     * build).
+     */
+    Status Load(const char* path);
+
+    /**
+     * Replace the gallery contents with the given users, e.g. a whole user database at startup.
+     * The entries are validated and the search data computed in parallel, so this is much faster than adding the
+     * users one by one. Invalid entries are skipped, and a user id given more than once is at the position of its first
+     * valid entry, with its last valid faceprints.
+     *
+     * @param[in] user_ids Null terminated user ids.
+     * @param[in] faceprints Faceprints of each user.
+     * @param[in] number_of_users Number of entries in user_ids and faceprints.
+     * @param[out] number_loaded Number of users in the gallery after the load.
+     * @return Status (Status::Ok on success, Status::Error on invalid arguments).
+     */
+    Status Load(const char* const* user_ids, const Faceprints* faceprints, size_t number_of_users,
+                size_t& number_loaded);
+
+    /**
+     * Warm the gallery ahead of a match, e.g. from AuthFaceprintsExtractionCallback::OnFaceDetected(), while the
+     * device is still computing the faceprints: the gallery's search data is loaded once, so a gallery that fits in
+     * the caches is matched hot. Takes about the memory traffic of a match. The gallery is warmed a chunk of users at
+     * a time, so a concurrent match is not held up for the whole pass.
+     */
+    void Prefetch() const override;
+
+    /**
+     * Warm only the users of the given access groups (see SetUserGroups()), e.g. the site or door about to be matched
+     * with Match(new_faceprints, access_groups).
+     *
+     * @param[in] access_groups Bitmask of the groups to warm.
+     */
+    void Prefetch(uint64_t access_groups) const;
+
+    /**
+     * Score the users matched last before searching the gallery, for repeated authentications of the same person
+     * (e.g. the consecutive probes of an authentication loop). If one of them matches, the gallery is not searched.
+     * As with the hot tier, such a match is always a match of the whole gallery search too. Only if several users
+     * match the probe, the recent one is returned rather than the first one in the gallery.
+     *
+     * @param[in] recent_users Number of recently matched users to score first (0 - off, the default).
+     */
+    void SetRecentUsersFirst(size_t recent_users);
+
+    /**
+     * Scan the gallery with an accelerator (e.g. a GPU kernel), see GalleryAccelerator. Each probe is then scored
+     * exactly against the shortlist_size users the accelerator shortlists instead of the whole gallery, and the
+     * recent users are not scored first. The hot tier is still searched first on the CPU. If the accelerator fails,
+     * the gallery is searched on the CPU.
+     *
+     * @param[in] accelerator Accelerator, not owned: it must outlive the gallery or be replaced (nullptr - off, the
+     * default).
+     * @param[in] shortlist_size Users shortlisted per probe, e.g. 64.
+     */
+    void SetAccelerator(GalleryAccelerator* accelerator, size_t shortlist_size);
+
+    /**
+     * Set the access groups of a user, for Match() of the users of some groups only (e.g. the groups a door admits),
+     * so one gallery serves every door. Users have no groups until set. The groups are kept in memory only: Clear()
+     * and Load() reset them, and Save() does not write them.
+     *
+     * @param[in] user_id Null terminated user id.
+     * @param[in] access_groups Bit g set if the user is in group g (64 groups).
+     * @return Status (Status::Ok on success, Status::Error if the user is not in the gallery).
+     */
+    Status SetUserGroups(const char* user_id, uint64_t access_groups);
+
+    /**
+     * Match faceprints against all the users in the gallery.
+     * If result.should_update is set, the matched user was updated in the gallery and its updated faceprints are
+     * written to updated_faceprints.
+     *
+     * @param[in] new_faceprints Probe faceprints.
+     * @param[out] updated_faceprints Updated faceprints of the matched user (only if result.should_update).
+     * @return Match result.
+     */
+    HostGalleryMatch Match(const Faceprints& new_faceprints, Faceprints& updated_faceprints);
+
+    /**
+     * Match faceprints against all the users in the gallery, as above, without the copy of the updated faceprints.
+     * The adaptive update is applied to the gallery in place; result.should_update notifies it, for a caller that
+     * keeps the gallery as its store (e.g. saves it with Save()) rather than a copy of the users' faceprints.
+     *
+     * @param[in] new_faceprints Probe faceprints.
+     * @return Match result.
+     */
+    HostGalleryMatch Match(const Faceprints& new_faceprints);
+
+    /**
+     * Match faceprints against the users of the given access groups only (see SetUserGroups()), as above. The search
+     * skips the other users in blocks of 64, so it costs about the share of the gallery in the groups. A user of the
+     * groups is matched as it would be in a gallery of only the users of the groups.
+     *
+     * @param[in] new_faceprints Probe faceprints.
+     * @param[in] access_groups Groups whose users may match (bit g for group g).
+     * @param[out] updated_faceprints Updated faceprints of the matched user (only if result.should_update).
+     * @return Match result.
+     */
+    HostGalleryMatch Match(const Faceprints& new_faceprints, uint64_t access_groups, Faceprints& updated_faceprints);
+
+    /**
+     * Match faceprints against the users of the given access groups only, without the copy of the updated faceprints.
+     *
+     * @param[in] new_faceprints Probe faceprints.
+     * @param[in] access_groups Groups whose users may match (bit g for group g).
+     * @return Match result.
+     */
+    HostGalleryMatch Match(const Faceprints& new_faceprints, uint64_t access_groups);
+
+    /**
+     * Find the user that faceprints match, as Match() does, but without the adaptive update of the user (and without
+     * counting it as a recent match, see SetRecentUsersFirst()). E.g. to check that a new enrollee is not enrolled
+     * already under another user id (see FaceAuthenticator::ExtractFaceprintsForEnroll()).
+     *
+     * @param[in] faceprints Faceprints to look for.
+     * @return Match result (result.should_update is never set).
+     */
+    HostGalleryMatch FindUser(const Faceprints& faceprints);
+
+    /**
+     * Match several faceprints against the gallery in a single pass over it.
+     * results[i] and updated_faceprints[i] are what Match(new_faceprints[i], updated_faceprints[i]) returns.
+     *
+     * @param[in] new_faceprints Array of number_of_probes probe faceprints.
+     * @param[in] number_of_probes Number of probes.
+     * @param[out] results Array of number_of_probes results.
+     * @param[out] updated_faceprints Array of number_of_probes updated faceprints.
+     * @return Status (Status::Ok on success, Status::Error on invalid arguments or if any of the probes failed).
+     */
+    Status MatchBatch(const Faceprints* new_faceprints, size_t number_of_probes, HostGalleryMatch* results,
+                      Faceprints* updated_faceprints) override;
+
+    /**
+     * Find the pairs of users that match each other, e.g. a person enrolled twice under different user ids, before
+     * importing a batch of enrollments. Every pair of users is scored, in a cache blocked pass over the gallery on the
+     * search threads, so the time grows with the square of the gallery size. Matches wait until it is done.
+     *
+     * @param[out] duplicates Array of max_duplicates pairs, filled with the highest scoring pairs first.
+     * @param[in] max_duplicates Size of the duplicates array.
+     * @param[out] number_of_duplicates Number of pairs found (can be more than max_duplicates).
+     * @return Status (Status::Ok on success, Status::Error on invalid arguments).
+     */
+    Status FindDuplicates(HostGalleryDuplicate* duplicates, size_t max_duplicates,
+                          size_t& number_of_duplicates) const;
+
+    /**
+     * Digests of the nodes of the gallery's users checksum tree, the host side of
+     * FaceAuthenticator::GetDifferingUsersFaceprints(). The users are spread over 256 buckets by their user ids:
+     * level 2 has the digests of the buckets, level 1 those of 16 groups of 16 buckets and level 0 the root digest.
+     * Two users databases with the same root digest have the same users and faceprints, and the buckets with the same
+     * digests the same users in them.
+     * The tree is built by the first call after a Load(), and then kept up to date with the changes to the gallery.
+     *
+     * @param[in] level Tree level (0 - 2).
+     * @param[in] first_node Index of the first node in the level.
+     * @param[in] number_of_nodes Number of nodes.
+     * @param[out] digests Array of number_of_nodes digests.
+     * @return Status (Status::Ok on success, Status::Error on invalid arguments).
+     */
+    Status GetChecksums(unsigned int level, unsigned int first_node, unsigned int number_of_nodes,
+                        uint64_t* digests) const;
+
+    /**
+     * The users of a bucket of the checksum tree (see GetChecksums()), with their checksums.
+     *
+     * @param[in] bucket Bucket index (0 - 255).
+     * @param[out] users Array of max_users users.
+     * @param[in] max_users Size of the users array.
+     * @param[out] number_of_users Number of users in the bucket (can be more than max_users).
+     * @return Status (Status::Ok on success, Status::Error on invalid arguments).
+     */
+    Status GetBucketChecksums(unsigned int bucket, HostGalleryUserChecksum* users, size_t max_users,
+                              size_t& number_of_users) const;
+
+private:
+    HostGalleryImpl* _impl = nullptr;
+};
+} // namespace RealSenseID
@@ -0,0 +1,27 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseIDExports.h"
+
+namespace RealSenseID
+{
+/**
+ * Connection keep-alive of a FaceAuthenticator (FaceAuthenticator::SetKeepAlivePolicy()).
+ * The device is pinged once the connection has been idle for idle_ms. When a ping fails the serial port is reopened,
+ * and reopening is retried with a wait that doubles from min_backoff_ms up to max_backoff_ms.
+ */
+struct RSID_API KeepAlivePolicy
+{
+    // ping after this long without operations (0 - keep-alive off)
+    unsigned int idle_ms = 0;
+
+    // a ping not answered within this time fails
+    unsigned int ping_timeout_ms = 500;
+
+    // wait before the first retry to reconnect. each further retry doubles it, up to max_backoff_ms.
+    unsigned int min_backoff_ms = 100;
+    unsigned int max_backoff_ms = 5000;
+};
+} // namespace RealSenseID
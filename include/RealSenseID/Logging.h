@@ -4,6 +4,7 @@
 #pragma once
 
 #include "RealSenseIDExports.h"
+#include <cstddef>
 #include <functional>
 
 /**
@@ -30,6 +31,17 @@ enum class LogLevel
 
 using LogCallback = std::function<void(LogLevel level, const char* msg)>;
 
+/**
+ * How log messages reach the callback.
+ */
+enum class LogDelivery
+{
+    Sync,            // the callback is called by the thread that logs (default)
+    AsyncBlock,      // queued and delivered by a dedicated thread. logging blocks while the queue is full
+    AsyncDropOldest, // queued and delivered by a dedicated thread. the oldest queued messages are dropped while the
+                     // queue is full, so logging never waits for the callback
+};
+
 /**
  * Use the given callback to get log messages from the library (default off).
  * @param callback[in] function to be called for each log entry.
@@ -38,4 +50,97 @@ using LogCallback = std::function<void(LogLevel level, const char* msg)>;
  */
 RSID_API void SetLogCallback(LogCallback callback, LogLevel min_level, bool do_formatting);
 
+/**
+ * Same as above, with asynchronous delivery to keep the callback's cost off the library's serial and preview
+ * threads. The console and file outputs are delivered the same way.
+ * Switching back to LogDelivery::Sync waits for the queued messages and stops the delivery thread.
+ * @param callback[in] function to be called for each log entry.
+ * @param min_level[in] minimum log level which would trigger this callback.
+ * @param do_formatting[in] set to true to get full formatted message, false to get the bare message.
+ * @param delivery[in] how the messages reach the callback.
+ */
+RSID_API void SetLogCallback(LogCallback callback, LogLevel min_level, bool do_formatting, LogDelivery delivery);
+
+/**
+ * A log message as logged: the module that logged it and the message, with no timestamp, level or tag formatting.
+ * The strings are valid during the callback only.
+ */
+struct LogRecord
+{
+    LogLevel level;
+    const char* tag;      // null terminated module name, e.g. "PacketSender"
+    const char* message;  // null terminated
+    size_t message_size;  // bytes of message, without the null
+};
+
+using StructuredLogCallback = std::function<void(const LogRecord& record)>;
+
+/**
+ * Use the given callback to get the log messages from the library as records (default off). The callback is called
+ * by the thread that logs, straight from the log call: the message is not passed through the formatter, queued or
+ * copied, and costs only its printf. Independent of SetLogCallback(), both can be set.
+ * @param callback[in] function to be called for each log entry, nullptr to remove the callback.
+ * @param min_level[in] minimum log level which would trigger this callback.
+ */
+RSID_API void SetStructuredLogCallback(StructuredLogCallback callback, LogLevel min_level);
+
+/**
+ * Sample the log messages of a tag (e.g. "PacketSender", "StreamConverter"), to keep debug logging of the per packet
+ * and per frame modules affordable. Messages below LogLevel::Warning are logged one in every one_in of them, and at
+ * most max_per_second per second. Dropped messages are never formatted. Applies to all the log outputs and can be
+ * changed at any time.
+ * @param tag[in] tag to sample, replacing its previous sampling.
+ * @param one_in[in] log one message in every one_in (1 for all).
+ * @param max_per_second[in] max messages per second (0 for no limit). one_in 1 and 0 remove the tag's sampling.
+ */
+RSID_API void SetLogSampling(const char* tag, unsigned int one_in, unsigned int max_per_second);
+
+/**
+ * Remove the sampling of all tags.
+ */
+RSID_API void ClearLogSampling();
+
+/**
+ * Start recording the serial traffic to/from the devices in memory, as binary records (time, thread, direction,
+ * message id and bytes). Much cheaper than RSID_DEBUG_SERIAL, so it can be used where timing matters.
+ * Each thread records into its own ring, the oldest records are overwritten when it is full.
+ * Clears the records of a previous trace.
+ * @param bytes_per_thread[in] memory of each thread's ring (about 2KB per record).
+ */
+RSID_API void StartSerialTrace(unsigned int bytes_per_thread);
+
+/**
+ * Stop recording the serial traffic. The records are kept for DumpSerialTrace().
+ */
+RSID_API void StopSerialTrace();
+
+/**
+ * Write the recorded serial traffic to a file, to be decoded with the rsid-serial-trace tool.
+ * Can be called while recording.
+ * @param path[in] file to write.
+ * @return True on success.
+ */
+RSID_API bool DumpSerialTrace(const char* path);
+
+/**
+ * Start recording trace spans of the library's operations: api calls, session start, packets sent and received,
+ * encryption, preview decoding and matching. Requires a build with RSID_TRACE_SPANS (the default).
+ * Clears the spans of a previous trace.
+ * @param max_spans[in] number of spans kept, the oldest are dropped when more are recorded.
+ */
+RSID_API void StartSpanTrace(unsigned int max_spans);
+
+/**
+ * Stop recording trace spans. The spans are kept for DumpSpanTrace().
+ */
+RSID_API void StopSpanTrace();
+
+/**
+ * Write the recorded spans to a file in the Chrome trace event JSON format, to be opened with chrome://tracing or
+ * ui.perfetto.dev. Can be called while recording.
+ * @param path[in] file to write.
+ * @return True on success.
+ */
+RSID_API bool DumpSpanTrace(const char* path);
+
 } // namespace RealSenseID
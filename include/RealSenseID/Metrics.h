@@ -0,0 +1,79 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseIDExports.h"
+
+/**
+ *  RealSenseID keeps counters and latency histograms of its operations since the library was loaded (or since the
+ *  last ResetMetrics()), to be scraped periodically by monitoring, e.g. a Prometheus exporter.
+ *  All counters are monotonic, rates (packets/sec, candidates/sec) are left to the scraper.
+ */
+namespace RealSenseID
+{
+/**
+ * Operations with a latency histogram.
+ */
+enum class MetricsOperation
+{
+    Enroll,
+    Authenticate,
+    QueryUserIds,
+    QueryNumberOfUsers,
+    QueryDeviceConfig,
+    Count // number of operations, not an operation
+};
+
+/**
+ * Upper bounds (milliseconds, inclusive) of the latency histogram buckets. The last bucket has no bound.
+ */
+static constexpr unsigned int MetricsLatencyBoundsMs[] = {5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000};
+static constexpr unsigned int MetricsLatencyBuckets = sizeof(MetricsLatencyBoundsMs) / sizeof(unsigned int) + 1;
+
+struct RSID_API LatencyHistogram
+{
+    // calls in each bucket (not cumulative). the last bucket counts the calls above the last bound
+    unsigned long long buckets[MetricsLatencyBuckets] = {0};
+    unsigned long long count = 0;
+    unsigned long long sum_us = 0;
+};
+
+struct RSID_API Metrics
+{
+    // packets sent to / received from the device, indexed by the message id character (e.g. packets_sent['E'])
+    unsigned long long packets_sent[128] = {0};
+    unsigned long long packets_received[128] = {0};
+
+    unsigned long long crc_errors = 0;   // packets received with a bad crc
+    unsigned long long timeouts = 0;     // receives that timed out waiting for a packet
+    unsigned long long sync_retries = 0; // packet start bytes found without the following sync byte, scan restarted
+    // time on the line: sending packets, and receiving them once their sync bytes arrived
+    unsigned long long serial_transfer_time_us = 0;
+    // time waiting for the sync bytes of the device's packets (mostly the device's processing time)
+    unsigned long long serial_wait_time_us = 0;
+    unsigned long long session_starts = 0;
+    unsigned long long session_start_time_us = 0; // total time of the session starts (with the key exchange)
+
+    LatencyHistogram latency[static_cast<int>(MetricsOperation::Count)];
+
+    // host matching (FaceAuthenticator::MatchFaceprints and the matcher searches). candidates/sec is
+    // matcher_candidates / matcher_time_us * 1e6
+    unsigned long long matcher_searches = 0;
+    unsigned long long matcher_candidates = 0; // gallery entries scored
+    unsigned long long matcher_time_us = 0;
+
+    unsigned long long preview_frames_dropped = 0;
+};
+
+/**
+ * Copy the current metrics. Thread safe, the counters are read one by one while the library keeps updating them.
+ * @param metrics[out] the current metrics.
+ */
+RSID_API void GetMetrics(Metrics& metrics);
+
+/**
+ * Zero all the metrics.
+ */
+RSID_API void ResetMetrics();
+} // namespace RealSenseID
@@ -0,0 +1,24 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseIDExports.h"
+
+namespace RealSenseID
+{
+/**
+ * Timing breakdown of a single authentication operation, in microseconds on the host's steady clock.
+ * The device stages are measured from the end of the request send. Stages the operation did not go through are 0.
+ */
+struct RSID_API OperationTiming
+{
+    unsigned long long session_start_us = 0;       // session start (with the key exchange in secure mode)
+    unsigned long long request_send_us = 0;        // sending the request packet
+    unsigned long long until_face_detected_us = 0; // device processing until the first FaceDetected arrived
+    unsigned long long until_result_us = 0;        // device processing until the result arrived
+    unsigned long long faceprints_transfer_us = 0; // from the result until the faceprints arrived (host mode)
+    unsigned long long host_match_us = 0;          // matching the faceprints on the host (gallery authentication)
+    unsigned long long total_us = 0;               // the whole operation, from the session start
+};
+} // namespace RealSenseID
@@ -4,6 +4,7 @@
 #pragma once
 
 #include "RealSenseIDExports.h"
+#include "FaceRect.h"
 
 namespace RealSenseID
 {
@@ -16,7 +17,81 @@ enum class PreviewMode
 {
     MJPEG_1080P = 0, // default
     MJPEG_720P = 1,
-    RAW10_1080P = 2 // dump all frames
+    RAW10_1080P = 2, // dump all frames
+    YUY2_720P = 3    // uncompressed 4:2:2 frames, converted without jpeg decode. more USB bandwidth than MJPEG_720P
+};
+
+/**
+ * Preview output scale, applied while decoding MJPEG frames or converting YUY2 frames (RAW10 frames are not scaled)
+ */
+enum class PreviewScale
+{
+    Full = 1, // default
+    Half = 2,
+    Quarter = 4,
+    Eighth = 8
+};
+
+/**
+ * Preview output pixel format of MJPEG and YUY2 modes (RAW10 frames are delivered as is, or as METADATA)
+ */
+enum class PreviewFormat
+{
+    RGB = 0,      // default. RGB24 (RGBA32 on Android)
+    GRAY8 = 1,    // luma only, chroma is not decoded
+    I420 = 2,     // planar Y, U, V with 2x2 subsampled chroma. stride is the Y plane's, U and V follow at half of it
+    MJPEG = 3,    // frame as received from the camera (jpeg, or the pixels of YUY2 modes), not decoded. size is the
+                  // frame's byte count, stride 0
+    METADATA = 4  // metadata only, pixels are neither decoded nor copied. buffer is nullptr, size and stride 0
+};
+
+/**
+ * Memory of the driver's capture buffers (Linux only)
+ */
+enum class CaptureMemory
+{
+    MMAP = 0,   // default. buffers allocated by the driver and mapped to the process
+    USERPTR = 1 // page aligned buffers allocated by the library. falls back to MMAP if the driver does not support it
+};
+
+/**
+ * Decoder of MJPEG frames
+ */
+enum class PreviewDecoder
+{
+    Software = 0, // default. libjpeg-turbo
+    Hardware = 1  // the platform's jpeg decoder (V4L2 memory-to-memory device on Linux), full scale RGB / GRAY8 / I420
+                  // only. falls back to Software if there is none or it fails
+};
+
+/**
+ * Quality of the software (libjpeg) decode of MJPEG frames
+ */
+enum class PreviewQuality
+{
+    Full = 0, // default. accurate integer DCT, smooth chroma upsampling
+    Fast = 1  // fast integer DCT, no chroma upsampling smoothing: faster decode of lower quality, for on-screen preview
+};
+
+/**
+ * Frames kept for a preview subscriber whose callback is still busy with an earlier frame
+ */
+enum class PreviewDropPolicy
+{
+    DropOldest = 0, // default. the newest frames are kept, the subscriber sees the latest frame next
+    DropNewest = 1  // the queued frames are kept, new frames are dropped until there is room
+};
+
+/**
+ * Frames requested by a preview subscriber (see Preview::Subscribe)
+ */
+struct RSID_API PreviewSubscription
+{
+    PreviewFormat previewFormat = PreviewFormat::RGB;
+    PreviewScale previewScale = PreviewScale::Full;
+    unsigned int queueSize = 1; // frames waiting for the subscriber's callback, each holds an image buffer
+    PreviewDropPolicy dropPolicy = PreviewDropPolicy::DropOldest; // when the queue is full
+    PreviewQuality previewQuality = PreviewQuality::Full; // MJPEG modes only
 };
 
 /**
@@ -26,6 +101,14 @@ struct RSID_API PreviewConfig
 {
     int cameraNumber = -1; // attempt to auto detect by default
     PreviewMode previewMode = PreviewMode::MJPEG_1080P; // RAW10 requires custom fw support
+    unsigned int bufferCount = 3; // image buffers, frames are dropped while all of them are in use
+    PreviewScale previewScale = PreviewScale::Full; // smaller scales decode faster. ignored for MJPEG / METADATA
+    PreviewFormat previewFormat = PreviewFormat::RGB;
+    unsigned int captureBufferCount = 4; // driver capture buffers (Linux only), the driver may adjust it
+    CaptureMemory captureMemory = CaptureMemory::MMAP;
+    unsigned int previewFps = 0; // max frames per second decoded, the others are skipped undecoded. 0 for all
+    PreviewDecoder previewDecoder = PreviewDecoder::Software;
+    PreviewQuality previewQuality = PreviewQuality::Full; // software decode of the MJPEG modes only
 };
 
 /**
@@ -38,6 +121,8 @@ struct RSID_API ImageMetadata
     unsigned int sensor_id = 0;
     bool led = false;
     bool projector = false;
+    unsigned int frame_counter = 0; // sensor frame counter, sequential
+    unsigned int exposure_time = 0; // microseconds
 };
 
 /**
@@ -52,17 +137,45 @@ struct RSID_API Image
     unsigned int stride = 0;
     unsigned int number = 0;
     ImageMetadata metadata;
+    // host times (std::chrono::steady_clock, microseconds) the frame was received from the camera and decoded
+    unsigned long long receive_time = 0;
+    unsigned long long decode_time = 0;
+};
+
+/**
+ * Preview statistics. Averages and maximums are over the last frames delivered
+ */
+struct RSID_API PreviewStatistics
+{
+    unsigned int frames = 0;         // frames delivered since the preview started
+    unsigned int dropped_frames = 0; // frames dropped since the preview started, decoding or buffers did not keep up
+    unsigned int buffers_in_use = 0; // image buffers held by the callback or acquired (see Preview::AcquireImage)
+    float decode_ms = 0;
+    float max_decode_ms = 0;
+    float latency_ms = 0; // from the frame's receive time to its callback
+    float max_latency_ms = 0;
 };
 
 /**
  * User defined callback for preview.
  * Callback will be used to provide preview image.
+ * The image buffer is valid only during the call, unless acquired with Preview::AcquireImage.
  */
 class RSID_API PreviewImageReadyCallback
 {
 public:
     virtual ~PreviewImageReadyCallback() = default;
     virtual void OnPreviewImageReady(const Image image) = 0;
+
+    /**
+     * Called instead of OnPreviewImageReady while a crop region is set (see Preview::SetCropRegion).
+     *
+     * @param image the decoded region only
+     * @param region the decoded region, in the image's (scaled) frame coordinates
+     */
+    virtual void OnCroppedImageReady(const Image image, const FaceRect region)
+    {
+    }
 };
 
 /**
@@ -106,6 +219,19 @@ public:
      */
     bool StopPreview();
 
+    /**
+     * Keep the camera in warm standby, e.g. while nobody is in front of it, so that showing the preview is immediate.
+     * Before StartPreview: the camera is opened now (its format set and capture buffers allocated) and streams with
+     * the frames dropped, so StartPreview delivers the camera's next frame instead of opening it first.
+     * After StartPreview: pauses the preview as PausePreview, but with the camera streaming, so ResumePreview delivers
+     * the camera's next frame.
+     * The frames are dropped undecoded, at the cost of the camera's USB traffic and a wakeup per frame (Linux and
+     * Windows). StopPreview closes the camera.
+     *
+     * @return True on success, false if the camera failed to open.
+     */
+    bool StandbyPreview();
+
      /**
      * Convert Raw Image in_image to RGB24 and fill result in out_image
      * @param in_image an raw10 Image to convert
@@ -114,6 +240,121 @@ public:
      */
     bool RawToRgb(const Image& in_image, Image& out_image);
 
+    /**
+     * Convert Raw Image in_image to 8 bit grayscale (the 8 msb of each pixel) and fill result in out_image.
+     * Not demosaiced nor rotated, much cheaper than RawToRgb. Without binning the pixels keep their bayer colors.
+     * @param in_image an raw10 Image to convert
+     * @param out_image an Image with pre-allocated buffer in size in_image.width * in_image.height,
+     *                  or (in_image.width / 2) * (in_image.height / 2) with binning
+     * @param binning average each 2x2 bayer cell into one pixel, an approximate luminance at half resolution
+     * @return True on success.
+     */
+    bool RawToGray(const Image& in_image, Image& out_image, bool binning = false);
+
+    /**
+     * Unpack Raw Image in_image to its full 10 bit values, one uint16_t per pixel (0-1023),
+     * and fill result in out_image. Not demosaiced nor rotated.
+     * @param in_image an raw10 Image to convert
+     * @param out_image an Image with pre-allocated buffer in size in_image.width * in_image.height * 2, aligned to 2
+     * @return True on success.
+     */
+    bool RawToRaw16(const Image& in_image, Image& out_image);
+
+    /**
+     * Deliver the preview frames also to another callback, e.g. for analytics next to the UI's StartPreview callback.
+     * Each frame is decoded once per distinct format, scale and quality, and the decoded image is shared by the
+     * subscribers and the StartPreview callback asking for it. Each subscriber is called on its own thread, with the
+     * frames it did not keep up with dropped by its policy. Subscribers get full frames while a crop region is set.
+     * RAW10 frames are delivered as is, whatever the subscription's format and scale.
+     * Frames are delivered while the preview is started and not paused, frames the preview drops are not delivered.
+     *
+     * @param callback the subscriber, called on OnPreviewImageReady. Must outlive the subscription
+     * @param subscription format, scale and drop policy of its frames
+     * @return True on success, false if the callback is already subscribed.
+     */
+    bool Subscribe(PreviewImageReadyCallback& callback, const PreviewSubscription& subscription);
+
+    /**
+     * Stop delivering frames to a subscriber. Waits for its running callback, so must not be called from it.
+     * The frames still queued for it are dropped.
+     *
+     * @param callback the subscriber
+     * @return True on success, false if the callback is not subscribed.
+     */
+    bool Unsubscribe(PreviewImageReadyCallback& callback);
+
+    /**
+     * Keep the buffer of an image received in the preview callback valid after the callback returns.
+     * Must be called during the callback. Each acquire must be matched by ReleaseImage, before the preview is
+     * destroyed.
+     * The buffer is not reused for new frames while acquired, so holding all buffers drops frames.
+     *
+     * @param image image received in OnPreviewImageReady
+     * @return True on success.
+     */
+    bool AcquireImage(const Image& image);
+
+    /**
+     * Release an image acquired with AcquireImage. Its buffer may be reused for new frames.
+     *
+     * @param image the acquired image
+     * @return True on success.
+     */
+    bool ReleaseImage(const Image& image);
+
+    /**
+     * Decode only a region of the following frames, e.g. around the latest face reported by the authenticator,
+     * and deliver them through PreviewImageReadyCallback::OnCroppedImageReady.
+     * Rows above and below the region and columns left of it are not decoded. RGB and GRAY8 formats only, not in
+     * RAW10 mode.
+     *
+     * @param region region in full resolution frame coordinates
+     * @return True on success.
+     */
+    bool SetCropRegion(const FaceRect& region);
+
+    /**
+     * Decode and deliver full frames again.
+     *
+     * @return True on success.
+     */
+    bool ClearCropRegion();
+
+    /**
+     * Get the preview statistics, e.g. to alarm on preview degradation.
+     *
+     * @param statistics filled with the statistics of the current (or last) preview
+     * @return True on success.
+     */
+    bool GetStatistics(PreviewStatistics& statistics);
+
+    /**
+     * Keep the frames of the last seconds in memory as received from the camera (jpeg files for MJPEG modes,
+     * raw for RAW10), to save them when an event occurs (e.g. a spoof or an authentication failure).
+     * Replaces a running recorder, its kept frames are dropped.
+     *
+     * @param seconds frames received earlier are dropped
+     * @param max_bytes memory budget of the kept frames and of the frames waiting to be written
+     * @return True on success.
+     */
+    bool StartFrameRecorder(unsigned int seconds, unsigned int max_bytes);
+
+    /**
+     * Write the kept frames to the given existing directory, in the background, and keep recording from scratch.
+     * Returns right away, the frames are written by a writer thread.
+     *
+     * @param directory existing directory for the frame files
+     * @return True on success, false if the recorder is not started or has no frames.
+     */
+    bool SaveRecordedFrames(const char* directory);
+
+    /**
+     * Stop the recorder. Waits for saved frames to be written, the kept frames are dropped.
+     *
+     * @return True on success.
+     */
+    bool StopFrameRecorder();
+
 private:
     RealSenseID::PreviewImpl* _impl = nullptr;
 };
@@ -0,0 +1,55 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseIDExports.h"
+
+/**
+ *  Opt-in real-time mode, for hosts that need a bounded latency from the device's reply to the application (e.g. a
+ *  door controller's unlock): memory locked in RAM so the library's buffers never page fault, and real-time
+ *  scheduling of the library's I/O threads so they are not delayed by the rest of the system.
+ *  Off by default. Real-time scheduling needs privileges (CAP_SYS_NICE or an rtprio limit on linux), and locking
+ *  memory needs a large enough RLIMIT_MEMLOCK.
+ */
+namespace RealSenseID
+{
+/**
+ * Real-time mode of the library (SetRealTimeConfig()).
+ */
+struct RSID_API RealTimeConfig
+{
+    // lock the process memory in RAM (mlockall on linux, a larger working set on windows) and prefault the buffers the
+    // library allocates up front (serial receive buffers, preview frame pool) and the I/O threads' stacks
+    bool lock_memory = false;
+
+    // priority of the library's I/O threads: the serial threads (async operations, serial reactor, android usb
+    // reader, firmware update reader) and the preview capture threads.
+    // linux: SCHED_FIFO priority (1-99). windows: any value > 0 registers the threads with MMCSS ("Pro Audio").
+    // 0 - default scheduling.
+    int io_thread_priority = 0;
+
+    // pin the I/O threads to this cpu (-1 - no pinning)
+    int io_thread_cpu = -1;
+};
+
+/**
+ * Set the real-time mode. Memory locking is applied right away, the scheduling applies to the I/O threads started
+ * afterwards, so set it before connecting and starting the preview.
+ * @param config[in] the mode.
+ * @return False if the memory could not be locked (the rest of the mode is still set).
+ */
+RSID_API bool SetRealTimeConfig(const RealTimeConfig& config);
+
+/**
+ * The current real-time mode. lock_memory is the applied state: false if locking the memory failed.
+ */
+RSID_API RealTimeConfig GetRealTimeConfig();
+
+/**
+ * Apply the I/O thread scheduling of the real-time mode to the calling thread and prefault its stack, e.g. for the
+ * application's thread that calls the blocking FaceAuthenticator api.
+ * @return False if the scheduling could not be set (e.g. no privileges), true if set or the mode is off.
+ */
+RSID_API bool EnterRealTimeThread();
+} // namespace RealSenseID
@@ -0,0 +1,119 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/RealSenseIDExports.h"
+#include "RealSenseID/GalleryBackend.h"
+#include "RealSenseID/GalleryTransport.h"
+#include "RealSenseID/Faceprints.h"
+#include "RealSenseID/Status.h"
+#include <cstddef>
+
+namespace RealSenseID
+{
+class RemoteGalleryImpl;
+
+/**
+ * Users gallery partitioned across GalleryNode instances on other hosts, for galleries too large for one host.
+ *
+ * Each user lives on one node, chosen by a hash of its user id, so all the clients of a gallery must be created
+ * with the same nodes in the same order. A match is sent to all the nodes in parallel (the probe is packed to 352
+ * bytes); each node returns its best candidates and the client merges them. Adaptive updates of the matched user are
+ * applied by its node and also returned to the caller, as with HostGallery.
+ *
+ * Unlike HostGallery, the match returns the best scoring user (not the first one over the threshold in gallery
+ * order), so the result does not depend on how the users are spread across the nodes.
+ * Thread safe.
+ */
+class RSID_API RemoteGallery : public GalleryBackend
+{
+public:
+    static constexpr size_t MaxTopK = 64;
+
+    /**
+     * @param[in] nodes Array of number_of_nodes transports, one for each node. The transports must outlive the
+     * gallery.
+     * @param[in] number_of_nodes Number of nodes (at least 1).
+     */
+    RemoteGallery(GalleryTransport* const* nodes, size_t number_of_nodes);
+    ~RemoteGallery() override;
+
+    RemoteGallery(const RemoteGallery&) = delete;
+    RemoteGallery& operator=(const RemoteGallery&) = delete;
+
+    /**
+     * Add user to its node, or replace its faceprints if the user is already in it.
+     *
+     * @param[in] user_id Null terminated user id (up to 30 chars).
+     * @param[in] faceprints User's faceprints.
+     * @return Status (Status::Ok on success, Status::Error on invalid arguments or if the node failed).
+     */
+    Status Add(const char* user_id, const Faceprints& faceprints);
+
+    /**
+     * Remove user from its node.
+     *
+     * @param[in] user_id Null terminated user id.
+     * @return Status (Status::Ok on success, Status::Error if the user is not in the gallery or the node failed).
+     */
+    Status Remove(const char* user_id);
+
+    /**
+     * Remove all users from all the nodes.
+     *
+     * @return Status (Status::Ok on success, Status::Error if any of the nodes failed).
+     */
+    Status Clear();
+
+    /**
+     * Query the number of users in all the nodes.
+     *
+     * @param[out] number_of_users Number of users.
+     * @return Status (Status::Ok on success, Status::Error if any of the nodes failed).
+     */
+    Status QuerySize(size_t& number_of_users);
+
+    /**
+     * Ask the nodes to warm their shards ahead of a match (see HostGallery::Prefetch()).
+     */
+    void Prefetch() const override;
+
+    /**
+     * Match faceprints against all the users in the gallery.
+     * If result.should_update is set, the matched user was updated in its node and its updated faceprints are
+     * written to updated_faceprints.
+     *
+     * @param[in] new_faceprints Probe faceprints.
+     * @param[out] updated_faceprints Updated faceprints of the matched user (only if result.should_update).
+     * @return Match result (the best match of the nodes that replied, if some of them failed).
+     */
+    HostGalleryMatch Match(const Faceprints& new_faceprints, Faceprints& updated_faceprints);
+
+    /**
+     * Match several faceprints against the gallery, all of them in a single request to each node.
+     * results[i] and updated_faceprints[i] are what Match(new_faceprints[i], updated_faceprints[i]) returns.
+     *
+     * @return Status (Status::Ok on success, Status::Error on invalid arguments or if any of the nodes failed - the
+     * results then hold the best matches of the nodes that replied).
+     */
+    Status MatchBatch(const Faceprints* new_faceprints, size_t number_of_probes, HostGalleryMatch* results,
+                      Faceprints* updated_faceprints) override;
+
+    /**
+     * Find the k best scoring users for the probe, without updating them.
+     * result.success is set for the users over the match threshold; user_id is set for all the results.
+     *
+     * @param[in] new_faceprints Probe faceprints.
+     * @param[in] k Max number of results (up to MaxTopK).
+     * @param[out] results Array of k results, sorted by descending score.
+     * @param[out] number_of_results Number of results written.
+     * @return Status (Status::Ok on success, Status::Error on invalid arguments or if any of the nodes failed).
+     */
+    Status MatchTopK(const Faceprints& new_faceprints, size_t k, HostGalleryMatch* results,
+                     size_t& number_of_results);
+
+private:
+    RemoteGalleryImpl* _impl = nullptr;
+};
+} // namespace RealSenseID
@@ -12,6 +12,50 @@ namespace RealSenseID
  */
 struct RSID_API SerialConfig
 {
+    enum class Transport
+    {
+        Tty = 0,    // the port's tty
+        UsbBulk = 1 // Linux: the bulk endpoints of the port's usb device, with no tty layer (see below)
+    };
+
     const char* port = nullptr;
+
+    // UsbBulk (Linux): talk to the device of the port (e.g. /dev/ttyACM0) through the usb bulk endpoints directly, as
+    // on Android: the usbfs node of the device is opened (needs write access to /dev/bus/usb/BBB/DDD) and the port is
+    // taken from its driver until disconnect. No termios or line discipline buffering, and a packet is a single
+    // transfer each way. The baud rate and the driver's low latency mode do not apply.
+    Transport transport = Transport::Tty;
+
+    // calibrate the link on connect: a short exchange of pings of varying sizes measures the link, and the port's
+    // driver modes and timeouts are chosen by it (see SerialLinkProfile). off: the port's defaults.
+    bool calibrate_link = false;
+};
+
+/**
+ * Serial link settings of a connection (FaceAuthenticator::GetLinkProfile()), chosen by the link calibration of
+ * SerialConfig::calibrate_link or the defaults.
+ */
+struct RSID_API SerialLinkProfile
+{
+    // the link was calibrated on connect (the measurements below are 0 otherwise)
+    bool calibrated = false;
+
+    // the driver's low latency mode is on (Linux ASYNC_LOW_LATENCY, e.g. the 1 ms latency timer of usb-serial
+    // adapters). enabled if the driver accepts it and the small pings are not slower with it.
+    bool low_latency = false;
+
+    // best round trip of a ping with a small (16 bytes) / a full data packet, in micros
+    unsigned int small_ping_us = 0;
+    unsigned int full_ping_us = 0;
+
+    // measured throughput of each direction, from the round trip difference of the two ping sizes (0 if unknown)
+    unsigned int bytes_per_second = 0;
+
+    // wait of a port read for the first byte before it returns with none (Linux VTIME, Windows read timeout), so a
+    // receive timeout or cancel is noticed within it
+    unsigned int read_timeout_ms = 200;
+
+    // time allowed for the write of a full packet (Windows write timeout. Linux writes are not timed)
+    unsigned int write_timeout_ms = 200;
 };
 } // namespace RealSenseID
@@ -0,0 +1,25 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+namespace RealSenseID
+{
+/**
+ * User defined callback for user ids listing.
+ * Called with the id of each user as it arrives from the device.
+ */
+class UserIdsCallback
+{
+public:
+    virtual ~UserIdsCallback() = default;
+
+    /**
+     * Called once for each user, in the device's DB order.
+     *
+     * @param[in] user_index Index of the user in the listing.
+     * @param[in] user_id Null terminated user id. Valid only during the call.
+     */
+    virtual void OnUserId(const unsigned int user_index, const char* user_id) = 0;
+};
+} // namespace RealSenseID
@@ -0,0 +1,39 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+namespace RealSenseID
+{
+class Faceprints;
+
+/**
+ * User defined callback for the changes of the device's DB since a given revision.
+ * Apply the calls in order to bring a host copy of the DB up to date.
+ */
+class UsersChangesCallback
+{
+public:
+    virtual ~UsersChangesCallback() = default;
+
+    /**
+     * Called first if all users were removed since the given revision.
+     */
+    virtual void OnAllUsersRemoved() = 0;
+
+    /**
+     * Called for each user removed since the given revision.
+     *
+     * @param[in] user_id Null terminated id of the removed user.
+     */
+    virtual void OnUserRemoved(const char* user_id) = 0;
+
+    /**
+     * Called for each user added or updated since the given revision.
+     *
+     * @param[in] user_id Null terminated id of the user.
+     * @param[in] faceprints The user's current faceprints. Valid only during the call.
+     */
+    virtual void OnUserChanged(const char* user_id, const Faceprints& faceprints) = 0;
+};
+} // namespace RealSenseID
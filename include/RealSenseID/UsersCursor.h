@@ -0,0 +1,20 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+namespace RealSenseID
+{
+/**
+ * Position of a paginated listing or export of the device's DB (see FaceAuthenticator::ExportUsers()).
+ * Start with a default constructed cursor and call again with the same cursor until done is set. After a failed
+ * page, calling again resumes after the last user delivered. Users enrolled or removed between pages shift the DB
+ * indices that follow them: compare FaceAuthenticator::GetUsersRevision() between pages, and restart when it changed.
+ */
+struct UsersCursor
+{
+    unsigned int next_index = 0;      // DB index of the next user to deliver
+    unsigned int number_of_users = 0; // number of users in the device's DB when the last page was read
+    bool done = false;                // set once the last user of the DB was delivered
+};
+} // namespace RealSenseID
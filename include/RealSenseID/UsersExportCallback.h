@@ -0,0 +1,28 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+namespace RealSenseID
+{
+class Faceprints;
+
+/**
+ * User defined callback for the export of the users (ids and faceprints together).
+ * Called with each user as it arrives from the device.
+ */
+class UsersExportCallback
+{
+public:
+    virtual ~UsersExportCallback() = default;
+
+    /**
+     * Called once for each exported user, in the device's DB order.
+     *
+     * @param[in] user_index Index of the user in the device's DB.
+     * @param[in] user_id Null terminated id of the user.
+     * @param[in] faceprints The user's faceprints. Valid only during the call.
+     */
+    virtual void OnUser(const unsigned int user_index, const char* user_id, const Faceprints& faceprints) = 0;
+};
+} // namespace RealSenseID
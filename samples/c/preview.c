@@ -18,7 +18,7 @@ void render(rsid_image image, void* ctx)
 
 int main()
 {
-    rsid_preview_config config;
+    rsid_preview_config config = {0};
     rsid_preview* preview;
     config.camera_number = -1;  // auto detect
     config.preview_mode = MJPEG_1080P;
@@ -0,0 +1,32 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "RealSenseID/Allocator.h"
+#include "LibraryMemory.h"
+
+namespace RealSenseID
+{
+void SetAllocator(Allocator* allocator)
+{
+    Memory::SetAllocator(allocator);
+}
+
+void GetAllocationStats(AllocationStats& stats)
+{
+    Memory::GetStats(stats);
+}
+
+static_assert(static_cast<int>(MemoryCategory::Count) == static_cast<int>(Memory::Category::Count), "neq");
+static_assert(static_cast<int>(MemoryCategory::Gallery) == static_cast<int>(Memory::Category::Gallery), "neq");
+static_assert(static_cast<int>(MemoryCategory::Other) == static_cast<int>(Memory::Category::Other), "neq");
+
+void GetMemoryStats(MemoryStats& stats)
+{
+    Memory::GetStats(stats);
+}
+
+void ResetAllocationStats()
+{
+    Memory::ResetStats();
+}
+} // namespace RealSenseID
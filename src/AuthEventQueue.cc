@@ -0,0 +1,147 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "RealSenseID/AuthEventQueue.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+namespace RealSenseID
+{
+constexpr size_t AuthEvent::MAX_FACES;
+
+// single producer (the authentication) / single consumer (the polling thread) ring.
+// _head is written by the consumer only, _tail by the producer only.
+class AuthEventQueueImpl
+{
+public:
+    explicit AuthEventQueueImpl(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+        {
+            size *= 2;
+        }
+        _events.resize(size);
+        _mask = size - 1;
+    }
+
+    // cleared slot of the next event, or nullptr if full. the event is queued on Push()
+    AuthEvent* Reserve()
+    {
+        auto tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _head.load(std::memory_order_acquire) == _events.size())
+        {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        // slots are reused, don't let the previous event's fields leak into this one
+        auto& event = _events[tail & _mask];
+        event = AuthEvent {};
+        return &event;
+    }
+
+    void Push()
+    {
+        _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool Poll(AuthEvent& event)
+    {
+        auto head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        event = _events[head & _mask];
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t Dropped() const
+    {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::vector<AuthEvent> _events;
+    size_t _mask = 0;
+    std::atomic<size_t> _head {0};
+    std::atomic<size_t> _tail {0};
+    std::atomic<size_t> _dropped {0};
+};
+
+AuthEventQueue::AuthEventQueue(size_t capacity) : _impl {new AuthEventQueueImpl(std::max<size_t>(capacity, 1))}
+{
+}
+
+AuthEventQueue::~AuthEventQueue()
+{
+    try
+    {
+        delete _impl;
+    }
+    catch (...)
+    {
+    }
+}
+
+bool AuthEventQueue::Poll(AuthEvent& event)
+{
+    return _impl->Poll(event);
+}
+
+size_t AuthEventQueue::Dropped() const
+{
+    return _impl->Dropped();
+}
+
+void AuthEventQueue::OnResult(const AuthenticateStatus status, const char* userId)
+{
+    auto* event = _impl->Reserve();
+    if (event == nullptr)
+    {
+        return;
+    }
+    event->type = AuthEventType::Result;
+    event->status = status;
+    if (userId != nullptr)
+    {
+        ::strncpy(event->user_id, userId, sizeof(event->user_id) - 1);
+        event->user_id[sizeof(event->user_id) - 1] = '\0';
+    }
+    _impl->Push();
+}
+
+void AuthEventQueue::OnHint(const AuthenticateStatus hint)
+{
+    auto* event = _impl->Reserve();
+    if (event == nullptr)
+    {
+        return;
+    }
+    event->type = AuthEventType::Hint;
+    event->status = hint;
+    _impl->Push();
+}
+
+void AuthEventQueue::OnFaceDetected(const FaceRect* faces, const size_t n_faces, const unsigned int ts)
+{
+    auto* event = _impl->Reserve();
+    if (event == nullptr)
+    {
+        return;
+    }
+    event->type = AuthEventType::FaceDetected;
+    event->ts = ts;
+    event->n_faces = std::min(n_faces, AuthEvent::MAX_FACES);
+    std::copy(faces, faces + event->n_faces, event->faces);
+    _impl->Push();
+}
+
+void AuthEventQueue::OnFaceDetected(const std::vector<FaceRect>& faces, const unsigned int ts)
+{
+    OnFaceDetected(faces.data(), faces.size(), ts);
+}
+} // namespace RealSenseID
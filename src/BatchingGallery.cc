@@ -0,0 +1,234 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "RealSenseID/BatchingGallery.h"
+#include "Matcher/Matcher.h"
+#include "Logger.h"
+#include "Tracer.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <vector>
+
+namespace RealSenseID
+{
+static const char* LOG_TAG = "BatchingGallery";
+
+constexpr unsigned int BatchingGallery::DefaultWindowMicros;
+constexpr size_t BatchingGallery::DefaultMaxProbes;
+
+class BatchingGalleryImpl
+{
+    using clock = std::chrono::steady_clock;
+
+public:
+    BatchingGalleryImpl(GalleryBackend& gallery, unsigned int window_micros, size_t max_probes) :
+        _gallery(gallery), _window {window_micros}, _max_probes {std::max<size_t>(max_probes, 1)}
+    {
+    }
+
+    void Prefetch() const
+    {
+        _gallery.Prefetch();
+    }
+
+    Status MatchBatch(const Faceprints* new_faceprints, size_t number_of_probes, HostGalleryMatch* results,
+                      Faceprints* updated_faceprints)
+    {
+        if (new_faceprints == nullptr || results == nullptr || updated_faceprints == nullptr)
+        {
+            LOG_ERROR(LOG_TAG, "Invalid batch match arguments");
+            return Status::Error;
+        }
+
+        // nothing to share: too many probes for a batch, or probes that would fail the batch
+        if (number_of_probes == 0 || number_of_probes > _max_probes ||
+            !ValidProbes(new_faceprints, number_of_probes))
+        {
+            return _gallery.MatchBatch(new_faceprints, number_of_probes, results, updated_faceprints);
+        }
+
+        Request request {new_faceprints, number_of_probes, results, updated_faceprints, clock::now()};
+        std::unique_lock<std::mutex> lock {_mutex};
+        _pending.push_back(&request);
+        _pending_probes += number_of_probes;
+        _cv.notify_all();
+
+        // one caller at a time runs a pass, for the requests pending when it starts. the others wait for their
+        // results, or to run the next pass.
+        while (!request.done)
+        {
+            if (_running)
+            {
+                _cv.wait(lock);
+                continue;
+            }
+
+            _running = true;
+            const auto deadline = _pending.front()->arrival + std::min(_window, _last_pass);
+            _cv.wait_until(lock, deadline, [this] { return _pending_probes >= _max_probes; });
+            std::vector<Request*> batch = TakeBatch();
+            lock.unlock();
+
+            const auto start = clock::now();
+            try
+            {
+                RunPass(batch);
+            }
+            // the waiting callers must still be released
+            catch (const std::exception& ex)
+            {
+                LOG_ERROR(LOG_TAG, "Batch match failed: %s", ex.what());
+            }
+            catch (...)
+            {
+                LOG_ERROR(LOG_TAG, "Batch match failed");
+            }
+            const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start);
+
+            lock.lock();
+            _last_pass = elapsed;
+            for (auto* batch_request : batch)
+            {
+                batch_request->done = true;
+            }
+            _running = false;
+            _cv.notify_all();
+        }
+        return request.status;
+    }
+
+private:
+    struct Request
+    {
+        const Faceprints* probes;
+        size_t number_of_probes;
+        HostGalleryMatch* results;
+        Faceprints* updated_faceprints;
+        clock::time_point arrival;
+        Status status = Status::Error;
+        bool done = false;
+    };
+
+    static bool ValidProbes(const Faceprints* new_faceprints, size_t number_of_probes)
+    {
+        for (size_t i = 0; i < number_of_probes; i++)
+        {
+            if (!Matcher::ValidateFaceprints(new_faceprints[i]) ||
+                new_faceprints[i].version != new_faceprints[0].version)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // the oldest pending request, and the next ones with the same faceprints version, up to max probes.
+    // must be called with the mutex held.
+    std::vector<Request*> TakeBatch()
+    {
+        std::vector<Request*> batch;
+        const int version = _pending.front()->probes[0].version;
+        size_t batch_probes = 0;
+        for (auto it = _pending.begin(); it != _pending.end();)
+        {
+            Request* request = *it;
+            if (request->probes[0].version != version ||
+                (!batch.empty() && batch_probes + request->number_of_probes > _max_probes))
+            {
+                ++it;
+                continue;
+            }
+            batch.push_back(request);
+            batch_probes += request->number_of_probes;
+            _pending_probes -= request->number_of_probes;
+            it = _pending.erase(it);
+        }
+        return batch;
+    }
+
+    // called by a single thread at a time (the one that set _running)
+    void RunPass(const std::vector<Request*>& batch)
+    {
+        RSID_TRACE_SPAN("gallery", "BatchingPass");
+        if (batch.size() == 1)
+        {
+            Request& request = *batch[0];
+            request.status = _gallery.MatchBatch(request.probes, request.number_of_probes, request.results,
+                                                 request.updated_faceprints);
+            return;
+        }
+
+        _probes.clear();
+        for (const auto* request : batch)
+        {
+            _probes.insert(_probes.end(), request->probes, request->probes + request->number_of_probes);
+        }
+        _results.assign(_probes.size(), HostGalleryMatch {});
+        _updated_faceprints.resize(_probes.size());
+        Status status =
+            _gallery.MatchBatch(_probes.data(), _probes.size(), _results.data(), _updated_faceprints.data());
+
+        size_t offset = 0;
+        for (auto* request : batch)
+        {
+            for (size_t i = 0; i < request->number_of_probes; i++)
+            {
+                request->results[i] = _results[offset + i];
+                if (_results[offset + i].result.should_update)
+                {
+                    request->updated_faceprints[i] = _updated_faceprints[offset + i];
+                }
+            }
+            request->status = status;
+            offset += request->number_of_probes;
+        }
+    }
+
+    GalleryBackend& _gallery;
+    const std::chrono::microseconds _window;
+    const size_t _max_probes;
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::deque<Request*> _pending;
+    size_t _pending_probes = 0;
+    bool _running = false;
+    std::chrono::microseconds _last_pass {0};
+
+    // the batch of the running pass
+    std::vector<Faceprints> _probes;
+    std::vector<HostGalleryMatch> _results;
+    std::vector<Faceprints> _updated_faceprints;
+};
+
+BatchingGallery::BatchingGallery(GalleryBackend& gallery, unsigned int window_micros, size_t max_probes) :
+    _impl {new BatchingGalleryImpl(gallery, window_micros, max_probes)}
+{
+}
+
+BatchingGallery::~BatchingGallery()
+{
+    try
+    {
+        delete _impl;
+    }
+    catch (...)
+    {
+    }
+}
+
+void BatchingGallery::Prefetch() const
+{
+    _impl->Prefetch();
+}
+
+Status BatchingGallery::MatchBatch(const Faceprints* new_faceprints, size_t number_of_probes,
+                                   HostGalleryMatch* results, Faceprints* updated_faceprints)
+{
+    return _impl->MatchBatch(new_faceprints, number_of_probes, results, updated_faceprints);
+}
+} // namespace RealSenseID
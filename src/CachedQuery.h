@@ -0,0 +1,56 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include <mutex>
+
+namespace RealSenseID
+{
+// Opt-in cache of a device query's result, dropped by the library's own calls that change it and by reconnects.
+// Thread safe, so a cached answer does not wait for an operation holding the serial line (e.g. an auth loop).
+template <typename T>
+class CachedQuery
+{
+public:
+    // disabling drops the cached value
+    void Enable(bool enable)
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        _enabled = enable;
+        _valid = false;
+    }
+
+    // false if disabled or nothing is cached
+    bool Get(T& value) const
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        if (!_valid)
+        {
+            return false;
+        }
+        value = _value;
+        return true;
+    }
+
+    // ignored if disabled
+    void Set(const T& value)
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        _value = value;
+        _valid = _enabled;
+    }
+
+    void Invalidate()
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        _valid = false;
+    }
+
+private:
+    mutable std::mutex _mutex;
+    bool _enabled = false;
+    bool _valid = false;
+    T _value {};
+};
+} // namespace RealSenseID
@@ -7,8 +7,11 @@
 #include <android/api-level.h>
 #include <unistd.h>
 #include <sstream>
+#include <cstring>
+#include <chrono>
 
 static const char* LOG_TAG = "AndroidCapture";
+static const int FRAME_WAIT_SECONDS = 10; // max time to wait for next frame
 namespace RealSenseID
 {
 namespace Capture
@@ -24,7 +27,7 @@ static void ThrowIfFailed(const char *what, uvc_error_t uvc_err)
 
 CaptureHandle::CaptureHandle(const PreviewConfig& config) : _config(config)
 {
-    _stream_converter = std::make_unique<StreamConverter>(_config.previewMode);
+    _stream_converter = std::make_unique<StreamConverter>(_config);
     int sys_dev = _config.cameraNumber;
     libusb_context *usb_context = NULL;
     auto api_level = android_get_device_api_level();
@@ -50,39 +53,153 @@ CaptureHandle::CaptureHandle(const PreviewConfig& config) : _config(config)
 
     StreamAttributes attr = _stream_converter->GetStreamAttributes();
     uvc_frame_format fmt = attr.format == MJPEG ? UVC_FRAME_FORMAT_MJPEG : UVC_FRAME_FORMAT_ANY;
+    if (attr.format == YUY2)
+        fmt = UVC_FRAME_FORMAT_YUYV;
     /* find stream by width, height. use default fps */
     res = uvc_get_stream_ctrl_format_size(devh, &ctrl, fmt, attr.width, attr.height, 0);
     ThrowIfFailed("uvc_get_stream_ctrl_format_size", res);
 
-    res = uvc_stream_open_ctrl(devh, &stream, &ctrl);
-    ThrowIfFailed("uvc_stream_open_ctrl", res);
-    res = uvc_stream_start(stream, NULL, (void*)this, 0);
-    ThrowIfFailed("uvc_stream_start", res);
+    // reserve the slots up front, so the streaming thread does not allocate per frame
+    for (auto& slot : _slots)
+        slot.data.reserve(ctrl.dwMaxVideoFrameSize);
+
+    // frames are delivered to OnFrame() as they complete, without waiting for Read()
+    res = uvc_start_streaming(devh, &ctrl, &CaptureHandle::OnFrame, this, 0);
+    ThrowIfFailed("uvc_start_streaming", res);
 };
 
 CaptureHandle::~CaptureHandle()
 {
+    // joins the streaming thread, no OnFrame() call after this
     uvc_stop_streaming(devh);
     LOG_DEBUG(LOG_TAG, "release camera");
     uvc_close(devh);
     uvc_exit(ctx);
 }
 
+void CaptureHandle::OnFrame(uvc_frame_t* frame, void* user_ptr)
+{
+    static_cast<CaptureHandle*>(user_ptr)->OnFrame(frame);
+}
+
+void CaptureHandle::OnFrame(const uvc_frame_t* frame)
+{
+    if (frame == nullptr || frame->data == nullptr || frame->data_bytes == 0)
+        return;
+    auto receive_time = HostTimeMicros();
+
+    // only this thread fills slots, so the free slot stays free while copying outside the lock
+    int free_slot = NO_FRAME;
+    {
+        std::lock_guard<std::mutex> lock {_frame_mutex};
+        if (_paused)
+            return;
+        for (int i = 0; i < FRAME_SLOTS; i++)
+        {
+            if (i != _pending_slot && i != _reading_slot)
+            {
+                free_slot = i;
+                break;
+            }
+        }
+    }
+
+    auto& slot = _slots[free_slot];
+    try
+    {
+        // no reallocation unless the frame is larger than any before
+        slot.data.resize(frame->data_bytes);
+    }
+    catch (const std::exception& ex)
+    {
+        LOG_ERROR(LOG_TAG, "Frame of %zu bytes dropped: %s", frame->data_bytes, ex.what());
+        return;
+    }
+    ::memcpy(slot.data.data(), frame->data, frame->data_bytes);
+    slot.size = frame->data_bytes;
+    slot.receive_time = receive_time;
+
+    {
+        std::lock_guard<std::mutex> lock {_frame_mutex};
+        if (_paused)
+            return;
+        // the newer frame wins
+        if (_pending_slot != NO_FRAME)
+            ++_dropped_frames;
+        _pending_slot = free_slot;
+    }
+    _frame_cv.notify_one();
+}
+
 bool CaptureHandle::Read(RealSenseID::Image* res)
 {
-    buffer buffer;
-    if (!stream){
-        return false;
+    buffer buffer_to_convert;
+    {
+        std::unique_lock<std::mutex> lock {_frame_mutex};
+        _frame_cv.wait_for(lock, std::chrono::seconds {FRAME_WAIT_SECONDS},
+                           [this] { return _pending_slot != NO_FRAME || _paused || _interrupted; });
+        if (_pending_slot == NO_FRAME || _paused || _interrupted)
+            return false;
+        if (_dropped_frames > 0)
+        {
+            LOG_TRACE(LOG_TAG, "dropped %u frames", _dropped_frames);
+            _total_dropped_frames += _dropped_frames;
+            _dropped_frames = 0;
+        }
+        _reading_slot = _pending_slot;
+        _pending_slot = NO_FRAME;
+        auto& slot = _slots[_reading_slot];
+        buffer_to_convert.data = slot.data.data();
+        buffer_to_convert.size = static_cast<unsigned int>(slot.size);
+        res->receive_time = slot.receive_time;
+    }
+
+    // decode while the streaming thread keeps filling the other slots
+    bool valid_read = false;
+    try
+    {
+        valid_read = _stream_converter->Buffer2Image(res, buffer_to_convert);
+    }
+    catch (...)
+    {
+        std::lock_guard<std::mutex> lock {_frame_mutex};
+        _reading_slot = NO_FRAME;
+        throw;
+    }
+    std::lock_guard<std::mutex> lock {_frame_mutex};
+    _reading_slot = NO_FRAME;
+    return valid_read;
+}
+
+void CaptureHandle::Pause()
+{
+    {
+        std::lock_guard<std::mutex> lock {_frame_mutex};
+        _paused = true;
+        // the pending frame would be stale on resume
+        _pending_slot = NO_FRAME;
     }
-    uvc_error_t err;
-    err = uvc_stream_get_frame(stream, &frame, 10000);
-    if (err != UVC_SUCCESS || frame == NULL)
+    _frame_cv.notify_all();
+}
+
+void CaptureHandle::Standby()
+{
+    Pause();
+}
+
+void CaptureHandle::Resume()
+{
+    std::lock_guard<std::mutex> lock {_frame_mutex};
+    _paused = false;
+}
+
+void CaptureHandle::Interrupt()
+{
     {
-        return false;
+        std::lock_guard<std::mutex> lock {_frame_mutex};
+        _interrupted = true;
     }
-    buffer.data = (unsigned char*)frame->data;
-    buffer.size = frame->data_bytes;
-    return _stream_converter->Buffer2Image(res,buffer);
+    _frame_cv.notify_all();
 }
 } // namespace Capture
-} // namespace RealSenseID
\ No newline at end of file
+} // namespace RealSenseID
@@ -6,6 +6,10 @@
 #include "StreamConverter.h"
 #include <libusb.h>
 #include <libuvc.h>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
 
 
 namespace RealSenseID
@@ -19,20 +23,63 @@ public:
     ~CaptureHandle();
     bool Read(RealSenseID::Image* container);
 
+    // stop taking frames until Resume(). a blocked Read() returns false right away
+    void Pause();
+    // paused, ready to deliver the next frame on Resume(): libuvc keeps streaming while paused, so the same as Pause()
+    void Standby();
+    void Resume();
+    // make a blocked Read() and all later calls return false right away
+    void Interrupt();
+
+    // the converter is used by Read(), access it from the reading thread only
+    StreamConverter& GetStreamConverter()
+    {
+        return *_stream_converter;
+    }
+
+    // frames dropped by the capture since it started, updated by Read(). access it from the reading thread only
+    unsigned int DroppedFrames() const
+    {
+        return _total_dropped_frames;
+    }
+
     // prevent copy or assignment
     // only single connection is allowed to a captre device.
     CaptureHandle(const CaptureHandle&) = delete;
     void operator=(const CaptureHandle&) = delete;
 
 private:
+    // libuvc calls this on its streaming thread for each frame. the frame is copied to a free slot and becomes the
+    // pending one for Read(); an older pending frame is dropped, so decoding never builds a backlog.
+    static void OnFrame(uvc_frame_t* frame, void* user_ptr);
+    void OnFrame(const uvc_frame_t* frame);
+
+    // one slot being filled, one pending and one being decoded
+    static constexpr int FRAME_SLOTS = 3;
+    static constexpr int NO_FRAME = -1;
+
+    struct FrameSlot
+    {
+        std::vector<unsigned char> data; // grows to the largest frame, then reused
+        size_t size = 0;
+        unsigned long long receive_time = 0;
+    };
+
     uvc_context_t* ctx = nullptr;
-    uvc_device_t* dev = nullptr;
     uvc_device_handle_t* devh = nullptr;
-    uvc_stream_handle_t* stream = nullptr;
     uvc_stream_ctrl_t ctrl;
-    uvc_frame_t* frame = nullptr;
     std::unique_ptr<StreamConverter> _stream_converter;
     PreviewConfig _config;
+
+    FrameSlot _slots[FRAME_SLOTS];
+    std::mutex _frame_mutex;
+    std::condition_variable _frame_cv;
+    bool _paused = false;
+    bool _interrupted = false;
+    int _pending_slot = NO_FRAME;
+    int _reading_slot = NO_FRAME;
+    unsigned int _dropped_frames = 0; // since the last Read()
+    unsigned int _total_dropped_frames = 0;
 };
 } // namespace Capture
-} // namespace RealSenseID
\ No newline at end of file
+} // namespace RealSenseID
@@ -0,0 +1,115 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "DecodeExecutor.h"
+#include <algorithm>
+
+namespace RealSenseID
+{
+namespace Capture
+{
+static constexpr unsigned int MAX_THREADS = 4;
+
+std::shared_ptr<DecodeExecutor> DecodeExecutor::Shared()
+{
+    // a weak reference, so the threads are not left to the static destructors
+    static std::mutex shared_mutex;
+    static std::weak_ptr<DecodeExecutor> shared;
+
+    std::lock_guard<std::mutex> lock {shared_mutex};
+    auto executor = shared.lock();
+    if (!executor)
+    {
+        auto thread_count = std::min(MAX_THREADS, std::max(1u, std::thread::hardware_concurrency()));
+        executor = std::make_shared<DecodeExecutor>(thread_count);
+        shared = executor;
+    }
+    return executor;
+}
+
+DecodeExecutor::DecodeExecutor(unsigned int thread_count)
+{
+    try
+    {
+        for (unsigned int i = 0; i < std::max(1u, thread_count); i++)
+        {
+            _threads.emplace_back(&DecodeExecutor::WorkerLoop, this);
+        }
+    }
+    catch (...)
+    {
+        {
+            std::lock_guard<std::mutex> lock {_mutex};
+            _stop = true;
+        }
+        _task_cv.notify_all();
+        for (auto& thread : _threads)
+        {
+            thread.join();
+        }
+        throw;
+    }
+}
+
+DecodeExecutor::~DecodeExecutor()
+{
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        _stop = true;
+    }
+    _task_cv.notify_all();
+    for (auto& thread : _threads)
+    {
+        thread.join();
+    }
+}
+
+void DecodeExecutor::Run(const std::function<void()>& task)
+{
+    Task entry {&task, nullptr, false};
+    {
+        std::unique_lock<std::mutex> lock {_mutex};
+        _tasks.push_back(&entry);
+        _task_cv.notify_one();
+        _done_cv.wait(lock, [&entry] { return entry.done; });
+    }
+    if (entry.error)
+    {
+        std::rethrow_exception(entry.error);
+    }
+}
+
+unsigned int DecodeExecutor::ThreadCount() const
+{
+    return static_cast<unsigned int>(_threads.size());
+}
+
+void DecodeExecutor::WorkerLoop()
+{
+    std::unique_lock<std::mutex> lock {_mutex};
+    while (true)
+    {
+        // queued tasks are run before stopping, their callers are waiting for them
+        _task_cv.wait(lock, [this] { return _stop || !_tasks.empty(); });
+        if (_tasks.empty())
+        {
+            return;
+        }
+        Task* task = _tasks.front();
+        _tasks.pop_front();
+        lock.unlock();
+        try
+        {
+            (*task->function)();
+        }
+        catch (...)
+        {
+            task->error = std::current_exception();
+        }
+        lock.lock();
+        task->done = true;
+        _done_cv.notify_all();
+    }
+}
+} // namespace Capture
+} // namespace RealSenseID
@@ -0,0 +1,59 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "LibraryThread.h"
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace RealSenseID
+{
+namespace Capture
+{
+// Fixed set of decode threads shared by all the previews of the process, so decoding several cameras uses a bounded
+// number of threads and the frames of all the cameras are decoded in the order they were submitted.
+// Run() waits for its task, so a stream has one frame in decode at a time and its frames are decoded in order.
+// Thread safe.
+class DecodeExecutor
+{
+public:
+    // the executor of the process, created on first use. its threads are joined when the last reference is released
+    static std::shared_ptr<DecodeExecutor> Shared();
+
+    explicit DecodeExecutor(unsigned int thread_count);
+    ~DecodeExecutor();
+
+    DecodeExecutor(const DecodeExecutor&) = delete;
+    DecodeExecutor& operator=(const DecodeExecutor&) = delete;
+
+    // run the task on a decode thread and wait for it. an exception of the task is rethrown here
+    void Run(const std::function<void()>& task);
+
+    unsigned int ThreadCount() const;
+
+private:
+    struct Task
+    {
+        const std::function<void()>* function;
+        std::exception_ptr error;
+        bool done;
+    };
+
+    void WorkerLoop();
+
+    std::mutex _mutex;
+    std::condition_variable _task_cv;
+    std::condition_variable _done_cv;
+    std::deque<Task*> _tasks; // oldest first, owned by the waiting Run() calls
+    bool _stop = false;
+    std::vector<LibraryThread> _threads;
+};
+} // namespace Capture
+} // namespace RealSenseID
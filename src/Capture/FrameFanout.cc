@@ -0,0 +1,375 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "FrameFanout.h"
+#include "Logger.h"
+#include <algorithm>
+
+static const char* LOG_TAG = "FrameFanout";
+
+namespace RealSenseID
+{
+namespace Capture
+{
+FrameFanout::FrameFanout(const PreviewConfig& config, FramePool& primary_pool, DecodeExecutor* executor) :
+    _config(config), _primary_pool(primary_pool), _executor(executor)
+{
+}
+
+FrameFanout::~FrameFanout()
+{
+    for (auto& subscriber : _subscribers)
+    {
+        Stop(*subscriber);
+    }
+    ReleasePending();
+}
+
+bool FrameFanout::Subscribe(PreviewImageReadyCallback& callback, const PreviewSubscription& subscription)
+{
+    auto subscriber = std::make_unique<Subscriber>();
+    subscriber->callback = &callback;
+    subscriber->subscription = subscription;
+    auto& requested = subscriber->subscription;
+    if (requested.previewFormat == PreviewFormat::METADATA)
+    {
+        requested.previewScale = PreviewScale::Full; // the primary frame's metadata, nothing converted
+    }
+    else if (_config.previewMode == PreviewMode::RAW10_1080P)
+    {
+        // delivered as is, the converter's image fits all
+        requested.previewFormat = _config.previewFormat;
+        requested.previewScale = _config.previewScale;
+    }
+    else if (requested.previewFormat == PreviewFormat::MJPEG)
+    {
+        requested.previewScale = PreviewScale::Full; // not decoded, so not scaled
+    }
+    if (requested.previewFormat == PreviewFormat::METADATA || requested.previewFormat == PreviewFormat::MJPEG ||
+        (_config.previewMode != PreviewMode::MJPEG_1080P && _config.previewMode != PreviewMode::MJPEG_720P))
+    {
+        requested.previewQuality = _config.previewQuality; // no jpeg decode
+    }
+
+    std::lock_guard<std::mutex> lock {_mutex};
+    for (const auto& existing : _subscribers)
+    {
+        if (existing->callback == &callback)
+        {
+            return false;
+        }
+    }
+
+    Output* output = nullptr;
+    for (auto& existing : _outputs)
+    {
+        if (existing->format == requested.previewFormat && existing->scale == requested.previewScale &&
+            existing->quality == requested.previewQuality)
+        {
+            output = existing.get();
+        }
+    }
+    if (output == nullptr)
+    {
+        PreviewConfig output_config = _config;
+        output_config.previewFormat = requested.previewFormat;
+        output_config.previewScale = requested.previewScale;
+        auto created = std::make_unique<Output>();
+        created->format = requested.previewFormat;
+        created->scale = requested.previewScale;
+        created->quality = requested.previewQuality;
+        const bool metadata_only = requested.previewFormat == PreviewFormat::METADATA;
+        created->pool =
+            std::make_unique<FramePool>(metadata_only ? 0 : _config.bufferCount, GetImageSize(output_config));
+        output = created.get();
+        _outputs.push_back(std::move(created));
+    }
+
+    subscriber->output = output;
+    _subscribers.reserve(_subscribers.size() + 1); // no throwing once the thread runs
+    subscriber->thread = LibraryThread(&FrameFanout::DeliveryLoop, std::ref(*subscriber));
+    output->subscribers++;
+    _subscribers.push_back(std::move(subscriber));
+    return true;
+}
+
+bool FrameFanout::Unsubscribe(PreviewImageReadyCallback& callback)
+{
+    std::unique_ptr<Subscriber> removed;
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        auto it = std::find_if(_subscribers.begin(), _subscribers.end(),
+                               [&callback](const std::unique_ptr<Subscriber>& s) { return s->callback == &callback; });
+        if (it == _subscribers.end())
+        {
+            return false;
+        }
+        removed = std::move(*it);
+        _subscribers.erase(it);
+        removed->output->subscribers--;
+    }
+
+    // not under the lock, the running callback may take a while
+    Stop(*removed);
+    std::lock_guard<std::mutex> lock {_mutex};
+    RemoveUnusedOutputs();
+    return true;
+}
+
+void FrameFanout::OnFrameConverted(buffer frame_buffer, const Image& image, bool cropped)
+{
+    // pick the outputs to decode and their buffers under the lock, decode without it (a slow decode must not hold up
+    // the subscribers and the application's reference counts), then publish the images under the lock again
+    _decoding.clear();
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        ReleasePending();
+        _primary_cropped = cropped;
+        for (auto& output : _outputs)
+        {
+            if (output->subscribers == 0 || output->format == PreviewFormat::METADATA || SharesPrimary(*output))
+            {
+                continue;
+            }
+            Image decoded;
+            decoded.buffer = output->pool->Acquire();
+            if (decoded.buffer == nullptr)
+            {
+                LOG_TRACE(LOG_TAG, "All subscriber buffers are in use, dropping frame");
+                continue;
+            }
+            decoded.receive_time = image.receive_time;
+            output->decoding = true; // kept by RemoveUnusedOutputs() until published
+            _decoding.push_back({output.get(), decoded});
+        }
+    }
+
+    for (auto& job : _decoding)
+    {
+        auto* output = job.output;
+        try
+        {
+            if (!output->converter)
+            {
+                PreviewConfig output_config = _config;
+                output_config.previewFormat = output->format;
+                output_config.previewScale = output->scale;
+                output_config.previewQuality = output->quality;
+                output_config.previewFps = 0; // gets the frames the capture's converter did not skip
+                output->converter = std::make_unique<StreamConverter>(output_config);
+                output->converter->SetExecutor(_executor);
+            }
+            job.ok = output->converter->Buffer2Image(&job.image, frame_buffer);
+        }
+        catch (const std::exception& ex)
+        {
+            // only the subscribers miss the frame
+            LOG_ERROR(LOG_TAG, "Subscriber decode failed: %s", ex.what());
+        }
+        job.image.metadata = image.metadata; // the frame's, only the capture's converter gets the metadata buffer
+    }
+
+    std::lock_guard<std::mutex> lock {_mutex};
+    for (auto& job : _decoding)
+    {
+        job.output->decoding = false;
+        if (job.ok && job.output->subscribers > 0)
+        {
+            job.output->pending = job.image;
+        }
+        else
+        {
+            job.output->pool->Release(job.image.buffer);
+        }
+    }
+    RemoveUnusedOutputs();
+}
+
+void FrameFanout::Deliver(const Image& primary)
+{
+    std::lock_guard<std::mutex> lock {_mutex};
+    for (auto& subscriber : _subscribers)
+    {
+        auto* output = subscriber->output;
+        QueuedImage entry;
+        if (SharesPrimary(*output))
+        {
+            entry = {primary, &_primary_pool};
+        }
+        else if (output->format == PreviewFormat::METADATA)
+        {
+            entry = {primary, nullptr}; // no buffer to hold
+            entry.image.buffer = nullptr;
+            entry.image.size = 0;
+            entry.image.stride = 0;
+            Push(*subscriber, entry);
+            continue;
+        }
+        else if (output->pending.buffer != nullptr)
+        {
+            entry = {output->pending, output->pool.get()};
+            entry.image.number = primary.number;
+        }
+        else
+        {
+            continue; // not decoded, no free buffer
+        }
+        entry.pool->AddRef(entry.image.buffer);
+        Push(*subscriber, entry);
+    }
+    ReleasePending();
+}
+
+void FrameFanout::Discard()
+{
+    std::lock_guard<std::mutex> lock {_mutex};
+    ReleasePending();
+}
+
+bool FrameFanout::AddRef(const unsigned char* buffer)
+{
+    std::lock_guard<std::mutex> lock {_mutex};
+    for (auto& output : _outputs)
+    {
+        if (output->pool->AddRef(buffer))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FrameFanout::Release(const unsigned char* buffer)
+{
+    std::lock_guard<std::mutex> lock {_mutex};
+    for (auto& output : _outputs)
+    {
+        if (output->pool->Release(buffer))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+unsigned int FrameFanout::InUse()
+{
+    std::lock_guard<std::mutex> lock {_mutex};
+    unsigned int in_use = 0;
+    for (auto& output : _outputs)
+    {
+        in_use += output->pool->InUse();
+    }
+    return in_use;
+}
+
+bool FrameFanout::SharesPrimary(const Output& output) const
+{
+    return output.format == _config.previewFormat && output.scale == _config.previewScale &&
+           output.quality == _config.previewQuality && !_primary_cropped;
+}
+
+void FrameFanout::ReleasePending()
+{
+    for (auto& output : _outputs)
+    {
+        if (output->pending.buffer != nullptr)
+        {
+            output->pool->Release(output->pending.buffer);
+            output->pending = Image {};
+        }
+    }
+}
+
+void FrameFanout::RemoveUnusedOutputs()
+{
+    // an output is kept while the application holds its images (see Preview::AcquireImage)
+    _outputs.erase(std::remove_if(_outputs.begin(), _outputs.end(),
+                                  [](const std::unique_ptr<Output>& output) {
+                                      return output->subscribers == 0 && !output->decoding &&
+                                             output->pending.buffer == nullptr && output->pool->InUse() == 0;
+                                  }),
+                   _outputs.end());
+}
+
+void FrameFanout::Push(Subscriber& subscriber, const QueuedImage& entry)
+{
+    QueuedImage dropped {};
+    {
+        std::lock_guard<std::mutex> lock {subscriber.mutex};
+        const size_t queue_size = std::max(1u, subscriber.subscription.queueSize);
+        bool keep = true;
+        if (subscriber.queue.size() >= queue_size)
+        {
+            if (subscriber.subscription.dropPolicy == PreviewDropPolicy::DropNewest)
+            {
+                dropped = entry;
+                keep = false;
+            }
+            else
+            {
+                dropped = subscriber.queue.front();
+                subscriber.queue.pop_front();
+            }
+        }
+        if (keep)
+        {
+            subscriber.queue.push_back(entry);
+        }
+    }
+    subscriber.cv.notify_one();
+    if (dropped.pool != nullptr)
+    {
+        LOG_TRACE(LOG_TAG, "Subscriber queue is full, dropping frame");
+        dropped.pool->Release(dropped.image.buffer);
+    }
+}
+
+void FrameFanout::DeliveryLoop(Subscriber& subscriber)
+{
+    std::unique_lock<std::mutex> lock {subscriber.mutex};
+    while (true)
+    {
+        subscriber.cv.wait(lock, [&subscriber] { return subscriber.stop || !subscriber.queue.empty(); });
+        if (subscriber.stop)
+        {
+            break;
+        }
+        auto entry = subscriber.queue.front();
+        subscriber.queue.pop_front();
+        lock.unlock();
+        try
+        {
+            subscriber.callback->OnPreviewImageReady(entry.image);
+        }
+        catch (...)
+        {
+            LOG_ERROR(LOG_TAG, "Subscriber callback exception");
+        }
+        if (entry.pool != nullptr)
+        {
+            entry.pool->Release(entry.image.buffer);
+        }
+        lock.lock();
+    }
+}
+
+void FrameFanout::Stop(Subscriber& subscriber)
+{
+    {
+        std::lock_guard<std::mutex> lock {subscriber.mutex};
+        subscriber.stop = true;
+    }
+    subscriber.cv.notify_one();
+    if (subscriber.thread.joinable())
+    {
+        subscriber.thread.join();
+    }
+    for (auto& entry : subscriber.queue)
+    {
+        entry.pool->Release(entry.image.buffer);
+    }
+    subscriber.queue.clear();
+}
+} // namespace Capture
+} // namespace RealSenseID
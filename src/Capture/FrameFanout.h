@@ -0,0 +1,111 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/Preview.h"
+#include "StreamConverter.h"
+#include "FramePool.h"
+#include "DecodeExecutor.h"
+#include "LibraryThread.h"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace RealSenseID
+{
+namespace Capture
+{
+// Delivers the preview frames to the preview's subscribers (see Preview::Subscribe).
+// As the tap of the capture's converter it decodes each frame once per distinct format, scale and quality of the
+// subscribers, except those of the converter itself, whose image is shared. Deliver() then queues the images to
+// the subscribers, each served by its own thread. Images are shared by the reference counts of their frame pools.
+// Subscribe(), Unsubscribe() and the reference counts are thread safe. OnFrameConverted(), Deliver() and Discard()
+// are called by the preview thread.
+class FrameFanout : public FrameTap
+{
+public:
+    // primary_pool: the pool of the images converted by the capture's converter
+    FrameFanout(const PreviewConfig& config, FramePool& primary_pool, DecodeExecutor* executor);
+    ~FrameFanout(); // stops the subscribers' threads, their queued frames are dropped
+
+    FrameFanout(const FrameFanout&) = delete;
+    FrameFanout& operator=(const FrameFanout&) = delete;
+
+    bool Subscribe(PreviewImageReadyCallback& callback, const PreviewSubscription& subscription);
+    bool Unsubscribe(PreviewImageReadyCallback& callback);
+
+    // decode the frame for the subscribers' formats, kept for the following Deliver() or Discard()
+    void OnFrameConverted(buffer frame_buffer, const Image& image, bool cropped) override;
+    // queue the frame converted last to the subscribers. primary: the converter's image, with its frame number
+    void Deliver(const Image& primary);
+    // drop the frame converted last
+    void Discard();
+
+    // reference counts of the images decoded for the subscribers (see FramePool)
+    bool AddRef(const unsigned char* buffer);
+    bool Release(const unsigned char* buffer);
+    unsigned int InUse();
+
+private:
+    // decoder and images of one format, scale and quality
+    struct Output
+    {
+        PreviewFormat format;
+        PreviewScale scale;
+        PreviewQuality quality;
+        unsigned int subscribers = 0;
+        std::unique_ptr<StreamConverter> converter; // created on the first frame it decodes
+        std::unique_ptr<FramePool> pool;
+        Image pending; // decoded by OnFrameConverted(), buffer is null if none
+        bool decoding = false; // being decoded by OnFrameConverted() outside the lock
+    };
+
+    // an output's image decoded by OnFrameConverted()
+    struct DecodeJob
+    {
+        Output* output;
+        Image image;
+        bool ok = false;
+    };
+
+    struct QueuedImage
+    {
+        Image image;
+        FramePool* pool;
+    };
+
+    struct Subscriber
+    {
+        PreviewImageReadyCallback* callback;
+        PreviewSubscription subscription;
+        Output* output;
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<QueuedImage> queue; // oldest first, each holds a reference to its image
+        bool stop = false;
+        LibraryThread thread;
+    };
+
+    bool SharesPrimary(const Output& output) const;
+    void ReleasePending();
+    void RemoveUnusedOutputs();
+    static void Push(Subscriber& subscriber, const QueuedImage& entry);
+    static void DeliveryLoop(Subscriber& subscriber);
+    static void Stop(Subscriber& subscriber);
+
+    const PreviewConfig _config;
+    FramePool& _primary_pool;
+    DecodeExecutor* _executor;
+
+    std::mutex _mutex; // guards the outputs and the subscribers
+    std::vector<std::unique_ptr<Output>> _outputs;
+    std::vector<std::unique_ptr<Subscriber>> _subscribers;
+    bool _primary_cropped = false; // the converter's image of the frame converted last is a crop region
+    std::vector<DecodeJob> _decoding; // used by OnFrameConverted() only
+};
+} // namespace Capture
+} // namespace RealSenseID
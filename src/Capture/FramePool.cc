@@ -0,0 +1,116 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "FramePool.h"
+#include "Logger.h"
+#include "RealTimeMode.h"
+#include "LibraryMemory.h"
+
+static const char* LOG_TAG = "FramePool";
+
+namespace RealSenseID
+{
+namespace Capture
+{
+FramePool::FramePool(size_t buffer_count, size_t buffer_size) : _buffer_size(buffer_size)
+{
+    _slots.resize(buffer_count > 0 ? buffer_count : 1, Slot {nullptr, 0});
+    try
+    {
+        for (auto& slot : _slots)
+        {
+            slot.data = static_cast<unsigned char*>(
+                Memory::Allocate(buffer_size, alignof(std::max_align_t), Memory::Category::PreviewFrames));
+            RealTimeMode::Prefault(slot.data, buffer_size);
+        }
+    }
+    catch (...)
+    {
+        for (auto& slot : _slots)
+        {
+            Memory::Deallocate(slot.data, buffer_size);
+        }
+        throw;
+    }
+}
+
+FramePool::~FramePool()
+{
+    for (auto& slot : _slots)
+    {
+        Memory::Deallocate(slot.data, _buffer_size);
+    }
+}
+
+unsigned char* FramePool::Acquire()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& slot : _slots)
+    {
+        if (slot.refs == 0)
+        {
+            slot.refs = 1;
+            return slot.data;
+        }
+    }
+    return nullptr;
+}
+
+bool FramePool::AddRef(const unsigned char* buffer)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto* slot = Find(buffer);
+    if (slot == nullptr || slot->refs == 0)
+    {
+        LOG_ERROR(LOG_TAG, "AddRef of a buffer not in use");
+        return false;
+    }
+    ++slot->refs;
+    return true;
+}
+
+bool FramePool::Release(const unsigned char* buffer)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto* slot = Find(buffer);
+    if (slot == nullptr || slot->refs == 0)
+    {
+        LOG_ERROR(LOG_TAG, "Release of a buffer not in use");
+        return false;
+    }
+    --slot->refs;
+    return true;
+}
+
+size_t FramePool::BufferSize() const
+{
+    return _buffer_size;
+}
+
+unsigned int FramePool::InUse()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    unsigned int in_use = 0;
+    for (const auto& slot : _slots)
+    {
+        if (slot.refs > 0)
+        {
+            ++in_use;
+        }
+    }
+    return in_use;
+}
+
+FramePool::Slot* FramePool::Find(const unsigned char* buffer)
+{
+    for (auto& slot : _slots)
+    {
+        if (slot.data == buffer)
+        {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+} // namespace Capture
+} // namespace RealSenseID
@@ -0,0 +1,56 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+
+namespace RealSenseID
+{
+namespace Capture
+{
+// Fixed set of preview image buffers with reference counts.
+// A buffer is free when its count drops to zero and is then reused for the next frame.
+// Thread safe.
+class FramePool
+{
+public:
+    FramePool(size_t buffer_count, size_t buffer_size);
+    ~FramePool();
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    // return a free buffer with a reference count of 1, or nullptr if all buffers are in use.
+    unsigned char* Acquire();
+
+    // add a reference to a buffer in use. return false if the buffer is not in use or not from this pool.
+    bool AddRef(const unsigned char* buffer);
+
+    // drop a reference. return false if the buffer is not in use or not from this pool.
+    bool Release(const unsigned char* buffer);
+
+    size_t BufferSize() const;
+
+    // number of buffers in use
+    unsigned int InUse();
+
+private:
+    // the buffers are from the library's allocator
+    struct Slot
+    {
+        unsigned char* data;
+        unsigned int refs;
+    };
+
+    Slot* Find(const unsigned char* buffer);
+
+    std::mutex _mutex;
+    std::vector<Slot> _slots;
+    size_t _buffer_size;
+};
+} // namespace Capture
+} // namespace RealSenseID
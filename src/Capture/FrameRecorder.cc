@@ -0,0 +1,143 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "FrameRecorder.h"
+#include "Logger.h"
+#include <cstdio>
+#include <cstring>
+
+static const char* LOG_TAG = "FrameRecorder";
+static const size_t MAX_SPARE_BUFFERS = 4;
+
+namespace RealSenseID
+{
+namespace Capture
+{
+FrameRecorder::FrameRecorder(unsigned int seconds, size_t max_bytes) :
+    _window_micros {static_cast<unsigned long long>(seconds) * 1000000ull}, _max_bytes {max_bytes}
+{
+    _writer_thread = LibraryThread([this]() { WriterLoop(); });
+}
+
+FrameRecorder::~FrameRecorder()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _cv.notify_all();
+    if (_writer_thread.joinable())
+    {
+        _writer_thread.join();
+    }
+}
+
+void FrameRecorder::Push(const unsigned char* data, size_t size, unsigned long long receive_time,
+                         const char* extension)
+{
+    if (data == nullptr || size == 0)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto recycle = [this](Frame& frame) {
+        _bytes -= frame.data.size();
+        if (_spare.size() < MAX_SPARE_BUFFERS)
+        {
+            _spare.push_back(std::move(frame.data));
+        }
+    };
+
+    // evict frames out of the time window, and the oldest ones until the new frame fits
+    while (!_frames.empty() &&
+           (_frames.front().receive_time + _window_micros < receive_time || _bytes + size > _max_bytes))
+    {
+        recycle(_frames.front());
+        _frames.pop_front();
+    }
+    if (_bytes + size > _max_bytes)
+    {
+        LOG_TRACE(LOG_TAG, "No room for frame, %zu bytes waiting to be written", _bytes);
+        return;
+    }
+
+    Frame frame;
+    if (!_spare.empty())
+    {
+        frame.data = std::move(_spare.back());
+        _spare.pop_back();
+    }
+    frame.data.resize(size);
+    ::memcpy(frame.data.data(), data, size);
+    frame.receive_time = receive_time;
+    frame.number = _next_number++;
+    frame.extension = extension;
+    _bytes += size;
+    _frames.push_back(std::move(frame));
+}
+
+bool FrameRecorder::Save(const std::string& directory)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_frames.empty())
+        {
+            return false;
+        }
+        LOG_DEBUG(LOG_TAG, "Saving %zu frames to %s", _frames.size(), directory.c_str());
+        for (auto& frame : _frames)
+        {
+            frame.directory = directory;
+            _to_write.push_back(std::move(frame));
+        }
+        _frames.clear();
+    }
+    _cv.notify_all();
+    return true;
+}
+
+void FrameRecorder::WriterLoop()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true)
+    {
+        _cv.wait(lock, [this] { return _stop || !_to_write.empty(); });
+        if (_to_write.empty()) // stopped, after writing all saved frames
+        {
+            break;
+        }
+        Frame frame = std::move(_to_write.front());
+        _to_write.pop_front();
+
+        // the frame still counts in the budget while being written
+        lock.unlock();
+        WriteFrame(frame);
+        lock.lock();
+
+        _bytes -= frame.data.size();
+        if (_spare.size() < MAX_SPARE_BUFFERS)
+        {
+            _spare.push_back(std::move(frame.data));
+        }
+    }
+}
+
+void FrameRecorder::WriteFrame(const Frame& frame)
+{
+    char name[64];
+    ::snprintf(name, sizeof(name), "frame_%06u_%llu.%s", frame.number, frame.receive_time, frame.extension);
+    std::string path = frame.directory + "/" + name;
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Failed to open %s", path.c_str());
+        return;
+    }
+    auto written = std::fwrite(frame.data.data(), 1, frame.data.size(), file);
+    if (std::fclose(file) != 0 || written != frame.data.size())
+    {
+        LOG_ERROR(LOG_TAG, "Failed to write %s", path.c_str());
+    }
+}
+} // namespace Capture
+} // namespace RealSenseID
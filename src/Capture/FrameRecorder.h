@@ -0,0 +1,68 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "LibraryThread.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstddef>
+
+namespace RealSenseID
+{
+namespace Capture
+{
+// Pre-event recorder of the frames as received from the camera (compressed for MJPEG modes).
+// Keeps the frames of the last seconds in memory, and on Save() hands them to a writer thread that writes them
+// to files, so the capture never waits for the disk.
+// Memory of the kept and the not yet written frames together is bounded by max_bytes: old kept frames are evicted
+// to make room, and new frames are not kept while the frames waiting to be written use the whole budget.
+// Thread safe.
+class FrameRecorder
+{
+public:
+    FrameRecorder(unsigned int seconds, size_t max_bytes);
+    ~FrameRecorder(); // waits for the saved frames to be written
+
+    FrameRecorder(const FrameRecorder&) = delete;
+    FrameRecorder& operator=(const FrameRecorder&) = delete;
+
+    // copy a frame received at receive_time (HostTimeMicros). extension of its file, e.g. "jpg"
+    void Push(const unsigned char* data, size_t size, unsigned long long receive_time, const char* extension);
+
+    // write the kept frames to the (existing) directory in the background and start over.
+    // return false if there are no frames to write
+    bool Save(const std::string& directory);
+
+private:
+    struct Frame
+    {
+        std::vector<unsigned char> data;
+        unsigned long long receive_time;
+        unsigned int number;
+        const char* extension;
+        std::string directory; // set when queued for writing
+    };
+
+    void WriterLoop();
+    void WriteFrame(const Frame& frame);
+
+    const unsigned long long _window_micros;
+    const size_t _max_bytes;
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::deque<Frame> _frames;   // kept frames, oldest first
+    std::deque<Frame> _to_write; // frames queued for the writer, oldest first
+    std::vector<std::vector<unsigned char>> _spare; // buffers of written / evicted frames, reused for new frames
+    size_t _bytes = 0;           // of _frames and _to_write
+    unsigned int _next_number = 0;
+    bool _stop = false;
+    LibraryThread _writer_thread;
+};
+} // namespace Capture
+} // namespace RealSenseID
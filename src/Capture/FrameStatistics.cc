@@ -0,0 +1,68 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "FrameStatistics.h"
+#include "MetricsRegistry.h"
+#include <algorithm>
+
+namespace RealSenseID
+{
+namespace Capture
+{
+constexpr size_t FrameStatistics::WINDOW_SIZE;
+
+void FrameStatistics::Reset()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _frames = 0;
+    _dropped_frames = 0;
+    _next = 0;
+    _count = 0;
+}
+
+void FrameStatistics::OnFrameDelivered(const Image& image, unsigned int decode_micros, unsigned long long deliver_time)
+{
+    float latency_ms = 0;
+    if (image.receive_time != 0 && deliver_time > image.receive_time)
+    {
+        latency_ms = static_cast<float>(deliver_time - image.receive_time) / 1000.0f;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    ++_frames;
+    _decode_ms[_next] = static_cast<float>(decode_micros) / 1000.0f;
+    _latency_ms[_next] = latency_ms;
+    _next = (_next + 1) % WINDOW_SIZE;
+    _count = std::min(_count + 1, WINDOW_SIZE);
+}
+
+void FrameStatistics::OnFramesDropped(unsigned int count)
+{
+    MetricsRegistry::OnPreviewFramesDropped(count);
+    std::lock_guard<std::mutex> lock(_mutex);
+    _dropped_frames += count;
+}
+
+PreviewStatistics FrameStatistics::Get()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    PreviewStatistics statistics;
+    statistics.frames = _frames;
+    statistics.dropped_frames = _dropped_frames;
+    if (_count == 0)
+    {
+        return statistics;
+    }
+    float decode_sum = 0, latency_sum = 0;
+    for (size_t i = 0; i < _count; i++)
+    {
+        decode_sum += _decode_ms[i];
+        latency_sum += _latency_ms[i];
+        statistics.max_decode_ms = std::max(statistics.max_decode_ms, _decode_ms[i]);
+        statistics.max_latency_ms = std::max(statistics.max_latency_ms, _latency_ms[i]);
+    }
+    statistics.decode_ms = decode_sum / _count;
+    statistics.latency_ms = latency_sum / _count;
+    return statistics;
+}
+} // namespace Capture
+} // namespace RealSenseID
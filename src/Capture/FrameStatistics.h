@@ -0,0 +1,40 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/Preview.h"
+#include <mutex>
+#include <cstddef>
+
+namespace RealSenseID
+{
+namespace Capture
+{
+// Rolling preview statistics: counters since Reset() and decode / latency over the last WINDOW_SIZE frames.
+// Thread safe.
+class FrameStatistics
+{
+public:
+    void Reset();
+
+    // a frame is delivered to the callback at deliver_time (HostTimeMicros)
+    void OnFrameDelivered(const Image& image, unsigned int decode_micros, unsigned long long deliver_time);
+    void OnFramesDropped(unsigned int count);
+
+    // all fields but buffers_in_use, which the frame pool knows
+    PreviewStatistics Get();
+
+private:
+    static constexpr size_t WINDOW_SIZE = 30;
+
+    std::mutex _mutex;
+    unsigned int _frames = 0;
+    unsigned int _dropped_frames = 0;
+    float _decode_ms[WINDOW_SIZE] = {0};
+    float _latency_ms[WINDOW_SIZE] = {0};
+    size_t _next = 0;  // next window slot
+    size_t _count = 0; // used window slots
+};
+} // namespace Capture
+} // namespace RealSenseID
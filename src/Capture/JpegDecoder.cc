@@ -0,0 +1,126 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "JpegDecoder.h"
+#include <algorithm>
+#include <cstring>
+
+#ifdef LINUX
+#include "V4L2JpegDecoder.h"
+#endif
+
+namespace RealSenseID
+{
+namespace Capture
+{
+#ifdef ANDROID
+static constexpr unsigned int RGB_PIXEL_SIZE = 4;
+#else
+static constexpr unsigned int RGB_PIXEL_SIZE = 3;
+#endif
+
+std::unique_ptr<JpegDecoder> CreateHardwareJpegDecoder(unsigned int width, unsigned int height)
+{
+#ifdef LINUX
+    return V4L2JpegDecoder::Create(width, height);
+#else
+    // no hardware decoder on this platform yet
+    (void)width;
+    (void)height;
+    return nullptr;
+#endif
+}
+
+static inline unsigned char Clamp(int value)
+{
+    return static_cast<unsigned char>(std::min(255, std::max(0, value)));
+}
+
+static inline void PutRgb(int luma, int r_offset, int g_offset, int b_offset, unsigned char* out)
+{
+    out[0] = Clamp(luma + r_offset);
+    out[1] = Clamp(luma + g_offset);
+    out[2] = Clamp(luma + b_offset);
+    if (RGB_PIXEL_SIZE == 4)
+        out[3] = 255;
+}
+
+// full range BT.601 in 16 bit fixed point, the same conversion as libjpeg's. scalar: the library's SIMD kernels
+// are the raw10 unpack ones. the chroma offsets are computed once per pixel pair, which shares them.
+static void ConvertRowToRgb(const unsigned char* y, const unsigned char* u, const unsigned char* v,
+                            unsigned int chroma_step, unsigned int width, unsigned char* out)
+{
+    constexpr int CR_R = 91881, CB_G = 22554, CR_G = 46802, CB_B = 116130, HALF = 1 << 15;
+    for (unsigned int x = 0; x < width; x += 2, u += chroma_step, v += chroma_step)
+    {
+        const int cb = *u - 128, cr = *v - 128;
+        const int r_offset = (CR_R * cr + HALF) >> 16;
+        const int g_offset = (-CB_G * cb - CR_G * cr + HALF) >> 16;
+        const int b_offset = (CB_B * cb + HALF) >> 16;
+        PutRgb(y[x], r_offset, g_offset, b_offset, out);
+        out += RGB_PIXEL_SIZE;
+        if (x + 1 < width)
+        {
+            PutRgb(y[x + 1], r_offset, g_offset, b_offset, out);
+            out += RGB_PIXEL_SIZE;
+        }
+    }
+}
+
+bool ConvertYuv420(const Yuv420Image& src, PreviewFormat format, Image* res)
+{
+    const unsigned int width = src.width, height = src.height;
+    const unsigned int chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+    switch (format)
+    {
+    case PreviewFormat::GRAY8:
+        for (unsigned int row = 0; row < height; row++)
+            ::memcpy(res->buffer + row * width, src.y + row * src.y_stride, width);
+        res->stride = width;
+        res->size = width * height;
+        break;
+    case PreviewFormat::I420: {
+        for (unsigned int row = 0; row < height; row++)
+            ::memcpy(res->buffer + row * width, src.y + row * src.y_stride, width);
+        unsigned char* u_plane = res->buffer + width * height;
+        unsigned char* v_plane = u_plane + chroma_width * chroma_height;
+        for (unsigned int row = 0; row < chroma_height; row++)
+        {
+            const unsigned char* u = src.u + row * src.chroma_stride;
+            const unsigned char* v = src.v + row * src.chroma_stride;
+            if (src.chroma_step == 1)
+            {
+                ::memcpy(u_plane + row * chroma_width, u, chroma_width);
+                ::memcpy(v_plane + row * chroma_width, v, chroma_width);
+                continue;
+            }
+            for (unsigned int x = 0; x < chroma_width; x++)
+            {
+                u_plane[row * chroma_width + x] = u[x * src.chroma_step];
+                v_plane[row * chroma_width + x] = v[x * src.chroma_step];
+            }
+        }
+        res->stride = width;
+        res->size = width * height + 2 * chroma_width * chroma_height;
+        break;
+    }
+    case PreviewFormat::RGB:
+        for (unsigned int row = 0; row < height; row++)
+        {
+            const unsigned int chroma_row = row / 2;
+            ConvertRowToRgb(src.y + row * src.y_stride, src.u + chroma_row * src.chroma_stride,
+                            src.v + chroma_row * src.chroma_stride, src.chroma_step, width,
+                            res->buffer + row * width * RGB_PIXEL_SIZE);
+        }
+        res->stride = width * RGB_PIXEL_SIZE;
+        res->size = width * height * RGB_PIXEL_SIZE;
+        break;
+    default:
+        return false;
+    }
+    res->width = width;
+    res->height = height;
+    return true;
+}
+} // namespace Capture
+} // namespace RealSenseID
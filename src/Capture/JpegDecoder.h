@@ -0,0 +1,50 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/Preview.h"
+#include "StreamConverter.h"
+#include <memory>
+
+namespace RealSenseID
+{
+namespace Capture
+{
+// Hardware jpeg decoder used by StreamConverter (see PreviewConfig::previewDecoder).
+// StreamConverter decodes with libjpeg the frames a decoder does not support or fails to decode.
+class JpegDecoder
+{
+public:
+    virtual ~JpegDecoder() = default;
+
+    virtual const char* Name() const = 0;
+
+    // true if frames can be decoded to the format at the scale (libjpeg's scale_denom)
+    virtual bool Supports(PreviewFormat format, unsigned int scale_denom) const = 0;
+
+    // decode the frame into res->buffer, sized by GetImageSize(). res->width / height / stride / size are set
+    virtual bool Decode(buffer frame_buffer, PreviewFormat format, Image* res) = 0;
+};
+
+// the platform's hardware decoder for frames of the given dimensions, nullptr if there is none
+std::unique_ptr<JpegDecoder> CreateHardwareJpegDecoder(unsigned int width, unsigned int height);
+
+// 4:2:0 yuv image as output by the hardware decoders: planar (chroma_step 1) or with interleaved chroma (NV12,
+// chroma_step 2). full range BT.601, as in jpeg
+struct Yuv420Image
+{
+    const unsigned char* y = nullptr;
+    const unsigned char* u = nullptr;
+    const unsigned char* v = nullptr;
+    unsigned int y_stride = 0;
+    unsigned int chroma_stride = 0;
+    unsigned int chroma_step = 1;
+    unsigned int width = 0;
+    unsigned int height = 0;
+};
+
+// convert to a full scale RGB, GRAY8 or I420 preview image in res->buffer and set its width / height / stride / size
+bool ConvertYuv420(const Yuv420Image& src, PreviewFormat format, Image* res);
+} // namespace Capture
+} // namespace RealSenseID
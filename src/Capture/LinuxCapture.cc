@@ -1,14 +1,20 @@
 #include "LinuxCapture.h"
 #include "Logger.h"
+#include "RealTimeMode.h"
 #include <linux/videodev2.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
 #include <unistd.h>
 #include <sstream>
 #include <cstring>
+#include <cstdlib>
 #include <iostream>
+#include <algorithm>
+#include <chrono>
 #include <memory>
 
 namespace RealSenseID
@@ -19,6 +25,8 @@ static const char* LOG_TAG = "LinuxCapture";
 
 static const std::string VIDEO_DEV = "/dev/video";
 static const int FAILED_V4L = -1;
+static const int FRAME_WAIT_SECONDS = 1; // max time to wait for next frame
+static const int MAX_EVENTS = 2;          // the camera and the wakeup eventfd
 
 static void ThrowIfFailed(const char* what, int res)
 {
@@ -29,23 +37,85 @@ static void ThrowIfFailed(const char* what, int res)
     throw std::runtime_error(err_stream.str());
 }
 
-void CleanMMAPBuffers(std::vector<buffer>& buffer_list)
+static const unsigned int MIN_CAPTURE_BUFFERS = 2;
+static const unsigned int MAX_CAPTURE_BUFFERS = 32;
+
+void CaptureHandle::CleanBuffers()
 {
     int ret;
-    for (int i = 0; i < buffer_list.size(); i++)
+    for (int i = 0; i < _buffers.size(); i++)
     {
-        if (buffer_list[i].size > 0)
+        if (_buffers[i].size == 0)
+            continue;
+        if (_memory == V4L2_MEMORY_USERPTR)
         {
-            ret = munmap(buffer_list[i].data, buffer_list[i].size); // unmap buffers
-            if (ret == FAILED_V4L)
-                LOG_ERROR(LOG_TAG, " unmapping buffer %d failed", i);
+            free(_buffers[i].data);
+            continue;
         }
+        ret = munmap(_buffers[i].data, _buffers[i].size); // unmap buffers
+        if (ret == FAILED_V4L)
+            LOG_ERROR(LOG_TAG, " unmapping buffer %d failed", i);
+    }
+    _buffers.clear();
+    _buffers_size.Set(0);
+}
+
+void CaptureHandle::CreateMMAPBuffers(unsigned int count)
+{
+    v4l2_requestbuffers req = {0};
+    req.count = count;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    ThrowIfFailed("set memory mode", ioctl(_fd, VIDIOC_REQBUFS, &req));
+    LOG_DEBUG(LOG_TAG, " got %d buffers", req.count);
+    _memory = V4L2_MEMORY_MMAP;
+
+    _buffers = std::vector<buffer>(req.count);
+    for (int i = 0; i < _buffers.size(); i++)
+    {
+        v4l2_buffer buf = {0};
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+        ThrowIfFailed("req buffer", ioctl(_fd, VIDIOC_QUERYBUF, &buf));
+        auto* data = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, buf.m.offset);
+        ThrowIfFailed("mmap", (data == MAP_FAILED) - 2);
+        _buffers[i].data = static_cast<unsigned char*>(data);
+        _buffers[i].size = buf.length;
+        _buffers_size.Set(static_cast<size_t>(buf.length) * (i + 1));
+    }
+}
+
+// returns false if the driver does not support user pointers
+bool CaptureHandle::CreateUserBuffers(unsigned int count, unsigned int size)
+{
+    v4l2_requestbuffers req = {0};
+    req.count = count;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_USERPTR;
+    if (ioctl(_fd, VIDIOC_REQBUFS, &req) == FAILED_V4L || req.count == 0)
+        return false;
+    LOG_DEBUG(LOG_TAG, " got %d user buffers", req.count);
+    _memory = V4L2_MEMORY_USERPTR;
+
+    auto page_size = static_cast<unsigned int>(sysconf(_SC_PAGESIZE));
+    size = (size + page_size - 1) / page_size * page_size;
+    _buffers = std::vector<buffer>(req.count);
+    for (auto& user_buffer : _buffers)
+    {
+        void* data = nullptr;
+        if (posix_memalign(&data, page_size, size) != 0)
+            throw std::runtime_error("failed to allocate capture buffer");
+        user_buffer.data = static_cast<unsigned char*>(data);
+        user_buffer.size = size;
     }
+    _buffers_size.Set(static_cast<size_t>(size) * _buffers.size());
+    return true;
 }
 
 CaptureHandle::CaptureHandle(const PreviewConfig& config): _config(config)
 {
-    _stream_converter = std::make_unique<StreamConverter>(_config.previewMode);
+    _stream_converter = std::make_unique<StreamConverter>(_config);
     
     std::string dev = VIDEO_DEV + std::to_string(_config.cameraNumber);
     _fd = open(dev.c_str(), O_RDWR | O_NONBLOCK, 0);
@@ -58,50 +128,56 @@ CaptureHandle::CaptureHandle(const PreviewConfig& config): _config(config)
         format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
         if(attr.format == MJPEG)
             format.fmt.pix.pixelformat = V4L2_PIX_FMT_MJPEG;
+        else if (attr.format == YUY2)
+            format.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
         format.fmt.pix.width = attr.width;
         format.fmt.pix.height = attr.height;
         ThrowIfFailed("set format", ioctl(_fd, VIDIOC_S_FMT, &format));
+        // the driver picks another format if the camera has no uncompressed stream
+        if (attr.format == YUY2 && format.fmt.pix.pixelformat != V4L2_PIX_FMT_YUYV)
+            throw std::runtime_error("camera does not support yuy2 preview");
 
-        // set memory mode
-        v4l2_requestbuffers req = {0};
-        req.count = 4;
-        req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        req.memory = V4L2_MEMORY_MMAP;
-        ThrowIfFailed("set memory mode", ioctl(_fd, VIDIOC_REQBUFS, &req));
-        LOG_DEBUG(LOG_TAG, " got %d buffers", req.count);
-
-        // create buffers
-        _buffers = std::vector<buffer>(req.count);
-        for (int i = 0; i < _buffers.size(); i++)
+        // set memory mode and create buffers
+        auto count = std::min(MAX_CAPTURE_BUFFERS, std::max(MIN_CAPTURE_BUFFERS, _config.captureBufferCount));
+        bool user_buffers = false;
+        if (_config.captureMemory == CaptureMemory::USERPTR)
         {
-            v4l2_buffer buf = {0};
-            buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-            buf.memory = V4L2_MEMORY_MMAP;
-            buf.index = i;
-            ThrowIfFailed("req buffer", ioctl(_fd, VIDIOC_QUERYBUF, &buf));
-            _buffers[i].data = static_cast<unsigned char*>(
-                mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, buf.m.offset));
-            ThrowIfFailed("mmap", (_buffers[i].data == MAP_FAILED) - 2);
-            _buffers[i].size = buf.length;
+            user_buffers = CreateUserBuffers(count, format.fmt.pix.sizeimage);
+            if (!user_buffers)
+                LOG_WARNING(LOG_TAG, "user pointer capture is not supported, using mmap");
         }
+        if (!user_buffers)
+            CreateMMAPBuffers(count);
 
         // start stream
         unsigned int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
         ThrowIfFailed("start stream", ioctl(_fd, VIDIOC_STREAMON, &type));
 
-        // create buffers
-        for (int i = 0; i < req.count; i++)
-        {
-            v4l2_buffer buf = {0};
-            buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-            buf.memory = V4L2_MEMORY_MMAP;
-            buf.index = i;
-            ThrowIfFailed("req buffer", ioctl(_fd, VIDIOC_QBUF, &buf));
-        }
+        // queue buffers
+        for (unsigned int i = 0; i < _buffers.size(); i++)
+            QueueBuffer(i);
+
+        _wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        ThrowIfFailed("eventfd", _wakeup_fd);
+        _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        ThrowIfFailed("epoll", _epoll_fd);
+        epoll_event ev = {0};
+        ev.events = EPOLLIN;
+        ev.data.fd = _fd;
+        ThrowIfFailed("epoll add camera", epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _fd, &ev));
+        ev.data.fd = _wakeup_fd;
+        ThrowIfFailed("epoll add wakeup", epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _wakeup_fd, &ev));
+        _capture_thread = LibraryThread(&CaptureHandle::CaptureLoop, this);
     }
     catch (const std::exception& ex)
     {
-        CleanMMAPBuffers(_buffers);
+        int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        ioctl(_fd, VIDIOC_STREAMOFF, &type);
+        CleanBuffers();
+        if (_epoll_fd != -1)
+            close(_epoll_fd);
+        if (_wakeup_fd != -1)
+            close(_wakeup_fd);
         if (_fd)
             close(_fd);
         throw ex;
@@ -110,43 +186,222 @@ CaptureHandle::CaptureHandle(const PreviewConfig& config): _config(config)
 
 CaptureHandle ::~CaptureHandle()
 {
+    {
+        std::lock_guard<std::mutex> lock {_frame_mutex};
+        _stop = true;
+    }
+    _pause_cv.notify_all();
+    Wakeup();
+    if (_capture_thread.joinable())
+        _capture_thread.join();
+    close(_epoll_fd);
+    close(_wakeup_fd);
+
     int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     ioctl(_fd, VIDIOC_STREAMOFF, &type); // shutdown stream
-    CleanMMAPBuffers(_buffers);
+    CleanBuffers();
     if (_fd)
         close(_fd);
 }
 
-bool CaptureHandle::Read(RealSenseID::Image* res)
+void CaptureHandle::Wakeup()
 {
-    bool valid_read = false;
-    struct v4l2_buffer buf = {0};
-    struct timeval tv = {0}; 
-    buffer buffer_to_convert;
-    tv.tv_sec = 1; // max time to wait for next frame
+    uint64_t one = 1;
+    auto ignored = write(_wakeup_fd, &one, sizeof(one));
+    (void)ignored;
+}
 
-    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE; 
-    buf.memory = V4L2_MEMORY_MMAP;
-    buf.index=0;
+void CaptureHandle::Pause()
+{
+    int dropped_index = NO_FRAME;
+    {
+        std::lock_guard<std::mutex> lock {_frame_mutex};
+        _paused = true;
+        // the pending frame would be stale on resume
+        dropped_index = _pending_index;
+        _pending_index = NO_FRAME;
+    }
+    _frame_cv.notify_all();
+    Wakeup();
+    if (dropped_index != NO_FRAME)
+        QueueBuffer(dropped_index);
+}
 
-    fd_set fds;
-    FD_ZERO(&fds);
-    FD_SET(_fd, &fds);
-    ThrowIfFailed("wait for frame", select(_fd + 1, &fds, NULL, NULL, &tv)); //wait for frame 
-    if (ioctl(_fd, VIDIOC_DQBUF, &buf) == FAILED_V4L){ // dequeue frame from buffer. 
-        return false;
+void CaptureHandle::Standby()
+{
+    Pause();
+    {
+        std::lock_guard<std::mutex> lock {_frame_mutex};
+        _standby = true;
     }
+    _pause_cv.notify_all();
+}
 
-    //now buf.index is the index of the latest buffer filled
-    buffer_to_convert.data = _buffers[buf.index].data;
-    buffer_to_convert.size = buf.bytesused;
-    valid_read = _stream_converter->Buffer2Image(res,buffer_to_convert);
+void CaptureHandle::Resume()
+{
+    {
+        std::lock_guard<std::mutex> lock {_frame_mutex};
+        _paused = false;
+        _standby = false;
+    }
+    _pause_cv.notify_all();
+}
 
-    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE; 
-    buf.memory = V4L2_MEMORY_MMAP;
-    ThrowIfFailed("qbuffer", ioctl(_fd, VIDIOC_QBUF, &buf)); // queue next frame
+void CaptureHandle::DiscardCompletedFrames()
+{
+    v4l2_buffer buf = {0};
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = _memory;
+    unsigned int discarded = 0;
+    while (ioctl(_fd, VIDIOC_DQBUF, &buf) != FAILED_V4L)
+    {
+        QueueBuffer(buf.index);
+        ++discarded;
+    }
+    if (discarded > 0)
+        LOG_TRACE(LOG_TAG, "discarded %u frames completed while paused", discarded);
+}
+
+void CaptureHandle::Interrupt()
+{
+    {
+        std::lock_guard<std::mutex> lock {_frame_mutex};
+        _interrupted = true;
+    }
+    _frame_cv.notify_all();
+}
+
+void CaptureHandle::QueueBuffer(unsigned int index)
+{
+    v4l2_buffer buf = {0};
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = _memory;
+    buf.index = index;
+    if (_memory == V4L2_MEMORY_USERPTR)
+    {
+        buf.m.userptr = reinterpret_cast<unsigned long>(_buffers[index].data);
+        buf.length = _buffers[index].size;
+    }
+    ThrowIfFailed("qbuffer", ioctl(_fd, VIDIOC_QBUF, &buf));
+}
+
+void CaptureHandle::CaptureLoop()
+{
+    RealTimeMode::EnterIoThread("capture");
+    try
+    {
+        while (!_stop)
+        {
+            bool was_paused = false;
+            {
+                // while paused the driver drops the frames, and this thread does not wake up. in standby it keeps
+                // giving the frames back to the driver below
+                std::unique_lock<std::mutex> lock {_frame_mutex};
+                was_paused = _paused && !_standby;
+                _pause_cv.wait(lock, [this] { return !_paused || _standby || _stop; });
+            }
+            // the buffers filled before the driver ran out of them hold frames of the pause
+            if (was_paused && !_stop)
+                DiscardCompletedFrames();
+
+            epoll_event events[MAX_EVENTS];
+            int count = epoll_wait(_epoll_fd, events, MAX_EVENTS, -1);
+            if (count == FAILED_V4L && errno == EINTR)
+                continue;
+            ThrowIfFailed("wait for frame", count);
+            for (int i = 0; i < count; i++)
+            {
+                if (events[i].data.fd == _wakeup_fd)
+                {
+                    uint64_t value;
+                    auto ignored = read(_wakeup_fd, &value, sizeof(value));
+                    (void)ignored;
+                }
+            }
+            if (_stop)
+                break;
+
+            v4l2_buffer buf = {0};
+            buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            buf.memory = _memory;
+            if (ioctl(_fd, VIDIOC_DQBUF, &buf) == FAILED_V4L) // no frame ready yet
+                continue;
+            auto receive_time = HostTimeMicros();
+
+            int dropped_index = NO_FRAME;
+            {
+                std::lock_guard<std::mutex> lock {_frame_mutex};
+                if (_paused)
+                {
+                    dropped_index = static_cast<int>(buf.index); // dequeued while pausing
+                }
+                else if (_pending_index != NO_FRAME)
+                {
+                    dropped_index = _pending_index;
+                    ++_dropped_frames;
+                }
+                if (!_paused)
+                {
+                    _pending_index = static_cast<int>(buf.index);
+                    _pending_size = buf.bytesused;
+                    _pending_time = receive_time;
+                }
+            }
+            _frame_cv.notify_one();
 
+            // the newer frame wins, give the older one back to the driver
+            if (dropped_index != NO_FRAME)
+                QueueBuffer(dropped_index);
+        }
+    }
+    catch (const std::exception& ex)
+    {
+        LOG_ERROR(LOG_TAG, "Capture thread: %s", ex.what());
+        std::lock_guard<std::mutex> lock {_frame_mutex};
+        _capture_error = ex.what();
+    }
+    _frame_cv.notify_one();
+}
+
+bool CaptureHandle::Read(RealSenseID::Image* res)
+{
+    buffer buffer_to_convert;
+    unsigned int index;
+    {
+        std::unique_lock<std::mutex> lock {_frame_mutex};
+        _frame_cv.wait_for(lock, std::chrono::seconds {FRAME_WAIT_SECONDS}, [this] {
+            return _pending_index != NO_FRAME || !_capture_error.empty() || _paused || _interrupted;
+        });
+        if (!_capture_error.empty())
+            throw std::runtime_error(_capture_error);
+        if (_pending_index == NO_FRAME || _paused || _interrupted)
+            return false;
+        if (_dropped_frames > 0)
+        {
+            LOG_TRACE(LOG_TAG, "dropped %u frames", _dropped_frames);
+            _total_dropped_frames += _dropped_frames;
+            _dropped_frames = 0;
+        }
+        index = static_cast<unsigned int>(_pending_index);
+        buffer_to_convert.data = _buffers[index].data;
+        buffer_to_convert.size = _pending_size;
+        res->receive_time = _pending_time;
+        _pending_index = NO_FRAME;
+    }
+
+    // decode while the capture thread keeps dequeuing into the other buffers
+    bool valid_read = false;
+    try
+    {
+        valid_read = _stream_converter->Buffer2Image(res, buffer_to_convert);
+    }
+    catch (...)
+    {
+        QueueBuffer(index);
+        throw;
+    }
+    QueueBuffer(index);
     return valid_read;
 }
 } // namespace Capture
-} // namespace RealSenseI
\ No newline at end of file
+} // namespace RealSenseID
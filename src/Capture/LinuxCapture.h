@@ -2,8 +2,15 @@
 
 #include "RealSenseID/Preview.h"
 #include "StreamConverter.h"
+#include "LibraryMemory.h"
+#include "LibraryThread.h"
 #include <vector>
 #include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <string>
 
 namespace RealSenseID
 {
@@ -17,16 +24,69 @@ public:
     ~CaptureHandle();
     bool Read(RealSenseID::Image* res);
 
+    // stop dequeuing frames until Resume(). a blocked Read() returns false right away
+    void Pause();
+    // paused, but the frames are dequeued and queued back as they arrive, so the stream stays live with free buffers
+    // and the first frame after Resume() is the next one the camera sends. costs a wakeup per frame, no decode
+    void Standby();
+    void Resume();
+    // make a blocked Read() and all later calls return false right away
+    void Interrupt();
+
+    // the converter is used by Read(), access it from the reading thread only
+    StreamConverter& GetStreamConverter()
+    {
+        return *_stream_converter;
+    }
+
+    // frames dropped by the capture since it started, updated by Read(). access it from the reading thread only
+    unsigned int DroppedFrames() const
+    {
+        return _total_dropped_frames;
+    }
+
     // prevent copy or assignment
     // only single connection is allowed to a capture device.
     CaptureHandle(const CaptureHandle&) = delete;
     void operator=(const CaptureHandle&) = delete;
 
 private:
+    // the capture thread dequeues frames as they arrive and keeps only the latest one pending for Read().
+    // an older pending frame is queued back to the driver (dropped), so decoding never builds a backlog.
+    void CaptureLoop();
+    void QueueBuffer(unsigned int index);
+    void CreateMMAPBuffers(unsigned int count);
+    bool CreateUserBuffers(unsigned int count, unsigned int size);
+    void CleanBuffers();
+    void Wakeup();
+    // queue back the frames completed while paused (stale by now)
+    void DiscardCompletedFrames();
+
+    static constexpr int NO_FRAME = -1;
+
     int _fd = 0;
+    int _wakeup_fd = -1;
+    int _epoll_fd = -1;
+    unsigned int _memory = 0; // v4l2_memory of _buffers
     std::vector<buffer> _buffers;
+    Memory::TrackedBytes _buffers_size {Memory::Category::PreviewFrames};
     std::unique_ptr<StreamConverter> _stream_converter;
     PreviewConfig _config;
+
+    LibraryThread _capture_thread;
+    std::atomic_bool _stop {false};
+    std::mutex _frame_mutex;
+    std::condition_variable _frame_cv;
+    std::condition_variable _pause_cv;
+    bool _paused = false;
+    bool _standby = false;
+    bool _interrupted = false;
+    int _pending_index = NO_FRAME;
+    unsigned int _pending_size = 0;
+    unsigned long long _pending_time = 0; // host receive time
+    unsigned int _dropped_frames = 0; // since the last Read()
+    unsigned int _total_dropped_frames = 0;
+    std::string _capture_error;
 };
 } // namespace Capture
 } // namespace RealSenseID
@@ -8,6 +8,8 @@
 #include <ksmedia.h>
 #include <string>
 #include <sstream>
+#include <mutex>
+#include <chrono>
 
 #include <ntverp.h>
 #if VER_PRODUCTBUILD > 9600 // Sensor timestamps require WinSDK ver 10 (10.0.15063) or later. see Readme for more info.
@@ -23,6 +25,8 @@ static const char* LOG_TAG = "MSMFCapture";
 static const DWORD STREAM_NUMBER = MF_SOURCE_READER_FIRST_VIDEO_STREAM;
 static const GUID W10_FORMAT = {FCC('pBAA'), 0x0000, 0x0010, {0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71}};
 constexpr uint8_t MS_HEADER_SIZE = 40;
+static const int FRAME_WAIT_SECONDS = 1; // max time to wait for next frame
+static const int FLUSH_WAIT_SECONDS = 1;
 
 MsmfInitializer::MsmfInitializer()
 {
@@ -62,6 +66,120 @@ static void ThrowIfFailed(const char* what, HRESULT hr)
     throw std::runtime_error(err_stream.str());
 }
 
+// forwards the async source reader's notifications to the capture handle. the handle is used under _handle_mutex
+// only, so once Detach() returns no notification is running or will reach it.
+class SourceReaderCallback : public IMFSourceReaderCallback
+{
+public:
+    explicit SourceReaderCallback(CaptureHandle* handle) : _handle(handle)
+    {
+    }
+
+    // the handle is going away, wait for a running notification and ignore later ones
+    void Detach()
+    {
+        std::lock_guard<std::mutex> lock {_handle_mutex};
+        _handle = nullptr;
+    }
+
+    STDMETHODIMP QueryInterface(REFIID iid, void** ppv) override
+    {
+        if (ppv == nullptr)
+            return E_POINTER;
+        if (iid == __uuidof(IUnknown) || iid == __uuidof(IMFSourceReaderCallback))
+        {
+            *ppv = static_cast<IMFSourceReaderCallback*>(this);
+            AddRef();
+            return S_OK;
+        }
+        *ppv = nullptr;
+        return E_NOINTERFACE;
+    }
+
+    STDMETHODIMP_(ULONG) AddRef() override
+    {
+        return InterlockedIncrement(&_refs);
+    }
+
+    STDMETHODIMP_(ULONG) Release() override
+    {
+        ULONG refs = InterlockedDecrement(&_refs);
+        if (refs == 0)
+            delete this;
+        return refs;
+    }
+
+    STDMETHODIMP OnReadSample(HRESULT hr, DWORD, DWORD, LONGLONG, IMFSample* sample) override
+    {
+        std::lock_guard<std::mutex> lock {_handle_mutex};
+        if (_handle)
+            _handle->OnReadSample(hr, sample);
+        return S_OK;
+    }
+
+    STDMETHODIMP OnFlush(DWORD) override
+    {
+        std::lock_guard<std::mutex> lock {_handle_mutex};
+        if (_handle)
+            _handle->OnFlush();
+        return S_OK;
+    }
+
+    STDMETHODIMP OnEvent(DWORD, IMFMediaEvent*) override
+    {
+        return S_OK;
+    }
+
+private:
+    virtual ~SourceReaderCallback() = default;
+
+    volatile LONG _refs = 1;
+    std::mutex _handle_mutex;
+    CaptureHandle* _handle;
+};
+
+// lock the frame's memory without copying it. 2D buffers are locked with Lock2D when their rows are contiguous
+static void LockFrame(IMFMediaBuffer* media_buffer, IMF2DBuffer** locked_2d, buffer& frame)
+{
+    IMF2DBuffer* buffer_2d = nullptr;
+    if (SUCCEEDED(media_buffer->QueryInterface(IID_PPV_ARGS(&buffer_2d))))
+    {
+        BOOL contiguous = FALSE;
+        DWORD length = 0;
+        BYTE* scanline0 = nullptr;
+        LONG pitch = 0;
+        if (SUCCEEDED(buffer_2d->IsContiguousFormat(&contiguous)) && contiguous &&
+            SUCCEEDED(buffer_2d->GetContiguousLength(&length)) && SUCCEEDED(buffer_2d->Lock2D(&scanline0, &pitch)))
+        {
+            if (pitch > 0)
+            {
+                frame.data = scanline0;
+                frame.size = static_cast<unsigned int>(length);
+                *locked_2d = buffer_2d;
+                return;
+            }
+            buffer_2d->Unlock2D(); // bottom-up image
+        }
+        buffer_2d->Release();
+    }
+    DWORD maxsize = 0, cursize = 0;
+    ThrowIfFailed("lock buffer", media_buffer->Lock(&frame.data, &maxsize, &cursize));
+    frame.size = static_cast<unsigned int>(cursize);
+}
+
+static void UnlockFrame(IMFMediaBuffer* media_buffer, IMF2DBuffer* locked_2d)
+{
+    if (locked_2d)
+    {
+        locked_2d->Unlock2D();
+        locked_2d->Release();
+    }
+    else
+    {
+        media_buffer->Unlock();
+    }
+}
+
 #ifdef METADATA_ENABLED_WIN
 void ExtractMetadataBuffer(IMFSample* pSample,buffer& buf)
 {
@@ -140,7 +258,7 @@ bool CreateMediaSource(IMFMediaSource** media_device, IMFAttributes** cap_config
 
 CaptureHandle::CaptureHandle(const PreviewConfig& config) : _config(config)
 {
-    _stream_converter = std::make_unique<StreamConverter>(_config.previewMode);
+    _stream_converter = std::make_unique<StreamConverter>(_config);
     
     IMFMediaSource* media_device = nullptr;
     IMFAttributes* cap_config = nullptr;
@@ -153,11 +271,15 @@ CaptureHandle::CaptureHandle(const PreviewConfig& config) : _config(config)
             throw std::runtime_error("CreateMediaSource() failed");
         }
 
+        _reader_callback = new SourceReaderCallback(this);
+        ThrowIfFailed("set async callback", cap_config->SetUnknown(MF_SOURCE_READER_ASYNC_CALLBACK, _reader_callback));
         ThrowIfFailed("create source reader",
                       MFCreateSourceReaderFromMediaSource(media_device, cap_config, &_video_src));
 
         StreamAttributes attr = _stream_converter->GetStreamAttributes();
         GUID stream_format = attr.format == MJPEG ? MFVideoFormat_MJPG : W10_FORMAT;
+        if (attr.format == YUY2)
+            stream_format = MFVideoFormat_YUY2;
 
         ThrowIfFailed("create mediatype ",MFCreateMediaType(&mediaType));
         ThrowIfFailed("set mediaType guid",mediaType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video));
@@ -175,6 +297,11 @@ CaptureHandle::CaptureHandle(const PreviewConfig& config) : _config(config)
             media_device->Release();
         if (_video_src)
             _video_src->Release();
+        if (_reader_callback)
+        {
+            _reader_callback->Detach();
+            _reader_callback->Release();
+        }
         throw ex;
     }
     if (mediaType)
@@ -183,52 +310,220 @@ CaptureHandle::CaptureHandle(const PreviewConfig& config) : _config(config)
         cap_config->Release();
     if (media_device)
         media_device->Release();
+
+    {
+        std::lock_guard<std::mutex> lock {_frame_mutex};
+        _read_requested = true;
+    }
+    RequestSample();
 };
 
 CaptureHandle::~CaptureHandle()
 {
-    if (_video_src)
+    bool flush = false;
+    {
+        std::lock_guard<std::mutex> lock {_frame_mutex};
+        _stop = true;
+        flush = _read_requested;
+    }
+    // complete the outstanding request before releasing the reader
+    if (_video_src && flush && SUCCEEDED(_video_src->Flush(STREAM_NUMBER)))
     {
-        _video_src->Flush(STREAM_NUMBER);
+        std::unique_lock<std::mutex> lock {_frame_mutex};
+        _frame_cv.wait_for(lock, std::chrono::seconds {FLUSH_WAIT_SECONDS}, [this] { return _flushed; });
+    }
+    // also after a flush timeout: a notification still running (or late) cannot reach the handle once detached
+    if (_reader_callback)
+    {
+        _reader_callback->Detach();
+        _reader_callback->Release();
+    }
+    if (_video_src)
         _video_src->Release();
+    if (_pending_sample)
+        _pending_sample->Release();
+}
+
+// _read_requested must be set by the caller
+void CaptureHandle::RequestSample()
+{
+    HRESULT hr = _video_src->ReadSample(STREAM_NUMBER, 0, NULL, NULL, NULL, NULL);
+    if (FAILED(hr))
+    {
+        std::lock_guard<std::mutex> lock {_frame_mutex};
+        _read_requested = false;
+        std::stringstream err_stream;
+        err_stream << "ReadSample failed with HResult error: " << std::hex << static_cast<unsigned long>(hr);
+        _capture_error = err_stream.str();
+        _frame_cv.notify_all();
+    }
+}
+
+void CaptureHandle::OnReadSample(long status, IMFSample* sample)
+{
+    bool request = false;
+    {
+        std::lock_guard<std::mutex> lock {_frame_mutex};
+        _read_requested = false;
+        if (FAILED(status))
+        {
+            if (!_stop)
+            {
+                std::stringstream err_stream;
+                err_stream << "read sample failed with HResult error: " << std::hex
+                           << static_cast<unsigned long>(status);
+                _capture_error = err_stream.str();
+            }
+        }
+        else if ((!_paused || _standby) && !_stop)
+        {
+            // sample is null on stream ticks. in standby the sample is dropped and the next one requested
+            if (sample && !_paused)
+            {
+                if (_pending_sample)
+                {
+                    _pending_sample->Release(); // the newer sample wins
+                    ++_dropped_frames;
+                }
+                sample->AddRef();
+                _pending_sample = sample;
+                _pending_time = HostTimeMicros();
+            }
+            request = true;
+            _read_requested = true;
+        }
     }
+    _frame_cv.notify_all();
+    if (request)
+        RequestSample();
+}
+
+void CaptureHandle::OnFlush()
+{
+    {
+        std::lock_guard<std::mutex> lock {_frame_mutex};
+        _flushed = true;
+    }
+    _frame_cv.notify_all();
 }
 
 bool CaptureHandle::Read(RealSenseID::Image* res)
 {
+    IMFSample* sample = nullptr;
+    {
+        std::unique_lock<std::mutex> lock {_frame_mutex};
+        _frame_cv.wait_for(lock, std::chrono::seconds {FRAME_WAIT_SECONDS}, [this] {
+            return _pending_sample != nullptr || !_capture_error.empty() || _paused || _interrupted;
+        });
+        if (!_capture_error.empty())
+            throw std::runtime_error(_capture_error);
+        if (_pending_sample == nullptr || _paused || _interrupted)
+            return false;
+        if (_dropped_frames > 0)
+        {
+            LOG_TRACE(LOG_TAG, "dropped %u frames", _dropped_frames);
+            _total_dropped_frames += _dropped_frames;
+            _dropped_frames = 0;
+        }
+        sample = _pending_sample;
+        res->receive_time = _pending_time;
+        _pending_sample = nullptr;
+    }
+
+    // decode while the source reader captures the next sample
     bool valid_read = false;
-    IMFSample* sample = NULL;
-    DWORD streamIndex, flags;
-    LONGLONG timestamp;
-    DWORD maxsize = 0, cursize = 0;
+    IMFMediaBuffer* media_buffer = nullptr;
+    IMF2DBuffer* locked_2d = nullptr;
+    bool locked = false;
     buffer frame_buffer;
     buffer meta_buffer;
-
-    _video_src->ReadSample(STREAM_NUMBER, 0, &streamIndex, &flags, &timestamp, &sample);
-
-    if (sample)
+    try
     {
-        ThrowIfFailed("ConvertToContiguousBuffer", sample->ConvertToContiguousBuffer(&_buf));
+        DWORD buffer_count = 0;
+        ThrowIfFailed("GetBufferCount", sample->GetBufferCount(&buffer_count));
+        if (buffer_count == 1)
+            ThrowIfFailed("GetBufferByIndex", sample->GetBufferByIndex(0, &media_buffer));
+        else // only samples made of several buffers need a copy
+            ThrowIfFailed("ConvertToContiguousBuffer", sample->ConvertToContiguousBuffer(&media_buffer));
+        LockFrame(media_buffer, &locked_2d, frame_buffer);
+        locked = true;
 
-        _buf->Lock(&(frame_buffer.data), &maxsize, &cursize);
-        frame_buffer.size = (unsigned int)cursize;
-    
-       // extract basic metadata also for non-raw streams. metadata patch need to be installed.
-       // metadata for non-raw streams includes timestamps.
-       ExtractMetadataBuffer(sample, meta_buffer);
-
-       valid_read = _stream_converter->Buffer2Image(res, frame_buffer, meta_buffer);
+        // extract basic metadata also for non-raw streams. metadata patch need to be installed.
+        // metadata for non-raw streams includes timestamps.
+        ExtractMetadataBuffer(sample, meta_buffer);
 
+        valid_read = _stream_converter->Buffer2Image(res, frame_buffer, meta_buffer);
+    }
+    catch (...)
+    {
         if (meta_buffer.data)
             delete[] meta_buffer.data;
-        if (_buf)
-        {
-            _buf->Unlock();
-            _buf->Release();
-        }
+        if (locked)
+            UnlockFrame(media_buffer, locked_2d);
+        if (media_buffer)
+            media_buffer->Release();
         sample->Release();
+        throw;
     }
+
+    if (meta_buffer.data)
+        delete[] meta_buffer.data;
+    UnlockFrame(media_buffer, locked_2d);
+    media_buffer->Release();
+    sample->Release();
     return valid_read;
 }
+
+void CaptureHandle::Pause()
+{
+    IMFSample* dropped = nullptr;
+    {
+        std::lock_guard<std::mutex> lock {_frame_mutex};
+        _paused = true;
+        // the pending sample would be stale on resume. the outstanding request completes and is not renewed
+        dropped = _pending_sample;
+        _pending_sample = nullptr;
+    }
+    _frame_cv.notify_all();
+    if (dropped)
+        dropped->Release();
+}
+
+void CaptureHandle::Standby()
+{
+    Pause();
+    bool request = false;
+    {
+        std::lock_guard<std::mutex> lock {_frame_mutex};
+        _standby = true;
+        request = !_read_requested && !_stop;
+        _read_requested = _read_requested || request;
+    }
+    if (request)
+        RequestSample();
+}
+
+void CaptureHandle::Resume()
+{
+    bool request = false;
+    {
+        std::lock_guard<std::mutex> lock {_frame_mutex};
+        _paused = false;
+        _standby = false;
+        request = !_read_requested && !_stop;
+        _read_requested = _read_requested || request;
+    }
+    if (request)
+        RequestSample();
+}
+
+void CaptureHandle::Interrupt()
+{
+    {
+        std::lock_guard<std::mutex> lock {_frame_mutex};
+        _interrupted = true;
+    }
+    _frame_cv.notify_all();
+}
 } // namespace Capture
 } // namespace RealSenseID
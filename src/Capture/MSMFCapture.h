@@ -2,8 +2,12 @@
 #include "RealSenseID/Preview.h"
 #include "StreamConverter.h"
 
+#include <mutex>
+#include <condition_variable>
+#include <string>
+
 struct IMFSourceReader;
-struct IMFMediaBuffer;
+struct IMFSample;
 
 
 namespace RealSenseID
@@ -17,6 +21,8 @@ public:
     ~MsmfInitializer();
 };
 
+class SourceReaderCallback;
+
 class CaptureHandle
 {
 public:
@@ -24,17 +30,60 @@ public:
     ~CaptureHandle();
     bool Read(RealSenseID::Image* res);
 
+    // stop requesting samples until Resume(). a blocked Read() returns false right away
+    void Pause();
+    // paused, but samples are still requested and dropped as they arrive, so the stream stays live and the first
+    // sample after Resume() is the next one the camera sends. costs a callback per frame, no decode
+    void Standby();
+    void Resume();
+    // make a blocked Read() and all later calls return false right away
+    void Interrupt();
+
+    // called by the async source reader on a media foundation thread
+    void OnReadSample(long status, IMFSample* sample);
+    void OnFlush();
+
+    // the converter is used by Read(), access it from the reading thread only
+    StreamConverter& GetStreamConverter()
+    {
+        return *_stream_converter;
+    }
+
+    // frames dropped by the capture since it started, updated by Read(). access it from the reading thread only
+    unsigned int DroppedFrames() const
+    {
+        return _total_dropped_frames;
+    }
+
     // prevent copy or assignment
     // only single connection is allowed to a capture device.
     CaptureHandle(const CaptureHandle&) = delete;
     void operator=(const CaptureHandle&) = delete;
 
 private:
+    // the source reader runs in async mode with one sample always requested ahead, so capture overlaps decode.
+    // only the latest sample is kept pending for Read(), older ones are dropped.
+    void RequestSample();
+
     MsmfInitializer _mf;
     IMFSourceReader* _video_src = nullptr;
-    IMFMediaBuffer* _buf = nullptr;
+    SourceReaderCallback* _reader_callback = nullptr;
     std::unique_ptr<StreamConverter> _stream_converter;
     PreviewConfig _config;
+
+    std::mutex _frame_mutex;
+    std::condition_variable _frame_cv;
+    IMFSample* _pending_sample = nullptr;
+    unsigned long long _pending_time = 0; // host receive time
+    bool _read_requested = false;
+    bool _paused = false;
+    bool _standby = false;
+    bool _interrupted = false;
+    bool _stop = false;
+    bool _flushed = false;
+    unsigned int _dropped_frames = 0; // since the last Read()
+    unsigned int _total_dropped_frames = 0;
+    std::string _capture_error;
 };
 } // namespace Capture
 } // namespace RealSenseID
\ No newline at end of file
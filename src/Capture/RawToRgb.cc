@@ -2,154 +2,438 @@
 // Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
 
 #include "RealSenseID/Preview.h"
+#include "CpuFeatures.h"
 #include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <system_error>
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define RSID_RAW_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define RSID_RAW_NEON
+#include <arm_neon.h>
+#endif
 
 namespace RealSenseID
 {
 namespace Capture
 {
-inline uint8_t Raw8Value(const uint8_t* src, int baseoff, int mod5)
+static constexpr int RGB_PIXEL_SIZE = 3;
+static constexpr unsigned int TILE_ROWS = 16; // source rows converted together and written as one rotated tile
+static constexpr unsigned int MAX_THREADS = 4;
+static constexpr unsigned int MIN_ROWS_PER_THREAD = 64;
+
+// RAW10 packs 4 pixels in 5 bytes: 4 bytes with the 8 msb of each pixel and one byte with the 2 lsb of all four.
+// unpack the 8 msb of a row into out[1..width], mirrored at both edges (out[0] = out[2], out[width+1] = out[width-1])
+static void UnpackRow(const uint8_t* src, unsigned int width, uint8_t* out)
 {
-    return (mod5 >= 4) ? 0 : *(src + baseoff);
+    uint8_t* dst = out + 1;
+    unsigned int groups = width / 4;
+    for (unsigned int g = 0; g < groups; g++)
+    {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+        dst[3] = src[3];
+        src += 5;
+        dst += 4;
+    }
+    for (unsigned int x = groups * 4; x < width; x++)
+    {
+        *dst++ = *src++;
+    }
+    out[0] = width > 1 ? out[2] : out[1];
+    out[width + 1] = width > 1 ? out[width - 1] : out[width];
 }
 
-void RotatedRaw2Rgb(const Image& src_img, Image& dst_img)
+// bilinear demosaic of the pixel at column x (index x+1 in the padded rows)
+struct Neighbours
 {
-    constexpr int rgb_pixel_size = 3;
-    unsigned int src_height = src_img.height, src_width = src_img.width; // width height is the same
-    unsigned int dst_height = src_width, dst_width = src_height;         // rotating image
+    uint8_t hn, vn, di;
+};
 
-    unsigned int line = src_img.size / src_height;
+static inline Neighbours Average(const uint8_t* up, const uint8_t* cur, const uint8_t* down, unsigned int i)
+{
+    Neighbours n;
+    n.hn = static_cast<uint8_t>((cur[i - 1] + cur[i + 1]) / 2);
+    n.vn = static_cast<uint8_t>((up[i] + down[i]) / 2);
+    n.di = static_cast<uint8_t>((up[i - 1] + up[i + 1] + down[i - 1] + down[i + 1]) / 4);
+    return n;
+}
 
-    const unsigned char* src = src_img.buffer;
-    unsigned char* dst = dst_img.buffer;
+static inline void PutPixel(uint8_t* out, uint8_t br1, uint8_t g, uint8_t br0)
+{
+    out[0] = br1;
+    out[1] = g;
+    out[2] = br0;
+}
 
-    const int palette = 128;
+// the two pixel kinds of a bayer row, for rows with even / odd y
+static inline void ColorPixel(const uint8_t* up, const uint8_t* cur, const uint8_t* down, unsigned int i, bool odd_row,
+                              uint8_t* out)
+{
+    auto n = Average(up, cur, down, i);
+    uint8_t g = static_cast<uint8_t>((n.vn + n.hn) / 2);
+    if (odd_row)
+        PutPixel(out, cur[i], g, n.di);
+    else
+        PutPixel(out, n.di, g, cur[i]);
+}
 
-    unsigned int src_x = 0, src_y = 0;
-    unsigned int dst_x = 0, dst_y = dst_height - 1;
-    unsigned int i;
+static inline void GreenPixel(const uint8_t* up, const uint8_t* cur, const uint8_t* down, unsigned int i, bool odd_row,
+                              uint8_t* out)
+{
+    auto n = Average(up, cur, down, i);
+    if (odd_row)
+        PutPixel(out, n.hn, cur[i], n.vn);
+    else
+        PutPixel(out, n.vn, cur[i], n.hn);
+}
 
-    for (i = 0; i < src_img.size; i++)
-    {
-        int p[8];
-        uint8_t hn, vn, di;
-        uint8_t br0, br1, g;
-        int mode;
-        int hnext = 1, hprev = 1;
-
-        /* skip every 5th byte */
-        switch (i % 5)
-        {
-        case 0:
-            hprev = 2;
-            break;
-        case 3:
-            hnext = 2;
-            break;
-        case 4:
-            continue;
-        }
+// convert source rows [first_row, last_row) and write them rotated into dst
+static void ConvertRows(const Image& src_img, uint8_t* dst, unsigned int first_row, unsigned int last_row)
+{
+    const unsigned int width = src_img.width, height = src_img.height;
+    const unsigned int line = src_img.size / height;
+    const unsigned int padded = width + 2;
+    const unsigned int dst_width = height; // rotating image
+    const unsigned int dst_line = dst_width * RGB_PIXEL_SIZE;
 
-        /* Setup offsets to this pixel's neighbours. */
-        p[0] = i - line - hprev;
-        p[1] = i - line;
-        p[2] = i - line + hnext;
-        p[3] = i - hprev;
-        p[4] = i + hnext;
-        p[5] = i + line - hprev;
-        p[6] = i + line;
-        p[7] = i + line + hnext;
-
-        /* Swap offsets if they are out of bounds. */
-        if (!src_y)
-        {
-            p[0] = p[5];
-            p[1] = p[6];
-            p[2] = p[7];
-        }
-        else if (src_y == src_height - 1)
-        {
-            p[5] = p[0];
-            p[6] = p[1];
-            p[7] = p[2];
-        }
+    auto row_index = [height](int y) {
+        // mirror at the top and bottom edges
+        if (y < 0)
+            return height > 1 ? 1u : 0u;
+        if (static_cast<unsigned int>(y) >= height)
+            return height > 1 ? height - 2 : 0u;
+        return static_cast<unsigned int>(y);
+    };
 
-        if (!src_x)
-        {
-            p[0] = p[2];
-            p[3] = p[4];
-            p[5] = p[7];
-        }
-        else if (src_x == src_width - 1)
-        {
-            p[2] = p[0];
-            p[4] = p[3];
-            p[7] = p[5];
-        }
+    // the unpacked rows above, at and below the current row
+    const unsigned int ring_size = 3;
+    std::vector<uint8_t> rows(ring_size * padded);
+    std::vector<uint8_t> tile(static_cast<size_t>(width) * TILE_ROWS * RGB_PIXEL_SIZE); // [x][row in tile]
+    auto ring_row = [&](int y) { return rows.data() + ((y + 1 - static_cast<int>(first_row)) % ring_size) * padded; };
 
-        /* Average matching neighbours. */
-        hn = ((Raw8Value(src, p[3], p[3] % 5) + Raw8Value(src, p[4], p[4] % 5)) / 2);
-        vn = ((Raw8Value(src, p[1], p[1] % 5) + Raw8Value(src, p[6], p[6] % 5)) / 2);
-        di = ((Raw8Value(src, p[0], p[0] % 5) + Raw8Value(src, p[2], p[2] % 5) + Raw8Value(src, p[5], p[5] % 5) +
-               Raw8Value(src, p[7], p[7] % 5)) /
-              4);
+    UnpackRow(src_img.buffer + row_index(static_cast<int>(first_row) - 1) * line, width,
+              ring_row(static_cast<int>(first_row) - 1));
+    UnpackRow(src_img.buffer + row_index(first_row) * line, width, ring_row(first_row));
 
-        /* Calculate RGB */
-        if (palette == 128)
-            mode = (src_x + src_y) & 0x01;
-        else
-            mode = ~(src_x + src_y) & 0x01;
-
-        if (mode)
+    for (unsigned int tile_row = first_row; tile_row < last_row; tile_row += TILE_ROWS)
+    {
+        const unsigned int tile_height = std::min(TILE_ROWS, last_row - tile_row);
+        for (unsigned int t = 0; t < tile_height; t++)
         {
-            g = Raw8Value(src, i, i % 5);
-            if (src_y & 0x01)
+            const int y = static_cast<int>(tile_row + t);
+            UnpackRow(src_img.buffer + row_index(y + 1) * line, width, ring_row(y + 1));
+            const uint8_t* up = ring_row(y - 1);
+            const uint8_t* cur = ring_row(y);
+            const uint8_t* down = ring_row(y + 1);
+            const bool odd_row = (y & 1) != 0;
+            const size_t tile_step = static_cast<size_t>(TILE_ROWS) * RGB_PIXEL_SIZE;
+            uint8_t* out = tile.data() + t * RGB_PIXEL_SIZE;
+
+            // pixel kinds alternate along the row: (x + y) even is a red/blue pixel, odd is green
+            unsigned int x = 0;
+            if (odd_row)
             {
-                br1 = hn;
-                br0 = vn;
+                for (; x + 1 < width; x += 2, out += 2 * tile_step)
+                {
+                    GreenPixel(up, cur, down, x + 1, true, out);
+                    ColorPixel(up, cur, down, x + 2, true, out + tile_step);
+                }
+                if (x < width)
+                    GreenPixel(up, cur, down, x + 1, true, out);
             }
             else
             {
-                br1 = vn;
-                br0 = hn;
+                for (; x + 1 < width; x += 2, out += 2 * tile_step)
+                {
+                    ColorPixel(up, cur, down, x + 1, false, out);
+                    GreenPixel(up, cur, down, x + 2, false, out + tile_step);
+                }
+                if (x < width)
+                    ColorPixel(up, cur, down, x + 1, false, out);
             }
         }
-        else if (src_y & 0x01)
-        {
-            br1 = Raw8Value(src, i, i % 5);
-            g = (vn + hn) / 2;
-            br0 = di;
-        }
-        else
+
+        // source pixel (x, y) goes to destination row (width - 1 - x), column y
+        const size_t tile_line = static_cast<size_t>(tile_height) * RGB_PIXEL_SIZE;
+        for (unsigned int x = 0; x < width; x++)
         {
-            br0 = Raw8Value(src, i, i % 5);
-            g = (vn + hn) / 2;
-            br1 = di;
+            uint8_t* dst_row = dst + static_cast<size_t>(width - 1 - x) * dst_line + tile_row * RGB_PIXEL_SIZE;
+            ::memcpy(dst_row, tile.data() + static_cast<size_t>(x) * TILE_ROWS * RGB_PIXEL_SIZE, tile_line);
         }
+    }
+}
 
-        unsigned int cur_rgb_pixel_offset = rgb_pixel_size * (dst_y * dst_width + dst_x);
-        *(dst + cur_rgb_pixel_offset) = br1;
-        *(dst + cur_rgb_pixel_offset + 1) = g;
-        *(dst + cur_rgb_pixel_offset + 2) = br0;
+void RotatedRaw2Rgb(const Image& src_img, Image& dst_img, unsigned int max_threads)
+{
+    const unsigned int src_height = src_img.height, src_width = src_img.width;
+    const unsigned int dst_height = src_width, dst_width = src_height; // rotating image
 
-        dst_y--;
-        src_x++;
+    // split the rows between threads, in whole tiles
+    unsigned int thread_count = max_threads > 0
+                                    ? max_threads
+                                    : std::min(MAX_THREADS, std::max(1u, std::thread::hardware_concurrency()));
+    thread_count = std::max(1u, std::min(thread_count, src_height / MIN_ROWS_PER_THREAD));
+    unsigned int tiles = (src_height + TILE_ROWS - 1) / TILE_ROWS;
+    unsigned int rows_per_thread = ((tiles + thread_count - 1) / thread_count) * TILE_ROWS;
 
-        /* Move to the next line*/
-        if (src_x == src_width)
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < thread_count; i++)
+    {
+        unsigned int first = i * rows_per_thread;
+        if (first >= src_height)
+            break;
+        unsigned int last = std::min(src_height, first + rows_per_thread);
+        try
         {
-            src_x = 0;
-            src_y++;
-            dst_y = dst_height - 1;
-            dst_x++;
+            workers.emplace_back(ConvertRows, std::cref(src_img), dst_img.buffer, first, last);
+        }
+        catch (const std::system_error&)
+        {
+            ConvertRows(src_img, dst_img.buffer, first, last); // no more threads, convert these rows here
         }
     }
+    ConvertRows(src_img, dst_img.buffer, 0, std::min(src_height, rows_per_thread));
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
 
     // change image attr to match the convertion
     dst_img.height = dst_height;
     dst_img.width = dst_width;
     dst_img.stride = dst_img.size / dst_img.height;
 }
+
+// unpack the 8 msb of a row into out[0..width), dropping the lsb byte of each group
+static void UnpackMsbScalar(const uint8_t* src, unsigned int width, uint8_t* out)
+{
+    unsigned int x = 0;
+    for (; x + 4 <= width; x += 4, src += 5)
+    {
+        ::memcpy(out, src, 4);
+        out += 4;
+    }
+    // a partial last group: its width - x msb bytes, then its lsb byte
+    ::memcpy(out, src, width - x);
+}
+
+// the SIMD versions unpack 16 pixels (4 groups of 5 bytes) per step, reading the 20 bytes with two overlapping 16 byte
+// loads: groups 0-2 from the first, group 3 from the second.
+#ifdef RSID_RAW_X86
+
+#if defined(__GNUC__) || defined(__clang__)
+#define RSID_TARGET_SSSE3 __attribute__((target("ssse3")))
+#else
+#define RSID_TARGET_SSSE3
+#endif
+
+RSID_TARGET_SSSE3 static void UnpackMsbSsse3(const uint8_t* src, unsigned int width, uint8_t* out)
+{
+    const __m128i first = _mm_setr_epi8(0, 1, 2, 3, 5, 6, 7, 8, 10, 11, 12, 13, -1, -1, -1, -1);
+    const __m128i second = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 11, 12, 13, 14);
+    unsigned int x = 0;
+    for (; x + 16 <= width; x += 16, src += 20, out += 16)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out),
+                         _mm_or_si128(_mm_shuffle_epi8(a, first), _mm_shuffle_epi8(b, second)));
+    }
+    UnpackMsbScalar(src, width - x, out);
+}
+
+#endif // RSID_RAW_X86
+
+#ifdef RSID_RAW_NEON
+static void UnpackMsbNeon(const uint8_t* src, unsigned int width, uint8_t* out)
+{
+    // out of range table indices give 0
+    static const uint8_t first_index[16] = {0, 1, 2, 3, 5, 6, 7, 8, 10, 11, 12, 13, 0xff, 0xff, 0xff, 0xff};
+    static const uint8_t second_index[16] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                             0xff, 0xff, 0xff, 0xff, 11,   12,   13,   14};
+    const uint8x16_t first = vld1q_u8(first_index);
+    const uint8x16_t second = vld1q_u8(second_index);
+    unsigned int x = 0;
+    for (; x + 16 <= width; x += 16, src += 20, out += 16)
+    {
+        uint8x16_t a = vld1q_u8(src);
+        uint8x16_t b = vld1q_u8(src + 4);
+        vst1q_u8(out, vorrq_u8(vqtbl1q_u8(a, first), vqtbl1q_u8(b, second)));
+    }
+    UnpackMsbScalar(src, width - x, out);
+}
+#endif // RSID_RAW_NEON
+
+// unpack the 10 bits of a row into out[0..width). the lsb byte of a group has the 2 lsb of pixel k at bits 2k, 2k+1
+static void Unpack10Scalar(const uint8_t* src, unsigned int width, uint16_t* out)
+{
+    unsigned int x = 0;
+    for (; x + 4 <= width; x += 4, src += 5, out += 4)
+    {
+        const unsigned int lsb = src[4];
+        for (unsigned int k = 0; k < 4; k++)
+            out[k] = static_cast<uint16_t>((src[k] << 2) | ((lsb >> (2 * k)) & 3));
+    }
+    // a partial last group: its width - x msb bytes, then its lsb byte (a row has (width * 10 + 7) / 8 bytes)
+    const unsigned int rest = width - x;
+    if (rest > 0)
+    {
+        const unsigned int lsb = src[rest];
+        for (unsigned int k = 0; k < rest; k++)
+            out[k] = static_cast<uint16_t>((src[k] << 2) | ((lsb >> (2 * k)) & 3));
+    }
+}
+
+// the SIMD versions shuffle each pixel's msb and its group's lsb byte into a 16 bit lane (msb << 8 | lsb), then
+// take (lane >> 6) & 0x3fc for the msb part and shift the lsb byte per lane for the 2 lsb. same 20 byte steps as above.
+#ifdef RSID_RAW_X86
+RSID_TARGET_SSSE3 static inline __m128i Unpack10Lanes(__m128i bytes, __m128i shuffle, __m128i lsb_scale)
+{
+    const __m128i lanes = _mm_shuffle_epi8(bytes, shuffle);
+    const __m128i msb = _mm_and_si128(_mm_srli_epi16(lanes, 6), _mm_set1_epi16(0x3fc));
+    // lsb << (6 - 2k), then >> 6 leaves bits 2k, 2k+1 at the bottom
+    const __m128i lsb = _mm_mullo_epi16(_mm_and_si128(lanes, _mm_set1_epi16(0xff)), lsb_scale);
+    return _mm_or_si128(msb, _mm_and_si128(_mm_srli_epi16(lsb, 6), _mm_set1_epi16(3)));
+}
+
+RSID_TARGET_SSSE3 static void Unpack10Ssse3(const uint8_t* src, unsigned int width, uint16_t* out)
+{
+    // pixels 0-7 from the first load (bytes 0-9), pixels 8-15 from the second (bytes 10-19 at 6-15)
+    const __m128i first = _mm_setr_epi8(4, 0, 4, 1, 4, 2, 4, 3, 9, 5, 9, 6, 9, 7, 9, 8);
+    const __m128i second = _mm_setr_epi8(10, 6, 10, 7, 10, 8, 10, 9, 15, 11, 15, 12, 15, 13, 15, 14);
+    const __m128i lsb_scale = _mm_setr_epi16(64, 16, 4, 1, 64, 16, 4, 1);
+    unsigned int x = 0;
+    for (; x + 16 <= width; x += 16, src += 20, out += 16)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), Unpack10Lanes(a, first, lsb_scale));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8), Unpack10Lanes(b, second, lsb_scale));
+    }
+    Unpack10Scalar(src, width - x, out);
+}
+#endif // RSID_RAW_X86
+
+#ifdef RSID_RAW_NEON
+static inline uint16x8_t Unpack10Lanes(uint8x16_t bytes, uint8x16_t shuffle, int16x8_t lsb_shift)
+{
+    const uint16x8_t lanes = vreinterpretq_u16_u8(vqtbl1q_u8(bytes, shuffle));
+    const uint16x8_t msb = vandq_u16(vshrq_n_u16(lanes, 6), vdupq_n_u16(0x3fc));
+    // negative shifts are right shifts
+    const uint16x8_t lsb = vshlq_u16(vandq_u16(lanes, vdupq_n_u16(0xff)), lsb_shift);
+    return vorrq_u16(msb, vandq_u16(lsb, vdupq_n_u16(3)));
+}
+
+static void Unpack10Neon(const uint8_t* src, unsigned int width, uint16_t* out)
+{
+    static const uint8_t first_index[16] = {4, 0, 4, 1, 4, 2, 4, 3, 9, 5, 9, 6, 9, 7, 9, 8};
+    static const uint8_t second_index[16] = {10, 6, 10, 7, 10, 8, 10, 9, 15, 11, 15, 12, 15, 13, 15, 14};
+    static const int16_t lsb_shifts[8] = {0, -2, -4, -6, 0, -2, -4, -6};
+    const uint8x16_t first = vld1q_u8(first_index);
+    const uint8x16_t second = vld1q_u8(second_index);
+    const int16x8_t lsb_shift = vld1q_s16(lsb_shifts);
+    unsigned int x = 0;
+    for (; x + 16 <= width; x += 16, src += 20, out += 16)
+    {
+        uint8x16_t a = vld1q_u8(src);
+        uint8x16_t b = vld1q_u8(src + 4);
+        vst1q_u16(out, Unpack10Lanes(a, first, lsb_shift));
+        vst1q_u16(out + 8, Unpack10Lanes(b, second, lsb_shift));
+    }
+    Unpack10Scalar(src, width - x, out);
+}
+#endif // RSID_RAW_NEON
+
+using unpack_fn = void (*)(const uint8_t* src, unsigned int width, uint8_t* out);
+using unpack10_fn = void (*)(const uint8_t* src, unsigned int width, uint16_t* out);
+
+static unpack_fn SelectUnpack()
+{
+#if defined(RSID_RAW_X86)
+    if (CpuFeatures::Has(CpuFeatures::Ssse3))
+        return UnpackMsbSsse3;
+#elif defined(RSID_RAW_NEON)
+    if (CpuFeatures::Has(CpuFeatures::Neon))
+        return UnpackMsbNeon;
+#endif
+    return UnpackMsbScalar;
+}
+
+static unpack10_fn SelectUnpack10()
+{
+#if defined(RSID_RAW_X86)
+    if (CpuFeatures::Has(CpuFeatures::Ssse3))
+        return Unpack10Ssse3;
+#elif defined(RSID_RAW_NEON)
+    if (CpuFeatures::Has(CpuFeatures::Neon))
+        return Unpack10Neon;
+#endif
+    return Unpack10Scalar;
+}
+
+void Raw2Gray(const Image& src_img, Image& dst_img, bool binning)
+{
+    static const unpack_fn unpack = SelectUnpack();
+
+    const unsigned int width = src_img.width, height = src_img.height;
+    const unsigned int line = src_img.size / height;
+    if (!binning)
+    {
+        for (unsigned int y = 0; y < height; y++)
+        {
+            unpack(src_img.buffer + static_cast<size_t>(y) * line, width,
+                   dst_img.buffer + static_cast<size_t>(y) * width);
+        }
+        dst_img.width = width;
+        dst_img.height = height;
+        dst_img.stride = width;
+        return;
+    }
+
+    // each 2x2 cell has one red, one blue and two green pixels, their average is close to the luminance
+    const unsigned int dst_width = width / 2, dst_height = height / 2;
+    static thread_local std::vector<uint8_t> rows; // grows to the widest frame, kept for the following frames
+    rows.resize(2 * static_cast<size_t>(width));
+    uint8_t* top = rows.data();
+    uint8_t* bottom = rows.data() + width;
+    for (unsigned int y = 0; y < dst_height; y++)
+    {
+        unpack(src_img.buffer + static_cast<size_t>(2 * y) * line, width, top);
+        unpack(src_img.buffer + static_cast<size_t>(2 * y + 1) * line, width, bottom);
+        uint8_t* dst = dst_img.buffer + static_cast<size_t>(y) * dst_width;
+        for (unsigned int x = 0; x < dst_width; x++)
+        {
+            unsigned int sum = top[2 * x] + top[2 * x + 1] + bottom[2 * x] + bottom[2 * x + 1];
+            dst[x] = static_cast<uint8_t>((sum + 2) / 4);
+        }
+    }
+    dst_img.width = dst_width;
+    dst_img.height = dst_height;
+    dst_img.stride = dst_width;
+}
+
+void Raw2Raw16(const Image& src_img, Image& dst_img)
+{
+    static const unpack10_fn unpack = SelectUnpack10();
+
+    const unsigned int width = src_img.width, height = src_img.height;
+    const unsigned int line = src_img.size / height;
+    auto* dst = reinterpret_cast<uint16_t*>(dst_img.buffer);
+    for (unsigned int y = 0; y < height; y++)
+        unpack(src_img.buffer + static_cast<size_t>(y) * line, width, dst + static_cast<size_t>(y) * width);
+    dst_img.width = width;
+    dst_img.height = height;
+    dst_img.stride = width * static_cast<unsigned int>(sizeof(uint16_t));
+}
 } // namespace Capture
-} // namespace RealSenseID
\ No newline at end of file
+} // namespace RealSenseID
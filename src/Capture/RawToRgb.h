@@ -10,7 +10,16 @@ namespace RealSenseID
 namespace Capture
 {
 
-void RotatedRaw2Rgb(const Image& src_img, Image& dst_img);
+// max_threads: threads converting the rows, 0 for the default (up to 4, by the hardware concurrency)
+void RotatedRaw2Rgb(const Image& src_img, Image& dst_img, unsigned int max_threads = 0);
+
+// the 8 msb of each RAW10 pixel, not demosaiced nor rotated. binning averages each 2x2 bayer cell into one pixel.
+// dst_img.buffer must hold width * height bytes (a quarter of it with binning).
+void Raw2Gray(const Image& src_img, Image& dst_img, bool binning = false);
+
+// the full 10 bits of each RAW10 pixel, one uint16_t per pixel, not demosaiced nor rotated.
+// dst_img.buffer must hold width * height * 2 bytes, aligned to 2.
+void Raw2Raw16(const Image& src_img, Image& dst_img);
 
 } // namespace Capture
 } // namespace RealSenseID
\ No newline at end of file
@@ -1,11 +1,15 @@
 #include "StreamConverter.h"
 #include "Logger.h"
+#include "Tracer.h"
+#include "JpegDecoder.h"
+#include "Yuy2ToImage.h"
 #include <cstring>
 #include <algorithm>
 #include <stdexcept>
 #include <string>
 #include <cassert>
 #include <map>
+#include <chrono>
 
 #include "MetadataDefines.h"
 
@@ -16,12 +20,14 @@ namespace Capture
 static const StreamAttributes RAW10_1080P_ATTR {1920, 1080, RAW};
 static const StreamAttributes MJPEG_1080P_ATTR {1056, 1920, MJPEG};
 static const StreamAttributes MJPEG_720P_ATTR {704, 1280, MJPEG};
+static const StreamAttributes YUY2_720P_ATTR {704, 1280, YUY2};
 #ifdef ANDROID
 static constexpr int RGB_PIXEL_SIZE = 4;
 #else
 static constexpr int RGB_PIXEL_SIZE = 3;
 #endif
 static const char* LOG_TAG = "StreamConverter";
+static constexpr unsigned int MAX_HW_DECODE_FAILURES = 3; // consecutive, before falling back to libjpeg for good
 
 static const StreamAttributes GetStreamAttributesByMode(PreviewMode mode)
 {
@@ -29,6 +35,7 @@ static const StreamAttributes GetStreamAttributesByMode(PreviewMode mode)
         {PreviewMode::MJPEG_1080P, MJPEG_1080P_ATTR},
         {PreviewMode::MJPEG_720P, MJPEG_720P_ATTR},
         {PreviewMode::RAW10_1080P, RAW10_1080P_ATTR},
+        {PreviewMode::YUY2_720P, YUY2_720P_ATTR},
     };
 
     if (preview_map.find(mode) == preview_map.end())
@@ -39,6 +46,66 @@ static const StreamAttributes GetStreamAttributesByMode(PreviewMode mode)
     return preview_map.at(mode);
 }
 
+static unsigned int GetScaleDenom(const StreamAttributes& attributes, PreviewScale scale, PreviewFormat format)
+{
+    // libjpeg scales by 1/2, 1/4 or 1/8 in the IDCT, yuy2 frames are subsampled. raw frames and passthrough / metadata
+    // frames are never scaled
+    if (attributes.format == RAW || format == PreviewFormat::MJPEG || format == PreviewFormat::METADATA)
+        return 1;
+    return static_cast<unsigned int>(scale);
+}
+
+static Image GetImageTemplate(const StreamAttributes& attributes, unsigned int scale_denom, PreviewFormat format)
+{
+    Image image;
+    // same rounding as libjpeg's output dimensions
+    image.width = (attributes.width + scale_denom - 1) / scale_denom;
+    image.height = (attributes.height + scale_denom - 1) / scale_denom;
+    if (format == PreviewFormat::METADATA) // no pixels, no buffer
+        return image;
+    if (attributes.format == RAW)
+    {
+        image.size = (image.width * image.height / 4) * 5;
+        image.stride = image.size / image.height;
+        return image;
+    }
+    switch (format)
+    {
+    case PreviewFormat::GRAY8:
+        image.size = image.width * image.height;
+        image.stride = image.width;
+        break;
+    case PreviewFormat::I420:
+        image.size = image.width * image.height + 2 * ((image.width + 1) / 2) * ((image.height + 1) / 2);
+        image.stride = image.width;
+        break;
+    case PreviewFormat::MJPEG:
+        // room for the largest compressed frame: a jpeg of a camera frame is smaller than its uncompressed yuv 4:2:2,
+        // which is the frame of the yuy2 mode
+        image.size = image.width * image.height * 2;
+        image.stride = 0;
+        break;
+    default:
+        image.size = image.width * image.height * RGB_PIXEL_SIZE;
+        image.stride = image.width * RGB_PIXEL_SIZE;
+        break;
+    }
+    return image;
+}
+
+unsigned int GetImageSize(const PreviewConfig& config)
+{
+    auto attributes = GetStreamAttributesByMode(config.previewMode);
+    auto scale_denom = GetScaleDenom(attributes, config.previewScale, config.previewFormat);
+    return GetImageTemplate(attributes, scale_denom, config.previewFormat).size;
+}
+
+unsigned long long HostTimeMicros()
+{
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+}
+
 // Extracts metadata from buffers
 ImageMetadata ExtractMetadataFromImage(buffer buffer)
 {
@@ -80,8 +147,11 @@ ImageMetadata ExtractMetadataFromMDBuffer(buffer buffer, bool to_mili = false)
     md.projector = tmp_md->laser_status;
     md.sensor_id = tmp_md->sensor_id;
     md.status = tmp_md->status;
+    md.frame_counter = tmp_md->frame_counter;
+    md.exposure_time = tmp_md->exposure_time;
 
-    LOG_TRACE(LOG_TAG, "timestamp:%d,led:%d,projector:%d", md.timestamp, md.led, md.projector);
+    LOG_TRACE(LOG_TAG, "timestamp:%d,frame:%u,led:%d,projector:%d", md.timestamp, md.frame_counter, md.led,
+              md.projector);
 
     return md;
 }
@@ -104,31 +174,66 @@ void StreamConverter::InitDecompressor()
 }
 
 // StreamConverter
-StreamConverter::StreamConverter(PreviewMode mode)
-{
-    _attributes = GetStreamAttributesByMode(mode);
-    _result_image.width = _attributes.width;
-    _result_image.height = _attributes.height;
-    _result_image.size = (_attributes.format == MJPEG) ? _result_image.width * _result_image.height * RGB_PIXEL_SIZE
-                                                      : (_result_image.width * _result_image.height / 4) * 5;
-    _result_image.stride = _result_image.size / _result_image.height;
-    _result_image.buffer = new unsigned char[_result_image.size];
+StreamConverter::StreamConverter(const PreviewConfig& config)
+{
+    _attributes = GetStreamAttributesByMode(config.previewMode);
+    _format = config.previewFormat;
+    _quality = config.previewQuality;
+    _scale_denom = GetScaleDenom(_attributes, config.previewScale, _format);
+    _result_image = GetImageTemplate(_attributes, _scale_denom, _format);
+    if (config.previewFps > 0)
+        _frame_interval = 1000000ull / config.previewFps;
     InitDecompressor();
+    if (config.previewDecoder == PreviewDecoder::Hardware && _attributes.format == MJPEG &&
+        _format != PreviewFormat::MJPEG && _format != PreviewFormat::METADATA)
+    {
+        try
+        {
+            _hw_decoder = CreateHardwareJpegDecoder(_attributes.width, _attributes.height);
+        }
+        catch (const std::exception& ex)
+        {
+            LOG_ERROR(LOG_TAG, "Hardware jpeg decoder init failed: %s", ex.what());
+        }
+        if (_hw_decoder && !_hw_decoder->Supports(_format, _scale_denom))
+            _hw_decoder.reset();
+        if (_hw_decoder)
+            LOG_INFO(LOG_TAG, "Decoding with %s", _hw_decoder->Name());
+        else
+            LOG_WARNING(LOG_TAG, "No hardware jpeg decoder for this preview, decoding with libjpeg");
+    }
 }
 
 StreamConverter::~StreamConverter()
 {
     ::jpeg_destroy_decompress(&_jpeg_dinfo);
+}
 
-    if (_result_image.buffer != nullptr)
+// true if the hardware decoder decoded the frame. false to decode it with libjpeg
+bool StreamConverter::HardwareDecode(Image* res, buffer frame_buffer)
+{
+    if (!_hw_decoder || _crop_requested)
+        return false;
+    RSID_TRACE_SPAN("preview", "HardwareDecode");
+    if (_hw_decoder->Decode(frame_buffer, _format, res))
     {
-        delete[] _result_image.buffer;
-        _result_image.buffer = nullptr;
+        _hw_failures = 0;
+        _crop_applied = false;
+        return true;
     }
+    if (++_hw_failures >= MAX_HW_DECODE_FAILURES)
+    {
+        LOG_WARNING(LOG_TAG, "%s failed %u times in a row, decoding with libjpeg", _hw_decoder->Name(), _hw_failures);
+        _hw_decoder.reset();
+    }
+    return false;
 }
 
 bool StreamConverter::DecodeJpeg(Image* res, buffer frame_buffer)
-{    
+{
+    RSID_TRACE_SPAN("preview", "DecodeJpeg");
+    if (HardwareDecode(res, frame_buffer))
+        return true;
     ::jpeg_mem_src(&_jpeg_dinfo, frame_buffer.data, frame_buffer.size); 
     auto rc = jpeg_read_header(&_jpeg_dinfo, TRUE);
     if (rc != 1)
@@ -138,25 +243,67 @@ bool StreamConverter::DecodeJpeg(Image* res, buffer frame_buffer)
         return false;
     }
 
-    if (RGB_PIXEL_SIZE == 4)
-        _jpeg_dinfo.out_color_space = JCS_EXT_RGBA;
+    switch (_format)
+    {
+    case PreviewFormat::GRAY8:
+        _jpeg_dinfo.out_color_space = JCS_GRAYSCALE;
+        break;
+    case PreviewFormat::I420:
+        if (_jpeg_dinfo.jpeg_color_space != JCS_YCbCr || _jpeg_dinfo.num_components != 3)
+        {
+            LOG_ERROR(LOG_TAG, "I420 output requires a YCbCr jpeg frame");
+            ::jpeg_abort_decompress(&_jpeg_dinfo);
+            return false;
+        }
+        _jpeg_dinfo.raw_data_out = TRUE;
+        break;
+    default:
+        if (RGB_PIXEL_SIZE == 4)
+            _jpeg_dinfo.out_color_space = JCS_EXT_RGBA;
+        break;
+    }
+
+    _jpeg_dinfo.scale_num = 1;
+    _jpeg_dinfo.scale_denom = _scale_denom;
+    if (_quality == PreviewQuality::Fast)
+    {
+        // set per frame, jpeg_read_header() restores the defaults
+        _jpeg_dinfo.dct_method = JDCT_IFAST;
+        _jpeg_dinfo.do_fancy_upsampling = FALSE;
+        _jpeg_dinfo.do_block_smoothing = FALSE;
+    }
 
     ::jpeg_start_decompress(&_jpeg_dinfo);
     auto width = _jpeg_dinfo.output_width;
     auto height = _jpeg_dinfo.output_height;
-    if (height > _result_image.height || width > _result_image.height)
+    if (width > _result_image.width || height > _result_image.height)
     {        
         LOG_ERROR(LOG_TAG, "jpeg decoded dimensions are bigger than expected");
+        ::jpeg_abort_decompress(&_jpeg_dinfo);
         return false;
     }
+    res->width = width;
+    res->height = height;
 
-    auto pixel_size = _jpeg_dinfo.output_components;
-    auto row_stride = width * pixel_size;
-    unsigned char* buffer_array[1];
-    while (_jpeg_dinfo.output_scanline < _jpeg_dinfo.output_height)
-    {        
-        buffer_array[0] = res->buffer + (_jpeg_dinfo.output_scanline) * row_stride;
-        ::jpeg_read_scanlines(&_jpeg_dinfo, buffer_array, 1);
+    _crop_applied = false;
+    if (_format == PreviewFormat::I420)
+    {
+        if (!ReadRawI420(res))
+        {
+            ::jpeg_abort_decompress(&_jpeg_dinfo);
+            return false;
+        }
+    }
+    else if (_crop_requested)
+    {
+        // the rows below the region are never decoded, so the decompressor is aborted instead of finished
+        bool ok = ReadCroppedScanlines(res);
+        ::jpeg_abort_decompress(&_jpeg_dinfo);
+        return ok;
+    }
+    else
+    {
+        ReadScanlines(res);
     }
 
     if (!::jpeg_finish_decompress(&_jpeg_dinfo))
@@ -167,15 +314,371 @@ bool StreamConverter::DecodeJpeg(Image* res, buffer frame_buffer)
     return true;
 }
 
-bool StreamConverter::Buffer2Image(Image* res, buffer frame_buffer,buffer md_buffer)
+void StreamConverter::ReadScanlines(Image* res)
+{
+    auto width = _jpeg_dinfo.output_width;
+    auto height = _jpeg_dinfo.output_height;
+    auto row_stride = width * _jpeg_dinfo.output_components;
+    res->stride = row_stride;
+
+    // hand libjpeg all the remaining rows in each call, so it decodes rec_outbuf_height rows at a time
+    // through its multi-row upsampling and color conversion paths
+    _jpeg_rows.resize(height);
+    for (unsigned int row = 0; row < height; row++)
+    {
+        _jpeg_rows[row] = res->buffer + row * row_stride;
+    }
+    while (_jpeg_dinfo.output_scanline < _jpeg_dinfo.output_height)
+    {
+        auto scanline = _jpeg_dinfo.output_scanline;
+        ::jpeg_read_scanlines(&_jpeg_dinfo, _jpeg_rows.data() + scanline, height - scanline);
+    }
+}
+
+// decode only the requested region: whole rows above it are skipped and each row is decoded only from the
+// iMCU column that contains the region's left edge (jpeg_crop_scanline)
+bool StreamConverter::ReadCroppedScanlines(Image* res)
+{
+    auto width = _jpeg_dinfo.output_width;
+    auto height = _jpeg_dinfo.output_height;
+    auto pixel_size = static_cast<unsigned int>(_jpeg_dinfo.output_components);
+
+    // the region is given in full resolution frame coordinates
+    JDIMENSION left = std::min(width, _crop_region.x / _scale_denom);
+    JDIMENSION top = std::min(height, _crop_region.y / _scale_denom);
+    JDIMENSION right = std::min(width, (_crop_region.x + _crop_region.w + _scale_denom - 1) / _scale_denom);
+    JDIMENSION bottom = std::min(height, (_crop_region.y + _crop_region.h + _scale_denom - 1) / _scale_denom);
+    if (right <= left || bottom <= top)
+    {
+        LOG_DEBUG(LOG_TAG, "Crop region is outside the frame");
+        return false;
+    }
+
+    // one more column on each side, so chroma upsampling at the region's edges sees the real neighbours.
+    // jpeg_crop_scanline then moves xoffset left and widens crop_width to whole iMCU columns
+    JDIMENSION xoffset = left > 0 ? left - 1 : 0;
+    JDIMENSION crop_width = std::min(width, right + 1) - xoffset;
+    ::jpeg_crop_scanline(&_jpeg_dinfo, &xoffset, &crop_width);
+    if (top > 0)
+    {
+        ::jpeg_skip_scanlines(&_jpeg_dinfo, top);
+    }
+
+    auto decoded_stride = crop_width * pixel_size;
+    auto rows = bottom - top;
+    _jpeg_rows.resize(rows);
+    for (unsigned int row = 0; row < rows; row++)
+    {
+        _jpeg_rows[row] = res->buffer + row * decoded_stride;
+    }
+    while (_jpeg_dinfo.output_scanline < bottom)
+    {
+        auto row = _jpeg_dinfo.output_scanline - top;
+        ::jpeg_read_scanlines(&_jpeg_dinfo, _jpeg_rows.data() + row, rows - row);
+    }
+
+    // trim the columns added for the iMCU alignment, in place
+    auto stride = (right - left) * pixel_size;
+    auto trim = (left - xoffset) * pixel_size;
+    for (unsigned int row = 0; row < rows; row++)
+    {
+        ::memmove(res->buffer + row * stride, res->buffer + row * decoded_stride + trim, stride);
+    }
+
+    res->width = right - left;
+    res->height = rows;
+    res->stride = stride;
+    _applied_crop.x = left;
+    _applied_crop.y = top;
+    _applied_crop.w = right - left;
+    _applied_crop.h = rows;
+    _crop_applied = true;
+    return true;
+}
+
+void StreamConverter::SetCropRegion(const FaceRect* region)
+{
+    _crop_requested = region != nullptr;
+    if (region != nullptr)
+    {
+        _crop_region = *region;
+    }
+}
+
+const FaceRect* StreamConverter::CroppedRegion() const
+{
+    return _crop_applied ? &_applied_crop : nullptr;
+}
+
+#if JPEG_LIB_VERSION >= 70
+static int DctWidth(const jpeg_component_info& comp)
+{
+    return comp.DCT_h_scaled_size;
+}
+static int DctHeight(const jpeg_component_info& comp)
+{
+    return comp.DCT_v_scaled_size;
+}
+#else
+static int DctWidth(const jpeg_component_info& comp)
+{
+    return comp.DCT_scaled_size;
+}
+static int DctHeight(const jpeg_component_info& comp)
+{
+    return comp.DCT_scaled_size;
+}
+#endif
+
+// read the decoded YCbCr planes as they are (no upsampling or color conversion) into an I420 image.
+// chroma that is sampled more densely than 2x2 (4:2:2 or 4:4:4 frames) is decimated
+bool StreamConverter::ReadRawI420(Image* res)
+{
+    auto width = _jpeg_dinfo.output_width;
+    auto height = _jpeg_dinfo.output_height;
+    auto chroma_width = (width + 1) / 2;
+    auto chroma_height = (height + 1) / 2;
+    const jpeg_component_info* comps = _jpeg_dinfo.comp_info;
+
+    // samples per output pixel of each component. when scaling, libjpeg may decode chroma at a larger dct size
+    // than luma, which reduces its subsampling
+    unsigned int ratio_x[3], ratio_y[3];
+    for (int c = 0; c < 3; c++)
+    {
+        auto luma_w = _jpeg_dinfo.max_h_samp_factor * DctWidth(comps[0]);
+        auto luma_h = _jpeg_dinfo.max_v_samp_factor * DctHeight(comps[0]);
+        auto comp_w = comps[c].h_samp_factor * DctWidth(comps[c]);
+        auto comp_h = comps[c].v_samp_factor * DctHeight(comps[c]);
+        ratio_x[c] = (luma_w % comp_w == 0) ? luma_w / comp_w : 0;
+        ratio_y[c] = (luma_h % comp_h == 0) ? luma_h / comp_h : 0;
+    }
+    if (ratio_x[0] != 1 || ratio_y[0] != 1 || ratio_x[1] == 0 || ratio_x[1] > 2 || ratio_y[1] == 0 ||
+        ratio_y[1] > 2 || ratio_x[2] != ratio_x[1] || ratio_y[2] != ratio_y[1])
+    {
+        LOG_ERROR(LOG_TAG, "Unsupported jpeg sampling for I420 output");
+        return false;
+    }
+
+    JSAMPARRAY planes[3];
+    for (int c = 0; c < 3; c++)
+    {
+        auto rows = comps[c].v_samp_factor * DctHeight(comps[c]);
+        auto row_size = comps[c].width_in_blocks * DctWidth(comps[c]);
+        _raw_data[c].resize(rows * row_size);
+        _raw_rows[c].resize(rows);
+        for (int row = 0; row < rows; row++)
+        {
+            _raw_rows[c][row] = _raw_data[c].data() + row * row_size;
+        }
+        planes[c] = _raw_rows[c].data();
+    }
+
+    unsigned char* y_plane = res->buffer;
+    unsigned char* chroma_planes[2] = {y_plane + width * height,
+                                       y_plane + width * height + chroma_width * chroma_height};
+    res->stride = width;
+
+    unsigned int lines_per_imcu = comps[0].v_samp_factor * DctHeight(comps[0]);
+    unsigned int imcu_row = 0;
+    while (_jpeg_dinfo.output_scanline < _jpeg_dinfo.output_height)
+    {
+        if (::jpeg_read_raw_data(&_jpeg_dinfo, planes, lines_per_imcu) == 0)
+        {
+            LOG_ERROR(LOG_TAG, "jpeg_read_raw_data failed");
+            return false;
+        }
+
+        auto first_y = imcu_row * lines_per_imcu;
+        for (unsigned int row = 0; row < lines_per_imcu && first_y + row < height; row++)
+        {
+            ::memcpy(y_plane + (first_y + row) * width, planes[0][row], width);
+        }
+
+        for (int c = 1; c < 3; c++)
+        {
+            unsigned int rows = comps[c].v_samp_factor * DctHeight(comps[c]);
+            for (unsigned int row = 0; row < rows; row++)
+            {
+                auto luma_row = (imcu_row * rows + row) * ratio_y[c];
+                if (luma_row % 2 != 0)
+                    continue; // full resolution chroma rows between the I420 chroma rows
+                auto out_row = luma_row / 2;
+                if (out_row >= chroma_height)
+                    break;
+                auto* dst = chroma_planes[c - 1] + out_row * chroma_width;
+                const auto* src = planes[c][row];
+                if (ratio_x[c] == 2)
+                {
+                    ::memcpy(dst, src, chroma_width);
+                }
+                else
+                {
+                    for (unsigned int x = 0; x < chroma_width; x++)
+                        dst[x] = src[x * 2];
+                }
+            }
+        }
+        ++imcu_row;
+    }
+    return true;
+}
+
+// the frame as received: the jpeg of the mjpeg modes, the yuy2 pixels of the yuy2 mode
+bool StreamConverter::PassthroughFrame(Image* res, buffer frame_buffer)
+{
+    if (frame_buffer.data == nullptr || frame_buffer.size == 0)
+    {
+        return false;
+    }
+    if (frame_buffer.size > _result_image.size)
+    {
+        LOG_ERROR(LOG_TAG, "frame of %u bytes is bigger than expected", frame_buffer.size);
+        return false;
+    }
+    ::memcpy(res->buffer, frame_buffer.data, frame_buffer.size);
+    res->size = frame_buffer.size;
+    return true;
+}
+
+// convert the uncompressed frame in place from the capture buffer. a crop region is converted alone, as with jpeg
+bool StreamConverter::ConvertYuy2(Image* res, buffer frame_buffer)
 {
+    RSID_TRACE_SPAN("preview", "ConvertYuy2");
+    Yuy2Frame frame;
+    frame.data = frame_buffer.data;
+    frame.width = _attributes.width;
+    frame.height = _attributes.height;
+    // rows may be padded by the driver
+    frame.stride = frame_buffer.size / _attributes.height;
+    if (frame.data == nullptr || frame.stride < frame.width * 2)
+    {
+        LOG_ERROR(LOG_TAG, "Got invalid yuy2 frame of %u bytes", frame_buffer.size);
+        return false;
+    }
+
+    _crop_applied = false;
+    if (_format == PreviewFormat::I420)
+    {
+        Yuy2ToI420(frame, _scale_denom, res->buffer);
+        return true;
+    }
+
+    const unsigned int pixel_size = _format == PreviewFormat::GRAY8 ? 1 : RGB_PIXEL_SIZE;
+    FaceRect region;
+    region.w = frame.width;
+    region.h = frame.height;
+    if (_crop_requested)
+    {
+        // same region of the output as the jpeg crop, in scaled output coordinates
+        unsigned int left = std::min(res->width, _crop_region.x / _scale_denom);
+        unsigned int top = std::min(res->height, _crop_region.y / _scale_denom);
+        unsigned int right = std::min(res->width, (_crop_region.x + _crop_region.w + _scale_denom - 1) / _scale_denom);
+        unsigned int bottom =
+            std::min(res->height, (_crop_region.y + _crop_region.h + _scale_denom - 1) / _scale_denom);
+        if (right <= left || bottom <= top)
+        {
+            LOG_DEBUG(LOG_TAG, "Crop region is outside the frame");
+            return false;
+        }
+        region.x = left * _scale_denom;
+        region.y = top * _scale_denom;
+        region.w = (right - left) * _scale_denom;
+        region.h = (bottom - top) * _scale_denom;
+        _applied_crop.x = left;
+        _applied_crop.y = top;
+        _applied_crop.w = right - left;
+        _applied_crop.h = bottom - top;
+        _crop_applied = true;
+        res->width = _applied_crop.w;
+        res->height = _applied_crop.h;
+    }
+    res->stride = res->width * pixel_size;
+    res->size = res->stride * res->height;
+    if (_format == PreviewFormat::GRAY8)
+        Yuy2ToGray(frame, region, _scale_denom, res->buffer, res->stride);
+    else
+        Yuy2ToRgb(frame, region, _scale_denom, pixel_size, res->buffer, res->stride);
+    return true;
+}
+
+bool StreamConverter::Buffer2Image(Image* res, buffer frame_buffer, buffer md_buffer)
+{
+    auto* target = res->buffer;
+    auto receive_time = res->receive_time;
     *res = _result_image;
+    res->buffer = target;
+    res->receive_time = receive_time;
+    if (_recorder != nullptr) // also frames dropped for lack of a buffer
+    {
+        const char* extension = _attributes.format == RAW ? "raw" : (_attributes.format == YUY2 ? "yuy2" : "jpg");
+        _recorder->Push(frame_buffer.data, frame_buffer.size, receive_time, extension);
+    }
+    if (SkipFrame(receive_time))
+    {
+        return false;
+    }
+    if (target == nullptr && _format != PreviewFormat::METADATA) // no free buffer, drop the frame
+    {
+        return false;
+    }
+    struct
+    {
+        Image* res;
+        buffer frame_buffer;
+        buffer md_buffer;
+        unsigned long long start_time;
+        bool converted;
+    } job {res, frame_buffer, md_buffer, 0, false};
+    // captures two pointers only, small enough for std::function to keep without allocating
+    auto convert = [this, &job] {
+        job.start_time = HostTimeMicros(); // not counting the wait for a decode thread
+        job.converted = ConvertFrame(job.res, job.frame_buffer, job.md_buffer);
+    };
+    if (_executor != nullptr && _format != PreviewFormat::METADATA) // not worth a thread switch
+    {
+        _executor->Run(convert);
+    }
+    else
+    {
+        convert();
+    }
+    if (!job.converted)
+    {
+        return false;
+    }
+    res->decode_time = HostTimeMicros();
+    _last_decode_micros = static_cast<unsigned int>(res->decode_time - job.start_time);
+    if (_tap != nullptr)
+    {
+        _tap->OnFrameConverted(frame_buffer, *res, _crop_applied);
+    }
+    return true;
+}
+
+bool StreamConverter::SkipFrame(unsigned long long receive_time)
+{
+    if (_frame_interval == 0)
+        return false;
+    // a frame up to a quarter interval early is taken, so jitter of the camera's frames does not skip one more
+    if (receive_time + _frame_interval / 4 < _next_frame_time)
+        return true;
+    _next_frame_time = receive_time + _frame_interval;
+    return false;
+}
+
+bool StreamConverter::ConvertFrame(Image* res, buffer frame_buffer, buffer md_buffer)
+{
+    RSID_TRACE_SPAN("preview", "ConvertFrame");
     switch (_attributes.format) // process image by mode
     {
     case MJPEG:
         try
         {
             res->metadata = ExtractMetadataFromMDBuffer(md_buffer,true);
+            if (_format == PreviewFormat::METADATA)
+                return true;
+            if (_format == PreviewFormat::MJPEG)
+                return PassthroughFrame(res, frame_buffer);
             return DecodeJpeg(res, frame_buffer);
         }
         catch (const std::exception& ex)
@@ -190,9 +693,18 @@ bool StreamConverter::Buffer2Image(Image* res, buffer frame_buffer,buffer md_buf
         res->metadata = md_buffer.size== 0 ? ExtractMetadataFromImage(frame_buffer) : ExtractMetadataFromMDBuffer(md_buffer);
         if (res->metadata.timestamp == 0) // don't return non-dumped images
             return false;
+        if (_format == PreviewFormat::METADATA)
+            return true;
         ::memcpy(res->buffer, frame_buffer.data, frame_buffer.size);
         return true;
         break;
+    case YUY2:
+        res->metadata = ExtractMetadataFromMDBuffer(md_buffer, true);
+        if (_format == PreviewFormat::METADATA)
+            return true;
+        if (_format == PreviewFormat::MJPEG)
+            return PassthroughFrame(res, frame_buffer);
+        return ConvertYuy2(res, frame_buffer);
     default:
         LOG_ERROR(LOG_TAG, "Unsupported preivew mode");
         return false;
@@ -205,6 +717,26 @@ bool StreamConverter::Buffer2Image(Image* res, buffer frame_buffer)
     return Buffer2Image(res, frame_buffer, dummy);
 }
 
+void StreamConverter::SetRecorder(FrameRecorder* recorder)
+{
+    _recorder = recorder;
+}
+
+void StreamConverter::SetTap(FrameTap* tap)
+{
+    _tap = tap;
+}
+
+void StreamConverter::SetExecutor(DecodeExecutor* executor)
+{
+    _executor = executor;
+}
+
+unsigned int StreamConverter::LastDecodeMicros() const
+{
+    return _last_decode_micros;
+}
+
 StreamAttributes StreamConverter::GetStreamAttributes()
 {
     return _attributes;
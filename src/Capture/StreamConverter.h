@@ -1,19 +1,25 @@
 #pragma once
 #include "RealSenseID/Preview.h"
+#include "FrameRecorder.h"
+#include "DecodeExecutor.h"
+#include "LibraryMemory.h"
 #include <stdio.h> // needed for jpeglib's FILE* usage
 #include "jpeglib.h"
 #include <memory>
 #include <functional>
+#include <vector>
 
 namespace RealSenseID
 {
 namespace Capture
 {
+class JpegDecoder;
 
 enum StreamFormat
 {
     MJPEG,
-    RAW
+    RAW,
+    YUY2
 };
 
 struct StreamAttributes
@@ -29,24 +35,88 @@ struct buffer
     unsigned int size = 0;
 };
 
+// size of the preview image buffer required for the given config
+unsigned int GetImageSize(const PreviewConfig& config);
+
+// host time of Image::receive_time / decode_time
+unsigned long long HostTimeMicros();
+
+// receives the frames converted by a StreamConverter, while the frame as received is still valid
+class FrameTap
+{
+public:
+    virtual ~FrameTap() = default;
+    // called by Buffer2Image() after converting a frame. cropped: image is a crop region of the frame
+    virtual void OnFrameConverted(buffer frame_buffer, const Image& image, bool cropped) = 0;
+};
+
 class StreamConverter
 {
 public:
-    StreamConverter(PreviewMode mode);
-    ~StreamConverter();    
+    explicit StreamConverter(const PreviewConfig& config);
+    ~StreamConverter();
+    // decode the frame into res->buffer, which must hold GetImageSize() bytes.
+    // the frame is dropped (returns false) if res->buffer is null, or skipped undecoded (returns false) to keep
+    // PreviewConfig::previewFps.
+    // res->receive_time is kept (set by the caller) and res->decode_time is set on success.
     bool Buffer2Image(Image* res, buffer frame_buffer, buffer metadata_buffer);
     bool Buffer2Image(Image* res, buffer frame_buffer);
     StreamAttributes GetStreamAttributes();
 
+    // decode only the given region (full resolution frame coordinates) of the next RGB / GRAY8 frames. RAW10
+    // frames are not cropped. nullptr decodes full frames again
+    void SetCropRegion(const FaceRect* region);
+    // the region of the frame decoded last (scaled output coordinates), or nullptr if it is a full frame
+    const FaceRect* CroppedRegion() const;
+    // keep the following frames, as received, in the recorder. nullptr stops
+    void SetRecorder(FrameRecorder* recorder);
+    // pass the following converted frames to the tap. nullptr stops
+    void SetTap(FrameTap* tap);
+    // decode the following frames on the executor's threads, Buffer2Image() waits for them. nullptr decodes on the
+    // calling thread
+    void SetExecutor(DecodeExecutor* executor);
+    // decode duration of the frame decoded last
+    unsigned int LastDecodeMicros() const;
+
 private:
     StreamAttributes _attributes;
-    Image _result_image; 
+    unsigned int _scale_denom = 1;
+    PreviewFormat _format = PreviewFormat::RGB;
+    PreviewQuality _quality = PreviewQuality::Full; // of the libjpeg decode
+    Image _result_image; // dimensions of the result, the buffer is supplied by the caller
     // jpeg structs
     jpeg_error_mgr _jpeg_jerr {0};
     jpeg_decompress_struct _jpeg_dinfo {0};
+    // output row pointers, reused between frames. the buffers are from the library's allocator
+    template <typename T>
+    using ConversionVector = std::vector<T, Memory::StdAllocator<T, alignof(T), Memory::Category::PreviewConversion>>;
+    ConversionVector<JSAMPROW> _jpeg_rows;
+    // per component rows of one iMCU row, for raw (planar) output
+    ConversionVector<unsigned char> _raw_data[3];
+    ConversionVector<JSAMPROW> _raw_rows[3];
+    bool _crop_requested = false;
+    bool _crop_applied = false;
+    FaceRect _crop_region;
+    FaceRect _applied_crop;
+    unsigned int _last_decode_micros = 0;
+    unsigned long long _frame_interval = 0; // by PreviewConfig::previewFps, 0 for all the frames
+    unsigned long long _next_frame_time = 0;
+    FrameRecorder* _recorder = nullptr;
+    DecodeExecutor* _executor = nullptr;
+    FrameTap* _tap = nullptr;
+    std::unique_ptr<JpegDecoder> _hw_decoder; // by PreviewConfig::previewDecoder, nullptr for libjpeg only
+    unsigned int _hw_failures = 0;            // consecutive
 
     void InitDecompressor();
+    bool SkipFrame(unsigned long long receive_time);
     bool DecodeJpeg(Image* res, buffer frame_buffer);
+    bool HardwareDecode(Image* res, buffer frame_buffer);
+    void ReadScanlines(Image* res);
+    bool ReadRawI420(Image* res);
+    bool ReadCroppedScanlines(Image* res);
+    bool PassthroughFrame(Image* res, buffer frame_buffer);
+    bool ConvertYuy2(Image* res, buffer frame_buffer);
+    bool ConvertFrame(Image* res, buffer frame_buffer, buffer metadata_buffer);
 };
 } // namespace Capture
 } // namespace RealSenseID
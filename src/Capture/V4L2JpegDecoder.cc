@@ -0,0 +1,339 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "V4L2JpegDecoder.h"
+#include "Logger.h"
+#include <linux/videodev2.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstring>
+#include <string>
+
+static const char* LOG_TAG = "V4L2JpegDecoder";
+
+namespace RealSenseID
+{
+namespace Capture
+{
+static const std::string VIDEO_DEV = "/dev/video";
+static const int MAX_VIDEO_DEVICES = 64;
+static const int DECODE_TIMEOUT_MS = 1000;
+static const uint32_t OUTPUT_TYPE = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE; // jpeg frames to the device
+static const uint32_t CAPTURE_TYPE = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE; // decoded images from the device
+
+// decoded formats in order of preference
+static const uint32_t CAPTURE_FORMATS[] = {V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_NV12M, V4L2_PIX_FMT_YUV420,
+                                           V4L2_PIX_FMT_YUV420M};
+
+static int Ioctl(int fd, unsigned long request, void* arg)
+{
+    int ret;
+    do
+    {
+        ret = ioctl(fd, request, arg);
+    } while (ret == -1 && errno == EINTR);
+    return ret;
+}
+
+// the jpeg format of a memory-to-memory device, 0 if it does not decode jpeg
+static uint32_t JpegFormat(int fd)
+{
+    v4l2_capability cap;
+    ::memset(&cap, 0, sizeof(cap));
+    if (Ioctl(fd, VIDIOC_QUERYCAP, &cap) == -1)
+        return 0;
+    uint32_t caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS) ? cap.device_caps : cap.capabilities;
+    if (!(caps & V4L2_CAP_VIDEO_M2M_MPLANE) || !(caps & V4L2_CAP_STREAMING))
+        return 0;
+
+    v4l2_fmtdesc desc;
+    ::memset(&desc, 0, sizeof(desc));
+    desc.type = OUTPUT_TYPE;
+    for (desc.index = 0; Ioctl(fd, VIDIOC_ENUM_FMT, &desc) == 0; desc.index++)
+    {
+        if (desc.pixelformat == V4L2_PIX_FMT_JPEG || desc.pixelformat == V4L2_PIX_FMT_MJPEG)
+            return desc.pixelformat;
+    }
+    return 0;
+}
+
+std::unique_ptr<V4L2JpegDecoder> V4L2JpegDecoder::Create(unsigned int width, unsigned int height)
+{
+    for (int i = 0; i < MAX_VIDEO_DEVICES; i++)
+    {
+        std::string path = VIDEO_DEV + std::to_string(i);
+        int fd = open(path.c_str(), O_RDWR | O_NONBLOCK);
+        if (fd == -1)
+            continue;
+        uint32_t jpeg_format = JpegFormat(fd);
+        if (jpeg_format == 0)
+        {
+            close(fd);
+            continue;
+        }
+        std::unique_ptr<V4L2JpegDecoder> decoder {new V4L2JpegDecoder(fd, width, height)}; // owns fd
+        if (decoder->Init(jpeg_format))
+        {
+            LOG_INFO(LOG_TAG, "Using jpeg decoder %s", path.c_str());
+            return decoder;
+        }
+        LOG_DEBUG(LOG_TAG, "%s cannot decode %ux%u jpeg frames", path.c_str(), width, height);
+    }
+    return nullptr;
+}
+
+V4L2JpegDecoder::V4L2JpegDecoder(int fd, unsigned int width, unsigned int height) :
+    _fd(fd), _width(width), _height(height)
+{
+}
+
+V4L2JpegDecoder::~V4L2JpegDecoder()
+{
+    if (_streaming)
+    {
+        int type = OUTPUT_TYPE;
+        Ioctl(_fd, VIDIOC_STREAMOFF, &type);
+        type = CAPTURE_TYPE;
+        Ioctl(_fd, VIDIOC_STREAMOFF, &type);
+    }
+    for (auto* planes : {&_jpeg_planes, &_decoded_planes})
+    {
+        for (auto& plane : *planes)
+        {
+            if (plane.data != nullptr)
+                munmap(plane.data, plane.length);
+        }
+    }
+    close(_fd);
+}
+
+const char* V4L2JpegDecoder::Name() const
+{
+    return "v4l2-m2m";
+}
+
+bool V4L2JpegDecoder::Supports(PreviewFormat format, unsigned int scale_denom) const
+{
+    return scale_denom == 1 &&
+           (format == PreviewFormat::RGB || format == PreviewFormat::GRAY8 || format == PreviewFormat::I420);
+}
+
+bool V4L2JpegDecoder::Init(uint32_t jpeg_format)
+{
+    v4l2_format fmt;
+    ::memset(&fmt, 0, sizeof(fmt));
+    fmt.type = OUTPUT_TYPE;
+    fmt.fmt.pix_mp.pixelformat = jpeg_format;
+    fmt.fmt.pix_mp.width = _width;
+    fmt.fmt.pix_mp.height = _height;
+    fmt.fmt.pix_mp.num_planes = 1;
+    fmt.fmt.pix_mp.plane_fmt[0].sizeimage = _width * _height * 2; // room for the largest camera jpeg
+    if (Ioctl(_fd, VIDIOC_S_FMT, &fmt) == -1 || fmt.fmt.pix_mp.pixelformat != jpeg_format)
+        return false;
+
+    if (!SetCaptureFormat())
+        return false;
+
+    for (uint32_t type : {OUTPUT_TYPE, CAPTURE_TYPE})
+    {
+        v4l2_requestbuffers req;
+        ::memset(&req, 0, sizeof(req));
+        req.count = 1;
+        req.type = type;
+        req.memory = V4L2_MEMORY_MMAP;
+        if (Ioctl(_fd, VIDIOC_REQBUFS, &req) == -1 || req.count < 1)
+            return false;
+    }
+    if (!MapBuffer(OUTPUT_TYPE, _jpeg_planes) || !MapBuffer(CAPTURE_TYPE, _decoded_planes))
+        return false;
+
+    for (uint32_t type : {OUTPUT_TYPE, CAPTURE_TYPE})
+    {
+        int stream_type = static_cast<int>(type);
+        if (Ioctl(_fd, VIDIOC_STREAMON, &stream_type) == -1)
+            return false;
+    }
+    _streaming = true;
+    return true;
+}
+
+bool V4L2JpegDecoder::SetCaptureFormat()
+{
+    for (uint32_t format : CAPTURE_FORMATS)
+    {
+        v4l2_format fmt;
+        ::memset(&fmt, 0, sizeof(fmt));
+        fmt.type = CAPTURE_TYPE;
+        fmt.fmt.pix_mp.pixelformat = format;
+        fmt.fmt.pix_mp.width = _width;
+        fmt.fmt.pix_mp.height = _height;
+        if (Ioctl(_fd, VIDIOC_S_FMT, &fmt) == -1)
+            continue;
+        // the driver may align the dimensions up, the frame is at the top left
+        const auto& pix = fmt.fmt.pix_mp;
+        if (pix.pixelformat != format || pix.width < _width || pix.height < _height)
+            continue;
+        _capture_format = format;
+        _capture_height = pix.height;
+        for (unsigned int p = 0; p < pix.num_planes && p < 3; p++)
+            _bytes_per_line[p] = pix.plane_fmt[p].bytesperline;
+        return true;
+    }
+    return false;
+}
+
+bool V4L2JpegDecoder::MapBuffer(uint32_t type, std::vector<Plane>& planes)
+{
+    v4l2_plane buf_planes[VIDEO_MAX_PLANES];
+    ::memset(buf_planes, 0, sizeof(buf_planes));
+    v4l2_buffer buf;
+    ::memset(&buf, 0, sizeof(buf));
+    buf.type = type;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = 0;
+    buf.m.planes = buf_planes;
+    buf.length = VIDEO_MAX_PLANES;
+    if (Ioctl(_fd, VIDIOC_QUERYBUF, &buf) == -1)
+        return false;
+
+    planes.resize(buf.length);
+    for (unsigned int p = 0; p < buf.length; p++)
+    {
+        void* data = mmap(nullptr, buf_planes[p].length, PROT_READ | PROT_WRITE, MAP_SHARED, _fd,
+                          buf_planes[p].m.mem_offset);
+        if (data == MAP_FAILED)
+            return false;
+        planes[p].data = static_cast<unsigned char*>(data);
+        planes[p].length = buf_planes[p].length;
+    }
+    return true;
+}
+
+bool V4L2JpegDecoder::WaitAndDequeue(uint32_t type, short events, unsigned int num_planes, uint32_t& flags)
+{
+    v4l2_plane buf_planes[VIDEO_MAX_PLANES];
+    ::memset(buf_planes, 0, sizeof(buf_planes));
+    v4l2_buffer buf;
+    ::memset(&buf, 0, sizeof(buf));
+    buf.type = type;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.m.planes = buf_planes;
+    buf.length = num_planes;
+    while (Ioctl(_fd, VIDIOC_DQBUF, &buf) == -1)
+    {
+        if (errno != EAGAIN)
+            return false;
+        pollfd poll_fd {_fd, events, 0};
+        int ready = poll(&poll_fd, 1, DECODE_TIMEOUT_MS);
+        if (ready == 0)
+        {
+            LOG_ERROR(LOG_TAG, "Decode timed out");
+            return false;
+        }
+        if (ready == -1 && errno != EINTR)
+            return false;
+    }
+    flags = buf.flags;
+    return true;
+}
+
+void V4L2JpegDecoder::Restart()
+{
+    for (uint32_t type : {OUTPUT_TYPE, CAPTURE_TYPE})
+    {
+        int stream_type = static_cast<int>(type);
+        Ioctl(_fd, VIDIOC_STREAMOFF, &stream_type); // returns the queued buffers
+        Ioctl(_fd, VIDIOC_STREAMON, &stream_type);
+    }
+}
+
+Yuv420Image V4L2JpegDecoder::DecodedImage() const
+{
+    Yuv420Image image;
+    image.width = _width;
+    image.height = _height;
+    image.y = _decoded_planes[0].data;
+    image.y_stride = _bytes_per_line[0];
+    switch (_capture_format)
+    {
+    case V4L2_PIX_FMT_NV12:
+        image.u = image.y + _bytes_per_line[0] * _capture_height;
+        image.v = image.u + 1;
+        image.chroma_stride = _bytes_per_line[0];
+        image.chroma_step = 2;
+        break;
+    case V4L2_PIX_FMT_NV12M:
+        image.u = _decoded_planes[1].data;
+        image.v = image.u + 1;
+        image.chroma_stride = _bytes_per_line[1];
+        image.chroma_step = 2;
+        break;
+    case V4L2_PIX_FMT_YUV420:
+        image.chroma_stride = _bytes_per_line[0] / 2;
+        image.u = image.y + _bytes_per_line[0] * _capture_height;
+        image.v = image.u + image.chroma_stride * ((_capture_height + 1) / 2);
+        break;
+    default: // V4L2_PIX_FMT_YUV420M
+        image.u = _decoded_planes[1].data;
+        image.v = _decoded_planes[2].data;
+        image.chroma_stride = _bytes_per_line[1];
+        break;
+    }
+    return image;
+}
+
+bool V4L2JpegDecoder::Decode(buffer frame_buffer, PreviewFormat format, Image* res)
+{
+    if (frame_buffer.size > _jpeg_planes[0].length)
+    {
+        LOG_ERROR(LOG_TAG, "jpeg frame of %u bytes is bigger than the decoder's buffer", frame_buffer.size);
+        return false;
+    }
+    ::memcpy(_jpeg_planes[0].data, frame_buffer.data, frame_buffer.size);
+
+    v4l2_plane jpeg_plane;
+    ::memset(&jpeg_plane, 0, sizeof(jpeg_plane));
+    jpeg_plane.bytesused = frame_buffer.size;
+    jpeg_plane.length = static_cast<uint32_t>(_jpeg_planes[0].length);
+    v4l2_buffer jpeg_buf;
+    ::memset(&jpeg_buf, 0, sizeof(jpeg_buf));
+    jpeg_buf.type = OUTPUT_TYPE;
+    jpeg_buf.memory = V4L2_MEMORY_MMAP;
+    jpeg_buf.index = 0;
+    jpeg_buf.m.planes = &jpeg_plane;
+    jpeg_buf.length = 1;
+
+    v4l2_plane decoded_planes[VIDEO_MAX_PLANES];
+    ::memset(decoded_planes, 0, sizeof(decoded_planes));
+    v4l2_buffer decoded_buf;
+    ::memset(&decoded_buf, 0, sizeof(decoded_buf));
+    decoded_buf.type = CAPTURE_TYPE;
+    decoded_buf.memory = V4L2_MEMORY_MMAP;
+    decoded_buf.index = 0;
+    decoded_buf.m.planes = decoded_planes;
+    decoded_buf.length = static_cast<uint32_t>(_decoded_planes.size());
+
+    uint32_t flags = 0;
+    bool ok = Ioctl(_fd, VIDIOC_QBUF, &decoded_buf) == 0 && Ioctl(_fd, VIDIOC_QBUF, &jpeg_buf) == 0 &&
+              WaitAndDequeue(CAPTURE_TYPE, POLLIN, decoded_buf.length, flags);
+    uint32_t jpeg_flags = 0;
+    ok = ok && WaitAndDequeue(OUTPUT_TYPE, POLLOUT, 1, jpeg_flags);
+    if (!ok)
+    {
+        LOG_ERROR(LOG_TAG, "Decode failed: %s", strerror(errno));
+        Restart();
+        return false;
+    }
+    if (flags & V4L2_BUF_FLAG_ERROR)
+    {
+        LOG_DEBUG(LOG_TAG, "Corrupt jpeg frame");
+        return false;
+    }
+    return ConvertYuv420(DecodedImage(), format, res);
+}
+} // namespace Capture
+} // namespace RealSenseID
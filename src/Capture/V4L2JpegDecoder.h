@@ -0,0 +1,58 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "JpegDecoder.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace RealSenseID
+{
+namespace Capture
+{
+// Jpeg decoding by a V4L2 memory-to-memory decoder device (multi-planar API), as found on most SoCs.
+// One jpeg (output) buffer and one decoded (capture) buffer, a frame at a time. Decodes to NV12 or YUV420, converted
+// to the preview format by ConvertYuv420.
+class V4L2JpegDecoder : public JpegDecoder
+{
+public:
+    // the first /dev/video device decoding jpeg to a supported format at the dimensions, nullptr if none
+    static std::unique_ptr<V4L2JpegDecoder> Create(unsigned int width, unsigned int height);
+    ~V4L2JpegDecoder() override;
+
+    V4L2JpegDecoder(const V4L2JpegDecoder&) = delete;
+    V4L2JpegDecoder& operator=(const V4L2JpegDecoder&) = delete;
+
+    const char* Name() const override;
+    bool Supports(PreviewFormat format, unsigned int scale_denom) const override;
+    bool Decode(buffer frame_buffer, PreviewFormat format, Image* res) override;
+
+private:
+    struct Plane
+    {
+        unsigned char* data = nullptr;
+        size_t length = 0;
+    };
+
+    V4L2JpegDecoder(int fd, unsigned int width, unsigned int height);
+    bool Init(uint32_t jpeg_format);
+    bool SetCaptureFormat();
+    bool MapBuffer(uint32_t type, std::vector<Plane>& planes);
+    bool WaitAndDequeue(uint32_t type, short events, unsigned int num_planes, uint32_t& flags);
+    void Restart(); // reclaim the queued buffers after a failed decode
+    Yuv420Image DecodedImage() const;
+
+    int _fd;
+    unsigned int _width;
+    unsigned int _height;
+    uint32_t _capture_format = 0;
+    unsigned int _capture_height = 0; // may be aligned by the driver
+    unsigned int _bytes_per_line[3] = {0, 0, 0};
+    std::vector<Plane> _jpeg_planes;
+    std::vector<Plane> _decoded_planes;
+    bool _streaming = false;
+};
+} // namespace Capture
+} // namespace RealSenseID
@@ -0,0 +1,141 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "Yuy2ToImage.h"
+#include <cstddef>
+
+namespace RealSenseID
+{
+namespace Capture
+{
+// libjpeg's YCbCr to RGB (jdcolor.c): 16 bit fixed-point coefficients, rounded
+static constexpr int SCALE_BITS = 16;
+static constexpr int ONE_HALF = 1 << (SCALE_BITS - 1);
+
+static constexpr int Fix(double x)
+{
+    return static_cast<int>(x * (1 << SCALE_BITS) + 0.5);
+}
+
+static constexpr int CR_R = Fix(1.40200);
+static constexpr int CB_B = Fix(1.77200);
+static constexpr int CR_G = Fix(0.71414);
+static constexpr int CB_G = Fix(0.34414);
+
+// the chroma terms added to the luma of each channel, shared by the two pixels of a pair
+struct ChromaTerms
+{
+    int r;
+    int g;
+    int b;
+};
+
+static inline ChromaTerms Chroma(int cb, int cr)
+{
+    cb -= 128;
+    cr -= 128;
+    return {(CR_R * cr + ONE_HALF) >> SCALE_BITS, (-CB_G * cb - CR_G * cr + ONE_HALF) >> SCALE_BITS,
+            (CB_B * cb + ONE_HALF) >> SCALE_BITS};
+}
+
+static inline uint8_t Clamp(int value)
+{
+    return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+static inline void PutRgb(uint8_t* dst, int y, const ChromaTerms& chroma, unsigned int pixel_size)
+{
+    dst[0] = Clamp(y + chroma.r);
+    dst[1] = Clamp(y + chroma.g);
+    dst[2] = Clamp(y + chroma.b);
+    if (pixel_size == 4)
+        dst[3] = 255;
+}
+
+// the U V of the pair that holds pixel x
+static inline const uint8_t* PairOf(const uint8_t* row, unsigned int x)
+{
+    return row + (x & ~1u) * 2;
+}
+
+static inline const uint8_t* Row(const Yuy2Frame& frame, unsigned int y)
+{
+    return frame.data + static_cast<size_t>(y) * frame.stride;
+}
+
+void Yuy2ToRgb(const Yuy2Frame& frame, const FaceRect& region, unsigned int step, unsigned int pixel_size, uint8_t* dst,
+               unsigned int dst_stride)
+{
+    const unsigned int width = (region.w + step - 1) / step;
+    const unsigned int height = (region.h + step - 1) / step;
+    for (unsigned int out_y = 0; out_y < height; out_y++)
+    {
+        const uint8_t* row = Row(frame, region.y + out_y * step);
+        uint8_t* out = dst + static_cast<size_t>(out_y) * dst_stride;
+        unsigned int out_x = 0;
+        if (step == 1 && region.x % 2 == 0)
+        {
+            // whole pairs: the chroma terms once for two pixels
+            const uint8_t* pair = row + region.x * 2;
+            for (; out_x + 1 < width; out_x += 2, pair += 4, out += 2 * pixel_size)
+            {
+                const auto chroma = Chroma(pair[1], pair[3]);
+                PutRgb(out, pair[0], chroma, pixel_size);
+                PutRgb(out + pixel_size, pair[2], chroma, pixel_size);
+            }
+        }
+        for (; out_x < width; out_x++, out += pixel_size)
+        {
+            const unsigned int x = region.x + out_x * step;
+            const uint8_t* pair = PairOf(row, x);
+            PutRgb(out, row[x * 2], Chroma(pair[1], pair[3]), pixel_size);
+        }
+    }
+}
+
+void Yuy2ToGray(const Yuy2Frame& frame, const FaceRect& region, unsigned int step, uint8_t* dst,
+                unsigned int dst_stride)
+{
+    const unsigned int width = (region.w + step - 1) / step;
+    const unsigned int height = (region.h + step - 1) / step;
+    const size_t pixel_step = static_cast<size_t>(step) * 2;
+    for (unsigned int out_y = 0; out_y < height; out_y++)
+    {
+        const uint8_t* luma = Row(frame, region.y + out_y * step) + region.x * 2;
+        uint8_t* out = dst + static_cast<size_t>(out_y) * dst_stride;
+        for (unsigned int out_x = 0; out_x < width; out_x++)
+        {
+            out[out_x] = luma[out_x * pixel_step];
+        }
+    }
+}
+
+void Yuy2ToI420(const Yuy2Frame& frame, unsigned int step, uint8_t* dst)
+{
+    const unsigned int width = (frame.width + step - 1) / step;
+    const unsigned int height = (frame.height + step - 1) / step;
+    const unsigned int chroma_width = (width + 1) / 2;
+    const unsigned int chroma_height = (height + 1) / 2;
+
+    FaceRect whole;
+    whole.w = frame.width;
+    whole.h = frame.height;
+    Yuy2ToGray(frame, whole, step, dst, width);
+
+    uint8_t* u_plane = dst + static_cast<size_t>(width) * height;
+    uint8_t* v_plane = u_plane + static_cast<size_t>(chroma_width) * chroma_height;
+    for (unsigned int chroma_y = 0; chroma_y < chroma_height; chroma_y++)
+    {
+        const uint8_t* row = Row(frame, chroma_y * 2 * step);
+        uint8_t* u_out = u_plane + static_cast<size_t>(chroma_y) * chroma_width;
+        uint8_t* v_out = v_plane + static_cast<size_t>(chroma_y) * chroma_width;
+        for (unsigned int chroma_x = 0; chroma_x < chroma_width; chroma_x++)
+        {
+            const uint8_t* pair = PairOf(row, chroma_x * 2 * step);
+            u_out[chroma_x] = pair[1];
+            v_out[chroma_x] = pair[3];
+        }
+    }
+}
+} // namespace Capture
+} // namespace RealSenseID
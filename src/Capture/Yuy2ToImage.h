@@ -0,0 +1,38 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/FaceRect.h"
+#include <cstdint>
+
+namespace RealSenseID
+{
+namespace Capture
+{
+// An uncompressed frame of PreviewMode::YUY2_720P as received: YUYV 4:2:2, each pair of pixels is Y0 U Y1 V.
+// It is converted in place, straight from the capture buffer, with no decode.
+// The colors are the full range YCbCr of the jpeg modes, converted to RGB with libjpeg's fixed-point coefficients.
+struct Yuy2Frame
+{
+    const uint8_t* data = nullptr;
+    unsigned int width = 0;  // even
+    unsigned int height = 0;
+    unsigned int stride = 0; // bytes per row, at least width * 2
+};
+
+// convert region (full resolution frame coordinates, inside the frame) taking every step-th pixel of it (the preview
+// scale): the image is ceil(region.w / step) x ceil(region.h / step) pixels, dst_stride bytes per row.
+// RGB24, or RGBA32 with an opaque alpha for pixel_size 4.
+void Yuy2ToRgb(const Yuy2Frame& frame, const FaceRect& region, unsigned int step, unsigned int pixel_size, uint8_t* dst,
+               unsigned int dst_stride);
+
+// luma only, as above
+void Yuy2ToGray(const Yuy2Frame& frame, const FaceRect& region, unsigned int step, uint8_t* dst,
+                unsigned int dst_stride);
+
+// the whole frame as I420 (planar Y, U, V, the chroma planes of half the image's width and height), every step-th
+// pixel. the chroma is decimated to the even rows, as the I420 output of the jpeg modes' 4:2:2 frames.
+void Yuy2ToI420(const Yuy2Frame& frame, unsigned int step, uint8_t* dst);
+} // namespace Capture
+} // namespace RealSenseID
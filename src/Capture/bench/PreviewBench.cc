@@ -0,0 +1,511 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+// Benchmarks of the preview frame conversion (StreamConverter::Buffer2Image, RotatedRaw2Rgb, Raw2Gray and
+// Raw2Raw16), no camera needed.
+// Build with -DRSID_PREVIEW=ON -DRSID_PREVIEW_BENCH=ON and run bin/rsid_preview_bench.
+//
+// The frames are recorded ones when given, each flag a directory saved by the preview's frame recorder in that mode:
+//   --mjpeg_1080p=<dir> --mjpeg_720p=<dir> --raw10_1080p=<dir> --yuy2_720p=<dir>
+// and generated ones otherwise (noisy gradients encoded as 4:2:2 jpegs or yuy2 pixels, random RAW10 pixels), which
+// decode at a similar speed but are no substitute for real frames when comparing decoders.
+// Any google benchmark flag is supported as well, e.g. --benchmark_filter=Mjpeg.
+//
+// Counters: frames/sec (items_per_second), allocs_per_frame (heap allocations, including libjpeg's on glibc) and
+// max_decode_us (slowest frame, as measured by StreamConverter). The threaded variants decode with a converter per
+// thread, like one preview per camera.
+// The raw unpack kernels in use are reported in the context ("isa"); set RSID_FORCE_ISA (see CpuFeatures.h) to
+// measure others.
+
+#include "StreamConverter.h"
+#include "RawToRgb.h"
+#include "CpuFeatures.h"
+#include "benchmark/benchmark.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <dirent.h>
+#endif
+
+using namespace RealSenseID;
+using namespace RealSenseID::Capture;
+
+// heap allocation count. on glibc malloc itself is counted (covering operator new and libjpeg's pools),
+// elsewhere operator new only
+static std::atomic<uint64_t> s_allocations {0};
+
+#ifdef __GLIBC__
+extern "C"
+{
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* ptr, size_t size);
+
+    void* malloc(size_t size)
+    {
+        s_allocations.fetch_add(1, std::memory_order_relaxed);
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size)
+    {
+        s_allocations.fetch_add(1, std::memory_order_relaxed);
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* ptr, size_t size)
+    {
+        s_allocations.fetch_add(1, std::memory_order_relaxed);
+        return __libc_realloc(ptr, size);
+    }
+}
+#else
+void* operator new(size_t size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    void* ptr = std::malloc(size > 0 ? size : 1);
+    if (ptr == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+#endif // __GLIBC__
+
+namespace
+{
+using Frame = std::vector<unsigned char>;
+
+constexpr PreviewMode Modes[] = {PreviewMode::MJPEG_1080P, PreviewMode::MJPEG_720P, PreviewMode::RAW10_1080P,
+                                 PreviewMode::YUY2_720P};
+const char* const ModeFlags[] = {"--mjpeg_1080p=", "--mjpeg_720p=", "--raw10_1080p=", "--yuy2_720p="};
+constexpr size_t ModeCount = sizeof(Modes) / sizeof(Modes[0]);
+constexpr size_t GeneratedFrames = 8;
+
+// frames of each mode, by the mode's index
+std::vector<Frame> s_corpus[ModeCount];
+
+// the files of the directory with the extension, sorted by name (the frame recorder's names are in frame order)
+std::vector<std::string> ListFrames(const std::string& directory, const std::string& extension)
+{
+    std::vector<std::string> names;
+#ifdef _WIN32
+    _finddata_t data;
+    auto handle = _findfirst((directory + "/*." + extension).c_str(), &data);
+    if (handle != -1)
+    {
+        do
+        {
+            names.push_back(data.name);
+        } while (_findnext(handle, &data) == 0);
+        _findclose(handle);
+    }
+#else
+    DIR* dir = ::opendir(directory.c_str());
+    if (dir != nullptr)
+    {
+        while (dirent* entry = ::readdir(dir))
+        {
+            std::string name = entry->d_name;
+            if (name.size() > extension.size() + 1 &&
+                name.compare(name.size() - extension.size() - 1, std::string::npos, "." + extension) == 0)
+            {
+                names.push_back(name);
+            }
+        }
+        ::closedir(dir);
+    }
+#endif
+    std::sort(names.begin(), names.end());
+    for (auto& name : names)
+    {
+        name = directory + "/" + name;
+    }
+    return names;
+}
+
+bool ReadFile(const std::string& path, Frame& frame)
+{
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    std::fseek(file, 0, SEEK_END);
+    long size = std::ftell(file);
+    std::fseek(file, 0, SEEK_SET);
+    frame.resize(size > 0 ? static_cast<size_t>(size) : 0);
+    bool ok = size > 0 && std::fread(frame.data(), 1, frame.size(), file) == frame.size();
+    std::fclose(file);
+    return ok;
+}
+
+StreamAttributes Attributes(PreviewMode mode)
+{
+    PreviewConfig config;
+    config.previewMode = mode;
+    return StreamConverter {config}.GetStreamAttributes();
+}
+
+// noisy diagonal gradient, compressed as a camera's 4:2:2 jpeg
+Frame GenerateJpeg(unsigned int width, unsigned int height, std::mt19937& random)
+{
+    std::uniform_int_distribution<int> noise {-12, 12};
+    std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * 3);
+    for (unsigned int y = 0; y < height; y++)
+    {
+        for (unsigned int x = 0; x < width; x++)
+        {
+            auto* pixel = &pixels[(static_cast<size_t>(y) * width + x) * 3];
+            int base = static_cast<int>((x + y) * 255 / (width + height));
+            for (int c = 0; c < 3; c++)
+            {
+                pixel[c] = static_cast<unsigned char>(std::min(255, std::max(0, base + noise(random))));
+            }
+        }
+    }
+
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    unsigned char* output = nullptr;
+    unsigned long output_size = 0;
+    jpeg_mem_dest(&cinfo, &output, &output_size);
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 85, TRUE);
+    cinfo.comp_info[0].h_samp_factor = 2; // 4:2:2
+    cinfo.comp_info[0].v_samp_factor = 1;
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height)
+    {
+        JSAMPROW row = &pixels[static_cast<size_t>(cinfo.next_scanline) * width * 3];
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    Frame frame(output, output + output_size);
+    std::free(output);
+    return frame;
+}
+
+// the noisy gradient of GenerateJpeg as uncompressed YUYV pixels
+Frame GenerateYuy2(unsigned int width, unsigned int height, std::mt19937& random)
+{
+    std::uniform_int_distribution<int> noise {-12, 12};
+    Frame frame(static_cast<size_t>(width) * height * 2);
+    for (unsigned int y = 0; y < height; y++)
+    {
+        for (unsigned int x = 0; x < width; x++)
+        {
+            auto* pixel = &frame[(static_cast<size_t>(y) * width + x) * 2];
+            int base = static_cast<int>((x + y) * 255 / (width + height));
+            pixel[0] = static_cast<unsigned char>(std::min(255, std::max(0, base + noise(random))));
+            pixel[1] = static_cast<unsigned char>(128 + noise(random)); // U of even pixels, V of odd ones
+        }
+    }
+    return frame;
+}
+
+// random pixels, with the non zero timestamp of a dumped frame in the first bytes
+Frame GenerateRaw10(unsigned int width, unsigned int height, std::mt19937& random)
+{
+    Frame frame(static_cast<size_t>(width) * height / 4 * 5);
+    std::uniform_int_distribution<int> byte {0, 255};
+    for (auto& value : frame)
+    {
+        value = static_cast<unsigned char>(byte(random));
+    }
+    uint32_t timestamp = 1000;
+    ::memcpy(frame.data(), &timestamp, sizeof(timestamp));
+    return frame;
+}
+
+void LoadCorpus(int argc, char** argv)
+{
+    std::mt19937 random {1};
+    for (size_t m = 0; m < ModeCount; m++)
+    {
+        auto attributes = Attributes(Modes[m]);
+        for (int i = 1; i < argc; i++)
+        {
+            if (std::strncmp(argv[i], ModeFlags[m], std::strlen(ModeFlags[m])) != 0)
+            {
+                continue;
+            }
+            const char* extension = attributes.format == RAW ? "raw" : (attributes.format == YUY2 ? "yuy2" : "jpg");
+            for (const auto& path : ListFrames(argv[i] + std::strlen(ModeFlags[m]), extension))
+            {
+                Frame frame;
+                if (ReadFile(path, frame))
+                {
+                    s_corpus[m].push_back(std::move(frame));
+                }
+            }
+            std::printf("%s: %zu recorded frames\n", ModeFlags[m], s_corpus[m].size());
+        }
+        // generated frames only if none were recorded
+        size_t generated = s_corpus[m].empty() ? GeneratedFrames : 0;
+        for (size_t i = 0; i < generated; i++)
+        {
+            if (attributes.format == RAW)
+                s_corpus[m].push_back(GenerateRaw10(attributes.width, attributes.height, random));
+            else if (attributes.format == YUY2)
+                s_corpus[m].push_back(GenerateYuy2(attributes.width, attributes.height, random));
+            else
+                s_corpus[m].push_back(GenerateJpeg(attributes.width, attributes.height, random));
+        }
+    }
+}
+
+size_t ModeIndex(PreviewMode mode)
+{
+    return static_cast<size_t>(std::find(std::begin(Modes), std::end(Modes), mode) - std::begin(Modes));
+}
+
+uint64_t Allocations()
+{
+    return s_allocations.load(std::memory_order_relaxed);
+}
+
+// decode the corpus of the mode in turn with Buffer2Image. thread 0 sets the counters of all the threads' frames.
+// with an executor the benchmark threads are streams submitting to its decode threads, as previews do
+void DecodeFrames(benchmark::State& state, PreviewMode mode, PreviewFormat format, DecodeExecutor* executor = nullptr,
+                  PreviewQuality quality = PreviewQuality::Full)
+{
+    const auto& frames = s_corpus[ModeIndex(mode)];
+    PreviewConfig config;
+    config.previewMode = mode;
+    config.previewFormat = format;
+    config.previewQuality = quality;
+    StreamConverter converter {config};
+    converter.SetExecutor(executor);
+    std::vector<unsigned char> image_buffer(GetImageSize(config));
+
+    size_t next = state.thread_index() % frames.size();
+    uint64_t allocations_start = 0;
+    bool first = true;
+    unsigned int max_decode_us = 0;
+    for (auto _ : state)
+    {
+        if (first)
+        {
+            allocations_start = Allocations(); // after all the threads' setup
+            first = false;
+        }
+        auto& frame = frames[next];
+        next = (next + 1) % frames.size();
+        Image image;
+        image.buffer = image_buffer.data();
+        buffer frame_buffer;
+        frame_buffer.data = const_cast<unsigned char*>(frame.data());
+        frame_buffer.size = static_cast<unsigned int>(frame.size());
+        if (!converter.Buffer2Image(&image, frame_buffer))
+        {
+            state.SkipWithError("Buffer2Image failed");
+            break;
+        }
+        max_decode_us = std::max(max_decode_us, converter.LastDecodeMicros());
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["max_decode_us"] = benchmark::Counter(max_decode_us, benchmark::Counter::kAvgThreads);
+    if (state.thread_index() == 0)
+    {
+        auto frames_decoded = static_cast<double>(state.iterations()) * state.threads();
+        state.counters["allocs_per_frame"] = static_cast<double>(Allocations() - allocations_start) / frames_decoded;
+    }
+}
+} // namespace
+
+static void BM_Mjpeg1080pToRgb(benchmark::State& state)
+{
+    DecodeFrames(state, PreviewMode::MJPEG_1080P, PreviewFormat::RGB);
+}
+
+// the streams share the decode threads of the process executor
+static void BM_Mjpeg1080pToRgbShared(benchmark::State& state)
+{
+    static auto executor = DecodeExecutor::Shared();
+    DecodeFrames(state, PreviewMode::MJPEG_1080P, PreviewFormat::RGB, executor.get());
+}
+
+static void BM_Mjpeg1080pToRgbFast(benchmark::State& state)
+{
+    DecodeFrames(state, PreviewMode::MJPEG_1080P, PreviewFormat::RGB, nullptr, PreviewQuality::Fast);
+}
+
+static void BM_Mjpeg720pToRgb(benchmark::State& state)
+{
+    DecodeFrames(state, PreviewMode::MJPEG_720P, PreviewFormat::RGB);
+}
+
+// same frames as MJPEG_720P, converted without a jpeg decode
+static void BM_Yuy2720pToRgb(benchmark::State& state)
+{
+    DecodeFrames(state, PreviewMode::YUY2_720P, PreviewFormat::RGB);
+}
+
+static void BM_Mjpeg1080pToGray8(benchmark::State& state)
+{
+    DecodeFrames(state, PreviewMode::MJPEG_1080P, PreviewFormat::GRAY8);
+}
+
+// the RAW10 frame as delivered to the callback (a copy with the frame's metadata)
+static void BM_Raw10Buffer2Image(benchmark::State& state)
+{
+    DecodeFrames(state, PreviewMode::RAW10_1080P, PreviewFormat::RGB);
+}
+
+// Preview::RawToRgb() of a RAW10 frame. argument: max threads (0 for the default)
+static void BM_RotatedRaw2Rgb(benchmark::State& state)
+{
+    const auto& frames = s_corpus[ModeIndex(PreviewMode::RAW10_1080P)];
+    auto attributes = Attributes(PreviewMode::RAW10_1080P);
+    std::vector<unsigned char> rgb_buffer(static_cast<size_t>(attributes.width) * attributes.height * 3);
+    auto max_threads = static_cast<unsigned int>(state.range(0));
+
+    size_t next = 0;
+    uint64_t allocations_start = Allocations();
+    for (auto _ : state)
+    {
+        const auto& frame = frames[next];
+        next = (next + 1) % frames.size();
+        Image raw;
+        raw.buffer = const_cast<unsigned char*>(frame.data());
+        raw.size = static_cast<unsigned int>(frame.size());
+        raw.width = attributes.width;
+        raw.height = attributes.height;
+        Image rgb;
+        rgb.buffer = rgb_buffer.data();
+        rgb.size = static_cast<unsigned int>(rgb_buffer.size());
+        RotatedRaw2Rgb(raw, rgb, max_threads);
+        benchmark::DoNotOptimize(rgb_buffer.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["allocs_per_frame"] =
+        static_cast<double>(Allocations() - allocations_start) / static_cast<double>(state.iterations());
+}
+
+// Preview::RawToGray() of a RAW10 frame. argument: 1 for 2x2 binning
+static void BM_Raw2Gray(benchmark::State& state)
+{
+    const auto& frames = s_corpus[ModeIndex(PreviewMode::RAW10_1080P)];
+    auto attributes = Attributes(PreviewMode::RAW10_1080P);
+    const bool binning = state.range(0) != 0;
+    std::vector<unsigned char> gray_buffer(static_cast<size_t>(attributes.width) * attributes.height);
+
+    size_t next = 0;
+    uint64_t allocations_start = Allocations();
+    for (auto _ : state)
+    {
+        const auto& frame = frames[next];
+        next = (next + 1) % frames.size();
+        Image raw;
+        raw.buffer = const_cast<unsigned char*>(frame.data());
+        raw.size = static_cast<unsigned int>(frame.size());
+        raw.width = attributes.width;
+        raw.height = attributes.height;
+        Image gray;
+        gray.buffer = gray_buffer.data();
+        gray.size = static_cast<unsigned int>(gray_buffer.size());
+        Raw2Gray(raw, gray, binning);
+        benchmark::DoNotOptimize(gray_buffer.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["allocs_per_frame"] =
+        static_cast<double>(Allocations() - allocations_start) / static_cast<double>(state.iterations());
+}
+
+// Preview::RawToRaw16() of a RAW10 frame
+static void BM_Raw2Raw16(benchmark::State& state)
+{
+    const auto& frames = s_corpus[ModeIndex(PreviewMode::RAW10_1080P)];
+    auto attributes = Attributes(PreviewMode::RAW10_1080P);
+    std::vector<uint16_t> raw16_buffer(static_cast<size_t>(attributes.width) * attributes.height);
+
+    size_t next = 0;
+    for (auto _ : state)
+    {
+        const auto& frame = frames[next];
+        next = (next + 1) % frames.size();
+        Image raw;
+        raw.buffer = const_cast<unsigned char*>(frame.data());
+        raw.size = static_cast<unsigned int>(frame.size());
+        raw.width = attributes.width;
+        raw.height = attributes.height;
+        Image raw16;
+        raw16.buffer = reinterpret_cast<unsigned char*>(raw16_buffer.data());
+        raw16.size = static_cast<unsigned int>(raw16_buffer.size() * sizeof(uint16_t));
+        Raw2Raw16(raw, raw16);
+        benchmark::DoNotOptimize(raw16_buffer.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * attributes.width * attributes.height * 2);
+}
+
+// converter threads
+static void DecodeThreads(benchmark::internal::Benchmark* benchmark)
+{
+    benchmark->Threads(1)->Threads(2)->Threads(4)->UseRealTime();
+}
+
+BENCHMARK(BM_Mjpeg1080pToRgb)->Apply(DecodeThreads);
+BENCHMARK(BM_Mjpeg1080pToRgbShared)->Apply(DecodeThreads)->Threads(8);
+BENCHMARK(BM_Mjpeg1080pToRgbFast)->Apply(DecodeThreads);
+BENCHMARK(BM_Mjpeg720pToRgb)->Apply(DecodeThreads);
+BENCHMARK(BM_Yuy2720pToRgb)->Apply(DecodeThreads);
+BENCHMARK(BM_Mjpeg1080pToGray8)->Apply(DecodeThreads);
+BENCHMARK(BM_Raw10Buffer2Image)->Apply(DecodeThreads);
+BENCHMARK(BM_RotatedRaw2Rgb)->ArgName("max_threads")->Arg(1)->Arg(0)->UseRealTime();
+BENCHMARK(BM_Raw2Gray)->ArgName("binning")->Arg(0)->Arg(1);
+BENCHMARK(BM_Raw2Raw16);
+
+int main(int argc, char** argv)
+{
+    LoadCorpus(argc, argv);
+    // the corpus flags are left out of google benchmark's flags
+    std::vector<char*> benchmark_args;
+    for (int i = 0; i < argc; i++)
+    {
+        bool corpus_flag = false;
+        for (auto* flag : ModeFlags)
+        {
+            corpus_flag = corpus_flag || std::strncmp(argv[i], flag, std::strlen(flag)) == 0;
+        }
+        if (!corpus_flag)
+        {
+            benchmark_args.push_back(argv[i]);
+        }
+    }
+    int benchmark_argc = static_cast<int>(benchmark_args.size());
+    benchmark::Initialize(&benchmark_argc, benchmark_args.data());
+    if (benchmark::ReportUnrecognizedArguments(benchmark_argc, benchmark_args.data()))
+    {
+        return 1;
+    }
+    benchmark::AddCustomContext("isa", RealSenseID::CpuFeatures::LevelName());
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,117 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "OperationQueue.h"
+#include "RealSenseID/Status.h"
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace RealSenseID
+{
+// Coalesces async read-only queries of a kind: the requests posted while an exchange is still queued join it, and
+// the exchange's result is handed to each of them (deliver() converts it to the request's output and status).
+// A request posted once the exchange has started queues the next one, so a result is never older than its request.
+template <typename T>
+class CoalescedQuery
+{
+public:
+    using Query = std::function<Status(T&)>;
+    using Deliver = std::function<Status(Status, const T&)>;
+
+    CoalescedQuery() : _state(std::make_shared<State>())
+    {
+    }
+
+    std::future<Status> Post(OperationQueue& queue, OperationPriority priority, const Query& query, Deliver deliver)
+    {
+        std::promise<Status> promise;
+        auto result = promise.get_future();
+        std::shared_ptr<Claim> claim;
+        {
+            std::lock_guard<std::mutex> lock {_state->mutex};
+            if (!_state->pending)
+            {
+                _state->pending = std::make_shared<Exchange>();
+                claim = std::make_shared<Claim>(_state, _state->pending);
+            }
+            _state->pending->requests.push_back({std::move(promise), std::move(deliver)});
+        }
+        if (claim)
+        {
+            // not under the lock, a throwing Post() releases the claim (which takes it). the requests' promises are the
+            // results, the exchange's own future is not needed
+            queue.Post(
+                [claim, query]() {
+                    Run(*claim, query);
+                    return Status::Ok;
+                },
+                priority);
+        }
+        return result;
+    }
+
+private:
+    struct Request
+    {
+        std::promise<Status> promise;
+        Deliver deliver;
+    };
+
+    struct Exchange
+    {
+        std::vector<Request> requests;
+    };
+
+    // shared with the queued operations, which may outlive the CoalescedQuery
+    struct State
+    {
+        std::mutex mutex;
+        std::shared_ptr<Exchange> pending; // queued, not started yet
+    };
+
+    // the queued operation's hold on the pending exchange. if the operation is dropped before it runs (the queue was
+    // stopped, or Post() threw), its release ends the exchange: its requests get broken promises, and the following
+    // requests start a new exchange instead of joining one that never comes.
+    struct Claim
+    {
+        Claim(std::shared_ptr<State> claim_state, std::shared_ptr<Exchange> claim_exchange) :
+            state(std::move(claim_state)), exchange(std::move(claim_exchange))
+        {
+        }
+
+        ~Claim()
+        {
+            std::lock_guard<std::mutex> lock {state->mutex};
+            if (state->pending == exchange)
+            {
+                state->pending.reset();
+            }
+        }
+
+        std::shared_ptr<State> state;
+        std::shared_ptr<Exchange> exchange;
+    };
+
+    std::shared_ptr<State> _state;
+
+    static void Run(Claim& claim, const Query& query)
+    {
+        {
+            std::lock_guard<std::mutex> lock {claim.state->mutex};
+            claim.state->pending.reset();
+        }
+        T value {};
+        const Status status = query(value);
+        for (auto& request : claim.exchange->requests)
+        {
+            request.promise.set_value(request.deliver(status, value));
+        }
+    }
+};
+} // namespace RealSenseID
@@ -0,0 +1,171 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "CpuFeatures.h"
+#include "Logger.h"
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define RSID_CPU_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define RSID_CPU_ARM64
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/auxv.h>
+#endif
+#endif
+
+namespace RealSenseID
+{
+namespace CpuFeatures
+{
+static const char* LOG_TAG = "CpuFeatures";
+
+struct Level
+{
+    const char* name;
+    uint32_t features; // the cap of RSID_FORCE_ISA
+    uint32_t required; // the features the level's kernels are selected by, for LevelName()
+};
+
+// ascending on each architecture. pclmul and crc32 are not required, only the firmware crc32 kernel uses them.
+static const Level Levels[] = {
+    {"scalar", 0, 0},
+    {"sse2", Sse2, Sse2},
+    {"ssse3", Sse2 | Ssse3, Sse2 | Ssse3},
+    {"sse4.1", Sse2 | Ssse3 | Sse41 | Popcnt | Pclmul, Sse2 | Ssse3 | Sse41 | Popcnt},
+    {"avx2", Sse2 | Ssse3 | Sse41 | Popcnt | Pclmul | Avx2, Sse2 | Ssse3 | Sse41 | Popcnt | Avx2},
+    {"avx512", Sse2 | Ssse3 | Sse41 | Popcnt | Pclmul | Avx2 | Avx512, Sse2 | Ssse3 | Sse41 | Popcnt | Avx2 | Avx512},
+    {"neon", Neon | Crc32, Neon},
+    {"sve", Neon | Crc32 | Sve, Neon | Sve},
+};
+
+#if defined(RSID_CPU_X86)
+static uint32_t Detect()
+{
+    uint32_t features = 0;
+#if defined(_MSC_VER)
+    int regs[4] = {0};
+    __cpuid(regs, 0);
+    const int max_leaf = regs[0];
+    __cpuid(regs, 1);
+    const int ecx = regs[2], edx = regs[3];
+    if (edx & (1 << 26))
+        features |= Sse2;
+    if (ecx & (1 << 9))
+        features |= Ssse3;
+    if (ecx & (1 << 19))
+        features |= Sse41;
+    if (ecx & (1 << 23))
+        features |= Popcnt;
+    if (ecx & (1 << 1))
+        features |= Pclmul;
+    // the wide registers need the os to save them too
+    const bool os_xsave = (ecx & (1 << 27)) && (ecx & (1 << 28));
+    const unsigned long long xcr0 = os_xsave ? _xgetbv(0) : 0;
+    if (max_leaf >= 7 && (xcr0 & 0x6) == 0x6)
+    {
+        __cpuidex(regs, 7, 0);
+        const int ebx = regs[1];
+        if (ebx & (1 << 5))
+            features |= Avx2;
+        const bool os_saves_zmm = (xcr0 & 0xe6) == 0xe6;
+        if (os_saves_zmm && (ebx & (1 << 16)) && (ebx & (1 << 30)))
+            features |= Avx512;
+    }
+#elif defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        features |= Sse2;
+    if (__builtin_cpu_supports("ssse3"))
+        features |= Ssse3;
+    if (__builtin_cpu_supports("sse4.1"))
+        features |= Sse41;
+    if (__builtin_cpu_supports("popcnt"))
+        features |= Popcnt;
+    if (__builtin_cpu_supports("pclmul"))
+        features |= Pclmul;
+    if (__builtin_cpu_supports("avx2"))
+        features |= Avx2;
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        features |= Avx512;
+#endif
+    return features;
+}
+#elif defined(RSID_CPU_ARM64)
+static uint32_t Detect()
+{
+    // advanced simd is mandatory on aarch64
+    uint32_t features = Neon;
+#if defined(_WIN32)
+    if (::IsProcessorFeaturePresent(PF_ARM_V8_CRC32_INSTRUCTIONS_AVAILABLE))
+        features |= Crc32;
+#ifdef PF_ARM_SVE_INSTRUCTIONS_AVAILABLE
+    if (::IsProcessorFeaturePresent(PF_ARM_SVE_INSTRUCTIONS_AVAILABLE))
+        features |= Sve;
+#endif
+#elif defined(__linux__)
+    // the aarch64 HWCAP_CRC32 and HWCAP_SVE bits (asm/hwcap.h)
+    const unsigned long hwcap = ::getauxval(AT_HWCAP);
+    if (hwcap & (1ul << 7))
+        features |= Crc32;
+    if (hwcap & (1ul << 22))
+        features |= Sve;
+#elif defined(__APPLE__)
+    features |= Crc32;
+#endif
+    return features;
+}
+#else
+static uint32_t Detect()
+{
+    return 0;
+}
+#endif
+
+static uint32_t DetectActive()
+{
+    const uint32_t detected = Detect();
+    uint32_t active = detected;
+    const char* forced = std::getenv("RSID_FORCE_ISA");
+    if (forced != nullptr && *forced != '\0')
+    {
+        const Level* level = nullptr;
+        for (const auto& candidate : Levels)
+        {
+            if (std::strcmp(candidate.name, forced) == 0)
+                level = &candidate;
+        }
+        if (level != nullptr)
+            active &= level->features;
+        else
+            LOG_WARNING(LOG_TAG, "Ignoring unknown RSID_FORCE_ISA \"%s\"", forced);
+    }
+    LOG_DEBUG(LOG_TAG, "Cpu features 0x%x, active 0x%x", detected, active);
+    return active;
+}
+
+uint32_t Active()
+{
+    static const uint32_t active = DetectActive();
+    return active;
+}
+
+const char* LevelName()
+{
+    const uint32_t active = Active();
+    const char* name = Levels[0].name;
+    for (const auto& level : Levels)
+    {
+        if (level.required != 0 && (level.required & ~active) == 0)
+            name = level.name;
+    }
+    return name;
+}
+} // namespace CpuFeatures
+} // namespace RealSenseID
@@ -0,0 +1,49 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include <stdint.h>
+
+namespace RealSenseID
+{
+// Instruction set extensions of the running cpu, for the runtime selection of the library's SIMD kernels (the
+// matcher, the firmware crc32, the raw frames unpack). Each user resolves its table of kernel function pointers once,
+// on first use, from Has().
+//
+// Detected once: cpuid (and the os support of the wide registers) on x86, getauxval(AT_HWCAP) on Linux / Android ARM,
+// IsProcessorFeaturePresent() on Windows ARM.
+//
+// The RSID_FORCE_ISA environment variable, read at the detection, caps the features at an instruction set level to
+// exercise and compare the other kernels on one machine: "scalar" (no SIMD at all), "sse2", "ssse3", "sse4.1"
+// (with popcnt and pclmul), "avx2" or "avx512" on x86, "scalar", "neon" (with the crc32 instructions) or "sve" on ARM.
+// A level above the cpu's does not add features. Since the tables are resolved once, it has to be set before the
+// process starts.
+namespace CpuFeatures
+{
+enum Feature : uint32_t
+{
+    Sse2 = 1u << 0,
+    Ssse3 = 1u << 1,
+    Sse41 = 1u << 2,
+    Popcnt = 1u << 3,
+    Pclmul = 1u << 4,
+    Avx2 = 1u << 5,
+    Avx512 = 1u << 6, // avx512f and avx512bw
+    Neon = 1u << 16,  // aarch64 advanced simd
+    Crc32 = 1u << 17, // armv8 crc32 instructions
+    Sve = 1u << 18
+};
+
+// the features of the cpu, capped by RSID_FORCE_ISA
+uint32_t Active();
+
+inline bool Has(Feature feature)
+{
+    return (Active() & feature) != 0;
+}
+
+// the best instruction set level of Active(), as the RSID_FORCE_ISA values
+const char* LevelName();
+} // namespace CpuFeatures
+} // namespace RealSenseID
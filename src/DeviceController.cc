@@ -53,6 +53,11 @@ Status DeviceController::QuerySerialNumber(std::string& serial)
     return _impl->QuerySerialNumber(serial);
 }
 
+void DeviceController::SetQueryCache(bool enable)
+{
+    _impl->SetQueryCache(enable);
+}
+
 Status DeviceController::Ping()
 {
     return _impl->Ping();
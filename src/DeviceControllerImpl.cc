@@ -14,6 +14,7 @@
 #include "PacketManager/WindowsSerial.h"
 #elif LINUX
 #include "PacketManager/LinuxSerial.h"
+#include "PacketManager/LinuxUsbSerial.h"
 #elif ANDROID
 #include "PacketManager/AndroidSerial.h"
 #else
@@ -30,13 +31,21 @@ Status DeviceControllerImpl::Connect(const SerialConfig& config)
     {
         // disconnect if already connected
         _serial.reset();
+        InvalidateQueryCache();
         PacketManager::SerialConfig serial_config;
         serial_config.port = config.port;
 
 #ifdef _WIN32
         _serial = std::make_unique<PacketManager::WindowsSerial>(serial_config);
 #elif LINUX
-        _serial = std::make_unique<PacketManager::LinuxSerial>(serial_config);
+        if (config.transport == SerialConfig::Transport::UsbBulk)
+        {
+            _serial = std::make_unique<PacketManager::LinuxUsbSerial>(serial_config);
+        }
+        else
+        {
+            _serial = std::make_unique<PacketManager::LinuxSerial>(serial_config);
+        }
 #else
         LOG_ERROR(LOG_TAG, "Serial connection method not supported for OS");
         return Status::Error;
@@ -55,6 +64,18 @@ Status DeviceControllerImpl::Connect(const SerialConfig& config)
     }
 }
 
+Status DeviceControllerImpl::Connect(std::unique_ptr<PacketManager::SerialConnection> serial)
+{
+    if (!serial)
+    {
+        LOG_ERROR(LOG_TAG, "Got null serial connection");
+        return Status::Error;
+    }
+    _serial = std::move(serial);
+    InvalidateQueryCache();
+    return Status::Ok;
+}
+
 #ifdef ANDROID
 Status DeviceControllerImpl::Connect(int fileDescriptor, int readEndpointAddress, int writeEndpointAddress)
 {
@@ -62,6 +83,7 @@ Status DeviceControllerImpl::Connect(int fileDescriptor, int readEndpointAddress
     {
         // disconnect if already connected
         _serial.reset();
+        InvalidateQueryCache();
 
         _serial =
             std::make_unique<PacketManager::AndroidSerial>(fileDescriptor, readEndpointAddress, writeEndpointAddress);
@@ -85,6 +107,19 @@ Status DeviceControllerImpl::Connect(int fileDescriptor, int readEndpointAddress
 void DeviceControllerImpl::Disconnect()
 {
     _serial.reset();
+    InvalidateQueryCache();
+}
+
+void DeviceControllerImpl::SetQueryCache(bool enable)
+{
+    _firmware_version_cache.Enable(enable);
+    _serial_number_cache.Enable(enable);
+}
+
+void DeviceControllerImpl::InvalidateQueryCache()
+{
+    _firmware_version_cache.Invalidate();
+    _serial_number_cache.Invalidate();
 }
 
 bool DeviceControllerImpl::Reboot()
@@ -94,12 +129,17 @@ bool DeviceControllerImpl::Reboot()
         LOG_ERROR(LOG_TAG, "Not connected to a serial port");
         return false;
     }
+    InvalidateQueryCache(); // may come back with another firmware
     auto status = _serial->SendBytes(PacketManager::Commands::reset, strlen(PacketManager::Commands::reset));
     return (status == PacketManager::SerialStatus::Ok);
 }
 
 Status DeviceControllerImpl::QueryFirmwareVersion(std::string& version)
 {
+    if (_firmware_version_cache.Get(version))
+    {
+        return Status::Ok;
+    }
     // clear output version string to avoid returning garbage
     version.clear();
 
@@ -163,6 +203,7 @@ Status DeviceControllerImpl::QueryFirmwareVersion(std::string& version)
         }
 
         version = version_in_progress;
+        _firmware_version_cache.Set(version);
 
         return Status::Ok;
     }
@@ -180,6 +221,10 @@ Status DeviceControllerImpl::QueryFirmwareVersion(std::string& version)
 
 Status DeviceControllerImpl::QuerySerialNumber(std::string& serial)
 {
+    if (_serial_number_cache.Get(serial))
+    {
+        return Status::Ok;
+    }
     // clear serial number string to avoid returning garbage
     serial.clear();
 
@@ -233,6 +278,7 @@ Status DeviceControllerImpl::QuerySerialNumber(std::string& serial)
             LOG_ERROR(LOG_TAG, "Serial number received from device is empty");
             return Status::Error;
         }
+        _serial_number_cache.Set(serial);
 
         return Status::Ok;
     }
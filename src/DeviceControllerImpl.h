@@ -6,6 +6,7 @@
 #include "RealSenseID/SerialConfig.h"
 #include "RealSenseID/Status.h"
 #include "PacketManager/SerialConnection.h"
+#include "CachedQuery.h"
 
 #include <memory>
 
@@ -21,6 +22,8 @@ public:
     DeviceControllerImpl& operator=(const DeviceControllerImpl&) = delete;
 
     Status Connect(const SerialConfig& config);
+    // connect using the given open connection (e.g. the host end of a DeviceEmulator)
+    Status Connect(std::unique_ptr<PacketManager::SerialConnection> serial);
 #ifdef ANDROID
     Status Connect(int fileDescriptor, int readEndpointAddress, int writeEndpointAddress);
 #endif
@@ -30,8 +33,13 @@ public:
     Status QueryFirmwareVersion(std::string& version);
     Status QuerySerialNumber(std::string& serial);
     Status Ping();
+    void SetQueryCache(bool enable);
 
 private:
     std::unique_ptr<PacketManager::SerialConnection> _serial;
+    CachedQuery<std::string> _firmware_version_cache;
+    CachedQuery<std::string> _serial_number_cache;
+
+    void InvalidateQueryCache();
 };
 } // namespace RealSenseID
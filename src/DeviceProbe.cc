@@ -0,0 +1,120 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "DeviceProbe.h"
+#include "DeviceControllerImpl.h"
+#include "Logger.h"
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+
+static const char* LOG_TAG = "DeviceProbe";
+
+namespace RealSenseID
+{
+namespace DeviceProbe
+{
+namespace
+{
+std::mutex s_cache_mutex;
+std::map<std::string, ProbedDevice> s_cache; // identified devices by port
+
+void ProbePort(const Connector& connect, ProbedDevice& result)
+{
+    DeviceControllerImpl controller;
+    std::string serial_number, firmware_version;
+    result.status = connect(controller, result.serialPort);
+    if (result.status == Status::Ok)
+    {
+        result.status = controller.QuerySerialNumber(serial_number);
+    }
+    if (result.status == Status::Ok)
+    {
+        result.status = controller.QueryFirmwareVersion(firmware_version);
+    }
+    if (result.status != Status::Ok)
+    {
+        LOG_DEBUG(LOG_TAG, "No device identified at %s (status %d)", result.serialPort,
+                  static_cast<int>(result.status));
+        return;
+    }
+    if (serial_number.size() >= sizeof(result.serialNumber) ||
+        firmware_version.size() >= sizeof(result.firmwareVersion))
+    {
+        LOG_ERROR(LOG_TAG, "Identity of the device at %s too long", result.serialPort);
+        result.status = Status::Error;
+        return;
+    }
+    ::snprintf(result.serialNumber, sizeof(result.serialNumber), "%s", serial_number.c_str());
+    ::snprintf(result.firmwareVersion, sizeof(result.firmwareVersion), "%s", firmware_version.c_str());
+}
+} // namespace
+
+std::vector<ProbedDevice> Probe(const std::vector<DeviceInfo>& devices, bool use_cache, const Connector& connect)
+{
+    std::vector<ProbedDevice> results(devices.size());
+    std::vector<size_t> to_probe;
+    {
+        std::lock_guard<std::mutex> lock {s_cache_mutex};
+        for (size_t i = 0; i < devices.size(); i++)
+        {
+            auto& result = results[i];
+            auto cached = use_cache ? s_cache.find(devices[i].serialPort) : s_cache.end();
+            if (cached != s_cache.end())
+            {
+                result = cached->second;
+                continue;
+            }
+            result = ProbedDevice {};
+            ::snprintf(result.serialPort, sizeof(result.serialPort), "%s", devices[i].serialPort);
+            result.status = Status::Error;
+            to_probe.push_back(i);
+        }
+    }
+
+    // a probe mostly waits for its device, so all of them run at once
+    std::vector<std::thread> threads;
+    threads.reserve(to_probe.size());
+    for (auto i : to_probe)
+    {
+        try
+        {
+            threads.emplace_back(ProbePort, std::cref(connect), std::ref(results[i]));
+        }
+        catch (const std::system_error& ex)
+        {
+            LOG_EXCEPTION(LOG_TAG, ex);
+            ProbePort(connect, results[i]);
+        }
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    std::lock_guard<std::mutex> lock {s_cache_mutex};
+    for (auto i : to_probe)
+    {
+        const auto& result = results[i];
+        if (result.status == Status::Ok)
+        {
+            s_cache[result.serialPort] = result;
+        }
+        else
+        {
+            s_cache.erase(result.serialPort);
+        }
+    }
+    return results;
+}
+
+void InvalidateCache()
+{
+    std::lock_guard<std::mutex> lock {s_cache_mutex};
+    s_cache.clear();
+}
+} // namespace DeviceProbe
+} // namespace RealSenseID
@@ -0,0 +1,25 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/DiscoverDevices.h"
+#include <functional>
+#include <vector>
+
+namespace RealSenseID
+{
+class DeviceControllerImpl;
+
+// ProbeDevices(): identifies the devices of many ports at once, a thread per port, and caches the identities.
+namespace DeviceProbe
+{
+// connects the controller to the port
+using Connector = std::function<Status(DeviceControllerImpl& controller, const char* port)>;
+
+std::vector<ProbedDevice> Probe(const std::vector<DeviceInfo>& devices, bool use_cache, const Connector& connect);
+
+// drop the cached identities (the devices changed)
+void InvalidateCache();
+} // namespace DeviceProbe
+} // namespace RealSenseID
@@ -0,0 +1,494 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "DeviceWatcher.h"
+#include "DeviceProbe.h"
+#include "Logger.h"
+#include "LibraryThread.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+
+#ifdef _WIN32
+// clang-format off
+#include <windows.h>
+#include <cfgmgr32.h>
+#include <objbase.h>
+// clang-format on
+#pragma comment(lib, "cfgmgr32.lib")
+#elif LINUX
+#include <errno.h>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+static const char* LOG_TAG = "DeviceWatcher";
+
+namespace RealSenseID
+{
+namespace DeviceWatcher
+{
+namespace
+{
+// after a device event, wait until no event arrived for this long before rescanning
+constexpr int CoalesceMillis = 200;
+
+struct DeviceLists
+{
+    std::vector<DeviceInfo> devices;
+    std::vector<int> capture_numbers;
+};
+
+bool SameLists(const DeviceLists& lhs, const DeviceLists& rhs)
+{
+    if (lhs.capture_numbers != rhs.capture_numbers || lhs.devices.size() != rhs.devices.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < lhs.devices.size(); i++)
+    {
+        if (::strcmp(lhs.devices[i].serialPort, rhs.devices[i].serialPort) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// nullptr if the scan failed
+std::shared_ptr<const DeviceLists> ScanLists()
+{
+    try
+    {
+        auto lists = std::make_shared<DeviceLists>();
+        lists->devices = ScanDevices();
+        lists->capture_numbers = ScanCapture();
+        return lists;
+    }
+    catch (const std::exception& ex)
+    {
+        LOG_EXCEPTION(LOG_TAG, ex);
+        return nullptr;
+    }
+}
+
+enum class WaitResult
+{
+    Event,
+    Timeout,
+    Stopped
+};
+
+// the platform's device events. throws std::runtime_error if they cannot be received.
+class EventSource
+{
+public:
+    EventSource();
+    ~EventSource();
+
+    EventSource(const EventSource&) = delete;
+    EventSource& operator=(const EventSource&) = delete;
+
+    // wait up to timeout_ms (-1 - forever) for a serial or capture device event
+    WaitResult Wait(int timeout_ms);
+
+    // Wait() returns Stopped from now on
+    void Interrupt();
+
+private:
+#ifdef _WIN32
+    static DWORD CALLBACK OnNotification(HCMNOTIFICATION notification, PVOID context, CM_NOTIFY_ACTION action,
+                                         PCM_NOTIFY_EVENT_DATA event_data, DWORD event_data_size);
+
+    HCMNOTIFICATION _notification = nullptr;
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    bool _pending = false;
+    bool _stopped = false;
+#elif LINUX
+    int _uevent_fd = -1; // netlink socket of the kernel's uevents
+    int _stop_fd = -1;   // eventfd, signaled by Interrupt()
+#endif
+};
+
+#ifdef _WIN32
+EventSource::EventSource()
+{
+    CM_NOTIFY_FILTER filter;
+    ::memset(&filter, 0, sizeof(filter));
+    filter.cbSize = sizeof(filter);
+    filter.FilterType = CM_NOTIFY_FILTER_TYPE_DEVICEINTERFACE;
+    filter.Flags = CM_NOTIFY_FILTER_FLAG_ALL_INTERFACE_CLASSES;
+    auto result = ::CM_Register_Notification(&filter, this, &EventSource::OnNotification, &_notification);
+    if (result != CR_SUCCESS)
+    {
+        throw std::runtime_error("CM_Register_Notification failed with error: " + std::to_string(result));
+    }
+}
+
+EventSource::~EventSource()
+{
+    // waits for running notification callbacks
+    ::CM_Unregister_Notification(_notification);
+}
+
+DWORD CALLBACK EventSource::OnNotification(HCMNOTIFICATION, PVOID context, CM_NOTIFY_ACTION action,
+                                           PCM_NOTIFY_EVENT_DATA, DWORD)
+{
+    if (action == CM_NOTIFY_ACTION_DEVICEINTERFACEARRIVAL || action == CM_NOTIFY_ACTION_DEVICEINTERFACEREMOVAL)
+    {
+        auto* self = static_cast<EventSource*>(context);
+        std::lock_guard<std::mutex> lock {self->_mutex};
+        self->_pending = true;
+        self->_cv.notify_one();
+    }
+    return ERROR_SUCCESS;
+}
+
+WaitResult EventSource::Wait(int timeout_ms)
+{
+    std::unique_lock<std::mutex> lock {_mutex};
+    auto ready = [this] { return _stopped || _pending; };
+    if (timeout_ms < 0)
+    {
+        _cv.wait(lock, ready);
+    }
+    else
+    {
+        _cv.wait_for(lock, std::chrono::milliseconds {timeout_ms}, ready);
+    }
+    if (_stopped)
+    {
+        return WaitResult::Stopped;
+    }
+    if (_pending)
+    {
+        _pending = false;
+        return WaitResult::Event;
+    }
+    return WaitResult::Timeout;
+}
+
+void EventSource::Interrupt()
+{
+    std::lock_guard<std::mutex> lock {_mutex};
+    _stopped = true;
+    _cv.notify_one();
+}
+#elif LINUX
+EventSource::EventSource()
+{
+    _uevent_fd = ::socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT);
+    if (_uevent_fd < 0)
+    {
+        throw std::runtime_error("Failed to open uevent socket. errno: " + std::to_string(errno));
+    }
+
+    sockaddr_nl addr;
+    ::memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = 1; // the kernel's events, sysfs is up to date when they arrive
+    if (::bind(_uevent_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+    {
+        auto bind_errno = errno;
+        ::close(_uevent_fd);
+        throw std::runtime_error("Failed to bind uevent socket. errno: " + std::to_string(bind_errno));
+    }
+
+    _stop_fd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (_stop_fd < 0)
+    {
+        auto eventfd_errno = errno;
+        ::close(_uevent_fd);
+        throw std::runtime_error("Failed to create eventfd. errno: " + std::to_string(eventfd_errno));
+    }
+}
+
+EventSource::~EventSource()
+{
+    ::close(_stop_fd);
+    ::close(_uevent_fd);
+}
+
+// a uevent is "action@devpath" followed by "KEY=value" strings, all null terminated.
+// only add/remove of serial ports and video devices are of interest.
+static bool IsDeviceEvent(const char* buffer, size_t size)
+{
+    bool add_or_remove = false;
+    bool subsystem = false;
+    for (size_t pos = 0; pos < size; pos += ::strlen(buffer + pos) + 1)
+    {
+        const char* field = buffer + pos;
+        if (::strcmp(field, "ACTION=add") == 0 || ::strcmp(field, "ACTION=remove") == 0)
+        {
+            add_or_remove = true;
+        }
+        else if (::strcmp(field, "SUBSYSTEM=tty") == 0 || ::strcmp(field, "SUBSYSTEM=video4linux") == 0)
+        {
+            subsystem = true;
+        }
+    }
+    return add_or_remove && subsystem;
+}
+
+WaitResult EventSource::Wait(int timeout_ms)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds {timeout_ms};
+    while (true)
+    {
+        int poll_timeout = -1;
+        if (timeout_ms >= 0)
+        {
+            auto left =
+                std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            poll_timeout = left.count() > 0 ? static_cast<int>(left.count()) : 0;
+        }
+
+        pollfd fds[2] = {{_stop_fd, POLLIN, 0}, {_uevent_fd, POLLIN, 0}};
+        int ready = ::poll(fds, 2, poll_timeout);
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            LOG_ERROR(LOG_TAG, "poll failed. errno: %d", errno);
+            return WaitResult::Stopped;
+        }
+        if (ready == 0)
+        {
+            return WaitResult::Timeout;
+        }
+        if (fds[0].revents != 0)
+        {
+            return WaitResult::Stopped;
+        }
+
+        // drain the socket, the events of other devices are ignored
+        bool device_event = false;
+        char buffer[8192];
+        ssize_t received;
+        while ((received = ::recv(_uevent_fd, buffer, sizeof(buffer) - 1, 0)) > 0)
+        {
+            buffer[received] = '\0';
+            device_event = device_event || IsDeviceEvent(buffer, static_cast<size_t>(received));
+        }
+        if (device_event)
+        {
+            return WaitResult::Event;
+        }
+    }
+}
+
+void EventSource::Interrupt()
+{
+    uint64_t one = 1;
+    auto ignored = ::write(_stop_fd, &one, sizeof(one));
+    (void)ignored;
+}
+#else
+EventSource::EventSource()
+{
+    throw std::runtime_error("Device watcher is not supported on this platform");
+}
+
+EventSource::~EventSource() = default;
+
+WaitResult EventSource::Wait(int)
+{
+    return WaitResult::Stopped;
+}
+
+void EventSource::Interrupt()
+{
+}
+#endif
+
+class Watcher;
+
+// the running watcher and its lists. separate from the start/stop lock, so the callback can use discovery while
+// Stop() waits for it
+std::mutex s_lists_mutex;
+const Watcher* s_active = nullptr;
+std::shared_ptr<const DeviceLists> s_lists;
+
+std::mutex s_control_mutex; // serializes Start() and Stop()
+std::unique_ptr<Watcher> s_watcher;
+
+class Watcher
+{
+public:
+    explicit Watcher(DevicesChangedCallback callback) : _callback {std::move(callback)}
+    {
+        _lists = ScanLists();
+        if (!_lists)
+        {
+            _lists = std::make_shared<DeviceLists>();
+        }
+        _thread = LibraryThread {[this] { Loop(); }};
+        // published once the thread runs, a failed start leaves no active watcher behind. _lists is replaced under
+        // the lock by then.
+        std::lock_guard<std::mutex> lock {s_lists_mutex};
+        s_active = this;
+        s_lists = _lists;
+    }
+
+    ~Watcher()
+    {
+        {
+            std::lock_guard<std::mutex> lock {s_lists_mutex};
+            if (s_active == this)
+            {
+                s_active = nullptr;
+                s_lists.reset();
+            }
+        }
+        _events.Interrupt();
+        if (_thread.joinable())
+        {
+            _thread.join();
+        }
+    }
+
+    Watcher(const Watcher&) = delete;
+    Watcher& operator=(const Watcher&) = delete;
+
+private:
+    void Loop()
+    {
+#ifdef _WIN32
+        // the capture scan uses media foundation
+        auto com_result = ::CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+#endif
+        Notify();
+        while (true)
+        {
+            auto result = _events.Wait(-1);
+            while (result == WaitResult::Event)
+            {
+                result = _events.Wait(CoalesceMillis);
+            }
+            if (result == WaitResult::Stopped)
+            {
+                break;
+            }
+
+            auto lists = ScanLists();
+            if (!lists || SameLists(*lists, *_lists))
+            {
+                continue;
+            }
+
+            LOG_DEBUG(LOG_TAG, "Devices changed: %zu serial, %zu capture", lists->devices.size(),
+                      lists->capture_numbers.size());
+            DeviceProbe::InvalidateCache(); // a port may have another device now
+            {
+                std::lock_guard<std::mutex> lock {s_lists_mutex};
+                _lists = lists;
+                if (s_active == this)
+                {
+                    s_lists = _lists;
+                }
+            }
+            Notify();
+        }
+#ifdef _WIN32
+        if (SUCCEEDED(com_result))
+        {
+            ::CoUninitialize();
+        }
+#endif
+    }
+
+    void Notify()
+    {
+        if (!_callback)
+        {
+            return;
+        }
+        try
+        {
+            _callback(_lists->devices, _lists->capture_numbers);
+        }
+        catch (const std::exception& ex)
+        {
+            LOG_EXCEPTION(LOG_TAG, ex);
+        }
+        catch (...)
+        {
+            LOG_ERROR(LOG_TAG, "Unknown exception in devices changed callback");
+        }
+    }
+
+    EventSource _events;
+    DevicesChangedCallback _callback;
+    std::shared_ptr<const DeviceLists> _lists; // replaced by the watcher's thread under s_lists_mutex
+    LibraryThread _thread;
+};
+
+std::shared_ptr<const DeviceLists> CurrentLists()
+{
+    std::lock_guard<std::mutex> lock {s_lists_mutex};
+    return s_lists;
+}
+} // namespace
+
+bool Start(DevicesChangedCallback callback)
+{
+    std::lock_guard<std::mutex> lock {s_control_mutex};
+    s_watcher.reset();
+    try
+    {
+        s_watcher = std::make_unique<Watcher>(std::move(callback));
+        LOG_DEBUG(LOG_TAG, "Started");
+        return true;
+    }
+    catch (const std::exception& ex)
+    {
+        LOG_EXCEPTION(LOG_TAG, ex);
+        return false;
+    }
+}
+
+void Stop()
+{
+    std::lock_guard<std::mutex> lock {s_control_mutex};
+    if (s_watcher)
+    {
+        s_watcher.reset();
+        LOG_DEBUG(LOG_TAG, "Stopped");
+    }
+}
+
+bool GetDevices(std::vector<DeviceInfo>& devices)
+{
+    auto lists = CurrentLists();
+    if (!lists)
+    {
+        return false;
+    }
+    devices = lists->devices;
+    return true;
+}
+
+bool GetCapture(std::vector<int>& capture_numbers)
+{
+    auto lists = CurrentLists();
+    if (!lists)
+    {
+        return false;
+    }
+    capture_numbers = lists->capture_numbers;
+    return true;
+}
+} // namespace DeviceWatcher
+} // namespace RealSenseID
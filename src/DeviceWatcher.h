@@ -0,0 +1,27 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/DiscoverDevices.h"
+#include <vector>
+
+namespace RealSenseID
+{
+// full scans of the system (DiscoverDevices.cc)
+std::vector<DeviceInfo> ScanDevices();
+std::vector<int> ScanCapture();
+
+// Keeps the device lists up to date on hotplug events, so discovery does not scan the system while it runs.
+// A background thread waits for the platform's device events, coalesces a burst of them (a single plug-in
+// produces many) and rescans once.
+namespace DeviceWatcher
+{
+bool Start(DevicesChangedCallback callback);
+void Stop();
+
+// the cached lists. false if the watcher is not running
+bool GetDevices(std::vector<DeviceInfo>& devices);
+bool GetCapture(std::vector<int>& capture_numbers);
+} // namespace DeviceWatcher
+} // namespace RealSenseID
@@ -1,66 +1,71 @@
 // License: Apache 2.0. See LICENSE file in root directory.
 // Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
 #include "RealSenseID/DiscoverDevices.h"
+#include "DeviceWatcher.h"
+#include "DeviceProbe.h"
+#include "DeviceControllerImpl.h"
 #include "Logger.h"
 
 static const char* LOG_TAG = "Utilities";
 
 
 #include <algorithm>
-#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
 #include <utility>
 #include <string>
-#include <regex>
-#include <string>
 #include <sstream>
-#include <array>
 
 namespace RealSenseID
 {
-static const std::regex VID_REGEX (".*VID_([0-9A-Fa-f]{4}).*",std::regex_constants::icase);
-static const std::regex PID_REGEX (".*PID_([0-9A-Fa-f]{4}).*",std::regex_constants::icase);
-static const std::regex COM_PORT_REGEX {".*(COM[0-9]+).*"};
-
 struct DeviceDescriptor
 {
-    const std::string vid;
-    const std::string pid;
+    uint16_t vid;
+    uint16_t pid;
 };
 
-static const std::vector<DeviceDescriptor> ExpectedVidPidPairs {DeviceDescriptor {"04d8", "00dd"},
-                                                                DeviceDescriptor {"2aad", "6373"}};
+static const DeviceDescriptor ExpectedVidPidPairs[] = {{0x04d8, 0x00dd}, {0x2aad, 0x6373}};
 
 // Matches given VID/PID pairs to expected ones and returns true if they match the device.
-static bool MatchToExpectedVidPidPairs(std::string vid, std::string pid)
+static bool MatchToExpectedVidPidPairs(uint16_t vid, uint16_t pid)
 {
-    // Normalize input VID/PID to lower case.
-    std::transform(vid.begin(), vid.end(), vid.begin(), [](unsigned char c) { return std::tolower(c); });
-    std::transform(pid.begin(), pid.end(), pid.begin(), [](unsigned char c) { return std::tolower(c); });
-
     for (const auto& expected : ExpectedVidPidPairs)
     {
-        const auto& expected_vid = expected.vid;
-        const auto& expected_pid = expected.pid;
-
-        if (vid == expected_vid && pid == expected_pid)
+        if (vid == expected.vid && pid == expected.pid)
             return true;
     }
-
     return false;
 }
 
-// Extracts string from input using regex matching - only one submatch is allowed. Returns an empty string on failure.
-static std::string ExtractStringUsingRegex(const std::string& input, const std::regex& regex)
+static int HexDigit(char c)
 {
-    std::string output;
-    std::smatch matches;
-    bool success = std::regex_match(input, matches, regex);
-    if (success && matches.size() == 2)
-        output = matches[1];
-
-    return output;
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
 }
+
+// Parses exactly 4 hex digits at str.
+static bool ParseHex4(const char* str, uint16_t& value)
+{
+    unsigned int result = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        int digit = HexDigit(str[i]);
+        if (digit < 0)
+            return false;
+        result = (result << 4) | static_cast<unsigned int>(digit);
+    }
+    value = static_cast<uint16_t>(result);
+    return true;
 }
+} // namespace RealSenseID
 
 #if _WIN32
 
@@ -93,6 +98,59 @@ static void ThrowIfFailedMSMF(char* what, HRESULT hr)
     throw std::runtime_error(err_stream.str());
 }
 
+static bool StartsWithNoCase(const char* str, const char* prefix)
+{
+    for (; *prefix != '\0'; ++str, ++prefix)
+    {
+        if (*str == '\0' ||
+            ::tolower(static_cast<unsigned char>(*str)) != ::tolower(static_cast<unsigned char>(*prefix)))
+            return false;
+    }
+    return true;
+}
+
+// Finds "<key>xxxx" in input (key case insensitive, x a hex digit), e.g. "VID_04D8" in a device instance id.
+// The last occurrence wins. Returns false if not found.
+static bool ExtractHexId(const char* input, const char* key, uint16_t& value)
+{
+    const size_t key_size = ::strlen(key);
+    bool found = false;
+    for (const char* pos = input; *pos != '\0'; ++pos)
+    {
+        uint16_t parsed;
+        if (StartsWithNoCase(pos, key) && ParseHex4(pos + key_size, parsed))
+        {
+            value = parsed;
+            found = true;
+        }
+    }
+    return found;
+}
+
+// Finds "COMn" in input (e.g. a port's friendly name "USB Serial Device (COM3)") and copies it to output.
+// The last occurrence wins. Returns false if not found or it does not fit.
+static bool ExtractComPort(const char* input, char* output, size_t output_size)
+{
+    const char* found = nullptr;
+    size_t found_size = 0;
+    for (const char* pos = ::strstr(input, "COM"); pos != nullptr; pos = ::strstr(pos + 1, "COM"))
+    {
+        size_t size = 3;
+        while (pos[size] >= '0' && pos[size] <= '9')
+            ++size;
+        if (size > 3)
+        {
+            found = pos;
+            found_size = size;
+        }
+    }
+    if (found == nullptr || found_size >= output_size)
+        return false;
+    ::memcpy(output, found, found_size);
+    output[found_size] = '\0';
+    return true;
+}
+
 std::vector<std::string> DiscoverSerial()
 {
     std::vector<std::string> port_names;
@@ -102,53 +160,52 @@ std::vector<std::string> DiscoverSerial()
     if (device_info_set == INVALID_HANDLE_VALUE)
         return port_names;
 
+    // buffers reused for all the devices
+    constexpr size_t max_buffer_size = 4096;
+    TCHAR device_id_buffer[max_buffer_size];
+    BYTE friendly_name_buffer[max_buffer_size];
+    char com_port[32];
+
     // Iterate over relevant devices.
     SP_DEVINFO_DATA device_info_data = {0};
     device_info_data.cbSize = sizeof(device_info_data);
     for (int device_index = 0; SetupDiEnumDeviceInfo(device_info_set, device_index, &device_info_data) != 0;
          ++device_index)
     {
-        constexpr size_t max_buffer_size = 4096;
-
-        TCHAR device_id_buffer[max_buffer_size];
         DWORD device_id_size = 0;
-        SetupDiGetDeviceInstanceId(device_info_set, &device_info_data, device_id_buffer, sizeof(device_id_buffer),
-                                   &device_id_size);
+        if (!SetupDiGetDeviceInstanceId(device_info_set, &device_info_data, device_id_buffer,
+                                        max_buffer_size - 1, &device_id_size))
+            continue;
         device_id_buffer[device_id_size] = '\0';
 
         // Assuming project uses multibyte charset, so TCHAR isn't unicode.
-        std::string device_id_string(reinterpret_cast<const char*>(device_id_buffer));
-        std::string vid = ExtractStringUsingRegex(device_id_string, VID_REGEX);
-        std::string pid = ExtractStringUsingRegex(device_id_string, PID_REGEX);
-
-        if (pid.empty() || vid.empty())
+        const char* device_id = reinterpret_cast<const char*>(device_id_buffer);
+        uint16_t vid, pid;
+        if (!ExtractHexId(device_id, "VID_", vid) || !ExtractHexId(device_id, "PID_", pid))
             continue;
 
         if (!MatchToExpectedVidPidPairs(vid, pid))
             continue;
 
-        BYTE friendly_name_buffer[max_buffer_size];
-        DWORD friendly_name_size;
-        SetupDiGetDeviceRegistryProperty(device_info_set, &device_info_data, SPDRP_FRIENDLYNAME, nullptr,
-                                         friendly_name_buffer, sizeof(friendly_name_buffer), &friendly_name_size);
+        DWORD friendly_name_size = 0;
+        if (!SetupDiGetDeviceRegistryProperty(device_info_set, &device_info_data, SPDRP_FRIENDLYNAME, nullptr,
+                                              friendly_name_buffer, sizeof(friendly_name_buffer) - 1,
+                                              &friendly_name_size))
+            continue;
         friendly_name_buffer[friendly_name_size] = '\0';
 
         // Assuming project uses multibyte charset, so TCHAR isn't unicode.
-        std::string friendly_name(reinterpret_cast<const char*>(friendly_name_buffer));
-        std::string com_port_string = ExtractStringUsingRegex(friendly_name, COM_PORT_REGEX);
-
-        std::ostringstream oss;
-        oss << "\\\\.\\" << com_port_string;
-        auto com_port_handle_string = oss.str();
+        if (!ExtractComPort(reinterpret_cast<const char*>(friendly_name_buffer), com_port, sizeof(com_port)))
+            continue;
 
-        port_names.push_back(com_port_handle_string);
+        port_names.push_back(std::string("\\\\.\\") + com_port);
     }
 
     SetupDiDestroyDeviceInfoList(device_info_set);
     return port_names;
 }
 
-std::vector<int> DiscoverCapture()
+std::vector<int> ScanCapture()
 {
     IMFAttributes* cap_config;
     std::vector<int> capture_numbers;
@@ -171,6 +228,7 @@ std::vector<int> DiscoverCapture()
     }
 
     constexpr size_t max_buffer_size = 4096;
+    char device_id_buffer[max_buffer_size]; // reused for all the devices
     for (UINT32 device_index = 0; device_index < count; device_index++)
     {
         HRESULT hr = S_OK;
@@ -181,17 +239,15 @@ std::vector<int> DiscoverCapture()
                                                          &cchName);
         if (SUCCEEDED(hr))
         {
-            char device_id_buffer[max_buffer_size];
             snprintf(device_id_buffer, max_buffer_size, "%ls", guid);
-            std::string device_id_string(device_id_buffer);
             CoTaskMemFree(guid);
 
-            std::string vid = ExtractStringUsingRegex(device_id_string, VID_REGEX);
-            std::string pid = ExtractStringUsingRegex(device_id_string, PID_REGEX);
-
-
-            if (pid.empty() || vid.empty())
+            uint16_t vid, pid;
+            if (!ExtractHexId(device_id_buffer, "VID_", vid) || !ExtractHexId(device_id_buffer, "PID_", pid))
+            {
+                ppDevices[device_index]->Release();
                 continue;
+            }
 
             auto matchResult = MatchToExpectedVidPidPairs(vid, pid);
             if (matchResult)
@@ -211,7 +267,7 @@ std::vector<int> DiscoverCapture()
     return capture_numbers;
 }
 
-std::vector<DeviceInfo> DiscoverDevices()
+std::vector<DeviceInfo> ScanDevices()
 {
     std::vector<DeviceInfo> devices;
     std::vector<std::string> port_names;
@@ -232,89 +288,158 @@ std::vector<DeviceInfo> DiscoverDevices()
 
 
 #elif LINUX
+#include <dirent.h>
+
 namespace RealSenseID
 {
-static const std::string V4L_PATH = "/sys/class/video4linux/";
-static const std::string V4L_CAM_ID_PATH = "/device/*/*/id/";
-static const int FAILED_V4L = -1;
+static const char* V4L_PATH = "/sys/class/video4linux/";
+static const char* TTY_PATH = "/sys/class/tty/";
 
-static void ThrowIfFailed(char* what, int res)
+// Reads a 4 hex digit usb id (idVendor/idProduct) from a sysfs attribute.
+static bool ReadSysfsHexId(const std::string& path, uint16_t& id)
 {
-    if (res != FAILED_V4L)
-        return;
-    std::stringstream err_stream;
-    err_stream << what << "v4l failed with error.";
-    throw std::runtime_error(err_stream.str());
+    FILE* file = ::fopen(path.c_str(), "r");
+    if (file == nullptr)
+        return false;
+    char buffer[16];
+    bool ok = ::fgets(buffer, sizeof(buffer), file) != nullptr && ParseHex4(buffer, id);
+    ::fclose(file);
+    return ok;
 }
 
-static std::string ExecuteCmd(const std::string cmd)
+// Reads the ids of the usb device of a class device (e.g. /sys/class/tty/ttyACM0).
+// Its "device" is the usb interface, or a port under the interface (ttyUSB), so the usb device is one or two levels
+// above. path is used as a scratch buffer.
+static bool ReadUsbIds(const char* class_path, const char* name, std::string& path, uint16_t& vid, uint16_t& pid)
 {
-    std::array<char, 128> buffer;
-    std::string result;
-    std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(cmd.c_str(), "r"), pclose);
-    if (!pipe)
+    path.assign(class_path).append(name).append("/device/..");
+    for (int level = 0; level < 2; level++, path.append("/.."))
     {
-        throw std::runtime_error("popen() failed!");
+        const size_t base_size = path.size();
+        bool found = ReadSysfsHexId(path.append("/idVendor"), vid);
+        path.resize(base_size);
+        if (!found)
+            continue;
+        found = ReadSysfsHexId(path.append("/idProduct"), pid);
+        path.resize(base_size);
+        return found;
     }
-    while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr)
+    return false;
+}
+
+// Class devices of the expected usb devices whose name starts with one of the prefixes, sorted by name.
+static std::vector<std::string> ScanClass(const char* class_path, std::initializer_list<const char*> prefixes)
+{
+    std::vector<std::string> names;
+    DIR* dir = ::opendir(class_path);
+    if (dir == nullptr)
     {
-        result += buffer.data();
+        LOG_DEBUG(LOG_TAG, "Failed to open %s", class_path);
+        return names;
     }
-    if (!result.empty())
+    std::string path; // reused for all the entries
+    path.reserve(256);
+    while (auto* entry = ::readdir(dir))
     {
-        result.pop_back();
+        const char* name = entry->d_name;
+        bool prefix_match = false;
+        for (auto* prefix : prefixes)
+            prefix_match = prefix_match || ::strncmp(name, prefix, ::strlen(prefix)) == 0;
+        if (!prefix_match)
+            continue;
+
+        uint16_t vid, pid;
+        if (ReadUsbIds(class_path, name, path, vid, pid) && MatchToExpectedVidPidPairs(vid, pid))
+            names.emplace_back(name);
     }
-    result.pop_back();
-    return result;
+    ::closedir(dir);
+    std::sort(names.begin(), names.end());
+    return names;
 }
 
-std::vector<int> DiscoverCapture()
+// video4linux nodes of the expected devices, from sysfs
+std::vector<int> ScanCapture()
 {
     std::vector<int> capture_numbers;
-
-    static const std::string id_req = "less " + V4L_PATH + "video";
-    static const std::string v4l_num_req = "ls " + V4L_PATH + " | wc -l";
-
-    int res = FAILED_V4L;
-    std::string result;
-
-    int number_of_dev = std::stoi(ExecuteCmd(v4l_num_req));
-    for (int cur = 0; cur < number_of_dev; cur++)
+    for (const auto& name : ScanClass(V4L_PATH, {"video"}))
     {
-        std::string vid = ExecuteCmd(id_req + std::to_string(cur) + V4L_CAM_ID_PATH + "vendor");
-        std::string pid = ExecuteCmd(id_req + std::to_string(cur) + V4L_CAM_ID_PATH + "product");
-        
-        if (vid.empty() || pid.empty())
-                continue;
-
-        if (MatchToExpectedVidPidPairs(vid, pid))
-        {
-            capture_numbers.push_back(cur);
-        }
+        capture_numbers.push_back(::atoi(name.c_str() + 5));
     }
-    LOG_DEBUG(LOG_TAG, " capture devices %d",capture_numbers.size());
+    std::sort(capture_numbers.begin(), capture_numbers.end());
+    LOG_DEBUG(LOG_TAG, "capture devices %zu", capture_numbers.size());
     return capture_numbers;
 }
 
-std::vector<DeviceInfo> DiscoverDevices()
+// usb serial ports of the expected devices, from sysfs
+std::vector<DeviceInfo> ScanDevices()
 {
-    LOG_DEBUG(LOG_TAG, "DiscoverDevices is not implemented on this platform!");
-    return {};
+    std::vector<DeviceInfo> devices;
+    for (const auto& name : ScanClass(TTY_PATH, {"ttyACM", "ttyUSB"}))
+    {
+        DeviceInfo device = {0};
+        ::snprintf(device.serialPort, sizeof(device.serialPort), "/dev/%s", name.c_str());
+        devices.push_back(device);
+    }
+    LOG_DEBUG(LOG_TAG, "serial devices %zu", devices.size());
+    return devices;
 }
 } // namespace RealSenseID
 #else
 namespace RealSenseID
 {
-std::vector<int> DiscoverCapture()
+std::vector<int> ScanCapture()
 {
     LOG_DEBUG(LOG_TAG, "DiscoverCapture is not implemented on this platform!");
     return {};
 }
 
-std::vector<DeviceInfo> DiscoverDevices()
+std::vector<DeviceInfo> ScanDevices()
 {
     LOG_DEBUG(LOG_TAG, "DiscoverDevices is not implemented on this platform!");
     return {};
 }
 } // namespace RealSenseID
-#endif
\ No newline at end of file
+#endif
+
+namespace RealSenseID
+{
+// while the device watcher runs its cached lists are returned, otherwise the system is scanned
+std::vector<DeviceInfo> DiscoverDevices()
+{
+    std::vector<DeviceInfo> devices;
+    if (DeviceWatcher::GetDevices(devices))
+    {
+        return devices;
+    }
+    return ScanDevices();
+}
+
+std::vector<int> DiscoverCapture()
+{
+    std::vector<int> capture_numbers;
+    if (DeviceWatcher::GetCapture(capture_numbers))
+    {
+        return capture_numbers;
+    }
+    return ScanCapture();
+}
+
+std::vector<ProbedDevice> ProbeDevices(const std::vector<DeviceInfo>& devices, bool use_cache)
+{
+    return DeviceProbe::Probe(devices, use_cache, [](DeviceControllerImpl& controller, const char* port) {
+        SerialConfig config;
+        config.port = port;
+        return controller.Connect(config);
+    });
+}
+
+bool StartDeviceWatcher(DevicesChangedCallback callback)
+{
+    return DeviceWatcher::Start(std::move(callback));
+}
+
+void StopDeviceWatcher()
+{
+    DeviceWatcher::Stop();
+}
+} // namespace RealSenseID
\ No newline at end of file
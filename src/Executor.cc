@@ -0,0 +1,18 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "RealSenseID/Executor.h"
+#include "LibraryThread.h"
+
+namespace RealSenseID
+{
+void SetExecutor(Executor* executor)
+{
+    LibraryThread::SetExecutor(executor);
+}
+
+Executor* GetExecutor()
+{
+    return LibraryThread::GetExecutor();
+}
+} // namespace RealSenseID
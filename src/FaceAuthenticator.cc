@@ -46,6 +46,41 @@ void FaceAuthenticator::Disconnect()
     _impl->Disconnect();
 }
 
+SerialLinkProfile FaceAuthenticator::GetLinkProfile() const
+{
+    return _impl->GetLinkProfile();
+}
+
+void FaceAuthenticator::SetPersistentSession(bool enable)
+{
+    _impl->SetPersistentSession(enable);
+}
+
+void FaceAuthenticator::SetPackedTransfers(bool enable)
+{
+    _impl->SetPackedTransfers(enable);
+}
+
+void FaceAuthenticator::SetLargePayloads(bool enable)
+{
+    _impl->SetLargePayloads(enable);
+}
+
+void FaceAuthenticator::SetMessageBatches(bool enable)
+{
+    _impl->SetMessageBatches(enable);
+}
+
+void FaceAuthenticator::CloseSession()
+{
+    _impl->CloseSession();
+}
+
+void FaceAuthenticator::SetQueryCache(bool enable)
+{
+    _impl->SetQueryCache(enable);
+}
+
 #ifdef RSID_SECURE
 Status FaceAuthenticator::Pair(const char* ecdsa_host_pubKey, const char* ecdsa_host_pubkey_sig,
                                char* ecdsa_device_pubkey)
@@ -74,6 +109,36 @@ Status FaceAuthenticator::AuthenticateLoop(AuthenticationCallback& callback)
     return _impl->AuthenticateLoop(callback);
 }
 
+Status FaceAuthenticator::SetAuthLoopPolicy(const AuthLoopPolicy& policy)
+{
+    return _impl->SetAuthLoopPolicy(policy);
+}
+
+AuthLoopPolicy FaceAuthenticator::GetAuthLoopPolicy() const
+{
+    return _impl->GetAuthLoopPolicy();
+}
+
+Status FaceAuthenticator::SetKeepAlivePolicy(const KeepAlivePolicy& policy)
+{
+    return _impl->SetKeepAlivePolicy(policy);
+}
+
+KeepAlivePolicy FaceAuthenticator::GetKeepAlivePolicy() const
+{
+    return _impl->GetKeepAlivePolicy();
+}
+
+void FaceAuthenticator::SetEventFilter(const EventFilter& filter)
+{
+    _impl->SetEventFilter(filter);
+}
+
+EventFilter FaceAuthenticator::GetEventFilter() const
+{
+    return _impl->GetEventFilter();
+}
+
 Status FaceAuthenticator::Cancel()
 {
     return _impl->Cancel();
@@ -104,6 +169,21 @@ Status FaceAuthenticator::QueryUserIds(char** user_ids, unsigned int& number_of_
     return _impl->QueryUserIds(user_ids, number_of_users);
 }
 
+Status FaceAuthenticator::QueryUserIdsToBuffer(char* user_ids, unsigned int& number_of_users)
+{
+    return _impl->QueryUserIdsToBuffer(user_ids, number_of_users);
+}
+
+Status FaceAuthenticator::QueryUserIds(UserIdsCallback& callback, unsigned int& number_of_users)
+{
+    return _impl->QueryUserIds(callback, number_of_users);
+}
+
+Status FaceAuthenticator::QueryUserIds(UsersCursor& cursor, unsigned int page_size, UserIdsCallback& callback)
+{
+    return _impl->QueryUserIds(cursor, page_size, callback);
+}
+
 Status FaceAuthenticator::QueryNumberOfUsers(unsigned int& number_of_users)
 {
     return _impl->QueryNumberOfUsers(number_of_users);
@@ -116,7 +196,18 @@ Status FaceAuthenticator::Standby()
 
 Status FaceAuthenticator::ExtractFaceprintsForEnroll(EnrollFaceprintsExtractionCallback& callback)
 {
-    return _impl->ExtractFaceprintsForEnroll(callback);
+    return _impl->ExtractFaceprintsForEnroll(nullptr, callback);
+}
+
+Status FaceAuthenticator::ExtractFaceprintsForEnroll(HostGallery& gallery, EnrollFaceprintsExtractionCallback& callback)
+{
+    return _impl->ExtractFaceprintsForEnroll(&gallery, callback);
+}
+
+Status FaceAuthenticator::ExtractFaceprintsFromImages(const StoredImage* images, unsigned int number_of_images,
+                                                      EnrollImagesCallback& callback)
+{
+    return _impl->ExtractFaceprintsFromImages(images, number_of_images, callback);
 }
 
 Status FaceAuthenticator::ExtractFaceprintsForAuth(AuthFaceprintsExtractionCallback& callback)
@@ -124,6 +215,11 @@ Status FaceAuthenticator::ExtractFaceprintsForAuth(AuthFaceprintsExtractionCallb
     return _impl->ExtractFaceprintsForAuth(callback);
 }
 
+Status FaceAuthenticator::AuthenticateWithGallery(GalleryBackend& gallery, GalleryAuthCallback& callback)
+{
+    return _impl->AuthenticateWithGallery(gallery, callback);
+}
+
 Status FaceAuthenticator::ExtractFaceprintsForAuthLoop(AuthFaceprintsExtractionCallback& callback)
 {
     return _impl->ExtractFaceprintsForAuthLoop(callback);
@@ -139,9 +235,111 @@ Status FaceAuthenticator::GetUsersFaceprints(Faceprints* user_features, unsigned
     return _impl->GetUsersFaceprints(user_features, num_of_users);
 }
 
+Status FaceAuthenticator::GetUsersFaceprints(FaceprintsExportCallback& callback, unsigned int& num_of_users)
+{
+    return _impl->GetUsersFaceprints(callback, num_of_users);
+}
+
+Status FaceAuthenticator::ExportUsers(UsersExportCallback& callback, unsigned int& num_of_users)
+{
+    return _impl->ExportUsers(callback, num_of_users);
+}
+
+Status FaceAuthenticator::ExportUsers(UsersCursor& cursor, unsigned int page_size, UsersExportCallback& callback)
+{
+    return _impl->ExportUsers(cursor, page_size, callback);
+}
+
+Status FaceAuthenticator::GetUsersFaceprints(UsersCursor& cursor, unsigned int page_size,
+                                             FaceprintsExportCallback& callback)
+{
+    return _impl->GetUsersFaceprints(cursor, page_size, callback);
+}
+
+unsigned int FaceAuthenticator::GetUsersRevision() const
+{
+    return _impl->GetUsersRevision();
+}
+
+Status FaceAuthenticator::GetChangedUsersFaceprints(unsigned int since_revision, UsersChangesCallback& callback,
+                                                     unsigned int& revision)
+{
+    return _impl->GetChangedUsersFaceprints(since_revision, callback, revision);
+}
+
+Status FaceAuthenticator::GetDifferingUsersFaceprints(const HostGallery& gallery, UsersChangesCallback& callback)
+{
+    return _impl->GetDifferingUsersFaceprints(gallery, callback);
+}
+
 Status FaceAuthenticator::SetUsersFaceprints (UserFaceprints * user_features, unsigned int num_of_users)
 {
     return _impl->SetUsersFaceprints(user_features, num_of_users);
 }
 
+Status FaceAuthenticator::BeginBulkUpdate()
+{
+    return _impl->BeginBulkUpdate();
+}
+
+Status FaceAuthenticator::CommitBulkUpdate()
+{
+    return _impl->CommitBulkUpdate();
+}
+
+std::future<Status> FaceAuthenticator::EnrollAsync(EnrollmentCallback& callback, const char* user_id)
+{
+    return _impl->EnrollAsync(callback, user_id);
+}
+
+std::future<Status> FaceAuthenticator::AuthenticateAsync(AuthenticationCallback& callback)
+{
+    return _impl->AuthenticateAsync(callback);
+}
+
+std::future<Status> FaceAuthenticator::AuthenticateLoopAsync(AuthenticationCallback& callback)
+{
+    return _impl->AuthenticateLoopAsync(callback);
+}
+
+std::future<Status> FaceAuthenticator::RemoveUserAsync(const char* user_id)
+{
+    return _impl->RemoveUserAsync(user_id);
+}
+
+std::future<Status> FaceAuthenticator::RemoveAllAsync()
+{
+    return _impl->RemoveAllAsync();
+}
+
+std::future<Status> FaceAuthenticator::QueryNumberOfUsersAsync(unsigned int& number_of_users)
+{
+    return _impl->QueryNumberOfUsersAsync(number_of_users);
+}
+
+std::future<Status> FaceAuthenticator::QueryUserIdsAsync(UserIdsCallback& callback, unsigned int& number_of_users)
+{
+    return _impl->QueryUserIdsAsync(callback, number_of_users);
+}
+
+std::future<Status> FaceAuthenticator::StandbyAsync()
+{
+    return _impl->StandbyAsync();
+}
+
+std::future<Status> FaceAuthenticator::ExtractFaceprintsForAuthAsync(AuthFaceprintsExtractionCallback& callback)
+{
+    return _impl->ExtractFaceprintsForAuthAsync(callback);
+}
+
+std::future<Status> FaceAuthenticator::GetUsersFaceprintsAsync(FaceprintsExportCallback& callback,
+                                                               unsigned int& num_of_users)
+{
+    return _impl->GetUsersFaceprintsAsync(callback, num_of_users);
+}
+
+std::future<Status> FaceAuthenticator::SetUsersFaceprintsAsync(UserFaceprints* user_features, unsigned int num_of_users)
+{
+    return _impl->SetUsersFaceprintsAsync(user_features, num_of_users);
+}
 } // namespace RealSenseID
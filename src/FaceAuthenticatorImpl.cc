@@ -3,18 +3,30 @@
 
 #include "FaceAuthenticatorImpl.h"
 #include "Logger.h"
+#include "Tracer.h"
+#include "MetricsRegistry.h"
 #include "PacketManager/Timer.h"
 #include "PacketManager/PacketSender.h"
 #include "PacketManager/SerialPacket.h"
+#include "PacketManager/PackedFaceprints.h"
+#include "PacketManager/EnrollImage.h"
+#include "PacketManager/Randomizer.h"
 #include "StatusHelper.h"
 #include "RealSenseID/MatchResultHost.h"
 #include "RealSenseID/Faceprints.h"
+#include "RealSenseID/AuthEventQueue.h"
 #include "Matcher/Matcher.h"
+#include "Matcher/MatcherThreadPool.h"
+#include "JpegPreparation.h"
 #include "CommonValues.h"
 #include "string.h"
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
 #include <stdexcept>
+#include <system_error>
 #include <thread>
 #include <chrono>
 
@@ -22,6 +34,7 @@
 #include "PacketManager/WindowsSerial.h"
 #elif LINUX
 #include "PacketManager/LinuxSerial.h"
+#include "PacketManager/LinuxUsbSerial.h"
 #elif ANDROID
 #include "PacketManager/AndroidSerial.h"
 #else
@@ -53,6 +66,64 @@ struct SecureVersionDescriptor
 
 static const unsigned int MAX_FACES = 10;
 
+// drops the events the EventFilter excludes, for devices that send them anyway (the ones without the session options)
+class EventGate
+{
+public:
+    explicit EventGate(const EventFilter& filter) : _filter(filter)
+    {
+    }
+
+    bool Hint() const
+    {
+        return _filter.hints;
+    }
+
+    bool Progress() const
+    {
+        return _filter.progress;
+    }
+
+    bool Faces()
+    {
+        if (!_filter.faces)
+        {
+            return false;
+        }
+        const auto now = std::chrono::steady_clock::now();
+        if (_faces_passed && now - _last_faces < std::chrono::milliseconds {_filter.face_interval_ms})
+        {
+            return false;
+        }
+        _faces_passed = true;
+        _last_faces = now;
+        return true;
+    }
+
+private:
+    EventFilter _filter;
+    bool _faces_passed = false;
+    std::chrono::steady_clock::time_point _last_faces;
+};
+
+static PacketManager::SessionOptions ToSessionOptions(const EventFilter& filter)
+{
+    PacketManager::SessionOptions options;
+    options.events = static_cast<uint8_t>((filter.hints ? PacketManager::SessionEventHints : 0) |
+                                          (filter.progress ? PacketManager::SessionEventProgress : 0) |
+                                          (filter.faces ? PacketManager::SessionEventFaces : 0));
+    options.face_interval_ms = static_cast<uint16_t>(std::min(filter.face_interval_ms, 0xFFFFu));
+    return options;
+}
+// AuthenticateWithGallery(): a frame's statuses, faceprints, matches and updated faceprints (and the alignment)
+const size_t FaceAuthenticatorImpl::OperationArenaSize =
+    MAX_FACES * (sizeof(AuthenticateStatus) + 2 * sizeof(Faceprints) + sizeof(HostGalleryMatch)) +
+    4 * alignof(std::max_align_t);
+// max GetUserFeatures / SetUserFeatures requests outstanding during faceprints export / import
+static const unsigned int USER_FEATURES_PIPELINE_DEPTH = 4;
+// users per step of an async export / import: how long a higher priority operation may wait for the serial line
+static const unsigned int ASYNC_STEP_USERS = 8;
+
 // save callback functions to use in the secure session later
 FaceAuthenticatorImpl::FaceAuthenticatorImpl(SignatureCallback* callback) :
 #ifdef RSID_SECURE
@@ -67,30 +138,74 @@ FaceAuthenticatorImpl::FaceAuthenticatorImpl(SignatureCallback* callback) :
     {
         throw(std::runtime_error("Got nullptr for SignatureCallback"));
     }
+    // in secure mode sleep less to take into account start session duration
+    _loop_policy.interval_with_face_ms = 100;
+    _loop_policy.min_interval_no_face_ms = 1500;
+    _loop_policy.max_interval_no_face_ms = 1500;
 }
 #else
     _session {}
 {
+    _loop_policy.interval_with_face_ms = 600;
+    _loop_policy.min_interval_no_face_ms = 2100;
+    _loop_policy.max_interval_no_face_ms = 2100;
 }
 #endif // RSID_SECURE
 
+FaceAuthenticatorImpl::~FaceAuthenticatorImpl()
+{
+    try
+    {
+        StopKeepAlive();
+        if (_operations.Stop())
+        {
+            Cancel(); // don't wait for a running loop
+        }
+        _operations.Join();
+    }
+    catch (...)
+    {
+    }
+}
+
 Status FaceAuthenticatorImpl::Connect(const SerialConfig& config)
 {
+    DeviceLock device_lock {_device_mutex};
     try
     {
         // disconnect if already connected
+        _session.Close();
         _serial.reset();
+        _users_journal.Reset(); // may be another device
+        InvalidateQueryCache();
+        ResetPackedSupport();
+        _reopen = nullptr;
         PacketManager::SerialConfig serial_config;
         serial_config.port = config.port;
 
 #ifdef _WIN32
-        _serial = std::make_unique<PacketManager::WindowsSerial>(serial_config);
+        _reopen = [serial_config]() { return std::make_unique<PacketManager::WindowsSerial>(serial_config); };
 #elif LINUX
-        _serial = std::make_unique<PacketManager::LinuxSerial>(serial_config);
+        if (config.transport == SerialConfig::Transport::UsbBulk)
+        {
+            _reopen = [serial_config]() { return std::make_unique<PacketManager::LinuxUsbSerial>(serial_config); };
+        }
+        else
+        {
+            _reopen = [serial_config]() { return std::make_unique<PacketManager::LinuxSerial>(serial_config); };
+        }
 #else
         LOG_ERROR(LOG_TAG, "Serial connection method not supported for OS");
         return Status::Error;
 #endif // WIN32
+        _serial = _reopen();
+        _link_profile = SerialLinkProfile {};
+        _session.Prepare();
+        if (config.calibrate_link && CalibrateLink() != Status::Ok)
+        {
+            LOG_WARNING(LOG_TAG, "Link calibration failed, using the default port settings");
+        }
+        MarkActivity();
         return Status::Ok;
     }
     catch (const std::exception& ex)
@@ -105,16 +220,45 @@ Status FaceAuthenticatorImpl::Connect(const SerialConfig& config)
     }
 }
 
+Status FaceAuthenticatorImpl::Connect(std::unique_ptr<PacketManager::SerialConnection> serial)
+{
+    DeviceLock device_lock {_device_mutex};
+    if (!serial)
+    {
+        LOG_ERROR(LOG_TAG, "Got null serial connection");
+        return Status::Error;
+    }
+    _session.Close();
+    _serial = std::move(serial);
+    _reopen = nullptr;
+    _link_profile = SerialLinkProfile {};
+    _users_journal.Reset(); // may be another device
+    InvalidateQueryCache();
+    ResetPackedSupport();
+    _session.Prepare();
+    MarkActivity();
+    return Status::Ok;
+}
+
 #ifdef ANDROID
 Status FaceAuthenticatorImpl::Connect(const AndroidSerialConfig& config)
 {
+    DeviceLock device_lock {_device_mutex};
     try
     {
         // disconnect if already connected
+        _session.Close();
         _serial.reset();
+        _users_journal.Reset(); // may be another device
+        InvalidateQueryCache();
+        ResetPackedSupport();
 
+        _reopen = nullptr;
+        _link_profile = SerialLinkProfile {};
         _serial = std::make_unique<PacketManager::AndroidSerial>(config.fileDescriptor, config.readEndpoint,
                                                                  config.writeEndpoint);
+        _session.Prepare();
+        MarkActivity();
         return Status::Ok;
     }
     catch (const std::exception& ex)
@@ -132,18 +276,101 @@ Status FaceAuthenticatorImpl::Connect(const AndroidSerialConfig& config)
 
 void FaceAuthenticatorImpl::Disconnect()
 {
+    DeviceLock device_lock {_device_mutex};
+    _session.Close();
     _serial.reset();
+    _reopen = nullptr;
+    _link_profile = SerialLinkProfile {};
+    InvalidateQueryCache();
+}
+
+SerialLinkProfile FaceAuthenticatorImpl::GetLinkProfile() const
+{
+    DeviceLock device_lock {_device_mutex};
+    return _link_profile;
+}
+
+void FaceAuthenticatorImpl::SetPersistentSession(bool enable)
+{
+    DeviceLock device_lock {_device_mutex};
+    _persistent_session = enable;
+    if (!enable)
+    {
+        _session.Close();
+    }
+}
+
+void FaceAuthenticatorImpl::SetPackedTransfers(bool enable)
+{
+    DeviceLock device_lock {_device_mutex};
+    _packed_transfers = enable;
+    ResetPackedSupport();
+}
+
+void FaceAuthenticatorImpl::SetLargePayloads(bool enable)
+{
+    DeviceLock device_lock {_device_mutex};
+    _large_payloads = enable; // offered from the next session start
+}
+
+void FaceAuthenticatorImpl::SetMessageBatches(bool enable)
+{
+    DeviceLock device_lock {_device_mutex};
+    _message_batches = enable; // offered from the next session start
+}
+
+void FaceAuthenticatorImpl::CloseSession()
+{
+    DeviceLock device_lock {_device_mutex};
+    _session.Close();
+}
+
+void FaceAuthenticatorImpl::SetQueryCache(bool enable)
+{
+    _number_of_users_cache.Enable(enable);
+    _device_config_cache.Enable(enable);
+}
+
+void FaceAuthenticatorImpl::InvalidateQueryCache()
+{
+    _number_of_users_cache.Invalidate();
+    _device_config_cache.Invalidate();
+}
+
+// Start a new session, or in persistent session mode (and within a loop or a bulk update) continue the open one
+PacketManager::SerialStatus FaceAuthenticatorImpl::StartSession()
+{
+    RSID_TRACE_SPAN("session", "StartSession");
+    if (!_serial)
+    {
+        LOG_ERROR(LOG_TAG, "Not connected to a serial port");
+        return PacketManager::SerialStatus::OpenFailed;
+    }
+    MarkActivity();
+    auto options = ToSessionOptions(GetEventFilter());
+    options.large_payload = _large_payloads ? PacketManager::MaxLargePayloadSize : 0; // used if the device takes it
+    options.batches = _message_batches;
+    if (options != _session.StartOptions())
+    {
+        _session.Close(); // the options go with the session start
+        _session.SetStartOptions(options);
+    }
+    return _persistent_session || _loop_session || _bulk_update ? _session.Resume(_serial.get())
+                                                                : _session.Start(_serial.get());
 }
 
 #ifdef RSID_SECURE
 Status FaceAuthenticatorImpl::Pair(const char* ecdsaHostPubKey, const char* ecdsaHostPubKeySig, char* ecdsaDevicePubKey)
 {
+    RSID_TRACE_SPAN("api", "Pair");
+    DeviceLock device_lock {_device_mutex};
     if (!_serial)
     {
         LOG_ERROR(LOG_TAG, "Not connected to a serial port");
         return Status::Error;
     }
     LOG_INFO(LOG_TAG, "Pairing start");
+    _session.Close(); // new keys, renegotiate on next session start
 
     unsigned char ecdsaSignedHostPubKey[SIGNED_PUBKEY_SIZE];
     ::memset(ecdsaSignedHostPubKey, 0, sizeof(ecdsaSignedHostPubKey));
@@ -184,22 +411,28 @@ Status FaceAuthenticatorImpl::Pair(const char* ecdsaHostPubKey, const char* ecds
 
 Status FaceAuthenticatorImpl::Unpair()
 {
+    RSID_TRACE_SPAN("api", "Unpair");
+    DeviceLock device_lock {_device_mutex};
     if (!_serial)
     {
         LOG_ERROR(LOG_TAG, "Not connected to a serial port");
         return Status::Error;
     }
+    _session.Close();
     auto status = _session.Unpair(_serial.get());
     return ToStatus(status);
 }
 #endif // RSID_SECURE
 
 
-// return list of faces from given packet
+static_assert(MAX_FACES <= AuthEvent::MAX_FACES, "AuthEvent can't hold MAX_FACES faces");
+
+// copy the faces of the given packet to faces and return their count
 // serialization format:
 //   First byte: face count
 //   N FaceRect structs (little endian, packed)
-static std::vector<FaceRect> GetDetectedFaces(const PacketManager::SerialPacket& packet, unsigned int & ts)
+static size_t GetDetectedFaces(const PacketManager::SerialPacket& packet, FaceRect (&faces)[MAX_FACES],
+                               unsigned int& ts)
 {
     assert(packet.header.id == PacketManager::MsgId::FaceDetected);
 
@@ -217,17 +450,14 @@ static std::vector<FaceRect> GetDetectedFaces(const PacketManager::SerialPacket&
         throw std::runtime_error("Got unexpected faces count in response: " + std::to_string(n_faces));
     }
 
-    std::vector<FaceRect> rv;
-    rv.reserve(n_faces);
     for (unsigned int i = 0; i < n_faces; i++)
     {
-        FaceRect face;
+        FaceRect& face = faces[i];
         ::memcpy(&face, data, sizeof(face));
         data += sizeof(face);
-        rv.push_back(face);
         LOG_DEBUG(LOG_TAG, "Detected face %u,%u %ux%u", face.x, face.y, face.w, face.h);
     }
-    return rv;
+    return n_faces;
 }
 
 // Do enroll session with the device. Call user's enroll callbacks in the process.
@@ -237,13 +467,16 @@ static std::vector<FaceRect> GetDetectedFaces(const PacketManager::SerialPacket&
 //      Unexpected msg_id in the fa response.
 Status FaceAuthenticatorImpl::Enroll(EnrollmentCallback& callback, const char* user_id)
 {
+    RSID_TRACE_SPAN("api", "Enroll");
+    DeviceLock device_lock {_device_mutex};
+    MetricsRegistry::ScopedLatency latency {MetricsOperation::Enroll};
     try
     {
         if (!ValidateUserId(user_id))
         {
             return Status::Error;
         }
-        auto status = _session.Start(_serial.get());
+        auto status = StartSession();
         if (status != PacketManager::SerialStatus::Ok)
         {
             LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(status));
@@ -261,6 +494,7 @@ Status FaceAuthenticatorImpl::Enroll(EnrollmentCallback& callback, const char* u
         }
 
         PacketManager::Timer session_timer {CommonValues::enroll_max_timeout};
+        EventGate gate {GetEventFilter()};
         while (true)
         {
             if (session_timer.ReachedTimeout())
@@ -283,10 +517,15 @@ Status FaceAuthenticatorImpl::Enroll(EnrollmentCallback& callback, const char* u
             // handle face detected as data packet
             if (msg_id == PacketManager::MsgId::FaceDetected)
             {
+                if (!gate.Faces())
+                {
+                    continue;
+                }
                 unsigned int ts;
-                auto faces = GetDetectedFaces(fa_packet, ts);
-                LOG_INFO("Enroll", "OnFaceDetected %u faces", static_cast<unsigned>(faces.size()));
-                callback.OnFaceDetected(faces, ts);
+                FaceRect faces[MAX_FACES];
+                auto n_faces = GetDetectedFaces(fa_packet, faces, ts);
+                LOG_INFO("Enroll", "OnFaceDetected %u faces", static_cast<unsigned>(n_faces));
+                callback.OnFaceDetected(faces, n_faces, ts);
                 continue; // continue to recv next messages
             }
 
@@ -299,15 +538,26 @@ Status FaceAuthenticatorImpl::Enroll(EnrollmentCallback& callback, const char* u
                 return Status::Ok;
 
             case (PacketManager::MsgId::Result):
+                if (EnrollStatus(fa_status) == EnrollStatus::Success)
+                {
+                    _users_journal.OnUserChanged(user_id);
+                    _number_of_users_cache.Invalidate();
+                }
                 callback.OnResult(EnrollStatus(fa_status));
                 break;
 
             case (PacketManager::MsgId::Progress):
-                callback.OnProgress((FacePose)fa_status);
+                if (gate.Progress())
+                {
+                    callback.OnProgress((FacePose)fa_status);
+                }
                 break;
 
             case (PacketManager::MsgId::Hint):
-                callback.OnHint(EnrollStatus(fa_status));
+                if (gate.Hint())
+                {
+                    callback.OnHint(EnrollStatus(fa_status));
+                }
                 break;
 
             default:
@@ -339,9 +589,15 @@ Status FaceAuthenticatorImpl::Enroll(EnrollmentCallback& callback, const char* u
 //      Unexpected msg_id in the fa response.
 Status FaceAuthenticatorImpl::Authenticate(AuthenticationCallback& callback)
 {
+    RSID_TRACE_SPAN("api", "Authenticate");
+    DeviceLock device_lock {_device_mutex};
+    MetricsRegistry::ScopedLatency latency {MetricsOperation::Authenticate};
+    const auto op_start = std::chrono::steady_clock::now();
+    OperationTiming timing;
     try
     {
-        auto status = _session.Start(_serial.get());
+        auto status = StartSession();
+        timing.session_start_us = MetricsRegistry::ElapsedMicros(op_start);
         if (status != PacketManager::SerialStatus::Ok)
         {
             LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(status));
@@ -349,7 +605,10 @@ Status FaceAuthenticatorImpl::Authenticate(AuthenticationCallback& callback)
             return ToStatus(status);
         }
         PacketManager::FaPacket fa_packet {PacketManager::MsgId::Authenticate};
+        auto send_start = std::chrono::steady_clock::now();
         status = _session.SendPacket(fa_packet);
+        timing.request_send_us = MetricsRegistry::ElapsedMicros(send_start);
+        const auto sent = std::chrono::steady_clock::now();
         if (status != PacketManager::SerialStatus::Ok)
         {
             LOG_ERROR(LOG_TAG, "Failed sending fa packet (status %d)", (int)status);
@@ -358,6 +617,7 @@ Status FaceAuthenticatorImpl::Authenticate(AuthenticationCallback& callback)
         }
 
         PacketManager::Timer session_timer {CommonValues::auth_max_timeout};
+        EventGate gate {GetEventFilter()};
         while (true)
         {
             if (session_timer.ReachedTimeout())
@@ -380,10 +640,19 @@ Status FaceAuthenticatorImpl::Authenticate(AuthenticationCallback& callback)
             // handle face detected as data packet
             if (msg_id == PacketManager::MsgId::FaceDetected)
             {
+                if (timing.until_face_detected_us == 0)
+                {
+                    timing.until_face_detected_us = MetricsRegistry::ElapsedMicros(sent);
+                }
+                if (!gate.Faces())
+                {
+                    continue;
+                }
                 unsigned int ts;
-                auto faces = GetDetectedFaces(fa_packet, ts);
-                LOG_INFO("Autenticate", "OnFaceDetected %u faces", static_cast<unsigned>(faces.size()));
-                callback.OnFaceDetected(faces, ts);
+                FaceRect faces[MAX_FACES];
+                auto n_faces = GetDetectedFaces(fa_packet, faces, ts);
+                LOG_INFO("Autenticate", "OnFaceDetected %u faces", static_cast<unsigned>(n_faces));
+                callback.OnFaceDetected(faces, n_faces, ts);
                 continue; // continue to recv next messages
             }
 
@@ -397,17 +666,27 @@ Status FaceAuthenticatorImpl::Authenticate(AuthenticationCallback& callback)
             // end of transaction
             case (PacketManager::MsgId::Reply):
                 LOG_INFO("Autenticate", "Done");
+                timing.total_us = MetricsRegistry::ElapsedMicros(op_start);
+                callback.OnTiming(timing);
                 return Status::Ok;
 
             case (PacketManager::MsgId::Result): {
+                timing.until_result_us = MetricsRegistry::ElapsedMicros(sent);
                 LOG_INFO("Autenticate", "OnResult status=%s(%d), user_id=\"%s\"", log_auth_status, fa_status, user_id);
+                if (auth_status == AuthenticateStatus::Success)
+                {
+                    _users_journal.OnUserChanged(user_id); // the device may have updated the adaptive descriptors
+                }
                 callback.OnResult(auth_status, user_id);
                 break;
             }
 
             case (PacketManager::MsgId::Hint):
                 LOG_INFO("Autenticate", "OnHint status=%s(%d), user_id=\"%s\"", log_auth_status, fa_status, user_id);
-                callback.OnHint(auth_status);
+                if (gate.Hint())
+                {
+                    callback.OnHint(auth_status);
+                }
                 break;
 
             default:
@@ -434,479 +713,579 @@ Status FaceAuthenticatorImpl::Authenticate(AuthenticationCallback& callback)
 // wait for cancel flag while sleeping upto timeout
 void FaceAuthenticatorImpl::AuthLoopSleep(std::chrono::milliseconds timeout)
 {
-    PacketManager::Timer timer {timeout};
     LOG_DEBUG(LOG_TAG, "AuthLoopSleep upto %zu millis", timeout.count());
-    // sleep in small interval to stop sleep if we got canceled
-    while (!timer.ReachedTimeout() && !_cancel_loop)
-    {
-        auto sleep_interval = std::chrono::milliseconds {500};
-        if (timer.TimeLeft() < sleep_interval)
-        {
-            sleep_interval = timer.TimeLeft();            
-            assert(sleep_interval > PacketManager::timeout_t::zero());
-        }      
-        
-        std::this_thread::sleep_for(sleep_interval);
-    }    
+    // Cancel() wakes us up
+    std::unique_lock<std::mutex> lock {_loop_mutex};
+    _loop_cv.wait_for(lock, timeout, [this] { return _cancel_loop.load(); });
 }
 
-
-// Perform authentication loop. Call user's callbacks in the process.
-// Wait for one of the following to happen:
-//      * We get 'reply' from device ('Y' , would happen if "cancel" command was sent).
-//      * Any non ok status from the session object(i.e. serial comm failed, or session timeout).
-//
-// Keep delay interval between requests:
-//      * 2100ms if no face was found or got error (or 1600ms in secure mode).
-//      * 600ms otherwise (or 100ms in secure mode).
-
-// Helper callback handler to deal with sleep intervals
-class AuthLoopCallback : public AuthenticationCallback
+void FaceAuthenticatorImpl::AuthLoopWait(bool face_found, unsigned int& idle_count)
 {
-    bool _face_found = false;
-    AuthenticationCallback& _user_callback;
-
-public:
-    explicit AuthLoopCallback(AuthenticationCallback& user_callback) : _user_callback(user_callback)
-    {
-    }
-
-    void OnResult(const AuthenticateStatus status, const char* userId) override
+    AuthLoopPolicy policy = GetAuthLoopPolicy();
+    if (face_found)
     {
-        if (status == AuthenticateStatus::NoFaceDetected || status == AuthenticateStatus::DeviceError ||
-            status == AuthenticateStatus::SerialError || status == AuthenticateStatus::Failure)
+        idle_count = 0;
+        if (policy.interval_with_face_ms > 0)
         {
-            _face_found = false;
+            AuthLoopSleep(std::chrono::milliseconds {policy.interval_with_face_ms});
         }
-        _user_callback.OnResult(status, userId);
+        return;
     }
 
-    void OnHint(const AuthenticateStatus hint) override
+    // exponential backoff while idle
+    uint64_t interval = policy.min_interval_no_face_ms;
+    for (unsigned int i = 0; i < idle_count && interval < policy.max_interval_no_face_ms; i++)
     {
-        _user_callback.OnHint(hint);
+        interval *= 2;
     }
+    interval = std::min<uint64_t>(interval, policy.max_interval_no_face_ms);
+    idle_count++;
+    AuthLoopSleep(std::chrono::milliseconds {interval});
+}
 
-    void OnFaceDetected(const std::vector<FaceRect>& faces, const unsigned int ts) override
+Status FaceAuthenticatorImpl::SetAuthLoopPolicy(const AuthLoopPolicy& policy)
+{
+    if (policy.min_interval_no_face_ms > policy.max_interval_no_face_ms)
     {
-        _face_found = !faces.empty();
-        _user_callback.OnFaceDetected(faces, ts);
+        LOG_ERROR(LOG_TAG, "Invalid auth loop policy: min interval %u > max interval %u",
+                  policy.min_interval_no_face_ms, policy.max_interval_no_face_ms);
+        return Status::Error;
     }
+    std::lock_guard<std::mutex> lock {_loop_mutex};
+    _loop_policy = policy;
+    return Status::Ok;
+}
 
-    bool face_found()
+AuthLoopPolicy FaceAuthenticatorImpl::GetAuthLoopPolicy() const
+{
+    std::lock_guard<std::mutex> lock {_loop_mutex};
+    return _loop_policy;
+}
+
+Status FaceAuthenticatorImpl::SetKeepAlivePolicy(const KeepAlivePolicy& policy)
+{
+    if (policy.ping_timeout_ms == 0 || policy.min_backoff_ms == 0 || policy.min_backoff_ms > policy.max_backoff_ms)
     {
-        return _face_found;
+        LOG_ERROR(LOG_TAG, "Invalid keep-alive policy: ping timeout %u, backoff %u - %u", policy.ping_timeout_ms,
+                  policy.min_backoff_ms, policy.max_backoff_ms);
+        return Status::Error;
     }
-};
+    StopKeepAlive();
+    std::lock_guard<std::mutex> lock {_keep_alive_mutex};
+    _keep_alive_policy = policy;
+    if (policy.idle_ms > 0)
+    {
+        _keep_alive_stop = false;
+        _keep_alive_thread = LibraryThread {&FaceAuthenticatorImpl::KeepAliveLoop, this};
+    }
+    return Status::Ok;
+}
 
-Status FaceAuthenticatorImpl::AuthenticateLoop(AuthenticationCallback& callback)
+KeepAlivePolicy FaceAuthenticatorImpl::GetKeepAlivePolicy() const
 {
-    _cancel_loop = false;
-    do
-    {
-        AuthLoopCallback clbk_handler {callback};
-        auto status = Authenticate(clbk_handler);
-        if (status != Status::Ok || _cancel_loop)
-        {
-            return status; // return from the loop on first error
-        }
+    std::lock_guard<std::mutex> lock {_keep_alive_mutex};
+    return _keep_alive_policy;
+}
 
-        auto sleep_for = clbk_handler.face_found() ? _loop_interval_with_face : _loop_interval_no_face;
-        AuthLoopSleep(sleep_for);
-    } while (!_cancel_loop);
+void FaceAuthenticatorImpl::SetEventFilter(const EventFilter& filter)
+{
+    std::lock_guard<std::mutex> lock {_event_filter_mutex};
+    _event_filter = filter;
+}
 
-    return Status::Ok;
+EventFilter FaceAuthenticatorImpl::GetEventFilter() const
+{
+    std::lock_guard<std::mutex> lock {_event_filter_mutex};
+    return _event_filter;
 }
 
-Status FaceAuthenticatorImpl::Cancel()
+void FaceAuthenticatorImpl::MarkActivity()
+{
+    _last_activity = std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+std::chrono::steady_clock::time_point FaceAuthenticatorImpl::LastActivity() const
+{
+    return std::chrono::steady_clock::time_point {std::chrono::steady_clock::duration {_last_activity.load()}};
+}
+
+void FaceAuthenticatorImpl::StopKeepAlive()
 {
-    try
-    {
-        _cancel_loop = true;
-        // Send cancel packet.
-        _session.Cancel();
-        return Status::Ok;
-    }
-    catch (std::exception& ex)
     {
-        LOG_EXCEPTION(LOG_TAG, ex);
-        return Status::Error;
+        std::lock_guard<std::mutex> lock {_keep_alive_mutex};
+        _keep_alive_stop = true;
     }
-    catch (...)
+    _keep_alive_cv.notify_all();
+    if (_keep_alive_thread.joinable())
     {
-        LOG_ERROR(LOG_TAG, "Unknown exception");
-        return Status::Error;
+        _keep_alive_thread.join();
     }
-} // namespace RealSenseID
+}
 
-Status FaceAuthenticatorImpl::RemoveUser(const char* user_id)
+// The keep-alive runs on the operations queue at the lowest priority, so it is serialized with the async operations
+// and never delays one. The monitor waits for it to finish before deciding on the next one (a keep-alive abandoned by
+// a stopped queue leaves it waiting until StopKeepAlive()).
+void FaceAuthenticatorImpl::KeepAliveLoop()
 {
-    try
-    {
-        if (!ValidateUserId(user_id))
-        {
-            return Status::Error;
-        }
-        auto status = _session.Start(_serial.get());
-        if (status != PacketManager::SerialStatus::Ok)
+    std::unique_lock<std::mutex> lock {_keep_alive_mutex};
+    bool link_down = false;
+    auto backoff = std::chrono::milliseconds {_keep_alive_policy.min_backoff_ms};
+    auto next_retry = std::chrono::steady_clock::now();
+    while (!_keep_alive_stop)
+    {
+        const auto due =
+            link_down ? next_retry : LastActivity() + std::chrono::milliseconds {_keep_alive_policy.idle_ms};
+        if (std::chrono::steady_clock::now() < due)
         {
-            LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(status));
-            return ToStatus(status);
+            _keep_alive_cv.wait_until(lock, due); // then check again, there may have been activity meanwhile
+            continue;
         }
 
-        PacketManager::FaPacket fa_packet {PacketManager::MsgId::RemoveUser, user_id, 0};
-        status = _session.SendPacket(fa_packet);
-        if (status != PacketManager::SerialStatus::Ok)
+        const KeepAlivePolicy policy = _keep_alive_policy;
+        _keep_alive_pending = true;
+        _operations.Post(
+            [this, policy, link_down]() {
+                auto status = KeepAlive(policy, link_down);
+                {
+                    std::lock_guard<std::mutex> done_lock {_keep_alive_mutex};
+                    _keep_alive_pending = false;
+                    _keep_alive_status = status;
+                }
+                _keep_alive_cv.notify_all();
+                return status;
+            },
+            OperationPriority::Telemetry);
+        _keep_alive_cv.wait(lock, [this] { return _keep_alive_stop || !_keep_alive_pending; });
+        if (_keep_alive_stop)
         {
-            LOG_ERROR(LOG_TAG, "Failed sending fa packet (status %d)", (int)status);
-            return ToStatus(status);
+            return;
         }
-
-        status = _session.RecvFaPacket(fa_packet);
-        if (status != PacketManager::SerialStatus::Ok)
+        link_down = _keep_alive_status != Status::Ok;
+        if (!link_down)
         {
-            LOG_ERROR(LOG_TAG, "Failed receiving fa packet (status %d)", (int)status);
-            return ToStatus(status);
+            backoff = std::chrono::milliseconds {policy.min_backoff_ms};
+            continue;
         }
-
-        return Status(fa_packet.GetStatusCode());
+        next_retry = std::chrono::steady_clock::now() + backoff;
+        backoff = std::min(backoff * 2, std::chrono::milliseconds {policy.max_backoff_ms});
     }
-    catch (std::exception& ex)
+}
+
+Status FaceAuthenticatorImpl::KeepAlive(const KeepAlivePolicy& policy, bool reconnect)
+{
+    RSID_TRACE_SPAN("api", "KeepAlive");
+    DeviceLock device_lock {_device_mutex};
+    if (!_serial && !_reopen)
     {
-        LOG_EXCEPTION(LOG_TAG, ex);
-        return Status::Error;
+        return Status::Ok; // not connected, nothing to keep alive
     }
-    catch (...)
+    if (!reconnect)
     {
-        LOG_ERROR(LOG_TAG, "Unknown exception");
-        return Status::Error;
+        if (std::chrono::steady_clock::now() - LastActivity() < std::chrono::milliseconds {policy.idle_ms})
+        {
+            return Status::Ok; // an operation ran since the keep-alive was queued
+        }
+        if (_serial && Ping(std::chrono::milliseconds {policy.ping_timeout_ms}) == Status::Ok)
+        {
+            MarkActivity();
+            return Status::Ok;
+        }
+        LOG_WARNING(LOG_TAG, "Keep-alive ping failed");
     }
+    return Reconnect(policy);
 }
 
-Status FaceAuthenticatorImpl::RemoveAll()
+// ping outside the session, as DeviceController::Ping() does
+Status FaceAuthenticatorImpl::Ping(std::chrono::milliseconds timeout, size_t data_size)
 {
+    using namespace PacketManager;
     try
     {
-        auto status = _session.Start(_serial.get());
-        if (status != PacketManager::SerialStatus::Ok)
-        {
-            LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(status));
-            return ToStatus(status);
-        }
-
-        PacketManager::FaPacket fa_packet {PacketManager::MsgId::RemoveAllUsers};
-        status = _session.SendPacket(fa_packet);
-        if (status != PacketManager::SerialStatus::Ok)
+        char random_data[sizeof(DataMessage::data)];
+        data_size = std::min(data_size, sizeof(random_data));
+        Randomizer::Instance().GenerateRandom((unsigned char*)random_data, data_size);
+        DataPacket ping_packet {MsgId::Ping, random_data, data_size};
+        PacketSender sender {_serial.get()};
+        auto status = sender.SendBinary(ping_packet);
+        if (status != SerialStatus::Ok)
         {
-            LOG_ERROR(LOG_TAG, "Failed sending fa packet (status %d)", (int)status);
             return ToStatus(status);
         }
-
-        status = _session.RecvFaPacket(fa_packet);
-        if (status != PacketManager::SerialStatus::Ok)
+        SerialPacket response;
+        status = sender.Recv(response, timeout);
+        if (status != SerialStatus::Ok)
         {
-            LOG_ERROR(LOG_TAG, "Failed receiving fa packet (status %d)", (int)status);
             return ToStatus(status);
         }
-
-        return Status(fa_packet.GetStatusCode());
+        const bool echoed = response.header.id == MsgId::Ping &&
+                            ::memcmp(random_data, response.payload.message.data_msg.data, data_size) == 0;
+        return echoed ? Status::Ok : Status::Error;
     }
-    catch (std::exception& ex)
+    catch (const std::exception& ex)
     {
         LOG_EXCEPTION(LOG_TAG, ex);
         return Status::Error;
     }
-    catch (...)
-    {
-        LOG_ERROR(LOG_TAG, "Unknown exception");
-        return Status::Error;
-    }
 }
 
-Status FaceAuthenticatorImpl::SetDeviceConfig(const DeviceConfig& device_config)
+static const size_t CalibrationSmallPing = 16;
+static const int CalibrationRounds = 3;
+static const std::chrono::milliseconds CalibrationPingTimeout {1000};
+
+// Best of a few round trips of a ping size (the first of a burst may include the device waking up)
+static Status BestRoundTrip(const std::function<Status()>& ping, std::chrono::microseconds& best)
 {
-    DeviceConfig prev_device_config;
-    auto query_status = QueryDeviceConfig(prev_device_config);
-    if (query_status != Status::Ok)
+    best = std::chrono::microseconds::max();
+    for (int i = 0; i < CalibrationRounds; i++)
     {
-        LOG_ERROR(LOG_TAG, "QueryDeviceConfig failed");
-        return query_status;
+        const auto start = std::chrono::steady_clock::now();
+        auto status = ping();
+        if (status != Status::Ok)
+        {
+            return status;
+        }
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, std::chrono::duration_cast<std::chrono::microseconds>(elapsed));
     }
-   
-    auto status = _session.Start(_serial.get());
-    if (status != PacketManager::SerialStatus::Ok)
-    {
-        LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(status));
-        return ToStatus(status);
-    }
-    int size = sizeof(device_config);
+    return Status::Ok;
+}
 
-    char settings[5];
-    settings[0] = static_cast<char>(device_config.camera_rotation);
-    settings[1] = static_cast<char>(device_config.security_level);
-    settings[2] = static_cast<char>(device_config.algo_flow);
-    settings[3] = static_cast<char>(device_config.face_selection_policy);
-    settings[4] = static_cast<char>(device_config.preview_mode);
-    PacketManager::DataPacket data_packet {PacketManager::MsgId::SetDeviceConfig, settings, sizeof(settings)};
+// The small ping measures the per packet latency (mostly the driver's and adapter's buffering, which the low latency
+// mode cuts), the difference to the full ping the throughput. The read timeout is the first byte wait of a port read:
+// a couple of small round trips, at least 100ms (the VTIME unit) and at most the default. The write timeout allows
+// a full packet four times over.
+Status FaceAuthenticatorImpl::CalibrateLink()
+{
+    using namespace std::chrono;
+    const size_t full_size = sizeof(PacketManager::DataMessage::data);
+    auto small_ping = [this]() { return Ping(CalibrationPingTimeout, CalibrationSmallPing); };
+    auto full_ping = [this, full_size]() { return Ping(CalibrationPingTimeout, full_size); };
 
-    status = _session.SendPacket(data_packet);
-    if (status != PacketManager::SerialStatus::Ok)
+    SerialLinkProfile profile;
+    microseconds small_rtt, full_rtt;
+    auto status = BestRoundTrip(small_ping, small_rtt);
+    if (status != Status::Ok)
     {
-        LOG_ERROR(LOG_TAG, "Failed sending data packet (status %d)", (int)status);
+        return status;
     }
-
-    PacketManager::DataPacket data_packet_reply {PacketManager::MsgId::SetDeviceConfig};
-    status = _session.RecvDataPacket(data_packet_reply);
-    if (status != PacketManager::SerialStatus::Ok)
+    if (_serial->SetLowLatency(true))
     {
-        LOG_ERROR(LOG_TAG, "Failed receiving reply packet (status %d)", (int)status);
-        return ToStatus(status);
+        microseconds low_latency_rtt;
+        status = BestRoundTrip(small_ping, low_latency_rtt);
+        if (status != Status::Ok)
+        {
+            _serial->SetLowLatency(false);
+            return status;
+        }
+        profile.low_latency = low_latency_rtt * 10 <= small_rtt * 11;
+        if (profile.low_latency)
+        {
+            small_rtt = std::min(small_rtt, low_latency_rtt);
+        }
+        else
+        {
+            _serial->SetLowLatency(false);
+        }
     }
-
-    if (data_packet_reply.header.id != PacketManager::MsgId::SetDeviceConfig)
+    status = BestRoundTrip(full_ping, full_rtt);
+    if (status != Status::Ok)
     {
-        LOG_ERROR(LOG_TAG, "Unexpected msg id in reply (%c)", data_packet_reply.header.id);
-        return Status::Error;
+        return status;
     }
 
-    static_assert(sizeof(data_packet_reply.payload.message.data_msg.data) >= 5, "Invalid data message");
-    // make sure we succeeeded - the response shoud contain the same values that we sent
-
-    if (::memcmp(data_packet_reply.Data().data, settings, sizeof(settings)))
+    profile.calibrated = true;
+    profile.small_ping_us = static_cast<unsigned int>(small_rtt.count());
+    profile.full_ping_us = static_cast<unsigned int>(full_rtt.count());
+    if (full_rtt > small_rtt)
     {
-        LOG_ERROR(LOG_TAG, "Settings at device were not applied");
-        return Status::Error;
+        // each direction carries the size difference, so the round trip carries it twice
+        const auto bytes = 2 * static_cast<long long>(full_size - CalibrationSmallPing);
+        profile.bytes_per_second = static_cast<unsigned int>(bytes * 1000000 / (full_rtt - small_rtt).count());
     }
-    // convert internal status to api's serial status and return
-    return ToStatus(status);
+    const auto read_ms = (duration_cast<milliseconds>(small_rtt * 2).count() / 100 + 1) * 100;
+    profile.read_timeout_ms = static_cast<unsigned int>(std::min<long long>(std::max<long long>(read_ms, 100), 200));
+    profile.write_timeout_ms = static_cast<unsigned int>(duration_cast<milliseconds>(full_rtt * 2).count() + 50);
+    _link_profile = profile;
+    ApplyLinkProfile();
+    LOG_INFO(LOG_TAG, "Link calibrated: ping %u/%u us, %u bytes/s, low latency %d, read timeout %u ms",
+             profile.small_ping_us, profile.full_ping_us, profile.bytes_per_second,
+             static_cast<int>(profile.low_latency), profile.read_timeout_ms);
+    return Status::Ok;
 }
 
-Status FaceAuthenticatorImpl::QueryDeviceConfig(DeviceConfig& device_config)
+void FaceAuthenticatorImpl::ApplyLinkProfile()
 {
-    auto status = _session.Start(_serial.get());
-    if (status != PacketManager::SerialStatus::Ok)
+    if (!_link_profile.calibrated || !_serial)
     {
-        LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(status));
-        return ToStatus(status);
+        return;
     }
-    PacketManager::DataPacket data_packet {PacketManager::MsgId::QueryDeviceConfig, NULL, 0};
-    status = _session.SendPacket(data_packet);
-    if (status != PacketManager::SerialStatus::Ok)
+    if (_link_profile.low_latency && !_serial->SetLowLatency(true))
     {
-        LOG_ERROR(LOG_TAG, "Failed sending data packet (status %d)", (int)status);
+        _link_profile.low_latency = false;
     }
-
-    PacketManager::DataPacket data_packet_reply {PacketManager::MsgId::QueryDeviceConfig};
-    status = _session.RecvDataPacket(data_packet_reply);
-    if (status != PacketManager::SerialStatus::Ok)
+    if (!_serial->SetPortTimeouts(std::chrono::milliseconds {_link_profile.read_timeout_ms},
+                                  std::chrono::milliseconds {_link_profile.write_timeout_ms}))
     {
-        LOG_ERROR(LOG_TAG, "Failed receiving fa packet (status %d)", (int)status);
-        return ToStatus(status);
+        // the port keeps its defaults
+        _link_profile.read_timeout_ms = SerialLinkProfile {}.read_timeout_ms;
+        _link_profile.write_timeout_ms = SerialLinkProfile {}.write_timeout_ms;
     }
+}
 
-    if (data_packet_reply.header.id != PacketManager::MsgId::QueryDeviceConfig)
+// Reopen the serial port and check the device answers. In persistent session mode the session is started right
+// away, so the next operation finds it ready.
+Status FaceAuthenticatorImpl::Reconnect(const KeepAlivePolicy& policy)
+{
+    RSID_TRACE_SPAN("api", "Reconnect");
+    _session.Close();
+    if (!_reopen)
     {
-        LOG_ERROR(LOG_TAG, "Unexpected msg id in reply (%c)", data_packet_reply.header.id);
+        LOG_ERROR(LOG_TAG, "The connection cannot be reopened");
         return Status::Error;
     }
-
-    auto data_size = sizeof(data_packet_reply.payload.message.data_msg.data);
-    if (data_size < 5)
+    try
+    {
+        _serial.reset(); // the port may not be opened twice
+        _serial = _reopen();
+        ApplyLinkProfile();
+    }
+    catch (const std::exception& ex)
     {
+        LOG_EXCEPTION(LOG_TAG, ex);
         return Status::Error;
     }
-    device_config.camera_rotation = (DeviceConfig::CameraRotation)data_packet_reply.payload.message.data_msg.data[0];
-    device_config.security_level = (DeviceConfig::SecurityLevel)data_packet_reply.payload.message.data_msg.data[1];
-    device_config.algo_flow = (DeviceConfig::AlgoFlow)data_packet_reply.payload.message.data_msg.data[2];
-    device_config.face_selection_policy = (DeviceConfig::FaceSelectionPolicy)data_packet_reply.payload.message.data_msg.data[3];
-    device_config.preview_mode = (DeviceConfig::PreviewMode)data_packet_reply.payload.message.data_msg.data[4];
-
-    // convert internal status to api's serial status and return
-    return ToStatus(status);
+    _session.Prepare();
+    if (Ping(std::chrono::milliseconds {policy.ping_timeout_ms}) != Status::Ok)
+    {
+        LOG_ERROR(LOG_TAG, "Reconnected, but the device does not answer");
+        return Status::Error;
+    }
+    LOG_INFO(LOG_TAG, "Reconnected");
+    InvalidateQueryCache(); // the device may have restarted
+    ResetPackedSupport();
+    if (_persistent_session)
+    {
+        auto status = StartSession();
+        if (status != PacketManager::SerialStatus::Ok)
+        {
+            LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(status));
+            return ToStatus(status);
+        }
+    }
+    MarkActivity();
+    return Status::Ok;
 }
 
-Status FaceAuthenticatorImpl::QueryUserIds(char** user_ids, unsigned int& number_of_users)
+// Run attempts until canceled or until an attempt fails, waiting between them per the loop policy.
+// The attempts share one session: the first one starts it and the next ones resume it, so there is no session
+// handshake per attempt. The session is closed when the loop ends, unless in persistent session mode.
+Status FaceAuthenticatorImpl::RunAuthLoop(const std::function<Status(bool& face_found)>& attempt)
 {
-    unsigned int retrieved_user_count = 0;
-    constexpr unsigned int chunk_size = 5;
+    DeviceLock device_lock {_device_mutex};
+    _cancel_loop = false;
+    _loop_session = true;
+    unsigned int idle_count = 0;
+    auto status = Status::Ok;
+    do
+    {
+        bool face_found = false;
+        status = attempt(face_found);
+        if (status != Status::Ok || _cancel_loop)
+        {
+            break; // return from the loop on first error
+        }
+
+        AuthLoopWait(face_found, idle_count);
+    } while (!_cancel_loop);
 
-    if (user_ids == nullptr || number_of_users == 0)
+    _loop_session = false;
+    if (!_persistent_session)
     {
-        LOG_ERROR(LOG_TAG, "QueryUserIds: Got invalid params (nullptr or zero)");
-        number_of_users = 0;
-        return Status::Error;
+        _session.Close();
     }
+    return status;
+}
 
-    try
+
+// Perform authentication loop. Call user's callbacks in the process.
+// Wait for one of the following to happen:
+//      * We get 'reply' from device ('Y' , would happen if "cancel" command was sent).
+//      * Any non ok status from the session object(i.e. serial comm failed, or session timeout).
+//
+// Keep delay interval between requests:
+//      * 2100ms if no face was found or got error (or 1600ms in secure mode).
+//      * 600ms otherwise (or 100ms in secure mode).
+
+// Helper callback handler to deal with sleep intervals
+class AuthLoopCallback : public AuthenticationCallback
+{
+    bool _face_found = false;
+    AuthenticationCallback& _user_callback;
+
+public:
+    explicit AuthLoopCallback(AuthenticationCallback& user_callback) : _user_callback(user_callback)
     {
-        unsigned int arrived_users = 0;
+    }
 
-        for (unsigned int i = 0; i < number_of_users && retrieved_user_count < number_of_users; i += arrived_users)
+    void OnResult(const AuthenticateStatus status, const char* userId) override
+    {
+        if (status == AuthenticateStatus::NoFaceDetected || status == AuthenticateStatus::DeviceError ||
+            status == AuthenticateStatus::SerialError || status == AuthenticateStatus::Failure)
         {
-            LOG_DEBUG(LOG_TAG, "Get userids.  So far:%u", i);
-            auto status = _session.Start(_serial.get());
-            if (status != PacketManager::SerialStatus::Ok)
-            {
-                LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(status));
-                number_of_users = 0;
-                return ToStatus(status);
-            }
-            // retrieve next NUMBER_OF_USERS_TO_QUERY users
-            unsigned int settings[2];
-            settings[0] = retrieved_user_count;
-            settings[1] = chunk_size;
-
-            PacketManager::DataPacket query_users_packet {PacketManager::MsgId::GetUserIds, (char*)settings,
-                                                          sizeof(settings)};
-            status = _session.SendPacket(query_users_packet);
-            if (status != PacketManager::SerialStatus::Ok)
-            {
-                LOG_ERROR(LOG_TAG, "Failed sending data packet (status %d)", static_cast<int>(status));
-                number_of_users = 0;
-                return ToStatus(status);
-            }
+            _face_found = false;
+        }
+        else if (status == AuthenticateStatus::Success || status == AuthenticateStatus::Forbidden ||
+                 status == AuthenticateStatus::Spoof)
+        {
+            _face_found = true; // a face was there, even if the event filter dropped its FaceDetected
+        }
+        _user_callback.OnResult(status, userId);
+    }
 
-            PacketManager::DataPacket reply_packet {PacketManager::MsgId::GetUserIds};
-            status = _session.RecvDataPacket(reply_packet);
-            if (status != PacketManager::SerialStatus::Ok)
-            {
-                LOG_ERROR(LOG_TAG, "Failed receiving data packet (status %d)", static_cast<int>(status));
-                number_of_users = 0;
-                return ToStatus(status);
-            }
+    void OnHint(const AuthenticateStatus hint) override
+    {
+        _user_callback.OnHint(hint);
+    }
 
-            if (reply_packet.header.id != PacketManager::MsgId::GetUserIds)
-            {
-                LOG_ERROR(LOG_TAG, "Unexpected msg id in reply (%c)", reply_packet.header.id);
-                number_of_users = 0;
-                return Status::Error;
-            }
+    void OnFaceDetected(const FaceRect* faces, const size_t n_faces, const unsigned int ts) override
+    {
+        _face_found = n_faces > 0;
+        _user_callback.OnFaceDetected(faces, n_faces, ts);
+    }
 
-            // get number of users from the response
-            const char* data = reply_packet.Data().data;
-            ::memcpy(&arrived_users, data, sizeof(unsigned int));
-            if (arrived_users == 0)
-            {
-                break;
-            }
+    void OnTiming(const OperationTiming& timing) override
+    {
+        _user_callback.OnTiming(timing);
+    }
 
-            // extract user ids from the returned chunk. each user id is zero delimited c string.
-            for (size_t j = 0, cur_pos = sizeof(unsigned int); j < arrived_users; j++)
-            {
-                if (retrieved_user_count >= number_of_users)
-                {
-                    break;
-                }
-                char* target = user_ids[retrieved_user_count];
-                ::strncpy(target, &data[cur_pos], PacketManager::MaxUserIdSize);
-                target[PacketManager::MaxUserIdSize] = '\0';
-                cur_pos += ::strlen(target) + 1;
-                retrieved_user_count++;
-            }
-        }
+    bool face_found()
+    {
+        return _face_found;
+    }
+};
 
-        assert(retrieved_user_count <= number_of_users);
-        number_of_users = retrieved_user_count;
+Status FaceAuthenticatorImpl::AuthenticateLoop(AuthenticationCallback& callback)
+{
+    return RunAuthLoop([this, &callback](bool& face_found) {
+        AuthLoopCallback clbk_handler {callback};
+        auto status = Authenticate(clbk_handler);
+        face_found = clbk_handler.face_found();
+        return status;
+    });
+}
 
+Status FaceAuthenticatorImpl::Cancel()
+{
+    try
+    {
+        {
+            std::lock_guard<std::mutex> lock {_loop_mutex};
+            _cancel_loop = true;
+        }
+        _loop_cv.notify_all();
+        // Send cancel packet.
+        _session.Cancel();
         return Status::Ok;
     }
     catch (std::exception& ex)
     {
         LOG_EXCEPTION(LOG_TAG, ex);
-        number_of_users = 0;
         return Status::Error;
     }
     catch (...)
     {
         LOG_ERROR(LOG_TAG, "Unknown exception");
-        number_of_users = 0;
         return Status::Error;
     }
-}
+} // namespace RealSenseID
 
-Status FaceAuthenticatorImpl::QueryNumberOfUsers(unsigned int& number_of_users)
+Status FaceAuthenticatorImpl::RemoveUser(const char* user_id)
 {
+    RSID_TRACE_SPAN("api", "RemoveUser");
+    DeviceLock device_lock {_device_mutex};
     try
     {
-        auto status = _session.Start(_serial.get());
+        if (!ValidateUserId(user_id))
+        {
+            return Status::Error;
+        }
+        auto status = StartSession();
         if (status != PacketManager::SerialStatus::Ok)
         {
             LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(status));
-            number_of_users = 0;
             return ToStatus(status);
         }
-        PacketManager::DataPacket get_nusers_packet {PacketManager::MsgId::GetNumberOfUsers};
-        status = _session.SendPacket(get_nusers_packet);
+
+        PacketManager::FaPacket fa_packet {PacketManager::MsgId::RemoveUser, user_id, 0};
+        status = _session.SendPacket(fa_packet);
         if (status != PacketManager::SerialStatus::Ok)
         {
-            LOG_ERROR(LOG_TAG, "Failed sending data packet (status %d)", (int)status);
-            number_of_users = 0;
+            LOG_ERROR(LOG_TAG, "Failed sending fa packet (status %d)", (int)status);
             return ToStatus(status);
         }
 
-        status = _session.RecvDataPacket(get_nusers_packet);
+        status = _session.RecvFaPacket(fa_packet);
         if (status != PacketManager::SerialStatus::Ok)
         {
-            LOG_ERROR(LOG_TAG, "Failed receiving data packet (status %d)", (int)status);
-            number_of_users = 0;
+            LOG_ERROR(LOG_TAG, "Failed receiving fa packet (status %d)", (int)status);
             return ToStatus(status);
         }
 
-        if (get_nusers_packet.header.id != PacketManager::MsgId::GetNumberOfUsers)
+        auto remove_status = Status(fa_packet.GetStatusCode());
+        if (remove_status == Status::Ok)
         {
-            LOG_ERROR(LOG_TAG, "Unexpected msg id in reply (%c)", get_nusers_packet.header.id);
-            number_of_users = 0;
-            return Status::Error;
+            _users_journal.OnUserRemoved(user_id);
+            _number_of_users_cache.Invalidate();
         }
-
-        uint32_t serialized_n_users = 0;
-        ::memcpy(&serialized_n_users, &get_nusers_packet.payload.message.data_msg.data[0], sizeof(serialized_n_users));
-        number_of_users = static_cast<unsigned int>(serialized_n_users);
-
-        return Status::Ok;
+        return remove_status;
     }
     catch (std::exception& ex)
     {
         LOG_EXCEPTION(LOG_TAG, ex);
-        number_of_users = 0;
         return Status::Error;
     }
     catch (...)
     {
         LOG_ERROR(LOG_TAG, "Unknown exception");
-        number_of_users = 0;
         return Status::Error;
     }
 }
 
-Status FaceAuthenticatorImpl::Standby()
+Status FaceAuthenticatorImpl::RemoveAll()
 {
+    RSID_TRACE_SPAN("api", "RemoveAll");
+    DeviceLock device_lock {_device_mutex};
     try
     {
-        auto status = _session.Start(_serial.get());
+        auto status = StartSession();
         if (status != PacketManager::SerialStatus::Ok)
         {
             LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(status));
             return ToStatus(status);
         }
 
-        PacketManager::DataPacket packet {PacketManager::MsgId::StandBy};
-        status = _session.SendPacket(packet);
+        PacketManager::FaPacket fa_packet {PacketManager::MsgId::RemoveAllUsers};
+        status = _session.SendPacket(fa_packet);
         if (status != PacketManager::SerialStatus::Ok)
         {
-            LOG_ERROR(LOG_TAG, "Failed sending fa packet (status %d)", static_cast<int>(status));
+            LOG_ERROR(LOG_TAG, "Failed sending fa packet (status %d)", (int)status);
             return ToStatus(status);
         }
 
-        PacketManager::FaPacket fa_packet {PacketManager::MsgId::Reply};
         status = _session.RecvFaPacket(fa_packet);
         if (status != PacketManager::SerialStatus::Ok)
         {
-            LOG_ERROR(LOG_TAG, "Failed receiving fa packet (status %d)", static_cast<int>(status));
+            LOG_ERROR(LOG_TAG, "Failed receiving fa packet (status %d)", (int)status);
             return ToStatus(status);
         }
 
-        auto status_code = fa_packet.GetStatusCode();
-        return static_cast<Status>(status_code);
+        auto remove_status = Status(fa_packet.GetStatusCode());
+        if (remove_status == Status::Ok)
+        {
+            _users_journal.OnAllUsersRemoved();
+            _number_of_users_cache.Set(0);
+        }
+        return remove_status;
     }
     catch (std::exception& ex)
     {
@@ -920,574 +1299,2716 @@ Status FaceAuthenticatorImpl::Standby()
     }
 }
 
-// Do faceprints extraction using enrollment flow, on the device.
-// If faceprints extraction was successful, the device will send a MsgId::Result with a Success value,
-// then the host listens for a DataPacket which contains Faceprints from the device, and finally a MsgId::Reply to
+Status FaceAuthenticatorImpl::SetDeviceConfig(const DeviceConfig& device_config)
+{
+    RSID_TRACE_SPAN("api", "SetDeviceConfig");
+    DeviceLock device_lock {_device_mutex};
+    DeviceConfig prev_device_config;
+    auto query_status = QueryDeviceConfig(prev_device_config);
+    if (query_status != Status::Ok)
+    {
+        LOG_ERROR(LOG_TAG, "QueryDeviceConfig failed");
+        return query_status;
+    }
+    _device_config_cache.Invalidate();
+   
+    auto status = StartSession();
+    if (status != PacketManager::SerialStatus::Ok)
+    {
+        LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(status));
+        return ToStatus(status);
+    }
+    int size = sizeof(device_config);
+
+    char settings[5];
+    settings[0] = static_cast<char>(device_config.camera_rotation);
+    settings[1] = static_cast<char>(device_config.security_level);
+    settings[2] = static_cast<char>(device_config.algo_flow);
+    settings[3] = static_cast<char>(device_config.face_selection_policy);
+    settings[4] = static_cast<char>(device_config.preview_mode);
+    PacketManager::DataPacket data_packet {PacketManager::MsgId::SetDeviceConfig, settings, sizeof(settings)};
+
+    status = _session.SendPacket(data_packet);
+    if (status != PacketManager::SerialStatus::Ok)
+    {
+        LOG_ERROR(LOG_TAG, "Failed sending data packet (status %d)", (int)status);
+    }
+
+    PacketManager::DataPacket data_packet_reply {PacketManager::MsgId::SetDeviceConfig};
+    status = _session.RecvDataPacket(data_packet_reply);
+    if (status != PacketManager::SerialStatus::Ok)
+    {
+        LOG_ERROR(LOG_TAG, "Failed receiving reply packet (status %d)", (int)status);
+        return ToStatus(status);
+    }
+
+    if (data_packet_reply.header.id != PacketManager::MsgId::SetDeviceConfig)
+    {
+        LOG_ERROR(LOG_TAG, "Unexpected msg id in reply (%c)", data_packet_reply.header.id);
+        return Status::Error;
+    }
+
+    static_assert(sizeof(data_packet_reply.payload.message.data_msg.data) >= 5, "Invalid data message");
+    // make sure we succeeeded - the response shoud contain the same values that we sent
+
+    if (::memcmp(data_packet_reply.Data().data, settings, sizeof(settings)))
+    {
+        LOG_ERROR(LOG_TAG, "Settings at device were not applied");
+        return Status::Error;
+    }
+    _device_config_cache.Set(device_config);
+    // convert internal status to api's serial status and return
+    return ToStatus(status);
+}
+
+Status FaceAuthenticatorImpl::QueryDeviceConfig(DeviceConfig& device_config)
+{
+    DeviceLock device_lock {_device_mutex};
+    if (_device_config_cache.Get(device_config))
+    {
+        return Status::Ok;
+    }
+    RSID_TRACE_SPAN("api", "QueryDeviceConfig");
+    MetricsRegistry::ScopedLatency latency {MetricsOperation::QueryDeviceConfig};
+    auto status = StartSession();
+    if (status != PacketManager::SerialStatus::Ok)
+    {
+        LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(status));
+        return ToStatus(status);
+    }
+    PacketManager::DataPacket data_packet {PacketManager::MsgId::QueryDeviceConfig, NULL, 0};
+    status = _session.SendPacket(data_packet);
+    if (status != PacketManager::SerialStatus::Ok)
+    {
+        LOG_ERROR(LOG_TAG, "Failed sending data packet (status %d)", (int)status);
+    }
+
+    PacketManager::DataPacket data_packet_reply {PacketManager::MsgId::QueryDeviceConfig};
+    status = _session.RecvDataPacket(data_packet_reply);
+    if (status != PacketManager::SerialStatus::Ok)
+    {
+        LOG_ERROR(LOG_TAG, "Failed receiving fa packet (status %d)", (int)status);
+        return ToStatus(status);
+    }
+
+    if (data_packet_reply.header.id != PacketManager::MsgId::QueryDeviceConfig)
+    {
+        LOG_ERROR(LOG_TAG, "Unexpected msg id in reply (%c)", data_packet_reply.header.id);
+        return Status::Error;
+    }
+
+    auto data_size = sizeof(data_packet_reply.payload.message.data_msg.data);
+    if (data_size < 5)
+    {
+        return Status::Error;
+    }
+    device_config.camera_rotation = (DeviceConfig::CameraRotation)data_packet_reply.payload.message.data_msg.data[0];
+    device_config.security_level = (DeviceConfig::SecurityLevel)data_packet_reply.payload.message.data_msg.data[1];
+    device_config.algo_flow = (DeviceConfig::AlgoFlow)data_packet_reply.payload.message.data_msg.data[2];
+    device_config.face_selection_policy = (DeviceConfig::FaceSelectionPolicy)data_packet_reply.payload.message.data_msg.data[3];
+    device_config.preview_mode = (DeviceConfig::PreviewMode)data_packet_reply.payload.message.data_msg.data[4];
+    _device_config_cache.Set(device_config);
+
+    // convert internal status to api's serial status and return
+    return ToStatus(status);
+}
+
+namespace
+{
+// user id including the terminating null, FaceAuthenticator::MAX_USERID_LENGTH
+constexpr size_t UserIdBufferSize = PacketManager::MaxUserIdSize + 1;
+
+// copies each id to its entry of the caller's array
+class UserIdsToArray : public UserIdsCallback
+{
+public:
+    explicit UserIdsToArray(char** user_ids) : _user_ids {user_ids}
+    {
+    }
+
+    void OnUserId(const unsigned int user_index, const char* user_id) override
+    {
+        ::strncpy(_user_ids[user_index], user_id, UserIdBufferSize);
+    }
+
+private:
+    char** _user_ids;
+};
+
+// copies each id to its UserIdBufferSize bytes of the caller's buffer
+class UserIdsToBuffer : public UserIdsCallback
+{
+public:
+    explicit UserIdsToBuffer(char* user_ids) : _user_ids {user_ids}
+    {
+    }
+
+    void OnUserId(const unsigned int user_index, const char* user_id) override
+    {
+        ::strncpy(_user_ids + user_index * UserIdBufferSize, user_id, UserIdBufferSize);
+    }
+
+private:
+    char* _user_ids;
+};
+
+// appends each id to the caller's vector, in the order they arrive
+class UserIdsCollector : public UserIdsCallback
+{
+public:
+    explicit UserIdsCollector(std::vector<std::string>& user_ids) : _user_ids {user_ids}
+    {
+    }
+
+    void OnUserId(const unsigned int, const char* user_id) override
+    {
+        _user_ids.emplace_back(user_id);
+    }
+
+private:
+    std::vector<std::string>& _user_ids;
+};
+} // namespace
+
+Status FaceAuthenticatorImpl::QueryUserIds(char** user_ids, unsigned int& number_of_users)
+{
+    if (user_ids == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "QueryUserIds: Got invalid params (nullptr)");
+        number_of_users = 0;
+        return Status::Error;
+    }
+    UserIdsToArray callback {user_ids};
+    return QueryUserIds(callback, number_of_users);
+}
+
+Status FaceAuthenticatorImpl::QueryUserIdsToBuffer(char* user_ids, unsigned int& number_of_users)
+{
+    if (user_ids == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "QueryUserIds: Got invalid params (nullptr)");
+        number_of_users = 0;
+        return Status::Error;
+    }
+    UserIdsToBuffer callback {user_ids};
+    return QueryUserIds(callback, number_of_users);
+}
+
+Status FaceAuthenticatorImpl::QueryUserIds(UserIdsCallback& callback, unsigned int& number_of_users)
+{
+    return QueryUserIds(0, callback, number_of_users);
+}
+
+// Query the ids of the users at DB indices [first, first + number_of_users), handing the callback their DB indices
+Status FaceAuthenticatorImpl::QueryUserIds(unsigned int first, UserIdsCallback& callback, unsigned int& number_of_users)
+{
+    RSID_TRACE_SPAN("api", "QueryUserIds");
+    DeviceLock device_lock {_device_mutex};
+    MetricsRegistry::ScopedLatency latency {MetricsOperation::QueryUserIds};
+    unsigned int retrieved_user_count = 0;
+
+    if (number_of_users == 0)
+    {
+        LOG_ERROR(LOG_TAG, "QueryUserIds: Got invalid params (zero)");
+        number_of_users = 0;
+        return Status::Error;
+    }
+
+    try
+    {
+        unsigned int arrived_users = 0;
+
+        auto status = StartSession();
+        if (status != PacketManager::SerialStatus::Ok)
+        {
+            LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(status));
+            number_of_users = 0;
+            return ToStatus(status);
+        }
+
+        // as many ids as fit in a reply, assuming max length ids: count + zero delimited ids. in large packets if the
+        // session has them.
+        const size_t large_payload = _session.LargePayloadSize();
+        const size_t capacity = large_payload > 0 ? large_payload - sizeof(uint32_t)
+                                                  : sizeof(PacketManager::DataMessage::data);
+        const unsigned int chunk_size =
+            static_cast<unsigned int>((capacity - sizeof(unsigned int)) / (PacketManager::MaxUserIdSize + 1));
+
+        for (unsigned int i = 0; i < number_of_users && retrieved_user_count < number_of_users; i += arrived_users)
+        {
+            LOG_DEBUG(LOG_TAG, "Get userids.  So far:%u", i);
+            // retrieve next chunk_size users (or less if not needed)
+            unsigned int settings[2];
+            settings[0] = first + retrieved_user_count;
+            settings[1] = std::min(chunk_size, number_of_users - retrieved_user_count);
+
+            PacketManager::DataPacket reply_packet {PacketManager::MsgId::GetUserIds};
+            const char* data = reply_packet.Data().data;
+            size_t data_size = sizeof(reply_packet.Data().data);
+            PacketManager::MsgId reply_id;
+            if (large_payload > 0)
+            {
+                auto& packet = LargePacketBuffer();
+                packet.SetData(PacketManager::MsgId::GetUserIds, sizeof(settings));
+                ::memcpy(packet.Data(), settings, sizeof(settings));
+                status = _session.SendPacket(packet);
+                if (status == PacketManager::SerialStatus::Ok)
+                {
+                    status = _session.RecvPacket(packet);
+                }
+                data = packet.Data();
+                data_size = std::min(packet.DataSize(), PacketManager::MaxLargeDataSize);
+                reply_id = packet.header.id;
+            }
+            else
+            {
+                PacketManager::DataPacket query_users_packet {PacketManager::MsgId::GetUserIds, (char*)settings,
+                                                              sizeof(settings)};
+                status = _session.SendPacket(query_users_packet);
+                if (status == PacketManager::SerialStatus::Ok)
+                {
+                    status = _session.RecvDataPacket(reply_packet);
+                }
+                reply_id = reply_packet.header.id;
+            }
+            if (status != PacketManager::SerialStatus::Ok)
+            {
+                LOG_ERROR(LOG_TAG, "Failed querying user ids (status %d)", static_cast<int>(status));
+                number_of_users = 0;
+                return ToStatus(status);
+            }
+
+            if (reply_id != PacketManager::MsgId::GetUserIds || data_size < sizeof(unsigned int))
+            {
+                LOG_ERROR(LOG_TAG, "Unexpected msg id in reply (%c)", reply_id);
+                number_of_users = 0;
+                return Status::Error;
+            }
+
+            // get number of users from the response
+            ::memcpy(&arrived_users, data, sizeof(unsigned int));
+            if (arrived_users == 0)
+            {
+                break;
+            }
+
+            // extract user ids from the returned chunk. each user id is zero delimited c string.
+            for (size_t j = 0, cur_pos = sizeof(unsigned int); j < arrived_users; j++)
+            {
+                if (retrieved_user_count >= number_of_users || cur_pos >= data_size)
+                {
+                    break;
+                }
+                char user_id[UserIdBufferSize];
+                const size_t max_length = std::min(PacketManager::MaxUserIdSize, data_size - cur_pos);
+                ::strncpy(user_id, &data[cur_pos], max_length);
+                user_id[max_length] = '\0';
+                cur_pos += ::strlen(user_id) + 1;
+                callback.OnUserId(first + retrieved_user_count, user_id);
+                retrieved_user_count++;
+            }
+        }
+
+        assert(retrieved_user_count <= number_of_users);
+        number_of_users = retrieved_user_count;
+
+        return Status::Ok;
+    }
+    catch (std::exception& ex)
+    {
+        LOG_EXCEPTION(LOG_TAG, ex);
+        number_of_users = 0;
+        return Status::Error;
+    }
+    catch (...)
+    {
+        LOG_ERROR(LOG_TAG, "Unknown exception");
+        number_of_users = 0;
+        return Status::Error;
+    }
+}
+
+Status FaceAuthenticatorImpl::QueryNumberOfUsers(unsigned int& number_of_users)
+{
+    DeviceLock device_lock {_device_mutex};
+    if (_number_of_users_cache.Get(number_of_users))
+    {
+        return Status::Ok;
+    }
+    return ReadNumberOfUsers(number_of_users);
+}
+
+Status FaceAuthenticatorImpl::ReadNumberOfUsers(unsigned int& number_of_users)
+{
+    RSID_TRACE_SPAN("api", "QueryNumberOfUsers");
+    DeviceLock device_lock {_device_mutex};
+    MetricsRegistry::ScopedLatency latency {MetricsOperation::QueryNumberOfUsers};
+    try
+    {
+        auto status = StartSession();
+        if (status != PacketManager::SerialStatus::Ok)
+        {
+            LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(status));
+            number_of_users = 0;
+            return ToStatus(status);
+        }
+        PacketManager::DataPacket get_nusers_packet {PacketManager::MsgId::GetNumberOfUsers};
+        status = _session.SendPacket(get_nusers_packet);
+        if (status != PacketManager::SerialStatus::Ok)
+        {
+            LOG_ERROR(LOG_TAG, "Failed sending data packet (status %d)", (int)status);
+            number_of_users = 0;
+            return ToStatus(status);
+        }
+
+        status = _session.RecvDataPacket(get_nusers_packet);
+        if (status != PacketManager::SerialStatus::Ok)
+        {
+            LOG_ERROR(LOG_TAG, "Failed receiving data packet (status %d)", (int)status);
+            number_of_users = 0;
+            return ToStatus(status);
+        }
+
+        if (get_nusers_packet.header.id != PacketManager::MsgId::GetNumberOfUsers)
+        {
+            LOG_ERROR(LOG_TAG, "Unexpected msg id in reply (%c)", get_nusers_packet.header.id);
+            number_of_users = 0;
+            return Status::Error;
+        }
+
+        uint32_t serialized_n_users = 0;
+        ::memcpy(&serialized_n_users, &get_nusers_packet.payload.message.data_msg.data[0], sizeof(serialized_n_users));
+        number_of_users = static_cast<unsigned int>(serialized_n_users);
+        _number_of_users_cache.Set(number_of_users);
+
+        return Status::Ok;
+    }
+    catch (std::exception& ex)
+    {
+        LOG_EXCEPTION(LOG_TAG, ex);
+        number_of_users = 0;
+        return Status::Error;
+    }
+    catch (...)
+    {
+        LOG_ERROR(LOG_TAG, "Unknown exception");
+        number_of_users = 0;
+        return Status::Error;
+    }
+}
+
+Status FaceAuthenticatorImpl::Standby()
+{
+    RSID_TRACE_SPAN("api", "Standby");
+    DeviceLock device_lock {_device_mutex};
+    try
+    {
+        auto status = StartSession();
+        if (status != PacketManager::SerialStatus::Ok)
+        {
+            LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(status));
+            return ToStatus(status);
+        }
+
+        PacketManager::DataPacket packet {PacketManager::MsgId::StandBy};
+        status = _session.SendPacket(packet);
+        if (status != PacketManager::SerialStatus::Ok)
+        {
+            LOG_ERROR(LOG_TAG, "Failed sending fa packet (status %d)", static_cast<int>(status));
+            return ToStatus(status);
+        }
+
+        PacketManager::FaPacket fa_packet {PacketManager::MsgId::Reply};
+        status = _session.RecvFaPacket(fa_packet);
+        if (status != PacketManager::SerialStatus::Ok)
+        {
+            LOG_ERROR(LOG_TAG, "Failed receiving fa packet (status %d)", static_cast<int>(status));
+            return ToStatus(status);
+        }
+
+        auto status_code = fa_packet.GetStatusCode();
+        if (static_cast<Status>(status_code) == Status::Ok)
+        {
+            _standby_pending = false;
+        }
+        return static_cast<Status>(status_code);
+    }
+    catch (std::exception& ex)
+    {
+        LOG_EXCEPTION(LOG_TAG, ex);
+        return Status::Error;
+    }
+    catch (...)
+    {
+        LOG_ERROR(LOG_TAG, "Unknown exception");
+        return Status::Error;
+    }
+}
+
+// Do faceprints extraction using enrollment flow, on the device.
+// If faceprints extraction was successful, the device will send a MsgId::Result with a Success value,
+// then the host listens for a DataPacket which contains Faceprints from the device, and finally a MsgId::Reply to
 // complete the operation. Wait for one of the following to happen:
 //      We get 'reply' from device ('Y').
 //      Any non ok status from the session object(i.e. serial comm failed, or session timeout).
 //      Unexpected msg_id in the fa response.
-Status FaceAuthenticatorImpl::ExtractFaceprintsForEnroll(EnrollFaceprintsExtractionCallback& callback)
+// With a gallery, the duplicate check runs in the background from the arrival of the faceprints, while the device
+// ends the operation, and the result is delivered with the verdict when the device's reply arrives (or the session
+// fails meanwhile).
+Status FaceAuthenticatorImpl::ExtractFaceprintsForEnroll(HostGallery* gallery,
+                                                         EnrollFaceprintsExtractionCallback& callback)
+{
+    RSID_TRACE_SPAN("api", "ExtractFaceprintsForEnroll");
+    DeviceLock device_lock {_device_mutex};
+    // the result variant with the duplicate check, with a gallery. one result per operation: after a session timeout
+    // failure, the faceprints and reply that may still arrive are not reported as a success.
+    bool result_delivered = false;
+    auto on_result = [&](EnrollStatus status, const Faceprints* faceprints, const HostGalleryMatch* duplicate) {
+        if (result_delivered)
+        {
+            return;
+        }
+        result_delivered = true;
+        if (gallery != nullptr)
+        {
+            callback.OnResult(status, faceprints, duplicate);
+        }
+        else
+        {
+            callback.OnResult(status, faceprints);
+        }
+    };
+    Faceprints enrolled;
+    std::future<HostGalleryMatch> duplicate_check;
+    auto deliver_enrolled = [&] {
+        if (!duplicate_check.valid())
+        {
+            return;
+        }
+        HostGalleryMatch duplicate;
+        try
+        {
+            duplicate = duplicate_check.get();
+        }
+        catch (const std::exception& ex)
+        {
+            LOG_ERROR(LOG_TAG, "Duplicate check failed: %s", ex.what()); // the faceprints are delivered unchecked
+        }
+        on_result(EnrollStatus::Success, &enrolled, duplicate.result.success ? &duplicate : nullptr);
+    };
+    try
+    {
+        auto status = StartSession();
+        if (status != PacketManager::SerialStatus::Ok)
+        {
+            LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(status));
+            auto enroll_status = ToEnrollStatus(status);
+            callback.OnHint(enroll_status);
+            return ToStatus(status);
+        }
+
+        PacketManager::FaPacket fa_packet {PacketManager::MsgId::EnrollFaceprintsExtraction, nullptr, '0'};
+        status = _session.SendPacket(fa_packet);
+        if (status != PacketManager::SerialStatus::Ok)
+        {
+            LOG_ERROR(LOG_TAG, "Failed sending fa packet (status %d)", (int)status);
+            auto enroll_status = ToEnrollStatus(status);
+            callback.OnHint(enroll_status);
+            return ToStatus(status);
+        }
+
+        PacketManager::Timer session_timer {CommonValues::enroll_max_timeout};
+        EventGate gate {GetEventFilter()};
+
+        bool faceprints_extraction_completed_on_device = false, received_faceprints_in_host = false;
+        bool timed_out = false;
+        
+        // yossidan mask-detector :
+       
+        while (true)
+        {
+            if (!timed_out && session_timer.ReachedTimeout())
+            {
+                LOG_ERROR(LOG_TAG, "session timeout");
+                timed_out = true;
+                deliver_enrolled(); // the faceprints that already arrived
+                on_result(EnrollStatus::Failure, nullptr, nullptr);
+                Cancel();
+            }
+
+            if (faceprints_extraction_completed_on_device && !received_faceprints_in_host)
+            {
+                PacketManager::DataPacket data_packet(PacketManager::MsgId::Faceprints);
+                status = _session.RecvDataPacket(data_packet);
+                if (status != PacketManager::SerialStatus::Ok)
+                {
+                    LOG_ERROR(LOG_TAG, "Failed receiving data packet (status %d)", (int)status);
+                    auto enroll_status = ToEnrollStatus(status);
+                    callback.OnHint(enroll_status);
+                    return ToStatus(status);
+                }
+
+                auto msg_id = data_packet.header.id;
+
+                if (msg_id == PacketManager::MsgId::Faceprints)
+                {
+                    LOG_DEBUG(LOG_TAG, "Got faceprints from device!");
+                    SecureVersionDescriptor* desc =
+                        (SecureVersionDescriptor*)(data_packet.payload.message.data_msg.data);
+
+                    //  read the mask-detector indicator:
+                    feature_t hasMask = desc->adaptiveDescriptorWithoutMask[HAS_MASK_INDEX_IN_FEATURS_VECTOR];
+                    LOG_DEBUG(LOG_TAG, "Enrollment flow : hasMask = %d.", hasMask);
+
+                    Faceprints faceprints;
+
+                    faceprints.version = desc->version;
+
+                    // during enroll we update both the enroll and adaptive vectors.
+
+                    // TODO yossidan - handle with/without mask vectors properly (if/as needed).
+                    static_assert(sizeof(faceprints.adaptiveDescriptorWithoutMask) == sizeof(desc->adaptiveDescriptorWithoutMask), "adaptive faceprints (without mask) sizes does not match");
+                    ::memcpy(faceprints.adaptiveDescriptorWithoutMask, desc->adaptiveDescriptorWithoutMask, sizeof(desc->adaptiveDescriptorWithoutMask));
+
+                    static_assert(sizeof(faceprints.enrollmentDescriptor) == sizeof(desc->adaptiveDescriptorWithoutMask), "enrollment faceprints sizes does not match");
+                    ::memcpy(faceprints.enrollmentDescriptor, desc->adaptiveDescriptorWithoutMask, sizeof(desc->adaptiveDescriptorWithoutMask));
+                    
+                    // received enrollment faceprints must be without mask detection!
+                    // assert(hasMask == 0);
+
+                    received_faceprints_in_host = true;
+
+                    if (gallery != nullptr)
+                    {
+                        enrolled = faceprints;
+                        duplicate_check = std::async(std::launch::async,
+                                                     [gallery, &enrolled] { return gallery->FindUser(enrolled); });
+                    }
+                    else
+                    {
+                        on_result(EnrollStatus::Success, &faceprints, nullptr);
+                    }
+
+                    continue;
+                }
+                else
+                {
+                    LOG_ERROR(LOG_TAG, "Got unexpected message id when expecting faceprints to arrive: %c",
+                              (char)msg_id);
+
+                    return Status::Error;
+                }
+            }
+
+            status = _session.RecvPacket(fa_packet);
+            if (status != PacketManager::SerialStatus::Ok)
+            {
+                LOG_ERROR(LOG_TAG, "Failed receiving fa packet (status %d)", (int)status);
+                deliver_enrolled();
+                auto enroll_status = ToEnrollStatus(status);
+                callback.OnHint(enroll_status);
+                return Status::SerialError;
+            }
+
+            auto msg_id = fa_packet.header.id;
+
+            // handle face detected as data packet
+            if (msg_id == PacketManager::MsgId::FaceDetected)
+            {
+                if (!gate.Faces())
+                {
+                    continue;
+                }
+                unsigned int ts;
+                FaceRect faces[MAX_FACES];
+                auto n_faces = GetDetectedFaces(fa_packet, faces, ts);
+                LOG_INFO("ExtractFaceprintsForAuth", "OnFaceDetected %u faces ts=%d", static_cast<unsigned>(n_faces),
+                         ts);
+                callback.OnFaceDetected(faces, n_faces, ts);
+                continue; // continue to recv next messages
+            }
+
+            auto fa_status = fa_packet.GetStatusCode();
+
+            switch (msg_id)
+            {
+            case (PacketManager::MsgId::Reply):
+                deliver_enrolled();
+                return Status::Ok;
+
+            case (PacketManager::MsgId::Result):
+
+                if (EnrollStatus(fa_status) == EnrollStatus::Success)
+                {
+                    LOG_DEBUG(LOG_TAG, "Faceprints extraction succeeded on device, ready to receive faceprints in host ...");
+                    faceprints_extraction_completed_on_device = true;
+                }               
+                else
+                {
+                    on_result(EnrollStatus(fa_status), nullptr, nullptr);
+                }
+                break;
+
+            case (PacketManager::MsgId::Progress):
+                if (gate.Progress())
+                {
+                    callback.OnProgress((FacePose)fa_status);
+                }
+                break;
+
+            case (PacketManager::MsgId::Hint):
+                if (gate.Hint())
+                {
+                    callback.OnHint(EnrollStatus(fa_status));
+                }
+                break;
+
+            default:
+                deliver_enrolled();
+                on_result(EnrollStatus::DeviceError, nullptr, nullptr);
+                return Status::Error;
+            }
+        }
+    }
+    catch (std::exception& ex)
+    {
+        LOG_EXCEPTION(LOG_TAG, ex);
+        deliver_enrolled();
+        on_result(EnrollStatus::Failure, nullptr, nullptr);
+        return Status::Error;
+    }
+    catch (...)
+    {
+        LOG_ERROR(LOG_TAG, "Unknown exception");
+        deliver_enrolled();
+        on_result(EnrollStatus::Failure, nullptr, nullptr);
+        return Status::Error;
+    }
+}
+
+// Do faceprints extraction using authentication flow on the device. Call user's authenticate callbacks in the process.
+// Wait for one of the following to happen:
+//      We get 'reply' from device ('Y').
+//      Any non ok status from the session object(i.e. serial comm failed, or session timeout).
+//      Unexpected msg_id in the fa response.
+Status FaceAuthenticatorImpl::ExtractFaceprintsForAuth(AuthFaceprintsExtractionCallback& callback)
+{
+    RSID_TRACE_SPAN("api", "ExtractFaceprintsForAuth");
+    DeviceLock device_lock {_device_mutex};
+    const auto op_start = std::chrono::steady_clock::now();
+    OperationTiming timing;
+    try
+    {
+        auto status = StartSession();
+        timing.session_start_us = MetricsRegistry::ElapsedMicros(op_start);
+        if (status != PacketManager::SerialStatus::Ok)
+        {
+            LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(status));
+            auto auth_status = ToAuthStatus(status);
+            callback.OnResult(auth_status, nullptr);
+            return ToStatus(status);
+        }
+        PacketManager::FaPacket fa_packet {PacketManager::MsgId::AuthenticateFaceprintsExtraction};
+        auto send_start = std::chrono::steady_clock::now();
+        status = _session.SendPacket(fa_packet);
+        timing.request_send_us = MetricsRegistry::ElapsedMicros(send_start);
+        const auto sent = std::chrono::steady_clock::now();
+        auto result_time = sent;
+        if (status != PacketManager::SerialStatus::Ok)
+        {
+            LOG_ERROR(LOG_TAG, "Failed sending fa packet (status %d)", (int)status);
+            auto auth_status = ToAuthStatus(status);
+            callback.OnResult(auth_status, nullptr);
+            return ToStatus(status);
+        }
+        PacketManager::Timer session_timer {CommonValues::auth_max_timeout};
+        EventGate gate {GetEventFilter()};
+        bool faceprints_extraction_completed_on_device = false, received_faceprints_in_host = false;
+        while (true)
+        {
+            if (session_timer.ReachedTimeout())
+            {
+                LOG_ERROR(LOG_TAG, "session timeout");
+                callback.OnResult(AuthenticateStatus::Failure, nullptr);
+                Cancel();
+            }
+
+            if (faceprints_extraction_completed_on_device && !received_faceprints_in_host)
+            {
+                PacketManager::DataPacket data_packet(PacketManager::MsgId::Faceprints);
+                status = _session.RecvDataPacket(data_packet);
+                if (status != PacketManager::SerialStatus::Ok)
+                {
+                    LOG_ERROR(LOG_TAG, "Failed receiving data packet (status %d)", (int)status);
+                    auto auth_status = ToAuthStatus(status);
+                    callback.OnResult(auth_status, nullptr);
+                    return ToStatus(status);
+                }
+
+                auto msg_id = data_packet.header.id;
+                if (msg_id == PacketManager::MsgId::Faceprints)
+                {
+                    LOG_DEBUG(LOG_TAG, "Got faceprints from device!");
+                    SecureVersionDescriptor* received_desc =
+                        (SecureVersionDescriptor*)(data_packet.payload.message.data_msg.data);
+
+                    //  mask-detector indicator:
+                    // we allow authentication with mask, so just provid LOG msg here.
+                    feature_t hasMask = received_desc->adaptiveDescriptorWithoutMask[HAS_MASK_INDEX_IN_FEATURS_VECTOR];                    
+                    LOG_DEBUG(LOG_TAG, "Authentication flow : hasMask = %d.", hasMask);
+
+                    received_faceprints_in_host = true;
+                    timing.faceprints_transfer_us += MetricsRegistry::ElapsedMicros(result_time);
+
+                    Faceprints faceprints;
+
+                    faceprints.version = received_desc->version;
+                    static_assert(sizeof(faceprints.adaptiveDescriptorWithoutMask) ==
+                                      sizeof(received_desc->adaptiveDescriptorWithoutMask),
+                                  "adaptive faceprints (without mask) sizes does not match");
+                    ::memcpy(faceprints.adaptiveDescriptorWithoutMask, received_desc->adaptiveDescriptorWithoutMask,
+                             sizeof(faceprints.adaptiveDescriptorWithoutMask));
+
+                    callback.OnResult(AuthenticateStatus::Success, &faceprints);
+                    continue;
+                }
+                else
+                {
+                    LOG_ERROR(LOG_TAG, "Got unexpected message id when expecting faceprints to arrive: %c",
+                              (char)msg_id);
+                    return RealSenseID::Status::Error;
+                }
+            }
+
+            status = _session.RecvPacket(fa_packet);
+            if (status != PacketManager::SerialStatus::Ok)
+            {
+                LOG_ERROR(LOG_TAG, "Failed receiving fa packet (status %d)", (int)status);
+                auto auth_status = ToAuthStatus(status);
+                callback.OnHint(auth_status);
+                return Status::SerialError;
+            }
+
+            auto msg_id = fa_packet.header.id;
+
+            // handle face detected as data packet
+            if (msg_id == PacketManager::MsgId::FaceDetected)
+            {
+                if (timing.until_face_detected_us == 0)
+                {
+                    timing.until_face_detected_us = MetricsRegistry::ElapsedMicros(sent);
+                }
+                if (!gate.Faces())
+                {
+                    continue;
+                }
+                unsigned int ts;
+                FaceRect faces[MAX_FACES];
+                auto n_faces = GetDetectedFaces(fa_packet, faces, ts);
+                LOG_INFO("ExtractFaceprintsForAuth", "OnFaceDetected %u faces ts=%d", static_cast<unsigned>(n_faces),
+                         ts);
+                callback.OnFaceDetected(faces, n_faces, ts);
+                continue; // continue to recv next messages
+            }
+
+            auto fa_status = fa_packet.GetStatusCode();
+
+            switch (msg_id)
+            {
+            case (PacketManager::MsgId::Reply):
+                timing.total_us = MetricsRegistry::ElapsedMicros(op_start);
+                callback.OnTiming(timing);
+                return Status::Ok;
+
+            case (PacketManager::MsgId::Result): {
+                // with FaceSelectionPolicy::All a result (and faceprints) arrives per face: the first result counts
+                result_time = std::chrono::steady_clock::now();
+                if (timing.until_result_us == 0)
+                {
+                    timing.until_result_us = MetricsRegistry::ElapsedMicros(sent);
+                }
+                if (AuthenticateStatus(fa_status) == AuthenticateStatus::Success)
+                {
+                    LOG_DEBUG(LOG_TAG,
+                              "Faceprints extraction succeeded on device, ready to receive faceprints in host ...");
+                    faceprints_extraction_completed_on_device = true;
+                    received_faceprints_in_host = false;
+                }
+                else
+                    callback.OnResult(AuthenticateStatus(fa_status), nullptr);
+                break;
+            }
+
+            case (PacketManager::MsgId::Hint):
+                if (gate.Hint())
+                {
+                    callback.OnHint(AuthenticateStatus(fa_status));
+                }
+                break;
+
+            default:
+                callback.OnHint(AuthenticateStatus::DeviceError);
+                return RealSenseID::Status::Error;
+            }
+        }
+    }
+    catch (std::exception& ex)
+    {
+        LOG_EXCEPTION(LOG_TAG, ex);
+        callback.OnHint(AuthenticateStatus::Failure);
+        return Status::Error;
+    }
+    catch (...)
+    {
+        LOG_ERROR(LOG_TAG, "Unknown exception");
+        callback.OnResult(AuthenticateStatus::Failure, nullptr);
+        return Status::Error;
+    }
+}
+
+// Perform faceprints extraction loop. Call user's callbacks in the process.
+// Wait for one of the following to happen:
+//      * We get 'reply' from device ('Y' , would happen if "cancel" command was sent).
+//      * Any non ok status from the session object(i.e. serial comm failed, or session timeout).
+//
+// Keep delay interval between requests:
+//      * 2100ms if no face was found or got error (or 1600ms in secure mode).
+//      * 600ms otherwise (or 100ms in secure mode).
+
+// The results of a loop delivered on a worker (AuthLoopPolicy::pipelined_results). The faceprints are copied from the
+// receive buffer and handed over, so the loop's next request goes out while the user's callback handles them. One
+// result is in flight: the next one waits for it, which keeps the results in order and the copy stable.
+class PipelinedResults
+{
+    AuthFaceprintsExtractionCallback& _user_callback;
+    AuthenticateStatus _status = AuthenticateStatus::Failure;
+    Faceprints _faceprints;
+    bool _has_faceprints = false;
+    std::future<void> _in_flight;
+
+public:
+    explicit PipelinedResults(AuthFaceprintsExtractionCallback& user_callback) : _user_callback(user_callback)
+    {
+    }
+
+    void Deliver(const AuthenticateStatus status, const Faceprints* faceprints)
+    {
+        Wait();
+        _status = status;
+        _has_faceprints = faceprints != nullptr;
+        if (_has_faceprints)
+        {
+            _faceprints = *faceprints;
+        }
+        try
+        {
+            _in_flight = std::async(std::launch::async, [this] {
+                _user_callback.OnResult(_status, _has_faceprints ? &_faceprints : nullptr);
+            });
+        }
+        catch (const std::system_error& ex)
+        {
+            LOG_WARNING(LOG_TAG, "Result worker not started: %s", ex.what()); // delivered in place
+            _user_callback.OnResult(_status, _has_faceprints ? &_faceprints : nullptr);
+        }
+    }
+
+    // wait for the result in flight. throws what the user's callback threw
+    void Wait()
+    {
+        if (_in_flight.valid())
+        {
+            _in_flight.get();
+        }
+    }
+};
+
+// Helper callback handler to deal with sleep intervals
+class FaceprintsLoopCallback : public AuthFaceprintsExtractionCallback
+{
+    bool _face_found = false;
+    AuthFaceprintsExtractionCallback& _user_callback;
+    PipelinedResults* _pipeline;
+
+public:
+    // pipeline: deliver the results through it (nullptr - in place)
+    explicit FaceprintsLoopCallback(AuthFaceprintsExtractionCallback& user_callback,
+                                    PipelinedResults* pipeline = nullptr) :
+        _user_callback(user_callback),
+        _pipeline(pipeline)
+    {
+    }
+
+    void OnResult(const AuthenticateStatus status, const Faceprints* faceprints) override
+    {
+        if (status == AuthenticateStatus::NoFaceDetected || status == AuthenticateStatus::DeviceError ||
+            status == AuthenticateStatus::SerialError || status == AuthenticateStatus::Failure)
+        {
+            _face_found = false;
+        }
+        if (_pipeline != nullptr)
+        {
+            _pipeline->Deliver(status, faceprints);
+        }
+        else
+        {
+            _user_callback.OnResult(status, faceprints);
+        }
+    }
+
+    void OnHint(const AuthenticateStatus hint) override
+    {
+        _user_callback.OnHint(hint);
+    }
+
+    void OnFaceDetected(const FaceRect* faces, const size_t n_faces, const unsigned int ts) override
+    {
+        _face_found = n_faces > 0;
+        _user_callback.OnFaceDetected(faces, n_faces, ts);
+    }
+
+    void OnTiming(const OperationTiming& timing) override
+    {
+        _user_callback.OnTiming(timing);
+    }
+
+    bool face_found()
+    {
+        return _face_found;
+    }
+};
+
+Status FaceAuthenticatorImpl::ExtractFaceprintsForAuthLoop(AuthFaceprintsExtractionCallback& callback)
+{
+    PipelinedResults pipeline {callback};
+    PipelinedResults* results = GetAuthLoopPolicy().pipelined_results ? &pipeline : nullptr;
+    auto status = RunAuthLoop([this, &callback, results](bool& face_found) {
+        FaceprintsLoopCallback clbk_handler {callback, results};
+        auto status = ExtractFaceprintsForAuth(clbk_handler);
+        face_found = clbk_handler.face_found();
+        return status;
+    });
+
+    // the last result is delivered before the loop returns
+    try
+    {
+        pipeline.Wait();
+    }
+    catch (std::exception& ex)
+    {
+        LOG_EXCEPTION(LOG_TAG, ex);
+        return Status::Error;
+    }
+    catch (...)
+    {
+        LOG_ERROR(LOG_TAG, "Unknown exception");
+        return Status::Error;
+    }
+    return status;
+}
+
+// Helper callback handler collecting the faces and faceprints of a frame. With FaceSelectionPolicy::All the device
+// sends a result (and faceprints on success) for each of the detected faces, in their order.
+// The statuses and faceprints are MAX_FACES arrays of the caller (in the operation's arena).
+class GalleryAuthCollector : public AuthFaceprintsExtractionCallback
+{
+    GalleryBackend& _gallery;
+    GalleryAuthCallback& _user_callback;
+
+public:
+    GalleryAuthCollector(GalleryBackend& gallery, GalleryAuthCallback& user_callback, AuthenticateStatus* statuses,
+                         Faceprints* faceprints) :
+        _gallery(gallery),
+        _user_callback(user_callback), statuses(statuses), faceprints(faceprints)
+    {
+    }
+
+    void OnResult(const AuthenticateStatus status, const Faceprints* result_faceprints) override
+    {
+        if (n_results >= MAX_FACES)
+        {
+            LOG_ERROR(LOG_TAG, "Got more than %u results in a frame", MAX_FACES);
+            return;
+        }
+        bool has_faceprints = result_faceprints != nullptr;
+        statuses[n_results] = status == AuthenticateStatus::Success && !has_faceprints ? AuthenticateStatus::Failure
+                                                                                       : status;
+        if (has_faceprints)
+        {
+            faceprints[n_results] = *result_faceprints;
+        }
+        n_results++;
+    }
+
+    void OnHint(const AuthenticateStatus hint) override
+    {
+        _user_callback.OnHint(hint);
+    }
+
+    void OnFaceDetected(const FaceRect* detected_faces, const size_t n_detected,
+                        const unsigned int detected_ts) override
+    {
+        n_faces = std::min<size_t>(n_detected, MAX_FACES);
+        std::copy(detected_faces, detected_faces + n_faces, faces);
+        ts = detected_ts;
+        // warm the gallery while the device computes the faceprints
+        if (n_faces > 0 && !prefetch.valid())
+        {
+            GalleryBackend* gallery = &_gallery;
+            try
+            {
+                prefetch = std::async(std::launch::async, [gallery] { gallery->Prefetch(); });
+            }
+            catch (const std::system_error& ex)
+            {
+                LOG_WARNING(LOG_TAG, "Gallery prefetch not started: %s", ex.what()); // the match still works, cold
+            }
+        }
+        _user_callback.OnFaceDetected(faces, n_faces, ts);
+    }
+
+    void OnTiming(const OperationTiming& operation_timing) override
+    {
+        timing = operation_timing;
+        has_timing = true;
+    }
+
+    FaceRect faces[MAX_FACES];
+    size_t n_faces = 0;
+    unsigned int ts = 0;
+    AuthenticateStatus* statuses;
+    Faceprints* faceprints; // valid where statuses is Success
+    size_t n_results = 0;
+    std::future<void> prefetch;
+    OperationTiming timing; // of the extraction, valid if has_timing
+    bool has_timing = false;
+};
+
+Status FaceAuthenticatorImpl::AuthenticateWithGallery(GalleryBackend& gallery, GalleryAuthCallback& callback)
+{
+    RSID_TRACE_SPAN("api", "AuthenticateWithGallery");
+    // the frame's faceprints, matches and updated faceprints live in the arena until the results callback returns.
+    // the matching runs outside the device lock, so a call from another thread may hold the instance's arena: this
+    // one then takes an arena of its own.
+    std::unique_lock<std::mutex> arena_lock {_arena_mutex, std::try_to_lock};
+    std::unique_ptr<OperationArena> own_arena;
+    if (!arena_lock.owns_lock())
+    {
+        own_arena.reset(new OperationArena(OperationArenaSize));
+    }
+    OperationArena& arena = own_arena ? *own_arena : _arena;
+    OperationArena::Scope arena_scope {arena};
+    auto statuses = arena.New<AuthenticateStatus>(MAX_FACES);
+    auto faceprints = arena.New<Faceprints>(MAX_FACES);
+    auto matches = arena.New<HostGalleryMatch>(MAX_FACES);
+    auto updated_faceprints = arena.New<Faceprints>(MAX_FACES);
+    if (statuses == nullptr || faceprints == nullptr || matches == nullptr || updated_faceprints == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "AuthenticateWithGallery: Operation arena exhausted");
+        return Status::Error;
+    }
+
+    const auto op_start = std::chrono::steady_clock::now();
+    GalleryAuthCollector collector {gallery, callback, statuses, faceprints};
+    auto status = ExtractFaceprintsForAuth(collector);
+    if (collector.prefetch.valid())
+    {
+        collector.prefetch.wait();
+    }
+
+    // the faces with faceprints are matched in a single batch, their faceprints moved to the front (in place, a
+    // probe is never after its face)
+    const size_t n_results = collector.n_results;
+    size_t probe_indices[MAX_FACES];
+    size_t n_probes = 0;
+    for (size_t i = 0; i < n_results; i++)
+    {
+        if (statuses[i] == AuthenticateStatus::Success)
+        {
+            if (n_probes != i)
+            {
+                faceprints[n_probes] = faceprints[i];
+            }
+            probe_indices[n_probes++] = i;
+        }
+    }
+    const auto match_start = std::chrono::steady_clock::now();
+    if (n_probes > 0 && gallery.MatchBatch(faceprints, n_probes, matches, updated_faceprints) != Status::Ok)
+    {
+        LOG_ERROR(LOG_TAG, "AuthenticateWithGallery: Failed matching some of the faces");
+    }
+    collector.timing.host_match_us = n_probes > 0 ? MetricsRegistry::ElapsedMicros(match_start) : 0;
+
+    GalleryFaceResult results[MAX_FACES];
+    for (size_t i = 0; i < n_results; i++)
+    {
+        if (i < collector.n_faces)
+        {
+            results[i].face = collector.faces[i];
+        }
+        results[i].status = statuses[i];
+    }
+    for (size_t p = 0; p < n_probes; p++)
+    {
+        auto& result = results[probe_indices[p]];
+        result.match = matches[p];
+        result.updated_faceprints = matches[p].result.should_update ? &updated_faceprints[p] : nullptr;
+        LOG_INFO("AuthenticateWithGallery", "Face %zu: success=%d user_id=\"%s\"", probe_indices[p],
+                 static_cast<int>(matches[p].result.success), matches[p].user_id);
+    }
+    callback.OnResult(results, n_results, collector.ts);
+    if (collector.has_timing)
+    {
+        collector.timing.total_us = MetricsRegistry::ElapsedMicros(op_start);
+        callback.OnTiming(collector.timing);
+    }
+    return status;
+}
+
+MatchResultHost FaceAuthenticatorImpl::MatchFaceprints(Faceprints& new_faceprints, Faceprints& existing_faceprints,
+                                                       Faceprints& updated_faceprints)
+{
+    RSID_TRACE_SPAN("api", "MatchFaceprints");
+    MatchResultHost finalResult;
+
+    auto result = Matcher::MatchFaceprints(new_faceprints, existing_faceprints, updated_faceprints);
+    finalResult.success = result.success;
+    finalResult.should_update = result.should_update;
+    finalResult.score = result.score;
+    finalResult.confidence = result.confidence;
+
+    return finalResult;
+}
+
+// Validate given user id.
+// Return true if valid, false otherwise.
+bool FaceAuthenticatorImpl::ValidateUserId(const char* user_id)
+{
+    if (user_id == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Invalid user id: nullptr");
+        return false;
+    }
+
+    auto user_id_len = ::strlen(user_id);
+    bool is_valid = user_id_len > 0 && user_id_len <= PacketManager::MaxUserIdSize;
+    if (!is_valid)
+    {
+        LOG_ERROR(LOG_TAG, "Invalid user id length. Valid size: 1 - %zu", PacketManager::MaxUserIdSize);
+    }
+    return is_valid;
+}
+
+// copy the faceprints from a GetUserFeatures reply packet
+static void ToFaceprints(const PacketManager::DataPacket& packet, Faceprints& faceprints)
+{
+    const SecureVersionDescriptor* desc = (const SecureVersionDescriptor*)(packet.payload.message.data_msg.data);
+
+    faceprints.version = desc->version;
+    faceprints.featuresType = (FaceprintsTypeEnum)desc->faceprintsType;
+    faceprints.flags = desc->flags;
+
+    static_assert(sizeof(faceprints.adaptiveDescriptorWithoutMask) == sizeof(desc->adaptiveDescriptorWithoutMask),
+                  "adaptive faceprints sizes (without mask) does not match");
+    ::memcpy(faceprints.adaptiveDescriptorWithoutMask, desc->adaptiveDescriptorWithoutMask,
+             sizeof(desc->adaptiveDescriptorWithoutMask));
+
+    static_assert(sizeof(faceprints.adaptiveDescriptorWithMask) == sizeof(desc->adaptiveDescriptorWithMask),
+                  "adaptive faceprints sizes (with mask) does not match");
+    ::memcpy(faceprints.adaptiveDescriptorWithMask, desc->adaptiveDescriptorWithMask,
+             sizeof(desc->adaptiveDescriptorWithMask));
+
+    static_assert(sizeof(faceprints.enrollmentDescriptor) == sizeof(desc->enrollmentDescriptor),
+                  "enrollment faceprints sizes does not match");
+    ::memcpy(faceprints.enrollmentDescriptor, desc->enrollmentDescriptor, sizeof(desc->enrollmentDescriptor));
+}
+
+// the users range of a bulk request in a large packet (see PacketManager/LargePacket.h): 16 bit first index and
+// count, as every device takes them, or 32 bit ones past index 65535 (on a device with that many users)
+static void SetUsersRangeRequest(PacketManager::LargePacket& packet, PacketManager::MsgId id, unsigned int first,
+                                 unsigned int count)
+{
+    if (first + count <= 0xFFFF)
+    {
+        const uint16_t request[2] = {static_cast<uint16_t>(first), static_cast<uint16_t>(count)};
+        packet.SetData(id, sizeof(request));
+        ::memcpy(packet.Data(), request, sizeof(request));
+    }
+    else
+    {
+        // a zero 16 bit count marks the 32 bit range
+        const uint32_t request[3] = {0, first, count};
+        packet.SetData(id, sizeof(request));
+        ::memcpy(packet.Data(), request, sizeof(request));
+    }
+}
+
+// packed faceprints of a GetUserFeaturesPacked reply: their size (u16) and the packed bytes
+static bool ToFaceprintsPacked(const PacketManager::DataPacket& packet, Faceprints& faceprints)
+{
+    const auto* data = reinterpret_cast<const unsigned char*>(packet.payload.message.data_msg.data);
+    const size_t size = static_cast<size_t>(data[0] | (data[1] << 8));
+    if (size > sizeof(PacketManager::DataMessage::data) - 2)
+    {
+        return false;
+    }
+    return PacketManager::UnpackFaceprints(data + 2, size, faceprints);
+}
+
+bool FaceAuthenticatorImpl::OnPackedProbeReply(PacketManager::SerialStatus status,
+                                               const PacketManager::SerialPacket& reply,
+                                               PacketManager::MsgId packed_id)
+{
+    if (status == PacketManager::SerialStatus::RecvTimeout)
+    {
+        // a device that drops unknown messages: a late reply, if any, goes with the session
+        LOG_WARNING(LOG_TAG, "No reply to packed faceprints, using the full descriptors");
+        _packed_faceprints = PackedSupport::No;
+        _session.Close();
+        auto ignored = StartSession(); // a failure shows in the request sent again
+        (void)ignored;
+        return false;
+    }
+    if (status != PacketManager::SerialStatus::Ok && status != PacketManager::SerialStatus::RecvUnexpectedPacket)
+    {
+        return true;
+    }
+    if (status == PacketManager::SerialStatus::Ok && reply.header.id == packed_id)
+    {
+        _packed_faceprints = PackedSupport::Yes;
+        return true;
+    }
+    LOG_DEBUG(LOG_TAG, "Device does not support packed faceprints, using the full descriptors");
+    _packed_faceprints = PackedSupport::No;
+    return false;
+}
+
+void FaceAuthenticatorImpl::ResetPackedSupport()
+{
+    _packed_faceprints = _packed_transfers ? PackedSupport::Unknown : PackedSupport::No;
+    _user_records = _packed_transfers ? PackedSupport::Unknown : PackedSupport::No;
+}
+
+Status FaceAuthenticatorImpl::GetUsersFaceprints(Faceprints* user_features, unsigned int& num_of_users)
+{
+    DeviceLock device_lock {_device_mutex};
+    auto status = StartSession();
+    bool all_is_well = true;
+    PacketManager::SerialStatus bad_status = PacketManager::SerialStatus::Ok;
+    if (status != PacketManager::SerialStatus::Ok)
+    {
+        LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(status));
+        return ToStatus(status);
+    }
+    ReadNumberOfUsers(num_of_users);
+    for (uint32_t i = 0; i < num_of_users; i++)
+    {
+        try
+        {
+            PacketManager::DataPacket get_features_packet {PacketManager::MsgId::GetUserFeatures, (char*)&i, sizeof(i)};
+            status = _session.SendPacket(get_features_packet);
+            if (status != PacketManager::SerialStatus::Ok)
+            {
+                LOG_ERROR(LOG_TAG, "Failed sending data packet (status %d)", (int)status);
+                all_is_well = false;
+                bad_status = status;
+                continue;
+            }
+            PacketManager::DataPacket get_features_return_packet {PacketManager::MsgId::GetUserFeatures};
+            status = _session.RecvDataPacket(get_features_return_packet);
+            if (status != PacketManager::SerialStatus::Ok)
+            {
+                LOG_ERROR(LOG_TAG, "Failed receiving data packet (status %d)", (int)status);
+                all_is_well = false;
+                bad_status = status;
+                continue;
+            }
+            if (get_features_return_packet.header.id == PacketManager::MsgId::GetUserFeatures)
+            {
+                LOG_DEBUG(LOG_TAG, "Got faceprints from device!");
+                ToFaceprints(get_features_return_packet, user_features[i]);
+            }
+            else
+            {
+                LOG_ERROR(LOG_TAG, "Got unexpected message id when expecting faceprints to arrive: %c",
+                          (char)get_features_packet.header.id);
+                all_is_well = false;
+                bad_status = status;
+                continue;
+            }
+        }
+        catch (std::exception& ex)
+        {
+            LOG_EXCEPTION(LOG_TAG, ex);
+            all_is_well = false;
+            bad_status = status;
+            continue;
+        }
+        catch (...)
+        {
+            LOG_ERROR(LOG_TAG, "Unknown exception");
+            all_is_well = false;
+            bad_status = status;
+            continue;
+        }
+    }
+    return all_is_well ? Status::Ok : ToStatus(bad_status);
+}
+
+// Pipelined export: keep up to USER_FEATURES_PIPELINE_DEPTH GetUserFeatures requests outstanding, so the device
+// handles the next request while the host receives the previous reply. Replies arrive in request order.
+Status FaceAuthenticatorImpl::GetUsersFaceprints(FaceprintsExportCallback& callback, unsigned int& num_of_users)
+{
+    DeviceLock device_lock {_device_mutex};
+    unsigned int total_users = 0;
+    auto query_status = ReadNumberOfUsers(total_users);
+    num_of_users = 0;
+    if (query_status != Status::Ok)
+    {
+        return query_status;
+    }
+    return ExportUsersFaceprints(0, total_users, callback, num_of_users);
+}
+
+// Export the users at DB indices [first, first + count), counting them in num_of_users
+Status FaceAuthenticatorImpl::ExportUsersFaceprints(unsigned int first, unsigned int count,
+                                                    FaceprintsExportCallback& callback, unsigned int& num_of_users)
 {
+    DeviceLock device_lock {_device_mutex};
     try
     {
-        auto status = _session.Start(_serial.get());
-        if (status != PacketManager::SerialStatus::Ok)
+        std::vector<unsigned int> indices(count);
+        for (unsigned int i = 0; i < count; i++)
         {
-            LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(status));
-            auto enroll_status = ToEnrollStatus(status);
-            callback.OnHint(enroll_status);
-            return ToStatus(status);
+            indices[i] = first + i;
         }
+        return FetchUsersFaceprints(indices, [&](size_t i, const Faceprints& faceprints) {
+            callback.OnFaceprints(indices[i], faceprints);
+            num_of_users++;
+        });
+    }
+    catch (std::exception& ex)
+    {
+        LOG_EXCEPTION(LOG_TAG, ex);
+        _session.Close();
+        return Status::Error;
+    }
+    catch (...)
+    {
+        LOG_ERROR(LOG_TAG, "Unknown exception");
+        _session.Close();
+        return Status::Error;
+    }
+}
 
-        PacketManager::FaPacket fa_packet {PacketManager::MsgId::EnrollFaceprintsExtraction, nullptr, '0'};
-        status = _session.SendPacket(fa_packet);
-        if (status != PacketManager::SerialStatus::Ok)
+Status FaceAuthenticatorImpl::ExportUsers(UsersExportCallback& callback, unsigned int& num_of_users)
+{
+    DeviceLock device_lock {_device_mutex};
+    unsigned int total_users = 0;
+    auto status = ReadNumberOfUsers(total_users);
+    num_of_users = 0;
+    if (status != Status::Ok)
+    {
+        return status;
+    }
+    return ExportUsersRange(0, total_users, callback, num_of_users);
+}
+
+// A page of the users from the cursor on: the number of users is read first, so the last page ends the export even
+// if users were removed meanwhile. The users delivered are contiguous from the cursor, so it resumes past them.
+Status FaceAuthenticatorImpl::ExportUsers(UsersCursor& cursor, unsigned int page_size, UsersExportCallback& callback)
+{
+    return ExportPage(cursor, page_size, [&](unsigned int first, unsigned int count, unsigned int& exported) {
+        return ExportUsersRange(first, count, callback, exported);
+    });
+}
+
+Status FaceAuthenticatorImpl::GetUsersFaceprints(UsersCursor& cursor, unsigned int page_size,
+                                                 FaceprintsExportCallback& callback)
+{
+    return ExportPage(cursor, page_size, [&](unsigned int first, unsigned int count, unsigned int& exported) {
+        return ExportUsersFaceprints(first, count, callback, exported);
+    });
+}
+
+Status FaceAuthenticatorImpl::QueryUserIds(UsersCursor& cursor, unsigned int page_size, UserIdsCallback& callback)
+{
+    return ExportPage(cursor, page_size, [&](unsigned int first, unsigned int count, unsigned int& exported) {
+        exported = count;
+        return QueryUserIds(first, callback, exported);
+    });
+}
+
+Status FaceAuthenticatorImpl::ExportPage(
+    UsersCursor& cursor, unsigned int page_size,
+    const std::function<Status(unsigned int, unsigned int, unsigned int&)>& export_range)
+{
+    DeviceLock device_lock {_device_mutex};
+    if (page_size == 0)
+    {
+        LOG_ERROR(LOG_TAG, "Got invalid page size (zero)");
+        return Status::Error;
+    }
+    unsigned int total_users = 0;
+    auto status = ReadNumberOfUsers(total_users);
+    if (status != Status::Ok)
+    {
+        return status;
+    }
+    cursor.number_of_users = total_users;
+    if (cursor.next_index >= total_users)
+    {
+        cursor.done = true;
+        return Status::Ok;
+    }
+    const unsigned int count = std::min(page_size, total_users - cursor.next_index);
+    unsigned int exported = 0;
+    status = export_range(cursor.next_index, count, exported);
+    cursor.next_index += exported;
+    cursor.done = status == Status::Ok && cursor.next_index >= total_users;
+    return status;
+}
+
+// Export the ids and faceprints of the users at DB indices [first, first + count) together: GetUserRecordsPacked in
+// large packets, each request for the rest of the range and each reply with as many users as fit. A session without
+// large packets, or a device without the message, gets the ids first and then the faceprints by index (two passes).
+Status FaceAuthenticatorImpl::ExportUsersRange(unsigned int first, unsigned int count, UsersExportCallback& callback,
+                                               unsigned int& num_of_users)
+{
+    RSID_TRACE_SPAN("api", "ExportUsers");
+    try
+    {
+        Status status = Status::Ok;
+        if (count == 0)
         {
-            LOG_ERROR(LOG_TAG, "Failed sending fa packet (status %d)", (int)status);
-            auto enroll_status = ToEnrollStatus(status);
-            callback.OnHint(enroll_status);
-            return ToStatus(status);
+            return status;
+        }
+        auto serial_status = StartSession();
+        if (serial_status != PacketManager::SerialStatus::Ok)
+        {
+            LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(serial_status));
+            return ToStatus(serial_status);
+        }
+        if (_session.LargePayloadSize() > 0 && _user_records != PackedSupport::No)
+        {
+            bool supported = true;
+            status = ExportUsersLarge(first, count, callback, num_of_users, supported);
+            if (supported)
+            {
+                return status;
+            }
         }
 
-        PacketManager::Timer session_timer {CommonValues::enroll_max_timeout};
+        std::vector<std::string> user_ids;
+        UserIdsCollector ids_collector {user_ids};
+        unsigned int number_of_ids = count;
+        status = QueryUserIds(first, ids_collector, number_of_ids);
+        if (status != Status::Ok)
+        {
+            return status;
+        }
+        std::vector<unsigned int> indices(user_ids.size());
+        for (unsigned int i = 0; i < indices.size(); i++)
+        {
+            indices[i] = first + i;
+        }
+        return FetchUsersFaceprints(indices, [&](size_t i, const Faceprints& faceprints) {
+            callback.OnUser(indices[i], user_ids[i].c_str(), faceprints);
+            num_of_users++;
+        });
+    }
+    catch (std::exception& ex)
+    {
+        LOG_EXCEPTION(LOG_TAG, ex);
+        _session.Close();
+        return Status::Error;
+    }
+    catch (...)
+    {
+        LOG_ERROR(LOG_TAG, "Unknown exception");
+        _session.Close();
+        return Status::Error;
+    }
+}
 
-        bool faceprints_extraction_completed_on_device = false, received_faceprints_in_host = false;
-        
-        // yossidan mask-detector :
-       
-        while (true)
+Status FaceAuthenticatorImpl::ExportUsersLarge(unsigned int first, unsigned int count, UsersExportCallback& callback,
+                                               unsigned int& num_of_users, bool& supported)
+{
+    auto& packet = LargePacketBuffer();
+    Faceprints faceprints;
+    unsigned int received = 0;
+    while (received < count)
+    {
+        const unsigned int rest = count - received;
+        SetUsersRangeRequest(packet, PacketManager::MsgId::GetUserRecordsPacked, first + received, rest);
+        auto status = _session.SendPacket(packet);
+        if (status == PacketManager::SerialStatus::Ok)
         {
-            if (session_timer.ReachedTimeout())
+            status = _session.RecvPacket(packet);
+        }
+        if (status != PacketManager::SerialStatus::Ok)
+        {
+            LOG_ERROR(LOG_TAG, "Failed exporting users (status %d)", (int)status);
+            return ToStatus(status);
+        }
+        if (!packet.IsLarge() || packet.header.id != PacketManager::MsgId::GetUserRecordsPacked)
+        {
+            if (received == 0 && _user_records == PackedSupport::Unknown &&
+                packet.header.id == PacketManager::MsgId::Reply)
             {
-                LOG_ERROR(LOG_TAG, "session timeout");
-                callback.OnResult(EnrollStatus::Failure, nullptr);
-                Cancel();
+                LOG_DEBUG(LOG_TAG, "Device does not support user records, exporting the ids and faceprints apart");
+                _user_records = PackedSupport::No;
+                supported = false;
+                return Status::Error;
             }
+            LOG_ERROR(LOG_TAG, "Got unexpected message id when expecting users to arrive: %c",
+                      (char)packet.header.id);
+            _session.Close();
+            return Status::Error;
+        }
+        _user_records = PackedSupport::Yes;
 
-            if (faceprints_extraction_completed_on_device && !received_faceprints_in_host)
+        const auto* data = reinterpret_cast<const unsigned char*>(packet.Data());
+        const size_t data_size = packet.DataSize();
+        const size_t users = data_size >= PacketManager::LargeBatchHeaderSize ? (data[0] | (data[1] << 8)) : 0;
+        if (users == 0 || users > rest)
+        {
+            LOG_ERROR(LOG_TAG, "Got %zu users for %u requested", users, rest);
+            _session.Close();
+            return Status::Error;
+        }
+        size_t offset = PacketManager::LargeBatchHeaderSize;
+        for (size_t i = 0; i < users; i++)
+        {
+            // the zero terminated id, then the packed faceprints size and bytes
+            const char* user_id = reinterpret_cast<const char*>(data + offset);
+            const size_t id_size = offset < data_size ? ::strnlen(user_id, data_size - offset) + 1 : 0;
+            const size_t size_offset = offset + id_size;
+            const size_t packed_size = id_size > 0 && id_size <= PacketManager::MaxUserIdSize + 1 &&
+                                               size_offset + 2 <= data_size
+                                           ? (data[size_offset] | (data[size_offset + 1] << 8))
+                                           : 0;
+            if (packed_size == 0 || packed_size > data_size - size_offset - 2 ||
+                !PacketManager::UnpackFaceprints(data + size_offset + 2, packed_size, faceprints))
             {
-                PacketManager::DataPacket data_packet(PacketManager::MsgId::Faceprints);
-                status = _session.RecvDataPacket(data_packet);
-                if (status != PacketManager::SerialStatus::Ok)
-                {
-                    LOG_ERROR(LOG_TAG, "Failed receiving data packet (status %d)", (int)status);
-                    auto enroll_status = ToEnrollStatus(status);
-                    callback.OnHint(enroll_status);
-                    return ToStatus(status);
-                }
-
-                auto msg_id = data_packet.header.id;
-
-                if (msg_id == PacketManager::MsgId::Faceprints)
-                {
-                    LOG_DEBUG(LOG_TAG, "Got faceprints from device!");
-                    SecureVersionDescriptor* desc =
-                        (SecureVersionDescriptor*)(data_packet.payload.message.data_msg.data);
+                LOG_ERROR(LOG_TAG, "Got a malformed user record");
+                _session.Close();
+                return Status::Error;
+            }
+            offset = size_offset + 2 + packed_size;
+            callback.OnUser(first + received, user_id, faceprints);
+            received++;
+            num_of_users++;
+        }
+    }
+    return Status::Ok;
+}
 
-                    //  read the mask-detector indicator:
-                    feature_t hasMask = desc->adaptiveDescriptorWithoutMask[HAS_MASK_INDEX_IN_FEATURS_VECTOR];
-                    LOG_DEBUG(LOG_TAG, "Enrollment flow : hasMask = %d.", hasMask);
+// Get the faceprints of the users at the given DB indices, pipelined, in order.
+// Stop on the first error: later replies could no longer be matched to their requests.
+Status FaceAuthenticatorImpl::FetchUsersFaceprints(const std::vector<unsigned int>& indices,
+                                                   const std::function<void(size_t, const Faceprints&)>& on_faceprints)
+{
+    RSID_TRACE_SPAN("api", "FetchUsersFaceprints");
+    auto status = StartSession();
+    if (status != PacketManager::SerialStatus::Ok)
+    {
+        LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(status));
+        return ToStatus(status);
+    }
+    if (_session.LargePayloadSize() > 0 && _packed_faceprints != PackedSupport::No)
+    {
+        return FetchUsersFaceprintsLarge(indices, on_faceprints);
+    }
 
-                    Faceprints faceprints;
+    Faceprints faceprints;
+    const size_t count = indices.size();
+    size_t sent = 0, received = 0;
+    std::vector<PacketManager::SerialPacket> requests; // sent together, in a batch if the session has them
+    requests.reserve(USER_FEATURES_PIPELINE_DEPTH);
+    while (received < count)
+    {
+        const bool packed = _packed_faceprints != PackedSupport::No;
+        const auto request_id =
+            packed ? PacketManager::MsgId::GetUserFeaturesPacked : PacketManager::MsgId::GetUserFeatures;
+        // a single request until the device is known to handle packed ones
+        const size_t depth = _packed_faceprints == PackedSupport::Unknown ? 1 : USER_FEATURES_PIPELINE_DEPTH;
+        requests.clear();
+        while (sent + requests.size() < count && sent + requests.size() - received < depth)
+        {
+            uint32_t user_index = static_cast<uint32_t>(indices[sent + requests.size()]);
+            requests.push_back(PacketManager::DataPacket {request_id, (char*)&user_index, sizeof(user_index)});
+        }
+        status = _session.SendPackets(requests.data(), requests.size());
+        if (status != PacketManager::SerialStatus::Ok)
+        {
+            LOG_ERROR(LOG_TAG, "Failed sending data packet (status %d)", (int)status);
+            DrainReplies(static_cast<unsigned int>(sent - received));
+            return ToStatus(status);
+        }
+        sent += requests.size();
 
-                    faceprints.version = desc->version;
+        PacketManager::DataPacket reply {request_id};
+        status = _session.RecvDataPacket(reply);
+        if (packed && _packed_faceprints == PackedSupport::Unknown && !OnPackedProbeReply(status, reply, request_id))
+        {
+            sent = received; // request it again in full
+            continue;
+        }
+        if (status != PacketManager::SerialStatus::Ok)
+        {
+            LOG_ERROR(LOG_TAG, "Failed receiving data packet (status %d)", (int)status);
+            return ToStatus(status);
+        }
+        if (reply.header.id != request_id)
+        {
+            LOG_ERROR(LOG_TAG, "Got unexpected message id when expecting faceprints to arrive: %c",
+                      (char)reply.header.id);
+            DrainReplies(static_cast<unsigned int>(sent - received - 1));
+            _session.Close();
+            return Status::Error;
+        }
+        if (!packed)
+        {
+            ToFaceprints(reply, faceprints);
+        }
+        else if (!ToFaceprintsPacked(reply, faceprints))
+        {
+            LOG_ERROR(LOG_TAG, "Got malformed packed faceprints");
+            DrainReplies(static_cast<unsigned int>(sent - received - 1));
+            _session.Close();
+            return Status::Error;
+        }
+        on_faceprints(received, faceprints);
+        received++;
+    }
+    return Status::Ok;
+}
 
-                    // during enroll we update both the enroll and adaptive vectors.
+PacketManager::LargePacket& FaceAuthenticatorImpl::LargePacketBuffer()
+{
+    if (!_large_packet)
+    {
+        _large_packet = std::make_unique<PacketManager::LargePacket>();
+    }
+    return *_large_packet;
+}
 
-                    // TODO yossidan - handle with/without mask vectors properly (if/as needed).
-                    static_assert(sizeof(faceprints.adaptiveDescriptorWithoutMask) == sizeof(desc->adaptiveDescriptorWithoutMask), "adaptive faceprints (without mask) sizes does not match");
-                    ::memcpy(faceprints.adaptiveDescriptorWithoutMask, desc->adaptiveDescriptorWithoutMask, sizeof(desc->adaptiveDescriptorWithoutMask));
+// FetchUsersFaceprints() in large packets (see PacketManager/LargePacket.h): each request asks for a run of
+// consecutive indices, and the device answers with the packed faceprints of as many of them as fit. The next request
+// goes on from the last user received.
+Status FaceAuthenticatorImpl::FetchUsersFaceprintsLarge(
+    const std::vector<unsigned int>& indices, const std::function<void(size_t, const Faceprints&)>& on_faceprints)
+{
+    auto& packet = LargePacketBuffer();
+    Faceprints faceprints;
+    const size_t count = indices.size();
+    size_t received = 0;
+    while (received < count)
+    {
+        unsigned int run = 1;
+        while (received + run < count && indices[received + run] == indices[received] + run)
+        {
+            run++;
+        }
+        SetUsersRangeRequest(packet, PacketManager::MsgId::GetUserFeaturesPacked, indices[received], run);
+        auto status = _session.SendPacket(packet);
+        if (status == PacketManager::SerialStatus::Ok)
+        {
+            status = _session.RecvPacket(packet);
+        }
+        if (status != PacketManager::SerialStatus::Ok)
+        {
+            LOG_ERROR(LOG_TAG, "Failed fetching faceprints (status %d)", (int)status);
+            return ToStatus(status);
+        }
+        if (!packet.IsLarge() || packet.header.id != PacketManager::MsgId::GetUserFeaturesPacked)
+        {
+            LOG_ERROR(LOG_TAG, "Got unexpected message id when expecting faceprints to arrive: %c",
+                      (char)packet.header.id);
+            _session.Close();
+            return Status::Error;
+        }
 
-                    static_assert(sizeof(faceprints.enrollmentDescriptor) == sizeof(desc->adaptiveDescriptorWithoutMask), "enrollment faceprints sizes does not match");
-                    ::memcpy(faceprints.enrollmentDescriptor, desc->adaptiveDescriptorWithoutMask, sizeof(desc->adaptiveDescriptorWithoutMask));
-                    
-                    // received enrollment faceprints must be without mask detection!
-                    // assert(hasMask == 0);
+        const auto* data = reinterpret_cast<const unsigned char*>(packet.Data());
+        const size_t data_size = packet.DataSize();
+        const size_t users = data_size >= PacketManager::LargeBatchHeaderSize ? (data[0] | (data[1] << 8)) : 0;
+        if (users == 0 || users > run)
+        {
+            LOG_ERROR(LOG_TAG, "Got %zu faceprints for %u requested", users, run);
+            _session.Close();
+            return Status::Error;
+        }
+        size_t offset = PacketManager::LargeBatchHeaderSize;
+        for (size_t i = 0; i < users; i++)
+        {
+            const size_t packed_size = offset + 2 <= data_size ? (data[offset] | (data[offset + 1] << 8)) : 0;
+            offset += 2;
+            if (packed_size == 0 || packed_size > data_size - offset ||
+                !PacketManager::UnpackFaceprints(data + offset, packed_size, faceprints))
+            {
+                LOG_ERROR(LOG_TAG, "Got malformed packed faceprints");
+                _session.Close();
+                return Status::Error;
+            }
+            offset += packed_size;
+            on_faceprints(received, faceprints);
+            received++;
+        }
+    }
+    return Status::Ok;
+}
 
-                    received_faceprints_in_host = true;
+// Bulk enrollment from stored images (see PacketManager/EnrollImage.h). The images are prepared on a thread pool a
+// batch ahead of the upload, and up to MaxImagesInFlight of them are outstanding on the device, so image N + 1 is
+// uploaded while the device extracts image N. The first image is sent alone, until the device answered it: a device
+// without the message answers each of its chunks with an error Reply.
+// An image that fails the preparation gets its Failure result in order, without going to the device.
+Status FaceAuthenticatorImpl::ExtractFaceprintsFromImages(const StoredImage* images, unsigned int number_of_images,
+                                                          EnrollImagesCallback& callback)
+{
+    RSID_TRACE_SPAN("api", "ExtractFaceprintsFromImages");
+    DeviceLock device_lock {_device_mutex};
+    if (images == nullptr && number_of_images > 0)
+    {
+        LOG_ERROR(LOG_TAG, "Invalid images: nullptr");
+        return Status::Error;
+    }
+    try
+    {
+        auto status = StartSession();
+        if (status != PacketManager::SerialStatus::Ok)
+        {
+            LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(status));
+            return ToStatus(status);
+        }
 
-                    callback.OnResult(EnrollStatus::Success, &faceprints);
+        // two batches: one is uploaded while the next is prepared
+        MatcherThreadPool pool;
+        const size_t batch_size = std::max<size_t>(pool.NumberOfThreads() * 2, PacketManager::MaxImagesInFlight);
+        std::vector<PreparedJpeg> batches[2] = {std::vector<PreparedJpeg>(batch_size),
+                                                std::vector<PreparedJpeg>(batch_size)};
+        std::vector<char> prepared_ok[2] = {std::vector<char>(batch_size), std::vector<char>(batch_size)};
+        auto prepare = [&](size_t batch) {
+            const size_t first = batch * batch_size;
+            const size_t count = std::min<size_t>(batch_size, number_of_images - first);
+            pool.Run(count, [&](size_t i) {
+                const StoredImage& image = images[first + i];
+                PreparedJpeg& prepared = batches[batch % 2][i];
+                const bool ok = PrepareJpeg(image.buffer, image.size, prepared) &&
+                                prepared.data.size() <= PacketManager::MaxEnrollImageSize;
+                prepared_ok[batch % 2][i] = ok;
+            });
+        };
+        const size_t n_batches = (number_of_images + batch_size - 1) / batch_size;
+        std::future<void> preparing;
+        if (n_batches > 0)
+        {
+            prepare(0);
+        }
+        size_t uploading_batch = 0;
 
-                    continue;
+        struct InFlight
+        {
+            unsigned int index;
+            bool sent; // false if the image failed the preparation
+        };
+        InFlight in_flight[PacketManager::MaxImagesInFlight];
+        size_t n_in_flight = 0;
+        bool supported = false;
+        unsigned int sent = 0, received = 0;
+        Faceprints faceprints;
+        unsigned char chunk[sizeof(PacketManager::DataMessage::data)];
+        while (received < number_of_images)
+        {
+            const unsigned int depth = supported ? PacketManager::MaxImagesInFlight : 1;
+            while (sent < number_of_images && sent - received < depth)
+            {
+                const size_t batch = sent / batch_size;
+                if (batch != uploading_batch)
+                {
+                    preparing.get();
+                    uploading_batch = batch;
                 }
-                else
+                // the next batch goes to the buffers of the one uploaded before this, all sent by now
+                if (!preparing.valid() && batch + 1 < n_batches)
                 {
-                    LOG_ERROR(LOG_TAG, "Got unexpected message id when expecting faceprints to arrive: %c",
-                              (char)msg_id);
-
-                    return Status::Error;
+                    preparing = std::async(std::launch::async, prepare, batch + 1);
+                }
+                const size_t slot = sent % batch_size;
+                const PreparedJpeg& prepared = batches[batch % 2][slot];
+                const bool ok = prepared_ok[batch % 2][slot] != 0;
+                if (!ok)
+                {
+                    LOG_WARNING(LOG_TAG, "Image %u is not a valid JPEG up to %zu bytes", sent,
+                                PacketManager::MaxEnrollImageSize);
                 }
+                for (size_t offset = 0; ok && offset < prepared.data.size(); offset += PacketManager::MaxImageChunkSize)
+                {
+                    PacketManager::ImageChunkHeader header;
+                    header.tag = static_cast<uint16_t>(sent);
+                    header.image_size = static_cast<uint32_t>(prepared.data.size());
+                    header.offset = static_cast<uint32_t>(offset);
+                    header.orientation = prepared.orientation;
+                    PacketManager::WriteImageChunkHeader(header, chunk);
+                    const size_t chunk_size = std::min(PacketManager::MaxImageChunkSize, prepared.data.size() - offset);
+                    ::memcpy(chunk + PacketManager::ImageChunkHeaderSize, prepared.data.data() + offset, chunk_size);
+                    PacketManager::DataPacket request {PacketManager::MsgId::EnrollImage,
+                                                       reinterpret_cast<char*>(chunk),
+                                                       PacketManager::ImageChunkHeaderSize + chunk_size};
+                    status = _session.SendPacket(request);
+                    if (status != PacketManager::SerialStatus::Ok)
+                    {
+                        LOG_ERROR(LOG_TAG, "Failed sending image chunk (status %d)", (int)status);
+                        _session.Close();
+                        return ToStatus(status);
+                    }
+                }
+                in_flight[n_in_flight++] = {sent, ok};
+                sent++;
             }
 
-            status = _session.RecvPacket(fa_packet);
-            if (status != PacketManager::SerialStatus::Ok)
+            const InFlight image = in_flight[0];
+            std::copy(in_flight + 1, in_flight + n_in_flight, in_flight);
+            n_in_flight--;
+            received++;
+            if (!image.sent)
             {
-                LOG_ERROR(LOG_TAG, "Failed receiving fa packet (status %d)", (int)status);
-                auto enroll_status = ToEnrollStatus(status);
-                callback.OnHint(enroll_status);
-                return Status::SerialError;
+                callback.OnResult(image.index, EnrollStatus::Failure, nullptr);
+                continue;
             }
 
-            auto msg_id = fa_packet.header.id;
-
-            // handle face detected as data packet
-            if (msg_id == PacketManager::MsgId::FaceDetected)
+            PacketManager::DataPacket reply {PacketManager::MsgId::EnrollImage};
+            status = _session.RecvDataPacket(reply);
+            if (!supported && status == PacketManager::SerialStatus::RecvUnexpectedPacket)
             {
-                unsigned int ts;
-                auto faces = GetDetectedFaces(fa_packet, ts);
-                LOG_INFO("ExtractFaceprintsForAuth", "OnFaceDetected %u faces ts=%d", static_cast<unsigned>(faces.size()), ts);
-                callback.OnFaceDetected(faces, ts);
-                continue; // continue to recv next messages
+                LOG_ERROR(LOG_TAG, "Device does not support image enrollment");
+                _session.Close(); // the rest of the chunks are answered too
+                return Status::Error;
             }
-
-            auto fa_status = fa_packet.GetStatusCode();
-
-            switch (msg_id)
+            if (status != PacketManager::SerialStatus::Ok)
             {
-            case (PacketManager::MsgId::Reply):
-                return Status::Ok;
+                LOG_ERROR(LOG_TAG, "Failed receiving image result (status %d)", (int)status);
+                _session.Close();
+                return ToStatus(status);
+            }
+            const auto* data = reinterpret_cast<const unsigned char*>(reply.payload.message.data_msg.data);
+            const uint16_t tag = static_cast<uint16_t>(data[0] | (data[1] << 8));
+            const auto enroll_status = static_cast<EnrollStatus>(data[2]);
+            const size_t packed_size = static_cast<size_t>(data[3] | (data[4] << 8));
+            const bool has_faceprints = enroll_status == EnrollStatus::Success;
+            if (reply.header.id != PacketManager::MsgId::EnrollImage || tag != static_cast<uint16_t>(image.index) ||
+                (has_faceprints &&
+                 (packed_size > sizeof(PacketManager::DataMessage::data) - PacketManager::ImageResultHeaderSize ||
+                  !PacketManager::UnpackFaceprints(data + PacketManager::ImageResultHeaderSize, packed_size,
+                                                   faceprints))))
+            {
+                LOG_ERROR(LOG_TAG, "Got unexpected reply for image %u", image.index);
+                _session.Close();
+                return Status::Error;
+            }
+            supported = true;
+            callback.OnResult(image.index, enroll_status, has_faceprints ? &faceprints : nullptr);
+        }
+        return Status::Ok;
+    }
+    catch (std::exception& ex)
+    {
+        LOG_EXCEPTION(LOG_TAG, ex);
+        return Status::Error;
+    }
+    catch (...)
+    {
+        LOG_ERROR(LOG_TAG, "Unknown exception");
+        return Status::Error;
+    }
+}
 
-            case (PacketManager::MsgId::Result):
+unsigned int FaceAuthenticatorImpl::GetUsersRevision() const
+{
+    return _users_journal.Revision();
+}
 
-                if (EnrollStatus(fa_status) == EnrollStatus::Success)
-                {
-                    LOG_DEBUG(LOG_TAG, "Faceprints extraction succeeded on device, ready to receive faceprints in host ...");
-                    faceprints_extraction_completed_on_device = true;
-                }               
-                else
-                {
-                    callback.OnResult(EnrollStatus(fa_status), nullptr);
-                }
-                break;
+Status FaceAuthenticatorImpl::GetChangedUsersFaceprints(unsigned int since_revision, UsersChangesCallback& callback,
+                                                        unsigned int& revision)
+{
+    DeviceLock device_lock {_device_mutex};
+    try
+    {
+        std::vector<std::string> changed, removed;
+        bool all_removed = false;
+        if (!_users_journal.ChangesSince(since_revision, changed, removed, all_removed, revision))
+        {
+            LOG_ERROR(LOG_TAG, "No changes journal since revision %u (current %u), full sync needed", since_revision,
+                      revision);
+            return Status::Error;
+        }
 
-            case (PacketManager::MsgId::Progress):
-                callback.OnProgress((FacePose)fa_status);
-                break;
+        if (all_removed)
+        {
+            callback.OnAllUsersRemoved();
+        }
+        for (const auto& user_id : removed)
+        {
+            callback.OnUserRemoved(user_id.c_str());
+        }
+        if (changed.empty())
+        {
+            return Status::Ok;
+        }
 
-            case (PacketManager::MsgId::Hint):
-                callback.OnHint(EnrollStatus(fa_status));
-                break;
+        // GetUserFeatures is by DB index: find the index of each changed user
+        std::vector<std::string> user_ids;
+        auto status = QueryAllUserIds(user_ids);
+        if (status != Status::Ok)
+        {
+            return status;
+        }
 
-            default:
-                callback.OnResult(EnrollStatus::DeviceError, nullptr);
-                return Status::Error;
+        std::vector<unsigned int> indices;
+        std::vector<const std::string*> fetched_ids;
+        for (const auto& user_id : changed)
+        {
+            auto it = std::find(user_ids.begin(), user_ids.end(), user_id);
+            if (it == user_ids.end())
+            {
+                // removed meanwhile (e.g. by another host)
+                callback.OnUserRemoved(user_id.c_str());
+                continue;
             }
+            indices.push_back(static_cast<unsigned int>(it - user_ids.begin()));
+            fetched_ids.push_back(&user_id);
         }
+
+        return FetchUsersFaceprints(indices, [&](size_t i, const Faceprints& faceprints) {
+            callback.OnUserChanged(fetched_ids[i]->c_str(), faceprints);
+        });
     }
     catch (std::exception& ex)
     {
         LOG_EXCEPTION(LOG_TAG, ex);
-        callback.OnResult(EnrollStatus::Failure, nullptr);
+        _session.Close();
         return Status::Error;
     }
     catch (...)
     {
         LOG_ERROR(LOG_TAG, "Unknown exception");
-        callback.OnResult(EnrollStatus::Failure, nullptr);
+        _session.Close();
         return Status::Error;
     }
 }
 
-// Do faceprints extraction using authentication flow on the device. Call user's authenticate callbacks in the process.
-// Wait for one of the following to happen:
-//      We get 'reply' from device ('Y').
-//      Any non ok status from the session object(i.e. serial comm failed, or session timeout).
-//      Unexpected msg_id in the fa response.
-Status FaceAuthenticatorImpl::ExtractFaceprintsForAuth(AuthFaceprintsExtractionCallback& callback)
+Status FaceAuthenticatorImpl::QueryAllUserIds(std::vector<std::string>& user_ids)
+{
+    user_ids.clear();
+    unsigned int number_of_users = 0;
+    auto status = ReadNumberOfUsers(number_of_users);
+    if (status != Status::Ok || number_of_users == 0)
+    {
+        return status;
+    }
+    std::vector<char> buffer(number_of_users * (PacketManager::MaxUserIdSize + 1));
+    std::vector<char*> user_id_ptrs(number_of_users);
+    for (unsigned int i = 0; i < number_of_users; i++)
+    {
+        user_id_ptrs[i] = &buffer[i * (PacketManager::MaxUserIdSize + 1)];
+    }
+    status = QueryUserIds(user_id_ptrs.data(), number_of_users);
+    if (status != Status::Ok)
+    {
+        return status;
+    }
+    user_ids.assign(user_id_ptrs.begin(), user_id_ptrs.begin() + number_of_users);
+    return Status::Ok;
+}
+
+// Compare the checksum trees of the device's DB and of the gallery from the root down, a request per group of
+// sibling nodes, into the nodes whose digests differ only. Then list the users of the differing buckets on both
+// sides, and fetch the faceprints of the device users that the gallery lacks or has with another checksum.
+Status FaceAuthenticatorImpl::GetDifferingUsersFaceprints(const HostGallery& gallery, UsersChangesCallback& callback)
 {
+    RSID_TRACE_SPAN("api", "GetDifferingUsersFaceprints");
+    DeviceLock device_lock {_device_mutex};
     try
     {
-        auto status = _session.Start(_serial.get());
-        if (status != PacketManager::SerialStatus::Ok)
-        {
-            LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(status));
-            auto auth_status = ToAuthStatus(status);
-            callback.OnResult(auth_status, nullptr);
-            return ToStatus(status);
-        }
-        PacketManager::FaPacket fa_packet {PacketManager::MsgId::AuthenticateFaceprintsExtraction};
-        status = _session.SendPacket(fa_packet);
-        if (status != PacketManager::SerialStatus::Ok)
+        auto serial_status = StartSession();
+        if (serial_status != PacketManager::SerialStatus::Ok)
         {
-            LOG_ERROR(LOG_TAG, "Failed sending fa packet (status %d)", (int)status);
-            auto auth_status = ToAuthStatus(status);
-            callback.OnResult(auth_status, nullptr);
-            return ToStatus(status);
+            LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(serial_status));
+            return ToStatus(serial_status);
         }
-        PacketManager::Timer session_timer {CommonValues::auth_max_timeout};
-        bool faceprints_extraction_completed_on_device = false, received_faceprints_in_host = false;
-        while (true)
+
+        std::vector<unsigned int> differing; // differing nodes of the last level compared
+        for (unsigned int level = 0; level < PacketManager::ChecksumLevels; level++)
         {
-            if (session_timer.ReachedTimeout())
+            std::vector<unsigned int> groups; // first node of each group of siblings to compare
+            if (level == 0)
             {
-                LOG_ERROR(LOG_TAG, "session timeout");
-                callback.OnResult(AuthenticateStatus::Failure, nullptr);
-                Cancel();
+                groups.push_back(0);
             }
+            for (auto parent : differing)
+            {
+                groups.push_back(parent * static_cast<unsigned int>(PacketManager::ChecksumFanout));
+            }
+            const unsigned int group_size = level == 0 ? 1 : static_cast<unsigned int>(PacketManager::ChecksumFanout);
+            differing.clear();
 
-            if (faceprints_extraction_completed_on_device && !received_faceprints_in_host)
+            uint64_t device_digests[PacketManager::ChecksumFanout];
+            uint64_t host_digests[PacketManager::ChecksumFanout];
+            for (auto first_node : groups)
             {
-                PacketManager::DataPacket data_packet(PacketManager::MsgId::Faceprints);
-                status = _session.RecvDataPacket(data_packet);
-                if (status != PacketManager::SerialStatus::Ok)
+                bool supported = true;
+                auto status = QueryChecksums(level, first_node, group_size, device_digests, supported);
+                if (!supported)
                 {
-                    LOG_ERROR(LOG_TAG, "Failed receiving data packet (status %d)", (int)status);
-                    auto auth_status = ToAuthStatus(status);
-                    callback.OnResult(auth_status, nullptr);
-                    return ToStatus(status);
+                    LOG_DEBUG(LOG_TAG, "Device does not support the users checksums, comparing all users");
+                    return CompareAllUsers(gallery, callback);
                 }
-
-                auto msg_id = data_packet.header.id;
-                if (msg_id == PacketManager::MsgId::Faceprints)
+                if (status != Status::Ok)
                 {
-                    LOG_DEBUG(LOG_TAG, "Got faceprints from device!");
-                    SecureVersionDescriptor* received_desc =
-                        (SecureVersionDescriptor*)(data_packet.payload.message.data_msg.data);
-
-                    //  mask-detector indicator:
-                    // we allow authentication with mask, so just provid LOG msg here.
-                    feature_t hasMask = received_desc->adaptiveDescriptorWithoutMask[HAS_MASK_INDEX_IN_FEATURS_VECTOR];                    
-                    LOG_DEBUG(LOG_TAG, "Authentication flow : hasMask = %d.", hasMask);
-
-                    received_faceprints_in_host = true;
-
-                    Faceprints faceprints;
-
-                    faceprints.version = received_desc->version;
-                    static_assert(sizeof(faceprints.adaptiveDescriptorWithoutMask) ==
-                                      sizeof(received_desc->adaptiveDescriptorWithoutMask),
-                                  "adaptive faceprints (without mask) sizes does not match");
-                    ::memcpy(faceprints.adaptiveDescriptorWithoutMask, received_desc->adaptiveDescriptorWithoutMask,
-                             sizeof(faceprints.adaptiveDescriptorWithoutMask));
-
-                    callback.OnResult(AuthenticateStatus::Success, &faceprints);
-                    continue;
+                    return status;
                 }
-                else
+                status = gallery.GetChecksums(level, first_node, group_size, host_digests);
+                if (status != Status::Ok)
                 {
-                    LOG_ERROR(LOG_TAG, "Got unexpected message id when expecting faceprints to arrive: %c",
-                              (char)msg_id);
-                    return RealSenseID::Status::Error;
+                    return status;
+                }
+                for (unsigned int i = 0; i < group_size; i++)
+                {
+                    if (device_digests[i] != host_digests[i])
+                    {
+                        differing.push_back(first_node + i);
+                    }
                 }
             }
-
-            status = _session.RecvPacket(fa_packet);
-            if (status != PacketManager::SerialStatus::Ok)
+            if (differing.empty())
             {
-                LOG_ERROR(LOG_TAG, "Failed receiving fa packet (status %d)", (int)status);
-                auto auth_status = ToAuthStatus(status);
-                callback.OnHint(auth_status);
-                return Status::SerialError;
+                return Status::Ok;
             }
+        }
 
-            auto msg_id = fa_packet.header.id;
-
-            // handle face detected as data packet
-            if (msg_id == PacketManager::MsgId::FaceDetected)
+        std::vector<unsigned int> indices;
+        std::vector<std::string> fetched_ids;
+        std::vector<HostGalleryUserChecksum> host_users;
+        std::vector<PacketManager::BucketUser> device_users;
+        for (auto bucket : differing)
+        {
+            auto status = QueryBucketUsers(bucket, device_users);
+            if (status != Status::Ok)
             {
-                unsigned int ts;
-                auto faces = GetDetectedFaces(fa_packet, ts);
-                LOG_INFO("ExtractFaceprintsForAuth", "OnFaceDetected %u faces ts=%d", static_cast<unsigned>(faces.size()), ts);
-                callback.OnFaceDetected(faces, ts);
-                continue; // continue to recv next messages
+                return status;
             }
+            size_t number_of_host_users = 0;
+            gallery.GetBucketChecksums(bucket, nullptr, 0, number_of_host_users);
+            host_users.resize(number_of_host_users);
+            gallery.GetBucketChecksums(bucket, host_users.data(), host_users.size(), number_of_host_users);
+            host_users.resize(std::min(host_users.size(), number_of_host_users)); // changed meanwhile
 
-            auto fa_status = fa_packet.GetStatusCode();
-
-            switch (msg_id)
+            for (const auto& host_user : host_users)
             {
-            case (PacketManager::MsgId::Reply):
-                return Status::Ok;
-
-            case (PacketManager::MsgId::Result): {
-                if (AuthenticateStatus(fa_status) == AuthenticateStatus::Success)
+                auto it = std::find_if(device_users.begin(), device_users.end(),
+                                       [&](const PacketManager::BucketUser& user) {
+                                           return ::strcmp(user.user_id, host_user.user_id) == 0;
+                                       });
+                if (it == device_users.end())
                 {
-                    LOG_DEBUG(LOG_TAG,
-                              "Faceprints extraction succeeded on device, ready to receive faceprints in host ...");
-                    faceprints_extraction_completed_on_device = true;
-                    received_faceprints_in_host = false;
+                    callback.OnUserRemoved(host_user.user_id);
                 }
-                else
-                    callback.OnResult(AuthenticateStatus(fa_status), nullptr);
-                break;
             }
-
-            case (PacketManager::MsgId::Hint):
-                callback.OnHint(AuthenticateStatus(fa_status));
-                break;
-
-            default:
-                callback.OnHint(AuthenticateStatus::DeviceError);
-                return RealSenseID::Status::Error;
+            for (const auto& device_user : device_users)
+            {
+                auto it = std::find_if(host_users.begin(), host_users.end(), [&](const HostGalleryUserChecksum& user) {
+                    return ::strcmp(user.user_id, device_user.user_id) == 0;
+                });
+                if (it == host_users.end() || it->checksum != device_user.checksum)
+                {
+                    indices.push_back(device_user.index);
+                    fetched_ids.push_back(device_user.user_id);
+                }
             }
         }
+        if (indices.empty())
+        {
+            return Status::Ok;
+        }
+
+        return FetchUsersFaceprints(indices, [&](size_t i, const Faceprints& faceprints) {
+            callback.OnUserChanged(fetched_ids[i].c_str(), faceprints);
+        });
     }
     catch (std::exception& ex)
     {
         LOG_EXCEPTION(LOG_TAG, ex);
-        callback.OnHint(AuthenticateStatus::Failure);
+        _session.Close();
         return Status::Error;
     }
     catch (...)
     {
         LOG_ERROR(LOG_TAG, "Unknown exception");
-        callback.OnResult(AuthenticateStatus::Failure, nullptr);
+        _session.Close();
         return Status::Error;
     }
 }
 
-// Perform faceprints extraction loop. Call user's callbacks in the process.
-// Wait for one of the following to happen:
-//      * We get 'reply' from device ('Y' , would happen if "cancel" command was sent).
-//      * Any non ok status from the session object(i.e. serial comm failed, or session timeout).
-//
-// Keep delay interval between requests:
-//      * 2100ms if no face was found or got error (or 1600ms in secure mode).
-//      * 600ms otherwise (or 100ms in secure mode).
-
-// Helper callback handler to deal with sleep intervals
-class FaceprintsLoopCallback : public AuthFaceprintsExtractionCallback
+// request: level (u8), first node (u16), number of nodes (u16). reply: the digests
+Status FaceAuthenticatorImpl::QueryChecksums(unsigned int level, unsigned int first_node, unsigned int number_of_nodes,
+                                             uint64_t* digests, bool& supported)
 {
-    bool _face_found = false;
-    AuthFaceprintsExtractionCallback& _user_callback;
+    supported = true;
+    char request[5];
+    request[0] = static_cast<char>(level);
+    const uint16_t first = static_cast<uint16_t>(first_node);
+    const uint16_t count = static_cast<uint16_t>(number_of_nodes);
+    ::memcpy(request + 1, &first, sizeof(first));
+    ::memcpy(request + 3, &count, sizeof(count));
+    PacketManager::DataPacket packet {PacketManager::MsgId::GetUsersChecksums, request, sizeof(request)};
+    auto status = _session.SendPacket(packet);
+    if (status != PacketManager::SerialStatus::Ok)
+    {
+        LOG_ERROR(LOG_TAG, "Failed sending data packet (status %d)", (int)status);
+        return ToStatus(status);
+    }
 
-public:
-    explicit FaceprintsLoopCallback(AuthFaceprintsExtractionCallback& user_callback) : _user_callback(user_callback)
+    PacketManager::DataPacket reply {PacketManager::MsgId::GetUsersChecksums};
+    status = _session.RecvDataPacket(reply);
+    if (status == PacketManager::SerialStatus::RecvTimeout)
+    {
+        // a device that drops unknown messages: a late reply, if any, goes with the session
+        LOG_WARNING(LOG_TAG, "No reply to users checksums");
+        supported = false;
+        _session.Close();
+        auto ignored = StartSession(); // a failure shows in the full comparison
+        (void)ignored;
+        return Status::Error;
+    }
+    if (status == PacketManager::SerialStatus::RecvUnexpectedPacket ||
+        (status == PacketManager::SerialStatus::Ok && reply.header.id != PacketManager::MsgId::GetUsersChecksums))
+    {
+        supported = false;
+        return Status::Error;
+    }
+    if (status != PacketManager::SerialStatus::Ok)
     {
+        LOG_ERROR(LOG_TAG, "Failed receiving data packet (status %d)", (int)status);
+        return ToStatus(status);
     }
+    // the received bytes only, the digests past them are zeros (as the untransmitted payload is)
+    const size_t digests_size = number_of_nodes * sizeof(uint64_t);
+    const size_t received = reply.header.payload_size > sizeof(reply.payload.sequence_number)
+                                ? reply.header.payload_size - sizeof(reply.payload.sequence_number)
+                                : 0;
+    const size_t copied = std::min({digests_size, received, sizeof(reply.payload.message.data_msg.data)});
+    ::memcpy(digests, reply.payload.message.data_msg.data, copied);
+    ::memset(reinterpret_cast<char*>(digests) + copied, 0, digests_size - copied);
+    return Status::Ok;
+}
 
-    void OnResult(const AuthenticateStatus status, const Faceprints* faceprints) override
+// request: level ChecksumLevels (u8), bucket (u16), first user (u16). reply: users in the bucket (u16), users in the
+// reply (u16) and the users. requested until all the bucket's users arrived.
+Status FaceAuthenticatorImpl::QueryBucketUsers(unsigned int bucket, std::vector<PacketManager::BucketUser>& users)
+{
+    users.clear();
+    uint16_t total = 0;
+    do
     {
-        if (status == AuthenticateStatus::NoFaceDetected || status == AuthenticateStatus::DeviceError ||
-            status == AuthenticateStatus::SerialError || status == AuthenticateStatus::Failure)
+        char request[5];
+        request[0] = static_cast<char>(PacketManager::ChecksumLevels);
+        const uint16_t bucket_index = static_cast<uint16_t>(bucket);
+        const uint16_t first = static_cast<uint16_t>(users.size());
+        ::memcpy(request + 1, &bucket_index, sizeof(bucket_index));
+        ::memcpy(request + 3, &first, sizeof(first));
+        PacketManager::DataPacket packet {PacketManager::MsgId::GetUsersChecksums, request, sizeof(request)};
+        auto status = _session.SendPacket(packet);
+        if (status != PacketManager::SerialStatus::Ok)
+        {
+            LOG_ERROR(LOG_TAG, "Failed sending data packet (status %d)", (int)status);
+            return ToStatus(status);
+        }
+
+        PacketManager::DataPacket reply {PacketManager::MsgId::GetUsersChecksums};
+        status = _session.RecvDataPacket(reply);
+        if (status != PacketManager::SerialStatus::Ok)
+        {
+            LOG_ERROR(LOG_TAG, "Failed receiving data packet (status %d)", (int)status);
+            return ToStatus(status);
+        }
+        const auto* data = reinterpret_cast<const unsigned char*>(reply.payload.message.data_msg.data);
+        uint16_t count = 0;
+        ::memcpy(&total, data, sizeof(total));
+        ::memcpy(&count, data + 2, sizeof(count));
+        if (reply.header.id != PacketManager::MsgId::GetUsersChecksums ||
+            count > PacketManager::MaxBucketUsersPerReply || (count == 0 && users.size() < total))
         {
-            _face_found = false;
+            LOG_ERROR(LOG_TAG, "Got unexpected bucket users reply");
+            return Status::Error;
         }
-        _user_callback.OnResult(status, faceprints);
-    }
+        for (uint16_t i = 0; i < count; i++)
+        {
+            PacketManager::BucketUser user;
+            PacketManager::ReadBucketUser(data + 4 + i * PacketManager::BucketUserSize, user);
+            users.push_back(user);
+        }
+    } while (users.size() < total);
+    return Status::Ok;
+}
 
-    void OnHint(const AuthenticateStatus hint) override
+Status FaceAuthenticatorImpl::CompareAllUsers(const HostGallery& gallery, UsersChangesCallback& callback)
+{
+    std::vector<std::string> user_ids;
+    auto status = QueryAllUserIds(user_ids);
+    if (status != Status::Ok)
     {
-        _user_callback.OnHint(hint);
+        return status;
     }
 
-    void OnFaceDetected(const std::vector<FaceRect>& faces, const unsigned int ts) override
+    const std::unordered_set<std::string> device_ids(user_ids.begin(), user_ids.end());
+    std::unordered_map<std::string, uint64_t> host_checksums;
+    std::vector<HostGalleryUserChecksum> host_users;
+    for (unsigned int bucket = 0; bucket < PacketManager::ChecksumBuckets; bucket++)
     {
-        _face_found = !faces.empty();
-        _user_callback.OnFaceDetected(faces, ts);
+        size_t number_of_host_users = 0;
+        gallery.GetBucketChecksums(bucket, nullptr, 0, number_of_host_users);
+        host_users.resize(number_of_host_users);
+        gallery.GetBucketChecksums(bucket, host_users.data(), host_users.size(), number_of_host_users);
+        for (size_t i = 0; i < std::min(host_users.size(), number_of_host_users); i++)
+        {
+            if (device_ids.find(host_users[i].user_id) == device_ids.end())
+            {
+                callback.OnUserRemoved(host_users[i].user_id);
+            }
+            host_checksums.emplace(host_users[i].user_id, host_users[i].checksum);
+        }
     }
 
-    bool face_found()
+    std::vector<unsigned int> indices(user_ids.size());
+    for (unsigned int i = 0; i < indices.size(); i++)
     {
-        return _face_found;
+        indices[i] = i;
     }
-};
+    return FetchUsersFaceprints(indices, [&](size_t i, const Faceprints& faceprints) {
+        const char* user_id = user_ids[i].c_str();
+        auto it = host_checksums.find(user_ids[i]);
+        if (it == host_checksums.end() || it->second != PacketManager::UserChecksum(user_id, faceprints))
+        {
+            callback.OnUserChanged(user_id, faceprints);
+        }
+    });
+}
 
-Status FaceAuthenticatorImpl::ExtractFaceprintsForAuthLoop(AuthFaceprintsExtractionCallback& callback)
+// receive and drop up to count outstanding replies, stop on the first failure
+void FaceAuthenticatorImpl::DrainReplies(unsigned int count)
 {
-    _cancel_loop = false;
-    do
+    for (unsigned int i = 0; i < count; i++)
     {
-        FaceprintsLoopCallback clbk_handler {callback};
-        auto status = ExtractFaceprintsForAuth(clbk_handler);
-        if (status != Status::Ok || _cancel_loop)
+        PacketManager::DataPacket reply {PacketManager::MsgId::GetUserFeatures};
+        if (_session.RecvDataPacket(reply) != PacketManager::SerialStatus::Ok)
         {
-            return status; // return from the loop on first error
+            return;
         }
-
-        auto sleep_for = clbk_handler.face_found() ? _loop_interval_with_face : _loop_interval_no_face;
-        AuthLoopSleep(sleep_for);
-    } while (!_cancel_loop);
-
-    return Status::Ok;
+    }
 }
 
-MatchResultHost FaceAuthenticatorImpl::MatchFaceprints(Faceprints& new_faceprints, Faceprints& existing_faceprints,
-                                                       Faceprints& updated_faceprints)
-{
-    MatchResultHost finalResult;
-
-    auto result = Matcher::MatchFaceprints(new_faceprints, existing_faceprints, updated_faceprints);
-    finalResult.success = result.success;
-    finalResult.should_update = result.should_update;
-    finalResult.score = result.score;
-    finalResult.confidence = result.confidence;
-
-    return finalResult;
-}
 
-// Validate given user id.
-// Return true if valid, false otherwise.
-bool FaceAuthenticatorImpl::ValidateUserId(const char* user_id)
+// Pipelined import: keep up to USER_FEATURES_PIPELINE_DEPTH SetUserFeatures requests outstanding and collect the
+// acks in request order. A user rejected by the device does not stop the import, but a communication error does,
+// since later acks could no longer be matched to their requests.
+// Note: a SecureVersionDescriptor takes most of a DataMessage, so each packet carries a single user.
+// Users are sent packed (SetUserFeaturesPacked) unless the device does not support it, or their faceprints are out
+// of the packed range.
+Status FaceAuthenticatorImpl::SetUsersFaceprints(UserFaceprints* user_features, unsigned int num_of_users)
 {
-    if (user_id == nullptr)
+    RSID_TRACE_SPAN("api", "SetUsersFaceprints");
+    DeviceLock device_lock {_device_mutex};
+    for (unsigned int i = 0; i < num_of_users; i++)
     {
-        LOG_ERROR(LOG_TAG, "Invalid user id: nullptr");
-        return false;
+        if (!ValidateUserId(user_features[i].user_id.c_str()))
+        {
+            return Status::Error;
+        }
     }
 
-    auto user_id_len = ::strlen(user_id);
-    bool is_valid = user_id_len > 0 && user_id_len <= PacketManager::MaxUserIdSize;
-    if (!is_valid)
+    bool all_users_set = true;
+    auto status = SendUsersFaceprints(user_features, num_of_users, all_users_set);
+    if (status != Status::Ok)
     {
-        LOG_ERROR(LOG_TAG, "Invalid user id length. Valid size: 1 - %zu", PacketManager::MaxUserIdSize);
+        if (_standby_pending && !_bulk_update)
+        {
+            Standby(); // persist the users acked before the error
+        }
+        return status;
     }
-    return is_valid;
+    if (_bulk_update)
+    {
+        return all_users_set ? Status::Ok : Status::Error; // persisted by CommitBulkUpdate()
+    }
+    return (Standby() == Status::Ok && all_users_set) ? Status::Ok : Status::Error;
 }
 
-Status FaceAuthenticatorImpl::GetUsersFaceprints(Faceprints* user_features, unsigned int& num_of_users)
+// The upload of SetUsersFaceprints(): Status::Error on a communication error. all_users_set is cleared if the device
+// rejected a user.
+Status FaceAuthenticatorImpl::SendUsersFaceprints(UserFaceprints* user_features, unsigned int num_of_users,
+                                                  bool& all_users_set)
 {
-    auto status = _session.Start(_serial.get());
-    bool all_is_well = true;
-    PacketManager::SerialStatus bad_status = PacketManager::SerialStatus::Ok;
-    if (status != PacketManager::SerialStatus::Ok)
+    static_assert(2 * (sizeof(SecureVersionDescriptor) + PacketManager::MaxUserIdSize + 1) >
+                      sizeof(PacketManager::DataMessage::data),
+                  "more than one user fits in a packet");
+    static_assert(2 + PacketManager::MaxPackedFaceprintsSize <= sizeof(SecureVersionDescriptor),
+                  "packed faceprints do not fit the request buffer");
+    DeviceLock device_lock {_device_mutex};
+    try
     {
-        LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(status));
-        return ToStatus(status);
+        auto status = StartSession();
+        if (status != PacketManager::SerialStatus::Ok)
+        {
+            LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(status));
+            return ToStatus(status);
+        }
+        if (_session.LargePayloadSize() > 0 && _packed_faceprints != PackedSupport::No)
+        {
+            return SendUsersFaceprintsLarge(user_features, num_of_users, all_users_set);
+        }
+        return SendUsersFaceprintsPipelined(user_features, num_of_users, all_users_set);
+    }
+    catch (std::exception& ex)
+    {
+        LOG_EXCEPTION(LOG_TAG, ex);
+        _session.Close();
+        return Status::Error;
     }
-    QueryNumberOfUsers(num_of_users);
-    for (uint16_t i = 0; i < num_of_users; i++)
+    catch (...)
     {
-        try
+        LOG_ERROR(LOG_TAG, "Unknown exception");
+        _session.Close();
+        return Status::Error;
+    }
+}
+
+// SendUsersFaceprints() in large packets (see PacketManager/LargePacket.h): the packed faceprints of consecutive
+// users are sent in batches, as many as fit in a packet. A user whose faceprints do not pack is sent alone, in full.
+Status FaceAuthenticatorImpl::SendUsersFaceprintsLarge(UserFaceprints* user_features, unsigned int num_of_users,
+                                                       bool& all_users_set)
+{
+    constexpr size_t record_header_size = PacketManager::MaxUserIdSize + 1 + 2; // user id, packed size
+    static_assert(PacketManager::LargeBatchHeaderSize + record_header_size + PacketManager::MaxPackedFaceprintsSize <=
+                      PacketManager::MinLargePayloadSize - sizeof(uint32_t),
+                  "packed faceprints do not fit a large packet");
+    auto& packet = LargePacketBuffer();
+    const size_t capacity = _session.LargePayloadSize() - sizeof(uint32_t);
+    unsigned int next = 0;
+    while (next < num_of_users)
+    {
+        auto* data = reinterpret_cast<unsigned char*>(packet.Data());
+        size_t offset = PacketManager::LargeBatchHeaderSize;
+        unsigned int users = 0;
+        // packed in place, while the largest packed faceprints fit
+        while (next + users < num_of_users && users < 0xFFFF &&
+               offset + record_header_size + PacketManager::MaxPackedFaceprintsSize <= capacity)
         {
-            PacketManager::DataPacket get_features_packet {PacketManager::MsgId::GetUserFeatures, (char*)&i, sizeof(i)};
-            status = _session.SendPacket(get_features_packet);
-            if (status != PacketManager::SerialStatus::Ok)
-            {
-                LOG_ERROR(LOG_TAG, "Failed sending data packet (status %d)", (int)status);
-                all_is_well = false;
-                bad_status = status;
-                continue;
-            }
-            PacketManager::DataPacket get_features_return_packet {PacketManager::MsgId::GetUserFeatures};
-            status = _session.RecvDataPacket(get_features_return_packet);
-            if (status != PacketManager::SerialStatus::Ok)
+            const UserFaceprints& user_desc = user_features[next + users];
+            char* user_id = reinterpret_cast<char*>(data + offset);
+            ::memset(user_id, 0, PacketManager::MaxUserIdSize + 1);
+            ::strncpy(user_id, user_desc.user_id.c_str(), PacketManager::MaxUserIdSize);
+            const size_t packed_size =
+                PacketManager::PackFaceprints(user_desc.faceprints, data + offset + record_header_size);
+            if (packed_size == 0)
             {
-                LOG_ERROR(LOG_TAG, "Failed receiving data packet (status %d)", (int)status);
-                all_is_well = false;
-                bad_status = status;
-                continue;
-            }
-            if (get_features_return_packet.header.id == PacketManager::MsgId::GetUserFeatures)
-            {
-                LOG_DEBUG(LOG_TAG, "Got faceprints from device!");
-                SecureVersionDescriptor* desc =
-                    (SecureVersionDescriptor*)(get_features_return_packet.payload.message.data_msg.data);
-
-                user_features[i].version = desc->version;
-                user_features[i].featuresType = (FaceprintsTypeEnum)desc->faceprintsType;
-                user_features[i].flags = desc->flags;
-
-                static_assert(sizeof(user_features[i].adaptiveDescriptorWithoutMask) ==
-                                  sizeof(desc->adaptiveDescriptorWithoutMask),
-                              "adaptive faceprints sizes (without mask) does not match");
-                ::memcpy(user_features[i].adaptiveDescriptorWithoutMask, desc->adaptiveDescriptorWithoutMask,
-                         sizeof(desc->adaptiveDescriptorWithoutMask));
-
-                static_assert(sizeof(user_features[i].adaptiveDescriptorWithMask) ==
-                                  sizeof(desc->adaptiveDescriptorWithMask),
-                              "adaptive faceprints sizes (with mask) does not match");
-                ::memcpy(user_features[i].adaptiveDescriptorWithMask, desc->adaptiveDescriptorWithMask,
-                         sizeof(desc->adaptiveDescriptorWithMask));
-
-                static_assert(sizeof(user_features[i].enrollmentDescriptor) == sizeof(desc->enrollmentDescriptor),
-                              "enrollment faceprints sizes does not match");
-                ::memcpy(user_features[i].enrollmentDescriptor, desc->enrollmentDescriptor,
-                         sizeof(desc->enrollmentDescriptor));
+                break;
             }
-            else
+            data[offset + PacketManager::MaxUserIdSize + 1] = static_cast<unsigned char>(packed_size);
+            data[offset + PacketManager::MaxUserIdSize + 2] = static_cast<unsigned char>(packed_size >> 8);
+            offset += record_header_size + packed_size;
+            users++;
+        }
+        if (users == 0)
+        {
+            auto status = SendUsersFaceprintsPipelined(user_features + next, 1, all_users_set);
+            if (status != Status::Ok)
             {
-                LOG_ERROR(LOG_TAG, "Got unexpected message id when expecting faceprints to arrive: %c",
-                          (char)get_features_packet.header.id);
-                all_is_well = false;
-                bad_status = status;
-                continue;
+                return status;
             }
+            next++;
+            continue;
         }
-        catch (std::exception& ex)
+        data[0] = static_cast<unsigned char>(users);
+        data[1] = static_cast<unsigned char>(users >> 8);
+        packet.SetData(PacketManager::MsgId::SetUserFeaturesPacked, offset);
+
+        auto status = _session.SendPacket(packet);
+        if (status == PacketManager::SerialStatus::Ok)
         {
-            LOG_EXCEPTION(LOG_TAG, ex);
-            all_is_well = false;
-            bad_status = status;
-            continue;
+            status = _session.RecvPacket(packet);
         }
-        catch (...)
+        if (status != PacketManager::SerialStatus::Ok)
         {
-            LOG_ERROR(LOG_TAG, "Unknown exception");
-            all_is_well = false;
-            bad_status = status;
-            continue;
+            LOG_ERROR(LOG_TAG, "Failed sending users faceprints (status %d)", (int)status);
+            return Status::Error;
+        }
+        const auto* reply = reinterpret_cast<const unsigned char*>(packet.Data());
+        const bool replied = packet.IsLarge() && packet.header.id == PacketManager::MsgId::SetUserFeaturesPacked &&
+                             packet.DataSize() >= PacketManager::LargeBatchHeaderSize + users &&
+                             (reply[0] | (reply[1] << 8)) == static_cast<int>(users);
+        for (unsigned int i = 0; i < users; i++)
+        {
+            if (!replied || reply[PacketManager::LargeBatchHeaderSize + i] != 0)
+            {
+                LOG_ERROR(LOG_TAG, "Error updating/adding user %u to DB", next + i);
+                all_users_set = false;
+                continue;
+            }
+            _users_journal.OnUserChanged(user_features[next + i].user_id.c_str());
+            _number_of_users_cache.Invalidate();
+            _standby_pending = true;
         }
+        next += users;
     }
-    return all_is_well ? Status::Ok : ToStatus(bad_status);
+    return Status::Ok;
 }
 
-Status FaceAuthenticatorImpl::SetUsersFaceprints(UserFaceprints* user_features, unsigned int num_of_users)
+// SendUsersFaceprints() in regular packets, up to USER_FEATURES_PIPELINE_DEPTH outstanding
+Status FaceAuthenticatorImpl::SendUsersFaceprintsPipelined(UserFaceprints* user_features, unsigned int num_of_users,
+                                                           bool& all_users_set)
 {
-    bool all_users_set = true;
-    auto status = _session.Start(_serial.get());
-    if (status != PacketManager::SerialStatus::Ok)
-    {
-        LOG_ERROR(LOG_TAG, "Session start failed with status %d", static_cast<int>(status));
-        return ToStatus(status);
-    }
-    for (unsigned int i = 0; i < num_of_users; i++)
-    {
-        try
+    PacketManager::SerialStatus status;
+    unsigned int sent = 0, acked = 0;
+    std::vector<PacketManager::MsgId> request_ids(num_of_users); // to match the acks
+    while (acked < num_of_users)
+    {
+        // a single request until the device is known to handle packed ones
+        const size_t depth = _packed_faceprints == PackedSupport::Unknown ? 1 : USER_FEATURES_PIPELINE_DEPTH;
+        while (sent < num_of_users && sent - acked < depth)
         {
-            UserFaceprints& user_desc = user_features[i];
-            const char* user_id = user_desc.user_id.c_str();
-            if (!ValidateUserId(user_id))
-            {
-                return Status::Error;
-            }
+            UserFaceprints& user_desc = user_features[sent];
             char buffer[sizeof(SecureVersionDescriptor) + PacketManager::MaxUserIdSize + 1] = {0};
-            strncpy(buffer, user_id, PacketManager::MaxUserIdSize + 1);
+            strncpy(buffer, user_desc.user_id.c_str(), PacketManager::MaxUserIdSize + 1);
             size_t offset = PacketManager::MaxUserIdSize + 1;
-            SecureVersionDescriptor* desc = (SecureVersionDescriptor*)&user_desc.faceprints;
-            memcpy(buffer + offset, (char*)desc, sizeof(*desc));
-            offset += sizeof(*desc);
-            PacketManager::DataPacket data_packet {PacketManager::MsgId::SetUserFeatures, buffer, offset};
-
-            status = _session.SendPacket(data_packet);
-            if (status != PacketManager::SerialStatus::Ok)
+            size_t packed_size = 0;
+            if (_packed_faceprints != PackedSupport::No)
             {
-                LOG_ERROR(LOG_TAG, "Failed sending data packet (status %d)", (int)status);
-                all_users_set = false;
-                continue;
+                auto* packed = reinterpret_cast<unsigned char*>(buffer + offset + 2);
+                packed_size = PacketManager::PackFaceprints(user_desc.faceprints, packed);
             }
-
-            status = _session.RecvDataPacket(data_packet);
-            if (status != PacketManager::SerialStatus::Ok)
+            if (packed_size > 0)
             {
-                LOG_ERROR(LOG_TAG, "Failed receiving data packet (status %d)", (int)status);
-                all_users_set = false;
-                continue;
+                buffer[offset] = static_cast<char>(packed_size);
+                buffer[offset + 1] = static_cast<char>(packed_size >> 8);
+                offset += 2 + packed_size;
+                request_ids[sent] = PacketManager::MsgId::SetUserFeaturesPacked;
+            }
+            else
+            {
+                SecureVersionDescriptor* desc = (SecureVersionDescriptor*)&user_desc.faceprints;
+                memcpy(buffer + offset, (char*)desc, sizeof(*desc));
+                offset += sizeof(*desc);
+                request_ids[sent] = PacketManager::MsgId::SetUserFeatures;
             }
-            if (data_packet.header.id != PacketManager::MsgId::SetUserFeatures)
+            PacketManager::DataPacket data_packet {request_ids[sent], buffer, offset};
+
+            status = _session.SendPacket(data_packet);
+            if (status != PacketManager::SerialStatus::Ok)
             {
-                LOG_ERROR(LOG_TAG, "Error updating/adding user to DB", (int)status);
-                all_users_set = false;
-                continue;
+                LOG_ERROR(LOG_TAG, "Failed sending data packet (status %d)", (int)status);
+                DrainReplies(sent - acked);
+                return Status::Error;
             }
+            sent++;
         }
-        catch (std::exception& ex)
+
+        const auto request_id = request_ids[acked];
+        PacketManager::DataPacket reply {request_id};
+        status = _session.RecvDataPacket(reply);
+        if (request_id == PacketManager::MsgId::SetUserFeaturesPacked &&
+            _packed_faceprints == PackedSupport::Unknown && !OnPackedProbeReply(status, reply, request_id))
         {
-            LOG_EXCEPTION(LOG_TAG, ex);
-            all_users_set = false;
+            sent = acked; // send it again in full
             continue;
         }
-        catch (...)
+        if (status != PacketManager::SerialStatus::Ok)
         {
-            LOG_ERROR(LOG_TAG, "Unknown exception");
+            LOG_ERROR(LOG_TAG, "Failed receiving data packet (status %d)", (int)status);
+            return Status::Error;
+        }
+        if (reply.header.id != request_id)
+        {
+            LOG_ERROR(LOG_TAG, "Error updating/adding user %u to DB", acked);
             all_users_set = false;
-            continue;
         }
+        else
+        {
+            _users_journal.OnUserChanged(user_features[acked].user_id.c_str());
+            _number_of_users_cache.Invalidate();
+            _standby_pending = true;
+        }
+        acked++;
+    }
+    return Status::Ok;
+}
+
+Status FaceAuthenticatorImpl::BeginBulkUpdate()
+{
+    DeviceLock device_lock {_device_mutex};
+    if (_bulk_update)
+    {
+        LOG_ERROR(LOG_TAG, "A bulk update is already open");
+        return Status::Error;
     }
+    _bulk_update = true;
+    return Status::Ok;
+}
 
-    return (Standby() == Status::Ok && all_users_set) ? Status::Ok : Status::Error;
+Status FaceAuthenticatorImpl::CommitBulkUpdate()
+{
+    RSID_TRACE_SPAN("api", "CommitBulkUpdate");
+    DeviceLock device_lock {_device_mutex};
+    if (!_bulk_update)
+    {
+        LOG_ERROR(LOG_TAG, "No bulk update is open");
+        return Status::Error;
+    }
+    // in the bulk update's session
+    auto status = _standby_pending ? Standby() : Status::Ok;
+    _bulk_update = false;
+    if (!_persistent_session && !_loop_session)
+    {
+        _session.Close();
+    }
+    return status;
+}
+
+std::future<Status> FaceAuthenticatorImpl::EnrollAsync(EnrollmentCallback& callback, const char* user_id)
+{
+    std::string id = user_id != nullptr ? user_id : "";
+    bool has_id = user_id != nullptr;
+    return _operations.Post([this, &callback, id, has_id]() { return Enroll(callback, has_id ? id.c_str() : nullptr); },
+                            OperationPriority::Auth);
+}
+
+std::future<Status> FaceAuthenticatorImpl::AuthenticateAsync(AuthenticationCallback& callback)
+{
+    return _operations.Post([this, &callback]() { return Authenticate(callback); }, OperationPriority::Auth);
+}
+
+std::future<Status> FaceAuthenticatorImpl::AuthenticateLoopAsync(AuthenticationCallback& callback)
+{
+    return _operations.Post([this, &callback]() { return AuthenticateLoop(callback); }, OperationPriority::Auth);
+}
+
+std::future<Status> FaceAuthenticatorImpl::RemoveUserAsync(const char* user_id)
+{
+    std::string id = user_id != nullptr ? user_id : "";
+    bool has_id = user_id != nullptr;
+    return _operations.Post([this, id, has_id]() { return RemoveUser(has_id ? id.c_str() : nullptr); },
+                            OperationPriority::Admin);
+}
+
+std::future<Status> FaceAuthenticatorImpl::RemoveAllAsync()
+{
+    return _operations.Post([this]() { return RemoveAll(); }, OperationPriority::Admin);
+}
+
+std::future<Status> FaceAuthenticatorImpl::QueryNumberOfUsersAsync(unsigned int& number_of_users)
+{
+    return _number_of_users_query.Post(
+        _operations, OperationPriority::Telemetry, [this](unsigned int& value) { return QueryNumberOfUsers(value); },
+        [&number_of_users](Status status, const unsigned int& value) {
+            number_of_users = status == Status::Ok ? value : 0;
+            return status;
+        });
+}
+
+// all the ids are read once for the coalesced requests, each gets up to its number_of_users of them
+std::future<Status> FaceAuthenticatorImpl::QueryUserIdsAsync(UserIdsCallback& callback, unsigned int& number_of_users)
+{
+    if (number_of_users == 0)
+    {
+        LOG_ERROR(LOG_TAG, "QueryUserIdsAsync: Got invalid params (zero)");
+        std::promise<Status> invalid;
+        invalid.set_value(Status::Error);
+        return invalid.get_future();
+    }
+    return _user_ids_query.Post(
+        _operations, OperationPriority::Telemetry,
+        [this](std::vector<std::string>& user_ids) { return QueryAllUserIds(user_ids); },
+        [&callback, &number_of_users](Status status, const std::vector<std::string>& user_ids) {
+            if (status != Status::Ok)
+            {
+                number_of_users = 0;
+                return status;
+            }
+            number_of_users = std::min(number_of_users, static_cast<unsigned int>(user_ids.size()));
+            for (unsigned int i = 0; i < number_of_users; i++)
+            {
+                callback.OnUserId(i, user_ids[i].c_str());
+            }
+            return status;
+        });
+}
+
+std::future<Status> FaceAuthenticatorImpl::StandbyAsync()
+{
+    return _operations.Post([this]() { return Standby(); }, OperationPriority::Admin);
 }
 
+std::future<Status> FaceAuthenticatorImpl::ExtractFaceprintsForAuthAsync(AuthFaceprintsExtractionCallback& callback)
+{
+    return _operations.Post([this, &callback]() { return ExtractFaceprintsForAuth(callback); },
+                            OperationPriority::Auth);
+}
+
+// the first step reads the number of users, each next one exports up to ASYNC_STEP_USERS of them
+std::future<Status> FaceAuthenticatorImpl::GetUsersFaceprintsAsync(FaceprintsExportCallback& callback,
+                                                                   unsigned int& num_of_users)
+{
+    return _operations.PostSteps(
+        [this, &callback, &num_of_users, counted = false, total_users = 0u, next = 0u](Status& status) mutable {
+            if (!counted)
+            {
+                counted = true;
+                num_of_users = 0;
+                status = ReadNumberOfUsers(total_users);
+                return status != Status::Ok || total_users == 0;
+            }
+            const auto count = std::min(total_users - next, ASYNC_STEP_USERS);
+            status = ExportUsersFaceprints(next, count, callback, num_of_users);
+            next += count;
+            return status != Status::Ok || next == total_users;
+        },
+        OperationPriority::Admin);
+}
 
+// each step sends up to ASYNC_STEP_USERS users, the last one persists them as SetUsersFaceprints() does
+std::future<Status> FaceAuthenticatorImpl::SetUsersFaceprintsAsync(UserFaceprints* user_features,
+                                                                   unsigned int num_of_users)
+{
+    for (unsigned int i = 0; i < num_of_users; i++)
+    {
+        if (!ValidateUserId(user_features[i].user_id.c_str()))
+        {
+            std::promise<Status> invalid;
+            invalid.set_value(Status::Error);
+            return invalid.get_future();
+        }
+    }
+    return _operations.PostSteps(
+        [this, user_features, num_of_users, next = 0u, all_users_set = true](Status& status) mutable {
+            DeviceLock device_lock {_device_mutex};
+            const auto count = std::min(num_of_users - next, ASYNC_STEP_USERS);
+            status = SendUsersFaceprints(user_features + next, count, all_users_set);
+            next += count;
+            if (status != Status::Ok && _standby_pending && !_bulk_update)
+            {
+                Standby(); // persist the users acked before the error
+            }
+            if (status != Status::Ok || next < num_of_users)
+            {
+                return status != Status::Ok;
+            }
+            if (!_bulk_update)
+            {
+                status = Standby();
+            }
+            status = status == Status::Ok && all_users_set ? Status::Ok : Status::Error;
+            return true;
+        },
+        OperationPriority::Admin);
+}
 } // namespace RealSenseID
@@ -5,15 +5,34 @@
 
 #include "RealSenseID/DeviceConfig.h"
 #include "RealSenseID/AuthenticationCallback.h"
+#include "RealSenseID/AuthLoopPolicy.h"
 #include "RealSenseID/AuthFaceprintsExtractionCallback.h"
 #include "RealSenseID/EnrollFaceprintsExtractionCallback.h"
 #include "RealSenseID/EnrollmentCallback.h"
+#include "RealSenseID/EnrollImagesCallback.h"
+#include "RealSenseID/EventFilter.h"
 #include "RealSenseID/Faceprints.h"
+#include "RealSenseID/FaceprintsExportCallback.h"
+#include "RealSenseID/GalleryAuthCallback.h"
+#include "RealSenseID/HostGallery.h"
+#include "RealSenseID/KeepAlivePolicy.h"
+#include "RealSenseID/UserIdsCallback.h"
+#include "RealSenseID/UsersChangesCallback.h"
+#include "RealSenseID/UsersCursor.h"
+#include "RealSenseID/UsersExportCallback.h"
 #include "RealSenseID/UserFaceprints.h"
 #include "RealSenseID/SerialConfig.h"
 #include "RealSenseID/SignatureCallback.h"
 #include "RealSenseID/Status.h"
 #include "RealSenseID/MatchResultHost.h"
+#include "UsersChangeJournal.h"
+#include "CachedQuery.h"
+#include "CoalescedQuery.h"
+#include "OperationArena.h"
+#include "OperationQueue.h"
+#include "PacketManager/UsersChecksum.h"
+#include "PacketManager/LargePacket.h"
+#include "LibraryThread.h"
 
 
 #ifdef ANDROID
@@ -30,6 +49,12 @@ using Session = RealSenseID::PacketManager::NonSecureSession;
 #include <memory>
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <functional>
+#include <future>
+#include <thread>
+#include <vector>
 
 namespace RealSenseID
 {
@@ -40,18 +65,22 @@ class FaceAuthenticatorImpl
 public:
     explicit FaceAuthenticatorImpl(SignatureCallback* callback);
 
-    ~FaceAuthenticatorImpl() = default;
+    ~FaceAuthenticatorImpl();
 
     FaceAuthenticatorImpl(const FaceAuthenticatorImpl&) = delete;
     FaceAuthenticatorImpl& operator=(const FaceAuthenticatorImpl&) = delete;
 
     Status Connect(const SerialConfig& config);
+    // connect using the given open connection (e.g. the host end of a DeviceEmulator)
+    Status Connect(std::unique_ptr<PacketManager::SerialConnection> serial);
 #ifdef ANDROID
     Status Connect(const AndroidSerialConfig& config);
 #endif
 
     void Disconnect();
 
+    SerialLinkProfile GetLinkProfile() const;
+
 #ifdef RSID_SECURE
     Status Pair(const char* ecdsaHostPubKey, const char* ecdsaHostPubKeySig, char* ecdsaDevicePubKey);
     Status Unpair();    
@@ -60,6 +89,12 @@ public:
     Status Enroll(EnrollmentCallback& callback, const char* user_id);
     Status Authenticate(AuthenticationCallback& callback);
     Status AuthenticateLoop(AuthenticationCallback& callback);
+    Status SetAuthLoopPolicy(const AuthLoopPolicy& policy);
+    AuthLoopPolicy GetAuthLoopPolicy() const;
+    Status SetKeepAlivePolicy(const KeepAlivePolicy& policy);
+    KeepAlivePolicy GetKeepAlivePolicy() const;
+    void SetEventFilter(const EventFilter& filter);
+    EventFilter GetEventFilter() const;
     Status Cancel();
     Status RemoveUser(const char* user_id);
     Status RemoveAll();
@@ -67,34 +102,179 @@ public:
     Status SetDeviceConfig(const DeviceConfig& device_config);
     Status QueryDeviceConfig(DeviceConfig& device_config);
     Status QueryUserIds(char** user_ids, unsigned int& number_of_users);
+    Status QueryUserIdsToBuffer(char* user_ids, unsigned int& number_of_users);
+    Status QueryUserIds(UserIdsCallback& callback, unsigned int& number_of_users);
+    Status QueryUserIds(UsersCursor& cursor, unsigned int page_size, UserIdsCallback& callback);
     Status QueryNumberOfUsers(unsigned int& number_of_users);
     Status Standby();
 
-    Status ExtractFaceprintsForEnroll(EnrollFaceprintsExtractionCallback& callback);
+    void SetPersistentSession(bool enable);
+    void SetPackedTransfers(bool enable);
+    void SetLargePayloads(bool enable);
+    void SetMessageBatches(bool enable);
+    void CloseSession();
+    void SetQueryCache(bool enable);
+
+    // gallery: look for the enrollee in it (nullptr - no duplicate check)
+    Status ExtractFaceprintsForEnroll(HostGallery* gallery, EnrollFaceprintsExtractionCallback& callback);
+    Status ExtractFaceprintsFromImages(const StoredImage* images, unsigned int number_of_images,
+                                       EnrollImagesCallback& callback);
     Status ExtractFaceprintsForAuth(AuthFaceprintsExtractionCallback& callback);
     Status ExtractFaceprintsForAuthLoop(AuthFaceprintsExtractionCallback& callback);
+    Status AuthenticateWithGallery(GalleryBackend& gallery, GalleryAuthCallback& callback);
     MatchResultHost MatchFaceprints(Faceprints& new_faceprints, Faceprints& existing_faceprints,
                                     Faceprints& updated_faceprints);
 
     Status GetUsersFaceprints(Faceprints* user_features, unsigned int& num_of_users);
+    Status GetUsersFaceprints(FaceprintsExportCallback& callback, unsigned int& num_of_users);
+    Status ExportUsers(UsersExportCallback& callback, unsigned int& num_of_users);
+    Status GetUsersFaceprints(UsersCursor& cursor, unsigned int page_size, FaceprintsExportCallback& callback);
+    Status ExportUsers(UsersCursor& cursor, unsigned int page_size, UsersExportCallback& callback);
+    unsigned int GetUsersRevision() const;
+    Status GetChangedUsersFaceprints(unsigned int since_revision, UsersChangesCallback& callback,
+                                     unsigned int& revision);
+    Status GetDifferingUsersFaceprints(const HostGallery& gallery, UsersChangesCallback& callback);
     Status SetUsersFaceprints(UserFaceprints* users_faceprints, unsigned int num_of_users);
+    Status BeginBulkUpdate();
+    Status CommitBulkUpdate();
 
-private:
-#ifdef RSID_SECURE
-    // in secure mode sleep less to take into account start session duration
-    const std::chrono::milliseconds _loop_interval_no_face {1500};
-    const std::chrono::milliseconds _loop_interval_with_face {100};
-#else
-    const std::chrono::milliseconds _loop_interval_no_face {2100};
-    const std::chrono::milliseconds _loop_interval_with_face {600};
-#endif
+    std::future<Status> EnrollAsync(EnrollmentCallback& callback, const char* user_id);
+    std::future<Status> AuthenticateAsync(AuthenticationCallback& callback);
+    std::future<Status> AuthenticateLoopAsync(AuthenticationCallback& callback);
+    std::future<Status> RemoveUserAsync(const char* user_id);
+    std::future<Status> RemoveAllAsync();
+    std::future<Status> QueryNumberOfUsersAsync(unsigned int& number_of_users);
+    std::future<Status> QueryUserIdsAsync(UserIdsCallback& callback, unsigned int& number_of_users);
+    std::future<Status> StandbyAsync();
+    std::future<Status> ExtractFaceprintsForAuthAsync(AuthFaceprintsExtractionCallback& callback);
+    std::future<Status> GetUsersFaceprintsAsync(FaceprintsExportCallback& callback, unsigned int& num_of_users);
+    std::future<Status> SetUsersFaceprintsAsync(UserFaceprints* user_features, unsigned int num_of_users);
 
+private:
+    AuthLoopPolicy _loop_policy;
+    mutable std::mutex _loop_mutex; // guards _loop_policy and the cancel wakeup
+    std::condition_variable _loop_cv;
     std::atomic<bool> _cancel_loop {false};
+    EventFilter _event_filter;
+    mutable std::mutex _event_filter_mutex;
+    bool _persistent_session = false;
+    bool _loop_session = false; // an auth loop keeps its session open between attempts
+    bool _bulk_update = false;  // between BeginBulkUpdate() and CommitBulkUpdate(): the session stays open too
+    bool _standby_pending = false; // users were set since the last Standby(), the DB is not persisted yet
+    bool _packed_transfers = false; // SetPackedTransfers()
+    bool _large_payloads = false;   // SetLargePayloads()
+    bool _message_batches = false;  // SetMessageBatches()
+    // whether the device handles the packed faceprints messages (see PacketManager/PackedFaceprints.h). found by the
+    // first faceprints export / import after connect, No unless packed transfers are enabled
+    enum class PackedSupport
+    {
+        Unknown,
+        Yes,
+        No
+    } _packed_faceprints = PackedSupport::No;
+    // whether the device handles GetUserRecordsPacked, found by the first ExportUsers() in large packets
+    PackedSupport _user_records = PackedSupport::No;
     std::unique_ptr<PacketManager::SerialConnection> _serial;
+    // opens the connection again (connected by a SerialConfig), empty if it cannot be reopened
+    std::function<std::unique_ptr<PacketManager::SerialConnection>()> _reopen;
     Session _session;
+    SerialLinkProfile _link_profile; // of the current connection (SerialConfig::calibrate_link)
+    // keep-alive (SetKeepAlivePolicy()): the monitor thread queues a keep-alive operation once the connection has
+    // been idle for the policy's idle time, and after a failed one retries to reconnect with backoff
+    KeepAlivePolicy _keep_alive_policy;
+    mutable std::mutex _keep_alive_mutex; // guards the policy and the monitor's wakeup
+    std::condition_variable _keep_alive_cv;
+    bool _keep_alive_stop = false;
+    bool _keep_alive_pending = false; // a keep-alive is queued or running
+    Status _keep_alive_status = Status::Ok;
+    LibraryThread _keep_alive_thread;
+    std::atomic<std::chrono::steady_clock::rep> _last_activity {0}; // last session start
+    UsersChangeJournal _users_journal;
+    // opt-in (SetQueryCache()). dropped by this instance's calls that change them and on connect / disconnect
+    CachedQuery<unsigned int> _number_of_users_cache;
+    CachedQuery<DeviceConfig> _device_config_cache;
+    // async queries of a kind share a device exchange
+    CoalescedQuery<unsigned int> _number_of_users_query;
+    CoalescedQuery<std::vector<std::string>> _user_ids_query;
+    // the packet of the bulk transfers in large packets (see PacketManager/LargePacket.h), allocated by the first one
+    std::unique_ptr<PacketManager::LargePacket> _large_packet;
+    // buffers of the operation in progress (see OperationArena.h), sized for the largest of them
+    static const size_t OperationArenaSize;
+    OperationArena _arena {OperationArenaSize};
+    std::mutex _arena_mutex; // held by the operation using _arena
+    // serializes the device exchanges of operations called from several threads (see FaceAuthenticator): each
+    // operation holds it from its session start to its last reply, so the session, the connection and their state
+    // above are used by one thread at a time. Recursive, as operations are made of each other. Cancel() does not take
+    // it, and host side work after the exchange (the matching of AuthenticateWithGallery()) runs without it.
+    mutable std::recursive_mutex _device_mutex;
+    using DeviceLock = std::lock_guard<std::recursive_mutex>;
+    // async operations run here. declared last so it stops before the session and serial are destroyed.
+    OperationQueue _operations;
+
+    PacketManager::SerialStatus StartSession();
+    void MarkActivity();
+    std::chrono::steady_clock::time_point LastActivity() const;
+    void StopKeepAlive();
+    void KeepAliveLoop();
+    // on the operations worker: ping if the connection is still idle (or right away reconnect if it is down) and
+    // reconnect if the ping fails
+    Status KeepAlive(const KeepAlivePolicy& policy, bool reconnect);
+    // ping with data_size bytes of random data, which the device echoes
+    Status Ping(std::chrono::milliseconds timeout, size_t data_size = sizeof(PacketManager::DataMessage::data));
+    // measure the link with pings and set the port's modes and timeouts by it (SerialConfig::calibrate_link)
+    Status CalibrateLink();
+    // set the port's modes and timeouts of _link_profile again, after the port was reopened
+    void ApplyLinkProfile();
+    Status Reconnect(const KeepAlivePolicy& policy);
+    // QueryNumberOfUsers() from the device, for the operations that need the exact number
+    Status ReadNumberOfUsers(unsigned int& number_of_users);
+    void InvalidateQueryCache();
+    void DrainReplies(unsigned int count);
+    // resolve PackedSupport::Unknown by the reply to the first packed faceprints request: a device without support
+    // answers with an error Reply (fa) packet. returns false if it does not support them, so the request is sent again
+    // in full. so does a timeout (the session is started again). another failed receive leaves it unknown.
+    bool OnPackedProbeReply(PacketManager::SerialStatus status, const PacketManager::SerialPacket& reply,
+                            PacketManager::MsgId packed_id);
+    // back to unknown after connect, or No if packed transfers are not enabled
+    void ResetPackedSupport();
+    Status FetchUsersFaceprints(const std::vector<unsigned int>& indices,
+                                const std::function<void(size_t, const Faceprints&)>& on_faceprints);
+    // the bulk transfers in large packets, in a started session that negotiated them
+    PacketManager::LargePacket& LargePacketBuffer();
+    Status FetchUsersFaceprintsLarge(const std::vector<unsigned int>& indices,
+                                     const std::function<void(size_t, const Faceprints&)>& on_faceprints);
+    Status SendUsersFaceprintsLarge(UserFaceprints* user_features, unsigned int num_of_users, bool& all_users_set);
+    Status SendUsersFaceprintsPipelined(UserFaceprints* user_features, unsigned int num_of_users,
+                                        bool& all_users_set);
+    Status ExportUsersFaceprints(unsigned int first, unsigned int count, FaceprintsExportCallback& callback,
+                                 unsigned int& num_of_users);
+    Status ExportUsersRange(unsigned int first, unsigned int count, UsersExportCallback& callback,
+                            unsigned int& num_of_users);
+    // ExportUsersRange() with GetUserRecordsPacked in large packets. supported is set to false if the device answered
+    // the first request with an error Reply, before any user was exported.
+    Status ExportUsersLarge(unsigned int first, unsigned int count, UsersExportCallback& callback,
+                            unsigned int& num_of_users, bool& supported);
+    // the next page of a cursor: export_range(first, count, exported) exports the page's users, counting them
+    Status ExportPage(UsersCursor& cursor, unsigned int page_size,
+                      const std::function<Status(unsigned int, unsigned int, unsigned int&)>& export_range);
+    Status QueryUserIds(unsigned int first, UserIdsCallback& callback, unsigned int& number_of_users);
+    Status SendUsersFaceprints(UserFaceprints* user_features, unsigned int num_of_users, bool& all_users_set);
+    // all the user ids, in DB order
+    Status QueryAllUserIds(std::vector<std::string>& user_ids);
+    // GetUsersChecksums requests (see PacketManager/UsersChecksum.h) in the started session. supported is set to
+    // false if the device answered with an error Reply (fa) packet, as firmware without the query does.
+    Status QueryChecksums(unsigned int level, unsigned int first_node, unsigned int number_of_nodes, uint64_t* digests,
+                          bool& supported);
+    Status QueryBucketUsers(unsigned int bucket, std::vector<PacketManager::BucketUser>& users);
+    // GetDifferingUsersFaceprints() by a full export, for a device without the checksums query
+    Status CompareAllUsers(const HostGallery& gallery, UsersChangesCallback& callback);
 
-    // wait for cancel flag while sleeping upto timeout
+    // wait up to timeout or until canceled
     void AuthLoopSleep(std::chrono::milliseconds timeout);
+    // wait before the next loop attempt. idle_count - number of consecutive attempts with no face
+    void AuthLoopWait(bool face_found, unsigned int& idle_count);
+    // run loop attempts in one session until canceled or an attempt fails
+    Status RunAuthLoop(const std::function<Status(bool& face_found)>& attempt);
     static bool ValidateUserId(const char* user_id);
 };
 } // namespace RealSenseID
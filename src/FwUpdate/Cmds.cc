@@ -27,7 +27,8 @@ std::string Cmds::dlinfo(const std::string& module_name)
 }
 
 std::string Cmds::dlinit(const std::string& name, const std::string& version, size_t size,
-                                          bool start_session, uint32_t crc, uint32_t block_size)
+                                          bool start_session, uint32_t crc, uint32_t block_size, bool offer_lz4,
+                                          uint32_t preferred_block_size)
 {
     std::ostringstream oss;
     oss << "\ndlinit " << name << " ver=" << version << " sz=" << size << " blksz=" << block_size << " crc=" << std::hex
@@ -36,13 +37,21 @@ std::string Cmds::dlinit(const std::string& name, const std::string& version, si
     if (start_session)
         oss << " session";
 
+    if (offer_lz4)
+        oss << " cmp=lz4";
+
+    if (preferred_block_size > 0)
+        oss << " blkpref=" << std::dec << preferred_block_size;
+
     return oss.str();
 }
 
-std::string Cmds::dl(size_t n)
+std::string Cmds::dl(size_t n, size_t compressed_size)
 {
     std::ostringstream oss;
     oss << "\ndl " << n;
+    if (compressed_size > 0)
+        oss << " csz=" << compressed_size;
 
     return oss.str();
 }
@@ -44,20 +44,25 @@ namespace Cmds
      * start_session    - start a new multiple-module update session
      * crc              - checksum calculated on the entire module
      * block_size       - updated module block size
+     * offer_lz4        - offer lz4 compressed blocks (cmp=lz4). a device that decompresses them repeats it in the ack
+     * preferred_block_size - offer another block size (blkpref=), 0 for none. a device taking it answers the block
+     *                    size it uses in the ack (blksz=), within its bounds
      *
      * returns a formatted dlinit command
      */
     std::string dlinit(const std::string& name, const std::string& version, size_t size, bool start_session,
-                              uint32_t crc, uint32_t block_size);
+                              uint32_t crc, uint32_t block_size, bool offer_lz4 = false,
+                              uint32_t preferred_block_size = 0);
 
     /**
      * update specific block number of updated module
      *
-     * n - block number to update
+     * n               - block number to update
+     * compressed_size - size of the block's lz4 compressed data (csz=), 0 if sent as is
      *
      * returns a formatted dl command
      */
-    std::string dl(size_t n);
+    std::string dl(size_t n, size_t compressed_size = 0);
   
     /**
      * finishes a module update process, if it was valid
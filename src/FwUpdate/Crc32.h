@@ -0,0 +1,17 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+#pragma once
+
+#include <cstdint>
+
+namespace RealSenseID
+{
+namespace FwUpdate
+{
+// calculates crc on a data buffer: the CRC-32 (reflected 0x04c11db7, as zlib) of its buffer_size / 4 whole 32 bit
+// words, continuing from crc (0 to start). the bytes past the last whole word are not included.
+// uses the CPU's carry-less multiply (x86 PCLMULQDQ, checked at runtime) or CRC32 instructions (ARMv8, when compiled
+// for them) if available, slice-by-16 tables otherwise.
+uint32_t CalculateCRC(uint32_t crc, const void* buffer, uint32_t buffer_size);
+} // namespace FwUpdate
+} // namespace RealSenseID
@@ -4,6 +4,7 @@
 #include "Utilities.h"
 #include "Logger.h"
 #include "Cmds.h"
+#include "Lz4.h"
 #include <thread>
 #include <chrono>
 #include <regex>
@@ -11,8 +12,13 @@
 #include <cassert>
 #include <set>
 #include <algorithm>
+#include <cstring>
 #include <stdexcept>
 #include <memory>
+#include <deque>
+#include <future>
+#include <cstdlib>
+#include <cmath>
 
 namespace RealSenseID
 {
@@ -101,6 +107,39 @@ bool FwUpdateEngine::ConsumeDlVerResponse(const std::string& module_name, Module
     return is_ok;
 }
 
+bool FwUpdateEngine::DeviceRunsModules(const ModuleVector& modules)
+{
+    _comm->WriteCmd(Cmds::dlver());
+    std::vector<ModuleVersionInfo> device_modules(modules.size());
+    auto all_listed = [&](const char* input) {
+        for (size_t i = 0; i < modules.size(); ++i)
+        {
+            if (!ParseDlVer(input, modules[i].name, device_modules[i]))
+                return false;
+        }
+        return true;
+    };
+    bool listed = _comm->WaitFor(all_listed, std::chrono::milliseconds {1000});
+    _comm->ConsumeScanned();
+    if (!listed)
+    {
+        LOG_DEBUG(LOG_TAG, "Not all modules of the image are listed by the device");
+        return false;
+    }
+    for (size_t i = 0; i < modules.size(); ++i)
+    {
+        const auto& device_module = device_modules[i];
+        if (device_module.state != ModuleVersionInfo::State::Active || device_module.version != modules[i].version)
+        {
+            LOG_DEBUG(LOG_TAG, "Module %s: device %s (state %d), image %s", modules[i].name.c_str(),
+                      device_module.version.c_str(), static_cast<int>(device_module.state),
+                      modules[i].version.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
 /*
 parse dlinfo response
 
@@ -211,59 +250,205 @@ std::vector<bool> FwUpdateEngine::GetBlockUpdateList(const ModuleInfo& module, b
     return rv;
 }
 
+// the device's response line to 'dl' (with the compressed size if the block is sent compressed)
+static std::string DlResponseStr(const std::string& name, size_t blkNo, size_t sz, size_t compressed_size)
+{
+    char str[96];
+    if (compressed_size > 0)
+        ::snprintf(str, sizeof(str), "%s : blk %zu sz=%zu csz=%zu", name.c_str(), blkNo, sz, compressed_size);
+    else
+        ::snprintf(str, sizeof(str), "%s : blk %zu sz=%zu", name.c_str(), blkNo, sz);
+    return str;
+}
+
 // parse 'dl' ack
-bool FwUpdateEngine::ParseDlResponse(const std::string& name, size_t blkNo, size_t sz)
+bool FwUpdateEngine::ParseDlResponse(const std::string& name, size_t blkNo, size_t sz, size_t compressed_size)
 {
     char* logBuf = _comm->GetScanPtr();
-    char str[64];
-    ::snprintf(str, sizeof(str), "%s : blk %zu sz=%zu", name.c_str(), blkNo, sz);
-    bool ack = strstr(logBuf, str) != NULL;
+    auto str = DlResponseStr(name, blkNo, sz, compressed_size);
+    bool ack = strstr(logBuf, str.c_str()) != NULL;
 
     if (!ack)
-        LOG_DEBUG(LOG_TAG, "cannot find %s", str);
+        LOG_DEBUG(LOG_TAG, "cannot find %s", str.c_str());
 
     _comm->ConsumeScanned();
     return ack;
 }
 
-// parse 'dl' send buffer result - return true if 'dl ret=0' is returned from device, false otherwise
-bool FwUpdateEngine::ParseDlBlockResult()
+// the ack line of dlinit, which answers its offers: "dlinit ack cmp=lz4" from a device that takes compressed blocks,
+// "blksz=<n>" the block size a device taking blkpref uses. the plain ack from others.
+std::string FwUpdateEngine::DlinitAckLine()
+{
+    auto ack_line_end = [](const char* input) -> const char* {
+        const char* ack = strstr(input, "dlinit ack");
+        return ack != nullptr ? strchr(ack, '\n') : nullptr;
+    };
+    _comm->WaitFor([&ack_line_end](const char* input) { return ack_line_end(input) != nullptr; },
+                   std::chrono::milliseconds {100});
+    const char* input = _comm->GetScanPtr();
+    const char* ack = strstr(input, "dlinit ack");
+    if (ack == nullptr)
+        return {};
+    const char* end = ack_line_end(input);
+    return end != nullptr ? std::string(ack, end) : std::string(ack);
+}
+
+// the block size of the dlinfo response ("blkSz <n>" of the SCRAP section if any, as GetBlockUpdateList), 0 if none
+static uint32_t DeviceBlockSize(const char* input)
+{
+    const char* scrap = strstr(input, "SCRAP info");
+    const char* p = strstr(scrap != nullptr ? scrap : input, "blkSz ");
+    return p != nullptr ? static_cast<uint32_t>(::strtoul(p + 6, nullptr, 10)) : 0;
+}
+
+// expected time per byte of the image with blocks of each size: the dl command round trip and the block's write,
+// over the part of the blocks that get through (the failures so far spread evenly over the bytes sent). a clean
+// link takes the largest blocks, a failing one smaller blocks that cost less to send again.
+uint32_t FwUpdateEngine::ChooseBlockSize() const
+{
+    if (_link.bytes_per_second <= 0)
+    {
+        return BlockSize;
+    }
+    const double failures_per_byte = static_cast<double>(_link.failed_blocks) / std::max<size_t>(_link.bytes_sent, 1);
+    uint32_t best_size = BlockSize;
+    double best_cost = 0;
+    for (uint32_t size = MinBlockSize; size <= MaxBlockSize; size *= 2)
+    {
+        const double success = std::max(0.1, std::exp(-failures_per_byte * size));
+        const double seconds = _link.command_seconds + size / _link.bytes_per_second;
+        const double cost = seconds / (size * success);
+        if (best_cost == 0 || cost < best_cost)
+        {
+            best_cost = cost;
+            best_size = size;
+        }
+    }
+    LOG_DEBUG(LOG_TAG, "Link %.0f bytes/s, dl %.1f ms, %zu failed blocks in %zu bytes: block size %u",
+              _link.bytes_per_second, _link.command_seconds * 1000, _link.failed_blocks, _link.bytes_sent, best_size);
+    return best_size;
+}
+
+void FwUpdateEngine::LinkEstimate::Measure(size_t bytes, std::chrono::steady_clock::duration command,
+                                           std::chrono::steady_clock::duration write)
+{
+    const double command_s = std::chrono::duration<double>(command).count();
+    const double write_s = std::chrono::duration<double>(write).count();
+    // averaged over the recent blocks
+    command_seconds = bytes_sent == 0 ? command_s : 0.75 * command_seconds + 0.25 * command_s;
+    if (write_s > 0)
+    {
+        const double rate = bytes / write_s;
+        bytes_per_second = bytes_sent == 0 ? rate : 0.75 * bytes_per_second + 0.25 * rate;
+    }
+    bytes_sent += bytes;
+}
+
+// find the n'th (1 based) complete "dl ret=<result>" in the input
+static bool FindDlResult(const char* input, size_t n, int& result)
 {
     const char* dlRetStr = "dl ret=";
-    char* logBuf = _comm->GetScanPtr();
-    char* p = strstr(logBuf, dlRetStr);
-    int result = -1;
-    bool rv = false;
-    if (p)
+    const size_t dlRetLen = strlen(dlRetStr);
+    const char* p = input;
+    for (size_t i = 0; i < n; ++i)
     {
-        p += strlen(dlRetStr);
-        uint32_t n = sscanf(p, "%d", &result);
-        if (n != 1)
-            rv = false;
-        else
-            rv = result == 0;
+        p = strstr(p, dlRetStr);
+        if (p == nullptr)
+            return false;
+        p += dlRetLen;
     }
+    char* end = nullptr;
+    long value = ::strtol(p, &end, 10);
+    if (end == p || *end == '\0') // no number, or it may still be arriving
+        return false;
+    result = static_cast<int>(value);
+    return true;
+}
 
-    _comm->ConsumeScanned();
-    return rv;
+bool FwUpdateEngine::WaitForDlResult(size_t results_start, size_t n, std::chrono::milliseconds timeout, int& result)
+{
+    result = -1;
+    auto found = _comm->WaitFor(
+        results_start, [n, &result](const char* input) { return FindDlResult(input, n, result); }, timeout);
+    if (!found)
+    {
+        LOG_ERROR(LOG_TAG, "No result for block #%zu after %zu millis", n, timeout.count());
+        return false;
+    }
+    return true;
 }
 
-void FwUpdateEngine::BurnModule(ProgressTick tick, const ModuleInfo& module, const Buffer& buffer, bool is_first,
-                                bool is_last, bool force_full)
+// the first block may take the worst case, later ones a margin over the slowest block so far
+static std::chrono::milliseconds BlockResultTimeout(std::chrono::milliseconds slowest, uint32_t block_size)
 {
-    // send dlver command to get the module's state
+    const std::chrono::milliseconds worst_case {2000 * block_size / (64 * 1024)};
+    const std::chrono::milliseconds min_timeout {2000};
+    if (slowest.count() == 0)
+        return worst_case;
+    return std::min(worst_case, std::max(min_timeout, slowest * 3));
+}
+
+void FwUpdateEngine::BurnModule(ProgressTick tick, const ModuleInfo& image_module, bool is_first, bool is_last,
+                                bool force_full)
+{
+    // the module's blocks may be split to another size than the image's for this device
+    ModuleInfo module = image_module;
+
+    // send dlver command to get the module's state, done as soon as the module's line arrives
     _comm->WriteCmd(Cmds::dlver());
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
     ModuleVersionInfo version_info;
+    _comm->WaitFor([&](const char* input) { return ParseDlVer(input, module.name, version_info); },
+                   std::chrono::milliseconds {1000});
     bool success = ConsumeDlVerResponse(module.name, version_info);
     if (!success)
     {
         throw std::runtime_error("Failed parsing verinfo response");
     }
-    // send dlinfo command to get the module's block info
-    _comm->WriteCmd(Cmds::dlinfo(module.name));
-    _comm->WaitForStr("dlinfo end", std::chrono::milliseconds {1000});
-    auto block_update_list = FwUpdateEngine::GetBlockUpdateList(module, force_full);
+    // blocks the journal recorded as confirmed are known good while the device is still mid-update of the
+    // module. if all of them are, the device's block info is not needed. a full update ignores the journal.
+    std::vector<bool> journaled(module.blocks.size(), false);
+    size_t n_journaled = 0;
+    if (_journal && !force_full && version_info.state == ModuleVersionInfo::State::ActiveUpdating)
+    {
+        for (size_t i = 0; i < module.blocks.size(); ++i)
+        {
+            journaled[i] = _journal->IsConfirmed(module.name, i);
+            n_journaled += journaled[i] ? 1 : 0;
+        }
+    }
+    std::vector<bool> block_update_list;
+    if (n_journaled > 0 && n_journaled == module.blocks.size())
+    {
+        LOG_DEBUG(LOG_TAG, "Module %s: all blocks confirmed in journal", module.name.c_str());
+        block_update_list.assign(module.blocks.size(), false);
+    }
+    else
+    {
+        // send dlinfo command to get the module's block info
+        _comm->WriteCmd(Cmds::dlinfo(module.name));
+        _comm->WaitForStr("dlinfo end", std::chrono::milliseconds {1000});
+        // the device's blocks may be of another size (an earlier update with adaptive_block_size): compare the
+        // crcs of blocks of its size. the journal's blocks are of the image's size, they do not apply then.
+        const auto device_block_size = DeviceBlockSize(_comm->GetScanPtr());
+        if (device_block_size != 0 && device_block_size != module.block_size)
+        {
+            LOG_DEBUG(LOG_TAG, "Module %s: device block size %u", module.name.c_str(), device_block_size);
+            SplitIntoBlocks(module, device_block_size);
+            journaled.assign(module.blocks.size(), false);
+            n_journaled = 0;
+        }
+        block_update_list = FwUpdateEngine::GetBlockUpdateList(module, force_full);
+        if (n_journaled > 0)
+        {
+            LOG_DEBUG(LOG_TAG, "Module %s: resuming, %zu blocks confirmed in journal", module.name.c_str(),
+                      n_journaled);
+            for (size_t i = 0; i < module.blocks.size(); ++i)
+            {
+                if (journaled[i])
+                    block_update_list[i] = false;
+            }
+        }
+    }
     assert(module.blocks.size() == block_update_list.size());
     auto n_updates = std::count(block_update_list.begin(), block_update_list.end(), true);
     auto need_update = n_updates > 0;
@@ -278,10 +463,7 @@ void FwUpdateEngine::BurnModule(ProgressTick tick, const ModuleInfo& module, con
     {
         LOG_DEBUG(LOG_TAG, "No need to update module, skipping...");
 
-        for (uint32_t i = 0; i < module.blocks.size(); ++i)
-        {
-            tick();
-        }
+        tick(static_cast<float>(image_module.blocks.size()));
 
         if (is_last)
         {
@@ -302,9 +484,42 @@ void FwUpdateEngine::BurnModule(ProgressTick tick, const ModuleInfo& module, con
         std::fill(block_update_list.begin(), block_update_list.end(), true);
     }
 
+    // with adaptive_block_size a fresh transfer offers the device the block size that suits the link so far. a
+    // device taking it answers the size it uses, and the blocks and their crcs follow it.
+    const bool offer_block_size = _adaptive_block_size && !_journal &&
+                                  version_info.state != ModuleVersionInfo::State::ActiveUpdating;
+    const uint32_t preferred_block_size = offer_block_size ? ChooseBlockSize() : 0;
+
     // send dlinit - if we're starting a session, open it
-    _comm->WriteCmd(Cmds::dlinit(module.name, module.version, module.size, is_first, module.crc, BlockSize));
-    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    // the device is ready for the CRCs once it acks dlinit
+    _comm->WriteCmd(Cmds::dlinit(module.name, module.version, module.size, is_first, module.crc, module.block_size,
+                                 _compress_blocks, preferred_block_size));
+    const auto dlinit_ack = (_compress_blocks || offer_block_size) ? DlinitAckLine() : std::string {};
+    const bool compress = _compress_blocks && dlinit_ack.find("cmp=lz4") != std::string::npos;
+    if (_compress_blocks)
+    {
+        LOG_INFO(LOG_TAG, "Module %s: %s", module.name.c_str(),
+                 compress ? "sending compressed blocks" : "device does not take compressed blocks");
+    }
+    if (offer_block_size)
+    {
+        const auto pos = dlinit_ack.find("blksz=");
+        const auto device_block_size =
+            pos != std::string::npos ? ::strtoul(dlinit_ack.c_str() + pos + 6, nullptr, 10) : module.block_size;
+        if (device_block_size == 0 || device_block_size % 4096 != 0 || device_block_size > MaxBlockSize)
+        {
+            throw std::runtime_error("Invalid block size in dlinit ack: " + dlinit_ack);
+        }
+        if (device_block_size != module.block_size)
+        {
+            SplitIntoBlocks(module, static_cast<uint32_t>(device_block_size));
+            block_update_list.assign(module.blocks.size(), true);
+        }
+        LOG_INFO(LOG_TAG, "Module %s: block size %u (preferred %u)", module.name.c_str(), module.block_size,
+                 preferred_block_size);
+    }
+    // the progress of the image's blocks, whatever size the module's blocks are
+    const float tick_share = static_cast<float>(image_module.blocks.size()) / module.blocks.size();
 
     // send CRCs of all blocks to fw as binary array of [n x uin32_t] bytes (little endian)
     std::vector<uint32_t> blkCrc;
@@ -316,41 +531,146 @@ void FwUpdateEngine::BurnModule(ProgressTick tick, const ModuleInfo& module, con
     _comm->ConsumeScanned();
 
     LOG_DEBUG(LOG_TAG, "Starting module %s update", module.name.c_str());
-    for (auto i = 0; i < module.blocks.size(); ++i)
+
+    // without pipelining each block is confirmed before the next one is sent.
+    // with it the next block's data is sent while the device still writes the previous one.
+    const size_t window = _pipeline_blocks ? PipelineWindow : 1;
+    const size_t results_start = _comm->ReadIndex();
+    struct SentBlock
     {
-        bool should_update_block = block_update_list[i];
-        if (!should_update_block)
+        size_t index;
+        std::chrono::steady_clock::time_point send_time;
+        size_t retries;
+        std::vector<unsigned char> compressed; // the data sent, if compressed
+    };
+    std::deque<SentBlock> in_flight; // blocks not confirmed yet
+    std::chrono::milliseconds slowest_block {0};
+    size_t n_results = 0; // "dl ret=" results received, one for each block sent (retries too)
+    std::vector<unsigned char> scratch; // only for the last block, if it reaches past the module's data
+
+    // with compression the blocks to send are compressed on other threads, up to CompressAhead blocks ahead of the
+    // one being sent, so the link does not wait for the compression
+    std::vector<size_t> blocks_to_send;
+    for (size_t i = 0; i < module.blocks.size(); ++i)
+    {
+        if (block_update_list[i])
+            blocks_to_send.push_back(i);
+    }
+    std::deque<std::future<std::vector<unsigned char>>> compressed_ahead;
+    size_t n_compress_started = 0;
+    auto compress_ahead = [&]() {
+        while (compress && n_compress_started < blocks_to_send.size() && compressed_ahead.size() < CompressAhead)
         {
-            LOG_DEBUG(LOG_TAG, "Module %s, block #%d already up-to-date, skipping...", module.name.c_str(), i);
-            continue;
+            const BlockInfo& block = module.blocks[blocks_to_send[n_compress_started++]];
+            compressed_ahead.push_back(std::async(std::launch::async, [&module, &block]() {
+                std::vector<unsigned char> block_scratch;
+                std::vector<unsigned char> compressed;
+                Lz4Compress(BlockData(module, block, block_scratch), block.size, compressed);
+                return compressed;
+            }));
         }
+    };
+    compress_ahead();
+    size_t bytes_sent = 0;
+    size_t bytes_raw = 0;
 
-        LOG_DEBUG(LOG_TAG, "Module %s, block #%d, updating...", module.name.c_str(), i);
-
+    // send the block (its compressed data if not empty) and measure the link with it
+    auto send_block = [&](size_t i, size_t retries, std::vector<unsigned char> compressed) {
+        LOG_DEBUG(LOG_TAG, "Module %s, block #%zu, updating...", module.name.c_str(), i);
         auto sz = module.blocks[i].size;
-        const unsigned char* sendBuf = buffer.data() + module.blocks[i].offset;
-
-        size_t sendSz = sz;
-
-        _comm->WriteCmd(Cmds::dl(i));
-        _comm->WaitForIdle();
-        bool dlAck = ParseDlResponse(module.name, i, sz);
+        const size_t compressed_size = compressed.size();
+        const unsigned char* sendBuf =
+            compressed_size > 0 ? compressed.data() : BlockData(module, module.blocks[i], scratch);
+        const size_t sendSz = compressed_size > 0 ? compressed_size : sz;
+        bytes_sent += sendSz;
+        bytes_raw += sz;
+
+        const auto command_start = std::chrono::steady_clock::now();
+        _comm->WriteCmd(Cmds::dl(i, compressed_size));
+        auto dl_response = DlResponseStr(module.name, i, sz, compressed_size);
+        _comm->WaitFor([&dl_response](const char* input) { return strstr(input, dl_response.c_str()) != nullptr; },
+                       std::chrono::milliseconds {1000});
+        bool dlAck = ParseDlResponse(module.name, i, sz, compressed_size);
         if (!dlAck)
         {
             throw std::runtime_error("Did not receive 'dl ack'");
         }
-
+        const auto write_start = std::chrono::steady_clock::now();
         _comm->WriteBinary((char*)sendBuf, sendSz);
+        _link.Measure(sendSz, write_start - command_start, std::chrono::steady_clock::now() - write_start);
+        in_flight.push_back(SentBlock {i, std::chrono::steady_clock::now(), retries, std::move(compressed)});
+    };
 
-        auto timeoutMs = 2000 * BlockSize / (64 * 1024);
-        _comm->WaitForStr("dl ret=", std::chrono::milliseconds {timeoutMs});
-        auto dlErr = ParseDlBlockResult();
-        if (!dlErr)
+    // a block the device failed to write is sent again (only that block), up to MaxBlockRetries times
+    auto confirm_block = [&]() {
+        auto timeout = BlockResultTimeout(slowest_block, module.block_size);
+        int result = -1;
+        if (!WaitForDlResult(results_start, ++n_results, timeout, result))
         {
             throw std::runtime_error("Error while parsing block");
         }
+        SentBlock sent = std::move(in_flight.front());
+        in_flight.pop_front();
+        if (result != 0)
+        {
+            ++_link.failed_blocks;
+            if (sent.retries >= MaxBlockRetries)
+            {
+                throw std::runtime_error("Block " + std::to_string(sent.index) + " failed, ret=" +
+                                         std::to_string(result));
+            }
+            LOG_WARNING(LOG_TAG, "Module %s, block #%zu failed (ret=%d), sending it again", module.name.c_str(),
+                        sent.index, result);
+            send_block(sent.index, sent.retries + 1, std::move(sent.compressed));
+            return;
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() -
+                                                                             sent.send_time);
+        if (_journal && module.block_size == image_module.block_size) // the journal keeps the image's blocks
+        {
+            _journal->Confirm(module.name, sent.index);
+        }
+        slowest_block = std::max(slowest_block, elapsed);
+        tick(tick_share);
+    };
+
+    for (size_t i = 0; i < module.blocks.size(); ++i)
+    {
+        bool should_update_block = block_update_list[i];
+        if (!should_update_block)
+        {
+            LOG_DEBUG(LOG_TAG, "Module %s, block #%zu already up-to-date, skipping...", module.name.c_str(), i);
+            continue;
+        }
 
-        tick();
+        while (in_flight.size() >= window)
+        {
+            confirm_block();
+        }
+
+        // a block that does not get smaller is sent as is
+        std::vector<unsigned char> compressed;
+        if (compress)
+        {
+            compressed = compressed_ahead.front().get();
+            compressed_ahead.pop_front();
+            compress_ahead();
+            if (compressed.size() >= module.blocks[i].size)
+            {
+                compressed.clear();
+            }
+        }
+        send_block(i, 0, std::move(compressed));
+    }
+    while (!in_flight.empty())
+    {
+        confirm_block();
+    }
+    _comm->ConsumeScanned();
+    if (compress)
+    {
+        LOG_DEBUG(LOG_TAG, "Module %s: sent %zu bytes for %zu bytes of blocks", module.name.c_str(), bytes_sent,
+                  bytes_raw);
     }
 
     // update finished - send dlver, receive response and check crcs
@@ -388,16 +708,9 @@ void FwUpdateEngine::Session(const ModuleVector& modules, ProgressTick tick, boo
     for (int i = 0; i < modules.size(); ++i)
     {
         const auto& module = modules.at(i);
-
-        auto buffer = LoadFileToBuffer(module.filename, module.aligned_size, module.size, module.file_offset);
-        if (buffer.empty())
-        {
-            throw std::runtime_error("Failed loading firwmare file");
-        }
-
         auto is_first_module = i == 0;
         auto is_last_module = i == modules.size() - 1;
-        BurnModule(tick, module, buffer, is_first_module, is_last_module, force_full);
+        BurnModule(tick, module, is_first_module, is_last_module, force_full);
 
         LOG_INFO(LOG_TAG, "Module %s done", module.name.c_str());
     }
@@ -419,6 +732,77 @@ ModuleVector FwUpdateEngine::ModulesFromFile(const std::string& path)
     return modules;
 }
 
+// 1. Probe that the host connection can change its baud rate at all.
+// 2. Ask the device to switch (dlspd). A device not supporting the rate does not ack it.
+// 3. Switch the host and verify the link with dlver.
+// On failure fall back to the default baud rate on both sides.
+long FwUpdateEngine::NegotiateBaudRate(long baud_rate)
+{
+    const long default_rate = Settings::DefaultBaudRate;
+    if (baud_rate != default_rate && !_comm->SetBaudRate(default_rate))
+    {
+        LOG_WARNING(LOG_TAG, "Connection does not support baud rate change, using %ld", default_rate);
+        baud_rate = default_rate;
+    }
+
+    if (baud_rate == default_rate)
+    {
+        _comm->WriteCmd(Cmds::dlspd(default_rate), true);
+        _comm->WriteCmd(Cmds::dlver(), true);
+        return default_rate;
+    }
+
+    try
+    {
+        _comm->WriteCmd(Cmds::dlspd(baud_rate), true);
+    }
+    catch (const std::exception&)
+    {
+        LOG_WARNING(LOG_TAG, "Device did not accept baud rate %ld, using %ld", baud_rate, default_rate);
+        _comm->WriteCmd(Cmds::dlspd(default_rate), true);
+        _comm->WriteCmd(Cmds::dlver(), true);
+        return default_rate;
+    }
+
+    try
+    {
+        if (!_comm->SetBaudRate(baud_rate))
+        {
+            throw std::runtime_error("Failed to set host baud rate");
+        }
+        _comm->WriteCmd(Cmds::dlver(), true);
+        LOG_INFO(LOG_TAG, "Switched to baud rate %ld", baud_rate);
+        return baud_rate;
+    }
+    catch (const std::exception&)
+    {
+        // the device took the new rate: switch it back at that rate (it may still hear us), then the host
+        LOG_WARNING(LOG_TAG, "No response at baud rate %ld, falling back to %ld", baud_rate, default_rate);
+        try
+        {
+            _comm->WriteCmd(Cmds::dlspd(default_rate), true);
+        }
+        catch (const std::exception& ex)
+        {
+            LOG_WARNING(LOG_TAG, "Device did not confirm the switch back: %s", ex.what());
+        }
+        if (!_comm->SetBaudRate(default_rate))
+        {
+            throw std::runtime_error("Failed to restore host baud rate");
+        }
+        try
+        {
+            _comm->WriteCmd(Cmds::dlver(), true);
+        }
+        catch (const std::exception&)
+        {
+            throw std::runtime_error("Lost the device after switching to baud rate " + std::to_string(baud_rate) +
+                                     ", power cycle it to retry");
+        }
+        return default_rate;
+    }
+}
+
 void FwUpdateEngine::BurnModules(const Settings& settings, const ModuleVector& modules, ProgressCallback on_progress)
 {
 	if (modules.empty())
@@ -438,25 +822,59 @@ void FwUpdateEngine::BurnModules(const Settings& settings, const ModuleVector& m
 
     float overall_progress = 0.0f;
     // wrap external progress callback with a "tick progress" lambda, called every time a block is sent.
-    auto progress_tick = [progress_delta, on_progress, &overall_progress]() {
-        overall_progress += progress_delta;
+    auto progress_tick = [progress_delta, on_progress, &overall_progress](float blocks) {
+        overall_progress += progress_delta * blocks;
         on_progress(overall_progress);
     };
 
+    _pipeline_blocks = settings.pipeline_blocks;
+    _compress_blocks = settings.compress_blocks;
+    _adaptive_block_size = settings.adaptive_block_size;
 #ifdef ANDROID
     _comm = std::make_unique<FwUpdaterComm>(settings.android_config);
 #else
     _comm = std::make_unique<FwUpdaterComm>(settings.port);
 #endif
+    _journal.reset();
     try
     {
+        if (!settings.journal_path.empty())
+        {
+            _journal = std::make_unique<UpdateJournal>(settings.journal_path, settings.device_id, modules);
+            if (settings.force_full)
+            {
+                _journal->Clear(); // every block is sent again
+            }
+        }
+
         _comm->WaitForIdle();
-        _comm->WriteCmd(Cmds::dlspd(settings.baud_rate), true);
-        _comm->WriteCmd(Cmds::dlver(), true);
+        // checked at the default baud rate, before the update is set up
+        if (settings.skip_up_to_date && !settings.force_full && DeviceRunsModules(modules))
+        {
+            LOG_INFO(LOG_TAG, "Device already runs the image's modules, update skipped");
+            on_progress(1.0f);
+            return;
+        }
+        _link = LinkEstimate {};
+        _link.bytes_per_second = NegotiateBaudRate(settings.baud_rate) / 10.0;
+        if (_adaptive_block_size)
+        {
+            // probe a command round trip of the link. the blocks sent measure it from then on.
+            const auto probe_start = std::chrono::steady_clock::now();
+            _comm->WriteCmd(Cmds::dlver(), true);
+            _link.command_seconds =
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - probe_start).count();
+            _comm->WaitForIdle();
+            _comm->ConsumeScanned();
+        }
 
         on_progress(0.0f);
 
         Session(modules, progress_tick, settings.force_full);
+        if (_journal)
+        {
+            _journal->Clear();
+        }
         on_progress(1.0f);
     }
     catch (const std::exception&)
@@ -4,6 +4,8 @@
 
 #include "FwUpdaterComm.h"
 #include "ModuleInfo.h"
+#include "UpdateJournal.h"
+#include <chrono>
 #include <string>
 #include <functional>
 #include <vector>
@@ -17,17 +19,33 @@ class FwUpdateEngine
 {
 public:
     using ProgressCallback = std::function<void(float)>;
-    using ProgressTick = std::function<void()>;
-    using Buffer = std::vector<unsigned char>;
+    // called as blocks are done, with the number of the image's blocks they make up
+    using ProgressTick = std::function<void(float)>;
 
     struct Settings
     {
+        // the device starts at the default baud rate. a different baud_rate is negotiated with dlspd, falling back
+        // to the default if the device or the host connection does not support it.
         static const long DefaultBaudRate = 115200;
 
         std::string fw_filename;
         const char* port = nullptr;
         long baud_rate = DefaultBaudRate;
         bool force_full = false; // if true update all modules and blocks regardless of crc checks
+        bool pipeline_blocks = false; // send a block while the device still writes the previous one
+        // offer the device lz4 compressed blocks in dlinit. if it accepts, each block to send is compressed (a few
+        // blocks ahead of the transfer, in parallel) and sent compressed if smaller.
+        bool compress_blocks = false;
+        // choose each module's block size by the link (a smaller one after failed blocks) and offer it in dlinit.
+        // the device answers the size it uses. not with a journal, whose blocks are of the default size.
+        bool adaptive_block_size = false;
+        // if the device reports every module of the image active with the image's version (one dlver), the update
+        // is skipped: no per module exchange, activation or reboot. ignored with force_full.
+        bool skip_up_to_date = false;
+        // if not empty, the blocks confirmed by the device are recorded in this file, and an interrupted update
+        // of the same image to the same device continues from them
+        std::string journal_path;
+        std::string device_id; // the device's key in the journal, e.g. its serial number
 #ifdef ANDROID
         AndroidSerialConfig android_config;
 #endif
@@ -36,30 +54,69 @@ public:
     FwUpdateEngine() = default;
     ~FwUpdateEngine() = default;
 
+    // the modules reference the file's read only mapping, they can be shared by the updates of several devices
     ModuleVector ModulesFromFile(const std::string& filename);
     void BurnModules(const Settings& settings, const ModuleVector& modules, ProgressCallback on_progress);
 
 
 private:
     static constexpr const uint32_t BlockSize = 512 * 1024;
+    // bounds of the block sizes offered with adaptive_block_size (and accepted from the device)
+    static constexpr const uint32_t MinBlockSize = 64 * 1024;
+    static constexpr const uint32_t MaxBlockSize = 512 * 1024;
+    // times a block the device failed to write is sent again
+    static constexpr const size_t MaxBlockRetries = 2;
+    // blocks sent and not confirmed by their "dl ret=" yet, in pipelined mode
+    static constexpr const size_t PipelineWindow = 2;
+    // blocks compressed ahead of the one being sent, with compress_blocks
+    static constexpr const size_t CompressAhead = 4;
 
     struct ModuleVersionInfo;
 
+    // the link's measurements in the session, for the block size of the next module
+    struct LinkEstimate
+    {
+        double bytes_per_second = 0;   // of the block writes
+        double command_seconds = 0.02; // round trip of a command and its ack
+        size_t bytes_sent = 0;
+        size_t failed_blocks = 0;
+
+        void Measure(size_t bytes, std::chrono::steady_clock::duration command,
+                     std::chrono::steady_clock::duration write);
+    };
+
+    // switch host and device to the given baud rate, or stay at the default one
+    // return the baud rate in use
+    long NegotiateBaudRate(long baud_rate);
+
     // do complete fw update session
     void Session(const ModuleVector& modules, ProgressTick progress_tick, bool force_full);
 
     // update single module
-    void BurnModule(ProgressTick tick, const ModuleInfo& module, const Buffer& buffer, bool is_first, bool is_last,
-                    bool force_full);
+    void BurnModule(ProgressTick tick, const ModuleInfo& image_module, bool is_first, bool is_last, bool force_full);
+
+    // true if the device's dlver lists each of the modules active with the module's version
+    bool DeviceRunsModules(const ModuleVector& modules);
 
     std::vector<bool> GetBlockUpdateList(const ModuleInfo& module, bool force_full);
 
     bool ConsumeDlVerResponse(const std::string& module_name, ModuleVersionInfo& module_info);
-    bool ParseDlResponse(const std::string& name, size_t blkNo, size_t sz);
+    bool ParseDlResponse(const std::string& name, size_t blkNo, size_t sz, size_t compressed_size);
+    // the device's dlinit ack line, with its answers to the offers of dlinit
+    std::string DlinitAckLine();
+    // the block size for the link so far (adaptive_block_size)
+    uint32_t ChooseBlockSize() const;
     bool ParseDlVer(const char* input, const std::string& module_name, ModuleVersionInfo& result);
-    bool ParseDlBlockResult();
+    // wait for the result of the n'th block (1 based) sent since the given read index.
+    // return false if it did not arrive, else the result is the value of its 'dl ret=' (0 - written)
+    bool WaitForDlResult(size_t results_start, size_t n, std::chrono::milliseconds timeout, int& result);
 
     std::unique_ptr<FwUpdaterComm> _comm;
+    std::unique_ptr<UpdateJournal> _journal;
+    bool _pipeline_blocks = false;
+    bool _compress_blocks = false;
+    bool _adaptive_block_size = false;
+    LinkEstimate _link;
 };
 } // namespace FwUpdate
 } // namespace RealSenseID
@@ -2,12 +2,15 @@
 // Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
 #include "FwUpdaterComm.h"
 #include "Logger.h"
+#include "RealTimeMode.h"
+#include "LibraryMemory.h"
 #include "PacketManager/Timer.h"
 
 #include <cstring>
 #include <cassert>
 #include <cmath>
 #include <stdexcept>
+#include <algorithm>
 
 #ifdef _WIN32
 #include "PacketManager/WindowsSerial.h"
@@ -29,7 +32,9 @@ static const char* LOG_TAG = "FwUpdater";
 
 FwUpdaterComm::FwUpdaterComm(const char* port_name)
 {
-    _read_buffer = new char[ReadBufferSize];
+    _read_buffer = static_cast<char*>(
+        Memory::Allocate(ReadBufferSize, alignof(std::max_align_t), Memory::Category::SerialBuffers));
+    _read_buffer[0] = '\0';
     PacketManager::SerialConfig serial_config;
     serial_config.port = port_name;
 
@@ -42,16 +47,18 @@ FwUpdaterComm::FwUpdaterComm(const char* port_name)
 #endif // WIN32
 
     // create thread thread
-    _reader_thread = std::thread([this] { this->ReaderThreadLoop(); });
+    _reader_thread = LibraryThread([this] { this->ReaderThreadLoop(); });
 }
 
 #ifdef ANDROID
 FwUpdaterComm::FwUpdaterComm(const AndroidSerialConfig& config)
 {
-    _read_buffer = new char[ReadBufferSize];
+    _read_buffer = static_cast<char*>(
+        Memory::Allocate(ReadBufferSize, alignof(std::max_align_t), Memory::Category::SerialBuffers));
+    _read_buffer[0] = '\0';
     _serial = std::make_unique<PacketManager::AndroidSerial>(config.fileDescriptor, config.readEndpoint, config.writeEndpoint);
     // create thread thread
-    _reader_thread = std::thread([this] { this->ReaderThreadLoop(); });
+    _reader_thread = LibraryThread([this] { this->ReaderThreadLoop(); });
 }
 #endif
 
@@ -67,7 +74,7 @@ FwUpdaterComm::~FwUpdaterComm()
     
     try
     {        
-        delete (_read_buffer);
+        Memory::Deallocate(_read_buffer, ReadBufferSize);
     }
     catch (...)
     {
@@ -76,27 +83,42 @@ FwUpdaterComm::~FwUpdaterComm()
 
 void FwUpdaterComm::ReaderThreadLoop()
 {
+    RealTimeMode::EnterIoThread("firmware update reader");
+    char chunk[4096];
     while (!_should_stop_thread)
     {
-        if (_read_index >= ReadBufferSize - 2)
+        size_t n_bytes = 0;
+        auto status = this->_serial->RecvAvailable(chunk, sizeof(chunk), n_bytes);
+        if (status == PacketManager::SerialStatus::RecvTimeout)
         {
-            // should never happen on normal execution, since 128kb should be enough for the entire session
-            assert(false);
-            _read_index = 0;
-            _scan_index = 0;
-        }
-        auto status = this->_serial->RecvBytes(&_read_buffer[_read_index], 1);
-        if (status == PacketManager::SerialStatus::Ok)
-        {
-            // putchar((int)_read_buffer[_read_index]);
-            _read_buffer[++_read_index] = '\0'; // always null terminate
             continue;
         }
-        if (status != PacketManager::SerialStatus::RecvTimeout)
+        if (status != PacketManager::SerialStatus::Ok)
         {
             break; // fail reading from the serial
         }
+        {
+            std::lock_guard<std::mutex> lock {_data_mutex};
+            if (_read_index + n_bytes >= ReadBufferSize - 1)
+            {
+                // should never happen on normal execution, since 128kb should be enough for the entire session
+                assert(false);
+                _read_index = 0;
+                _scan_index = 0;
+                n_bytes = std::min(n_bytes, ReadBufferSize - 1);
+            }
+            ::memcpy(&_read_buffer[_read_index], chunk, n_bytes);
+            _read_index += n_bytes;
+            _read_buffer[_read_index] = '\0'; // always null terminate
+            _last_data_time = std::chrono::steady_clock::now();
+        }
+        _data_cv.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock {_data_mutex};
+        _reader_stopped = true;
     }
+    _data_cv.notify_all();
 }
 
 void FwUpdaterComm::ConsumeScanned()
@@ -119,15 +141,22 @@ char* FwUpdaterComm::ReadBuffer() const
 // wait until no more input (100 ms without any new bytes)
 size_t FwUpdaterComm::WaitForIdle()
 {
-    while (true)
+    constexpr std::chrono::milliseconds idle_time {100};
+    std::unique_lock<std::mutex> lock {_data_mutex};
+    auto idle_since = std::chrono::steady_clock::now();
+    while (!_reader_stopped)
     {
-        auto prevIndex = _read_index.load();
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        if (prevIndex == _read_index.load())
+        // each arrival wakes this up and the idle time restarts from it
+        auto got_data = _data_cv.wait_until(lock, idle_since + idle_time, [this, idle_since] {
+            return _reader_stopped || _last_data_time > idle_since;
+        });
+        if (!got_data)
         {
-            return _read_index.load();
+            break;
         }
+        idle_since = _last_data_time;
     }
+    return _read_index.load();
 }
 
 // 1. Break binary data into chunks of 16kb.
@@ -160,13 +189,14 @@ void FwUpdaterComm::WriteBinary(const char* buf, size_t n_bytes)
     }    
 }
 
-// 1. Wait until input drained
+// 1. Consume the input so far, the response is scanned from here
 // 2. Send the command
 // 3. Wait for cmd "ack" upto 1 second, if wait_response is true
 void FwUpdaterComm::WriteCmd(const std::string& cmd, bool wait_response)
 {
     LOG_DEBUG(LOG_TAG, "WriteCmd \"%s\"", cmd.c_str());
-    WaitForIdle();
+    // each response is waited for up to its terminator or ack, so there is no need to wait for idle input
+    ConsumeScanned();
     auto serial_status = _serial->SendBytes(cmd.c_str(), cmd.length());
     if (serial_status != PacketManager::SerialStatus::Ok)
     {
@@ -192,6 +222,11 @@ void FwUpdaterComm::WriteCmd(const std::string& cmd, bool wait_response)
     WaitForStr(first_word.c_str(), timeout);
 }
 
+bool FwUpdaterComm::SetBaudRate(long baud_rate)
+{
+    return _serial->SetBaudRate(static_cast<unsigned int>(baud_rate));
+}
+
 void FwUpdaterComm::WaitForStr(const char* wait_str, std::chrono::milliseconds timeout)
 {
     using PacketManager::SerialStatus;
@@ -205,26 +240,36 @@ void FwUpdaterComm::WaitForStr(const char* wait_str, std::chrono::milliseconds t
         return;
     }
 
-    LOG_DEBUG(LOG_TAG, "waiting [%s] for %zu millis..", wait_str, timeout.count());    
-    auto scan_idx = _scan_index.load();
-
-    while (!timer.ReachedTimeout())
+    LOG_DEBUG(LOG_TAG, "waiting [%s] for %zu millis..", wait_str, timeout.count());
+    auto found = WaitFor([wait_str](const char* input) { return strstr(input, wait_str) != nullptr; }, timeout);
+    if (found)
     {
-        WaitForIdle();
+        LOG_DEBUG(LOG_TAG, "Got the expected str \"%s\" after %zu millis", wait_str, timer.Elapsed().count());
+        return;
+    }
+    ConsumeScanned();
+    throw std::runtime_error("FwUpdaterComm::WaitForStr failed");
+}
 
-        auto found = strstr(&_read_buffer[scan_idx], wait_str) != nullptr;
-        if (found)
-        {
-            LOG_DEBUG(LOG_TAG, "Got the expected str \"%s\" after %zu millis", wait_str, timer.Elapsed().count());            
-            return;
-        }
+bool FwUpdaterComm::WaitFor(const std::function<bool(const char*)>& predicate, std::chrono::milliseconds timeout)
+{
+    return WaitFor(_scan_index.load(), predicate, timeout);
+}
 
-        if (timer.ReachedTimeout())
-        {                        
-            ConsumeScanned();
-            throw std::runtime_error("FwUpdaterComm::WaitForStr failed");            
-        }
-    }    
+bool FwUpdaterComm::WaitFor(size_t from_index, const std::function<bool(const char*)>& predicate,
+                            std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock {_data_mutex};
+    from_index = std::min(from_index, _read_index.load()); // the buffer may have wrapped
+    auto done = _data_cv.wait_for(lock, timeout, [this, from_index, &predicate] {
+        return _reader_stopped || predicate(&_read_buffer[from_index]);
+    });
+    return done && predicate(&_read_buffer[from_index]);
+}
+
+size_t FwUpdaterComm::ReadIndex() const
+{
+    return _read_index.load();
 }
 
 void FwUpdaterComm::StopReaderThread()
@@ -232,6 +277,7 @@ void FwUpdaterComm::StopReaderThread()
     _should_stop_thread = true;
     if (_reader_thread.joinable())
     {
+        _serial->InterruptRecv(); // don't wait for the receive timeout
         LOG_DEBUG(LOG_TAG, "Stopping reader thread..");
         _reader_thread.join();
         LOG_DEBUG(LOG_TAG, "Reader thread stopped");
@@ -3,11 +3,15 @@
 #pragma once
 
 #include "PacketManager/SerialConnection.h"
+#include "LibraryThread.h"
 #include <memory>
 #include <thread>
 #include <chrono>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
 #include <string>
+#include <functional>
 #ifdef ANDROID
 #include "RealSenseID/AndroidSerialConfig.h"
 #endif
@@ -36,7 +40,8 @@ public:
     // throw std::runtime_error if failed
     char* ReadBuffer() const;
 
-    // wait until no more input (100 ms without any new bytes). return index to current data
+    // wait until no more input (100 ms without any new bytes). return index to current data.
+    // wakes up on each arrival, returns as soon as the 100 ms pass since the last one
     // throw std::runtime_error if failed
     size_t WaitForIdle();
 
@@ -44,16 +49,31 @@ public:
     // throw std::runtime_error if failed
     void WriteBinary(const char* buf, size_t n_bytes);
 
-    // 1. Wait until input drained
-    // 2. Send the comman
-    // 3 Waif for cmd "ack" upto 1 second, if wait_response is true
+    // 1. Consume the input so far, the response is scanned from here
+    // 2. Send the command
+    // 3. Wait for cmd "ack" upto 1 second, if wait_response is true
     // throw std::runtime_error if failed
     void WriteCmd(const std::string& cmd, bool wait_response = true);
     
+    // change the baud rate of the serial connection
+    // return false if failed or not supported by the connection
+    bool SetBaudRate(long baud_rate);
+
     // Wait until str appears in the serial input
     // throw std::runtime_error if failed
     void WaitForStr(const char* str, std::chrono::milliseconds timeout);
 
+    // Wait until predicate is true for the scanned input (GetScanPtr()), checked on each arrival of data.
+    // return false on timeout
+    bool WaitFor(const std::function<bool(const char*)>& predicate, std::chrono::milliseconds timeout);
+
+    // Same, for the input from the given index (a ReadIndex() taken earlier) regardless of what was scanned since
+    bool WaitFor(size_t from_index, const std::function<bool(const char*)>& predicate,
+                 std::chrono::milliseconds timeout);
+
+    // index of the end of the input received so far
+    size_t ReadIndex() const;
+
     // Stop and join the reading thread. 
     // Needed to avoid errors while connection is about to be closed befor reboot device
     void StopReaderThread();
@@ -61,12 +81,19 @@ public:
 
 private:
     std::unique_ptr<PacketManager::SerialConnection> _serial;
-    std::thread _reader_thread;
+    LibraryThread _reader_thread;
     std::atomic<bool> _should_stop_thread {false};
     std::atomic<size_t> _read_index {0};
     std::atomic<size_t> _scan_index {0};
     char* _read_buffer;
-    
+
+    // the reader thread receives chunks of whatever the serial has, appends them to _read_buffer (null terminated)
+    // and signals _data_cv, under _data_mutex. waiters scan the buffer under the same mutex.
+    std::mutex _data_mutex;
+    std::condition_variable _data_cv;
+    std::chrono::steady_clock::time_point _last_data_time;
+    bool _reader_stopped = false;
+
     void ReaderThreadLoop();
 };
 } // namespace FwUpdate
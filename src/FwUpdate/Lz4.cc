@@ -0,0 +1,108 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+#include "Lz4.h"
+#include <cstdint>
+#include <cstring>
+
+namespace RealSenseID
+{
+namespace FwUpdate
+{
+static constexpr size_t MinMatch = 4;
+static constexpr size_t MaxOffset = 65535;
+// the spec's end of block rules: the last match starts at least 12 bytes before the end, and the last 5 bytes are
+// literals
+static constexpr size_t MatchStartLimit = 12;
+static constexpr size_t LastLiterals = 5;
+static constexpr int HashLog = 16;
+
+static uint32_t Read32(const unsigned char* p)
+{
+    uint32_t value;
+    ::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t Hash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - HashLog);
+}
+
+// a length over the token's nibble continues in bytes of 255 and a last one of less
+static void WriteLength(unsigned char*& out, size_t length)
+{
+    while (length >= 255)
+    {
+        *out++ = 255;
+        length -= 255;
+    }
+    *out++ = static_cast<unsigned char>(length);
+}
+
+static void WriteSequence(unsigned char*& out, const unsigned char* literals, size_t literal_length, size_t offset,
+                          size_t match_length)
+{
+    unsigned char* token = out++;
+    *token = static_cast<unsigned char>((literal_length >= 15 ? 15 : literal_length) << 4);
+    if (literal_length >= 15)
+    {
+        WriteLength(out, literal_length - 15);
+    }
+    ::memcpy(out, literals, literal_length);
+    out += literal_length;
+    if (match_length == 0)
+    {
+        return; // the last literals
+    }
+    *out++ = static_cast<unsigned char>(offset & 0xFF);
+    *out++ = static_cast<unsigned char>(offset >> 8);
+    const size_t length_code = match_length - MinMatch;
+    *token |= static_cast<unsigned char>(length_code >= 15 ? 15 : length_code);
+    if (length_code >= 15)
+    {
+        WriteLength(out, length_code - 15);
+    }
+}
+
+size_t Lz4Compress(const unsigned char* src, size_t size, std::vector<unsigned char>& dst)
+{
+    dst.resize(size + size / 255 + 16); // the worst case: all literals
+    unsigned char* out = dst.data();
+    size_t anchor = 0; // start of the literals not written yet
+
+    if (size > MatchStartLimit)
+    {
+        // position + 1 of the last occurrence of each hashed 4 bytes (0 - none)
+        std::vector<uint32_t> table(size_t {1} << HashLog, 0);
+        const size_t match_start_end = size - MatchStartLimit;
+        const size_t match_end_limit = size - LastLiterals;
+        size_t pos = 0;
+        while (pos < match_start_end)
+        {
+            const uint32_t sequence = Read32(src + pos);
+            uint32_t& entry = table[Hash(sequence)];
+            const size_t candidate = entry;
+            entry = static_cast<uint32_t>(pos + 1);
+            if (candidate == 0 || pos - (candidate - 1) > MaxOffset || Read32(src + candidate - 1) != sequence)
+            {
+                ++pos;
+                continue;
+            }
+            const size_t match = candidate - 1;
+            size_t length = MinMatch;
+            while (pos + length < match_end_limit && src[match + length] == src[pos + length])
+            {
+                ++length;
+            }
+            WriteSequence(out, src + anchor, pos - anchor, pos - match, length);
+            pos += length;
+            anchor = pos;
+        }
+    }
+    WriteSequence(out, src + anchor, size - anchor, 0, 0);
+    const size_t compressed_size = static_cast<size_t>(out - dst.data());
+    dst.resize(compressed_size);
+    return compressed_size;
+}
+} // namespace FwUpdate
+} // namespace RealSenseID
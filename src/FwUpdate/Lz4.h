@@ -0,0 +1,18 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace RealSenseID
+{
+namespace FwUpdate
+{
+// Compress size bytes into a single LZ4 block (the raw block format of the LZ4 spec: sequences of literals and
+// matches, no frame header or checksum), as decompressed by the device. Greedy matching with a hash table of the
+// last position of each 4 bytes, matches up to 64KB back.
+// return the compressed size (dst is resized to it). a block that does not compress comes out slightly larger.
+size_t Lz4Compress(const unsigned char* src, size_t size, std::vector<unsigned char>& dst);
+} // namespace FwUpdate
+} // namespace RealSenseID
@@ -0,0 +1,127 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+#include "MappedFile.h"
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace RealSenseID
+{
+namespace FwUpdate
+{
+MappedFile::~MappedFile()
+{
+    Unmap();
+}
+
+const unsigned char* MappedFile::Data() const
+{
+    return _data;
+}
+
+size_t MappedFile::Size() const
+{
+    return _size;
+}
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string& path)
+{
+    HANDLE file_handle = ::CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                       FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_handle == INVALID_HANDLE_VALUE)
+    {
+        throw std::runtime_error("Failed to open file " + path);
+    }
+    _file_handle = file_handle;
+
+    LARGE_INTEGER file_size;
+    if (!::GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0)
+    {
+        Unmap();
+        throw std::runtime_error("File is empty " + path);
+    }
+
+    _mapping_handle = ::CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (_mapping_handle == nullptr)
+    {
+        Unmap();
+        throw std::runtime_error("Failed to map file " + path);
+    }
+    _data = static_cast<const unsigned char*>(::MapViewOfFile(_mapping_handle, FILE_MAP_READ, 0, 0, 0));
+    if (_data == nullptr)
+    {
+        Unmap();
+        throw std::runtime_error("Failed to map file " + path);
+    }
+    _size = static_cast<size_t>(file_size.QuadPart);
+}
+
+void MappedFile::Unmap()
+{
+    if (_data != nullptr)
+    {
+        ::UnmapViewOfFile(_data);
+        _data = nullptr;
+    }
+    if (_mapping_handle != nullptr)
+    {
+        ::CloseHandle(_mapping_handle);
+        _mapping_handle = nullptr;
+    }
+    if (_file_handle != nullptr)
+    {
+        ::CloseHandle(_file_handle);
+        _file_handle = nullptr;
+    }
+    _size = 0;
+}
+#else
+MappedFile::MappedFile(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Failed to open file " + path);
+    }
+
+    struct stat file_stat;
+    if (::fstat(fd, &file_stat) != 0 || file_stat.st_size <= 0)
+    {
+        ::close(fd);
+        throw std::runtime_error("File is empty " + path);
+    }
+
+    const size_t size = static_cast<size_t>(file_stat.st_size);
+    void* data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd); // the mapping keeps the file referenced
+    if (data == MAP_FAILED)
+    {
+        throw std::runtime_error("Failed to map file " + path);
+    }
+    _data = static_cast<const unsigned char*>(data);
+    _size = size;
+}
+
+void MappedFile::Unmap()
+{
+    if (_data != nullptr)
+    {
+        ::munmap(const_cast<unsigned char*>(_data), _size);
+        _data = nullptr;
+    }
+    _size = 0;
+}
+#endif // _WIN32
+} // namespace FwUpdate
+} // namespace RealSenseID
@@ -0,0 +1,37 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+namespace RealSenseID
+{
+namespace FwUpdate
+{
+// read only mapping of an entire file.
+// throws std::runtime_error if the file cannot be opened or mapped.
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char* Data() const;
+    size_t Size() const;
+
+private:
+    void Unmap();
+
+    const unsigned char* _data = nullptr;
+    size_t _size = 0;
+#ifdef _WIN32
+    void* _file_handle = nullptr;
+    void* _mapping_handle = nullptr;
+#endif
+};
+} // namespace FwUpdate
+} // namespace RealSenseID
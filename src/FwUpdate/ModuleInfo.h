@@ -2,8 +2,10 @@
 // Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
 #pragma once
 
+#include "MappedFile.h"
 #include <string>
 #include <vector>
+#include <memory>
 #include <cinttypes>
 
 namespace RealSenseID
@@ -20,14 +22,16 @@ struct BlockInfo
 
 struct ModuleInfo
 {
-    std::string filename;          // path to module file
-    size_t file_offset = 0;        // module start offset in file
-    size_t size = 0;               // actual data size
-    size_t aligned_size = 0;       // aligned data size
-    std::string name;              // module name
-    std::string version;           // module version
-    uint32_t crc = 0;              // crc of entire module
-    std::vector<BlockInfo> blocks; // block specific data
+    std::string filename;                   // path to module file
+    std::shared_ptr<const MappedFile> file; // read only mapping of the file, shared by all its modules
+    size_t file_offset = 0;                 // module start offset in file
+    size_t size = 0;                        // actual data size
+    size_t aligned_size = 0;                // aligned data size
+    std::string name;                       // module name
+    std::string version;                    // module version
+    uint32_t crc = 0;                       // crc of entire module
+    uint32_t block_size = 0;                // size of the blocks (but the last one)
+    std::vector<BlockInfo> blocks;          // block specific data
 };
 
 using ModuleVector = std::vector<ModuleInfo>;
@@ -0,0 +1,194 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+#include "UpdateJournal.h"
+#include "Logger.h"
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <mutex>
+#include <cctype>
+#include <cstdio>
+#include <cstdint>
+#include <stdexcept>
+
+namespace RealSenseID
+{
+namespace FwUpdate
+{
+static const char* LOG_TAG = "FwUpdater";
+
+static std::mutex s_file_mutex;
+
+// the journal's fields are separated by whitespace
+static std::string ToJournalField(const std::string& str)
+{
+    std::string result = str.empty() ? "-" : str;
+    for (auto& c : result)
+    {
+        if (std::isspace(static_cast<unsigned char>(c)))
+            c = '_';
+    }
+    return result;
+}
+
+// 64 bit FNV-1a
+static void HashBytes(uint64_t& hash, const void* data, size_t size)
+{
+    auto bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+}
+
+std::string UpdateJournal::ImageDigest(const ModuleVector& modules)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const auto& module : modules)
+    {
+        HashBytes(hash, module.name.c_str(), module.name.size() + 1);
+        HashBytes(hash, module.version.c_str(), module.version.size() + 1);
+        uint64_t size = module.size;
+        HashBytes(hash, &size, sizeof(size));
+        HashBytes(hash, &module.crc, sizeof(module.crc));
+        for (const auto& block : module.blocks)
+        {
+            HashBytes(hash, &block.crc, sizeof(block.crc));
+        }
+    }
+    char digest[17];
+    ::snprintf(digest, sizeof(digest), "%016llx", static_cast<unsigned long long>(hash));
+    return digest;
+}
+
+UpdateJournal::UpdateJournal(const std::string& path, const std::string& device, const ModuleVector& modules) :
+    _path {path}, _device {ToJournalField(device)}, _digest {ImageDigest(modules)}
+{
+    if (Load())
+    {
+        // the device was since updated with another image, the blocks it confirmed for that image are stale
+        LOG_INFO(LOG_TAG, "Dropping stale update journal entries of %s", _device.c_str());
+        RemoveEntries(false);
+    }
+}
+
+bool UpdateJournal::Load()
+{
+    std::lock_guard<std::mutex> lock {s_file_mutex};
+    std::ifstream file(_path);
+    if (!file)
+    {
+        return false; // no journal yet
+    }
+    bool other_images = false;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream ss(line);
+        std::string device, digest, module;
+        size_t block;
+        if (!(ss >> device >> digest >> module >> block))
+        {
+            continue; // e.g. a line cut by a crash while written
+        }
+        if (device == _device && digest == _digest)
+        {
+            _confirmed.emplace(module, block);
+        }
+        else if (device == _device)
+        {
+            other_images = true;
+        }
+    }
+    if (!_confirmed.empty())
+    {
+        LOG_INFO(LOG_TAG, "Resuming update of %s: %zu blocks already confirmed", _device.c_str(), _confirmed.size());
+    }
+    return other_images;
+}
+
+bool UpdateJournal::IsConfirmed(const std::string& module, size_t block) const
+{
+    return _confirmed.find(std::make_pair(module, block)) != _confirmed.end();
+}
+
+void UpdateJournal::Confirm(const std::string& module, size_t block)
+{
+    if (IsConfirmed(module, block))
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock {s_file_mutex};
+    // reopened for each block, so every confirmed block is in the file once this returns
+    std::ofstream file(_path, std::ios::app);
+    file << _device << ' ' << _digest << ' ' << ToJournalField(module) << ' ' << block << '\n';
+    file.close();
+    if (!file)
+    {
+        throw std::runtime_error("Failed writing update journal " + _path);
+    }
+    _confirmed.emplace(module, block);
+}
+
+void UpdateJournal::Clear()
+{
+    _confirmed.clear();
+    RemoveEntries(true);
+}
+
+void UpdateJournal::RemoveEntries(bool this_image)
+{
+    std::lock_guard<std::mutex> lock {s_file_mutex};
+    std::vector<std::string> kept;
+    {
+        std::ifstream file(_path);
+        if (!file)
+        {
+            return;
+        }
+        std::string line;
+        while (std::getline(file, line))
+        {
+            std::istringstream ss(line);
+            std::string device, digest, module;
+            size_t block;
+            const bool parsed = static_cast<bool>(ss >> device >> digest >> module >> block);
+            if (!parsed || (device == _device && (digest == _digest) == this_image))
+            {
+                continue; // dropped, also incomplete lines
+            }
+            kept.push_back(line);
+        }
+    }
+
+    if (kept.empty())
+    {
+        std::remove(_path.c_str());
+        return;
+    }
+    // other devices' entries are kept. write them aside and replace, so a crash does not lose them
+    const std::string tmp_path = _path + ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::trunc);
+        for (const auto& line : kept)
+        {
+            file << line << '\n';
+        }
+        file.close();
+        if (!file)
+        {
+            LOG_WARNING(LOG_TAG, "Failed writing update journal %s", tmp_path.c_str());
+            return;
+        }
+    }
+#ifdef _WIN32
+    std::remove(_path.c_str()); // rename does not replace existing files
+#endif
+    if (std::rename(tmp_path.c_str(), _path.c_str()) != 0)
+    {
+        LOG_WARNING(LOG_TAG, "Failed replacing update journal %s", _path.c_str());
+    }
+}
+} // namespace FwUpdate
+} // namespace RealSenseID
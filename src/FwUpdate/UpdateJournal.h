@@ -0,0 +1,49 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+#pragma once
+
+#include "ModuleInfo.h"
+#include <string>
+#include <set>
+#include <utility>
+
+namespace RealSenseID
+{
+namespace FwUpdate
+{
+// Persistent record of the blocks a device confirmed ("dl ret=0") during an update, so an interrupted update
+// can continue where it stopped.
+// The journal file is shared by all devices and images: each line is "<device> <image digest> <module> <block>".
+// Lines are appended as blocks are confirmed and removed once the update of that device and image completes, or
+// once the device is updated with another image.
+// File access is serialized between all journals of the process (e.g. devices updated concurrently).
+class UpdateJournal
+{
+public:
+    UpdateJournal(const std::string& path, const std::string& device, const ModuleVector& modules);
+
+    // digest of the image's modules, from their names, versions, sizes and block crcs
+    static std::string ImageDigest(const ModuleVector& modules);
+
+    bool IsConfirmed(const std::string& module, size_t block) const;
+
+    // record the block, throws if the journal file cannot be written
+    void Confirm(const std::string& module, size_t block);
+
+    // the update completed (or starts over), remove this device and image from the journal
+    void Clear();
+
+private:
+    // true if the journal has entries of this device for other images
+    bool Load();
+
+    // remove the entries of this device for this image, or for all other images
+    void RemoveEntries(bool this_image);
+
+    std::string _path;
+    std::string _device;
+    std::string _digest;
+    std::set<std::pair<std::string, size_t>> _confirmed;
+};
+} // namespace FwUpdate
+} // namespace RealSenseID
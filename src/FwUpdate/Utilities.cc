@@ -2,12 +2,15 @@
 // Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
 #include "Utilities.h"
 #include "Logger.h"
-#include <fstream>
+#include <memory>
 #include <stdexcept>
 #include <vector>
 #include <cstring>
 #include <cassert>
 #include <algorithm>
+#include <exception>
+#include <thread>
+#include <system_error>
 
 namespace RealSenseID
 {
@@ -15,44 +18,14 @@ namespace FwUpdate
 {
 static const char* LOG_TAG = "FwUpdater";
 
-static const uint32_t CRC_LUT[] = {
-    0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f, 0xe963a535, 0x9e6495a3, 0x0edb8832,
-    0x79dcb8a4, 0xe0d5e91e, 0x97d2d988, 0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91, 0x1db71064, 0x6ab020f2,
-    0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7, 0x136c9856, 0x646ba8c0, 0xfd62f97a,
-    0x8a65c9ec, 0x14015c4f, 0x63066cd9, 0xfa0f3d63, 0x8d080df5, 0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172,
-    0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b, 0x35b5a8fa, 0x42b2986c, 0xdbbbc9d6, 0xacbcf940, 0x32d86ce3,
-    0x45df5c75, 0xdcd60dcf, 0xabd13d59, 0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423,
-    0xcfba9599, 0xb8bda50f, 0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924, 0x2f6f7c87, 0x58684c11, 0xc1611dab,
-    0xb6662d3d, 0x76dc4190, 0x01db7106, 0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
-    0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d, 0x91646c97, 0xe6635c01, 0x6b6b51f4,
-    0x1c6c6162, 0x856530d8, 0xf262004e, 0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457, 0x65b0d9c6, 0x12b7e950,
-    0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65, 0x4db26158, 0x3ab551ce, 0xa3bc0074,
-    0xd4bb30e2, 0x4adfa541, 0x3dd895d7, 0xa4d1c46d, 0xd3d6f4fb, 0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0,
-    0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9, 0x5005713c, 0x270241aa, 0xbe0b1010, 0xc90c2086, 0x5768b525,
-    0x206f85b3, 0xb966d409, 0xce61e49f, 0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81,
-    0xb7bd5c3b, 0xc0ba6cad, 0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a, 0xead54739, 0x9dd277af, 0x04db2615,
-    0x73dc1683, 0xe3630b12, 0x94643b84, 0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
-    0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb, 0x196c3671, 0x6e6b06e7, 0xfed41b76,
-    0x89d32be0, 0x10da7a5a, 0x67dd4acc, 0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5, 0xd6d6a3e8, 0xa1d1937e,
-    0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b, 0xd80d2bda, 0xaf0a1b4c, 0x36034af6,
-    0x41047a60, 0xdf60efc3, 0xa867df55, 0x316e8eef, 0x4669be79, 0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236,
-    0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f, 0xc5ba3bbe, 0xb2bd0b28, 0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7,
-    0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d, 0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f,
-    0x72076785, 0x05005713, 0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38, 0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7,
-    0x0bdbdf21, 0x86d3d2d4, 0xf1d4e242, 0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
-    0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69, 0x616bffd3, 0x166ccf45, 0xa00ae278,
-    0xd70dd2ee, 0x4e048354, 0x3903b3c2, 0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db, 0xaed16a4a, 0xd9d65adc,
-    0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9, 0xbdbdf21c, 0xcabac28a, 0x53b39330,
-    0x24b4a3a6, 0xbad03605, 0xcdd70693, 0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94,
-    0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d,
-};
-
 static constexpr uint32_t UFIF_ALIGN = 16;
 static constexpr uint32_t UFIF_SIG = 0x46484655;
 static constexpr uint32_t UFIF_VER = 0x0100;
 static constexpr uint32_t UFIF_NAME_MAX = 64;
 static constexpr uint32_t DIGEST_HEADER_VERSION = 0x00000004;
 static constexpr uint32_t DIGEST_HEADER_VERSION_SIZE = 12;
+static constexpr unsigned int CRC_MAX_THREADS = 4;
+static constexpr size_t CRC_MIN_BYTES_PER_THREAD = 4 * 1024 * 1024;
 
 // Header of each module
 struct DigestHeader
@@ -108,13 +81,15 @@ static bool UfifCheckHeader(const UfifFile& header)
     return true;
 }
 
-static std::vector<UfifEntry> UfifReadHeader(std::ifstream& file, UfifFile& header)
+// the ufif header and its entries at the start of the mapped file
+static std::vector<UfifEntry> UfifReadHeader(const MappedFile& file, UfifFile& header, size_t& pos)
 {
-    if (!file.read((char*)&header, sizeof(UfifFile)))
+    if (file.Size() < sizeof(UfifFile))
     {
         throw std::runtime_error("Error while reading ufifFile_t");
     }
-
+    ::memcpy(&header, file.Data(), sizeof(UfifFile));
+    pos = sizeof(UfifFile);
 
     if (!UfifCheckHeader(header))
     {
@@ -123,74 +98,163 @@ static std::vector<UfifEntry> UfifReadHeader(std::ifstream& file, UfifFile& head
 
     // read headers entries from file
     std::vector<UfifEntry> rv(header.entryN);
-    if (!file.read((char*)rv.data(), rv.size() * sizeof(UfifEntry)))
+    const size_t entries_size = rv.size() * sizeof(UfifEntry);
+    if (file.Size() - pos < entries_size)
     {
         throw std::runtime_error("Error while reading ufifEntries");
     }
+    if (entries_size > 0)
+    {
+        ::memcpy(rv.data(), file.Data() + pos, entries_size);
+    }
+    pos += entries_size;
     return rv;
 }
 
-uint32_t CalculateCRC(uint32_t crc, const void* buffer, uint32_t buffer_size)
+// crc of the module's data, its last partial word padded with zeroes
+static uint32_t ModuleCRC(const unsigned char* module_data, uint32_t size)
 {
-    auto current = static_cast<const uint32_t*>(buffer);
-    auto end = static_cast<const uint32_t*>(current + (buffer_size / sizeof(buffer_size)));
+    auto crc = CalculateCRC(0, module_data, size & ~3);
+    if (size % 4)
+    {
+        uint32_t tail = 0;
+        ::memcpy(&tail, module_data + (size & ~3), size % 4);
+        crc = CalculateCRC(crc, &tail, sizeof(tail));
+    }
+    return crc;
+}
 
-    crc = crc ^ ~0U;
+// the blocks' crcs (seeded with the block number) in [first, last)
+static void CalculateBlocksCRC(ModuleInfo& module, size_t first, size_t last)
+{
+    std::vector<unsigned char> scratch;
+    for (size_t i = first; i < last; i++)
+    {
+        auto& block = module.blocks[i];
+        block.crc = CalculateCRC(static_cast<uint32_t>(i), BlockData(module, block, scratch),
+                                 static_cast<uint32_t>(block.size));
+    }
+}
 
-    if (buffer_size != 0)
+// the block crcs of a large module are split between threads (each block's crc has its own seed, so they are
+// independent). the crc itself runs at memory speed, so a few threads saturate it.
+static void CalculateBlocksCRC(ModuleInfo& module)
+{
+    const size_t n_blocks = module.blocks.size();
+    unsigned int thread_count = std::min(CRC_MAX_THREADS, std::max(1u, std::thread::hardware_concurrency()));
+    thread_count = static_cast<unsigned int>(
+        std::max<size_t>(1, std::min<size_t>(thread_count, module.aligned_size / CRC_MIN_BYTES_PER_THREAD)));
+    const size_t blocks_per_thread = (n_blocks + thread_count - 1) / thread_count;
+
+    std::vector<std::thread> workers;
+    std::vector<std::exception_ptr> errors(thread_count);
+    for (unsigned int i = 1; i < thread_count; i++)
     {
-        do
+        const size_t first = i * blocks_per_thread;
+        if (first >= n_blocks)
         {
-            uint32_t value = *current++;
-            crc = CRC_LUT[(crc ^ (value >> 0)) & 0xff] ^ (crc >> 8);
-            crc = CRC_LUT[(crc ^ (value >> 8)) & 0xff] ^ (crc >> 8);
-            crc = CRC_LUT[(crc ^ (value >> 16)) & 0xff] ^ (crc >> 8);
-            crc = CRC_LUT[(crc ^ (value >> 24)) & 0xff] ^ (crc >> 8);
-        } while (current != end);
+            break;
+        }
+        const size_t last = std::min(n_blocks, first + blocks_per_thread);
+        try
+        {
+            workers.emplace_back([&module, &errors, i, first, last]() {
+                try
+                {
+                    CalculateBlocksCRC(module, first, last);
+                }
+                catch (...)
+                {
+                    errors[i] = std::current_exception();
+                }
+            });
+        }
+        catch (const std::system_error&)
+        {
+            CalculateBlocksCRC(module, first, last); // no more threads, calculate these blocks here
+        }
+    }
+    try
+    {
+        CalculateBlocksCRC(module, 0, std::min(n_blocks, blocks_per_thread));
+    }
+    catch (...)
+    {
+        errors[0] = std::current_exception();
+    }
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+    for (const auto& error : errors)
+    {
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+void SplitIntoBlocks(ModuleInfo& module, uint32_t block_size)
+{
+    if (block_size == 0)
+    {
+        throw std::runtime_error("Invalid block size");
+    }
+    auto n_blocks = module.aligned_size / block_size;
+    if (module.aligned_size % block_size)
+    {
+        n_blocks++;
     }
-    return crc ^ ~0U;
+
+    // crc sz must be 4-aligned, the bytes past the module's data count as zeroes
+    size_t crc_aligned_data_size = (module.size + 3) & ~size_t {3};
+    module.block_size = block_size;
+    module.blocks.clear();
+    for (size_t i = 0; i < n_blocks; i++)
+    {
+        BlockInfo block;
+        block.offset = i * static_cast<size_t>(block_size);
+        block.size = std::min<size_t>(crc_aligned_data_size, block_size);
+        block.crc = 0;
+        crc_aligned_data_size -= block.size;
+        module.blocks.push_back(block);
+    }
+    CalculateBlocksCRC(module);
 }
 
 ModuleVector ParseUfifToModules(const std::string& path, const uint32_t block_size)
-{     
-    std::ifstream ifile(path, std::ios::binary);
-    if (!ifile)
+{
+    // the modules reference the mapping instead of copies of their data
+    std::shared_ptr<const MappedFile> file;
+    try
     {
+        file = std::make_shared<const MappedFile>(path);
+    }
+    catch (const std::exception& ex)
+    {
+        LOG_ERROR(LOG_TAG, "%s", ex.what());
         throw std::runtime_error("Error while trying to read project header");
     }
-    ifile.unsetf(std::ios::skipws);
 
     UfifFile header;
-    auto entries = UfifReadHeader(ifile, header);
+    size_t ofs = 0;
+    auto entries = UfifReadHeader(*file, header, ofs);
 
     ModuleVector result;
     for (const auto& entry : entries)
     {
         DigestHeader hdr = {0};
-        auto ofs = ifile.tellg();
-        if (ofs == -1)
-        {
-            throw std::runtime_error("tellg failed");
-        }
-
         if (ofs % UFIF_ALIGN)
         {
             ofs += UFIF_ALIGN - ofs % UFIF_ALIGN;
-            if (!ifile.seekg(ofs))
-            {
-                throw std::runtime_error("seekg failed");
-            }
         }
 
-        if (!ifile.read((char*)&hdr, sizeof(hdr)))
+        if (ofs > file->Size() || file->Size() - ofs < sizeof(hdr))
         {
             throw std::runtime_error("read failed");
         }
-
-        if (!ifile.seekg(ofs))
-        {
-            throw std::runtime_error("seekg failed while reading digest header");
-        }
+        ::memcpy(&hdr, file->Data() + ofs, sizeof(hdr));
 
         if ((hdr.ver >> 16) != (DIGEST_HEADER_VERSION >> 16))
         {
@@ -213,75 +277,59 @@ ModuleVector ParseUfifToModules(const std::string& path, const uint32_t block_si
             throw std::runtime_error("Error while validating header version");
         }
 
-        // 4k aligned module size
-        auto aligned_buffer_size = (entry.size + 4095) & 0xfffff000;
-        auto n_blocks = aligned_buffer_size / block_size;
-        if (aligned_buffer_size % block_size)
-        {
-            n_blocks++;
-        }
-        LOG_DEBUG(LOG_TAG, "[%8s] %0.2f MB,  %u blocks", module_name.c_str(), entry.size / 1048576.0, n_blocks);
-
-        // buffer to store module data,
-        // init with zeroes so alignment bytes(aligned_buffer_size-entry.size) are all zeroes
-        std::vector<unsigned char> module_buffer(aligned_buffer_size, 0);
-        if (!ifile.read((char*)&module_buffer[0], entry.size))
+        if (file->Size() - ofs < entry.size)
         {
             throw std::runtime_error("Failed reading module from file");
         }
 
-        // crc sz must be 4-aligned
-        uint32_t crc_aligned_data_size = (entry.size + 3) & ~3;
-        auto whole_module_crc = CalculateCRC(0, module_buffer.data(), crc_aligned_data_size);
-        if (whole_module_crc != entry.crc32)
-        {
-            throw std::runtime_error("Invalid crc field in module " + module_name);
-        }
+        // 4k aligned module size
+        auto aligned_buffer_size = (entry.size + 4095) & 0xfffff000;
 
         ModuleInfo module_info;
-        module_info.crc = whole_module_crc;
         module_info.name = module_name;
         module_info.version = (char*)hdr.binVer;
         module_info.filename = path;
+        module_info.file = file;
         module_info.file_offset = ofs;
         module_info.size = entry.size;
         module_info.aligned_size = aligned_buffer_size;
 
-        uint32_t block_crc_size;
-        for (unsigned i = 0; i < n_blocks; i++)
+        auto whole_module_crc = ModuleCRC(file->Data() + ofs, entry.size);
+        if (whole_module_crc != entry.crc32)
         {
-            BlockInfo block;
-            block.offset = i * static_cast<size_t>(block_size);
-            block_crc_size = std::min(crc_aligned_data_size, block_size);
-            block.size = block_crc_size;
-            block.crc = CalculateCRC(i, &module_buffer[block.offset], block_crc_size);
-            crc_aligned_data_size -= block_crc_size;
-            module_info.blocks.push_back(block);
+            throw std::runtime_error("Invalid crc field in module " + module_name);
         }
+        module_info.crc = whole_module_crc;
+
+        SplitIntoBlocks(module_info, block_size);
+        LOG_DEBUG(LOG_TAG, "[%8s] %0.2f MB,  %zu blocks", module_name.c_str(), entry.size / 1048576.0,
+                  module_info.blocks.size());
         result.push_back(module_info);
-    }    
+        ofs += entry.size;
+    }
     return result;
 }
 
-std::vector<unsigned char> LoadFileToBuffer(const std::string& path, size_t aligned_size, size_t size, size_t offset)
+const unsigned char* BlockData(const ModuleInfo& module, const BlockInfo& block, std::vector<unsigned char>& scratch)
 {
-    if (aligned_size < size)
-        throw std::runtime_error("Requested buffer size is smaller than actual data size");
-
-    std::ifstream file(path, std::ios::binary);
-    if (!file)
-        throw std::runtime_error("Failed open file for binary read");
-
-    file.unsetf(std::ios::skipws);
-    file.seekg(offset, std::ios::beg);
+    if (!module.file || module.file_offset > module.file->Size() ||
+        module.file->Size() - module.file_offset < module.size || block.offset + block.size > module.aligned_size)
+    {
+        throw std::runtime_error("Block is outside of module " + module.name);
+    }
 
-    std::vector<unsigned char> buffer(aligned_size, 0);
-    if (!file.read(reinterpret_cast<char*>(buffer.data()), size))
+    const unsigned char* module_data = module.file->Data() + module.file_offset;
+    if (block.offset + block.size <= module.size)
     {
-        throw std::runtime_error("Failed reading all bytes from file");
+        return module_data + block.offset;
     }
 
-    return buffer;
+    scratch.assign(block.size, 0);
+    if (block.offset < module.size)
+    {
+        ::memcpy(scratch.data(), module_data + block.offset, module.size - block.offset);
+    }
+    return scratch.data();
 }
 } // namespace FwUpdate
 } // namespace RealSenseID
@@ -3,6 +3,7 @@
 #pragma once
 
 #include "ModuleInfo.h"
+#include "Crc32.h"
 #include <cstdint>
 #include <string>
 
@@ -10,13 +11,14 @@ namespace RealSenseID
 {
 namespace FwUpdate
 {
-// calculates crc on a data buffer
-uint32_t CalculateCRC(uint32_t crc, const void* buffer, uint32_t buffer_size);
-
 // parses a packaged binary firmware file and returns a list of modules with their metadata
 ModuleVector ParseUfifToModules(const std::string& path, const uint32_t block_size);
 
-// Load data of specified size and from specified offset into a buffer of an aligned size
-std::vector<unsigned char> LoadFileToBuffer(const std::string& path, size_t aligned_size, size_t size, size_t offset);
+// split the module (its size, aligned size and file set) into blocks of block_size and calculate their crcs
+void SplitIntoBlocks(ModuleInfo& module, uint32_t block_size);
+
+// the block's data in the module's mapped file.
+// a block reaching past the module's data (its last block) is copied to scratch and padded with zeroes.
+const unsigned char* BlockData(const ModuleInfo& module, const BlockInfo& block, std::vector<unsigned char>& scratch);
 } // namespace FwUpdate
 } // namespace RealSenseID
\ No newline at end of file
@@ -7,7 +7,13 @@
 
 #include <algorithm>
 #include <fstream>
+#include <map>
+#include <sstream>
 #include <exception>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <system_error>
 
 namespace RealSenseID
 {
@@ -28,6 +34,42 @@ static bool DoesFileExist(const char* path)
     return f.good();
 }
 
+static FwUpdateEngine::Settings ToEngineSettings(const FwUpdater::Settings& settings, const char* binPath)
+{
+    FwUpdateEngine::Settings internal_settings;
+    internal_settings.fw_filename = binPath;
+    // falls back to NORMAL_BAUD_RATE if not supported
+    internal_settings.baud_rate = settings.fast_baud_rate ? FASTER_BAUD_RATE : NORMAL_BAUD_RATE;
+    internal_settings.port = settings.port;
+    internal_settings.force_full = settings.force_full;
+    internal_settings.pipeline_blocks = settings.pipeline_blocks;
+    internal_settings.compress_blocks = settings.compress_blocks;
+    internal_settings.adaptive_block_size = settings.adaptive_block_size;
+    internal_settings.skip_up_to_date = settings.skip_up_to_date;
+    if (settings.journal_path != nullptr)
+    {
+        internal_settings.journal_path = settings.journal_path;
+        const char* device_id = settings.serial_number != nullptr ? settings.serial_number : settings.port;
+        internal_settings.device_id = device_id != nullptr ? device_id : "";
+    }
+#ifdef ANDROID
+    internal_settings.android_config = settings.android_config;
+#endif
+    return internal_settings;
+}
+
+static ModuleVector ModulesToUpdate(FwUpdateEngine& update_engine, const char* binPath, bool excludeRecognition)
+{
+    auto modules = update_engine.ModulesFromFile(binPath);
+    if (excludeRecognition)
+    {
+        modules.erase(std::remove_if(modules.begin(), modules.end(),
+                                     [](const ModuleInfo& mod_info) { return mod_info.name == MODULE_RECOG; }),
+                      modules.end());
+    }
+    return modules;
+}
+
 bool FwUpdater::ExtractFwVersion(const char* binPath, std::string& outFwVersion,
                                  std::string& outRecognitionVersion) const
 {
@@ -70,6 +112,46 @@ bool FwUpdater::ExtractFwVersion(const char* binPath, std::string& outFwVersion,
     }
 }
 
+bool FwUpdater::IsUpToDate(const char* binPath, const char* deviceFirmwareVersion, bool excludeRecognition) const
+{
+    try
+    {
+        if (deviceFirmwareVersion == nullptr || !DoesFileExist(binPath))
+        {
+            return false;
+        }
+        // "NAME:version" sections separated by '|'
+        std::map<std::string, std::string> device_versions;
+        std::stringstream version_stream(deviceFirmwareVersion);
+        std::string section;
+        while (std::getline(version_stream, section, '|'))
+        {
+            auto pos = section.find(':');
+            if (pos != std::string::npos)
+            {
+                device_versions[section.substr(0, pos)] = section.substr(pos + 1);
+            }
+        }
+
+        FwUpdateEngine update_engine;
+        auto modules = ModulesToUpdate(update_engine, binPath, excludeRecognition);
+        for (const auto& module : modules)
+        {
+            auto device_version = device_versions.find(module.name);
+            if (device_version == device_versions.end() || device_version->second != module.version)
+            {
+                return false;
+            }
+        }
+        return !modules.empty();
+    }
+    catch (const std::exception& ex)
+    {
+        LOG_EXCEPTION(LOG_TAG, ex);
+        return false;
+    }
+}
+
 Status FwUpdater::Update(FwUpdater::EventHandler* handler, Settings settings, const char* binPath,
                          bool excludeRecognition) const
 {
@@ -90,23 +172,9 @@ Status FwUpdater::Update(FwUpdater::EventHandler* handler, Settings settings, co
             }
         };
 
-        FwUpdateEngine::Settings internal_settings;
-        internal_settings.fw_filename = binPath;
-        internal_settings.baud_rate = NORMAL_BAUD_RATE;
-        internal_settings.port = settings.port;
-        internal_settings.force_full = settings.force_full;
-#ifdef ANDROID
-        internal_settings.android_config = settings.android_config;
-#endif
-
+        auto internal_settings = ToEngineSettings(settings, binPath);
         FwUpdateEngine update_engine;
-        auto modules = update_engine.ModulesFromFile(binPath);
-
-        if (excludeRecognition)
-        {
-            modules.erase(std::remove_if(modules.begin(), modules.end(),
-                                         [](const ModuleInfo& mod_info) { return mod_info.name == MODULE_RECOG; }));
-        }
+        auto modules = ModulesToUpdate(update_engine, binPath, excludeRecognition);
 
         PacketManager::Timer timer;
         update_engine.BurnModules(internal_settings, modules, callback_wrapper);
@@ -120,4 +188,100 @@ Status FwUpdater::Update(FwUpdater::EventHandler* handler, Settings settings, co
         return Status::Error;
     }
 }
+
+#ifndef ANDROID
+Status FwUpdater::UpdateFleet(FleetEventHandler* handler, Settings settings, const char* binPath,
+                              bool excludeRecognition, const char* const* ports, unsigned int numberOfPorts,
+                              unsigned int maxParallel) const
+{
+    if (ports == nullptr || numberOfPorts == 0)
+    {
+        LOG_ERROR(LOG_TAG, "No ports to update");
+        return Status::Error;
+    }
+
+    ModuleVector modules;
+    try
+    {
+        if (!DoesFileExist(binPath))
+        {
+            LOG_ERROR(LOG_TAG, "file does not exist: :%s", binPath);
+            return Status::Error;
+        }
+        // parse and map once, the modules' data is shared (read only) by all devices
+        FwUpdateEngine update_engine;
+        modules = ModulesToUpdate(update_engine, binPath, excludeRecognition);
+    }
+    catch (const std::exception& ex)
+    {
+        LOG_EXCEPTION(LOG_TAG, ex);
+        return Status::Error;
+    }
+
+    std::atomic<unsigned int> next_device {0};
+    std::atomic<unsigned int> n_failed {0};
+    auto update_devices = [&]() {
+        for (auto i = next_device++; i < numberOfPorts; i = next_device++)
+        {
+            const char* port = ports[i];
+            Status status = Status::Error;
+            try
+            {
+                auto internal_settings = ToEngineSettings(settings, binPath);
+                internal_settings.port = port;
+                internal_settings.device_id = port;
+                auto on_progress = [handler, port](float progress) {
+                    LOG_DEBUG(LOG_TAG, "%s progress: %d%%", port, static_cast<int>(progress * 100));
+                    if (handler != nullptr)
+                    {
+                        handler->OnProgress(port, progress);
+                    }
+                };
+                FwUpdateEngine update_engine;
+                update_engine.BurnModules(internal_settings, modules, on_progress);
+                LOG_INFO(LOG_TAG, "Firmware update of %s success", port);
+                status = Status::Ok;
+            }
+            catch (const std::exception& ex)
+            {
+                LOG_ERROR(LOG_TAG, "Firmware update of %s failed: %s", port, ex.what());
+            }
+            if (status != Status::Ok)
+            {
+                ++n_failed;
+            }
+            if (handler != nullptr)
+            {
+                handler->OnDeviceDone(port, status);
+            }
+        }
+    };
+
+    // bounded pool of workers, each updates the next device until none are left
+    PacketManager::Timer timer;
+    auto n_workers = std::max(1u, std::min(maxParallel, numberOfPorts));
+    std::vector<std::thread> workers;
+    try
+    {
+        for (unsigned int i = 1; i < n_workers; ++i)
+        {
+            workers.emplace_back(update_devices);
+        }
+    }
+    catch (const std::system_error& ex)
+    {
+        LOG_WARNING(LOG_TAG, "Updating with %zu threads only: %s", workers.size() + 1, ex.what());
+    }
+    update_devices();
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+
+    auto elapsed_seconds = timer.Elapsed() / 1000;
+    LOG_INFO(LOG_TAG, "Fleet firmware update done, %u of %u devices failed (duration %lldm:%llds)", n_failed.load(),
+             numberOfPorts, elapsed_seconds / 60, elapsed_seconds % 60);
+    return n_failed == 0 ? Status::Ok : Status::Error;
+}
+#endif
 } // namespace RealSenseID
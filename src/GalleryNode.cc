@@ -0,0 +1,334 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "RealSenseID/GalleryNode.h"
+#include "RealSenseID/GalleryTransport.h"
+#include "GalleryWire.h"
+#include "Matcher/Matcher.h"
+#include "Matcher/MatcherGallery.h"
+#include "Matcher/MatcherGalleryFile.h"
+#include "Matcher/MatcherUserIndex.h"
+#include "Logger.h"
+#include "Tracer.h"
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace RealSenseID
+{
+static const char* LOG_TAG = "GalleryNode";
+
+using GalleryWire::MessageType;
+using GalleryWire::ReplyStatus;
+
+class GalleryNodeImpl
+{
+public:
+    GalleryNodeImpl() : _thresholds {Matcher::GetDefaultThresholds()}
+    {
+    }
+
+    Status HandleRequest(const unsigned char* request, size_t request_size, unsigned char* reply, size_t& reply_size)
+    {
+        RSID_TRACE_SPAN("gallery", "HandleRequest");
+        reply_size = 0;
+        GalleryWire::Reader reader {request, request_size};
+        if (!reader.Ok() || reply == nullptr)
+        {
+            LOG_ERROR(LOG_TAG, "Malformed request (%zu bytes)", request_size);
+            return Status::Error;
+        }
+
+        GalleryWire::Writer writer {reply, GalleryTransport::MaxMessageSize};
+        ReplyStatus status = ReplyStatus::Error;
+        switch (reader.Type())
+        {
+        case MessageType::Match:
+            status = OnMatch(reader, writer);
+            break;
+        case MessageType::Update:
+            status = OnUpdate(reader, writer);
+            break;
+        case MessageType::Add:
+            status = OnAdd(reader);
+            break;
+        case MessageType::Remove:
+            status = OnRemove(reader);
+            break;
+        case MessageType::Clear:
+            status = OnClear(reader);
+            break;
+        case MessageType::Size:
+            status = OnSize(reader, writer);
+            break;
+        case MessageType::Prefetch:
+            status = OnPrefetch(reader);
+            break;
+        default:
+            LOG_ERROR(LOG_TAG, "Unknown request type %d", static_cast<int>(reader.Type()));
+            break;
+        }
+
+        if (status != ReplyStatus::Ok)
+        {
+            // no payload with an error status
+            writer = GalleryWire::Writer {reply, GalleryTransport::MaxMessageSize};
+        }
+        reply_size = writer.Finish(reader.Type(), status);
+        return reply_size > 0 ? Status::Ok : Status::Error;
+    }
+
+    size_t Size() const
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        return _gallery.Size();
+    }
+
+    Status Save(const char* path) const
+    {
+        if (path == nullptr)
+        {
+            return Status::Error;
+        }
+
+        std::lock_guard<std::mutex> lock {_mutex};
+        return MatcherGalleryFile::Save(_gallery, path) ? Status::Ok : Status::Error;
+    }
+
+    Status Load(const char* path)
+    {
+        if (path == nullptr)
+        {
+            return Status::Error;
+        }
+
+        auto file = MatcherGalleryFile::Open(path);
+        if (!file)
+        {
+            LOG_ERROR(LOG_TAG, "Failed to load gallery file \"%s\"", path);
+            return Status::Error;
+        }
+        std::lock_guard<std::mutex> lock {_mutex};
+        _gallery.Attach(std::move(file));
+        _index.Rebuild(_gallery);
+        return Status::Ok;
+    }
+
+private:
+    ReplyStatus OnMatch(GalleryWire::Reader& reader, GalleryWire::Writer& writer)
+    {
+        const int32_t version = reader.I32();
+        const size_t k = reader.U8();
+        const size_t number_of_probes = reader.U8();
+        if (k == 0 || number_of_probes == 0 || number_of_probes > GalleryWire::MaxProbes)
+        {
+            LOG_ERROR(LOG_TAG, "Invalid match request: k=%zu, probes=%zu", k, number_of_probes);
+            return ReplyStatus::Error;
+        }
+        Faceprints probes[GalleryWire::MaxProbes];
+        for (size_t i = 0; i < number_of_probes; i++)
+        {
+            probes[i] = Faceprints {};
+            probes[i].version = version;
+            reader.Probe(probes[i]);
+        }
+        if (!reader.AtEnd())
+        {
+            return ReplyStatus::Error;
+        }
+
+        std::lock_guard<std::mutex> lock {_mutex};
+        for (size_t i = 0; i < number_of_probes; i++)
+        {
+            // an empty node has no candidates. invalid probes fail the whole request.
+            _matches.clear();
+            if (!_gallery.Empty() && !Matcher::MatchFaceprintsTopK(probes[i], _gallery, k, _matches, _thresholds, true))
+            {
+                return ReplyStatus::Error;
+            }
+            writer.U8(static_cast<uint8_t>(_matches.size()));
+            for (const auto& match : _matches)
+            {
+                writer.I16(match.score);
+                writer.I16(match.confidence);
+                writer.UserId(_gallery.UserId(static_cast<size_t>(match.userId)));
+            }
+        }
+        return ReplyStatus::Ok;
+    }
+
+    // adaptive update of a matched user. the probe is matched against the user again, so a node only applies
+    // updates its own user qualifies for.
+    ReplyStatus OnUpdate(GalleryWire::Reader& reader, GalleryWire::Writer& writer)
+    {
+        char user_id[MaxUserIdBuffer];
+        reader.UserId(user_id, sizeof(user_id));
+        Faceprints probe {};
+        probe.version = reader.I32();
+        reader.Probe(probe);
+        if (!reader.AtEnd())
+        {
+            return ReplyStatus::Error;
+        }
+
+        std::lock_guard<std::mutex> lock {_mutex};
+        const size_t index = _index.Find(_gallery, user_id);
+        if (index == MatcherUserIndex::NotFound)
+        {
+            return ReplyStatus::NotFound;
+        }
+        const Faceprints existing_faceprints = _gallery.Entry(index).faceprints;
+        Faceprints updated_faceprints;
+        auto result = Matcher::MatchFaceprints(probe, existing_faceprints, updated_faceprints);
+        if (!result.should_update)
+        {
+            return ReplyStatus::Error;
+        }
+        // the same update as a host gallery match
+        Matcher::BuildAdaptiveUpdate(probe, existing_faceprints, _thresholds, updated_faceprints);
+        if (!_gallery.Update(index, updated_faceprints))
+        {
+            return ReplyStatus::Error;
+        }
+        writer.FullFaceprints(_gallery.Entry(index).faceprints);
+        return ReplyStatus::Ok;
+    }
+
+    ReplyStatus OnAdd(GalleryWire::Reader& reader)
+    {
+        ExtendedFaceprints entry;
+        reader.UserId(entry.user_id, sizeof(entry.user_id));
+        entry.faceprints = Faceprints {};
+        reader.FullFaceprints(entry.faceprints);
+        if (!reader.AtEnd())
+        {
+            return ReplyStatus::Error;
+        }
+
+        std::lock_guard<std::mutex> lock {_mutex};
+        const size_t index = _index.Find(_gallery, entry.user_id);
+        if (index != MatcherUserIndex::NotFound)
+        {
+            return _gallery.Update(index, entry.faceprints) ? ReplyStatus::Ok : ReplyStatus::Error;
+        }
+        if (!_gallery.Add(entry))
+        {
+            return ReplyStatus::Error;
+        }
+        _index.Insert(entry.user_id, _gallery.Size() - 1);
+        return ReplyStatus::Ok;
+    }
+
+    ReplyStatus OnRemove(GalleryWire::Reader& reader)
+    {
+        char user_id[MaxUserIdBuffer];
+        reader.UserId(user_id, sizeof(user_id));
+        if (!reader.AtEnd())
+        {
+            return ReplyStatus::Error;
+        }
+
+        std::lock_guard<std::mutex> lock {_mutex};
+        const size_t index = _index.Find(_gallery, user_id);
+        if (index == MatcherUserIndex::NotFound)
+        {
+            return ReplyStatus::NotFound;
+        }
+        // the last user takes the removed one's place
+        const size_t last = _gallery.Size() - 1;
+        _index.Erase(user_id, index);
+        if (index != last)
+        {
+            _index.Move(_gallery.UserId(last), last, index);
+        }
+        return _gallery.SwapRemove(index) ? ReplyStatus::Ok : ReplyStatus::Error;
+    }
+
+    ReplyStatus OnClear(GalleryWire::Reader& reader)
+    {
+        if (!reader.AtEnd())
+        {
+            return ReplyStatus::Error;
+        }
+
+        std::lock_guard<std::mutex> lock {_mutex};
+        _gallery.Clear();
+        _index.Clear();
+        return ReplyStatus::Ok;
+    }
+
+    ReplyStatus OnSize(GalleryWire::Reader& reader, GalleryWire::Writer& writer)
+    {
+        if (!reader.AtEnd())
+        {
+            return ReplyStatus::Error;
+        }
+        writer.U32(static_cast<uint32_t>(Size()));
+        return ReplyStatus::Ok;
+    }
+
+    ReplyStatus OnPrefetch(GalleryWire::Reader& reader)
+    {
+        if (!reader.AtEnd())
+        {
+            return ReplyStatus::Error;
+        }
+
+        // a chunk per hold of the mutex, so the matches of other clients are not held up for the whole pass
+        for (size_t begin = 0;; begin += PrefetchChunk)
+        {
+            std::lock_guard<std::mutex> lock {_mutex};
+            if (begin >= _gallery.Size())
+            {
+                return ReplyStatus::Ok;
+            }
+            _gallery.Prefetch(begin, begin + PrefetchChunk);
+        }
+    }
+
+    static constexpr size_t MaxUserIdBuffer = sizeof(ExtendedFaceprints::user_id);
+    static constexpr size_t PrefetchChunk = 1024;
+
+    mutable std::mutex _mutex;
+    MatcherGallery _gallery;
+    MatcherUserIndex _index;
+    std::vector<TopKMatch> _matches;
+    Thresholds _thresholds;
+};
+
+GalleryNode::GalleryNode() : _impl {new GalleryNodeImpl()}
+{
+}
+
+GalleryNode::~GalleryNode()
+{
+    try
+    {
+        delete _impl;
+    }
+    catch (...)
+    {
+    }
+}
+
+Status GalleryNode::HandleRequest(const unsigned char* request, size_t request_size, unsigned char* reply,
+                                  size_t& reply_size)
+{
+    return _impl->HandleRequest(request, request_size, reply, reply_size);
+}
+
+size_t GalleryNode::Size() const
+{
+    return _impl->Size();
+}
+
+Status GalleryNode::Save(const char* path) const
+{
+    return _impl->Save(path);
+}
+
+Status GalleryNode::Load(const char* path)
+{
+    return _impl->Load(path);
+}
+} // namespace RealSenseID
@@ -0,0 +1,337 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "GalleryWire.h"
+#include "Matcher/MatcherUserIndex.h"
+#include "PacketManager/Crc16.h"
+#include <cstring>
+#include <initializer_list>
+
+namespace RealSenseID
+{
+namespace GalleryWire
+{
+static constexpr unsigned char Magic[4] = {'R', 'S', 'G', 'W'};
+static constexpr uint8_t FormatVersion = 1;
+static constexpr size_t ProbeLength = NUM_OF_RECOGNITION_FEATURES;
+static constexpr int ProbeBits = 11;
+static constexpr int ProbeOffset = 1023;
+static constexpr size_t MaxUserIdLength = 30;
+
+static_assert(ProbeLength * ProbeBits == PackedProbeSize * 8, "packed probe size mismatch");
+
+uint32_t UserIdHash(const char* user_id)
+{
+    return MatcherUserIndex::Hash(user_id);
+}
+
+static void StoreU16(unsigned char* dst, uint16_t value)
+{
+    dst[0] = static_cast<unsigned char>(value);
+    dst[1] = static_cast<unsigned char>(value >> 8);
+}
+
+static void StoreU32(unsigned char* dst, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        dst[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+
+static uint16_t LoadU16(const unsigned char* src)
+{
+    return static_cast<uint16_t>(src[0] | (src[1] << 8));
+}
+
+static uint32_t LoadU32(const unsigned char* src)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        value |= static_cast<uint32_t>(src[i]) << (8 * i);
+    }
+    return value;
+}
+
+static uint16_t PayloadCrc(const unsigned char* payload, size_t size)
+{
+    return PacketManager::Crc16(reinterpret_cast<const char*>(payload), size);
+}
+
+Writer::Writer(unsigned char* buffer, size_t capacity) : _buffer(buffer), _capacity(capacity)
+{
+    _ok = buffer != nullptr && capacity >= HeaderSize;
+}
+
+unsigned char* Writer::Reserve(size_t size)
+{
+    if (!_ok || _capacity - _size < size)
+    {
+        _ok = false;
+        return nullptr;
+    }
+    auto* dst = _buffer + _size;
+    _size += size;
+    return dst;
+}
+
+void Writer::U8(uint8_t value)
+{
+    if (auto* dst = Reserve(1))
+    {
+        dst[0] = value;
+    }
+}
+
+void Writer::I16(int16_t value)
+{
+    U16(static_cast<uint16_t>(value));
+}
+
+void Writer::U16(uint16_t value)
+{
+    if (auto* dst = Reserve(2))
+    {
+        StoreU16(dst, value);
+    }
+}
+
+void Writer::I32(int32_t value)
+{
+    U32(static_cast<uint32_t>(value));
+}
+
+void Writer::U32(uint32_t value)
+{
+    if (auto* dst = Reserve(4))
+    {
+        StoreU32(dst, value);
+    }
+}
+
+void Writer::UserId(const char* user_id)
+{
+    size_t length = user_id != nullptr ? ::strlen(user_id) : 0;
+    if (length == 0 || length > MaxUserIdLength)
+    {
+        _ok = false;
+        return;
+    }
+    U8(static_cast<uint8_t>(length));
+    if (auto* dst = Reserve(length))
+    {
+        ::memcpy(dst, user_id, length);
+    }
+}
+
+void Writer::FullFaceprints(const Faceprints& faceprints)
+{
+    for (int reserved : faceprints.reserved)
+    {
+        I32(reserved);
+    }
+    I32(faceprints.version);
+    U16(static_cast<uint16_t>(faceprints.featuresType));
+    I32(faceprints.flags);
+    for (const feature_t* descriptor : {faceprints.adaptiveDescriptorWithoutMask, faceprints.adaptiveDescriptorWithMask,
+                                        faceprints.enrollmentDescriptor})
+    {
+        for (size_t i = 0; i < FEATURES_VECTOR_ALLOC_SIZE; i++)
+        {
+            I16(descriptor[i]);
+        }
+    }
+}
+
+void Writer::Probe(const Faceprints& faceprints)
+{
+    auto* dst = Reserve(PackedProbeSize);
+    if (dst == nullptr)
+    {
+        return;
+    }
+
+    uint32_t acc = 0;
+    int bits = 0;
+    for (size_t i = 0; i < ProbeLength; i++)
+    {
+        int value = faceprints.adaptiveDescriptorWithoutMask[i];
+        if (value < -ProbeOffset || value > ProbeOffset)
+        {
+            _ok = false;
+            return;
+        }
+        acc |= static_cast<uint32_t>(value + ProbeOffset) << bits;
+        bits += ProbeBits;
+        while (bits >= 8)
+        {
+            *dst++ = static_cast<unsigned char>(acc);
+            acc >>= 8;
+            bits -= 8;
+        }
+    }
+}
+
+size_t Writer::Finish(MessageType type, ReplyStatus status)
+{
+    if (!_ok)
+    {
+        return 0;
+    }
+    const size_t payload_size = _size - HeaderSize;
+    ::memcpy(_buffer, Magic, sizeof(Magic));
+    _buffer[4] = FormatVersion;
+    _buffer[5] = static_cast<unsigned char>(type);
+    _buffer[6] = static_cast<unsigned char>(status);
+    _buffer[7] = 0;
+    StoreU32(_buffer + 8, static_cast<uint32_t>(payload_size));
+    StoreU16(_buffer + 12, PayloadCrc(_buffer + HeaderSize, payload_size));
+    StoreU16(_buffer + 14, 0);
+    return _size;
+}
+
+Reader::Reader(const unsigned char* message, size_t size)
+{
+    if (message == nullptr || size < HeaderSize || ::memcmp(message, Magic, sizeof(Magic)) != 0 ||
+        message[4] != FormatVersion)
+    {
+        return;
+    }
+    const size_t payload_size = LoadU32(message + 8);
+    if (payload_size != size - HeaderSize || LoadU16(message + 12) != PayloadCrc(message + HeaderSize, payload_size))
+    {
+        return;
+    }
+    _type = static_cast<MessageType>(message[5]);
+    _status = static_cast<ReplyStatus>(message[6]);
+    _payload = message + HeaderSize;
+    _payload_size = payload_size;
+    _ok = true;
+}
+
+MessageType Reader::Type() const
+{
+    return _type;
+}
+
+ReplyStatus Reader::Status() const
+{
+    return _status;
+}
+
+const unsigned char* Reader::Take(size_t size)
+{
+    if (!_ok || _payload_size - _offset < size)
+    {
+        _ok = false;
+        return nullptr;
+    }
+    auto* src = _payload + _offset;
+    _offset += size;
+    return src;
+}
+
+uint8_t Reader::U8()
+{
+    auto* src = Take(1);
+    return src != nullptr ? src[0] : 0;
+}
+
+int16_t Reader::I16()
+{
+    return static_cast<int16_t>(U16());
+}
+
+uint16_t Reader::U16()
+{
+    auto* src = Take(2);
+    return src != nullptr ? LoadU16(src) : 0;
+}
+
+int32_t Reader::I32()
+{
+    return static_cast<int32_t>(U32());
+}
+
+uint32_t Reader::U32()
+{
+    auto* src = Take(4);
+    return src != nullptr ? LoadU32(src) : 0;
+}
+
+void Reader::UserId(char* user_id, size_t user_id_size)
+{
+    size_t length = U8();
+    if (length == 0 || length > MaxUserIdLength || length >= user_id_size)
+    {
+        _ok = false;
+    }
+    auto* src = Take(length);
+    if (src == nullptr)
+    {
+        user_id[0] = '\0';
+        return;
+    }
+    ::memcpy(user_id, src, length);
+    user_id[length] = '\0';
+}
+
+void Reader::FullFaceprints(Faceprints& faceprints)
+{
+    for (int& reserved : faceprints.reserved)
+    {
+        reserved = I32();
+    }
+    faceprints.version = I32();
+    faceprints.featuresType = static_cast<FaceprintsTypeEnum>(U16());
+    faceprints.flags = I32();
+    for (feature_t* descriptor : {faceprints.adaptiveDescriptorWithoutMask, faceprints.adaptiveDescriptorWithMask,
+                                  faceprints.enrollmentDescriptor})
+    {
+        for (size_t i = 0; i < FEATURES_VECTOR_ALLOC_SIZE; i++)
+        {
+            descriptor[i] = I16();
+        }
+    }
+}
+
+void Reader::Probe(Faceprints& faceprints)
+{
+    auto* src = Take(PackedProbeSize);
+    if (src == nullptr)
+    {
+        return;
+    }
+
+    uint32_t acc = 0;
+    int bits = 0;
+    for (size_t i = 0; i < ProbeLength; i++)
+    {
+        while (bits < ProbeBits)
+        {
+            acc |= static_cast<uint32_t>(*src++) << bits;
+            bits += 8;
+        }
+        int value = static_cast<int>(acc & ((1u << ProbeBits) - 1)) - ProbeOffset;
+        if (value > ProbeOffset)
+        {
+            _ok = false;
+        }
+        faceprints.adaptiveDescriptorWithoutMask[i] = static_cast<feature_t>(value);
+        acc >>= ProbeBits;
+        bits -= ProbeBits;
+    }
+}
+
+bool Reader::Ok() const
+{
+    return _ok;
+}
+
+bool Reader::AtEnd() const
+{
+    return _ok && _offset == _payload_size;
+}
+} // namespace GalleryWire
+} // namespace RealSenseID
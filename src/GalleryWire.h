@@ -0,0 +1,126 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/Faceprints.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace RealSenseID
+{
+// Binary messages between RemoteGallery and GalleryNode.
+// All the fields are little endian, whatever the byte order of the hosts.
+//
+//   header (16 bytes) - magic "RSGW", format version, message type, reply status, reserved byte, payload size (u32),
+//                       crc16 of the payload, reserved (u16)
+//   payload           - request / reply of the message type:
+//     Match     req: faceprints version (i32), k (u8), number of probes (u8), packed probes
+//               rep: for each probe: number of candidates (u8), candidates [score (i16), confidence (i16), user id]
+//     Update    req: user id, faceprints version (i32), packed probe      rep: faceprints
+//     Add       req: user id, faceprints                                  rep: -
+//     Remove    req: user id                                              rep: -
+//     Size      req: -                                                    rep: number of users (u32)
+//     Clear, Prefetch                                                     req / rep: -
+//
+//   user id         - length (u8) and chars, without the null char
+//   faceprints      - reserved (5 x i32), version (i32), features type (u16), flags (i32), the 3 descriptors
+//                     (259 x i16 each)
+//   packed probe    - the 256 adaptive without-mask values, the only ones searched, offset by 1023 to 11 bits and
+//                     packed lsb first: 352 bytes instead of 512.
+//
+// A reply has the type of its request. Its payload is empty unless the status is Ok.
+namespace GalleryWire
+{
+enum class MessageType : uint8_t
+{
+    Match = 1,
+    Update,
+    Add,
+    Remove,
+    Clear,
+    Size,
+    Prefetch
+};
+
+enum class ReplyStatus : uint8_t
+{
+    Ok = 0,
+    Error,
+    NotFound
+};
+
+static constexpr size_t HeaderSize = 16;
+static constexpr size_t PackedProbeSize = 352;
+static constexpr size_t MaxProbes = 10;
+
+// stable hash of a user id, selecting its node (the same on all hosts and builds)
+uint32_t UserIdHash(const char* user_id);
+
+// writes a message to a buffer: the payload fields in order, then Finish() writes the header.
+// a field that does not fit in the buffer (or an invalid one) fails the message.
+class Writer
+{
+public:
+    Writer(unsigned char* buffer, size_t capacity);
+
+    void U8(uint8_t value);
+    void I16(int16_t value);
+    void U16(uint16_t value);
+    void I32(int32_t value);
+    void U32(uint32_t value);
+    void UserId(const char* user_id);
+    void FullFaceprints(const Faceprints& faceprints);
+    // fails if a value is out of the valid faceprints range [-1023,1023]
+    void Probe(const Faceprints& faceprints);
+
+    // write the header. returns the message size (0 if the message failed).
+    size_t Finish(MessageType type, ReplyStatus status = ReplyStatus::Ok);
+
+private:
+    unsigned char* Reserve(size_t size);
+
+    unsigned char* _buffer;
+    size_t _capacity;
+    size_t _size = HeaderSize;
+    bool _ok = true;
+};
+
+// reads a message written by Writer: the header is validated on construction, then the payload fields are read in
+// order. reading past the payload or an invalid field fails the message (and returns zeros).
+class Reader
+{
+public:
+    Reader(const unsigned char* message, size_t size);
+
+    MessageType Type() const;
+    ReplyStatus Status() const;
+
+    uint8_t U8();
+    int16_t I16();
+    uint16_t U16();
+    int32_t I32();
+    uint32_t U32();
+    // user_id buffer of user_id_size bytes (at least the id length + 1)
+    void UserId(char* user_id, size_t user_id_size);
+    void FullFaceprints(Faceprints& faceprints);
+    // unpack to faceprints.adaptiveDescriptorWithoutMask (the other fields are left as is)
+    void Probe(Faceprints& faceprints);
+
+    // true if the message is valid and all the fields read so far were in it
+    bool Ok() const;
+    // true if the whole payload was read
+    bool AtEnd() const;
+
+private:
+    const unsigned char* Take(size_t size);
+
+    const unsigned char* _payload = nullptr;
+    size_t _payload_size = 0;
+    size_t _offset = 0;
+    MessageType _type = MessageType::Match;
+    ReplyStatus _status = ReplyStatus::Error;
+    bool _ok = false;
+};
+} // namespace GalleryWire
+} // namespace RealSenseID
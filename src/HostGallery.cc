@@ -0,0 +1,880 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "RealSenseID/HostGallery.h"
+#include "Matcher/Matcher.h"
+#include "Matcher/MatcherGallery.h"
+#include "Matcher/MatcherGalleryFile.h"
+#include "Matcher/MatcherTieredGallery.h"
+#include "Matcher/MatcherThreadPool.h"
+#include "Matcher/MatcherUserIndex.h"
+#include "PacketManager/SerialPacket.h"
+#include "PacketManager/UsersChecksum.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace RealSenseID
+{
+static const char* LOG_TAG = "HostGallery";
+
+class HostGalleryImpl
+{
+public:
+    HostGalleryImpl(unsigned int search_threads, const TieredGalleryConfig& tiers,
+                    const HostGalleryPlacement& placement) :
+        _gallery {tiers}, _thresholds {Matcher::GetDefaultThresholds()}, _placement(placement)
+    {
+        if (search_threads > 1)
+        {
+            _pool.reset(new MatcherThreadPool(search_threads, placement.numa_shards));
+            _search_config.pool = _pool.get();
+        }
+    }
+
+    Status Add(const char* user_id, const Faceprints& faceprints)
+    {
+        if (!ValidateUserId(user_id))
+        {
+            return Status::Error;
+        }
+
+        std::lock_guard<std::mutex> lock {_mutex};
+        size_t index = _index.Find(_gallery.Cold(), user_id);
+        if (index != MatcherUserIndex::NotFound)
+        {
+            if (!_gallery.Update(index, faceprints))
+            {
+                return Status::Error;
+            }
+            OnChecksumChanged(index);
+            return Status::Ok;
+        }
+
+        ExtendedFaceprints entry;
+        ::strncpy(entry.user_id, user_id, sizeof(entry.user_id) - 1);
+        entry.user_id[sizeof(entry.user_id) - 1] = '\0';
+        entry.faceprints = faceprints;
+        if (!_gallery.Add(entry))
+        {
+            return Status::Error;
+        }
+        _index.Insert(entry.user_id, _gallery.Size() - 1);
+        OnChecksumAdded(_gallery.Size() - 1);
+        return Status::Ok;
+    }
+
+    Status Remove(const char* user_id)
+    {
+        if (user_id == nullptr)
+        {
+            return Status::Error;
+        }
+
+        std::lock_guard<std::mutex> lock {_mutex};
+        size_t index = _index.Find(_gallery.Cold(), user_id);
+        if (index == MatcherUserIndex::NotFound)
+        {
+            LOG_DEBUG(LOG_TAG, "User \"%s\" not in gallery", user_id);
+            return Status::Error;
+        }
+        // the last user takes the removed one's place
+        const size_t last = _gallery.Size() - 1;
+        _index.Erase(user_id, index);
+        if (index != last)
+        {
+            _index.Move(_gallery.UserId(last), last, index);
+        }
+        ForgetRecent(index, last);
+        OnChecksumRemoved(index, last);
+        OnGroupsRemoved(index, last);
+        return _gallery.SwapRemove(index) ? Status::Ok : Status::Error;
+    }
+
+    void Clear()
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        _gallery.Clear();
+        _index.Clear();
+        _recent.clear();
+        ResetChecksums();
+        ResetGroups();
+    }
+
+    size_t Size() const
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        return _gallery.Size();
+    }
+
+    Status Save(const char* path) const
+    {
+        if (path == nullptr)
+        {
+            return Status::Error;
+        }
+
+        std::lock_guard<std::mutex> lock {_mutex};
+        return MatcherGalleryFile::Save(_gallery.Cold(), path) ? Status::Ok : Status::Error;
+    }
+
+    Status Load(const char* path)
+    {
+        if (path == nullptr)
+        {
+            return Status::Error;
+        }
+
+        auto file = MatcherGalleryFile::Open(path);
+        if (!file)
+        {
+            LOG_ERROR(LOG_TAG, "Failed to load gallery file \"%s\"", path);
+            return Status::Error;
+        }
+        std::lock_guard<std::mutex> lock {_mutex};
+        _gallery.Attach(std::move(file));
+        _index.Rebuild(_gallery.Cold());
+        _recent.clear();
+        ResetChecksums();
+        ResetGroups();
+        PlaceGallery();
+        return Status::Ok;
+    }
+
+    Status Load(const char* const* user_ids, const Faceprints* faceprints, size_t number_of_users,
+                size_t& number_loaded)
+    {
+        number_loaded = 0;
+        if (user_ids == nullptr || faceprints == nullptr)
+        {
+            LOG_ERROR(LOG_TAG, "Invalid load arguments");
+            return Status::Error;
+        }
+
+        // without search threads the load still runs in parallel, on a pool of its own
+        std::unique_ptr<MatcherThreadPool> load_pool;
+        MatcherThreadPool* pool = _pool.get();
+        if (pool == nullptr && number_of_users >= MinParallelLoad)
+        {
+            load_pool.reset(new MatcherThreadPool());
+            pool = load_pool.get();
+        }
+
+        // the faceprints are validated first, so an invalid entry does not replace a valid one of the same user
+        std::vector<unsigned char> valid(number_of_users);
+        auto validate = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+            {
+                valid[i] = Matcher::ValidateFaceprints(faceprints[i]) &&
+                           Matcher::ValidateVector(&faceprints[i].adaptiveDescriptorWithMask[0]);
+            }
+        };
+        const size_t n_shards = pool != nullptr ? std::max<size_t>(pool->NumberOfThreads(), 1) : 1;
+        const size_t shard_size = (number_of_users + n_shards - 1) / n_shards;
+        if (n_shards == 1)
+        {
+            validate(0, number_of_users);
+        }
+        else
+        {
+            pool->Run(n_shards, [&](size_t shard) {
+                const size_t begin = std::min(shard * shard_size, number_of_users);
+                validate(begin, std::min(begin + shard_size, number_of_users));
+            });
+        }
+
+        // as if added one by one: a user is at the position of its first valid entry, with its last valid faceprints
+        std::vector<const char*> load_user_ids;
+        std::vector<const Faceprints*> load_faceprints;
+        load_user_ids.reserve(number_of_users);
+        load_faceprints.reserve(number_of_users);
+        std::unordered_map<std::string, size_t> positions;
+        positions.reserve(number_of_users);
+        size_t skipped = 0;
+        for (size_t i = 0; i < number_of_users; i++)
+        {
+            const char* user_id = user_ids[i];
+            const size_t user_id_len = user_id != nullptr ? ::strnlen(user_id, PacketManager::MaxUserIdSize + 1) : 0;
+            if (user_id_len == 0 || user_id_len > PacketManager::MaxUserIdSize || !valid[i])
+            {
+                skipped++;
+                continue;
+            }
+            auto position = positions.emplace(std::string(user_id, user_id_len), load_user_ids.size());
+            if (!position.second)
+            {
+                load_faceprints[position.first->second] = &faceprints[i];
+                continue;
+            }
+            load_user_ids.push_back(user_id);
+            load_faceprints.push_back(&faceprints[i]);
+        }
+        if (skipped > 0)
+        {
+            LOG_ERROR(LOG_TAG, "%zu invalid entries were not loaded", skipped);
+        }
+
+        std::lock_guard<std::mutex> lock {_mutex};
+        _gallery.Clear();
+        _recent.clear();
+        number_loaded = _gallery.AddBatch(load_user_ids.data(), load_faceprints.data(), load_user_ids.size(), pool);
+        _index.Rebuild(_gallery.Cold());
+        ResetChecksums();
+        ResetGroups();
+        PlaceGallery();
+        return Status::Ok;
+    }
+
+    Status FindDuplicates(HostGalleryDuplicate* duplicates, size_t max_duplicates, size_t& number_of_duplicates) const
+    {
+        number_of_duplicates = 0;
+        if (duplicates == nullptr && max_duplicates > 0)
+        {
+            LOG_ERROR(LOG_TAG, "Invalid duplicates array");
+            return Status::Error;
+        }
+
+        std::vector<DuplicatePair> pairs;
+        std::lock_guard<std::mutex> lock {_mutex};
+        // the pairs that would be matched as one another
+        number_of_duplicates = Matcher::FindDuplicates(_gallery.Cold(), _thresholds.strongThreshold_pNMgNM,
+                                                       max_duplicates, pairs, _pool.get());
+        for (size_t i = 0; i < pairs.size(); i++)
+        {
+            HostGalleryDuplicate& duplicate = duplicates[i];
+            duplicate = HostGalleryDuplicate {};
+            ::strncpy(duplicate.user_id, _gallery.UserId(pairs[i].first), sizeof(duplicate.user_id) - 1);
+            ::strncpy(duplicate.other_user_id, _gallery.UserId(pairs[i].second), sizeof(duplicate.other_user_id) - 1);
+            duplicate.score = pairs[i].score;
+        }
+        return Status::Ok;
+    }
+
+    Status GetChecksums(unsigned int level, unsigned int first_node, unsigned int number_of_nodes,
+                        uint64_t* digests) const
+    {
+        if (level >= PacketManager::ChecksumLevels ||
+            static_cast<size_t>(first_node) + number_of_nodes > PacketManager::ChecksumLevelSize(level) ||
+            (digests == nullptr && number_of_nodes > 0))
+        {
+            LOG_ERROR(LOG_TAG, "Invalid checksums arguments");
+            return Status::Error;
+        }
+
+        std::lock_guard<std::mutex> lock {_mutex};
+        BuildChecksums();
+        for (unsigned int i = 0; i < number_of_nodes; i++)
+        {
+            digests[i] = _checksum_tree.Digest(level, first_node + i);
+        }
+        return Status::Ok;
+    }
+
+    Status GetBucketChecksums(unsigned int bucket, HostGalleryUserChecksum* users, size_t max_users,
+                              size_t& number_of_users) const
+    {
+        number_of_users = 0;
+        if (bucket >= PacketManager::ChecksumBuckets || (users == nullptr && max_users > 0))
+        {
+            LOG_ERROR(LOG_TAG, "Invalid bucket checksums arguments");
+            return Status::Error;
+        }
+
+        std::lock_guard<std::mutex> lock {_mutex};
+        BuildChecksums();
+        for (size_t i = 0; i < _user_buckets.size(); i++)
+        {
+            if (_user_buckets[i] != bucket)
+            {
+                continue;
+            }
+            if (number_of_users < max_users)
+            {
+                HostGalleryUserChecksum& user = users[number_of_users];
+                user = HostGalleryUserChecksum {};
+                ::strncpy(user.user_id, _gallery.UserId(i), sizeof(user.user_id) - 1);
+                user.checksum = _user_checksums[i];
+            }
+            number_of_users++;
+        }
+        return Status::Ok;
+    }
+
+    // access_groups: warm the users of these groups only (nullptr - all the users).
+    // the mutex is taken per chunk of users, so a match waits for one chunk at most.
+    void Prefetch(const uint64_t* access_groups) const
+    {
+        for (size_t begin = 0;; begin += PrefetchChunk)
+        {
+            std::lock_guard<std::mutex> lock {_mutex};
+            const size_t end = std::min(begin + PrefetchChunk, _gallery.Size());
+            if (begin >= end)
+            {
+                return;
+            }
+            if (access_groups == nullptr)
+            {
+                _gallery.Cold().Prefetch(begin, end);
+                continue;
+            }
+            // warm each run of consecutive members
+            size_t run_begin = begin;
+            for (size_t index = begin; index <= end; index++)
+            {
+                if (index < end && InGroups(index, *access_groups))
+                {
+                    continue;
+                }
+                _gallery.Cold().Prefetch(run_begin, index);
+                run_begin = index + 1;
+            }
+        }
+    }
+
+    void SetRecentUsersFirst(size_t recent_users)
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        _recent_capacity = recent_users;
+        if (_recent.size() > recent_users)
+        {
+            _recent.resize(recent_users);
+        }
+    }
+
+    void SetAccelerator(GalleryAccelerator* accelerator, size_t shortlist_size)
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        _gallery.SetAccelerator(accelerator, shortlist_size);
+    }
+
+    Status SetUserGroups(const char* user_id, uint64_t access_groups)
+    {
+        if (user_id == nullptr)
+        {
+            return Status::Error;
+        }
+
+        std::lock_guard<std::mutex> lock {_mutex};
+        size_t index = _index.Find(_gallery.Cold(), user_id);
+        if (index == MatcherUserIndex::NotFound)
+        {
+            LOG_DEBUG(LOG_TAG, "User \"%s\" not in gallery", user_id);
+            return Status::Error;
+        }
+        for (size_t group = 0; group < AccessGroups; group++)
+        {
+            SetBit(_group_members[group], index, (access_groups >> group) & 1);
+        }
+        return Status::Ok;
+    }
+
+    // access_groups: match the users of these groups only (nullptr - all the users)
+    HostGalleryMatch Match(const Faceprints& new_faceprints, Faceprints* updated_faceprints,
+                           const uint64_t* access_groups)
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        SearchConfig search_config = _search_config;
+        search_config.hints = _recent.data();
+        search_config.number_of_hints = _recent.size();
+        if (access_groups != nullptr)
+        {
+            search_config.eligible = GroupsEligible(*access_groups);
+        }
+        // the adaptive update is applied in place, not built in a copy of the matched user's faceprints
+        search_config.defer_update = true;
+        Faceprints deferred;
+        auto result = _gallery.Match(new_faceprints, deferred, _thresholds, search_config);
+
+        HostGalleryMatch gallery_match;
+        if (!ToMatchedUser(result, gallery_match) || !result.should_update)
+        {
+            return gallery_match;
+        }
+        const auto index = static_cast<size_t>(result.userId);
+        gallery_match.result.should_update = _gallery.UpdateInPlace(index, new_faceprints, _thresholds);
+        if (gallery_match.result.should_update)
+        {
+            OnChecksumChanged(index);
+            if (updated_faceprints != nullptr)
+            {
+                *updated_faceprints = _gallery.Entry(index).faceprints;
+            }
+        }
+        return gallery_match;
+    }
+
+    HostGalleryMatch FindUser(const Faceprints& faceprints)
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        SearchConfig search_config = _search_config;
+        search_config.hints = _recent.data();
+        search_config.number_of_hints = _recent.size();
+        // the match decision only
+        search_config.defer_update = true;
+        Faceprints deferred;
+        auto result = _gallery.Match(faceprints, deferred, _thresholds, search_config);
+
+        HostGalleryMatch gallery_match;
+        ToMatchedUser(result, gallery_match, false);
+        return gallery_match;
+    }
+
+    Status MatchBatch(const Faceprints* new_faceprints, size_t number_of_probes, HostGalleryMatch* results,
+                      Faceprints* updated_faceprints)
+    {
+        if (new_faceprints == nullptr || results == nullptr || updated_faceprints == nullptr)
+        {
+            LOG_ERROR(LOG_TAG, "Invalid batch match arguments");
+            return Status::Error;
+        }
+
+        std::lock_guard<std::mutex> lock {_mutex};
+        std::vector<ExtendedMatchResult> match_results(number_of_probes);
+        bool success = _gallery.MatchBatch(new_faceprints, number_of_probes, match_results.data(), updated_faceprints,
+                                           _thresholds, _search_config);
+
+        // the updates are applied after the whole batch was matched against the same gallery, in probe order
+        for (size_t i = 0; i < number_of_probes; i++)
+        {
+            results[i] = ToGalleryMatch(match_results[i], updated_faceprints[i]);
+        }
+        return success ? Status::Ok : Status::Error;
+    }
+
+private:
+    // place the loaded search data, if configured. must be called with the mutex held.
+    void PlaceGallery()
+    {
+        if (!_placement.numa_shards && !_placement.huge_pages)
+        {
+            return;
+        }
+        try
+        {
+            _gallery.Place(_pool.get(), _search_config.min_shard_size, _placement.huge_pages);
+        }
+        catch (const std::bad_alloc&)
+        {
+            // the gallery stays in ordinary memory
+            LOG_ERROR(LOG_TAG, "Failed to allocate placed memory for %zu users", _gallery.Size());
+        }
+    }
+
+    // the users checksum tree is built on first use (so a load does not read all the faceprints for it), then kept
+    // up to date with the changes. must be called with the mutex held.
+    void BuildChecksums() const
+    {
+        if (_checksums_built)
+        {
+            return;
+        }
+        const size_t size = _gallery.Size();
+        _user_checksums.resize(size);
+        _user_buckets.resize(size);
+        if (_pool != nullptr && size >= MinParallelLoad)
+        {
+            const size_t n_tasks = _pool->NumberOfThreads();
+            _pool->Run(n_tasks, [this, size, n_tasks](size_t task) {
+                for (size_t i = size * task / n_tasks; i < size * (task + 1) / n_tasks; i++)
+                {
+                    ComputeChecksum(i);
+                }
+            });
+        }
+        else
+        {
+            for (size_t i = 0; i < size; i++)
+            {
+                ComputeChecksum(i);
+            }
+        }
+        _checksum_tree.Clear();
+        for (size_t i = 0; i < size; i++)
+        {
+            _checksum_tree.Add(_user_buckets[i], _user_checksums[i]);
+        }
+        _checksums_built = true;
+    }
+
+    void ComputeChecksum(size_t index) const
+    {
+        const ExtendedFaceprints entry = _gallery.Cold().Entry(index);
+        _user_buckets[index] = static_cast<uint8_t>(PacketManager::ChecksumBucket(entry.user_id));
+        _user_checksums[index] = PacketManager::UserChecksum(entry.user_id, entry.faceprints);
+    }
+
+    void OnChecksumAdded(size_t index)
+    {
+        if (_checksums_built)
+        {
+            _user_checksums.resize(index + 1);
+            _user_buckets.resize(index + 1);
+            ComputeChecksum(index);
+            _checksum_tree.Add(_user_buckets[index], _user_checksums[index]);
+        }
+    }
+
+    void OnChecksumChanged(size_t index)
+    {
+        if (_checksums_built)
+        {
+            _checksum_tree.Remove(_user_buckets[index], _user_checksums[index]);
+            ComputeChecksum(index);
+            _checksum_tree.Add(_user_buckets[index], _user_checksums[index]);
+        }
+    }
+
+    // the user at index is removed and the last user takes its place
+    void OnChecksumRemoved(size_t index, size_t last)
+    {
+        if (_checksums_built)
+        {
+            _checksum_tree.Remove(_user_buckets[index], _user_checksums[index]);
+            _user_checksums[index] = _user_checksums[last];
+            _user_buckets[index] = _user_buckets[last];
+            _user_checksums.pop_back();
+            _user_buckets.pop_back();
+        }
+    }
+
+    void ResetChecksums()
+    {
+        _checksums_built = false;
+        _user_checksums.clear();
+        _user_buckets.clear();
+        _checksum_tree.Clear();
+    }
+
+    static bool ValidateUserId(const char* user_id)
+    {
+        if (user_id == nullptr)
+        {
+            LOG_ERROR(LOG_TAG, "Invalid user id: nullptr");
+            return false;
+        }
+
+        auto user_id_len = ::strlen(user_id);
+        bool is_valid = user_id_len > 0 && user_id_len <= PacketManager::MaxUserIdSize;
+        if (!is_valid)
+        {
+            LOG_ERROR(LOG_TAG, "Invalid user id length. Valid size: 1 - %zu", PacketManager::MaxUserIdSize);
+        }
+        return is_valid;
+    }
+
+    static void SetBit(std::vector<uint64_t>& bits, size_t index, bool value)
+    {
+        if (index / 64 >= bits.size())
+        {
+            if (!value)
+            {
+                return;
+            }
+            bits.resize(index / 64 + 1, 0);
+        }
+        const uint64_t bit = uint64_t {1} << (index % 64);
+        bits[index / 64] = value ? bits[index / 64] | bit : bits[index / 64] & ~bit;
+    }
+
+    static bool GetBit(const std::vector<uint64_t>& bits, size_t index)
+    {
+        return index / 64 < bits.size() && (bits[index / 64] >> (index % 64)) & 1;
+    }
+
+    bool InGroups(size_t index, uint64_t access_groups) const
+    {
+        for (size_t group = 0; group < AccessGroups; group++)
+        {
+            if (((access_groups >> group) & 1) && GetBit(_group_members[group], index))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // the users of the access groups, as the eligible bitset of the search (see SearchConfig::eligible): an or of the
+    // groups' bitsets, a word per 64 users. must be called with the mutex held.
+    const uint64_t* GroupsEligible(uint64_t access_groups)
+    {
+        _eligible.assign((_gallery.Size() + 63) / 64, 0);
+        for (size_t group = 0; group < AccessGroups; group++)
+        {
+            if (((access_groups >> group) & 1) == 0)
+            {
+                continue;
+            }
+            const auto& members = _group_members[group];
+            const size_t words = std::min(members.size(), _eligible.size());
+            for (size_t word = 0; word < words; word++)
+            {
+                _eligible[word] |= members[word];
+            }
+        }
+        return _eligible.data();
+    }
+
+    // the user at index is removed and the last user takes its groups' place
+    void OnGroupsRemoved(size_t index, size_t last)
+    {
+        for (auto& members : _group_members)
+        {
+            SetBit(members, index, GetBit(members, last));
+            SetBit(members, last, false);
+        }
+    }
+
+    void ResetGroups()
+    {
+        for (auto& members : _group_members)
+        {
+            members.clear();
+        }
+    }
+
+    // convert to the public result (but should_update) if a user matched. remember: keep the user as a recent match
+    bool ToMatchedUser(const ExtendedMatchResult& result, HostGalleryMatch& gallery_match, bool remember = true)
+    {
+        if (!result.isSame || result.userId < 0 || static_cast<size_t>(result.userId) >= _gallery.Size())
+        {
+            return false;
+        }
+
+        const auto index = static_cast<size_t>(result.userId);
+        gallery_match.result.success = true;
+        gallery_match.result.score = result.maxScore;
+        gallery_match.result.confidence = result.confidence;
+        ::strncpy(gallery_match.user_id, _gallery.UserId(index), sizeof(gallery_match.user_id) - 1);
+        if (remember)
+        {
+            RememberRecent(index);
+        }
+        return true;
+    }
+
+    // convert to the public result and apply the adaptive update of the matched user, if any
+    HostGalleryMatch ToGalleryMatch(const ExtendedMatchResult& result, const Faceprints& updated_faceprints)
+    {
+        HostGalleryMatch gallery_match;
+        if (!ToMatchedUser(result, gallery_match))
+        {
+            return gallery_match;
+        }
+
+        const auto index = static_cast<size_t>(result.userId);
+        if (result.should_update)
+        {
+            gallery_match.result.should_update = _gallery.Update(index, updated_faceprints);
+            if (gallery_match.result.should_update)
+            {
+                OnChecksumChanged(index);
+            }
+        }
+        return gallery_match;
+    }
+
+    // move the matched user to the front of the recent users
+    void RememberRecent(size_t index)
+    {
+        if (_recent_capacity == 0)
+        {
+            return;
+        }
+        auto it = std::find(_recent.begin(), _recent.end(), index);
+        if (it == _recent.end())
+        {
+            if (_recent.size() < _recent_capacity)
+            {
+                _recent.push_back(index);
+            }
+            it = _recent.end() - 1;
+            *it = index;
+        }
+        std::rotate(_recent.begin(), it, it + 1);
+    }
+
+    // the user at index is removed and the last user takes its place
+    void ForgetRecent(size_t index, size_t last)
+    {
+        _recent.erase(std::remove(_recent.begin(), _recent.end(), index), _recent.end());
+        std::replace(_recent.begin(), _recent.end(), last, index);
+    }
+
+    mutable std::mutex _mutex;
+    MatcherTieredGallery _gallery;
+    MatcherUserIndex _index;
+    Thresholds _thresholds;
+    const HostGalleryPlacement _placement;
+
+    // smallest bulk load worth threads of its own
+    static constexpr size_t MinParallelLoad = 4096;
+
+    // users warmed per hold of the mutex by Prefetch()
+    static constexpr size_t PrefetchChunk = 1024;
+
+    std::unique_ptr<MatcherThreadPool> _pool;
+    SearchConfig _search_config;
+    size_t _recent_capacity = 0;
+    std::vector<size_t> _recent; // gallery indices of the users matched last, most recent first
+
+    // the users of each access group, a bitset of gallery indices per group (see SetUserGroups())
+    static constexpr size_t AccessGroups = 64;
+    std::vector<uint64_t> _group_members[AccessGroups];
+    std::vector<uint64_t> _eligible; // scratch bitset of GroupsEligible()
+
+    // users checksum tree (see PacketManager/UsersChecksum.h), and the checksum and bucket of each gallery index
+    static_assert(PacketManager::ChecksumBuckets <= 256, "bucket index does not fit a byte");
+    mutable bool _checksums_built = false;
+    mutable PacketManager::UsersChecksumTree _checksum_tree;
+    mutable std::vector<uint64_t> _user_checksums;
+    mutable std::vector<uint8_t> _user_buckets;
+};
+
+HostGallery::HostGallery() : HostGallery(1, 0)
+{
+}
+
+HostGallery::HostGallery(unsigned int search_threads) : HostGallery(search_threads, 0)
+{
+}
+
+HostGallery::HostGallery(unsigned int search_threads, size_t hot_users) :
+    HostGallery(search_threads, hot_users, HostGalleryPlacement())
+{
+}
+
+HostGallery::HostGallery(unsigned int search_threads, size_t hot_users, const HostGalleryPlacement& placement)
+{
+    TieredGalleryConfig tiers;
+    tiers.hot_capacity = hot_users;
+    _impl = new HostGalleryImpl(search_threads, tiers, placement);
+}
+
+HostGallery::~HostGallery()
+{
+    try
+    {
+        delete _impl;
+    }
+    catch (...)
+    {
+    }
+}
+
+Status HostGallery::Add(const char* user_id, const Faceprints& faceprints)
+{
+    return _impl->Add(user_id, faceprints);
+}
+
+Status HostGallery::Remove(const char* user_id)
+{
+    return _impl->Remove(user_id);
+}
+
+void HostGallery::Clear()
+{
+    _impl->Clear();
+}
+
+size_t HostGallery::Size() const
+{
+    return _impl->Size();
+}
+
+Status HostGallery::Save(const char* path) const
+{
+    return _impl->Save(path);
+}
+
+Status HostGallery::Load(const char* path)
+{
+    return _impl->Load(path);
+}
+
+Status HostGallery::Load(const char* const* user_ids, const Faceprints* faceprints, size_t number_of_users,
+                         size_t& number_loaded)
+{
+    return _impl->Load(user_ids, faceprints, number_of_users, number_loaded);
+}
+
+Status HostGallery::FindDuplicates(HostGalleryDuplicate* duplicates, size_t max_duplicates,
+                                   size_t& number_of_duplicates) const
+{
+    return _impl->FindDuplicates(duplicates, max_duplicates, number_of_duplicates);
+}
+
+Status HostGallery::GetChecksums(unsigned int level, unsigned int first_node, unsigned int number_of_nodes,
+                                 uint64_t* digests) const
+{
+    return _impl->GetChecksums(level, first_node, number_of_nodes, digests);
+}
+
+Status HostGallery::GetBucketChecksums(unsigned int bucket, HostGalleryUserChecksum* users, size_t max_users,
+                                       size_t& number_of_users) const
+{
+    return _impl->GetBucketChecksums(bucket, users, max_users, number_of_users);
+}
+
+void HostGallery::Prefetch() const
+{
+    _impl->Prefetch(nullptr);
+}
+
+void HostGallery::Prefetch(uint64_t access_groups) const
+{
+    _impl->Prefetch(&access_groups);
+}
+
+void HostGallery::SetRecentUsersFirst(size_t recent_users)
+{
+    _impl->SetRecentUsersFirst(recent_users);
+}
+
+void HostGallery::SetAccelerator(GalleryAccelerator* accelerator, size_t shortlist_size)
+{
+    _impl->SetAccelerator(accelerator, shortlist_size);
+}
+
+Status HostGallery::SetUserGroups(const char* user_id, uint64_t access_groups)
+{
+    return _impl->SetUserGroups(user_id, access_groups);
+}
+
+HostGalleryMatch HostGallery::Match(const Faceprints& new_faceprints, Faceprints& updated_faceprints)
+{
+    return _impl->Match(new_faceprints, &updated_faceprints, nullptr);
+}
+
+HostGalleryMatch HostGallery::Match(const Faceprints& new_faceprints)
+{
+    return _impl->Match(new_faceprints, nullptr, nullptr);
+}
+
+HostGalleryMatch HostGallery::Match(const Faceprints& new_faceprints, uint64_t access_groups,
+                                    Faceprints& updated_faceprints)
+{
+    return _impl->Match(new_faceprints, &updated_faceprints, &access_groups);
+}
+
+HostGalleryMatch HostGallery::Match(const Faceprints& new_faceprints, uint64_t access_groups)
+{
+    return _impl->Match(new_faceprints, nullptr, &access_groups);
+}
+
+HostGalleryMatch HostGallery::FindUser(const Faceprints& faceprints)
+{
+    return _impl->FindUser(faceprints);
+}
+
+Status HostGallery::MatchBatch(const Faceprints* new_faceprints, size_t number_of_probes, HostGalleryMatch* results,
+                               Faceprints* updated_faceprints)
+{
+    return _impl->MatchBatch(new_faceprints, number_of_probes, results, updated_faceprints);
+}
+} // namespace RealSenseID
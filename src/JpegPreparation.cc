@@ -0,0 +1,181 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "JpegPreparation.h"
+#include <string.h>
+
+namespace RealSenseID
+{
+static constexpr unsigned char MarkerPrefix = 0xFF;
+static constexpr unsigned char SOI = 0xD8;
+static constexpr unsigned char EOI = 0xD9;
+static constexpr unsigned char SOS = 0xDA;
+static constexpr unsigned char APP0 = 0xE0;
+static constexpr unsigned char APP1 = 0xE1;
+static constexpr unsigned char APP14 = 0xEE;
+static constexpr unsigned char APP15 = 0xEF;
+static constexpr unsigned char COM = 0xFE;
+static constexpr uint16_t OrientationTag = 0x0112;
+
+static uint16_t ReadU16(const unsigned char* src, bool big_endian)
+{
+    return big_endian ? static_cast<uint16_t>(src[0] << 8 | src[1]) : static_cast<uint16_t>(src[1] << 8 | src[0]);
+}
+
+static uint32_t ReadU32(const unsigned char* src, bool big_endian)
+{
+    return big_endian ? static_cast<uint32_t>(ReadU16(src, true)) << 16 | ReadU16(src + 2, true)
+                      : static_cast<uint32_t>(ReadU16(src + 2, false)) << 16 | ReadU16(src, false);
+}
+
+// standalone markers have no length field
+static bool IsStandalone(unsigned char marker)
+{
+    return marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7);
+}
+
+// start of frame markers, which carry the image size. C4 (DHT), C8 (JPG) and CC (DAC) are not frames.
+static bool IsStartOfFrame(unsigned char marker)
+{
+    return marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+}
+
+// orientation tag of the IFD0 of an exif segment (after its "Exif\0\0" id), 1 if there is none
+static uint8_t ExifOrientation(const unsigned char* tiff, size_t size)
+{
+    if (size < 8 || (::memcmp(tiff, "II", 2) != 0 && ::memcmp(tiff, "MM", 2) != 0))
+    {
+        return 1;
+    }
+    const bool big_endian = tiff[0] == 'M';
+    const uint32_t ifd = ReadU32(tiff + 4, big_endian);
+    if (ifd > size - 2)
+    {
+        return 1;
+    }
+    const uint16_t n_entries = ReadU16(tiff + ifd, big_endian);
+    for (uint32_t i = 0; i < n_entries; i++)
+    {
+        const size_t entry = ifd + 2 + static_cast<size_t>(i) * 12;
+        if (entry + 12 > size)
+        {
+            break;
+        }
+        if (ReadU16(tiff + entry, big_endian) == OrientationTag)
+        {
+            const uint16_t orientation = ReadU16(tiff + entry + 8, big_endian); // a SHORT, in the value field
+            return orientation >= 1 && orientation <= 8 ? static_cast<uint8_t>(orientation) : 1;
+        }
+    }
+    return 1;
+}
+
+// end of the entropy coded data from pos: the next marker that is not a stuffed byte (FF00) or a restart marker
+static size_t EntropyEnd(const unsigned char* jpeg, size_t size, size_t pos)
+{
+    for (; pos + 1 < size; pos++)
+    {
+        if (jpeg[pos] == MarkerPrefix && jpeg[pos + 1] != 0x00 && !(jpeg[pos + 1] >= 0xD0 && jpeg[pos + 1] <= 0xD7))
+        {
+            return pos;
+        }
+    }
+    return size;
+}
+
+bool PrepareJpeg(const unsigned char* jpeg, size_t size, PreparedJpeg& prepared)
+{
+    prepared.data.clear();
+    prepared.orientation = 1;
+    prepared.width = 0;
+    prepared.height = 0;
+    if (jpeg == nullptr || size < 4 || jpeg[0] != MarkerPrefix || jpeg[1] != SOI)
+    {
+        return false;
+    }
+
+    auto append = [&prepared, jpeg](size_t begin, size_t end) {
+        prepared.data.insert(prepared.data.end(), jpeg + begin, jpeg + end);
+    };
+    prepared.data.reserve(size);
+    append(0, 2);
+    bool has_frame = false;
+    bool has_scan = false;
+    size_t pos = 2;
+    while (pos + 2 <= size)
+    {
+        if (jpeg[pos] != MarkerPrefix)
+        {
+            return false;
+        }
+        const unsigned char marker = jpeg[pos + 1];
+        if (marker == MarkerPrefix) // fill byte
+        {
+            pos++;
+            continue;
+        }
+        if (marker == EOI)
+        {
+            append(pos, pos + 2);
+            return has_frame && has_scan;
+        }
+        if (IsStandalone(marker))
+        {
+            append(pos, pos + 2);
+            pos += 2;
+            continue;
+        }
+        if (pos + 4 > size)
+        {
+            return false;
+        }
+        const size_t length = ReadU16(jpeg + pos + 2, true);
+        const size_t segment_end = pos + 2 + length;
+        if (length < 2 || segment_end > size)
+        {
+            return false;
+        }
+        const unsigned char* segment = jpeg + pos + 4;
+        const size_t segment_size = length - 2;
+
+        if (IsStartOfFrame(marker))
+        {
+            if (segment_size < 5)
+            {
+                return false;
+            }
+            prepared.height = ReadU16(segment + 1, true);
+            prepared.width = ReadU16(segment + 3, true);
+            has_frame = prepared.width > 0 && prepared.height > 0;
+        }
+        else if (marker == APP1 && segment_size >= 6 && ::memcmp(segment, "Exif\0\0", 6) == 0)
+        {
+            prepared.orientation = ExifOrientation(segment + 6, segment_size - 6);
+        }
+
+        const bool dropped = (marker > APP0 && marker <= APP15 && marker != APP14) || marker == COM;
+        if (marker == SOS)
+        {
+            const size_t scan_end = EntropyEnd(jpeg, size, segment_end);
+            append(pos, scan_end);
+            has_scan = true;
+            pos = scan_end;
+            continue;
+        }
+        if (!dropped)
+        {
+            append(pos, segment_end);
+        }
+        pos = segment_end;
+    }
+
+    // truncated after the last scan: a decoder reads what is there, so end the image
+    if (!has_frame || !has_scan)
+    {
+        return false;
+    }
+    const unsigned char eoi[2] = {MarkerPrefix, EOI};
+    prepared.data.insert(prepared.data.end(), eoi, eoi + 2);
+    return true;
+}
+} // namespace RealSenseID
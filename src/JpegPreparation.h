@@ -0,0 +1,28 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace RealSenseID
+{
+// JPEG image ready for upload with the EnrollImage messages (see PacketManager/EnrollImage.h)
+struct PreparedJpeg
+{
+    std::vector<unsigned char> data;
+    uint8_t orientation = 1; // exif orientation, 1 - 8
+    uint16_t width = 0;
+    uint16_t height = 0;
+};
+
+// Host side preparation of a stored JPEG image (e.g. a badge photo) for bulk enrollment: the markers are validated
+// and the segments the device does not need for decoding are dropped - the application segments but APP0 (JFIF) and
+// APP14 (Adobe, whose color transform changes the decoding), and the comments. Camera and phone photos carry exif
+// data, thumbnails and color profiles of tens of KB, a large part of the upload time of a small photo.
+// The exif orientation is kept aside, for the device to turn the image upright.
+// Returns false if the image is not a valid JPEG (prepared is then partly written). prepared.data is reused.
+bool PrepareJpeg(const unsigned char* jpeg, size_t size, PreparedJpeg& prepared);
+} // namespace RealSenseID
@@ -0,0 +1,183 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "LibraryMemory.h"
+#include <algorithm>
+#include <atomic>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace RealSenseID
+{
+namespace Memory
+{
+namespace
+{
+using Counter = std::atomic<unsigned long long>;
+
+// placed right before the block returned to the library
+struct BlockHeader
+{
+    Allocator* allocator; // nullptr - the default heap
+    Category category;
+};
+
+constexpr size_t CategoryCount = static_cast<size_t>(Category::Count);
+
+std::atomic<Allocator*> s_allocator {nullptr};
+Counter s_allocations {0};
+Counter s_deallocations {0};
+Counter s_bytes_allocated {0};
+Counter s_bytes_in_use {0};
+Counter s_peak_bytes_in_use {0};
+// by category (Allocate() and Track()), and their total
+Counter s_category_in_use[CategoryCount];
+Counter s_category_peak[CategoryCount];
+Counter s_total_in_use {0};
+Counter s_total_peak {0};
+
+// bytes before the block: the header, keeping the block aligned
+size_t PrefixSize(size_t alignment)
+{
+    return (sizeof(BlockHeader) + alignment - 1) / alignment * alignment;
+}
+
+void* HeapAllocate(size_t size, size_t alignment)
+{
+    void* ptr = nullptr;
+#ifdef _WIN32
+    ptr = _aligned_malloc(size, alignment);
+#else
+    if (posix_memalign(&ptr, std::max(alignment, sizeof(void*)), size) != 0)
+        ptr = nullptr;
+#endif
+    return ptr;
+}
+
+void HeapDeallocate(void* ptr)
+{
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+void RaisePeak(Counter& peak_counter, unsigned long long in_use)
+{
+    auto peak = peak_counter.load(std::memory_order_relaxed);
+    while (in_use > peak && !peak_counter.compare_exchange_weak(peak, in_use, std::memory_order_relaxed))
+    {
+    }
+}
+
+void OnAllocate(size_t size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    s_bytes_allocated.fetch_add(size, std::memory_order_relaxed);
+    RaisePeak(s_peak_bytes_in_use, s_bytes_in_use.fetch_add(size, std::memory_order_relaxed) + size);
+}
+} // namespace
+
+void Track(Category category, long long bytes) noexcept
+{
+    const auto index = static_cast<size_t>(category);
+    if (bytes == 0 || index >= CategoryCount)
+    {
+        return;
+    }
+    // unsigned wrap around subtracts
+    const auto delta = static_cast<unsigned long long>(bytes);
+    const auto in_use = s_category_in_use[index].fetch_add(delta, std::memory_order_relaxed) + delta;
+    const auto total = s_total_in_use.fetch_add(delta, std::memory_order_relaxed) + delta;
+    if (bytes > 0)
+    {
+        RaisePeak(s_category_peak[index], in_use);
+        RaisePeak(s_total_peak, total);
+    }
+}
+
+void* Allocate(size_t size, size_t alignment, Category category)
+{
+    alignment = std::max(alignment, alignof(BlockHeader));
+    const size_t prefix = PrefixSize(alignment);
+    Allocator* allocator = s_allocator.load(std::memory_order_acquire);
+    void* raw =
+        allocator != nullptr ? allocator->Allocate(prefix + size, alignment) : HeapAllocate(prefix + size, alignment);
+    if (raw == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    auto* block = static_cast<unsigned char*>(raw) + prefix;
+    auto& header = reinterpret_cast<BlockHeader*>(block)[-1];
+    header.allocator = allocator;
+    header.category = category;
+    OnAllocate(size);
+    Track(category, static_cast<long long>(size));
+    return block;
+}
+
+void Deallocate(void* ptr, size_t size, size_t alignment) noexcept
+{
+    if (ptr == nullptr)
+    {
+        return;
+    }
+    alignment = std::max(alignment, alignof(BlockHeader));
+    const size_t prefix = PrefixSize(alignment);
+    Allocator* allocator = static_cast<BlockHeader*>(ptr)[-1].allocator;
+    Track(static_cast<BlockHeader*>(ptr)[-1].category, -static_cast<long long>(size));
+    void* raw = static_cast<unsigned char*>(ptr) - prefix;
+    if (allocator != nullptr)
+    {
+        allocator->Deallocate(raw, prefix + size, alignment);
+    }
+    else
+    {
+        HeapDeallocate(raw);
+    }
+    s_deallocations.fetch_add(1, std::memory_order_relaxed);
+    s_bytes_in_use.fetch_sub(size, std::memory_order_relaxed);
+}
+
+void SetAllocator(Allocator* allocator)
+{
+    s_allocator.store(allocator, std::memory_order_release);
+}
+
+void GetStats(AllocationStats& stats)
+{
+    stats.allocations = s_allocations.load(std::memory_order_relaxed);
+    stats.deallocations = s_deallocations.load(std::memory_order_relaxed);
+    stats.bytes_allocated = s_bytes_allocated.load(std::memory_order_relaxed);
+    stats.bytes_in_use = s_bytes_in_use.load(std::memory_order_relaxed);
+    stats.peak_bytes_in_use = s_peak_bytes_in_use.load(std::memory_order_relaxed);
+}
+
+void GetStats(MemoryStats& stats)
+{
+    for (size_t i = 0; i < CategoryCount; i++)
+    {
+        stats.categories[i].bytes_in_use = s_category_in_use[i].load(std::memory_order_relaxed);
+        stats.categories[i].peak_bytes_in_use = s_category_peak[i].load(std::memory_order_relaxed);
+    }
+    stats.total.bytes_in_use = s_total_in_use.load(std::memory_order_relaxed);
+    stats.total.peak_bytes_in_use = s_total_peak.load(std::memory_order_relaxed);
+}
+
+void ResetStats()
+{
+    s_allocations.store(0, std::memory_order_relaxed);
+    s_deallocations.store(0, std::memory_order_relaxed);
+    s_bytes_allocated.store(0, std::memory_order_relaxed);
+    s_peak_bytes_in_use.store(s_bytes_in_use.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    for (size_t i = 0; i < CategoryCount; i++)
+    {
+        s_category_peak[i].store(s_category_in_use[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    s_total_peak.store(s_total_in_use.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+} // namespace Memory
+} // namespace RealSenseID
@@ -0,0 +1,116 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/Allocator.h"
+#include <cstddef>
+#include <new>
+
+namespace RealSenseID
+{
+// Library wide allocation of buffers behind the public SetAllocator() api.
+// Each block records the allocator it came from, so replacing the allocator does not affect the blocks in use.
+// The bytes held by each subsystem (GetMemoryStats()) are counted by the category of its blocks, and by Track() for
+// memory that does not come from Allocate() (member arrays, containers of the default allocator, spdlog's queue).
+namespace Memory
+{
+// same values as RealSenseID::MemoryCategory
+enum class Category : unsigned char
+{
+    PreviewFrames,
+    PreviewConversion,
+    Packets,
+    SerialBuffers,
+    Logging,
+    Gallery,
+    Operations,
+    Other,
+    Count
+};
+
+// size bytes aligned to alignment (a power of 2), charged to the category. throws std::bad_alloc on failure.
+void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t), Category category = Category::Other);
+// free a block of Allocate() with the same size and alignment
+void Deallocate(void* ptr, size_t size, size_t alignment = alignof(std::max_align_t)) noexcept;
+
+// bytes of the category held outside Allocate(): positive when taken, negative when released
+void Track(Category category, long long bytes) noexcept;
+
+void SetAllocator(Allocator* allocator);
+void GetStats(AllocationStats& stats);
+void GetStats(MemoryStats& stats);
+void ResetStats();
+
+// bytes tracked for the lifetime of the object, e.g. a member holding a buffer. Set() when the size changes
+class TrackedBytes
+{
+public:
+    explicit TrackedBytes(Category category, size_t bytes = 0) noexcept : _category(category)
+    {
+        Set(bytes);
+    }
+
+    ~TrackedBytes()
+    {
+        Set(0);
+    }
+
+    TrackedBytes(const TrackedBytes&) = delete;
+    TrackedBytes& operator=(const TrackedBytes&) = delete;
+
+    void Set(size_t bytes) noexcept
+    {
+        Track(_category, static_cast<long long>(bytes) - static_cast<long long>(_bytes));
+        _bytes = bytes;
+    }
+
+private:
+    Category _category;
+    size_t _bytes = 0;
+};
+
+// std allocator over Allocate() / Deallocate(), for the library's containers
+template <typename T, size_t Alignment = alignof(T), Category C = Category::Other>
+class StdAllocator
+{
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind
+    {
+        using other = StdAllocator<U, Alignment, C>;
+    };
+
+    StdAllocator() = default;
+
+    template <typename U>
+    StdAllocator(const StdAllocator<U, Alignment, C>&) noexcept
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+        return n > 0 ? static_cast<T*>(Allocate(n * sizeof(T), Alignment, C)) : nullptr;
+    }
+
+    void deallocate(T* ptr, size_t n) noexcept
+    {
+        Deallocate(ptr, n * sizeof(T), Alignment);
+    }
+
+    template <typename U>
+    bool operator==(const StdAllocator<U, Alignment, C>&) const noexcept
+    {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const StdAllocator<U, Alignment, C>&) const noexcept
+    {
+        return false;
+    }
+};
+} // namespace Memory
+} // namespace RealSenseID
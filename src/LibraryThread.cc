@@ -0,0 +1,171 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "LibraryThread.h"
+#include "Logger.h"
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+
+namespace RealSenseID
+{
+static const char* LOG_TAG = "LibraryThread";
+
+static std::atomic<Executor*> s_executor {nullptr};
+
+// a loop run by the executor. shared by the task and the LibraryThread, so either may go first: the loop is run by
+// whichever of the task and join() takes it first
+struct LibraryThread::State
+{
+    enum class Stage
+    {
+        Queued,
+        Running,
+        Done
+    };
+
+    std::mutex mutex;
+    std::condition_variable done_cv;
+    Stage stage = Stage::Queued;
+    std::thread::id id;
+    std::function<void()> loop;
+
+    // run the loop on this thread if it has not started. false if it has
+    bool Run()
+    {
+        std::function<void()> taken;
+        {
+            std::lock_guard<std::mutex> lock {mutex};
+            if (stage != Stage::Queued)
+            {
+                return false;
+            }
+            stage = Stage::Running;
+            id = std::this_thread::get_id();
+            taken = std::move(loop);
+        }
+        try
+        {
+            taken();
+        }
+        catch (const std::exception& ex)
+        {
+            LOG_ERROR(LOG_TAG, "Loop failed: %s", ex.what());
+        }
+        catch (...)
+        {
+            LOG_ERROR(LOG_TAG, "Loop failed");
+        }
+        {
+            std::lock_guard<std::mutex> lock {mutex};
+            stage = Stage::Done;
+            id = std::thread::id {};
+        }
+        done_cv.notify_all();
+        return true;
+    }
+};
+
+void LibraryThread::SetExecutor(Executor* executor)
+{
+    s_executor.store(executor, std::memory_order_release);
+}
+
+Executor* LibraryThread::GetExecutor()
+{
+    return s_executor.load(std::memory_order_acquire);
+}
+
+void LibraryThread::Start(std::function<void()> loop)
+{
+    Executor* executor = GetExecutor();
+    if (executor == nullptr)
+    {
+        _thread = std::thread(std::move(loop));
+        return;
+    }
+
+    auto state = std::make_shared<State>();
+    state->loop = std::move(loop);
+    executor->Execute([state]() { state->Run(); });
+    _state = std::move(state);
+}
+
+LibraryThread::~LibraryThread()
+{
+    if (joinable())
+    {
+        join();
+    }
+}
+
+LibraryThread::LibraryThread(LibraryThread&& other) noexcept :
+    _thread {std::move(other._thread)}, _state {std::move(other._state)}
+{
+}
+
+LibraryThread& LibraryThread::operator=(LibraryThread&& other)
+{
+    if (this != &other)
+    {
+        if (joinable())
+        {
+            join();
+        }
+        _thread = std::move(other._thread);
+        _state = std::move(other._state);
+    }
+    return *this;
+}
+
+bool LibraryThread::joinable() const
+{
+    return _thread.joinable() || _state != nullptr;
+}
+
+void LibraryThread::join()
+{
+    if (_thread.joinable())
+    {
+        _thread.join();
+        return;
+    }
+    if (_state == nullptr)
+    {
+        throw std::invalid_argument("LibraryThread: not joinable");
+    }
+    // not started yet (e.g. the executor's workers are busy): run it here rather than wait for a worker
+    if (!_state->Run())
+    {
+        std::unique_lock<std::mutex> lock {_state->mutex};
+        _state->done_cv.wait(lock, [this] { return _state->stage == State::Stage::Done; });
+    }
+    _state.reset();
+}
+
+void LibraryThread::detach()
+{
+    if (_thread.joinable())
+    {
+        _thread.detach();
+        return;
+    }
+    if (_state == nullptr)
+    {
+        throw std::invalid_argument("LibraryThread: not joinable");
+    }
+    _state.reset(); // the executor's task keeps the loop
+}
+
+std::thread::id LibraryThread::get_id() const
+{
+    if (_state == nullptr)
+    {
+        return _thread.get_id();
+    }
+    std::lock_guard<std::mutex> lock {_state->mutex};
+    return _state->id;
+}
+} // namespace RealSenseID
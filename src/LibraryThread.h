@@ -0,0 +1,60 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/Executor.h"
+#include <functional>
+#include <memory>
+#include <thread>
+
+namespace RealSenseID
+{
+// A loop of the library behind the public SetExecutor() api: runs on a thread of its own, or as a task of the
+// executor set when it was started. Used in place of std::thread for the library's long running loops, with the same
+// start, joinable() and join(). Unlike std::thread it is joined when destroyed or reassigned while joinable.
+class LibraryThread
+{
+public:
+    // the executor of the loops started afterwards (nullptr - a thread each)
+    static void SetExecutor(Executor* executor);
+    static Executor* GetExecutor();
+
+    LibraryThread() = default;
+
+    // start function(args...), as std::thread
+    template <typename Function, typename... Args>
+    explicit LibraryThread(Function&& function, Args&&... args)
+    {
+        Start(std::bind(std::forward<Function>(function), std::forward<Args>(args)...));
+    }
+
+    ~LibraryThread();
+
+    LibraryThread(LibraryThread&& other) noexcept;
+    LibraryThread& operator=(LibraryThread&& other);
+
+    LibraryThread(const LibraryThread&) = delete;
+    LibraryThread& operator=(const LibraryThread&) = delete;
+
+    // started and not joined yet
+    bool joinable() const;
+
+    // wait for the loop to return. a loop queued in the executor that has not started yet is run on the calling
+    // thread, so it always runs once.
+    void join();
+
+    // let the loop run on its own, as std::thread. not joinable afterwards
+    void detach();
+
+    // the thread running the loop, default id if not running (yet)
+    std::thread::id get_id() const;
+
+private:
+    struct State;
+    void Start(std::function<void()> loop);
+
+    std::thread _thread;
+    std::shared_ptr<State> _state; // with an executor
+};
+} // namespace RealSenseID
@@ -6,8 +6,14 @@
 #include "spdlog/sinks/base_sink.h"
 #include "spdlog/fmt/bin_to_hex.h"
 #include "spdlog/sinks/basic_file_sink.h"
+#include "spdlog/async_logger.h"
+#include "spdlog/details/thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <iterator>
 #include <memory>
 #include <cstdarg> // for va_start
+#include <cstring>
 #include <cassert>
 
 
@@ -18,6 +24,7 @@
 #endif // ANDROID
 
 #define LOG_BUFFER_SIZE 512
+#define ASYNC_QUEUE_SIZE 8192 // messages
 
 
 namespace RealSenseID
@@ -25,11 +32,13 @@ namespace RealSenseID
 class UserCallbackSink : public spdlog::sinks::base_sink<std::mutex>
 {
     Logger::LogCallback _clbk;
+    bool _do_formatting;
 
 public:
     UserCallbackSink(Logger::LogCallback clbk, Logger::LogLevel min_level, bool do_formatting)
     {
         _clbk = clbk;
+        _do_formatting = do_formatting;
         auto spdlog_level = static_cast<spdlog::level::level_enum>(min_level);
         set_level(spdlog_level);
         const char* pattern = do_formatting ? "%+" : "%v";
@@ -39,7 +48,17 @@ public:
     void sink_it_(const spdlog::details::log_msg& msg) override
     {
         spdlog::memory_buf_t formatted;
-        base_sink<std::mutex>::formatter_->format(msg, formatted);
+        if (_do_formatting)
+        {
+            base_sink<std::mutex>::formatter_->format(msg, formatted);
+        }
+        else
+        {
+            // what the "%v" pattern gives, without running the formatter
+            formatted.append(msg.payload.data(), msg.payload.data() + msg.payload.size());
+            formatted.append(spdlog::details::os::default_eol,
+                             spdlog::details::os::default_eol + std::strlen(spdlog::details::os::default_eol));
+        }
         formatted.push_back('\0'); // convert to c_str
         auto clbk_level = static_cast<Logger::LogLevel>(msg.level);
         _clbk(clbk_level, (const char*)formatted.data());
@@ -58,18 +77,16 @@ public:
 
 Logger::Logger()
 {
-    _logger = new spdlog::logger("");
-    auto& sinks = _logger->sinks();
-    sinks.clear();
-    _logger->set_level(spdlog::level::off);
+    auto level = spdlog::level::off;
+    auto flush_level = spdlog::level::off;
 
 #ifdef RSID_DEBUG_CONSOLE
 #ifdef ANDROID
-    sinks.push_back(std::make_shared<spdlog::sinks::android_sink_mt>("RSID", true));
+    _base_sinks.push_back(std::make_shared<spdlog::sinks::android_sink_mt>("RSID", true));
 #else
-    sinks.push_back(std::make_shared<spdlog::sinks::stdout_color_sink_mt>());
+    _base_sinks.push_back(std::make_shared<spdlog::sinks::stdout_color_sink_mt>());
 #endif // ANDROID
-    _logger->set_level(spdlog::level::debug);
+    level = spdlog::level::debug;
 
 #endif // RSID_DEBUG_CONSOLE
 
@@ -78,58 +95,247 @@ Logger::Logger()
     try
     {
         auto truncate = true;
-        sinks.push_back(std::make_shared<spdlog::sinks::basic_file_sink_mt>(logfile, truncate));
-        _logger->set_level(spdlog::level::debug);
-        _logger->flush_on(spdlog::level::debug); // flush each log message immediatly to the file.
+        _base_sinks.push_back(std::make_shared<spdlog::sinks::basic_file_sink_mt>(logfile, truncate));
+        level = spdlog::level::debug;
+        flush_level = spdlog::level::debug; // flush each log message immediatly to the file.
     }
     catch (const std::exception& ex)
     {
         printf("Failed to create log file \"%s\": %s\n", logfile.c_str(), ex.what());
     }
 #endif // RSID_DEBUG_FILE
+
+    _initial_level = level;
+    _initial_flush_level = flush_level;
+    _level.store(level, std::memory_order_relaxed);
 }
 
 Logger::~Logger()
 {
-    delete _logger;
+    _loggers.clear();
+    _thread_pool.reset(); // logs the queued messages and stops the log thread
+    _queue_memory.Set(0);
 }
 
-// set log callback sink. replace exiting one if already exists
-void Logger::SetCallback(LogCallback clbk, LogLevel level, bool do_formatting)
+void Logger::Install(Delivery delivery, int level, int flush_level)
 {
-    auto& sinks = _logger->sinks();
-    if (is_callback_set)
+    std::vector<spdlog::sink_ptr> sinks = _base_sinks;
+    if (_callback_sink)
+    {
+        sinks.push_back(_callback_sink);
+    }
+
+    std::shared_ptr<spdlog::logger> logger;
+    if (delivery == Delivery::Sync)
+    {
+        logger = std::make_shared<spdlog::logger>("", sinks.begin(), sinks.end());
+    }
+    else
     {
-        // the last sink is the callback sink - replace with new one
-        assert(!sinks.empty());
-        if (!sinks.empty())
+        if (!_thread_pool)
         {
-            sinks.pop_back();
+            _thread_pool = std::make_shared<spdlog::details::thread_pool>(ASYNC_QUEUE_SIZE, 1);
+            _queue_memory.Set(ASYNC_QUEUE_SIZE * sizeof(spdlog::details::async_msg));
         }
-        is_callback_set = false;
+        auto policy = delivery == Delivery::AsyncBlock ? spdlog::async_overflow_policy::block
+                                                       : spdlog::async_overflow_policy::overrun_oldest;
+        logger = std::make_shared<spdlog::async_logger>("", sinks.begin(), sinks.end(), _thread_pool, policy);
+    }
+    logger->set_level(static_cast<spdlog::level::level_enum>(level));
+    logger->flush_on(static_cast<spdlog::level::level_enum>(flush_level));
+    _loggers.push_back(logger);
+    _logger.store(logger.get());
+    UpdateLevel();
+
+    if (delivery == Delivery::Sync && _thread_pool)
+    {
+        _thread_pool.reset(); // the replaced async loggers' queued messages are logged before it stops
+        _queue_memory.Set(0);
+    }
+}
+
+spdlog::logger* Logger::Current()
+{
+    auto* logger = _logger.load();
+    if (logger != nullptr)
+    {
+        return logger;
+    }
+    std::lock_guard<std::mutex> lock {_config_mutex};
+    if (_logger.load() == nullptr)
+    {
+        Install(Delivery::Sync, _initial_level, _initial_flush_level);
+    }
+    return _logger.load();
+}
+
+// set log callback sink. replace exiting one if already exists
+void Logger::SetCallback(LogCallback clbk, LogLevel level, bool do_formatting, Delivery delivery)
+{
+    std::lock_guard<std::mutex> lock {_config_mutex};
+    _callback_sink = std::make_shared<UserCallbackSink>(clbk, level, do_formatting);
+
+    auto* current = _logger.load();
+    int current_level = current != nullptr ? static_cast<int>(current->level()) : _initial_level;
+    int flush_level = current != nullptr ? static_cast<int>(current->flush_level()) : _initial_flush_level;
+    Install(delivery, std::min(current_level, static_cast<int>(level)), flush_level);
+}
+
+void Logger::SetStructuredCallback(StructuredCallback callback, LogLevel level)
+{
+    std::lock_guard<std::mutex> lock {_config_mutex};
+    std::unique_ptr<StructuredOutput> output;
+    if (callback)
+    {
+        output.reset(new StructuredOutput {std::move(callback), static_cast<int>(level)});
+    }
+    _structured.store(output.get());
+    if (_structured_output)
+    {
+        _retired_outputs.push_back(std::move(_structured_output));
+    }
+    _structured_output = std::move(output);
+    UpdateLevel();
+    Reclaim();
+}
+
+void Logger::SetSampling(const char* tag, unsigned int one_in, unsigned int max_per_second)
+{
+    std::lock_guard<std::mutex> lock {_config_mutex};
+    // the other tags' rules (and their counters) are kept
+    auto table = std::make_unique<SamplingTable>();
+    if (_sampling_table)
+    {
+        std::copy_if(_sampling_table->begin(), _sampling_table->end(), std::back_inserter(*table),
+                     [tag](const std::shared_ptr<SamplingRule>& rule) { return rule->tag != tag; });
+    }
+    if (one_in > 1 || max_per_second > 0)
+    {
+        auto rule = std::make_shared<SamplingRule>();
+        rule->tag = tag;
+        rule->one_in = std::max(1u, one_in);
+        rule->max_per_second = max_per_second;
+        table->push_back(std::move(rule));
+    }
+    if (table->empty())
+    {
+        table.reset();
+    }
+    _sampling.store(table.get());
+    if (_sampling_table)
+    {
+        _retired_tables.push_back(std::move(_sampling_table));
+    }
+    _sampling_table = std::move(table);
+    Reclaim();
+}
+
+void Logger::ClearSampling()
+{
+    std::lock_guard<std::mutex> lock {_config_mutex};
+    _sampling.store(nullptr);
+    if (_sampling_table)
+    {
+        _retired_tables.push_back(std::move(_sampling_table));
     }
+    Reclaim();
+}
+
+void Logger::Reclaim()
+{
+    // a Log() call counts itself before it loads the pointers, so with no call counted after the replacements were
+    // stored, none can still use a retired one
+    if (_readers.load() == 0)
+    {
+        _retired_outputs.clear();
+        _retired_tables.clear();
+    }
+}
 
-    sinks.push_back(std::make_shared<UserCallbackSink>(clbk, level, do_formatting));
-    is_callback_set = true;
-    auto required_spdlog_level = static_cast<spdlog::level::level_enum>(level);
-    if (!_logger->should_log(required_spdlog_level))
+void Logger::UpdateLevel()
+{
+    auto* logger = _logger.load();
+    int level = logger != nullptr ? static_cast<int>(logger->level()) : _initial_level;
+    auto* structured = _structured.load();
+    if (structured != nullptr)
     {
-        _logger->set_level(required_spdlog_level);
+        level = std::min(level, structured->level);
     }
+    _level.store(level, std::memory_order_relaxed);
 }
 
+bool Logger::Sampled(const char* tag, int level)
+{
+    auto* table = _sampling.load();
+    if (table == nullptr || level >= static_cast<int>(LogLevel::Warning))
+    {
+        return true;
+    }
+    for (const auto& rule : *table)
+    {
+        if (std::strcmp(rule->tag.c_str(), tag) != 0)
+        {
+            continue;
+        }
+        if (rule->count.fetch_add(1, std::memory_order_relaxed) % rule->one_in != 0)
+        {
+            return false;
+        }
+        if (rule->max_per_second == 0)
+        {
+            return true;
+        }
+        // approximate under contention: a thread may count into the window another one just reset
+        using namespace std::chrono;
+        int64_t now = duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+        int64_t start = rule->window_start.load(std::memory_order_relaxed);
+        if (now - start >= 1000 && rule->window_start.compare_exchange_strong(start, now, std::memory_order_relaxed))
+        {
+            rule->window_count.store(0, std::memory_order_relaxed);
+        }
+        return rule->window_count.fetch_add(1, std::memory_order_relaxed) < rule->max_per_second;
+    }
+    return true;
+}
+
+// if log level is right and the tag's sampling takes it, vsprintf the args to buffer and log it
+void Logger::Log(int level, const char* tag, const char* format, va_list args)
+{
+    auto* logger = Current();
+    // counted while it may use the structured output and the sampling table (see Reclaim())
+    struct ReaderScope
+    {
+        std::atomic<int>& readers;
+        explicit ReaderScope(std::atomic<int>& counter) : readers(counter)
+        {
+            readers.fetch_add(1);
+        }
+        ~ReaderScope()
+        {
+            readers.fetch_sub(1);
+        }
+    } reader_scope {_readers};
+    auto* structured = _structured.load();
+    auto spdlog_level = static_cast<spdlog::level::level_enum>(level);
+    bool to_logger = logger->should_log(spdlog_level);
+    bool to_structured = structured != nullptr && level >= structured->level;
+    if ((!to_logger && !to_structured) || !Sampled(tag, level))
+        return;
+    char buffer[LOG_BUFFER_SIZE];
+    int size = vsnprintf(buffer, sizeof(buffer), format, args);
+    if (size < 0)
+        size = snprintf(buffer, sizeof(buffer), "(bad printf format \"%s\")", format);
+    size = std::min(std::max(size, 0), LOG_BUFFER_SIZE - 1); // truncated to the buffer
+    if (to_logger)
+        logger->log(spdlog_level, "[{}] {}", tag, buffer);
+    if (to_structured)
+        structured->callback(static_cast<LogLevel>(level), tag, buffer, static_cast<size_t>(size));
+}
 
-// if log level is right, vsprintf the args to buffer and log it
 #define LOG_IT_(LEVEL)                                                                                                 \
     va_list args;                                                                                                      \
-    if (!_logger->should_log(LEVEL))                                                                                   \
-        return;                                                                                                        \
     va_start(args, format);                                                                                            \
-    char buffer[LOG_BUFFER_SIZE];                                                                                      \
-    auto Ok = vsnprintf(buffer, sizeof(buffer), format, args) >= 0;                                                    \
-    if (!Ok)                                                                                                           \
-        snprintf(buffer, sizeof(buffer), "(bad printf format \"%s\")", format);                                        \
-    _logger->log(LEVEL, "[{}] {}", tag, buffer);                                                                       \
+    Log(LEVEL, tag, format, args);                                                                                     \
     va_end(args)
 
 
@@ -165,6 +371,6 @@ void Logger::Critical(const char* tag, const char* format, ...)
 
 void Logger::DebugBytes(const char* tag, const char* msg, const char* buf, size_t size)
 {
-    _logger->debug("[{}] {} {} bytes {:pa}\n", tag, msg, size, spdlog::to_hex(buf, &buf[size]));
+    Current()->debug("[{}] {} {} bytes {:pa}\n", tag, msg, size, spdlog::to_hex(buf, &buf[size]));
 }
 } // namespace RealSenseID
@@ -5,12 +5,23 @@
 
 #include <functional>
 #include <memory>
+#include <atomic>
+#include <cstdarg>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
 #include "spdlog/fwd.h"
+#include "LibraryMemory.h"
 
 
 namespace spdlog
 {
 class logger;
+namespace details
+{
+class thread_pool;
+} // namespace details
 } // namespace spdlog
 
 namespace RealSenseID
@@ -20,6 +31,10 @@ namespace RealSenseID
 // * User provided callback function.
 // * Standard output if RSID_DEBUG_CONSOLE is defined.
 // * "rsid_debug.log" file if RSID_DEBUG_FILE is defined.
+// The outputs are called by the logging thread, or with async delivery by a dedicated thread that takes
+// the formatted messages from a bounded queue.
+// A structured callback gets the level, tag and message of each log call directly from the logging thread, with no
+// spdlog formatting, queueing or copy. Per tag sampling drops messages before they are formatted.
 class Logger
 {
 public:
@@ -34,7 +49,17 @@ public:
         Off
     };
 
+    // how the messages reach the outputs, same values as RealSenseID::LogDelivery
+    enum class Delivery
+    {
+        Sync,            // by the logging thread
+        AsyncBlock,      // queued for the log thread. logging blocks while the queue is full
+        AsyncDropOldest, // queued for the log thread. the oldest queued message is dropped while the queue is full
+    };
+
     using LogCallback = std::function<void(LogLevel level, const char* msg)>;
+    // msg is the message without the tag, null terminated, size bytes long
+    using StructuredCallback = std::function<void(LogLevel level, const char* tag, const char* msg, size_t size)>;
 
     Logger(Logger const&) = delete;
     void operator=(Logger const&) = delete;
@@ -45,8 +70,17 @@ public:
         return instance;
     }
 
-    // Set callback for given level. replace current callback if already exists
-    void SetCallback(LogCallback callback, LogLevel level, bool do_formatting);
+    // Set callback for given level. replace current callback if already exists.
+    // switching to Sync delivery waits for the queued messages and stops the log thread.
+    void SetCallback(LogCallback callback, LogLevel level, bool do_formatting, Delivery delivery = Delivery::Sync);
+
+    // Set the structured callback for given level, replacing the current one. an empty callback removes it.
+    void SetStructuredCallback(StructuredCallback callback, LogLevel level);
+
+    // Sample the messages of the tag below Warning level: log one in every one_in of them, and at most
+    // max_per_second per second (0 for no limit). one_in 1 and max_per_second 0 remove the tag's sampling.
+    void SetSampling(const char* tag, unsigned int one_in, unsigned int max_per_second);
+    void ClearSampling();
 
     void Trace(const char* tag, const char* format, ...);
     void Debug(const char* tag, const char* format, ...);
@@ -54,26 +88,126 @@ public:
     void Warning(const char* tag, const char* format, ...);
     void Error(const char* tag, const char* format, ...);
     void Critical(const char* tag, const char* format, ...);
-    // Debug bytes in hex format
+    // Debug bytes in hex format (to the formatted outputs only)
     void DebugBytes(const char* tag, const char* msg, const char* buffer, size_t size);
 
+    // true if messages of the given level are logged, checked before the LOG_ macros evaluate their arguments
+    bool ShouldLog(LogLevel level) const
+    {
+        return static_cast<int>(level) >= _level.load(std::memory_order_relaxed);
+    }
+
 private:
-    spdlog::logger* _logger = nullptr;
+    struct StructuredOutput
+    {
+        StructuredCallback callback;
+        int level;
+    };
+
+    struct SamplingRule
+    {
+        std::string tag;
+        unsigned int one_in = 1;
+        unsigned int max_per_second = 0;
+        std::atomic<uint32_t> count {0};        // messages seen
+        std::atomic<int64_t> window_start {0};  // steady clock ms of the current second
+        std::atomic<uint32_t> window_count {0}; // messages logged in it
+    };
+
+    // the logger in use. a new one is created for each configuration change, threads that are still logging
+    // with a replaced one can keep using it (it is kept until destruction)
+    std::atomic<spdlog::logger*> _logger {nullptr};
+    std::atomic<int> _level {static_cast<int>(LogLevel::Off)}; // level of the logger in use
+    int _initial_level = static_cast<int>(LogLevel::Off);         // of the logger created on first use
+    int _initial_flush_level = static_cast<int>(LogLevel::Off);
+    std::vector<std::shared_ptr<spdlog::logger>> _loggers;
+    std::vector<std::shared_ptr<spdlog::sinks::sink>> _base_sinks; // console and file
+    std::shared_ptr<spdlog::sinks::sink> _callback_sink;
+    std::shared_ptr<spdlog::details::thread_pool> _thread_pool; // async delivery
+    Memory::TrackedBytes _queue_memory {Memory::Category::Logging}; // of _thread_pool
+    using SamplingTable = std::vector<std::shared_ptr<SamplingRule>>;
+
+    // the structured output and sampling rules in use, replaced as a whole. a replaced one is retired, and freed by a
+    // later configuration change once no Log() call is running (see Reclaim())
+    std::atomic<StructuredOutput*> _structured {nullptr};
+    std::atomic<SamplingTable*> _sampling {nullptr};
+    std::atomic<int> _readers {0}; // Log() calls that may use _structured and _sampling
+    std::unique_ptr<StructuredOutput> _structured_output;
+    std::unique_ptr<SamplingTable> _sampling_table;
+    std::vector<std::unique_ptr<StructuredOutput>> _retired_outputs;
+    std::vector<std::unique_ptr<SamplingTable>> _retired_tables;
+    std::mutex _config_mutex;
 
     Logger();
     ~Logger();
 
-    bool is_callback_set = false;
+    // create a logger with the current sinks and replace the one in use
+    void Install(Delivery delivery, int level, int flush_level);
+
+    // the runtime level: the lowest of the logger's and the structured output's
+    void UpdateLevel();
+
+    // free the retired structured outputs and sampling tables if no Log() call is running. a Log() call that starts
+    // afterwards loads the replacements. called with the config mutex held.
+    void Reclaim();
+
+    // false if the tag's sampling drops this message
+    bool Sampled(const char* tag, int level);
+
+    void Log(int level, const char* tag, const char* format, va_list args);
+
+    // the logger in use, created on first use: a process that never logs (or only below the level) does not build
+    // the spdlog logger
+    spdlog::logger* Current();
 };
 } // namespace RealSenseID
 
-#define LOG_TRACE(...)         Logger::Instance().Trace(__VA_ARGS__)
-#define LOG_DEBUG(...)         Logger::Instance().Debug(__VA_ARGS__)
-#define LOG_INFO(...)          Logger::Instance().Info(__VA_ARGS__)
-#define LOG_WARNING(...)       Logger::Instance().Warning(__VA_ARGS__)
-#define LOG_ERROR(...)         Logger::Instance().Error(__VA_ARGS__)
-#define LOG_CRITICAL(...)      Logger::Instance().Critical(__VA_ARGS__)
-#define LOG_EXCEPTION(tag, ex) Logger::Instance().Error(tag, "%s", ex.what())
+// Levels below RSID_LOG_MIN_LEVEL (0 = Trace .. 6 = Off, set by the RSID_LOG_MIN_LEVEL cmake option) are compiled
+// out: their arguments are still type checked but never evaluated.
+// Enabled levels check the runtime level before evaluating the arguments.
+#ifndef RSID_LOG_MIN_LEVEL
+#define RSID_LOG_MIN_LEVEL 0
+#endif
+
+#define RSID_LOG_ENABLED_(LEVEL, ...)                                                                                  \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (Logger::Instance().ShouldLog(Logger::LogLevel::LEVEL))                                                     \
+            Logger::Instance().LEVEL(__VA_ARGS__);                                                                     \
+    } while (0)
+#define RSID_LOG_DISABLED_(LEVEL, ...) (void)sizeof((Logger::Instance().LEVEL(__VA_ARGS__), 0))
+
+#if RSID_LOG_MIN_LEVEL <= 0
+#define LOG_TRACE(...) RSID_LOG_ENABLED_(Trace, __VA_ARGS__)
+#else
+#define LOG_TRACE(...) RSID_LOG_DISABLED_(Trace, __VA_ARGS__)
+#endif
+#if RSID_LOG_MIN_LEVEL <= 1
+#define LOG_DEBUG(...) RSID_LOG_ENABLED_(Debug, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) RSID_LOG_DISABLED_(Debug, __VA_ARGS__)
+#endif
+#if RSID_LOG_MIN_LEVEL <= 2
+#define LOG_INFO(...) RSID_LOG_ENABLED_(Info, __VA_ARGS__)
+#else
+#define LOG_INFO(...) RSID_LOG_DISABLED_(Info, __VA_ARGS__)
+#endif
+#if RSID_LOG_MIN_LEVEL <= 3
+#define LOG_WARNING(...) RSID_LOG_ENABLED_(Warning, __VA_ARGS__)
+#else
+#define LOG_WARNING(...) RSID_LOG_DISABLED_(Warning, __VA_ARGS__)
+#endif
+#if RSID_LOG_MIN_LEVEL <= 4
+#define LOG_ERROR(...) RSID_LOG_ENABLED_(Error, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) RSID_LOG_DISABLED_(Error, __VA_ARGS__)
+#endif
+#if RSID_LOG_MIN_LEVEL <= 5
+#define LOG_CRITICAL(...) RSID_LOG_ENABLED_(Critical, __VA_ARGS__)
+#else
+#define LOG_CRITICAL(...) RSID_LOG_DISABLED_(Critical, __VA_ARGS__)
+#endif
+#define LOG_EXCEPTION(tag, ex) LOG_ERROR(tag, "%s", ex.what())
 
 
 #ifdef RSID_DEBUG_SERIAL
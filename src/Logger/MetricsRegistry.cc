@@ -0,0 +1,210 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "MetricsRegistry.h"
+#include <cstddef>
+
+namespace RealSenseID
+{
+namespace MetricsRegistry
+{
+namespace
+{
+using Counter = std::atomic<unsigned long long>;
+
+constexpr size_t MsgIdCount = sizeof(Metrics::packets_sent) / sizeof(Metrics::packets_sent[0]);
+constexpr size_t OperationCount = static_cast<size_t>(MetricsOperation::Count);
+
+struct Histogram
+{
+    Counter buckets[MetricsLatencyBuckets];
+    Counter count;
+    Counter sum_us;
+};
+
+struct Registry
+{
+    Counter packets_sent[MsgIdCount];
+    Counter packets_received[MsgIdCount];
+    Counter crc_errors;
+    Counter timeouts;
+    Counter sync_retries;
+    Counter serial_transfer_time_us;
+    Counter serial_wait_time_us;
+    Counter session_starts;
+    Counter session_start_time_us;
+    Histogram latency[OperationCount];
+    Counter matcher_searches;
+    Counter matcher_candidates;
+    Counter matcher_time_us;
+    Counter preview_frames_dropped;
+};
+
+// zero initialized as a static
+Registry s_registry;
+
+// number of matcher searches in progress on this thread
+thread_local int s_search_depth = 0;
+
+void Increment(Counter& counter, unsigned long long value = 1)
+{
+    counter.fetch_add(value, std::memory_order_relaxed);
+}
+
+unsigned long long Load(const Counter& counter)
+{
+    return counter.load(std::memory_order_relaxed);
+}
+
+// ids outside the table (corrupt packets) are counted under 0
+size_t MsgIdIndex(char msg_id)
+{
+    auto index = static_cast<unsigned char>(msg_id);
+    return index < MsgIdCount ? index : 0;
+}
+} // namespace
+
+void OnPacketSent(char msg_id)
+{
+    Increment(s_registry.packets_sent[MsgIdIndex(msg_id)]);
+}
+
+void OnPacketReceived(char msg_id)
+{
+    Increment(s_registry.packets_received[MsgIdIndex(msg_id)]);
+}
+
+void OnCrcError()
+{
+    Increment(s_registry.crc_errors);
+}
+
+void OnTimeout()
+{
+    Increment(s_registry.timeouts);
+}
+
+void OnSyncRetry()
+{
+    Increment(s_registry.sync_retries);
+}
+
+void OnSerialTransfer(uint64_t elapsed_us)
+{
+    Increment(s_registry.serial_transfer_time_us, elapsed_us);
+}
+
+void OnSerialWait(uint64_t elapsed_us)
+{
+    Increment(s_registry.serial_wait_time_us, elapsed_us);
+}
+
+void OnSessionStart(uint64_t elapsed_us)
+{
+    Increment(s_registry.session_starts);
+    Increment(s_registry.session_start_time_us, elapsed_us);
+}
+
+void OnLatency(MetricsOperation operation, uint64_t elapsed_us)
+{
+    auto op_index = static_cast<size_t>(operation);
+    if (op_index >= OperationCount)
+    {
+        return;
+    }
+    size_t bucket = 0;
+    while (bucket < MetricsLatencyBuckets - 1 && elapsed_us > MetricsLatencyBoundsMs[bucket] * 1000ull)
+    {
+        bucket++;
+    }
+    auto& histogram = s_registry.latency[op_index];
+    Increment(histogram.buckets[bucket]);
+    Increment(histogram.count);
+    Increment(histogram.sum_us, elapsed_us);
+}
+
+void OnMatcherSearch(uint64_t candidates, uint64_t elapsed_us)
+{
+    Increment(s_registry.matcher_searches);
+    Increment(s_registry.matcher_candidates, candidates);
+    Increment(s_registry.matcher_time_us, elapsed_us);
+}
+
+ScopedMatcherSearch::ScopedMatcherSearch() :
+    _outermost {s_search_depth++ == 0}, _start {std::chrono::steady_clock::now()}
+{
+}
+
+ScopedMatcherSearch::~ScopedMatcherSearch()
+{
+    s_search_depth--;
+    if (_outermost)
+        OnMatcherSearch(_candidates, ElapsedMicros(_start));
+}
+
+void OnPreviewFramesDropped(unsigned int count)
+{
+    Increment(s_registry.preview_frames_dropped, count);
+}
+
+void Get(Metrics& metrics)
+{
+    for (size_t i = 0; i < MsgIdCount; i++)
+    {
+        metrics.packets_sent[i] = Load(s_registry.packets_sent[i]);
+        metrics.packets_received[i] = Load(s_registry.packets_received[i]);
+    }
+    metrics.crc_errors = Load(s_registry.crc_errors);
+    metrics.timeouts = Load(s_registry.timeouts);
+    metrics.sync_retries = Load(s_registry.sync_retries);
+    metrics.serial_transfer_time_us = Load(s_registry.serial_transfer_time_us);
+    metrics.serial_wait_time_us = Load(s_registry.serial_wait_time_us);
+    metrics.session_starts = Load(s_registry.session_starts);
+    metrics.session_start_time_us = Load(s_registry.session_start_time_us);
+    for (size_t op = 0; op < OperationCount; op++)
+    {
+        auto& source = s_registry.latency[op];
+        auto& target = metrics.latency[op];
+        for (size_t bucket = 0; bucket < MetricsLatencyBuckets; bucket++)
+        {
+            target.buckets[bucket] = Load(source.buckets[bucket]);
+        }
+        target.count = Load(source.count);
+        target.sum_us = Load(source.sum_us);
+    }
+    metrics.matcher_searches = Load(s_registry.matcher_searches);
+    metrics.matcher_candidates = Load(s_registry.matcher_candidates);
+    metrics.matcher_time_us = Load(s_registry.matcher_time_us);
+    metrics.preview_frames_dropped = Load(s_registry.preview_frames_dropped);
+}
+
+void Reset()
+{
+    for (size_t i = 0; i < MsgIdCount; i++)
+    {
+        s_registry.packets_sent[i].store(0, std::memory_order_relaxed);
+        s_registry.packets_received[i].store(0, std::memory_order_relaxed);
+    }
+    s_registry.crc_errors.store(0, std::memory_order_relaxed);
+    s_registry.timeouts.store(0, std::memory_order_relaxed);
+    s_registry.sync_retries.store(0, std::memory_order_relaxed);
+    s_registry.serial_transfer_time_us.store(0, std::memory_order_relaxed);
+    s_registry.serial_wait_time_us.store(0, std::memory_order_relaxed);
+    s_registry.session_starts.store(0, std::memory_order_relaxed);
+    s_registry.session_start_time_us.store(0, std::memory_order_relaxed);
+    for (auto& histogram : s_registry.latency)
+    {
+        for (auto& bucket : histogram.buckets)
+        {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        histogram.count.store(0, std::memory_order_relaxed);
+        histogram.sum_us.store(0, std::memory_order_relaxed);
+    }
+    s_registry.matcher_searches.store(0, std::memory_order_relaxed);
+    s_registry.matcher_candidates.store(0, std::memory_order_relaxed);
+    s_registry.matcher_time_us.store(0, std::memory_order_relaxed);
+    s_registry.preview_frames_dropped.store(0, std::memory_order_relaxed);
+}
+} // namespace MetricsRegistry
+} // namespace RealSenseID
@@ -0,0 +1,102 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/Metrics.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace RealSenseID
+{
+// Library wide counters and latency histograms behind the public GetMetrics() api.
+// Updates are relaxed atomic increments, cheap enough for the serial and matcher paths.
+namespace MetricsRegistry
+{
+void OnPacketSent(char msg_id);
+void OnPacketReceived(char msg_id);
+void OnCrcError();
+void OnTimeout();
+void OnSyncRetry();
+void OnSerialTransfer(uint64_t elapsed_us);
+void OnSerialWait(uint64_t elapsed_us);
+void OnSessionStart(uint64_t elapsed_us);
+void OnLatency(MetricsOperation operation, uint64_t elapsed_us);
+void OnMatcherSearch(uint64_t candidates, uint64_t elapsed_us);
+void OnPreviewFramesDropped(unsigned int count);
+
+void Get(Metrics& metrics);
+void Reset();
+
+inline uint64_t ElapsedMicros(std::chrono::steady_clock::time_point since)
+{
+    auto elapsed = std::chrono::steady_clock::now() - since;
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+}
+
+// records the latency of the enclosing scope
+class ScopedLatency
+{
+public:
+    explicit ScopedLatency(MetricsOperation operation) :
+        _operation {operation}, _start {std::chrono::steady_clock::now()}
+    {
+    }
+
+    ~ScopedLatency()
+    {
+        OnLatency(_operation, ElapsedMicros(_start));
+    }
+
+    ScopedLatency(const ScopedLatency&) = delete;
+    ScopedLatency& operator=(const ScopedLatency&) = delete;
+
+private:
+    MetricsOperation _operation;
+    std::chrono::steady_clock::time_point _start;
+};
+
+// records a session start of the enclosing scope
+class ScopedSessionStart
+{
+public:
+    ScopedSessionStart() : _start {std::chrono::steady_clock::now()}
+    {
+    }
+
+    ~ScopedSessionStart()
+    {
+        OnSessionStart(ElapsedMicros(_start));
+    }
+
+    ScopedSessionStart(const ScopedSessionStart&) = delete;
+    ScopedSessionStart& operator=(const ScopedSessionStart&) = delete;
+
+private:
+    std::chrono::steady_clock::time_point _start;
+};
+
+// records a matcher search of the enclosing scope. the number of candidates is set once known.
+// only the outermost scope on a thread records, so searches nested in another search are not counted twice
+class ScopedMatcherSearch
+{
+public:
+    ScopedMatcherSearch();
+    ~ScopedMatcherSearch();
+
+    void SetCandidates(uint64_t candidates)
+    {
+        _candidates = candidates;
+    }
+
+    ScopedMatcherSearch(const ScopedMatcherSearch&) = delete;
+    ScopedMatcherSearch& operator=(const ScopedMatcherSearch&) = delete;
+
+private:
+    uint64_t _candidates = 0;
+    bool _outermost;
+    std::chrono::steady_clock::time_point _start;
+};
+} // namespace MetricsRegistry
+} // namespace RealSenseID
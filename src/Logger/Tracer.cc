@@ -0,0 +1,168 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "Tracer.h"
+#include "Logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+namespace RealSenseID
+{
+namespace Tracer
+{
+static const char* LOG_TAG = "Tracer";
+static constexpr size_t MinSpans = 64;
+
+std::atomic<bool> g_enabled {false};
+
+namespace
+{
+struct Span
+{
+    const char* category;
+    const char* name;
+    uint64_t start_us;
+    uint64_t end_us;
+    uint32_t thread;
+    char msg_id;
+};
+
+struct Buffer
+{
+    std::mutex mutex;
+    std::vector<Span> spans; // ring of the newest spans
+    size_t next = 0;
+    size_t count = 0;
+    uint64_t start_us = 0; // the trace's time zero
+};
+
+Buffer& GetBuffer()
+{
+    static Buffer buffer;
+    return buffer;
+}
+
+std::atomic<uint32_t> s_next_thread {0};
+} // namespace
+
+// sequential id of the calling thread, shorter than the os ids in the viewers
+static uint32_t ThreadId()
+{
+    thread_local uint32_t thread_id = ++s_next_thread;
+    return thread_id;
+}
+
+uint64_t NowMicros()
+{
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+}
+
+void RecordSpan(const char* category, const char* name, char msg_id, uint64_t start_us, uint64_t end_us)
+{
+    const Span span {category, name, start_us, end_us, ThreadId(), msg_id};
+    auto& buffer = GetBuffer();
+    std::lock_guard<std::mutex> lock {buffer.mutex};
+    if (buffer.spans.empty())
+    {
+        return; // never started
+    }
+    buffer.spans[buffer.next] = span;
+    buffer.next = (buffer.next + 1) % buffer.spans.size();
+    buffer.count = std::min(buffer.count + 1, buffer.spans.size());
+}
+
+void Start(size_t max_spans)
+{
+    auto& buffer = GetBuffer();
+    {
+        std::lock_guard<std::mutex> lock {buffer.mutex};
+        buffer.spans.assign(std::max(max_spans, MinSpans), Span {});
+        buffer.next = 0;
+        buffer.count = 0;
+        buffer.start_us = NowMicros();
+    }
+    g_enabled = true;
+    LOG_INFO(LOG_TAG, "Started, up to %zu spans", std::max(max_spans, MinSpans));
+}
+
+void Stop()
+{
+    g_enabled = false;
+}
+
+// the names are literals from the code, only quotes and backslashes need escaping
+static void WriteJsonString(FILE* file, const char* str)
+{
+    ::fputc('"', file);
+    for (; *str != '\0'; ++str)
+    {
+        if (*str == '"' || *str == '\\')
+        {
+            ::fputc('\\', file);
+        }
+        ::fputc(*str, file);
+    }
+    ::fputc('"', file);
+}
+
+bool Dump(const char* path)
+{
+    if (path == nullptr)
+    {
+        return false;
+    }
+
+    std::vector<Span> spans;
+    uint64_t start_us = 0;
+    {
+        auto& buffer = GetBuffer();
+        std::lock_guard<std::mutex> lock {buffer.mutex};
+        const size_t size = buffer.spans.size();
+        for (size_t i = 0; i < buffer.count; ++i)
+        {
+            spans.push_back(buffer.spans[(buffer.next + size - buffer.count + i) % size]);
+        }
+        start_us = buffer.start_us;
+    }
+
+    FILE* file = ::fopen(path, "w");
+    if (file == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Failed to open %s", path);
+        return false;
+    }
+    ::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+    ::fputs("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"RealSenseID\"}}", file);
+    for (const auto& span : spans)
+    {
+        // spans started before Start() are clamped to the trace's begin
+        const uint64_t begin = std::max(span.start_us, start_us);
+        const uint64_t duration = span.end_us > begin ? span.end_us - begin : 0;
+        ::fputs(",\n{\"name\":", file);
+        WriteJsonString(file, span.name);
+        ::fputs(",\"cat\":", file);
+        WriteJsonString(file, span.category);
+        ::fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%llu,\"dur\":%llu", span.thread,
+                  static_cast<unsigned long long>(begin - start_us), static_cast<unsigned long long>(duration));
+        if (span.msg_id >= 0x20 && span.msg_id < 0x7f && span.msg_id != '"' && span.msg_id != '\\')
+        {
+            ::fprintf(file, ",\"args\":{\"msg_id\":\"%c\"}", span.msg_id);
+        }
+        ::fputc('}', file);
+    }
+    ::fputs("\n]}\n", file);
+    const bool write_failed = ::ferror(file) != 0;
+    if (::fclose(file) != 0 || write_failed)
+    {
+        LOG_ERROR(LOG_TAG, "Failed writing %s", path);
+        return false;
+    }
+    LOG_INFO(LOG_TAG, "Dumped %zu spans to %s", spans.size(), path);
+    return true;
+}
+} // namespace Tracer
+} // namespace RealSenseID
@@ -0,0 +1,100 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace RealSenseID
+{
+// Scoped trace spans, for finding where the time of an operation goes (session start, packets, device replies,
+// decoding, matching).
+// Spans are recorded into a bounded in memory buffer only between Start() and Stop(), and written by Dump() in the
+// Chrome trace event JSON format (opened by chrome://tracing and ui.perfetto.dev).
+// Use the RSID_TRACE_SPAN macros below. Without RSID_TRACE_SPANS defined they compile to nothing, otherwise a span
+// costs a single relaxed atomic load while tracing is stopped.
+namespace Tracer
+{
+// start recording up to max_spans spans (the newest are kept). clears previous spans
+void Start(size_t max_spans);
+void Stop();
+bool Dump(const char* path);
+
+extern std::atomic<bool> g_enabled;
+
+inline bool IsEnabled()
+{
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t NowMicros();
+
+// name and category must be string literals (or otherwise outlive the trace), they are stored by pointer.
+// msg_id is shown as the span's argument if not '\0'
+void RecordSpan(const char* category, const char* name, char msg_id, uint64_t start_us, uint64_t end_us);
+
+class ScopedSpan
+{
+public:
+    ScopedSpan(const char* category, const char* name, char msg_id = '\0')
+    {
+        if (IsEnabled())
+        {
+            _category = category;
+            _name = name;
+            _msg_id = msg_id;
+            _start_us = NowMicros();
+        }
+    }
+
+    ~ScopedSpan()
+    {
+        if (_name != nullptr)
+        {
+            RecordSpan(_category, _name, _msg_id, _start_us, NowMicros());
+        }
+    }
+
+    // the message id is often known only after the span started (e.g. received packets)
+    void SetMsgId(char msg_id)
+    {
+        _msg_id = msg_id;
+    }
+
+    ScopedSpan(const ScopedSpan&) = delete;
+    ScopedSpan& operator=(const ScopedSpan&) = delete;
+
+private:
+    const char* _category = nullptr;
+    const char* _name = nullptr;
+    char _msg_id = '\0';
+    uint64_t _start_us = 0;
+};
+
+// does nothing, for builds without RSID_TRACE_SPANS
+struct NullSpan
+{
+    NullSpan(const char*, const char*, char = '\0')
+    {
+    }
+    void SetMsgId(char)
+    {
+    }
+};
+} // namespace Tracer
+} // namespace RealSenseID
+
+// RSID_TRACE_SPAN(category, name) traces the rest of the enclosing scope.
+// RSID_TRACE_SPAN_VAR(var, category, name) names the span, e.g. to call var.SetMsgId() later.
+#ifdef RSID_TRACE_SPANS
+#define RSID_TRACE_SPAN_VAR(var, category, ...) RealSenseID::Tracer::ScopedSpan var(category, __VA_ARGS__)
+#else
+#define RSID_TRACE_SPAN_VAR(var, category, ...) RealSenseID::Tracer::NullSpan var(category, __VA_ARGS__)
+#endif
+
+#define RSID_TRACE_CONCAT_(a, b) a##b
+#define RSID_TRACE_CONCAT(a, b) RSID_TRACE_CONCAT_(a, b)
+#define RSID_TRACE_SPAN(category, ...)                                                                                 \
+    RSID_TRACE_SPAN_VAR(RSID_TRACE_CONCAT(rsid_trace_span_, __LINE__), category, __VA_ARGS__)
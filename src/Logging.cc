@@ -3,11 +3,23 @@
 
 #include "RealSenseID/Logging.h"
 #include "Logger/Logger.h"
+#include "Logger/Tracer.h"
+#include "PacketManager/SerialTrace.h"
 
 
 namespace RealSenseID
 {
+static_assert(static_cast<int>(Logger::Delivery::Sync) == static_cast<int>(LogDelivery::Sync), "neq");
+static_assert(static_cast<int>(Logger::Delivery::AsyncBlock) == static_cast<int>(LogDelivery::AsyncBlock), "neq");
+static_assert(static_cast<int>(Logger::Delivery::AsyncDropOldest) == static_cast<int>(LogDelivery::AsyncDropOldest),
+              "neq");
+
 void SetLogCallback(LogCallback user_callback, LogLevel level, bool do_formatting)
+{
+    SetLogCallback(user_callback, level, do_formatting, LogDelivery::Sync);
+}
+
+void SetLogCallback(LogCallback user_callback, LogLevel level, bool do_formatting, LogDelivery delivery)
 {
     // callback wrapper
     // cast the inner received Logger::LogLevel to the public RealSenseID::LogLevel and call user callback.
@@ -17,7 +29,64 @@ void SetLogCallback(LogCallback user_callback, LogLevel level, bool do_formattin
 
     // cast public RealSenseID::LogLevel to the inner Logger::LogLevel and register the callback wrapper.
     auto logger_level = static_cast<Logger::LogLevel>(level);
-    Logger::Instance().SetCallback(clbk_wrapper, logger_level, do_formatting);
+    Logger::Instance().SetCallback(clbk_wrapper, logger_level, do_formatting,
+                                   static_cast<Logger::Delivery>(delivery));
+}
+
+void SetStructuredLogCallback(StructuredLogCallback user_callback, LogLevel level)
+{
+    Logger::StructuredCallback clbk_wrapper;
+    if (user_callback)
+    {
+        clbk_wrapper = [user_callback](Logger::LogLevel logger_level, const char* tag, const char* msg, size_t size) {
+            LogRecord record {static_cast<RealSenseID::LogLevel>(logger_level), tag, msg, size};
+            user_callback(record);
+        };
+    }
+    Logger::Instance().SetStructuredCallback(clbk_wrapper, static_cast<Logger::LogLevel>(level));
+}
+
+void SetLogSampling(const char* tag, unsigned int one_in, unsigned int max_per_second)
+{
+    if (tag != nullptr)
+    {
+        Logger::Instance().SetSampling(tag, one_in, max_per_second);
+    }
+}
+
+void ClearLogSampling()
+{
+    Logger::Instance().ClearSampling();
+}
+
+void StartSerialTrace(unsigned int bytes_per_thread)
+{
+    PacketManager::SerialTrace::Start(bytes_per_thread);
+}
+
+void StopSerialTrace()
+{
+    PacketManager::SerialTrace::Stop();
+}
+
+bool DumpSerialTrace(const char* path)
+{
+    return PacketManager::SerialTrace::Dump(path);
+}
+
+void StartSpanTrace(unsigned int max_spans)
+{
+    Tracer::Start(max_spans);
+}
+
+void StopSpanTrace()
+{
+    Tracer::Stop();
+}
+
+bool DumpSpanTrace(const char* path)
+{
+    return Tracer::Dump(path);
 }
 
 } // namespace RealSenseID
@@ -0,0 +1,60 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "LibraryMemory.h"
+#include <cstddef>
+#include <vector>
+
+namespace RealSenseID
+{
+// Minimal std allocator returning memory aligned to Alignment bytes (power of 2, >= sizeof(void*)), from the library's
+// allocator (SetAllocator()). Used for the dense gallery matrices, so that every row starts on a cache line.
+// The blocks are charged to the gallery's memory (GetMemoryStats()).
+template <typename T, size_t Alignment>
+class AlignedAllocator
+{
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind
+    {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() = default;
+
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+        return n > 0 ? static_cast<T*>(Memory::Allocate(n * sizeof(T), Alignment, Memory::Category::Gallery)) : nullptr;
+    }
+
+    void deallocate(T* ptr, size_t n) noexcept
+    {
+        Memory::Deallocate(ptr, n * sizeof(T), Alignment);
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const noexcept
+    {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const noexcept
+    {
+        return false;
+    }
+};
+
+// other containers of the galleries and their indices, from the library's allocator and charged to the gallery
+template <typename T>
+using GalleryVector = std::vector<T, Memory::StdAllocator<T, alignof(T), Memory::Category::Gallery>>;
+} // namespace RealSenseID
@@ -3,14 +3,29 @@
 
 #include "Matcher.h"
 #include "Logger.h"
+#include "Tracer.h"
+#include "MetricsRegistry.h"
 #include "RealSenseID/Faceprints.h"
 #include "ExtendedFaceprints.h"
+#include "MatcherKernels.h"
+#include "MatcherGallery.h"
+#include "MatcherThreadPool.h"
+#include "MatcherIvfIndex.h"
+#include "MatcherInt8Prefilter.h"
+#include "MatcherPqIndex.h"
+#include "MatcherSignPrefilter.h"
+#include "MatcherConcurrentGallery.h"
+#include <atomic>
 #include <cmath>
 #include <assert.h>
 #include <cstring>
 #include <stdexcept>
 #include <vector>
 #include <algorithm>
+#include <array>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 // #include <iostream>
 
 /*
@@ -65,6 +80,9 @@ bool Matcher::GetScores(const Faceprints& new_faceprints,
                         const std::vector<ExtendedFaceprints>& existing_faceprints_array, TagResult& result,
                         match_calc_t threshold)
 {
+    RSID_TRACE_SPAN("matcher", "GetScores");
+    MetricsRegistry::ScopedMatcherSearch search;
+    search.SetCandidates(existing_faceprints_array.size());
     // initialize.
     result.score = 0;
     result.id = -1;
@@ -123,6 +141,244 @@ bool Matcher::GetScores(const Faceprints& new_faceprints,
     return true;
 }
 
+// NccGrade() truncates the two normalized correlations and their product, so it never exceeds the real valued grade
+// 4096 * corr^2 / (norm1 * norm2). The scans only need the exact fixed-point grade of a candidate whose real valued
+// grade is over the score it has to beat (the best score so far, under the threshold while scanning, or the
+// threshold): the others are skipped with a few floating-point multiplies instead of the msb searches and divisions
+// of NccGrade(), and the results are unchanged. The margin covers the rounding of the doubles.
+static inline bool GradeMayExceed(int32_t corr, uint32_t norm1, uint32_t norm2, match_calc_t score)
+{
+    constexpr double MarginGrade = 4096.0 * (1.0 + 1e-9);
+    const double c = corr > 0 ? static_cast<double>(corr) : 0.0;
+    return c * c * MarginGrade > static_cast<double>(score) * norm1 * norm2;
+}
+
+// result of scanning a range of the gallery. The scan of a range stops at the first entry that would stop
+// the sequential scan too (a score above threshold).
+struct ShardScanResult
+{
+    match_calc_t max_score = s_minPossibleScore;
+    int max_subject = -1;
+    bool hit = false;
+};
+
+// index of the lowest set bit of a non zero word
+static inline unsigned LowestBit(uint64_t word)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    if (_BitScanForward(&index, static_cast<unsigned long>(word)))
+    {
+        return index;
+    }
+    _BitScanForward(&index, static_cast<unsigned long>(word >> 32));
+    return index + 32;
+#else
+    return static_cast<unsigned>(__builtin_ctzll(word));
+#endif
+}
+
+static inline bool IsEligible(const uint64_t* eligible, size_t index)
+{
+    return eligible == nullptr || (eligible[index / 64] >> (index % 64)) & 1;
+}
+
+// bits [offset, offset + count) of bits, as a bitset of its own
+static void SliceBits(const uint64_t* bits, size_t offset, size_t count, std::vector<uint64_t>& slice)
+{
+    slice.assign((count + 63) / 64, 0);
+    const size_t shift = offset % 64;
+    for (size_t i = 0; i < slice.size(); i++)
+    {
+        const size_t word = offset / 64 + i;
+        slice[i] = bits[word] >> shift;
+        // the next word's low bits, if they are in the range
+        if (shift != 0 && (i + 1) * 64 - shift < count)
+        {
+            slice[i] |= bits[word + 1] << (64 - shift);
+        }
+    }
+}
+
+// visit(index) the entries of [begin, end) that are eligible (see SearchConfig::eligible, all of them if null), in
+// order, until it returns false. words of the bitset with no eligible entry are skipped whole.
+template <typename Visit>
+static inline void ForEachEligible(const uint64_t* eligible, size_t begin, size_t end, Visit&& visit)
+{
+    if (eligible == nullptr)
+    {
+        for (size_t index = begin; index < end; index++)
+        {
+            if (!visit(index))
+            {
+                return;
+            }
+        }
+        return;
+    }
+    for (size_t word_begin = begin - begin % 64; word_begin < end; word_begin += 64)
+    {
+        uint64_t word = eligible[word_begin / 64];
+        if (word_begin < begin)
+        {
+            word &= ~uint64_t {0} << (begin - word_begin);
+        }
+        if (end - word_begin < 64)
+        {
+            word &= (uint64_t {1} << (end - word_begin)) - 1;
+        }
+        while (word != 0)
+        {
+            const size_t index = word_begin + LowestBit(word);
+            word &= word - 1;
+            if (!visit(index))
+            {
+                return;
+            }
+        }
+    }
+}
+
+bool Matcher::GetScores(const Faceprints& new_faceprints, const GalleryRows& rows, TagResult& result,
+                        match_calc_t threshold, const SearchConfig& search_config)
+{
+    RSID_TRACE_SPAN("matcher", "GetScores");
+    MetricsRegistry::ScopedMatcherSearch search;
+    search.SetCandidates(rows.size);
+    // initialize.
+    result.score = 0;
+    result.id = -1;
+
+    if (rows.size == 0)
+    {
+        return false;
+    }
+
+    const feature_t* queryFea = &new_faceprints.adaptiveDescriptorWithoutMask[0];
+    uint32_t vec_length = RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER;
+
+    // the probe norm is the same for all candidates and the gallery norms are cached,
+    // so only the correlation is calculated inside the loop.
+    uint32_t query_norm = 1;
+    short query_norm_msb = 1;
+    GetVectorNorm(queryFea, query_norm, query_norm_msb, vec_length);
+
+    size_t numberOfSubjects = rows.size;
+
+    // hinted entries first: one over threshold is the result, without a scan.
+    for (size_t i = 0; i < search_config.number_of_hints; i++)
+    {
+        const size_t hint = search_config.hints[i];
+        if (hint >= numberOfSubjects || !IsEligible(search_config.eligible, hint))
+        {
+            continue;
+        }
+        int32_t corr = MatcherKernels::ComputeCorr(queryFea, rows.adaptive_vectors + hint * vec_length, vec_length);
+        auto& norm = rows.norms[hint];
+        if (!GradeMayExceed(corr, query_norm, norm.norm, threshold))
+        {
+            continue;
+        }
+        match_calc_t adaptedScore = NccGrade(corr, query_norm, query_norm_msb, norm.norm, norm.norm_msb);
+        if (adaptedScore > threshold)
+        {
+            search.SetCandidates(i + 1);
+            result.score = adaptedScore;
+            result.id = static_cast<int>(hint);
+            return true;
+        }
+    }
+
+    // index of the earliest entry known to stop the scan. shards past it can stop, their result is not used.
+    std::atomic<size_t> earliest_stop {numberOfSubjects};
+
+    auto scan_range = [&](size_t begin, size_t end, ShardScanResult& shard) {
+        ForEachEligible(search_config.eligible, begin, end, [&](size_t subjectIndex) {
+            if (subjectIndex > earliest_stop.load(std::memory_order_relaxed))
+            {
+                return false;
+            }
+
+            // only the dense (hot) gallery data is touched here. entries were validated when added to the gallery.
+            int32_t corr =
+                MatcherKernels::ComputeCorr(queryFea, rows.adaptive_vectors + subjectIndex * vec_length, vec_length);
+            auto& norm = rows.norms[subjectIndex];
+            if (!GradeMayExceed(corr, query_norm, norm.norm, shard.max_score))
+            {
+                return true;
+            }
+            match_calc_t adaptedScore = NccGrade(corr, query_norm, query_norm_msb, norm.norm, norm.norm_msb);
+
+            if (adaptedScore > shard.max_score)
+            {
+                shard.max_score = adaptedScore;
+                shard.max_subject = static_cast<int>(subjectIndex);
+            }
+
+            if (adaptedScore > threshold)
+            {
+                shard.hit = true;
+                size_t current = earliest_stop.load(std::memory_order_relaxed);
+                while (subjectIndex < current && !earliest_stop.compare_exchange_weak(current, subjectIndex))
+                {
+                }
+                return false;
+            }
+            return true;
+        });
+    };
+
+    size_t min_shard_size = std::max<size_t>(search_config.min_shard_size, 1);
+    size_t n_shards = 1;
+    if (search_config.pool != nullptr)
+    {
+        n_shards = std::min(search_config.pool->NumberOfThreads(), numberOfSubjects / min_shard_size);
+        n_shards = std::max<size_t>(n_shards, 1);
+    }
+
+    // a single shard is scanned without allocations (MatcherStaticGallery)
+    ShardScanResult single_shard;
+    std::vector<ShardScanResult> shards;
+    if (n_shards == 1)
+    {
+        scan_range(0, numberOfSubjects, single_shard);
+    }
+    else
+    {
+        shards.resize(n_shards);
+        size_t shard_size = (numberOfSubjects + n_shards - 1) / n_shards;
+        search_config.pool->Run(n_shards, [&](size_t shard_index) {
+            size_t begin = shard_index * shard_size;
+            size_t end = std::min(begin + shard_size, numberOfSubjects);
+            scan_range(begin, end, shards[shard_index]);
+        });
+    }
+
+    // reduce in gallery order, exactly as the sequential scan would have seen the entries.
+    match_calc_t maxScore = s_minPossibleScore;
+    int maxSubject = -1;
+    const ShardScanResult* shard_results = n_shards == 1 ? &single_shard : shards.data();
+    for (size_t i = 0; i < n_shards; i++)
+    {
+        const auto& shard = shard_results[i];
+        if (shard.max_score > maxScore)
+        {
+            maxScore = shard.max_score;
+            maxSubject = shard.max_subject;
+        }
+
+        if (shard.hit)
+        {
+            break;
+        }
+    }
+
+    result.score = maxScore;
+    result.id = maxSubject;
+
+    return true;
+}
+
 void Matcher::FaceMatch(const Faceprints& new_faceprints,
                         const std::vector<ExtendedFaceprints>& existing_faceprints_array, ExtendedMatchResult& result,
                         const Thresholds& thresholds)
@@ -153,6 +409,42 @@ void Matcher::FaceMatch(const Faceprints& new_faceprints,
     result.confidence = CalculateConfidence(scoresResult.score, threshold, result);
 }
 
+void Matcher::FaceMatch(const Faceprints& new_faceprints, const GalleryRows& rows, ExtendedMatchResult& result,
+                        const Thresholds& thresholds, const SearchConfig& search_config)
+{
+    result.isIdentical = false;
+    result.isSame = false;
+    result.maxScore = 0;
+    result.confidence = 0;
+    result.userId = -1;
+    result.should_update = false;
+
+    TagResult scoresResult;
+    match_calc_t threshold = thresholds.strongThreshold_pNMgNM;
+
+    bool isScoreSuccess = GetScores(new_faceprints, rows, scoresResult, threshold, search_config);
+
+    if (!isScoreSuccess)
+    {
+        LOG_ERROR(LOG_TAG, "Failed during GetScores() - please check.");
+        return;
+    }
+
+    FillMatchResult(scoresResult, thresholds, result);
+}
+
+void Matcher::FillMatchResult(const TagResult& scoresResult, const Thresholds& thresholds, ExtendedMatchResult& result)
+{
+    match_calc_t threshold = thresholds.strongThreshold_pNMgNM;
+
+    result.maxScore = scoresResult.score;
+    result.isSame = scoresResult.score > threshold;
+    result.isIdentical = (scoresResult.score > thresholds.identicalThreshold_NM);
+    result.userId = scoresResult.id;
+
+    result.confidence = CalculateConfidence(scoresResult.score, threshold, result);
+}
+
 static void SetToDefaultThresholds(Thresholds& thresholds)
 {
     thresholds.identicalThreshold_M = s_identicalThreshold_M;
@@ -181,177 +473,1276 @@ bool Matcher::ValidateFaceprints(const Faceprints& faceprints, bool check_enroll
     
     bool is_valid = true;
 
-    if(check_enrollment_vector)
+    if(check_enrollment_vector)
+    {
+        is_valid = ValidateVector(&faceprints.enrollmentDescriptor[0], nfeatures);
+    }
+    else
+    {
+        // TODO yossidan - handle with/without mask vectors properly (if/as needed).
+        is_valid = ValidateVector(&faceprints.adaptiveDescriptorWithoutMask[0], nfeatures);
+    }
+    
+    if (!is_valid)
+    {
+        LOG_ERROR(LOG_TAG, "Vector (faceprint) validation failed!");
+    }
+
+    return is_valid;
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const Faceprints& new_faceprints,
+                                                    const std::vector<ExtendedFaceprints>& existing_faceprints_array,
+                                                    Faceprints& updated_faceprints)
+{
+    RSID_TRACE_SPAN("matcher", "MatchFaceprintsToArray");
+    // TODO yossidan - handle with/without mask vectors properly (as needed).
+
+    Thresholds thresholds;
+    SetToDefaultThresholds(thresholds);
+    ExtendedMatchResult result;
+    
+    result.userId = -1;
+    result.maxScore = 0;
+
+    if (!ValidateFaceprints(new_faceprints)) 
+	{
+        LOG_ERROR(LOG_TAG, "Faceprints vector failed range validation.");
+		return result;	
+	}
+    
+    if(existing_faceprints_array.size() <= 0)
+    {
+        LOG_ERROR(LOG_TAG, "Faceprints array size is 0.");
+        return result;	
+    }
+
+    if (new_faceprints.version != existing_faceprints_array[0].faceprints.version) 
+    {
+        LOG_ERROR(LOG_TAG, "version mismatch between 2 vectors. Skipping this match()!");
+		return result;	
+    }
+
+    // Try to match the 2 faceprints. And raise should_update flag respecively.
+    FaceMatch(new_faceprints, existing_faceprints_array, result, thresholds);
+    result.should_update = (result.maxScore >= thresholds.updateThreshold_NM) && result.isSame;
+
+    bool enable_update = true;
+
+    // if should_update then we create an update vector such that:
+    // (1) the current vector is blended into the latest avg vector.
+    // (2) then we make sure that the updated avg vector is not too far from the orig. 
+    if (result.should_update && enable_update)
+    {
+        // Init updated_faceprints to the faceprints already exists in the DB
+        //  
+        size_t user_index = (size_t)result.userId;
+
+        if((user_index < 0) || (user_index >= existing_faceprints_array.size()))
+        {
+            LOG_ERROR(LOG_TAG, "Invalid user_index : Skipping function.");
+            return result;
+        }
+
+        updated_faceprints = existing_faceprints_array[user_index].faceprints;
+        
+        const uint32_t vec_length = RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER;
+
+        // TODO yossidan - handle with/without mask vectors properly (if/as needed).
+
+        // blend the current avg vector with the new vector
+        BlendAverageVector(&updated_faceprints.adaptiveDescriptorWithoutMask[0], &new_faceprints.adaptiveDescriptorWithoutMask[0], vec_length);
+
+        // make sure blended avg vector is not too far from enrollment vector
+        UpdateAverageVector(&updated_faceprints.adaptiveDescriptorWithoutMask[0], &updated_faceprints.enrollmentDescriptor[0],
+                            thresholds, vec_length);
+    }
+    
+    return result;
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const Faceprints& new_faceprints,
+                                                    const std::vector<ExtendedFaceprints>& existing_faceprints_array,
+                                                    Faceprints& updated_faceprints, const Thresholds& thresholds)
+{
+    RSID_TRACE_SPAN("matcher", "MatchFaceprintsToArray");
+    // TODO yossidan - handle with/without mask vectors properly (as needed).
+    
+    ExtendedMatchResult result;
+
+    result.userId = -1;
+    result.maxScore = 0;
+
+    if (!ValidateFaceprints(new_faceprints)) 
+	{
+        LOG_ERROR(LOG_TAG, "Faceprints vector failed range validation.");
+		return result;	
+	}
+    
+    if(existing_faceprints_array.size() <= 0)
+    {
+        LOG_ERROR(LOG_TAG, "Faceprints array size is 0.");
+        return result;	
+    }
+
+    if (new_faceprints.version != existing_faceprints_array[0].faceprints.version) 
+    {
+        LOG_ERROR(LOG_TAG, "version mismatch between 2 vectors. Skipping this match()!");
+		return result;	
+    }
+
+    FaceMatch(new_faceprints, existing_faceprints_array, result, thresholds);
+    result.should_update = (result.maxScore >= thresholds.updateThreshold_NM) && result.isSame;
+   
+    bool enable_update = true;
+
+    // if should_update then we create an update vector such that:
+    // (1) the current vector is blended into the latest avg vector.
+    // (2) then we make sure that the updated avg vector is not too far from the orig. 
+    if (result.should_update && enable_update)
+    {      
+        // Init updated_faceprints to the faceprints already exists in the DB
+        //  
+        size_t user_index = (size_t)result.userId;
+
+        if((user_index < 0) || (user_index >= existing_faceprints_array.size()))
+        {
+            LOG_ERROR(LOG_TAG, "Invalid user_index : Skipping function.");
+            return result;
+        }
+
+        updated_faceprints = existing_faceprints_array[user_index].faceprints;
+
+        const uint32_t vec_length = RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER;
+
+        // TODO yossidan - handle with/without mask vectors properly (if/as needed).
+
+        // update avg vector with the new vector
+        BlendAverageVector(&updated_faceprints.adaptiveDescriptorWithoutMask[0], &new_faceprints.adaptiveDescriptorWithoutMask[0],
+                                vec_length);
+
+        // make sure avg vector is not too far from enrollment vector
+        UpdateAverageVector(&updated_faceprints.adaptiveDescriptorWithoutMask[0], &updated_faceprints.enrollmentDescriptor[0],
+                            thresholds, vec_length);
+    }
+ 
+    return result;
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const Faceprints& new_faceprints, const MatcherGallery& gallery,
+                                                    Faceprints& updated_faceprints)
+{
+    return MatchFaceprintsToArray(new_faceprints, gallery, updated_faceprints, GetDefaultThresholds());
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const Faceprints& new_faceprints, const MatcherGallery& gallery,
+                                                    Faceprints& updated_faceprints, const Thresholds& thresholds)
+{
+    return MatchFaceprintsToArray(new_faceprints, gallery, updated_faceprints, thresholds, SearchConfig {});
+}
+
+// common input checks for matching a probe against a gallery.
+bool Matcher::ValidateGalleryProbe(const Faceprints& new_faceprints, const MatcherGallery& gallery)
+{
+    return ValidateGalleryProbe(new_faceprints, gallery.Size(), gallery.FaceprintsVersion());
+}
+
+bool Matcher::ValidateGalleryProbe(const Faceprints& new_faceprints, size_t gallery_size, int gallery_version)
+{
+    if (!ValidateFaceprints(new_faceprints))
+    {
+        LOG_ERROR(LOG_TAG, "Faceprints vector failed range validation.");
+        return false;
+    }
+
+    if (gallery_size == 0)
+    {
+        LOG_ERROR(LOG_TAG, "Faceprints array size is 0.");
+        return false;
+    }
+
+    if (new_faceprints.version != gallery_version)
+    {
+        LOG_ERROR(LOG_TAG, "version mismatch between 2 vectors. Skipping this match()!");
+        return false;
+    }
+    return true;
+}
+
+// if should_update then we create an update vector such that:
+// (1) the current vector is blended into the latest avg vector.
+// (2) then we make sure that the updated avg vector is not too far from the orig.
+void Matcher::ApplyGalleryUpdate(const Faceprints& new_faceprints, const MatcherGallery& gallery,
+                                 const Thresholds& thresholds, ExtendedMatchResult& result,
+                                 Faceprints& updated_faceprints, bool build_update)
+{
+    result.should_update = (result.maxScore >= thresholds.updateThreshold_NM) && result.isSame;
+    if (!result.should_update || !build_update)
+    {
+        return;
+    }
+
+    size_t user_index = (size_t)result.userId;
+
+    if (user_index >= gallery.Size())
+    {
+        LOG_ERROR(LOG_TAG, "Invalid user_index : Skipping function.");
+        return;
+    }
+
+    BuildAdaptiveUpdate(new_faceprints, gallery.Entry(user_index).faceprints, thresholds, updated_faceprints);
+}
+
+void Matcher::BuildAdaptiveUpdate(const Faceprints& new_faceprints, const Faceprints& existing_faceprints,
+                                  const Thresholds& thresholds, Faceprints& updated_faceprints)
+{
+    updated_faceprints = existing_faceprints;
+
+    const uint32_t vec_length = RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER;
+
+    BlendAverageVector(&updated_faceprints.adaptiveDescriptorWithoutMask[0],
+                       &new_faceprints.adaptiveDescriptorWithoutMask[0], vec_length);
+
+    UpdateAverageVector(&updated_faceprints.adaptiveDescriptorWithoutMask[0],
+                        &updated_faceprints.enrollmentDescriptor[0], thresholds, vec_length);
+}
+
+bool Matcher::UpdateGalleryEntry(const Faceprints& new_faceprints, MatcherGallery& gallery, size_t index,
+                                 const Thresholds& thresholds)
+{
+    feature_t* adaptive = gallery.AdaptiveVectorForUpdate(index);
+    if (adaptive == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Invalid user_index : Skipping function.");
+        return false;
+    }
+
+    const uint32_t vec_length = RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER;
+
+    // same steps as BuildAdaptiveUpdate(), on the gallery row
+    BlendAverageVector(adaptive, &new_faceprints.adaptiveDescriptorWithoutMask[0], vec_length);
+    UpdateAverageVector(adaptive, gallery.EnrollmentVector(index), thresholds, vec_length);
+    gallery.RefreshNorm(index);
+    return true;
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const Faceprints& new_faceprints, const MatcherGallery& gallery,
+                                                    Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                    const SearchConfig& search_config)
+{
+    RSID_TRACE_SPAN("matcher", "MatchFaceprintsToArray");
+    ExtendedMatchResult result;
+
+    result.userId = -1;
+    result.maxScore = 0;
+
+    if (!ValidateGalleryProbe(new_faceprints, gallery))
+    {
+        return result;
+    }
+
+    FaceMatch(new_faceprints, gallery.Rows(), result, thresholds, search_config);
+    ApplyGalleryUpdate(new_faceprints, gallery, thresholds, result, updated_faceprints, !search_config.defer_update);
+    return result;
+}
+
+bool Matcher::GetScoresForCandidates(const Faceprints& new_faceprints, const MatcherGallery& gallery,
+                                     const std::vector<uint32_t>& candidates, TagResult& result,
+                                     match_calc_t threshold, const uint64_t* eligible)
+{
+    RSID_TRACE_SPAN("matcher", "GetScoresForCandidates");
+    MetricsRegistry::ScopedMatcherSearch search;
+    search.SetCandidates(candidates.size());
+    // initialize.
+    result.score = 0;
+    result.id = -1;
+
+    const feature_t* queryFea = &new_faceprints.adaptiveDescriptorWithoutMask[0];
+    const uint32_t vec_length = RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER;
+
+    uint32_t query_norm = 1;
+    short query_norm_msb = 1;
+    GetVectorNorm(queryFea, query_norm, query_norm_msb, vec_length);
+
+    match_calc_t maxScore = s_minPossibleScore;
+    int maxSubject = -1;
+
+    for (uint32_t subjectIndex : candidates)
+    {
+        if (subjectIndex >= gallery.Size())
+        {
+            LOG_ERROR(LOG_TAG, "Index candidate out of gallery range");
+            return false;
+        }
+        if (!IsEligible(eligible, subjectIndex))
+        {
+            continue;
+        }
+
+        int32_t corr = MatcherKernels::ComputeCorr(queryFea, gallery.AdaptiveVector(subjectIndex), vec_length);
+        auto& norm = gallery.Norm(subjectIndex);
+        if (!GradeMayExceed(corr, query_norm, norm.norm, maxScore))
+        {
+            continue;
+        }
+        match_calc_t adaptedScore = NccGrade(corr, query_norm, query_norm_msb, norm.norm, norm.norm_msb);
+
+        if (adaptedScore > maxScore)
+        {
+            maxScore = adaptedScore;
+            maxSubject = static_cast<int>(subjectIndex);
+        }
+
+        if (adaptedScore > threshold)
+        {
+            break;
+        }
+    }
+
+    result.score = maxScore;
+    result.id = maxSubject;
+    return true;
+}
+
+bool Matcher::GetScoresBounded(const Faceprints& new_faceprints, const MatcherGallery& gallery,
+                               const MatcherInt8Prefilter& prefilter, TagResult& result, match_calc_t threshold)
+{
+    RSID_TRACE_SPAN("matcher", "GetScoresBounded");
+    MetricsRegistry::ScopedMatcherSearch search;
+    // initialize.
+    result.score = 0;
+    result.id = -1;
+
+    const feature_t* queryFea = &new_faceprints.adaptiveDescriptorWithoutMask[0];
+    const uint32_t vec_length = RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER;
+
+    uint32_t query_norm = 1;
+    short query_norm_msb = 1;
+    GetVectorNorm(queryFea, query_norm, query_norm_msb, vec_length);
+
+    // NccGrade() of a positive correlation is at most 4096 * corr^2 / (norm1 * norm2), so a correlation bound is also
+    // a grade bound.
+    std::vector<double> bounds;
+    prefilter.CorrelationBounds(queryFea, bounds);
+    const size_t numberOfSubjects = bounds.size();
+    size_t best_bound_index = 0;
+    for (size_t subjectIndex = 0; subjectIndex < numberOfSubjects; subjectIndex++)
+    {
+        double corr_bound = std::max(bounds[subjectIndex], 0.0);
+        bounds[subjectIndex] = corr_bound * corr_bound * 4096.0 /
+                               (static_cast<double>(query_norm) * gallery.Norm(subjectIndex).norm);
+        if (bounds[subjectIndex] > bounds[best_bound_index])
+        {
+            best_bound_index = subjectIndex;
+        }
+    }
+
+    size_t scored = 0;
+    auto score = [&](size_t subjectIndex) {
+        scored++;
+        int32_t corr = MatcherKernels::ComputeCorr(queryFea, gallery.AdaptiveVector(subjectIndex), vec_length);
+        auto& norm = gallery.Norm(subjectIndex);
+        return NccGrade(corr, query_norm, query_norm_msb, norm.norm, norm.norm_msb);
+    };
+
+    // the exhaustive scan stops at the first entry over threshold, and its result is that entry. only entries whose
+    // bound is over threshold can be it.
+    match_calc_t maxScore = s_minPossibleScore;
+    int maxSubject = -1;
+    std::vector<bool> done(numberOfSubjects, false);
+    for (size_t subjectIndex = 0; subjectIndex < numberOfSubjects; subjectIndex++)
+    {
+        if (bounds[subjectIndex] <= threshold)
+        {
+            continue;
+        }
+        match_calc_t adaptedScore = score(subjectIndex);
+        done[subjectIndex] = true;
+        if (adaptedScore > threshold)
+        {
+            search.SetCandidates(scored);
+            result.score = adaptedScore;
+            result.id = static_cast<int>(subjectIndex);
+            return true;
+        }
+        if (adaptedScore > maxScore)
+        {
+            maxScore = adaptedScore;
+            maxSubject = static_cast<int>(subjectIndex);
+        }
+    }
+
+    // no entry over threshold: the result is the first entry with the max score. the entry with the best bound is
+    // likely it, so the other entries are compared with its score and most of them are skipped by their bound.
+    auto update_max = [&](size_t subjectIndex, match_calc_t adaptedScore) {
+        if (adaptedScore > maxScore ||
+            (adaptedScore == maxScore && maxSubject >= 0 && static_cast<int>(subjectIndex) < maxSubject))
+        {
+            maxScore = adaptedScore;
+            maxSubject = static_cast<int>(subjectIndex);
+        }
+    };
+    if (numberOfSubjects > 0 && !done[best_bound_index])
+    {
+        update_max(best_bound_index, score(best_bound_index));
+        done[best_bound_index] = true;
+    }
+    for (size_t subjectIndex = 0; subjectIndex < numberOfSubjects; subjectIndex++)
+    {
+        if (done[subjectIndex] || bounds[subjectIndex] < maxScore)
+        {
+            continue;
+        }
+        update_max(subjectIndex, score(subjectIndex));
+    }
+
+    search.SetCandidates(scored);
+    result.score = maxScore;
+    result.id = maxSubject;
+    return true;
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const Faceprints& new_faceprints, const MatcherGallery& gallery,
+                                                    const MatcherIvfIndex& index, size_t n_probe_lists,
+                                                    Faceprints& updated_faceprints, const Thresholds& thresholds)
+{
+    RSID_TRACE_SPAN("matcher", "MatchFaceprintsToArray");
+    ExtendedMatchResult result;
+
+    if (!ValidateGalleryProbe(new_faceprints, gallery))
+    {
+        return result;
+    }
+
+    if (!index.IsBuilt() || index.Size() != gallery.Size())
+    {
+        LOG_ERROR(LOG_TAG, "Index is not built or out of sync with the gallery.");
+        return result;
+    }
+
+    std::vector<uint32_t> candidates;
+    index.Search(&new_faceprints.adaptiveDescriptorWithoutMask[0], n_probe_lists, candidates);
+
+    TagResult scoresResult;
+    if (!GetScoresForCandidates(new_faceprints, gallery, candidates, scoresResult, thresholds.strongThreshold_pNMgNM))
+    {
+        LOG_ERROR(LOG_TAG, "Failed during GetScores() - please check.");
+        return result;
+    }
+
+    FillMatchResult(scoresResult, thresholds, result);
+    ApplyGalleryUpdate(new_faceprints, gallery, thresholds, result, updated_faceprints);
+    return result;
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const Faceprints& new_faceprints, const MatcherGallery& gallery,
+                                                    const MatcherInt8Prefilter& prefilter, int tolerance,
+                                                    Faceprints& updated_faceprints, const Thresholds& thresholds)
+{
+    RSID_TRACE_SPAN("matcher", "MatchFaceprintsToArray");
+    ExtendedMatchResult result;
+
+    if (!ValidateGalleryProbe(new_faceprints, gallery))
+    {
+        return result;
+    }
+
+    if (prefilter.Size() != gallery.Size())
+    {
+        LOG_ERROR(LOG_TAG, "Prefilter is out of sync with the gallery.");
+        return result;
+    }
+
+    std::vector<uint32_t> candidates;
+    prefilter.Search(&new_faceprints.adaptiveDescriptorWithoutMask[0], tolerance, candidates);
+
+    TagResult scoresResult;
+    if (!GetScoresForCandidates(new_faceprints, gallery, candidates, scoresResult, thresholds.strongThreshold_pNMgNM))
+    {
+        LOG_ERROR(LOG_TAG, "Failed during GetScores() - please check.");
+        return result;
+    }
+
+    FillMatchResult(scoresResult, thresholds, result);
+    ApplyGalleryUpdate(new_faceprints, gallery, thresholds, result, updated_faceprints);
+    return result;
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const Faceprints& new_faceprints, const MatcherGallery& gallery,
+                                                    const MatcherInt8Prefilter& prefilter,
+                                                    Faceprints& updated_faceprints, const Thresholds& thresholds)
+{
+    RSID_TRACE_SPAN("matcher", "MatchFaceprintsToArray");
+    ExtendedMatchResult result;
+
+    if (!ValidateGalleryProbe(new_faceprints, gallery))
+    {
+        return result;
+    }
+
+    if (prefilter.Size() != gallery.Size())
+    {
+        LOG_ERROR(LOG_TAG, "Prefilter is out of sync with the gallery.");
+        return result;
+    }
+
+    TagResult scoresResult;
+    if (!GetScoresBounded(new_faceprints, gallery, prefilter, scoresResult, thresholds.strongThreshold_pNMgNM))
+    {
+        LOG_ERROR(LOG_TAG, "Failed during GetScores() - please check.");
+        return result;
+    }
+
+    FillMatchResult(scoresResult, thresholds, result);
+    ApplyGalleryUpdate(new_faceprints, gallery, thresholds, result, updated_faceprints);
+    return result;
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const Faceprints& new_faceprints, const MatcherGallery& gallery,
+                                                    const MatcherSignPrefilter& prefilter, size_t shortlist_size,
+                                                    Faceprints& updated_faceprints, const Thresholds& thresholds)
+{
+    RSID_TRACE_SPAN("matcher", "MatchFaceprintsToArray");
+    ExtendedMatchResult result;
+
+    if (!ValidateGalleryProbe(new_faceprints, gallery))
+    {
+        return result;
+    }
+
+    if (prefilter.Size() != gallery.Size())
+    {
+        LOG_ERROR(LOG_TAG, "Prefilter is out of sync with the gallery.");
+        return result;
+    }
+
+    std::vector<uint32_t> candidates;
+    prefilter.Search(&new_faceprints.adaptiveDescriptorWithoutMask[0], shortlist_size, candidates);
+
+    TagResult scoresResult;
+    if (!GetScoresForCandidates(new_faceprints, gallery, candidates, scoresResult, thresholds.strongThreshold_pNMgNM))
+    {
+        LOG_ERROR(LOG_TAG, "Failed during GetScores() - please check.");
+        return result;
+    }
+
+    FillMatchResult(scoresResult, thresholds, result);
+    ApplyGalleryUpdate(new_faceprints, gallery, thresholds, result, updated_faceprints);
+    return result;
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const Faceprints& new_faceprints, const MatcherGallery& gallery,
+                                                    const MatcherPqIndex& index, size_t shortlist_size,
+                                                    Faceprints& updated_faceprints, const Thresholds& thresholds)
+{
+    RSID_TRACE_SPAN("matcher", "MatchFaceprintsToArray");
+    ExtendedMatchResult result;
+
+    if (!ValidateGalleryProbe(new_faceprints, gallery))
+    {
+        return result;
+    }
+
+    if (!index.IsBuilt() || index.Size() != gallery.Size())
+    {
+        LOG_ERROR(LOG_TAG, "Index is not built or out of sync with the gallery.");
+        return result;
+    }
+
+    std::vector<uint32_t> candidates;
+    index.Search(&new_faceprints.adaptiveDescriptorWithoutMask[0], shortlist_size, candidates);
+
+    TagResult scoresResult;
+    if (!GetScoresForCandidates(new_faceprints, gallery, candidates, scoresResult, thresholds.strongThreshold_pNMgNM))
+    {
+        LOG_ERROR(LOG_TAG, "Failed during GetScores() - please check.");
+        return result;
+    }
+
+    FillMatchResult(scoresResult, thresholds, result);
+    ApplyGalleryUpdate(new_faceprints, gallery, thresholds, result, updated_faceprints);
+    return result;
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToCandidates(const Faceprints& new_faceprints,
+                                                         const MatcherGallery& gallery,
+                                                         const std::vector<uint32_t>& candidates,
+                                                         Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                         const SearchConfig& search_config)
+{
+    RSID_TRACE_SPAN("matcher", "MatchFaceprintsToCandidates");
+    ExtendedMatchResult result;
+
+    if (!ValidateGalleryProbe(new_faceprints, gallery))
+    {
+        return result;
+    }
+
+    TagResult scoresResult;
+    if (!GetScoresForCandidates(new_faceprints, gallery, candidates, scoresResult, thresholds.strongThreshold_pNMgNM,
+                                search_config.eligible))
+    {
+        LOG_ERROR(LOG_TAG, "Failed during GetScores() - please check.");
+        return result;
+    }
+
+    FillMatchResult(scoresResult, thresholds, result);
+    ApplyGalleryUpdate(new_faceprints, gallery, thresholds, result, updated_faceprints, !search_config.defer_update);
+    return result;
+}
+
+// the clock is read before every AnytimeCheckInterval candidates of a deadline bounded search
+static constexpr size_t AnytimeCheckInterval = 64;
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArrayAnytime(const Faceprints& new_faceprints,
+                                                           const MatcherGallery& gallery, const MatcherIvfIndex* index,
+                                                           std::chrono::steady_clock::time_point deadline,
+                                                           Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                           const SearchConfig& search_config, bool& complete)
+{
+    RSID_TRACE_SPAN("matcher", "MatchFaceprintsToArrayAnytime");
+    ExtendedMatchResult result;
+    complete = false;
+
+    if (!ValidateGalleryProbe(new_faceprints, gallery))
+    {
+        return result;
+    }
+
+    if (index != nullptr && (!index->IsBuilt() || index->Size() != gallery.Size()))
+    {
+        LOG_ERROR(LOG_TAG, "Index is not built or out of sync with the gallery.");
+        return result;
+    }
+
+    MetricsRegistry::ScopedMatcherSearch search;
+
+    const feature_t* queryFea = &new_faceprints.adaptiveDescriptorWithoutMask[0];
+    const uint32_t vec_length = RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER;
+
+    uint32_t query_norm = 1;
+    short query_norm_msb = 1;
+    GetVectorNorm(queryFea, query_norm, query_norm_msb, vec_length);
+
+    const match_calc_t threshold = thresholds.strongThreshold_pNMgNM;
+    const size_t numberOfSubjects = gallery.Size();
+    match_calc_t maxScore = s_minPossibleScore;
+    int maxSubject = -1;
+    size_t scored = 0;
+    bool timed_out = false;
+
+    // score one candidate. false stops the search: a match, or the deadline passed.
+    auto score = [&](size_t subjectIndex) {
+        if (scored % AnytimeCheckInterval == 0 && std::chrono::steady_clock::now() >= deadline)
+        {
+            timed_out = true;
+            return false;
+        }
+        scored++;
+
+        int32_t corr = MatcherKernels::ComputeCorr(queryFea, gallery.AdaptiveVector(subjectIndex), vec_length);
+        auto& norm = gallery.Norm(subjectIndex);
+        if (!GradeMayExceed(corr, query_norm, norm.norm, maxScore))
+        {
+            return true;
+        }
+        match_calc_t adaptedScore = NccGrade(corr, query_norm, query_norm_msb, norm.norm, norm.norm_msb);
+        if (adaptedScore > maxScore)
+        {
+            maxScore = adaptedScore;
+            maxSubject = static_cast<int>(subjectIndex);
+        }
+        return adaptedScore <= threshold;
+    };
+
+    bool searching = true;
+    for (size_t i = 0; searching && i < search_config.number_of_hints; i++)
+    {
+        const size_t hint = search_config.hints[i];
+        if (hint < numberOfSubjects && IsEligible(search_config.eligible, hint))
+        {
+            searching = score(hint);
+        }
+    }
+
+    if (searching && index != nullptr)
+    {
+        index->PriorityOrder(queryFea, [&](uint32_t candidate) {
+            if (IsEligible(search_config.eligible, candidate))
+            {
+                searching = score(candidate);
+            }
+            return searching;
+        });
+    }
+    else if (searching)
+    {
+        ForEachEligible(search_config.eligible, 0, numberOfSubjects, score);
+    }
+    search.SetCandidates(scored);
+    complete = !timed_out;
+
+    TagResult scoresResult;
+    scoresResult.score = maxScore;
+    scoresResult.id = maxSubject;
+    FillMatchResult(scoresResult, thresholds, result);
+    ApplyGalleryUpdate(new_faceprints, gallery, thresholds, result, updated_faceprints, !search_config.defer_update);
+    return result;
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const Faceprints& new_faceprints, const GallerySnapshot& snapshot,
+                                                    Faceprints& updated_faceprints, const Thresholds& thresholds)
+{
+    return MatchFaceprintsToArray(new_faceprints, snapshot, updated_faceprints, thresholds, SearchConfig {});
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const Faceprints& new_faceprints, const GallerySnapshot& snapshot,
+                                                    Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                    const SearchConfig& search_config)
+{
+    RSID_TRACE_SPAN("matcher", "MatchFaceprintsToArray");
+    ExtendedMatchResult result;
+
+    // scan the segments in order, exactly as one gallery scan would: the best score wins (the earliest entry on
+    // ties) and the scan stops at the first segment with a score above the strong threshold.
+    SearchConfig segment_config = search_config;
+    segment_config.defer_update = true;
+    // hints are gallery indices, not segment indices
+    segment_config.hints = nullptr;
+    segment_config.number_of_hints = 0;
+    // and so is the eligible bitset, each segment gets its own slice of it
+    std::vector<uint64_t> segment_eligible;
+    size_t best_segment = 0;
+    bool found = false;
+    for (size_t segment = 0; segment < snapshot.segments.size(); segment++)
+    {
+        if (search_config.eligible != nullptr)
+        {
+            SliceBits(search_config.eligible, snapshot.offsets[segment], snapshot.segments[segment]->Size(),
+                      segment_eligible);
+            segment_config.eligible = segment_eligible.data();
+        }
+        Faceprints unused;
+        ExtendedMatchResult segment_result = MatchFaceprintsToArray(new_faceprints, *snapshot.segments[segment],
+                                                                    unused, thresholds, segment_config);
+        if (segment_result.userId < 0)
+        {
+            continue;
+        }
+        if (!found || segment_result.maxScore > result.maxScore)
+        {
+            result = segment_result;
+            best_segment = segment;
+            found = true;
+        }
+        if (segment_result.maxScore > thresholds.strongThreshold_pNMgNM)
+        {
+            break;
+        }
+    }
+
+    if (!found)
+    {
+        return result;
+    }
+
+    const size_t segment_index = static_cast<size_t>(result.userId);
+    result.userId = static_cast<int>(snapshot.offsets[best_segment] + segment_index);
+    if (result.should_update && !search_config.defer_update)
+    {
+        BuildAdaptiveUpdate(new_faceprints, snapshot.segments[best_segment]->Entry(segment_index).faceprints,
+                            thresholds, updated_faceprints);
+    }
+    return result;
+}
+
+ExtendedMatchResult Matcher::MatchFaceprintsToArrayMaskAware(const Faceprints& new_faceprints,
+                                                             const MatcherGallery& gallery,
+                                                             Faceprints& updated_faceprints,
+                                                             const Thresholds& thresholds)
+{
+    RSID_TRACE_SPAN("matcher", "MatchFaceprintsToArrayMaskAware");
+    const bool probe_has_mask = new_faceprints.adaptiveDescriptorWithoutMask[HAS_MASK_INDEX_IN_FEATURS_VECTOR] != 0;
+    if (!probe_has_mask)
+    {
+        return MatchFaceprintsToArray(new_faceprints, gallery, updated_faceprints, thresholds);
+    }
+
+    ExtendedMatchResult result;
+    MetricsRegistry::ScopedMatcherSearch search;
+    search.SetCandidates(gallery.Size());
+
+    if (!ValidateGalleryProbe(new_faceprints, gallery))
+    {
+        return result;
+    }
+
+    const feature_t* queryFea = &new_faceprints.adaptiveDescriptorWithoutMask[0];
+    const uint32_t vec_length = RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER;
+
+    uint32_t query_norm = 1;
+    short query_norm_msb = 1;
+    GetVectorNorm(queryFea, query_norm, query_norm_msb, vec_length);
+
+    match_calc_t maxScore = s_minPossibleScore;
+    int maxSubject = -1;
+    bool maxWithMask = false;
+
+    for (size_t subjectIndex = 0; subjectIndex < gallery.Size(); subjectIndex++)
+    {
+        // fused pass: both gallery descriptors against the probe, the probe is loaded once.
+        const feature_t* gallery_vectors[2] = {gallery.AdaptiveMaskVector(subjectIndex),
+                                               gallery.AdaptiveVector(subjectIndex)};
+        int32_t corr[2];
+        MatcherKernels::ComputeCorrBatch(gallery_vectors, 2, queryFea, vec_length, corr);
+
+        const auto& norm = gallery.Norm(subjectIndex);
+        match_calc_t score_NM = NccGrade(corr[1], query_norm, query_norm_msb, norm.norm, norm.norm_msb);
+        match_calc_t score_M = s_minPossibleScore;
+        if (gallery.HasMaskDescriptor(subjectIndex))
+        {
+            const auto& mask_norm = gallery.MaskNorm(subjectIndex);
+            score_M = NccGrade(corr[0], query_norm, query_norm_msb, mask_norm.norm, mask_norm.norm_msb);
+        }
+
+        bool with_mask = score_M > score_NM;
+        match_calc_t score = with_mask ? score_M : score_NM;
+
+        if (score > maxScore)
+        {
+            maxScore = score;
+            maxSubject = static_cast<int>(subjectIndex);
+            maxWithMask = with_mask;
+        }
+
+        match_calc_t threshold = with_mask ? thresholds.strongThreshold_pMgM : thresholds.strongThreshold_pMgNM;
+        if (score > threshold)
+        {
+            break;
+        }
+    }
+
+    const match_calc_t threshold = maxWithMask ? thresholds.strongThreshold_pMgM : thresholds.strongThreshold_pMgNM;
+    const match_calc_t identical = maxWithMask ? thresholds.identicalThreshold_M : thresholds.identicalThreshold_NM;
+
+    result.maxScore = maxScore;
+    result.isSame = maxScore > threshold;
+    result.isIdentical = maxScore > identical;
+    result.userId = maxSubject;
+    result.confidence = CalculateConfidence(maxScore, threshold, result);
+
+    if (!result.isSame || maxSubject < 0)
     {
-        is_valid = ValidateVector(&faceprints.enrollmentDescriptor[0], nfeatures);
+        return result;
+    }
+
+    const size_t user_index = static_cast<size_t>(maxSubject);
+    if (maxWithMask)
+    {
+        result.should_update = maxScore >= thresholds.updateThreshold_M;
     }
     else
     {
-        // TODO yossidan - handle with/without mask vectors properly (if/as needed).
-        is_valid = ValidateVector(&faceprints.adaptiveDescriptorWithoutMask[0], nfeatures);
+        // no with-mask descriptor matched: open the first one from the probe if close enough.
+        result.should_update = !gallery.HasMaskDescriptor(user_index) && maxScore >= thresholds.updateThreshold_MFirst;
     }
-    
-    if (!is_valid)
+
+    if (result.should_update)
     {
-        LOG_ERROR(LOG_TAG, "Vector (faceprint) validation failed!");
+        updated_faceprints = gallery.Entry(user_index).faceprints;
+        feature_t* mask_descriptor = &updated_faceprints.adaptiveDescriptorWithMask[0];
+        if (maxWithMask)
+        {
+            BlendAverageVector(mask_descriptor, queryFea, vec_length);
+            UpdateAverageVector(mask_descriptor, &updated_faceprints.enrollmentDescriptor[0], thresholds, vec_length);
+        }
+        else
+        {
+            ::memcpy(mask_descriptor, queryFea, vec_length * sizeof(feature_t));
+        }
     }
 
-    return is_valid;
+    return result;
 }
 
-ExtendedMatchResult Matcher::MatchFaceprintsToArray(const Faceprints& new_faceprints,
-                                                    const std::vector<ExtendedFaceprints>& existing_faceprints_array,
-                                                    Faceprints& updated_faceprints)
+bool Matcher::MatchFaceprintsToArrayBatch(const Faceprints* new_faceprints, size_t number_of_probes,
+                                          const MatcherGallery& gallery, ExtendedMatchResult* results,
+                                          Faceprints* updated_faceprints, const Thresholds& thresholds)
 {
-    // TODO yossidan - handle with/without mask vectors properly (as needed).
-
-    Thresholds thresholds;
-    SetToDefaultThresholds(thresholds);
-    ExtendedMatchResult result;
-    
-    result.userId = -1;
-    result.maxScore = 0;
+    return MatchFaceprintsToArrayBatch(new_faceprints, number_of_probes, gallery, results, updated_faceprints,
+                                       thresholds, SearchConfig {});
+}
 
-    if (!ValidateFaceprints(new_faceprints)) 
-	{
-        LOG_ERROR(LOG_TAG, "Faceprints vector failed range validation.");
-		return result;	
-	}
-    
-    if(existing_faceprints_array.size() <= 0)
+bool Matcher::MatchFaceprintsToArrayBatch(const Faceprints* new_faceprints, size_t number_of_probes,
+                                          const MatcherGallery& gallery, ExtendedMatchResult* results,
+                                          Faceprints* updated_faceprints, const Thresholds& thresholds,
+                                          const SearchConfig& search_config)
+{
+    RSID_TRACE_SPAN("matcher", "MatchFaceprintsToArrayBatch");
+    MetricsRegistry::ScopedMatcherSearch search;
+    search.SetCandidates(number_of_probes * gallery.Size());
+    if (new_faceprints == nullptr || results == nullptr || updated_faceprints == nullptr)
     {
-        LOG_ERROR(LOG_TAG, "Faceprints array size is 0.");
-        return result;	
+        LOG_ERROR(LOG_TAG, "Null pointer detected : Skipping function.");
+        return false;
     }
 
-    if (new_faceprints.version != existing_faceprints_array[0].faceprints.version) 
+    const uint32_t vec_length = RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER;
+    const match_calc_t threshold = thresholds.strongThreshold_pNMgNM;
+    const size_t numberOfSubjects = gallery.Size();
+
+    // state of a probe inside the current batch.
+    struct ProbeState
     {
-        LOG_ERROR(LOG_TAG, "version mismatch between 2 vectors. Skipping this match()!");
-		return result;	
+        size_t probe_index = 0;
+        uint32_t norm = 1;
+        short norm_msb = 1;
+        // index of the earliest entry known to stop the probe's scan. shards past it skip the probe.
+        std::atomic<size_t> earliest_stop {0};
+    };
+
+    // same sharding as the single probe search
+    size_t min_shard_size = std::max<size_t>(search_config.min_shard_size, 1);
+    size_t n_shards = 1;
+    if (search_config.pool != nullptr)
+    {
+        n_shards = std::min(search_config.pool->NumberOfThreads(), numberOfSubjects / min_shard_size);
+        n_shards = std::max<size_t>(n_shards, 1);
     }
+    size_t shard_size = (numberOfSubjects + n_shards - 1) / std::max<size_t>(n_shards, 1);
+    // shards x probes scan results
+    std::vector<ShardScanResult> shard_results(n_shards * MatcherKernels::MaxBatchProbes);
 
-    // Try to match the 2 faceprints. And raise should_update flag respecively.
-    FaceMatch(new_faceprints, existing_faceprints_array, result, thresholds);
-    result.should_update = (result.maxScore >= thresholds.updateThreshold_NM) && result.isSame;
-
-    bool enable_update = true;
-
-    // if should_update then we create an update vector such that:
-    // (1) the current vector is blended into the latest avg vector.
-    // (2) then we make sure that the updated avg vector is not too far from the orig. 
-    if (result.should_update && enable_update)
+    bool all_ok = true;
+    for (size_t batch_start = 0; batch_start < number_of_probes; batch_start += MatcherKernels::MaxBatchProbes)
     {
-        // Init updated_faceprints to the faceprints already exists in the DB
-        //  
-        size_t user_index = (size_t)result.userId;
+        size_t batch_end = std::min(batch_start + MatcherKernels::MaxBatchProbes, number_of_probes);
 
-        if((user_index < 0) || (user_index >= existing_faceprints_array.size()))
+        ProbeState states[MatcherKernels::MaxBatchProbes];
+        uint32_t n_states = 0;
+        for (size_t probe = batch_start; probe < batch_end; probe++)
         {
-            LOG_ERROR(LOG_TAG, "Invalid user_index : Skipping function.");
-            return result;
+            results[probe] = ExtendedMatchResult {};
+            if (!ValidateGalleryProbe(new_faceprints[probe], gallery))
+            {
+                all_ok = false;
+                continue;
+            }
+            auto& state = states[n_states++];
+            state.probe_index = probe;
+            state.earliest_stop = numberOfSubjects;
+            GetVectorNorm(&new_faceprints[probe].adaptiveDescriptorWithoutMask[0], state.norm, state.norm_msb, vec_length);
+        }
+        std::fill(shard_results.begin(), shard_results.end(), ShardScanResult {});
+
+        // scan a range of the gallery for the batch's probes. each gallery row is loaded once for all the probes
+        // still scanning. a probe leaves the scan once it clears the threshold (same early exit as the single probe
+        // search).
+        auto scan_range = [&](size_t begin, size_t end, ShardScanResult* shard) {
+            uint32_t active[MatcherKernels::MaxBatchProbes];
+            const feature_t* active_vectors[MatcherKernels::MaxBatchProbes];
+            uint32_t n_active = 0;
+            for (uint32_t i = 0; i < n_states; i++)
+            {
+                active[n_active++] = i;
+            }
+
+            int32_t corr[MatcherKernels::MaxBatchProbes];
+            ForEachEligible(search_config.eligible, begin, end, [&](size_t subjectIndex) {
+                uint32_t still_active = 0;
+                for (uint32_t p = 0; p < n_active; p++)
+                {
+                    if (subjectIndex <= states[active[p]].earliest_stop.load(std::memory_order_relaxed))
+                    {
+                        active[still_active++] = active[p];
+                    }
+                }
+                n_active = still_active;
+                for (uint32_t p = 0; p < n_active; p++)
+                {
+                    active_vectors[p] = &new_faceprints[states[active[p]].probe_index].adaptiveDescriptorWithoutMask[0];
+                }
+                if (n_active == 0)
+                {
+                    return false;
+                }
+                MatcherKernels::ComputeCorrBatch(active_vectors, n_active, gallery.AdaptiveVector(subjectIndex),
+                                                 vec_length, corr);
+
+                auto& norm = gallery.Norm(subjectIndex);
+                still_active = 0;
+                for (uint32_t p = 0; p < n_active; p++)
+                {
+                    auto& state = states[active[p]];
+                    auto& probe_shard = shard[active[p]];
+                    if (!GradeMayExceed(corr[p], state.norm, norm.norm, probe_shard.max_score))
+                    {
+                        active[still_active++] = active[p];
+                        continue;
+                    }
+                    match_calc_t score = NccGrade(corr[p], state.norm, state.norm_msb, norm.norm, norm.norm_msb);
+                    if (score > probe_shard.max_score)
+                    {
+                        probe_shard.max_score = score;
+                        probe_shard.max_subject = static_cast<int>(subjectIndex);
+                    }
+                    if (score <= threshold)
+                    {
+                        active[still_active++] = active[p];
+                        continue;
+                    }
+                    probe_shard.hit = true;
+                    size_t current = state.earliest_stop.load(std::memory_order_relaxed);
+                    while (subjectIndex < current && !state.earliest_stop.compare_exchange_weak(current, subjectIndex))
+                    {
+                    }
+                }
+                n_active = still_active;
+                return n_active > 0;
+            });
+        };
+
+        if (n_shards == 1)
+        {
+            scan_range(0, numberOfSubjects, &shard_results[0]);
+        }
+        else
+        {
+            search_config.pool->Run(n_shards, [&](size_t shard_index) {
+                size_t begin = shard_index * shard_size;
+                size_t end = std::min(begin + shard_size, numberOfSubjects);
+                scan_range(begin, end, &shard_results[shard_index * MatcherKernels::MaxBatchProbes]);
+            });
         }
 
-        updated_faceprints = existing_faceprints_array[user_index].faceprints;
-        
-        const uint32_t vec_length = RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER;
-
-        // TODO yossidan - handle with/without mask vectors properly (if/as needed).
-
-        // blend the current avg vector with the new vector
-        BlendAverageVector(&updated_faceprints.adaptiveDescriptorWithoutMask[0], &new_faceprints.adaptiveDescriptorWithoutMask[0], vec_length);
-
-        // make sure blended avg vector is not too far from enrollment vector
-        UpdateAverageVector(&updated_faceprints.adaptiveDescriptorWithoutMask[0], &updated_faceprints.enrollmentDescriptor[0],
-                            thresholds, vec_length);
+        for (uint32_t i = 0; i < n_states; i++)
+        {
+            // reduce in gallery order, exactly as the sequential scan would have seen the entries.
+            TagResult scoresResult;
+            scoresResult.score = s_minPossibleScore;
+            scoresResult.id = -1;
+            for (size_t shard_index = 0; shard_index < n_shards; shard_index++)
+            {
+                const auto& shard = shard_results[shard_index * MatcherKernels::MaxBatchProbes + i];
+                if (shard.max_score > scoresResult.score)
+                {
+                    scoresResult.score = shard.max_score;
+                    scoresResult.id = shard.max_subject;
+                }
+                if (shard.hit)
+                {
+                    break;
+                }
+            }
+
+            const auto& state = states[i];
+            auto& result = results[state.probe_index];
+            FillMatchResult(scoresResult, thresholds, result);
+            ApplyGalleryUpdate(new_faceprints[state.probe_index], gallery, thresholds, result,
+                               updated_faceprints[state.probe_index], !search_config.defer_update);
+        }
     }
-    
-    return result;
+
+    return all_ok;
 }
 
-ExtendedMatchResult Matcher::MatchFaceprintsToArray(const Faceprints& new_faceprints,
-                                                    const std::vector<ExtendedFaceprints>& existing_faceprints_array,
-                                                    Faceprints& updated_faceprints, const Thresholds& thresholds)
+bool Matcher::MatchFaceprintsTopK(const Faceprints& new_faceprints, const MatcherGallery& gallery, size_t k,
+                                  std::vector<TopKMatch>& results, const Thresholds& thresholds, bool early_exit)
 {
-    // TODO yossidan - handle with/without mask vectors properly (as needed).
-    
-    ExtendedMatchResult result;
-
-    result.userId = -1;
-    result.maxScore = 0;
+    RSID_TRACE_SPAN("matcher", "MatchFaceprintsTopK");
+    MetricsRegistry::ScopedMatcherSearch search;
+    search.SetCandidates(gallery.Size());
+    results.clear();
 
-    if (!ValidateFaceprints(new_faceprints)) 
-	{
-        LOG_ERROR(LOG_TAG, "Faceprints vector failed range validation.");
-		return result;	
-	}
-    
-    if(existing_faceprints_array.size() <= 0)
+    if (k == 0 || !ValidateGalleryProbe(new_faceprints, gallery))
     {
-        LOG_ERROR(LOG_TAG, "Faceprints array size is 0.");
-        return result;	
+        return false;
     }
 
-    if (new_faceprints.version != existing_faceprints_array[0].faceprints.version) 
+    const feature_t* queryFea = &new_faceprints.adaptiveDescriptorWithoutMask[0];
+    const uint32_t vec_length = RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER;
+
+    uint32_t query_norm = 1;
+    short query_norm_msb = 1;
+    GetVectorNorm(queryFea, query_norm, query_norm_msb, vec_length);
+
+    // fixed size min-heap of the best k candidates seen so far. the top of the heap is the weakest candidate
+    // (lowest score, and on equal scores the highest index, so earlier entries win ties).
+    auto weaker_first = [](const TopKMatch& lhs, const TopKMatch& rhs) {
+        return (lhs.score != rhs.score) ? (lhs.score > rhs.score) : (lhs.userId < rhs.userId);
+    };
+    k = std::min(k, gallery.Size());
+    std::vector<TopKMatch> heap;
+    heap.reserve(k);
+    size_t over_threshold = 0; // of the heap's candidates, for early_exit
+    const auto identical = thresholds.identicalThreshold_NM;
+
+    for (size_t subjectIndex = 0; subjectIndex < gallery.Size(); subjectIndex++)
     {
-        LOG_ERROR(LOG_TAG, "version mismatch between 2 vectors. Skipping this match()!");
-		return result;	
-    }
-
-    FaceMatch(new_faceprints, existing_faceprints_array, result, thresholds);
-    result.should_update = (result.maxScore >= thresholds.updateThreshold_NM) && result.isSame;
-   
-    bool enable_update = true;
-
-    // if should_update then we create an update vector such that:
-    // (1) the current vector is blended into the latest avg vector.
-    // (2) then we make sure that the updated avg vector is not too far from the orig. 
-    if (result.should_update && enable_update)
-    {      
-        // Init updated_faceprints to the faceprints already exists in the DB
-        //  
-        size_t user_index = (size_t)result.userId;
-
-        if((user_index < 0) || (user_index >= existing_faceprints_array.size()))
+        int32_t corr = MatcherKernels::ComputeCorr(queryFea, gallery.AdaptiveVector(subjectIndex), vec_length);
+        auto& norm = gallery.Norm(subjectIndex);
+        if (heap.size() == k && !GradeMayExceed(corr, query_norm, norm.norm, heap.front().score))
         {
-            LOG_ERROR(LOG_TAG, "Invalid user_index : Skipping function.");
-            return result;
+            continue;
         }
+        match_calc_t score = NccGrade(corr, query_norm, query_norm_msb, norm.norm, norm.norm_msb);
 
-        updated_faceprints = existing_faceprints_array[user_index].faceprints;
+        TopKMatch candidate;
+        candidate.userId = static_cast<int>(subjectIndex);
+        candidate.score = score;
 
-        const uint32_t vec_length = RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER;
+        if (heap.size() < k)
+        {
+            heap.push_back(candidate);
+            std::push_heap(heap.begin(), heap.end(), weaker_first);
+        }
+        else if (score > heap.front().score)
+        {
+            std::pop_heap(heap.begin(), heap.end(), weaker_first);
+            over_threshold -= heap.back().score > identical ? 1 : 0;
+            heap.back() = candidate;
+            std::push_heap(heap.begin(), heap.end(), weaker_first);
+        }
+        else
+        {
+            continue;
+        }
+        over_threshold += score > identical ? 1 : 0;
 
-        // TODO yossidan - handle with/without mask vectors properly (if/as needed).
+        if (early_exit && over_threshold == k)
+        {
+            break;
+        }
+    }
 
-        // update avg vector with the new vector
-        BlendAverageVector(&updated_faceprints.adaptiveDescriptorWithoutMask[0], &new_faceprints.adaptiveDescriptorWithoutMask[0],
-                                vec_length);
+    std::sort_heap(heap.begin(), heap.end(), weaker_first);
 
-        // make sure avg vector is not too far from enrollment vector
-        UpdateAverageVector(&updated_faceprints.adaptiveDescriptorWithoutMask[0], &updated_faceprints.enrollmentDescriptor[0],
-                            thresholds, vec_length);
+    ExtendedMatchResult unused_result;
+    for (auto& match : heap)
+    {
+        match.confidence = CalculateConfidence(match.score, thresholds.strongThreshold_pNMgNM, unused_result);
     }
- 
-    return result;
+    results = std::move(heap);
+    return true;
 }
 
-bool Matcher::UpdateAverageVector(feature_t* updated_faceprints_vec, const feature_t* orig_faceprints_vec, 
-                                    const Thresholds& thresholds, const uint32_t vec_length)                             
+size_t Matcher::FindDuplicates(const MatcherGallery& gallery, match_calc_t threshold, size_t max_pairs,
+                               std::vector<DuplicatePair>& pairs, MatcherThreadPool* pool)
 {
-    
-    // TODO yossidan - handle with/without mask vectors properly (as needed).
+    RSID_TRACE_SPAN("matcher", "FindDuplicates");
+    pairs.clear();
+    const size_t n = gallery.Size();
+    if (n < 2)
+    {
+        return 0;
+    }
 
-    if((nullptr == orig_faceprints_vec) || (nullptr == updated_faceprints_vec))
+    // a task scores a block of rows against all the later gallery entries, a column block at a time: the column
+    // block stays in the L2 cache while all the row batches of the block are scored against it, and each column
+    // row is loaded once per batch of MaxBatchProbes rows.
+    constexpr size_t RowBlock = 64;
+    constexpr size_t ColumnBlock = 512;
+    constexpr size_t MaxBatch = MatcherKernels::MaxBatchProbes;
+    const uint32_t vec_length = RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER;
+    const size_t n_tasks = (n + RowBlock - 1) / RowBlock;
+    std::vector<std::vector<DuplicatePair>> task_pairs(n_tasks);
+    std::vector<size_t> task_found(n_tasks, 0);
+
+    // higher score first, ties by index so the kept pairs do not depend on the task split
+    auto better = [](const DuplicatePair& a, const DuplicatePair& b) {
+        if (a.score != b.score)
+            return a.score > b.score;
+        return a.first != b.first ? a.first < b.first : a.second < b.second;
+    };
+
+    auto score_rows = [&](size_t task) {
+        const size_t row_begin = task * RowBlock;
+        const size_t row_end = std::min(row_begin + RowBlock, n);
+        // the max_pairs best pairs of the task, as a heap with the worst on top
+        auto& found = task_pairs[task];
+        for (size_t column_begin = row_begin + 1; column_begin < n; column_begin += ColumnBlock)
+        {
+            const size_t column_end = std::min(column_begin + ColumnBlock, n);
+            for (size_t batch_begin = row_begin; batch_begin < row_end; batch_begin += MaxBatch)
+            {
+                const uint32_t n_rows = static_cast<uint32_t>(std::min(batch_begin + MaxBatch, row_end) - batch_begin);
+                const feature_t* rows[MaxBatch];
+                const GalleryEntryNorm* row_norms[MaxBatch];
+                for (uint32_t r = 0; r < n_rows; r++)
+                {
+                    rows[r] = gallery.AdaptiveVector(batch_begin + r);
+                    row_norms[r] = &gallery.Norm(batch_begin + r);
+                }
+
+                // the pairs of the upper triangle only (column after row)
+                int32_t corr[MaxBatch];
+                for (size_t column = std::max(column_begin, batch_begin + 1); column < column_end; column++)
+                {
+                    MatcherKernels::ComputeCorrBatch(rows, n_rows, gallery.AdaptiveVector(column), vec_length, corr);
+                    const auto& column_norm = gallery.Norm(column);
+                    for (uint32_t r = 0; r < n_rows && batch_begin + r < column; r++)
+                    {
+                        if (!GradeMayExceed(corr[r], row_norms[r]->norm, column_norm.norm, threshold))
+                        {
+                            continue;
+                        }
+                        match_calc_t score = NccGrade(corr[r], row_norms[r]->norm, row_norms[r]->norm_msb,
+                                                      column_norm.norm, column_norm.norm_msb);
+                        if (score <= threshold)
+                        {
+                            continue;
+                        }
+                        task_found[task]++;
+                        DuplicatePair pair {static_cast<int>(batch_begin + r), static_cast<int>(column), score};
+                        if (found.size() < max_pairs)
+                        {
+                            found.push_back(pair);
+                            std::push_heap(found.begin(), found.end(), better);
+                        }
+                        else if (!found.empty() && better(pair, found.front()))
+                        {
+                            std::pop_heap(found.begin(), found.end(), better);
+                            found.back() = pair;
+                            std::push_heap(found.begin(), found.end(), better);
+                        }
+                    }
+                }
+            }
+        }
+    };
+
+    if (pool == nullptr || pool->NumberOfThreads() < 2)
     {
-        LOG_ERROR(LOG_TAG, "Null pointer detected : Skipping function.");
-        return false;
+        for (size_t task = 0; task < n_tasks; task++)
+        {
+            score_rows(task);
+        }
     }
-    // Explain - as long as the avg vector is "too far" from the orig vector, we
-    // want to update the avg vector with more samples of the orig vector.
-    // hence refreshing the avg to be more similar to the orig vector.
-   
-    match_calc_t match_score = 0;
-    MatchTwoVectors(updated_faceprints_vec, orig_faceprints_vec, &match_score, vec_length);
+    else
+    {
+        pool->Run(n_tasks, score_rows);
+    }
+
+    size_t number_of_pairs = 0;
+    for (size_t task = 0; task < n_tasks; task++)
+    {
+        number_of_pairs += task_found[task];
+        pairs.insert(pairs.end(), task_pairs[task].begin(), task_pairs[task].end());
+    }
+    const size_t kept = std::min(max_pairs, pairs.size());
+    std::partial_sort(pairs.begin(), pairs.begin() + kept, pairs.end(), better);
+    pairs.resize(kept);
+    return number_of_pairs;
+}
+
+// the refresh loop of UpdateAverageVector(): as long as the avg vector is "too far" from the orig vector, we
+// want to update the avg vector with more samples of the orig vector. hence refreshing the avg to be more similar
+// to the orig vector.
+// score() returns the current score, blend_and_score() blends once more and returns the new score.
+template <typename ScoreFn, typename BlendAndScoreFn>
+static void RefreshAverageVector(ScoreFn score, BlendAndScoreFn blend_and_score, const Thresholds& thresholds)
+{
+    match_calc_t match_score = score();
 
     // adding limit on number of iterations, e.g. if one vector is all zeros we'll get 
     // deadlock here.
@@ -361,9 +1752,7 @@ bool Matcher::UpdateAverageVector(feature_t* updated_faceprints_vec, const featu
         LOG_DEBUG(LOG_TAG, "----> Avg vector is far from orig vector. Doing update while() loop : count = %d. score = %d.", 
             cnt_iter, match_score);
 
-        BlendAverageVector(updated_faceprints_vec, orig_faceprints_vec, vec_length);
-
-        MatchTwoVectors(updated_faceprints_vec, orig_faceprints_vec, &match_score, vec_length);
+        match_score = blend_and_score();
 
         cnt_iter++;
         if(cnt_iter > 10)
@@ -374,26 +1763,67 @@ bool Matcher::UpdateAverageVector(feature_t* updated_faceprints_vec, const featu
             break;
         }
     }
+}
 
-    return true;
+template <uint32_t N>
+void Matcher::UpdateAverageVectorN(feature_t* updated_faceprints_vec, const feature_t* orig_faceprints_vec,
+                                   const Thresholds& thresholds)
+{
+    // the orig vector does not change: its norm is computed once. each iteration then blends and sums the ncc terms
+    // of the new avg vector in a single pass over the two vectors.
+    uint32_t orig_norm = 1;
+    short orig_norm_msb = 1;
+    GetVectorNorm(orig_faceprints_vec, orig_norm, orig_norm_msb, N);
+
+    auto blend_and_score = [=] {
+        MatcherKernels::NccSums sums;
+        MatcherKernels::BlendVectorsNccSums(updated_faceprints_vec, orig_faceprints_vec, N,
+                                            RSID_UPDATE_GALLERY_HISTORY_WEIGHT, sums);
+        // protect division by 0.
+        uint32_t norm = (sums.norm1 == 0) ? 1 : sums.norm1;
+        return NccGrade(sums.corr, norm, GetMsb(norm), orig_norm, orig_norm_msb);
+    };
+    RefreshAverageVector([=] { return MatchTwoVectorsN<N>(updated_faceprints_vec, orig_faceprints_vec); },
+                         blend_and_score, thresholds);
 }
 
-static void ConvertFaceprintsToExtendedFaceprints(const Faceprints& faceprints, ExtendedFaceprints& extended_faceprints)
+bool Matcher::UpdateAverageVector(feature_t* updated_faceprints_vec, const feature_t* orig_faceprints_vec, 
+                                    const Thresholds& thresholds, const uint32_t vec_length)                             
 {
-    extended_faceprints.faceprints.version = faceprints.version;
     
-    static_assert(sizeof(extended_faceprints.faceprints.adaptiveDescriptorWithoutMask) == sizeof(faceprints.adaptiveDescriptorWithoutMask), "updated faceprints (with mask) sizes don't match");
-    ::memcpy(&extended_faceprints.faceprints.adaptiveDescriptorWithoutMask[0], &faceprints.adaptiveDescriptorWithoutMask[0], sizeof(faceprints.adaptiveDescriptorWithoutMask));
+    // TODO yossidan - handle with/without mask vectors properly (as needed).
+
+    if((nullptr == orig_faceprints_vec) || (nullptr == updated_faceprints_vec))
+    {
+        LOG_ERROR(LOG_TAG, "Null pointer detected : Skipping function.");
+        return false;
+    }
 
-    static_assert(sizeof(extended_faceprints.faceprints.adaptiveDescriptorWithMask) == sizeof(faceprints.adaptiveDescriptorWithMask), "updated faceprints (without) sizes don't match");
-    ::memcpy(&extended_faceprints.faceprints.adaptiveDescriptorWithMask[0], &faceprints.adaptiveDescriptorWithMask[0], sizeof(faceprints.adaptiveDescriptorWithMask));
+    if (vec_length == RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER)
+    {
+        UpdateAverageVectorN<RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER>(updated_faceprints_vec,
+                                                                             orig_faceprints_vec, thresholds);
+        return true;
+    }
 
-    static_assert(sizeof(extended_faceprints.faceprints.enrollmentDescriptor) == sizeof(faceprints.enrollmentDescriptor), "enrollment faceprints sizes don't match");
-    ::memcpy(&extended_faceprints.faceprints.enrollmentDescriptor[0], &faceprints.enrollmentDescriptor[0], sizeof(faceprints.enrollmentDescriptor));
+    auto score = [=] {
+        match_calc_t match_score = 0;
+        MatchTwoVectors(updated_faceprints_vec, orig_faceprints_vec, &match_score, vec_length);
+        return match_score;
+    };
+    auto blend_and_score = [=] {
+        BlendAverageVector(updated_faceprints_vec, orig_faceprints_vec, vec_length);
+        return score();
+    };
+    RefreshAverageVector(score, blend_and_score, thresholds);
+    return true;
 }
 
 MatchResultInternal Matcher::MatchFaceprints(const Faceprints& new_faceprints, const Faceprints& existing_faceprints, Faceprints& updated_faceprints)
 {
+    RSID_TRACE_SPAN("matcher", "MatchFaceprints");
+    MetricsRegistry::ScopedMatcherSearch search;
+    search.SetCandidates(1);
     // init match result
     MatchResultInternal matchResult;
     matchResult.success = false;
@@ -413,13 +1843,39 @@ MatchResultInternal Matcher::MatchFaceprints(const Faceprints& new_faceprints, c
 		return matchResult;	
 	}
 
-    // init existing faceprints array
-    ExtendedFaceprints existing_extended_faceprints;
-    ConvertFaceprintsToExtendedFaceprints(existing_faceprints, existing_extended_faceprints);
-    std::vector<ExtendedFaceprints> existing_faceprints_array = {existing_extended_faceprints};
+    if (!IsSameVersion(new_faceprints, existing_faceprints))
+    {
+        return matchResult;
+    }
+
+    // the pair is matched in place: the same score, result and update as MatchFaceprintsToArray() with a single
+    // entry array, without building the array.
+    Thresholds thresholds;
+    SetToDefaultThresholds(thresholds);
+    TagResult scoresResult;
+    scoresResult.score = s_minPossibleScore;
+    MatchTwoVectors(&new_faceprints.adaptiveDescriptorWithoutMask[0],
+                    &existing_faceprints.adaptiveDescriptorWithoutMask[0], &scoresResult.score,
+                    RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER);
+    // as in the array scan, a score that is not over the minimum selects no user
+    scoresResult.id = scoresResult.score > s_minPossibleScore ? 0 : -1;
 
-    // match using shared code
-    ExtendedMatchResult result = MatchFaceprintsToArray(new_faceprints, existing_faceprints_array, updated_faceprints);
+    ExtendedMatchResult result;
+    FillMatchResult(scoresResult, thresholds, result);
+    result.should_update = (result.maxScore >= thresholds.updateThreshold_NM) && result.isSame && result.userId == 0;
+    if (result.should_update)
+    {
+        if (&updated_faceprints == &new_faceprints)
+        {
+            // the update overwrites the probe before blending it: blend from a copy
+            const Faceprints probe = new_faceprints;
+            BuildAdaptiveUpdate(probe, existing_faceprints, thresholds, updated_faceprints);
+        }
+        else
+        {
+            BuildAdaptiveUpdate(new_faceprints, existing_faceprints, thresholds, updated_faceprints);
+        }
+    }
 
     LOG_DEBUG(LOG_TAG, "Match score: %f, confidence: %f, isSame: %d, shouldUpdate: %d", float(result.maxScore), float(result.confidence), 
                 result.isSame, result.should_update);
@@ -444,8 +1900,28 @@ Thresholds Matcher::GetDefaultThresholds()
 // NOTE - Here below we have functions with fixed point calculations.
 // These are suitable for fixed-point arithmetic (and feature vectors are integer-valued respectively).
 //
+template <uint32_t N>
+bool Matcher::ValidateVectorN(const feature_t* vec)
+{
+    // no early exit: the min / max coordinates are reduced without branches (vectorized), then checked once.
+    feature_t min_feature = 0;
+    feature_t max_feature = 0;
+    for (uint32_t i = 0; i < N; i++)
+    {
+        min_feature = std::min(min_feature, vec[i]);
+        max_feature = std::max(max_feature, vec[i]);
+    }
+
+    return max_feature <= s_maxFeatureValue && min_feature >= -s_maxFeatureValue;
+}
+
 bool Matcher::ValidateVector(const feature_t* vec, const uint32_t vec_length)
 {
+    if (vec_length == RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER)
+    {
+        return ValidateVectorN<RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER>(vec);
+    }
+
     for (uint32_t i = 0; i < vec_length; i++)
     {
         feature_t curr_feature = (feature_t)vec[i];
@@ -459,6 +1935,13 @@ bool Matcher::ValidateVector(const feature_t* vec, const uint32_t vec_length)
     return true;
 }
 
+template <uint32_t N>
+void Matcher::BlendAverageVectorN(feature_t* user_average_faceprints, const feature_t* user_new_faceprints)
+{
+    // simd kernel, identical to the scalar formula below (see MatcherKernels.cc)
+    MatcherKernels::BlendVectors(user_average_faceprints, user_new_faceprints, N, RSID_UPDATE_GALLERY_HISTORY_WEIGHT);
+}
+
 void Matcher::BlendAverageVector(feature_t* user_average_faceprints, const feature_t* user_new_faceprints,
                                         const uint32_t vec_length)
 {
@@ -480,25 +1963,19 @@ void Matcher::BlendAverageVector(feature_t* user_average_faceprints, const featu
         return; 
     }
 
-    int history_weight = RSID_UPDATE_GALLERY_HISTORY_WEIGHT;
-    int round_value = (history_weight + 1);
-    for (uint32_t i = 0; i < vec_length ; ++i)
+    if (vec_length == RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER)
     {
-        int32_t v = static_cast<int32_t>(user_average_faceprints[i]);
-        v *= 2 * history_weight;
-        v += 2 * (int)(user_new_faceprints[i]);
-        v = (v >= 0) ? (v + round_value) : (v - round_value);
-        v /= (2 * round_value);
-
-        short feature_value = static_cast<short>(v);
-        feature_value = (feature_value > s_maxFeatureValue) ? s_maxFeatureValue : feature_value;
-        feature_value = (feature_value < -s_maxFeatureValue) ? -s_maxFeatureValue : feature_value;
-
-        user_average_faceprints[i] = static_cast<short>(v);
+        BlendAverageVectorN<RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER>(user_average_faceprints,
+                                                                            user_new_faceprints);
+        return;
     }
+
+    MatcherKernels::BlendVectors(user_average_faceprints, user_new_faceprints, vec_length,
+                                 RSID_UPDATE_GALLERY_HISTORY_WEIGHT);
 }
 
-match_calc_t Matcher::CalculateConfidence(match_calc_t score, match_calc_t threshold, ExtendedMatchResult& result)
+// the two piece linear confidence curve, tabulated by CalculateConfidence().
+static match_calc_t ConfidenceCurve(match_calc_t score)
 {
     int32_t confidence = 0;
     int32_t min_confidence = 0;
@@ -551,6 +2028,27 @@ match_calc_t Matcher::CalculateConfidence(match_calc_t score, match_calc_t thres
     return static_cast<match_calc_t>(confidence);
 }
 
+match_calc_t Matcher::CalculateConfidence(match_calc_t score, match_calc_t threshold, ExtendedMatchResult& result)
+{
+    // the confidence depends on the score only, so the curve is evaluated once for every score of the grade range
+    // [0, 4096] and looked up afterwards.
+    using ConfidenceTable = std::array<match_calc_t, RSID_MAX_POSSIBLE_SCORE - RSID_MIN_POSSIBLE_SCORE + 1>;
+    static const ConfidenceTable s_confidenceTable = [] {
+        ConfidenceTable table;
+        for (size_t i = 0; i < table.size(); i++)
+        {
+            table[i] = ConfidenceCurve(static_cast<match_calc_t>(RSID_MIN_POSSIBLE_SCORE + i));
+        }
+        return table;
+    }();
+
+    if (score < RSID_MIN_POSSIBLE_SCORE || score > RSID_MAX_POSSIBLE_SCORE)
+    {
+        return ConfidenceCurve(score);
+    }
+    return s_confidenceTable[score - RSID_MIN_POSSIBLE_SCORE];
+}
+
 short Matcher::GetMsb(const uint32_t ux)
 {
     // we find the msb index of a positive integer (index starts from 1).
@@ -575,6 +2073,23 @@ short Matcher::GetMsb(const uint32_t ux)
     return static_cast<short>(msb);
 }
 
+template <uint32_t N>
+match_calc_t Matcher::MatchTwoVectorsN(const feature_t* T1, const feature_t* T2)
+{
+    static_assert(N <= 256, "Vector length > 256 : Matcher may require carefull adjustments");
+
+    // corr/norm sums are computed by the best simd kernel available (see MatcherKernels.cc).
+    // the kernels are bit-exact with the original scalar loop.
+    MatcherKernels::NccSums sums;
+    MatcherKernels::ComputeNccSums(T1, T2, N, sums);
+
+    // protect division by 0.
+    uint32_t norm1 = (sums.norm1 == 0) ? 1 : sums.norm1;
+    uint32_t norm2 = (sums.norm2 == 0) ? 1 : sums.norm2;
+
+    return NccGrade(sums.corr, norm1, GetMsb(norm1), norm2, GetMsb(norm2));
+}
+
 void Matcher::MatchTwoVectors(const feature_t* T1, const feature_t* T2, match_calc_t* retprob, const uint32_t vec_length)
 {
     // Normalized cross-correlation (ncc) is calculate here with integer arithmetic only.
@@ -610,33 +2125,39 @@ void Matcher::MatchTwoVectors(const feature_t* T1, const feature_t* T2, match_ca
         return;
     }
 
-    uint32_t nfeatures = vec_length;
-    
-    int32_t corr = 0;
-    int32_t min_corr = 0;
-    uint32_t ucorr = 0;
-    uint32_t norm1 = 0;
-    uint32_t norm2 = 0;
-
-    for (uint32_t i = 0; i < nfeatures; ++i)
+    if (vec_length == RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER)
     {
-        int32_t t1 = static_cast<int32_t>(T1[i]);
-        int32_t t2 = static_cast<int32_t>(T2[i]);
-
-        corr += t1 * t2;
-        norm1 += t1 * t1;
-        norm2 += t2 * t2;
+        *retprob = MatchTwoVectorsN<RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER>(T1, T2);
+        return;
     }
 
+    MatcherKernels::NccSums sums;
+    MatcherKernels::ComputeNccSums(T1, T2, vec_length, sums);
+
+    // protect division by 0.
+    uint32_t norm1 = (sums.norm1 == 0) ? 1 : sums.norm1;
+    uint32_t norm2 = (sums.norm2 == 0) ? 1 : sums.norm2;
+
+    *retprob = NccGrade(sums.corr, norm1, GetMsb(norm1), norm2, GetMsb(norm2));
+}
+
+void Matcher::GetVectorNorm(const feature_t* vec, uint32_t& norm, short& norm_msb, const uint32_t vec_length)
+{
+    MatcherKernels::NccSums sums;
+    MatcherKernels::ComputeNccSums(vec, vec, vec_length, sums);
+
     // protect division by 0.
-    norm1 = (norm1 == 0) ? 1 : norm1;
-    norm2 = (norm2 == 0) ? 1 : norm2;
+    norm = (sums.norm1 == 0) ? 1 : sums.norm1;
+    norm_msb = GetMsb(norm);
+}
+
+match_calc_t Matcher::NccGrade(int32_t corr, uint32_t norm1, short norm1_msb, uint32_t norm2, short norm2_msb)
+{
+    int32_t min_corr = 0;
 
     // negative correlation will be considered as 0 correlation.
-    ucorr = static_cast<uint32_t>(std::max(corr, min_corr));
+    uint32_t ucorr = static_cast<uint32_t>(std::max(corr, min_corr));
 
-    short norm1_msb = GetMsb(norm1);
-    short norm2_msb = GetMsb(norm2);
     short corr_msb = GetMsb(ucorr);
     int32_t min_shift = 0;
 
@@ -664,11 +2185,7 @@ void Matcher::MatchTwoVectors(const feature_t* T1, const feature_t* T2, match_ca
         grade = (similarity << (-shift_back));
     }
 
-    // std::cout << "ncc result: -----> grade =  " << grade << std::endl;
-
-    // LOG_DEBUG(LOG_TAG, "ncc result: -----> grade = %u", grade);
-
-    *retprob = static_cast<match_calc_t>(grade);
+    return static_cast<match_calc_t>(grade);
 }
 
 } // namespace RealSenseID
@@ -4,7 +4,9 @@
 #pragma once
 #include "MatcherImplDefines.h"
 #include "RealSenseID/Faceprints.h"
+#include <chrono>
 #include <vector>
+#include <stddef.h>
 #include <stdint.h>
 
 namespace RealSenseID
@@ -13,6 +15,16 @@ using feature_t = short;
 using match_calc_t = short;
 
 class ExtendedFaceprints;
+class MatcherGallery;
+class MatcherThreadPool;
+class MatcherIvfIndex;
+class MatcherInt8Prefilter;
+class MatcherSignPrefilter;
+class MatcherPqIndex;
+struct GallerySnapshot;
+struct GalleryEntryNorm;
+template <size_t Capacity>
+class MatcherStaticGallery;
 
 struct ExtendedMatchResult
 {
@@ -40,6 +52,31 @@ struct TagResult
     match_calc_t similarityScore = 0;
 };
 
+// the dense rows of a gallery that the single probe search reads: size adaptive vectors of
+// RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER values, one after the other, and their cached norms
+struct GalleryRows
+{
+    const feature_t* adaptive_vectors = nullptr;
+    const GalleryEntryNorm* norms = nullptr;
+    size_t size = 0;
+    int version = 0;
+};
+
+struct TopKMatch
+{
+    int userId = -1; // index in the gallery
+    match_calc_t score = 0;
+    match_calc_t confidence = 0;
+};
+
+// pair of gallery entries found by Matcher::FindDuplicates()
+struct DuplicatePair
+{
+    int first = -1;  // index in the gallery
+    int second = -1; // index in the gallery, after first
+    match_calc_t score = 0;
+};
+
 struct Thresholds
 {   
     // naming convention here :
@@ -61,6 +98,35 @@ struct Thresholds
     match_calc_t updateThreshold_MFirst; // for opening first adaptive with-mask vector. 
 };
 
+// Gallery search options.
+// if pool is set (and has more than 1 thread), galleries of at least 2*min_shard_size entries are split to
+// shards scanned in parallel. Results are identical to the sequential scan (same early exit and tie-breaking).
+// if defer_update is set, only result.should_update is reported and updated_faceprints is left untouched, so the match
+// decision returns without the blend/update work. That work is then done by BuildAdaptiveUpdate(), e.g. in a
+// MatcherUpdateQueue, or in place by UpdateGalleryEntry().
+// if hints are set, the single probe search of a MatcherGallery scores the hinted entries (gallery indices, e.g. the
+// users matched last or the frequent users of a door) first, in order. The first one over strongThreshold_pNMgNM is
+// the result and the gallery is not scanned. Otherwise the whole gallery is scanned and the result is the plain one.
+// A hinted result is a match the plain search accepts as well; the two differ only when several users score over
+// the threshold, where the plain search returns the first in gallery order. Invalid indices are skipped. Batch and
+// snapshot searches ignore the hints.
+// if eligible is set, only the entries whose bit is set may match (bit i % 64 of word i / 64 for gallery index i, a
+// bitset covering the whole gallery), e.g. the users of the access groups a door admits. The scans skip the other
+// entries a word at a time, so a search costs the eligible entries only, and the result is the plain search of a
+// gallery holding only the eligible entries (with their indices). Applies to the single probe, batch, candidates and
+// snapshot searches (of a snapshot, the bitset covers the global indices).
+struct SearchConfig
+{
+    MatcherThreadPool* pool = nullptr;
+    size_t min_shard_size = 4096;
+    bool defer_update = false;
+    const size_t* hints = nullptr;
+    size_t number_of_hints = 0;
+    const uint64_t* eligible = nullptr;
+};
+
+// The gallery searches (the MatcherGallery, candidates, index and batch variants) score the probe's and the
+// gallery's without-mask adaptive descriptors only. MatchFaceprintsToArrayMaskAware() also scores the with-mask ones.
 class Matcher
 {
 public:
@@ -81,10 +147,173 @@ public:
                                                       const std::vector<ExtendedFaceprints>& existing_faceprints_array,
                                                       Faceprints& updated_faceprints, const Thresholds& thresholds);
 
-    
+    // match single vs. a gallery with cached norms. Same results as the std::vector overloads, but only the
+    // correlation is calculated per candidate.
+    // internal thresholds will be used.
+    static ExtendedMatchResult MatchFaceprintsToArray(const Faceprints& new_faceprints, const MatcherGallery& gallery,
+                                                      Faceprints& updated_faceprints);
+
+    // match single vs. a gallery with cached norms. thresholds provided by caller.
+    static ExtendedMatchResult MatchFaceprintsToArray(const Faceprints& new_faceprints, const MatcherGallery& gallery,
+                                                      Faceprints& updated_faceprints, const Thresholds& thresholds);
+
+    // match single vs. a gallery, possibly in parallel according to search_config.
+    static ExtendedMatchResult MatchFaceprintsToArray(const Faceprints& new_faceprints, const MatcherGallery& gallery,
+                                                      Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                      const SearchConfig& search_config);
+
+    // match single vs. a fixed capacity gallery (MatcherStaticGallery.h). Same results and search config as the
+    // MatcherGallery overload; without a pool in the search config, the search allocates no memory.
+    template <size_t Capacity>
+    static ExtendedMatchResult MatchFaceprintsToArray(const Faceprints& new_faceprints,
+                                                      const MatcherStaticGallery<Capacity>& gallery,
+                                                      Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                      const SearchConfig& search_config = SearchConfig {});
+
+    // match a batch of probes vs. a gallery in a single pass over the gallery (each gallery row is loaded once
+    // for up to 8 probes). results[i] and updated_faceprints[i] are identical to what
+    // MatchFaceprintsToArray(new_faceprints[i], gallery, updated_faceprints[i], thresholds) returns.
+    // returns false if any of the probes failed (its result is left with userId = -1).
+    static bool MatchFaceprintsToArrayBatch(const Faceprints* new_faceprints, size_t number_of_probes,
+                                            const MatcherGallery& gallery, ExtendedMatchResult* results,
+                                            Faceprints* updated_faceprints, const Thresholds& thresholds);
+
+    // match a batch of probes vs. a gallery, possibly in parallel according to search_config: each shard of the
+    // gallery is scanned for all the probes in a single pass. Same results as the sequential batch.
+    static bool MatchFaceprintsToArrayBatch(const Faceprints* new_faceprints, size_t number_of_probes,
+                                            const MatcherGallery& gallery, ExtendedMatchResult* results,
+                                            Faceprints* updated_faceprints, const Thresholds& thresholds,
+                                            const SearchConfig& search_config);
+
+    // approximate match single vs. a gallery using an ivf index built on it. only candidates from the
+    // n_probe_lists nearest index lists are scored (exactly, in gallery order with the usual early exit).
+    // probing all the index lists gives the same result as the exhaustive search.
+    static ExtendedMatchResult MatchFaceprintsToArray(const Faceprints& new_faceprints, const MatcherGallery& gallery,
+                                                      const MatcherIvfIndex& index, size_t n_probe_lists,
+                                                      Faceprints& updated_faceprints, const Thresholds& thresholds);
+
+    // two stage match single vs. a gallery: the int8 prefilter selects the entries whose approximate grade is within
+    // tolerance of the best approximate grade, and only these are scored exactly. The result is the same as the
+    // exhaustive search whenever the exact best match is within tolerance (grade units, [0,4096]) in the prefilter.
+    static ExtendedMatchResult MatchFaceprintsToArray(const Faceprints& new_faceprints, const MatcherGallery& gallery,
+                                                      const MatcherInt8Prefilter& prefilter, int tolerance,
+                                                      Faceprints& updated_faceprints, const Thresholds& thresholds);
+
+    // exact match single vs. a gallery: the prefilter bounds the correlation of every entry, and only the entries whose
+    // bound can still beat the best score so far (or strongThreshold_pNMgNM) are scored exactly. Same results as the
+    // exhaustive search.
+    static ExtendedMatchResult MatchFaceprintsToArray(const Faceprints& new_faceprints, const MatcherGallery& gallery,
+                                                      const MatcherInt8Prefilter& prefilter,
+                                                      Faceprints& updated_faceprints, const Thresholds& thresholds);
+
+    // two stage match single vs. a gallery: the sign prefilter shortlists the shortlist_size entries nearest to the
+    // probe signature, and only these are scored exactly. The result is the same as the exhaustive search whenever the
+    // exact best match is in the shortlist.
+    static ExtendedMatchResult MatchFaceprintsToArray(const Faceprints& new_faceprints, const MatcherGallery& gallery,
+                                                      const MatcherSignPrefilter& prefilter, size_t shortlist_size,
+                                                      Faceprints& updated_faceprints, const Thresholds& thresholds);
+
+    // two stage match single vs. a gallery: the pq index shortlists the shortlist_size entries with the highest
+    // approximate score, and only these are scored exactly (MatchTwoVectors()'s ncc, with the vectors read from the
+    // gallery, e.g. a gallery file mapped from disk). The result is the same as the exhaustive search whenever the
+    // exact best match is in the shortlist.
+    static ExtendedMatchResult MatchFaceprintsToArray(const Faceprints& new_faceprints, const MatcherGallery& gallery,
+                                                      const MatcherPqIndex& index, size_t shortlist_size,
+                                                      Faceprints& updated_faceprints, const Thresholds& thresholds);
+
+    // two stage match single vs. a gallery: only the candidates (gallery indices in ascending order, e.g. the shortlist
+    // of a GalleryAccelerator) are scored exactly. The result is the same as the exhaustive search whenever the exact
+    // best match is among them. search_config.defer_update and eligible apply (ineligible candidates are skipped), the
+    // rest of the search config does not.
+    static ExtendedMatchResult MatchFaceprintsToCandidates(const Faceprints& new_faceprints,
+                                                           const MatcherGallery& gallery,
+                                                           const std::vector<uint32_t>& candidates,
+                                                           Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                           const SearchConfig& search_config);
+
+    // deadline bounded (anytime) match single vs. a gallery, for a fixed latency budget on galleries too large to scan
+    // in it. The candidates are scored in priority order: the hints of the search config first (e.g. the sticky users
+    // of a door, or a tiered gallery's hot users), then by the ivf index, the lists nearest to the probe first (index
+    // may be nullptr: then in gallery order). The search stops at the first score over strongThreshold_pNMgNM, or at
+    // the deadline with the best result so far (the clock is read every few dozen candidates).
+    // complete is set if the deadline did not cut the search: then a result without a match has the exhaustive
+    // search's best score, and a match is one the plain search accepts as well (see SearchConfig::hints).
+    // search_config.defer_update and eligible apply, the pool does not.
+    static ExtendedMatchResult MatchFaceprintsToArrayAnytime(const Faceprints& new_faceprints,
+                                                             const MatcherGallery& gallery,
+                                                             const MatcherIvfIndex* index,
+                                                             std::chrono::steady_clock::time_point deadline,
+                                                             Faceprints& updated_faceprints,
+                                                             const Thresholds& thresholds,
+                                                             const SearchConfig& search_config, bool& complete);
+
+    // match single vs. a snapshot of a MatcherConcurrentGallery. Same results as a single gallery holding all the
+    // snapshot entries; result.userId is the global index in the snapshot.
+    static ExtendedMatchResult MatchFaceprintsToArray(const Faceprints& new_faceprints, const GallerySnapshot& snapshot,
+                                                      Faceprints& updated_faceprints, const Thresholds& thresholds);
+
+    static ExtendedMatchResult MatchFaceprintsToArray(const Faceprints& new_faceprints, const GallerySnapshot& snapshot,
+                                                      Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                      const SearchConfig& search_config);
+
+    // mask aware match single vs. a gallery.
+    // the probe mask flag (adaptiveDescriptorWithoutMask[HAS_MASK_INDEX_IN_FEATURS_VECTOR]) selects the threshold set:
+    // - probe without mask: probe vs. gallery without-mask descriptors (strongThreshold_pNMgNM), same as
+    //   MatchFaceprintsToArray().
+    // - probe with mask: probe vs. both gallery descriptors in one fused pass. The with-mask descriptor is
+    //   matched with strongThreshold_pMgM / identicalThreshold_M and the without-mask one with strongThreshold_pMgNM.
+    //   The best scoring pair wins. On update, the with-mask adaptive descriptor is blended (updateThreshold_M),
+    //   or opened from the probe if the user has none yet (updateThreshold_MFirst).
+    static ExtendedMatchResult MatchFaceprintsToArrayMaskAware(const Faceprints& new_faceprints,
+                                                               const MatcherGallery& gallery,
+                                                               Faceprints& updated_faceprints,
+                                                               const Thresholds& thresholds);
+
+    // find the k best matches of new_faceprints in the gallery (full scan, no first-over-threshold exit).
+    // results are sorted by descending score (ties by ascending gallery index), at most k entries (k is clamped to
+    // the gallery size). if early_exit is set, the scan stops once k candidates scored above identicalThreshold_NM,
+    // since any later candidate can only replace a match which is already "identical".
+    // returns false on invalid input.
+    static bool MatchFaceprintsTopK(const Faceprints& new_faceprints, const MatcherGallery& gallery, size_t k,
+                                    std::vector<TopKMatch>& results, const Thresholds& thresholds,
+                                    bool early_exit = false);
+
+    // the pairs of gallery entries scoring above threshold against each other (first as the probe), e.g. the
+    // same person enrolled twice. an all-pairs pass over the gallery, blocked for cache reuse and split to row
+    // blocks run on the pool (if any). pairs gets at most max_pairs of them, the highest scores first (ties by
+    // first, then second), so a gallery of look-alikes cannot grow it with the square of its size.
+    // returns the number of pairs found, which can be more than max_pairs.
+    static size_t FindDuplicates(const MatcherGallery& gallery, match_calc_t threshold, size_t max_pairs,
+                                 std::vector<DuplicatePair>& pairs, MatcherThreadPool* pool = nullptr);
+
+    // adaptive update of existing_faceprints with new_faceprints, as done by the matching functions when
+    // should_update is set: blend the new vector into the adaptive one and keep it close to the enrollment vector.
+    static void BuildAdaptiveUpdate(const Faceprints& new_faceprints, const Faceprints& existing_faceprints,
+                                    const Thresholds& thresholds, Faceprints& updated_faceprints);
+
+    // the same adaptive update of gallery entry index, applied in place to its adaptive vector (its norm is refreshed),
+    // without the Entry() copy out and Update() re-insert of the whole faceprints. returns false on invalid index.
+    static bool UpdateGalleryEntry(const Faceprints& new_faceprints, MatcherGallery& gallery, size_t index,
+                                   const Thresholds& thresholds);
+
+    // the same in place update of an entry of a fixed capacity gallery (MatcherStaticGallery.h)
+    template <size_t Capacity>
+    static bool UpdateGalleryEntry(const Faceprints& new_faceprints, MatcherStaticGallery<Capacity>& gallery,
+                                   size_t index, const Thresholds& thresholds);
+
+    // calculate the norm (sum of squares, 0 replaced by 1) of a vector and its msb, as used by the ncc calculation.
+    static void GetVectorNorm(const feature_t* vec, uint32_t& norm, short& norm_msb,
+                              const uint32_t vec_length = RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER);
+
     // checks the faceprints vector coordinates are in valid range [-1023,+1023]. 
     // if check_enrollment_vector=false it validates the adaptive faceprints, otherwise it validates the enrollment faceprints.
     static bool ValidateFaceprints(const Faceprints& faceprints, bool check_enrollment_vector=false);
+
+    // checks the vector coordinates are in valid range [-1023,+1023].
+    static bool ValidateVector(const feature_t* T1, const uint32_t vec_length = RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER);
+
+    // the internal thresholds, used by the overloads without a thresholds argument.
+    static Thresholds GetDefaultThresholds();
     
     
 private:
@@ -96,9 +325,25 @@ private:
 
     static bool UpdateAverageVector(feature_t* updated_faceprints_vec, const feature_t* orig_faceprints_vec,
                                     const Thresholds& thresholds, const uint32_t vec_length = RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER);
-                                    
 
-    static Thresholds GetDefaultThresholds();
+    // fixed length kernels of the functions above. N is a compile time constant and the pointers are not checked, so
+    // the loops are fully unrolled and vectorized. The runtime length functions check their arguments once and
+    // dispatch to N = RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER (other lengths keep the generic loops).
+    template <uint32_t N>
+    static bool ValidateVectorN(const feature_t* vec);
+
+    template <uint32_t N>
+    static void BlendAverageVectorN(feature_t* user_average_faceprints, const feature_t* user_new_faceprints);
+
+    template <uint32_t N>
+    static match_calc_t MatchTwoVectorsN(const feature_t* T1, const feature_t* T2);
+
+    template <uint32_t N>
+    static void UpdateAverageVectorN(feature_t* updated_faceprints_vec, const feature_t* orig_faceprints_vec,
+                                     const Thresholds& thresholds);
+
+    // fixed-point ncc grade from correlation and (non zero) norms with their msb values.
+    static match_calc_t NccGrade(int32_t corr, uint32_t norm1, short norm1_msb, uint32_t norm2, short norm2_msb);
 
     static short GetMsb(const uint32_t ux);
 
@@ -110,10 +355,35 @@ private:
                           const std::vector<ExtendedFaceprints>& existing_faceprints_array, TagResult& result,
                           match_calc_t threshold);
 
-    static match_calc_t CalculateConfidence(match_calc_t score, match_calc_t threshold, ExtendedMatchResult& result);
+    static void FaceMatch(const Faceprints& new_faceprints, const GalleryRows& rows, ExtendedMatchResult& result,
+                          const Thresholds& thresholds, const SearchConfig& search_config);
 
-    static bool ValidateVector(const feature_t* T1, const uint32_t vec_length = RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER);
+    static bool GetScores(const Faceprints& new_faceprints, const GalleryRows& rows, TagResult& result,
+                          match_calc_t threshold, const SearchConfig& search_config);
+
+    static bool GetScoresForCandidates(const Faceprints& new_faceprints, const MatcherGallery& gallery,
+                                       const std::vector<uint32_t>& candidates, TagResult& result,
+                                       match_calc_t threshold, const uint64_t* eligible = nullptr);
+
+    static bool GetScoresBounded(const Faceprints& new_faceprints, const MatcherGallery& gallery,
+                                 const MatcherInt8Prefilter& prefilter, TagResult& result, match_calc_t threshold);
+
+    static void FillMatchResult(const TagResult& scoresResult, const Thresholds& thresholds,
+                                ExtendedMatchResult& result);
+
+    static bool ValidateGalleryProbe(const Faceprints& new_faceprints, const MatcherGallery& gallery);
+    static bool ValidateGalleryProbe(const Faceprints& new_faceprints, size_t gallery_size, int gallery_version);
+
+    static void ApplyGalleryUpdate(const Faceprints& new_faceprints, const MatcherGallery& gallery,
+                                   const Thresholds& thresholds, ExtendedMatchResult& result,
+                                   Faceprints& updated_faceprints, bool build_update = true);
+
+    static match_calc_t CalculateConfidence(match_calc_t score, match_calc_t threshold, ExtendedMatchResult& result);
 
+    // micro benchmarks of the internal helpers (src/Matcher/bench)
+    friend class MatcherBench;
+    // scores with the production kernels (MatchTwoVectors(), NccGrade())
+    friend class MatcherEvaluation;
 };
 
 } // namespace RealSenseID
@@ -0,0 +1,212 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "MatcherConcurrentGallery.h"
+#include "Logger.h"
+#include <algorithm>
+#include <atomic>
+
+namespace RealSenseID
+{
+static const char* LOG_TAG = "MatcherConcurrentGallery";
+
+size_t GallerySnapshot::Size() const
+{
+    return size;
+}
+
+bool GallerySnapshot::Empty() const
+{
+    return size == 0;
+}
+
+int GallerySnapshot::FaceprintsVersion() const
+{
+    return segments.empty() ? 0 : segments.front()->FaceprintsVersion();
+}
+
+ExtendedFaceprints GallerySnapshot::Entry(size_t index) const
+{
+    size_t segment = 0, segment_index = 0;
+    Locate(index, segment, segment_index);
+    return segments[segment]->Entry(segment_index);
+}
+
+bool GallerySnapshot::Locate(size_t index, size_t& segment, size_t& segment_index) const
+{
+    if (index >= size)
+    {
+        return false;
+    }
+    // last segment starting at or before index
+    auto it = std::upper_bound(offsets.begin(), offsets.end(), index);
+    segment = static_cast<size_t>(it - offsets.begin()) - 1;
+    segment_index = index - offsets[segment];
+    return true;
+}
+
+void GallerySnapshot::UpdateOffsets()
+{
+    offsets.resize(segments.size());
+    size = 0;
+    for (size_t i = 0; i < segments.size(); i++)
+    {
+        offsets[i] = size;
+        size += segments[i]->Size();
+    }
+}
+
+MatcherConcurrentGallery::MatcherConcurrentGallery(size_t segment_size) :
+    _segment_size(std::max<size_t>(segment_size, 1)), _snapshot(std::make_shared<GallerySnapshot>())
+{
+}
+
+std::shared_ptr<const GallerySnapshot> MatcherConcurrentGallery::Snapshot() const
+{
+    return std::atomic_load(&_snapshot);
+}
+
+void MatcherConcurrentGallery::Publish(std::shared_ptr<const GallerySnapshot> snapshot)
+{
+    std::atomic_store(&_snapshot, std::move(snapshot));
+}
+
+void MatcherConcurrentGallery::Assign(const std::vector<ExtendedFaceprints>& entries)
+{
+    std::lock_guard<std::mutex> lock(_writer_mutex);
+
+    auto next = std::make_shared<GallerySnapshot>();
+    std::shared_ptr<MatcherGallery> segment;
+    size_t rejected = 0;
+    for (const auto& entry : entries)
+    {
+        if (!next->segments.empty() && next->segments.front()->FaceprintsVersion() != entry.faceprints.version)
+        {
+            rejected++;
+            continue;
+        }
+        if (!segment || segment->Size() >= _segment_size)
+        {
+            segment = std::make_shared<MatcherGallery>();
+            segment->Reserve(_segment_size);
+        }
+        if (!segment->Add(entry))
+        {
+            rejected++;
+            continue;
+        }
+        if (next->segments.empty() || next->segments.back() != segment)
+        {
+            next->segments.push_back(segment);
+        }
+    }
+    if (rejected > 0)
+    {
+        LOG_ERROR(LOG_TAG, "%zu invalid entries were not added to the gallery", rejected);
+    }
+    next->UpdateOffsets();
+    Publish(std::move(next));
+}
+
+bool MatcherConcurrentGallery::Add(const ExtendedFaceprints& entry)
+{
+    std::lock_guard<std::mutex> lock(_writer_mutex);
+
+    auto current = std::atomic_load(&_snapshot);
+    if (!current->Empty() && current->FaceprintsVersion() != entry.faceprints.version)
+    {
+        LOG_ERROR(LOG_TAG, "Mismatch in faceprints versions");
+        return false;
+    }
+
+    auto next = std::make_shared<GallerySnapshot>(*current);
+    std::shared_ptr<MatcherGallery> segment;
+    const bool append_to_last = !next->segments.empty() && next->segments.back()->Size() < _segment_size;
+    if (append_to_last)
+    {
+        segment = std::make_shared<MatcherGallery>(*next->segments.back());
+    }
+    else
+    {
+        segment = std::make_shared<MatcherGallery>();
+        segment->Reserve(_segment_size);
+    }
+    if (!segment->Add(entry))
+    {
+        return false;
+    }
+
+    if (append_to_last)
+    {
+        next->segments.back() = segment;
+    }
+    else
+    {
+        next->segments.push_back(segment);
+    }
+    next->UpdateOffsets();
+    Publish(std::move(next));
+    return true;
+}
+
+bool MatcherConcurrentGallery::Update(size_t index, const Faceprints& faceprints)
+{
+    std::lock_guard<std::mutex> lock(_writer_mutex);
+
+    auto current = std::atomic_load(&_snapshot);
+    size_t segment_number = 0, segment_index = 0;
+    if (!current->Locate(index, segment_number, segment_index))
+    {
+        return false;
+    }
+
+    auto segment = std::make_shared<MatcherGallery>(*current->segments[segment_number]);
+    if (!segment->Update(segment_index, faceprints))
+    {
+        return false;
+    }
+
+    auto next = std::make_shared<GallerySnapshot>(*current);
+    next->segments[segment_number] = segment;
+    Publish(std::move(next));
+    return true;
+}
+
+bool MatcherConcurrentGallery::Remove(size_t index)
+{
+    std::lock_guard<std::mutex> lock(_writer_mutex);
+
+    auto current = std::atomic_load(&_snapshot);
+    size_t segment_number = 0, segment_index = 0;
+    if (!current->Locate(index, segment_number, segment_index))
+    {
+        return false;
+    }
+
+    auto next = std::make_shared<GallerySnapshot>(*current);
+    if (current->segments[segment_number]->Size() == 1)
+    {
+        next->segments.erase(next->segments.begin() + segment_number);
+    }
+    else
+    {
+        auto segment = std::make_shared<MatcherGallery>(*current->segments[segment_number]);
+        segment->Remove(segment_index);
+        next->segments[segment_number] = segment;
+    }
+    next->UpdateOffsets();
+    Publish(std::move(next));
+    return true;
+}
+
+void MatcherConcurrentGallery::Clear()
+{
+    std::lock_guard<std::mutex> lock(_writer_mutex);
+    Publish(std::make_shared<GallerySnapshot>());
+}
+
+size_t MatcherConcurrentGallery::Size() const
+{
+    return Snapshot()->Size();
+}
+} // namespace RealSenseID
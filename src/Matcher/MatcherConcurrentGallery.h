@@ -0,0 +1,77 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "MatcherGallery.h"
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <stddef.h>
+
+namespace RealSenseID
+{
+// Immutable view of a MatcherConcurrentGallery: the gallery split to segments (each a MatcherGallery), in order.
+// Global index = offset of the segment + index in the segment. Search it with the GallerySnapshot overload of
+// Matcher::MatchFaceprintsToArray().
+struct GallerySnapshot
+{
+    std::vector<std::shared_ptr<const MatcherGallery>> segments;
+    std::vector<size_t> offsets; // global index of the first entry of each segment
+    size_t size = 0;
+
+    size_t Size() const;
+    bool Empty() const;
+
+    // faceprints version shared by all entries (valid only if not empty).
+    int FaceprintsVersion() const;
+
+    // entry at the given global index
+    ExtendedFaceprints Entry(size_t index) const;
+
+    // segment and index in the segment of the given global index. returns false on invalid index.
+    bool Locate(size_t index, size_t& segment, size_t& segment_index) const;
+
+    void UpdateOffsets();
+};
+
+// Gallery shared by concurrent readers (authentication threads) and writers (enroll / remove / adaptive updates),
+// with read-copy-update snapshots.
+//
+// Readers call Snapshot() and search the returned snapshot for as long as they like, without taking any gallery
+// lock: a snapshot is never modified. Writers are serialized; each write copies only the segment it changes
+// (at most segment_size entries), builds a new snapshot sharing all other segments and publishes it atomically.
+// Snapshots (and segments) still used by readers are freed when their last reader releases them.
+//
+// So a search never waits for a writer and a write costs O(segment_size), independent of the gallery size.
+// A reader sees either the gallery before or after a write, never a partial one.
+class MatcherConcurrentGallery
+{
+public:
+    explicit MatcherConcurrentGallery(size_t segment_size = 1024);
+
+    MatcherConcurrentGallery(const MatcherConcurrentGallery&) = delete;
+    MatcherConcurrentGallery& operator=(const MatcherConcurrentGallery&) = delete;
+
+    // current snapshot (never null)
+    std::shared_ptr<const GallerySnapshot> Snapshot() const;
+
+    // replace the gallery contents with all valid entries of the given array (invalid ones are logged and skipped).
+    void Assign(const std::vector<ExtendedFaceprints>& entries);
+
+    // same semantics as the MatcherGallery functions, with global indices.
+    bool Add(const ExtendedFaceprints& entry);
+    bool Update(size_t index, const Faceprints& faceprints);
+    bool Remove(size_t index);
+    void Clear();
+
+    size_t Size() const;
+
+private:
+    void Publish(std::shared_ptr<const GallerySnapshot> snapshot);
+
+    const size_t _segment_size;
+    std::mutex _writer_mutex;
+    std::shared_ptr<const GallerySnapshot> _snapshot; // accessed with std::atomic_load / std::atomic_store
+};
+} // namespace RealSenseID
@@ -0,0 +1,221 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "MatcherEvaluation.h"
+#include "MatcherGallery.h"
+#include "MatcherKernels.h"
+#include "MatcherThreadPool.h"
+#include "Tracer.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <string>
+#include <unordered_map>
+
+namespace RealSenseID
+{
+constexpr int ScoreDistribution::MaxScore;
+
+uint64_t ScoreDistribution::Genuine() const
+{
+    return std::accumulate(genuine.begin(), genuine.end(), uint64_t {0});
+}
+
+uint64_t ScoreDistribution::Impostor() const
+{
+    return std::accumulate(impostor.begin(), impostor.end(), uint64_t {0});
+}
+
+double ScoreDistribution::FalseAcceptRate(int threshold) const
+{
+    const uint64_t total = Impostor();
+    const size_t first_accepted = static_cast<size_t>(std::min(std::max(threshold + 1, 0), MaxScore + 1));
+    const uint64_t accepted = std::accumulate(impostor.begin() + first_accepted, impostor.end(), uint64_t {0});
+    return total > 0 ? static_cast<double>(accepted) / static_cast<double>(total) : 0.0;
+}
+
+double ScoreDistribution::FalseRejectRate(int threshold) const
+{
+    const uint64_t total = Genuine();
+    const size_t first_accepted = static_cast<size_t>(std::min(std::max(threshold + 1, 0), MaxScore + 1));
+    const uint64_t rejected = std::accumulate(genuine.begin(), genuine.begin() + first_accepted, uint64_t {0});
+    return total > 0 ? static_cast<double>(rejected) / static_cast<double>(total) : 0.0;
+}
+
+int ScoreDistribution::ThresholdForFalseAcceptRate(double far) const
+{
+    const uint64_t total = Impostor();
+    if (total == 0)
+    {
+        return 0;
+    }
+    // from the top: the accepted impostors grow as the threshold goes down
+    uint64_t accepted = 0;
+    int threshold = MaxScore;
+    for (int t = MaxScore - 1; t >= 0; t--)
+    {
+        accepted += impostor[t + 1];
+        if (static_cast<double>(accepted) / static_cast<double>(total) > far)
+        {
+            break;
+        }
+        threshold = t;
+    }
+    return threshold;
+}
+
+int ScoreDistribution::EqualErrorThreshold() const
+{
+    const double genuine_total = static_cast<double>(std::max<uint64_t>(Genuine(), 1));
+    const double impostor_total = static_cast<double>(std::max<uint64_t>(Impostor(), 1));
+    // at threshold t: rejected genuine pairs score <= t, accepted impostors score > t
+    uint64_t rejected = 0;
+    uint64_t accepted = Impostor();
+    int best_threshold = 0;
+    double best_gap = 2.0;
+    for (int t = 0; t <= MaxScore; t++)
+    {
+        rejected += genuine[t];
+        accepted -= impostor[t];
+        const double gap = std::fabs(static_cast<double>(accepted) / impostor_total -
+                                     static_cast<double>(rejected) / genuine_total);
+        if (gap < best_gap)
+        {
+            best_gap = gap;
+            best_threshold = t;
+        }
+    }
+    return best_threshold;
+}
+
+ScoreDistribution MatcherEvaluation::Evaluate(const MatcherGallery& probes, const MatcherGallery& references,
+                                              EvaluationPairs pairs, MatcherThreadPool* pool)
+{
+    RSID_TRACE_SPAN("matcher", "Evaluate");
+    const bool self = &probes == &references;
+    const bool mask_probes = pairs != EvaluationPairs::NoMask;
+    const bool mask_references = pairs == EvaluationPairs::MaskToMask;
+    // in a self evaluation with the without-mask references, (i, j) and (j, i) are the same pair if both are probes
+    const bool symmetric = self && !mask_references;
+
+    // the labels as numbers
+    std::unordered_map<std::string, int> label_ids;
+    auto label_of = [&label_ids](const char* user_id) {
+        return label_ids.emplace(user_id, static_cast<int>(label_ids.size())).first->second;
+    };
+    std::vector<size_t> probe_rows;
+    std::vector<int> probe_labels;
+    for (size_t i = 0; i < probes.Size(); i++)
+    {
+        if (probes.HasMask(i) == mask_probes)
+        {
+            probe_rows.push_back(i);
+            probe_labels.push_back(label_of(probes.UserId(i)));
+        }
+    }
+    std::vector<size_t> reference_rows;
+    std::vector<int> reference_labels;
+    for (size_t j = 0; j < references.Size(); j++)
+    {
+        if (!mask_references || references.HasMaskDescriptor(j))
+        {
+            reference_rows.push_back(j);
+            reference_labels.push_back(label_of(references.UserId(j)));
+        }
+    }
+
+    // as in Matcher::FindDuplicates(): row blocks of probes against column blocks of references that stay in the L2
+    // cache, MaxBatchProbes probes per reference load. the tasks take interleaved row blocks, so a symmetric (half)
+    // evaluation is balanced too.
+    constexpr size_t RowBlock = 64;
+    constexpr size_t ColumnBlock = 512;
+    constexpr size_t MaxBatch = MatcherKernels::MaxBatchProbes;
+    const uint32_t vec_length = RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER;
+    const size_t n_row_blocks = (probe_rows.size() + RowBlock - 1) / RowBlock;
+    size_t n_tasks = 1;
+    if (pool != nullptr && pool->NumberOfThreads() > 1)
+    {
+        n_tasks = std::max<size_t>(std::min(n_row_blocks, pool->NumberOfThreads() * 4), 1);
+    }
+    std::vector<ScoreDistribution> task_scores(n_tasks);
+
+    auto score_rows = [&](size_t task) {
+        ScoreDistribution& scores = task_scores[task];
+        for (size_t block = task; block < n_row_blocks; block += n_tasks)
+        {
+            const size_t row_begin = block * RowBlock;
+            const size_t row_end = std::min(row_begin + RowBlock, probe_rows.size());
+            for (size_t column_begin = 0; column_begin < reference_rows.size(); column_begin += ColumnBlock)
+            {
+                const size_t column_end = std::min(column_begin + ColumnBlock, reference_rows.size());
+                for (size_t batch_begin = row_begin; batch_begin < row_end; batch_begin += MaxBatch)
+                {
+                    const uint32_t n_rows =
+                        static_cast<uint32_t>(std::min(batch_begin + MaxBatch, row_end) - batch_begin);
+                    const feature_t* rows[MaxBatch];
+                    const GalleryEntryNorm* row_norms[MaxBatch];
+                    for (uint32_t r = 0; r < n_rows; r++)
+                    {
+                        rows[r] = probes.AdaptiveVector(probe_rows[batch_begin + r]);
+                        row_norms[r] = &probes.Norm(probe_rows[batch_begin + r]);
+                    }
+
+                    int32_t corr[MaxBatch];
+                    for (size_t column = column_begin; column < column_end; column++)
+                    {
+                        const size_t reference = reference_rows[column];
+                        const feature_t* reference_vector = mask_references ? references.AdaptiveMaskVector(reference)
+                                                                            : references.AdaptiveVector(reference);
+                        const GalleryEntryNorm& reference_norm =
+                            mask_references ? references.MaskNorm(reference) : references.Norm(reference);
+                        MatcherKernels::ComputeCorrBatch(rows, n_rows, reference_vector, vec_length, corr);
+                        for (uint32_t r = 0; r < n_rows; r++)
+                        {
+                            const size_t probe = probe_rows[batch_begin + r];
+                            // (reference, probe) was scored already if the reference is a probe too
+                            if (self && (reference == probe || (symmetric && reference < probe &&
+                                                                references.HasMask(reference) == mask_probes)))
+                            {
+                                continue;
+                            }
+                            const match_calc_t score =
+                                Matcher::NccGrade(corr[r], row_norms[r]->norm, row_norms[r]->norm_msb,
+                                                  reference_norm.norm, reference_norm.norm_msb);
+                            const size_t bin = static_cast<size_t>(std::min<int>(std::max<int>(score, 0),
+                                                                                 ScoreDistribution::MaxScore));
+                            if (probe_labels[batch_begin + r] == reference_labels[column])
+                            {
+                                scores.genuine[bin]++;
+                            }
+                            else
+                            {
+                                scores.impostor[bin]++;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    };
+
+    if (n_tasks == 1)
+    {
+        score_rows(0);
+    }
+    else
+    {
+        pool->Run(n_tasks, score_rows);
+    }
+
+    ScoreDistribution result;
+    for (const auto& scores : task_scores)
+    {
+        for (int s = 0; s <= ScoreDistribution::MaxScore; s++)
+        {
+            result.genuine[s] += scores.genuine[s];
+            result.impostor[s] += scores.impostor[s];
+        }
+    }
+    return result;
+}
+} // namespace RealSenseID
@@ -0,0 +1,63 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "Matcher.h"
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace RealSenseID
+{
+class MatcherGallery;
+class MatcherThreadPool;
+
+// the probe / reference descriptors of a threshold set
+enum class EvaluationPairs
+{
+    NoMask,       // probes without mask vs. the without-mask adaptive descriptors (strongThreshold_pNMgNM)
+    MaskToNoMask, // probes with mask vs. the without-mask adaptive descriptors (strongThreshold_pMgNM)
+    MaskToMask    // probes with mask vs. the with-mask adaptive descriptors (strongThreshold_pMgM)
+};
+
+// genuine / impostor score histograms, one bin per score in [0, MaxScore].
+// the rates are those of the matcher decision: a pair is accepted if its score is over the threshold.
+struct ScoreDistribution
+{
+    static constexpr int MaxScore = 4096;
+
+    std::vector<uint64_t> genuine = std::vector<uint64_t>(MaxScore + 1);
+    std::vector<uint64_t> impostor = std::vector<uint64_t>(MaxScore + 1);
+
+    uint64_t Genuine() const;
+    uint64_t Impostor() const;
+
+    // impostor pairs accepted / impostor pairs (0 if none)
+    double FalseAcceptRate(int threshold) const;
+    // genuine pairs rejected / genuine pairs (0 if none)
+    double FalseRejectRate(int threshold) const;
+
+    // the lowest threshold with a false accept rate of at most far (so the lowest false reject rate)
+    int ThresholdForFalseAcceptRate(double far) const;
+    // the threshold where the false accept and false reject rates are closest (the equal error rate)
+    int EqualErrorThreshold() const;
+};
+
+// Offline score evaluation of labeled faceprints, for tuning the matcher thresholds.
+//
+// Every probe is scored against every reference with the production kernels and cached norms of the gallery search,
+// so the scores are the fixed-point Matcher::MatchTwoVectors() ones, bit for bit. A pair is genuine if the two user
+// ids (the labels) are equal and impostor otherwise. The scoring is blocked like Matcher::FindDuplicates() and split
+// to tasks on the pool (if any), each with its own histograms.
+class MatcherEvaluation
+{
+public:
+    // score the probes against the references. the probe mask flag selects the probes of the pairs kind (the probe
+    // descriptor is its adaptive without-mask one, as in a match). if probes and references are the same gallery,
+    // an entry is not scored against itself and each unordered pair of probes is scored once (except MaskToMask,
+    // where the two directions use different descriptors).
+    static ScoreDistribution Evaluate(const MatcherGallery& probes, const MatcherGallery& references,
+                                      EvaluationPairs pairs, MatcherThreadPool* pool = nullptr);
+};
+} // namespace RealSenseID
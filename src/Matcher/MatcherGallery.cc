@@ -0,0 +1,639 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "MatcherGallery.h"
+#include "MatcherGalleryFile.h"
+#include "Matcher.h"
+#include "MatcherThreadPool.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+namespace RealSenseID
+{
+static const char* LOG_TAG = "MatcherGallery";
+
+static_assert((MatcherGallery::VectorLength * sizeof(feature_t)) % MatcherGallery::Alignment == 0,
+              "gallery rows must keep the matrix alignment");
+
+bool MatcherGallery::Create(const std::vector<ExtendedFaceprints>& entries, MatcherGallery& gallery,
+                            std::vector<size_t>* rejected_indices)
+{
+    gallery.Clear();
+    gallery.Reserve(entries.size());
+    size_t rejected = 0;
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (gallery.Add(entries[i]))
+        {
+            continue;
+        }
+        rejected++;
+        if (rejected_indices != nullptr)
+        {
+            rejected_indices->push_back(i);
+        }
+    }
+    if (rejected > 0)
+    {
+        LOG_ERROR(LOG_TAG, "%zu invalid entries were not added to the gallery", rejected);
+    }
+    return rejected == 0;
+}
+
+MatcherGallery::MatcherGallery(const MatcherGallery& other) :
+    _cold_entries(other._cold_entries), _adaptive_vectors(other._adaptive_vectors),
+    _adaptive_mask_vectors(other._adaptive_mask_vectors), _norms(other._norms), _mask_norms(other._mask_norms),
+    _has_mask_descriptor(other._has_mask_descriptor), _version(other._version), _has_mask(other._has_mask)
+{
+    if (other._file)
+    {
+        Attach(other._file);
+    }
+    else
+    {
+        // a copy is not placed
+        if (other._placed)
+        {
+            const size_t matrix_length = other._size * VectorLength;
+            _adaptive_vectors.assign(other._adaptive_vectors_view, other._adaptive_vectors_view + matrix_length);
+            _adaptive_mask_vectors.assign(other._adaptive_mask_vectors_view,
+                                          other._adaptive_mask_vectors_view + matrix_length);
+        }
+        RefreshView();
+    }
+}
+
+MatcherGallery::MatcherGallery(MatcherGallery&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+MatcherGallery& MatcherGallery::operator=(const MatcherGallery& other)
+{
+    if (this != &other)
+    {
+        MatcherGallery copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+MatcherGallery& MatcherGallery::operator=(MatcherGallery&& other) noexcept
+{
+    if (this != &other)
+    {
+        _cold_entries = std::move(other._cold_entries);
+        _adaptive_vectors = std::move(other._adaptive_vectors);
+        _adaptive_mask_vectors = std::move(other._adaptive_mask_vectors);
+        _norms = std::move(other._norms);
+        _mask_norms = std::move(other._mask_norms);
+        _has_mask_descriptor = std::move(other._has_mask_descriptor);
+        _has_mask = std::move(other._has_mask);
+        _version = other._version;
+        _file = std::move(other._file);
+        _placed = std::move(other._placed);
+        _size = other._size;
+        _cold_entries_view = other._cold_entries_view;
+        _adaptive_vectors_view = other._adaptive_vectors_view;
+        _adaptive_mask_vectors_view = other._adaptive_mask_vectors_view;
+        _norms_view = other._norms_view;
+        _mask_norms_view = other._mask_norms_view;
+        _has_mask_view = other._has_mask_view;
+        _has_mask_descriptor_view = other._has_mask_descriptor_view;
+        other.Clear();
+    }
+    return *this;
+}
+
+void MatcherGallery::Attach(std::shared_ptr<const MatcherGalleryFile> file)
+{
+    Clear();
+    if (!file)
+    {
+        return;
+    }
+    _file = std::move(file);
+    _version = _file->FaceprintsVersion();
+    _size = _file->Size();
+    _cold_entries_view = _file->ColdEntries();
+    _adaptive_vectors_view = _file->AdaptiveVectors();
+    _adaptive_mask_vectors_view = _file->AdaptiveMaskVectors();
+    _norms_view = _file->Norms();
+    _mask_norms_view = _file->MaskNorms();
+    _has_mask_view = _file->HasMask();
+    _has_mask_descriptor_view = _file->HasMaskDescriptor();
+}
+
+bool MatcherGallery::IsMapped() const
+{
+    return static_cast<bool>(_file);
+}
+
+void MatcherGallery::Detach()
+{
+    if (!_file && !_placed)
+    {
+        return;
+    }
+    const size_t n = _size;
+    // the matrices views are the file or the placed memory, the other views are the owned arrays unless mapped
+    _adaptive_vectors.assign(_adaptive_vectors_view, _adaptive_vectors_view + n * VectorLength);
+    _adaptive_mask_vectors.assign(_adaptive_mask_vectors_view, _adaptive_mask_vectors_view + n * VectorLength);
+    if (_file)
+    {
+        _cold_entries.assign(_cold_entries_view, _cold_entries_view + n);
+        _norms.assign(_norms_view, _norms_view + n);
+        _mask_norms.assign(_mask_norms_view, _mask_norms_view + n);
+        _has_mask.assign(_has_mask_view, _has_mask_view + n);
+        _has_mask_descriptor.assign(_has_mask_descriptor_view, _has_mask_descriptor_view + n);
+    }
+    _file.reset();
+    _placed.reset();
+    RefreshView();
+}
+
+void MatcherGallery::RefreshView()
+{
+    _size = _cold_entries.size();
+    _cold_entries_view = _cold_entries.data();
+    _adaptive_vectors_view = _adaptive_vectors.data();
+    _adaptive_mask_vectors_view = _adaptive_mask_vectors.data();
+    if (_placed)
+    {
+        _adaptive_vectors_view = static_cast<const feature_t*>(_placed->Data());
+        _adaptive_mask_vectors_view = _adaptive_vectors_view + _size * VectorLength;
+    }
+    _norms_view = _norms.data();
+    _mask_norms_view = _mask_norms.data();
+    _has_mask_view = _has_mask.data();
+    _has_mask_descriptor_view = _has_mask_descriptor.data();
+}
+
+void MatcherGallery::Reserve(size_t capacity)
+{
+    Detach();
+    _cold_entries.reserve(capacity);
+    _adaptive_vectors.reserve(capacity * VectorLength);
+    _adaptive_mask_vectors.reserve(capacity * VectorLength);
+    _norms.reserve(capacity);
+    _mask_norms.reserve(capacity);
+    _has_mask_descriptor.reserve(capacity);
+    _has_mask.reserve(capacity);
+    RefreshView();
+}
+
+void MatcherGallery::Place(MatcherThreadPool* pool, size_t min_shard_size, bool huge_pages)
+{
+    Detach();
+    if (_size == 0)
+    {
+        return;
+    }
+
+    const size_t matrix_length = _size * VectorLength;
+    std::unique_ptr<MatcherPlacedMemory> placed {
+        new MatcherPlacedMemory(2 * matrix_length * sizeof(feature_t), huge_pages)};
+    auto* vectors = static_cast<feature_t*>(placed->Data());
+    feature_t* mask_vectors = vectors + matrix_length;
+
+    // the shards of the parallel search
+    min_shard_size = std::max<size_t>(min_shard_size, 1);
+    size_t n_shards = 1;
+    if (pool != nullptr)
+    {
+        n_shards = std::max<size_t>(std::min(pool->NumberOfThreads(), _size / min_shard_size), 1);
+    }
+    const size_t shard_size = (_size + n_shards - 1) / n_shards;
+    auto place_shard = [&](size_t shard) {
+        const size_t begin = std::min(shard * shard_size, _size) * VectorLength;
+        const size_t end = std::min((shard + 1) * shard_size, _size) * VectorLength;
+        std::copy(_adaptive_vectors.begin() + begin, _adaptive_vectors.begin() + end, vectors + begin);
+        std::copy(_adaptive_mask_vectors.begin() + begin, _adaptive_mask_vectors.begin() + end, mask_vectors + begin);
+    };
+    if (n_shards == 1)
+    {
+        place_shard(0);
+    }
+    else
+    {
+        pool->Run(n_shards, place_shard);
+    }
+
+    aligned_features_t().swap(_adaptive_vectors);
+    aligned_features_t().swap(_adaptive_mask_vectors);
+    _placed = std::move(placed);
+    RefreshView();
+}
+
+bool MatcherGallery::IsPlaced() const
+{
+    return static_cast<bool>(_placed);
+}
+
+bool MatcherGallery::Add(const ExtendedFaceprints& entry)
+{
+    if (!IsValidEntry(entry.faceprints))
+    {
+        return false;
+    }
+    Detach();
+    if (_cold_entries.empty())
+    {
+        _version = entry.faceprints.version;
+    }
+    _cold_entries.emplace_back();
+    ::memcpy(_cold_entries.back().user_id, entry.user_id, sizeof(entry.user_id));
+    _adaptive_vectors.resize(_adaptive_vectors.size() + VectorLength);
+    _adaptive_mask_vectors.resize(_adaptive_mask_vectors.size() + VectorLength);
+    _norms.emplace_back();
+    _mask_norms.emplace_back();
+    _has_mask_descriptor.push_back(0);
+    _has_mask.push_back(0);
+    RefreshView();
+    StoreEntry(_cold_entries.size() - 1, entry.faceprints);
+    return true;
+}
+
+size_t MatcherGallery::AddBatch(const char* const* user_ids, const Faceprints* const* faceprints,
+                                size_t number_of_entries, MatcherThreadPool* pool)
+{
+    if (number_of_entries == 0 || user_ids == nullptr || faceprints == nullptr)
+    {
+        return 0;
+    }
+
+    // shards of at least MinShardSize entries, one per thread
+    constexpr size_t MinShardSize = 1024;
+    size_t n_shards = 1;
+    if (pool != nullptr)
+    {
+        n_shards = std::max<size_t>(std::min(pool->NumberOfThreads(), number_of_entries / MinShardSize), 1);
+    }
+    const size_t shard_size = (number_of_entries + n_shards - 1) / n_shards;
+    auto run_shards = [&](const std::function<void(size_t, size_t)>& task) {
+        auto run_shard = [&](size_t shard) {
+            size_t begin = shard * shard_size;
+            task(begin, std::min(begin + shard_size, number_of_entries));
+        };
+        if (n_shards == 1)
+        {
+            run_shard(0);
+        }
+        else
+        {
+            pool->Run(n_shards, run_shard);
+        }
+    };
+
+    // range check of the vectors (the expensive part of the validation)
+    std::vector<unsigned char> valid(number_of_entries);
+    run_shards([&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            const Faceprints* entry = faceprints[i];
+            valid[i] = user_ids[i] != nullptr && entry != nullptr && Matcher::ValidateFaceprints(*entry) &&
+                       Matcher::ValidateVector(&entry->adaptiveDescriptorWithMask[0]);
+        }
+    });
+
+    // version check and gallery index of each valid entry
+    int version = _size > 0 ? _version : 0;
+    bool has_version = _size > 0;
+    std::vector<size_t> indices(number_of_entries);
+    size_t next_index = _size;
+    for (size_t i = 0; i < number_of_entries; i++)
+    {
+        if (valid[i] && has_version && faceprints[i]->version != version)
+        {
+            valid[i] = 0;
+        }
+        if (!valid[i])
+        {
+            continue;
+        }
+        if (!has_version)
+        {
+            version = faceprints[i]->version;
+            has_version = true;
+        }
+        indices[i] = next_index++;
+    }
+    const size_t added = next_index - _size;
+    if (added < number_of_entries)
+    {
+        LOG_ERROR(LOG_TAG, "%zu invalid entries were not added to the gallery", number_of_entries - added);
+    }
+    if (added == 0)
+    {
+        return 0;
+    }
+
+    Detach();
+    _version = version;
+    _cold_entries.resize(next_index);
+    _adaptive_vectors.resize(next_index * VectorLength);
+    _adaptive_mask_vectors.resize(next_index * VectorLength);
+    _norms.resize(next_index);
+    _mask_norms.resize(next_index);
+    _has_mask_descriptor.resize(next_index);
+    _has_mask.resize(next_index);
+    RefreshView();
+
+    run_shards([&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            if (!valid[i])
+            {
+                continue;
+            }
+            char* user_id = _cold_entries[indices[i]].user_id;
+            ::strncpy(user_id, user_ids[i], sizeof(GalleryColdEntry::user_id) - 1);
+            user_id[sizeof(GalleryColdEntry::user_id) - 1] = '\0';
+            StoreEntry(indices[i], *faceprints[i]);
+        }
+    });
+    return added;
+}
+
+bool MatcherGallery::Update(size_t index, const Faceprints& faceprints)
+{
+    if (index >= _size || !IsValidEntry(faceprints))
+    {
+        return false;
+    }
+    // placed matrices are updated in place
+    if (!_placed)
+    {
+        Detach();
+    }
+    StoreEntry(index, faceprints);
+    return true;
+}
+
+feature_t* MatcherGallery::AdaptiveVectorForUpdate(size_t index)
+{
+    if (index >= _size)
+    {
+        return nullptr;
+    }
+    // placed matrices are updated in place
+    if (!_placed)
+    {
+        Detach();
+    }
+    feature_t* vectors = _placed ? static_cast<feature_t*>(_placed->Data()) : _adaptive_vectors.data();
+    return vectors + index * VectorLength;
+}
+
+void MatcherGallery::RefreshNorm(size_t index)
+{
+    auto& norm = _norms[index];
+    Matcher::GetVectorNorm(AdaptiveVector(index), norm.norm, norm.norm_msb);
+}
+
+bool MatcherGallery::Remove(size_t index)
+{
+    if (index >= _size)
+    {
+        return false;
+    }
+    Detach();
+    _cold_entries.erase(_cold_entries.begin() + index);
+    auto row = _adaptive_vectors.begin() + index * VectorLength;
+    _adaptive_vectors.erase(row, row + VectorLength);
+    auto mask_row = _adaptive_mask_vectors.begin() + index * VectorLength;
+    _adaptive_mask_vectors.erase(mask_row, mask_row + VectorLength);
+    _norms.erase(_norms.begin() + index);
+    _mask_norms.erase(_mask_norms.begin() + index);
+    _has_mask_descriptor.erase(_has_mask_descriptor.begin() + index);
+    _has_mask.erase(_has_mask.begin() + index);
+    RefreshView();
+    return true;
+}
+
+bool MatcherGallery::SwapRemove(size_t index)
+{
+    if (index >= _size)
+    {
+        return false;
+    }
+    Detach();
+    const size_t last = _size - 1;
+    if (index != last)
+    {
+        _cold_entries[index] = _cold_entries[last];
+        std::copy_n(_adaptive_vectors.begin() + last * VectorLength, VectorLength,
+                    _adaptive_vectors.begin() + index * VectorLength);
+        std::copy_n(_adaptive_mask_vectors.begin() + last * VectorLength, VectorLength,
+                    _adaptive_mask_vectors.begin() + index * VectorLength);
+        _norms[index] = _norms[last];
+        _mask_norms[index] = _mask_norms[last];
+        _has_mask_descriptor[index] = _has_mask_descriptor[last];
+        _has_mask[index] = _has_mask[last];
+    }
+    _cold_entries.pop_back();
+    _adaptive_vectors.resize(last * VectorLength);
+    _adaptive_mask_vectors.resize(last * VectorLength);
+    _norms.pop_back();
+    _mask_norms.pop_back();
+    _has_mask_descriptor.pop_back();
+    _has_mask.pop_back();
+    RefreshView();
+    return true;
+}
+
+void MatcherGallery::Clear()
+{
+    _cold_entries.clear();
+    _adaptive_vectors.clear();
+    _adaptive_mask_vectors.clear();
+    _norms.clear();
+    _mask_norms.clear();
+    _has_mask_descriptor.clear();
+    _has_mask.clear();
+    _file.reset();
+    _placed.reset();
+    RefreshView();
+}
+
+size_t MatcherGallery::Size() const
+{
+    return _size;
+}
+
+bool MatcherGallery::Empty() const
+{
+    return _size == 0;
+}
+
+// read one byte per cache line (volatile, so the loads are not optimized away)
+static void TouchCacheLines(const void* data, size_t size)
+{
+    constexpr size_t cache_line = 64;
+    auto* bytes = static_cast<const volatile unsigned char*>(data);
+    for (size_t offset = 0; offset < size; offset += cache_line)
+    {
+        (void)bytes[offset];
+    }
+}
+
+void MatcherGallery::Prefetch(size_t begin, size_t end) const
+{
+    end = std::min(end, _size);
+    if (begin >= end)
+    {
+        return;
+    }
+    const size_t count = end - begin;
+    const void* vectors = AdaptiveVector(begin);
+    const size_t vectors_size = count * VectorLength * sizeof(feature_t);
+    const void* norms = &_norms_view[begin];
+    const size_t norms_size = count * sizeof(GalleryEntryNorm);
+    if (_file)
+    {
+        _file->WillNeed(vectors, vectors_size);
+        _file->WillNeed(norms, norms_size);
+    }
+    TouchCacheLines(vectors, vectors_size);
+    TouchCacheLines(norms, norms_size);
+}
+
+const char* MatcherGallery::UserId(size_t index) const
+{
+    return _cold_entries_view[index].user_id;
+}
+
+ExtendedFaceprints MatcherGallery::Entry(size_t index) const
+{
+    ExtendedFaceprints entry;
+    FromColdEntry(_cold_entries_view[index], _version, AdaptiveVector(index), AdaptiveMaskVector(index), entry);
+    return entry;
+}
+
+void MatcherGallery::FromColdEntry(const GalleryColdEntry& cold_entry, int version, const feature_t* adaptive_vector,
+                                   const feature_t* adaptive_mask_vector, ExtendedFaceprints& entry)
+{
+    ::memcpy(entry.user_id, cold_entry.user_id, sizeof(entry.user_id));
+    auto& faceprints = entry.faceprints;
+    ::memcpy(faceprints.reserved, cold_entry.reserved, sizeof(faceprints.reserved));
+    faceprints.version = version;
+    faceprints.featuresType = cold_entry.features_type;
+    faceprints.flags = cold_entry.flags;
+    ::memcpy(faceprints.adaptiveDescriptorWithoutMask, adaptive_vector, VectorLength * sizeof(feature_t));
+    ::memcpy(&faceprints.adaptiveDescriptorWithoutMask[VectorLength], cold_entry.adaptive_tail,
+             sizeof(cold_entry.adaptive_tail));
+    ::memcpy(faceprints.adaptiveDescriptorWithMask, adaptive_mask_vector, VectorLength * sizeof(feature_t));
+    ::memcpy(&faceprints.adaptiveDescriptorWithMask[VectorLength], cold_entry.adaptive_mask_tail,
+             sizeof(cold_entry.adaptive_mask_tail));
+    ::memcpy(faceprints.enrollmentDescriptor, cold_entry.enrollment_descriptor,
+             sizeof(faceprints.enrollmentDescriptor));
+}
+
+GalleryRows MatcherGallery::Rows() const
+{
+    GalleryRows rows;
+    rows.adaptive_vectors = _adaptive_vectors_view;
+    rows.norms = _norms_view;
+    rows.size = _size;
+    rows.version = _version;
+    return rows;
+}
+
+const feature_t* MatcherGallery::AdaptiveVector(size_t index) const
+{
+    return &_adaptive_vectors_view[index * VectorLength];
+}
+
+const feature_t* MatcherGallery::EnrollmentVector(size_t index) const
+{
+    return &_cold_entries_view[index].enrollment_descriptor[0];
+}
+
+const GalleryEntryNorm& MatcherGallery::Norm(size_t index) const
+{
+    return _norms_view[index];
+}
+
+int MatcherGallery::FaceprintsVersion() const
+{
+    return _version;
+}
+
+bool MatcherGallery::HasMask(size_t index) const
+{
+    return _has_mask_view[index] != 0;
+}
+
+const feature_t* MatcherGallery::AdaptiveMaskVector(size_t index) const
+{
+    return &_adaptive_mask_vectors_view[index * VectorLength];
+}
+
+const GalleryEntryNorm& MatcherGallery::MaskNorm(size_t index) const
+{
+    return _mask_norms_view[index];
+}
+
+bool MatcherGallery::HasMaskDescriptor(size_t index) const
+{
+    return _has_mask_descriptor_view[index] != 0;
+}
+
+bool MatcherGallery::IsValidEntry(const Faceprints& faceprints) const
+{
+    if (!Matcher::ValidateFaceprints(faceprints) || !Matcher::ValidateVector(&faceprints.adaptiveDescriptorWithMask[0]))
+    {
+        LOG_ERROR(LOG_TAG, "Invalid faceprints vector range");
+        return false;
+    }
+
+    // all entries must share the same faceprints version
+    if (_size > 0 && faceprints.version != _version)
+    {
+        LOG_ERROR(LOG_TAG, "Mismatch in faceprints versions");
+        return false;
+    }
+    return true;
+}
+
+void MatcherGallery::ToColdEntry(const Faceprints& faceprints, GalleryColdEntry& cold_entry)
+{
+    ::memcpy(cold_entry.reserved, faceprints.reserved, sizeof(cold_entry.reserved));
+    cold_entry.features_type = faceprints.featuresType;
+    cold_entry.flags = faceprints.flags;
+    ::memcpy(cold_entry.enrollment_descriptor, faceprints.enrollmentDescriptor,
+             sizeof(cold_entry.enrollment_descriptor));
+    ::memcpy(cold_entry.adaptive_tail, &faceprints.adaptiveDescriptorWithoutMask[VectorLength],
+             sizeof(cold_entry.adaptive_tail));
+    ::memcpy(cold_entry.adaptive_mask_tail, &faceprints.adaptiveDescriptorWithMask[VectorLength],
+             sizeof(cold_entry.adaptive_mask_tail));
+}
+
+void MatcherGallery::StoreEntry(size_t index, const Faceprints& faceprints)
+{
+    ToColdEntry(faceprints, _cold_entries[index]);
+
+    feature_t* vectors = _placed ? static_cast<feature_t*>(_placed->Data()) : _adaptive_vectors.data();
+    feature_t* mask_vectors = _placed ? vectors + _size * VectorLength : _adaptive_mask_vectors.data();
+
+    feature_t* row = vectors + index * VectorLength;
+    ::memcpy(row, &faceprints.adaptiveDescriptorWithoutMask[0], VectorLength * sizeof(feature_t));
+
+    auto& norm = _norms[index];
+    Matcher::GetVectorNorm(row, norm.norm, norm.norm_msb);
+    _has_mask[index] = faceprints.adaptiveDescriptorWithoutMask[HAS_MASK_INDEX_IN_FEATURS_VECTOR] != 0 ? 1 : 0;
+
+    feature_t* mask_row = mask_vectors + index * VectorLength;
+    ::memcpy(mask_row, &faceprints.adaptiveDescriptorWithMask[0], VectorLength * sizeof(feature_t));
+    auto& mask_norm = _mask_norms[index];
+    Matcher::GetVectorNorm(mask_row, mask_norm.norm, mask_norm.norm_msb);
+    bool has_mask_descriptor = false;
+    for (size_t i = 0; i < VectorLength && !has_mask_descriptor; i++)
+    {
+        has_mask_descriptor = mask_row[i] != 0;
+    }
+    _has_mask_descriptor[index] = has_mask_descriptor ? 1 : 0;
+}
+} // namespace RealSenseID
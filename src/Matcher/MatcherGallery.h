@@ -0,0 +1,205 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "ExtendedFaceprints.h"
+#include "AlignedAllocator.h"
+#include "Matcher.h"
+#include "MatcherPlacedMemory.h"
+#include "MatcherImplDefines.h"
+#include <memory>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace RealSenseID
+{
+// Cached norm of a gallery vector (sum of squares, 0 replaced by 1) and its msb,
+// as used by the fixed-point ncc in Matcher.
+struct GalleryEntryNorm
+{
+    uint32_t norm = 1;
+    short norm_msb = 1;
+};
+
+// Cold data of a gallery entry: the ExtendedFaceprints fields that are not in the hot matrices, i.e. the user id,
+// the faceprints header, the enrollment vector and the values past VectorLength of the two adaptive descriptors
+// (mask flag etc.). ~600 bytes instead of a ~1.6KB ExtendedFaceprints copy per user.
+struct GalleryColdEntry
+{
+    static constexpr size_t TailLength = FEATURES_VECTOR_ALLOC_SIZE - RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER;
+
+    char user_id[sizeof(ExtendedFaceprints::user_id)];
+    int reserved[sizeof(Faceprints::reserved) / sizeof(int)];
+    FaceprintsTypeEnum features_type;
+    int flags;
+    feature_t enrollment_descriptor[FEATURES_VECTOR_ALLOC_SIZE];
+    feature_t adaptive_tail[TailLength];
+    feature_t adaptive_mask_tail[TailLength];
+};
+
+// Set of enrolled faceprints used for 1:N host matching.
+//
+// Layout is structure-of-arrays: the adaptive vectors scanned during a search are kept in dense,
+// 64-byte aligned matrices (RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER shorts per row, one matrix for the
+// without-mask and one for the with-mask descriptors), next to small side arrays of norms and mask flags.
+// The rest of the entry (user id, enrollment vector, etc.) is kept apart in an array of GalleryColdEntry, read only
+// for the matched user, so a scan touches 512 bytes per user instead of ~1.6KB. The adaptive vectors are not stored
+// twice: Entry() reassembles the full ExtendedFaceprints from both, which is only needed for updates and export.
+//
+// Entries are validated once, when they enter the gallery (vector range check and same faceprints version for all
+// entries). Invalid entries are rejected, so the search loops run only the ncc kernel.
+// Note that rejected entries are not stored, so gallery indices may differ from the indices of the source array;
+// use UserId(index) to identify a match.
+//
+// The cached norm is refreshed whenever an entry is added or updated.
+//
+// A gallery can also be attached to a memory mapped gallery file (see MatcherGalleryFile), in which case the
+// search reads the mapped arrays directly. The first modification copies the mapped data to memory.
+class MatcherGalleryFile;
+class MatcherThreadPool;
+
+class MatcherGallery
+{
+public:
+    static constexpr size_t VectorLength = RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER;
+    static constexpr size_t Alignment = 64;
+
+    MatcherGallery() = default;
+
+    // a gallery of all the valid entries of the given array. returns false if some entries failed validation: they
+    // are logged and skipped, and their indices are added to rejected_indices (if given).
+    static bool Create(const std::vector<ExtendedFaceprints>& entries, MatcherGallery& gallery,
+                       std::vector<size_t>* rejected_indices = nullptr);
+
+    MatcherGallery(const MatcherGallery& other);
+    MatcherGallery(MatcherGallery&& other) noexcept;
+    MatcherGallery& operator=(const MatcherGallery& other);
+    MatcherGallery& operator=(MatcherGallery&& other) noexcept;
+
+    // replace the gallery contents with the given mapped file (kept open as long as the gallery uses it).
+    void Attach(std::shared_ptr<const MatcherGalleryFile> file);
+
+    // true if the gallery reads an attached file
+    bool IsMapped() const;
+
+    void Reserve(size_t capacity);
+
+    // move the descriptor matrices to memory placed for the parallel search on the pool (see MatcherPlacedMemory):
+    // each shard of the search (MatchFaceprintsToArray sharding with this min_shard_size) is written by the pool
+    // thread that searches it, so a pool with pinned threads reads it from its own NUMA node. optionally backed by
+    // huge pages. updates are written in place. adding or removing entries (or a copy of the gallery) moves the
+    // matrices back to ordinary memory. a mapped file is copied to memory first.
+    void Place(MatcherThreadPool* pool, size_t min_shard_size, bool huge_pages);
+
+    // true if the descriptor matrices are in placed memory
+    bool IsPlaced() const;
+
+    // add entry to the gallery. returns false (and does not add) if the entry failed validation.
+    bool Add(const ExtendedFaceprints& entry);
+
+    // bulk add: the valid entries of faceprints[i] / user_ids[i] (null terminated, truncated to the user id size),
+    // in order. invalid entries (and ones of another faceprints version) are skipped. the entries are validated and
+    // stored by shards in parallel on the pool (if any), without an ExtendedFaceprints copy.
+    // returns the number of entries added.
+    size_t AddBatch(const char* const* user_ids, const Faceprints* const* faceprints, size_t number_of_entries,
+                    MatcherThreadPool* pool = nullptr);
+
+    // replace the faceprints at the given index (e.g. after adaptive update).
+    // returns false on invalid index or if the new faceprints failed validation.
+    bool Update(size_t index, const Faceprints& faceprints);
+
+    // in place adaptive update (see Matcher::UpdateGalleryEntry): the without-mask adaptive vector of the entry, to be
+    // written directly, and RefreshNorm(index) after. a mapped file is copied to memory first, placed matrices are
+    // written in place. returns nullptr on invalid index.
+    feature_t* AdaptiveVectorForUpdate(size_t index);
+    void RefreshNorm(size_t index);
+
+    // remove entry at the given index. returns false on invalid index.
+    bool Remove(size_t index);
+
+    // remove entry at the given index by moving the last entry to its place (constant time, but the last entry
+    // changes its index). returns false on invalid index.
+    bool SwapRemove(size_t index);
+
+    void Clear();
+
+    size_t Size() const;
+    bool Empty() const;
+
+    // faceprints version shared by all entries (valid only if not empty).
+    int FaceprintsVersion() const;
+
+    // user id of the entry (cold data)
+    const char* UserId(size_t index) const;
+
+    // full entry, reassembled from the hot and cold data (a ~1.6KB copy: for updates, not for the search loop)
+    ExtendedFaceprints Entry(size_t index) const;
+
+    // hot data, used by the search loop
+    GalleryRows Rows() const;
+    const feature_t* AdaptiveVector(size_t index) const;
+    const GalleryEntryNorm& Norm(size_t index) const;
+    bool HasMask(size_t index) const;
+
+    // enrollment vector of the entry (cold data)
+    const feature_t* EnrollmentVector(size_t index) const;
+
+    // warm the hot data of entries [begin, end) ahead of a search: a mapped file is read ahead by the os and faulted
+    // in, and the data is loaded once (one read per cache line), so a shard that fits in the caches is scanned hot.
+    // costs a memory pass over the range, meant for the time before the probe is known (e.g. while the device
+    // computes the faceprints).
+    void Prefetch(size_t begin, size_t end) const;
+
+    // with-mask adaptive descriptor (all zeros if the user has none yet)
+    const feature_t* AdaptiveMaskVector(size_t index) const;
+    const GalleryEntryNorm& MaskNorm(size_t index) const;
+    bool HasMaskDescriptor(size_t index) const;
+
+    // cold data of the faceprints (all but the user id)
+    static void ToColdEntry(const Faceprints& faceprints, GalleryColdEntry& cold_entry);
+
+    // full entry of the cold data, its faceprints version and its adaptive vectors (VectorLength values each)
+    static void FromColdEntry(const GalleryColdEntry& cold_entry, int version, const feature_t* adaptive_vector,
+                              const feature_t* adaptive_mask_vector, ExtendedFaceprints& entry);
+
+private:
+    friend class MatcherGalleryFile;
+
+    bool IsValidEntry(const Faceprints& faceprints) const;
+    // store the faceprints at index: adaptive vectors to the hot arrays, the rest (but the user id) to the cold entry
+    void StoreEntry(size_t index, const Faceprints& faceprints);
+
+    // copy the attached file contents (or the placed matrices) to the owned arrays (before any modification)
+    void Detach();
+
+    // point the accessors at the owned arrays (and the placed matrices)
+    void RefreshView();
+
+    using aligned_features_t = std::vector<feature_t, AlignedAllocator<feature_t, Alignment>>;
+
+    GalleryVector<GalleryColdEntry> _cold_entries;
+    aligned_features_t _adaptive_vectors;
+    aligned_features_t _adaptive_mask_vectors;
+    GalleryVector<GalleryEntryNorm> _norms;
+    GalleryVector<GalleryEntryNorm> _mask_norms;
+    GalleryVector<unsigned char> _has_mask_descriptor;
+    int _version = 0;
+    GalleryVector<unsigned char> _has_mask;
+
+    std::shared_ptr<const MatcherGalleryFile> _file;
+    // descriptor matrices after Place(): the adaptive vectors, then the with-mask adaptive vectors
+    std::unique_ptr<MatcherPlacedMemory> _placed;
+
+    // what the accessors read: the owned arrays above, the placed matrices or the attached file
+    size_t _size = 0;
+    const GalleryColdEntry* _cold_entries_view = nullptr;
+    const feature_t* _adaptive_vectors_view = nullptr;
+    const feature_t* _adaptive_mask_vectors_view = nullptr;
+    const GalleryEntryNorm* _norms_view = nullptr;
+    const GalleryEntryNorm* _mask_norms_view = nullptr;
+    const unsigned char* _has_mask_view = nullptr;
+    const unsigned char* _has_mask_descriptor_view = nullptr;
+};
+} // namespace RealSenseID
@@ -0,0 +1,652 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "MatcherGalleryFile.h"
+#include "MatcherGallery.h"
+#include "Matcher.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace RealSenseID
+{
+static const char* LOG_TAG = "MatcherGalleryFile";
+
+static_assert(std::is_trivially_copyable<GalleryColdEntry>::value, "gallery records are stored as is");
+static_assert(std::is_trivially_copyable<ExtendedFaceprints>::value, "version 1 gallery records are read as is");
+static_assert(std::is_trivially_copyable<GalleryEntryNorm>::value, "gallery norms are stored as is");
+
+static const char HeaderMagic[8] = {'R', 'S', 'I', 'D', 'G', 'A', 'L', 'H'};
+static const char FooterMagic[8] = {'R', 'S', 'I', 'D', 'G', 'A', 'L', 'F'};
+static constexpr size_t SectionAlignment = MatcherGallery::Alignment;
+// format version 1: ExtendedFaceprints records instead of GalleryColdEntry
+static constexpr uint32_t FullEntriesFormatVersion = 1;
+// format version 2: the header without the log sequence
+static constexpr uint32_t NoSequenceFormatVersion = 2;
+
+struct GalleryFileHeader
+{
+    char magic[8];
+    uint32_t format_version;
+    uint32_t header_size;
+    uint64_t count;
+    int32_t faceprints_version;
+    uint32_t vector_length;
+    uint32_t entry_size;
+    uint32_t norm_size;
+    uint64_t file_size;
+    uint64_t header_checksum; // of the header bytes, with this field zeroed
+    uint64_t log_sequence;    // since format version 3
+};
+
+// header size of the formats before the log sequence
+static constexpr size_t NoSequenceHeaderSize = offsetof(GalleryFileHeader, log_sequence);
+
+struct GalleryFileFooter
+{
+    char magic[8];
+    uint64_t count;
+    uint64_t data_checksum; // of all the bytes between the header and the footer
+};
+
+static_assert(sizeof(GalleryFileHeader) <= SectionAlignment, "header must fit before the first section");
+
+// 64 bit FNV-1a over 8 byte words (the result does not depend on how the input is split between Update() calls).
+class GalleryChecksum
+{
+public:
+    void Update(const void* data, size_t size)
+    {
+        auto bytes = static_cast<const unsigned char*>(data);
+        while (size > 0 && _pending_size > 0)
+        {
+            AddPending(*bytes++);
+            size--;
+        }
+        for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), bytes += sizeof(uint64_t))
+        {
+            uint64_t word;
+            ::memcpy(&word, bytes, sizeof(word));
+            AddWord(word);
+        }
+        while (size-- > 0)
+        {
+            AddPending(*bytes++);
+        }
+    }
+
+    uint64_t Final() const
+    {
+        uint64_t hash = _hash;
+        if (_pending_size > 0)
+        {
+            uint64_t word = 0;
+            ::memcpy(&word, _pending, _pending_size);
+            hash = (hash ^ word) * Prime;
+        }
+        return hash;
+    }
+
+private:
+    static constexpr uint64_t Prime = 0x100000001b3ULL;
+
+    void AddWord(uint64_t word)
+    {
+        _hash = (_hash ^ word) * Prime;
+    }
+
+    void AddPending(unsigned char byte)
+    {
+        _pending[_pending_size++] = byte;
+        if (_pending_size == sizeof(uint64_t))
+        {
+            uint64_t word;
+            ::memcpy(&word, _pending, sizeof(word));
+            AddWord(word);
+            _pending_size = 0;
+        }
+    }
+
+    uint64_t _hash = 0xcbf29ce484222325ULL;
+    unsigned char _pending[sizeof(uint64_t)] = {};
+    size_t _pending_size = 0;
+};
+
+// offsets of the sections of a file with count entries
+struct GalleryFileLayout
+{
+    size_t adaptive_vectors;
+    size_t adaptive_mask_vectors;
+    size_t norms;
+    size_t mask_norms;
+    size_t has_mask;
+    size_t has_mask_descriptor;
+    size_t entries;
+    size_t footer;
+    size_t file_size;
+
+    GalleryFileLayout(size_t count, size_t entry_size)
+    {
+        const size_t vectors_size = count * MatcherGallery::VectorLength * sizeof(feature_t);
+        size_t offset = SectionAlignment;
+        adaptive_vectors = Next(offset, vectors_size);
+        adaptive_mask_vectors = Next(offset, vectors_size);
+        norms = Next(offset, count * sizeof(GalleryEntryNorm));
+        mask_norms = Next(offset, count * sizeof(GalleryEntryNorm));
+        has_mask = Next(offset, count);
+        has_mask_descriptor = Next(offset, count);
+        entries = Next(offset, count * entry_size);
+        footer = offset;
+        file_size = footer + sizeof(GalleryFileFooter);
+    }
+
+private:
+    static size_t Next(size_t& offset, size_t section_size)
+    {
+        size_t section = offset;
+        offset += (section_size + SectionAlignment - 1) / SectionAlignment * SectionAlignment;
+        return section;
+    }
+};
+
+static uint64_t HeaderChecksum(GalleryFileHeader header, size_t header_size = sizeof(GalleryFileHeader))
+{
+    header.header_checksum = 0;
+    GalleryChecksum checksum;
+    checksum.Update(&header, header_size);
+    return checksum.Final();
+}
+
+// writes sections with zero padding up to the next aligned offset, and checksums what was written
+class GalleryFileWriter
+{
+public:
+    explicit GalleryFileWriter(std::FILE* file) : _file(file)
+    {
+    }
+
+    bool WriteSection(size_t offset, const void* data, size_t size)
+    {
+        return Pad(offset) && Write(data, size, true);
+    }
+
+    bool Pad(size_t offset)
+    {
+        static const unsigned char zeros[SectionAlignment] = {};
+        while (_offset < offset)
+        {
+            size_t size = (std::min)(offset - _offset, sizeof(zeros));
+            if (!Write(zeros, size, _offset >= SectionAlignment))
+            {
+                return false;
+            }
+        }
+        return _offset == offset;
+    }
+
+    bool Write(const void* data, size_t size, bool checksum)
+    {
+        if (size > 0 && std::fwrite(data, 1, size, _file) != size)
+        {
+            return false;
+        }
+        if (checksum)
+        {
+            _checksum.Update(data, size);
+        }
+        _offset += size;
+        return true;
+    }
+
+    uint64_t Checksum() const
+    {
+        return _checksum.Final();
+    }
+
+private:
+    std::FILE* _file;
+    size_t _offset = 0;
+    GalleryChecksum _checksum;
+};
+
+// flush the file's written data to the disk
+static bool SyncFile(std::FILE* file)
+{
+#ifdef _WIN32
+    return ::_commit(::_fileno(file)) == 0;
+#else
+    return ::fsync(::fileno(file)) == 0;
+#endif
+}
+
+// flush the directory entry of path (the rename) to the disk. windows has no directory sync, the rename is journaled
+static void SyncDirectory(const char* path)
+{
+#ifndef _WIN32
+    std::string dir = path;
+    const auto slash = dir.find_last_of('/');
+    dir = slash == std::string::npos ? "." : dir.substr(0, std::max<size_t>(slash, 1));
+    int fd = ::open(dir.c_str(), O_RDONLY);
+    if (fd >= 0)
+    {
+        ::fsync(fd);
+        ::close(fd);
+    }
+#else
+    (void)path;
+#endif
+}
+
+bool MatcherGalleryFile::Save(const MatcherGallery& gallery, const char* path, uint64_t log_sequence)
+{
+    if (path == nullptr)
+    {
+        return false;
+    }
+
+    const size_t count = gallery.Size();
+    const GalleryFileLayout layout(count, sizeof(GalleryColdEntry));
+    const size_t vectors_size = count * MatcherGallery::VectorLength * sizeof(feature_t);
+
+    GalleryFileHeader header;
+    ::memset(&header, 0, sizeof(header));
+    ::memcpy(header.magic, HeaderMagic, sizeof(header.magic));
+    header.format_version = FormatVersion;
+    header.header_size = static_cast<uint32_t>(sizeof(header));
+    header.count = count;
+    header.faceprints_version = gallery.FaceprintsVersion();
+    header.vector_length = static_cast<uint32_t>(MatcherGallery::VectorLength);
+    header.entry_size = static_cast<uint32_t>(sizeof(GalleryColdEntry));
+    header.norm_size = static_cast<uint32_t>(sizeof(GalleryEntryNorm));
+    header.file_size = layout.file_size;
+    header.log_sequence = log_sequence;
+    header.header_checksum = HeaderChecksum(header);
+
+    const std::string tmp_path = std::string(path) + ".tmp";
+    std::FILE* file = std::fopen(tmp_path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Failed to create gallery file %s", tmp_path.c_str());
+        return false;
+    }
+
+    GalleryFileWriter writer(file);
+    bool ok = writer.Write(&header, sizeof(header), false) &&
+              writer.WriteSection(layout.adaptive_vectors, gallery._adaptive_vectors_view, vectors_size) &&
+              writer.WriteSection(layout.adaptive_mask_vectors, gallery._adaptive_mask_vectors_view, vectors_size) &&
+              writer.WriteSection(layout.norms, gallery._norms_view, count * sizeof(GalleryEntryNorm)) &&
+              writer.WriteSection(layout.mask_norms, gallery._mask_norms_view, count * sizeof(GalleryEntryNorm)) &&
+              writer.WriteSection(layout.has_mask, gallery._has_mask_view, count) &&
+              writer.WriteSection(layout.has_mask_descriptor, gallery._has_mask_descriptor_view, count) &&
+              writer.WriteSection(layout.entries, gallery._cold_entries_view, count * sizeof(GalleryColdEntry)) &&
+              writer.Pad(layout.footer);
+    if (ok)
+    {
+        GalleryFileFooter footer;
+        ::memset(&footer, 0, sizeof(footer));
+        ::memcpy(footer.magic, FooterMagic, sizeof(footer.magic));
+        footer.count = count;
+        footer.data_checksum = writer.Checksum();
+        ok = writer.Write(&footer, sizeof(footer), false);
+    }
+    // on disk before the rename, so a crash after it never leaves a renamed but incomplete file
+    ok = ok && std::fflush(file) == 0 && SyncFile(file);
+    ok = (std::fclose(file) == 0) && ok;
+    if (!ok)
+    {
+        LOG_ERROR(LOG_TAG, "Failed to write gallery file %s", tmp_path.c_str());
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+
+#ifdef _WIN32
+    std::remove(path); // rename does not replace an existing file on windows
+#endif
+    if (std::rename(tmp_path.c_str(), path) != 0)
+    {
+        LOG_ERROR(LOG_TAG, "Failed to rename %s to %s", tmp_path.c_str(), path);
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    SyncDirectory(path);
+    return true;
+}
+
+std::shared_ptr<const MatcherGalleryFile> MatcherGalleryFile::Open(const char* path, bool verify_data)
+{
+    if (path == nullptr)
+    {
+        return nullptr;
+    }
+
+    std::shared_ptr<MatcherGalleryFile> file(new MatcherGalleryFile());
+    if (!file->Map(path))
+    {
+        return nullptr;
+    }
+
+    if (file->_data_size < SectionAlignment + sizeof(GalleryFileFooter))
+    {
+        LOG_ERROR(LOG_TAG, "Gallery file %s is truncated", path);
+        return nullptr;
+    }
+
+    GalleryFileHeader header;
+    ::memcpy(&header, file->_data, sizeof(header));
+    const bool full_entries = header.format_version == FullEntriesFormatVersion;
+    const bool has_sequence = !full_entries && header.format_version != NoSequenceFormatVersion;
+    const size_t header_size = has_sequence ? sizeof(header) : NoSequenceHeaderSize;
+    if (::memcmp(header.magic, HeaderMagic, sizeof(HeaderMagic)) != 0 ||
+        header.header_checksum != HeaderChecksum(header, header_size))
+    {
+        LOG_ERROR(LOG_TAG, "Gallery file %s has a corrupted header", path);
+        return nullptr;
+    }
+    const size_t entry_size = full_entries ? sizeof(ExtendedFaceprints) : sizeof(GalleryColdEntry);
+    if ((header.format_version != FormatVersion && has_sequence) || header.header_size != header_size ||
+        header.vector_length != MatcherGallery::VectorLength || header.entry_size != entry_size ||
+        header.norm_size != sizeof(GalleryEntryNorm))
+    {
+        LOG_ERROR(LOG_TAG, "Gallery file %s is not compatible with this build (format version %u)", path,
+                  header.format_version);
+        return nullptr;
+    }
+
+    // each entry takes at least its two vectors and its record, so a larger count is corrupted (and its layout could
+    // overflow)
+    const size_t min_entry_size = 2 * MatcherGallery::VectorLength * sizeof(feature_t) + entry_size;
+    if (header.count > file->_data_size / min_entry_size)
+    {
+        LOG_ERROR(LOG_TAG, "Gallery file %s is truncated", path);
+        return nullptr;
+    }
+    const size_t count = static_cast<size_t>(header.count);
+    const GalleryFileLayout layout(count, entry_size);
+    if (header.file_size != layout.file_size || file->_data_size != layout.file_size)
+    {
+        LOG_ERROR(LOG_TAG, "Gallery file %s is truncated", path);
+        return nullptr;
+    }
+
+    GalleryFileFooter footer;
+    ::memcpy(&footer, file->_data + layout.footer, sizeof(footer));
+    if (::memcmp(footer.magic, FooterMagic, sizeof(FooterMagic)) != 0 || footer.count != header.count)
+    {
+        LOG_ERROR(LOG_TAG, "Gallery file %s has a corrupted footer", path);
+        return nullptr;
+    }
+    if (verify_data)
+    {
+        GalleryChecksum checksum;
+        checksum.Update(file->_data + SectionAlignment, layout.footer - SectionAlignment);
+        if (checksum.Final() != footer.data_checksum)
+        {
+            LOG_ERROR(LOG_TAG, "Gallery file %s failed the data checksum", path);
+            return nullptr;
+        }
+    }
+
+    const unsigned char* data = file->_data;
+    file->_size = count;
+    file->_version = header.faceprints_version;
+    file->_log_sequence = has_sequence ? header.log_sequence : 0;
+    file->_adaptive_vectors = reinterpret_cast<const feature_t*>(data + layout.adaptive_vectors);
+    file->_adaptive_mask_vectors = reinterpret_cast<const feature_t*>(data + layout.adaptive_mask_vectors);
+    file->_norms = reinterpret_cast<const GalleryEntryNorm*>(data + layout.norms);
+    file->_mask_norms = reinterpret_cast<const GalleryEntryNorm*>(data + layout.mask_norms);
+    file->_has_mask = data + layout.has_mask;
+    file->_has_mask_descriptor = data + layout.has_mask_descriptor;
+    if (full_entries)
+    {
+        file->ConvertEntries(reinterpret_cast<const ExtendedFaceprints*>(data + layout.entries));
+    }
+    else
+    {
+        file->_cold_entries = reinterpret_cast<const GalleryColdEntry*>(data + layout.entries);
+    }
+    if (!file->ValidEntries(path))
+    {
+        return nullptr;
+    }
+    return file;
+}
+
+// the checks of the entries added to a gallery (MatcherGallery::IsValidEntry()), and the norms and flags stored with
+// the vectors must be theirs: the search kernels rely on them. the data checksum does not prove it (it is no
+// signature, and it may be skipped).
+bool MatcherGalleryFile::ValidEntries(const char* path) const
+{
+    constexpr size_t VectorLength = MatcherGallery::VectorLength;
+    for (size_t i = 0; i < _size; i++)
+    {
+        const feature_t* row = _adaptive_vectors + i * VectorLength;
+        const feature_t* mask_row = _adaptive_mask_vectors + i * VectorLength;
+        const char* user_id = _cold_entries[i].user_id;
+        bool valid = Matcher::ValidateVector(row) && Matcher::ValidateVector(mask_row) && _has_mask[i] <= 1 &&
+                     _has_mask_descriptor[i] <= 1 &&
+                     ::memchr(user_id, '\0', sizeof(GalleryColdEntry::user_id)) != nullptr;
+        if (valid)
+        {
+            GalleryEntryNorm norm, mask_norm;
+            Matcher::GetVectorNorm(row, norm.norm, norm.norm_msb);
+            Matcher::GetVectorNorm(mask_row, mask_norm.norm, mask_norm.norm_msb);
+            valid = norm.norm == _norms[i].norm && norm.norm_msb == _norms[i].norm_msb &&
+                    mask_norm.norm == _mask_norms[i].norm && mask_norm.norm_msb == _mask_norms[i].norm_msb;
+        }
+        if (!valid)
+        {
+            LOG_ERROR(LOG_TAG, "Gallery file %s has an invalid entry (%zu)", path, i);
+            return false;
+        }
+    }
+    return true;
+}
+
+void MatcherGalleryFile::ConvertEntries(const ExtendedFaceprints* entries)
+{
+    _converted_entries.resize(_size);
+    for (size_t i = 0; i < _size; i++)
+    {
+        ::memcpy(_converted_entries[i].user_id, entries[i].user_id, sizeof(entries[i].user_id));
+        MatcherGallery::ToColdEntry(entries[i].faceprints, _converted_entries[i]);
+    }
+    _cold_entries = _converted_entries.data();
+}
+
+uint64_t MatcherGalleryFile::LogSequence() const
+{
+    return _log_sequence;
+}
+
+uint64_t MatcherGalleryFile::Checksum(const void* data, size_t size)
+{
+    GalleryChecksum checksum;
+    checksum.Update(data, size);
+    return checksum.Final();
+}
+
+MatcherGalleryFile::~MatcherGalleryFile()
+{
+    Unmap();
+}
+
+#ifdef _WIN32
+bool MatcherGalleryFile::Map(const char* path)
+{
+    HANDLE file_handle = ::CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                       FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_handle == INVALID_HANDLE_VALUE)
+    {
+        LOG_ERROR(LOG_TAG, "Failed to open gallery file %s", path);
+        return false;
+    }
+    _file_handle = file_handle;
+
+    LARGE_INTEGER file_size;
+    if (!::GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0)
+    {
+        LOG_ERROR(LOG_TAG, "Gallery file %s is empty", path);
+        Unmap();
+        return false;
+    }
+
+    _mapping_handle = ::CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (_mapping_handle == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Failed to map gallery file %s", path);
+        Unmap();
+        return false;
+    }
+    _data = static_cast<const unsigned char*>(::MapViewOfFile(_mapping_handle, FILE_MAP_READ, 0, 0, 0));
+    if (_data == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Failed to map gallery file %s", path);
+        Unmap();
+        return false;
+    }
+    _data_size = static_cast<size_t>(file_size.QuadPart);
+    return true;
+}
+
+void MatcherGalleryFile::Unmap()
+{
+    if (_data != nullptr)
+    {
+        ::UnmapViewOfFile(_data);
+        _data = nullptr;
+    }
+    if (_mapping_handle != nullptr)
+    {
+        ::CloseHandle(_mapping_handle);
+        _mapping_handle = nullptr;
+    }
+    if (_file_handle != nullptr)
+    {
+        ::CloseHandle(_file_handle);
+        _file_handle = nullptr;
+    }
+    _data_size = 0;
+}
+#else
+bool MatcherGalleryFile::Map(const char* path)
+{
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        LOG_ERROR(LOG_TAG, "Failed to open gallery file %s", path);
+        return false;
+    }
+
+    struct stat file_stat;
+    if (::fstat(fd, &file_stat) != 0 || file_stat.st_size <= 0)
+    {
+        LOG_ERROR(LOG_TAG, "Gallery file %s is empty", path);
+        ::close(fd);
+        return false;
+    }
+
+    const size_t size = static_cast<size_t>(file_stat.st_size);
+    void* data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd); // the mapping keeps the file referenced
+    if (data == MAP_FAILED)
+    {
+        LOG_ERROR(LOG_TAG, "Failed to map gallery file %s", path);
+        return false;
+    }
+    _data = static_cast<const unsigned char*>(data);
+    _data_size = size;
+    return true;
+}
+
+void MatcherGalleryFile::Unmap()
+{
+    if (_data != nullptr)
+    {
+        ::munmap(const_cast<unsigned char*>(_data), _data_size);
+        _data = nullptr;
+    }
+    _data_size = 0;
+}
+#endif // _WIN32
+
+void MatcherGalleryFile::WillNeed(const void* data, size_t size) const
+{
+    auto* begin = static_cast<const unsigned char*>(data);
+    if (size == 0 || begin < _data || begin + size > _data + _data_size)
+    {
+        return;
+    }
+#ifdef _WIN32
+    // PrefetchVirtualMemory() is windows 8+ only. the caller touches the pages instead.
+#else
+    // madvise needs a page aligned start
+    const uintptr_t page_size = static_cast<uintptr_t>(::sysconf(_SC_PAGESIZE));
+    const uintptr_t start = reinterpret_cast<uintptr_t>(begin) & ~(page_size - 1);
+    const uintptr_t end = reinterpret_cast<uintptr_t>(begin + size);
+    ::madvise(reinterpret_cast<void*>(start), end - start, MADV_WILLNEED);
+#endif
+}
+
+size_t MatcherGalleryFile::Size() const
+{
+    return _size;
+}
+
+int MatcherGalleryFile::FaceprintsVersion() const
+{
+    return _version;
+}
+
+const GalleryColdEntry* MatcherGalleryFile::ColdEntries() const
+{
+    return _cold_entries;
+}
+
+const feature_t* MatcherGalleryFile::AdaptiveVectors() const
+{
+    return _adaptive_vectors;
+}
+
+const feature_t* MatcherGalleryFile::AdaptiveMaskVectors() const
+{
+    return _adaptive_mask_vectors;
+}
+
+const GalleryEntryNorm* MatcherGalleryFile::Norms() const
+{
+    return _norms;
+}
+
+const GalleryEntryNorm* MatcherGalleryFile::MaskNorms() const
+{
+    return _mask_norms;
+}
+
+const unsigned char* MatcherGalleryFile::HasMask() const
+{
+    return _has_mask;
+}
+
+const unsigned char* MatcherGalleryFile::HasMaskDescriptor() const
+{
+    return _has_mask_descriptor;
+}
+} // namespace RealSenseID
@@ -0,0 +1,100 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "ExtendedFaceprints.h"
+#include "MatcherGallery.h"
+#include "MatcherImplDefines.h"
+#include <memory>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace RealSenseID
+{
+using feature_t = short;
+
+// Persistent binary gallery file, memory mapped read-only and matched in place (no parsing on load).
+//
+// The file is the MatcherGallery structure-of-arrays written as is, every section 64-byte aligned:
+//
+//   header   - magic, format version, entry count, faceprints version, record sizes, header checksum, log sequence
+//   sections - adaptive vectors, with-mask adaptive vectors, norms, with-mask norms, mask flags,
+//              has-mask-descriptor flags, GalleryColdEntry records
+//   footer   - magic, entry count and checksum of all the sections
+//
+// The file uses the native layout and byte order. Record sizes and the vector length are stored in the header,
+// so a file written by an incompatible build is rejected instead of misread.
+//
+// Format version 1 stored full ExtendedFaceprints records in the last section. Such files are still opened: their
+// records are converted to cold entries in memory on Open(), and written in the current format by the next Save().
+// Format version 2 had no log sequence (opened as sequence 0).
+class MatcherGalleryFile
+{
+public:
+    static constexpr uint32_t FormatVersion = 3;
+
+    // write the gallery to path. The file is written to path + ".tmp", flushed to the disk and renamed over path
+    // when complete, so an interrupted save (or a power loss) never leaves a truncated gallery behind.
+    // log_sequence: the sequence number of the last MatcherGalleryStore log record the gallery includes.
+    static bool Save(const MatcherGallery& gallery, const char* path, uint64_t log_sequence = 0);
+
+    // map the file at path. Returns nullptr if the file is missing, truncated, from an incompatible build, fails
+    // the header checksum or has an invalid entry (checked as the entries added to a gallery, reading the vectors
+    // once). With verify_data the footer checksum of all the sections is checked too (reads the whole file once);
+    // skip it for the fastest start on trusted storage.
+    static std::shared_ptr<const MatcherGalleryFile> Open(const char* path, bool verify_data = true);
+
+    // the 64 bit checksum used by the file format (also used for the records of MatcherGalleryStore's log)
+    static uint64_t Checksum(const void* data, size_t size);
+
+    ~MatcherGalleryFile();
+
+    MatcherGalleryFile(const MatcherGalleryFile&) = delete;
+    MatcherGalleryFile& operator=(const MatcherGalleryFile&) = delete;
+
+    size_t Size() const;
+    int FaceprintsVersion() const;
+    uint64_t LogSequence() const;
+
+    const GalleryColdEntry* ColdEntries() const;
+    const feature_t* AdaptiveVectors() const;
+    const feature_t* AdaptiveMaskVectors() const;
+    const GalleryEntryNorm* Norms() const;
+    const GalleryEntryNorm* MaskNorms() const;
+    const unsigned char* HasMask() const;
+    const unsigned char* HasMaskDescriptor() const;
+
+    // ask the os to read the pages of [data, data + size) (a part of the mapping) ahead, without waiting for them
+    void WillNeed(const void* data, size_t size) const;
+
+private:
+    MatcherGalleryFile() = default;
+
+    bool Map(const char* path);
+    bool ValidEntries(const char* path) const;
+    // cold entries of the ExtendedFaceprints records of a version 1 file
+    void ConvertEntries(const ExtendedFaceprints* entries);
+    void Unmap();
+
+    const unsigned char* _data = nullptr;
+    size_t _data_size = 0;
+#ifdef _WIN32
+    void* _file_handle = nullptr;
+    void* _mapping_handle = nullptr;
+#endif
+
+    size_t _size = 0;
+    int _version = 0;
+    uint64_t _log_sequence = 0;
+    const GalleryColdEntry* _cold_entries = nullptr;
+    std::vector<GalleryColdEntry> _converted_entries;
+    const feature_t* _adaptive_vectors = nullptr;
+    const feature_t* _adaptive_mask_vectors = nullptr;
+    const GalleryEntryNorm* _norms = nullptr;
+    const GalleryEntryNorm* _mask_norms = nullptr;
+    const unsigned char* _has_mask = nullptr;
+    const unsigned char* _has_mask_descriptor = nullptr;
+};
+} // namespace RealSenseID
@@ -0,0 +1,811 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "MatcherGalleryStore.h"
+#include "MatcherGalleryFile.h"
+#include "Logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace RealSenseID
+{
+static const char* LOG_TAG = "MatcherGalleryStore";
+
+// Log records, in the native layout and byte order (as the gallery file). The same bytes are the replication
+// stream: a header, payload_size bytes of payload and the checksum (uint64) of the header and payload.
+static constexpr uint32_t LogRecordMagic = 0x32444952; // "RID2"
+
+enum LogRecordType : uint32_t
+{
+    UpdateRecord = 1, // payload: the two adaptive descriptors
+    AddRecord = 2,    // payload: the ExtendedFaceprints
+    RemoveRecord = 3  // no payload
+};
+
+struct GalleryLogHeader
+{
+    uint32_t magic;
+    uint32_t type;
+    uint64_t sequence;
+    uint32_t index;
+    uint32_t payload_size;
+};
+
+struct UpdatePayload
+{
+    feature_t adaptive_descriptor_without_mask[FEATURES_VECTOR_ALLOC_SIZE];
+    feature_t adaptive_descriptor_with_mask[FEATURES_VECTOR_ALLOC_SIZE];
+};
+
+// the update record of the logs written before the sequence numbers
+static constexpr uint32_t LegacyRecordMagic = 0x4c444952; // "RIDL"
+
+struct LegacyLogRecord
+{
+    uint32_t magic;
+    uint32_t index;
+    UpdatePayload payload;
+    uint64_t checksum; // of all the bytes before this field
+};
+
+static size_t PayloadSize(uint32_t type)
+{
+    switch (type)
+    {
+    case UpdateRecord:
+        return sizeof(UpdatePayload);
+    case AddRecord:
+        return sizeof(ExtendedFaceprints);
+    case RemoveRecord:
+        return 0;
+    default:
+        return SIZE_MAX;
+    }
+}
+
+static GalleryVector<unsigned char> EncodeRecord(uint32_t type, uint64_t sequence, size_t index, const void* payload,
+                                                size_t payload_size)
+{
+    GalleryLogHeader header;
+    ::memset(&header, 0, sizeof(header));
+    header.magic = LogRecordMagic;
+    header.type = type;
+    header.sequence = sequence;
+    header.index = static_cast<uint32_t>(index);
+    header.payload_size = static_cast<uint32_t>(payload_size);
+
+    GalleryVector<unsigned char> bytes(sizeof(header) + payload_size + sizeof(uint64_t));
+    ::memcpy(bytes.data(), &header, sizeof(header));
+    if (payload_size > 0)
+    {
+        ::memcpy(bytes.data() + sizeof(header), payload, payload_size);
+    }
+    const uint64_t checksum = MatcherGalleryFile::Checksum(bytes.data(), sizeof(header) + payload_size);
+    ::memcpy(bytes.data() + sizeof(header) + payload_size, &checksum, sizeof(checksum));
+    return bytes;
+}
+
+static bool FileExists(const std::string& path)
+{
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    std::fclose(file);
+    return true;
+}
+
+static bool SyncFile(std::FILE* file)
+{
+    if (std::fflush(file) != 0)
+    {
+        return false;
+    }
+#ifdef _WIN32
+    return ::_commit(::_fileno(file)) == 0;
+#else
+    return ::fsync(::fileno(file)) == 0;
+#endif
+}
+
+// append the contents of the file at from_path to the file at to_path
+static bool AppendFile(const std::string& from_path, const std::string& to_path)
+{
+    std::FILE* from = std::fopen(from_path.c_str(), "rb");
+    if (from == nullptr)
+    {
+        return false;
+    }
+    std::FILE* to = std::fopen(to_path.c_str(), "ab");
+    if (to == nullptr)
+    {
+        std::fclose(from);
+        return false;
+    }
+    bool ok = true;
+    char buffer[64 * 1024];
+    size_t read_size;
+    while (ok && (read_size = std::fread(buffer, 1, sizeof(buffer), from)) > 0)
+    {
+        ok = std::fwrite(buffer, 1, read_size, to) == read_size;
+    }
+    std::fclose(from);
+    ok = (std::fclose(to) == 0) && ok;
+    return ok;
+}
+
+// a decoded log record, pointing into the bytes it was read from
+struct GalleryLogRecord
+{
+    uint32_t type = 0;
+    uint64_t sequence = 0; // 0 for a legacy record
+    size_t index = 0;
+    const unsigned char* payload = nullptr;
+    size_t payload_size = 0;
+};
+
+// the record at the start of data. returns its size, 0 if data does not start with a whole valid record.
+static size_t DecodeRecord(const unsigned char* data, size_t size, GalleryLogRecord& record)
+{
+    uint32_t magic;
+    if (size < sizeof(magic))
+    {
+        return 0;
+    }
+    ::memcpy(&magic, data, sizeof(magic));
+    if (magic == LegacyRecordMagic)
+    {
+        if (size < sizeof(LegacyLogRecord))
+        {
+            return 0;
+        }
+        LegacyLogRecord legacy;
+        ::memcpy(&legacy, data, sizeof(legacy));
+        if (legacy.checksum != MatcherGalleryFile::Checksum(&legacy, offsetof(LegacyLogRecord, checksum)))
+        {
+            return 0;
+        }
+        record.type = UpdateRecord;
+        record.sequence = 0;
+        record.index = legacy.index;
+        record.payload = data + offsetof(LegacyLogRecord, payload);
+        record.payload_size = sizeof(UpdatePayload);
+        return sizeof(LegacyLogRecord);
+    }
+
+    GalleryLogHeader header;
+    if (magic != LogRecordMagic || size < sizeof(header))
+    {
+        return 0;
+    }
+    ::memcpy(&header, data, sizeof(header));
+    if (header.payload_size != PayloadSize(header.type) || header.sequence == 0)
+    {
+        return 0;
+    }
+    const size_t record_size = sizeof(header) + header.payload_size + sizeof(uint64_t);
+    uint64_t checksum;
+    if (size < record_size)
+    {
+        return 0;
+    }
+    ::memcpy(&checksum, data + sizeof(header) + header.payload_size, sizeof(checksum));
+    if (checksum != MatcherGalleryFile::Checksum(data, sizeof(header) + header.payload_size))
+    {
+        return 0;
+    }
+    record.type = header.type;
+    record.sequence = header.sequence;
+    record.index = header.index;
+    record.payload = data + sizeof(header);
+    record.payload_size = header.payload_size;
+    return record_size;
+}
+
+MatcherGalleryStore::MatcherGalleryStore(const GalleryStoreConfig& config) : _config(config)
+{
+}
+
+MatcherGalleryStore::~MatcherGalleryStore()
+{
+    Close();
+}
+
+bool MatcherGalleryStore::Open(const char* path)
+{
+    Close();
+    if (path == nullptr)
+    {
+        return false;
+    }
+
+    _path = path;
+    uint64_t sequence = 0;
+    if (FileExists(_path))
+    {
+        auto file = MatcherGalleryFile::Open(path, _config.verify_data);
+        if (!file)
+        {
+            LOG_ERROR(LOG_TAG, "Failed to load gallery file %s", path);
+            _path.clear();
+            return false;
+        }
+        sequence = file->LogSequence();
+        _gallery.Attach(file);
+    }
+    else
+    {
+        _gallery.Clear();
+    }
+    {
+        std::lock_guard<std::mutex> lock(_log_mutex);
+        _sequence = sequence;
+        _backlog.clear();
+        _backlog_first = sequence + 1;
+    }
+
+    // a crash during compaction leaves the rotated log behind; its records are older than the ones in the log.
+    // records the gallery file already includes (a crash after the compaction saved it) are skipped.
+    _log_records = 0;
+    if (!ReplayLog(CompactingLogPath()) || !ReplayLog(LogPath()) || !OpenLog())
+    {
+        CloseLog();
+        _gallery.Clear();
+        _path.clear();
+        return false;
+    }
+
+    LOG_DEBUG(LOG_TAG, "Opened gallery store %s: %zu users, %zu logged records, sequence %llu", path, _gallery.Size(),
+              _log_records, static_cast<unsigned long long>(Sequence()));
+
+    _stop = false;
+    _background_thread = LibraryThread([this] { BackgroundLoop(); });
+    return true;
+}
+
+void MatcherGalleryStore::Close()
+{
+    if (_background_thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(_background_mutex);
+            _stop = true;
+        }
+        _background_cv.notify_all();
+        _background_thread.join();
+    }
+    Flush();
+    CloseLog();
+    _replication_cv.notify_all();
+    _gallery.Clear();
+    _path.clear();
+}
+
+bool MatcherGalleryStore::IsOpen() const
+{
+    std::lock_guard<std::mutex> lock(_log_mutex);
+    return _log != nullptr;
+}
+
+bool MatcherGalleryStore::Reset(const MatcherGallery& gallery)
+{
+    return ResetTo(gallery, nullptr);
+}
+
+bool MatcherGalleryStore::ResetReplica(const MatcherGallery& gallery, uint64_t sequence)
+{
+    return ResetTo(gallery, &sequence);
+}
+
+bool MatcherGalleryStore::ResetTo(const MatcherGallery& gallery, const uint64_t* sequence)
+{
+    std::lock_guard<std::mutex> compact_lock(_compact_mutex);
+    std::lock_guard<std::shared_timed_mutex> gallery_lock(_gallery_mutex);
+    std::lock_guard<std::mutex> log_lock(_log_mutex);
+    if (_log == nullptr)
+    {
+        return false;
+    }
+    // a new history: the standbys behind it need a snapshot
+    const uint64_t new_sequence = sequence != nullptr ? *sequence : _sequence + 1;
+    if (!MatcherGalleryFile::Save(gallery, _path.c_str(), new_sequence))
+    {
+        return false;
+    }
+    _sequence = new_sequence;
+    _backlog.clear();
+    _backlog_first = new_sequence + 1;
+    _replication_cv.notify_all();
+
+    std::fclose(_log);
+    _log = nullptr;
+    std::remove(CompactingLogPath().c_str());
+    std::remove(LogPath().c_str());
+    _gallery = gallery;
+    _log_records = 0;
+    _log_dirty = false;
+    _log = std::fopen(LogPath().c_str(), "ab");
+    if (_log == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Failed to open log %s", LogPath().c_str());
+        return false;
+    }
+    return true;
+}
+
+const MatcherGallery& MatcherGalleryStore::Gallery() const
+{
+    return _gallery;
+}
+
+std::shared_lock<std::shared_timed_mutex> MatcherGalleryStore::LockGallery() const
+{
+    return std::shared_lock<std::shared_timed_mutex>(_gallery_mutex);
+}
+
+bool MatcherGalleryStore::RecordUpdate(size_t index, const Faceprints& faceprints)
+{
+    UpdatePayload payload;
+    ::memcpy(payload.adaptive_descriptor_without_mask, faceprints.adaptiveDescriptorWithoutMask,
+             sizeof(payload.adaptive_descriptor_without_mask));
+    ::memcpy(payload.adaptive_descriptor_with_mask, faceprints.adaptiveDescriptorWithMask,
+             sizeof(payload.adaptive_descriptor_with_mask));
+    return Commit(UpdateRecord, index, &payload, sizeof(payload));
+}
+
+bool MatcherGalleryStore::RecordAdd(const ExtendedFaceprints& entry)
+{
+    return Commit(AddRecord, 0, &entry, sizeof(entry));
+}
+
+bool MatcherGalleryStore::RecordRemove(size_t index)
+{
+    return Commit(RemoveRecord, index, nullptr, 0);
+}
+
+bool MatcherGalleryStore::Commit(uint32_t type, size_t index, const void* payload, size_t payload_size)
+{
+    if (!IsOpen())
+    {
+        return false;
+    }
+
+    std::lock_guard<std::shared_timed_mutex> lock(_gallery_mutex);
+    if (type == AddRecord)
+    {
+        index = _gallery.Size();
+    }
+    const auto bytes = EncodeRecord(type, Sequence() + 1, index, payload, payload_size);
+    GalleryLogRecord record;
+    DecodeRecord(bytes.data(), bytes.size(), record);
+    if (!ApplyRecord(record))
+    {
+        return false;
+    }
+    return AppendRecord(record, bytes.data(), bytes.size());
+}
+
+bool MatcherGalleryStore::ApplyRecord(const GalleryLogRecord& record)
+{
+    switch (record.type)
+    {
+    case UpdateRecord: {
+        if (record.index >= _gallery.Size())
+        {
+            return false;
+        }
+        UpdatePayload payload;
+        ::memcpy(&payload, record.payload, sizeof(payload));
+        Faceprints updated = _gallery.Entry(record.index).faceprints;
+        ::memcpy(updated.adaptiveDescriptorWithoutMask, payload.adaptive_descriptor_without_mask,
+                 sizeof(updated.adaptiveDescriptorWithoutMask));
+        ::memcpy(updated.adaptiveDescriptorWithMask, payload.adaptive_descriptor_with_mask,
+                 sizeof(updated.adaptiveDescriptorWithMask));
+        return _gallery.Update(record.index, updated);
+    }
+    case AddRecord: {
+        // always appended: a record of another index does not match the gallery
+        if (record.index != _gallery.Size())
+        {
+            return false;
+        }
+        ExtendedFaceprints entry;
+        ::memcpy(&entry, record.payload, sizeof(entry));
+        entry.user_id[sizeof(entry.user_id) - 1] = '\0';
+        return _gallery.Add(entry);
+    }
+    case RemoveRecord:
+        return _gallery.Remove(record.index);
+    default:
+        return false;
+    }
+}
+
+bool MatcherGalleryStore::AppendRecord(const GalleryLogRecord& record, const unsigned char* data, size_t size)
+{
+    size_t log_records;
+    bool logged;
+    {
+        std::lock_guard<std::mutex> lock(_log_mutex);
+        // the record is applied: it keeps its sequence (and goes to the standbys) even if the disk write fails
+        _sequence = record.sequence;
+        AddToBacklog(data, size);
+        logged = _log != nullptr && std::fwrite(data, 1, size, _log) == size;
+        if (logged)
+        {
+            _log_dirty = true;
+            ++_log_records;
+        }
+        log_records = _log_records;
+    }
+    _replication_cv.notify_all();
+    if (!logged)
+    {
+        LOG_ERROR(LOG_TAG, "Failed to log record %llu (user %zu)", static_cast<unsigned long long>(record.sequence),
+                  record.index);
+        return false;
+    }
+
+    if (_config.compact_threshold > 0 && log_records == _config.compact_threshold)
+    {
+        _background_cv.notify_all();
+    }
+    return true;
+}
+
+void MatcherGalleryStore::AddToBacklog(const unsigned char* data, size_t size)
+{
+    if (_config.replication_backlog == 0)
+    {
+        _backlog_first = _sequence + 1;
+        return;
+    }
+    _backlog.emplace_back(data, data + size);
+    while (_backlog.size() > _config.replication_backlog)
+    {
+        _backlog.pop_front();
+        _backlog_first++;
+    }
+}
+
+uint64_t MatcherGalleryStore::Sequence() const
+{
+    std::lock_guard<std::mutex> lock(_log_mutex);
+    return _sequence;
+}
+
+bool MatcherGalleryStore::Snapshot(MatcherGallery& gallery, uint64_t& sequence) const
+{
+    if (!IsOpen())
+    {
+        return false;
+    }
+    // records are applied under the exclusive gallery lock, so the gallery and sequence match under the shared one
+    std::shared_lock<std::shared_timed_mutex> lock(_gallery_mutex);
+    gallery = _gallery;
+    sequence = Sequence();
+    return true;
+}
+
+bool MatcherGalleryStore::SaveSnapshot(const char* path, uint64_t& sequence) const
+{
+    if (!IsOpen() || path == nullptr)
+    {
+        return false;
+    }
+    std::shared_lock<std::shared_timed_mutex> lock(_gallery_mutex);
+    sequence = Sequence();
+    return MatcherGalleryFile::Save(_gallery, path, sequence);
+}
+
+ReplicationRead MatcherGalleryStore::ReadReplication(uint64_t after_sequence, size_t max_records,
+                                                     unsigned int timeout_ms, std::vector<unsigned char>& records)
+{
+    std::unique_lock<std::mutex> lock(_log_mutex);
+    _replication_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                             [&] { return _log == nullptr || _sequence != after_sequence; });
+    if (_log == nullptr)
+    {
+        return ReplicationRead::Closed;
+    }
+    if (after_sequence > _sequence || after_sequence + 1 < _backlog_first)
+    {
+        return ReplicationRead::SnapshotNeeded;
+    }
+    if (after_sequence == _sequence)
+    {
+        return ReplicationRead::UpToDate;
+    }
+    const size_t first = static_cast<size_t>(after_sequence + 1 - _backlog_first);
+    const size_t last = std::min(_backlog.size(), first + std::max<size_t>(max_records, 1));
+    for (size_t i = first; i < last; i++)
+    {
+        records.insert(records.end(), _backlog[i].begin(), _backlog[i].end());
+    }
+    return ReplicationRead::Records;
+}
+
+ReplicationApply MatcherGalleryStore::ApplyReplication(const unsigned char* records, size_t size)
+{
+    if (!IsOpen())
+    {
+        return ReplicationApply::Failed;
+    }
+
+    std::lock_guard<std::shared_timed_mutex> lock(_gallery_mutex);
+    size_t offset = 0;
+    while (offset < size)
+    {
+        GalleryLogRecord record;
+        const size_t record_size = DecodeRecord(records + offset, size - offset, record);
+        if (record_size == 0 || record.sequence == 0)
+        {
+            LOG_ERROR(LOG_TAG, "Invalid replication record at offset %zu", offset);
+            return ReplicationApply::Invalid;
+        }
+        const uint64_t sequence = Sequence();
+        if (record.sequence > sequence + 1)
+        {
+            LOG_DEBUG(LOG_TAG, "Replication gap: record %llu after %llu",
+                      static_cast<unsigned long long>(record.sequence), static_cast<unsigned long long>(sequence));
+            return ReplicationApply::SnapshotNeeded;
+        }
+        if (record.sequence == sequence + 1)
+        {
+            if (!ApplyRecord(record))
+            {
+                LOG_ERROR(LOG_TAG, "Failed to apply replication record %llu",
+                          static_cast<unsigned long long>(record.sequence));
+                return ReplicationApply::Failed;
+            }
+            if (!AppendRecord(record, records + offset, record_size))
+            {
+                return ReplicationApply::Failed;
+            }
+        }
+        offset += record_size;
+    }
+    return ReplicationApply::Applied;
+}
+
+bool MatcherGalleryStore::Flush()
+{
+    std::lock_guard<std::mutex> lock(_log_mutex);
+    if (_log == nullptr || !_log_dirty)
+    {
+        return true;
+    }
+    if (!SyncFile(_log))
+    {
+        LOG_ERROR(LOG_TAG, "Failed to sync log %s", LogPath().c_str());
+        return false;
+    }
+    _log_dirty = false;
+    return true;
+}
+
+bool MatcherGalleryStore::Compact()
+{
+    std::lock_guard<std::mutex> compact_lock(_compact_mutex);
+
+    // snapshot the gallery and start a new log under the locks, then write the gallery file without blocking
+    // RecordUpdate().
+    MatcherGallery snapshot;
+    uint64_t sequence;
+    {
+        std::shared_lock<std::shared_timed_mutex> gallery_lock(_gallery_mutex);
+        std::lock_guard<std::mutex> log_lock(_log_mutex);
+        if (_log == nullptr)
+        {
+            return false;
+        }
+        if (_log_records == 0 && !FileExists(CompactingLogPath()))
+        {
+            return true;
+        }
+        snapshot = _gallery;
+        sequence = _sequence;
+        if (!RotateLog())
+        {
+            return false;
+        }
+    }
+
+    if (!MatcherGalleryFile::Save(snapshot, _path.c_str(), sequence))
+    {
+        // the rotated log is kept, so nothing is lost: it is replayed on Open() or merged by the next compaction
+        return false;
+    }
+    std::remove(CompactingLogPath().c_str());
+    LOG_DEBUG(LOG_TAG, "Compacted gallery store %s (%zu users)", _path.c_str(), snapshot.Size());
+    return true;
+}
+
+size_t MatcherGalleryStore::PendingRecords() const
+{
+    std::lock_guard<std::mutex> lock(_log_mutex);
+    return _log_records;
+}
+
+std::string MatcherGalleryStore::LogPath() const
+{
+    return _path + ".wal";
+}
+
+std::string MatcherGalleryStore::CompactingLogPath() const
+{
+    return _path + ".wal.compacting";
+}
+
+bool MatcherGalleryStore::OpenLog()
+{
+    std::lock_guard<std::mutex> lock(_log_mutex);
+    _log = std::fopen(LogPath().c_str(), "ab");
+    if (_log == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Failed to open log %s", LogPath().c_str());
+        return false;
+    }
+    _log_dirty = false;
+    return true;
+}
+
+void MatcherGalleryStore::CloseLog()
+{
+    std::lock_guard<std::mutex> lock(_log_mutex);
+    if (_log != nullptr)
+    {
+        std::fclose(_log);
+        _log = nullptr;
+    }
+    _log_records = 0;
+    _log_dirty = false;
+}
+
+bool MatcherGalleryStore::ReplayLog(const std::string& log_path)
+{
+    std::FILE* log = std::fopen(log_path.c_str(), "rb");
+    if (log == nullptr)
+    {
+        return true; // no log
+    }
+
+    std::vector<unsigned char> data;
+    unsigned char buffer[64 * 1024];
+    size_t read_size;
+    while ((read_size = std::fread(buffer, 1, sizeof(buffer), log)) > 0)
+    {
+        data.insert(data.end(), buffer, buffer + read_size);
+    }
+    std::fclose(log);
+
+    size_t offset = 0;
+    size_t records = 0;
+    GalleryLogRecord record;
+    size_t record_size;
+    while (offset < data.size() && (record_size = DecodeRecord(data.data() + offset, data.size() - offset, record)) > 0)
+    {
+        std::lock_guard<std::shared_timed_mutex> gallery_lock(_gallery_mutex);
+        std::lock_guard<std::mutex> log_lock(_log_mutex);
+        // a legacy record has no sequence: it is the next one
+        const uint64_t sequence = record.sequence != 0 ? record.sequence : _sequence + 1;
+        if (sequence > _sequence)
+        {
+            if (sequence != _sequence + 1)
+            {
+                LOG_ERROR(LOG_TAG, "Log %s is missing records %llu to %llu", log_path.c_str(),
+                          static_cast<unsigned long long>(_sequence + 1),
+                          static_cast<unsigned long long>(sequence - 1));
+            }
+            if (!ApplyRecord(record))
+            {
+                LOG_ERROR(LOG_TAG, "Log %s does not match the gallery (record %llu, user %zu of %zu)", log_path.c_str(),
+                          static_cast<unsigned long long>(sequence), record.index, _gallery.Size());
+                return false;
+            }
+            _sequence = sequence;
+            const auto bytes = EncodeRecord(record.type, sequence, record.index, record.payload, record.payload_size);
+            AddToBacklog(bytes.data(), bytes.size());
+        }
+        offset += record_size;
+        records++;
+    }
+    _log_records += records;
+
+    if (offset < data.size())
+    {
+        // drop the torn tail, so records appended from now on stay readable
+        LOG_ERROR(LOG_TAG, "Dropping torn record at the end of %s (%zu records kept)", log_path.c_str(), records);
+        const std::string tmp_path = log_path + ".tmp";
+        std::FILE* rewritten = std::fopen(tmp_path.c_str(), "wb");
+        bool ok = rewritten != nullptr;
+        if (ok && offset > 0)
+        {
+            ok = std::fwrite(data.data(), 1, offset, rewritten) == offset;
+        }
+        ok = (rewritten != nullptr && std::fclose(rewritten) == 0) && ok;
+#ifdef _WIN32
+        ok = ok && std::remove(log_path.c_str()) == 0; // rename does not replace an existing file on windows
+#endif
+        if (!ok || std::rename(tmp_path.c_str(), log_path.c_str()) != 0)
+        {
+            LOG_ERROR(LOG_TAG, "Failed to rewrite log %s", log_path.c_str());
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MatcherGalleryStore::RotateLog()
+{
+    // called with the log mutex held
+    std::fclose(_log);
+    _log = nullptr;
+
+    const std::string log_path = LogPath();
+    const std::string compacting_path = CompactingLogPath();
+    bool ok;
+    if (FileExists(compacting_path))
+    {
+        // left by a failed compaction: keep the records in order
+        ok = AppendFile(log_path, compacting_path) && std::remove(log_path.c_str()) == 0;
+    }
+    else
+    {
+        ok = std::rename(log_path.c_str(), compacting_path.c_str()) == 0;
+    }
+    if (!ok)
+    {
+        LOG_ERROR(LOG_TAG, "Failed to rotate log %s", log_path.c_str());
+    }
+
+    _log = std::fopen(log_path.c_str(), "ab");
+    if (_log == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Failed to open log %s", log_path.c_str());
+        return false;
+    }
+    if (ok)
+    {
+        _log_records = 0;
+        _log_dirty = false;
+    }
+    return ok;
+}
+
+void MatcherGalleryStore::BackgroundLoop()
+{
+    const auto compaction_due = [this] {
+        return _config.compact_threshold > 0 && PendingRecords() >= _config.compact_threshold;
+    };
+
+    // after a failed compaction wait for the next interval instead of retrying right away
+    bool retry_now = true;
+    std::unique_lock<std::mutex> lock(_background_mutex);
+    while (!_stop)
+    {
+        _background_cv.wait_for(lock, std::chrono::milliseconds(_config.sync_interval_ms),
+                                [&] { return _stop.load() || (retry_now && compaction_due()); });
+        if (_stop)
+        {
+            break;
+        }
+        lock.unlock();
+        Flush();
+        retry_now = !compaction_due() || Compact();
+        lock.lock();
+    }
+}
+} // namespace RealSenseID
@@ -0,0 +1,188 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "MatcherGallery.h"
+#include "AlignedAllocator.h"
+#include "RealSenseID/Faceprints.h"
+#include "LibraryThread.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace RealSenseID
+{
+struct GalleryStoreConfig
+{
+    // number of logged updates that triggers a background compaction (0 - compact only on Compact())
+    size_t compact_threshold = 4096;
+    // the background thread syncs the log to disk at this interval
+    unsigned int sync_interval_ms = 1000;
+    // verify the gallery file data checksum on Open()
+    bool verify_data = true;
+    // number of the latest log records kept in memory for standbys (ReadReplication()), 0 - no replication
+    size_t replication_backlog = 0;
+};
+
+struct GalleryLogRecord;
+
+enum class ReplicationRead
+{
+    Records,        // records were appended
+    UpToDate,       // no records after the given sequence (timed out)
+    SnapshotNeeded, // the records after the given sequence are no longer kept (or the standby diverged)
+    Closed
+};
+
+enum class ReplicationApply
+{
+    Applied,
+    SnapshotNeeded, // a gap before the records: reset the standby from a snapshot
+    Invalid,        // not a sequence of whole log records
+    Failed          // a record could not be applied or logged (the standby is inconsistent, reset it)
+};
+
+// Persistent host-mode gallery: a MatcherGalleryFile (path) plus an append-only log of changes (path + ".wal").
+//
+// RecordUpdate() / RecordAdd() / RecordRemove() apply an adaptive update / enroll / remove to the in-memory gallery
+// and append a record (user index plus both adaptive descriptors, the added entry, or the removed index) to the
+// log. They never wait for the disk: a background thread syncs the log every sync_interval_ms and, once
+// compact_threshold records were logged, rewrites the gallery file and drops the log. Flush() syncs the log on
+// demand.
+//
+// Records are numbered by a sequence that continues across compactions and restarts; the gallery file stores the
+// sequence of the last record it includes. On Open(), the gallery file is mapped and the records of the log past
+// its sequence replayed over it. Records are checksummed; a torn record at the end of the log (crash while
+// writing) is dropped.
+//
+// Replication (active / hot-standby hosts): the primary keeps its latest replication_backlog records in memory and
+// a standby tails them with ReadReplication() on the primary / ApplyReplication() on its own store, which applies
+// and logs them with the primary's sequence numbers, so a standby can take over (and be replicated from) at once.
+// A standby starts, or catches up after falling behind the backlog, from a snapshot: SaveSnapshot() is a gallery
+// file to Open() on the standby (or Snapshot() / ResetReplica() in memory), then the records after its sequence.
+// Reset() starts a new history: the standbys need a snapshot.
+//
+// Threading: Gallery() may be searched and changes recorded from one thread (e.g. the authentication thread),
+// concurrently with the background thread. If changes are recorded (or replicated) from another thread (e.g. by a
+// MatcherUpdateQueue), searches must hold LockGallery() while they read Gallery(). ReadReplication() may be called
+// from any thread.
+class MatcherGalleryStore
+{
+public:
+    explicit MatcherGalleryStore(const GalleryStoreConfig& config = GalleryStoreConfig());
+    ~MatcherGalleryStore();
+
+    MatcherGalleryStore(const MatcherGalleryStore&) = delete;
+    MatcherGalleryStore& operator=(const MatcherGalleryStore&) = delete;
+
+    // open the store at path (an empty gallery if the file does not exist yet) and start the background thread.
+    // returns false if the gallery file exists but could not be loaded.
+    bool Open(const char* path);
+
+    // stop the background thread, sync the log and close the store.
+    void Close();
+
+    bool IsOpen() const;
+
+    // replace the whole gallery (e.g. after enroll / remove): the gallery file is rewritten and the log dropped.
+    bool Reset(const MatcherGallery& gallery);
+
+    const MatcherGallery& Gallery() const;
+
+    // shared lock of the gallery: RecordUpdate() waits until it is released
+    std::shared_lock<std::shared_timed_mutex> LockGallery() const;
+
+    // apply the adaptive descriptors of faceprints to the entry at index and log the update.
+    bool RecordUpdate(size_t index, const Faceprints& faceprints);
+
+    // add the entry at the end of the gallery (e.g. after enroll) and log it. returns false if the entry failed
+    // validation.
+    bool RecordAdd(const ExtendedFaceprints& entry);
+
+    // remove the entry at index (the entries after it move down by one, as MatcherGallery::Remove()) and log it.
+    bool RecordRemove(size_t index);
+
+    // sequence number of the last record applied (0 - none)
+    uint64_t Sequence() const;
+
+    // copy of the gallery and its sequence
+    bool Snapshot(MatcherGallery& gallery, uint64_t& sequence) const;
+
+    // write the gallery to a gallery file at path (with its sequence, see MatcherGalleryFile::LogSequence()), for a
+    // standby to Open()
+    bool SaveSnapshot(const char* path, uint64_t& sequence) const;
+
+    // append up to max_records records after after_sequence (the standby's Sequence()) to records, waiting up to
+    // timeout_ms for new ones if there are none yet.
+    ReplicationRead ReadReplication(uint64_t after_sequence, size_t max_records, unsigned int timeout_ms,
+                                    std::vector<unsigned char>& records);
+
+    // standby: replace the whole gallery with a snapshot of the primary, as Reset()
+    bool ResetReplica(const MatcherGallery& gallery, uint64_t sequence);
+
+    // standby: apply and log the records of ReadReplication(). the records the store already has are skipped.
+    ReplicationApply ApplyReplication(const unsigned char* records, size_t size);
+
+    // sync the log to disk
+    bool Flush();
+
+    // rewrite the gallery file with all logged updates and drop the log.
+    bool Compact();
+
+    // number of updates logged since the last compaction
+    size_t PendingRecords() const;
+
+private:
+    using RecordBytes = GalleryVector<unsigned char>;
+
+    std::string LogPath() const;
+    std::string CompactingLogPath() const;
+
+    bool OpenLog();
+    void CloseLog();
+    bool ReplayLog(const std::string& log_path);
+    bool RotateLog();
+    void BackgroundLoop();
+
+    // with the gallery lock held
+    bool ApplyRecord(const GalleryLogRecord& record);
+    // apply a new record of the primary and log it with the next sequence
+    bool Commit(uint32_t type, size_t index, const void* payload, size_t payload_size);
+    // with the gallery lock held: log an applied record and keep it for the standbys
+    bool AppendRecord(const GalleryLogRecord& record, const unsigned char* data, size_t size);
+    // with the log lock held
+    void AddToBacklog(const unsigned char* data, size_t size);
+    bool ResetTo(const MatcherGallery& gallery, const uint64_t* sequence);
+
+    GalleryStoreConfig _config;
+    std::string _path;
+    MatcherGallery _gallery;
+
+    std::mutex _compact_mutex;         // serializes Compact() / Reset()
+    // gallery modifications are exclusive, searches and snapshots shared
+    mutable std::shared_timed_mutex _gallery_mutex;
+    mutable std::mutex _log_mutex;
+    std::FILE* _log = nullptr;
+    size_t _log_records = 0;
+    bool _log_dirty = false;
+
+    // with the log mutex
+    uint64_t _sequence = 0;
+    std::deque<RecordBytes> _backlog; // the records _backlog_first.._sequence
+    uint64_t _backlog_first = 1;
+    std::condition_variable _replication_cv;
+
+    LibraryThread _background_thread;
+    std::mutex _background_mutex;
+    std::condition_variable _background_cv;
+    std::atomic<bool> _stop {false};
+};
+} // namespace RealSenseID
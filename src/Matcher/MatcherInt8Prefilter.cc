@@ -0,0 +1,175 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "MatcherInt8Prefilter.h"
+#include "MatcherGallery.h"
+#include "MatcherKernels.h"
+#include <algorithm>
+#include <cmath>
+
+namespace RealSenseID
+{
+// approximate ncc grade: 4096 * cos^2 for positive correlation, 0 otherwise (same scale as Matcher::NccGrade).
+static int ApproximateGrade(int32_t corr, int32_t norm1, int32_t norm2)
+{
+    if (corr <= 0 || norm1 <= 0 || norm2 <= 0)
+    {
+        return 0;
+    }
+    double c = static_cast<double>(corr);
+    return static_cast<int>((c * c * 4096.0) / (static_cast<double>(norm1) * static_cast<double>(norm2)));
+}
+
+void MatcherInt8Prefilter::Quantize(const feature_t* vec, int8_t* out)
+{
+    for (size_t i = 0; i < VectorLength; i++)
+    {
+        int v = static_cast<int>(vec[i]) >> QuantizationShift;
+        out[i] = static_cast<int8_t>(std::max(-128, std::min(127, v)));
+    }
+}
+
+void MatcherInt8Prefilter::Build(const MatcherGallery& gallery)
+{
+    Clear();
+    _vectors.resize(gallery.Size() * VectorLength);
+    _norms.resize(gallery.Size());
+    _lengths.resize(gallery.Size());
+    _residual_lengths.resize(gallery.Size());
+    for (size_t idx = 0; idx < gallery.Size(); idx++)
+    {
+        StoreRow(gallery, idx);
+    }
+}
+
+bool MatcherInt8Prefilter::Add(const MatcherGallery& gallery, size_t gallery_index)
+{
+    if (gallery_index != Size() || gallery_index >= gallery.Size())
+    {
+        return false;
+    }
+    _vectors.resize(_vectors.size() + VectorLength);
+    _norms.push_back(0);
+    _lengths.push_back(0);
+    _residual_lengths.push_back(0);
+    StoreRow(gallery, gallery_index);
+    return true;
+}
+
+bool MatcherInt8Prefilter::Update(const MatcherGallery& gallery, size_t gallery_index)
+{
+    if (gallery_index >= Size() || gallery_index >= gallery.Size())
+    {
+        return false;
+    }
+    StoreRow(gallery, gallery_index);
+    return true;
+}
+
+bool MatcherInt8Prefilter::Remove(size_t gallery_index)
+{
+    if (gallery_index >= Size())
+    {
+        return false;
+    }
+    auto row = _vectors.begin() + gallery_index * VectorLength;
+    _vectors.erase(row, row + VectorLength);
+    _norms.erase(_norms.begin() + gallery_index);
+    _lengths.erase(_lengths.begin() + gallery_index);
+    _residual_lengths.erase(_residual_lengths.begin() + gallery_index);
+    return true;
+}
+
+void MatcherInt8Prefilter::Clear()
+{
+    _vectors.clear();
+    _norms.clear();
+    _lengths.clear();
+    _residual_lengths.clear();
+}
+
+size_t MatcherInt8Prefilter::Size() const
+{
+    return _norms.size();
+}
+
+void MatcherInt8Prefilter::Search(const feature_t* probe, int tolerance, std::vector<uint32_t>& candidates) const
+{
+    candidates.clear();
+
+    int8_t probe8[VectorLength];
+    Quantize(probe, probe8);
+    int32_t probe_norm = MatcherKernels::ComputeCorrInt8(probe8, probe8, VectorLength);
+
+    const size_t n = Size();
+    std::vector<int> grades(n);
+    int best_grade = 0;
+    for (size_t idx = 0; idx < n; idx++)
+    {
+        int32_t corr = MatcherKernels::ComputeCorrInt8(probe8, &_vectors[idx * VectorLength], VectorLength);
+        grades[idx] = ApproximateGrade(corr, probe_norm, _norms[idx]);
+        best_grade = std::max(best_grade, grades[idx]);
+    }
+
+    int min_grade = best_grade - std::max(tolerance, 0);
+    for (size_t idx = 0; idx < n; idx++)
+    {
+        if (grades[idx] >= min_grade)
+        {
+            candidates.push_back(static_cast<uint32_t>(idx));
+        }
+    }
+}
+
+// squared norm of the quantization residual of vec
+static int32_t ResidualNorm(const feature_t* vec, const int8_t* vec8)
+{
+    const int32_t scale = 1 << MatcherInt8Prefilter::QuantizationShift;
+    int32_t norm = 0;
+    for (size_t i = 0; i < MatcherInt8Prefilter::VectorLength; i++)
+    {
+        int32_t r = static_cast<int32_t>(vec[i]) - static_cast<int32_t>(vec8[i]) * scale;
+        norm += r * r;
+    }
+    return norm;
+}
+
+void MatcherInt8Prefilter::CorrelationBounds(const feature_t* probe, std::vector<double>& bounds) const
+{
+    // with q = (q8 << s) + rq and g = (g8 << s) + rg:
+    //   dot(q, g) = dot(q, g8 << s) + dot(q, rg) = (dot(q8, g8) << 2s) + dot(rq, g8 << s) + dot(q, rg)
+    //             <= (dot(q8, g8) << 2s) + |rq| * |g8| * 2^s + |q| * |rg|
+    int8_t probe8[VectorLength];
+    Quantize(probe, probe8);
+    int32_t probe_norm = 0;
+    for (size_t i = 0; i < VectorLength; i++)
+    {
+        probe_norm += static_cast<int32_t>(probe[i]) * probe[i];
+    }
+    const double probe_length = std::sqrt(static_cast<double>(probe_norm));
+    const double probe_residual_length = std::sqrt(static_cast<double>(ResidualNorm(probe, probe8)));
+    const double scale = static_cast<double>(1 << QuantizationShift);
+
+    const size_t n = Size();
+    bounds.resize(n);
+    for (size_t idx = 0; idx < n; idx++)
+    {
+        int32_t corr8 = MatcherKernels::ComputeCorrInt8(probe8, &_vectors[idx * VectorLength], VectorLength);
+        double bound = static_cast<double>(corr8) * scale * scale;
+        bound += probe_residual_length * _lengths[idx] * scale;
+        bound += probe_length * _residual_lengths[idx];
+        // margin for the floating point rounding
+        bounds[idx] = bound + 1.0;
+    }
+}
+
+void MatcherInt8Prefilter::StoreRow(const MatcherGallery& gallery, size_t gallery_index)
+{
+    int8_t* row = &_vectors[gallery_index * VectorLength];
+    Quantize(gallery.AdaptiveVector(gallery_index), row);
+    _norms[gallery_index] = MatcherKernels::ComputeCorrInt8(row, row, VectorLength);
+    _lengths[gallery_index] = std::sqrt(static_cast<double>(_norms[gallery_index]));
+    const int32_t residual_norm = ResidualNorm(gallery.AdaptiveVector(gallery_index), row);
+    _residual_lengths[gallery_index] = std::sqrt(static_cast<double>(residual_norm));
+}
+} // namespace RealSenseID
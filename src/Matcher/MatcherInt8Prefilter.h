@@ -0,0 +1,67 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "MatcherImplDefines.h"
+#include "AlignedAllocator.h"
+#include "RealSenseID/Faceprints.h"
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace RealSenseID
+{
+class MatcherGallery;
+
+// 8 bit quantized copy of the gallery adaptive vectors, used as a first (approximate) search stage.
+//
+// Features are in [-1023, +1023], so dropping the 3 low bits maps them to int8 with ~0.4% relative error. The
+// prefilter scores every entry with an int8 dot product (half the memory of the gallery, twice the simd lanes) and
+// keeps the entries whose approximate grade is within `tolerance` of the best approximate grade. Only these are
+// then scored exactly by the Matcher.
+//
+// The prefilter also keeps the norm of each entry's quantization residual, so it can bound the exact correlation of
+// every entry (Cauchy-Schwarz on the residuals). The exact search of the Matcher scores only the entries whose bound
+// can still change its result.
+//
+// Like MatcherIvfIndex, the prefilter stores gallery indices: call Add()/Update()/Remove() with every matching change
+// of the gallery.
+class MatcherInt8Prefilter
+{
+public:
+    static constexpr size_t VectorLength = RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER;
+    static constexpr int QuantizationShift = 3;
+
+    MatcherInt8Prefilter() = default;
+
+    void Build(const MatcherGallery& gallery);
+
+    // append the gallery entry at gallery_index (must be the next index, i.e. Size()).
+    bool Add(const MatcherGallery& gallery, size_t gallery_index);
+    bool Update(const MatcherGallery& gallery, size_t gallery_index);
+    bool Remove(size_t gallery_index);
+    void Clear();
+
+    size_t Size() const;
+
+    // select candidates whose approximate grade (same [0,4096] scale as the exact ncc) is at least
+    // (best approximate grade - tolerance). candidates are sorted by ascending gallery index.
+    void Search(const feature_t* probe, int tolerance, std::vector<uint32_t>& candidates) const;
+
+    // upper bound of the exact correlation of the probe with each entry (bounds[i] >= dot(probe, entry i)).
+    void CorrelationBounds(const feature_t* probe, std::vector<double>& bounds) const;
+
+    static void Quantize(const feature_t* vec, int8_t* out);
+
+private:
+    void StoreRow(const MatcherGallery& gallery, size_t gallery_index);
+
+    using aligned_int8_t = std::vector<int8_t, AlignedAllocator<int8_t, 64>>;
+    aligned_int8_t _vectors; // Size() x VectorLength
+    std::vector<int32_t> _norms;
+    // lengths for CorrelationBounds(): of the int8 vector, and of (vector - (int8 vector << QuantizationShift))
+    std::vector<double> _lengths;
+    std::vector<double> _residual_lengths;
+};
+} // namespace RealSenseID
@@ -0,0 +1,230 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "MatcherIvfIndex.h"
+#include "MatcherGallery.h"
+#include <algorithm>
+#include <cmath>
+
+namespace RealSenseID
+{
+static float Dot(const float* centroid, const feature_t* vec)
+{
+    float sum = 0.f;
+    for (size_t i = 0; i < MatcherIvfIndex::VectorLength; i++)
+    {
+        sum += centroid[i] * static_cast<float>(vec[i]);
+    }
+    return sum;
+}
+
+static void Normalize(float* vec)
+{
+    float norm = 0.f;
+    for (size_t i = 0; i < MatcherIvfIndex::VectorLength; i++)
+    {
+        norm += vec[i] * vec[i];
+    }
+    norm = std::sqrt(norm);
+    if (norm <= 0.f)
+        return;
+    for (size_t i = 0; i < MatcherIvfIndex::VectorLength; i++)
+    {
+        vec[i] /= norm;
+    }
+}
+
+bool MatcherIvfIndex::Build(const MatcherGallery& gallery, size_t number_of_lists, size_t kmeans_iterations)
+{
+    Clear();
+
+    const size_t n = gallery.Size();
+    if (n == 0 || number_of_lists == 0)
+    {
+        return false;
+    }
+    number_of_lists = std::min(number_of_lists, n);
+
+    // deterministic init: evenly spaced gallery entries
+    _centroids.assign(number_of_lists * VectorLength, 0.f);
+    for (size_t list = 0; list < number_of_lists; list++)
+    {
+        const feature_t* vec = gallery.AdaptiveVector(list * n / number_of_lists);
+        float* centroid = &_centroids[list * VectorLength];
+        for (size_t i = 0; i < VectorLength; i++)
+        {
+            centroid[i] = static_cast<float>(vec[i]);
+        }
+        Normalize(centroid);
+    }
+
+    std::vector<uint32_t> assignment(n, 0);
+    for (size_t iter = 0; iter < kmeans_iterations; iter++)
+    {
+        bool changed = false;
+        for (size_t idx = 0; idx < n; idx++)
+        {
+            uint32_t list = NearestList(gallery.AdaptiveVector(idx));
+            changed = changed || (list != assignment[idx]) || iter == 0;
+            assignment[idx] = list;
+        }
+        if (!changed)
+            break;
+
+        // recompute centroids as the (normalized) mean of their members. empty lists keep their centroid.
+        std::vector<float> sums(_centroids.size(), 0.f);
+        std::vector<size_t> counts(number_of_lists, 0);
+        for (size_t idx = 0; idx < n; idx++)
+        {
+            const feature_t* vec = gallery.AdaptiveVector(idx);
+            float* sum = &sums[assignment[idx] * VectorLength];
+            for (size_t i = 0; i < VectorLength; i++)
+            {
+                sum[i] += static_cast<float>(vec[i]);
+            }
+            counts[assignment[idx]]++;
+        }
+        for (size_t list = 0; list < number_of_lists; list++)
+        {
+            if (counts[list] == 0)
+                continue;
+            float* centroid = &_centroids[list * VectorLength];
+            std::copy(&sums[list * VectorLength], &sums[list * VectorLength] + VectorLength, centroid);
+            Normalize(centroid);
+        }
+    }
+
+    _lists.assign(number_of_lists, {});
+    for (size_t idx = 0; idx < n; idx++)
+    {
+        _lists[NearestList(gallery.AdaptiveVector(idx))].push_back(static_cast<uint32_t>(idx));
+    }
+    _size = n;
+    return true;
+}
+
+bool MatcherIvfIndex::Insert(const MatcherGallery& gallery, size_t gallery_index)
+{
+    if (!IsBuilt() || gallery_index >= gallery.Size())
+    {
+        return false;
+    }
+    auto& list = _lists[NearestList(gallery.AdaptiveVector(gallery_index))];
+    auto value = static_cast<uint32_t>(gallery_index);
+    list.insert(std::upper_bound(list.begin(), list.end(), value), value);
+    _size++;
+    return true;
+}
+
+bool MatcherIvfIndex::Remove(size_t gallery_index)
+{
+    if (!IsBuilt())
+    {
+        return false;
+    }
+
+    auto value = static_cast<uint32_t>(gallery_index);
+    auto contains = [value](const GalleryVector<uint32_t>& list) {
+        return std::binary_search(list.begin(), list.end(), value);
+    };
+    if (std::none_of(_lists.begin(), _lists.end(), contains))
+    {
+        return false; // not indexed, the other entries keep their indices
+    }
+    for (auto& list : _lists)
+    {
+        auto it = std::lower_bound(list.begin(), list.end(), value);
+        if (it != list.end() && *it == value)
+        {
+            it = list.erase(it);
+        }
+        // the lists are sorted, so only the tail needs to be shifted
+        for (; it != list.end(); ++it)
+        {
+            --(*it);
+        }
+    }
+    _size--;
+    return true;
+}
+
+void MatcherIvfIndex::Clear()
+{
+    _centroids.clear();
+    _lists.clear();
+    _size = 0;
+}
+
+bool MatcherIvfIndex::IsBuilt() const
+{
+    return !_lists.empty();
+}
+
+size_t MatcherIvfIndex::NumberOfLists() const
+{
+    return _lists.size();
+}
+
+size_t MatcherIvfIndex::Size() const
+{
+    return _size;
+}
+
+void MatcherIvfIndex::Search(const feature_t* probe, size_t n_probe_lists, std::vector<uint32_t>& candidates) const
+{
+    candidates.clear();
+    if (!IsBuilt())
+    {
+        return;
+    }
+
+    std::vector<uint32_t> lists;
+    NearestLists(probe, std::max<size_t>(n_probe_lists, 1), lists);
+    for (auto list : lists)
+    {
+        candidates.insert(candidates.end(), _lists[list].begin(), _lists[list].end());
+    }
+
+    // visit candidates in gallery order, so the re-ranking keeps the exact search tie-breaking.
+    std::sort(candidates.begin(), candidates.end());
+}
+
+void MatcherIvfIndex::NearestLists(const feature_t* vec, size_t n_lists, std::vector<uint32_t>& lists) const
+{
+    const size_t number_of_lists = _lists.size();
+    n_lists = std::min(n_lists, number_of_lists);
+
+    std::vector<std::pair<float, uint32_t>> scores(number_of_lists);
+    for (size_t list = 0; list < number_of_lists; list++)
+    {
+        scores[list] = {Dot(&_centroids[list * VectorLength], vec), static_cast<uint32_t>(list)};
+    }
+    std::partial_sort(scores.begin(), scores.begin() + n_lists, scores.end(),
+                      [](const std::pair<float, uint32_t>& lhs, const std::pair<float, uint32_t>& rhs) {
+                          return (lhs.first != rhs.first) ? (lhs.first > rhs.first) : (lhs.second < rhs.second);
+                      });
+
+    lists.clear();
+    for (size_t i = 0; i < n_lists; i++)
+    {
+        lists.push_back(scores[i].second);
+    }
+}
+
+uint32_t MatcherIvfIndex::NearestList(const feature_t* vec) const
+{
+    uint32_t best_list = 0;
+    float best_score = -1e30f;
+    const size_t number_of_lists = _centroids.size() / VectorLength;
+    for (size_t list = 0; list < number_of_lists; list++)
+    {
+        float score = Dot(&_centroids[list * VectorLength], vec);
+        if (score > best_score)
+        {
+            best_score = score;
+            best_list = static_cast<uint32_t>(list);
+        }
+    }
+    return best_list;
+}
+} // namespace RealSenseID
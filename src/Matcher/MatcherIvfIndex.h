@@ -0,0 +1,88 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "MatcherImplDefines.h"
+#include "AlignedAllocator.h"
+#include "RealSenseID/Faceprints.h"
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace RealSenseID
+{
+class MatcherGallery;
+
+// Inverted file (IVF) index over the adaptive vectors of a MatcherGallery, for approximate 1:N search in very
+// large galleries.
+//
+// The gallery vectors are clustered (spherical k-means, i.e. by cosine similarity which is what the ncc
+// measures) into a number of lists. A search only visits the lists whose centroids are closest to the probe, and
+// the candidates found there are re-ranked with the exact fixed-point ncc (see Matcher).
+// More probed lists means better recall for more latency. Probing all lists gives the exact result.
+//
+// The index stores gallery indices. Insert()/Remove() must be called with every matching change of the gallery
+// (Remove() shifts the following indices down, same as MatcherGallery::Remove()).
+class MatcherIvfIndex
+{
+public:
+    static constexpr size_t VectorLength = RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER;
+
+    MatcherIvfIndex() = default;
+
+    // cluster the gallery to number_of_lists lists (at most the gallery size) and assign all entries.
+    // returns false if the gallery is empty.
+    bool Build(const MatcherGallery& gallery, size_t number_of_lists, size_t kmeans_iterations = 10);
+
+    // add the gallery entry at gallery_index (which must be the last gallery entry, or any new index)
+    // to its nearest list. The centroids are not changed, so rebuild from time to time after many inserts.
+    bool Insert(const MatcherGallery& gallery, size_t gallery_index);
+
+    // remove the entry at gallery_index and shift the following indices down by one. false (and no change) if the
+    // entry is not indexed.
+    bool Remove(size_t gallery_index);
+
+    void Clear();
+
+    bool IsBuilt() const;
+    size_t NumberOfLists() const;
+    size_t Size() const;
+
+    // collect the gallery indices stored in the n_probe_lists lists nearest to the probe vector,
+    // sorted by ascending gallery index.
+    void Search(const feature_t* probe, size_t n_probe_lists, std::vector<uint32_t>& candidates) const;
+
+    // visit the gallery indices of the index, list by list from the list nearest to the probe vector (each list by
+    // ascending gallery index), until visit(index) returns false: the visiting order of a search that may stop
+    // early, see Matcher::MatchFaceprintsToArrayAnytime(). only the order of the lists is computed up front.
+    template <typename Visit>
+    void PriorityOrder(const feature_t* probe, Visit visit) const
+    {
+        if (!IsBuilt())
+        {
+            return;
+        }
+        std::vector<uint32_t> lists;
+        NearestLists(probe, _lists.size(), lists);
+        for (auto list : lists)
+        {
+            for (auto gallery_index : _lists[list])
+            {
+                if (!visit(gallery_index))
+                {
+                    return;
+                }
+            }
+        }
+    }
+
+private:
+    void NearestLists(const feature_t* vec, size_t n_lists, std::vector<uint32_t>& lists) const;
+    uint32_t NearestList(const feature_t* vec) const;
+
+    GalleryVector<float> _centroids; // number_of_lists x VectorLength, unit length rows
+    GalleryVector<GalleryVector<uint32_t>> _lists;
+    size_t _size = 0;
+};
+} // namespace RealSenseID
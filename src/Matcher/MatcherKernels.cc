@@ -0,0 +1,807 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "MatcherKernels.h"
+#include "CpuFeatures.h"
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define RSID_MATCHER_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define RSID_MATCHER_NEON
+#include <arm_neon.h>
+#endif
+
+// The kernels rely on 16 bit multiply-accumulate into 32 bit lanes (pmaddwd / vmlal). Every partial product and
+// partial sum is kept modulo 2^32, same as the scalar loop, so the final sums are identical no matter how the
+// additions are reordered.
+
+namespace RealSenseID
+{
+namespace MatcherKernels
+{
+using kernel_fn = void (*)(const short*, const short*, uint32_t, NccSums&);
+using corr_kernel_fn = int32_t (*)(const short*, const short*, uint32_t);
+using corr_batch_kernel_fn = void (*)(const short* const*, uint32_t, const short*, uint32_t, int32_t*);
+using corr_int8_kernel_fn = int32_t (*)(const int8_t*, const int8_t*, uint32_t);
+using hamming_kernel_fn = uint32_t (*)(const uint64_t*, const uint64_t*, uint32_t);
+using pq_scores_kernel_fn = void (*)(const uint16_t*, uint32_t, const uint8_t*, uint32_t, uint32_t*);
+using blend_kernel_fn = void (*)(short*, const short*, uint32_t, int);
+using blend_sums_kernel_fn = void (*)(short*, const short*, uint32_t, int, NccSums&);
+
+// accumulate the elements in [start, vec_length)
+static void AccumulateTail(const short* T1, const short* T2, uint32_t start, uint32_t vec_length, NccSums& sums)
+{
+    uint32_t corr = static_cast<uint32_t>(sums.corr);
+    for (uint32_t i = start; i < vec_length; ++i)
+    {
+        int32_t t1 = static_cast<int32_t>(T1[i]);
+        int32_t t2 = static_cast<int32_t>(T2[i]);
+
+        corr += static_cast<uint32_t>(t1 * t2);
+        sums.norm1 += static_cast<uint32_t>(t1 * t1);
+        sums.norm2 += static_cast<uint32_t>(t2 * t2);
+    }
+    sums.corr = static_cast<int32_t>(corr);
+}
+
+static uint32_t AccumulateCorrTail(const short* T1, const short* T2, uint32_t start, uint32_t vec_length,
+                                   uint32_t corr)
+{
+    for (uint32_t i = start; i < vec_length; ++i)
+    {
+        corr += static_cast<uint32_t>(static_cast<int32_t>(T1[i]) * static_cast<int32_t>(T2[i]));
+    }
+    return corr;
+}
+
+void ComputeNccSumsScalar(const short* T1, const short* T2, uint32_t vec_length, NccSums& sums)
+{
+    sums = NccSums {};
+    AccumulateTail(T1, T2, 0, vec_length, sums);
+}
+
+int32_t ComputeCorrScalar(const short* T1, const short* T2, uint32_t vec_length)
+{
+    return static_cast<int32_t>(AccumulateCorrTail(T1, T2, 0, vec_length, 0));
+}
+
+void ComputeCorrBatchScalar(const short* const* probes, uint32_t n_probes, const short* T2, uint32_t vec_length,
+                            int32_t* corr_out)
+{
+    for (uint32_t p = 0; p < n_probes; ++p)
+    {
+        corr_out[p] = ComputeCorrScalar(probes[p], T2, vec_length);
+    }
+}
+
+int32_t ComputeCorrInt8Scalar(const int8_t* T1, const int8_t* T2, uint32_t vec_length)
+{
+    int32_t corr = 0;
+    for (uint32_t i = 0; i < vec_length; ++i)
+    {
+        corr += static_cast<int32_t>(T1[i]) * static_cast<int32_t>(T2[i]);
+    }
+    return corr;
+}
+
+uint32_t HammingDistanceScalar(const uint64_t* T1, const uint64_t* T2, uint32_t n_words)
+{
+    uint32_t distance = 0;
+    for (uint32_t i = 0; i < n_words; ++i)
+    {
+        // swar popcount
+        uint64_t v = T1[i] ^ T2[i];
+        v = v - ((v >> 1) & 0x5555555555555555ull);
+        v = (v & 0x3333333333333333ull) + ((v >> 2) & 0x3333333333333333ull);
+        v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0full;
+        distance += static_cast<uint32_t>((v * 0x0101010101010101ull) >> 56);
+    }
+    return distance;
+}
+
+void PqScoresScalar(const uint16_t* tables, uint32_t n_subspaces, const uint8_t* codes, uint32_t n_blocks,
+                    uint32_t* scores_out)
+{
+    for (uint32_t block = 0; block < n_blocks; ++block)
+    {
+        uint32_t* scores = scores_out + block * PqBlockEntries;
+        for (uint32_t e = 0; e < PqBlockEntries; ++e)
+        {
+            scores[e] = 0;
+        }
+        for (uint32_t m = 0; m < n_subspaces; ++m)
+        {
+            const uint16_t* table = tables + m * 256;
+            for (uint32_t e = 0; e < PqBlockEntries; ++e)
+            {
+                scores[e] += table[codes[e]];
+            }
+            codes += PqBlockEntries;
+        }
+    }
+}
+
+// one coordinate of BlendVectors(): (2*w*average + 2*new +/- (w+1)) / (2*(w+1)), truncated
+static inline short BlendValue(short average, short new_value, int history_weight)
+{
+    const int32_t round_value = history_weight + 1;
+    int32_t v = 2 * history_weight * static_cast<int32_t>(average) + 2 * static_cast<int32_t>(new_value);
+    v = (v >= 0) ? (v + round_value) : (v - round_value);
+    return static_cast<short>(v / (2 * round_value));
+}
+
+// blend the elements in [start, vec_length)
+static void BlendTail(short* average, const short* new_vec, uint32_t start, uint32_t vec_length, int history_weight)
+{
+    for (uint32_t i = start; i < vec_length; ++i)
+    {
+        average[i] = BlendValue(average[i], new_vec[i], history_weight);
+    }
+}
+
+void BlendVectorsScalar(short* average, const short* new_vec, uint32_t vec_length, int history_weight)
+{
+    BlendTail(average, new_vec, 0, vec_length, history_weight);
+}
+
+void BlendVectorsNccSumsScalar(short* average, const short* new_vec, uint32_t vec_length, int history_weight,
+                               NccSums& sums)
+{
+    BlendVectorsScalar(average, new_vec, vec_length, history_weight);
+    ComputeNccSumsScalar(average, new_vec, vec_length, sums);
+}
+
+#ifdef RSID_MATCHER_X86
+
+static uint32_t HorizontalSum128(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(v));
+}
+
+// SSE2 is part of the x86-64 baseline, so this one needs no runtime check.
+static void ComputeNccSumsSse2(const short* T1, const short* T2, uint32_t vec_length, NccSums& sums)
+{
+    __m128i corr = _mm_setzero_si128();
+    __m128i norm1 = _mm_setzero_si128();
+    __m128i norm2 = _mm_setzero_si128();
+
+    uint32_t i = 0;
+    for (; i + 8 <= vec_length; i += 8)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(T1 + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(T2 + i));
+        corr = _mm_add_epi32(corr, _mm_madd_epi16(a, b));
+        norm1 = _mm_add_epi32(norm1, _mm_madd_epi16(a, a));
+        norm2 = _mm_add_epi32(norm2, _mm_madd_epi16(b, b));
+    }
+
+    sums.corr = static_cast<int32_t>(HorizontalSum128(corr));
+    sums.norm1 = HorizontalSum128(norm1);
+    sums.norm2 = HorizontalSum128(norm2);
+    AccumulateTail(T1, T2, i, vec_length, sums);
+}
+
+static int32_t ComputeCorrSse2(const short* T1, const short* T2, uint32_t vec_length)
+{
+    __m128i corr = _mm_setzero_si128();
+
+    uint32_t i = 0;
+    for (; i + 8 <= vec_length; i += 8)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(T1 + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(T2 + i));
+        corr = _mm_add_epi32(corr, _mm_madd_epi16(a, b));
+    }
+
+    return static_cast<int32_t>(AccumulateCorrTail(T1, T2, i, vec_length, HorizontalSum128(corr)));
+}
+
+static void ComputeCorrBatchSse2(const short* const* probes, uint32_t n_probes, const short* T2,
+                                 uint32_t vec_length, int32_t* corr_out)
+{
+    __m128i corr[MaxBatchProbes];
+    for (uint32_t p = 0; p < n_probes; ++p)
+        corr[p] = _mm_setzero_si128();
+
+    uint32_t i = 0;
+    for (; i + 8 <= vec_length; i += 8)
+    {
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(T2 + i));
+        for (uint32_t p = 0; p < n_probes; ++p)
+        {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(probes[p] + i));
+            corr[p] = _mm_add_epi32(corr[p], _mm_madd_epi16(a, b));
+        }
+    }
+
+    for (uint32_t p = 0; p < n_probes; ++p)
+    {
+        uint32_t sum = AccumulateCorrTail(probes[p], T2, i, vec_length, HorizontalSum128(corr[p]));
+        corr_out[p] = static_cast<int32_t>(sum);
+    }
+}
+
+// sign extend the low/high 8 bytes to 16 bit lanes (SSE2 has no pmovsxbw)
+static inline __m128i Int8LowToInt16(__m128i v)
+{
+    return _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8);
+}
+
+static inline __m128i Int8HighToInt16(__m128i v)
+{
+    return _mm_srai_epi16(_mm_unpackhi_epi8(v, v), 8);
+}
+
+static int32_t ComputeCorrInt8Sse2(const int8_t* T1, const int8_t* T2, uint32_t vec_length)
+{
+    __m128i corr = _mm_setzero_si128();
+
+    uint32_t i = 0;
+    for (; i + 16 <= vec_length; i += 16)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(T1 + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(T2 + i));
+        corr = _mm_add_epi32(corr, _mm_madd_epi16(Int8LowToInt16(a), Int8LowToInt16(b)));
+        corr = _mm_add_epi32(corr, _mm_madd_epi16(Int8HighToInt16(a), Int8HighToInt16(b)));
+    }
+
+    int32_t sum = static_cast<int32_t>(HorizontalSum128(corr));
+    return sum + ComputeCorrInt8Scalar(T1 + i, T2 + i, vec_length - i);
+}
+
+// 4 blended values from v = 2*w*average + 2*new: add the rounding term away from zero, then divide.
+// |v| < 2^24, so it converts to float exactly and the correctly rounded quotient never crosses an integer
+// (it is at least 1/(2*(w+1)) away from the next one): truncating it gives the exact integer division.
+static inline __m128i BlendRoundSse2(__m128i v, __m128i round_value, __m128 divisor)
+{
+    const __m128i sign = _mm_srai_epi32(v, 31);
+    v = _mm_add_epi32(v, _mm_sub_epi32(_mm_xor_si128(round_value, sign), sign));
+    return _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(v), divisor));
+}
+
+// 8 blended values: the (average, new) pairs are multiplied by (2*w, 2) and summed by pmaddwd.
+static inline __m128i BlendSse2(__m128i a, __m128i b, __m128i weights, __m128i round_value, __m128 divisor)
+{
+    const __m128i lo = BlendRoundSse2(_mm_madd_epi16(_mm_unpacklo_epi16(a, b), weights), round_value, divisor);
+    const __m128i hi = BlendRoundSse2(_mm_madd_epi16(_mm_unpackhi_epi16(a, b), weights), round_value, divisor);
+    return _mm_packs_epi32(lo, hi); // the blended values are in the range of the inputs, so never saturated
+}
+
+static void BlendVectorsSse2(short* average, const short* new_vec, uint32_t vec_length, int history_weight)
+{
+    const __m128i weights = _mm_set1_epi32((2 << 16) | (2 * history_weight));
+    const __m128i round_value = _mm_set1_epi32(history_weight + 1);
+    const __m128 divisor = _mm_set1_ps(static_cast<float>(2 * (history_weight + 1)));
+
+    uint32_t i = 0;
+    for (; i + 8 <= vec_length; i += 8)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(average + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(new_vec + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(average + i), BlendSse2(a, b, weights, round_value, divisor));
+    }
+
+    BlendTail(average, new_vec, i, vec_length, history_weight);
+}
+
+static void BlendVectorsNccSumsSse2(short* average, const short* new_vec, uint32_t vec_length, int history_weight,
+                                    NccSums& sums)
+{
+    const __m128i weights = _mm_set1_epi32((2 << 16) | (2 * history_weight));
+    const __m128i round_value = _mm_set1_epi32(history_weight + 1);
+    const __m128 divisor = _mm_set1_ps(static_cast<float>(2 * (history_weight + 1)));
+    __m128i corr = _mm_setzero_si128();
+    __m128i norm1 = _mm_setzero_si128();
+    __m128i norm2 = _mm_setzero_si128();
+
+    uint32_t i = 0;
+    for (; i + 8 <= vec_length; i += 8)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(average + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(new_vec + i));
+        a = BlendSse2(a, b, weights, round_value, divisor);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(average + i), a);
+        corr = _mm_add_epi32(corr, _mm_madd_epi16(a, b));
+        norm1 = _mm_add_epi32(norm1, _mm_madd_epi16(a, a));
+        norm2 = _mm_add_epi32(norm2, _mm_madd_epi16(b, b));
+    }
+
+    BlendTail(average, new_vec, i, vec_length, history_weight);
+    sums.corr = static_cast<int32_t>(HorizontalSum128(corr));
+    sums.norm1 = HorizontalSum128(norm1);
+    sums.norm2 = HorizontalSum128(norm2);
+    AccumulateTail(average, new_vec, i, vec_length, sums);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#define RSID_TARGET_AVX2 __attribute__((target("avx2")))
+#define RSID_TARGET_POPCNT __attribute__((target("popcnt")))
+#else
+#define RSID_TARGET_AVX2
+#define RSID_TARGET_POPCNT
+#endif
+
+RSID_TARGET_AVX2 static uint32_t HorizontalSum256(__m256i v)
+{
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(sum));
+}
+
+RSID_TARGET_AVX2 static void ComputeNccSumsAvx2(const short* T1, const short* T2, uint32_t vec_length,
+                                                NccSums& sums)
+{
+    __m256i corr = _mm256_setzero_si256();
+    __m256i norm1 = _mm256_setzero_si256();
+    __m256i norm2 = _mm256_setzero_si256();
+
+    uint32_t i = 0;
+    for (; i + 16 <= vec_length; i += 16)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(T1 + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(T2 + i));
+        corr = _mm256_add_epi32(corr, _mm256_madd_epi16(a, b));
+        norm1 = _mm256_add_epi32(norm1, _mm256_madd_epi16(a, a));
+        norm2 = _mm256_add_epi32(norm2, _mm256_madd_epi16(b, b));
+    }
+
+    sums.corr = static_cast<int32_t>(HorizontalSum256(corr));
+    sums.norm1 = HorizontalSum256(norm1);
+    sums.norm2 = HorizontalSum256(norm2);
+    AccumulateTail(T1, T2, i, vec_length, sums);
+}
+
+RSID_TARGET_AVX2 static int32_t ComputeCorrAvx2(const short* T1, const short* T2, uint32_t vec_length)
+{
+    // two independent accumulators to hide the madd latency
+    __m256i corr0 = _mm256_setzero_si256();
+    __m256i corr1 = _mm256_setzero_si256();
+
+    uint32_t i = 0;
+    for (; i + 32 <= vec_length; i += 32)
+    {
+        __m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(T1 + i));
+        __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(T2 + i));
+        __m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(T1 + i + 16));
+        __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(T2 + i + 16));
+        corr0 = _mm256_add_epi32(corr0, _mm256_madd_epi16(a0, b0));
+        corr1 = _mm256_add_epi32(corr1, _mm256_madd_epi16(a1, b1));
+    }
+    for (; i + 16 <= vec_length; i += 16)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(T1 + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(T2 + i));
+        corr0 = _mm256_add_epi32(corr0, _mm256_madd_epi16(a, b));
+    }
+
+    uint32_t corr = HorizontalSum256(_mm256_add_epi32(corr0, corr1));
+    return static_cast<int32_t>(AccumulateCorrTail(T1, T2, i, vec_length, corr));
+}
+
+RSID_TARGET_AVX2 static void ComputeCorrBatchAvx2(const short* const* probes, uint32_t n_probes, const short* T2,
+                                                  uint32_t vec_length, int32_t* corr_out)
+{
+    __m256i corr[MaxBatchProbes];
+    for (uint32_t p = 0; p < n_probes; ++p)
+        corr[p] = _mm256_setzero_si256();
+
+    uint32_t i = 0;
+    for (; i + 16 <= vec_length; i += 16)
+    {
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(T2 + i));
+        for (uint32_t p = 0; p < n_probes; ++p)
+        {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(probes[p] + i));
+            corr[p] = _mm256_add_epi32(corr[p], _mm256_madd_epi16(a, b));
+        }
+    }
+
+    for (uint32_t p = 0; p < n_probes; ++p)
+    {
+        uint32_t sum = AccumulateCorrTail(probes[p], T2, i, vec_length, HorizontalSum256(corr[p]));
+        corr_out[p] = static_cast<int32_t>(sum);
+    }
+}
+
+RSID_TARGET_AVX2 static int32_t ComputeCorrInt8Avx2(const int8_t* T1, const int8_t* T2, uint32_t vec_length)
+{
+    __m256i corr = _mm256_setzero_si256();
+
+    uint32_t i = 0;
+    for (; i + 16 <= vec_length; i += 16)
+    {
+        __m256i a = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(T1 + i)));
+        __m256i b = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(T2 + i)));
+        corr = _mm256_add_epi32(corr, _mm256_madd_epi16(a, b));
+    }
+
+    int32_t sum = static_cast<int32_t>(HorizontalSum256(corr));
+    return sum + ComputeCorrInt8Scalar(T1 + i, T2 + i, vec_length - i);
+}
+
+// every cpu with avx2 also has popcnt (sse2 only cpus may not, they use the scalar loop)
+RSID_TARGET_POPCNT static uint32_t HammingDistancePopcnt(const uint64_t* T1, const uint64_t* T2, uint32_t n_words)
+{
+    uint32_t distance = 0;
+    for (uint32_t i = 0; i < n_words; ++i)
+    {
+        const uint64_t v = T1[i] ^ T2[i];
+#if defined(_M_X64) || defined(__x86_64__)
+        distance += static_cast<uint32_t>(_mm_popcnt_u64(v));
+#else
+        distance += static_cast<uint32_t>(_mm_popcnt_u32(static_cast<uint32_t>(v)));
+        distance += static_cast<uint32_t>(_mm_popcnt_u32(static_cast<uint32_t>(v >> 32)));
+#endif
+    }
+    return distance;
+}
+
+// a 256 entry table does not fit a byte shuffle (16 entries), so the 8 entries of a block look up their codes with a
+// single gather per subspace. The gather reads 32 bits at each 16 bit entry (hence the table's padding value) and the
+// high half is masked off. Two accumulators, for the even and odd subspaces, hide the gather latency.
+RSID_TARGET_AVX2 static void PqScoresAvx2(const uint16_t* tables, uint32_t n_subspaces, const uint8_t* codes,
+                                          uint32_t n_blocks, uint32_t* scores_out)
+{
+    const __m256i low_half = _mm256_set1_epi32(0xFFFF);
+    const auto* base = reinterpret_cast<const int*>(tables);
+    for (uint32_t block = 0; block < n_blocks; ++block)
+    {
+        __m256i even = _mm256_setzero_si256();
+        __m256i odd = _mm256_setzero_si256();
+        uint32_t m = 0;
+        for (; m + 2 <= n_subspaces; m += 2)
+        {
+            __m256i index0 = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(codes)));
+            __m256i index1 =
+                _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(codes + PqBlockEntries)));
+            index0 = _mm256_add_epi32(index0, _mm256_set1_epi32(static_cast<int>(m * 256)));
+            index1 = _mm256_add_epi32(index1, _mm256_set1_epi32(static_cast<int>((m + 1) * 256)));
+            even = _mm256_add_epi32(even, _mm256_and_si256(_mm256_i32gather_epi32(base, index0, 2), low_half));
+            odd = _mm256_add_epi32(odd, _mm256_and_si256(_mm256_i32gather_epi32(base, index1, 2), low_half));
+            codes += 2 * PqBlockEntries;
+        }
+        for (; m < n_subspaces; ++m)
+        {
+            __m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(codes)));
+            index = _mm256_add_epi32(index, _mm256_set1_epi32(static_cast<int>(m * 256)));
+            even = _mm256_add_epi32(even, _mm256_and_si256(_mm256_i32gather_epi32(base, index, 2), low_half));
+            codes += PqBlockEntries;
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(scores_out + block * PqBlockEntries),
+                            _mm256_add_epi32(even, odd));
+    }
+}
+
+RSID_TARGET_AVX2 static inline __m256i BlendRoundAvx2(__m256i v, __m256i round_value, __m256 divisor)
+{
+    const __m256i sign = _mm256_srai_epi32(v, 31);
+    v = _mm256_add_epi32(v, _mm256_sub_epi32(_mm256_xor_si256(round_value, sign), sign));
+    return _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(v), divisor));
+}
+
+// unpack and pack work within the 128 bit lanes, so the 16 values come back in order.
+RSID_TARGET_AVX2 static inline __m256i BlendAvx2(__m256i a, __m256i b, __m256i weights, __m256i round_value,
+                                                 __m256 divisor)
+{
+    const __m256i lo =
+        BlendRoundAvx2(_mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), weights), round_value, divisor);
+    const __m256i hi =
+        BlendRoundAvx2(_mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), weights), round_value, divisor);
+    return _mm256_packs_epi32(lo, hi);
+}
+
+RSID_TARGET_AVX2 static void BlendVectorsAvx2(short* average, const short* new_vec, uint32_t vec_length,
+                                              int history_weight)
+{
+    const __m256i weights = _mm256_set1_epi32((2 << 16) | (2 * history_weight));
+    const __m256i round_value = _mm256_set1_epi32(history_weight + 1);
+    const __m256 divisor = _mm256_set1_ps(static_cast<float>(2 * (history_weight + 1)));
+
+    uint32_t i = 0;
+    for (; i + 16 <= vec_length; i += 16)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(average + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(new_vec + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(average + i), BlendAvx2(a, b, weights, round_value, divisor));
+    }
+
+    BlendTail(average, new_vec, i, vec_length, history_weight);
+}
+
+RSID_TARGET_AVX2 static void BlendVectorsNccSumsAvx2(short* average, const short* new_vec, uint32_t vec_length,
+                                                     int history_weight, NccSums& sums)
+{
+    const __m256i weights = _mm256_set1_epi32((2 << 16) | (2 * history_weight));
+    const __m256i round_value = _mm256_set1_epi32(history_weight + 1);
+    const __m256 divisor = _mm256_set1_ps(static_cast<float>(2 * (history_weight + 1)));
+    __m256i corr = _mm256_setzero_si256();
+    __m256i norm1 = _mm256_setzero_si256();
+    __m256i norm2 = _mm256_setzero_si256();
+
+    uint32_t i = 0;
+    for (; i + 16 <= vec_length; i += 16)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(average + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(new_vec + i));
+        a = BlendAvx2(a, b, weights, round_value, divisor);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(average + i), a);
+        corr = _mm256_add_epi32(corr, _mm256_madd_epi16(a, b));
+        norm1 = _mm256_add_epi32(norm1, _mm256_madd_epi16(a, a));
+        norm2 = _mm256_add_epi32(norm2, _mm256_madd_epi16(b, b));
+    }
+
+    BlendTail(average, new_vec, i, vec_length, history_weight);
+    sums.corr = static_cast<int32_t>(HorizontalSum256(corr));
+    sums.norm1 = HorizontalSum256(norm1);
+    sums.norm2 = HorizontalSum256(norm2);
+    AccumulateTail(average, new_vec, i, vec_length, sums);
+}
+
+#endif // RSID_MATCHER_X86
+
+#ifdef RSID_MATCHER_NEON
+static void ComputeNccSumsNeon(const short* T1, const short* T2, uint32_t vec_length, NccSums& sums)
+{
+    int32x4_t corr = vdupq_n_s32(0);
+    int32x4_t norm1 = vdupq_n_s32(0);
+    int32x4_t norm2 = vdupq_n_s32(0);
+
+    uint32_t i = 0;
+    for (; i + 8 <= vec_length; i += 8)
+    {
+        int16x8_t a = vld1q_s16(T1 + i);
+        int16x8_t b = vld1q_s16(T2 + i);
+        corr = vmlal_s16(corr, vget_low_s16(a), vget_low_s16(b));
+        corr = vmlal_high_s16(corr, a, b);
+        norm1 = vmlal_s16(norm1, vget_low_s16(a), vget_low_s16(a));
+        norm1 = vmlal_high_s16(norm1, a, a);
+        norm2 = vmlal_s16(norm2, vget_low_s16(b), vget_low_s16(b));
+        norm2 = vmlal_high_s16(norm2, b, b);
+    }
+
+    sums.corr = static_cast<int32_t>(vaddvq_u32(vreinterpretq_u32_s32(corr)));
+    sums.norm1 = vaddvq_u32(vreinterpretq_u32_s32(norm1));
+    sums.norm2 = vaddvq_u32(vreinterpretq_u32_s32(norm2));
+    AccumulateTail(T1, T2, i, vec_length, sums);
+}
+
+static int32_t ComputeCorrNeon(const short* T1, const short* T2, uint32_t vec_length)
+{
+    int32x4_t corr = vdupq_n_s32(0);
+
+    uint32_t i = 0;
+    for (; i + 8 <= vec_length; i += 8)
+    {
+        int16x8_t a = vld1q_s16(T1 + i);
+        int16x8_t b = vld1q_s16(T2 + i);
+        corr = vmlal_s16(corr, vget_low_s16(a), vget_low_s16(b));
+        corr = vmlal_high_s16(corr, a, b);
+    }
+
+    uint32_t sum = vaddvq_u32(vreinterpretq_u32_s32(corr));
+    return static_cast<int32_t>(AccumulateCorrTail(T1, T2, i, vec_length, sum));
+}
+
+static void ComputeCorrBatchNeon(const short* const* probes, uint32_t n_probes, const short* T2,
+                                 uint32_t vec_length, int32_t* corr_out)
+{
+    int32x4_t corr[MaxBatchProbes];
+    for (uint32_t p = 0; p < n_probes; ++p)
+        corr[p] = vdupq_n_s32(0);
+
+    uint32_t i = 0;
+    for (; i + 8 <= vec_length; i += 8)
+    {
+        int16x8_t b = vld1q_s16(T2 + i);
+        for (uint32_t p = 0; p < n_probes; ++p)
+        {
+            int16x8_t a = vld1q_s16(probes[p] + i);
+            corr[p] = vmlal_s16(corr[p], vget_low_s16(a), vget_low_s16(b));
+            corr[p] = vmlal_high_s16(corr[p], a, b);
+        }
+    }
+
+    for (uint32_t p = 0; p < n_probes; ++p)
+    {
+        uint32_t sum = vaddvq_u32(vreinterpretq_u32_s32(corr[p]));
+        corr_out[p] = static_cast<int32_t>(AccumulateCorrTail(probes[p], T2, i, vec_length, sum));
+    }
+}
+
+static int32_t ComputeCorrInt8Neon(const int8_t* T1, const int8_t* T2, uint32_t vec_length)
+{
+    int32x4_t corr = vdupq_n_s32(0);
+
+    uint32_t i = 0;
+    for (; i + 16 <= vec_length; i += 16)
+    {
+        int8x16_t a = vld1q_s8(T1 + i);
+        int8x16_t b = vld1q_s8(T2 + i);
+        corr = vpadalq_s16(corr, vmull_s8(vget_low_s8(a), vget_low_s8(b)));
+        corr = vpadalq_s16(corr, vmull_high_s8(a, b));
+    }
+
+    return vaddvq_s32(corr) + ComputeCorrInt8Scalar(T1 + i, T2 + i, vec_length - i);
+}
+static uint32_t HammingDistanceNeon(const uint64_t* T1, const uint64_t* T2, uint32_t n_words)
+{
+    uint32_t distance = 0;
+    uint32_t i = 0;
+    for (; i + 2 <= n_words; i += 2)
+    {
+        uint8x16_t v = vreinterpretq_u8_u64(veorq_u64(vld1q_u64(T1 + i), vld1q_u64(T2 + i)));
+        distance += vaddvq_u8(vcntq_u8(v)); // at most 128
+    }
+    return distance + HammingDistanceScalar(T1 + i, T2 + i, n_words - i);
+}
+
+// see BlendRoundSse2()
+static inline int32x4_t BlendRoundNeon(int32x4_t v, int32x4_t round_value, float32x4_t divisor)
+{
+    const int32x4_t sign = vshrq_n_s32(v, 31);
+    v = vaddq_s32(v, vsubq_s32(veorq_s32(round_value, sign), sign));
+    return vcvtq_s32_f32(vdivq_f32(vcvtq_f32_s32(v), divisor));
+}
+
+static inline int16x8_t BlendNeon(int16x8_t a, int16x8_t b, int history_weight, int32x4_t round_value,
+                                  float32x4_t divisor)
+{
+    const int16_t weight = static_cast<int16_t>(2 * history_weight);
+    int32x4_t lo = vmlal_n_s16(vmull_n_s16(vget_low_s16(a), weight), vget_low_s16(b), 2);
+    int32x4_t hi = vmlal_n_s16(vmull_n_s16(vget_high_s16(a), weight), vget_high_s16(b), 2);
+    lo = BlendRoundNeon(lo, round_value, divisor);
+    hi = BlendRoundNeon(hi, round_value, divisor);
+    return vcombine_s16(vmovn_s32(lo), vmovn_s32(hi));
+}
+
+static void BlendVectorsNeon(short* average, const short* new_vec, uint32_t vec_length, int history_weight)
+{
+    const int32x4_t round_value = vdupq_n_s32(history_weight + 1);
+    const float32x4_t divisor = vdupq_n_f32(static_cast<float>(2 * (history_weight + 1)));
+
+    uint32_t i = 0;
+    for (; i + 8 <= vec_length; i += 8)
+    {
+        int16x8_t a = vld1q_s16(average + i);
+        int16x8_t b = vld1q_s16(new_vec + i);
+        vst1q_s16(average + i, BlendNeon(a, b, history_weight, round_value, divisor));
+    }
+
+    BlendTail(average, new_vec, i, vec_length, history_weight);
+}
+
+static void BlendVectorsNccSumsNeon(short* average, const short* new_vec, uint32_t vec_length, int history_weight,
+                                    NccSums& sums)
+{
+    const int32x4_t round_value = vdupq_n_s32(history_weight + 1);
+    const float32x4_t divisor = vdupq_n_f32(static_cast<float>(2 * (history_weight + 1)));
+    int32x4_t corr = vdupq_n_s32(0);
+    int32x4_t norm1 = vdupq_n_s32(0);
+    int32x4_t norm2 = vdupq_n_s32(0);
+
+    uint32_t i = 0;
+    for (; i + 8 <= vec_length; i += 8)
+    {
+        int16x8_t b = vld1q_s16(new_vec + i);
+        int16x8_t a = BlendNeon(vld1q_s16(average + i), b, history_weight, round_value, divisor);
+        vst1q_s16(average + i, a);
+        corr = vmlal_s16(corr, vget_low_s16(a), vget_low_s16(b));
+        corr = vmlal_high_s16(corr, a, b);
+        norm1 = vmlal_s16(norm1, vget_low_s16(a), vget_low_s16(a));
+        norm1 = vmlal_high_s16(norm1, a, a);
+        norm2 = vmlal_s16(norm2, vget_low_s16(b), vget_low_s16(b));
+        norm2 = vmlal_high_s16(norm2, b, b);
+    }
+
+    BlendTail(average, new_vec, i, vec_length, history_weight);
+    sums.corr = static_cast<int32_t>(vaddvq_u32(vreinterpretq_u32_s32(corr)));
+    sums.norm1 = vaddvq_u32(vreinterpretq_u32_s32(norm1));
+    sums.norm2 = vaddvq_u32(vreinterpretq_u32_s32(norm2));
+    AccumulateTail(average, new_vec, i, vec_length, sums);
+}
+#endif // RSID_MATCHER_NEON
+
+struct KernelEntry
+{
+    kernel_fn fn;
+    corr_kernel_fn corr_fn;
+    corr_batch_kernel_fn corr_batch_fn;
+    corr_int8_kernel_fn corr_int8_fn;
+    hamming_kernel_fn hamming_fn;
+    pq_scores_kernel_fn pq_scores_fn;
+    blend_kernel_fn blend_fn;
+    blend_sums_kernel_fn blend_sums_fn;
+    const char* name;
+};
+
+static KernelEntry SelectKernel()
+{
+#if defined(RSID_MATCHER_X86)
+    if (CpuFeatures::Has(CpuFeatures::Avx2) && CpuFeatures::Has(CpuFeatures::Popcnt))
+        return {ComputeNccSumsAvx2,    ComputeCorrAvx2, ComputeCorrBatchAvx2, ComputeCorrInt8Avx2,
+                HammingDistancePopcnt, PqScoresAvx2,    BlendVectorsAvx2,     BlendVectorsNccSumsAvx2,
+                "avx2"};
+    if (CpuFeatures::Has(CpuFeatures::Sse2))
+        return {ComputeNccSumsSse2,
+                ComputeCorrSse2,
+                ComputeCorrBatchSse2,
+                ComputeCorrInt8Sse2,
+                CpuFeatures::Has(CpuFeatures::Popcnt) ? HammingDistancePopcnt : HammingDistanceScalar,
+                PqScoresScalar,
+                BlendVectorsSse2,
+                BlendVectorsNccSumsSse2,
+                "sse2"};
+#elif defined(RSID_MATCHER_NEON)
+    // no gather on neon: the scalar lookups
+    if (CpuFeatures::Has(CpuFeatures::Neon))
+        return {ComputeNccSumsNeon,  ComputeCorrNeon, ComputeCorrBatchNeon, ComputeCorrInt8Neon,
+                HammingDistanceNeon, PqScoresScalar,  BlendVectorsNeon,     BlendVectorsNccSumsNeon,
+                "neon"};
+#endif
+    return {ComputeNccSumsScalar,  ComputeCorrScalar, ComputeCorrBatchScalar, ComputeCorrInt8Scalar,
+            HammingDistanceScalar, PqScoresScalar,    BlendVectorsScalar,     BlendVectorsNccSumsScalar,
+            "scalar"};
+}
+
+static const KernelEntry& ActiveKernel()
+{
+    static const KernelEntry kernel = SelectKernel();
+    return kernel;
+}
+
+void ComputeNccSums(const short* T1, const short* T2, uint32_t vec_length, NccSums& sums)
+{
+    ActiveKernel().fn(T1, T2, vec_length, sums);
+}
+
+int32_t ComputeCorr(const short* T1, const short* T2, uint32_t vec_length)
+{
+    return ActiveKernel().corr_fn(T1, T2, vec_length);
+}
+
+void ComputeCorrBatch(const short* const* probes, uint32_t n_probes, const short* T2, uint32_t vec_length,
+                      int32_t* corr_out)
+{
+    ActiveKernel().corr_batch_fn(probes, n_probes, T2, vec_length, corr_out);
+}
+
+int32_t ComputeCorrInt8(const int8_t* T1, const int8_t* T2, uint32_t vec_length)
+{
+    return ActiveKernel().corr_int8_fn(T1, T2, vec_length);
+}
+
+uint32_t HammingDistance(const uint64_t* T1, const uint64_t* T2, uint32_t n_words)
+{
+    return ActiveKernel().hamming_fn(T1, T2, n_words);
+}
+
+void PqScores(const uint16_t* tables, uint32_t n_subspaces, const uint8_t* codes, uint32_t n_blocks,
+              uint32_t* scores_out)
+{
+    ActiveKernel().pq_scores_fn(tables, n_subspaces, codes, n_blocks, scores_out);
+}
+
+void BlendVectors(short* average, const short* new_vec, uint32_t vec_length, int history_weight)
+{
+    ActiveKernel().blend_fn(average, new_vec, vec_length, history_weight);
+}
+
+void BlendVectorsNccSums(short* average, const short* new_vec, uint32_t vec_length, int history_weight,
+                         NccSums& sums)
+{
+    ActiveKernel().blend_sums_fn(average, new_vec, vec_length, history_weight, sums);
+}
+
+const char* ActiveKernelName()
+{
+    return ActiveKernel().name;
+}
+} // namespace MatcherKernels
+} // namespace RealSenseID
@@ -0,0 +1,80 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include <stdint.h>
+
+namespace RealSenseID
+{
+namespace MatcherKernels
+{
+// Raw sums needed by the fixed-point ncc in Matcher::MatchTwoVectors().
+// All sums are accumulated modulo 2^32, exactly like the scalar reference loop, so every
+// kernel below produces bit-identical results for any input.
+struct NccSums
+{
+    int32_t corr = 0;
+    uint32_t norm1 = 0;
+    uint32_t norm2 = 0;
+};
+
+// Compute corr = sum(T1*T2), norm1 = sum(T1*T1), norm2 = sum(T2*T2).
+// Dispatches (once, at first call) to the best kernel supported by the running cpu (see CpuFeatures.h):
+// AVX2 / SSE2 on x86, NEON on ARM64 and a portable scalar loop otherwise.
+void ComputeNccSums(const short* T1, const short* T2, uint32_t vec_length, NccSums& sums);
+
+// Compute only corr = sum(T1*T2). Used when both norms are already known (e.g. cached in MatcherGallery).
+int32_t ComputeCorr(const short* T1, const short* T2, uint32_t vec_length);
+
+// Max number of probes handled by a single ComputeCorrBatch() call.
+static constexpr uint32_t MaxBatchProbes = 8;
+
+// Compute corr_out[p] = sum(probes[p]*T2) for n_probes (<= MaxBatchProbes) probes.
+// T2 is loaded once for all probes, so a gallery row is streamed from memory once per batch.
+void ComputeCorrBatch(const short* const* probes, uint32_t n_probes, const short* T2, uint32_t vec_length,
+                      int32_t* corr_out);
+
+// Compute sum(T1*T2) of two int8 vectors (used by the quantized prefilter).
+int32_t ComputeCorrInt8(const int8_t* T1, const int8_t* T2, uint32_t vec_length);
+
+// Number of different bits of two bit strings of n_words 64 bit words (used by the sign prefilter).
+uint32_t HammingDistance(const uint64_t* T1, const uint64_t* T2, uint32_t n_words);
+
+// Number of entries whose codes are interleaved in a block of the product quantized codes (see PqScores()).
+static constexpr uint32_t PqBlockEntries = 8;
+
+// Asymmetric distance scores of product quantized codes (used by the pq index): for each entry e of n_blocks blocks,
+//   scores_out[e] = sum over subspace m of tables[m*256 + code(e, m)]
+// A block holds n_subspaces x PqBlockEntries 8 bit codes, subspace major (the codes of subspace m of the block's
+// entries are contiguous). tables has n_subspaces x 256 values and one more of padding, n_subspaces * 65535 must fit
+// 32 bits.
+void PqScores(const uint16_t* tables, uint32_t n_subspaces, const uint8_t* codes, uint32_t n_blocks,
+              uint32_t* scores_out);
+
+// Blend new_vec into average (the adaptive update of Matcher::BlendAverageVector()):
+//   average[i] = round((history_weight*average[i] + new_vec[i]) / (history_weight+1)), halves away from zero.
+// history_weight must be in [1, 127]. Every kernel produces the same values as the scalar integer division.
+void BlendVectors(short* average, const short* new_vec, uint32_t vec_length, int history_weight);
+
+// BlendVectors(), then the ncc sums of the blended average (T1) and new_vec (T2) - in the same pass.
+void BlendVectorsNccSums(short* average, const short* new_vec, uint32_t vec_length, int history_weight,
+                         NccSums& sums);
+
+// Scalar reference implementations (always available).
+void ComputeNccSumsScalar(const short* T1, const short* T2, uint32_t vec_length, NccSums& sums);
+int32_t ComputeCorrScalar(const short* T1, const short* T2, uint32_t vec_length);
+void ComputeCorrBatchScalar(const short* const* probes, uint32_t n_probes, const short* T2, uint32_t vec_length,
+                            int32_t* corr_out);
+int32_t ComputeCorrInt8Scalar(const int8_t* T1, const int8_t* T2, uint32_t vec_length);
+uint32_t HammingDistanceScalar(const uint64_t* T1, const uint64_t* T2, uint32_t n_words);
+void PqScoresScalar(const uint16_t* tables, uint32_t n_subspaces, const uint8_t* codes, uint32_t n_blocks,
+                    uint32_t* scores_out);
+void BlendVectorsScalar(short* average, const short* new_vec, uint32_t vec_length, int history_weight);
+void BlendVectorsNccSumsScalar(short* average, const short* new_vec, uint32_t vec_length, int history_weight,
+                               NccSums& sums);
+
+// Name of the kernel selected by ComputeNccSums() ("avx2", "sse2", "neon" or "scalar").
+const char* ActiveKernelName();
+} // namespace MatcherKernels
+} // namespace RealSenseID
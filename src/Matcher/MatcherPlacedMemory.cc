@@ -0,0 +1,113 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "MatcherPlacedMemory.h"
+#include "Logger.h"
+#include <new>
+#include <stdint.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace RealSenseID
+{
+static const char* LOG_TAG = "MatcherPlacedMemory";
+
+constexpr size_t MatcherPlacedMemory::HugePageSize;
+
+MatcherPlacedMemory::MatcherPlacedMemory(size_t size, bool huge_pages)
+{
+    _size = (size + HugePageSize - 1) / HugePageSize * HugePageSize;
+    if (_size == 0)
+    {
+        return;
+    }
+#ifdef _WIN32
+    // committed pages get physical memory on first touch. large pages are committed (and locked) up front.
+    if (huge_pages)
+    {
+        const size_t large_page_size = ::GetLargePageMinimum();
+        if (large_page_size > 0 && _size % large_page_size == 0)
+        {
+            _data = ::VirtualAlloc(nullptr, _size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+            _huge_pages = _data != nullptr;
+        }
+        if (!_huge_pages)
+        {
+            LOG_WARNING(LOG_TAG, "Large pages not available (needs the lock pages in memory privilege)");
+        }
+    }
+    if (_data == nullptr)
+    {
+        _data = ::VirtualAlloc(nullptr, _size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    }
+    if (_data == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+#else
+    // map a huge page more and trim, for a huge page aligned block
+    const size_t mapped_size = _size + HugePageSize;
+    void* mapping = ::mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+    {
+        throw std::bad_alloc();
+    }
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(mapping);
+    const uintptr_t aligned = (begin + HugePageSize - 1) & ~static_cast<uintptr_t>(HugePageSize - 1);
+    if (aligned > begin)
+    {
+        ::munmap(mapping, aligned - begin);
+    }
+    const uintptr_t end = begin + mapped_size;
+    if (end > aligned + _size)
+    {
+        ::munmap(reinterpret_cast<void*>(aligned + _size), end - aligned - _size);
+    }
+    _data = reinterpret_cast<void*>(aligned);
+
+    if (huge_pages)
+    {
+#ifdef MADV_HUGEPAGE
+        _huge_pages = ::madvise(_data, _size, MADV_HUGEPAGE) == 0;
+#endif
+        if (!_huge_pages)
+        {
+            LOG_WARNING(LOG_TAG, "Transparent huge pages not available");
+        }
+    }
+#endif
+}
+
+MatcherPlacedMemory::~MatcherPlacedMemory()
+{
+    if (_data == nullptr)
+    {
+        return;
+    }
+#ifdef _WIN32
+    ::VirtualFree(_data, 0, MEM_RELEASE);
+#else
+    ::munmap(_data, _size);
+#endif
+}
+
+void* MatcherPlacedMemory::Data() const
+{
+    return _data;
+}
+
+size_t MatcherPlacedMemory::Size() const
+{
+    return _size;
+}
+
+bool MatcherPlacedMemory::HugePages() const
+{
+    return _huge_pages;
+}
+} // namespace RealSenseID
@@ -0,0 +1,38 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include <stddef.h>
+
+namespace RealSenseID
+{
+// Memory block for the dense matrices of a large gallery, placed for the search threads.
+//
+// The pages are reserved but not touched, so each one is backed on the NUMA node of the thread that first writes it
+// (the default first touch policy of linux and windows): a gallery shard written by the thread that searches it is
+// read from local memory. With huge_pages the block is backed by 2 MB pages where the system allows it (transparent
+// huge pages on linux, large pages on windows with the lock pages privilege), for fewer TLB misses in the scans.
+class MatcherPlacedMemory
+{
+public:
+    static constexpr size_t HugePageSize = 2 * 1024 * 1024;
+
+    // size bytes, HugePageSize aligned. throws std::bad_alloc on failure.
+    MatcherPlacedMemory(size_t size, bool huge_pages);
+    ~MatcherPlacedMemory();
+
+    MatcherPlacedMemory(const MatcherPlacedMemory&) = delete;
+    MatcherPlacedMemory& operator=(const MatcherPlacedMemory&) = delete;
+
+    void* Data() const;
+    size_t Size() const;
+    // true if the block was given huge pages (or advised to use them, on linux)
+    bool HugePages() const;
+
+private:
+    void* _data = nullptr;
+    size_t _size = 0;
+    bool _huge_pages = false;
+};
+} // namespace RealSenseID
@@ -0,0 +1,321 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "MatcherPqIndex.h"
+#include "MatcherGallery.h"
+#include "MatcherKernels.h"
+#include <algorithm>
+#include <cmath>
+
+namespace RealSenseID
+{
+static_assert(MatcherPqIndex::VectorLength % MatcherPqIndex::Subspaces == 0, "subspaces must split the vector evenly");
+static_assert(MatcherPqIndex::Centroids == 256, "codes are single bytes");
+
+static constexpr size_t BlockEntries = MatcherKernels::PqBlockEntries;
+static constexpr size_t BlockBytes = MatcherPqIndex::Subspaces * BlockEntries;
+// a quantized table value is at most this, so the sum of the Subspaces tables fits 16 bits
+static constexpr float TableMax = 2047.f;
+static_assert(MatcherPqIndex::Subspaces * 2047 <= 0xFFFF, "scores must fit 16 bits");
+// the shortlist cutoff is found with a histogram of the scores at this shift (4096 bins)
+static constexpr int HistogramShift = 4;
+
+static void ToUnitVector(const feature_t* vec, float* out)
+{
+    float norm = 0.f;
+    for (size_t i = 0; i < MatcherPqIndex::VectorLength; i++)
+    {
+        out[i] = static_cast<float>(vec[i]);
+        norm += out[i] * out[i];
+    }
+    norm = std::sqrt(norm);
+    if (norm <= 0.f)
+        return;
+    for (size_t i = 0; i < MatcherPqIndex::VectorLength; i++)
+    {
+        out[i] /= norm;
+    }
+}
+
+static float SquaredDistance(const float* a, const float* b)
+{
+    float sum = 0.f;
+    for (size_t i = 0; i < MatcherPqIndex::SubspaceLength; i++)
+    {
+        const float d = a[i] - b[i];
+        sum += d * d;
+    }
+    return sum;
+}
+
+static uint8_t NearestCentroid(const float* codebook, const float* sub_vector)
+{
+    size_t best = 0;
+    float best_distance = SquaredDistance(codebook, sub_vector);
+    for (size_t c = 1; c < MatcherPqIndex::Centroids; c++)
+    {
+        const float distance = SquaredDistance(codebook + c * MatcherPqIndex::SubspaceLength, sub_vector);
+        if (distance < best_distance)
+        {
+            best_distance = distance;
+            best = c;
+        }
+    }
+    return static_cast<uint8_t>(best);
+}
+
+bool MatcherPqIndex::Build(const MatcherGallery& gallery, size_t training_size, size_t kmeans_iterations)
+{
+    Clear();
+
+    const size_t n = gallery.Size();
+    if (n == 0)
+    {
+        return false;
+    }
+
+    // training sample: evenly spaced gallery entries, as unit vectors
+    const size_t t = std::max<size_t>(1, std::min(training_size, n));
+    std::vector<float> training(t * VectorLength);
+    for (size_t s = 0; s < t; s++)
+    {
+        ToUnitVector(gallery.AdaptiveVector(s * n / t), &training[s * VectorLength]);
+    }
+
+    // k-means of each subspace, deterministic init from evenly spaced samples. empty clusters keep their centroid.
+    _codebooks.assign(Subspaces * Centroids * SubspaceLength, 0.f);
+    std::vector<uint8_t> assignment(t, 0);
+    for (size_t m = 0; m < Subspaces; m++)
+    {
+        float* codebook = &_codebooks[m * Centroids * SubspaceLength];
+        for (size_t c = 0; c < Centroids; c++)
+        {
+            const float* sub_vector = &training[(c * t / Centroids) * VectorLength + m * SubspaceLength];
+            std::copy(sub_vector, sub_vector + SubspaceLength, codebook + c * SubspaceLength);
+        }
+
+        for (size_t iter = 0; iter < kmeans_iterations; iter++)
+        {
+            bool changed = false;
+            for (size_t s = 0; s < t; s++)
+            {
+                const uint8_t c = NearestCentroid(codebook, &training[s * VectorLength + m * SubspaceLength]);
+                changed = changed || c != assignment[s] || iter == 0;
+                assignment[s] = c;
+            }
+            if (!changed)
+                break;
+
+            std::vector<float> sums(Centroids * SubspaceLength, 0.f);
+            std::vector<size_t> counts(Centroids, 0);
+            for (size_t s = 0; s < t; s++)
+            {
+                const float* sub_vector = &training[s * VectorLength + m * SubspaceLength];
+                float* sum = &sums[assignment[s] * SubspaceLength];
+                for (size_t i = 0; i < SubspaceLength; i++)
+                {
+                    sum[i] += sub_vector[i];
+                }
+                counts[assignment[s]]++;
+            }
+            for (size_t c = 0; c < Centroids; c++)
+            {
+                if (counts[c] == 0)
+                    continue;
+                for (size_t i = 0; i < SubspaceLength; i++)
+                {
+                    codebook[c * SubspaceLength + i] = sums[c * SubspaceLength + i] / static_cast<float>(counts[c]);
+                }
+            }
+        }
+    }
+
+    _codes.assign((n + BlockEntries - 1) / BlockEntries * BlockBytes, 0);
+    uint8_t code[Subspaces];
+    for (size_t idx = 0; idx < n; idx++)
+    {
+        Encode(gallery.AdaptiveVector(idx), code);
+        StoreCode(idx, code);
+    }
+    _size = n;
+    return true;
+}
+
+bool MatcherPqIndex::Add(const MatcherGallery& gallery, size_t gallery_index)
+{
+    if (!IsBuilt() || gallery_index != Size() || gallery_index >= gallery.Size())
+    {
+        return false;
+    }
+    if (_size % BlockEntries == 0)
+    {
+        _codes.resize(_codes.size() + BlockBytes, 0);
+    }
+    uint8_t code[Subspaces];
+    Encode(gallery.AdaptiveVector(gallery_index), code);
+    StoreCode(gallery_index, code);
+    _size++;
+    return true;
+}
+
+bool MatcherPqIndex::Update(const MatcherGallery& gallery, size_t gallery_index)
+{
+    if (gallery_index >= Size() || gallery_index >= gallery.Size())
+    {
+        return false;
+    }
+    uint8_t code[Subspaces];
+    Encode(gallery.AdaptiveVector(gallery_index), code);
+    StoreCode(gallery_index, code);
+    return true;
+}
+
+bool MatcherPqIndex::Remove(size_t gallery_index)
+{
+    if (gallery_index >= Size())
+    {
+        return false;
+    }
+    uint8_t code[Subspaces];
+    for (size_t idx = gallery_index; idx + 1 < _size; idx++)
+    {
+        LoadCode(idx + 1, code);
+        StoreCode(idx, code);
+    }
+    _size--;
+    _codes.resize((_size + BlockEntries - 1) / BlockEntries * BlockBytes);
+    return true;
+}
+
+void MatcherPqIndex::Clear()
+{
+    _codebooks.clear();
+    _codes.clear();
+    _size = 0;
+}
+
+bool MatcherPqIndex::IsBuilt() const
+{
+    return !_codebooks.empty();
+}
+
+size_t MatcherPqIndex::Size() const
+{
+    return _size;
+}
+
+void MatcherPqIndex::Encode(const feature_t* vec, uint8_t* code) const
+{
+    float unit[VectorLength];
+    ToUnitVector(vec, unit);
+    for (size_t m = 0; m < Subspaces; m++)
+    {
+        code[m] = NearestCentroid(&_codebooks[m * Centroids * SubspaceLength], unit + m * SubspaceLength);
+    }
+}
+
+void MatcherPqIndex::StoreCode(size_t gallery_index, const uint8_t* code)
+{
+    uint8_t* block = &_codes[gallery_index / BlockEntries * BlockBytes] + gallery_index % BlockEntries;
+    for (size_t m = 0; m < Subspaces; m++)
+    {
+        block[m * BlockEntries] = code[m];
+    }
+}
+
+void MatcherPqIndex::LoadCode(size_t gallery_index, uint8_t* code) const
+{
+    const uint8_t* block = &_codes[gallery_index / BlockEntries * BlockBytes] + gallery_index % BlockEntries;
+    for (size_t m = 0; m < Subspaces; m++)
+    {
+        code[m] = block[m * BlockEntries];
+    }
+}
+
+void MatcherPqIndex::ComputeTables(const feature_t* probe, uint16_t* tables) const
+{
+    float unit[VectorLength];
+    ToUnitVector(probe, unit);
+
+    // correlation of each probe sub-vector with each centroid of its subspace. Each table is offset by its minimum
+    // (the same for all the entries, so the ranking is kept) and all are scaled by the same factor.
+    std::vector<float> correlations(Subspaces * Centroids);
+    float widest_range = 0.f;
+    for (size_t m = 0; m < Subspaces; m++)
+    {
+        const float* codebook = &_codebooks[m * Centroids * SubspaceLength];
+        float* table = &correlations[m * Centroids];
+        for (size_t c = 0; c < Centroids; c++)
+        {
+            float corr = 0.f;
+            for (size_t i = 0; i < SubspaceLength; i++)
+            {
+                corr += unit[m * SubspaceLength + i] * codebook[c * SubspaceLength + i];
+            }
+            table[c] = corr;
+        }
+        const auto range = std::minmax_element(table, table + Centroids);
+        const float min_value = *range.first;
+        widest_range = std::max(widest_range, *range.second - min_value);
+        for (size_t c = 0; c < Centroids; c++)
+        {
+            table[c] -= min_value;
+        }
+    }
+
+    const float scale = widest_range > 0.f ? TableMax / widest_range : 0.f;
+    for (size_t i = 0; i < Subspaces * Centroids; i++)
+    {
+        tables[i] = static_cast<uint16_t>(std::lround(correlations[i] * scale));
+    }
+    tables[Subspaces * Centroids] = 0; // padding read by the gather kernel
+}
+
+void MatcherPqIndex::Search(const feature_t* probe, size_t shortlist_size, std::vector<uint32_t>& candidates) const
+{
+    candidates.clear();
+    const size_t n = Size();
+    if (n == 0)
+    {
+        return;
+    }
+
+    uint16_t tables[Subspaces * Centroids + 1];
+    ComputeTables(probe, tables);
+    const size_t n_blocks = (n + BlockEntries - 1) / BlockEntries;
+    std::vector<uint32_t> scores(n_blocks * BlockEntries);
+    MatcherKernels::PqScores(tables, static_cast<uint32_t>(Subspaces), _codes.data(), static_cast<uint32_t>(n_blocks),
+                             scores.data());
+
+    // higher scores are better: all the entries in bins above cutoff, and the first ones (by index) at cutoff
+    constexpr size_t bins = (0xFFFF >> HistogramShift) + 1;
+    std::vector<uint32_t> histogram(bins, 0);
+    for (size_t idx = 0; idx < n; idx++)
+    {
+        histogram[scores[idx] >> HistogramShift]++;
+    }
+    size_t cutoff = bins - 1;
+    size_t better = 0;
+    while (cutoff > 0 && better + histogram[cutoff] < shortlist_size)
+    {
+        better += histogram[cutoff];
+        cutoff--;
+    }
+    size_t at_cutoff = shortlist_size > better ? shortlist_size - better : 0;
+
+    candidates.reserve(std::min(shortlist_size, n));
+    for (size_t idx = 0; idx < n; idx++)
+    {
+        const size_t bin = scores[idx] >> HistogramShift;
+        if (bin > cutoff)
+        {
+            candidates.push_back(static_cast<uint32_t>(idx));
+        }
+        else if (bin == cutoff && at_cutoff > 0)
+        {
+            candidates.push_back(static_cast<uint32_t>(idx));
+            at_cutoff--;
+        }
+    }
+}
+} // namespace RealSenseID
@@ -0,0 +1,71 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "MatcherImplDefines.h"
+#include "AlignedAllocator.h"
+#include "RealSenseID/Faceprints.h"
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace RealSenseID
+{
+class MatcherGallery;
+
+// Product quantized (PQ) codes of the gallery adaptive vectors, used as a first (approximate) search stage on
+// archival galleries (tens of millions of entries) whose vectors are searched from a gallery file rather than memory.
+//
+// Each vector is normalized and split into Subspaces sub-vectors of SubspaceLength features, and each sub-vector is
+// replaced by the index of its nearest centroid in the codebook of its subspace (256 centroids, k-means trained on a
+// sample of the gallery): a code of Subspaces bytes per entry (the gallery has 512). A search computes, per subspace,
+// the correlation of the probe's sub-vector with each centroid (the asymmetric distance lookup tables), and scores an
+// entry by summing its codes' table values, an approximation of the cosine the ncc measures. Only the shortlist_size
+// best scoring entries are then scored exactly, reading their vectors from the gallery.
+//
+// The codebooks are not retrained by Add()/Update(), so rebuild from time to time after many changes.
+// Like MatcherIvfIndex, the index stores gallery indices: call Add()/Update()/Remove() with every matching change of
+// the gallery.
+class MatcherPqIndex
+{
+public:
+    static constexpr size_t VectorLength = RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER;
+    static constexpr size_t Subspaces = 32;
+    static constexpr size_t SubspaceLength = VectorLength / Subspaces;
+    static constexpr size_t Centroids = 256;
+
+    MatcherPqIndex() = default;
+
+    // train the codebooks on up to training_size gallery entries (evenly spaced) and encode all the entries.
+    // returns false if the gallery is empty. Encoding costs Centroids x VectorLength multiply-adds per entry.
+    bool Build(const MatcherGallery& gallery, size_t training_size = 8192, size_t kmeans_iterations = 8);
+
+    // append the gallery entry at gallery_index (must be the next index, i.e. Size()).
+    bool Add(const MatcherGallery& gallery, size_t gallery_index);
+    bool Update(const MatcherGallery& gallery, size_t gallery_index);
+    // remove the entry at gallery_index and shift the following entries down by one.
+    bool Remove(size_t gallery_index);
+    void Clear();
+
+    bool IsBuilt() const;
+    size_t Size() const;
+
+    // select the shortlist_size entries with the highest approximate score (ties, at the 1/4096 resolution of the
+    // scores histogram, by gallery index). candidates are sorted by ascending gallery index.
+    void Search(const feature_t* probe, size_t shortlist_size, std::vector<uint32_t>& candidates) const;
+
+private:
+    void Encode(const feature_t* vec, uint8_t* code) const;
+    void StoreCode(size_t gallery_index, const uint8_t* code);
+    void LoadCode(size_t gallery_index, uint8_t* code) const;
+    // lookup tables of the probe, quantized so that the sum of the Subspaces tables fits 16 bits
+    void ComputeTables(const feature_t* probe, uint16_t* tables) const;
+
+    GalleryVector<float> _codebooks; // Subspaces x Centroids x SubspaceLength
+    using aligned_uint8_t = std::vector<uint8_t, AlignedAllocator<uint8_t, 64>>;
+    // blocks of MatcherKernels::PqBlockEntries entries, see MatcherKernels::PqScores()
+    aligned_uint8_t _codes;
+    size_t _size = 0;
+};
+} // namespace RealSenseID
@@ -0,0 +1,122 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "MatcherSignPrefilter.h"
+#include "MatcherGallery.h"
+#include "MatcherKernels.h"
+#include <algorithm>
+
+namespace RealSenseID
+{
+static_assert(MatcherSignPrefilter::VectorLength % 64 == 0, "signature must be whole 64 bit words");
+
+void MatcherSignPrefilter::Sign(const feature_t* vec, uint64_t* signature)
+{
+    for (size_t w = 0; w < SignatureWords; w++)
+    {
+        uint64_t bits = 0;
+        for (size_t b = 0; b < 64; b++)
+        {
+            bits |= static_cast<uint64_t>(vec[w * 64 + b] > 0) << b;
+        }
+        signature[w] = bits;
+    }
+}
+
+void MatcherSignPrefilter::Build(const MatcherGallery& gallery)
+{
+    Clear();
+    _signatures.resize(gallery.Size() * SignatureWords);
+    for (size_t idx = 0; idx < gallery.Size(); idx++)
+    {
+        Sign(gallery.AdaptiveVector(idx), &_signatures[idx * SignatureWords]);
+    }
+}
+
+bool MatcherSignPrefilter::Add(const MatcherGallery& gallery, size_t gallery_index)
+{
+    if (gallery_index != Size() || gallery_index >= gallery.Size())
+    {
+        return false;
+    }
+    _signatures.resize(_signatures.size() + SignatureWords);
+    Sign(gallery.AdaptiveVector(gallery_index), &_signatures[gallery_index * SignatureWords]);
+    return true;
+}
+
+bool MatcherSignPrefilter::Update(const MatcherGallery& gallery, size_t gallery_index)
+{
+    if (gallery_index >= Size() || gallery_index >= gallery.Size())
+    {
+        return false;
+    }
+    Sign(gallery.AdaptiveVector(gallery_index), &_signatures[gallery_index * SignatureWords]);
+    return true;
+}
+
+bool MatcherSignPrefilter::Remove(size_t gallery_index)
+{
+    if (gallery_index >= Size())
+    {
+        return false;
+    }
+    auto row = _signatures.begin() + gallery_index * SignatureWords;
+    _signatures.erase(row, row + SignatureWords);
+    return true;
+}
+
+void MatcherSignPrefilter::Clear()
+{
+    _signatures.clear();
+}
+
+size_t MatcherSignPrefilter::Size() const
+{
+    return _signatures.size() / SignatureWords;
+}
+
+void MatcherSignPrefilter::Search(const feature_t* probe, size_t shortlist_size,
+                                  std::vector<uint32_t>& candidates) const
+{
+    candidates.clear();
+
+    uint64_t probe_signature[SignatureWords];
+    Sign(probe, probe_signature);
+
+    // distances are in [0, VectorLength]: a histogram gives the shortlist cutoff without sorting.
+    const size_t n = Size();
+    std::vector<uint16_t> distances(n);
+    size_t histogram[VectorLength + 1] = {0};
+    for (size_t idx = 0; idx < n; idx++)
+    {
+        uint32_t distance = MatcherKernels::HammingDistance(probe_signature, &_signatures[idx * SignatureWords],
+                                                            static_cast<uint32_t>(SignatureWords));
+        distances[idx] = static_cast<uint16_t>(distance);
+        histogram[distance]++;
+    }
+
+    // all the entries nearer than cutoff, and the first ones (by index) at cutoff
+    size_t cutoff = 0;
+    size_t nearer = 0;
+    while (cutoff < VectorLength && nearer + histogram[cutoff] < shortlist_size)
+    {
+        nearer += histogram[cutoff];
+        cutoff++;
+    }
+    size_t at_cutoff = shortlist_size > nearer ? shortlist_size - nearer : 0;
+
+    candidates.reserve(std::min(shortlist_size, n));
+    for (size_t idx = 0; idx < n; idx++)
+    {
+        if (distances[idx] < cutoff)
+        {
+            candidates.push_back(static_cast<uint32_t>(idx));
+        }
+        else if (distances[idx] == cutoff && at_cutoff > 0)
+        {
+            candidates.push_back(static_cast<uint32_t>(idx));
+            at_cutoff--;
+        }
+    }
+}
+} // namespace RealSenseID
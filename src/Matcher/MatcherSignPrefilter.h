@@ -0,0 +1,55 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "MatcherImplDefines.h"
+#include "AlignedAllocator.h"
+#include "RealSenseID/Faceprints.h"
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace RealSenseID
+{
+class MatcherGallery;
+
+// 256 bit sign signature of the gallery adaptive vectors, used as a first (approximate) search stage on very large
+// galleries.
+//
+// Bit i of a signature is set when feature i is positive. The Hamming distance of two signatures approximates the
+// angle between the vectors, so the entries nearest to the probe signature are a shortlist for exact scoring. The
+// scan reads 32 bytes per entry (the int8 prefilter reads 256, the gallery 512), and the recall is tuned by the
+// shortlist size.
+//
+// Like MatcherIvfIndex, the prefilter stores gallery indices: call Add()/Update()/Remove() with every matching change
+// of the gallery.
+class MatcherSignPrefilter
+{
+public:
+    static constexpr size_t VectorLength = RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER;
+    static constexpr size_t SignatureWords = VectorLength / 64;
+
+    MatcherSignPrefilter() = default;
+
+    void Build(const MatcherGallery& gallery);
+
+    // append the gallery entry at gallery_index (must be the next index, i.e. Size()).
+    bool Add(const MatcherGallery& gallery, size_t gallery_index);
+    bool Update(const MatcherGallery& gallery, size_t gallery_index);
+    bool Remove(size_t gallery_index);
+    void Clear();
+
+    size_t Size() const;
+
+    // select the shortlist_size entries nearest to the probe signature (ties by gallery index). candidates are sorted
+    // by ascending gallery index.
+    void Search(const feature_t* probe, size_t shortlist_size, std::vector<uint32_t>& candidates) const;
+
+    static void Sign(const feature_t* vec, uint64_t* signature);
+
+private:
+    using aligned_uint64_t = std::vector<uint64_t, AlignedAllocator<uint64_t, 64>>;
+    aligned_uint64_t _signatures; // Size() x SignatureWords
+};
+} // namespace RealSenseID
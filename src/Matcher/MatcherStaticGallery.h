@@ -0,0 +1,227 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "Matcher.h"
+#include "MatcherGallery.h"
+#include "ExtendedFaceprints.h"
+#include <stddef.h>
+#include <string.h>
+
+namespace RealSenseID
+{
+// Gallery of up to Capacity users in storage sized at compile time, for hosts without a heap (e.g. the controller of
+// a door panel matching a few thousand users in host mode).
+//
+// The layout is MatcherGallery's (dense 64-byte aligned matrices of the adaptive vectors, their cached norms, the
+// cold entries apart) in member arrays, so the gallery is one object of a known size (~1.6KB per user), placed by the
+// application (static storage, not the stack). No gallery function allocates, Add() fails when the gallery is full.
+//
+// Searched with Matcher::MatchFaceprintsToArray() and updated in place with Matcher::UpdateGalleryEntry(), with the
+// same results as a MatcherGallery of the same entries. Without a pool in the search config, a search allocates
+// nothing and scans the same rows for the same probe.
+template <size_t Capacity>
+class MatcherStaticGallery
+{
+public:
+    static_assert(Capacity > 0, "MatcherStaticGallery needs a capacity");
+
+    static constexpr size_t VectorLength = MatcherGallery::VectorLength;
+    static constexpr size_t Alignment = MatcherGallery::Alignment;
+
+    // add entry to the gallery. returns false (and does not add) if the gallery is full or the entry failed
+    // validation (vector range check and same faceprints version for all entries, as MatcherGallery).
+    bool Add(const ExtendedFaceprints& entry)
+    {
+        if (_size == Capacity || !IsValidEntry(entry.faceprints))
+        {
+            return false;
+        }
+        if (_size == 0)
+        {
+            _version = entry.faceprints.version;
+        }
+        ::memcpy(_cold_entries[_size].user_id, entry.user_id, sizeof(entry.user_id));
+        StoreEntry(_size, entry.faceprints);
+        ++_size;
+        return true;
+    }
+
+    // replace the faceprints at the given index. returns false on invalid index or faceprints.
+    bool Update(size_t index, const Faceprints& faceprints)
+    {
+        if (index >= _size || !IsValidEntry(faceprints))
+        {
+            return false;
+        }
+        StoreEntry(index, faceprints);
+        return true;
+    }
+
+    // the without-mask adaptive vector of the entry, to be written directly, and RefreshNorm(index) after.
+    // returns nullptr on invalid index.
+    feature_t* AdaptiveVectorForUpdate(size_t index)
+    {
+        return index < _size ? &_adaptive_vectors[index * VectorLength] : nullptr;
+    }
+
+    void RefreshNorm(size_t index)
+    {
+        auto& norm = _norms[index];
+        Matcher::GetVectorNorm(AdaptiveVector(index), norm.norm, norm.norm_msb);
+    }
+
+    // remove entry at the given index by moving the last entry to its place (the last entry changes its index).
+    // returns false on invalid index.
+    bool SwapRemove(size_t index)
+    {
+        if (index >= _size)
+        {
+            return false;
+        }
+        const size_t last = _size - 1;
+        if (index != last)
+        {
+            _cold_entries[index] = _cold_entries[last];
+            ::memcpy(&_adaptive_vectors[index * VectorLength], &_adaptive_vectors[last * VectorLength],
+                     VectorLength * sizeof(feature_t));
+            ::memcpy(&_adaptive_mask_vectors[index * VectorLength], &_adaptive_mask_vectors[last * VectorLength],
+                     VectorLength * sizeof(feature_t));
+            _norms[index] = _norms[last];
+        }
+        _size = last;
+        return true;
+    }
+
+    void Clear()
+    {
+        _size = 0;
+    }
+
+    size_t Size() const
+    {
+        return _size;
+    }
+
+    bool Empty() const
+    {
+        return _size == 0;
+    }
+
+    bool Full() const
+    {
+        return _size == Capacity;
+    }
+
+    // faceprints version shared by all entries (valid only if not empty).
+    int FaceprintsVersion() const
+    {
+        return _version;
+    }
+
+    const char* UserId(size_t index) const
+    {
+        return _cold_entries[index].user_id;
+    }
+
+    // full entry, reassembled from the hot and cold data (a ~1.6KB copy: for updates, not for the search loop)
+    ExtendedFaceprints Entry(size_t index) const
+    {
+        ExtendedFaceprints entry;
+        MatcherGallery::FromColdEntry(_cold_entries[index], _version, AdaptiveVector(index),
+                                      &_adaptive_mask_vectors[index * VectorLength], entry);
+        return entry;
+    }
+
+    // hot data, used by the search loop
+    GalleryRows Rows() const
+    {
+        GalleryRows rows;
+        rows.adaptive_vectors = _adaptive_vectors;
+        rows.norms = _norms;
+        rows.size = _size;
+        rows.version = _version;
+        return rows;
+    }
+
+    const feature_t* AdaptiveVector(size_t index) const
+    {
+        return &_adaptive_vectors[index * VectorLength];
+    }
+
+    const GalleryEntryNorm& Norm(size_t index) const
+    {
+        return _norms[index];
+    }
+
+    const feature_t* EnrollmentVector(size_t index) const
+    {
+        return &_cold_entries[index].enrollment_descriptor[0];
+    }
+
+private:
+    bool IsValidEntry(const Faceprints& faceprints) const
+    {
+        return Matcher::ValidateFaceprints(faceprints) &&
+               Matcher::ValidateVector(&faceprints.adaptiveDescriptorWithMask[0]) &&
+               (_size == 0 || faceprints.version == _version);
+    }
+
+    void StoreEntry(size_t index, const Faceprints& faceprints)
+    {
+        MatcherGallery::ToColdEntry(faceprints, _cold_entries[index]);
+        ::memcpy(&_adaptive_vectors[index * VectorLength], &faceprints.adaptiveDescriptorWithoutMask[0],
+                 VectorLength * sizeof(feature_t));
+        ::memcpy(&_adaptive_mask_vectors[index * VectorLength], &faceprints.adaptiveDescriptorWithMask[0],
+                 VectorLength * sizeof(feature_t));
+        RefreshNorm(index);
+    }
+
+    alignas(Alignment) feature_t _adaptive_vectors[Capacity * VectorLength];
+    alignas(Alignment) feature_t _adaptive_mask_vectors[Capacity * VectorLength];
+    GalleryEntryNorm _norms[Capacity];
+    GalleryColdEntry _cold_entries[Capacity];
+    size_t _size = 0;
+    int _version = 0;
+};
+
+template <size_t Capacity>
+ExtendedMatchResult Matcher::MatchFaceprintsToArray(const Faceprints& new_faceprints,
+                                                    const MatcherStaticGallery<Capacity>& gallery,
+                                                    Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                    const SearchConfig& search_config)
+{
+    ExtendedMatchResult result;
+    if (!ValidateGalleryProbe(new_faceprints, gallery.Size(), gallery.FaceprintsVersion()))
+    {
+        return result;
+    }
+
+    FaceMatch(new_faceprints, gallery.Rows(), result, thresholds, search_config);
+    result.should_update = (result.maxScore >= thresholds.updateThreshold_NM) && result.isSame;
+    if (result.should_update && !search_config.defer_update)
+    {
+        BuildAdaptiveUpdate(new_faceprints, gallery.Entry(static_cast<size_t>(result.userId)).faceprints, thresholds,
+                            updated_faceprints);
+    }
+    return result;
+}
+
+template <size_t Capacity>
+bool Matcher::UpdateGalleryEntry(const Faceprints& new_faceprints, MatcherStaticGallery<Capacity>& gallery,
+                                 size_t index, const Thresholds& thresholds)
+{
+    feature_t* adaptive = gallery.AdaptiveVectorForUpdate(index);
+    if (adaptive == nullptr)
+    {
+        return false;
+    }
+
+    // same steps as the MatcherGallery overload
+    BlendAverageVector(adaptive, &new_faceprints.adaptiveDescriptorWithoutMask[0]);
+    UpdateAverageVector(adaptive, gallery.EnrollmentVector(index), thresholds);
+    gallery.RefreshNorm(index);
+    return true;
+}
+} // namespace RealSenseID
@@ -0,0 +1,164 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "MatcherThreadPool.h"
+#include "Logger.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace RealSenseID
+{
+static const char* LOG_TAG = "MatcherThreadPool";
+
+// pin the thread to the given cpu. returns false if not supported or failed.
+static bool PinThread(std::thread& thread, size_t cpu)
+{
+#ifdef _WIN32
+    if (cpu >= sizeof(DWORD_PTR) * 8)
+    {
+        return false;
+    }
+    return ::SetThreadAffinityMask(thread.native_handle(), static_cast<DWORD_PTR>(1) << cpu) != 0;
+#elif defined(__linux__)
+    if (cpu >= CPU_SETSIZE)
+    {
+        return false;
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    return ::pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus) == 0;
+#else
+    (void)thread;
+    (void)cpu;
+    return false;
+#endif
+}
+
+MatcherThreadPool::MatcherThreadPool(size_t number_of_threads, bool pin_threads) : _pinned {pin_threads}
+{
+    // pinned: the calling thread does not take part, so all the threads are workers
+    size_t n_workers = pin_threads ? std::max<size_t>(number_of_threads, 1)
+                                   : (number_of_threads > 1 ? number_of_threads - 1 : 0);
+    _workers.reserve(n_workers);
+    _thread_next_task.resize(pin_threads ? n_workers : 0);
+    for (size_t i = 0; i < n_workers; i++)
+    {
+        _workers.emplace_back(&MatcherThreadPool::WorkerLoop, this, i);
+    }
+
+    if (pin_threads)
+    {
+        // spread over the cpus, so the threads span all the NUMA nodes (which number their cpus in blocks)
+        const size_t n_cpus = std::max<unsigned int>(std::thread::hardware_concurrency(), 1);
+        for (size_t i = 0; i < n_workers; i++)
+        {
+            if (!PinThread(_workers[i], i * n_cpus / n_workers % n_cpus))
+            {
+                LOG_WARNING(LOG_TAG, "Failed to pin search thread %zu", i);
+            }
+        }
+    }
+}
+
+MatcherThreadPool::~MatcherThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        _stop = true;
+    }
+    _work_cv.notify_all();
+    for (auto& worker : _workers)
+    {
+        if (worker.joinable())
+            worker.join();
+    }
+}
+
+size_t MatcherThreadPool::NumberOfThreads() const
+{
+    return _pinned ? _workers.size() : _workers.size() + 1;
+}
+
+bool MatcherThreadPool::PinnedThreads() const
+{
+    return _pinned;
+}
+
+void MatcherThreadPool::Run(size_t n_tasks, const std::function<void(size_t)>& task)
+{
+    if (n_tasks == 0)
+        return;
+
+    std::lock_guard<std::mutex> run_lock {_run_mutex};
+    std::unique_lock<std::mutex> lock {_mutex};
+    _task = &task;
+    _n_tasks = n_tasks;
+    _next_task = 0;
+    for (size_t i = 0; i < _thread_next_task.size(); i++)
+    {
+        _thread_next_task[i] = i;
+    }
+    _pending_tasks = n_tasks;
+    _work_cv.notify_all();
+
+    // the calling thread takes part in the work (unless the tasks are pinned to the workers)
+    while (!_pinned && RunNextTask(lock, 0))
+    {
+    }
+
+    _done_cv.wait(lock, [this] { return _pending_tasks == 0; });
+    _task = nullptr;
+}
+
+bool MatcherThreadPool::HasTask(size_t thread_index) const
+{
+    if (_task == nullptr)
+        return false;
+    return _pinned ? _thread_next_task[thread_index] < _n_tasks : _next_task < _n_tasks;
+}
+
+// pick the next task of the thread (if any) and run it without holding the lock. returns false if no task was left.
+bool MatcherThreadPool::RunNextTask(std::unique_lock<std::mutex>& lock, size_t thread_index)
+{
+    if (!HasTask(thread_index))
+        return false;
+
+    size_t task_index;
+    if (_pinned)
+    {
+        task_index = _thread_next_task[thread_index];
+        _thread_next_task[thread_index] += _thread_next_task.size();
+    }
+    else
+    {
+        task_index = _next_task++;
+    }
+    const auto* task = _task;
+    lock.unlock();
+    (*task)(task_index);
+    lock.lock();
+
+    if (--_pending_tasks == 0)
+        _done_cv.notify_all();
+    return true;
+}
+
+void MatcherThreadPool::WorkerLoop(size_t thread_index)
+{
+    std::unique_lock<std::mutex> lock {_mutex};
+    while (true)
+    {
+        _work_cv.wait(lock, [this, thread_index] { return _stop || HasTask(thread_index); });
+        if (_stop)
+            return;
+        RunNextTask(lock, thread_index);
+    }
+}
+} // namespace RealSenseID
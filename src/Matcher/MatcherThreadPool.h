@@ -0,0 +1,56 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <stddef.h>
+
+namespace RealSenseID
+{
+// Fixed size worker pool used by the parallel gallery search.
+// Run() executes task(0) .. task(n_tasks-1) on the workers and the calling thread, and returns when all are done.
+// Only one Run() may be active at a time (calls are serialized).
+//
+// With pin_threads, all the threads are workers pinned to cpus spread over the machine, and task i always runs on
+// thread i % NumberOfThreads() (the calling thread only waits). So shard i of a search is always scanned by the same
+// core, which keeps the memory it first touched on that core's NUMA node.
+class MatcherThreadPool
+{
+public:
+    // number_of_threads includes the calling thread, so 1 means "no workers, run everything inline".
+    explicit MatcherThreadPool(size_t number_of_threads = std::thread::hardware_concurrency(),
+                               bool pin_threads = false);
+    ~MatcherThreadPool();
+
+    MatcherThreadPool(const MatcherThreadPool&) = delete;
+    MatcherThreadPool& operator=(const MatcherThreadPool&) = delete;
+
+    size_t NumberOfThreads() const;
+    bool PinnedThreads() const;
+
+    void Run(size_t n_tasks, const std::function<void(size_t)>& task);
+
+private:
+    void WorkerLoop(size_t thread_index);
+    bool HasTask(size_t thread_index) const;
+    bool RunNextTask(std::unique_lock<std::mutex>& lock, size_t thread_index);
+
+    std::vector<std::thread> _workers;
+    std::mutex _run_mutex; // serializes Run() calls
+    std::mutex _mutex;
+    std::condition_variable _work_cv;
+    std::condition_variable _done_cv;
+    const std::function<void(size_t)>* _task = nullptr;
+    size_t _n_tasks = 0;
+    size_t _next_task = 0;
+    std::vector<size_t> _thread_next_task; // next task of each pinned thread
+    const bool _pinned;
+    size_t _pending_tasks = 0;
+    bool _stop = false;
+};
+} // namespace RealSenseID
@@ -0,0 +1,538 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "MatcherTieredGallery.h"
+#include "Logger.h"
+#include <algorithm>
+#include <string.h>
+
+namespace RealSenseID
+{
+static const char* LOG_TAG = "MatcherTieredGallery";
+
+constexpr uint32_t MatcherTieredGallery::NotHot;
+
+static_assert(GalleryAccelerator::VectorLength == MatcherGallery::VectorLength, "accelerator row size mismatch");
+static_assert(sizeof(feature_t) == sizeof(int16_t), "accelerator feature size mismatch");
+
+MatcherTieredGallery::MatcherTieredGallery(const TieredGalleryConfig& config) : _config(config)
+{
+    _config.promote_hits = std::max<uint32_t>(_config.promote_hits, 1);
+    // hot slots are kept in 32 bits
+    _config.hot_capacity = std::min<size_t>(_config.hot_capacity, NotHot - 1);
+}
+
+bool MatcherTieredGallery::HotEnabled() const
+{
+    return _config.hot_capacity > 0;
+}
+
+void MatcherTieredGallery::ResetTiers()
+{
+    _hot.Clear();
+    _cold_index.clear();
+    _last_used.clear();
+    const size_t size = HotEnabled() ? _cold.Size() : 0;
+    _hits.assign(size, 0);
+    _hot_slot.assign(size, NotHot);
+}
+
+void MatcherTieredGallery::Attach(std::shared_ptr<const MatcherGalleryFile> file)
+{
+    _cold.Attach(std::move(file));
+    ResetTiers();
+    InvalidateAccelerator();
+}
+
+void MatcherTieredGallery::Place(MatcherThreadPool* pool, size_t min_shard_size, bool huge_pages)
+{
+    _cold.Place(pool, min_shard_size, huge_pages);
+}
+
+void MatcherTieredGallery::SetAccelerator(GalleryAccelerator* accelerator, size_t shortlist_size)
+{
+    _accelerator = shortlist_size > 0 ? accelerator : nullptr;
+    _shortlist_size = shortlist_size;
+    InvalidateAccelerator();
+}
+
+bool MatcherTieredGallery::Add(const ExtendedFaceprints& entry)
+{
+    if (!_cold.Add(entry))
+    {
+        return false;
+    }
+    OnColdRowChanged(_cold.Size() - 1);
+    if (HotEnabled())
+    {
+        _hits.push_back(0);
+        _hot_slot.push_back(NotHot);
+    }
+    return true;
+}
+
+size_t MatcherTieredGallery::AddBatch(const char* const* user_ids, const Faceprints* const* faceprints,
+                                      size_t number_of_entries, MatcherThreadPool* pool)
+{
+    const size_t old_size = _cold.Size();
+    const size_t added = _cold.AddBatch(user_ids, faceprints, number_of_entries, pool);
+    for (size_t i = old_size; i < _cold.Size(); i++)
+    {
+        OnColdRowChanged(i);
+    }
+    if (HotEnabled())
+    {
+        _hits.resize(_cold.Size(), 0);
+        _hot_slot.resize(_cold.Size(), NotHot);
+    }
+    return added;
+}
+
+bool MatcherTieredGallery::Update(size_t index, const Faceprints& faceprints)
+{
+    if (!_cold.Update(index, faceprints))
+    {
+        return false;
+    }
+    OnColdRowChanged(index);
+    if (HotEnabled() && _hot_slot[index] != NotHot)
+    {
+        _hot.Update(_hot_slot[index], faceprints);
+    }
+    return true;
+}
+
+bool MatcherTieredGallery::UpdateInPlace(size_t index, const Faceprints& new_faceprints, const Thresholds& thresholds)
+{
+    if (!Matcher::UpdateGalleryEntry(new_faceprints, _cold, index, thresholds))
+    {
+        return false;
+    }
+    OnColdRowChanged(index);
+    // the hot copy is the same vector, so the same update keeps it equal
+    if (HotEnabled() && _hot_slot[index] != NotHot)
+    {
+        Matcher::UpdateGalleryEntry(new_faceprints, _hot, _hot_slot[index], thresholds);
+    }
+    return true;
+}
+
+bool MatcherTieredGallery::Remove(size_t index)
+{
+    if (!_cold.Remove(index))
+    {
+        return false;
+    }
+    // the rows after index moved down by one
+    InvalidateAccelerator();
+    if (!HotEnabled())
+    {
+        return true;
+    }
+
+    if (_hot_slot[index] != NotHot)
+    {
+        RemoveHot(_hot_slot[index]);
+    }
+    _hits.erase(_hits.begin() + index);
+    _hot_slot.erase(_hot_slot.begin() + index);
+    // the cold entries after index moved down by one
+    for (auto& cold_index : _cold_index)
+    {
+        if (cold_index > index)
+        {
+            cold_index--;
+        }
+    }
+    return true;
+}
+
+bool MatcherTieredGallery::SwapRemove(size_t index)
+{
+    if (index >= _cold.Size())
+    {
+        return false;
+    }
+    if (HotEnabled() && _hot_slot[index] != NotHot)
+    {
+        RemoveHot(_hot_slot[index]);
+    }
+    _cold.SwapRemove(index);
+    OnColdRowChanged(index);
+    if (!HotEnabled())
+    {
+        return true;
+    }
+
+    // the last cold entry moved to index
+    _hits[index] = _hits.back();
+    _hot_slot[index] = _hot_slot.back();
+    _hits.pop_back();
+    _hot_slot.pop_back();
+    if (index < _hot_slot.size() && _hot_slot[index] != NotHot)
+    {
+        _cold_index[_hot_slot[index]] = index;
+    }
+    return true;
+}
+
+void MatcherTieredGallery::Clear()
+{
+    _cold.Clear();
+    ResetTiers();
+    InvalidateAccelerator();
+}
+
+size_t MatcherTieredGallery::Size() const
+{
+    return _cold.Size();
+}
+
+const char* MatcherTieredGallery::UserId(size_t index) const
+{
+    return _cold.UserId(index);
+}
+
+ExtendedFaceprints MatcherTieredGallery::Entry(size_t index) const
+{
+    return _cold.Entry(index);
+}
+
+const MatcherGallery& MatcherTieredGallery::Cold() const
+{
+    return _cold;
+}
+
+const MatcherGallery& MatcherTieredGallery::Hot() const
+{
+    return _hot;
+}
+
+ExtendedMatchResult MatcherTieredGallery::Match(const Faceprints& new_faceprints, Faceprints& updated_faceprints,
+                                                const Thresholds& thresholds, const SearchConfig& search_config)
+{
+    if (HotEnabled() && !_hot.Empty())
+    {
+        // the hot tier is small, it is scanned by the calling thread
+        SearchConfig hot_config;
+        hot_config.defer_update = search_config.defer_update;
+        hot_config.eligible = HotEligible(search_config.eligible);
+        auto result = Matcher::MatchFaceprintsToArray(new_faceprints, _hot, updated_faceprints, thresholds, hot_config);
+        if (result.isSame)
+        {
+            OnHotMatch(result);
+            return result;
+        }
+    }
+
+    ExtendedMatchResult result;
+    bool success = false;
+    if (!MatchColdAccelerated(&new_faceprints, 1, &result, &updated_faceprints, thresholds, search_config, success))
+    {
+        result = Matcher::MatchFaceprintsToArray(new_faceprints, _cold, updated_faceprints, thresholds, search_config);
+    }
+    OnColdMatch(result);
+    return result;
+}
+
+ExtendedMatchResult MatcherTieredGallery::MatchAnytime(const Faceprints& new_faceprints,
+                                                       const MatcherIvfIndex* cold_index,
+                                                       std::chrono::steady_clock::time_point deadline,
+                                                       Faceprints& updated_faceprints, const Thresholds& thresholds,
+                                                       const SearchConfig& search_config, bool& complete)
+{
+    ExtendedMatchResult hot_result;
+    complete = true;
+    if (HotEnabled() && !_hot.Empty())
+    {
+        SearchConfig hot_config;
+        hot_config.defer_update = search_config.defer_update;
+        hot_config.eligible = HotEligible(search_config.eligible);
+        hot_result = Matcher::MatchFaceprintsToArrayAnytime(new_faceprints, _hot, nullptr, deadline, updated_faceprints,
+                                                            thresholds, hot_config, complete);
+        if (hot_result.isSame)
+        {
+            OnHotMatch(hot_result);
+            return hot_result;
+        }
+        if (hot_result.userId >= 0)
+        {
+            hot_result.userId = static_cast<int>(_cold_index[static_cast<size_t>(hot_result.userId)]);
+        }
+    }
+
+    ExtendedMatchResult result;
+    if (complete)
+    {
+        result = Matcher::MatchFaceprintsToArrayAnytime(new_faceprints, _cold, cold_index, deadline,
+                                                        updated_faceprints, thresholds, search_config, complete);
+    }
+    // a cut cold search may not have reached the best hot user yet (the cold tier holds the hot users too)
+    if (!complete && hot_result.userId >= 0 && (result.userId < 0 || hot_result.maxScore > result.maxScore))
+    {
+        return hot_result;
+    }
+    OnColdMatch(result);
+    return result;
+}
+
+bool MatcherTieredGallery::MatchBatch(const Faceprints* new_faceprints, size_t number_of_probes,
+                                      ExtendedMatchResult* results, Faceprints* updated_faceprints,
+                                      const Thresholds& thresholds, const SearchConfig& search_config)
+{
+    if (!HotEnabled() || _hot.Empty())
+    {
+        bool success = false;
+        if (!MatchColdAccelerated(new_faceprints, number_of_probes, results, updated_faceprints, thresholds,
+                                  search_config, success))
+        {
+            success = Matcher::MatchFaceprintsToArrayBatch(new_faceprints, number_of_probes, _cold, results,
+                                                           updated_faceprints, thresholds, search_config);
+        }
+        for (size_t i = 0; i < number_of_probes; i++)
+        {
+            OnColdMatch(results[i]);
+        }
+        return success;
+    }
+
+    SearchConfig hot_config;
+    hot_config.defer_update = search_config.defer_update;
+    hot_config.eligible = HotEligible(search_config.eligible);
+    Matcher::MatchFaceprintsToArrayBatch(new_faceprints, number_of_probes, _hot, results, updated_faceprints,
+                                         thresholds, hot_config);
+
+    // all the hot results are mapped before any promotion changes the hot tier
+    std::vector<size_t> misses;
+    std::vector<Faceprints> miss_probes;
+    for (size_t i = 0; i < number_of_probes; i++)
+    {
+        if (results[i].isSame)
+        {
+            OnHotMatch(results[i]);
+        }
+        else
+        {
+            misses.push_back(i);
+            miss_probes.push_back(new_faceprints[i]);
+        }
+    }
+    if (misses.empty())
+    {
+        return true;
+    }
+
+    std::vector<ExtendedMatchResult> miss_results(misses.size());
+    std::vector<Faceprints> miss_updated(misses.size());
+    bool success = false;
+    if (!MatchColdAccelerated(miss_probes.data(), miss_probes.size(), miss_results.data(), miss_updated.data(),
+                              thresholds, search_config, success))
+    {
+        success = Matcher::MatchFaceprintsToArrayBatch(miss_probes.data(), miss_probes.size(), _cold,
+                                                       miss_results.data(), miss_updated.data(), thresholds,
+                                                       search_config);
+    }
+    for (size_t i = 0; i < misses.size(); i++)
+    {
+        results[misses[i]] = miss_results[i];
+        updated_faceprints[misses[i]] = miss_updated[i];
+        OnColdMatch(miss_results[i]);
+    }
+    return success;
+}
+
+void MatcherTieredGallery::InvalidateAccelerator()
+{
+    _accelerator_synced = false;
+    _accelerator_rows.clear();
+}
+
+void MatcherTieredGallery::OnColdRowChanged(size_t index)
+{
+    if (_accelerator == nullptr || !_accelerator_synced)
+    {
+        return;
+    }
+    // past a quarter of the gallery, one upload of all the rows is cheaper than the row by row one
+    if (_accelerator_rows.size() >= _cold.Size() / 4)
+    {
+        InvalidateAccelerator();
+        return;
+    }
+    _accelerator_rows.push_back(static_cast<uint32_t>(index));
+}
+
+bool MatcherTieredGallery::SyncAccelerator()
+{
+    if (_accelerator == nullptr)
+    {
+        return false;
+    }
+
+    const size_t size = _cold.Size();
+    bool ok = _accelerator->Resize(size);
+    if (ok && !_accelerator_synced)
+    {
+        // the rows are contiguous in the gallery
+        ok = _accelerator->SetRows(0, size, _cold.AdaptiveVector(0));
+    }
+    else if (ok)
+    {
+        std::sort(_accelerator_rows.begin(), _accelerator_rows.end());
+        _accelerator_rows.erase(std::unique(_accelerator_rows.begin(), _accelerator_rows.end()),
+                                _accelerator_rows.end());
+        // the rows past the end were swap removed
+        _accelerator_rows.erase(std::lower_bound(_accelerator_rows.begin(), _accelerator_rows.end(), size),
+                                _accelerator_rows.end());
+        // consecutive rows in one call
+        const auto& rows = _accelerator_rows;
+        for (size_t begin = 0, end = 0; ok && begin < rows.size(); begin = end)
+        {
+            end = begin + 1;
+            while (end < rows.size() && rows[end] == rows[end - 1] + 1)
+            {
+                end++;
+            }
+            ok = _accelerator->SetRows(rows[begin], end - begin, _cold.AdaptiveVector(rows[begin]));
+        }
+    }
+    _accelerator_rows.clear();
+    _accelerator_synced = ok;
+    if (!ok)
+    {
+        LOG_ERROR(LOG_TAG, "Accelerator update failed, matching on the cpu");
+    }
+    return ok;
+}
+
+bool MatcherTieredGallery::MatchColdAccelerated(const Faceprints* new_faceprints, size_t number_of_probes,
+                                                ExtendedMatchResult* results, Faceprints* updated_faceprints,
+                                                const Thresholds& thresholds, const SearchConfig& search_config,
+                                                bool& success)
+{
+    // the accelerator shortlists from the whole gallery, a search of the eligible users runs on the cpu
+    if (number_of_probes == 0 || _cold.Empty() || search_config.eligible != nullptr || !SyncAccelerator())
+    {
+        return false;
+    }
+
+    const size_t vector_length = MatcherGallery::VectorLength;
+    const size_t shortlist_size = std::min(_shortlist_size, _cold.Size());
+    std::vector<int16_t> probes(number_of_probes * vector_length);
+    for (size_t i = 0; i < number_of_probes; i++)
+    {
+        ::memcpy(&probes[i * vector_length], new_faceprints[i].adaptiveDescriptorWithoutMask,
+                 vector_length * sizeof(feature_t));
+    }
+    std::vector<uint32_t> shortlist(number_of_probes * shortlist_size);
+    if (!_accelerator->Search(probes.data(), number_of_probes, shortlist_size, shortlist.data()))
+    {
+        LOG_ERROR(LOG_TAG, "Accelerator search failed, matching on the cpu");
+        // its copy may be lost
+        InvalidateAccelerator();
+        return false;
+    }
+
+    // the shortlist is scored as the cpu search would, out of range or repeated rows are dropped
+    std::vector<uint32_t> candidates;
+    // a probe that is not valid (or with no candidate left) has no user
+    success = true;
+    for (size_t i = 0; i < number_of_probes; i++)
+    {
+        const auto first = shortlist.begin() + i * shortlist_size;
+        candidates.assign(first, first + shortlist_size);
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+        candidates.erase(std::lower_bound(candidates.begin(), candidates.end(), _cold.Size()), candidates.end());
+        results[i] = Matcher::MatchFaceprintsToCandidates(new_faceprints[i], _cold, candidates, updated_faceprints[i],
+                                                          thresholds, search_config);
+        success = success && results[i].userId >= 0;
+    }
+    return true;
+}
+
+const uint64_t* MatcherTieredGallery::HotEligible(const uint64_t* eligible)
+{
+    if (eligible == nullptr)
+    {
+        return nullptr;
+    }
+    _hot_eligible.assign((_hot.Size() + 63) / 64, 0);
+    for (size_t slot = 0; slot < _hot.Size(); slot++)
+    {
+        const size_t index = _cold_index[slot];
+        if ((eligible[index / 64] >> (index % 64)) & 1)
+        {
+            _hot_eligible[slot / 64] |= uint64_t {1} << (slot % 64);
+        }
+    }
+    return _hot_eligible.data();
+}
+
+void MatcherTieredGallery::OnHotMatch(ExtendedMatchResult& result)
+{
+    const auto slot = static_cast<size_t>(result.userId);
+    _last_used[slot] = ++_clock;
+    result.userId = static_cast<int>(_cold_index[slot]);
+}
+
+void MatcherTieredGallery::OnColdMatch(const ExtendedMatchResult& result)
+{
+    if (!HotEnabled() || !result.isSame || result.userId < 0)
+    {
+        return;
+    }
+
+    const auto index = static_cast<size_t>(result.userId);
+    if (_hot_slot[index] != NotHot)
+    {
+        _last_used[_hot_slot[index]] = ++_clock;
+        return;
+    }
+    if (++_hits[index] >= _config.promote_hits)
+    {
+        Promote(index);
+    }
+}
+
+void MatcherTieredGallery::Promote(size_t index)
+{
+    if (_hot.Size() >= _config.hot_capacity)
+    {
+        EvictLeastRecent();
+    }
+
+    if (!_hot.Add(_cold.Entry(index)))
+    {
+        LOG_ERROR(LOG_TAG, "Failed to promote entry %zu", index);
+        return;
+    }
+    _hits[index] = 0;
+    _hot_slot[index] = static_cast<uint32_t>(_hot.Size() - 1);
+    _cold_index.push_back(index);
+    _last_used.push_back(++_clock);
+}
+
+void MatcherTieredGallery::EvictLeastRecent()
+{
+    if (_last_used.empty())
+    {
+        return;
+    }
+    auto least_recent = std::min_element(_last_used.begin(), _last_used.end()) - _last_used.begin();
+    RemoveHot(static_cast<uint32_t>(least_recent));
+}
+
+void MatcherTieredGallery::RemoveHot(uint32_t slot)
+{
+    _hot.Remove(slot);
+    _hot_slot[_cold_index[slot]] = NotHot;
+    _cold_index.erase(_cold_index.begin() + slot);
+    _last_used.erase(_last_used.begin() + slot);
+    // the hot entries after slot moved down by one
+    for (size_t i = slot; i < _cold_index.size(); i++)
+    {
+        _hot_slot[_cold_index[i]] = static_cast<uint32_t>(i);
+    }
+}
+} // namespace RealSenseID
@@ -0,0 +1,148 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "Matcher.h"
+#include "MatcherGallery.h"
+#include "RealSenseID/GalleryAccelerator.h"
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace RealSenseID
+{
+struct TieredGalleryConfig
+{
+    // max number of users in the hot tier (0 - no hot tier, every match scans the whole gallery)
+    size_t hot_capacity = 0;
+    // successful matches of a user in the cold tier that promote it to the hot tier
+    uint32_t promote_hits = 2;
+};
+
+// Gallery for skewed access, where a few users make most of the matches (e.g. the daily badge holders of a site).
+//
+// The cold tier is the whole gallery: a MatcherGallery, possibly attached to a mapped gallery file. The hot tier is a
+// small MatcherGallery holding copies of the users matched recently and often, and is scanned first:
+// - a hot match over strongThreshold_pNMgNM is returned without touching the cold tier.
+// - otherwise the whole cold tier is scanned, so the result is exactly the one of the plain gallery search.
+// A hot match is a match the plain search accepts as well. The two differ only when several users score over
+// strongThreshold_pNMgNM, where the plain search returns the first in gallery order and the tiered one a hot user.
+//
+// Each cold match counts a hit for the matched user. After promote_hits hits the user is copied to the hot tier,
+// evicting the least recently matched hot user if the tier is full (its hits start over).
+//
+// The cold tier can be scanned by a GalleryAccelerator instead (SetAccelerator()): it shortlists the candidates of the
+// probes, which are then scored exactly. The accelerator's copy of the cold tier is brought up to date before each
+// search, with the rows changed since the last one. If it fails, the search runs on the cpu as without it.
+//
+// A search config with an eligible bitset (of cold tier indices) applies to both tiers, and runs on the cpu.
+//
+// Indices (Entry(), Update(), result.userId) are cold tier indices, the same as in Cold().
+// Not thread safe.
+class MatcherTieredGallery
+{
+public:
+    explicit MatcherTieredGallery(const TieredGalleryConfig& config = TieredGalleryConfig());
+
+    // replace the gallery contents with the given mapped file (the hot tier starts empty)
+    void Attach(std::shared_ptr<const MatcherGalleryFile> file);
+
+    // place the cold tier for the parallel search (see MatcherGallery::Place). the hot tier is small and stays as is.
+    void Place(MatcherThreadPool* pool, size_t min_shard_size, bool huge_pages);
+
+    // scan the cold tier on the accelerator, shortlist_size candidates per probe (nullptr or 0 - on the cpu). the
+    // accelerator is not owned. the hints of the search config are then not used.
+    void SetAccelerator(GalleryAccelerator* accelerator, size_t shortlist_size);
+
+    // same semantics as the MatcherGallery functions. updates are applied to the hot copy too.
+    bool Add(const ExtendedFaceprints& entry);
+    // see MatcherGallery::AddBatch
+    size_t AddBatch(const char* const* user_ids, const Faceprints* const* faceprints, size_t number_of_entries,
+                    MatcherThreadPool* pool = nullptr);
+    bool Update(size_t index, const Faceprints& faceprints);
+    // adaptive update of the entry with the probe, in place (see Matcher::UpdateGalleryEntry)
+    bool UpdateInPlace(size_t index, const Faceprints& new_faceprints, const Thresholds& thresholds);
+    bool Remove(size_t index);
+    bool SwapRemove(size_t index);
+    void Clear();
+
+    size_t Size() const;
+    const char* UserId(size_t index) const;
+    ExtendedFaceprints Entry(size_t index) const;
+
+    const MatcherGallery& Cold() const;
+    const MatcherGallery& Hot() const;
+
+    // match single vs. the gallery, hot tier first. the search_config is used for the cold tier.
+    ExtendedMatchResult Match(const Faceprints& new_faceprints, Faceprints& updated_faceprints,
+                              const Thresholds& thresholds, const SearchConfig& search_config);
+
+    // deadline bounded match (see Matcher::MatchFaceprintsToArrayAnytime()): the hot tier first, then the cold tier,
+    // its hints first and then in the cold_index priority order (if given, an index of the cold tier), until the
+    // deadline. If the deadline cut the search, the result is the best of both tiers so far. The accelerator is not
+    // used.
+    ExtendedMatchResult MatchAnytime(const Faceprints& new_faceprints, const MatcherIvfIndex* cold_index,
+                                     std::chrono::steady_clock::time_point deadline, Faceprints& updated_faceprints,
+                                     const Thresholds& thresholds, const SearchConfig& search_config,
+                                     bool& complete);
+
+    // match a batch of probes: all the probes vs. the hot tier in one pass, then the probes without a hot match vs.
+    // the cold tier in one pass. results[i] and updated_faceprints[i] are what Match(new_faceprints[i]) returns.
+    // returns false if any of the probes failed.
+    bool MatchBatch(const Faceprints* new_faceprints, size_t number_of_probes, ExtendedMatchResult* results,
+                    Faceprints* updated_faceprints, const Thresholds& thresholds, const SearchConfig& search_config);
+
+private:
+    static constexpr uint32_t NotHot = UINT32_MAX;
+
+    bool HotEnabled() const;
+
+    // empty hot tier and no hits, for the current cold tier
+    void ResetTiers();
+
+    // the eligible bitset of the cold tier (see SearchConfig::eligible) mapped to the hot tier (nullptr - all)
+    const uint64_t* HotEligible(const uint64_t* eligible);
+
+    // map a hot tier result to the cold index and mark the user as used
+    void OnHotMatch(ExtendedMatchResult& result);
+    // count a cold match and promote the user if it has enough hits
+    void OnColdMatch(const ExtendedMatchResult& result);
+
+    void Promote(size_t index);
+    void EvictLeastRecent();
+    void RemoveHot(uint32_t slot);
+
+    // mark the cold rows to send to the accelerator before the next search: all of them, or the one at index
+    void InvalidateAccelerator();
+    void OnColdRowChanged(size_t index);
+    // bring the accelerator's copy up to date. returns false if there is no accelerator or it failed.
+    bool SyncAccelerator();
+    // cold tier search of the probes on the accelerator. returns false if it failed, with no results. success is set
+    // as the return value of Matcher::MatchFaceprintsToArrayBatch.
+    bool MatchColdAccelerated(const Faceprints* new_faceprints, size_t number_of_probes, ExtendedMatchResult* results,
+                              Faceprints* updated_faceprints, const Thresholds& thresholds,
+                              const SearchConfig& search_config, bool& success);
+
+    TieredGalleryConfig _config;
+    MatcherGallery _cold;
+    MatcherGallery _hot;
+
+    // per cold entry
+    std::vector<uint32_t> _hits;
+    std::vector<uint32_t> _hot_slot; // index in the hot tier or NotHot
+
+    // per hot entry
+    std::vector<size_t> _cold_index;
+    std::vector<uint64_t> _last_used;
+    uint64_t _clock = 0;
+    std::vector<uint64_t> _hot_eligible; // see HotEligible()
+
+    GalleryAccelerator* _accelerator = nullptr;
+    size_t _shortlist_size = 0;
+    bool _accelerator_synced = false;        // false: all the rows are sent on the next search
+    std::vector<uint32_t> _accelerator_rows; // changed since the last search
+};
+} // namespace RealSenseID
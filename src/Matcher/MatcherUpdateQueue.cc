@@ -0,0 +1,129 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "MatcherUpdateQueue.h"
+#include "MatcherGalleryStore.h"
+#include "Logger.h"
+#include <cstring>
+#include <vector>
+
+namespace RealSenseID
+{
+static const char* LOG_TAG = "MatcherUpdateQueue";
+
+MatcherUpdateQueue::MatcherUpdateQueue(MatcherGalleryStore& store, size_t max_pending) :
+    _store(store), _max_pending(max_pending)
+{
+    _worker = LibraryThread([this] { WorkerLoop(); });
+}
+
+MatcherUpdateQueue::~MatcherUpdateQueue()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _work_cv.notify_all();
+    _worker.join();
+}
+
+bool MatcherUpdateQueue::Enqueue(size_t user_index, const Faceprints& new_faceprints, const Thresholds& thresholds,
+                                 Callback callback)
+{
+    const auto& gallery = _store.Gallery();
+    if (user_index >= gallery.Size())
+    {
+        return false;
+    }
+
+    Job job;
+    job.user_index = user_index;
+    ::memcpy(job.user_id, gallery.UserId(user_index), sizeof(job.user_id));
+    job.new_faceprints = new_faceprints;
+    job.thresholds = thresholds;
+    job.callback = std::move(callback);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_stop || _jobs.size() >= _max_pending)
+        {
+            return false;
+        }
+        _jobs.push_back(std::move(job));
+    }
+    _work_cv.notify_one();
+    return true;
+}
+
+void MatcherUpdateQueue::Drain()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _done_cv.wait(lock, [this] { return _jobs.empty() && _in_progress == 0; });
+}
+
+size_t MatcherUpdateQueue::Pending() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _jobs.size() + _in_progress;
+}
+
+bool MatcherUpdateQueue::Apply(const Job& job)
+{
+    // build the update from the current gallery entry (it may have been updated since the match)
+    Faceprints updated_faceprints;
+    {
+        auto gallery_lock = _store.LockGallery();
+        const auto& gallery = _store.Gallery();
+        if (job.user_index >= gallery.Size() ||
+            ::strncmp(gallery.UserId(job.user_index), job.user_id, sizeof(job.user_id)) != 0)
+        {
+            LOG_DEBUG(LOG_TAG, "User %zu changed since the match, update dropped", job.user_index);
+            return false;
+        }
+        Matcher::BuildAdaptiveUpdate(job.new_faceprints, gallery.Entry(job.user_index).faceprints, job.thresholds,
+                                     updated_faceprints);
+    }
+    return _store.RecordUpdate(job.user_index, updated_faceprints);
+}
+
+void MatcherUpdateQueue::WorkerLoop()
+{
+    std::vector<Job> batch;
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true)
+    {
+        _work_cv.wait(lock, [this] { return _stop || !_jobs.empty(); });
+        if (_jobs.empty())
+        {
+            break; // stopped and drained
+        }
+
+        batch.assign(std::make_move_iterator(_jobs.begin()), std::make_move_iterator(_jobs.end()));
+        _jobs.clear();
+        _in_progress = batch.size();
+        lock.unlock();
+
+        std::vector<bool> applied(batch.size());
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            applied[i] = Apply(batch[i]);
+        }
+        const bool flushed = _store.Flush();
+        if (!flushed)
+        {
+            LOG_ERROR(LOG_TAG, "Failed to persist %zu updates", batch.size());
+        }
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            if (batch[i].callback)
+            {
+                batch[i].callback(batch[i].user_index, applied[i] && flushed);
+            }
+        }
+        batch.clear();
+
+        lock.lock();
+        _in_progress = 0;
+        _done_cv.notify_all();
+    }
+}
+} // namespace RealSenseID
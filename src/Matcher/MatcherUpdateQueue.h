@@ -0,0 +1,78 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "Matcher.h"
+#include "RealSenseID/Faceprints.h"
+#include "LibraryThread.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace RealSenseID
+{
+class MatcherGalleryStore;
+
+// Background write-back of adaptive updates.
+//
+// Match with SearchConfig::defer_update set, so the match decision returns before the blend/update work, and pass
+// the matched user and probe to Enqueue() when result.should_update is set. A worker thread then builds the
+// update (Matcher::BuildAdaptiveUpdate()), applies it to the store's gallery (MatcherGalleryStore::RecordUpdate(),
+// exclusive of searches holding LockGallery()) and syncs the store's log. The callback is called on the worker
+// thread once the update is on disk, or with persisted=false if it was dropped (e.g. the user was removed
+// meanwhile).
+//
+// Updates queued together are synced to disk together.
+class MatcherUpdateQueue
+{
+public:
+    using Callback = std::function<void(size_t user_index, bool persisted)>;
+
+    // the store must outlive the queue
+    explicit MatcherUpdateQueue(MatcherGalleryStore& store, size_t max_pending = 1024);
+
+    // applies all queued updates before returning
+    ~MatcherUpdateQueue();
+
+    MatcherUpdateQueue(const MatcherUpdateQueue&) = delete;
+    MatcherUpdateQueue& operator=(const MatcherUpdateQueue&) = delete;
+
+    // queue the adaptive update of gallery user user_index with new_faceprints. Call with the gallery lock held (the
+    // same one used for the match), so user_index still refers to the matched user.
+    // returns false if the queue is full (the caller may update synchronously instead).
+    bool Enqueue(size_t user_index, const Faceprints& new_faceprints, const Thresholds& thresholds,
+                 Callback callback = nullptr);
+
+    // block until all queued updates were applied
+    void Drain();
+
+    size_t Pending() const;
+
+private:
+    struct Job
+    {
+        size_t user_index;
+        char user_id[31];
+        Faceprints new_faceprints;
+        Thresholds thresholds;
+        Callback callback;
+    };
+
+    void WorkerLoop();
+    bool Apply(const Job& job);
+
+    MatcherGalleryStore& _store;
+    const size_t _max_pending;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _work_cv;
+    std::condition_variable _done_cv;
+    std::deque<Job> _jobs;
+    size_t _in_progress = 0;
+    bool _stop = false;
+    LibraryThread _worker;
+};
+} // namespace RealSenseID
@@ -0,0 +1,166 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "MatcherUserIndex.h"
+#include "MatcherGallery.h"
+#include <cstring>
+
+namespace RealSenseID
+{
+static constexpr size_t MinBuckets = 16;
+
+constexpr size_t MatcherUserIndex::NotFound;
+constexpr uint32_t MatcherUserIndex::Empty;
+
+uint32_t MatcherUserIndex::Hash(const char* user_id)
+{
+    uint32_t hash = 2166136261u;
+    for (auto* c = reinterpret_cast<const unsigned char*>(user_id); *c != '\0'; c++)
+    {
+        hash ^= *c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+size_t MatcherUserIndex::Find(const MatcherGallery& gallery, const char* user_id) const
+{
+    if (_size == 0 || user_id == nullptr)
+    {
+        return NotFound;
+    }
+
+    const uint32_t hash = Hash(user_id);
+    for (size_t bucket = hash & _mask; _buckets[bucket].index != Empty; bucket = (bucket + 1) & _mask)
+    {
+        const auto& entry = _buckets[bucket];
+        if (entry.hash == hash && entry.index < gallery.Size() &&
+            ::strcmp(gallery.UserId(entry.index), user_id) == 0)
+        {
+            return entry.index;
+        }
+    }
+    return NotFound;
+}
+
+size_t MatcherUserIndex::FindBucket(uint32_t hash, size_t index) const
+{
+    if (_size == 0)
+    {
+        return NotFound;
+    }
+    for (size_t bucket = hash & _mask; _buckets[bucket].index != Empty; bucket = (bucket + 1) & _mask)
+    {
+        if (_buckets[bucket].index == index)
+        {
+            return bucket;
+        }
+    }
+    return NotFound;
+}
+
+void MatcherUserIndex::Insert(const char* user_id, size_t index)
+{
+    // at most half full
+    if ((_size + 1) * 2 > _buckets.size())
+    {
+        Grow((_size + 1) * 2);
+    }
+    InsertBucket(Hash(user_id), static_cast<uint32_t>(index));
+    _size++;
+}
+
+void MatcherUserIndex::InsertBucket(uint32_t hash, uint32_t index)
+{
+    size_t bucket = hash & _mask;
+    while (_buckets[bucket].index != Empty)
+    {
+        bucket = (bucket + 1) & _mask;
+    }
+    _buckets[bucket].hash = hash;
+    _buckets[bucket].index = index;
+}
+
+void MatcherUserIndex::Erase(const char* user_id, size_t index)
+{
+    const size_t bucket = FindBucket(Hash(user_id), index);
+    if (bucket != NotFound)
+    {
+        EraseBucket(bucket);
+        _size--;
+    }
+}
+
+void MatcherUserIndex::EraseBucket(size_t bucket)
+{
+    // backward shift: move back each following bucket of the run that may live in the freed one, i.e. whose home
+    // bucket is not between the freed bucket and its own one
+    size_t hole = bucket;
+    for (size_t next = (hole + 1) & _mask; _buckets[next].index != Empty; next = (next + 1) & _mask)
+    {
+        const size_t home = _buckets[next].hash & _mask;
+        if (((next - home) & _mask) >= ((next - hole) & _mask))
+        {
+            _buckets[hole] = _buckets[next];
+            hole = next;
+        }
+    }
+    _buckets[hole] = Bucket {};
+}
+
+void MatcherUserIndex::Move(const char* user_id, size_t from, size_t to)
+{
+    const size_t bucket = FindBucket(Hash(user_id), from);
+    if (bucket != NotFound)
+    {
+        _buckets[bucket].index = static_cast<uint32_t>(to);
+    }
+}
+
+void MatcherUserIndex::Rebuild(const MatcherGallery& gallery)
+{
+    Clear();
+    Grow(gallery.Size() * 2);
+    for (size_t i = 0; i < gallery.Size(); i++)
+    {
+        InsertBucket(Hash(gallery.UserId(i)), static_cast<uint32_t>(i));
+    }
+    _size = gallery.Size();
+}
+
+void MatcherUserIndex::Clear()
+{
+    _buckets.clear();
+    _mask = 0;
+    _size = 0;
+}
+
+size_t MatcherUserIndex::Size() const
+{
+    return _size;
+}
+
+void MatcherUserIndex::Grow(size_t min_buckets)
+{
+    size_t count = MinBuckets;
+    while (count < min_buckets)
+    {
+        count *= 2;
+    }
+    if (count <= _buckets.size())
+    {
+        return;
+    }
+
+    GalleryVector<Bucket> old_buckets(count);
+    old_buckets.swap(_buckets);
+    _mask = count - 1;
+    for (const auto& bucket : old_buckets)
+    {
+        if (bucket.index != Empty)
+        {
+            InsertBucket(bucket.hash, bucket.index);
+        }
+    }
+}
+} // namespace RealSenseID
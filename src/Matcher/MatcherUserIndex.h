@@ -0,0 +1,67 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "AlignedAllocator.h"
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace RealSenseID
+{
+class MatcherGallery;
+
+// User id -> gallery index lookup, so adding, updating and removing a user by id does not scan the gallery.
+//
+// Open addressing with linear probing over a power of two table of (hash, index) buckets, grown to stay at most half
+// full. The ids themselves are not copied: a bucket is confirmed against the id of the gallery entry it points at.
+// Deletion shifts the following buckets back instead of leaving tombstones, so lookups stay short under churn.
+//
+// The index does not observe the gallery, it has to be told about each change: Insert() after an Add(), and
+// Erase() / Move() around a MatcherGallery::SwapRemove() (which moves the last entry to the removed index).
+// Not thread safe.
+class MatcherUserIndex
+{
+public:
+    static constexpr size_t NotFound = SIZE_MAX;
+
+    // index of the user in the gallery or NotFound
+    size_t Find(const MatcherGallery& gallery, const char* user_id) const;
+
+    // user_id was added to the gallery at index
+    void Insert(const char* user_id, size_t index);
+    // user_id at index is removed from the gallery
+    void Erase(const char* user_id, size_t index);
+    // user_id moved from index from to index to
+    void Move(const char* user_id, size_t from, size_t to);
+
+    // index all the entries of the gallery (e.g. after attaching a gallery file)
+    void Rebuild(const MatcherGallery& gallery);
+    void Clear();
+
+    size_t Size() const;
+
+    // 32 bit fnv-1a of the id. stable across hosts and builds (the gallery wire selects nodes by it)
+    static uint32_t Hash(const char* user_id);
+
+private:
+    static constexpr uint32_t Empty = UINT32_MAX;
+
+    struct Bucket
+    {
+        uint32_t hash = 0;
+        uint32_t index = Empty;
+    };
+
+    // bucket holding the given gallery index for the id hash, or NotFound
+    size_t FindBucket(uint32_t hash, size_t index) const;
+    void InsertBucket(uint32_t hash, uint32_t index);
+    void EraseBucket(size_t bucket);
+    void Grow(size_t min_buckets);
+
+    GalleryVector<Bucket> _buckets;
+    size_t _mask = 0;
+    size_t _size = 0;
+};
+} // namespace RealSenseID
@@ -0,0 +1,937 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+// Micro benchmarks of the Matcher on synthetic galleries.
+// Build with -DRSID_MATCHER_BENCH=ON and run bin/rsid_matcher_bench (any google benchmark flag is supported, e.g.
+// --benchmark_filter=Gallery).
+//
+// The probes never match the gallery, so every search is a full scan (the worst case of an authentication).
+// Reported counters:
+//   time_per_candidate - search time divided by the gallery size, in seconds (e.g. "25ns")
+//   bytes_per_second - adaptive vector bytes streamed from the gallery
+// The kernels in use are reported in the context ("isa"); set RSID_FORCE_ISA (see CpuFeatures.h) to measure others.
+
+#include "Matcher.h"
+#include "MatcherGallery.h"
+#include "MatcherInt8Prefilter.h"
+#include "MatcherIvfIndex.h"
+#include "MatcherPqIndex.h"
+#include "MatcherSignPrefilter.h"
+#include "MatcherStaticGallery.h"
+#include "MatcherThreadPool.h"
+#include "MatcherTieredGallery.h"
+#include "MatcherUserIndex.h"
+#include "ExtendedFaceprints.h"
+#include "CpuFeatures.h"
+#include "benchmark/benchmark.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace RealSenseID
+{
+class MatcherBench
+{
+public:
+    static void MatchTwoVectors(const feature_t* T1, const feature_t* T2, match_calc_t* retprob)
+    {
+        Matcher::MatchTwoVectors(T1, T2, retprob);
+    }
+
+    static void BlendAverageVector(feature_t* average, const feature_t* new_vec)
+    {
+        Matcher::BlendAverageVector(average, new_vec);
+    }
+
+    static bool UpdateAverageVector(feature_t* updated_vec, const feature_t* orig_vec, const Thresholds& thresholds)
+    {
+        return Matcher::UpdateAverageVector(updated_vec, orig_vec, thresholds);
+    }
+
+    static match_calc_t CalculateConfidence(match_calc_t score, match_calc_t threshold, ExtendedMatchResult& result)
+    {
+        return Matcher::CalculateConfidence(score, threshold, result);
+    }
+
+    static Thresholds GetDefaultThresholds()
+    {
+        return Matcher::GetDefaultThresholds();
+    }
+};
+} // namespace RealSenseID
+
+using namespace RealSenseID;
+
+namespace
+{
+constexpr size_t VectorLength = RSID_NUMBER_OF_RECOGNITION_FACEPRINTS_MATCHER;
+
+void RandomVector(std::mt19937& rng, feature_t* vec)
+{
+    std::uniform_int_distribution<int> dist(-200, 200);
+    for (size_t i = 0; i < VectorLength; i++)
+    {
+        vec[i] = static_cast<feature_t>(dist(rng));
+    }
+}
+
+Faceprints RandomFaceprints(std::mt19937& rng)
+{
+    Faceprints faceprints;
+    RandomVector(rng, &faceprints.adaptiveDescriptorWithoutMask[0]);
+    RandomVector(rng, &faceprints.adaptiveDescriptorWithMask[0]);
+    ::memcpy(&faceprints.enrollmentDescriptor[0], &faceprints.adaptiveDescriptorWithoutMask[0],
+             VectorLength * sizeof(feature_t));
+    faceprints.adaptiveDescriptorWithoutMask[HAS_MASK_INDEX_IN_FEATURS_VECTOR] = 0;
+    faceprints.adaptiveDescriptorWithMask[HAS_MASK_INDEX_IN_FEATURS_VECTOR] = 0;
+    faceprints.enrollmentDescriptor[HAS_MASK_INDEX_IN_FEATURS_VECTOR] = 0;
+    return faceprints;
+}
+
+// the galleries are cached between benchmarks of the same size. Only one representation is kept at a time,
+// so the 1M user runs fit in memory.
+struct GalleryCache
+{
+    size_t size = 0;
+    std::unique_ptr<std::vector<ExtendedFaceprints>> array;
+    std::unique_ptr<MatcherGallery> gallery;
+};
+
+GalleryCache& Cache()
+{
+    static GalleryCache cache;
+    return cache;
+}
+
+const std::vector<ExtendedFaceprints>& GetArray(size_t size)
+{
+    auto& cache = Cache();
+    if (!cache.array || cache.size != size)
+    {
+        cache.gallery.reset();
+        cache.array.reset(new std::vector<ExtendedFaceprints>(size));
+        std::mt19937 rng(1);
+        for (auto& entry : *cache.array)
+        {
+            entry.user_id[0] = '\0';
+            entry.faceprints = RandomFaceprints(rng);
+        }
+        cache.size = size;
+    }
+    return *cache.array;
+}
+
+const MatcherGallery& GetGallery(size_t size)
+{
+    auto& cache = Cache();
+    if (!cache.gallery || cache.size != size)
+    {
+        cache.array.reset();
+        cache.gallery.reset(new MatcherGallery());
+        cache.gallery->Reserve(size);
+        std::mt19937 rng(1);
+        ExtendedFaceprints entry;
+        entry.user_id[0] = '\0';
+        for (size_t i = 0; i < size; i++)
+        {
+            entry.faceprints = RandomFaceprints(rng);
+            cache.gallery->Add(entry);
+        }
+        cache.size = size;
+    }
+    return *cache.gallery;
+}
+
+void SetScanCounters(benchmark::State& state, size_t candidates)
+{
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * candidates));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * candidates * VectorLength * sizeof(feature_t)));
+    state.counters["time_per_candidate"] = benchmark::Counter(
+        static_cast<double>(candidates), benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+}
+
+void BM_MatchTwoVectors(benchmark::State& state)
+{
+    std::mt19937 rng(2);
+    feature_t T1[VectorLength], T2[VectorLength];
+    RandomVector(rng, T1);
+    RandomVector(rng, T2);
+    match_calc_t score = 0;
+    for (auto _ : state)
+    {
+        MatcherBench::MatchTwoVectors(T1, T2, &score);
+        benchmark::DoNotOptimize(score);
+    }
+    SetScanCounters(state, 1);
+}
+
+// single vs. single, as in a host loop over its own users: a non-matching pair (range 0) or a probe close to the
+// user, so the adaptive update is built too (range 1).
+void BM_MatchFaceprints(benchmark::State& state)
+{
+    std::mt19937 rng(6);
+    const Faceprints existing = RandomFaceprints(rng);
+    Faceprints probe = RandomFaceprints(rng);
+    if (state.range(0) != 0)
+    {
+        probe = existing;
+        std::uniform_int_distribution<int> noise(-40, 40);
+        for (size_t i = 0; i < VectorLength; i++)
+        {
+            const int value = existing.adaptiveDescriptorWithoutMask[i] + noise(rng);
+            probe.adaptiveDescriptorWithoutMask[i] =
+                static_cast<feature_t>(std::max(-RSID_MAX_FEATURE_VALUE, std::min(RSID_MAX_FEATURE_VALUE, value)));
+        }
+    }
+    Faceprints updated;
+    for (auto _ : state)
+    {
+        auto result = Matcher::MatchFaceprints(probe, existing, updated);
+        benchmark::DoNotOptimize(result);
+    }
+    auto result = Matcher::MatchFaceprints(probe, existing, updated);
+    state.counters["should_update"] = result.should_update ? 1 : 0;
+}
+
+void BM_MatchFaceprintsToArray_Vector(benchmark::State& state)
+{
+    const size_t size = static_cast<size_t>(state.range(0));
+    const auto& array = GetArray(size);
+    std::mt19937 rng(3);
+    const Faceprints probe = RandomFaceprints(rng);
+    const Thresholds thresholds = MatcherBench::GetDefaultThresholds();
+    Faceprints updated;
+    for (auto _ : state)
+    {
+        auto result = Matcher::MatchFaceprintsToArray(probe, array, updated, thresholds);
+        benchmark::DoNotOptimize(result);
+    }
+    SetScanCounters(state, size);
+}
+
+void BM_MatchFaceprintsToArray_Gallery(benchmark::State& state)
+{
+    const size_t size = static_cast<size_t>(state.range(0));
+    const auto& gallery = GetGallery(size);
+    std::mt19937 rng(3);
+    const Faceprints probe = RandomFaceprints(rng);
+    const Thresholds thresholds = MatcherBench::GetDefaultThresholds();
+    Faceprints updated;
+    for (auto _ : state)
+    {
+        auto result = Matcher::MatchFaceprintsToArray(probe, gallery, updated, thresholds);
+        benchmark::DoNotOptimize(result);
+    }
+    SetScanCounters(state, size);
+}
+
+// fixed capacity gallery of the same users as the MatcherGallery (the probe matches no one). static storage: 4096 users
+// are ~7MB. the result is checked against the MatcherGallery search first.
+void BM_MatchFaceprintsToArray_StaticGallery(benchmark::State& state)
+{
+    static MatcherStaticGallery<4096> static_gallery;
+    const size_t size = static_cast<size_t>(state.range(0));
+    const auto& gallery = GetGallery(size);
+    static_gallery.Clear();
+    for (size_t i = 0; i < size; i++)
+    {
+        static_gallery.Add(gallery.Entry(i));
+    }
+    std::mt19937 rng(3);
+    const Faceprints probe = RandomFaceprints(rng);
+    const Thresholds thresholds = MatcherBench::GetDefaultThresholds();
+    Faceprints updated;
+    auto plain = Matcher::MatchFaceprintsToArray(probe, gallery, updated, thresholds);
+    auto result = Matcher::MatchFaceprintsToArray(probe, static_gallery, updated, thresholds);
+    if (static_gallery.Size() != size || result.userId != plain.userId || result.maxScore != plain.maxScore)
+    {
+        state.SkipWithError("static gallery result differs from the gallery search");
+        return;
+    }
+    for (auto _ : state)
+    {
+        result = Matcher::MatchFaceprintsToArray(probe, static_gallery, updated, thresholds);
+        benchmark::DoNotOptimize(result);
+    }
+    SetScanCounters(state, size);
+}
+
+// exact search with the int8 prefilter bounds (the probe matches no one): only the entries whose bound can beat the
+// best score are scored exactly. the result is checked against the plain search first.
+void BM_MatchFaceprintsToArray_Bounded(benchmark::State& state)
+{
+    const size_t size = static_cast<size_t>(state.range(0));
+    const auto& gallery = GetGallery(size);
+    MatcherInt8Prefilter prefilter;
+    prefilter.Build(gallery);
+    std::mt19937 rng(3);
+    const Faceprints probe = RandomFaceprints(rng);
+    const Thresholds thresholds = MatcherBench::GetDefaultThresholds();
+    Faceprints updated;
+    auto plain = Matcher::MatchFaceprintsToArray(probe, gallery, updated, thresholds);
+    auto bounded = Matcher::MatchFaceprintsToArray(probe, gallery, prefilter, updated, thresholds);
+    if (bounded.userId != plain.userId || bounded.maxScore != plain.maxScore)
+    {
+        state.SkipWithError("bounded result differs from the plain search");
+        return;
+    }
+    for (auto _ : state)
+    {
+        auto result = Matcher::MatchFaceprintsToArray(probe, gallery, prefilter, updated, thresholds);
+        benchmark::DoNotOptimize(result);
+    }
+    SetScanCounters(state, size);
+}
+
+// sign prefilter shortlist, then exact scoring of the shortlist. the probe is a noisy copy of an enrolled user (in the
+// middle of the gallery), which must be found. arguments: gallery size, shortlist size.
+void BM_MatchFaceprintsToArray_SignPrefilter(benchmark::State& state)
+{
+    const size_t size = static_cast<size_t>(state.range(0));
+    const size_t shortlist_size = static_cast<size_t>(state.range(1));
+    const auto& gallery = GetGallery(size);
+    MatcherSignPrefilter prefilter;
+    prefilter.Build(gallery);
+    const size_t user = size / 2;
+    Faceprints probe = gallery.Entry(user).faceprints;
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<int> noise(-60, 60);
+    for (size_t i = 0; i < VectorLength; i++)
+    {
+        auto& value = probe.adaptiveDescriptorWithoutMask[i];
+        value = static_cast<feature_t>(value + noise(rng));
+    }
+    const Thresholds thresholds = MatcherBench::GetDefaultThresholds();
+    Faceprints updated;
+    auto result = Matcher::MatchFaceprintsToArray(probe, gallery, prefilter, shortlist_size, updated, thresholds);
+    if (!result.isSame || result.userId != static_cast<int>(user))
+    {
+        state.SkipWithError("enrolled user not found in the shortlist");
+        return;
+    }
+    for (auto _ : state)
+    {
+        result = Matcher::MatchFaceprintsToArray(probe, gallery, prefilter, shortlist_size, updated, thresholds);
+        benchmark::DoNotOptimize(result);
+    }
+    // the scan reads the signatures, not the vectors: no bytes_per_second
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * size));
+    state.counters["time_per_candidate"] = benchmark::Counter(
+        static_cast<double>(size), benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+}
+
+// pq index shortlist, then exact scoring of the shortlist, as above. arguments: gallery size, shortlist size.
+void BM_MatchFaceprintsToArray_PqIndex(benchmark::State& state)
+{
+    const size_t size = static_cast<size_t>(state.range(0));
+    const size_t shortlist_size = static_cast<size_t>(state.range(1));
+    const auto& gallery = GetGallery(size);
+    MatcherPqIndex index;
+    index.Build(gallery);
+    const size_t user = size / 2;
+    Faceprints probe = gallery.Entry(user).faceprints;
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<int> noise(-60, 60);
+    for (size_t i = 0; i < VectorLength; i++)
+    {
+        auto& value = probe.adaptiveDescriptorWithoutMask[i];
+        value = static_cast<feature_t>(value + noise(rng));
+    }
+    const Thresholds thresholds = MatcherBench::GetDefaultThresholds();
+    Faceprints updated;
+    auto result = Matcher::MatchFaceprintsToArray(probe, gallery, index, shortlist_size, updated, thresholds);
+    if (!result.isSame || result.userId != static_cast<int>(user))
+    {
+        state.SkipWithError("enrolled user not found in the shortlist");
+        return;
+    }
+    for (auto _ : state)
+    {
+        result = Matcher::MatchFaceprintsToArray(probe, gallery, index, shortlist_size, updated, thresholds);
+        benchmark::DoNotOptimize(result);
+    }
+    // the scan reads the codes, not the vectors: no bytes_per_second
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * size));
+    state.counters["time_per_candidate"] = benchmark::Counter(
+        static_cast<double>(size), benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+}
+
+// repeated authentications of the same enrolled user (in the middle of the gallery), with the 4 users matched last
+// as search hints (hints:1) or without (hints:0). the hinted result is checked against the plain search first.
+void BM_MatchFaceprintsToArray_Hinted(benchmark::State& state)
+{
+    const size_t size = static_cast<size_t>(state.range(0));
+    const auto& gallery = GetGallery(size);
+    const size_t user = size / 2;
+    const Faceprints probe = gallery.Entry(user).faceprints;
+    const size_t recent[] = {size / 3, user, 7, size - 1};
+    const Thresholds thresholds = MatcherBench::GetDefaultThresholds();
+    SearchConfig search_config;
+    if (state.range(1) != 0)
+    {
+        search_config.hints = recent;
+        search_config.number_of_hints = sizeof(recent) / sizeof(recent[0]);
+    }
+    Faceprints updated;
+    auto plain = Matcher::MatchFaceprintsToArray(probe, gallery, updated, thresholds);
+    auto hinted = Matcher::MatchFaceprintsToArray(probe, gallery, updated, thresholds, search_config);
+    if (!hinted.isSame || hinted.userId != plain.userId || hinted.maxScore != plain.maxScore)
+    {
+        state.SkipWithError("hinted result differs from the plain search");
+        return;
+    }
+    for (auto _ : state)
+    {
+        auto result = Matcher::MatchFaceprintsToArray(probe, gallery, updated, thresholds, search_config);
+        benchmark::DoNotOptimize(result);
+    }
+}
+
+// deadline bounded search of a noisy probe of an enrolled user (in the middle of the gallery), in ivf priority order
+// (ivf:1, sqrt(size) lists) or gallery order (ivf:0), with a time budget (budget_us:0 - none). the result without a
+// deadline is checked against the plain search first. counters: the fraction of the searches that found the user and
+// that were complete.
+void BM_MatchFaceprintsToArray_Anytime(benchmark::State& state)
+{
+    const size_t size = static_cast<size_t>(state.range(0));
+    const auto& gallery = GetGallery(size);
+    MatcherIvfIndex index;
+    if (state.range(1) != 0)
+    {
+        index.Build(gallery, static_cast<size_t>(std::sqrt(static_cast<double>(size))), 2);
+    }
+    const MatcherIvfIndex* ivf = index.IsBuilt() ? &index : nullptr;
+    const auto budget = std::chrono::microseconds(state.range(2));
+    const size_t user = size / 2;
+    Faceprints probe = gallery.Entry(user).faceprints;
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<int> noise(-60, 60);
+    for (size_t i = 0; i < VectorLength; i++)
+    {
+        auto& value = probe.adaptiveDescriptorWithoutMask[i];
+        value = static_cast<feature_t>(value + noise(rng));
+    }
+    const Thresholds thresholds = MatcherBench::GetDefaultThresholds();
+    const SearchConfig search_config;
+    Faceprints updated;
+    bool complete = false;
+    auto plain = Matcher::MatchFaceprintsToArray(probe, gallery, updated, thresholds);
+    const auto no_deadline = std::chrono::steady_clock::time_point::max();
+    auto result = Matcher::MatchFaceprintsToArrayAnytime(probe, gallery, ivf, no_deadline, updated, thresholds,
+                                                         search_config, complete);
+    if (!complete || !result.isSame || result.userId != plain.userId || result.maxScore != plain.maxScore)
+    {
+        state.SkipWithError("anytime result differs from the plain search");
+        return;
+    }
+    int64_t found = 0;
+    int64_t completed = 0;
+    for (auto _ : state)
+    {
+        const auto deadline = budget.count() > 0 ? std::chrono::steady_clock::now() + budget : no_deadline;
+        result = Matcher::MatchFaceprintsToArrayAnytime(probe, gallery, ivf, deadline, updated, thresholds,
+                                                        search_config, complete);
+        found += result.isSame ? 1 : 0;
+        completed += complete ? 1 : 0;
+        benchmark::DoNotOptimize(result);
+    }
+    state.counters["found"] = static_cast<double>(found) / static_cast<double>(state.iterations());
+    state.counters["complete"] = static_cast<double>(completed) / static_cast<double>(state.iterations());
+}
+
+// a door admitting some of the users of a shared gallery: each user is eligible with the given percentage, the
+// others are skipped by the eligible bitset. the result is checked against the plain search of a gallery holding only
+// the eligible users first.
+void BM_MatchFaceprintsToArray_Eligible(benchmark::State& state)
+{
+    const size_t size = static_cast<size_t>(state.range(0));
+    const auto& gallery = GetGallery(size);
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> percent(0, 99);
+    std::vector<uint64_t> eligible((size + 63) / 64, 0);
+    MatcherGallery eligible_gallery;
+    std::vector<size_t> eligible_index;
+    for (size_t i = 0; i < size; i++)
+    {
+        if (percent(rng) < state.range(1))
+        {
+            eligible[i / 64] |= uint64_t {1} << (i % 64);
+            eligible_gallery.Add(gallery.Entry(i));
+            eligible_index.push_back(i);
+        }
+    }
+    const Faceprints probe = RandomFaceprints(rng);
+    const Thresholds thresholds = MatcherBench::GetDefaultThresholds();
+    SearchConfig search_config;
+    search_config.eligible = eligible.data();
+    Faceprints updated;
+    auto plain = Matcher::MatchFaceprintsToArray(probe, eligible_gallery, updated, thresholds);
+    auto result = Matcher::MatchFaceprintsToArray(probe, gallery, updated, thresholds, search_config);
+    const int expected_user = plain.userId < 0 ? -1 : static_cast<int>(eligible_index[plain.userId]);
+    if (result.userId != expected_user || result.maxScore != plain.maxScore)
+    {
+        state.SkipWithError("eligible result differs from the search of the eligible users");
+        return;
+    }
+    for (auto _ : state)
+    {
+        result = Matcher::MatchFaceprintsToArray(probe, gallery, updated, thresholds, search_config);
+        benchmark::DoNotOptimize(result);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * size));
+    state.counters["time_per_candidate"] = benchmark::Counter(
+        static_cast<double>(size), benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+}
+
+// the faces of a group (FaceSelectionPolicy::All) matched in one batch, one of them enrolled. arguments: gallery
+// size, search threads. the results are checked against the single probe search first.
+void BM_MatchFaceprintsToArrayBatch_Group(benchmark::State& state)
+{
+    constexpr size_t GroupSize = 5;
+    const size_t size = static_cast<size_t>(state.range(0));
+    const auto& gallery = GetGallery(size);
+    std::mt19937 rng(6);
+    std::vector<Faceprints> probes;
+    for (size_t i = 0; i < GroupSize; i++)
+    {
+        probes.push_back(RandomFaceprints(rng));
+    }
+    // one enrolled face, in the last shard (its scan stops early)
+    probes[1] = gallery.Entry(size - size / 8).faceprints;
+    const Thresholds thresholds = MatcherBench::GetDefaultThresholds();
+    MatcherThreadPool pool {static_cast<size_t>(state.range(1))};
+    SearchConfig search_config;
+    search_config.pool = &pool;
+    std::vector<ExtendedMatchResult> results(GroupSize);
+    std::vector<Faceprints> updated(GroupSize);
+
+    Matcher::MatchFaceprintsToArrayBatch(probes.data(), GroupSize, gallery, results.data(), updated.data(),
+                                         thresholds, search_config);
+    for (size_t i = 0; i < GroupSize; i++)
+    {
+        Faceprints single_updated;
+        auto single = Matcher::MatchFaceprintsToArray(probes[i], gallery, single_updated, thresholds);
+        if (single.userId != results[i].userId || single.maxScore != results[i].maxScore)
+        {
+            state.SkipWithError("batch result differs from the single probe search");
+            return;
+        }
+    }
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(Matcher::MatchFaceprintsToArrayBatch(
+            probes.data(), GroupSize, gallery, results.data(), updated.data(), thresholds, search_config));
+    }
+    SetScanCounters(state, size * GroupSize);
+}
+
+// skewed authentications: 80% of the probes are one of 5% frequent users (every 20th user, so the plain search does
+// not find them early), the rest any enrolled user. arguments: gallery size, hot tier capacity (0 - plain gallery
+// search). the hot tier is warmed with 4 probes per frequent user first, and the first warm-up results are checked
+// against the plain search.
+void BM_MatchTieredGallery_Skewed(benchmark::State& state)
+{
+    constexpr size_t CheckedProbes = 256;
+    const size_t size = static_cast<size_t>(state.range(0));
+    const auto& gallery = GetGallery(size);
+    TieredGalleryConfig config;
+    config.hot_capacity = static_cast<size_t>(state.range(1));
+    MatcherTieredGallery tiered {config};
+    for (size_t i = 0; i < size; i++)
+    {
+        tiered.Add(gallery.Entry(i));
+    }
+
+    std::mt19937 rng(7);
+    const size_t frequent_users = size / 20;
+    std::uniform_int_distribution<size_t> frequent_user(0, frequent_users - 1);
+    std::uniform_int_distribution<size_t> any_user(0, size - 1);
+    std::bernoulli_distribution is_frequent(0.8);
+    auto next_probe = [&]() {
+        size_t user = is_frequent(rng) ? frequent_user(rng) * 20 : any_user(rng);
+        return gallery.Entry(user).faceprints;
+    };
+
+    const Thresholds thresholds = MatcherBench::GetDefaultThresholds();
+    SearchConfig search_config;
+    Faceprints updated;
+    for (size_t i = 0; i < 4 * frequent_users; i++)
+    {
+        const auto& probe = next_probe();
+        auto result = tiered.Match(probe, updated, thresholds, search_config);
+        if (i >= CheckedProbes)
+        {
+            continue;
+        }
+        auto plain = Matcher::MatchFaceprintsToArray(probe, gallery, updated, thresholds);
+        if (result.userId != plain.userId || result.maxScore != plain.maxScore)
+        {
+            state.SkipWithError("tiered result differs from the plain search");
+            return;
+        }
+    }
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(tiered.Match(next_probe(), updated, thresholds, search_config));
+    }
+    state.counters["hot_users"] = static_cast<double>(tiered.Hot().Size());
+}
+
+// reference GalleryAccelerator on the cpu: float normalized correlation of every row, stands in for a GPU kernel
+class ReferenceAccelerator : public GalleryAccelerator
+{
+public:
+    bool Resize(size_t number_of_rows) override
+    {
+        _rows.resize(number_of_rows * VectorLength);
+        _norms.resize(number_of_rows);
+        return true;
+    }
+
+    bool SetRows(size_t first_row, size_t number_of_rows, const int16_t* vectors) override
+    {
+        for (size_t row = first_row; row < first_row + number_of_rows; row++, vectors += VectorLength)
+        {
+            std::copy(vectors, vectors + VectorLength, &_rows[row * VectorLength]);
+            _norms[row] = Norm(&_rows[row * VectorLength]);
+        }
+        return true;
+    }
+
+    bool Search(const int16_t* probes, size_t number_of_probes, size_t shortlist_size, uint32_t* shortlist) override
+    {
+        std::vector<float> scores(_norms.size());
+        std::vector<uint32_t> order(_norms.size());
+        float probe[VectorLength];
+        for (size_t i = 0; i < number_of_probes; i++, probes += VectorLength)
+        {
+            std::copy(probes, probes + VectorLength, probe);
+            const float probe_norm = Norm(probe);
+            for (size_t row = 0; row < _norms.size(); row++)
+            {
+                const float* vec = &_rows[row * VectorLength];
+                float dot = 0;
+                for (size_t j = 0; j < VectorLength; j++)
+                {
+                    dot += probe[j] * vec[j];
+                }
+                scores[row] = dot / (probe_norm * _norms[row]);
+                order[row] = static_cast<uint32_t>(row);
+            }
+            std::partial_sort(order.begin(), order.begin() + shortlist_size, order.end(),
+                              [&scores](uint32_t a, uint32_t b) { return scores[a] > scores[b]; });
+            std::copy(order.begin(), order.begin() + shortlist_size, shortlist + i * shortlist_size);
+        }
+        return true;
+    }
+
+private:
+    static float Norm(const float* vec)
+    {
+        float sum = 0;
+        for (size_t j = 0; j < VectorLength; j++)
+        {
+            sum += vec[j] * vec[j];
+        }
+        return std::max(std::sqrt(sum), 1.0f);
+    }
+
+    std::vector<float> _rows;
+    std::vector<float> _norms;
+};
+
+// tiered gallery (no hot tier) scanned by the reference accelerator: the result must be the one of the cpu search.
+// the time is that of the float scan plus the exact scoring of the shortlist.
+void BM_MatchTieredGallery_Accelerated(benchmark::State& state)
+{
+    constexpr size_t CheckedProbes = 64;
+    const size_t size = static_cast<size_t>(state.range(0));
+    const auto& gallery = GetGallery(size);
+    MatcherTieredGallery tiered {TieredGalleryConfig()};
+    for (size_t i = 0; i < size; i++)
+    {
+        tiered.Add(gallery.Entry(i));
+    }
+    ReferenceAccelerator accelerator;
+    tiered.SetAccelerator(&accelerator, static_cast<size_t>(state.range(1)));
+
+    std::mt19937 rng(9);
+    std::uniform_int_distribution<size_t> any_user(0, size - 1);
+    const Thresholds thresholds = MatcherBench::GetDefaultThresholds();
+    SearchConfig search_config;
+    search_config.defer_update = true;
+    Faceprints updated;
+    for (size_t i = 0; i < CheckedProbes; i++)
+    {
+        const auto probe = gallery.Entry(any_user(rng)).faceprints;
+        auto result = tiered.Match(probe, updated, thresholds, search_config);
+        auto plain = Matcher::MatchFaceprintsToArray(probe, gallery, updated, thresholds);
+        if (result.userId != plain.userId || result.maxScore != plain.maxScore)
+        {
+            state.SkipWithError("accelerated result differs from the cpu search");
+            return;
+        }
+    }
+
+    for (auto _ : state)
+    {
+        const auto probe = gallery.Entry(any_user(rng)).faceprints;
+        benchmark::DoNotOptimize(tiered.Match(probe, updated, thresholds, search_config));
+    }
+}
+
+// enroll / remove churn by user id: each iteration removes a random user and adds a new one, as HostGallery does
+void BM_GalleryChurn(benchmark::State& state)
+{
+    const size_t size = static_cast<size_t>(state.range(0));
+    MatcherGallery gallery;
+    MatcherUserIndex index;
+    gallery.Reserve(size + 1);
+    std::mt19937 rng(1);
+    ExtendedFaceprints entry;
+    entry.faceprints = RandomFaceprints(rng);
+    size_t next_user = 0;
+    auto add_user = [&]() {
+        ::snprintf(entry.user_id, sizeof(entry.user_id), "user%zu", next_user++);
+        gallery.Add(entry);
+        index.Insert(entry.user_id, gallery.Size() - 1);
+    };
+    for (size_t i = 0; i < size; i++)
+    {
+        add_user();
+    }
+
+    std::uniform_int_distribution<size_t> any_user(0, size - 1);
+    char user_id[sizeof(entry.user_id)];
+    for (auto _ : state)
+    {
+        ::strcpy(user_id, gallery.UserId(any_user(rng)));
+        const size_t removed = index.Find(gallery, user_id);
+        const size_t last = gallery.Size() - 1;
+        index.Erase(user_id, removed);
+        if (removed != last)
+        {
+            index.Move(gallery.UserId(last), last, removed);
+        }
+        gallery.SwapRemove(removed);
+        add_user();
+    }
+    if (index.Find(gallery, entry.user_id) != gallery.Size() - 1)
+    {
+        state.SkipWithError("user index out of sync with the gallery");
+    }
+}
+
+// all-pairs duplicate search of the gallery (the random users match no one). items are the scored pairs.
+void BM_FindDuplicates(benchmark::State& state)
+{
+    const size_t size = static_cast<size_t>(state.range(0));
+    const auto& gallery = GetGallery(size);
+    const Thresholds thresholds = MatcherBench::GetDefaultThresholds();
+    std::vector<DuplicatePair> pairs;
+    for (auto _ : state)
+    {
+        Matcher::FindDuplicates(gallery, thresholds.strongThreshold_pNMgNM, 1000, pairs);
+        benchmark::DoNotOptimize(pairs.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * size * (size - 1) / 2));
+}
+
+// adaptive update of a matched user: built in a copy of its faceprints and stored back (0), or in place (1). both
+// must leave the same entry.
+void BM_GalleryAdaptiveUpdate(benchmark::State& state)
+{
+    constexpr size_t Size = 10000;
+    const bool in_place = state.range(0) != 0;
+    MatcherGallery gallery = GetGallery(Size);
+    MatcherGallery reference = gallery;
+    const Thresholds thresholds = MatcherBench::GetDefaultThresholds();
+    std::mt19937 rng(11);
+    std::uniform_int_distribution<size_t> any_user(0, Size - 1);
+    Faceprints updated;
+    for (size_t i = 0; i < 16; i++)
+    {
+        const size_t index = any_user(rng);
+        const Faceprints probe = RandomFaceprints(rng);
+        Matcher::BuildAdaptiveUpdate(probe, reference.Entry(index).faceprints, thresholds, updated);
+        reference.Update(index, updated);
+        Matcher::UpdateGalleryEntry(probe, gallery, index, thresholds);
+        const size_t row_size = VectorLength * sizeof(feature_t);
+        if (::memcmp(gallery.AdaptiveVector(index), reference.AdaptiveVector(index), row_size) != 0 ||
+            gallery.Norm(index).norm != reference.Norm(index).norm)
+        {
+            state.SkipWithError("in place update differs from the copy");
+            return;
+        }
+    }
+
+    const Faceprints probe = RandomFaceprints(rng);
+    for (auto _ : state)
+    {
+        const size_t index = any_user(rng);
+        if (in_place)
+        {
+            Matcher::UpdateGalleryEntry(probe, gallery, index, thresholds);
+        }
+        else
+        {
+            Matcher::BuildAdaptiveUpdate(probe, gallery.Entry(index).faceprints, thresholds, updated);
+            gallery.Update(index, updated);
+        }
+        benchmark::ClobberMemory();
+    }
+}
+
+// the full faceprints of a user, reassembled from the hot and cold data of the gallery (once per adaptive update).
+// bytes_per_user is the gallery memory per user, hot and cold data together.
+void BM_GalleryEntry(benchmark::State& state)
+{
+    const size_t size = static_cast<size_t>(state.range(0));
+    const auto& gallery = GetGallery(size);
+    std::mt19937 first_user_rng(1);
+    const Faceprints first_user = RandomFaceprints(first_user_rng);
+    const auto entry = gallery.Entry(0);
+    // RandomFaceprints sets the vector values and the mask flag
+    const size_t compared_size = (VectorLength + 1) * sizeof(feature_t);
+    if (::memcmp(entry.faceprints.adaptiveDescriptorWithoutMask, first_user.adaptiveDescriptorWithoutMask,
+                 compared_size) != 0 ||
+        ::memcmp(entry.faceprints.adaptiveDescriptorWithMask, first_user.adaptiveDescriptorWithMask, compared_size) !=
+            0 ||
+        ::memcmp(entry.faceprints.enrollmentDescriptor, first_user.enrollmentDescriptor, compared_size) != 0)
+    {
+        state.SkipWithError("gallery entry differs from the added faceprints");
+        return;
+    }
+
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<size_t> any_user(0, size - 1);
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(gallery.Entry(any_user(rng)));
+    }
+    state.counters["bytes_per_user"] = static_cast<double>(
+        sizeof(GalleryColdEntry) + 2 * (VectorLength * sizeof(feature_t) + sizeof(GalleryEntryNorm) + 1));
+}
+
+void BM_BlendAverageVector(benchmark::State& state)
+{
+    std::mt19937 rng(4);
+    feature_t average[VectorLength], new_vec[VectorLength];
+    RandomVector(rng, average);
+    RandomVector(rng, new_vec);
+    for (auto _ : state)
+    {
+        MatcherBench::BlendAverageVector(average, new_vec);
+        benchmark::ClobberMemory();
+    }
+    SetScanCounters(state, 1);
+}
+
+void BM_ValidateFaceprints(benchmark::State& state)
+{
+    std::mt19937 rng(6);
+    const Faceprints faceprints = RandomFaceprints(rng);
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(Matcher::ValidateFaceprints(faceprints));
+    }
+    SetScanCounters(state, 1);
+}
+
+void BM_UpdateAverageVector(benchmark::State& state)
+{
+    std::mt19937 rng(5);
+    feature_t orig[VectorLength], updated[VectorLength], work[VectorLength];
+    RandomVector(rng, orig);
+    RandomVector(rng, updated);
+    const Thresholds thresholds = MatcherBench::GetDefaultThresholds();
+    for (auto _ : state)
+    {
+        ::memcpy(work, updated, sizeof(work));
+        benchmark::DoNotOptimize(MatcherBench::UpdateAverageVector(work, orig, thresholds));
+    }
+    SetScanCounters(state, 1);
+}
+
+void BM_CalculateConfidence(benchmark::State& state)
+{
+    const Thresholds thresholds = MatcherBench::GetDefaultThresholds();
+    ExtendedMatchResult result;
+    match_calc_t score = 0;
+    for (auto _ : state)
+    {
+        // sweep the whole grade range, both below and above the threshold
+        score = static_cast<match_calc_t>((score + 97) & 4095);
+        benchmark::DoNotOptimize(
+            MatcherBench::CalculateConfidence(score, thresholds.strongThreshold_pNMgNM, result));
+    }
+}
+} // namespace
+
+BENCHMARK(BM_MatchTwoVectors);
+BENCHMARK(BM_MatchFaceprints)->Arg(0)->Arg(1);
+BENCHMARK(BM_MatchFaceprintsToArray_Vector)->RangeMultiplier(10)->Range(100, 1000000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_MatchFaceprintsToArray_Gallery)->RangeMultiplier(10)->Range(100, 1000000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_MatchFaceprintsToArray_StaticGallery)->Arg(100)->Arg(1000)->Arg(4096)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_MatchFaceprintsToArray_Bounded)->RangeMultiplier(10)->Range(100, 1000000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_MatchFaceprintsToArray_SignPrefilter)
+    ->ArgNames({"size", "shortlist"})
+    ->ArgsProduct({{100000, 1000000}, {256, 4096}})
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_MatchFaceprintsToArray_PqIndex)
+    ->ArgNames({"size", "shortlist"})
+    ->ArgsProduct({{100000, 1000000}, {256, 4096}})
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_MatchFaceprintsToArray_Hinted)
+    ->ArgNames({"size", "hints"})
+    ->ArgsProduct({{10000, 100000}, {0, 1}})
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_MatchFaceprintsToArray_Anytime)
+    ->ArgNames({"size", "ivf", "budget_us"})
+    ->ArgsProduct({{100000}, {0, 1}, {0, 100, 1000}})
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_MatchFaceprintsToArray_Eligible)
+    ->ArgNames({"size", "percent"})
+    ->ArgsProduct({{100000}, {1, 10, 50, 100}})
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_MatchFaceprintsToArrayBatch_Group)
+    ->ArgNames({"size", "threads"})
+    ->ArgsProduct({{10000, 100000}, {1, 4}})
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
+BENCHMARK(BM_MatchTieredGallery_Skewed)
+    ->ArgNames({"size", "hot"})
+    ->ArgsProduct({{10000, 100000}, {0, 1024, 8192}})
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_MatchTieredGallery_Accelerated)
+    ->ArgNames({"size", "shortlist"})
+    ->ArgsProduct({{10000, 100000}, {16, 64}})
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_GalleryChurn)->RangeMultiplier(10)->Range(1000, 100000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_FindDuplicates)->RangeMultiplier(4)->Range(1024, 16384)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_GalleryAdaptiveUpdate)->ArgNames({"in_place"})->Arg(0)->Arg(1);
+BENCHMARK(BM_GalleryEntry)->RangeMultiplier(100)->Range(1000, 100000);
+BENCHMARK(BM_BlendAverageVector);
+BENCHMARK(BM_ValidateFaceprints);
+BENCHMARK(BM_UpdateAverageVector);
+BENCHMARK(BM_CalculateConfidence);
+
+int main(int argc, char** argv)
+{
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        return 1;
+    }
+    benchmark::AddCustomContext("isa", RealSenseID::CpuFeatures::LevelName());
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,178 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+// Score distribution of labeled faceprints, for tuning the matcher thresholds.
+// The faceprints are gallery files (MatcherGalleryFile, e.g. HostGallery::Save()) where the user id of an entry is
+// the label of its subject: entries with the same user id are the same person. Every probe is scored against every
+// reference with the matcher's own kernels (MatcherEvaluation), and the tool prints the genuine / impostor counts,
+// the equal error rate, the threshold for the target false accept rate and the rates at the default threshold.
+//
+// Usage: rsid-matcher-eval [options] <probes gallery> [references gallery]
+//   without a references gallery the probes are scored against each other.
+//   --pairs nomask|mask|mask-to-mask  threshold set to evaluate (default nomask):
+//                                     nomask       - probes without mask vs. without-mask descriptors (pNMgNM)
+//                                     mask         - probes with mask vs. without-mask descriptors (pMgNM)
+//                                     mask-to-mask - probes with mask vs. with-mask descriptors (pMgM)
+//   --far <rate>                      target false accept rate (default 1e-5)
+//   --threads <n>                     scoring threads (default: all the cpus)
+//   --csv <path>                      write the histograms and rates per score
+
+#include "MatcherEvaluation.h"
+#include "MatcherGallery.h"
+#include "MatcherGalleryFile.h"
+#include "MatcherThreadPool.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+
+using namespace RealSenseID;
+
+static constexpr int SUCCESS_MAIN = 0;
+static constexpr int FAILURE_MAIN = 1;
+
+static void PrintUsage(const char* name)
+{
+    std::cout << "Usage: " << name << " [options] <probes gallery> [references gallery]\n"
+              << "  --pairs nomask|mask|mask-to-mask  threshold set to evaluate (default nomask)\n"
+              << "  --far <rate>                      target false accept rate (default 1e-5)\n"
+              << "  --threads <n>                     scoring threads (default: all the cpus)\n"
+              << "  --csv <path>                      write the histograms and rates per score\n";
+}
+
+static bool LoadGallery(const char* path, MatcherGallery& gallery)
+{
+    auto file = MatcherGalleryFile::Open(path);
+    if (!file)
+    {
+        std::cout << "Failed to open gallery file " << path << '\n';
+        return false;
+    }
+    gallery.Attach(std::move(file));
+    return true;
+}
+
+static void PrintRates(const char* title, const ScoreDistribution& scores, int threshold)
+{
+    std::cout << std::left << std::setw(28) << title << std::right << " threshold " << std::setw(4) << threshold
+              << "  FAR " << std::scientific << std::setprecision(3) << scores.FalseAcceptRate(threshold) << "  FRR "
+              << scores.FalseRejectRate(threshold) << std::defaultfloat << '\n';
+}
+
+static bool WriteCsv(const char* path, const ScoreDistribution& scores)
+{
+    std::ofstream csv(path);
+    if (!csv)
+    {
+        return false;
+    }
+    csv << "score,genuine,impostor,far,frr\n";
+    csv << std::setprecision(9);
+    for (int s = 0; s <= ScoreDistribution::MaxScore; s++)
+    {
+        csv << s << ',' << scores.genuine[s] << ',' << scores.impostor[s] << ',' << scores.FalseAcceptRate(s) << ','
+            << scores.FalseRejectRate(s) << '\n';
+    }
+    return static_cast<bool>(csv);
+}
+
+int main(int argc, char* argv[])
+{
+    EvaluationPairs pairs = EvaluationPairs::NoMask;
+    double target_far = 1e-5;
+    size_t threads = std::max<unsigned int>(std::thread::hardware_concurrency(), 1);
+    const char* csv_path = nullptr;
+    const char* paths[2] = {nullptr, nullptr};
+    size_t n_paths = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        const bool has_value = i + 1 < argc;
+        if (::strcmp(argv[i], "--pairs") == 0 && has_value)
+        {
+            const std::string value = argv[++i];
+            if (value == "nomask")
+                pairs = EvaluationPairs::NoMask;
+            else if (value == "mask")
+                pairs = EvaluationPairs::MaskToNoMask;
+            else if (value == "mask-to-mask")
+                pairs = EvaluationPairs::MaskToMask;
+            else
+            {
+                PrintUsage(argv[0]);
+                return FAILURE_MAIN;
+            }
+        }
+        else if (::strcmp(argv[i], "--far") == 0 && has_value)
+        {
+            target_far = std::atof(argv[++i]);
+        }
+        else if (::strcmp(argv[i], "--threads") == 0 && has_value)
+        {
+            threads = static_cast<size_t>(std::max(std::atoi(argv[++i]), 1));
+        }
+        else if (::strcmp(argv[i], "--csv") == 0 && has_value)
+        {
+            csv_path = argv[++i];
+        }
+        else if (argv[i][0] != '-' && n_paths < 2)
+        {
+            paths[n_paths++] = argv[i];
+        }
+        else
+        {
+            PrintUsage(argv[0]);
+            return FAILURE_MAIN;
+        }
+    }
+    if (n_paths == 0)
+    {
+        PrintUsage(argv[0]);
+        return FAILURE_MAIN;
+    }
+
+    MatcherGallery probes;
+    MatcherGallery references;
+    if (!LoadGallery(paths[0], probes) || (n_paths == 2 && !LoadGallery(paths[1], references)))
+    {
+        return FAILURE_MAIN;
+    }
+
+    MatcherThreadPool pool(threads);
+    const auto start = std::chrono::steady_clock::now();
+    const ScoreDistribution scores =
+        MatcherEvaluation::Evaluate(probes, n_paths == 2 ? references : probes, pairs, &pool);
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const uint64_t genuine = scores.Genuine();
+    const uint64_t impostor = scores.Impostor();
+    std::cout << genuine << " genuine and " << impostor << " impostor pairs scored in " << std::fixed
+              << std::setprecision(1) << elapsed << " s" << std::defaultfloat << '\n';
+    if (genuine == 0 || impostor == 0)
+    {
+        std::cout << "Both genuine and impostor pairs are needed for the rates\n";
+        return FAILURE_MAIN;
+    }
+
+    const Thresholds defaults = Matcher::GetDefaultThresholds();
+    const int default_threshold = pairs == EvaluationPairs::NoMask         ? defaults.strongThreshold_pNMgNM
+                                  : pairs == EvaluationPairs::MaskToNoMask ? defaults.strongThreshold_pMgNM
+                                                                           : defaults.strongThreshold_pMgM;
+    PrintRates("default", scores, default_threshold);
+    PrintRates("equal error", scores, scores.EqualErrorThreshold());
+    std::ostringstream target_title;
+    target_title << "recommended (FAR <= " << target_far << ")";
+    PrintRates(target_title.str().c_str(), scores, scores.ThresholdForFalseAcceptRate(target_far));
+
+    if (csv_path != nullptr && !WriteCsv(csv_path, scores))
+    {
+        std::cout << "Failed to write " << csv_path << '\n';
+        return FAILURE_MAIN;
+    }
+    return SUCCESS_MAIN;
+}
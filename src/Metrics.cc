@@ -0,0 +1,18 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "RealSenseID/Metrics.h"
+#include "Logger/MetricsRegistry.h"
+
+namespace RealSenseID
+{
+void GetMetrics(Metrics& metrics)
+{
+    MetricsRegistry::Get(metrics);
+}
+
+void ResetMetrics()
+{
+    MetricsRegistry::Reset();
+}
+} // namespace RealSenseID
@@ -0,0 +1,32 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "OperationArena.h"
+#include "LibraryMemory.h"
+
+namespace RealSenseID
+{
+OperationArena::OperationArena(size_t capacity) :
+    _block(static_cast<unsigned char*>(
+        Memory::Allocate(capacity, alignof(std::max_align_t), Memory::Category::Operations))),
+    _capacity(capacity)
+{
+}
+
+OperationArena::~OperationArena()
+{
+    Memory::Deallocate(_block, _capacity);
+}
+
+void* OperationArena::Take(size_t size, size_t alignment)
+{
+    // the block is aligned to max_align_t, so an offset aligned to the type's alignment is an aligned address
+    const size_t offset = (_used + alignment - 1) & ~(alignment - 1);
+    if (offset > _capacity || size > _capacity - offset)
+    {
+        return nullptr;
+    }
+    _used = offset + size;
+    return _block + offset;
+}
+} // namespace RealSenseID
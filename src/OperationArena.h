@@ -0,0 +1,83 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+namespace RealSenseID
+{
+// Bump pointer memory for the buffers of a device operation (faceprints copies, match results), so an operation run
+// again and again does not go through the allocator. The block is allocated once (Memory::Allocate()) and sized for
+// the worst case of the operations using it. A Scope returns the memory taken in it when the operation completes, so
+// pointers into the arena are valid until then (e.g. for the duration of a callback).
+// Not thread safe: a FaceAuthenticator operation uses its arena under a lock, or an arena of its own if another
+// thread's operation holds it.
+class OperationArena
+{
+public:
+    explicit OperationArena(size_t capacity);
+    ~OperationArena();
+
+    OperationArena(const OperationArena&) = delete;
+    OperationArena& operator=(const OperationArena&) = delete;
+
+    // n default initialized Ts (so indeterminate for plain structs), nullptr if the arena has no room left for them
+    template <typename T>
+    T* New(size_t n)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "the arena does not run destructors");
+        void* ptr = Take(n * sizeof(T), alignof(T));
+        if (ptr == nullptr)
+        {
+            return nullptr;
+        }
+        T* items = static_cast<T*>(ptr);
+        for (size_t i = 0; i < n; i++)
+        {
+            new (items + i) T;
+        }
+        return items;
+    }
+
+    size_t Capacity() const
+    {
+        return _capacity;
+    }
+
+    size_t Used() const
+    {
+        return _used;
+    }
+
+    // memory taken from the arena during the scope is returned at its end
+    class Scope
+    {
+    public:
+        explicit Scope(OperationArena& arena) : _arena(arena), _mark(arena._used)
+        {
+        }
+
+        ~Scope()
+        {
+            _arena._used = _mark;
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        OperationArena& _arena;
+        size_t _mark;
+    };
+
+private:
+    unsigned char* _block = nullptr;
+    size_t _capacity = 0;
+    size_t _used = 0;
+
+    void* Take(size_t size, size_t alignment);
+};
+} // namespace RealSenseID
@@ -0,0 +1,136 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "OperationQueue.h"
+#include "Logger.h"
+#include "RealTimeMode.h"
+#include <algorithm>
+#include <iterator>
+
+static const char* LOG_TAG = "OperationQueue";
+
+namespace RealSenseID
+{
+OperationQueue::~OperationQueue()
+{
+    try
+    {
+        Stop();
+        Join();
+    }
+    catch (...)
+    {
+    }
+}
+
+bool OperationQueue::Queue::Push(std::function<void()> operation, OperationPriority priority)
+{
+    if (stop)
+    {
+        LOG_ERROR(LOG_TAG, "Operation queue is stopped");
+        return false; // operation is destroyed without running, its future reports broken promise
+    }
+    operations[static_cast<size_t>(priority)].push_back(std::move(operation));
+    cv.notify_one();
+    return true;
+}
+
+bool OperationQueue::Queue::HasOperations() const
+{
+    for (const auto& queue : operations)
+    {
+        if (!queue.empty())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void OperationQueue::Enqueue(std::function<void()> operation, OperationPriority priority)
+{
+    std::lock_guard<std::mutex> lock {_queue->mutex};
+    if (_queue->Push(std::move(operation), priority) && !_worker.joinable())
+    {
+        _worker = LibraryThread(&OperationQueue::WorkerLoop, _queue);
+    }
+}
+
+// a step runs on the worker, which holds the queue. the next step is queued behind the operations posted meanwhile
+std::function<void()> OperationQueue::StepOperation(std::weak_ptr<Queue> queue,
+                                                    std::shared_ptr<std::function<bool(Status&)>> step,
+                                                    std::shared_ptr<std::promise<Status>> promise,
+                                                    OperationPriority priority)
+{
+    return [queue, step, promise, priority]() {
+        Status status = Status::Ok;
+        try
+        {
+            if (!(*step)(status))
+            {
+                auto shared_queue = queue.lock();
+                if (shared_queue)
+                {
+                    std::lock_guard<std::mutex> lock {shared_queue->mutex};
+                    shared_queue->Push(StepOperation(queue, step, promise, priority), priority);
+                }
+                return;
+            }
+        }
+        catch (...)
+        {
+            promise->set_exception(std::current_exception());
+            return;
+        }
+        promise->set_value(status);
+    };
+}
+
+void OperationQueue::WorkerLoop(std::shared_ptr<Queue> queue)
+{
+    RealTimeMode::EnterIoThread("async operations");
+    std::unique_lock<std::mutex> lock {queue->mutex};
+    while (true)
+    {
+        queue->cv.wait(lock, [&queue] { return queue->stop || queue->HasOperations(); });
+        if (queue->stop)
+        {
+            return;
+        }
+        // the highest priority first
+        auto next = std::find_if(std::rbegin(queue->operations), std::rend(queue->operations),
+                                 [](const std::deque<std::function<void()>>& queued) { return !queued.empty(); });
+        auto operation = std::move(next->front());
+        next->pop_front();
+        queue->running = true;
+        lock.unlock();
+        operation();
+        lock.lock();
+        queue->running = false;
+    }
+}
+
+bool OperationQueue::Stop()
+{
+    std::deque<std::function<void()>> abandoned[3];
+    std::lock_guard<std::mutex> lock {_queue->mutex};
+    _queue->stop = true;
+    std::swap(abandoned, _queue->operations);
+    _queue->cv.notify_one();
+    return _queue->running;
+}
+
+void OperationQueue::Join()
+{
+    if (!_worker.joinable())
+    {
+        return;
+    }
+    if (_worker.get_id() == std::this_thread::get_id())
+    {
+        _worker.detach(); // called by an operation: the worker exits once it returns
+        return;
+    }
+    _worker.join();
+}
+} // namespace RealSenseID
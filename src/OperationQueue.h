@@ -0,0 +1,96 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/Status.h"
+#include "LibraryThread.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace RealSenseID
+{
+// lowest first
+enum class OperationPriority
+{
+    Telemetry,
+    Admin,
+    Auth
+};
+
+// Runs operations one after the other on a worker thread (started on first use), the highest priority ones first and
+// in posting order within a priority.
+// Post() returns a future of the operation's status.
+// PostSteps() posts a long operation in steps: step(status) runs the next step and returns true once done (the future
+// then gets status). Between the steps the operation goes back to the end of its priority's queue, so higher priority
+// operations do not wait for all of it and operations of the same priority take turns.
+// Stop() abandons operations not started yet (their futures throw std::future_error / broken_promise).
+// The queue may be stopped and destroyed by one of its operations: the worker is then detached, and it exits once
+// that operation returns.
+class OperationQueue
+{
+public:
+    OperationQueue() = default;
+    ~OperationQueue();
+
+    OperationQueue(const OperationQueue&) = delete;
+    OperationQueue& operator=(const OperationQueue&) = delete;
+
+    template <typename F>
+    std::future<Status> Post(F&& operation, OperationPriority priority)
+    {
+        auto task = std::make_shared<std::packaged_task<Status()>>(std::forward<F>(operation));
+        auto result = task->get_future();
+        Enqueue([task]() { (*task)(); }, priority);
+        return result;
+    }
+
+    template <typename F>
+    std::future<Status> PostSteps(F&& step, OperationPriority priority)
+    {
+        auto promise = std::make_shared<std::promise<Status>>();
+        auto result = promise->get_future();
+        Enqueue(StepOperation(_queue, std::make_shared<std::function<bool(Status&)>>(std::forward<F>(step)), promise,
+                              priority),
+                priority);
+        return result;
+    }
+
+    // discard pending operations and stop accepting new ones.
+    // return true if an operation is still running (call Join() to wait for it).
+    bool Stop();
+    // wait for the worker to exit (after Stop()). called by an operation, the worker is detached instead.
+    void Join();
+
+private:
+    // shared with the worker, which may outlive the OperationQueue (see Join())
+    struct Queue
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<std::function<void()>> operations[3]; // by priority
+        bool stop = false;
+        bool running = false;
+
+        // false if stopped
+        bool Push(std::function<void()> operation, OperationPriority priority);
+        bool HasOperations() const;
+    };
+
+    std::shared_ptr<Queue> _queue = std::make_shared<Queue>();
+    LibraryThread _worker;
+
+    void Enqueue(std::function<void()> operation, OperationPriority priority);
+    static std::function<void()> StepOperation(std::weak_ptr<Queue> queue,
+                                               std::shared_ptr<std::function<bool(Status&)>> step,
+                                               std::shared_ptr<std::promise<Status>> promise,
+                                               OperationPriority priority);
+    static void WorkerLoop(std::shared_ptr<Queue> queue);
+};
+} // namespace RealSenseID
@@ -24,6 +24,8 @@ struct SerialConfig
     unsigned char bytesize = 8;
     unsigned char stopbits = 0; // 0=1 stopbits, 1=1.5 stopbits, 2=2 stopbits
     unsigned char parity = 0;
+    // block in SendBytes() until the written bytes were transmitted (one drain per SendBytes() call)
+    bool drain_on_send = true;
 };
 
 enum class RSID_NO_DISCARD SerialStatus
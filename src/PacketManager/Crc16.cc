@@ -27,12 +27,64 @@ static const uint16_t CRC16_LOOKUP[256] = {
     0x2e93, 0x3eb2, 0x0ed1, 0x1ef0};
 
 static const unsigned int CRC16_INITIAL_VAL = 0x1d0f;
+static const unsigned int CRC16_POLYNOM = 0x1021;
 
+// slice-by-8 tables: table[k][i] is the crc contribution of byte i followed by k zero bytes
+struct Crc16SliceTables
+{
+    uint16_t table[8][256];
+
+    Crc16SliceTables()
+    {
+        for (unsigned int i = 0; i < 256; i++)
+        {
+            table[0][i] = CRC16_LOOKUP[i];
+        }
+        for (unsigned int k = 1; k < 8; k++)
+        {
+            for (unsigned int i = 0; i < 256; i++)
+            {
+                unsigned int prev = table[k - 1][i];
+                table[k][i] = static_cast<uint16_t>((prev << 8) ^ CRC16_LOOKUP[prev >> 8]);
+            }
+        }
+    }
+};
+
+static const Crc16SliceTables& SliceTables()
+{
+    static const Crc16SliceTables tables;
+    return tables;
+}
+
+// a * b mod polynom (polynomials over GF(2))
+static unsigned int MulMod(unsigned int a, unsigned int b)
+{
+    unsigned int result = 0;
+    for (int bit = 15; bit >= 0; bit--)
+    {
+        result = ((result << 1) & 0xffff) ^ ((result & 0x8000) ? CRC16_POLYNOM : 0);
+        if ((b >> bit) & 1)
+        {
+            result ^= a;
+        }
+    }
+    return result;
+}
 
 uint16_t RealSenseID::PacketManager::Crc16(uint16_t initial_crc, const char* buffer, std::size_t bufferSize)
 {
+    const auto& t = SliceTables().table;
     unsigned int crc = initial_crc;
-    auto* bytePtr = buffer;
+    auto* bytePtr = reinterpret_cast<const unsigned char*>(buffer);
+
+    while (bufferSize >= 8)
+    {
+        crc = t[7][((crc >> 8) ^ bytePtr[0]) & 0xff] ^ t[6][(crc ^ bytePtr[1]) & 0xff] ^ t[5][bytePtr[2]] ^
+              t[4][bytePtr[3]] ^ t[3][bytePtr[4]] ^ t[2][bytePtr[5]] ^ t[1][bytePtr[6]] ^ t[0][bytePtr[7]];
+        bytePtr += 8;
+        bufferSize -= 8;
+    }
 
     while (bufferSize-- > 0)
     {
@@ -47,3 +99,20 @@ uint16_t RealSenseID::PacketManager::Crc16(const char* buffer, std::size_t buffe
 {
     return Crc16(CRC16_INITIAL_VAL, buffer, bufferSize);
 }
+
+// each zero byte multiplies the crc by x^8 (mod polynom): multiply once by x^(8 * count), by squaring
+uint16_t RealSenseID::PacketManager::Crc16Zeros(uint16_t initial_crc, std::size_t count)
+{
+    unsigned int power = 1;     // x^0
+    unsigned int base = 0x0100; // x^8
+    while (count > 0)
+    {
+        if (count & 1)
+        {
+            power = MulMod(power, base);
+        }
+        base = MulMod(base, base);
+        count >>= 1;
+    }
+    return static_cast<uint16_t>(MulMod(initial_crc, power));
+}
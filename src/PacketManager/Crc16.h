@@ -12,5 +12,8 @@ namespace PacketManager
 {
 uint16_t Crc16(uint16_t initial_crc, const char* buffer, std::size_t bufferSize);
 uint16_t Crc16(const char* buffer, std::size_t bufferSize);
+
+// continue the crc over count zero bytes, in O(log(count))
+uint16_t Crc16Zeros(uint16_t initial_crc, std::size_t count);
 } // namespace PacketManager
 } // namespace RealSenseID
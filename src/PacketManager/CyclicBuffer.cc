@@ -3,6 +3,7 @@
 
 #include "CyclicBuffer.h"
 #include <algorithm>
+#include <string.h>
 #include "Logger.h"
 
 
@@ -12,10 +13,6 @@ namespace PacketManager
 {
 static const char* LOG_TAG = "CyclicBuffer";
 
-CyclicBuffer::CyclicBuffer() : _read_index(0), _write_index(0), _buffer_full(false)
-{
-}
-
 size_t CyclicBuffer::Read(char* destination_buffer, size_t bytes_to_read)
 {
     if (NULL == destination_buffer)
@@ -23,74 +20,79 @@ size_t CyclicBuffer::Read(char* destination_buffer, size_t bytes_to_read)
         LOG_ERROR(LOG_TAG, "The destinationBuffer is NULL");
         return 0;
     }
-    if (bytes_to_read == 0)
-    {
-        return 0;
-    }
 
-    size_t actual_bytes_read = 0;
-
-    const std::lock_guard<std::mutex> lock(_mutex);
-    if (_write_index > _read_index)
+    const size_t read_count = _read_count.load(std::memory_order_relaxed);
+    const size_t available = _write_count.load(std::memory_order_acquire) - read_count;
+    const size_t actual_bytes_read = std::min(available, bytes_to_read);
+    if (actual_bytes_read == 0)
     {
-        actual_bytes_read = std::min(_write_index - _read_index, bytes_to_read);
-        ::memcpy(destination_buffer, &_buffer[_read_index], actual_bytes_read);
-
-        _read_index += actual_bytes_read;
+        return 0;
     }
-    else if (_read_index > _write_index || _buffer_full)
-    {
-        actual_bytes_read = std::min(_buffer_size - _read_index, bytes_to_read);
-        ::memcpy(destination_buffer, &_buffer[_read_index], actual_bytes_read);
-        _read_index = (_read_index + actual_bytes_read == _buffer_size) ? 0 : _read_index + actual_bytes_read;
-        if (bytes_to_read > actual_bytes_read)
-        {
-            size_t available_bytes_to_read = std::min(_write_index, bytes_to_read - actual_bytes_read);
-            ::memcpy(&destination_buffer[actual_bytes_read], _buffer, available_bytes_to_read);
 
-            actual_bytes_read += available_bytes_to_read;
-            _read_index += available_bytes_to_read;
-        }
-    }
+    // up to two segments: until the end of the buffer, then from its start
+    const size_t start = read_count & _mask;
+    const size_t first = std::min(actual_bytes_read, _buffer_size - start);
+    ::memcpy(destination_buffer, &_buffer[start], first);
+    ::memcpy(destination_buffer + first, _buffer, actual_bytes_read - first);
 
-    _buffer_full = false;
+    _read_count.store(read_count + actual_bytes_read, std::memory_order_release);
     return actual_bytes_read;
 }
 
-size_t CyclicBuffer::Write(char* source_buffer, size_t bytes_to_write)
+size_t CyclicBuffer::Write(const char* source_buffer, size_t bytes_to_write)
 {
-    if (nullptr == source_buffer || _buffer_full)
+    if (nullptr == source_buffer)
     {
-        if (nullptr == source_buffer)
-            LOG_ERROR(LOG_TAG, "The destinationBuffer is NULL");
-        if (_buffer_full)
-            LOG_ERROR(LOG_TAG, "Buffer is full");
+        LOG_ERROR(LOG_TAG, "The destinationBuffer is NULL");
         return 0;
     }
 
-    const std::lock_guard<std::mutex> lock(_mutex);
-    size_t actual_bytes_written = 0;
-    if (_write_index >= _read_index)
+    const size_t write_count = _write_count.load(std::memory_order_relaxed);
+    const size_t free_space = _buffer_size - (write_count - _read_count.load(std::memory_order_acquire));
+    const size_t actual_bytes_written = std::min(free_space, bytes_to_write);
+    if (actual_bytes_written == 0)
     {
-        actual_bytes_written = std::min(_buffer_size - _write_index, bytes_to_write);
-        ::memcpy(&_buffer[_write_index], source_buffer, actual_bytes_written);
-        _write_index = (_write_index + actual_bytes_written == _buffer_size) ? 0 : _write_index + actual_bytes_written;
+        if (bytes_to_write > 0)
+        {
+            LOG_ERROR(LOG_TAG, "Buffer is full");
+        }
+        return 0;
     }
-    if (bytes_to_write > actual_bytes_written)
-    {
-        size_t available_bytes_to_write = std::min(_read_index - _write_index, bytes_to_write - actual_bytes_written);
-        ::memcpy(&_buffer[_write_index], &source_buffer[actual_bytes_written], available_bytes_to_write);
 
-        actual_bytes_written += available_bytes_to_write;
-        _write_index += available_bytes_to_write;
-    }
-    if ((_write_index == _read_index) && (actual_bytes_written > 0))
+    const size_t start = write_count & _mask;
+    const size_t first = std::min(actual_bytes_written, _buffer_size - start);
+    ::memcpy(&_buffer[start], source_buffer, first);
+    ::memcpy(_buffer, source_buffer + first, actual_bytes_written - first);
+
+    // seq_cst store / load pair with the consumer's in WaitForData(): either the consumer sees the new bytes or the
+    // producer sees the waiting consumer
+    _write_count.store(write_count + actual_bytes_written);
+    if (_consumer_waiting.load())
     {
-        _buffer_full = true;
+        std::lock_guard<std::mutex> lock(_wait_mutex);
+        _wait_cv.notify_one();
     }
-    
     return actual_bytes_written;
 }
 
+size_t CyclicBuffer::FreeSpace() const
+{
+    return _buffer_size - (_write_count.load(std::memory_order_relaxed) - _read_count.load(std::memory_order_acquire));
+}
+
+bool CyclicBuffer::WaitForData(std::chrono::milliseconds timeout)
+{
+    auto has_data = [this] { return _write_count.load() != _read_count.load(std::memory_order_relaxed); };
+    if (has_data())
+    {
+        return true;
+    }
+
+    std::unique_lock<std::mutex> lock(_wait_mutex);
+    _consumer_waiting.store(true);
+    bool result = _wait_cv.wait_for(lock, timeout, has_data);
+    _consumer_waiting.store(false);
+    return result;
+}
 } // namespace PacketManager
-} // namespace RealSenseID
\ No newline at end of file
+} // namespace RealSenseID
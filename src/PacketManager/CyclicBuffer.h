@@ -3,28 +3,58 @@
 
 #pragma once
 
+#include "LibraryMemory.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <mutex>
+#include <stddef.h>
 
 namespace RealSenseID
 {
 namespace PacketManager
 {
+// Lock-free single producer / single consumer byte ring.
+// One thread may Write() while another Read()s and WaitForData()s, with no lock on the data path:
+// _write_count / _read_count only grow (masked to the buffer size on access), each is stored only by its own side
+// with release and loaded by the other side with acquire.
+// The mutex / condition variable are used only to wake up a consumer blocked in WaitForData().
 class CyclicBuffer
 {
 public:
-    CyclicBuffer();
+    CyclicBuffer() = default;
 
+    CyclicBuffer(const CyclicBuffer&) = delete;
+    CyclicBuffer& operator=(const CyclicBuffer&) = delete;
+
+    // consumer: copy up to bytes_to_read bytes and return the number of bytes copied
     size_t Read(char* destination_buffer, size_t bytes_to_read);
-    size_t Write(char* source_buffer, size_t bytes_to_write);
+
+    // producer: copy up to bytes_to_write bytes (as many as there is room for) and return the number of bytes copied
+    size_t Write(const char* source_buffer, size_t bytes_to_write);
+
+    // consumer: wait until there are bytes to read or the timeout expires. return true if there are bytes to read.
+    bool WaitForData(std::chrono::milliseconds timeout);
+
+    // producer: the number of bytes a Write() can take now (the consumer may free more meanwhile)
+    size_t FreeSpace() const;
+
+    static const size_t Capacity = 65536;
 
 private:
-    static const size_t _buffer_size = 65536;
+    static const size_t _buffer_size = Capacity;
+    static_assert((_buffer_size & (_buffer_size - 1)) == 0, "buffer size must be a power of two");
+    static const size_t _mask = _buffer_size - 1;
+
     unsigned char _buffer[_buffer_size];
+    Memory::TrackedBytes _buffer_memory {Memory::Category::SerialBuffers, _buffer_size};
+
+    std::atomic<size_t> _write_count {0};
+    std::atomic<size_t> _read_count {0};
 
-    size_t _read_index;
-    size_t _write_index;
-    bool _buffer_full;
-    std::mutex _mutex;
+    std::atomic<bool> _consumer_waiting {false};
+    std::mutex _wait_mutex;
+    std::condition_variable _wait_cv;
 };
 } // namespace PacketManager
-} // namespace RealSenseID
\ No newline at end of file
+} // namespace RealSenseID
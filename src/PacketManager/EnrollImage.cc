@@ -0,0 +1,32 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "EnrollImage.h"
+#include <string.h>
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+void WriteImageChunkHeader(const ImageChunkHeader& header, unsigned char* dst)
+{
+    ::memcpy(dst, &header.tag, sizeof(header.tag));
+    ::memcpy(dst + 2, &header.image_size, sizeof(header.image_size));
+    ::memcpy(dst + 6, &header.offset, sizeof(header.offset));
+    dst[10] = header.orientation;
+}
+
+void ReadImageChunkHeader(const unsigned char* src, ImageChunkHeader& header)
+{
+    ::memcpy(&header.tag, src, sizeof(header.tag));
+    ::memcpy(&header.image_size, src + 2, sizeof(header.image_size));
+    ::memcpy(&header.offset, src + 6, sizeof(header.offset));
+    header.orientation = src[10];
+}
+
+size_t ImageChunks(size_t image_size)
+{
+    return image_size > 0 ? (image_size + MaxImageChunkSize - 1) / MaxImageChunkSize : 1;
+}
+} // namespace PacketManager
+} // namespace RealSenseID
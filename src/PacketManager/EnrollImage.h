@@ -0,0 +1,48 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "PackedFaceprints.h"
+#include "SerialPacket.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+// EnrollImage messages: a stored JPEG image uploaded for faceprints extraction, as ExtractFaceprintsForEnroll() does
+// with the camera (host mode bulk enrollment). Little endian:
+//
+//   request: a chunk of the image - image tag (u16), image size (u32), chunk offset (u32), exif orientation (u8, 1 -
+//            8, 1 for upright), then the chunk's bytes (up to MaxImageChunkSize). The chunks of an image are sent in
+//            order, and only the last one is answered.
+//   reply:   image tag (u16), EnrollStatus (u8), packed faceprints size (u16), then the packed faceprints (see
+//            PackedFaceprints.h) if the status is Success.
+//
+// The device extracts the faceprints of an image once its last chunk arrived, and meanwhile receives the chunks of
+// the next one: it holds up to MaxImagesInFlight images, so the host uploads image N + 1 while image N is extracted.
+// A device without the message answers each chunk with an error Reply (fa) packet.
+static constexpr size_t ImageChunkHeaderSize = 2 + 4 + 4 + 1;
+static constexpr size_t MaxImageChunkSize = sizeof(DataMessage::data) - ImageChunkHeaderSize;
+static constexpr size_t MaxEnrollImageSize = 1024 * 1024;
+static constexpr unsigned int MaxImagesInFlight = 2;
+static constexpr size_t ImageResultHeaderSize = 2 + 1 + 2;
+
+struct ImageChunkHeader
+{
+    uint16_t tag = 0;
+    uint32_t image_size = 0;
+    uint32_t offset = 0;
+    uint8_t orientation = 1;
+};
+
+// write / read a chunk header (ImageChunkHeaderSize bytes)
+void WriteImageChunkHeader(const ImageChunkHeader& header, unsigned char* dst);
+void ReadImageChunkHeader(const unsigned char* src, ImageChunkHeader& header);
+
+// number of chunks of an image of image_size bytes
+size_t ImageChunks(size_t image_size);
+} // namespace PacketManager
+} // namespace RealSenseID
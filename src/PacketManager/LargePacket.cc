@@ -0,0 +1,89 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "LargePacket.h"
+#include "LibraryMemory.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+static_assert(MaxLargePayloadSize % 32 == 0 && MaxLargePayloadSize <= 0xFFFF, "invalid large payload size");
+
+LargePacket::LargePacket()
+{
+    // the payload is written by the sender (or the receive), the rest is zeroed
+    ::memset(&header, 0, sizeof(header));
+    ::memset(hmac, 0, sizeof(hmac));
+    header.sync1 = SyncByte::Sync1;
+    header.sync2 = SyncByte::Sync2;
+    header.protocol_ver = LargeProtocolVer;
+    header.id = MsgId::None;
+    payload.sequence_number = 0;
+    crc = 0;
+}
+
+void LargePacket::SetData(MsgId id, size_t data_size)
+{
+    if (data_size > MaxLargeDataSize)
+    {
+        throw std::runtime_error("LargePacket: given size exceeds max allowed");
+    }
+    ::memset(&header.iv, 0, sizeof(header.iv));
+    header.protocol_ver = LargeProtocolVer;
+    header.id = id;
+    // padded to 32 bytes, as the regular packets
+    const size_t payload_size = (sizeof(payload.sequence_number) + data_size + 31) & ~size_t {31};
+    ::memset(payload.data + data_size, 0, payload_size - sizeof(payload.sequence_number) - data_size);
+    header.payload_size = static_cast<uint16_t>(payload_size);
+    ::memset(hmac, 0, sizeof(hmac));
+}
+
+char* LargePacket::Data()
+{
+    return payload.data;
+}
+
+const char* LargePacket::Data() const
+{
+    return payload.data;
+}
+
+size_t LargePacket::DataSize() const
+{
+    return header.payload_size > sizeof(payload.sequence_number)
+               ? header.payload_size - sizeof(payload.sequence_number)
+               : 0;
+}
+
+bool LargePacket::IsLarge() const
+{
+    return header.protocol_ver == LargeProtocolVer;
+}
+
+void* LargePacket::operator new(size_t size)
+{
+    return Memory::Allocate(size, alignof(std::max_align_t), Memory::Category::Packets);
+}
+
+void LargePacket::operator delete(void* ptr, size_t size) noexcept
+{
+    Memory::Deallocate(ptr, size);
+}
+
+size_t AcceptedLargePayload(const SessionOptions& offered, const unsigned char* reply_options, size_t size)
+{
+    SessionOptions accepted;
+    if (offered.large_payload == 0 || !ReadSessionOptions(reply_options, size, accepted))
+    {
+        return 0;
+    }
+    size_t payload_size = std::min<size_t>({accepted.large_payload, offered.large_payload, MaxLargePayloadSize});
+    payload_size &= ~size_t {31};
+    return payload_size >= MinLargePayloadSize ? payload_size : 0;
+}
+} // namespace PacketManager
+} // namespace RealSenseID
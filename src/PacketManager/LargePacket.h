@@ -0,0 +1,84 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "SerialPacket.h"
+#include "SessionOptions.h"
+#include <cstddef>
+#include <cstdint>
+
+#pragma pack(push)
+#pragma pack(1)
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+// Large packets (protocol version LargeProtocolVer) for the bulk transfers of a session that negotiated them (the
+// large payload of the session options, see SessionOptions.h). The frame is that of a regular data packet with a
+// payload of up to the negotiated size instead of the fixed DataMessage, so the header, hmac, crc, sync and (in the
+// secure session) iv and crypto setup are paid once for many users. The crc is over the transmitted bytes only
+// (header, payload_size bytes of payload and hmac). Sequence numbers are shared with the regular packets.
+//
+// The bulk messages in large packets (little endian):
+//   GetUserIds             request and reply as in a regular packet: first index (u32) and count (u32), the number
+//                          of ids sent (u32) and the zero delimited ids.
+//   GetUserFeaturesPacked  request: first index (u16), count (u16). Past index 65535, first index and count 0 (u16),
+//                          then first index (u32), count (u32). reply: the number of users sent (u16), then the
+//                          packed faceprints size (u16) and packed faceprints (see PackedFaceprints.h) of each. The
+//                          device sends the users that fit, at least one.
+//   SetUserFeaturesPacked  request: number of users (u16), then the user id (MaxUserIdSize + 1 bytes), packed
+//                          faceprints size (u16) and packed faceprints of each. reply: the number of users (u16) and
+//                          a status (u8, 0 if the user was set) of each.
+//   GetUserRecordsPacked   request as GetUserFeaturesPacked. reply: the number of users sent (u16), then the zero
+//                          terminated user id (up to MaxUserIdSize + 1 bytes), packed faceprints size (u16) and packed
+//                          faceprints of each. The device sends the users that fit, at least one.
+// Other messages are regular packets only. A device taking large packets handles the packed faceprints messages, and
+// answers a request it cannot handle with an error Reply in a regular packet, as for regular requests.
+static const unsigned char LargeProtocolVer = 3;
+static constexpr size_t MaxLargePayloadSize = 32 * 1024; // with the sequence number
+static constexpr size_t MaxLargeDataSize = MaxLargePayloadSize - sizeof(uint32_t);
+// a large payload of less is not worth the switch
+static constexpr size_t MinLargePayloadSize = 4 * sizeof(SerialPacket::payload);
+static constexpr size_t LargeBatchHeaderSize = 2;
+
+// A large data packet, or a regular packet received in its place (e.g. the error Reply of a request). About 32KB:
+// allocated once and reused for the packets of a transfer.
+struct LargePacket
+{
+    PacketHeader header;
+    struct
+    {
+        uint32_t sequence_number;
+        char data[MaxLargeDataSize];
+    } payload;
+    char hmac[32]; // if security is enabled it will store hmac calculation
+    uint16_t crc;
+
+    LargePacket();
+
+    // make it a large data packet of data_size bytes, to be written to Data(). data_size must not exceed
+    // MaxLargeDataSize.
+    void SetData(MsgId id, size_t data_size);
+
+    char* Data();
+    const char* Data() const;
+
+    // size of the received data (the payload but the sequence number)
+    size_t DataSize() const;
+
+    bool IsLarge() const;
+
+    // from the library's allocator, charged to the packets' memory (GetMemoryStats())
+    static void* operator new(size_t size);
+    static void operator delete(void* ptr, size_t size) noexcept;
+};
+
+// large payload size of a session started with the offered options, from the options of the device's reply (size
+// bytes at reply_options): 0 if the device has none or its payload is too small to use
+size_t AcceptedLargePayload(const SessionOptions& offered, const unsigned char* reply_options, size_t size);
+} // namespace PacketManager
+} // namespace RealSenseID
+
+#pragma pack(pop)
@@ -1,10 +1,14 @@
 // License: Apache 2.0. See LICENSE file in root directory.
 // Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
 #include "LinuxSerial.h"
+#include "SerialTrace.h"
+#include "LinuxSerialBaudRate.h"
 #include "CommonTypes.h"
 #include "SerialPacket.h"
 #include "Timer.h"
 #include "Logger.h"
+#include "RealTimeMode.h"
+#include <algorithm>
 #include <string>
 #include <stdexcept>
 #include <thread>
@@ -12,6 +16,10 @@
 #include <fcntl.h>
 #include <string.h>
 #include <termios.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
 #include <errno.h>
 #include <cassert>
 #include <cmath>
@@ -44,6 +52,38 @@ static speed_t to_speed_t(unsigned int baudRate)
         return B57600;
     case 115200:
         return B115200;
+#ifdef B230400
+    case 230400:
+        return B230400;
+#endif
+#ifdef B460800
+    case 460800:
+        return B460800;
+#endif
+#ifdef B921600
+    case 921600:
+        return B921600;
+#endif
+#ifdef B1000000
+    case 1000000:
+        return B1000000;
+#endif
+#ifdef B1500000
+    case 1500000:
+        return B1500000;
+#endif
+#ifdef B2000000
+    case 2000000:
+        return B2000000;
+#endif
+#ifdef B3000000
+    case 3000000:
+        return B3000000;
+#endif
+#ifdef B4000000
+    case 4000000:
+        return B4000000;
+#endif
     default:
         return -1;
     }
@@ -57,6 +97,7 @@ LinuxSerial::~LinuxSerial()
 {
     try
     {
+        ::close(_wakeup_fd);
         ::close(_handle);
     }
     catch (...)
@@ -78,6 +119,7 @@ static void throw_on_error(int result, const char* err_msg, int handle_to_close)
 }
 LinuxSerial::LinuxSerial(const SerialConfig& config) : _config {config}
 {
+    RealTimeMode::Prefault(_recv_buffer, sizeof(_recv_buffer));
     LOG_DEBUG(LOG_TAG, "Opening serial port %s baudrate %u", config.port, config.baudrate);
     _handle = ::open(config.port, O_RDWR | O_NOCTTY);
     if (_handle < 0)
@@ -87,11 +129,12 @@ LinuxSerial::LinuxSerial(const SerialConfig& config) : _config {config}
 
     struct termios options = {0};
 
+    // non standard baud rates are set after the other options
     auto baudRate = to_speed_t(config.baudrate);
-    if (baudRate == -1)
+    const bool custom_baudrate = baudRate == static_cast<speed_t>(-1);
+    if (custom_baudrate)
     {
-        ::close(_handle);
-        throw std::runtime_error("Failed open serial port. Invalid baudrate");
+        baudRate = B115200;
     }
 
     throw_on_error(::cfsetispeed(&options, baudRate), "cfsetispeed", _handle);
@@ -104,13 +147,97 @@ LinuxSerial::LinuxSerial(const SerialConfig& config) : _config {config}
     options.c_iflag |= (IGNPAR | IGNBRK);
 
     throw_on_error(::tcsetattr(_handle, TCSANOW, &options), "tcsetattr", _handle);
+    if (custom_baudrate)
+    {
+        throw_on_error(SetLinuxCustomBaudRate(_handle, config.baudrate) ? 0 : -1, "Set baudrate", _handle);
+    }
 
     // discard any existing data in input/output buffers
     ::tcflush(_handle, TCIOFLUSH);
+
+    _wakeup_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    throw_on_error(_wakeup_fd, "eventfd", _handle);
+}
+
+void LinuxSerial::InterruptRecv()
+{
+    uint64_t one = 1;
+    auto ignored = ::write(_wakeup_fd, &one, sizeof(one));
+    (void)ignored;
+}
+
+bool LinuxSerial::SetBaudRate(unsigned int baudrate)
+{
+    LOG_DEBUG(LOG_TAG, "Set baudrate %u", baudrate);
+    auto speed = to_speed_t(baudrate);
+    bool ok = false;
+    if (speed == static_cast<speed_t>(-1))
+    {
+        ok = SetLinuxCustomBaudRate(_handle, baudrate);
+    }
+    else
+    {
+        struct termios options;
+        ok = ::tcgetattr(_handle, &options) == 0 && ::cfsetispeed(&options, speed) == 0 &&
+             ::cfsetospeed(&options, speed) == 0 && ::tcsetattr(_handle, TCSANOW, &options) == 0;
+    }
+    if (!ok)
+    {
+        LOG_ERROR(LOG_TAG, "Failed to set baudrate %u. errno=%d", baudrate, errno);
+        return false;
+    }
+    _config.baudrate = baudrate;
+    return true;
+}
+
+bool LinuxSerial::SetLowLatency(bool enable)
+{
+    struct serial_struct serial_info;
+    if (::ioctl(_handle, TIOCGSERIAL, &serial_info) != 0)
+    {
+        LOG_DEBUG(LOG_TAG, "Low latency mode not supported by the driver. errno=%d", errno);
+        return false;
+    }
+    if (enable)
+    {
+        serial_info.flags |= ASYNC_LOW_LATENCY;
+    }
+    else
+    {
+        serial_info.flags &= ~ASYNC_LOW_LATENCY;
+    }
+    if (::ioctl(_handle, TIOCSSERIAL, &serial_info) != 0)
+    {
+        LOG_DEBUG(LOG_TAG, "Failed to set low latency mode %d. errno=%d", static_cast<int>(enable), errno);
+        return false;
+    }
+    return true;
+}
+
+bool LinuxSerial::SetPortTimeouts(timeout_t read_timeout, timeout_t write_timeout)
+{
+    (void)write_timeout;
+    struct termios options;
+    const auto tenths = std::min<timeout_t::rep>(std::max<timeout_t::rep>((read_timeout.count() + 99) / 100, 1), 255);
+    if (::tcgetattr(_handle, &options) != 0)
+    {
+        LOG_ERROR(LOG_TAG, "Failed to get port options. errno=%d", errno);
+        return false;
+    }
+    options.c_cc[VTIME] = static_cast<cc_t>(tenths);
+    options.c_cc[VMIN] = 0;
+    if (::tcsetattr(_handle, TCSANOW, &options) != 0)
+    {
+        LOG_ERROR(LOG_TAG, "Failed to set read timeout. errno=%d", errno);
+        return false;
+    }
+    _read_timeout = timeout_t {tenths * 100};
+    return true;
 }
 
 SerialStatus LinuxSerial::SendBytes(const char* buffer, size_t n_bytes)
 {
+    SerialTrace::Record(SerialTrace::Direction::Send, _handle, buffer, n_bytes);
     size_t bytes_sent = 0;
     while (n_bytes > bytes_sent)
     {
@@ -125,13 +252,71 @@ SerialStatus LinuxSerial::SendBytes(const char* buffer, size_t n_bytes)
             return SerialStatus::SendFailed;
         }
         bytes_sent += static_cast<size_t>(write_rv);
-        ::tcdrain(_handle);
 #ifdef RSID_DEBUG_SERIAL
         LOG_DEBUG(LOG_TAG, "[snd] Sent %zu/%zu", bytes_sent, n_bytes);
 #endif
     }
     assert(n_bytes == bytes_sent);
 
+    if (_config.drain_on_send)
+    {
+        ::tcdrain(_handle);
+    }
+
+    return SerialStatus::Ok;
+}
+
+// copy up to n_bytes buffered bytes and return the number of bytes copied
+size_t LinuxSerial::TakeBuffered(char* buffer, size_t n_bytes)
+{
+    size_t available = _recv_end - _recv_begin;
+    size_t n_copy = n_bytes < available ? n_bytes : available;
+    ::memcpy(buffer, &_recv_buffer[_recv_begin], n_copy);
+    _recv_begin += n_copy;
+    return n_copy;
+}
+
+// read whatever is available (up to 200ms wait, or max_wait if interruptible) into the empty receive buffer
+SerialStatus LinuxSerial::FillBuffer(bool* interrupted, timeout_t max_wait)
+{
+    assert(_recv_begin == _recv_end);
+    _recv_begin = _recv_end = 0;
+
+    if (interrupted != nullptr)
+    {
+        *interrupted = false;
+        struct pollfd fds[2] = {{_handle, POLLIN, 0}, {_wakeup_fd, POLLIN, 0}};
+        auto poll_rv = ::poll(fds, 2, static_cast<int>(std::max(max_wait, timeout_t {0}).count()));
+        if (poll_rv < 0 && errno != EINTR)
+        {
+            LOG_ERROR(LOG_TAG, "[rcv] poll failed. errorno %d", errno);
+            return SerialStatus::RecvFailed;
+        }
+        if (fds[1].revents & POLLIN)
+        {
+            uint64_t count = 0;
+            auto ignored = ::read(_wakeup_fd, &count, sizeof(count));
+            (void)ignored;
+            *interrupted = true;
+            return SerialStatus::Ok;
+        }
+        if (!(fds[0].revents & (POLLIN | POLLERR | POLLHUP)))
+        {
+            return SerialStatus::Ok; // nothing received
+        }
+    }
+    auto last_read_result = ::read(_handle, (void*)_recv_buffer, sizeof(_recv_buffer));
+    if (last_read_result < 0)
+    {
+        LOG_ERROR(LOG_TAG, "[rcv] rv=%d errorno %d", last_read_result, errno);
+        return SerialStatus::RecvFailed;
+    }
+    if (last_read_result > 0)
+    {
+        DEBUG_SERIAL(LOG_TAG, "[rcv]", _recv_buffer, last_read_result);
+        SerialTrace::Record(SerialTrace::Direction::Recv, _handle, _recv_buffer, last_read_result);
+    }
+    _recv_end = static_cast<size_t>(last_read_result);
     return SerialStatus::Ok;
 }
 
@@ -146,27 +331,20 @@ SerialStatus LinuxSerial::RecvBytes(char* buffer, size_t n_bytes)
 
     // set timeout to depend on number of bytes needed
     Timer timer {std::chrono::milliseconds {200 + 4 * n_bytes}};
-    unsigned int total_bytes_read = 0;
-    while (!timer.ReachedTimeout())
+    size_t total_bytes_read = TakeBuffered(buffer, n_bytes);
+    while (total_bytes_read < n_bytes && !timer.ReachedTimeout())
     {
-        unsigned char* buf_ptr = (unsigned char*)buffer + total_bytes_read;
-        auto last_read_result = read(_handle, (void*)buf_ptr, n_bytes - total_bytes_read);
-        if (last_read_result > 0)
+        auto status = FillBuffer();
+        if (status != SerialStatus::Ok)
         {
-            DEBUG_SERIAL(LOG_TAG, "[rcv]", (const char*)buf_ptr, last_read_result);
-            total_bytes_read += last_read_result;
-
-            if (total_bytes_read >= n_bytes)
-            {
-                assert(n_bytes == total_bytes_read);
-                return SerialStatus::Ok;
-            }
-        }
-        else if (last_read_result < 0)
-        {
-            LOG_ERROR(LOG_TAG, "[rcv] rv=%d errorno %d", last_read_result, errno);
-            return SerialStatus::RecvFailed;
+            return status;
         }
+        total_bytes_read += TakeBuffered(buffer + total_bytes_read, n_bytes - total_bytes_read);
+    }
+
+    if (total_bytes_read == n_bytes)
+    {
+        return SerialStatus::Ok;
     }
 
     // reached here on timout
@@ -174,8 +352,62 @@ SerialStatus LinuxSerial::RecvBytes(char* buffer, size_t n_bytes)
     {
         LOG_DEBUG(LOG_TAG, "Timeout recv %zu bytes. Got only %zu bytes", n_bytes, total_bytes_read);
     }
-    
+
     return SerialStatus::RecvTimeout;
 }
+
+SerialStatus LinuxSerial::RecvAvailable(char* buffer, size_t max_bytes, size_t& n_bytes_read)
+{
+    n_bytes_read = 0;
+    if (max_bytes == 0)
+    {
+        LOG_ERROR(LOG_TAG, "Attempt to recv 0 bytes");
+        return SerialStatus::RecvFailed;
+    }
+    n_bytes_read = TakeBuffered(buffer, max_bytes);
+    if (n_bytes_read == 0)
+    {
+        bool interrupted = false;
+        auto status = FillBuffer(&interrupted, _read_timeout);
+        if (status != SerialStatus::Ok)
+        {
+            return status;
+        }
+        n_bytes_read = TakeBuffered(buffer, max_bytes);
+    }
+    return n_bytes_read > 0 ? SerialStatus::Ok : SerialStatus::RecvTimeout;
+}
+
+SerialStatus LinuxSerial::DiscardUntil(char value, timeout_t max_wait)
+{
+    // same as receiving a single byte, unless the caller's wait ends sooner
+    Timer timer {std::min(max_wait, timeout_t {204})};
+    while (true)
+    {
+        auto* begin = &_recv_buffer[_recv_begin];
+        auto* found = static_cast<const char*>(::memchr(begin, value, _recv_end - _recv_begin));
+        if (found != nullptr)
+        {
+            _recv_begin += static_cast<size_t>(found - begin) + 1;
+            return SerialStatus::Ok;
+        }
+        _recv_begin = _recv_end;
+
+        if (timer.ReachedTimeout())
+        {
+            return SerialStatus::RecvTimeout;
+        }
+        bool interrupted = false;
+        auto status = FillBuffer(&interrupted, std::min(timer.TimeLeft(), timeout_t {200}));
+        if (status != SerialStatus::Ok)
+        {
+            return status;
+        }
+        if (interrupted)
+        {
+            return SerialStatus::RecvTimeout;
+        }
+    }
+}
 } // namespace PacketManager
 } // namespace RealSenseID
@@ -24,9 +24,45 @@ public:
     // receive all bytes and copy to the buffer
     SerialStatus RecvBytes(char* buffer, size_t n_bytes) final;
 
+    // the buffered bytes, or the bytes of one read from the port
+    SerialStatus RecvAvailable(char* buffer, size_t max_bytes, size_t& n_bytes_read) final;
+
+    // discard bytes up to and including the first one equal to value (scanning the receive buffer)
+    SerialStatus DiscardUntil(char value, timeout_t max_wait) final;
+
+    // wake up DiscardUntil() through an eventfd polled together with the port
+    void InterruptRecv() final;
+
+    // any baud rate, standard or not
+    bool SetBaudRate(unsigned int baudrate) final;
+
+    // ASYNC_LOW_LATENCY of the tty (TIOCSSERIAL). drivers without the serial ioctls do not support it.
+    bool SetLowLatency(bool enable) final;
+
+    // VTIME (rounded up to 100ms units) and the poll of RecvAvailable(). writes are not timed.
+    bool SetPortTimeouts(timeout_t read_timeout, timeout_t write_timeout) final;
+
+    // the port's file descriptor (e.g. to poll it with SerialReactor instead of using RecvBytes())
+    int Handle() const
+    {
+        return _handle;
+    }
+
 private:
     SerialConfig _config;
     int _handle = -1;
+    int _wakeup_fd = -1;
+    timeout_t _read_timeout {200};
+
+    // received bytes not consumed yet are _recv_buffer[_recv_begin, _recv_end).
+    // reads from the port are done in chunks of up to the buffer size, so a packet usually takes one or two reads.
+    char _recv_buffer[4096];
+    size_t _recv_begin = 0;
+    size_t _recv_end = 0;
+
+    size_t TakeBuffered(char* buffer, size_t n_bytes);
+    // interrupted != nullptr: also return (with no bytes and *interrupted == true) when InterruptRecv() is called
+    SerialStatus FillBuffer(bool* interrupted = nullptr, timeout_t max_wait = timeout_t {200});
 };
 } // namespace PacketManager
 } // namespace RealSenseID
@@ -0,0 +1,29 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "LinuxSerialBaudRate.h"
+#include <asm/ioctls.h>
+#include <asm/termbits.h>
+
+// from <sys/ioctl.h>, which conflicts with <asm/termbits.h>
+extern "C" int ioctl(int fd, unsigned long request, ...);
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+bool SetLinuxCustomBaudRate(int handle, unsigned int baudrate)
+{
+    struct termios2 options;
+    if (::ioctl(handle, TCGETS2, &options) < 0)
+    {
+        return false;
+    }
+    options.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+    options.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+    options.c_ispeed = baudrate;
+    options.c_ospeed = baudrate;
+    return ::ioctl(handle, TCSETS2, &options) == 0;
+}
+} // namespace PacketManager
+} // namespace RealSenseID
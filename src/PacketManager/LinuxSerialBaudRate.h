@@ -0,0 +1,15 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+// set any (non standard) input and output baud rate with termios2 / BOTHER.
+// kept in its own translation unit since the kernel termios headers it needs conflict with <termios.h>.
+// return false on failure (errno is set).
+bool SetLinuxCustomBaudRate(int handle, unsigned int baudrate);
+} // namespace PacketManager
+} // namespace RealSenseID
@@ -0,0 +1,269 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "LinuxUsbSerial.h"
+#include "Logger.h"
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/usbdevice_fs.h>
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+static const char* LOG_TAG = "LinuxUsbSerial";
+
+static constexpr unsigned int CdcCommClass = 0x02;
+static constexpr unsigned int CdcDataClass = 0x0a;
+
+namespace
+{
+// an interface of the usb device, from sysfs
+struct UsbInterface
+{
+    std::string path;
+    unsigned int number = 0;
+    unsigned int interface_class = 0;
+    int bulk_in = -1;
+    int bulk_out = -1;
+};
+} // namespace
+
+// first line of a sysfs attribute, empty if none
+static std::string ReadAttribute(const std::string& path)
+{
+    char line[64] = {0};
+    FILE* file = ::fopen(path.c_str(), "r");
+    if (file == nullptr)
+    {
+        return {};
+    }
+    if (::fgets(line, sizeof(line), file) == nullptr)
+    {
+        line[0] = '\0';
+    }
+    ::fclose(file);
+    line[::strcspn(line, "\r\n")] = '\0';
+    return line;
+}
+
+static std::string RealPath(const std::string& path)
+{
+    char resolved[PATH_MAX];
+    return ::realpath(path.c_str(), resolved) != nullptr ? std::string {resolved} : std::string {};
+}
+
+static std::string BaseName(const std::string& path)
+{
+    auto pos = path.find_last_of('/');
+    return pos == std::string::npos ? path : path.substr(pos + 1);
+}
+
+static std::string DirName(const std::string& path)
+{
+    auto pos = path.find_last_of('/');
+    return pos == std::string::npos ? std::string {} : path.substr(0, pos);
+}
+
+// number, class and bulk endpoints (the ep_XX directories) of the interface at path
+static bool ReadInterface(const std::string& path, UsbInterface& usb_interface)
+{
+    auto number = ReadAttribute(path + "/bInterfaceNumber");
+    if (number.empty())
+    {
+        return false;
+    }
+    usb_interface.path = path;
+    usb_interface.number = static_cast<unsigned int>(::strtoul(number.c_str(), nullptr, 16));
+    usb_interface.interface_class =
+        static_cast<unsigned int>(::strtoul(ReadAttribute(path + "/bInterfaceClass").c_str(), nullptr, 16));
+    DIR* dir = ::opendir(path.c_str());
+    if (dir == nullptr)
+    {
+        return false;
+    }
+    while (auto* entry = ::readdir(dir))
+    {
+        if (::strncmp(entry->d_name, "ep_", 3) != 0)
+        {
+            continue;
+        }
+        auto endpoint = path + "/" + entry->d_name;
+        if (ReadAttribute(endpoint + "/type") != "Bulk")
+        {
+            continue;
+        }
+        auto address = static_cast<int>(::strtoul(ReadAttribute(endpoint + "/bEndpointAddress").c_str(), nullptr, 16));
+        auto direction = ReadAttribute(endpoint + "/direction");
+        if (direction == "in" && usb_interface.bulk_in < 0)
+        {
+            usb_interface.bulk_in = address;
+        }
+        else if (direction == "out" && usb_interface.bulk_out < 0)
+        {
+            usb_interface.bulk_out = address;
+        }
+    }
+    ::closedir(dir);
+    return true;
+}
+
+// the interface with the bulk endpoints: the port's own (e.g. usb-serial adapters), or the cdc data interface of
+// the port's cdc-acm control interface
+static bool FindDataInterface(const UsbInterface& port_interface, UsbInterface& data_interface)
+{
+    if (port_interface.bulk_in >= 0 && port_interface.bulk_out >= 0)
+    {
+        data_interface = port_interface;
+        return true;
+    }
+    const auto device_path = DirName(port_interface.path);
+    const auto prefix = BaseName(device_path) + ":";
+    DIR* dir = ::opendir(device_path.c_str());
+    if (dir == nullptr)
+    {
+        return false;
+    }
+    bool found = false;
+    while (auto* entry = ::readdir(dir))
+    {
+        UsbInterface candidate;
+        if (::strncmp(entry->d_name, prefix.c_str(), prefix.size()) != 0 ||
+            !ReadInterface(device_path + "/" + entry->d_name, candidate))
+        {
+            continue;
+        }
+        if (candidate.interface_class == CdcDataClass && candidate.bulk_in >= 0 && candidate.bulk_out >= 0)
+        {
+            data_interface = candidate;
+            found = true;
+            break;
+        }
+    }
+    ::closedir(dir);
+    return found;
+}
+
+LinuxUsbSerial::LinuxUsbSerial(const SerialConfig& config)
+{
+    // the port's usb interface: /sys/class/tty/<name>/device links to it, the usb device is its parent
+    const auto port_path = RealPath(config.port != nullptr ? config.port : "");
+    UsbInterface port_interface;
+    if (port_path.empty() ||
+        !ReadInterface(RealPath("/sys/class/tty/" + BaseName(port_path) + "/device"), port_interface))
+    {
+        throw std::runtime_error(std::string("Not a usb serial port: ") + (config.port ? config.port : "null"));
+    }
+    UsbInterface data_interface;
+    if (!FindDataInterface(port_interface, data_interface))
+    {
+        throw std::runtime_error("No bulk endpoints on the usb device of the serial port");
+    }
+    const auto device_path = DirName(port_interface.path);
+    const auto bus = ::strtoul(ReadAttribute(device_path + "/busnum").c_str(), nullptr, 10);
+    const auto device = ::strtoul(ReadAttribute(device_path + "/devnum").c_str(), nullptr, 10);
+    char usbfs_path[64];
+    ::snprintf(usbfs_path, sizeof(usbfs_path), "/dev/bus/usb/%03lu/%03lu", bus, device);
+    LOG_DEBUG(LOG_TAG, "Opening %s (port %s) interface %u endpoints in 0x%02x out 0x%02x", usbfs_path, config.port,
+              data_interface.number, data_interface.bulk_in, data_interface.bulk_out);
+
+    _handle = ::open(usbfs_path, O_RDWR | O_CLOEXEC);
+    if (_handle < 0)
+    {
+        throw std::runtime_error(std::string("Failed open ") + usbfs_path + ". errno: " + std::to_string(errno));
+    }
+
+    // take the interfaces from the driver (detaching cdc-acm from one interface releases the other as well)
+    std::vector<unsigned int> interfaces {port_interface.number};
+    if (data_interface.number != port_interface.number)
+    {
+        interfaces.push_back(data_interface.number);
+    }
+    for (auto number : interfaces)
+    {
+        struct usbdevfs_ioctl command = {static_cast<int>(number), USBDEVFS_DISCONNECT, nullptr};
+        if (::ioctl(_handle, USBDEVFS_IOCTL, &command) == 0)
+        {
+            _detached.push_back(number);
+        }
+        else if (errno != ENODATA)
+        {
+            LOG_DEBUG(LOG_TAG, "Detach driver of interface %u failed. errno=%d", number, errno);
+        }
+        unsigned int claim = number;
+        if (::ioctl(_handle, USBDEVFS_CLAIMINTERFACE, &claim) != 0)
+        {
+            const int error_number = errno;
+            Close();
+            throw std::runtime_error("Failed to claim usb interface " + std::to_string(number) +
+                                     ". errno: " + std::to_string(error_number));
+        }
+        _claimed.push_back(number);
+    }
+
+    // cdc devices may wait for the host to open the port (DTR) before they send
+    if (port_interface.interface_class == CdcCommClass)
+    {
+        struct usbdevfs_ctrltransfer control;
+        ::memset(&control, 0, sizeof(control));
+        control.bRequestType = 0x21; // class request to the interface
+        control.bRequest = 0x22;     // SET_CONTROL_LINE_STATE
+        control.wValue = 0x3;        // DTR | RTS
+        control.wIndex = static_cast<uint16_t>(port_interface.number);
+        control.timeout = 1000;
+        if (::ioctl(_handle, USBDEVFS_CONTROL, &control) < 0)
+        {
+            LOG_DEBUG(LOG_TAG, "Set control line state failed. errno=%d", errno);
+        }
+    }
+
+    StartReader(_handle, data_interface.bulk_in, data_interface.bulk_out);
+}
+
+LinuxUsbSerial::~LinuxUsbSerial()
+{
+    try
+    {
+        Close();
+    }
+    catch (...)
+    {
+    }
+}
+
+void LinuxUsbSerial::Close()
+{
+    StopReader();
+    if (_handle < 0)
+    {
+        return;
+    }
+    for (auto number : _claimed)
+    {
+        ::ioctl(_handle, USBDEVFS_RELEASEINTERFACE, &number);
+    }
+    // give the port back to the driver
+    for (auto number : _detached)
+    {
+        struct usbdevfs_ioctl command = {static_cast<int>(number), USBDEVFS_CONNECT, nullptr};
+        if (::ioctl(_handle, USBDEVFS_IOCTL, &command) != 0)
+        {
+            LOG_DEBUG(LOG_TAG, "Reattach driver of interface %u failed. errno=%d", number, errno);
+        }
+    }
+    _claimed.clear();
+    _detached.clear();
+    ::close(_handle);
+    _handle = -1;
+}
+} // namespace PacketManager
+} // namespace RealSenseID
@@ -0,0 +1,32 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+#include "UsbBulkSerial.h"
+#include <vector>
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+// The device of a tty port (e.g. /dev/ttyACM0) through its usb bulk endpoints instead of the tty: the usbfs node of
+// the port's usb device is opened and the data interface claimed from the kernel driver (cdc-acm), which gives the
+// tty back when closed. No termios or line discipline in the path, and a packet is one transfer each way.
+// Needs write access to the usbfs node (/dev/bus/usb/BBB/DDD, e.g. a udev rule) and a port on a usb device.
+class LinuxUsbSerial : public UsbBulkSerial
+{
+public:
+    // throws if the port is not a usb device's or the interface cannot be claimed
+    explicit LinuxUsbSerial(const SerialConfig& config);
+    ~LinuxUsbSerial() override;
+
+private:
+    int _handle = -1;
+    // the interfaces the kernel driver was detached from, given back on close (the port's own interface first)
+    std::vector<unsigned int> _detached;
+    std::vector<unsigned int> _claimed;
+
+    void Close();
+};
+} // namespace PacketManager
+} // namespace RealSenseID
@@ -3,11 +3,19 @@
 
 #include "MbedtlsWrapper.h"
 #include "Logger.h"
+#include "mbedtls/platform_util.h"
+#include <algorithm>
+#include <chrono>
+#include <initializer_list>
 #include <string.h>
+#include <system_error>
 
 static const char* LOG_TAG = "MbedtlsWrapper";
 static const char* SALT_AES = "aes";
 static const char* SALT_HMAC = "hmac";
+// the signed host ecdh key is reused by this many sessions / for this long before a new one is generated and signed
+static const unsigned int MAX_ECDH_KEY_SESSIONS = 1000;
+static const std::chrono::minutes MAX_ECDH_KEY_AGE {60};
 
 namespace RealSenseID
 {
@@ -21,14 +29,31 @@ MbedtlsWrapper::MbedtlsWrapper() :
     mbedtls_ecdh_init(&_edch_ctx);
     mbedtls_aes_init(&_aes_ctx);
     _md = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+    mbedtls_md_init(&_hmac_inner);
+    mbedtls_md_init(&_hmac_outer);
+    mbedtls_md_init(&_hmac_work);
+    mbedtls_mpi_init(&_next_d);
+    mbedtls_ecp_point_init(&_next_Q);
+#if defined(MBEDTLS_AESNI_C) && defined(MBEDTLS_HAVE_X86_64)
+    LOG_DEBUG(LOG_TAG, "AES-NI %s", mbedtls_aesni_has_support(MBEDTLS_AESNI_AES) ? "supported" : "not supported");
+#endif
 }
 
 MbedtlsWrapper::~MbedtlsWrapper()
 {
+    if (_next_key.valid())
+    {
+        _next_key.wait(); // the worker writes to _next_d / _next_Q
+    }
+    mbedtls_mpi_free(&_next_d);
+    mbedtls_ecp_point_free(&_next_Q);
     mbedtls_entropy_free(&_entropy_ctx);
     mbedtls_ctr_drbg_free(&_ctr_drbg_ctx);
     mbedtls_ecdh_free(&_edch_ctx);
     mbedtls_aes_free(&_aes_ctx);
+    mbedtls_md_free(&_hmac_inner);
+    mbedtls_md_free(&_hmac_outer);
+    mbedtls_md_free(&_hmac_work);
 }
 
 void MbedtlsWrapper::Reset()
@@ -52,11 +77,28 @@ size_t MbedtlsWrapper::GetSignedEcdhPubkeySize()
     return SIGNED_PUBKEY_SIZE;
 }
 
+void MbedtlsWrapper::ClearSignedEcdhPubkey()
+{
+    _ecdh_key_signed = false;
+}
+
 unsigned char* MbedtlsWrapper::GetSignedEcdhPubkey(SignCallback sign_clbk)
 {
+    // the device generates a new key every session, so the shared secret is new even when our key is reused.
+    // reusing it skips the key generation and the sign callback (which may be a round trip to an HSM).
+    if (_ecdh_key_signed && _ecdh_key_sessions < MAX_ECDH_KEY_SESSIONS &&
+        std::chrono::steady_clock::now() - _ecdh_key_time < MAX_ECDH_KEY_AGE)
+    {
+        _ecdh_key_sessions++;
+        ::memset(_shared_secret, 0, sizeof(_shared_secret));
+        LOG_DEBUG(LOG_TAG, "Reusing signed ecdh key");
+        return _ecdh_signed_pubkey;
+    }
+
+    _ecdh_key_signed = false;
     Reset();
 
-    if (!GenerateEcdhKey())
+    if (!RenewEcdhKey())
     {
         LOG_ERROR(LOG_TAG, "Failed to generate ecdh key");
         return nullptr;
@@ -84,6 +126,9 @@ unsigned char* MbedtlsWrapper::GetSignedEcdhPubkey(SignCallback sign_clbk)
         return nullptr;
     }
 
+    _ecdh_key_signed = true;
+    _ecdh_key_sessions = 1;
+    _ecdh_key_time = std::chrono::steady_clock::now();
     return _ecdh_signed_pubkey;
 }
 
@@ -163,6 +208,11 @@ bool MbedtlsWrapper::VerifyEcdhSignedKey(const unsigned char* ecdh_signed_pubkey
         return false;
     }
 
+    if (!KeyHmac())
+    {
+        return false;
+    }
+
     return true;
 }
 
@@ -180,20 +230,109 @@ bool MbedtlsWrapper::Decrypt(const unsigned char* iv, const unsigned char* input
     return res;
 }
 
+// hash the ipad / opad blocks of the session's hmac key once (rfc 2104: the key is shorter than the block)
+bool MbedtlsWrapper::KeyHmac()
+{
+    static constexpr size_t Sha256BlockSize = 64;
+    static_assert(ECC_P256_KEY_X_Y_Z_SIZE_BYTES <= Sha256BlockSize, "hmac key longer than the sha-256 block");
+
+    _hmac_ready = false;
+    int ret = 0;
+    for (auto* ctx : {&_hmac_inner, &_hmac_outer, &_hmac_work})
+    {
+        if (ret == 0 && ctx->md_info == nullptr)
+        {
+            ret = mbedtls_md_setup(ctx, _md, 0);
+        }
+    }
+    if (ret != 0)
+    {
+        LOG_ERROR(LOG_TAG, "Failed! mbedtls_md_setup returned %d", ret);
+        return false;
+    }
+
+    unsigned char ipad[Sha256BlockSize];
+    unsigned char opad[Sha256BlockSize];
+    ::memset(ipad, 0x36, sizeof(ipad));
+    ::memset(opad, 0x5c, sizeof(opad));
+    for (size_t i = 0; i < ECC_P256_KEY_X_Y_Z_SIZE_BYTES; i++)
+    {
+        ipad[i] ^= _hmac_key[i];
+        opad[i] ^= _hmac_key[i];
+    }
+    ret = mbedtls_md_starts(&_hmac_inner);
+    if (ret == 0)
+    {
+        ret = mbedtls_md_update(&_hmac_inner, ipad, sizeof(ipad));
+    }
+    if (ret == 0)
+    {
+        ret = mbedtls_md_starts(&_hmac_outer);
+    }
+    if (ret == 0)
+    {
+        ret = mbedtls_md_update(&_hmac_outer, opad, sizeof(opad));
+    }
+    mbedtls_platform_zeroize(ipad, sizeof(ipad));
+    mbedtls_platform_zeroize(opad, sizeof(opad));
+    if (ret != 0)
+    {
+        LOG_ERROR(LOG_TAG, "Failed keying hmac (%d)", ret);
+        return false;
+    }
+    _hmac_ready = true;
+    return true;
+}
+
 bool MbedtlsWrapper::CalcHmac(const unsigned char* input, const unsigned int length, unsigned char* hmac)
 {
-    int ret = mbedtls_md_hmac(_md, _hmac_key, ECC_P256_KEY_X_Y_Z_SIZE_BYTES, input, length, hmac);
+    int ret = 0;
+    if (!_hmac_ready)
+    {
+        ret = mbedtls_md_hmac(_md, _hmac_key, ECC_P256_KEY_X_Y_Z_SIZE_BYTES, input, length, hmac);
+        if (ret != 0)
+        {
+            LOG_ERROR(LOG_TAG, "Failed! mbedtls_md_hmac returned %d", ret);
+            return false;
+        }
+        return true;
+    }
+
+    // H(opad || H(ipad || input)), continuing the precomputed ipad / opad states
+    unsigned char inner_hash[HMAC_256_SIZE_BYTES];
+    ret = mbedtls_md_clone(&_hmac_work, &_hmac_inner);
+    if (ret == 0)
+    {
+        ret = mbedtls_md_update(&_hmac_work, input, length);
+    }
+    if (ret == 0)
+    {
+        ret = mbedtls_md_finish(&_hmac_work, inner_hash);
+    }
+    if (ret == 0)
+    {
+        ret = mbedtls_md_clone(&_hmac_work, &_hmac_outer);
+    }
+    if (ret == 0)
+    {
+        ret = mbedtls_md_update(&_hmac_work, inner_hash, sizeof(inner_hash));
+    }
+    if (ret == 0)
+    {
+        ret = mbedtls_md_finish(&_hmac_work, hmac);
+    }
     if (ret != 0)
     {
-        LOG_ERROR(LOG_TAG, "Failed! mbedtls_hkdf returned %d", ret);
+        LOG_ERROR(LOG_TAG, "Failed! hmac returned %d", ret);
         return false;
     }
     return true;
 }
 
-bool MbedtlsWrapper::GenerateEcdhKey()
+// seed the random generator, once
+bool MbedtlsWrapper::SeedRandom()
 {
-    if (_ecdh_generate_key)
+    if (_random_seeded)
         return true;
 
     int ret = mbedtls_ctr_drbg_seed(&_ctr_drbg_ctx, mbedtls_entropy_func, &_entropy_ctx, NULL, 0);
@@ -202,25 +341,139 @@ bool MbedtlsWrapper::GenerateEcdhKey()
         LOG_ERROR(LOG_TAG, "Failed! mbedtls_ctr_drbg_seed returned %d", ret);
         return false;
     }
+    _random_seeded = true;
+    return true;
+}
+
+bool MbedtlsWrapper::GenerateRandom(unsigned char* output, size_t length)
+{
+    if (!SeedRandom())
+        return false;
+
+    // the drbg reseeds itself from the entropy source every MBEDTLS_CTR_DRBG_RESEED_INTERVAL requests
+    while (length > 0)
+    {
+        size_t chunk = std::min<size_t>(length, MBEDTLS_CTR_DRBG_MAX_REQUEST);
+        int ret = mbedtls_ctr_drbg_random(&_ctr_drbg_ctx, output, chunk);
+        if (ret != 0)
+        {
+            LOG_ERROR(LOG_TAG, "Failed! mbedtls_ctr_drbg_random returned %d", ret);
+            return false;
+        }
+        output += chunk;
+        length -= chunk;
+    }
+    return true;
+}
+
+// seed the random generator and load the group, once
+bool MbedtlsWrapper::InitEcdh()
+{
+    if (_ecdh_initialized)
+        return true;
+
+    if (!SeedRandom())
+        return false;
 
-    ret = mbedtls_ecp_group_load(&_edch_ctx.grp, MBEDTLS_ECP_DP_SECP256R1);
+    int ret = mbedtls_ecp_group_load(&_edch_ctx.grp, MBEDTLS_ECP_DP_SECP256R1);
     if (ret != 0)
     {
         LOG_ERROR(LOG_TAG, "Failed! mbedtls_ecp_group_load returned %d", ret);
         return false;
     }
 
-    ret = mbedtls_ecdh_gen_public(&_edch_ctx.grp, &_edch_ctx.d, &_edch_ctx.Q, mbedtls_ctr_drbg_random, &_ctr_drbg_ctx);
-    if (ret != 0)
-    {
-        LOG_ERROR(LOG_TAG, "Failed! mbedtls_ecdh_gen_public returned %d", ret);
+    _ecdh_initialized = true;
+    return true;
+}
+
+// generate a key if there is none yet
+bool MbedtlsWrapper::GenerateEcdhKey()
+{
+    if (_ecdh_generate_key)
+        return true;
+    return RenewEcdhKey();
+}
+
+// replace the key with the pre-generated one, or generate one now if it is not available (or not ready yet)
+bool MbedtlsWrapper::RenewEcdhKey()
+{
+    if (!InitEcdh())
         return false;
-    }
 
+    _ecdh_generate_key = false;
+    if (TakeNextEcdhKey())
+    {
+        LOG_DEBUG(LOG_TAG, "Using pre-generated ecdh key");
+    }
+    else
+    {
+        int ret = mbedtls_ecdh_gen_public(&_edch_ctx.grp, &_edch_ctx.d, &_edch_ctx.Q, mbedtls_ctr_drbg_random,
+                                          &_ctr_drbg_ctx);
+        if (ret != 0)
+        {
+            LOG_ERROR(LOG_TAG, "Failed! mbedtls_ecdh_gen_public returned %d", ret);
+            return false;
+        }
+    }
     _ecdh_generate_key = true;
+    PrepareNextEcdhKey();
     return true;
 }
 
+// generate a key pair with its own random generator (the members are used by the session meanwhile)
+static bool GenerateEcdhKeyPair(mbedtls_mpi* d, mbedtls_ecp_point* Q)
+{
+    mbedtls_entropy_context entropy_ctx;
+    mbedtls_ctr_drbg_context ctr_drbg_ctx;
+    mbedtls_ecp_group grp;
+    mbedtls_entropy_init(&entropy_ctx);
+    mbedtls_ctr_drbg_init(&ctr_drbg_ctx);
+    mbedtls_ecp_group_init(&grp);
+
+    int ret = mbedtls_ctr_drbg_seed(&ctr_drbg_ctx, mbedtls_entropy_func, &entropy_ctx, NULL, 0);
+    if (ret == 0)
+    {
+        ret = mbedtls_ecp_group_load(&grp, MBEDTLS_ECP_DP_SECP256R1);
+    }
+    if (ret == 0)
+    {
+        ret = mbedtls_ecdh_gen_public(&grp, d, Q, mbedtls_ctr_drbg_random, &ctr_drbg_ctx);
+    }
+    if (ret != 0)
+    {
+        LOG_ERROR(LOG_TAG, "Failed to pre-generate ecdh key. Returned %d", ret);
+    }
+
+    mbedtls_ecp_group_free(&grp);
+    mbedtls_ctr_drbg_free(&ctr_drbg_ctx);
+    mbedtls_entropy_free(&entropy_ctx);
+    return ret == 0;
+}
+
+void MbedtlsWrapper::PrepareNextEcdhKey()
+{
+    if (_next_key.valid())
+        return;
+    try
+    {
+        _next_key = std::async(std::launch::async, [this]() { return GenerateEcdhKeyPair(&_next_d, &_next_Q); });
+    }
+    catch (const std::system_error& ex)
+    {
+        LOG_WARNING(LOG_TAG, "Cannot pre-generate ecdh key: %s", ex.what());
+    }
+}
+
+// false if no pre-generated key is ready: one still being generated is not waited for, it is kept for the next renewal
+bool MbedtlsWrapper::TakeNextEcdhKey()
+{
+    if (!_next_key.valid() || _next_key.wait_for(std::chrono::seconds {0}) != std::future_status::ready)
+        return false;
+    if (!_next_key.get())
+        return false;
+    return mbedtls_mpi_copy(&_edch_ctx.d, &_next_d) == 0 && mbedtls_ecp_copy(&_edch_ctx.Q, &_next_Q) == 0;
+}
+
 bool MbedtlsWrapper::AesCtr256(const unsigned char* iv, const unsigned char* input, unsigned char* output,
                                const unsigned int length)
 {
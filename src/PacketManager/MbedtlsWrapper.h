@@ -7,8 +7,12 @@
 #include "mbedtls/ecdh.h"
 #include "mbedtls/aes.h"
 #include "mbedtls/hkdf.h"
+#include "mbedtls/md.h"
+#include "mbedtls/aesni.h"
 
+#include <chrono>
 #include <functional>
+#include <future>
 
 #define ECC_P256_KEY_SIZE_BYTES        64
 #define ECC_P256_SIG_SIZE_BYTES        64
@@ -38,28 +42,58 @@ public:
 
     bool IsMaEnabled(bool& isMaEnabled);
     size_t GetSignedEcdhPubkeySize();
+    // the signed key is reused by the following sessions for a bounded number of sessions / time
     unsigned char* GetSignedEcdhPubkey(SignCallback signCallback);
+    // force a new key and signature on the next GetSignedEcdhPubkey() (e.g. the host signing key changed)
+    void ClearSignedEcdhPubkey();
     bool VerifyEcdhSignedKey(const unsigned char* ecdhSignedPubKey, VerifyCallback verifyCallback);
+    // aes-ctr. output may be the same buffer as input (in place)
     bool Encrypt(const unsigned char* iv, const unsigned char* input, unsigned char* output, const unsigned int length);
     bool Decrypt(const unsigned char* iv, const unsigned char* input, unsigned char* output, const unsigned int length);
     bool CalcHmac(const unsigned char* input, const unsigned int length, unsigned char* hmac);
+    // random bytes from the wrapper's ctr-drbg (seeded once), e.g. the packet ivs
+    bool GenerateRandom(unsigned char* output, size_t length);
+    // start generating the next ecdh key pair in the background, if not already started. nothing is generated
+    // before the first call (or the first session), so a wrapper that never starts a session costs nothing.
+    void PrepareNextEcdhKey();
 
 private:
     void Reset();
+    bool SeedRandom();
+    bool InitEcdh();
     bool GenerateEcdhKey();
+    bool RenewEcdhKey();
+    bool TakeNextEcdhKey();
+    bool KeyHmac();
     bool AesCtr256(const unsigned char* iv, const unsigned char* input, unsigned char* output,
                    const unsigned int length);
 
     bool _ecdh_generate_key;
+    bool _ecdh_initialized = false;
+    bool _random_seeded = false;
+    // the next key pair is generated in the background while the current one is in use
+    std::future<bool> _next_key;
+    mbedtls_mpi _next_d;
+    mbedtls_ecp_point _next_Q;
     mbedtls_entropy_context _entropy_ctx;
     mbedtls_ctr_drbg_context _ctr_drbg_ctx;
     mbedtls_ecdh_context _edch_ctx;
     mbedtls_aes_context _aes_ctx;
     const mbedtls_md_info_t* _md;
+    // sha-256 states after the hmac ipad / opad blocks, hashed once per session key. CalcHmac() continues a copy of
+    // each in _hmac_work, so a packet costs no key block compressions.
+    mbedtls_md_context_t _hmac_inner;
+    mbedtls_md_context_t _hmac_outer;
+    mbedtls_md_context_t _hmac_work;
+    bool _hmac_ready = false;
     unsigned char _shared_secret[ECC_P256_KEY_X_Y_Z_SIZE_BYTES];
     unsigned char _aes_key[ECC_P256_KEY_X_Y_Z_SIZE_BYTES];
     unsigned char _hmac_key[ECC_P256_KEY_X_Y_Z_SIZE_BYTES];
     unsigned char _ecdh_signed_pubkey[SIGNED_PUBKEY_SIZE];
+    // _ecdh_signed_pubkey is valid and may be reused by the next sessions
+    bool _ecdh_key_signed = false;
+    unsigned int _ecdh_key_sessions = 0;
+    std::chrono::steady_clock::time_point _ecdh_key_time;
 };
 } // namespace PacketManager
 } // namespace RealSenseID
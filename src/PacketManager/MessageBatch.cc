@@ -0,0 +1,154 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "MessageBatch.h"
+#include <algorithm>
+#include <string.h>
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+static_assert(BatchHeaderSize + 2 * (BatchEntryHeaderSize + sizeof(FaMessage)) <= sizeof(DataMessage::data),
+              "batch too small");
+
+static uint16_t PayloadSize(size_t message_size)
+{
+    return static_cast<uint16_t>((sizeof(uint32_t) + message_size + 31) & ~size_t {31});
+}
+
+// the message bytes of a packet in a batch
+static size_t MessageSize(const SerialPacket& packet)
+{
+    if (IsFaPacket(packet))
+    {
+        return sizeof(FaMessage);
+    }
+    const size_t size = packet.header.payload_size > sizeof(packet.payload.sequence_number)
+                            ? packet.header.payload_size - sizeof(packet.payload.sequence_number)
+                            : 0;
+    return std::min(size, sizeof(DataMessage::data));
+}
+
+MessageBatch::MessageBatch()
+{
+    Clear();
+}
+
+bool MessageBatch::Add(const SerialPacket& packet)
+{
+    const size_t size = MessageSize(packet);
+    if (packet.header.id == MsgId::Batch || _count == 0xFF ||
+        _size + BatchEntryHeaderSize + size > sizeof(DataMessage::data))
+    {
+        return false;
+    }
+    auto* data = reinterpret_cast<unsigned char*>(_packet.payload.message.data_msg.data);
+    data[_size] = static_cast<unsigned char>(packet.header.id);
+    data[_size + 1] = static_cast<unsigned char>(size);
+    data[_size + 2] = static_cast<unsigned char>(size >> 8);
+    ::memcpy(data + _size + BatchEntryHeaderSize, &packet.payload.message, size);
+    _size += BatchEntryHeaderSize + size;
+    _count++;
+    return true;
+}
+
+size_t MessageBatch::Fill(const SerialPacket* packets, size_t count)
+{
+    Clear();
+    size_t added = 0;
+    while (added < count && Add(packets[added]))
+    {
+        added++;
+    }
+    return added;
+}
+
+size_t MessageBatch::Count() const
+{
+    return _count;
+}
+
+void MessageBatch::Clear()
+{
+    // a sent packet is encrypted in place
+    _packet = DataPacket {MsgId::Batch};
+    _count = 0;
+    _size = BatchHeaderSize;
+}
+
+DataPacket& MessageBatch::Packet()
+{
+    _packet.payload.message.data_msg.data[0] = static_cast<char>(_count);
+    _packet.header.payload_size = PayloadSize(_size);
+    return _packet;
+}
+
+bool MessageBatchReader::Load(const SerialPacket& batch)
+{
+    Clear();
+    const size_t data_size = MessageSize(batch);
+    const auto* data = reinterpret_cast<const unsigned char*>(batch.payload.message.data_msg.data);
+    if (batch.header.id != MsgId::Batch || data_size < BatchHeaderSize || data[0] == 0)
+    {
+        return false;
+    }
+    // check all the entries before taking any
+    size_t offset = BatchHeaderSize;
+    for (size_t i = 0; i < data[0]; i++)
+    {
+        if (offset + BatchEntryHeaderSize > data_size || static_cast<MsgId>(data[offset]) == MsgId::Batch)
+        {
+            return false;
+        }
+        const size_t size = static_cast<size_t>(data[offset + 1] | (data[offset + 2] << 8));
+        offset += BatchEntryHeaderSize;
+        if (size > data_size - offset)
+        {
+            return false;
+        }
+        offset += size;
+    }
+    _batch = batch;
+    _remaining = data[0];
+    _offset = BatchHeaderSize;
+    return true;
+}
+
+bool MessageBatchReader::Next(SerialPacket& packet)
+{
+    if (_remaining == 0)
+    {
+        return false;
+    }
+    const auto* data = reinterpret_cast<const unsigned char*>(_batch.payload.message.data_msg.data);
+    const size_t size = static_cast<size_t>(data[_offset + 1] | (data[_offset + 2] << 8));
+    packet = SerialPacket {};
+    packet.header.protocol_ver = _batch.header.protocol_ver;
+    packet.header.id = static_cast<MsgId>(data[_offset]);
+    packet.header.payload_size = PayloadSize(size);
+    packet.payload.sequence_number = _batch.payload.sequence_number;
+    ::memcpy(&packet.payload.message, data + _offset + BatchEntryHeaderSize, size);
+    _offset += BatchEntryHeaderSize + size;
+    _remaining--;
+    return true;
+}
+
+bool MessageBatchReader::Empty() const
+{
+    return _remaining == 0;
+}
+
+void MessageBatchReader::Clear()
+{
+    _remaining = 0;
+    _offset = 0;
+}
+
+bool AcceptedBatches(const SessionOptions& offered, const unsigned char* reply_options, size_t size)
+{
+    SessionOptions accepted;
+    return offered.batches && ReadSessionOptions(reply_options, size, accepted) && accepted.batches;
+}
+} // namespace PacketManager
+} // namespace RealSenseID
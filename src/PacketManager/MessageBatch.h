@@ -0,0 +1,70 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "SerialPacket.h"
+#include "SessionOptions.h"
+#include <cstddef>
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+// Message batches: several small messages (acks, hints, progress, pipelined requests) in one Batch data packet, in a
+// session that negotiated them (the batches flag of the session options, see SessionOptions.h). The framing, and in
+// the secure session the iv, encryption, hmac and sequence check, are then paid once for the batch.
+// The batch data (little endian): the number of messages (u8), then of each its id (u8), size (u16) and message bytes
+// (the payload but the sequence number, of an fa message its FaMessage). The messages of a batch are in order and take
+// its sequence number. Batches are not nested, and large packets are not batched.
+static constexpr size_t BatchHeaderSize = 1;
+static constexpr size_t BatchEntryHeaderSize = 1 + 2;
+
+// Builds a batch packet
+class MessageBatch
+{
+public:
+    MessageBatch();
+
+    // add the message of packet. returns false if it does not fit (the batch is then unchanged)
+    bool Add(const SerialPacket& packet);
+
+    // start over with packets: add as many of the count packets as fit, return how many
+    size_t Fill(const SerialPacket* packets, size_t count);
+
+    size_t Count() const;
+    void Clear();
+
+    // the batch packet, to be sent
+    DataPacket& Packet();
+
+private:
+    DataPacket _packet {MsgId::Batch};
+    size_t _count = 0;
+    size_t _size = BatchHeaderSize;
+};
+
+// Splits a received batch packet into its messages
+class MessageBatchReader
+{
+public:
+    // take the messages of a batch. returns false, with no messages, if it is malformed
+    bool Load(const SerialPacket& batch);
+
+    // the next message as a packet of its own, false if there is none left
+    bool Next(SerialPacket& packet);
+
+    bool Empty() const;
+    void Clear();
+
+private:
+    SerialPacket _batch;
+    size_t _remaining = 0;
+    size_t _offset = 0;
+};
+
+// whether a session started with the offered options has batches, from the options of the device's reply (size bytes
+// at reply_options)
+bool AcceptedBatches(const SessionOptions& offered, const unsigned char* reply_options, size_t size);
+} // namespace PacketManager
+} // namespace RealSenseID
@@ -4,12 +4,16 @@
 #include "NonSecureSession.h"
 #include "PacketSender.h"
 #include "Logger.h"
+#include "MetricsRegistry.h"
+#include <algorithm>
 #include <stdexcept>
 #include <string.h>
 #include <cassert>
 
 static const char* LOG_TAG = "NonSecureSession";
 static const int MAX_SEQ_NUMBER_DELTA = 20;
+// renegotiate on Resume() once the sequence numbers pass this value
+static const uint32_t MAX_RESUME_SEQ_NUMBER = 0xFFFFFFFF - (1u << 20);
 
 namespace RealSenseID
 {
@@ -28,9 +32,15 @@ NonSecureSession::~NonSecureSession()
     }
 }
 
+void NonSecureSession::Prepare()
+{
+    _rtt.Reset(); // new connection
+}
+
 SerialStatus NonSecureSession::Start(SerialConnection* serial_conn)
 {
     LOG_DEBUG(LOG_TAG, "Start session");
+    MetricsRegistry::ScopedSessionStart session_start;
 
     _is_open = false;
     _cancel_required = false;
@@ -42,8 +52,15 @@ SerialStatus NonSecureSession::Start(SerialConnection* serial_conn)
     _serial = serial_conn;
     _last_sent_seq_number = 0;
     _last_recv_seq_number = 0;
+    _large_payload_size = 0;
+    _batches = false;
+    _recv_batch.Clear();
 
-    DataPacket packet {MsgId::StartSession};
+    unsigned char options[SessionOptionsSize];
+    WriteSessionOptions(_start_options, options);
+    DataPacket packet = _start_options.IsDefault()
+                            ? DataPacket {MsgId::StartSession}
+                            : DataPacket {MsgId::StartSession, reinterpret_cast<char*>(options), sizeof(options)};
     PacketSender sender {_serial};
     auto status = sender.SendBinary(packet);
     if (status != SerialStatus::Ok)
@@ -54,11 +71,51 @@ SerialStatus NonSecureSession::Start(SerialConnection* serial_conn)
 
     status = sender.Recv(packet);
     if (status != SerialStatus::Ok || packet.header.id != MsgId::StartSession)
+    {
         LOG_ERROR(LOG_TAG, "Failed to recv device start session response");
+        return status;
+    }
+    // the options the device applies, if it has them
+    const size_t reply_size = packet.header.payload_size > sizeof(packet.payload.sequence_number)
+                                  ? packet.header.payload_size - sizeof(packet.payload.sequence_number)
+                                  : 0;
+    const auto* reply_options = reinterpret_cast<const unsigned char*>(packet.Data().data);
+    const size_t options_size = std::min(reply_size, sizeof(packet.Data().data));
+    _large_payload_size = AcceptedLargePayload(_start_options, reply_options, options_size);
+    _batches = AcceptedBatches(_start_options, reply_options, options_size);
 
+    _is_open = true;
     return status;
 }
 
+SerialStatus NonSecureSession::Resume(SerialConnection* serial_conn)
+{
+    if (!_is_open || _serial != serial_conn || _last_sent_seq_number > MAX_RESUME_SEQ_NUMBER ||
+        _last_recv_seq_number > MAX_RESUME_SEQ_NUMBER)
+    {
+        return Start(serial_conn);
+    }
+    LOG_DEBUG(LOG_TAG, "Resume session");
+    _cancel_required = false;
+    _recv_batch.Clear(); // messages left of the previous operation's batch
+    return SerialStatus::Ok;
+}
+
+void NonSecureSession::Close()
+{
+    _is_open = false;
+}
+
+void NonSecureSession::SetStartOptions(const SessionOptions& options)
+{
+    _start_options = options;
+}
+
+const SessionOptions& NonSecureSession::StartOptions() const
+{
+    return _start_options;
+}
+
 bool NonSecureSession::IsOpen()
 {
     return _is_open;
@@ -66,18 +123,88 @@ bool NonSecureSession::IsOpen()
 
 SerialStatus NonSecureSession::SendPacket(SerialPacket& packet)
 {
-    return SendPacketImpl(packet);
+    auto status = SendPacketImpl(packet);
+    if (status != SerialStatus::Ok)
+    {
+        _is_open = false; // device and host may be out of sync
+    }
+    return status;
 }
 
 SerialStatus NonSecureSession::RecvPacket(SerialPacket& packet)
 {
-    return RecvPacketImpl(packet);
+    if (_recv_batch.Next(packet))
+    {
+        return SerialStatus::Ok;
+    }
+    auto status = RecvPacketImpl(packet);
+    if (status == SerialStatus::Ok && packet.header.id == MsgId::Batch &&
+        !(_recv_batch.Load(packet) && _recv_batch.Next(packet)))
+    {
+        LOG_ERROR(LOG_TAG, "Malformed message batch");
+        status = SerialStatus::RecvFailed;
+    }
+    if (status != SerialStatus::Ok)
+    {
+        _is_open = false; // device and host may be out of sync
+    }
+    return status;
+}
+
+SerialStatus NonSecureSession::SendPackets(SerialPacket* packets, size_t count)
+{
+    for (size_t sent = 0; sent < count;)
+    {
+        const size_t batched = _batches && count - sent > 1 ? _send_batch.Fill(packets + sent, count - sent) : 0;
+        SerialStatus status;
+        if (batched > 1)
+        {
+            status = SendPacket(_send_batch.Packet());
+            _last_request = packets[sent + batched - 1].header.id; // the reply timeouts are by the requests
+            sent += batched;
+        }
+        else
+        {
+            status = SendPacket(packets[sent]);
+            sent++;
+        }
+        if (status != SerialStatus::Ok)
+        {
+            return status;
+        }
+    }
+    return SerialStatus::Ok;
 }
 
-SerialStatus NonSecureSession::RecvFaPacket(FaPacket& packet)
+SerialStatus NonSecureSession::SendPacket(LargePacket& packet)
+{
+    auto status = SendPacketImpl(packet);
+    if (status != SerialStatus::Ok)
+    {
+        _is_open = false; // device and host may be out of sync
+    }
+    return status;
+}
+
+SerialStatus NonSecureSession::RecvPacket(LargePacket& packet)
 {
     auto status = RecvPacketImpl(packet);
     if (status != SerialStatus::Ok)
+    {
+        _is_open = false; // device and host may be out of sync
+    }
+    return status;
+}
+
+size_t NonSecureSession::LargePayloadSize() const
+{
+    return _is_open ? _large_payload_size : 0;
+}
+
+SerialStatus NonSecureSession::RecvFaPacket(FaPacket& packet)
+{
+    auto status = RecvPacket(packet);
+    if (status != SerialStatus::Ok)
     {
         return status;
     }
@@ -86,7 +213,7 @@ SerialStatus NonSecureSession::RecvFaPacket(FaPacket& packet)
 
 SerialStatus NonSecureSession::RecvDataPacket(DataPacket& packet)
 {
-    auto status = RecvPacketImpl(packet);
+    auto status = RecvPacket(packet);
     if (status != SerialStatus::Ok)
     {
         return status;
@@ -94,10 +221,12 @@ SerialStatus NonSecureSession::RecvDataPacket(DataPacket& packet)
     return IsDataPacket(packet) ? SerialStatus::Ok : SerialStatus::RecvUnexpectedPacket;
 }
 
-SerialStatus NonSecureSession::SendPacketImpl(SerialPacket& packet)
+template <typename Packet>
+SerialStatus NonSecureSession::SendPacketImpl(Packet& packet)
 {
     // increment and set sequence number in the packet
     packet.payload.sequence_number = ++_last_sent_seq_number;
+    _last_request = packet.header.id;
     assert(_serial != nullptr);
     PacketSender sender {_serial};
     return sender.SendBinary(packet);
@@ -109,7 +238,8 @@ static bool ValidateSeqNumber(uint32_t last_recv_number, uint32_t seq_number)
     return (last_recv_number < seq_number && seq_number <= last_recv_number + MAX_SEQ_NUMBER_DELTA);
 }
 
-SerialStatus NonSecureSession::RecvPacketImpl(SerialPacket& packet)
+template <typename Packet>
+SerialStatus NonSecureSession::RecvPacketImpl(Packet& packet)
 {
     assert(_serial != nullptr);
     PacketSender sender {_serial};
@@ -121,11 +251,19 @@ SerialStatus NonSecureSession::RecvPacketImpl(SerialPacket& packet)
         return status;
     }
 
-    status = sender.Recv(packet);
+    // send the cancel as soon as it is requested, also while waiting for the packet
+    sender.SetWaitHandler([this]() { return HandleCancelFlag(); });
+    Timer rtt_timer;
+    status = sender.Recv(packet, _rtt.Timeout(_last_request));
+    if (status == SerialStatus::RecvTimeout)
+    {
+        _rtt.OnTimeout(_last_request);
+    }
     if (status != SerialStatus::Ok)
     {
         return status;
     }
+    _rtt.OnReply(_last_request, rtt_timer.Elapsed());
 
     // validate sequence number
     auto current_seq = packet.payload.sequence_number;
@@ -142,6 +280,11 @@ void NonSecureSession::Cancel()
 {
     LOG_DEBUG(LOG_TAG, "Cancel requested.");
     _cancel_required = true;
+    SerialConnection* serial = _serial;
+    if (serial != nullptr)
+    {
+        serial->InterruptRecv(); // the receiving thread sends the cancel right away
+    }
 }
 
 SerialStatus NonSecureSession::HandleCancelFlag()
@@ -151,14 +294,15 @@ SerialStatus NonSecureSession::HandleCancelFlag()
         return SerialStatus::Ok;
     }
     _cancel_required = false;
-    if (!_serial)
+    SerialConnection* serial = _serial;
+    if (serial == nullptr)
     {
         LOG_WARNING(LOG_TAG, "Cannot send cancel, no serial connection");
         return SerialStatus::SendFailed;
     }
 
     LOG_DEBUG(LOG_TAG, "Sending cancel..");
-    return _serial->SendBytes(Commands::face_cancel, ::strlen(Commands::face_cancel));
+    return serial->SendBytes(Commands::face_cancel, ::strlen(Commands::face_cancel));
 }
 } // namespace PacketManager
 } // namespace RealSenseID
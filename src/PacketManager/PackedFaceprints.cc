@@ -0,0 +1,318 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "PackedFaceprints.h"
+#include <cstdint>
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+static constexpr size_t FeatureCount = NUM_OF_RECOGNITION_FEATURES;
+static constexpr size_t ExtraCount = FEATURES_VECTOR_ALLOC_SIZE - NUM_OF_RECOGNITION_FEATURES;
+static constexpr int FeatureBits = 11;
+static constexpr int FeatureOffset = 1023;
+static constexpr int MaxDeltaBits = 12; // zigzag of a difference in [-2046,2046]
+static constexpr uint8_t ReservedFlag = 0x01;
+static constexpr uint8_t PlainMode = 0;
+
+static constexpr size_t PlainSize = (FeatureCount * FeatureBits + 7) / 8 + 2 * ExtraCount;
+
+static_assert(MaxPackedFaceprintsSize == 1 + sizeof(Faceprints::reserved) + 10 + 3 * PlainSize + 2,
+              "max packed faceprints size mismatch");
+
+class Writer
+{
+public:
+    explicit Writer(unsigned char* dst) : _dst(dst)
+    {
+    }
+
+    void Bytes(uint32_t value, int count)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            *_dst++ = static_cast<unsigned char>(value >> (8 * i));
+        }
+    }
+
+    // bit fields, lsb first. Flush() after the last one
+    void Bits(uint32_t value, int bits)
+    {
+        _acc |= value << _bits;
+        _bits += bits;
+        while (_bits >= 8)
+        {
+            *_dst++ = static_cast<unsigned char>(_acc);
+            _acc >>= 8;
+            _bits -= 8;
+        }
+    }
+
+    void Flush()
+    {
+        if (_bits > 0)
+        {
+            *_dst++ = static_cast<unsigned char>(_acc);
+        }
+        _acc = 0;
+        _bits = 0;
+    }
+
+    unsigned char* Position() const
+    {
+        return _dst;
+    }
+
+private:
+    unsigned char* _dst;
+    uint32_t _acc = 0;
+    int _bits = 0;
+};
+
+class Reader
+{
+public:
+    Reader(const unsigned char* src, size_t size) : _src(src), _end(src + size)
+    {
+    }
+
+    uint32_t Bytes(int count)
+    {
+        if (_end - _src < count)
+        {
+            _ok = false;
+            return 0;
+        }
+        uint32_t value = 0;
+        for (int i = 0; i < count; i++)
+        {
+            value |= static_cast<uint32_t>(*_src++) << (8 * i);
+        }
+        return value;
+    }
+
+    // bit fields, lsb first. Align() after the last one
+    uint32_t Bits(int bits)
+    {
+        while (_bits < bits)
+        {
+            if (_src == _end)
+            {
+                _ok = false;
+                return 0;
+            }
+            _acc |= static_cast<uint32_t>(*_src++) << _bits;
+            _bits += 8;
+        }
+        uint32_t value = _acc & ((1u << bits) - 1);
+        _acc >>= bits;
+        _bits -= bits;
+        return value;
+    }
+
+    void Align()
+    {
+        _acc = 0;
+        _bits = 0;
+    }
+
+    void Fail()
+    {
+        _ok = false;
+    }
+
+    bool Ok() const
+    {
+        return _ok;
+    }
+
+    bool AtEnd() const
+    {
+        return _ok && _src == _end;
+    }
+
+private:
+    const unsigned char* _src;
+    const unsigned char* _end;
+    uint32_t _acc = 0;
+    int _bits = 0;
+    bool _ok = true;
+};
+
+static uint32_t ZigZag(int value)
+{
+    return value >= 0 ? static_cast<uint32_t>(value) << 1 : (static_cast<uint32_t>(-value) << 1) - 1;
+}
+
+static int UnZigZag(uint32_t value)
+{
+    return (value & 1) ? -static_cast<int>((value + 1) >> 1) : static_cast<int>(value >> 1);
+}
+
+static bool ValidFeatures(const feature_t* descriptor)
+{
+    for (size_t i = 0; i < FeatureCount; i++)
+    {
+        if (descriptor[i] < -FeatureOffset || descriptor[i] > FeatureOffset)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void WriteExtras(Writer& writer, const feature_t* descriptor)
+{
+    for (size_t i = FeatureCount; i < FEATURES_VECTOR_ALLOC_SIZE; i++)
+    {
+        writer.Bytes(static_cast<uint16_t>(descriptor[i]), 2);
+    }
+}
+
+static void ReadExtras(Reader& reader, feature_t* descriptor)
+{
+    for (size_t i = FeatureCount; i < FEATURES_VECTOR_ALLOC_SIZE; i++)
+    {
+        descriptor[i] = static_cast<feature_t>(reader.Bytes(2));
+    }
+}
+
+static void WritePlain(Writer& writer, const feature_t* descriptor)
+{
+    for (size_t i = 0; i < FeatureCount; i++)
+    {
+        writer.Bits(static_cast<uint32_t>(descriptor[i] + FeatureOffset), FeatureBits);
+    }
+    writer.Flush();
+    WriteExtras(writer, descriptor);
+}
+
+static void ReadFeature(Reader& reader, feature_t& feature, int value)
+{
+    if (value < -FeatureOffset || value > FeatureOffset)
+    {
+        reader.Fail();
+    }
+    feature = static_cast<feature_t>(value);
+}
+
+static void ReadPlain(Reader& reader, feature_t* descriptor)
+{
+    for (size_t i = 0; i < FeatureCount; i++)
+    {
+        ReadFeature(reader, descriptor[i], static_cast<int>(reader.Bits(FeatureBits)) - FeatureOffset);
+    }
+    reader.Align();
+    ReadExtras(reader, descriptor);
+}
+
+// the smaller of the plain and the delta coding
+static void WriteAdaptive(Writer& writer, const feature_t* descriptor, const feature_t* enrollment)
+{
+    uint32_t all_bits = 0;
+    for (size_t i = 0; i < FeatureCount; i++)
+    {
+        all_bits |= ZigZag(descriptor[i] - enrollment[i]);
+    }
+    int delta_bits = 0;
+    while (all_bits >> delta_bits)
+    {
+        delta_bits++;
+    }
+
+    if (delta_bits >= FeatureBits)
+    {
+        writer.Bytes(PlainMode, 1);
+        WritePlain(writer, descriptor);
+        return;
+    }
+    writer.Bytes(static_cast<uint32_t>(1 + delta_bits), 1);
+    if (delta_bits > 0)
+    {
+        for (size_t i = 0; i < FeatureCount; i++)
+        {
+            writer.Bits(ZigZag(descriptor[i] - enrollment[i]), delta_bits);
+        }
+        writer.Flush();
+    }
+    WriteExtras(writer, descriptor);
+}
+
+static void ReadAdaptive(Reader& reader, feature_t* descriptor, const feature_t* enrollment)
+{
+    const uint32_t mode = reader.Bytes(1);
+    if (mode == PlainMode)
+    {
+        ReadPlain(reader, descriptor);
+        return;
+    }
+    const int delta_bits = static_cast<int>(mode) - 1;
+    if (delta_bits > MaxDeltaBits)
+    {
+        reader.Fail();
+        return;
+    }
+    for (size_t i = 0; i < FeatureCount; i++)
+    {
+        int delta = delta_bits > 0 ? UnZigZag(reader.Bits(delta_bits)) : 0;
+        ReadFeature(reader, descriptor[i], enrollment[i] + delta);
+    }
+    reader.Align();
+    ReadExtras(reader, descriptor);
+}
+
+size_t PackFaceprints(const Faceprints& faceprints, unsigned char* dst)
+{
+    if (!ValidFeatures(faceprints.enrollmentDescriptor) || !ValidFeatures(faceprints.adaptiveDescriptorWithoutMask) ||
+        !ValidFeatures(faceprints.adaptiveDescriptorWithMask))
+    {
+        return 0;
+    }
+
+    bool has_reserved = false;
+    for (int reserved : faceprints.reserved)
+    {
+        has_reserved = has_reserved || reserved != 0;
+    }
+
+    Writer writer {dst};
+    writer.Bytes(has_reserved ? ReservedFlag : 0, 1);
+    if (has_reserved)
+    {
+        for (int reserved : faceprints.reserved)
+        {
+            writer.Bytes(static_cast<uint32_t>(reserved), 4);
+        }
+    }
+    writer.Bytes(static_cast<uint32_t>(faceprints.version), 4);
+    writer.Bytes(static_cast<uint16_t>(faceprints.featuresType), 2);
+    writer.Bytes(static_cast<uint32_t>(faceprints.flags), 4);
+    WritePlain(writer, faceprints.enrollmentDescriptor);
+    WriteAdaptive(writer, faceprints.adaptiveDescriptorWithoutMask, faceprints.enrollmentDescriptor);
+    WriteAdaptive(writer, faceprints.adaptiveDescriptorWithMask, faceprints.enrollmentDescriptor);
+    return static_cast<size_t>(writer.Position() - dst);
+}
+
+bool UnpackFaceprints(const unsigned char* src, size_t size, Faceprints& faceprints)
+{
+    Reader reader {src, size};
+    const uint32_t encoding = reader.Bytes(1);
+    if (encoding & ~static_cast<uint32_t>(ReservedFlag))
+    {
+        return false; // a newer encoding
+    }
+    for (int& reserved : faceprints.reserved)
+    {
+        reserved = (encoding & ReservedFlag) ? static_cast<int>(reader.Bytes(4)) : 0;
+    }
+    faceprints.version = static_cast<int>(reader.Bytes(4));
+    faceprints.featuresType = static_cast<FaceprintsTypeEnum>(reader.Bytes(2));
+    faceprints.flags = static_cast<int>(reader.Bytes(4));
+    ReadPlain(reader, faceprints.enrollmentDescriptor);
+    ReadAdaptive(reader, faceprints.adaptiveDescriptorWithoutMask, faceprints.enrollmentDescriptor);
+    ReadAdaptive(reader, faceprints.adaptiveDescriptorWithMask, faceprints.enrollmentDescriptor);
+    return reader.AtEnd();
+}
+} // namespace PacketManager
+} // namespace RealSenseID
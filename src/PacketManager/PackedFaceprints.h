@@ -0,0 +1,38 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/Faceprints.h"
+#include <cstddef>
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+// Compact faceprints of the SetUserFeaturesPacked / GetUserFeaturesPacked messages, instead of the descriptor struct
+// of SetUserFeatures / GetUserFeatures (little endian):
+//
+//   encoding (u8)   - bit 0: the reserved words follow (they are all zeros otherwise)
+//   reserved        - 5 x i32, only with encoding bit 0
+//   version (i32), features type (u16), flags (i32)
+//   enrollment      - plain descriptor
+//   adaptive without mask, adaptive with mask - each a mode (u8) and:
+//     mode 0        plain descriptor
+//     mode 1 + w    the 256 features as differences from the enrollment's, zigzag coded in w bits (w <= 12),
+//                   then the 3 extra elements (i16 each). w is 0 when they equal the enrollment's.
+//
+//   plain descriptor - the 256 features offset by 1023 to 11 bits, then the 3 extra elements (i16 each)
+//
+// Bit fields are packed lsb first. A fresh enrollment (adaptive descriptors equal to the enrollment) packs to 383
+// bytes and any descriptor to at most 1107, instead of the 1588 of the struct.
+static constexpr size_t MaxPackedFaceprintsSize = 1 + 20 + 10 + 358 + 2 * (1 + 358);
+
+// pack to dst (at least MaxPackedFaceprintsSize bytes). returns the packed size, 0 if a feature is out of the valid
+// range [-1023,1023].
+size_t PackFaceprints(const Faceprints& faceprints, unsigned char* dst);
+
+// returns false if the packed faceprints are malformed (faceprints is then partly written)
+bool UnpackFaceprints(const unsigned char* src, size_t size, Faceprints& faceprints);
+} // namespace PacketManager
+} // namespace RealSenseID
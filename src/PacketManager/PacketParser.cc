@@ -0,0 +1,181 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "PacketParser.h"
+#include "PacketSender.h"
+#include "Logger.h"
+#include <string.h>
+#include <cstddef>
+#include <utility>
+
+static const char* LOG_TAG = "PacketParser";
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+PacketParser::PacketParser(PacketCallback callback) : _callback {std::move(callback)}
+{
+}
+
+void PacketParser::SetLargePacketCallback(LargePacketCallback callback)
+{
+    _large_callback = std::move(callback);
+    if (_large_callback && !_large_packet)
+    {
+        _large_packet.reset(new LargePacket);
+    }
+}
+
+void PacketParser::Reset()
+{
+    _state = State::Sync1;
+    _received = 0;
+}
+
+// copy up to the missing bytes of the current part and return the number of bytes consumed
+size_t PacketParser::FeedPart(char* part, size_t part_size, const char* data, size_t n_bytes)
+{
+    size_t missing = part_size - _received;
+    size_t n_copy = n_bytes < missing ? n_bytes : missing;
+    ::memcpy(part + _received, data, n_copy);
+    _received += n_copy;
+    return n_copy;
+}
+
+void PacketParser::Feed(const char* data, size_t n_bytes)
+{
+    auto* header_ptr = reinterpret_cast<char*>(&_packet.header);
+    constexpr size_t trailer_size = sizeof(_packet.hmac) + sizeof(_packet.crc);
+    static_assert(offsetof(SerialPacket, crc) == offsetof(SerialPacket, hmac) + sizeof(_packet.hmac),
+                  "unexpected packet layout");
+    static_assert(offsetof(LargePacket, crc) == offsetof(LargePacket, hmac) + sizeof(_packet.hmac),
+                  "unexpected packet layout");
+
+    while (n_bytes > 0)
+    {
+        size_t consumed = 0;
+        switch (_state)
+        {
+        case State::Sync1: {
+            auto* found = static_cast<const char*>(::memchr(data, static_cast<char>(SyncByte::Sync1), n_bytes));
+            if (found == nullptr)
+            {
+                return;
+            }
+            consumed = static_cast<size_t>(found - data) + 1;
+            _state = State::Sync2;
+            break;
+        }
+
+        case State::Sync2:
+            consumed = 1;
+            if (*data == static_cast<char>(SyncByte::Sync2))
+            {
+                ::memset(reinterpret_cast<char*>(&_packet), 0, sizeof(_packet)); // unused payload must be zeros (crc)
+                _packet.header.sync1 = SyncByte::Sync1;
+                _packet.header.sync2 = SyncByte::Sync2;
+                _state = State::Version;
+            }
+            else
+            {
+                _state = *data == static_cast<char>(SyncByte::Sync1) ? State::Sync2 : State::Sync1;
+            }
+            break;
+
+        case State::Version:
+            // validated before the rest of the header, so text that happens to contain the sync bytes costs 3 bytes
+            consumed = 1;
+            _packet.header.protocol_ver = static_cast<unsigned char>(*data);
+            _large = _packet.header.protocol_ver == LargeProtocolVer && _large_callback;
+            if (_packet.header.protocol_ver != ProtocolVer && !_large)
+            {
+                LOG_ERROR(LOG_TAG, "Protocol version doesn't match. Expected: %u, Received: %u", ProtocolVer,
+                          _packet.header.protocol_ver);
+                _state = State::Sync1;
+                _callback(SerialStatus::VersionMismatch, _packet);
+                break;
+            }
+            _received = 3;
+            _state = State::Header;
+            break;
+
+        case State::Header:
+            consumed = FeedPart(header_ptr, sizeof(_packet.header), data, n_bytes);
+            if (_received == sizeof(_packet.header))
+            {
+                OnHeader();
+            }
+            break;
+
+        case State::Payload: {
+            auto* payload_ptr =
+                _large ? reinterpret_cast<char*>(&_large_packet->payload) : reinterpret_cast<char*>(&_packet.payload);
+            consumed = FeedPart(payload_ptr, _packet.header.payload_size, data, n_bytes);
+            if (_received == _packet.header.payload_size)
+            {
+                _received = 0;
+                _state = State::Trailer;
+            }
+            break;
+        }
+
+        case State::Trailer:
+            consumed = FeedPart(_large ? _large_packet->hmac : _packet.hmac, trailer_size, data, n_bytes);
+            if (_received == trailer_size)
+            {
+                OnTrailer();
+            }
+            break;
+        }
+        data += consumed;
+        n_bytes -= consumed;
+    }
+}
+
+void PacketParser::OnHeader()
+{
+    _received = 0;
+    if (_packet.header.payload_size > (_large ? sizeof(LargePacket::payload) : sizeof(SerialPacket::payload)))
+    {
+        LOG_ERROR(LOG_TAG, "Packet size is bigger than payload max size");
+        _state = State::Sync1;
+        _callback(SerialStatus::RecvFailed, _packet);
+        return;
+    }
+    if (_large)
+    {
+        _large_packet->header = _packet.header;
+    }
+    _state = _packet.header.payload_size > 0 ? State::Payload : State::Trailer;
+}
+
+void PacketParser::OnTrailer()
+{
+    _received = 0;
+    _state = State::Sync1;
+    if (_large)
+    {
+        auto expected_crc = PacketSender::CalcCrc(*_large_packet);
+        if (expected_crc != _large_packet->crc)
+        {
+            LOG_ERROR(LOG_TAG, "Got invalid crc. Expected: %u. Actual: %u", expected_crc, _large_packet->crc);
+            _large_callback(SerialStatus::CrcError, *_large_packet);
+            return;
+        }
+        LOG_DEBUG(LOG_TAG, "Received large packet '%c'", _large_packet->header.id);
+        _large_callback(SerialStatus::Ok, *_large_packet);
+        return;
+    }
+    auto expected_crc = PacketSender::CalcCrc(_packet);
+    if (expected_crc != _packet.crc)
+    {
+        LOG_ERROR(LOG_TAG, "Got invalid crc. Expected: %u. Actual: %u", expected_crc, _packet.crc);
+        _callback(SerialStatus::CrcError, _packet);
+        return;
+    }
+    LOG_DEBUG(LOG_TAG, "Received packet '%c'", _packet.header.id);
+    _callback(SerialStatus::Ok, _packet);
+}
+} // namespace PacketManager
+} // namespace RealSenseID
@@ -0,0 +1,60 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "SerialPacket.h"
+#include "LargePacket.h"
+#include "CommonTypes.h"
+#include <functional>
+#include <memory>
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+// Incremental serial packet parser.
+// Feed() it the bytes as they arrive (in chunks of any size) and it calls the callback for each complete packet,
+// with SerialStatus::Ok and the packet if valid, or with the error (VersionMismatch, RecvFailed, CrcError) if not.
+// Bytes outside packets (e.g. text output of the device) are skipped while looking for the sync bytes.
+// The same validations as PacketSender::Recv() are done.
+// Large packets (see LargePacket.h) are parsed if a large packet callback is set, and are a version mismatch otherwise.
+class PacketParser
+{
+public:
+    using PacketCallback = std::function<void(SerialStatus status, const SerialPacket& packet)>;
+    using LargePacketCallback = std::function<void(SerialStatus status, const LargePacket& packet)>;
+
+    explicit PacketParser(PacketCallback callback);
+
+    // called for each large packet instead of the packet callback
+    void SetLargePacketCallback(LargePacketCallback callback);
+
+    void Feed(const char* data, size_t n_bytes);
+    void Reset();
+
+private:
+    enum class State
+    {
+        Sync1,
+        Sync2,
+        Version,
+        Header,
+        Payload,
+        Trailer // hmac + crc
+    };
+
+    PacketCallback _callback;
+    LargePacketCallback _large_callback;
+    State _state = State::Sync1;
+    SerialPacket _packet;
+    std::unique_ptr<LargePacket> _large_packet; // allocated with the large packet callback
+    bool _large = false;                        // the current packet is a large one
+    size_t _received = 0; // bytes received of the current state's part
+
+    size_t FeedPart(char* part, size_t part_size, const char* data, size_t n_bytes);
+    void OnHeader();
+    void OnTrailer();
+};
+} // namespace PacketManager
+} // namespace RealSenseID
@@ -5,11 +5,17 @@
 #include "SerialConnection.h"
 #include "Timer.h"
 #include "Logger.h"
+#include "Tracer.h"
+#include "MetricsRegistry.h"
 #include "Crc16.h"
 #include <string.h>
+#include <algorithm>
 #include <cstdint>
 #include <stdexcept>
 #include <cassert>
+#include <cstddef>
+#include <utility>
+#include <chrono>
 
 const char* LOG_TAG = "PacketSender";
 
@@ -31,59 +37,166 @@ PacketSender::PacketSender(SerialConnection* serial_iface) : _serial {serial_ifa
     }
 }
 
+void PacketSender::SetWaitHandler(WaitHandler handler)
+{
+    _wait_handler = std::move(handler);
+}
+
 SerialStatus PacketSender::Send(SerialPacket& packet)
 {
+    return SendFrame(nullptr, 0, packet);
+}
+
+SerialStatus PacketSender::SendBinary(SerialPacket& packet)
+{
+    // __FACE_API__ command is sent in the same write as the packet
+    return SendFrame(Commands::face_api, ::strlen(Commands::face_api), packet);
+}
+
+SerialStatus PacketSender::Send(LargePacket& packet)
+{
+    return SendFrame(nullptr, 0, packet);
+}
+
+SerialStatus PacketSender::SendBinary(LargePacket& packet)
+{
+    return SendFrame(Commands::face_api, ::strlen(Commands::face_api), packet);
+}
+
+// assemble prefix + headers + payload + hmac + crc and send them with a single SendBytes() call
+SerialStatus PacketSender::SendFrame(const char* prefix, size_t prefix_size, SerialPacket& packet)
+{
+    RSID_TRACE_SPAN("serial", "SendPacket", static_cast<char>(packet.header.id));
     LOG_DEBUG(LOG_TAG, "Sending packet '%c'", packet.header.id);
 
-    // send the headers + payload
-    auto* packet_ptr = reinterpret_cast<const char*>(&packet);
-    auto packet_size = sizeof(packet.header) + packet.header.payload_size;
-    auto status = _serial->SendBytes(packet_ptr, packet_size);
-    if (status != SerialStatus::Ok)
+    constexpr size_t max_prefix_size = 32;
+    char frame[max_prefix_size + sizeof(SerialPacket)];
+    if (prefix_size > max_prefix_size || packet.header.payload_size > sizeof(packet.payload))
     {
-        return status;
+        LOG_ERROR(LOG_TAG, "Invalid packet frame size");
+        return SerialStatus::SendFailed;
     }
 
-    // send the hmac
-    status = _serial->SendBytes(packet.hmac, sizeof(packet.hmac));
-    if (status != SerialStatus::Ok)
+    size_t frame_size = 0;
+    if (prefix != nullptr)
     {
-        return status;
+        ::memcpy(frame, prefix, prefix_size);
+        frame_size += prefix_size;
     }
 
-    // send crc
+    // headers + payload
+    auto packet_size = sizeof(packet.header) + packet.header.payload_size;
+    ::memcpy(frame + frame_size, reinterpret_cast<const char*>(&packet), packet_size);
+    frame_size += packet_size;
+
+    // hmac
+    ::memcpy(frame + frame_size, packet.hmac, sizeof(packet.hmac));
+    frame_size += sizeof(packet.hmac);
+
+    // crc
     auto crc = CalcCrc(packet);
-    status = _serial->SendBytes(reinterpret_cast<const char*>(&crc), sizeof(crc));
+    ::memcpy(frame + frame_size, &crc, sizeof(crc));
+    frame_size += sizeof(crc);
+
+    auto send_start = std::chrono::steady_clock::now();
+    auto status = _serial->SendBytes(frame, frame_size);
+    if (status != SerialStatus::Ok)
+    {
+        LOG_ERROR(LOG_TAG, "Failed sending packet '%c'", packet.header.id);
+        return status;
+    }
+    MetricsRegistry::OnSerialTransfer(MetricsRegistry::ElapsedMicros(send_start));
+    MetricsRegistry::OnPacketSent(static_cast<char>(packet.header.id));
     return status;
 }
 
-SerialStatus PacketSender::SendBinary(SerialPacket& packet)
+// too large for a frame on the stack: the prefix and the headers + payload are one write (the payload is sent from the
+// packet) and the hmac + crc another. a write takes far less than the transfer of the payload.
+SerialStatus PacketSender::SendFrame(const char* prefix, size_t prefix_size, LargePacket& packet)
 {
-    // send __FACE_API__ command
-    auto face_api_len = ::strlen(Commands::face_api);
-    auto status = _serial->SendBytes(Commands::face_api, face_api_len);
+    RSID_TRACE_SPAN("serial", "SendLargePacket", static_cast<char>(packet.header.id));
+    LOG_DEBUG(LOG_TAG, "Sending large packet '%c' (%u bytes)", packet.header.id, packet.header.payload_size);
+    if (packet.header.payload_size > sizeof(packet.payload))
+    {
+        LOG_ERROR(LOG_TAG, "Invalid packet frame size");
+        return SerialStatus::SendFailed;
+    }
+
+    auto send_start = std::chrono::steady_clock::now();
+    auto status = SerialStatus::Ok;
+    if (prefix != nullptr)
+    {
+        status = _serial->SendBytes(prefix, prefix_size);
+    }
+    if (status == SerialStatus::Ok)
+    {
+        status = _serial->SendBytes(reinterpret_cast<const char*>(&packet),
+                                    sizeof(packet.header) + packet.header.payload_size);
+    }
+    if (status == SerialStatus::Ok)
+    {
+        char trailer[sizeof(packet.hmac) + sizeof(packet.crc)];
+        ::memcpy(trailer, packet.hmac, sizeof(packet.hmac));
+        auto crc = CalcCrc(packet);
+        ::memcpy(trailer + sizeof(packet.hmac), &crc, sizeof(crc));
+        status = _serial->SendBytes(trailer, sizeof(trailer));
+    }
     if (status != SerialStatus::Ok)
     {
-        LOG_ERROR(LOG_TAG, "Failed sending face entry command");
+        LOG_ERROR(LOG_TAG, "Failed sending packet '%c'", packet.header.id);
         return status;
     }
-
-    return Send(packet);
+    MetricsRegistry::OnSerialTransfer(MetricsRegistry::ElapsedMicros(send_start));
+    MetricsRegistry::OnPacketSent(static_cast<char>(packet.header.id));
+    return status;
 }
 
 // keep trying getting the packet until timeout
 SerialStatus PacketSender::Recv(SerialPacket& target)
 {
+    return Recv(target, recv_packet_timeout);
+}
+
+timeout_t PacketSender::DefaultRecvTimeout()
+{
+    return recv_packet_timeout;
+}
+
+// versions and largest payload of the packets received into a packet type
+static bool AcceptsVersion(const SerialPacket&, unsigned char version)
+{
+    return version == ProtocolVer;
+}
+
+static bool AcceptsVersion(const LargePacket&, unsigned char version)
+{
+    return version == ProtocolVer || version == LargeProtocolVer;
+}
+
+static size_t MaxPayloadSize(unsigned char version)
+{
+    return version == LargeProtocolVer ? sizeof(LargePacket::payload) : sizeof(SerialPacket::payload);
+}
+
+template <typename Packet>
+SerialStatus PacketSender::RecvFrame(Packet& target, timeout_t timeout)
+{
+    RSID_TRACE_SPAN_VAR(span, "serial", "RecvPacket");
     LOG_DEBUG(LOG_TAG, "Waiting packet..");
 
-    Timer timer {recv_packet_timeout};
-    // reset the target packet with zeros
-    ::memset(reinterpret_cast<char*>(&target), 0, sizeof(target));
+    Timer timer {timeout};
 
-    // wait for sync bytes up to timeout
-    auto status = WaitSyncBytes(target, &timer);
+    // wait for sync bytes up to timeout. the wait is the device's processing time, the rest is the transfer
+    auto wait_start = std::chrono::steady_clock::now();
+    auto status = WaitSyncBytes(target.header, &timer);
+    MetricsRegistry::OnSerialWait(MetricsRegistry::ElapsedMicros(wait_start));
+    auto transfer_start = std::chrono::steady_clock::now();
     if (status != SerialStatus::Ok)
     {
+        if (status == SerialStatus::RecvTimeout)
+        {
+            MetricsRegistry::OnTimeout();
+        }
         return status;
     }
 
@@ -94,7 +207,7 @@ SerialStatus PacketSender::Recv(SerialPacket& target)
         LOG_ERROR(LOG_TAG, "Failed to recv protocol version byte");
         return status;
     }
-    if (target.header.protocol_ver != ProtocolVer)
+    if (!AcceptsVersion(target, target.header.protocol_ver))
     {
         LOG_ERROR(LOG_TAG, "Protocol version doesn't match. Expected: %u, Received: %u", ProtocolVer,
                   target.header.protocol_ver);
@@ -111,14 +224,22 @@ SerialStatus PacketSender::Recv(SerialPacket& target)
         return status;
     }
 
-    if (target.header.payload_size > sizeof(SerialPacket::payload))
+    const size_t max_payload_size = MaxPayloadSize(target.header.protocol_ver);
+    if (target.header.payload_size > max_payload_size)
     {
         LOG_ERROR(LOG_TAG, "Packet size is bigger than payload max size");
         return SerialStatus::RecvFailed;
     }
 
-    // recv packet payload
+    // every other field is overwritten by the received bytes. only the payload beyond payload_size is zeroed (that of
+    // a regular packet: a large one is read up to its size)
     target_ptr = reinterpret_cast<char*>(&target.payload);
+    if (target.header.protocol_ver == ProtocolVer)
+    {
+        ::memset(target_ptr + target.header.payload_size, 0, max_payload_size - target.header.payload_size);
+    }
+
+    // recv packet payload
     status = _serial->RecvBytes(target_ptr, target.header.payload_size);
     if (status != SerialStatus::Ok)
     {
@@ -141,44 +262,105 @@ SerialStatus PacketSender::Recv(SerialPacket& target)
         LOG_ERROR(LOG_TAG, "Failed to recv packet crc (%zu bytes)", sizeof(target.crc));
         return status;
     }
+    MetricsRegistry::OnSerialTransfer(MetricsRegistry::ElapsedMicros(transfer_start));
 
     // validate crc
     auto expected_crc = CalcCrc(target);
     if (expected_crc != target.crc)
     {
         LOG_ERROR(LOG_TAG, "Got invalid crc. Expected: %u. Actual: %u", expected_crc, target.crc);
+        MetricsRegistry::OnCrcError();
         return SerialStatus::CrcError;
     }
 
+    span.SetMsgId(static_cast<char>(target.header.id));
+    MetricsRegistry::OnPacketReceived(static_cast<char>(target.header.id));
     LOG_DEBUG(LOG_TAG, "Received packet '%c' after %zu millis", target.header.id, timer.Elapsed());
     return SerialStatus::Ok;
 }
 
+SerialStatus PacketSender::Recv(SerialPacket& target, timeout_t timeout)
+{
+    return RecvFrame(target, timeout);
+}
+
+SerialStatus PacketSender::Recv(LargePacket& target, timeout_t timeout)
+{
+    return RecvFrame(target, timeout);
+}
+
 // wait for sync bytes and place them into target
-SerialStatus PacketSender::WaitSyncBytes(SerialPacket& target, Timer* timer)
+SerialStatus PacketSender::WaitSyncBytes(PacketHeader& target, Timer* timer)
 {
+    RSID_TRACE_SPAN("serial", "WaitSyncBytes");
     while (!timer->ReachedTimeout())
     {
-        auto status = _serial->RecvBytes(reinterpret_cast<char*>(&target.header.sync1), 1);
-        if (status == SerialStatus::Ok && target.header.sync1 == SyncByte::Sync1)
+        if (_wait_handler)
         {
+            auto status = _wait_handler();
+            if (status != SerialStatus::Ok)
+            {
+                return status;
+            }
+        }
+        auto status =
+            _serial->DiscardUntil(static_cast<char>(SyncByte::Sync1), std::max(timer->TimeLeft(), timeout_t {0}));
+        if (status == SerialStatus::Ok)
+        {
+            target.sync1 = SyncByte::Sync1;
             // wait for sync2
-            status = _serial->RecvBytes(reinterpret_cast<char*>(&target.header.sync2), 1);
-            if (status == SerialStatus::Ok && target.header.sync2 == SyncByte::Sync2)
+            status = _serial->RecvBytes(reinterpret_cast<char*>(&target.sync2), 1);
+            if (status == SerialStatus::Ok && target.sync2 == SyncByte::Sync2)
             {
                 return SerialStatus::Ok;
             }
+            if (status == SerialStatus::Ok)
+            {
+                MetricsRegistry::OnSyncRetry();
+            }
         }
     }
     return SerialStatus::RecvTimeout;
 }
 
+// crc of the header, the first payload_size bytes of the payload, padded_size - payload_size zeros and the hmac
+static uint16_t FrameCrc(const char* packet_ptr, size_t header_size, size_t payload_size, size_t padded_size,
+                         const char* hmac, size_t hmac_size)
+{
+    auto crc = Crc16(packet_ptr, header_size + payload_size);
+    crc = Crc16Zeros(crc, padded_size - payload_size);
+    return Crc16(crc, hmac, hmac_size);
+}
+
+// crc of the whole packet (without the crc field).
+// The payload bytes beyond payload_size are not transmitted and are zeros on both sides (packets are zeroed on
+// construction and before receive), so only the transmitted bytes are scanned and the unused payload is accounted for
+// with Crc16Zeros().
 uint16_t PacketSender::CalcCrc(const SerialPacket& packet)
 {
-    auto* packet_ptr = reinterpret_cast<const char*>(&packet);
-    auto crc = Crc16(packet_ptr, sizeof(packet) - sizeof(packet.crc));
-    static_assert(sizeof(packet.crc) == sizeof(crc), "packet.crc and crc size mismatch");
-    return crc;
+    static_assert(offsetof(SerialPacket, hmac) == sizeof(packet.header) + sizeof(packet.payload),
+                  "unexpected packet layout");
+    static_assert(offsetof(SerialPacket, crc) == offsetof(SerialPacket, hmac) + sizeof(packet.hmac),
+                  "unexpected packet layout");
+
+    size_t payload_size = packet.header.payload_size;
+    if (payload_size > sizeof(packet.payload))
+    {
+        payload_size = sizeof(packet.payload);
+    }
+    static_assert(sizeof(packet.crc) == sizeof(uint16_t), "packet.crc and crc size mismatch");
+    return FrameCrc(reinterpret_cast<const char*>(&packet), sizeof(packet.header), payload_size,
+                    sizeof(packet.payload), packet.hmac, sizeof(packet.hmac));
+}
+
+// crc of a large packet: the transmitted bytes only. A regular packet received into it has the crc of SerialPacket.
+uint16_t PacketSender::CalcCrc(const LargePacket& packet)
+{
+    const size_t max_payload_size = MaxPayloadSize(packet.header.protocol_ver);
+    const size_t payload_size = std::min<size_t>(packet.header.payload_size, max_payload_size);
+    const size_t padded_size = packet.header.protocol_ver == LargeProtocolVer ? payload_size : max_payload_size;
+    return FrameCrc(reinterpret_cast<const char*>(&packet), sizeof(packet.header), payload_size, padded_size,
+                    packet.hmac, sizeof(packet.hmac));
 }
 } // namespace PacketManager
 } // namespace RealSenseID
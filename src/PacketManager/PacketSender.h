@@ -4,7 +4,9 @@
 #pragma once
 
 #include "SerialPacket.h"
+#include "LargePacket.h"
 #include "CommonTypes.h"
+#include <functional>
 
 // packet sender for sending/receiving complete serial packets over the serial interface
 namespace RealSenseID
@@ -18,6 +20,10 @@ class PacketSender
 public:
     explicit PacketSender(SerialConnection* serializer);
 
+    // called by Recv() while waiting for the sync bytes (e.g. to send a pending cancel). non Ok status aborts Recv().
+    using WaitHandler = std::function<SerialStatus()>;
+    void SetWaitHandler(WaitHandler handler);
+
     // send packet and return Status::ok on success
     SerialStatus Send(SerialPacket& packet);
 
@@ -26,6 +32,10 @@ public:
     // return Status::ok if both sends were successfull
     SerialStatus SendBinary(SerialPacket& packet);
 
+    // send a large packet (see LargePacket.h)
+    SerialStatus Send(LargePacket& packet);
+    SerialStatus SendBinary(LargePacket& packet);
+
     // receive complete and valid packet (with valid crc)
     // return:
     // Status::Ok on success,
@@ -33,17 +43,34 @@ public:
     // Status::RecvFailed on other failures
     SerialStatus Recv(SerialPacket& target);
 
+    // receive with the given timeout instead of the default one
+    SerialStatus Recv(SerialPacket& target, timeout_t timeout);
+
+    // receive a large packet or a regular one (e.g. an error Reply), with the validations of Recv()
+    SerialStatus Recv(LargePacket& target, timeout_t timeout);
+
+    // timeout of Recv(target): the longest the device may take to start a reply
+    static timeout_t DefaultRecvTimeout();
+
     // Wait for sync bytes
     // return:
     // Status::Ok on success,
     // Status::RecvTimeout on timeout
     // Status::RecvFailed on other failures
-    SerialStatus WaitSyncBytes(SerialPacket& target, Timer* timeout);
+    SerialStatus WaitSyncBytes(PacketHeader& target, Timer* timeout);
 
-private:
+    // crc of the packet as sent on the wire (without the crc field)
     static uint16_t CalcCrc(const SerialPacket& packet);
+    static uint16_t CalcCrc(const LargePacket& packet);
+
+private:
+    SerialStatus SendFrame(const char* prefix, size_t prefix_size, SerialPacket& packet);
+    SerialStatus SendFrame(const char* prefix, size_t prefix_size, LargePacket& packet);
+    template <typename Packet>
+    SerialStatus RecvFrame(Packet& target, timeout_t timeout);
 
     SerialConnection* _serial;
+    WaitHandler _wait_handler;
 };
 } // namespace PacketManager
 } // namespace RealSenseID
@@ -2,10 +2,7 @@
 // Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
 
 #include "Randomizer.h"
-
-#include <limits.h>
-
-static std::uniform_int_distribution<> distrib(0, UCHAR_MAX);
+#include <cstdint>
 
 namespace RealSenseID
 {
@@ -17,13 +14,26 @@ Randomizer& Randomizer::Instance()
     return s_instance;
 }
 
+Randomizer::Randomizer()
+{
+    std::random_device random_device;
+    std::seed_seq seed {random_device(), random_device(), random_device(), random_device()};
+    _generator.seed(seed);
+}
+
 void Randomizer::GenerateRandom(unsigned char* outBuffer, size_t length)
 {
-    std::mt19937 gen(_random_device());
-    for (size_t i = 0; i < length; i++)
+    std::lock_guard<std::mutex> lock {_mutex};
+    // 4 bytes per draw
+    for (size_t i = 0; i < length; i += 4)
     {
-        outBuffer[i] = (unsigned char)(distrib(gen));
+        auto value = static_cast<uint32_t>(_generator());
+        for (size_t j = i; j < length && j < i + 4; j++)
+        {
+            outBuffer[j] = static_cast<unsigned char>(value);
+            value >>= 8;
+        }
     }
 }
 } // namespace PacketManager
-} // namespace RealSenseID
\ No newline at end of file
+} // namespace RealSenseID
@@ -3,12 +3,15 @@
 
 #pragma once
 
+#include <mutex>
 #include <random>
 
 namespace RealSenseID
 {
 namespace PacketManager
 {
+// Non cryptographic random bytes (e.g. ping data). The generator is seeded once from std::random_device.
+// The secure session's ivs come from MbedtlsWrapper::GenerateRandom() instead.
 class Randomizer
 {
 public:
@@ -16,8 +19,9 @@ public:
     static Randomizer& Instance();
 
 private:
-    Randomizer() = default;
-    std::random_device _random_device;
+    Randomizer();
+    std::mutex _mutex;
+    std::mt19937 _generator;
 };
 } // namespace PacketManager
-} // namespace RealSenseID
\ No newline at end of file
+} // namespace RealSenseID
@@ -0,0 +1,91 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "RttEstimator.h"
+#include "PacketSender.h"
+#include <algorithm>
+#include <cmath>
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+constexpr timeout_t RttEstimator::MinTimeout;
+
+static constexpr double RttGain = 1.0 / 8;
+static constexpr double RttVarGain = 1.0 / 4;
+static constexpr unsigned int MaxBackoff = 6;
+
+LatencyClass LatencyClassOf(MsgId request)
+{
+    switch (request)
+    {
+    case MsgId::Ping:
+    case MsgId::GetNumberOfUsers:
+    case MsgId::GetUserIds:
+    case MsgId::GetUserFeatures:
+    case MsgId::GetUserFeaturesPacked:
+    case MsgId::GetUsersChecksums:
+    case MsgId::QueryDeviceConfig:
+        return LatencyClass::Quick;
+    default:
+        return LatencyClass::Long;
+    }
+}
+
+size_t RttEstimator::IndexOf(MsgId request)
+{
+    return static_cast<unsigned char>(request) % 128;
+}
+
+timeout_t RttEstimator::Timeout(MsgId request) const
+{
+    const timeout_t max_timeout = PacketSender::DefaultRecvTimeout();
+    const Estimate& estimate = _estimates[IndexOf(request)];
+    if (!estimate.has_sample || LatencyClassOf(request) == LatencyClass::Long)
+    {
+        return max_timeout;
+    }
+    const double rto_ms = (estimate.srtt_ms + 4 * estimate.rttvar_ms) * static_cast<double>(1u << estimate.backoff);
+    const auto rto = timeout_t {static_cast<timeout_t::rep>(std::ceil(rto_ms))};
+    return std::min(std::max(rto, MinTimeout), max_timeout);
+}
+
+void RttEstimator::OnReply(MsgId request, timeout_t rtt)
+{
+    // the latency of long requests is the operation, not the connection
+    if (LatencyClassOf(request) == LatencyClass::Long)
+    {
+        return;
+    }
+    Estimate& estimate = _estimates[IndexOf(request)];
+    const double rtt_ms = static_cast<double>(rtt.count());
+    if (!estimate.has_sample)
+    {
+        estimate.srtt_ms = rtt_ms;
+        estimate.rttvar_ms = rtt_ms / 2;
+        estimate.has_sample = true;
+    }
+    else
+    {
+        estimate.rttvar_ms = (1 - RttVarGain) * estimate.rttvar_ms + RttVarGain * std::fabs(estimate.srtt_ms - rtt_ms);
+        estimate.srtt_ms = (1 - RttGain) * estimate.srtt_ms + RttGain * rtt_ms;
+    }
+    estimate.backoff = 0;
+}
+
+void RttEstimator::OnTimeout(MsgId request)
+{
+    Estimate& estimate = _estimates[IndexOf(request)];
+    if (estimate.has_sample && LatencyClassOf(request) == LatencyClass::Quick)
+    {
+        estimate.backoff = std::min(estimate.backoff + 1, MaxBackoff);
+    }
+}
+
+void RttEstimator::Reset()
+{
+    _estimates.fill(Estimate {});
+}
+} // namespace PacketManager
+} // namespace RealSenseID
@@ -0,0 +1,63 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "CommonTypes.h"
+#include "SerialPacket.h"
+#include <array>
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+// Expected device latency of a request.
+// Quick requests (queries of the device state and DB) are answered right away, and their reply timeout follows the
+// measured round trip time. Long requests (face operations, DB writes, session setup) keep the fixed timeout.
+enum class LatencyClass
+{
+    Quick,
+    Long
+};
+
+LatencyClass LatencyClassOf(MsgId request);
+
+// Round trip time estimates of a connection's quick requests and the receive timeouts derived from them, as TCP's
+// retransmission timeout (RFC 6298): smoothed rtt and rtt variance with gains 1/8 and 1/4, timeout = srtt + 4 * rttvar.
+// Each request has its own estimate, since the reply sizes and so the transfer times at low baud rates differ.
+// The timeout is clamped to [MinTimeout, default receive timeout] and doubles after each timeout until the next reply.
+// Until its first sample a request gets the default receive timeout.
+// Not thread safe, owned by the session.
+class RttEstimator
+{
+public:
+    static constexpr timeout_t MinTimeout {100};
+
+    // receive timeout of a reply (or the next packet of a reply) to the request
+    timeout_t Timeout(MsgId request) const;
+
+    // a reply to the request arrived after rtt
+    void OnReply(MsgId request, timeout_t rtt);
+
+    // no reply to the request within its timeout
+    void OnTimeout(MsgId request);
+
+    // forget the estimate (new connection)
+    void Reset();
+
+private:
+    struct Estimate
+    {
+        bool has_sample = false;
+        double srtt_ms = 0;
+        double rttvar_ms = 0;
+        unsigned int backoff = 0;
+    };
+
+    // by msg id ('A'-'Z', 'a'-'z')
+    std::array<Estimate, 128> _estimates;
+
+    static size_t IndexOf(MsgId request);
+};
+} // namespace PacketManager
+} // namespace RealSenseID
@@ -4,18 +4,26 @@
 #include "SecureSession.h"
 #include "PacketSender.h"
 #include "Logger.h"
-#include "Randomizer.h"
+#include "Tracer.h"
+#include "MetricsRegistry.h"
+#include <algorithm>
 #include <stdexcept>
 #include <string>
+#include <cstring>
 #include <cassert>
+#include <vector>
 
 static const char* LOG_TAG = "SecureSession";
 static const int MAX_SEQ_NUMBER_DELTA = 20;
+// renegotiate on Resume() once the sequence numbers pass this value
+static const uint32_t MAX_RESUME_SEQ_NUMBER = 0xFFFFFFFF - (1u << 20);
 
 namespace RealSenseID
 {
 namespace PacketManager
 {
+static_assert(SessionOptionsSignatureSize == ECC_P256_SIG_SIZE_BYTES, "session options are signed like the keys");
+
 SecureSession::SecureSession(SignCallback sign_callback, VerifyCallback verify_callback) :
     _sign_callback(sign_callback), _verify_callback(verify_callback)
 {
@@ -62,9 +70,17 @@ SerialStatus SecureSession::Unpair(SerialConnection* serial_conn)
     return PairImpl(serial_conn, (char*)hostPubKey, (char*)hostPubKeySig, devicePubKey);
 }
 
+void SecureSession::Prepare()
+{
+    _rtt.Reset(); // new connection
+    _crypto_wrapper.PrepareNextEcdhKey();
+}
+
 SerialStatus SecureSession::Start(SerialConnection* serial_conn)
 {
+    RSID_TRACE_SPAN("session", "StartSecureSession");
     LOG_DEBUG(LOG_TAG, "Start session");
+    MetricsRegistry::ScopedSessionStart session_start;
 
     _is_open = false;
     _cancel_required = false;
@@ -76,6 +92,9 @@ SerialStatus SecureSession::Start(SerialConnection* serial_conn)
     _serial = serial_conn;
     _last_sent_seq_number = 0;
     _last_recv_seq_number = 0;
+    _large_payload_size = 0;
+    _batches = false;
+    _recv_batch.Clear();
 
     // Generate ecdh keys and get public key with signature
     MbedtlsWrapper::SignCallback sign_clbk = [this](const unsigned char* buffer, const unsigned int buffer_len,
@@ -84,14 +103,33 @@ SerialStatus SecureSession::Start(SerialConnection* serial_conn)
     };
 
     // Generate and send our public key to device
-    unsigned char* signed_pubkey = _crypto_wrapper.GetSignedEcdhPubkey(sign_clbk);
+    unsigned char* signed_pubkey = nullptr;
+    {
+        RSID_TRACE_SPAN("session", "SignEcdhKey");
+        signed_pubkey = _crypto_wrapper.GetSignedEcdhPubkey(sign_clbk);
+    }
     if (!signed_pubkey)
     {
         LOG_ERROR(LOG_TAG, "Failed to generate signed ECDH public key");
         return SerialStatus::SecurityError;
     }
     auto signed_pubkey_size = _crypto_wrapper.GetSignedEcdhPubkeySize();
-    DataPacket packet {MsgId::HostEcdhKey, (char*)signed_pubkey, signed_pubkey_size};
+    // the session options follow the signed key, with their signature (see SessionOptions.h)
+    char key_data[sizeof(DataMessage::data)];
+    size_t key_data_size = signed_pubkey_size;
+    ::memcpy(key_data, signed_pubkey, signed_pubkey_size);
+    if (!_start_options.IsDefault())
+    {
+        auto* options = reinterpret_cast<unsigned char*>(key_data) + signed_pubkey_size;
+        WriteSessionOptions(_start_options, options);
+        if (!SignOptions(signed_pubkey, options, options + SessionOptionsSize))
+        {
+            LOG_ERROR(LOG_TAG, "Failed to sign the session options");
+            return SerialStatus::SecurityError;
+        }
+        key_data_size += SessionOptionsSize + SessionOptionsSignatureSize;
+    }
+    DataPacket packet {MsgId::HostEcdhKey, key_data, key_data_size};
 
     PacketSender sender {_serial};
     auto status = sender.SendBinary(packet);
@@ -111,6 +149,8 @@ SerialStatus SecureSession::Start(SerialConnection* serial_conn)
     if (packet.header.id != MsgId::DeviceEcdhKey)
     {
         LOG_ERROR(LOG_TAG, "Mutual authentication failed");
+        _crypto_wrapper.ClearSignedEcdhPubkey(); // sign a new key next time
+        _signed_options.clear();
         return SerialStatus::SecurityError;
     }
 
@@ -123,16 +163,93 @@ SerialStatus SecureSession::Start(SerialConnection* serial_conn)
     };
 
     auto* data_to_verify = reinterpret_cast<const unsigned char*>(packet.Data().data);
+    RSID_TRACE_SPAN("session", "VerifyEcdhKey");
     if (!_crypto_wrapper.VerifyEcdhSignedKey(data_to_verify, verify_clbk))
     {
         LOG_ERROR(LOG_TAG, "Verify key callback failed");
         return SerialStatus::SecurityError;
     }
 
+    // the options the device applies follow its signed key, if it has them, with their signature
+    const size_t reply_size = packet.header.payload_size > sizeof(packet.payload.sequence_number)
+                                  ? packet.header.payload_size - sizeof(packet.payload.sequence_number)
+                                  : 0;
+    const size_t data_size = std::min(reply_size, sizeof(packet.Data().data));
+    const auto* reply_options = data_to_verify + signed_pubkey_size;
+    const size_t options_size = data_size > signed_pubkey_size ? data_size - signed_pubkey_size : 0;
+    SessionOptions applied;
+    if (ReadSessionOptions(reply_options, options_size, applied))
+    {
+        if (options_size < SessionOptionsSize + SessionOptionsSignatureSize ||
+            !_verify_callback(SignedOptionsData(data_to_verify, reply_options).data(),
+                              static_cast<unsigned int>(ECC_P256_KEY_SIZE_BYTES + SessionOptionsSize),
+                              reply_options + SessionOptionsSize, SessionOptionsSignatureSize))
+        {
+            LOG_ERROR(LOG_TAG, "Failed to verify the device session options");
+            return SerialStatus::SecurityError;
+        }
+        _large_payload_size = AcceptedLargePayload(_start_options, reply_options, SessionOptionsSize);
+        _batches = AcceptedBatches(_start_options, reply_options, SessionOptionsSize);
+    }
+
     _is_open = true;
     return SerialStatus::Ok;
 }
 
+// the signed data of session options: the ecdh public key they follow, then the options
+std::vector<unsigned char> SecureSession::SignedOptionsData(const unsigned char* pubkey, const unsigned char* options)
+{
+    std::vector<unsigned char> data(ECC_P256_KEY_SIZE_BYTES + SessionOptionsSize);
+    ::memcpy(data.data(), pubkey, ECC_P256_KEY_SIZE_BYTES);
+    ::memcpy(data.data() + ECC_P256_KEY_SIZE_BYTES, options, SessionOptionsSize);
+    return data;
+}
+
+// the signature is reused while the key and the options are the same, as the signed key is (see MbedtlsWrapper.h)
+bool SecureSession::SignOptions(const unsigned char* pubkey, const unsigned char* options, unsigned char* out_sig)
+{
+    auto data = SignedOptionsData(pubkey, options);
+    if (data != _signed_options)
+    {
+        _signed_options.clear();
+        if (!_sign_callback(data.data(), static_cast<unsigned int>(data.size()), _options_signature))
+        {
+            return false;
+        }
+        _signed_options = std::move(data);
+    }
+    ::memcpy(out_sig, _options_signature, SessionOptionsSignatureSize);
+    return true;
+}
+
+SerialStatus SecureSession::Resume(SerialConnection* serial_conn)
+{
+    if (!_is_open || _serial != serial_conn || _last_sent_seq_number > MAX_RESUME_SEQ_NUMBER ||
+        _last_recv_seq_number > MAX_RESUME_SEQ_NUMBER)
+    {
+        return Start(serial_conn);
+    }
+    LOG_DEBUG(LOG_TAG, "Resume session");
+    _cancel_required = false;
+    _recv_batch.Clear(); // messages left of the previous operation's batch
+    return SerialStatus::Ok;
+}
+
+void SecureSession::Close()
+{
+    _is_open = false;
+}
+
+void SecureSession::SetStartOptions(const SessionOptions& options)
+{
+    _start_options = options;
+}
+
+const SessionOptions& SecureSession::StartOptions() const
+{
+    return _start_options;
+}
+
 bool SecureSession::IsOpen()
 {
     return _is_open;
@@ -141,7 +258,12 @@ bool SecureSession::IsOpen()
 // Encrypt and send packet to the serial connection
 SerialStatus SecureSession::SendPacket(SerialPacket& packet)
 {
-    return SendPacketImpl(packet);
+    auto status = SendPacketImpl(packet);
+    if (status != SerialStatus::Ok)
+    {
+        _is_open = false; // device and host may be out of sync
+    }
+    return status;
 }
 
 // Wait for any packet until timeout.
@@ -149,13 +271,78 @@ SerialStatus SecureSession::SendPacket(SerialPacket& packet)
 // Fill the given packet with the decrypted received packet packet.
 SerialStatus SecureSession::RecvPacket(SerialPacket& packet)
 {
-    return RecvPacketImpl(packet);
+    if (_recv_batch.Next(packet))
+    {
+        return SerialStatus::Ok;
+    }
+    auto status = RecvPacketImpl(packet);
+    if (status == SerialStatus::Ok && packet.header.id == MsgId::Batch &&
+        !(_recv_batch.Load(packet) && _recv_batch.Next(packet)))
+    {
+        LOG_ERROR(LOG_TAG, "Malformed message batch");
+        status = SerialStatus::RecvFailed;
+    }
+    if (status != SerialStatus::Ok)
+    {
+        _is_open = false; // device and host may be out of sync
+    }
+    return status;
+}
+
+SerialStatus SecureSession::SendPackets(SerialPacket* packets, size_t count)
+{
+    for (size_t sent = 0; sent < count;)
+    {
+        const size_t batched = _batches && count - sent > 1 ? _send_batch.Fill(packets + sent, count - sent) : 0;
+        SerialStatus status;
+        if (batched > 1)
+        {
+            status = SendPacket(_send_batch.Packet());
+            _last_request = packets[sent + batched - 1].header.id; // the reply timeouts are by the requests
+            sent += batched;
+        }
+        else
+        {
+            status = SendPacket(packets[sent]);
+            sent++;
+        }
+        if (status != SerialStatus::Ok)
+        {
+            return status;
+        }
+    }
+    return SerialStatus::Ok;
+}
+
+SerialStatus SecureSession::SendPacket(LargePacket& packet)
+{
+    auto status = SendPacketImpl(packet);
+    if (status != SerialStatus::Ok)
+    {
+        _is_open = false; // device and host may be out of sync
+    }
+    return status;
+}
+
+SerialStatus SecureSession::RecvPacket(LargePacket& packet)
+{
+    auto status = RecvPacketImpl(packet);
+    if (status != SerialStatus::Ok)
+    {
+        _is_open = false; // device and host may be out of sync
+    }
+    return status;
+}
+
+size_t SecureSession::LargePayloadSize() const
+{
+    return _is_open ? _large_payload_size : 0;
 }
 
 // Receive packet, decrypt and try to convert to FaPacket
 SerialStatus SecureSession::RecvFaPacket(FaPacket& packet)
 {
-    auto status = RecvPacketImpl(packet);
+    auto status = RecvPacket(packet);
     if (status != SerialStatus::Ok)
     {
         return status;
@@ -166,7 +353,7 @@ SerialStatus SecureSession::RecvFaPacket(FaPacket& packet)
 // Receive packet, decrypt and try to convert to DataPacket
 SerialStatus SecureSession::RecvDataPacket(DataPacket& packet)
 {
-    auto status = RecvPacketImpl(packet);
+    auto status = RecvPacket(packet);
     if (status != SerialStatus::Ok)
     {
         return status;
@@ -179,6 +366,8 @@ RealSenseID::PacketManager::SerialStatus SecureSession::PairImpl(SerialConnectio
                                                                  const char* ecdsaHostPubKeySig,
                                                                  char* ecdsaDevicePubKey)
 {
+    _crypto_wrapper.ClearSignedEcdhPubkey(); // the host key the device verifies with may change
+    _signed_options.clear();
     unsigned char ecdsaSignedHostPubKey[SIGNED_PUBKEY_SIZE];
     ::memset(ecdsaSignedHostPubKey, 0, sizeof(ecdsaSignedHostPubKey));
     ::memcpy(ecdsaSignedHostPubKey, ecdsaHostPubKey, ECC_P256_KEY_SIZE_BYTES);
@@ -216,34 +405,40 @@ RealSenseID::PacketManager::SerialStatus SecureSession::PairImpl(SerialConnectio
     return SerialStatus::Ok;
 }
 
-SerialStatus SecureSession::SendPacketImpl(SerialPacket& packet)
+template <typename Packet>
+SerialStatus SecureSession::SendPacketImpl(Packet& packet)
 {
     // increment and set sequence number in the packet
     packet.payload.sequence_number = ++_last_sent_seq_number;
+    _last_request = packet.header.id;
 
-    // encrypt packet except for sync bytes and msg id
-    char* packet_ptr = (char*)&packet;
-    char* payload_to_encrypt = ((char*)&(packet.payload));
-    unsigned char temp_encrypted_data[sizeof(SerialPacket::payload)] = {0};
-    // randomize iv for encryption/decryption
-    Randomizer::Instance().GenerateRandom(packet.header.iv, sizeof(packet.header.iv));
-    auto ok = _crypto_wrapper.Encrypt(packet.header.iv, (unsigned char*)payload_to_encrypt, temp_encrypted_data,
-                                      packet.header.payload_size);
-    if (!ok)
-    {
-        LOG_ERROR(LOG_TAG, "Failed encrypting packet");
-        return SerialStatus::SecurityError;
-    }
-
-    // copy back encrypted data in the the packet payload
-    ::memcpy(payload_to_encrypt, (char*)temp_encrypted_data, packet.header.payload_size);
-
-    int content_size = sizeof(packet.header) + packet.header.payload_size;
-    ok = _crypto_wrapper.CalcHmac((unsigned char*)packet_ptr, content_size, (unsigned char*)packet.hmac);
-    if (!ok)
     {
-        LOG_ERROR(LOG_TAG, "Failed to calc HMAC");
-        return SerialStatus::SecurityError;
+        RSID_TRACE_SPAN("session", "EncryptPacket", static_cast<char>(packet.header.id));
+        // encrypt packet except for sync bytes and msg id.
+        // aes-ctr xors the payload with the key stream, so it is encrypted in place.
+        char* packet_ptr = (char*)&packet;
+        auto* payload_to_encrypt = reinterpret_cast<unsigned char*>(&packet.payload);
+        // randomize iv for encryption/decryption, from the session's seeded ctr-drbg
+        if (!_crypto_wrapper.GenerateRandom(packet.header.iv, sizeof(packet.header.iv)))
+        {
+            LOG_ERROR(LOG_TAG, "Failed generating packet iv");
+            return SerialStatus::SecurityError;
+        }
+        auto ok = _crypto_wrapper.Encrypt(packet.header.iv, payload_to_encrypt, payload_to_encrypt,
+                                          packet.header.payload_size);
+        if (!ok)
+        {
+            LOG_ERROR(LOG_TAG, "Failed encrypting packet");
+            return SerialStatus::SecurityError;
+        }
+
+        int content_size = sizeof(packet.header) + packet.header.payload_size;
+        ok = _crypto_wrapper.CalcHmac((unsigned char*)packet_ptr, content_size, (unsigned char*)packet.hmac);
+        if (!ok)
+        {
+            LOG_ERROR(LOG_TAG, "Failed to calc HMAC");
+            return SerialStatus::SecurityError;
+        }
     }
 
     assert(_serial != nullptr);
@@ -257,7 +452,8 @@ static bool ValidateSeqNumber(uint32_t last_recv_number, uint32_t seq_number)
     return (last_recv_number < seq_number && seq_number <= last_recv_number + MAX_SEQ_NUMBER_DELTA);
 }
 
-SerialStatus SecureSession::RecvPacketImpl(SerialPacket& packet)
+template <typename Packet>
+SerialStatus SecureSession::RecvPacketImpl(Packet& packet)
 {
     assert(_serial != nullptr);
     PacketSender sender {_serial};
@@ -269,12 +465,21 @@ SerialStatus SecureSession::RecvPacketImpl(SerialPacket& packet)
         return status;
     }
 
-    status = sender.Recv(packet);
+    // send the cancel as soon as it is requested, also while waiting for the packet
+    sender.SetWaitHandler([this]() { return HandleCancelFlag(); });
+    Timer rtt_timer;
+    status = sender.Recv(packet, _rtt.Timeout(_last_request));
+    if (status == SerialStatus::RecvTimeout)
+    {
+        _rtt.OnTimeout(_last_request);
+    }
     if (status != SerialStatus::Ok)
     {
         return status;
     }
+    _rtt.OnReply(_last_request, rtt_timer.Elapsed());
 
+    RSID_TRACE_SPAN("session", "DecryptPacket", static_cast<char>(packet.header.id));
     char* packet_ptr = (char*)&packet;
 
     // verify hmac of the received packet
@@ -294,10 +499,9 @@ SerialStatus SecureSession::RecvPacketImpl(SerialPacket& packet)
         return SerialStatus::SecurityError;
     }
 
-    // decrypt payload
-    char* payload_to_decrypt = ((char*)&(packet.payload));
-    unsigned char temp_decrypted_data[sizeof(SerialPacket::payload)] = {0};
-    ok = _crypto_wrapper.Decrypt(packet.header.iv, (unsigned char*)payload_to_decrypt, temp_decrypted_data,
+    // decrypt payload in place
+    auto* payload_to_decrypt = reinterpret_cast<unsigned char*>(&packet.payload);
+    ok = _crypto_wrapper.Decrypt(packet.header.iv, payload_to_decrypt, payload_to_decrypt,
                                  packet.header.payload_size);
     if (!ok)
     {
@@ -305,9 +509,6 @@ SerialStatus SecureSession::RecvPacketImpl(SerialPacket& packet)
         return SerialStatus::SecurityError;
     }
 
-    // copy back encrypted data in the the packet payload
-    ::memcpy(payload_to_decrypt, temp_decrypted_data, packet.header.payload_size);
-
     // validate sequence number
     auto current_seq = packet.payload.sequence_number;
     if (!ValidateSeqNumber(_last_recv_seq_number, current_seq))
@@ -323,6 +524,11 @@ void SecureSession::Cancel()
 {
     LOG_DEBUG(LOG_TAG, "Cancel requested.");
     _cancel_required = true;
+    SerialConnection* serial = _serial;
+    if (serial != nullptr)
+    {
+        serial->InterruptRecv(); // the receiving thread sends the cancel right away
+    }
 }
 
 SerialStatus SecureSession::HandleCancelFlag()
@@ -332,14 +538,15 @@ SerialStatus SecureSession::HandleCancelFlag()
         return SerialStatus::Ok;
     }
     _cancel_required = false;
-    if (!_serial)
+    SerialConnection* serial = _serial;
+    if (serial == nullptr)
     {
         LOG_WARNING(LOG_TAG, "Cannot send cancel, no serial connection");
         return SerialStatus::SendFailed;
     }
 
     LOG_DEBUG(LOG_TAG, "Sending cancel..");
-    return _serial->SendBytes(Commands::face_cancel, ::strlen(Commands::face_cancel));
+    return serial->SendBytes(Commands::face_cancel, ::strlen(Commands::face_cancel));
 }
 } // namespace PacketManager
 } // namespace RealSenseID
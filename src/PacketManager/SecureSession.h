@@ -5,10 +5,15 @@
 
 #include "SerialConnection.h"
 #include "SerialPacket.h"
+#include "LargePacket.h"
+#include "MessageBatch.h"
 #include "CommonTypes.h"
 #include "Timer.h"
+#include "RttEstimator.h"
+#include "SessionOptions.h"
 #include "MbedtlsWrapper.h"
 #include <atomic>
+#include <vector>
 
 // Thread safe session manager. sends/receive packets with encryption.
 // Session starts on Start(serial_connection*) and ends in destruction.
@@ -35,10 +40,28 @@ public:
                       char* ecdsaDevicePubKey);
     SerialStatus Unpair(SerialConnection* serial_conn);
 
+    // Get ready for a first session over a new connection (the ecdh key is generated in the background and the round
+    // trip time estimate starts over).
+    void Prepare();
+
     // Start the session using the given (already open) serial connection.
     // return Status::Ok on success, or error Status otherwise.
     SerialStatus Start(SerialConnection* serial_conn);
 
+    // Continue the open session for a new operation (no renegotiation).
+    // Start a new session instead if the session is closed, uses another serial connection or its sequence numbers
+    // are about to run out.
+    // return Status::Ok on success, or error Status otherwise.
+    SerialStatus Resume(SerialConnection* serial_conn);
+
+    // Close the session. The next Resume() starts a new one.
+    void Close();
+
+    // Options sent with the next session starts (see SessionOptions.h). An open session keeps the options it was
+    // started with: Close() it to change them.
+    void SetStartOptions(const SessionOptions& options);
+    const SessionOptions& StartOptions() const;
+
     // return true if session is open
     bool IsOpen();
 
@@ -50,10 +73,24 @@ public:
     SerialStatus SendPacket(SerialPacket& packet);
 
     // Wait for any packet until timeout.
-    // Fill the given packet with the received packet.
+    // Fill the given packet with the received packet. The messages of a received batch (see MessageBatch.h) are
+    // returned one by one.
     // return Status::Ok on success, or error status otherwise.
     SerialStatus RecvPacket(SerialPacket& packet);
 
+    // Send the packets in order, in message batches if the session negotiated them (the packets are then left as they
+    // were, else they are sent as by SendPacket()).
+    // return Status::Ok on success, or error status otherwise.
+    SerialStatus SendPackets(SerialPacket* packets, size_t count);
+
+    // Send / receive large packets (see LargePacket.h), if the session negotiated them. The received packet may be a
+    // regular one (e.g. an error Reply).
+    SerialStatus SendPacket(LargePacket& packet);
+    SerialStatus RecvPacket(LargePacket& packet);
+
+    // largest payload of the large packets of the open session (with the sequence number), 0 if it has none
+    size_t LargePayloadSize() const;
+
     // Wait for fa packet until timeout.
     // Fill the given packet with the received fa packet.
     // If no fa packet available, return timeout status.
@@ -68,22 +105,37 @@ public:
     // return Status::Ok on success, or error status otherwise.
     SerialStatus RecvDataPacket(DataPacket& packet);
 
-    // async cancel. set the _cancel_required flag and send cancel before next recv
+    // async cancel. set the _cancel_required flag and wake up the receiving thread, which sends the cancel
     void Cancel();
 
 private:
-    SerialConnection* _serial = nullptr;
+    std::atomic<SerialConnection*> _serial {nullptr}; // also read by Cancel()
     uint32_t _last_sent_seq_number = 0;
     uint32_t _last_recv_seq_number = 0;
+    MsgId _last_request = MsgId::None; // the reply timeouts are by the request's latency class
+    RttEstimator _rtt;
+    SessionOptions _start_options;
+    size_t _large_payload_size = 0; // negotiated on start
+    bool _batches = false;          // negotiated on start
+    MessageBatch _send_batch;
+    // the messages of the last received batch not yet returned
+    MessageBatchReader _recv_batch;
     SignCallback _sign_callback;
     VerifyCallback _verify_callback;
     MbedtlsWrapper _crypto_wrapper;
+    std::vector<unsigned char> _signed_options; // the data of _options_signature, empty if none
+    unsigned char _options_signature[SessionOptionsSignatureSize] = {};
     bool _is_open = false;
 
+    static std::vector<unsigned char> SignedOptionsData(const unsigned char* pubkey, const unsigned char* options);
+    bool SignOptions(const unsigned char* pubkey, const unsigned char* options, unsigned char* out_sig);
+
     SerialStatus PairImpl(SerialConnection* serial_conn, const char* ecdsaHostPubKey, const char* ecdsaHostPubKeySig,
                           char* ecdsaDevicePubKey);
-    SerialStatus SendPacketImpl(SerialPacket& packet);
-    SerialStatus RecvPacketImpl(SerialPacket& packet);
+    template <typename Packet>
+    SerialStatus SendPacketImpl(Packet& packet);
+    template <typename Packet>
+    SerialStatus RecvPacketImpl(Packet& packet);
     SerialStatus HandleCancelFlag(); // if _cancel_required, send cancel. otherwise do nothing
 };
 } // namespace PacketManager
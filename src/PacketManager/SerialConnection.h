@@ -22,6 +22,72 @@ public:
 
     // receive all bytes and copy to the buffer
     virtual SerialStatus RecvBytes(char* buffer, size_t n_bytes) = 0;
+
+    // receive the bytes available, at least one and up to max_bytes, waiting for the first one up to the
+    // receive timeout. n_bytes_read is the number of bytes copied. return RecvTimeout if none arrived.
+    // default implementation receives a single byte.
+    virtual SerialStatus RecvAvailable(char* buffer, size_t max_bytes, size_t& n_bytes_read)
+    {
+        n_bytes_read = 0;
+        if (max_bytes == 0)
+        {
+            return SerialStatus::RecvFailed;
+        }
+        auto status = RecvBytes(buffer, 1);
+        if (status == SerialStatus::Ok)
+        {
+            n_bytes_read = 1;
+        }
+        return status;
+    }
+
+    // wake up a DiscardUntil() or RecvAvailable() blocked in another thread, which then returns RecvTimeout early.
+    // RecvBytes() is not interrupted (a packet is never cut), the wakeup is kept for the next DiscardUntil().
+    // may be called from any thread. default implementation does nothing (the wait ends on its own timeout).
+    virtual void InterruptRecv()
+    {
+    }
+
+    // change the baud rate of the open connection.
+    // return false if failed or not supported by the connection.
+    virtual bool SetBaudRate(unsigned int baudrate)
+    {
+        (void)baudrate;
+        return false;
+    }
+
+    // enable or disable the driver's low latency mode.
+    // return false if failed or not supported by the connection.
+    virtual bool SetLowLatency(bool enable)
+    {
+        (void)enable;
+        return false;
+    }
+
+    // set the wait of a port read for the first byte, and the time allowed for a write (where the port times writes,
+    // which may allow more for each byte written). return false if failed or not supported by the connection.
+    virtual bool SetPortTimeouts(timeout_t read_timeout, timeout_t write_timeout)
+    {
+        (void)read_timeout;
+        (void)write_timeout;
+        return false;
+    }
+
+    // receive and discard bytes up to and including the first one equal to value, waiting up to the receive timeout
+    // or max_wait if shorter.
+    // return Status::Ok if found, or error status if not found in the bytes received meanwhile.
+    // default implementation checks a single byte. buffered connections may scan all bytes already received.
+    virtual SerialStatus DiscardUntil(char value, timeout_t max_wait)
+    {
+        (void)max_wait;
+        char byte = 0;
+        auto status = RecvBytes(&byte, 1);
+        if (status != SerialStatus::Ok)
+        {
+            return status;
+        }
+        return byte == value ? SerialStatus::Ok : SerialStatus::RecvTimeout;
+    }
 };
 } // namespace PacketManager
 } // namespace RealSenseID
@@ -59,8 +59,10 @@ enum class MsgId : char
     DeviceEcdsaKey = 'b',
     HostEcdhKey = 'c',
     DeviceEcdhKey = 'd',    
+    EnrollImage = 'e',
     Faceprints = 'f',
     FaceDetected = 'g',
+    GetUsersChecksums = 'h',
     GetNumberOfUsers = 'n',
     StartSession = 'o',
     Ping = 'p',
@@ -68,6 +70,8 @@ enum class MsgId : char
     SetDeviceConfig = 's',
     StandBy = 't',
     GetUserIds = 'u',    
+    SetUserFeaturesPacked = 'v',
+    GetUserFeaturesPacked = 'w',
     SecureFaceprintsBeginSecureSession = 'i',
     SecureFaceprintsEndSecureSession = 'j',
     SecureFaceprintsOnSecureSessionReady = 'k',
@@ -76,21 +80,25 @@ enum class MsgId : char
     SecureFaceprintsFaceprintsReady = 'r',
     SetUserFeatures = 'x',
     GetUserFeatures = 'y',
+    Batch = 'z',
+    GetUserRecordsPacked = '1', // large packets only, see LargePacket.h
 
 };
 
+        struct PacketHeader
+        {
+            SyncByte sync1;
+            SyncByte sync2;
+
+            unsigned char protocol_ver;
+            MsgId id; //'A'-'Z' fa message, 'a-'z' data message
+            unsigned char iv[16];
+            uint16_t payload_size;
+        };
+
         struct SerialPacket
         {
-            struct
-            {
-                SyncByte sync1;
-                SyncByte sync2;
-
-                unsigned char protocol_ver;
-                MsgId id; //'A'-'Z' fa message, 'a-'z' data message
-                unsigned char iv[16];
-                uint16_t payload_size;
-            } header;
+            PacketHeader header;
             struct
             {
                 uint32_t sequence_number;
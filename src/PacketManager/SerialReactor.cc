@@ -0,0 +1,226 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "SerialReactor.h"
+#include "SerialTrace.h"
+#include "Logger.h"
+#include "RealTimeMode.h"
+#include <stdexcept>
+#include <string>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+static const char* LOG_TAG = "SerialReactor";
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+SerialReactor::Connection::Connection(int fd, SerialReactorHandler* handler) :
+    fd {fd}, handler {handler}, parser {[handler](SerialStatus status, const SerialPacket& packet) {
+        if (status == SerialStatus::Ok)
+        {
+            handler->OnPacket(packet);
+        }
+        else
+        {
+            handler->OnError(status);
+        }
+    }}
+{
+}
+
+SerialReactor::SerialReactor(unsigned int num_threads)
+{
+    _epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+    if (_epoll_fd < 0)
+    {
+        throw std::runtime_error("Failed to create epoll instance. errno: " + std::to_string(errno));
+    }
+
+    _stop_fd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (_stop_fd < 0)
+    {
+        ::close(_epoll_fd);
+        throw std::runtime_error("Failed to create eventfd. errno: " + std::to_string(errno));
+    }
+
+    // level triggered and never read: once signaled, wakes every thread
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = _stop_fd;
+    if (::epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _stop_fd, &ev) < 0)
+    {
+        ::close(_stop_fd);
+        ::close(_epoll_fd);
+        throw std::runtime_error("Failed to add eventfd to epoll. errno: " + std::to_string(errno));
+    }
+
+    if (num_threads == 0)
+    {
+        num_threads = std::thread::hardware_concurrency();
+    }
+    if (num_threads == 0)
+    {
+        num_threads = 1;
+    }
+    LOG_DEBUG(LOG_TAG, "Starting %u threads", num_threads);
+    for (unsigned int i = 0; i < num_threads; i++)
+    {
+        _threads.emplace_back(&SerialReactor::WorkerLoop, this);
+    }
+}
+
+SerialReactor::~SerialReactor()
+{
+    try
+    {
+        uint64_t one = 1;
+        auto ignored = ::write(_stop_fd, &one, sizeof(one));
+        (void)ignored;
+        for (auto& thread : _threads)
+        {
+            thread.join();
+        }
+        ::close(_stop_fd);
+        ::close(_epoll_fd);
+    }
+    catch (...)
+    {
+    }
+}
+
+// one shot: after an event the fd is disabled until re-armed, so each connection is handled by one thread at a time
+bool SerialReactor::Arm(int fd, int op)
+{
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.fd = fd;
+    return ::epoll_ctl(_epoll_fd, op, fd, &ev) == 0;
+}
+
+bool SerialReactor::Add(int fd, SerialReactorHandler* handler)
+{
+    if (fd < 0 || handler == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Invalid connection");
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock {_connections_mutex};
+    if (_connections.find(fd) != _connections.end())
+    {
+        LOG_ERROR(LOG_TAG, "Connection %d already added", fd);
+        return false;
+    }
+    _connections[fd] = std::make_shared<Connection>(fd, handler);
+    if (!Arm(fd, EPOLL_CTL_ADD))
+    {
+        LOG_ERROR(LOG_TAG, "Failed to add connection %d. errno: %d", fd, errno);
+        _connections.erase(fd);
+        return false;
+    }
+    return true;
+}
+
+void SerialReactor::Remove(int fd)
+{
+    std::shared_ptr<Connection> connection;
+    {
+        std::lock_guard<std::mutex> lock {_connections_mutex};
+        auto it = _connections.find(fd);
+        if (it == _connections.end())
+        {
+            return;
+        }
+        connection = it->second;
+        _connections.erase(it);
+        ::epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+
+    // wait for a thread that may be handling the connection right now
+    std::lock_guard<std::mutex> lock {connection->mutex};
+    connection->removed = true;
+}
+
+void SerialReactor::WorkerLoop()
+{
+    RealTimeMode::EnterIoThread("serial reactor");
+    constexpr int max_events = 16;
+    struct epoll_event events[max_events];
+    while (true)
+    {
+        int n_events = ::epoll_wait(_epoll_fd, events, max_events, -1);
+        if (n_events < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            LOG_ERROR(LOG_TAG, "epoll_wait failed. errno: %d", errno);
+            return;
+        }
+
+        for (int i = 0; i < n_events; i++)
+        {
+            int fd = events[i].data.fd;
+            if (fd == _stop_fd)
+            {
+                return;
+            }
+
+            std::shared_ptr<Connection> connection;
+            {
+                std::lock_guard<std::mutex> lock {_connections_mutex};
+                auto it = _connections.find(fd);
+                if (it == _connections.end())
+                {
+                    continue; // removed meanwhile
+                }
+                connection = it->second;
+            }
+
+            std::lock_guard<std::mutex> lock {connection->mutex};
+            if (connection->removed)
+            {
+                continue;
+            }
+            if (HandleEvent(*connection, events[i].events) && !Arm(fd, EPOLL_CTL_MOD))
+            {
+                LOG_ERROR(LOG_TAG, "Failed to re-arm connection %d. errno: %d", fd, errno);
+            }
+        }
+    }
+}
+
+// read what is available and feed the parser. return false if the connection failed and should not be polled.
+bool SerialReactor::HandleEvent(Connection& connection, uint32_t events)
+{
+    if (events & EPOLLIN)
+    {
+        auto n_read = ::read(connection.fd, connection.buffer, sizeof(connection.buffer));
+        if (n_read > 0)
+        {
+            DEBUG_SERIAL(LOG_TAG, "[rcv]", connection.buffer, n_read);
+            SerialTrace::Record(SerialTrace::Direction::Recv, connection.fd, connection.buffer, n_read);
+            connection.parser.Feed(connection.buffer, static_cast<size_t>(n_read));
+            return true;
+        }
+        if (n_read < 0 && (errno == EINTR || errno == EAGAIN))
+        {
+            return true;
+        }
+    }
+    else if (!(events & (EPOLLERR | EPOLLHUP)))
+    {
+        return true;
+    }
+
+    LOG_ERROR(LOG_TAG, "Connection %d failed. errno: %d", connection.fd, errno);
+    connection.handler->OnError(SerialStatus::RecvFailed);
+    return false;
+}
+} // namespace PacketManager
+} // namespace RealSenseID
@@ -0,0 +1,82 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "PacketParser.h"
+#include "SerialPacket.h"
+#include "CommonTypes.h"
+#include "LibraryThread.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+// Per-connection handler of the packets received by the reactor.
+// Called on one of the reactor's threads, never concurrently for the same connection.
+class SerialReactorHandler
+{
+public:
+    virtual ~SerialReactorHandler() = default;
+
+    // a complete, valid packet was received
+    virtual void OnPacket(const SerialPacket& packet) = 0;
+
+    // an invalid packet was received (VersionMismatch, CrcError, RecvFailed), or the port failed (RecvFailed).
+    // after a port failure the connection is no longer polled.
+    virtual void OnError(SerialStatus status) = 0;
+};
+
+// epoll based reactor: a fixed number of threads (by default one per core) wait on many serial ports at once.
+// incoming bytes are parsed incrementally per connection and complete packets are dispatched to its handler,
+// so the number of threads does not grow with the number of devices.
+// Only reads are multiplexed - send with the connection's SerialConnection::SendBytes() as usual.
+// Linux only.
+class SerialReactor
+{
+public:
+    // num_threads == 0: one thread per core
+    explicit SerialReactor(unsigned int num_threads = 0);
+    ~SerialReactor();
+
+    SerialReactor(const SerialReactor&) = delete;
+    SerialReactor& operator=(const SerialReactor&) = delete;
+
+    // start polling the given open port (e.g. LinuxSerial::Handle()). the handler must outlive the registration.
+    bool Add(int fd, SerialReactorHandler* handler);
+
+    // stop polling the port. on return the handler is not called anymore.
+    // must not be called from the port's own handler.
+    void Remove(int fd);
+
+private:
+    struct Connection
+    {
+        Connection(int fd, SerialReactorHandler* handler);
+
+        int fd;
+        SerialReactorHandler* handler;
+        PacketParser parser;
+        std::mutex mutex; // held while handling the connection's events
+        bool removed = false;
+        char buffer[4096];
+    };
+
+    int _epoll_fd = -1;
+    int _stop_fd = -1; // eventfd, signaled on destruction to wake all threads
+    std::vector<LibraryThread> _threads;
+    std::mutex _connections_mutex;
+    std::map<int, std::shared_ptr<Connection>> _connections;
+
+    void WorkerLoop();
+    bool HandleEvent(Connection& connection, uint32_t events);
+    bool Arm(int fd, int op);
+};
+} // namespace PacketManager
+} // namespace RealSenseID
@@ -0,0 +1,234 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "SerialTrace.h"
+#include "SerialPacket.h"
+#include "Logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+namespace SerialTrace
+{
+static const char* LOG_TAG = "SerialTrace";
+static constexpr size_t MinSlots = 16;
+static constexpr size_t MaxRetiredRings = 16; // rings of exited threads kept for the dump
+static constexpr size_t MaxMsgIdOffset = 34;  // packets may follow a command prefix in the same write
+
+std::atomic<bool> g_enabled {false};
+static std::atomic<uint32_t> s_generation {0}; // incremented by Start(), the rings of older generations are dropped
+
+namespace
+{
+struct Slot
+{
+    RecordHeader record;
+    char data[MaxRecordBytes];
+};
+
+struct Ring
+{
+    std::mutex mutex;
+    std::vector<Slot> slots;
+    size_t next = 0;
+    size_t count = 0;
+    std::atomic<bool> retired {false};
+};
+
+struct Registry
+{
+    std::mutex mutex;
+    std::vector<std::shared_ptr<Ring>> rings;
+    size_t slots_per_ring = MinSlots;
+    uint32_t next_thread = 0;
+};
+
+Registry& GetRegistry()
+{
+    static Registry registry;
+    return registry;
+}
+
+// the calling thread's ring in the current generation
+struct ThreadRing
+{
+    std::shared_ptr<Ring> ring;
+    uint32_t generation = 0;
+    uint32_t thread = 0;
+
+    ~ThreadRing()
+    {
+        if (ring)
+        {
+            ring->retired = true;
+        }
+    }
+};
+
+thread_local ThreadRing t_ring;
+} // namespace
+
+static uint64_t NowMicros()
+{
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+}
+
+static char FindMsgId(const char* buffer, size_t size)
+{
+    const size_t last = std::min(size, MaxMsgIdOffset + 4);
+    for (size_t i = 0; i + 3 < last; ++i)
+    {
+        if (buffer[i] == static_cast<char>(SyncByte::Sync1) && buffer[i + 1] == static_cast<char>(SyncByte::Sync2) &&
+            static_cast<unsigned char>(buffer[i + 2]) == ProtocolVer)
+        {
+            return buffer[i + 3];
+        }
+    }
+    return '\0';
+}
+
+// register a ring for the calling thread. false if tracing was stopped meanwhile
+static bool RegisterThreadRing()
+{
+    auto& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock {registry.mutex};
+    if (!g_enabled)
+    {
+        return false;
+    }
+
+    // drop the oldest rings of exited threads
+    size_t n_retired = std::count_if(registry.rings.begin(), registry.rings.end(),
+                                     [](const std::shared_ptr<Ring>& ring) { return ring->retired.load(); });
+    for (auto it = registry.rings.begin(); n_retired >= MaxRetiredRings && it != registry.rings.end();)
+    {
+        if ((*it)->retired)
+        {
+            it = registry.rings.erase(it);
+            --n_retired;
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    auto ring = std::make_shared<Ring>();
+    ring->slots.resize(registry.slots_per_ring);
+    registry.rings.push_back(ring);
+    t_ring.ring = ring;
+    t_ring.generation = s_generation.load();
+    t_ring.thread = ++registry.next_thread;
+    return true;
+}
+
+void RecordImpl(Direction direction, uintptr_t channel, const char* buffer, size_t size)
+{
+    const auto time_us = NowMicros();
+    if (t_ring.ring && t_ring.generation != s_generation.load())
+    {
+        t_ring.ring.reset(); // no longer in the registry
+    }
+    if (!t_ring.ring && !RegisterThreadRing())
+    {
+        return;
+    }
+
+    auto& ring = *t_ring.ring;
+    std::lock_guard<std::mutex> lock {ring.mutex};
+    auto& slot = ring.slots[ring.next];
+    slot.record.time_us = time_us;
+    slot.record.thread = t_ring.thread;
+    slot.record.channel = static_cast<uint32_t>(channel);
+    slot.record.size = static_cast<uint32_t>(size);
+    slot.record.stored_size = static_cast<uint16_t>(std::min(size, MaxRecordBytes));
+    slot.record.direction = static_cast<uint8_t>(direction);
+    slot.record.msg_id = FindMsgId(buffer, size);
+    ::memcpy(slot.data, buffer, slot.record.stored_size);
+    ring.next = (ring.next + 1) % ring.slots.size();
+    ring.count = std::min(ring.count + 1, ring.slots.size());
+}
+
+void Start(size_t ring_bytes)
+{
+    auto& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock {registry.mutex};
+    registry.rings.clear();
+    registry.slots_per_ring = std::max(MinSlots, ring_bytes / sizeof(Slot));
+    registry.next_thread = 0;
+    ++s_generation;
+    g_enabled = true;
+    LOG_INFO(LOG_TAG, "Started, %zu records per thread", registry.slots_per_ring);
+}
+
+void Stop()
+{
+    g_enabled = false;
+}
+
+bool Dump(const char* path)
+{
+    if (path == nullptr)
+    {
+        return false;
+    }
+
+    // (record, data) of all rings, oldest first
+    std::vector<std::pair<RecordHeader, std::vector<char>>> records;
+    {
+        auto& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock {registry.mutex};
+        for (const auto& ring : registry.rings)
+        {
+            std::lock_guard<std::mutex> ring_lock {ring->mutex};
+            const size_t n_slots = ring->slots.size();
+            for (size_t i = 0; i < ring->count; ++i)
+            {
+                const auto& slot = ring->slots[(ring->next + n_slots - ring->count + i) % n_slots];
+                records.emplace_back(slot.record, std::vector<char>(slot.data, slot.data + slot.record.stored_size));
+            }
+        }
+    }
+    using Record = std::pair<RecordHeader, std::vector<char>>;
+    std::stable_sort(records.begin(), records.end(),
+                     [](const Record& a, const Record& b) { return a.first.time_us < b.first.time_us; });
+
+    FILE* file = ::fopen(path, "wb");
+    if (file == nullptr)
+    {
+        LOG_ERROR(LOG_TAG, "Failed to open %s", path);
+        return false;
+    }
+    FileHeader header;
+    ::memcpy(header.magic, FileMagic, sizeof(header.magic));
+    header.record_count = static_cast<uint32_t>(records.size());
+    header.reserved = 0;
+    bool ok = ::fwrite(&header, sizeof(header), 1, file) == 1;
+    for (const auto& record : records)
+    {
+        if (!ok)
+            break;
+        ok = ::fwrite(&record.first, sizeof(record.first), 1, file) == 1 &&
+             (record.second.empty() || ::fwrite(record.second.data(), record.second.size(), 1, file) == 1);
+    }
+    ok = ::fclose(file) == 0 && ok;
+    if (!ok)
+    {
+        LOG_ERROR(LOG_TAG, "Failed writing %s", path);
+        return false;
+    }
+    LOG_INFO(LOG_TAG, "Dumped %zu records to %s", records.size(), path);
+    return true;
+}
+} // namespace SerialTrace
+} // namespace PacketManager
+} // namespace RealSenseID
@@ -0,0 +1,69 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+// Binary trace of the serial traffic, for debugging timing sensitive issues without hex formatting on the I/O threads.
+// Each thread records into its own ring of fixed size slots (the oldest records are overwritten), Dump() merges
+// the rings by time into a file that the rsid-serial-trace tool decodes.
+//
+// File format (little endian):
+//   FileHeader
+//   records sorted by time: RecordHeader followed by its stored_size bytes
+namespace SerialTrace
+{
+enum class Direction : uint8_t
+{
+    Send = 0,
+    Recv = 1
+};
+
+#pragma pack(push, 1)
+struct FileHeader
+{
+    char magic[8]; // "RSIDTRC1"
+    uint32_t record_count;
+    uint32_t reserved;
+};
+
+struct RecordHeader
+{
+    uint64_t time_us;     // steady clock
+    uint32_t thread;      // sequential id of the recording thread
+    uint32_t channel;     // the connection's handle, the streams of a channel are continuous
+    uint32_t size;        // bytes sent / received
+    uint16_t stored_size; // bytes following the record (at most MaxRecordBytes)
+    uint8_t direction;    // Direction
+    char msg_id;          // MsgId if the bytes start with a packet, '\0' otherwise
+};
+#pragma pack(pop)
+
+static const char FileMagic[8] = {'R', 'S', 'I', 'D', 'T', 'R', 'C', '1'};
+static constexpr size_t MaxRecordBytes = 2048; // a whole packet. bigger transfers are cut
+
+// start recording, with a ring of ring_bytes per thread. clears previous records
+void Start(size_t ring_bytes);
+void Stop();
+bool Dump(const char* path);
+
+extern std::atomic<bool> g_enabled;
+void RecordImpl(Direction direction, uintptr_t channel, const char* buffer, size_t size);
+
+inline void Record(Direction direction, uintptr_t channel, const char* buffer, size_t size)
+{
+    if (g_enabled.load(std::memory_order_relaxed) && size > 0)
+    {
+        RecordImpl(direction, channel, buffer, size);
+    }
+}
+} // namespace SerialTrace
+} // namespace PacketManager
+} // namespace RealSenseID
@@ -0,0 +1,37 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "SessionOptions.h"
+#include <string.h>
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+void WriteSessionOptions(const SessionOptions& options, unsigned char* dst)
+{
+    dst[0] = SessionOptionsVersion;
+    dst[1] = options.events;
+    ::memcpy(dst + 2, &options.face_interval_ms, sizeof(options.face_interval_ms));
+    ::memcpy(dst + 4, &options.large_payload, sizeof(options.large_payload));
+    dst[6] = options.batches ? 1 : 0;
+}
+
+bool ReadSessionOptions(const unsigned char* src, size_t size, SessionOptions& options)
+{
+    if (size < SessionOptionsMinSize || src[0] != SessionOptionsVersion)
+    {
+        return false;
+    }
+    options.events = src[1] & SessionEventsAll;
+    ::memcpy(&options.face_interval_ms, src + 2, sizeof(options.face_interval_ms));
+    options.large_payload = 0;
+    if (size >= SessionOptionsMinSize + sizeof(options.large_payload))
+    {
+        ::memcpy(&options.large_payload, src + 4, sizeof(options.large_payload));
+    }
+    options.batches = size >= SessionOptionsSize && src[6] == 1;
+    return true;
+}
+} // namespace PacketManager
+} // namespace RealSenseID
@@ -0,0 +1,76 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+// Options of a session, sent with its start: as the data of the StartSession packet (non secure session) or after the
+// signed key in the HostEcdhKey packet (secure session). Little endian:
+//
+//   version (u8, SessionOptionsVersion), events (u8, SessionEvents mask of the events the host wants), face interval
+//   (u16, millis: at most one FaceDetected per interval, 0 for all of them), large payload (u16, the largest payload
+//   of the large packets the host sends and receives, see LargePacket.h, 0 for none), batches (u8, 1 if the host
+//   sends and receives message batches, see MessageBatch.h)
+//
+// Nothing is added for the default options, so the start packet is then the same as without them. A device without
+// the options ignores the extra bytes and sends all events, so the host filters them too.
+// A device with the options answers with the options it applies, in the same layout: as the data of its StartSession
+// packet or after its signed key. Its large payload is at most the host's, 0 if it does not take large packets. The
+// reply of a device without the options has none (too few bytes, version 0), so the session has no large packets.
+// The large payload and batches fields may be missing (options of SessionOptionsMinSize bytes or more), for none.
+//
+// In the secure session the options (all SessionOptionsSize bytes) are followed by their signature: the sender's
+// ecdsa signature of its ecdh public key followed by the options, as its key's signature (the device then verifies it
+// with the host's key, and the host with the device's). A device without the options ignores both, and the reply
+// options of a device with them are not taken unless signed, so neither side's options can be changed on the way.
+static constexpr uint8_t SessionOptionsVersion = 1;
+static constexpr size_t SessionOptionsSize = 1 + 1 + 2 + 2 + 1;
+static constexpr size_t SessionOptionsMinSize = 1 + 1 + 2;
+static constexpr size_t SessionOptionsSignatureSize = 64;
+
+enum SessionEvents : uint8_t
+{
+    SessionEventHints = 1,    // Hint packets
+    SessionEventProgress = 2, // Progress packets
+    SessionEventFaces = 4,    // FaceDetected packets
+    SessionEventsAll = SessionEventHints | SessionEventProgress | SessionEventFaces
+};
+
+struct SessionOptions
+{
+    uint8_t events = SessionEventsAll;
+    uint16_t face_interval_ms = 0;
+    uint16_t large_payload = 0;
+    bool batches = false;
+
+    bool IsDefault() const
+    {
+        return events == SessionEventsAll && face_interval_ms == 0 && large_payload == 0 && !batches;
+    }
+
+    bool operator==(const SessionOptions& other) const
+    {
+        return events == other.events && face_interval_ms == other.face_interval_ms &&
+               large_payload == other.large_payload && batches == other.batches;
+    }
+
+    bool operator!=(const SessionOptions& other) const
+    {
+        return !(*this == other);
+    }
+};
+
+// write the options (SessionOptionsSize bytes)
+void WriteSessionOptions(const SessionOptions& options, unsigned char* dst);
+
+// read the options from the size bytes at src. returns false, leaving options as they are, if there are none (too few
+// bytes or another version)
+bool ReadSessionOptions(const unsigned char* src, size_t size, SessionOptions& options);
+} // namespace PacketManager
+} // namespace RealSenseID
@@ -0,0 +1,269 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "UsbBulkSerial.h"
+#include "Logger.h"
+#include "LibraryMemory.h"
+#include "RealTimeMode.h"
+#include "SerialPacket.h"
+#include "SerialTrace.h"
+#include "Timer.h"
+#include <cassert>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <errno.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <linux/usbdevice_fs.h>
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+static const char* LOG_TAG = "UsbBulkSerial";
+static constexpr timeout_t recv_packet_timeout {5000};
+// the reader waits for completed reads up to this, so a stop is noticed within it
+static constexpr int reader_poll_ms = 200;
+
+UsbBulkSerial::~UsbBulkSerial()
+{
+    StopReader();
+}
+
+void UsbBulkSerial::StartReader(int file_descriptor, int read_endpoint_address, int write_endpoint_address)
+{
+    _file_descriptor = file_descriptor;
+    _read_endpoint_address = read_endpoint_address;
+    _write_endpoint_address = write_endpoint_address;
+    _stop_reader = false;
+    _reader_failed = false;
+    _reader_thread = LibraryThread([this]() { ReaderLoop(); });
+}
+
+void UsbBulkSerial::StopReader()
+{
+    _stop_reader = true;
+    if (_reader_thread.joinable())
+    {
+        _reader_thread.join();
+    }
+}
+
+bool UsbBulkSerial::SubmitRead(::usbdevfs_urb& urb, char* buffer, size_t index)
+{
+    ::memset(&urb, 0, sizeof(urb));
+    urb.type = USBDEVFS_URB_TYPE_BULK;
+    urb.endpoint = static_cast<unsigned char>(_read_endpoint_address);
+    urb.buffer = buffer;
+    urb.buffer_length = static_cast<int>(ReadTransferSize);
+    urb.usercontext = reinterpret_cast<void*>(index);
+    if (::ioctl(_file_descriptor, USBDEVFS_SUBMITURB, &urb) != 0)
+    {
+        LOG_ERROR(LOG_TAG, "Submit read failed. errno=%d", errno);
+        return false;
+    }
+    return true;
+}
+
+void UsbBulkSerial::ReaderLoop()
+{
+    RealTimeMode::EnterIoThread("usb reader");
+    auto buffers = std::make_unique<char[]>(ReadUrbCount * ReadTransferSize);
+    Memory::TrackedBytes buffers_memory {Memory::Category::SerialBuffers, ReadUrbCount * ReadTransferSize};
+    struct usbdevfs_urb urbs[ReadUrbCount];
+    bool submitted[ReadUrbCount] = {};
+    size_t in_flight = 0;
+    // submit the idle reads the ring has room for, on top of the reads in flight, so a completed read always fits
+    static_assert(ReadUrbCount * ReadTransferSize <= CyclicBuffer::Capacity, "the ring must take all the reads");
+    bool submit_failed = false;
+    auto submit_reads = [&]() {
+        for (size_t i = 0; i < ReadUrbCount && !submit_failed; i++)
+        {
+            if (submitted[i] || _read_from_device_buffer.FreeSpace() < (in_flight + 1) * ReadTransferSize)
+            {
+                continue;
+            }
+            submitted[i] = SubmitRead(urbs[i], buffers.get() + i * ReadTransferSize, i);
+            submit_failed = !submitted[i];
+            in_flight += submitted[i] ? 1 : 0;
+        }
+    };
+
+    bool device_gone = false;
+    while (!_stop_reader && !device_gone)
+    {
+        submit_reads();
+        if (submit_failed)
+        {
+            break;
+        }
+        if (in_flight == 0)
+        {
+            // the ring is full: wait for the receives to take from it
+            std::this_thread::sleep_for(std::chrono::milliseconds {1});
+            continue;
+        }
+        // usbfs polls writable when a submitted urb completed. while reads wait for room, poll briefly to submit them
+        struct pollfd fds = {_file_descriptor, POLLOUT, 0};
+        const int poll_ms = in_flight < ReadUrbCount ? 1 : reader_poll_ms;
+        if (::poll(&fds, 1, poll_ms) < 0 && errno != EINTR)
+        {
+            LOG_ERROR(LOG_TAG, "poll failed. errno=%d", errno);
+            break;
+        }
+        if (fds.revents & (POLLERR | POLLHUP))
+        {
+            device_gone = true;
+            break;
+        }
+
+        // hand over the completed reads, oldest first. they are submitted again once there is room
+        struct usbdevfs_urb* urb = nullptr;
+        while (::ioctl(_file_descriptor, USBDEVFS_REAPURBNDELAY, &urb) == 0)
+        {
+            const auto index = reinterpret_cast<size_t>(urb->usercontext);
+            submitted[index] = false;
+            --in_flight;
+            if (urb->status == 0 && urb->actual_length > 0)
+            {
+                const auto bytes_read = static_cast<size_t>(urb->actual_length);
+                auto* data = static_cast<const char*>(urb->buffer);
+                SerialTrace::Record(SerialTrace::Direction::Recv, _file_descriptor, data, bytes_read);
+                size_t actual_bytes_writen = _read_from_device_buffer.Write(data, bytes_read);
+                if (actual_bytes_writen != bytes_read)
+                {
+                    LOG_ERROR(LOG_TAG, "Intermediate buffer out of space!");
+                    assert(false);
+                }
+            }
+            else if (urb->status == -ENODEV || urb->status == -ESHUTDOWN)
+            {
+                device_gone = true;
+            }
+            else if (urb->status == -EPIPE)
+            {
+                unsigned int endpoint = static_cast<unsigned int>(_read_endpoint_address);
+                ::ioctl(_file_descriptor, USBDEVFS_CLEAR_HALT, &endpoint);
+            }
+        }
+        if (errno == ENODEV)
+        {
+            device_gone = true;
+        }
+    }
+    if (device_gone || submit_failed)
+    {
+        LOG_ERROR(LOG_TAG, "%s, stopped reading", device_gone ? "Device is gone" : "Failed submitting a read");
+        _reader_failed = true;
+    }
+
+    // cancel the reads still submitted, and reap them before their buffers go
+    for (size_t i = 0; i < ReadUrbCount; i++)
+    {
+        if (submitted[i])
+        {
+            ::ioctl(_file_descriptor, USBDEVFS_DISCARDURB, &urbs[i]);
+        }
+    }
+    while (in_flight > 0)
+    {
+        struct usbdevfs_urb* urb = nullptr;
+        if (::ioctl(_file_descriptor, USBDEVFS_REAPURB, &urb) != 0)
+        {
+            break;
+        }
+        --in_flight;
+    }
+}
+
+SerialStatus UsbBulkSerial::SendBytes(const char* buffer, size_t n_bytes)
+{
+    struct usbdevfs_bulktransfer ctrl;
+    memset(&ctrl, 0, sizeof(ctrl));
+    ctrl.ep = _write_endpoint_address;
+    ctrl.len = static_cast<unsigned int>(n_bytes);
+    ctrl.data = (void*)buffer;
+    ctrl.timeout = 1000;
+    SerialTrace::Record(SerialTrace::Direction::Send, _file_descriptor, buffer, n_bytes);
+    int number_of_bytes_sent = ioctl(_file_descriptor, USBDEVFS_BULK, &ctrl);
+
+    if (0 > number_of_bytes_sent)
+    {
+        int error_number = errno;
+        LOG_ERROR(LOG_TAG, "ioctl failed with error: 0x%x", error_number);
+        return SerialStatus::SendFailed;
+    }
+
+    if (n_bytes != static_cast<size_t>(number_of_bytes_sent))
+    {
+        LOG_ERROR(LOG_TAG, "Error while writing to serial port");
+        return SerialStatus::SendFailed;
+    }
+    DEBUG_SERIAL(LOG_TAG, "[snd]", buffer, n_bytes);
+    return SerialStatus::Ok;
+}
+
+SerialStatus UsbBulkSerial::RecvBytes(char* buffer, size_t n_bytes)
+{
+    if (n_bytes == 0)
+    {
+        LOG_ERROR(LOG_TAG, "Attempt to recv 0 bytes");
+        return SerialStatus::RecvFailed;
+    }
+
+    Timer timer {recv_packet_timeout};
+    size_t total_bytes_read = 0;
+    while (!timer.ReachedTimeout())
+    {
+        char* buf_ptr = buffer + total_bytes_read;
+        auto last_read_result = _read_from_device_buffer.Read(buf_ptr, n_bytes - total_bytes_read);
+        if (last_read_result > 0)
+        {
+            total_bytes_read += last_read_result;
+            if (total_bytes_read >= n_bytes)
+            {
+                assert(n_bytes == total_bytes_read);
+                DEBUG_SERIAL(LOG_TAG, "[rcv]", buffer, total_bytes_read);
+                return SerialStatus::Ok;
+            }
+        }
+        else if (_reader_failed)
+        {
+            LOG_ERROR(LOG_TAG, "Reader stopped, got only %zu of %zu bytes", total_bytes_read, n_bytes);
+            return SerialStatus::RecvFailed;
+        }
+        else
+        {
+            // block until the reader thread writes to the buffer
+            _read_from_device_buffer.WaitForData(timer.TimeLeft());
+        }
+    }
+    DEBUG_SERIAL(LOG_TAG, "[rcv]", buffer, total_bytes_read);
+    LOG_DEBUG(LOG_TAG, "Timeout recv %zu bytes. Got only %zu bytes", n_bytes, total_bytes_read);
+    return SerialStatus::RecvTimeout;
+}
+
+SerialStatus UsbBulkSerial::RecvAvailable(char* buffer, size_t max_bytes, size_t& n_bytes_read)
+{
+    n_bytes_read = 0;
+    if (max_bytes == 0)
+    {
+        LOG_ERROR(LOG_TAG, "Attempt to recv 0 bytes");
+        return SerialStatus::RecvFailed;
+    }
+    n_bytes_read = _read_from_device_buffer.Read(buffer, max_bytes);
+    if (n_bytes_read == 0 && _read_from_device_buffer.WaitForData(std::chrono::milliseconds {200}))
+    {
+        n_bytes_read = _read_from_device_buffer.Read(buffer, max_bytes);
+    }
+    if (n_bytes_read == 0)
+    {
+        return _reader_failed ? SerialStatus::RecvFailed : SerialStatus::RecvTimeout;
+    }
+    DEBUG_SERIAL(LOG_TAG, "[rcv]", buffer, n_bytes_read);
+    return SerialStatus::Ok;
+}
+} // namespace PacketManager
+} // namespace RealSenseID
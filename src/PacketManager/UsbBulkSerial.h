@@ -0,0 +1,69 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "SerialConnection.h"
+#include "CyclicBuffer.h"
+#include "LibraryThread.h"
+#include <atomic>
+
+struct usbdevfs_urb;
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+// Serial connection over the bulk endpoints of a usbdevfs file descriptor (USBDEVFS_BULK), with no tty in between.
+// A reader thread keeps several bulk reads submitted (asynchronous URBs) and writes what arrives to a ring the
+// receives take from, so the device can send while a completed read is handed over. A read is submitted only while
+// the ring has room for it and the reads in flight. Once the reader stops (the device is gone or a read could not be
+// submitted) the receives fail.
+// Shared by the Android connection (the fd and endpoints of the java UsbDeviceConnection) and the Linux one (a usbfs
+// node opened by the library). The derived class starts the reader when the fd is ready and stops it before closing.
+class UsbBulkSerial : public SerialConnection
+{
+public:
+    ~UsbBulkSerial() override;
+
+    // prevent copy or assignment
+    // only single connection is allowed to a serial port.
+    UsbBulkSerial(const UsbBulkSerial&) = delete;
+    void operator=(const UsbBulkSerial&) = delete;
+
+    // send all bytes in one bulk transfer and return status
+    SerialStatus SendBytes(const char* buffer, size_t n_bytes) final;
+
+    // receive all bytes and copy to the buffer
+    SerialStatus RecvBytes(char* buffer, size_t n_bytes) final;
+
+    // the bytes the reader thread has written to the buffer so far
+    SerialStatus RecvAvailable(char* buffer, size_t max_bytes, size_t& n_bytes_read) final;
+
+protected:
+    UsbBulkSerial() = default;
+
+    // start / stop the reader thread on the fd and endpoints
+    void StartReader(int file_descriptor, int read_endpoint_address, int write_endpoint_address);
+    void StopReader();
+
+private:
+    // a large packet (LargePacket.h) in one read. a multiple of the endpoints' max packet size.
+    static constexpr size_t ReadTransferSize = 32 * 1024;
+    // reads submitted at a time, as many as the ring takes
+    static constexpr size_t ReadUrbCount = 2;
+
+    int _file_descriptor = -1;
+    int _read_endpoint_address = 0;
+    int _write_endpoint_address = 0;
+
+    std::atomic<bool> _stop_reader {false};
+    std::atomic<bool> _reader_failed {false};
+    LibraryThread _reader_thread;
+    CyclicBuffer _read_from_device_buffer;
+
+    void ReaderLoop();
+    bool SubmitRead(::usbdevfs_urb& urb, char* buffer, size_t index);
+};
+} // namespace PacketManager
+} // namespace RealSenseID
@@ -0,0 +1,111 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "UsersChecksum.h"
+#include <algorithm>
+#include <string.h>
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+static constexpr uint64_t FnvOffset = 0xcbf29ce484222325ULL;
+static constexpr uint64_t FnvPrime = 0x100000001b3ULL;
+
+// 64 bit FNV-1a over 8 byte words, the tail zero padded
+static uint64_t HashWords(uint64_t hash, const void* data, size_t size)
+{
+    auto bytes = static_cast<const unsigned char*>(data);
+    for (; size > 0; bytes += sizeof(uint64_t), size -= std::min(size, sizeof(uint64_t)))
+    {
+        uint64_t word = 0;
+        ::memcpy(&word, bytes, std::min(size, sizeof(uint64_t)));
+        hash = (hash ^ word) * FnvPrime;
+    }
+    return hash;
+}
+
+// the splitmix64 finalizer, so sums of user checksums do not cancel out
+static uint64_t Mix(uint64_t hash)
+{
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    return hash ^ (hash >> 31);
+}
+
+size_t ChecksumLevelSize(size_t level)
+{
+    size_t size = 1;
+    for (size_t i = 0; i < level; i++)
+    {
+        size *= ChecksumFanout;
+    }
+    return size;
+}
+
+size_t ChecksumBucket(const char* user_id)
+{
+    const uint64_t hash = Mix(HashWords(FnvOffset, user_id, ::strnlen(user_id, MaxUserIdSize)));
+    return static_cast<size_t>(hash % ChecksumBuckets);
+}
+
+// the faceprints fields one after the other, without the struct's padding
+uint64_t UserChecksum(const char* user_id, const Faceprints& faceprints)
+{
+    char id[MaxUserIdSize + 1] = {0};
+    ::strncpy(id, user_id, MaxUserIdSize);
+    uint64_t hash = HashWords(FnvOffset, id, sizeof(id));
+    hash = HashWords(hash, faceprints.reserved, sizeof(faceprints.reserved));
+    const int32_t header[3] = {faceprints.version, static_cast<int32_t>(faceprints.featuresType), faceprints.flags};
+    hash = HashWords(hash, header, sizeof(header));
+    hash = HashWords(hash, faceprints.adaptiveDescriptorWithoutMask, sizeof(faceprints.adaptiveDescriptorWithoutMask));
+    hash = HashWords(hash, faceprints.adaptiveDescriptorWithMask, sizeof(faceprints.adaptiveDescriptorWithMask));
+    hash = HashWords(hash, faceprints.enrollmentDescriptor, sizeof(faceprints.enrollmentDescriptor));
+    return Mix(hash);
+}
+
+void WriteBucketUser(const BucketUser& user, unsigned char* dst)
+{
+    ::memcpy(dst, &user.index, sizeof(user.index));
+    ::memcpy(dst + 2, &user.checksum, sizeof(user.checksum));
+    ::memcpy(dst + 10, user.user_id, sizeof(user.user_id));
+}
+
+void ReadBucketUser(const unsigned char* src, BucketUser& user)
+{
+    ::memcpy(&user.index, src, sizeof(user.index));
+    ::memcpy(&user.checksum, src + 2, sizeof(user.checksum));
+    ::memcpy(user.user_id, src + 10, sizeof(user.user_id));
+    user.user_id[MaxUserIdSize] = '\0';
+}
+
+void UsersChecksumTree::Add(size_t bucket, uint64_t user_checksum)
+{
+    _buckets[bucket] += user_checksum;
+}
+
+void UsersChecksumTree::Remove(size_t bucket, uint64_t user_checksum)
+{
+    _buckets[bucket] -= user_checksum;
+}
+
+void UsersChecksumTree::Clear()
+{
+    _buckets.assign(ChecksumBuckets, 0);
+}
+
+uint64_t UsersChecksumTree::Digest(size_t level, size_t node) const
+{
+    if (level + 1 == ChecksumLevels)
+    {
+        return _buckets[node];
+    }
+    uint64_t children[ChecksumFanout];
+    for (size_t i = 0; i < ChecksumFanout; i++)
+    {
+        children[i] = Digest(level + 1, node * ChecksumFanout + i);
+    }
+    return Mix(HashWords(FnvOffset, children, sizeof(children)));
+}
+} // namespace PacketManager
+} // namespace RealSenseID
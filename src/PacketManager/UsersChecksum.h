@@ -0,0 +1,70 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/Faceprints.h"
+#include "SerialPacket.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+// Checksum tree of a users DB, for comparing the device's DB with a host copy of it (GetUsersChecksums message)
+// without exporting all the users.
+//
+// A user falls in one of ChecksumBuckets buckets by a hash of its user id, and its digest is a hash of the user id and
+// the faceprints. A bucket's digest is the sum of its users' digests, so it does not depend on the order of the users
+// and a change updates it in constant time. The digest of an inner node is a hash of its ChecksumFanout children's
+// digests. Level 0 is the root, level ChecksumLevels - 1 the buckets.
+//
+// GetUsersChecksums request / reply (little endian):
+//   level < ChecksumLevels:  level (u8), first node (u16), number of nodes (u16, up to MaxChecksumsPerReply)
+//                            reply: the digests (u64) of the nodes
+//   level == ChecksumLevels: level (u8), bucket (u16), first user (u16)
+//                            reply: users in the bucket (u16), users in the reply (u16, up to
+//                            MaxBucketUsersPerReply), then each user's DB index (u16, as in GetUserFeatures), checksum
+//                            (u64) and user id (31 bytes)
+static constexpr size_t ChecksumFanout = 16;
+static constexpr size_t ChecksumLevels = 3;
+static constexpr size_t ChecksumBuckets = ChecksumFanout * ChecksumFanout;
+static constexpr size_t MaxChecksumsPerReply = 240;
+static constexpr size_t BucketUserSize = 2 + 8 + MaxUserIdSize + 1;
+static constexpr size_t MaxBucketUsersPerReply = (sizeof(DataMessage::data) - 4) / BucketUserSize;
+
+// number of nodes in a level of the tree
+size_t ChecksumLevelSize(size_t level);
+
+size_t ChecksumBucket(const char* user_id);
+uint64_t UserChecksum(const char* user_id, const Faceprints& faceprints);
+
+// user of a bucket in a GetUsersChecksums reply
+struct BucketUser
+{
+    uint16_t index = 0;
+    uint64_t checksum = 0;
+    char user_id[MaxUserIdSize + 1] = {0};
+};
+
+// write / read a bucket user (BucketUserSize bytes)
+void WriteBucketUser(const BucketUser& user, unsigned char* dst);
+void ReadBucketUser(const unsigned char* src, BucketUser& user);
+
+class UsersChecksumTree
+{
+public:
+    void Add(size_t bucket, uint64_t user_checksum);
+    void Remove(size_t bucket, uint64_t user_checksum);
+    void Clear();
+
+    // digest of a node (level < ChecksumLevels, node < ChecksumLevelSize(level))
+    uint64_t Digest(size_t level, size_t node) const;
+
+private:
+    std::vector<uint64_t> _buckets = std::vector<uint64_t>(ChecksumBuckets);
+};
+} // namespace PacketManager
+} // namespace RealSenseID
@@ -2,14 +2,23 @@
 // Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
 
 #include "WindowsSerial.h"
+#include "SerialTrace.h"
 #include "SerialPacket.h"
 #include "CommonTypes.h"
+#include "Timer.h"
 #include "Logger.h"
+#include "RealTimeMode.h"
 
 #include <string>
 #include <stdexcept>
+#include <algorithm>
+#include <utility>
+#include <cassert>
+#include <string.h>
 
 static const char* LOG_TAG = "WindowsSerial";
+// added to the write timeout per byte written, so a large write at a low baud rate is not cut by the constant part
+static const DWORD WRITE_TIMEOUT_MS_PER_BYTE = 5;
 
 static void ThrowWinError(std::string msg)
 {
@@ -22,10 +31,12 @@ namespace PacketManager
 {
 WindowsSerial::WindowsSerial(const SerialConfig& config) : _config {config}
 {
+    RealTimeMode::Prefault(_chunks, sizeof(_chunks));
     DCB dcbSerialParams = {0};
     std::string port = std::string("\\\\.\\") + _config.port;
     LOG_DEBUG(LOG_TAG, "Opening serial port %s", config.port);
-    _handle = ::CreateFileA(port.c_str(), GENERIC_READ | GENERIC_WRITE, 0, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    _handle = ::CreateFileA(port.c_str(), GENERIC_READ | GENERIC_WRITE, 0, 0, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, 0);
 
     if (_handle == INVALID_HANDLE_VALUE)
     {
@@ -35,7 +46,7 @@ WindowsSerial::WindowsSerial(const SerialConfig& config) : _config {config}
     dcbSerialParams.DCBlength = sizeof(dcbSerialParams);
     if (!GetCommState(_handle, &dcbSerialParams))
     {
-        ::CloseHandle(_handle);
+        Close();
         ThrowWinError("Failed to open serial port");
     }
     dcbSerialParams.BaudRate = _config.baudrate;
@@ -45,23 +56,45 @@ WindowsSerial::WindowsSerial(const SerialConfig& config) : _config {config}
 
     if (!SetCommState(_handle, &dcbSerialParams))
     {
-        ::CloseHandle(_handle);
+        Close();
         ThrowWinError("Failed to open serial port");
     }
 
     COMMTIMEOUTS timeouts = {0};
 
-    // waits 200ms for 1st byte and then proceeds adding 5ms for each bytes received
+    // a read completes as soon as any bytes are available, or with 0 bytes after 200ms.
+    // the time to wait for all the requested bytes is handled by RecvBytes().
+    timeouts.ReadIntervalTimeout = MAXDWORD;
+    timeouts.ReadTotalTimeoutMultiplier = MAXDWORD;
     timeouts.ReadTotalTimeoutConstant = 200;
-    timeouts.ReadTotalTimeoutMultiplier = 5;
     timeouts.WriteTotalTimeoutConstant = 200;
     timeouts.WriteTotalTimeoutMultiplier = 5;
 
     if (!SetCommTimeouts(_handle, &timeouts))
     {
-        ::CloseHandle(_handle);
+        Close();
         ThrowWinError("Failed to open serial port");
     }
+
+    _completion_port = ::CreateIoCompletionPort(_handle, NULL, 0, 1);
+    if (_completion_port == NULL)
+    {
+        Close();
+        ThrowWinError("Failed to create completion port");
+    }
+
+    _write_event = ::CreateEventA(NULL, TRUE, FALSE, NULL);
+    if (_write_event == NULL)
+    {
+        Close();
+        ThrowWinError("Failed to create write event");
+    }
+
+    if (PostRead() != SerialStatus::Ok)
+    {
+        Close();
+        ThrowWinError("Failed to read from serial port");
+    }
 }
 
 WindowsSerial::~WindowsSerial()
@@ -69,60 +102,289 @@ WindowsSerial::~WindowsSerial()
     try
     {
 	    LOG_DEBUG(LOG_TAG, "Closing serial port");
-        if (_handle == INVALID_HANDLE_VALUE)
-        {
-            return;
-        }
-        ::CloseHandle(_handle);
+        Close();
     }
     catch (...)
     {
     }
 }
 
+void WindowsSerial::Close()
+{
+    if (_handle != INVALID_HANDLE_VALUE && _read_pending)
+    {
+        // the pending read writes to our buffer - wait for it to be cancelled before releasing anything
+        DWORD ignored = 0;
+        ::CancelIoEx(_handle, &_read_overlapped);
+        ::GetOverlappedResult(_handle, &_read_overlapped, &ignored, TRUE);
+        _read_pending = false;
+    }
+    if (_write_event != NULL)
+    {
+        ::CloseHandle(_write_event);
+        _write_event = NULL;
+    }
+    if (_completion_port != NULL)
+    {
+        ::CloseHandle(_completion_port);
+        _completion_port = NULL;
+    }
+    if (_handle != INVALID_HANDLE_VALUE)
+    {
+        ::CloseHandle(_handle);
+        _handle = INVALID_HANDLE_VALUE;
+    }
+}
+
+bool WindowsSerial::SetBaudRate(unsigned int baudrate)
+{
+    LOG_DEBUG(LOG_TAG, "Set baudrate %u", baudrate);
+    DCB dcbSerialParams = {0};
+    dcbSerialParams.DCBlength = sizeof(dcbSerialParams);
+    if (!GetCommState(_handle, &dcbSerialParams))
+    {
+        LOG_ERROR(LOG_TAG, "Failed to get comm state. Last error: %x", ::GetLastError());
+        return false;
+    }
+    dcbSerialParams.BaudRate = baudrate;
+    if (!SetCommState(_handle, &dcbSerialParams))
+    {
+        LOG_ERROR(LOG_TAG, "Failed to set baudrate %u. Last error: %x", baudrate, ::GetLastError());
+        return false;
+    }
+    _config.baudrate = baudrate;
+    return true;
+}
+
+bool WindowsSerial::SetPortTimeouts(timeout_t read_timeout, timeout_t write_timeout)
+{
+    COMMTIMEOUTS timeouts = {0};
+    timeouts.ReadIntervalTimeout = MAXDWORD;
+    timeouts.ReadTotalTimeoutMultiplier = MAXDWORD;
+    timeouts.ReadTotalTimeoutConstant = static_cast<DWORD>(std::max<timeout_t::rep>(read_timeout.count(), 1));
+    timeouts.WriteTotalTimeoutConstant = static_cast<DWORD>(std::max<timeout_t::rep>(write_timeout.count(), 1));
+    timeouts.WriteTotalTimeoutMultiplier = WRITE_TIMEOUT_MS_PER_BYTE;
+    if (!SetCommTimeouts(_handle, &timeouts))
+    {
+        LOG_ERROR(LOG_TAG, "Failed to set timeouts. Last error: %x", ::GetLastError());
+        return false;
+    }
+    return true;
+}
+
 SerialStatus WindowsSerial::SendBytes(const char* buffer, size_t n_bytes)
 {
     DWORD bytes_to_write = static_cast<DWORD>(n_bytes);
     DWORD bytes_written = 0;
 
     DEBUG_SERIAL(LOG_TAG, "[snd]", buffer, n_bytes);
+    SerialTrace::Record(SerialTrace::Direction::Send, reinterpret_cast<uintptr_t>(_handle), buffer, n_bytes);
 
-    if (!::WriteFile(_handle, buffer, bytes_to_write, &bytes_written, NULL) || bytes_written != bytes_to_write)
+    // low bit set on the event keeps the write's completion out of the completion port, which serves reads only
+    OVERLAPPED overlapped = {0};
+    overlapped.hEvent = reinterpret_cast<HANDLE>(reinterpret_cast<ULONG_PTR>(_write_event) | 1);
+    if (!::WriteFile(_handle, buffer, bytes_to_write, NULL, &overlapped) && ::GetLastError() != ERROR_IO_PENDING)
+    {
+        LOG_ERROR(LOG_TAG, "Error while writing to serial port. Last error: %x", ::GetLastError());
+        return SerialStatus::SendFailed;
+    }
+
+    // the write timeout is set by the comm timeouts
+    if (!::GetOverlappedResult(_handle, &overlapped, &bytes_written, TRUE) || bytes_written != bytes_to_write)
     {
         LOG_ERROR(LOG_TAG, "Error while writing to serial port");
         return SerialStatus::SendFailed;
     }
-    else
+
+    if (_config.drain_on_send && !::FlushFileBuffers(_handle))
     {
-        return SerialStatus::Ok;
+        LOG_ERROR(LOG_TAG, "Error while draining serial port. Last error: %x", ::GetLastError());
+        return SerialStatus::SendFailed;
     }
+    return SerialStatus::Ok;
 }
 
-SerialStatus WindowsSerial::RecvBytes(char* buffer, size_t n_bytes)
+// post the next read into _read_chunk. its completion is queued to the completion port.
+SerialStatus WindowsSerial::PostRead()
 {
-    DWORD bytes_to_read = static_cast<DWORD>(n_bytes);
-    DWORD bytes_actual_read = 0;
+    assert(!_read_pending);
+    ::memset(&_read_overlapped, 0, sizeof(_read_overlapped));
+    if (!::ReadFile(_handle, _read_chunk, static_cast<DWORD>(_chunk_size), NULL, &_read_overlapped) &&
+        ::GetLastError() != ERROR_IO_PENDING)
+    {
+        LOG_ERROR(LOG_TAG, "Error while reading from serial port. Last error: %x", ::GetLastError());
+        return SerialStatus::RecvFailed;
+    }
+    // completed or not, the completion packet is queued
+    _read_pending = true;
+    return SerialStatus::Ok;
+}
 
-    if (!::ReadFile(_handle, (LPVOID)buffer, bytes_to_read, &bytes_actual_read, NULL))
+size_t WindowsSerial::TakeBuffered(char* buffer, size_t n_bytes)
+{
+    size_t available = _recv_end - _recv_begin;
+    size_t n_copy = n_bytes < available ? n_bytes : available;
+    ::memcpy(buffer, &_recv_buffer[_recv_begin], n_copy);
+    _recv_begin += n_copy;
+    return n_copy;
+}
+
+void WindowsSerial::InterruptRecv()
+{
+    ::PostQueuedCompletionStatus(_completion_port, 0, 0, NULL);
+}
+
+// wait up to timeout for the posted read to complete, make its bytes the receive buffer and post the next read
+SerialStatus WindowsSerial::FillBuffer(timeout_t timeout, bool* interrupted)
+{
+    assert(_recv_begin == _recv_end);
+    _recv_begin = _recv_end = 0;
+
+    if (interrupted != nullptr)
+    {
+        *interrupted = _interrupt_pending;
+        if (_interrupt_pending)
+        {
+            _interrupt_pending = false;
+            return SerialStatus::Ok;
+        }
+    }
+
+    if (!_read_pending)
+    {
+        auto status = PostRead();
+        if (status != SerialStatus::Ok)
+        {
+            return status;
+        }
+    }
+
+    DWORD bytes_read = 0;
+    ULONG_PTR key = 0;
+    LPOVERLAPPED overlapped = NULL;
+    DWORD wait_ms = static_cast<DWORD>(std::max<timeout_t::rep>(timeout.count(), 0));
+    if (!::GetQueuedCompletionStatus(_completion_port, &bytes_read, &key, &overlapped, wait_ms))
     {
+        if (overlapped == NULL)
+        {
+            return SerialStatus::Ok; // no bytes yet, the read is still pending
+        }
+        _read_pending = false;
         LOG_ERROR(LOG_TAG, "Error while reading from serial port. Last error: %x", ::GetLastError());
         return SerialStatus::RecvFailed;
     }
+    if (overlapped == NULL)
+    {
+        // InterruptRecv() packet. the read is still pending
+        if (interrupted != nullptr)
+        {
+            *interrupted = true;
+        }
+        else
+        {
+            _interrupt_pending = true;
+        }
+        return SerialStatus::Ok;
+    }
+    _read_pending = false;
+
+    std::swap(_recv_buffer, _read_chunk);
+    _recv_end = bytes_read;
+    if (bytes_read > 0)
+    {
+        DEBUG_SERIAL(LOG_TAG, "[rcv]", _recv_buffer, bytes_read);
+        SerialTrace::Record(SerialTrace::Direction::Recv, reinterpret_cast<uintptr_t>(_handle), _recv_buffer,
+                            bytes_read);
+    }
+    return PostRead();
+}
+
+SerialStatus WindowsSerial::RecvBytes(char* buffer, size_t n_bytes)
+{
+    if (n_bytes == 0)
+    {
+        LOG_ERROR(LOG_TAG, "Attempt to recv 0 bytes");
+        return SerialStatus::RecvFailed;
+    }
 
-    if (bytes_actual_read != bytes_to_read)
+    // waits 200ms for 1st byte and then proceeds adding 5ms for each bytes received
+    Timer timer {std::chrono::milliseconds {200 + 5 * n_bytes}};
+    size_t total_bytes_read = TakeBuffered(buffer, n_bytes);
+    while (total_bytes_read < n_bytes && !timer.ReachedTimeout())
     {
-        if (bytes_to_read != 1)
+        auto status = FillBuffer(timer.TimeLeft());
+        if (status != SerialStatus::Ok)
         {
-            // log only if not waiting for sync bytes, where it is expected to timeout sometimes
-            LOG_DEBUG(LOG_TAG, "Timeout reading %d bytes. Got only %d", bytes_to_read, bytes_actual_read);
+            return status;
         }
-        return SerialStatus::RecvTimeout;
+        total_bytes_read += TakeBuffered(buffer + total_bytes_read, n_bytes - total_bytes_read);
     }
-    else
+
+    if (total_bytes_read == n_bytes)
     {
-        DEBUG_SERIAL(LOG_TAG, "[rcv]", buffer, bytes_actual_read);
         return SerialStatus::Ok;
     }
+
+    if (n_bytes != 1)
+    {
+        // log only if not waiting for sync bytes, where it is expected to timeout sometimes
+        LOG_DEBUG(LOG_TAG, "Timeout reading %zu bytes. Got only %zu", n_bytes, total_bytes_read);
+    }
+    return SerialStatus::RecvTimeout;
+}
+
+SerialStatus WindowsSerial::RecvAvailable(char* buffer, size_t max_bytes, size_t& n_bytes_read)
+{
+    n_bytes_read = 0;
+    if (max_bytes == 0)
+    {
+        LOG_ERROR(LOG_TAG, "Attempt to recv 0 bytes");
+        return SerialStatus::RecvFailed;
+    }
+    n_bytes_read = TakeBuffered(buffer, max_bytes);
+    if (n_bytes_read == 0)
+    {
+        bool interrupted = false;
+        auto status = FillBuffer(std::chrono::milliseconds {200}, &interrupted);
+        if (status != SerialStatus::Ok)
+        {
+            return status;
+        }
+        n_bytes_read = TakeBuffered(buffer, max_bytes);
+    }
+    return n_bytes_read > 0 ? SerialStatus::Ok : SerialStatus::RecvTimeout;
+}
+
+SerialStatus WindowsSerial::DiscardUntil(char value, timeout_t max_wait)
+{
+    // same as receiving a single byte, unless the caller's wait ends sooner
+    Timer timer {std::min(max_wait, timeout_t {205})};
+    while (true)
+    {
+        auto* begin = &_recv_buffer[_recv_begin];
+        auto* found = static_cast<const char*>(::memchr(begin, value, _recv_end - _recv_begin));
+        if (found != nullptr)
+        {
+            _recv_begin += static_cast<size_t>(found - begin) + 1;
+            return SerialStatus::Ok;
+        }
+        _recv_begin = _recv_end;
+
+        if (timer.ReachedTimeout())
+        {
+            return SerialStatus::RecvTimeout;
+        }
+        bool interrupted = false;
+        auto status = FillBuffer(timer.TimeLeft(), &interrupted);
+        if (status != SerialStatus::Ok)
+        {
+            return status;
+        }
+        if (interrupted)
+        {
+            return SerialStatus::RecvTimeout;
+        }
+    }
 }
 } // namespace PacketManager
 } // namespace RealSenseID
@@ -4,6 +4,7 @@
 #pragma once
 
 #include "SerialConnection.h"
+#include "CommonTypes.h"
 #include <windows.h>
 
 namespace RealSenseID
@@ -27,9 +28,46 @@ public:
     // receive all bytes and copy to the buffer
     SerialStatus RecvBytes(char* buffer, size_t n_bytes) final;
 
+    // the buffered bytes, or the bytes of one read from the port
+    SerialStatus RecvAvailable(char* buffer, size_t max_bytes, size_t& n_bytes_read) final;
+
+    // discard bytes up to and including the first one equal to value (scanning the receive buffer)
+    SerialStatus DiscardUntil(char value, timeout_t max_wait) final;
+
+    // wake up DiscardUntil() by posting a packet to the completion port
+    void InterruptRecv() final;
+
+    bool SetBaudRate(unsigned int baudrate) final;
+
+    // the read total timeout constant, and the write total timeout constant (with no per byte multiplier)
+    bool SetPortTimeouts(timeout_t read_timeout, timeout_t write_timeout) final;
+
 private:
     SerialConfig _config;
     HANDLE _handle = INVALID_HANDLE_VALUE;
+
+    // the port is opened for overlapped I/O. reads complete to _completion_port, writes signal _write_event.
+    HANDLE _completion_port = NULL;
+    HANDLE _write_event = NULL;
+
+    // one read is always posted ahead into _read_chunk, so the device's next bytes arrive while the host parses
+    // the current ones. when it completes the two buffers are swapped and the next read is posted.
+    // received bytes not consumed yet are _recv_buffer[_recv_begin, _recv_end).
+    static const size_t _chunk_size = 4096;
+    char _chunks[2][_chunk_size];
+    char* _recv_buffer = _chunks[0];
+    char* _read_chunk = _chunks[1];
+    size_t _recv_begin = 0;
+    size_t _recv_end = 0;
+    OVERLAPPED _read_overlapped = {0};
+    bool _read_pending = false;
+    bool _interrupt_pending = false; // wakeup received while not interruptible, reported by the next DiscardUntil()
+
+    void Close();
+    SerialStatus PostRead();
+    size_t TakeBuffered(char* buffer, size_t n_bytes);
+    // interrupted != nullptr: also return (with no bytes and *interrupted == true) when InterruptRecv() is called
+    SerialStatus FillBuffer(timeout_t timeout, bool* interrupted = nullptr);
 };
 } // namespace PacketManager
 } // namespace RealSenseID
@@ -0,0 +1,1573 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+// Benchmarks of the host protocol stack against the DeviceEmulator, no device needed.
+// Build with -DRSID_PROTOCOL_BENCH=ON (and preferably -DRSID_DEBUG_CONSOLE=OFF, the packet logs are costly) and run
+// bin/rsid_protocol_bench (any google benchmark flag is supported, e.g. --benchmark_filter=Export).
+//
+// The link benchmarks' arguments are the line speed in baud (0 for a line with no transmit time, to measure the host
+// overhead alone) and the link latency in milliseconds. Wall time is what counts, so they use real time.
+// The session is the one of the build: build once with and once without -DRSID_SECURE=ON to compare the secure and
+// the non secure session. BM_PacketRoundTrip (framing and crc), BM_Crc and BM_PacketCrypto (secure builds) isolate
+// the costs of the layers below the session. BM_ReplayAuthenticate (non secure builds) replays a recorded
+// authentication with the device's timing, its host_us counter is the host's own processing time.
+
+#include "emulator/DeviceEmulator.h"
+#include "emulator/ReplaySerial.h"
+#include "DeviceControllerImpl.h"
+#include "DeviceProbe.h"
+#include "FaceAuthenticatorImpl.h"
+#include "PacketSender.h"
+#include "SerialTrace.h"
+#include "RealSenseID/Allocator.h"
+#include "RealSenseID/AuthFaceprintsExtractionCallback.h"
+#include "RealSenseID/EnrollFaceprintsExtractionCallback.h"
+#include "RealSenseID/EnrollImagesCallback.h"
+#include "RealSenseID/FaceprintsExportCallback.h"
+#include "RealSenseID/GalleryAuthCallback.h"
+#include "RealSenseID/HostGallery.h"
+#include "RealSenseID/UsersChangesCallback.h"
+#include "RealSenseID/UserIdsCallback.h"
+#include "RealSenseID/UsersExportCallback.h"
+#include "RealSenseID/SignatureCallback.h"
+#include "benchmark/benchmark.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <string.h>
+#include <stdlib.h>
+#ifdef __linux__
+#include <sys/resource.h>
+#endif // __linux__
+
+using namespace RealSenseID;
+using namespace RealSenseID::PacketManager;
+
+// heap allocations of each thread, to count the host's allocations in an operation (the emulator has its own thread)
+static thread_local unsigned long long t_heap_allocations = 0;
+
+void* operator new(size_t size)
+{
+    t_heap_allocations++;
+    if (void* ptr = ::malloc(size > 0 ? size : 1))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    ::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    ::free(ptr);
+}
+
+namespace
+{
+// size of the descriptor of a user in the device database (about the size of the faceprints)
+constexpr size_t DescriptorSize = sizeof(Faceprints);
+
+DeviceEmulatorConfig EmulatorConfig(const benchmark::State& state)
+{
+    DeviceEmulatorConfig config;
+    config.link.baudrate = static_cast<unsigned int>(state.range(0));
+    config.link.latency = timeout_t {state.range(1)};
+    return config;
+}
+
+// faceprints of an enrolled user: the adaptive descriptors drifted a little from the enrollment's
+Faceprints EnrolledFaceprints(size_t seed)
+{
+    Faceprints faceprints;
+    ::memset(faceprints.reserved, 0, sizeof(faceprints.reserved));
+    for (size_t i = 0; i < FEATURES_VECTOR_ALLOC_SIZE; i++)
+    {
+        int value = static_cast<int>((seed * 131 + i * 37) % 2047) - 1023;
+        int drift = static_cast<int>((seed + i * 7) % 9) - 4;
+        int adaptive = std::max(-1023, std::min(1023, value + drift));
+        faceprints.enrollmentDescriptor[i] = static_cast<feature_t>(value);
+        faceprints.adaptiveDescriptorWithoutMask[i] = static_cast<feature_t>(adaptive);
+        faceprints.adaptiveDescriptorWithMask[i] = static_cast<feature_t>(adaptive);
+    }
+    return faceprints;
+}
+
+void AddUsers(DeviceEmulator& emulator, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        Faceprints faceprints = EnrolledFaceprints(i);
+        const auto* descriptor = reinterpret_cast<const char*>(&faceprints);
+        emulator.SetUser("user_" + std::to_string(i), std::vector<char>(descriptor, descriptor + DescriptorSize));
+    }
+}
+
+// the emulated device signs its keys with an all zeros signature and does not check the host's signature
+class NullSignatureCallback : public SignatureCallback
+{
+public:
+    bool Sign(const unsigned char* buffer, const unsigned int buffer_len, unsigned char* out_sig) override
+    {
+        (void)buffer;
+        (void)buffer_len;
+        ::memset(out_sig, 0, 64);
+        return true;
+    }
+
+    bool Verify(const unsigned char* buffer, const unsigned int buffer_len, const unsigned char* sig,
+                const unsigned int sig_len) override
+    {
+        (void)buffer;
+        (void)buffer_len;
+        (void)sig;
+        (void)sig_len;
+        return true;
+    }
+};
+
+NullSignatureCallback null_signature_callback;
+
+std::unique_ptr<Session> CreateSession()
+{
+#ifdef RSID_SECURE
+    return std::make_unique<Session>(
+        [](const unsigned char* buffer, const unsigned int buffer_len, unsigned char* out_sig) {
+            return null_signature_callback.Sign(buffer, buffer_len, out_sig);
+        },
+        [](const unsigned char* buffer, const unsigned int buffer_len, const unsigned char* sig,
+           const unsigned int sig_len) { return null_signature_callback.Verify(buffer, buffer_len, sig, sig_len); });
+#else
+    return std::make_unique<Session>();
+#endif // RSID_SECURE
+}
+
+// authenticator connected to the emulator, with persistent session (a session start per operation is measured
+// separately by BM_StartSession)
+std::unique_ptr<FaceAuthenticatorImpl> ConnectAuthenticator(DeviceEmulator& emulator)
+{
+    auto authenticator = std::make_unique<FaceAuthenticatorImpl>(&null_signature_callback);
+    authenticator->Connect(emulator.HostConnection());
+    authenticator->SetPersistentSession(true);
+    authenticator->SetPackedTransfers(true); // as the emulator's config has them
+    authenticator->SetLargePayloads(true);
+    authenticator->SetMessageBatches(true);
+    return authenticator;
+}
+
+class NullAuthCallback : public AuthenticationCallback
+{
+public:
+    void OnResult(const AuthenticateStatus status, const char* user_id) override
+    {
+        last_status = status;
+        (void)user_id;
+    }
+
+    void OnHint(const AuthenticateStatus hint) override
+    {
+        (void)hint;
+    }
+
+    void OnFaceDetected(const std::vector<FaceRect>& faces, const unsigned int ts) override
+    {
+        (void)faces;
+        (void)ts;
+    }
+
+    void OnTiming(const OperationTiming& operation_timing) override
+    {
+        timing = operation_timing;
+    }
+
+    AuthenticateStatus last_status = AuthenticateStatus::Failure;
+    OperationTiming timing;
+};
+
+// cancels the loop it runs in after a number of authentications
+class CancelingAuthCallback : public NullAuthCallback
+{
+public:
+    CancelingAuthCallback(FaceAuthenticatorImpl& authenticator, unsigned int attempts) :
+        _authenticator(authenticator), _attempts(attempts)
+    {
+    }
+
+    void OnResult(const AuthenticateStatus status, const char* user_id) override
+    {
+        NullAuthCallback::OnResult(status, user_id);
+        if (status == AuthenticateStatus::Success && ++count == _attempts)
+        {
+            _authenticator.Cancel();
+        }
+    }
+
+    unsigned int count = 0;
+
+private:
+    FaceAuthenticatorImpl& _authenticator;
+    unsigned int _attempts;
+};
+
+// badge photo like JPEG: exif metadata (with a thumbnail) of exif_size bytes and scan_size bytes of entropy coded data
+std::vector<unsigned char> SyntheticJpeg(size_t exif_size, size_t scan_size, unsigned int seed)
+{
+    std::vector<unsigned char> jpeg {0xFF, 0xD8};
+    auto segment = [&jpeg](unsigned char marker, size_t size) {
+        jpeg.insert(jpeg.end(), {0xFF, marker, static_cast<unsigned char>((size + 2) >> 8),
+                                 static_cast<unsigned char>(size + 2)});
+    };
+    segment(0xE1, exif_size);
+    const unsigned char exif[] = {'E', 'x', 'i', 'f', 0, 0, 'M', 'M', 0, 42, 0, 0, 0, 8, 0, 1, 0x01, 0x12, 0, 3, 0, 0,
+                                  0, 1, 0, 6, 0, 0, 0, 0, 0, 0};
+    jpeg.insert(jpeg.end(), exif, exif + sizeof(exif));
+    jpeg.resize(jpeg.size() + exif_size - sizeof(exif), 0x5A);
+    segment(0xC0, 15); // 8 bit, 480 x 640, 3 components
+    jpeg.insert(jpeg.end(), {8, 0x01, 0xE0, 0x02, 0x80, 3, 1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1});
+    segment(0xDA, 10);
+    jpeg.insert(jpeg.end(), {3, 1, 0, 2, 0x11, 3, 0x11, 0, 0x3F, 0});
+    for (size_t i = 0; i < scan_size; i++)
+    {
+        const unsigned char value = static_cast<unsigned char>((seed * 2654435761u + i * 40503u) >> 13);
+        jpeg.push_back(value == 0xFF ? 0xFE : value);
+    }
+    jpeg.insert(jpeg.end(), {0xFF, 0xD9});
+    return jpeg;
+}
+
+class CountingExportCallback : public FaceprintsExportCallback
+{
+public:
+    void OnFaceprints(unsigned int user_index, const Faceprints& faceprints) override
+    {
+        (void)user_index;
+        (void)faceprints;
+        count++;
+    }
+
+    unsigned int count = 0;
+};
+
+class CountingUsersExportCallback : public UsersExportCallback
+{
+public:
+    void OnUser(unsigned int user_index, const char* user_id, const Faceprints& faceprints) override
+    {
+        (void)user_index;
+        (void)user_id;
+        (void)faceprints;
+        count++;
+    }
+
+    unsigned int count = 0;
+};
+
+class CountingImagesCallback : public EnrollImagesCallback
+{
+public:
+    void OnResult(const unsigned int image_index, const EnrollStatus status, const Faceprints* faceprints) override
+    {
+        (void)image_index;
+        (void)faceprints;
+        count += status == EnrollStatus::Success ? 1 : 0;
+    }
+
+    unsigned int count = 0;
+};
+
+class CountingUserIdsCallback : public UserIdsCallback
+{
+public:
+    void OnUserId(const unsigned int user_index, const char* user_id) override
+    {
+        (void)user_index;
+        (void)user_id;
+        count++;
+    }
+
+    unsigned int count = 0;
+};
+
+// counts on the authenticator's worker thread, read by the benchmark's
+class AtomicExportCallback : public FaceprintsExportCallback
+{
+public:
+    void OnFaceprints(unsigned int user_index, const Faceprints& faceprints) override
+    {
+        (void)user_index;
+        (void)faceprints;
+        count++;
+    }
+
+    std::atomic<unsigned int> count {0};
+};
+
+class CountingChangesCallback : public UsersChangesCallback
+{
+public:
+    void OnAllUsersRemoved() override
+    {
+    }
+
+    void OnUserRemoved(const char* user_id) override
+    {
+        (void)user_id;
+        removed++;
+    }
+
+    void OnUserChanged(const char* user_id, const Faceprints& faceprints) override
+    {
+        (void)user_id;
+        (void)faceprints;
+        changed++;
+    }
+
+    unsigned int removed = 0;
+    unsigned int changed = 0;
+};
+
+// keeps the enrolled faceprints and whether the duplicate check found the enrollee
+class DuplicateCheckCallback : public EnrollFaceprintsExtractionCallback
+{
+public:
+    void OnResult(const EnrollStatus status, const Faceprints* result_faceprints) override
+    {
+        if (status == EnrollStatus::Success && result_faceprints != nullptr)
+        {
+            faceprints = *result_faceprints;
+            results++;
+        }
+    }
+
+    void OnResult(const EnrollStatus status, const Faceprints* result_faceprints,
+                  const HostGalleryMatch* duplicate_user) override
+    {
+        duplicate = duplicate_user != nullptr;
+        OnResult(status, result_faceprints);
+    }
+
+    void OnProgress(const FacePose pose) override
+    {
+        (void)pose;
+    }
+
+    void OnHint(const EnrollStatus hint) override
+    {
+        (void)hint;
+    }
+
+    Faceprints faceprints;
+    unsigned int results = 0;
+    bool duplicate = false;
+};
+
+// matches the faceprints of every attempt of a loop against a shared gallery, and cancels the loop after a number
+// of attempts. the latency of an attempt is from the device's face detection to the match result.
+class GatewayCallback : public AuthFaceprintsExtractionCallback
+{
+public:
+    GatewayCallback(FaceAuthenticatorImpl& authenticator, HostGallery& gallery, unsigned int attempts) :
+        _authenticator(authenticator), _gallery(gallery), _attempts(attempts)
+    {
+    }
+
+    // every result counts as an attempt, so the loop is cancelled against a failing device too
+    void OnResult(const AuthenticateStatus status, const Faceprints* faceprints) override
+    {
+        if (status != AuthenticateStatus::Success || faceprints == nullptr)
+        {
+            failures++;
+        }
+        else
+        {
+            const auto match = _gallery.Match(*faceprints);
+            latencies_ms.push_back(
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _face_time).count());
+            failures += match.result.success ? 0 : 1;
+        }
+        if (++count == _attempts)
+        {
+            _authenticator.Cancel();
+        }
+    }
+
+    void OnHint(const AuthenticateStatus hint) override
+    {
+        (void)hint;
+    }
+
+    void OnFaceDetected(const FaceRect* faces, const size_t n_faces, const unsigned int ts) override
+    {
+        (void)faces;
+        (void)n_faces;
+        (void)ts;
+        _face_time = std::chrono::steady_clock::now();
+    }
+
+    unsigned int count = 0;
+    unsigned int failures = 0;
+    std::vector<double> latencies_ms;
+
+private:
+    FaceAuthenticatorImpl& _authenticator;
+    HostGallery& _gallery;
+    unsigned int _attempts;
+    std::chrono::steady_clock::time_point _face_time;
+};
+
+// matches the faceprints of every attempt of a loop against a gallery and handles the match for a while (e.g. the
+// access decision and its log), then cancels the loop after a number of attempts. with pipelined results an attempt
+// may be in flight when the loop is canceled, so a few more results may arrive.
+class LobbyScanCallback : public AuthFaceprintsExtractionCallback
+{
+public:
+    LobbyScanCallback(FaceAuthenticatorImpl& authenticator, HostGallery& gallery, unsigned int attempts,
+                      std::chrono::milliseconds handling) :
+        _authenticator(authenticator), _gallery(gallery), _attempts(attempts), _handling(handling)
+    {
+    }
+
+    void OnResult(const AuthenticateStatus status, const Faceprints* faceprints) override
+    {
+        if (status != AuthenticateStatus::Success || faceprints == nullptr)
+        {
+            return;
+        }
+        matched += _gallery.Match(*faceprints).result.success ? 1 : 0;
+        std::this_thread::sleep_for(_handling);
+        if (++count == _attempts)
+        {
+            _authenticator.Cancel();
+        }
+    }
+
+    void OnHint(const AuthenticateStatus hint) override
+    {
+        (void)hint;
+    }
+
+    unsigned int count = 0;
+    unsigned int matched = 0;
+
+private:
+    FaceAuthenticatorImpl& _authenticator;
+    HostGallery& _gallery;
+    unsigned int _attempts;
+    std::chrono::milliseconds _handling;
+};
+
+// cpu time of all the process's threads (linux only, 0 elsewhere)
+double ProcessCpuSeconds()
+{
+#ifdef __linux__
+    struct rusage usage;
+    if (::getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+        return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+               static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+    }
+#endif // __linux__
+    return 0;
+}
+
+// number of threads of the process (linux only, 0 elsewhere)
+unsigned int ProcessThreads()
+{
+    std::ifstream status {"/proc/self/status"};
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.compare(0, 8, "Threads:") == 0)
+        {
+            return static_cast<unsigned int>(std::stoul(line.substr(8)));
+        }
+    }
+    return 0;
+}
+
+// size on the wire of a packet sent with PacketSender::Send()
+size_t FrameSize(const SerialPacket& packet)
+{
+    return sizeof(packet.header) + packet.header.payload_size + sizeof(packet.hmac) + sizeof(packet.crc);
+}
+} // namespace
+
+// authenticator construction and destruction, e.g. the startup of a short lived cli or of an app using only the
+// host side matching. no session is opened.
+static void BM_CreateAuthenticator(benchmark::State& state)
+{
+    for (auto _ : state)
+    {
+        FaceAuthenticatorImpl authenticator {&null_signature_callback};
+        benchmark::DoNotOptimize(&authenticator);
+    }
+}
+
+// session start round trip (the key exchange in the secure session)
+static void BM_StartSession(benchmark::State& state)
+{
+    DeviceEmulator emulator {EmulatorConfig(state)};
+    auto serial = emulator.HostConnection();
+    auto session = CreateSession();
+    for (auto _ : state)
+    {
+        if (session->Start(serial.get()) != SerialStatus::Ok)
+        {
+            state.SkipWithError("StartSession failed");
+            break;
+        }
+    }
+}
+
+static void BM_QueryNumberOfUsers(benchmark::State& state)
+{
+    DeviceEmulator emulator {EmulatorConfig(state)};
+    AddUsers(emulator, 10);
+    auto authenticator = ConnectAuthenticator(emulator);
+    for (auto _ : state)
+    {
+        unsigned int number_of_users = 0;
+        if (authenticator->QueryNumberOfUsers(number_of_users) != Status::Ok || number_of_users != 10)
+        {
+            state.SkipWithError("QueryNumberOfUsers failed");
+            break;
+        }
+    }
+}
+
+static void BM_QueryUserIds(benchmark::State& state)
+{
+    constexpr unsigned int users = 1000;
+    DeviceEmulator emulator {EmulatorConfig(state)};
+    AddUsers(emulator, users);
+    auto authenticator = ConnectAuthenticator(emulator);
+
+    std::vector<std::vector<char>> buffers(users, std::vector<char>(MaxUserIdSize + 1));
+    std::vector<char*> user_ids(users);
+    for (unsigned int i = 0; i < users; i++)
+    {
+        user_ids[i] = buffers[i].data();
+    }
+
+    for (auto _ : state)
+    {
+        unsigned int number_of_users = users;
+        if (authenticator->QueryUserIds(user_ids.data(), number_of_users) != Status::Ok || number_of_users != users)
+        {
+            state.SkipWithError("QueryUserIds failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * users));
+}
+
+// user ids listings requested by several clients at once. coalesced: the async requests share a device exchange
+// (otherwise each client's listing runs on its own)
+static void BM_ConcurrentQueryUserIds(benchmark::State& state, bool coalesced)
+{
+    constexpr unsigned int users = 100;
+    constexpr size_t clients = 8;
+    DeviceEmulator emulator {EmulatorConfig(state)};
+    AddUsers(emulator, users);
+    auto authenticator = ConnectAuthenticator(emulator);
+
+    for (auto _ : state)
+    {
+        CountingUserIdsCallback callbacks[clients];
+        unsigned int numbers_of_users[clients];
+        bool ok = true;
+        if (coalesced)
+        {
+            std::vector<std::future<Status>> results;
+            for (size_t i = 0; i < clients; i++)
+            {
+                numbers_of_users[i] = users;
+                results.push_back(authenticator->QueryUserIdsAsync(callbacks[i], numbers_of_users[i]));
+            }
+            for (auto& result : results)
+            {
+                ok = result.get() == Status::Ok && ok;
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < clients; i++)
+            {
+                numbers_of_users[i] = users;
+                ok = authenticator->QueryUserIds(callbacks[i], numbers_of_users[i]) == Status::Ok && ok;
+            }
+        }
+        for (size_t i = 0; i < clients; i++)
+        {
+            ok = ok && numbers_of_users[i] == users && callbacks[i].count == users;
+        }
+        if (!ok)
+        {
+            state.SkipWithError("QueryUserIds failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * clients));
+}
+
+// pipelined faceprints export. packed: the device supports the packed faceprints messages, large: and the large
+// packets, for batches of users
+static void BM_ExportFaceprints(benchmark::State& state, bool packed, bool large)
+{
+    constexpr unsigned int users = 20;
+    auto config = EmulatorConfig(state);
+    config.packed_faceprints = packed;
+    config.large_payload = large ? MaxLargePayloadSize : 0;
+    DeviceEmulator emulator {config};
+    AddUsers(emulator, users);
+    auto authenticator = ConnectAuthenticator(emulator);
+
+    for (auto _ : state)
+    {
+        CountingExportCallback callback;
+        unsigned int number_of_users = 0;
+        if (authenticator->GetUsersFaceprints(callback, number_of_users) != Status::Ok || callback.count != users)
+        {
+            state.SkipWithError("GetUsersFaceprints failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * users));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * users * DescriptorSize));
+}
+
+// the ids and faceprints of all the users, in large packets: ExportUsers() in a single pass (records), or the ids
+// with QueryUserIds() and then the faceprints with GetUsersFaceprints()
+static void BM_ExportUsers(benchmark::State& state, bool records)
+{
+    constexpr unsigned int users = 20;
+    auto config = EmulatorConfig(state);
+    config.large_payload = MaxLargePayloadSize;
+    DeviceEmulator emulator {config};
+    AddUsers(emulator, users);
+    auto authenticator = ConnectAuthenticator(emulator);
+
+    for (auto _ : state)
+    {
+        unsigned int number_of_users = 0;
+        bool ok = false;
+        if (records)
+        {
+            CountingUsersExportCallback callback;
+            ok = authenticator->ExportUsers(callback, number_of_users) == Status::Ok && callback.count == users;
+        }
+        else
+        {
+            CountingUserIdsCallback ids_callback;
+            CountingExportCallback callback;
+            unsigned int number_of_ids = users;
+            ok = authenticator->QueryUserIds(ids_callback, number_of_ids) == Status::Ok && number_of_ids == users &&
+                 authenticator->GetUsersFaceprints(callback, number_of_users) == Status::Ok && callback.count == users;
+        }
+        if (!ok)
+        {
+            state.SkipWithError("Users export failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * users));
+}
+
+// ExportUsers() in pages of page_size users with a cursor, as a host syncing a large DB with bounded memory does. Each
+// page costs a number of users query and a records request more than the single pass (records)
+static void BM_ExportUsersPages(benchmark::State& state)
+{
+    constexpr unsigned int users = 20;
+    constexpr unsigned int page_size = 5;
+    auto config = EmulatorConfig(state);
+    config.large_payload = MaxLargePayloadSize;
+    DeviceEmulator emulator {config};
+    AddUsers(emulator, users);
+    auto authenticator = ConnectAuthenticator(emulator);
+
+    for (auto _ : state)
+    {
+        CountingUsersExportCallback callback;
+        UsersCursor cursor;
+        auto status = Status::Ok;
+        while (!cursor.done && status == Status::Ok)
+        {
+            status = authenticator->ExportUsers(cursor, page_size, callback);
+        }
+        if (status != Status::Ok || callback.count != users)
+        {
+            state.SkipWithError("Users export failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * users));
+}
+
+// pipelined faceprints import. packed: the device supports the packed faceprints messages, large: and the large
+// packets, for batches of users
+static void BM_ImportFaceprints(benchmark::State& state, bool packed, bool large)
+{
+    constexpr unsigned int users = 20;
+    auto config = EmulatorConfig(state);
+    config.packed_faceprints = packed;
+    config.large_payload = large ? MaxLargePayloadSize : 0;
+    DeviceEmulator emulator {config};
+    auto authenticator = ConnectAuthenticator(emulator);
+
+    std::vector<UserFaceprints> user_faceprints(users);
+    for (unsigned int i = 0; i < users; i++)
+    {
+        user_faceprints[i].user_id = "user_" + std::to_string(i);
+        user_faceprints[i].faceprints = EnrolledFaceprints(i);
+    }
+
+    for (auto _ : state)
+    {
+        if (authenticator->SetUsersFaceprints(user_faceprints.data(), users) != Status::Ok)
+        {
+            state.SkipWithError("SetUsersFaceprints failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * users));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * users * DescriptorSize));
+}
+
+// bulk enrollment of stored photos: the upload of each image overlaps the device's extraction of the previous one.
+// the emulated extraction takes 50 ms, the photos carry 16 KB of exif data that is not uploaded.
+static void BM_EnrollImages(benchmark::State& state)
+{
+    constexpr unsigned int images = 8;
+    auto config = EmulatorConfig(state);
+    config.extract_image_time = timeout_t {50};
+    DeviceEmulator emulator {config};
+    auto authenticator = ConnectAuthenticator(emulator);
+
+    std::vector<std::vector<unsigned char>> jpegs;
+    std::vector<StoredImage> stored_images(images);
+    for (unsigned int i = 0; i < images; i++)
+    {
+        jpegs.push_back(SyntheticJpeg(16 * 1024, 8 * 1024, i));
+        stored_images[i].buffer = jpegs[i].data();
+        stored_images[i].size = static_cast<unsigned int>(jpegs[i].size());
+    }
+
+    for (auto _ : state)
+    {
+        CountingImagesCallback callback;
+        if (authenticator->ExtractFaceprintsFromImages(stored_images.data(), images, callback) != Status::Ok ||
+            callback.count != images)
+        {
+            state.SkipWithError("ExtractFaceprintsFromImages failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * images));
+}
+
+// provisioning in batches (to report progress), each batch persisted to flash or a single commit in a bulk update.
+// the emulated flash commit takes 100 ms.
+static void BM_ImportBatches(benchmark::State& state, bool bulk)
+{
+    constexpr unsigned int users = 100;
+    constexpr unsigned int batch_size = 10;
+    auto config = EmulatorConfig(state);
+    config.standby_time = timeout_t {100};
+    DeviceEmulator emulator {config};
+    auto authenticator = ConnectAuthenticator(emulator);
+    authenticator->SetPersistentSession(false); // as a provisioning app would run it
+
+    std::vector<UserFaceprints> user_faceprints(users);
+    for (unsigned int i = 0; i < users; i++)
+    {
+        user_faceprints[i].user_id = "user_" + std::to_string(i);
+        user_faceprints[i].faceprints = EnrolledFaceprints(i);
+    }
+
+    for (auto _ : state)
+    {
+        bool ok = !bulk || authenticator->BeginBulkUpdate() == Status::Ok;
+        for (unsigned int i = 0; ok && i < users; i += batch_size)
+        {
+            ok = authenticator->SetUsersFaceprints(&user_faceprints[i], batch_size) == Status::Ok;
+        }
+        ok = ok && (!bulk || authenticator->CommitBulkUpdate() == Status::Ok);
+        if (!ok)
+        {
+            state.SkipWithError("SetUsersFaceprints failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * users));
+}
+
+// host gallery / device DB consistency check with one user that differs. checksums: the device supports the users
+// checksums query (otherwise all users are exported)
+static void BM_CompareUsers(benchmark::State& state, bool checksums)
+{
+    constexpr unsigned int users = 100;
+    auto config = EmulatorConfig(state);
+    config.users_checksums = checksums;
+    DeviceEmulator emulator {config};
+    AddUsers(emulator, users);
+    auto authenticator = ConnectAuthenticator(emulator);
+
+    HostGallery gallery;
+    for (unsigned int i = 0; i < users; i++)
+    {
+        gallery.Add(("user_" + std::to_string(i)).c_str(), EnrolledFaceprints(i == 0 ? users : i));
+    }
+
+    for (auto _ : state)
+    {
+        CountingChangesCallback callback;
+        if (authenticator->GetDifferingUsersFaceprints(gallery, callback) != Status::Ok || callback.changed != 1 ||
+            callback.removed != 0)
+        {
+            state.SkipWithError("GetDifferingUsersFaceprints failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * users));
+}
+
+// faceprints of random vectors, unlike each other (a full scan of a gallery of them finds no match)
+static Faceprints RandomFaceprints(std::mt19937& rng)
+{
+    std::uniform_int_distribution<int> feature {-1023, 1023};
+    Faceprints faceprints;
+    ::memset(faceprints.reserved, 0, sizeof(faceprints.reserved));
+    for (size_t i = 0; i < FEATURES_VECTOR_ALLOC_SIZE; i++)
+    {
+        const auto value = static_cast<feature_t>(feature(rng));
+        faceprints.enrollmentDescriptor[i] = value;
+        faceprints.adaptiveDescriptorWithoutMask[i] = value;
+        faceprints.adaptiveDescriptorWithMask[i] = value;
+    }
+    return faceprints;
+}
+
+// host mode enrollment of a new person, checked for duplicates in a HostGallery of 100000 users (a full scan), with
+// enroll_end_ms of device time from the faceprints to the end of the enrollment (921600 baud). overlapped: the gallery
+// variant of ExtractFaceprintsForEnroll(), which searches the gallery meanwhile; otherwise HostGallery::FindUser()
+// after the extraction returned.
+static void BM_EnrollDuplicateCheck(benchmark::State& state, bool overlapped)
+{
+    constexpr unsigned int users = 100000;
+    std::mt19937 rng {1};
+    HostGallery gallery;
+    for (unsigned int i = 0; i < users; i++)
+    {
+        gallery.Add(("user_" + std::to_string(i)).c_str(), RandomFaceprints(rng));
+    }
+    DeviceEmulatorConfig config;
+    config.link.baudrate = 921600;
+    config.enroll_end_time = std::chrono::milliseconds {state.range(0)};
+    DeviceEmulator emulator {config};
+    Faceprints enrollee = RandomFaceprints(rng);
+    const auto* descriptor = reinterpret_cast<const char*>(&enrollee);
+    emulator.SetAuthFaceprints(std::vector<char>(descriptor, descriptor + DescriptorSize));
+    auto authenticator = ConnectAuthenticator(emulator);
+
+    for (auto _ : state)
+    {
+        DuplicateCheckCallback callback;
+        bool ok = authenticator->ExtractFaceprintsForEnroll(overlapped ? &gallery : nullptr, callback) == Status::Ok &&
+                  callback.results == 1;
+        if (ok && !overlapped)
+        {
+            callback.duplicate = gallery.FindUser(callback.faceprints).result.success;
+        }
+        if (!ok || callback.duplicate)
+        {
+            state.SkipWithError("Enrollment failed or found a duplicate");
+            break;
+        }
+    }
+}
+
+// authentication with the device's processing time taken out (the default emulator answers right away).
+// heap_allocs: heap allocations of the calling thread per authentication (the loopback line allocates one for each
+// packet sent, the host's protocol stack none), lib_allocs: those of the library's allocator (SetAllocator()). both
+// after a first authentication that warms up the session. send_us, result_us: the request send and the wait for the
+// result, of the operation's timing breakdown (OnTiming()).
+static void BM_Authenticate(benchmark::State& state)
+{
+    DeviceEmulator emulator {EmulatorConfig(state)};
+    AddUsers(emulator, 1);
+    auto authenticator = ConnectAuthenticator(emulator);
+    NullAuthCallback warm_up;
+    authenticator->Authenticate(warm_up);
+    const unsigned long long heap_allocations = t_heap_allocations;
+    ResetAllocationStats();
+    unsigned long long send_us = 0, result_us = 0;
+    for (auto _ : state)
+    {
+        NullAuthCallback callback;
+        if (authenticator->Authenticate(callback) != Status::Ok ||
+            callback.last_status != AuthenticateStatus::Success)
+        {
+            state.SkipWithError("Authenticate failed");
+            break;
+        }
+        send_us += callback.timing.request_send_us;
+        result_us += callback.timing.until_result_us;
+    }
+    AllocationStats stats;
+    GetAllocationStats(stats);
+    state.counters["heap_allocs"] = benchmark::Counter(static_cast<double>(t_heap_allocations - heap_allocations),
+                                                       benchmark::Counter::kAvgIterations);
+    state.counters["lib_allocs"] =
+        benchmark::Counter(static_cast<double>(stats.allocations), benchmark::Counter::kAvgIterations);
+    state.counters["send_us"] = benchmark::Counter(static_cast<double>(send_us), benchmark::Counter::kAvgIterations);
+    state.counters["result_us"] =
+        benchmark::Counter(static_cast<double>(result_us), benchmark::Counter::kAvgIterations);
+}
+
+// authentication of a device sending face rectangles and hints for 10 frames before the result, with all the events
+// or with only the result (EventFilter): the filtered events are not sent over the link. batches: the device sends
+// the events in message batches
+static void BM_AuthenticateEvents(benchmark::State& state, bool filtered, bool batches)
+{
+    auto config = EmulatorConfig(state);
+    config.message_batches = batches;
+    DeviceEmulator emulator {config};
+    AddUsers(emulator, 1);
+    std::vector<EmulatedFaReply> script;
+    for (int frame = 0; frame < 10; frame++)
+    {
+        script.push_back({MsgId::FaceDetected, 1, ""});
+        script.push_back({MsgId::Hint, static_cast<char>(AuthenticateStatus::CameraStarted), ""});
+    }
+    script.push_back({MsgId::Result, static_cast<char>(AuthenticateStatus::Success), "user_0"});
+    emulator.SetAuthenticateScript(std::move(script));
+    auto authenticator = ConnectAuthenticator(emulator);
+    if (filtered)
+    {
+        EventFilter filter;
+        filter.hints = false;
+        filter.faces = false;
+        authenticator->SetEventFilter(filter);
+    }
+    for (auto _ : state)
+    {
+        NullAuthCallback callback;
+        if (authenticator->Authenticate(callback) != Status::Ok ||
+            callback.last_status != AuthenticateStatus::Success)
+        {
+            state.SkipWithError("Authenticate failed");
+            break;
+        }
+    }
+}
+
+// latency of an authentication queued while an async export of the whole DB runs: the authentication waits for the
+// export's current step only. the iteration time is the authentication's.
+static void BM_AuthenticateDuringExport(benchmark::State& state)
+{
+    constexpr unsigned int users = 100;
+    DeviceEmulator emulator {EmulatorConfig(state)};
+    AddUsers(emulator, users);
+    auto authenticator = ConnectAuthenticator(emulator);
+    for (auto _ : state)
+    {
+        AtomicExportCallback export_callback;
+        unsigned int number_of_users = 0;
+        auto exported = authenticator->GetUsersFaceprintsAsync(export_callback, number_of_users);
+        while (export_callback.count == 0)
+        {
+            std::this_thread::yield();
+        }
+
+        NullAuthCallback callback;
+        const auto start = std::chrono::steady_clock::now();
+        auto authenticated = authenticator->AuthenticateAsync(callback);
+        const bool auth_ok = authenticated.get() == Status::Ok && callback.last_status == AuthenticateStatus::Success;
+        state.SetIterationTime(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        const bool export_ok = exported.get() == Status::Ok && export_callback.count == users;
+        if (!auth_ok || !export_ok)
+        {
+            state.SkipWithError(auth_ok ? "GetUsersFaceprintsAsync failed" : "AuthenticateAsync failed");
+            break;
+        }
+    }
+}
+
+// authentication loop without waits between the attempts and without a persistent session: the loop keeps its
+// session open, so only the first attempt starts a session
+static void BM_AuthenticateLoop(benchmark::State& state)
+{
+    constexpr unsigned int attempts = 20;
+    DeviceEmulator emulator {EmulatorConfig(state)};
+    AddUsers(emulator, 1);
+    auto authenticator = ConnectAuthenticator(emulator);
+    authenticator->SetPersistentSession(false);
+    AuthLoopPolicy policy;
+    policy.interval_with_face_ms = 0;
+    authenticator->SetAuthLoopPolicy(policy);
+    for (auto _ : state)
+    {
+        CancelingAuthCallback callback {*authenticator, attempts};
+        if (authenticator->AuthenticateLoop(callback) != Status::Ok || callback.count != attempts)
+        {
+            state.SkipWithError("AuthenticateLoop failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * attempts));
+}
+
+// scaling of a gateway process serving several devices, e.g. a door controller: devices emulated devices on 921600
+// baud lines, each running ExtractFaceprintsForAuthLoop with interval_ms between its attempts (the loop policy's
+// interval with a face) on a caller thread, and matching the faceprints of every attempt against one shared
+// HostGallery of 10000 users from the loop's callback. an iteration runs 20 attempts on every device.
+// p50_ms / p99_ms / max_ms: latency of the attempts, from the device's face detection event to the match result (the
+// transfer of the result and the faceprints, their handling on the host and the match). the devices send their
+// events unbatched, so the face detection event arrives ahead of the faceprints.
+// cpu_per_device: host cpu seconds per second per device, threads: host threads (the library's and the callers').
+// both without the emulators' threads, linux only.
+static void BM_GatewayLoad(benchmark::State& state)
+{
+    constexpr unsigned int users = 10000;
+    constexpr unsigned int attempts = 20;
+    const auto devices = static_cast<size_t>(state.range(0));
+    HostGallery gallery;
+    for (unsigned int i = 0; i < users; i++)
+    {
+        gallery.Add(("user_" + std::to_string(i)).c_str(), EnrolledFaceprints(i));
+    }
+
+    const unsigned int threads_before = ProcessThreads();
+    DeviceEmulatorConfig config;
+    config.link.baudrate = 921600;
+    config.message_batches = false;
+    AuthLoopPolicy policy;
+    policy.interval_with_face_ms = static_cast<unsigned int>(state.range(1));
+    std::vector<std::unique_ptr<DeviceEmulator>> emulators;
+    std::vector<std::unique_ptr<FaceAuthenticatorImpl>> authenticators;
+    for (size_t d = 0; d < devices; d++)
+    {
+        emulators.push_back(std::make_unique<DeviceEmulator>(config));
+        Faceprints faceprints = EnrolledFaceprints((d * 7919) % users);
+        const auto* descriptor = reinterpret_cast<const char*>(&faceprints);
+        emulators[d]->SetAuthFaceprints(std::vector<char>(descriptor, descriptor + DescriptorSize));
+        emulators[d]->SetAuthenticateScript(
+            {{MsgId::FaceDetected, 1, ""}, {MsgId::Result, static_cast<char>(AuthenticateStatus::Success), ""}});
+        authenticators.push_back(ConnectAuthenticator(*emulators[d]));
+        authenticators[d]->SetAuthLoopPolicy(policy);
+    }
+
+    std::vector<double> latencies_ms;
+    unsigned int max_threads = 0;
+    const double cpu_before = ProcessCpuSeconds();
+    const auto start = std::chrono::steady_clock::now();
+    bool failed = false;
+    for (auto _ : state)
+    {
+        std::vector<std::unique_ptr<GatewayCallback>> callbacks;
+        std::vector<Status> statuses(devices, Status::Error);
+        std::vector<std::thread> loops;
+        std::atomic<size_t> running {devices};
+        for (size_t d = 0; d < devices; d++)
+        {
+            callbacks.push_back(std::make_unique<GatewayCallback>(*authenticators[d], gallery, attempts));
+            loops.emplace_back([&, d]() {
+                statuses[d] = authenticators[d]->ExtractFaceprintsForAuthLoop(*callbacks[d]);
+                running--;
+            });
+        }
+        while (running > 0)
+        {
+            max_threads = std::max(max_threads, ProcessThreads());
+            std::this_thread::sleep_for(std::chrono::milliseconds {10});
+        }
+        bool ok = true;
+        for (size_t d = 0; d < devices; d++)
+        {
+            loops[d].join();
+            ok = ok && statuses[d] == Status::Ok && callbacks[d]->count == attempts && callbacks[d]->failures == 0;
+            latencies_ms.insert(latencies_ms.end(), callbacks[d]->latencies_ms.begin(),
+                                callbacks[d]->latencies_ms.end());
+        }
+        if (!ok)
+        {
+            state.SkipWithError("ExtractFaceprintsForAuthLoop failed or a match failed");
+            failed = true;
+            break;
+        }
+    }
+    if (failed)
+    {
+        return;
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double host_cpu = ProcessCpuSeconds() - cpu_before;
+    for (auto& emulator : emulators)
+    {
+        host_cpu -= emulator->ThreadCpuSeconds();
+    }
+
+    std::sort(latencies_ms.begin(), latencies_ms.end());
+    auto percentile = [&latencies_ms](double p) {
+        return latencies_ms[std::min(latencies_ms.size() - 1, static_cast<size_t>(p * latencies_ms.size()))];
+    };
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * devices * attempts));
+    state.counters["p50_ms"] = percentile(0.5);
+    state.counters["p99_ms"] = percentile(0.99);
+    state.counters["max_ms"] = latencies_ms.back();
+    state.counters["cpu_per_device"] = host_cpu / seconds / static_cast<double>(devices);
+    const unsigned int other_threads = threads_before + static_cast<unsigned int>(devices);
+    state.counters["threads"] = static_cast<double>(max_threads > other_threads ? max_threads - other_threads : 0);
+}
+
+// counts the frames whose face matched the gallery, handling each result for a while (e.g. the access decision and
+// its log)
+class CountingGalleryCallback : public GalleryAuthCallback
+{
+public:
+    explicit CountingGalleryCallback(std::chrono::milliseconds handling = std::chrono::milliseconds {0}) :
+        _handling(handling)
+    {
+    }
+
+    void OnResult(const GalleryFaceResult* results, const size_t n_results, const unsigned int ts) override
+    {
+        (void)ts;
+        matched += (n_results > 0 && results[0].match.result.success) ? 1 : 0;
+        std::this_thread::sleep_for(_handling);
+    }
+
+    unsigned int matched = 0;
+
+private:
+    std::chrono::milliseconds _handling;
+};
+
+// one authenticator shared by several caller threads (e.g. the entry and exit readers of a door on one device),
+// each running AuthenticateWithGallery against one HostGallery of 50000 users, where the user is the last one added
+// (the match scans the whole gallery), and handling each result for handling_ms. the host matching and result
+// handling of a thread overlap the device exchange of the next.
+static void BM_SharedAuthenticator(benchmark::State& state)
+{
+    constexpr unsigned int users = 50000;
+    constexpr unsigned int attempts = 24;
+    const auto threads = static_cast<unsigned int>(state.range(0));
+    const std::chrono::milliseconds handling {state.range(1)};
+    HostGallery gallery;
+    for (unsigned int i = 0; i < users; i++)
+    {
+        gallery.Add(("user_" + std::to_string(i)).c_str(), EnrolledFaceprints(i));
+    }
+
+    DeviceEmulatorConfig config;
+    config.link.baudrate = 921600;
+    DeviceEmulator emulator {config};
+    Faceprints faceprints = EnrolledFaceprints(users - 1);
+    const auto* descriptor = reinterpret_cast<const char*>(&faceprints);
+    emulator.SetAuthFaceprints(std::vector<char>(descriptor, descriptor + DescriptorSize));
+    emulator.SetAuthenticateScript({{MsgId::Result, static_cast<char>(AuthenticateStatus::Success), ""}});
+    auto authenticator = ConnectAuthenticator(emulator);
+
+    for (auto _ : state)
+    {
+        std::vector<CountingGalleryCallback> callbacks(threads, CountingGalleryCallback {handling});
+        std::vector<std::thread> callers;
+        std::atomic<bool> ok {true};
+        for (unsigned int t = 0; t < threads; t++)
+        {
+            callers.emplace_back([&, t]() {
+                for (unsigned int i = t; i < attempts; i += threads)
+                {
+                    if (authenticator->AuthenticateWithGallery(gallery, callbacks[t]) != Status::Ok)
+                    {
+                        ok = false;
+                    }
+                }
+            });
+        }
+        unsigned int matched = 0;
+        for (unsigned int t = 0; t < threads; t++)
+        {
+            callers[t].join();
+            matched += callbacks[t].matched;
+        }
+        if (!ok || matched != attempts)
+        {
+            state.SkipWithError("AuthenticateWithGallery failed or a match failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * attempts));
+}
+
+// continuous lobby scanning: ExtractFaceprintsForAuthLoop with no wait between the attempts, matching every frame
+// against a HostGallery of 10000 users and handling the match for handling_ms, with the results delivered in place or
+// pipelined (the next extraction overlaps the handling of the previous faceprints). items: attempts per second.
+static void BM_LobbyScan(benchmark::State& state, bool pipelined)
+{
+    constexpr unsigned int users = 10000;
+    constexpr unsigned int attempts = 20;
+    const std::chrono::milliseconds handling {state.range(0)};
+    HostGallery gallery;
+    for (unsigned int i = 0; i < users; i++)
+    {
+        gallery.Add(("user_" + std::to_string(i)).c_str(), EnrolledFaceprints(i));
+    }
+
+    DeviceEmulatorConfig config;
+    config.link.baudrate = 921600;
+    DeviceEmulator emulator {config};
+    Faceprints faceprints = EnrolledFaceprints(users / 2);
+    const auto* descriptor = reinterpret_cast<const char*>(&faceprints);
+    emulator.SetAuthFaceprints(std::vector<char>(descriptor, descriptor + DescriptorSize));
+    emulator.SetAuthenticateScript(
+        {{MsgId::FaceDetected, 1, ""}, {MsgId::Result, static_cast<char>(AuthenticateStatus::Success), ""}});
+    auto authenticator = ConnectAuthenticator(emulator);
+    AuthLoopPolicy policy;
+    policy.interval_with_face_ms = 0;
+    policy.pipelined_results = pipelined;
+    authenticator->SetAuthLoopPolicy(policy);
+
+    unsigned int results = 0;
+    for (auto _ : state)
+    {
+        LobbyScanCallback callback {*authenticator, gallery, attempts, handling};
+        const auto status = authenticator->ExtractFaceprintsForAuthLoop(callback);
+        if (status != Status::Ok || callback.count < attempts || callback.matched != callback.count)
+        {
+            state.SkipWithError("ExtractFaceprintsForAuthLoop failed or a match failed");
+            break;
+        }
+        results += callback.count;
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(results));
+}
+
+// identifying the devices of a gateway (ProbeDevices()): the serial number and firmware version queries of every
+// port, all the ports at once (concurrent) or one port after the other as a service without it would.
+static void BM_ProbeDevices(benchmark::State& state, bool concurrent)
+{
+    const auto n_devices = static_cast<size_t>(state.range(0));
+    DeviceEmulatorConfig config;
+    config.link.baudrate = 115200;
+    std::vector<DeviceInfo> devices(n_devices);
+    for (size_t d = 0; d < n_devices; d++)
+    {
+        ::snprintf(devices[d].serialPort, sizeof(devices[d].serialPort), "emulator%zu", d);
+    }
+
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        std::vector<std::unique_ptr<DeviceEmulator>> emulators;
+        for (size_t d = 0; d < n_devices; d++)
+        {
+            config.serial_number = "EMULATED" + std::to_string(d);
+            emulators.push_back(std::make_unique<DeviceEmulator>(config));
+        }
+        auto connect = [&emulators](DeviceControllerImpl& controller, const char* port) {
+            return controller.Connect(emulators[::strtoul(port + 8, nullptr, 10)]->HostConnection());
+        };
+        state.ResumeTiming();
+
+        std::vector<ProbedDevice> results;
+        if (concurrent)
+        {
+            results = DeviceProbe::Probe(devices, false, connect);
+        }
+        else
+        {
+            for (const auto& device : devices)
+            {
+                auto result = DeviceProbe::Probe({device}, false, connect);
+                results.push_back(result[0]);
+            }
+        }
+
+        for (size_t d = 0; d < n_devices; d++)
+        {
+            const auto serial_number = "EMULATED" + std::to_string(d);
+            if (results[d].status != Status::Ok || serial_number != results[d].serialNumber)
+            {
+                state.SkipWithError("ProbeDevices failed or identified the wrong device");
+                return;
+            }
+        }
+        state.PauseTiming();
+        emulators.clear();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * n_devices));
+}
+
+#ifndef RSID_SECURE
+// authentication replayed from a trace of the emulator's (ReplaySerial): the device replies at the recorded delays,
+// host_us is the host's time before its sends (the replay's, recorded_host_us the recording's)
+static void BM_ReplayAuthenticate(benchmark::State& state)
+{
+    const std::string trace_path = "rsid_bench_replay.trace";
+    {
+        DeviceEmulator emulator {EmulatorConfig(state)};
+        AddUsers(emulator, 1);
+        auto authenticator = ConnectAuthenticator(emulator);
+        SerialTrace::Start(1 << 20);
+        NullAuthCallback callback;
+        const auto status = authenticator->Authenticate(callback);
+        SerialTrace::Stop();
+        if (status != Status::Ok || !SerialTrace::Dump(trace_path.c_str()))
+        {
+            state.SkipWithError("Recording failed");
+            return;
+        }
+    }
+    std::vector<ReplayRecord> records;
+    std::string error;
+    const bool loaded = ReplaySerial::LoadTrace(trace_path.c_str(), 0, records, error);
+    ::remove(trace_path.c_str());
+    if (!loaded)
+    {
+        state.SkipWithError(error.c_str());
+        return;
+    }
+
+    unsigned long long host_us = 0, recorded_host_us = 0;
+    for (auto _ : state)
+    {
+        auto serial = std::make_unique<ReplaySerial>(records);
+        auto* replay = serial.get();
+        FaceAuthenticatorImpl authenticator {&null_signature_callback};
+        authenticator.Connect(std::move(serial));
+        NullAuthCallback callback;
+        std::string divergence;
+        if (authenticator.Authenticate(callback) != Status::Ok || callback.last_status != AuthenticateStatus::Success ||
+            replay->Diverged(divergence))
+        {
+            state.SkipWithError("Replay failed");
+            break;
+        }
+        for (const auto& timing : replay->SendTimings())
+        {
+            host_us += timing.replay_us;
+            recorded_host_us += timing.recorded_us;
+        }
+    }
+    state.counters["host_us"] = benchmark::Counter(static_cast<double>(host_us), benchmark::Counter::kAvgIterations);
+    state.counters["recorded_host_us"] =
+        benchmark::Counter(static_cast<double>(recorded_host_us), benchmark::Counter::kAvgIterations);
+}
+#endif // RSID_SECURE
+
+// data packet sent by PacketSender and echoed back by a PacketSender on the other end of the line: framing, crc and
+// transmit time, without a session. two packets per iteration.
+static void BM_PacketRoundTrip(benchmark::State& state)
+{
+    LoopbackConfig config;
+    config.baudrate = static_cast<unsigned int>(state.range(0));
+    auto ends = LoopbackSerial::CreatePair(config);
+    std::unique_ptr<LoopbackSerial> host_end = std::move(ends.first);
+    std::unique_ptr<LoopbackSerial> echo_end = std::move(ends.second);
+
+    std::atomic<bool> stop {false};
+    std::thread echo_thread {[&echo_end, &stop]() {
+        PacketSender sender {echo_end.get()};
+        sender.SetWaitHandler([&stop]() { return stop ? SerialStatus::RecvFailed : SerialStatus::Ok; });
+        while (!stop)
+        {
+            SerialPacket packet;
+            if (sender.Recv(packet) == SerialStatus::Ok)
+            {
+                sender.Send(packet);
+            }
+        }
+    }};
+
+    std::vector<char> data(static_cast<size_t>(state.range(1)), 1);
+    DataPacket packet {MsgId::GetUserFeatures, data.data(), data.size()};
+    PacketSender sender {host_end.get()};
+    for (auto _ : state)
+    {
+        SerialPacket reply;
+        if (sender.Send(packet) != SerialStatus::Ok || sender.Recv(reply) != SerialStatus::Ok ||
+            reply.header.id != packet.header.id)
+        {
+            state.SkipWithError("Round trip failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * 2));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * 2 * FrameSize(packet)));
+
+    stop = true;
+    echo_end->InterruptRecv();
+    echo_thread.join();
+}
+
+// crc of a full data packet
+static void BM_Crc(benchmark::State& state)
+{
+    std::vector<char> data(sizeof(DataMessage::data), 1);
+    DataPacket packet {MsgId::GetUserFeatures, data.data(), data.size()};
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(PacketSender::CalcCrc(packet));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * FrameSize(packet)));
+}
+
+#ifdef RSID_SECURE
+// the secure session's cost per packet: encrypt + hmac by the sender, hmac + decrypt by the receiver, of a data
+// packet of the given payload size
+static void BM_PacketCrypto(benchmark::State& state)
+{
+    // key exchange between two wrappers, like the host and the device
+    MbedtlsWrapper sender_crypto;
+    MbedtlsWrapper receiver_crypto;
+    auto sign = [](const unsigned char* buffer, const unsigned int buffer_len, unsigned char* out_sig) {
+        return null_signature_callback.Sign(buffer, buffer_len, out_sig);
+    };
+    auto verify = [](const unsigned char* buffer, const unsigned int buffer_len, const unsigned char* sig,
+                     const unsigned int sig_len) {
+        return null_signature_callback.Verify(buffer, buffer_len, sig, sig_len);
+    };
+    unsigned char* receiver_key = receiver_crypto.GetSignedEcdhPubkey(sign);
+    unsigned char* sender_key = sender_crypto.GetSignedEcdhPubkey(sign);
+    if (receiver_key == nullptr || sender_key == nullptr || !sender_crypto.VerifyEcdhSignedKey(receiver_key, verify) ||
+        !receiver_crypto.VerifyEcdhSignedKey(sender_key, verify))
+    {
+        state.SkipWithError("Key exchange failed");
+        return;
+    }
+
+    std::vector<char> data(static_cast<size_t>(state.range(0)), 1);
+    DataPacket packet {MsgId::GetUserFeatures, data.data(), data.size()};
+    auto* payload = reinterpret_cast<unsigned char*>(&packet.payload);
+    auto* packet_ptr = reinterpret_cast<unsigned char*>(&packet);
+    const unsigned int content_size = sizeof(packet.header) + packet.header.payload_size;
+    for (auto _ : state)
+    {
+        unsigned char hmac[HMAC_256_SIZE_BYTES];
+        bool ok = sender_crypto.GenerateRandom(packet.header.iv, sizeof(packet.header.iv)) &&
+                  sender_crypto.Encrypt(packet.header.iv, payload, payload, packet.header.payload_size) &&
+                  sender_crypto.CalcHmac(packet_ptr, content_size, reinterpret_cast<unsigned char*>(packet.hmac)) &&
+                  receiver_crypto.CalcHmac(packet_ptr, content_size, hmac) &&
+                  ::memcmp(hmac, packet.hmac, sizeof(hmac)) == 0 &&
+                  receiver_crypto.Decrypt(packet.header.iv, payload, payload, packet.header.payload_size);
+        if (!ok)
+        {
+            state.SkipWithError("Packet crypto failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * FrameSize(packet)));
+}
+#endif // RSID_SECURE
+
+// {baudrate, latency ms}
+static void LinkArgs(benchmark::internal::Benchmark* benchmark)
+{
+    benchmark->ArgNames({"baud", "latency_ms"});
+    benchmark->Args({0, 0});
+    for (long baudrate : {115200, 460800, 921600, 3000000})
+    {
+        benchmark->Args({baudrate, 0});
+    }
+    benchmark->Args({115200, 1});
+}
+
+// {baudrate, data size}: an empty data packet and a full one
+static void PacketArgs(benchmark::internal::Benchmark* benchmark)
+{
+    benchmark->ArgNames({"baud", "data_size"});
+    for (long baudrate : {0, 115200, 460800, 921600, 3000000})
+    {
+        benchmark->Args({baudrate, 0});
+        benchmark->Args({baudrate, static_cast<long>(sizeof(DataMessage::data))});
+    }
+}
+
+BENCHMARK(BM_CreateAuthenticator)->UseRealTime();
+BENCHMARK(BM_StartSession)->Apply(LinkArgs)->UseRealTime();
+BENCHMARK(BM_QueryNumberOfUsers)->Apply(LinkArgs)->UseRealTime();
+BENCHMARK(BM_QueryUserIds)->Apply(LinkArgs)->UseRealTime();
+BENCHMARK_CAPTURE(BM_ConcurrentQueryUserIds, coalesced, true)->Apply(LinkArgs)->UseRealTime();
+BENCHMARK_CAPTURE(BM_ConcurrentQueryUserIds, serial, false)->Apply(LinkArgs)->UseRealTime();
+BENCHMARK_CAPTURE(BM_ExportFaceprints, large, true, true)->Apply(LinkArgs)->UseRealTime();
+BENCHMARK_CAPTURE(BM_ExportFaceprints, packed, true, false)->Apply(LinkArgs)->UseRealTime();
+BENCHMARK_CAPTURE(BM_ExportFaceprints, full, false, false)->Apply(LinkArgs)->UseRealTime();
+BENCHMARK_CAPTURE(BM_ExportUsers, records, true)->Apply(LinkArgs)->UseRealTime();
+BENCHMARK_CAPTURE(BM_ExportUsers, ids_then_faceprints, false)->Apply(LinkArgs)->UseRealTime();
+BENCHMARK(BM_ExportUsersPages)->Apply(LinkArgs)->UseRealTime();
+BENCHMARK_CAPTURE(BM_ImportFaceprints, large, true, true)->Apply(LinkArgs)->UseRealTime();
+BENCHMARK_CAPTURE(BM_ImportFaceprints, packed, true, false)->Apply(LinkArgs)->UseRealTime();
+BENCHMARK_CAPTURE(BM_ImportFaceprints, full, false, false)->Apply(LinkArgs)->UseRealTime();
+BENCHMARK_CAPTURE(BM_ImportBatches, bulk, true)->Apply(LinkArgs)->UseRealTime();
+BENCHMARK_CAPTURE(BM_ImportBatches, batches, false)->Apply(LinkArgs)->UseRealTime();
+BENCHMARK_CAPTURE(BM_CompareUsers, checksums, true)->Apply(LinkArgs)->UseRealTime();
+BENCHMARK_CAPTURE(BM_CompareUsers, export, false)->Apply(LinkArgs)->UseRealTime();
+BENCHMARK(BM_EnrollImages)->ArgNames({"baud", "latency_ms"})->Args({921600, 0})->Args({3000000, 0})->UseRealTime();
+BENCHMARK_CAPTURE(BM_EnrollDuplicateCheck, overlapped, true)->ArgName("enroll_end_ms")->Arg(0)->Arg(20)->UseRealTime();
+BENCHMARK_CAPTURE(BM_EnrollDuplicateCheck, after, false)->ArgName("enroll_end_ms")->Arg(0)->Arg(20)->UseRealTime();
+BENCHMARK(BM_Authenticate)->Apply(LinkArgs)->UseRealTime();
+BENCHMARK(BM_AuthenticateLoop)->Apply(LinkArgs)->UseRealTime();
+BENCHMARK_CAPTURE(BM_AuthenticateEvents, all, false, true)->Apply(LinkArgs)->UseRealTime();
+BENCHMARK_CAPTURE(BM_AuthenticateEvents, unbatched, false, false)->Apply(LinkArgs)->UseRealTime();
+BENCHMARK_CAPTURE(BM_AuthenticateEvents, filtered, true, true)->Apply(LinkArgs)->UseRealTime();
+BENCHMARK(BM_AuthenticateDuringExport)->Apply(LinkArgs)->UseManualTime();
+BENCHMARK(BM_GatewayLoad)
+    ->ArgNames({"devices", "interval_ms"})
+    ->ArgsProduct({{1, 2, 4, 8, 16, 32}, {0, 100}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK_CAPTURE(BM_LobbyScan, pipelined, true)
+    ->ArgName("handling_ms")
+    ->Arg(0)
+    ->Arg(20)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK_CAPTURE(BM_LobbyScan, in_place, false)
+    ->ArgName("handling_ms")
+    ->Arg(0)
+    ->Arg(20)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK(BM_SharedAuthenticator)
+    ->ArgNames({"threads", "handling_ms"})
+    ->ArgsProduct({{1, 2}, {0, 10}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK_CAPTURE(BM_ProbeDevices, concurrent, true)
+    ->ArgName("devices")
+    ->Arg(1)
+    ->Arg(40)
+    ->Iterations(3)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK_CAPTURE(BM_ProbeDevices, sequential, false)
+    ->ArgName("devices")
+    ->Arg(1)
+    ->Arg(40)
+    ->Iterations(1)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+#ifndef RSID_SECURE
+BENCHMARK(BM_ReplayAuthenticate)->Apply(LinkArgs)->UseRealTime();
+#endif // RSID_SECURE
+BENCHMARK(BM_PacketRoundTrip)->Apply(PacketArgs)->UseRealTime();
+BENCHMARK(BM_Crc);
+#ifdef RSID_SECURE
+BENCHMARK(BM_PacketCrypto)->ArgName("data_size")->Arg(0)->Arg(static_cast<long>(sizeof(DataMessage::data)));
+#endif // RSID_SECURE
+
+BENCHMARK_MAIN();
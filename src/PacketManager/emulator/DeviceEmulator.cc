@@ -0,0 +1,1181 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "DeviceEmulator.h"
+#include "PacketParser.h"
+#include "PacketSender.h"
+#include "EnrollImage.h"
+#include "PackedFaceprints.h"
+#include "SessionOptions.h"
+#include "UsersChecksum.h"
+#include "Logger.h"
+#ifdef RSID_SECURE
+#endif // RSID_SECURE
+#include "RealSenseID/AuthenticateStatus.h"
+#include "RealSenseID/EnrollStatus.h"
+#include "RealSenseID/FaceRect.h"
+#include "RealSenseID/Status.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <string.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <time.h>
+#endif // __linux__
+
+static const char* LOG_TAG = "DeviceEmulator";
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+static constexpr size_t UserIdBufferSize = MaxUserIdSize + 1;
+
+static size_t DataSize(const SerialPacket& packet)
+{
+    size_t payload_size = std::min<size_t>(packet.header.payload_size, sizeof(packet.payload));
+    return payload_size > sizeof(packet.payload.sequence_number)
+               ? payload_size - sizeof(packet.payload.sequence_number)
+               : 0;
+}
+
+static char ToStatusCode(Status status)
+{
+    return static_cast<char>(status);
+}
+
+DeviceEmulator::DeviceEmulator(const DeviceEmulatorConfig& config) : _config {config}
+{
+    auto ends = LoopbackSerial::CreatePair(config.link);
+    _host_end = std::move(ends.first);
+    _device_end = std::move(ends.second);
+#ifdef RSID_SECURE
+    _crypto_wrapper.PrepareNextEcdhKey(); // ready by the first session
+#endif // RSID_SECURE
+    _thread = std::thread {&DeviceEmulator::ThreadLoop, this};
+}
+
+DeviceEmulator::~DeviceEmulator()
+{
+    try
+    {
+        _stop = true;
+        _device_end->InterruptRecv();
+        if (_thread.joinable())
+        {
+            _thread.join();
+        }
+    }
+    catch (...)
+    {
+    }
+}
+
+std::unique_ptr<SerialConnection> DeviceEmulator::HostConnection()
+{
+    return std::move(_host_end);
+}
+
+void DeviceEmulator::SetUser(const std::string& user_id, std::vector<char> descriptor)
+{
+    std::lock_guard<std::mutex> lock {_mutex};
+    auto it = std::find_if(_users.begin(), _users.end(), [&](const User& user) { return user.user_id == user_id; });
+    if (it != _users.end())
+    {
+        it->descriptor = std::move(descriptor);
+        return;
+    }
+    _users.push_back(User {user_id, std::move(descriptor)});
+}
+
+size_t DeviceEmulator::NumberOfUsers() const
+{
+    std::lock_guard<std::mutex> lock {_mutex};
+    return _users.size();
+}
+
+void DeviceEmulator::SetAuthenticateScript(std::vector<EmulatedFaReply> replies)
+{
+    std::lock_guard<std::mutex> lock {_mutex};
+    _authenticate_script = std::move(replies);
+}
+
+void DeviceEmulator::SetAuthFaceprints(std::vector<char> descriptor)
+{
+    std::lock_guard<std::mutex> lock {_mutex};
+    _auth_faceprints = std::move(descriptor);
+}
+
+unsigned int DeviceEmulator::PacketsHandled() const
+{
+    return _packets_handled;
+}
+
+double DeviceEmulator::ThreadCpuSeconds()
+{
+#ifdef __linux__
+    clockid_t clock_id;
+    struct timespec cpu_time;
+    if (::pthread_getcpuclockid(_thread.native_handle(), &clock_id) == 0 && ::clock_gettime(clock_id, &cpu_time) == 0)
+    {
+        return static_cast<double>(cpu_time.tv_sec) + static_cast<double>(cpu_time.tv_nsec) * 1e-9;
+    }
+#endif // __linux__
+    return 0;
+}
+
+void DeviceEmulator::ThreadLoop()
+{
+    PacketParser parser {[this](SerialStatus status, const SerialPacket& packet) {
+        if (status != SerialStatus::Ok)
+        {
+            LOG_WARNING(LOG_TAG, "Dropped invalid packet (status %d)", static_cast<int>(status));
+            return;
+        }
+        OnFrame(packet);
+    }};
+    parser.SetLargePacketCallback([this](SerialStatus status, const LargePacket& packet) {
+        if (status != SerialStatus::Ok)
+        {
+            LOG_WARNING(LOG_TAG, "Dropped invalid large packet (status %d)", static_cast<int>(status));
+            return;
+        }
+        OnLargeFrame(packet);
+    });
+
+    char buffer[4096];
+    while (!_stop)
+    {
+        size_t n_bytes_read = 0;
+        auto status = _device_end->RecvAvailable(buffer, sizeof(buffer), n_bytes_read);
+        if (status == SerialStatus::Ok)
+        {
+            OnText(buffer, n_bytes_read);
+            parser.Feed(buffer, n_bytes_read);
+        }
+        else if (status == SerialStatus::RecvFailed)
+        {
+            LOG_DEBUG(LOG_TAG, "Host end closed");
+            return;
+        }
+    }
+}
+
+// the text commands are lines of printable characters, the packets' bytes around them are skipped
+void DeviceEmulator::OnText(const char* data, size_t size)
+{
+    constexpr size_t max_line_size = 32;
+    for (size_t i = 0; i < size; i++)
+    {
+        const char c = data[i];
+        if (c != '\r' && c != '\n')
+        {
+            bool printable = c >= ' ' && c <= '~';
+            if (!printable || _text_line.size() == max_line_size)
+            {
+                _text_line.clear();
+            }
+            else
+            {
+                _text_line += c;
+            }
+            continue;
+        }
+
+        std::string answer;
+        if (_text_line == "bspver")
+        {
+            std::stringstream modules(_config.firmware_version);
+            std::string module;
+            while (std::getline(modules, module, '|'))
+            {
+                auto colon = module.find(':');
+                answer += module.substr(0, colon) + " : " + module.substr(colon + 1) + "\r\n";
+            }
+        }
+        else if (_text_line == "bspver -device")
+        {
+            answer = "SN : [" + _config.serial_number + "]\r\n";
+        }
+        _text_line.clear();
+        if (!answer.empty() && _device_end->SendBytes(answer.data(), answer.size()) != SerialStatus::Ok)
+        {
+            LOG_WARNING(LOG_TAG, "Failed sending text answer");
+        }
+    }
+}
+
+void DeviceEmulator::OnFrame(const SerialPacket& packet)
+{
+    _packets_handled++;
+    if (_config.command_time.count() > 0)
+    {
+        std::this_thread::sleep_for(_config.command_time);
+    }
+
+    if (packet.header.id == MsgId::Ping)
+    {
+        OnPing(packet);
+        return;
+    }
+#ifdef RSID_SECURE
+    if (packet.header.id == MsgId::HostEcdhKey)
+    {
+        OnHostEcdhKey(packet);
+        return;
+    }
+    SerialPacket decrypted = packet;
+    if (!Decrypt(decrypted))
+    {
+        LOG_WARNING(LOG_TAG, "Dropped packet '%c': invalid hmac", static_cast<char>(packet.header.id));
+        return;
+    }
+    _collect_replies = _session_options.batches;
+    HandlePacket(decrypted);
+#else
+    _collect_replies = _session_options.batches;
+    HandlePacket(packet);
+#endif // RSID_SECURE
+    FlushReplies();
+}
+
+void DeviceEmulator::OnLargeFrame(const LargePacket& packet)
+{
+    _packets_handled++;
+    if (_config.command_time.count() > 0)
+    {
+        std::this_thread::sleep_for(_config.command_time);
+    }
+#ifdef RSID_SECURE
+    std::unique_ptr<LargePacket> decrypted {new LargePacket(packet)};
+    if (!Decrypt(*decrypted))
+    {
+        LOG_WARNING(LOG_TAG, "Dropped large packet '%c': invalid hmac", static_cast<char>(packet.header.id));
+        return;
+    }
+    HandleLargePacket(*decrypted);
+#else
+    HandleLargePacket(packet);
+#endif // RSID_SECURE
+}
+
+void DeviceEmulator::ApplySessionOptions(const SessionOptions& options, unsigned char* reply_data)
+{
+    _session_options = options;
+    const size_t device_payload = _config.packed_faceprints ? _config.large_payload : 0;
+    const size_t large_payload =
+        std::min({static_cast<size_t>(options.large_payload), device_payload, MaxLargePayloadSize}) & ~size_t {31};
+    _session_options.large_payload = static_cast<uint16_t>(large_payload);
+    _large_payload_size = large_payload;
+    _session_options.batches = options.batches && _config.message_batches;
+    WriteSessionOptions(_session_options, reply_data);
+}
+
+void DeviceEmulator::HandlePacket(const SerialPacket& packet)
+{
+    switch (packet.header.id)
+    {
+    case MsgId::StartSession: {
+        _last_sent_seq_number = 0;
+        SessionOptions options;
+        ReadSessionOptions(reinterpret_cast<const unsigned char*>(packet.payload.message.data_msg.data),
+                           DataSize(packet), options);
+        unsigned char reply_data[SessionOptionsSize];
+        ApplySessionOptions(options, reply_data);
+        DataPacket reply {MsgId::StartSession, reinterpret_cast<char*>(reply_data), sizeof(reply_data)};
+        WriteFrame(reply);
+        break;
+    }
+
+    case MsgId::GetNumberOfUsers: {
+        uint32_t number_of_users = static_cast<uint32_t>(NumberOfUsers());
+        DataPacket reply {MsgId::GetNumberOfUsers, reinterpret_cast<char*>(&number_of_users),
+                          sizeof(number_of_users)};
+        Send(reply);
+        break;
+    }
+
+    case MsgId::GetUserIds:
+        OnGetUserIds(packet);
+        break;
+
+    case MsgId::GetUserFeatures:
+        OnGetUserFeatures(packet);
+        break;
+
+    case MsgId::SetUserFeatures:
+        OnSetUserFeatures(packet);
+        break;
+
+    case MsgId::GetUserFeaturesPacked:
+        if (!_config.packed_faceprints)
+        {
+            SendFaReply(MsgId::Reply, ToStatusCode(Status::Error));
+            break;
+        }
+        OnGetUserFeaturesPacked(packet);
+        break;
+
+    case MsgId::SetUserFeaturesPacked:
+        if (!_config.packed_faceprints)
+        {
+            SendFaReply(MsgId::Reply, ToStatusCode(Status::Error));
+            break;
+        }
+        OnSetUserFeaturesPacked(packet);
+        break;
+
+    case MsgId::GetUsersChecksums:
+        if (!_config.users_checksums)
+        {
+            SendFaReply(MsgId::Reply, ToStatusCode(Status::Error));
+            break;
+        }
+        OnGetUsersChecksums(packet);
+        break;
+
+    case MsgId::EnrollImage:
+        if (!_config.enroll_images)
+        {
+            SendFaReply(MsgId::Reply, ToStatusCode(Status::Error));
+            break;
+        }
+        OnEnrollImage(packet);
+        break;
+
+    case MsgId::RemoveUser:
+        OnRemoveUser(packet);
+        break;
+
+    case MsgId::RemoveAllUsers: {
+        {
+            std::lock_guard<std::mutex> lock {_mutex};
+            _users.clear();
+        }
+        SendFaReply(MsgId::Reply, ToStatusCode(Status::Ok));
+        break;
+    }
+
+    case MsgId::StandBy:
+        if (_config.standby_time.count() > 0)
+        {
+            std::this_thread::sleep_for(_config.standby_time);
+        }
+        SendFaReply(MsgId::Reply, ToStatusCode(Status::Ok));
+        break;
+
+    case MsgId::Authenticate:
+        OnAuthenticate(false);
+        break;
+
+    case MsgId::AuthenticateFaceprintsExtraction:
+        OnAuthenticate(true);
+        break;
+
+    case MsgId::EnrollFaceprintsExtraction:
+        OnEnrollFaceprintsExtraction();
+        break;
+
+    case MsgId::Batch: {
+        MessageBatchReader batch;
+        if (!_session_options.batches || !batch.Load(packet))
+        {
+            SendFaReply(MsgId::Reply, ToStatusCode(Status::Error));
+            break;
+        }
+        SerialPacket message;
+        while (batch.Next(message))
+        {
+            HandlePacket(message);
+        }
+        break;
+    }
+
+    default:
+        LOG_WARNING(LOG_TAG, "Unsupported packet '%c'", static_cast<char>(packet.header.id));
+        SendFaReply(MsgId::Reply, ToStatusCode(Status::Error));
+        break;
+    }
+}
+
+// large packets are taken in a session that negotiated them
+void DeviceEmulator::HandleLargePacket(const LargePacket& packet)
+{
+    if (_large_payload_size == 0 || packet.header.payload_size > _large_payload_size)
+    {
+        LOG_WARNING(LOG_TAG, "Unexpected large packet '%c'", static_cast<char>(packet.header.id));
+        SendFaReply(MsgId::Reply, ToStatusCode(Status::Error));
+        return;
+    }
+    if (!_large_reply)
+    {
+        _large_reply.reset(new LargePacket);
+    }
+
+    switch (packet.header.id)
+    {
+    case MsgId::GetUserIds:
+        OnGetUserIdsLarge(packet);
+        break;
+
+    case MsgId::GetUserFeaturesPacked:
+        OnGetUserFeaturesLarge(packet, false);
+        break;
+
+    case MsgId::GetUserRecordsPacked:
+        if (!_config.user_records)
+        {
+            SendFaReply(MsgId::Reply, ToStatusCode(Status::Error));
+            break;
+        }
+        OnGetUserFeaturesLarge(packet, true);
+        break;
+
+    case MsgId::SetUserFeaturesPacked:
+        OnSetUserFeaturesLarge(packet);
+        break;
+
+    default:
+        LOG_WARNING(LOG_TAG, "Unsupported large packet '%c'", static_cast<char>(packet.header.id));
+        SendFaReply(MsgId::Reply, ToStatusCode(Status::Error));
+        break;
+    }
+}
+
+size_t DeviceEmulator::WriteUserIds(unsigned int first, unsigned int count, char* data, size_t capacity)
+{
+    unsigned int arrived_users = 0;
+    size_t offset = sizeof(arrived_users);
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        for (size_t i = first; i < _users.size() && arrived_users < count; i++)
+        {
+            const auto& user_id = _users[i].user_id;
+            if (offset + user_id.size() + 1 > capacity)
+            {
+                break;
+            }
+            ::memcpy(data + offset, user_id.c_str(), user_id.size() + 1);
+            offset += user_id.size() + 1;
+            arrived_users++;
+        }
+    }
+    ::memcpy(data, &arrived_users, sizeof(arrived_users));
+    return offset;
+}
+
+// request: first index and count (two unsigned ints). reply: number of ids sent and the zero delimited ids
+void DeviceEmulator::OnGetUserIds(const SerialPacket& packet)
+{
+    unsigned int settings[2] = {0, 0};
+    ::memcpy(settings, packet.payload.message.data_msg.data, std::min(sizeof(settings), DataSize(packet)));
+
+    char data[sizeof(DataMessage::data)] = {0};
+    const size_t size = WriteUserIds(settings[0], settings[1], data, sizeof(data));
+    DataPacket reply {MsgId::GetUserIds, data, size};
+    Send(reply);
+}
+
+// as OnGetUserIds(), up to the session's large payload
+void DeviceEmulator::OnGetUserIdsLarge(const LargePacket& packet)
+{
+    unsigned int settings[2] = {0, 0};
+    ::memcpy(settings, packet.Data(), std::min(sizeof(settings), packet.DataSize()));
+    const size_t size = WriteUserIds(settings[0], settings[1], _large_reply->Data(),
+                                     _large_payload_size - sizeof(_large_reply->payload.sequence_number));
+    _large_reply->SetData(MsgId::GetUserIds, size);
+    Send(*_large_reply);
+}
+
+// request: first index and count, u16, or u32 after a zero u16 first index and count. reply: the number of users
+// sent (u16), then the packed faceprints size (u16) and packed faceprints of each, as many as fit. with_user_ids: each
+// user's zero terminated id before its faceprints
+void DeviceEmulator::OnGetUserFeaturesLarge(const LargePacket& packet, bool with_user_ids)
+{
+    const auto reply_id = with_user_ids ? MsgId::GetUserRecordsPacked : MsgId::GetUserFeaturesPacked;
+    uint16_t short_arguments[2] = {0, 0};
+    ::memcpy(short_arguments, packet.Data(), std::min(sizeof(short_arguments), packet.DataSize()));
+    uint32_t arguments[2] = {short_arguments[0], short_arguments[1]};
+    if (arguments[1] == 0 && packet.DataSize() >= sizeof(short_arguments) + sizeof(arguments))
+    {
+        ::memcpy(arguments, packet.Data() + sizeof(short_arguments), sizeof(arguments));
+    }
+    auto* data = reinterpret_cast<unsigned char*>(_large_reply->Data());
+    const size_t capacity = _large_payload_size - sizeof(_large_reply->payload.sequence_number);
+    uint16_t sent = 0;
+    size_t offset = LargeBatchHeaderSize;
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        for (size_t i = arguments[0]; i < _users.size() && sent < arguments[1]; i++)
+        {
+            Faceprints faceprints;
+            unsigned char packed[MaxPackedFaceprintsSize];
+            size_t packed_size = 0;
+            if (_users[i].descriptor.size() == sizeof(faceprints))
+            {
+                ::memcpy(&faceprints, _users[i].descriptor.data(), sizeof(faceprints));
+                packed_size = PackFaceprints(faceprints, packed);
+            }
+            const auto& user_id = _users[i].user_id;
+            const size_t id_size = with_user_ids ? user_id.size() + 1 : 0;
+            if (packed_size == 0 || offset + id_size + 2 + packed_size > capacity)
+            {
+                break;
+            }
+            ::memcpy(data + offset, user_id.c_str(), id_size);
+            offset += id_size;
+            data[offset] = static_cast<unsigned char>(packed_size);
+            data[offset + 1] = static_cast<unsigned char>(packed_size >> 8);
+            ::memcpy(data + offset + 2, packed, packed_size);
+            offset += 2 + packed_size;
+            sent++;
+        }
+    }
+    if (sent == 0)
+    {
+        LOG_WARNING(LOG_TAG, "%c: no packable user at index %u", static_cast<char>(reply_id),
+                    static_cast<unsigned int>(arguments[0]));
+        SendFaReply(MsgId::Reply, ToStatusCode(Status::Error));
+        return;
+    }
+    ::memcpy(data, &sent, sizeof(sent));
+    _large_reply->SetData(reply_id, offset);
+    Send(*_large_reply);
+}
+
+// request: number of users (u16), then the user id (31 bytes), packed faceprints size (u16) and packed faceprints of
+// each. reply: the number of users (u16) and a status (u8, 0 if set) of each
+void DeviceEmulator::OnSetUserFeaturesLarge(const LargePacket& packet)
+{
+    const auto* data = reinterpret_cast<const unsigned char*>(packet.Data());
+    const size_t data_size = packet.DataSize();
+    uint16_t count = 0;
+    ::memcpy(&count, data, std::min(sizeof(count), data_size));
+    const size_t capacity = _large_payload_size - sizeof(_large_reply->payload.sequence_number);
+    if (data_size < LargeBatchHeaderSize || LargeBatchHeaderSize + count > capacity)
+    {
+        LOG_WARNING(LOG_TAG, "SetUserFeaturesPacked: malformed packet");
+        SendFaReply(MsgId::Reply, ToStatusCode(Status::Error));
+        return;
+    }
+
+    auto* statuses = reinterpret_cast<unsigned char*>(_large_reply->Data());
+    ::memcpy(statuses, &count, sizeof(count));
+    size_t offset = LargeBatchHeaderSize;
+    bool malformed = false;
+    for (uint16_t i = 0; i < count; i++)
+    {
+        size_t packed_size = 0;
+        if (!malformed && offset + UserIdBufferSize + 2 <= data_size)
+        {
+            const unsigned char* size_bytes = data + offset + UserIdBufferSize;
+            packed_size = static_cast<size_t>(size_bytes[0] | (size_bytes[1] << 8));
+        }
+        Faceprints faceprints;
+        malformed = malformed || offset + UserIdBufferSize + 2 + packed_size > data_size ||
+                    !UnpackFaceprints(data + offset + UserIdBufferSize + 2, packed_size, faceprints);
+        statuses[LargeBatchHeaderSize + i] = malformed ? 1 : 0;
+        if (malformed)
+        {
+            continue; // the rest cannot be found
+        }
+        char user_id[UserIdBufferSize];
+        ::memcpy(user_id, data + offset, sizeof(user_id));
+        user_id[MaxUserIdSize] = '\0';
+        const auto* descriptor = reinterpret_cast<const char*>(&faceprints);
+        SetUser(user_id, std::vector<char>(descriptor, descriptor + sizeof(faceprints)));
+        offset += UserIdBufferSize + 2 + packed_size;
+    }
+    _large_reply->SetData(MsgId::SetUserFeaturesPacked, LargeBatchHeaderSize + count);
+    Send(*_large_reply);
+}
+
+// request: user index (uint32_t, legacy hosts send a uint16_t in the zeroed payload). reply: the user's descriptor
+void DeviceEmulator::OnGetUserFeatures(const SerialPacket& packet)
+{
+    uint32_t user_index = 0;
+    ::memcpy(&user_index, packet.payload.message.data_msg.data, sizeof(user_index));
+
+    std::vector<char> descriptor;
+    bool found = false;
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        if (user_index < _users.size())
+        {
+            descriptor = _users[user_index].descriptor;
+            found = true;
+        }
+    }
+    if (!found)
+    {
+        LOG_WARNING(LOG_TAG, "GetUserFeatures: no user at index %u", static_cast<unsigned int>(user_index));
+        SendFaReply(MsgId::Reply, ToStatusCode(Status::Error));
+        return;
+    }
+
+    descriptor.resize(std::min(descriptor.size(), sizeof(DataMessage::data)));
+    DataPacket reply {MsgId::GetUserFeatures, descriptor.data(), descriptor.size()};
+    Send(reply);
+}
+
+// request: user id (31 bytes) followed by the descriptor
+void DeviceEmulator::OnSetUserFeatures(const SerialPacket& packet)
+{
+    const char* data = packet.payload.message.data_msg.data;
+    const size_t data_size = DataSize(packet);
+    if (data_size < UserIdBufferSize)
+    {
+        LOG_WARNING(LOG_TAG, "SetUserFeatures: packet too small");
+        SendFaReply(MsgId::Reply, ToStatusCode(Status::Error));
+        return;
+    }
+
+    char user_id[UserIdBufferSize];
+    ::memcpy(user_id, data, sizeof(user_id));
+    user_id[MaxUserIdSize] = '\0';
+    SetUser(user_id, std::vector<char>(data + UserIdBufferSize, data + data_size));
+
+    DataPacket reply {MsgId::SetUserFeatures};
+    Send(reply);
+}
+
+// request: user index (uint32_t, as in GetUserFeatures). reply: packed faceprints size (uint16_t) and the packed
+// faceprints
+void DeviceEmulator::OnGetUserFeaturesPacked(const SerialPacket& packet)
+{
+    uint32_t user_index = 0;
+    ::memcpy(&user_index, packet.payload.message.data_msg.data, sizeof(user_index));
+
+    Faceprints faceprints;
+    bool found = false;
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        if (user_index < _users.size() && _users[user_index].descriptor.size() == sizeof(faceprints))
+        {
+            ::memcpy(&faceprints, _users[user_index].descriptor.data(), sizeof(faceprints));
+            found = true;
+        }
+    }
+    unsigned char data[2 + MaxPackedFaceprintsSize];
+    size_t packed_size = found ? PackFaceprints(faceprints, data + 2) : 0;
+    if (packed_size == 0)
+    {
+        LOG_WARNING(LOG_TAG, "GetUserFeaturesPacked: no packable user at index %u",
+                    static_cast<unsigned int>(user_index));
+        SendFaReply(MsgId::Reply, ToStatusCode(Status::Error));
+        return;
+    }
+
+    data[0] = static_cast<unsigned char>(packed_size);
+    data[1] = static_cast<unsigned char>(packed_size >> 8);
+    DataPacket reply {MsgId::GetUserFeaturesPacked, reinterpret_cast<char*>(data), 2 + packed_size};
+    Send(reply);
+}
+
+// request: user id (31 bytes), packed faceprints size (uint16_t) and the packed faceprints
+void DeviceEmulator::OnSetUserFeaturesPacked(const SerialPacket& packet)
+{
+    const auto* data = reinterpret_cast<const unsigned char*>(packet.payload.message.data_msg.data);
+    const size_t data_size = DataSize(packet);
+    const size_t packed_size = data_size >= UserIdBufferSize + 2
+                                   ? static_cast<size_t>(data[UserIdBufferSize] | (data[UserIdBufferSize + 1] << 8))
+                                   : 0;
+    Faceprints faceprints;
+    if (UserIdBufferSize + 2 + packed_size > data_size ||
+        !UnpackFaceprints(data + UserIdBufferSize + 2, packed_size, faceprints))
+    {
+        LOG_WARNING(LOG_TAG, "SetUserFeaturesPacked: malformed packet");
+        SendFaReply(MsgId::Reply, ToStatusCode(Status::Error));
+        return;
+    }
+
+    char user_id[UserIdBufferSize];
+    ::memcpy(user_id, data, sizeof(user_id));
+    user_id[MaxUserIdSize] = '\0';
+    const auto* descriptor = reinterpret_cast<const char*>(&faceprints);
+    SetUser(user_id, std::vector<char>(descriptor, descriptor + sizeof(faceprints)));
+
+    DataPacket reply {MsgId::SetUserFeaturesPacked};
+    Send(reply);
+}
+
+// faceprints of an image: a fresh enrollment with features from a generator seeded by the image bytes
+static void ImageFaceprints(const std::vector<unsigned char>& image, Faceprints& faceprints)
+{
+    uint64_t state = 0xcbf29ce484222325ULL;
+    for (auto byte : image)
+    {
+        state = (state ^ byte) * 0x100000001b3ULL;
+    }
+    for (size_t i = 0; i < FEATURES_VECTOR_ALLOC_SIZE; i++)
+    {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        faceprints.enrollmentDescriptor[i] =
+            i < NUM_OF_RECOGNITION_FEATURES ? static_cast<feature_t>(static_cast<int>(state >> 54) - 512) : 0;
+    }
+    ::memset(faceprints.reserved, 0, sizeof(faceprints.reserved));
+    ::memcpy(faceprints.adaptiveDescriptorWithoutMask, faceprints.enrollmentDescriptor,
+             sizeof(faceprints.enrollmentDescriptor));
+    ::memcpy(faceprints.adaptiveDescriptorWithMask, faceprints.enrollmentDescriptor,
+             sizeof(faceprints.enrollmentDescriptor));
+}
+
+// request: a chunk of an image. reply to the last chunk: tag, EnrollStatus and packed faceprints, see EnrollImage.h
+void DeviceEmulator::OnEnrollImage(const SerialPacket& packet)
+{
+    const auto* data = reinterpret_cast<const unsigned char*>(packet.payload.message.data_msg.data);
+    const size_t data_size = DataSize(packet);
+    ImageChunkHeader header;
+    if (data_size < ImageChunkHeaderSize)
+    {
+        LOG_WARNING(LOG_TAG, "EnrollImage: malformed packet");
+        return;
+    }
+    ReadImageChunkHeader(data, header);
+    if (header.offset == 0)
+    {
+        _image.clear();
+        _image_broken = header.image_size > MaxEnrollImageSize;
+    }
+    if (header.offset != _image.size() || header.offset >= header.image_size)
+    {
+        _image_broken = true;
+    }
+    // the packet is padded, the chunk is the rest of the image up to MaxImageChunkSize
+    const size_t chunk_size =
+        header.offset < header.image_size
+            ? std::min<size_t>({data_size - ImageChunkHeaderSize, MaxImageChunkSize, header.image_size - header.offset})
+            : 0;
+    if (!_image_broken)
+    {
+        _image.insert(_image.end(), data + ImageChunkHeaderSize, data + ImageChunkHeaderSize + chunk_size);
+    }
+    if (header.offset + chunk_size < header.image_size)
+    {
+        return; // more chunks to come
+    }
+
+    if (_config.extract_image_time.count() > 0)
+    {
+        std::this_thread::sleep_for(_config.extract_image_time);
+    }
+    const bool valid = !_image_broken && _image.size() >= 4 && _image[0] == 0xFF && _image[1] == 0xD8 &&
+                       _image[_image.size() - 2] == 0xFF && _image[_image.size() - 1] == 0xD9;
+    unsigned char reply_data[ImageResultHeaderSize + MaxPackedFaceprintsSize] = {0};
+    ::memcpy(reply_data, &header.tag, sizeof(header.tag));
+    reply_data[2] = static_cast<unsigned char>(valid ? EnrollStatus::Success : EnrollStatus::Failure);
+    size_t packed_size = 0;
+    if (valid)
+    {
+        Faceprints faceprints;
+        ImageFaceprints(_image, faceprints);
+        packed_size = PackFaceprints(faceprints, reply_data + ImageResultHeaderSize);
+    }
+    reply_data[3] = static_cast<unsigned char>(packed_size);
+    reply_data[4] = static_cast<unsigned char>(packed_size >> 8);
+    _image.clear();
+    DataPacket reply {MsgId::EnrollImage, reinterpret_cast<char*>(reply_data), ImageResultHeaderSize + packed_size};
+    Send(reply);
+}
+
+// request: level (u8) and two u16 arguments. reply: the digests of nodes or the users of a bucket, see UsersChecksum.h
+void DeviceEmulator::OnGetUsersChecksums(const SerialPacket& packet)
+{
+    const auto* request = reinterpret_cast<const unsigned char*>(packet.payload.message.data_msg.data);
+    uint16_t arguments[2] = {0, 0};
+    ::memcpy(arguments, request + 1, std::min(sizeof(arguments), DataSize(packet) > 0 ? DataSize(packet) - 1 : 0));
+    const size_t level = DataSize(packet) >= 1 + sizeof(arguments) ? request[0] : ChecksumLevels + 1;
+    const bool valid = level < ChecksumLevels ? arguments[0] + arguments[1] <= ChecksumLevelSize(level) &&
+                                                    arguments[1] <= MaxChecksumsPerReply
+                                              : level == ChecksumLevels && arguments[0] < ChecksumBuckets;
+    if (!valid)
+    {
+        LOG_WARNING(LOG_TAG, "GetUsersChecksums: invalid request");
+        SendFaReply(MsgId::Reply, ToStatusCode(Status::Error));
+        return;
+    }
+
+    UsersChecksumTree tree;
+    std::vector<BucketUser> bucket_users;
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        for (size_t i = 0; i < _users.size(); i++)
+        {
+            Faceprints faceprints;
+            ::memset(&faceprints, 0, sizeof(faceprints));
+            if (_users[i].descriptor.size() == sizeof(faceprints))
+            {
+                ::memcpy(&faceprints, _users[i].descriptor.data(), sizeof(faceprints));
+            }
+            const char* user_id = _users[i].user_id.c_str();
+            const size_t bucket = ChecksumBucket(user_id);
+            const uint64_t checksum = UserChecksum(user_id, faceprints);
+            tree.Add(bucket, checksum);
+            if (level == ChecksumLevels && bucket == arguments[0])
+            {
+                BucketUser user;
+                user.index = static_cast<uint16_t>(i);
+                user.checksum = checksum;
+                ::strncpy(user.user_id, user_id, MaxUserIdSize);
+                bucket_users.push_back(user);
+            }
+        }
+    }
+
+    unsigned char data[sizeof(DataMessage::data)] = {0};
+    size_t size = 0;
+    if (level < ChecksumLevels)
+    {
+        for (uint16_t i = 0; i < arguments[1]; i++)
+        {
+            const uint64_t digest = tree.Digest(level, arguments[0] + i);
+            ::memcpy(data + size, &digest, sizeof(digest));
+            size += sizeof(digest);
+        }
+    }
+    else
+    {
+        const uint16_t total = static_cast<uint16_t>(bucket_users.size());
+        const size_t first = std::min<size_t>(arguments[1], bucket_users.size());
+        const uint16_t count = static_cast<uint16_t>(std::min(bucket_users.size() - first, MaxBucketUsersPerReply));
+        ::memcpy(data, &total, sizeof(total));
+        ::memcpy(data + 2, &count, sizeof(count));
+        size = 4;
+        for (uint16_t i = 0; i < count; i++)
+        {
+            WriteBucketUser(bucket_users[first + i], data + size);
+            size += BucketUserSize;
+        }
+    }
+    DataPacket reply {MsgId::GetUsersChecksums, reinterpret_cast<char*>(data), size};
+    Send(reply);
+}
+
+void DeviceEmulator::OnRemoveUser(const SerialPacket& packet)
+{
+    std::string user_id {packet.payload.message.fa_msg.user_id,
+                         ::strnlen(packet.payload.message.fa_msg.user_id, MaxUserIdSize)};
+    bool removed = false;
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        auto it =
+            std::find_if(_users.begin(), _users.end(), [&](const User& user) { return user.user_id == user_id; });
+        if (it != _users.end())
+        {
+            _users.erase(it);
+            removed = true;
+        }
+    }
+    SendFaReply(MsgId::Reply, ToStatusCode(removed ? Status::Ok : Status::Error));
+}
+
+void DeviceEmulator::OnAuthenticate(bool extract_faceprints)
+{
+    if (_config.authenticate_time.count() > 0)
+    {
+        std::this_thread::sleep_for(_config.authenticate_time);
+    }
+
+    std::vector<EmulatedFaReply> replies;
+    std::vector<char> faceprints;
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        replies = _authenticate_script;
+        faceprints = _auth_faceprints;
+        if (replies.empty() && extract_faceprints)
+        {
+            const auto status = faceprints.empty() ? AuthenticateStatus::NoFaceDetected : AuthenticateStatus::Success;
+            replies.push_back({MsgId::Result, static_cast<char>(status), ""});
+        }
+        else if (replies.empty())
+        {
+            if (_users.empty())
+            {
+                replies.push_back({MsgId::Result, static_cast<char>(AuthenticateStatus::Forbidden), ""});
+            }
+            else
+            {
+                replies.push_back({MsgId::Result, static_cast<char>(AuthenticateStatus::Success), _users[0].user_id});
+            }
+        }
+    }
+
+    bool faces_sent = false;
+    std::chrono::steady_clock::time_point last_faces;
+    const std::chrono::milliseconds face_interval {_session_options.face_interval_ms};
+    for (const auto& reply : replies)
+    {
+        if ((reply.id == MsgId::Hint && !(_session_options.events & SessionEventHints)) ||
+            (reply.id == MsgId::Progress && !(_session_options.events & SessionEventProgress)))
+        {
+            continue;
+        }
+        if (reply.id == MsgId::FaceDetected)
+        {
+            const auto now = std::chrono::steady_clock::now();
+            if (!(_session_options.events & SessionEventFaces) || (faces_sent && now - last_faces < face_interval))
+            {
+                continue;
+            }
+            faces_sent = true;
+            last_faces = now;
+            SendFaces(static_cast<unsigned int>(reply.status));
+            continue;
+        }
+        SendFaReply(reply.id, reply.status, reply.user_id.c_str());
+        if (extract_faceprints && reply.id == MsgId::Result &&
+            reply.status == static_cast<char>(AuthenticateStatus::Success))
+        {
+            const size_t size = std::min(faceprints.size(), sizeof(DataMessage::data));
+            DataPacket packet {MsgId::Faceprints, faceprints.data(), size};
+            Send(packet);
+        }
+    }
+    SendFaReply(MsgId::Reply, static_cast<char>(AuthenticateStatus::Success));
+}
+
+void DeviceEmulator::OnEnrollFaceprintsExtraction()
+{
+    std::vector<char> faceprints;
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        faceprints = _auth_faceprints;
+    }
+    if (faceprints.empty())
+    {
+        SendFaReply(MsgId::Result, static_cast<char>(EnrollStatus::Failure));
+    }
+    else
+    {
+        SendFaReply(MsgId::Result, static_cast<char>(EnrollStatus::Success));
+        const size_t size = std::min(faceprints.size(), sizeof(DataMessage::data));
+        DataPacket packet {MsgId::Faceprints, faceprints.data(), size};
+        Send(packet);
+        if (_config.enroll_end_time.count() > 0)
+        {
+            // the faceprints go out before the device ends the enrollment
+            const bool collect_replies = _collect_replies;
+            FlushReplies();
+            std::this_thread::sleep_for(_config.enroll_end_time);
+            _collect_replies = collect_replies;
+        }
+    }
+    SendFaReply(MsgId::Reply, static_cast<char>(EnrollStatus::Success));
+}
+
+// FaceDetected: face count (u8), timestamp (u32), then the FaceRects
+void DeviceEmulator::SendFaces(unsigned int n_faces)
+{
+    char data[sizeof(DataMessage::data)] = {0};
+    const uint8_t count = static_cast<uint8_t>(std::min(n_faces, 10u));
+    const uint32_t ts = _packets_handled.load();
+    data[0] = static_cast<char>(count);
+    ::memcpy(data + 1, &ts, sizeof(ts));
+    size_t offset = 1 + sizeof(ts);
+    for (uint8_t i = 0; i < count; i++)
+    {
+        FaceRect face;
+        face.x = 100 + 50 * i;
+        face.y = 120;
+        face.w = 200;
+        face.h = 240;
+        ::memcpy(data + offset, &face, sizeof(face));
+        offset += sizeof(face);
+    }
+    DataPacket packet {MsgId::FaceDetected, data, offset};
+    Send(packet);
+}
+
+void DeviceEmulator::SendFaReply(MsgId id, char status, const char* user_id)
+{
+    FaPacket reply {id, user_id, status};
+    Send(reply);
+}
+
+void DeviceEmulator::Send(LargePacket& packet)
+{
+    packet.payload.sequence_number = ++_last_sent_seq_number;
+#ifdef RSID_SECURE
+    if (!Encrypt(packet))
+    {
+        LOG_WARNING(LOG_TAG, "Failed encrypting packet '%c'", static_cast<char>(packet.header.id));
+        return;
+    }
+#endif // RSID_SECURE
+    WriteFrame(packet);
+}
+
+void DeviceEmulator::Send(SerialPacket& packet)
+{
+    if (_collect_replies)
+    {
+        _replies.push_back(packet);
+        return;
+    }
+    Transmit(packet);
+}
+
+// the replies collected, in as few batches as they fit in. a batch of one is sent as the packet itself.
+void DeviceEmulator::FlushReplies()
+{
+    _collect_replies = false;
+    for (size_t sent = 0; sent < _replies.size();)
+    {
+        const size_t batched = _reply_batch.Fill(_replies.data() + sent, _replies.size() - sent);
+        if (batched > 1)
+        {
+            Transmit(_reply_batch.Packet());
+            sent += batched;
+        }
+        else
+        {
+            Transmit(_replies[sent]);
+            sent++;
+        }
+    }
+    _replies.clear();
+}
+
+void DeviceEmulator::Transmit(SerialPacket& packet)
+{
+    packet.payload.sequence_number = ++_last_sent_seq_number;
+#ifdef RSID_SECURE
+    if (!Encrypt(packet))
+    {
+        LOG_WARNING(LOG_TAG, "Failed encrypting packet '%c'", static_cast<char>(packet.header.id));
+        return;
+    }
+#endif // RSID_SECURE
+    WriteFrame(packet);
+}
+
+// a ping is sent outside the session (not encrypted, no sequence number) and echoed back as is
+void DeviceEmulator::OnPing(const SerialPacket& packet)
+{
+    WriteFrame(packet);
+}
+
+// same wire format as PacketSender::Send(), without counting the packet in the metrics
+void DeviceEmulator::WriteFrame(const SerialPacket& packet)
+{
+    char frame[sizeof(SerialPacket)];
+    size_t frame_size = sizeof(packet.header) + packet.header.payload_size;
+    ::memcpy(frame, &packet, frame_size);
+    ::memcpy(frame + frame_size, packet.hmac, sizeof(packet.hmac));
+    frame_size += sizeof(packet.hmac);
+    auto crc = PacketSender::CalcCrc(packet);
+    ::memcpy(frame + frame_size, &crc, sizeof(crc));
+    frame_size += sizeof(crc);
+
+    if (_device_end->SendBytes(frame, frame_size) != SerialStatus::Ok)
+    {
+        LOG_WARNING(LOG_TAG, "Failed sending packet '%c'", static_cast<char>(packet.header.id));
+    }
+}
+
+void DeviceEmulator::WriteFrame(const LargePacket& packet)
+{
+    const size_t content_size = sizeof(packet.header) + packet.header.payload_size;
+    std::vector<char> frame(content_size + sizeof(packet.hmac) + sizeof(packet.crc));
+    ::memcpy(frame.data(), &packet, content_size);
+    ::memcpy(frame.data() + content_size, packet.hmac, sizeof(packet.hmac));
+    auto crc = PacketSender::CalcCrc(packet);
+    ::memcpy(frame.data() + content_size + sizeof(packet.hmac), &crc, sizeof(crc));
+
+    if (_device_end->SendBytes(frame.data(), frame.size()) != SerialStatus::Ok)
+    {
+        LOG_WARNING(LOG_TAG, "Failed sending packet '%c'", static_cast<char>(packet.header.id));
+    }
+}
+
+#ifdef RSID_SECURE
+// request: the host's signed ecdh key. reply: the device's signed ecdh key, unencrypted like the request
+void DeviceEmulator::OnHostEcdhKey(const SerialPacket& packet)
+{
+    auto sign_callback = [](const unsigned char* buffer, const unsigned int buffer_len, unsigned char* out_sig) {
+        (void)buffer;
+        (void)buffer_len;
+        ::memset(out_sig, 0, ECC_P256_SIG_SIZE_BYTES);
+        return true;
+    };
+    auto verify_callback = [](const unsigned char* buffer, const unsigned int buffer_len, const unsigned char* sig,
+                              const unsigned int sig_len) {
+        (void)buffer;
+        (void)buffer_len;
+        (void)sig;
+        (void)sig_len;
+        return true;
+    };
+
+    // the device key first: the key exchange then uses it instead of generating another one
+    unsigned char* signed_pubkey = _crypto_wrapper.GetSignedEcdhPubkey(sign_callback);
+    auto* host_signed_pubkey = reinterpret_cast<const unsigned char*>(packet.payload.message.data_msg.data);
+    if (signed_pubkey == nullptr || DataSize(packet) < _crypto_wrapper.GetSignedEcdhPubkeySize() ||
+        !_crypto_wrapper.VerifyEcdhSignedKey(host_signed_pubkey, verify_callback))
+    {
+        LOG_WARNING(LOG_TAG, "Key exchange failed");
+        SendFaReply(MsgId::Reply, ToStatusCode(Status::SecurityError));
+        return;
+    }
+
+    _last_sent_seq_number = 0;
+    const size_t key_size = _crypto_wrapper.GetSignedEcdhPubkeySize();
+    // the host's options and their signature follow its key (see SessionOptions.h)
+    const auto* host_options = host_signed_pubkey + key_size;
+    unsigned char signed_options[ECC_P256_KEY_SIZE_BYTES + SessionOptionsSize];
+    ::memcpy(signed_options, host_signed_pubkey, ECC_P256_KEY_SIZE_BYTES);
+    ::memcpy(signed_options + ECC_P256_KEY_SIZE_BYTES, host_options, SessionOptionsSize);
+    SessionOptions options;
+    if (ReadSessionOptions(host_options, DataSize(packet) - key_size, options) &&
+        (DataSize(packet) < key_size + SessionOptionsSize + SessionOptionsSignatureSize ||
+         !verify_callback(signed_options, sizeof(signed_options), host_options + SessionOptionsSize,
+                          SessionOptionsSignatureSize)))
+    {
+        LOG_WARNING(LOG_TAG, "Session options not signed");
+        SendFaReply(MsgId::Reply, ToStatusCode(Status::SecurityError));
+        return;
+    }
+    // the applied options follow the key, with their signature
+    char reply_data[sizeof(DataMessage::data)];
+    ::memcpy(reply_data, signed_pubkey, key_size);
+    auto* reply_options = reinterpret_cast<unsigned char*>(reply_data) + key_size;
+    ApplySessionOptions(options, reply_options);
+    ::memcpy(signed_options, signed_pubkey, ECC_P256_KEY_SIZE_BYTES);
+    ::memcpy(signed_options + ECC_P256_KEY_SIZE_BYTES, reply_options, SessionOptionsSize);
+    sign_callback(signed_options, sizeof(signed_options), reply_options + SessionOptionsSize);
+    DataPacket reply {MsgId::DeviceEcdhKey, reply_data, key_size + SessionOptionsSize + SessionOptionsSignatureSize};
+    WriteFrame(reply);
+}
+
+// verify the hmac and decrypt the payload in place (SecureSession::RecvPacket())
+template <typename Packet>
+bool DeviceEmulator::Decrypt(Packet& packet)
+{
+    const unsigned int payload_size = std::min<unsigned int>(packet.header.payload_size, sizeof(packet.payload));
+    unsigned char hmac[HMAC_256_SIZE_BYTES];
+    if (!_crypto_wrapper.CalcHmac(reinterpret_cast<const unsigned char*>(&packet),
+                                  static_cast<unsigned int>(sizeof(packet.header)) + payload_size, hmac) ||
+        ::memcmp(packet.hmac, hmac, sizeof(hmac)) != 0)
+    {
+        return false;
+    }
+    auto* payload = reinterpret_cast<unsigned char*>(&packet.payload);
+    return _crypto_wrapper.Decrypt(packet.header.iv, payload, payload, payload_size);
+}
+
+// encrypt the payload in place and set the hmac (SecureSession::SendPacket())
+template <typename Packet>
+bool DeviceEmulator::Encrypt(Packet& packet)
+{
+    auto* payload = reinterpret_cast<unsigned char*>(&packet.payload);
+    return _crypto_wrapper.GenerateRandom(packet.header.iv, sizeof(packet.header.iv)) &&
+           _crypto_wrapper.Encrypt(packet.header.iv, payload, payload, packet.header.payload_size) &&
+           _crypto_wrapper.CalcHmac(reinterpret_cast<const unsigned char*>(&packet),
+                                    static_cast<unsigned int>(sizeof(packet.header)) + packet.header.payload_size,
+                                    reinterpret_cast<unsigned char*>(packet.hmac));
+}
+#endif // RSID_SECURE
+} // namespace PacketManager
+} // namespace RealSenseID
@@ -0,0 +1,214 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "LoopbackSerial.h"
+#include "SerialPacket.h"
+#include "LargePacket.h"
+#include "MessageBatch.h"
+#include "SessionOptions.h"
+#ifdef RSID_SECURE
+#include "MbedtlsWrapper.h"
+#endif // RSID_SECURE
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+struct DeviceEmulatorConfig
+{
+    LoopbackConfig link;
+    // device processing time of every command, before its first reply
+    timeout_t command_time {0};
+    // additional processing time of an authentication, before its replies
+    timeout_t authenticate_time {0};
+    // device time from the faceprints of an EnrollFaceprintsExtraction to its Reply (stopping the camera)
+    timeout_t enroll_end_time {0};
+    // additional processing time of a StandBy, which persists the database to flash
+    timeout_t standby_time {0};
+    // handle GetUserFeaturesPacked / SetUserFeaturesPacked, false to emulate a firmware without them
+    bool packed_faceprints = true;
+    // handle GetUserRecordsPacked (in large packets), false to emulate a firmware without it
+    bool user_records = true;
+    // handle GetUsersChecksums, false to emulate a firmware without it
+    bool users_checksums = true;
+    // handle EnrollImage, false to emulate a firmware without it
+    bool enroll_images = true;
+    // faceprints extraction time of an uploaded image, before its reply
+    timeout_t extract_image_time {0};
+    // largest payload of the large packets the device takes, 0 to emulate a firmware without them. a device without
+    // the packed faceprints messages has none.
+    size_t large_payload = MaxLargePayloadSize;
+    // take and send message batches, false to emulate a firmware without them
+    bool message_batches = true;
+    // answers to the text commands of DeviceController::QuerySerialNumber() and QueryFirmwareVersion() (the latter in
+    // the query's format, modules separated by '|')
+    std::string serial_number = "EMULATED0001";
+    std::string firmware_version = "OPFW:7.10.0.10|RECOG:7.10.0.10";
+};
+
+// fa message sent by the emulated device
+struct EmulatedFaReply
+{
+    MsgId id;
+    char status;
+    std::string user_id;
+};
+
+// Emulated F45x device for exercising the host protocol stack (PacketSender, the non secure session,
+// FaceAuthenticatorImpl) without hardware, e.g. in benchmarks and CI.
+//
+// The device runs in its own thread on one end of a LoopbackSerial pair; the host uses the other end
+// (HostConnection()). It speaks the session protocol of the build (the secure session with RSID_SECURE, the non
+// secure one otherwise) and handles:
+//   StartSession, GetNumberOfUsers, GetUserIds, GetUserFeatures, SetUserFeatures, their packed variants (see
+//   PackedFaceprints.h), GetUsersChecksums, EnrollImage, RemoveUser, RemoveAllUsers, StandBy, Authenticate and
+//   AuthenticateFaceprintsExtraction, EnrollFaceprintsExtraction, and Ping outside the session.
+// It also answers the bspver text commands of the DeviceController queries between packets.
+// Other commands are answered with a Reply packet with Status::Error.
+//
+// Users are kept as user id + the opaque descriptor bytes of SetUserFeatures, which GetUserFeatures returns as is.
+// The packed variants convert from / to the descriptor, which must then be the size of the faceprints. The users
+// checksum tree (see UsersChecksum.h) is built for each GetUsersChecksums request, with the checksum of a descriptor
+// of another size taken over all zeros faceprints.
+// EnrollImage collects the chunks of an image (see EnrollImage.h) and answers the last one with Success and
+// faceprints derived from the image bytes (the same image gives the same faceprints), or with Failure if the image
+// does not start and end like a JPEG or its chunks were out of order.
+// Authenticate sends the scripted fa replies (SetAuthenticateScript()), then the Reply packet. The default script is
+// a Result with AuthenticateStatus::Success and the first user (or AuthenticateStatus::Forbidden if there are none).
+// A scripted FaceDetected is sent as the FaceDetected data packet, with the status as the number of faces. The events
+// the session options (see SessionOptions.h) filter out are not sent.
+// AuthenticateFaceprintsExtraction (host mode) sends the same script, each successful Result followed by the
+// Faceprints data packet of SetAuthFaceprints(). Its default script is a Result with AuthenticateStatus::Success, or
+// AuthenticateStatus::NoFaceDetected if no faceprints were set.
+// EnrollFaceprintsExtraction sends a Result with EnrollStatus::Success and the same Faceprints data packet (or a
+// Result with EnrollStatus::Failure if no faceprints were set), then the Reply.
+// The session options are answered with the options applied. In a session with large packets (see LargePacket.h)
+// GetUserIds and the packed faceprints messages are also handled in large packets. In a session with message batches
+// (see MessageBatch.h) the messages of a batch are handled in order, and the replies to a packet are sent in batches.
+// The device packets are not counted in the library metrics.
+//
+// In the secure session the device does the ecdh key exchange and encrypts / authenticates its packets like the
+// device, but accepts any host signature and signs its key with an all zeros signature (the host's verify callback
+// must accept it). The device's ecdh key is reused across sessions, so the emulator's key generation does not
+// show up in the host's session start time.
+class DeviceEmulator
+{
+public:
+    explicit DeviceEmulator(const DeviceEmulatorConfig& config = {});
+    ~DeviceEmulator();
+
+    DeviceEmulator(const DeviceEmulator&) = delete;
+    DeviceEmulator& operator=(const DeviceEmulator&) = delete;
+
+    // the host end of the line. can be taken once.
+    std::unique_ptr<SerialConnection> HostConnection();
+
+    // add user to the device database, or replace its descriptor
+    void SetUser(const std::string& user_id, std::vector<char> descriptor = {});
+    size_t NumberOfUsers() const;
+
+    // fa replies of each authentication. empty for the default script.
+    void SetAuthenticateScript(std::vector<EmulatedFaReply> replies);
+
+    // faceprints of the face at the camera, sent by each faceprints extraction (the size of the faceprints)
+    void SetAuthFaceprints(std::vector<char> descriptor);
+
+    // number of packets handled so far
+    unsigned int PacketsHandled() const;
+
+    // cpu time of the device's thread so far, to tell the host's cpu time from the emulator's (linux only, 0
+    // elsewhere)
+    double ThreadCpuSeconds();
+
+private:
+    struct User
+    {
+        std::string user_id;
+        std::vector<char> descriptor;
+    };
+
+    DeviceEmulatorConfig _config;
+    std::unique_ptr<LoopbackSerial> _host_end;
+    std::unique_ptr<LoopbackSerial> _device_end;
+
+    mutable std::mutex _mutex; // guards the database and the script
+    std::vector<User> _users;
+    std::vector<EmulatedFaReply> _authenticate_script;
+    std::vector<char> _auth_faceprints;
+
+    // image being uploaded (EnrollImage)
+    std::vector<unsigned char> _image;
+    bool _image_broken = false;
+
+    uint32_t _last_sent_seq_number = 0;
+    SessionOptions _session_options; // of the current session
+    size_t _large_payload_size = 0;  // of the current session
+    std::unique_ptr<LargePacket> _large_reply;
+    // replies to the packet being handled, in a session with message batches
+    bool _collect_replies = false;
+    std::vector<SerialPacket> _replies;
+    MessageBatch _reply_batch;
+    std::string _text_line; // text command being received
+    std::atomic<unsigned int> _packets_handled {0};
+    std::atomic<bool> _stop {false};
+    std::thread _thread;
+
+#ifdef RSID_SECURE
+    MbedtlsWrapper _crypto_wrapper;
+#endif // RSID_SECURE
+
+    void ThreadLoop();
+    void OnText(const char* data, size_t size);
+    void OnFrame(const SerialPacket& packet);
+    void OnLargeFrame(const LargePacket& packet);
+    void HandlePacket(const SerialPacket& packet);
+    void HandleLargePacket(const LargePacket& packet);
+    // the options applied to a session started with the given ones, in the reply's data (SessionOptionsSize bytes)
+    void ApplySessionOptions(const SessionOptions& options, unsigned char* reply_data);
+    // send with the next sequence number (a reply being collected, at the end of its packet's handling)
+    void Send(SerialPacket& packet);
+    void Send(LargePacket& packet);
+    void Transmit(SerialPacket& packet);
+    void FlushReplies();
+    void WriteFrame(const SerialPacket& packet);
+    void WriteFrame(const LargePacket& packet);
+    void SendFaReply(MsgId id, char status, const char* user_id = nullptr);
+    void SendFaces(unsigned int n_faces);
+
+    // the ids of up to count users from first, as many as fit in capacity bytes: their number (u32) and the zero
+    // delimited ids. returns the size written.
+    size_t WriteUserIds(unsigned int first, unsigned int count, char* data, size_t capacity);
+    void OnGetUserIds(const SerialPacket& packet);
+    void OnGetUserIdsLarge(const LargePacket& packet);
+    // GetUserFeaturesPacked, or GetUserRecordsPacked with with_user_ids
+    void OnGetUserFeaturesLarge(const LargePacket& packet, bool with_user_ids);
+    void OnSetUserFeaturesLarge(const LargePacket& packet);
+    void OnGetUserFeatures(const SerialPacket& packet);
+    void OnSetUserFeatures(const SerialPacket& packet);
+    void OnGetUserFeaturesPacked(const SerialPacket& packet);
+    void OnSetUserFeaturesPacked(const SerialPacket& packet);
+    void OnGetUsersChecksums(const SerialPacket& packet);
+    void OnEnrollImage(const SerialPacket& packet);
+    void OnRemoveUser(const SerialPacket& packet);
+    // Authenticate, or AuthenticateFaceprintsExtraction with extract_faceprints
+    void OnAuthenticate(bool extract_faceprints);
+    void OnEnrollFaceprintsExtraction();
+    void OnPing(const SerialPacket& packet);
+#ifdef RSID_SECURE
+    void OnHostEcdhKey(const SerialPacket& packet);
+    template <typename Packet>
+    bool Decrypt(Packet& packet);
+    template <typename Packet>
+    bool Encrypt(Packet& packet);
+#endif // RSID_SECURE
+};
+} // namespace PacketManager
+} // namespace RealSenseID
@@ -0,0 +1,271 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "LoopbackSerial.h"
+#include "SerialTrace.h"
+#include "Logger.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <string.h>
+
+static const char* LOG_TAG = "LoopbackSerial";
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+class LoopbackChannel
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    explicit LoopbackChannel(const LoopbackConfig& config) : _config {config}
+    {
+    }
+
+    // queue the bytes for delivery and wait until they were transmitted
+    SerialStatus Write(const char* data, size_t n_bytes)
+    {
+        clock::time_point transmitted;
+        {
+            std::lock_guard<std::mutex> lock {_mutex};
+            if (_reader_closed)
+            {
+                return SerialStatus::SendFailed;
+            }
+            auto transmit_time = std::chrono::microseconds {0};
+            if (_config.baudrate > 0)
+            {
+                transmit_time = std::chrono::microseconds {n_bytes * 10 * 1000000ull / _config.baudrate};
+            }
+            transmitted = std::max(clock::now(), _line_free_at) + transmit_time;
+            _line_free_at = transmitted;
+            _chunks.push_back(Chunk {std::vector<char>(data, data + n_bytes), 0, transmitted + _config.latency});
+        }
+        _cv.notify_all();
+        std::this_thread::sleep_until(transmitted);
+        return SerialStatus::Ok;
+    }
+
+    // copy up to max_bytes of the delivered bytes, waiting for the first one up to the deadline.
+    // if interruptible, also return RecvTimeout (with no bytes) on Interrupt().
+    SerialStatus Read(char* buffer, size_t max_bytes, size_t& n_bytes_read, clock::time_point deadline,
+                      bool interruptible)
+    {
+        n_bytes_read = 0;
+        std::unique_lock<std::mutex> lock {_mutex};
+        while (true)
+        {
+            if (interruptible && _interrupted)
+            {
+                _interrupted = false;
+                return SerialStatus::RecvTimeout;
+            }
+
+            auto now = clock::now();
+            while (n_bytes_read < max_bytes && !_chunks.empty() && _chunks.front().available_at <= now)
+            {
+                auto& chunk = _chunks.front();
+                auto n_bytes = std::min(max_bytes - n_bytes_read, chunk.bytes.size() - chunk.offset);
+                ::memcpy(buffer + n_bytes_read, chunk.bytes.data() + chunk.offset, n_bytes);
+                n_bytes_read += n_bytes;
+                chunk.offset += n_bytes;
+                if (chunk.offset == chunk.bytes.size())
+                {
+                    _chunks.pop_front();
+                }
+            }
+            if (n_bytes_read > 0)
+            {
+                return SerialStatus::Ok;
+            }
+            if (_chunks.empty() && _writer_closed)
+            {
+                return SerialStatus::RecvFailed;
+            }
+            if (now >= deadline)
+            {
+                return SerialStatus::RecvTimeout;
+            }
+
+            auto wakeup = deadline;
+            if (!_chunks.empty())
+            {
+                wakeup = std::min(wakeup, _chunks.front().available_at);
+            }
+            _cv.wait_until(lock, wakeup);
+        }
+    }
+
+    void Interrupt()
+    {
+        {
+            std::lock_guard<std::mutex> lock {_mutex};
+            _interrupted = true;
+        }
+        _cv.notify_all();
+    }
+
+    void SetBaudRate(unsigned int baudrate)
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        _config.baudrate = baudrate;
+    }
+
+    void CloseWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lock {_mutex};
+            _writer_closed = true;
+        }
+        _cv.notify_all();
+    }
+
+    void CloseReader()
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        _reader_closed = true;
+        _chunks.clear();
+    }
+
+private:
+    struct Chunk
+    {
+        std::vector<char> bytes;
+        size_t offset;                // bytes already received
+        clock::time_point available_at; // end of transmission + latency
+    };
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    LoopbackConfig _config;
+    std::deque<Chunk> _chunks;
+    clock::time_point _line_free_at;
+    bool _interrupted = false;
+    bool _writer_closed = false;
+    bool _reader_closed = false;
+};
+
+static LoopbackChannel::clock::time_point Deadline(size_t timeout_ms)
+{
+    return LoopbackChannel::clock::now() + std::chrono::milliseconds {timeout_ms};
+}
+
+std::pair<std::unique_ptr<LoopbackSerial>, std::unique_ptr<LoopbackSerial>> LoopbackSerial::CreatePair(
+    const LoopbackConfig& config)
+{
+    auto first_to_second = std::make_shared<LoopbackChannel>(config);
+    auto second_to_first = std::make_shared<LoopbackChannel>(config);
+    return {std::make_unique<LoopbackSerial>(first_to_second, second_to_first, true),
+            std::make_unique<LoopbackSerial>(second_to_first, first_to_second)};
+}
+
+LoopbackSerial::LoopbackSerial(std::shared_ptr<LoopbackChannel> tx, std::shared_ptr<LoopbackChannel> rx,
+                               bool traced) :
+    _tx {std::move(tx)}, _rx {std::move(rx)}, _traced {traced}
+{
+}
+
+LoopbackSerial::~LoopbackSerial()
+{
+    _tx->CloseWriter();
+    _rx->CloseReader();
+}
+
+SerialStatus LoopbackSerial::SendBytes(const char* buffer, size_t n_bytes)
+{
+    if (_traced)
+    {
+        SerialTrace::Record(SerialTrace::Direction::Send, reinterpret_cast<uintptr_t>(this), buffer, n_bytes);
+    }
+    auto status = _tx->Write(buffer, n_bytes);
+    if (status != SerialStatus::Ok)
+    {
+        LOG_ERROR(LOG_TAG, "Failed sending %zu bytes: the other end is closed", n_bytes);
+    }
+    return status;
+}
+
+SerialStatus LoopbackSerial::Read(char* buffer, size_t max_bytes, size_t& n_bytes_read,
+                                  std::chrono::steady_clock::time_point deadline, bool interruptible)
+{
+    auto status = _rx->Read(buffer, max_bytes, n_bytes_read, deadline, interruptible);
+    if (_traced)
+    {
+        SerialTrace::Record(SerialTrace::Direction::Recv, reinterpret_cast<uintptr_t>(this), buffer, n_bytes_read);
+    }
+    return status;
+}
+
+// same timeout as LinuxSerial::RecvBytes()
+SerialStatus LoopbackSerial::RecvBytes(char* buffer, size_t n_bytes)
+{
+    if (n_bytes == 0)
+    {
+        LOG_ERROR(LOG_TAG, "Attempt to recv 0 bytes");
+        return SerialStatus::RecvFailed;
+    }
+
+    auto deadline = Deadline(200 + 4 * n_bytes);
+    size_t total_bytes_read = 0;
+    while (total_bytes_read < n_bytes)
+    {
+        size_t n_bytes_read = 0;
+        auto status = Read(buffer + total_bytes_read, n_bytes - total_bytes_read, n_bytes_read, deadline, false);
+        if (status != SerialStatus::Ok)
+        {
+            return status;
+        }
+        total_bytes_read += n_bytes_read;
+    }
+    return SerialStatus::Ok;
+}
+
+SerialStatus LoopbackSerial::RecvAvailable(char* buffer, size_t max_bytes, size_t& n_bytes_read)
+{
+    n_bytes_read = 0;
+    if (max_bytes == 0)
+    {
+        LOG_ERROR(LOG_TAG, "Attempt to recv 0 bytes");
+        return SerialStatus::RecvFailed;
+    }
+    return Read(buffer, max_bytes, n_bytes_read, Deadline(204), true);
+}
+
+SerialStatus LoopbackSerial::DiscardUntil(char value, timeout_t max_wait)
+{
+    // same as receiving a single byte, unless the caller's wait ends sooner
+    auto deadline = Deadline(static_cast<size_t>(std::min(std::max(max_wait, timeout_t {0}), timeout_t {204}).count()));
+    while (true)
+    {
+        char byte = 0;
+        size_t n_bytes_read = 0;
+        auto status = Read(&byte, 1, n_bytes_read, deadline, true);
+        if (status != SerialStatus::Ok)
+        {
+            return status;
+        }
+        if (byte == value)
+        {
+            return SerialStatus::Ok;
+        }
+    }
+}
+
+void LoopbackSerial::InterruptRecv()
+{
+    _rx->Interrupt();
+}
+
+bool LoopbackSerial::SetBaudRate(unsigned int baudrate)
+{
+    _tx->SetBaudRate(baudrate);
+    _rx->SetBaudRate(baudrate);
+    return true;
+}
+} // namespace PacketManager
+} // namespace RealSenseID
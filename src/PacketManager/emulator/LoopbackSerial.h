@@ -0,0 +1,64 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "SerialConnection.h"
+#include <chrono>
+#include <memory>
+#include <utility>
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+// Emulated serial line between the two ends of a loopback pair.
+struct LoopbackConfig
+{
+    // line speed. each byte takes 10 bits on the line (8N1). 0 for a line with no transmit time.
+    unsigned int baudrate = 115200;
+    // added to the delivery of every SendBytes() (e.g. the usb-serial adapter latency)
+    timeout_t latency {0};
+};
+
+// one direction of the line (LoopbackSerial.cc)
+class LoopbackChannel;
+
+// In-process serial connection: one end of a pair created by CreatePair().
+// Bytes sent on one end are received on the other after their transmit time at the configured baud rate (the
+// line carries one SendBytes() at a time) plus the latency. SendBytes() returns once its bytes were transmitted,
+// like a port with drain_on_send. Receive timeouts are the same as LinuxSerial's.
+// When an end is destroyed, receiving on the other end fails (RecvFailed) once the bytes in transit were received.
+// The first end of a pair (the host's) records its transfers in the SerialTrace, as the real ports do.
+class LoopbackSerial : public SerialConnection
+{
+public:
+    static std::pair<std::unique_ptr<LoopbackSerial>, std::unique_ptr<LoopbackSerial>> CreatePair(
+        const LoopbackConfig& config);
+
+    LoopbackSerial(std::shared_ptr<LoopbackChannel> tx, std::shared_ptr<LoopbackChannel> rx, bool traced = false);
+    ~LoopbackSerial() override;
+
+    LoopbackSerial(const LoopbackSerial&) = delete;
+    LoopbackSerial& operator=(const LoopbackSerial&) = delete;
+
+    SerialStatus SendBytes(const char* buffer, size_t n_bytes) final;
+    SerialStatus RecvBytes(char* buffer, size_t n_bytes) final;
+    SerialStatus RecvAvailable(char* buffer, size_t max_bytes, size_t& n_bytes_read) final;
+    SerialStatus DiscardUntil(char value, timeout_t max_wait) final;
+    void InterruptRecv() final;
+
+    // changes the speed of both directions of the line
+    bool SetBaudRate(unsigned int baudrate) final;
+
+private:
+    // receive from _rx and record it if traced
+    SerialStatus Read(char* buffer, size_t max_bytes, size_t& n_bytes_read,
+                      std::chrono::steady_clock::time_point deadline, bool interruptible);
+
+    std::shared_ptr<LoopbackChannel> _tx;
+    std::shared_ptr<LoopbackChannel> _rx;
+    bool _traced;
+};
+} // namespace PacketManager
+} // namespace RealSenseID
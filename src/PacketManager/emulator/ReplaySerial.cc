@@ -0,0 +1,419 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "ReplaySerial.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <string.h>
+
+static const char* LOG_TAG = "ReplaySerial";
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+static constexpr size_t MaxPacketOffset = 34; // packets may follow a command prefix in the same write
+static constexpr size_t NoPacket = static_cast<size_t>(-1);
+
+// offset of the packet the bytes start with (after a command prefix), NoPacket if none
+static size_t FindPacket(const char* bytes, size_t size)
+{
+    const size_t last = std::min(size, MaxPacketOffset + 4);
+    for (size_t i = 0; i + 3 < last; ++i)
+    {
+        if (bytes[i] == static_cast<char>(SyncByte::Sync1) && bytes[i + 1] == static_cast<char>(SyncByte::Sync2) &&
+            static_cast<unsigned char>(bytes[i + 2]) == ProtocolVer)
+        {
+            return i;
+        }
+    }
+    return NoPacket;
+}
+
+static char PacketId(const char* bytes, size_t size)
+{
+    const auto offset = FindPacket(bytes, size);
+    return offset == NoPacket ? '\0' : bytes[offset + 3];
+}
+
+// packets of the session and the link, not an operation's request
+static bool IsSessionPacket(char msg_id)
+{
+    switch (static_cast<MsgId>(msg_id))
+    {
+    case MsgId::StartSession:
+    case MsgId::HostEcdhKey:
+    case MsgId::HostEcdsaKey:
+    case MsgId::Ping:
+        return true;
+    default:
+        return msg_id == '\0';
+    }
+}
+
+static uint64_t Micros(ReplaySerial::clock::duration duration)
+{
+    return static_cast<uint64_t>(std::max<long long>(
+        0, std::chrono::duration_cast<std::chrono::microseconds>(duration).count()));
+}
+
+bool ReplaySerial::LoadTrace(const char* path, uint32_t channel, std::vector<ReplayRecord>& records,
+                             std::string& error)
+{
+    records.clear();
+    std::unique_ptr<FILE, int (*)(FILE*)> file {::fopen(path, "rb"), ::fclose};
+    if (!file)
+    {
+        error = std::string("failed to open ") + path;
+        return false;
+    }
+    SerialTrace::FileHeader header;
+    if (::fread(&header, sizeof(header), 1, file.get()) != 1 ||
+        ::memcmp(header.magic, SerialTrace::FileMagic, sizeof(header.magic)) != 0)
+    {
+        error = std::string(path) + " is not a serial trace";
+        return false;
+    }
+
+    std::map<uint32_t, std::vector<ReplayRecord>> channels;
+    uint32_t first_sender = 0;
+    for (uint32_t i = 0; i < header.record_count; ++i)
+    {
+        SerialTrace::RecordHeader record;
+        if (::fread(&record, sizeof(record), 1, file.get()) != 1 || record.stored_size > SerialTrace::MaxRecordBytes)
+        {
+            error = "truncated trace at record " + std::to_string(i);
+            return false;
+        }
+        std::vector<char> bytes(record.stored_size);
+        if (!bytes.empty() && ::fread(bytes.data(), bytes.size(), 1, file.get()) != 1)
+        {
+            error = "truncated trace at record " + std::to_string(i);
+            return false;
+        }
+        const auto direction = static_cast<SerialTrace::Direction>(record.direction);
+        if (direction == SerialTrace::Direction::Send && first_sender == 0)
+        {
+            first_sender = record.channel;
+        }
+        if (direction == SerialTrace::Direction::Recv && record.stored_size < record.size &&
+            (channel == 0 || channel == record.channel))
+        {
+            error = "device transfer of record " + std::to_string(i) + " was cut to " +
+                    std::to_string(record.stored_size) + " bytes";
+            return false;
+        }
+        channels[record.channel].push_back(ReplayRecord {direction, record.time_us, record.size, std::move(bytes)});
+    }
+
+    auto it = channels.find(channel != 0 ? channel : first_sender);
+    if (it == channels.end())
+    {
+        error = "no records of the channel";
+        return false;
+    }
+    records = std::move(it->second);
+    return true;
+}
+
+ReplaySerial::ReplaySerial(std::vector<ReplayRecord> records) : _records {std::move(records)}
+{
+    // device bytes before the first send (e.g. a boot banner) are delivered from the start
+    const auto now = clock::now();
+    _last_send = now;
+    _last_recv = now;
+    if (!_records.empty())
+    {
+        ScheduleDeviceRecords(now, _records.front().time_us);
+    }
+}
+
+void ReplaySerial::ScheduleDeviceRecords(clock::time_point time, uint64_t recorded_time_us)
+{
+    auto available_at = time;
+    for (; _next < _records.size() && _records[_next].direction == SerialTrace::Direction::Recv; ++_next)
+    {
+        const auto& record = _records[_next];
+        const auto delay = std::chrono::microseconds {record.time_us - std::min(record.time_us, recorded_time_us)};
+        available_at = std::max(available_at, time + delay);
+        _chunks.push_back(Chunk {record.bytes, 0, available_at});
+    }
+    _cv.notify_all();
+}
+
+SerialStatus ReplaySerial::SendBytes(const char* buffer, size_t n_bytes)
+{
+    std::lock_guard<std::mutex> lock {_mutex};
+    const auto now = clock::now();
+    const char msg_id = PacketId(buffer, n_bytes);
+    if (!_divergence.empty())
+    {
+        return SerialStatus::SendFailed;
+    }
+
+    char description[160];
+    if (_next >= _records.size())
+    {
+        ::snprintf(description, sizeof(description), "send %zu of %zu bytes (packet '%c') after the recording's end",
+                   _timings.size() + 1, n_bytes, msg_id ? msg_id : '-');
+        _divergence = description;
+    }
+    else
+    {
+        const auto& record = _records[_next];
+        const char recorded_id = PacketId(record.bytes.data(), record.bytes.size());
+        if (recorded_id != msg_id || record.size != n_bytes)
+        {
+            ::snprintf(description, sizeof(description),
+                       "send %zu of %zu bytes (packet '%c'), recorded %zu bytes (packet '%c')", _timings.size() + 1,
+                       n_bytes, msg_id ? msg_id : '-', record.size, recorded_id ? recorded_id : '-');
+            _divergence = description;
+        }
+    }
+    if (!_divergence.empty())
+    {
+        LOG_ERROR(LOG_TAG, "Diverged from the recording: %s", _divergence.c_str());
+        _cv.notify_all();
+        return SerialStatus::SendFailed;
+    }
+
+    const auto& record = _records[_next];
+    ReplaySendTiming timing {msg_id, n_bytes, 0, 0};
+    if (_next > 0)
+    {
+        timing.recorded_us = record.time_us - std::min(record.time_us, _records[_next - 1].time_us);
+        timing.replay_us = Micros(now - std::max(_last_send, _last_recv));
+    }
+    _timings.push_back(timing);
+    _last_send = now;
+    ++_next;
+    ScheduleDeviceRecords(now, record.time_us);
+    return SerialStatus::Ok;
+}
+
+SerialStatus ReplaySerial::Read(char* buffer, size_t max_bytes, size_t& n_bytes_read, clock::time_point deadline,
+                                bool interruptible)
+{
+    n_bytes_read = 0;
+    std::unique_lock<std::mutex> lock {_mutex};
+    while (true)
+    {
+        if (interruptible && _interrupted)
+        {
+            _interrupted = false;
+            return SerialStatus::RecvTimeout;
+        }
+
+        auto now = clock::now();
+        while (n_bytes_read < max_bytes && !_chunks.empty() && _chunks.front().available_at <= now)
+        {
+            auto& chunk = _chunks.front();
+            auto n_bytes = std::min(max_bytes - n_bytes_read, chunk.bytes.size() - chunk.offset);
+            ::memcpy(buffer + n_bytes_read, chunk.bytes.data() + chunk.offset, n_bytes);
+            n_bytes_read += n_bytes;
+            chunk.offset += n_bytes;
+            _last_recv = now;
+            if (chunk.offset == chunk.bytes.size())
+            {
+                _chunks.pop_front();
+            }
+        }
+        if (n_bytes_read > 0)
+        {
+            return SerialStatus::Ok;
+        }
+        if (_chunks.empty() && !_divergence.empty())
+        {
+            return SerialStatus::RecvFailed;
+        }
+        if (now >= deadline)
+        {
+            return SerialStatus::RecvTimeout;
+        }
+
+        auto wakeup = deadline;
+        if (!_chunks.empty())
+        {
+            wakeup = std::min(wakeup, _chunks.front().available_at);
+        }
+        _cv.wait_until(lock, wakeup);
+    }
+}
+
+static ReplaySerial::clock::time_point Deadline(size_t timeout_ms)
+{
+    return ReplaySerial::clock::now() + std::chrono::milliseconds {timeout_ms};
+}
+
+// same timeouts as LinuxSerial
+SerialStatus ReplaySerial::RecvBytes(char* buffer, size_t n_bytes)
+{
+    if (n_bytes == 0)
+    {
+        LOG_ERROR(LOG_TAG, "Attempt to recv 0 bytes");
+        return SerialStatus::RecvFailed;
+    }
+
+    auto deadline = Deadline(200 + 4 * n_bytes);
+    size_t total_bytes_read = 0;
+    while (total_bytes_read < n_bytes)
+    {
+        size_t n_bytes_read = 0;
+        auto status = Read(buffer + total_bytes_read, n_bytes - total_bytes_read, n_bytes_read, deadline, false);
+        if (status != SerialStatus::Ok)
+        {
+            return status;
+        }
+        total_bytes_read += n_bytes_read;
+    }
+    return SerialStatus::Ok;
+}
+
+SerialStatus ReplaySerial::RecvAvailable(char* buffer, size_t max_bytes, size_t& n_bytes_read)
+{
+    n_bytes_read = 0;
+    if (max_bytes == 0)
+    {
+        LOG_ERROR(LOG_TAG, "Attempt to recv 0 bytes");
+        return SerialStatus::RecvFailed;
+    }
+    return Read(buffer, max_bytes, n_bytes_read, Deadline(204), true);
+}
+
+SerialStatus ReplaySerial::DiscardUntil(char value, timeout_t max_wait)
+{
+    auto deadline = Deadline(static_cast<size_t>(std::min(std::max(max_wait, timeout_t {0}), timeout_t {204}).count()));
+    while (true)
+    {
+        char byte = 0;
+        size_t n_bytes_read = 0;
+        auto status = Read(&byte, 1, n_bytes_read, deadline, true);
+        if (status != SerialStatus::Ok)
+        {
+            return status;
+        }
+        if (byte == value)
+        {
+            return SerialStatus::Ok;
+        }
+    }
+}
+
+void ReplaySerial::InterruptRecv()
+{
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        _interrupted = true;
+    }
+    _cv.notify_all();
+}
+
+bool ReplaySerial::NextRequest(SerialPacket& packet) const
+{
+    std::lock_guard<std::mutex> lock {_mutex};
+    for (size_t i = _next; i < _records.size(); ++i)
+    {
+        const auto& record = _records[i];
+        if (record.direction != SerialTrace::Direction::Send)
+        {
+            continue;
+        }
+        const auto offset = FindPacket(record.bytes.data(), record.bytes.size());
+        if (offset == NoPacket || IsSessionPacket(record.bytes[offset + 3]))
+        {
+            continue;
+        }
+        packet = SerialPacket {};
+        ::memcpy(&packet, record.bytes.data() + offset, std::min(sizeof(packet), record.bytes.size() - offset));
+        return true;
+    }
+    return false;
+}
+
+bool ReplaySerial::PersistentSession() const
+{
+    std::lock_guard<std::mutex> lock {_mutex};
+    size_t n_requests = 0;
+    bool session_started = false;
+    for (const auto& record : _records)
+    {
+        if (record.direction != SerialTrace::Direction::Send)
+        {
+            continue;
+        }
+        const char msg_id = PacketId(record.bytes.data(), record.bytes.size());
+        if (msg_id == static_cast<char>(MsgId::StartSession))
+        {
+            session_started = true;
+        }
+        else if (!IsSessionPacket(msg_id))
+        {
+            // each operation of a closing session starts its own
+            if (++n_requests > 1 && !session_started)
+            {
+                return true;
+            }
+            session_started = false;
+        }
+    }
+    return false;
+}
+
+bool ReplaySerial::PackedTransfers() const
+{
+    std::lock_guard<std::mutex> lock {_mutex};
+    for (const auto& record : _records)
+    {
+        const char msg_id = PacketId(record.bytes.data(), record.bytes.size());
+        if (record.direction == SerialTrace::Direction::Send &&
+            (msg_id == static_cast<char>(MsgId::GetUserFeaturesPacked) ||
+             msg_id == static_cast<char>(MsgId::SetUserFeaturesPacked)))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+SessionOptions ReplaySerial::StartOptions() const
+{
+    std::lock_guard<std::mutex> lock {_mutex};
+    SessionOptions options;
+    for (const auto& record : _records)
+    {
+        const auto offset = FindPacket(record.bytes.data(), record.bytes.size());
+        if (record.direction != SerialTrace::Direction::Send || offset == NoPacket ||
+            record.bytes[offset + 3] != static_cast<char>(MsgId::StartSession))
+        {
+            continue;
+        }
+        SerialPacket packet {};
+        ::memcpy(&packet, record.bytes.data() + offset, std::min(sizeof(packet), record.bytes.size() - offset));
+        const auto& data = packet.payload.message.data_msg;
+        const size_t size = packet.header.payload_size > sizeof(packet.payload.sequence_number)
+                                ? packet.header.payload_size - sizeof(packet.payload.sequence_number)
+                                : 0;
+        ReadSessionOptions(reinterpret_cast<const unsigned char*>(data.data), std::min(size, sizeof(data.data)),
+                           options);
+        break;
+    }
+    return options;
+}
+
+bool ReplaySerial::Diverged(std::string& description) const
+{
+    std::lock_guard<std::mutex> lock {_mutex};
+    description = _divergence;
+    return !_divergence.empty();
+}
+
+std::vector<ReplaySendTiming> ReplaySerial::SendTimings() const
+{
+    std::lock_guard<std::mutex> lock {_mutex};
+    return _timings;
+}
+} // namespace PacketManager
+} // namespace RealSenseID
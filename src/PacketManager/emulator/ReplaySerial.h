@@ -0,0 +1,115 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "SerialConnection.h"
+#include "SerialPacket.h"
+#include "SerialTrace.h"
+#include "SessionOptions.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace RealSenseID
+{
+namespace PacketManager
+{
+// a transfer of a serial trace
+struct ReplayRecord
+{
+    SerialTrace::Direction direction;
+    uint64_t time_us; // recorded steady clock time
+    size_t size;      // bytes transferred. the bytes of a send may be cut (SerialTrace::MaxRecordBytes)
+    std::vector<char> bytes;
+};
+
+// host time before a send: from the last receive of device bytes (or the previous send, the later) to the send
+struct ReplaySendTiming
+{
+    char msg_id; // MsgId of the sent packet, '\0' if the bytes are not a packet
+    size_t size;
+    uint64_t recorded_us;
+    uint64_t replay_us;
+};
+
+// Serial connection that plays the device side of a recorded conversation (a channel of a SerialTrace dump) back to
+// the host stack, e.g. to reproduce a slow enroll or a timeout of the field on a developer machine.
+//
+// Each host send is checked against the next recorded one (same packet id and size, the contents may differ), then
+// the device bytes recorded after it are delivered at their recorded delays from it. So the device takes the same
+// time as in the field while the host runs at its own speed, and the host's time before each send is measured
+// independently of the device (SendTimings()). A send that differs from the recording stops the replay: it fails
+// with SendFailed and Diverged() tells where.
+//
+// The recording has to start before the connection's first session (the host starts its own), and be of the non
+// secure session (the secure session's keys are random). The link calibration's pings carry random data, so a
+// connection with SerialConfig::calibrate_link does not replay either.
+class ReplaySerial : public SerialConnection
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    // read the records of a channel of a trace file. channel 0: the first channel that sends. returns false with
+    // the error if the file is invalid or a device transfer of the channel was cut (see SerialTrace::MaxRecordBytes).
+    static bool LoadTrace(const char* path, uint32_t channel, std::vector<ReplayRecord>& records,
+                          std::string& error);
+
+    explicit ReplaySerial(std::vector<ReplayRecord> records);
+
+    ReplaySerial(const ReplaySerial&) = delete;
+    ReplaySerial& operator=(const ReplaySerial&) = delete;
+
+    SerialStatus SendBytes(const char* buffer, size_t n_bytes) final;
+    SerialStatus RecvBytes(char* buffer, size_t n_bytes) final;
+    SerialStatus RecvAvailable(char* buffer, size_t max_bytes, size_t& n_bytes_read) final;
+    SerialStatus DiscardUntil(char value, timeout_t max_wait) final;
+    void InterruptRecv() final;
+
+    // the next recorded operation request of the host (not a session or link packet). false if there are no more
+    bool NextRequest(SerialPacket& packet) const;
+
+    // the recording kept the session open across operations (FaceAuthenticator::SetPersistentSession())
+    bool PersistentSession() const;
+
+    // the recording sent packed faceprints messages (FaceAuthenticator::SetPackedTransfers())
+    bool PackedTransfers() const;
+
+    // the session options the recording's host offered on its first session start, the defaults if none
+    SessionOptions StartOptions() const;
+
+    // the host sent something else than the recording. description: the send and the recorded one
+    bool Diverged(std::string& description) const;
+
+    std::vector<ReplaySendTiming> SendTimings() const;
+
+private:
+    struct Chunk
+    {
+        std::vector<char> bytes;
+        size_t offset; // bytes already received
+        clock::time_point available_at;
+    };
+
+    // queue the device records from _next on, at their delays from the record of recorded_time_us, replayed at time
+    void ScheduleDeviceRecords(clock::time_point time, uint64_t recorded_time_us);
+    SerialStatus Read(char* buffer, size_t max_bytes, size_t& n_bytes_read, clock::time_point deadline,
+                      bool interruptible);
+
+    const std::vector<ReplayRecord> _records;
+    mutable std::mutex _mutex;
+    std::condition_variable _cv;
+    size_t _next = 0; // next record to replay (a host send)
+    std::deque<Chunk> _chunks;
+    clock::time_point _last_send;    // replay time of the last send
+    clock::time_point _last_recv;    // replay time of the last receive of device bytes
+    std::vector<ReplaySendTiming> _timings;
+    std::string _divergence;
+    bool _interrupted = false;
+};
+} // namespace PacketManager
+} // namespace RealSenseID
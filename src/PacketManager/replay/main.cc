@@ -0,0 +1,268 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+// Replay a serial trace (RealSenseID::DumpSerialTrace) of a device conversation to the host stack: the recorded
+// operations run again on FaceAuthenticatorImpl, connected to the device bytes of the trace delivered at their recorded
+// timings. Prints each operation's status and duration, then the host's processing time before each of its sends,
+// recorded vs replayed, to tell regressions of the host from the device's timing.
+//
+// Usage: rsid-serial-replay <trace file> [channel (hex, as the trace decoder prints)]
+
+#include "FaceAuthenticatorImpl.h"
+#include "ReplaySerial.h"
+#include "RealSenseID/AuthFaceprintsExtractionCallback.h"
+#include "RealSenseID/AuthenticationCallback.h"
+#include "RealSenseID/EnrollFaceprintsExtractionCallback.h"
+#include "RealSenseID/EnrollmentCallback.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace RealSenseID;
+using namespace RealSenseID::PacketManager;
+
+static constexpr int SUCCESS_MAIN = 0;
+static constexpr int FAILURE_MAIN = 1;
+
+namespace
+{
+// the non secure session signs nothing
+class NullSignatureCallback : public SignatureCallback
+{
+public:
+    bool Sign(const unsigned char*, const unsigned int, unsigned char* out_sig) override
+    {
+        std::fill(out_sig, out_sig + 64, 0);
+        return true;
+    }
+
+    bool Verify(const unsigned char*, const unsigned int, const unsigned char*, const unsigned int) override
+    {
+        return true;
+    }
+};
+
+class ReplayAuthCallback : public AuthenticationCallback
+{
+public:
+    void OnResult(const AuthenticateStatus status, const char*) override
+    {
+        result = Description(status);
+    }
+
+    void OnHint(const AuthenticateStatus) override
+    {
+    }
+
+    std::string result;
+};
+
+class ReplayEnrollCallback : public EnrollmentCallback
+{
+public:
+    void OnResult(const EnrollStatus status) override
+    {
+        result = Description(status);
+    }
+
+    void OnProgress(const FacePose) override
+    {
+    }
+
+    void OnHint(const EnrollStatus) override
+    {
+    }
+
+    std::string result;
+};
+
+class ReplayAuthExtractionCallback : public AuthFaceprintsExtractionCallback
+{
+public:
+    void OnResult(const AuthenticateStatus status, const Faceprints*) override
+    {
+        result = Description(status);
+    }
+
+    void OnHint(const AuthenticateStatus) override
+    {
+    }
+
+    std::string result;
+};
+
+class ReplayEnrollExtractionCallback : public EnrollFaceprintsExtractionCallback
+{
+public:
+    void OnResult(const EnrollStatus status, const Faceprints*) override
+    {
+        result = Description(status);
+    }
+
+    void OnProgress(const FacePose) override
+    {
+    }
+
+    void OnHint(const EnrollStatus) override
+    {
+    }
+
+    std::string result;
+};
+
+// run the operation of a recorded request. false if the tool does not replay it
+bool RunOperation(FaceAuthenticatorImpl& authenticator, const SerialPacket& request, Status& status,
+                  std::string& result)
+{
+    switch (request.header.id)
+    {
+    case MsgId::Authenticate: {
+        ReplayAuthCallback callback;
+        status = authenticator.Authenticate(callback);
+        result = callback.result;
+        return true;
+    }
+    case MsgId::AuthenticateFaceprintsExtraction: {
+        ReplayAuthExtractionCallback callback;
+        status = authenticator.ExtractFaceprintsForAuth(callback);
+        result = callback.result;
+        return true;
+    }
+    case MsgId::Enroll: {
+        char user_id[MaxUserIdSize + 1] = {0};
+        ::memcpy(user_id, request.payload.message.fa_msg.user_id, MaxUserIdSize);
+        ReplayEnrollCallback callback;
+        status = authenticator.Enroll(callback, user_id);
+        result = callback.result;
+        return true;
+    }
+    case MsgId::EnrollFaceprintsExtraction: {
+        ReplayEnrollExtractionCallback callback;
+        status = authenticator.ExtractFaceprintsForEnroll(nullptr, callback);
+        result = callback.result;
+        return true;
+    }
+    case MsgId::GetNumberOfUsers: {
+        unsigned int number_of_users = 0;
+        status = authenticator.QueryNumberOfUsers(number_of_users);
+        result = std::to_string(number_of_users) + " users";
+        return true;
+    }
+    case MsgId::RemoveUser: {
+        char user_id[MaxUserIdSize + 1] = {0};
+        ::memcpy(user_id, request.payload.message.fa_msg.user_id, MaxUserIdSize);
+        status = authenticator.RemoveUser(user_id);
+        return true;
+    }
+    case MsgId::RemoveAllUsers:
+        status = authenticator.RemoveAll();
+        return true;
+    case MsgId::StandBy:
+        status = authenticator.Standby();
+        return true;
+    default:
+        return false;
+    }
+}
+
+void PrintSendTimings(const std::vector<ReplaySendTiming>& timings)
+{
+    struct Total
+    {
+        size_t count = 0;
+        uint64_t recorded_us = 0;
+        uint64_t replay_us = 0;
+    };
+    std::map<char, Total> totals;
+
+    std::printf("\nhost time before each send (us):\n%6s %6s %8s %10s %10s\n", "send", "packet", "bytes", "recorded",
+                "replay");
+    for (size_t i = 0; i < timings.size(); ++i)
+    {
+        const auto& timing = timings[i];
+        const char msg_id = timing.msg_id ? timing.msg_id : '-';
+        std::printf("%6zu %6c %8zu %10llu %10llu\n", i + 1, msg_id, timing.size,
+                    static_cast<unsigned long long>(timing.recorded_us),
+                    static_cast<unsigned long long>(timing.replay_us));
+        auto& total = totals[msg_id];
+        ++total.count;
+        total.recorded_us += timing.recorded_us;
+        total.replay_us += timing.replay_us;
+    }
+
+    std::printf("\nper packet (mean us):\n%6s %6s %10s %10s\n", "packet", "sends", "recorded", "replay");
+    for (const auto& total : totals)
+    {
+        std::printf("%6c %6zu %10llu %10llu\n", total.first, total.second.count,
+                    static_cast<unsigned long long>(total.second.recorded_us / total.second.count),
+                    static_cast<unsigned long long>(total.second.replay_us / total.second.count));
+    }
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2 || argc > 3)
+    {
+        std::fprintf(stderr, "Usage: %s <trace file> [channel (hex)]\n", argv[0]);
+        return FAILURE_MAIN;
+    }
+    const auto channel = argc == 3 ? static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 16)) : 0u;
+
+    std::vector<ReplayRecord> records;
+    std::string error;
+    if (!ReplaySerial::LoadTrace(argv[1], channel, records, error))
+    {
+        std::fprintf(stderr, "Failed loading %s: %s\n", argv[1], error.c_str());
+        return FAILURE_MAIN;
+    }
+    std::printf("%zu records\n", records.size());
+
+    auto serial = std::make_unique<ReplaySerial>(std::move(records));
+    auto* replay = serial.get();
+    NullSignatureCallback signature_callback;
+    FaceAuthenticatorImpl authenticator {&signature_callback};
+    authenticator.Connect(std::move(serial));
+    authenticator.SetPersistentSession(replay->PersistentSession());
+    authenticator.SetPackedTransfers(replay->PackedTransfers());
+    const auto start_options = replay->StartOptions();
+    authenticator.SetLargePayloads(start_options.large_payload > 0);
+    authenticator.SetMessageBatches(start_options.batches);
+
+    SerialPacket request;
+    bool completed = true;
+    while (replay->NextRequest(request))
+    {
+        const char msg_id = static_cast<char>(request.header.id);
+        Status status = Status::Ok;
+        std::string result;
+        const auto start = std::chrono::steady_clock::now();
+        if (!RunOperation(authenticator, request, status, result))
+        {
+            std::printf("stopped at packet '%c': not an operation the tool replays\n", msg_id);
+            completed = false;
+            break;
+        }
+        const auto elapsed_ms =
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        std::printf("'%c' %-10s %-24s %6lld ms\n", msg_id, Description(status), result.c_str(),
+                    static_cast<long long>(elapsed_ms));
+
+        std::string divergence;
+        if (replay->Diverged(divergence))
+        {
+            std::printf("diverged from the recording: %s\n", divergence.c_str());
+            completed = false;
+            break;
+        }
+    }
+
+    PrintSendTimings(replay->SendTimings());
+    return completed ? SUCCESS_MAIN : FAILURE_MAIN;
+}
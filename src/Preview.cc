@@ -41,8 +41,73 @@ bool Preview::StopPreview()
     return _impl->StopPreview();
 }
 
+bool Preview::StandbyPreview()
+{
+    return _impl->StandbyPreview();
+}
+
 bool Preview::RawToRgb(const Image& in_image, Image& out_image)
 {
     return _impl->RawToRgb(in_image, out_image);
 }
+
+bool Preview::RawToGray(const Image& in_image, Image& out_image, bool binning)
+{
+    return _impl->RawToGray(in_image, out_image, binning);
+}
+
+bool Preview::RawToRaw16(const Image& in_image, Image& out_image)
+{
+    return _impl->RawToRaw16(in_image, out_image);
+}
+
+bool Preview::Subscribe(PreviewImageReadyCallback& callback, const PreviewSubscription& subscription)
+{
+    return _impl->Subscribe(callback, subscription);
+}
+
+bool Preview::Unsubscribe(PreviewImageReadyCallback& callback)
+{
+    return _impl->Unsubscribe(callback);
+}
+
+bool Preview::AcquireImage(const Image& image)
+{
+    return _impl->AcquireImage(image);
+}
+
+bool Preview::ReleaseImage(const Image& image)
+{
+    return _impl->ReleaseImage(image);
+}
+
+bool Preview::SetCropRegion(const FaceRect& region)
+{
+    return _impl->SetCropRegion(region);
+}
+
+bool Preview::ClearCropRegion()
+{
+    return _impl->ClearCropRegion();
+}
+
+bool Preview::GetStatistics(PreviewStatistics& statistics)
+{
+    return _impl->GetStatistics(statistics);
+}
+
+bool Preview::StartFrameRecorder(unsigned int seconds, unsigned int max_bytes)
+{
+    return _impl->StartFrameRecorder(seconds, max_bytes);
+}
+
+bool Preview::SaveRecordedFrames(const char* directory)
+{
+    return _impl->SaveRecordedFrames(directory);
+}
+
+bool Preview::StopFrameRecorder()
+{
+    return _impl->StopFrameRecorder();
+}
 } // namespace RealSenseID
@@ -3,9 +3,11 @@
 
 #include "PreviewImpl.h"
 #include "Logger.h"
+#include "RealTimeMode.h"
 #include "RealSenseID/DiscoverDevices.h"
 #include "RawToRgb.h"
 #include <chrono>
+#include <cstdint>
 
 static const char* LOG_TAG = "Preview";
 
@@ -25,6 +27,12 @@ PreviewImpl::PreviewImpl(const PreviewConfig& config) : _config(config)
         }
         _config.cameraNumber = (camera_numbers.size() > 0) ? camera_numbers[0] : 0;
     }
+    // metadata previews have no images
+    const bool metadata_only = _config.previewFormat == PreviewFormat::METADATA;
+    _frame_pool = std::make_unique<Capture::FramePool>(metadata_only ? 0 : _config.bufferCount,
+                                                       Capture::GetImageSize(_config));
+    _decode_executor = Capture::DecodeExecutor::Shared();
+    _fanout = std::make_unique<Capture::FrameFanout>(_config, *_frame_pool, _decode_executor.get());
 };
 
 PreviewImpl::~PreviewImpl()
@@ -42,45 +50,119 @@ bool PreviewImpl::StartPreview(PreviewImageReadyCallback& callback)
 {
     _callback = &callback;
 
-    _paused = false;
-    _canceled = false;
+    {
+        std::lock_guard<std::mutex> lock {_state_mutex};
+        _paused = false;
+        _standby = false;
+        _canceled = false;
+    }
 
     if (_worker_thread.joinable())
     {
         return false;
     }
+    _statistics.Reset();
 
-    _worker_thread = std::thread([&]() {
+    _worker_thread = LibraryThread([&]() {
+        RealTimeMode::EnterIoThread("preview");
         try
         {
-            _capture = std::make_unique<Capture::CaptureHandle>(_config);
+            std::unique_ptr<Capture::CaptureHandle> capture;
+            {
+                // a camera in standby is already streaming, its next frame is the first one
+                std::lock_guard<std::mutex> lock {_state_mutex};
+                capture.swap(_standby_capture);
+            }
+            const bool warm = capture != nullptr;
+            if (!warm)
+            {
+                capture = OpenCapture();
+            }
+            {
+                std::lock_guard<std::mutex> lock {_state_mutex};
+                _capture = std::move(capture);
+                if (_paused && _standby)
+                {
+                    _capture->Standby();
+                }
+                else if (_paused)
+                {
+                    _capture->Pause();
+                }
+                else if (warm)
+                {
+                    _capture->Resume();
+                }
+            }
+            const bool metadata_only = _config.previewFormat == PreviewFormat::METADATA;
             unsigned int frameNumber = 0;
-            LOG_DEBUG(LOG_TAG, "Preview started!");
-            while (!_canceled)
+            unsigned int capture_dropped = 0;
+            LOG_DEBUG(LOG_TAG, "Preview started%s!", warm ? " from standby" : "");
+            while (true)
             {
-                if (_paused)
+                FaceRect crop_region;
+                bool crop_enabled;
+                std::shared_ptr<Capture::FrameRecorder> recorder;
                 {
-                    std::this_thread::sleep_for(std::chrono::milliseconds {100});
-                    continue;
+                    // pause, resume and stop wake this up right away
+                    std::unique_lock<std::mutex> lock {_state_mutex};
+                    _state_cv.wait(lock, [this] { return !_paused || _canceled; });
+                    if (_canceled)
+                    {
+                        break;
+                    }
+                    crop_enabled = _crop_enabled;
+                    crop_region = _crop_region;
+                    recorder = _recorder;
                 }
+                auto& converter = _capture->GetStreamConverter();
+                converter.SetCropRegion(crop_enabled ? &crop_region : nullptr);
+                converter.SetRecorder(recorder.get());
                 RealSenseID::Image container;
+                if (!metadata_only)
+                {
+                    container.buffer = _frame_pool->Acquire();
+                }
+                if (container.buffer == nullptr && !metadata_only)
+                {
+                    LOG_TRACE(LOG_TAG, "All preview buffers are in use, dropping frame");
+                }
+                // read also without a buffer to keep the stream flowing (the frame is dropped)
+                auto* frame_buffer = container.buffer;
                 bool res = _capture->Read(&container);
-                if (_canceled)
+                converter.SetRecorder(nullptr);
+                auto dropped = _capture->DroppedFrames();
+                if (dropped != capture_dropped)
                 {
-                    break;
+                    _statistics.OnFramesDropped(dropped - capture_dropped);
+                    capture_dropped = dropped;
                 }
-                if (_paused)
+                if (!res && frame_buffer == nullptr && !metadata_only && container.receive_time != 0)
                 {
-                    continue;
+                    _statistics.OnFramesDropped(1); // received but no buffer to decode it to
                 }
-                if (res)
+                if (res && !_canceled && !_paused)
                 {
                     container.number = frameNumber++;
-                    _callback->OnPreviewImageReady(container);
+                    _fanout->Deliver(container); // the subscribers run along with the callback
+                    _statistics.OnFrameDelivered(container, converter.LastDecodeMicros(), Capture::HostTimeMicros());
+                    auto* cropped_region = converter.CroppedRegion();
+                    if (cropped_region != nullptr)
+                    {
+                        _callback->OnCroppedImageReady(container, *cropped_region);
+                    }
+                    else
+                    {
+                        _callback->OnPreviewImageReady(container);
+                    }
                 }
                 else
                 {
-                    continue;
+                    _fanout->Discard();
+                }
+                if (frame_buffer != nullptr)
+                {
+                    _frame_pool->Release(frame_buffer);
                 }
             }
         }
@@ -94,30 +176,112 @@ bool PreviewImpl::StartPreview(PreviewImageReadyCallback& callback)
             LOG_ERROR(LOG_TAG, "Streaming unknonwn exception");
             _canceled = true;
         }
+        std::lock_guard<std::mutex> lock {_state_mutex};
         _capture.reset();
     });
     return true;
 }
 
+std::unique_ptr<Capture::CaptureHandle> PreviewImpl::OpenCapture()
+{
+    auto capture = std::make_unique<Capture::CaptureHandle>(_config);
+    // the cameras of all the previews are decoded by the same threads
+    capture->GetStreamConverter().SetExecutor(_decode_executor.get());
+    capture->GetStreamConverter().SetTap(_fanout.get());
+    return capture;
+}
+
+bool PreviewImpl::StandbyPreview()
+{
+    {
+        std::lock_guard<std::mutex> lock {_state_mutex};
+        if (_worker_thread.joinable())
+        {
+            // a started preview pauses with its camera streaming, for ResumePreview. the worker applies it to a
+            // camera it is still opening
+            _paused = true;
+            _standby = true;
+            if (_capture)
+            {
+                _capture->Standby();
+            }
+            return true;
+        }
+        if (_standby_capture)
+        {
+            return true;
+        }
+    }
+
+    // opened outside the lock, taking as long as a cold start
+    std::unique_ptr<Capture::CaptureHandle> capture;
+    try
+    {
+        capture = OpenCapture();
+        capture->Standby();
+    }
+    catch (const std::exception& ex)
+    {
+        LOG_ERROR(LOG_TAG, "Failed to open the camera for standby: %s", ex.what());
+        return false;
+    }
+    std::lock_guard<std::mutex> lock {_state_mutex};
+    if (!_standby_capture)
+    {
+        _standby_capture = std::move(capture);
+    }
+    LOG_DEBUG(LOG_TAG, "Preview in standby");
+    return true;
+}
+
 bool PreviewImpl::PausePreview()
 {
+    std::lock_guard<std::mutex> lock {_state_mutex};
     _paused = true;
+    _standby = false;
+    if (_capture)
+    {
+        _capture->Pause();
+    }
     return true;
 }
 
 bool PreviewImpl::ResumePreview()
 {
-    _paused = false;
+    {
+        std::lock_guard<std::mutex> lock {_state_mutex};
+        _paused = false;
+        _standby = false;
+        if (_capture)
+        {
+            _capture->Resume();
+        }
+    }
+    _state_cv.notify_all();
     return true;
 }
 
 bool PreviewImpl::StopPreview()
 {
-    _canceled = true;
+    {
+        std::lock_guard<std::mutex> lock {_state_mutex};
+        _canceled = true;
+        if (_capture)
+        {
+            _capture->Interrupt();
+        }
+    }
+    _state_cv.notify_all();
     if (_worker_thread.joinable())
     {
         _worker_thread.join();
     }
+    // a camera left in standby is closed too
+    std::unique_ptr<Capture::CaptureHandle> standby_capture;
+    {
+        std::lock_guard<std::mutex> lock {_state_mutex};
+        standby_capture.swap(_standby_capture);
+    }
     return true;
 }
 
@@ -139,4 +303,151 @@ bool PreviewImpl::RawToRgb(const Image& in_image, Image& out_image)
     Capture::RotatedRaw2Rgb(in_image, out_image);
     return true;
 }
+
+bool PreviewImpl::RawToGray(const Image& in_image, Image& out_image, bool binning)
+{
+    if (in_image.buffer == nullptr || out_image.buffer == nullptr || in_image.size == 0)
+        return false;
+    const unsigned int gray_size = binning ? (in_image.width / 2) * (in_image.height / 2)
+                                           : in_image.width * in_image.height;
+    if (out_image.size != gray_size) // check for valid buffer of out_image
+    {
+        LOG_DEBUG(LOG_TAG, "RawToGray out_image is in size %d. need to be %d", out_image.size, gray_size);
+        return false;
+    }
+    if (((in_image.width * in_image.height / 4) * 5) != in_image.size) // check for valid w10 image 10bpp
+    {
+        LOG_DEBUG(LOG_TAG, "RawToGray in_image is not a valid raw10 image");
+        return false;
+    }
+    Capture::Raw2Gray(in_image, out_image, binning);
+    return true;
+}
+
+bool PreviewImpl::RawToRaw16(const Image& in_image, Image& out_image)
+{
+    if (in_image.buffer == nullptr || out_image.buffer == nullptr || in_image.size == 0)
+        return false;
+    if (out_image.size != in_image.width * in_image.height * 2) // check for valid buffer of out_image
+    {
+        LOG_DEBUG(LOG_TAG, "RawToRaw16 out_image is in size %d. need to be in_image width*height*2 =%d",
+                  out_image.size, in_image.width * in_image.height * 2);
+        return false;
+    }
+    if (reinterpret_cast<uintptr_t>(out_image.buffer) % alignof(uint16_t) != 0)
+    {
+        LOG_DEBUG(LOG_TAG, "RawToRaw16 out_image buffer is not aligned to 2");
+        return false;
+    }
+    if (((in_image.width * in_image.height / 4) * 5) != in_image.size) // check for valid w10 image 10bpp
+    {
+        LOG_DEBUG(LOG_TAG, "RawToRaw16 in_image is not a valid raw10 image");
+        return false;
+    }
+    Capture::Raw2Raw16(in_image, out_image);
+    return true;
+}
+
+bool PreviewImpl::Subscribe(PreviewImageReadyCallback& callback, const PreviewSubscription& subscription)
+{
+    try
+    {
+        return _fanout->Subscribe(callback, subscription);
+    }
+    catch (const std::exception& ex)
+    {
+        LOG_ERROR(LOG_TAG, "Failed to subscribe: %s", ex.what());
+        return false;
+    }
+}
+
+bool PreviewImpl::Unsubscribe(PreviewImageReadyCallback& callback)
+{
+    return _fanout->Unsubscribe(callback);
+}
+
+bool PreviewImpl::AcquireImage(const Image& image)
+{
+    return _frame_pool->AddRef(image.buffer) || _fanout->AddRef(image.buffer);
+}
+
+bool PreviewImpl::ReleaseImage(const Image& image)
+{
+    return _frame_pool->Release(image.buffer) || _fanout->Release(image.buffer);
+}
+
+bool PreviewImpl::SetCropRegion(const FaceRect& region)
+{
+    if (region.w == 0 || region.h == 0)
+        return false;
+    if (_config.previewFormat != PreviewFormat::RGB && _config.previewFormat != PreviewFormat::GRAY8)
+    {
+        LOG_ERROR(LOG_TAG, "Crop region is supported for RGB and GRAY8 formats only");
+        return false;
+    }
+    if (_config.previewMode == PreviewMode::RAW10_1080P) // raw frames are delivered as received
+    {
+        LOG_ERROR(LOG_TAG, "Crop region is not supported for RAW10 frames");
+        return false;
+    }
+    std::lock_guard<std::mutex> lock {_state_mutex};
+    _crop_region = region;
+    _crop_enabled = true;
+    return true;
+}
+
+bool PreviewImpl::ClearCropRegion()
+{
+    std::lock_guard<std::mutex> lock {_state_mutex};
+    _crop_enabled = false;
+    return true;
+}
+
+bool PreviewImpl::GetStatistics(PreviewStatistics& statistics)
+{
+    statistics = _statistics.Get();
+    statistics.buffers_in_use = _frame_pool->InUse() + _fanout->InUse();
+    return true;
+}
+
+bool PreviewImpl::StartFrameRecorder(unsigned int seconds, unsigned int max_bytes)
+{
+    if (seconds == 0 || max_bytes == 0)
+        return false;
+    std::shared_ptr<Capture::FrameRecorder> recorder;
+    try
+    {
+        recorder = std::make_shared<Capture::FrameRecorder>(seconds, max_bytes);
+    }
+    catch (const std::exception& ex)
+    {
+        LOG_ERROR(LOG_TAG, "Failed to start frame recorder: %s", ex.what());
+        return false;
+    }
+    std::lock_guard<std::mutex> lock {_state_mutex};
+    _recorder.swap(recorder);
+    return true; // the previous recorder, if any, is destroyed after the lock is released
+}
+
+bool PreviewImpl::SaveRecordedFrames(const char* directory)
+{
+    if (directory == nullptr)
+        return false;
+    std::shared_ptr<Capture::FrameRecorder> recorder;
+    {
+        std::lock_guard<std::mutex> lock {_state_mutex};
+        recorder = _recorder;
+    }
+    return recorder && recorder->Save(directory);
+}
+
+bool PreviewImpl::StopFrameRecorder()
+{
+    std::shared_ptr<Capture::FrameRecorder> recorder;
+    {
+        std::lock_guard<std::mutex> lock {_state_mutex};
+        recorder.swap(_recorder);
+    }
+    return true;
+}
 } // namespace RealSenseID
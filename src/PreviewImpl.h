@@ -4,9 +4,18 @@
 #pragma once
 
 #include "RealSenseID/Preview.h"
+#include "FramePool.h"
+#include "FrameStatistics.h"
+#include "FrameRecorder.h"
+#include "DecodeExecutor.h"
+#include "FrameFanout.h"
+#include "LibraryThread.h"
 
 #include <thread>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
 
 #ifdef ANDROID
 #include "AndroidCapture.h"
@@ -27,14 +36,41 @@ public:
     bool PausePreview();
     bool ResumePreview();
     bool StopPreview();
+    bool StandbyPreview();
     bool RawToRgb(const Image& in_image,Image& out_image);
+    bool RawToGray(const Image& in_image, Image& out_image, bool binning);
+    bool RawToRaw16(const Image& in_image, Image& out_image);
+    bool Subscribe(PreviewImageReadyCallback& callback, const PreviewSubscription& subscription);
+    bool Unsubscribe(PreviewImageReadyCallback& callback);
+    bool AcquireImage(const Image& image);
+    bool ReleaseImage(const Image& image);
+    bool SetCropRegion(const FaceRect& region);
+    bool ClearCropRegion();
+    bool GetStatistics(PreviewStatistics& statistics);
+    bool StartFrameRecorder(unsigned int seconds, unsigned int max_bytes);
+    bool SaveRecordedFrames(const char* directory);
+    bool StopFrameRecorder();
 
 private:
+    // the camera opened for this preview, decoding to its executor and fanout
+    std::unique_ptr<Capture::CaptureHandle> OpenCapture();
+
     PreviewConfig _config;
-    std::thread _worker_thread;
+    LibraryThread _worker_thread;
     std::atomic_bool _canceled {false};
     std::atomic_bool _paused {false};
+    bool _standby = false; // guarded by _state_mutex. paused in standby rather than plain pause
+    std::mutex _state_mutex; // guards _capture and the pause / cancel transitions
+    std::condition_variable _state_cv;
+    bool _crop_enabled = false; // guarded by _state_mutex
+    FaceRect _crop_region;
+    std::shared_ptr<Capture::FrameRecorder> _recorder; // guarded by _state_mutex, the worker holds it during a read
     PreviewImageReadyCallback* _callback = nullptr;
     std::unique_ptr<Capture::CaptureHandle> _capture;
+    std::unique_ptr<Capture::CaptureHandle> _standby_capture; // guarded by _state_mutex, opened before StartPreview
+    std::unique_ptr<Capture::FramePool> _frame_pool;
+    std::shared_ptr<Capture::DecodeExecutor> _decode_executor; // shared with the other previews of the process
+    std::unique_ptr<Capture::FrameFanout> _fanout; // the subscribers, fed by the worker
+    Capture::FrameStatistics _statistics;
 };
 } // namespace RealSenseID
@@ -0,0 +1,23 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "RealSenseID/RealTime.h"
+#include "RealTimeMode.h"
+
+namespace RealSenseID
+{
+bool SetRealTimeConfig(const RealTimeConfig& config)
+{
+    return RealTimeMode::Configure(config);
+}
+
+RealTimeConfig GetRealTimeConfig()
+{
+    return RealTimeMode::GetConfig();
+}
+
+bool EnterRealTimeThread()
+{
+    return RealTimeMode::EnterIoThread("application");
+}
+} // namespace RealSenseID
@@ -0,0 +1,184 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "RealTimeMode.h"
+#include "Logger.h"
+#include <algorithm>
+#include <mutex>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <avrt.h>
+#pragma comment(lib, "avrt.lib")
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <errno.h>
+#endif
+
+namespace RealSenseID
+{
+namespace RealTimeMode
+{
+static const char* LOG_TAG = "RealTimeMode";
+static constexpr size_t PageSize = 4096;
+// the deepest the library's I/O threads get (a few serial packets and the preview conversion locals)
+static constexpr size_t PrefaultStackBytes = 64 * 1024;
+#ifdef _WIN32
+// added to the working set so the prefaulted buffers can be locked
+static constexpr SIZE_T LockedWorkingSetBytes = 64 * 1024 * 1024;
+#endif
+
+static std::mutex s_mutex;
+static RealTimeConfig s_config;
+
+static bool LockMemory(bool lock)
+{
+#ifdef _WIN32
+    SIZE_T min_size = 0, max_size = 0;
+    auto process = ::GetCurrentProcess();
+    if (!::GetProcessWorkingSetSize(process, &min_size, &max_size))
+    {
+        return false;
+    }
+    if (lock)
+    {
+        return ::SetProcessWorkingSetSize(process, min_size + LockedWorkingSetBytes,
+                                          std::max(max_size, min_size + LockedWorkingSetBytes)) != 0;
+    }
+    return min_size < LockedWorkingSetBytes ||
+           ::SetProcessWorkingSetSize(process, min_size - LockedWorkingSetBytes, max_size) != 0;
+#elif defined(__linux__)
+    if (lock)
+    {
+        if (::mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+        {
+            LOG_ERROR(LOG_TAG, "mlockall failed. errno %d", errno);
+            return false;
+        }
+        return true;
+    }
+    return ::munlockall() == 0;
+#else
+    (void)lock;
+    return false;
+#endif
+}
+
+static bool SetThreadScheduling(int priority, int cpu)
+{
+    bool ok = true;
+#ifdef _WIN32
+    if (priority > 0)
+    {
+        DWORD task_index = 0;
+        // the registration ends with the thread
+        HANDLE task = ::AvSetMmThreadCharacteristicsW(L"Pro Audio", &task_index);
+        ok = task != nullptr && ::AvSetMmThreadPriority(task, AVRT_PRIORITY_HIGH);
+    }
+    if (cpu >= static_cast<int>(sizeof(DWORD_PTR) * 8))
+    {
+        ok = false;
+    }
+    else if (cpu >= 0 && ::SetThreadAffinityMask(::GetCurrentThread(), static_cast<DWORD_PTR>(1) << cpu) == 0)
+    {
+        ok = false;
+    }
+#elif defined(__linux__)
+    if (priority > 0)
+    {
+        sched_param param {};
+        param.sched_priority =
+            std::min(std::max(priority, ::sched_get_priority_min(SCHED_FIFO)), ::sched_get_priority_max(SCHED_FIFO));
+        ok = ::pthread_setschedparam(::pthread_self(), SCHED_FIFO, &param) == 0;
+    }
+    if (cpu >= CPU_SETSIZE)
+    {
+        ok = false;
+    }
+    else if (cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        ok = ::sched_setaffinity(0, sizeof(cpus), &cpus) == 0 && ok;
+    }
+#else
+    ok = priority <= 0 && cpu < 0;
+#endif
+    return ok;
+}
+
+// touch the stack the thread will use, so its pages are faulted in (and locked) now
+static void PrefaultStack()
+{
+    volatile unsigned char stack[PrefaultStackBytes];
+    for (size_t i = 0; i < sizeof(stack); i += PageSize)
+    {
+        stack[i] = 0;
+    }
+}
+
+bool Configure(const RealTimeConfig& config)
+{
+    std::lock_guard<std::mutex> lock {s_mutex};
+    bool ok = true;
+    bool lock_memory = s_config.lock_memory;
+    if (config.lock_memory != lock_memory)
+    {
+        ok = LockMemory(config.lock_memory);
+        lock_memory = ok ? config.lock_memory : lock_memory; // the applied state, GetConfig() reports it
+    }
+    s_config = config;
+    s_config.lock_memory = lock_memory;
+    return ok;
+}
+
+RealTimeConfig GetConfig()
+{
+    std::lock_guard<std::mutex> lock {s_mutex};
+    return s_config;
+}
+
+bool EnterIoThread(const char* name)
+{
+    const RealTimeConfig config = GetConfig();
+    if (config.lock_memory)
+    {
+        PrefaultStack();
+    }
+    if (config.io_thread_priority <= 0 && config.io_thread_cpu < 0)
+    {
+        return true;
+    }
+    if (!SetThreadScheduling(config.io_thread_priority, config.io_thread_cpu))
+    {
+        LOG_WARNING(LOG_TAG, "Failed to set the real-time scheduling of the %s thread", name);
+        return false;
+    }
+    LOG_DEBUG(LOG_TAG, "%s thread: priority %d, cpu %d", name, config.io_thread_priority, config.io_thread_cpu);
+    return true;
+}
+
+void Prefault(void* data, size_t size)
+{
+    if (data == nullptr || size == 0 || !GetConfig().lock_memory)
+    {
+        return;
+    }
+    auto* bytes = static_cast<volatile unsigned char*>(data);
+    for (size_t i = 0; i < size; i += PageSize)
+    {
+        bytes[i] = bytes[i];
+    }
+    bytes[size - 1] = bytes[size - 1];
+#ifdef _WIN32
+    if (!::VirtualLock(data, size))
+    {
+        LOG_WARNING(LOG_TAG, "Failed to lock a buffer of %zu bytes", size);
+    }
+#endif
+}
+} // namespace RealTimeMode
+} // namespace RealSenseID
@@ -0,0 +1,24 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include "RealSenseID/RealTime.h"
+#include <cstddef>
+
+namespace RealSenseID
+{
+// Library wide real-time mode behind the public SetRealTimeConfig() api.
+namespace RealTimeMode
+{
+bool Configure(const RealTimeConfig& config);
+RealTimeConfig GetConfig();
+
+// apply the I/O thread scheduling to the calling thread and prefault its stack. called first thing by the library's
+// I/O threads. return false if the scheduling could not be set.
+bool EnterIoThread(const char* name);
+
+// with lock_memory: touch the pages of a buffer allocated up front (and lock them on windows), so it never faults
+void Prefault(void* data, size_t size);
+} // namespace RealTimeMode
+} // namespace RealSenseID
@@ -0,0 +1,440 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "RealSenseID/RemoteGallery.h"
+#include "GalleryWire.h"
+#include "Matcher/Matcher.h"
+#include "Matcher/MatcherThreadPool.h"
+#include "PacketManager/SerialPacket.h"
+#include "Logger.h"
+#include "Tracer.h"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace RealSenseID
+{
+static const char* LOG_TAG = "RemoteGallery";
+
+constexpr size_t RemoteGallery::MaxTopK;
+
+using GalleryWire::MessageType;
+using GalleryWire::ReplyStatus;
+
+class RemoteGalleryImpl
+{
+public:
+    RemoteGalleryImpl(GalleryTransport* const* nodes, size_t number_of_nodes) :
+        _thresholds {Matcher::GetDefaultThresholds()}, _pool {std::max<size_t>(number_of_nodes, 1)}
+    {
+        if (nodes == nullptr || number_of_nodes == 0)
+        {
+            throw std::invalid_argument("RemoteGallery::RemoteGallery() - no nodes");
+        }
+        _nodes.assign(nodes, nodes + number_of_nodes);
+        if (std::find(_nodes.begin(), _nodes.end(), nullptr) != _nodes.end())
+        {
+            throw std::invalid_argument("RemoteGallery::RemoteGallery() - node must not be nullptr");
+        }
+        _request.resize(GalleryTransport::MaxMessageSize);
+        _replies.assign(number_of_nodes, std::vector<unsigned char>(GalleryTransport::MaxMessageSize));
+        _reply_sizes.assign(number_of_nodes, 0);
+        _node_ok.assign(number_of_nodes, 0);
+    }
+
+    Status Add(const char* user_id, const Faceprints& faceprints)
+    {
+        if (!ValidateUserId(user_id))
+        {
+            return Status::Error;
+        }
+
+        std::lock_guard<std::mutex> lock {_mutex};
+        GalleryWire::Writer writer {_request.data(), _request.size()};
+        writer.UserId(user_id);
+        writer.FullFaceprints(faceprints);
+        return CallOwner(user_id, writer.Finish(MessageType::Add)) == ReplyStatus::Ok ? Status::Ok : Status::Error;
+    }
+
+    Status Remove(const char* user_id)
+    {
+        if (!ValidateUserId(user_id))
+        {
+            return Status::Error;
+        }
+
+        std::lock_guard<std::mutex> lock {_mutex};
+        GalleryWire::Writer writer {_request.data(), _request.size()};
+        writer.UserId(user_id);
+        auto status = CallOwner(user_id, writer.Finish(MessageType::Remove));
+        if (status == ReplyStatus::NotFound)
+        {
+            LOG_DEBUG(LOG_TAG, "User \"%s\" not in gallery", user_id);
+        }
+        return status == ReplyStatus::Ok ? Status::Ok : Status::Error;
+    }
+
+    Status Clear()
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        GalleryWire::Writer writer {_request.data(), _request.size()};
+        return Scatter(writer.Finish(MessageType::Clear), MessageType::Clear) ? Status::Ok : Status::Error;
+    }
+
+    Status QuerySize(size_t& number_of_users)
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        number_of_users = 0;
+        GalleryWire::Writer writer {_request.data(), _request.size()};
+        bool success = Scatter(writer.Finish(MessageType::Size), MessageType::Size);
+        for (size_t node = 0; node < _nodes.size(); node++)
+        {
+            if (_node_ok[node])
+            {
+                auto reader = Reply(node);
+                number_of_users += reader.U32();
+            }
+        }
+        return success ? Status::Ok : Status::Error;
+    }
+
+    void Prefetch()
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        GalleryWire::Writer writer {_request.data(), _request.size()};
+        if (!Scatter(writer.Finish(MessageType::Prefetch), MessageType::Prefetch))
+        {
+            LOG_WARNING(LOG_TAG, "Prefetch failed on some of the nodes"); // the match still works, cold
+        }
+    }
+
+    Status MatchBatch(const Faceprints* new_faceprints, size_t number_of_probes, HostGalleryMatch* results,
+                      Faceprints* updated_faceprints)
+    {
+        RSID_TRACE_SPAN("gallery", "RemoteMatchBatch");
+        if (new_faceprints == nullptr || results == nullptr || updated_faceprints == nullptr)
+        {
+            LOG_ERROR(LOG_TAG, "Invalid batch match arguments");
+            return Status::Error;
+        }
+
+        std::lock_guard<std::mutex> lock {_mutex};
+        bool success = true;
+        // one request for up to MaxProbes probes of the same faceprints version
+        size_t first = 0;
+        while (first < number_of_probes)
+        {
+            size_t count = 1;
+            while (first + count < number_of_probes && count < GalleryWire::MaxProbes &&
+                   new_faceprints[first + count].version == new_faceprints[first].version)
+            {
+                count++;
+            }
+            success &= MatchGroup(new_faceprints + first, count, results + first, updated_faceprints + first);
+            first += count;
+        }
+        return success ? Status::Ok : Status::Error;
+    }
+
+    Status MatchTopK(const Faceprints& new_faceprints, size_t k, HostGalleryMatch* results, size_t& number_of_results)
+    {
+        RSID_TRACE_SPAN("gallery", "RemoteMatchTopK");
+        number_of_results = 0;
+        if (k == 0 || k > RemoteGallery::MaxTopK || results == nullptr)
+        {
+            LOG_ERROR(LOG_TAG, "Invalid top-k match arguments");
+            return Status::Error;
+        }
+
+        std::lock_guard<std::mutex> lock {_mutex};
+        std::vector<Candidate> candidates;
+        bool success = ScatterMatch(&new_faceprints, 1, k);
+        for (size_t node = 0; node < _nodes.size(); node++)
+        {
+            if (!_node_ok[node])
+            {
+                continue;
+            }
+            auto reader = Reply(node);
+            size_t n_candidates = reader.U8();
+            for (size_t i = 0; i < n_candidates; i++)
+            {
+                candidates.push_back(ReadCandidate(reader, node));
+            }
+        }
+
+        // nodes are merged in order, so equal scores keep the node order
+        std::stable_sort(candidates.begin(), candidates.end(),
+                         [](const Candidate& lhs, const Candidate& rhs) { return lhs.score > rhs.score; });
+        number_of_results = std::min(k, candidates.size());
+        for (size_t i = 0; i < number_of_results; i++)
+        {
+            results[i] = ToGalleryMatch(candidates[i], true);
+        }
+        return success ? Status::Ok : Status::Error;
+    }
+
+private:
+    struct Candidate
+    {
+        match_calc_t score = 0;
+        match_calc_t confidence = 0;
+        char user_id[31] = {0};
+        size_t node = 0;
+        bool valid = false;
+    };
+
+    static bool ValidateUserId(const char* user_id)
+    {
+        if (user_id == nullptr)
+        {
+            LOG_ERROR(LOG_TAG, "Invalid user id: nullptr");
+            return false;
+        }
+
+        auto user_id_len = ::strlen(user_id);
+        bool is_valid = user_id_len > 0 && user_id_len <= PacketManager::MaxUserIdSize;
+        if (!is_valid)
+        {
+            LOG_ERROR(LOG_TAG, "Invalid user id length. Valid size: 1 - %zu", PacketManager::MaxUserIdSize);
+        }
+        return is_valid;
+    }
+
+    GalleryWire::Reader Reply(size_t node) const
+    {
+        return GalleryWire::Reader {_replies[node].data(), _reply_sizes[node]};
+    }
+
+    // send the request to the node. the reply is valid if it has the request's type (the status is returned).
+    bool Call(size_t node, size_t request_size, MessageType type, ReplyStatus& status)
+    {
+        _reply_sizes[node] = 0;
+        auto call_status =
+            _nodes[node]->Call(_request.data(), request_size, _replies[node].data(), _reply_sizes[node]);
+        if (call_status != Status::Ok || _reply_sizes[node] > GalleryTransport::MaxMessageSize)
+        {
+            LOG_ERROR(LOG_TAG, "Node %zu: request failed (status %d)", node, static_cast<int>(call_status));
+            return false;
+        }
+        auto reader = Reply(node);
+        if (!reader.Ok() || reader.Type() != type)
+        {
+            LOG_ERROR(LOG_TAG, "Node %zu: malformed reply", node);
+            return false;
+        }
+        status = reader.Status();
+        return true;
+    }
+
+    // send the request to the node owning the user. returns the reply status (Error if the call failed).
+    ReplyStatus CallOwner(const char* user_id, size_t request_size)
+    {
+        if (request_size == 0)
+        {
+            LOG_ERROR(LOG_TAG, "Invalid request");
+            return ReplyStatus::Error;
+        }
+        GalleryWire::Reader request {_request.data(), request_size};
+        size_t node = GalleryWire::UserIdHash(user_id) % _nodes.size();
+        ReplyStatus status = ReplyStatus::Error;
+        return Call(node, request_size, request.Type(), status) ? status : ReplyStatus::Error;
+    }
+
+    // send the request to all the nodes in parallel. _node_ok is set for the nodes which replied Ok.
+    // returns true if all of them did.
+    bool Scatter(size_t request_size, MessageType type)
+    {
+        std::fill(_node_ok.begin(), _node_ok.end(), 0);
+        if (request_size == 0)
+        {
+            LOG_ERROR(LOG_TAG, "Invalid request");
+            return false;
+        }
+        _pool.Run(_nodes.size(), [&](size_t node) {
+            ReplyStatus status = ReplyStatus::Error;
+            _node_ok[node] = Call(node, request_size, type, status) && status == ReplyStatus::Ok;
+        });
+        return std::all_of(_node_ok.begin(), _node_ok.end(), [](char ok) { return ok != 0; });
+    }
+
+    bool ScatterMatch(const Faceprints* probes, size_t number_of_probes, size_t k)
+    {
+        GalleryWire::Writer writer {_request.data(), _request.size()};
+        writer.I32(probes[0].version);
+        writer.U8(static_cast<uint8_t>(k));
+        writer.U8(static_cast<uint8_t>(number_of_probes));
+        for (size_t i = 0; i < number_of_probes; i++)
+        {
+            writer.Probe(probes[i]);
+        }
+        return Scatter(writer.Finish(MessageType::Match), MessageType::Match);
+    }
+
+    Candidate ReadCandidate(GalleryWire::Reader& reader, size_t node) const
+    {
+        Candidate candidate;
+        candidate.score = reader.I16();
+        candidate.confidence = reader.I16();
+        reader.UserId(candidate.user_id, sizeof(candidate.user_id));
+        candidate.node = node;
+        candidate.valid = reader.Ok();
+        return candidate;
+    }
+
+    // the user id is set for a match, or for any candidate with with_user_id (top-k)
+    HostGalleryMatch ToGalleryMatch(const Candidate& candidate, bool with_user_id = false) const
+    {
+        HostGalleryMatch match;
+        match.result.score = candidate.score;
+        match.result.confidence = candidate.confidence;
+        match.result.success = candidate.valid && candidate.score > _thresholds.strongThreshold_pNMgNM;
+        if (match.result.success || (candidate.valid && with_user_id))
+        {
+            ::strncpy(match.user_id, candidate.user_id, sizeof(match.user_id) - 1);
+        }
+        return match;
+    }
+
+    // match up to MaxProbes probes of the same version: the best candidate of each node, merged in node order
+    bool MatchGroup(const Faceprints* probes, size_t number_of_probes, HostGalleryMatch* results,
+                    Faceprints* updated_faceprints)
+    {
+        Candidate best[GalleryWire::MaxProbes];
+        bool success = ScatterMatch(probes, number_of_probes, 1);
+        for (size_t node = 0; node < _nodes.size(); node++)
+        {
+            if (!_node_ok[node])
+            {
+                continue;
+            }
+            auto reader = Reply(node);
+            for (size_t p = 0; p < number_of_probes; p++)
+            {
+                size_t n_candidates = reader.U8();
+                for (size_t i = 0; i < n_candidates; i++)
+                {
+                    auto candidate = ReadCandidate(reader, node);
+                    if (candidate.valid && (!best[p].valid || candidate.score > best[p].score))
+                    {
+                        best[p] = candidate;
+                    }
+                }
+            }
+            if (!reader.AtEnd())
+            {
+                LOG_ERROR(LOG_TAG, "Node %zu: malformed match reply", node);
+                success = false;
+            }
+        }
+
+        for (size_t p = 0; p < number_of_probes; p++)
+        {
+            results[p] = ToGalleryMatch(best[p]);
+            if (results[p].result.success && best[p].score >= _thresholds.updateThreshold_NM)
+            {
+                results[p].result.should_update = Update(best[p], probes[p], updated_faceprints[p]);
+            }
+        }
+        return success;
+    }
+
+    // adaptive update of the matched user, applied by the node which has it
+    bool Update(const Candidate& candidate, const Faceprints& probe, Faceprints& updated_faceprints)
+    {
+        GalleryWire::Writer writer {_request.data(), _request.size()};
+        writer.UserId(candidate.user_id);
+        writer.I32(probe.version);
+        writer.Probe(probe);
+        size_t request_size = writer.Finish(MessageType::Update);
+        ReplyStatus status = ReplyStatus::Error;
+        if (request_size == 0 || !Call(candidate.node, request_size, MessageType::Update, status) ||
+            status != ReplyStatus::Ok)
+        {
+            LOG_ERROR(LOG_TAG, "Node %zu: failed updating user \"%s\"", candidate.node, candidate.user_id);
+            return false;
+        }
+        auto reader = Reply(candidate.node);
+        Faceprints faceprints;
+        reader.FullFaceprints(faceprints);
+        if (!reader.AtEnd())
+        {
+            LOG_ERROR(LOG_TAG, "Node %zu: malformed update reply", candidate.node);
+            return false;
+        }
+        updated_faceprints = faceprints;
+        return true;
+    }
+
+    mutable std::mutex _mutex; // one operation at a time: the buffers are shared and a node is called by one thread
+    std::vector<GalleryTransport*> _nodes;
+    Thresholds _thresholds;
+    MatcherThreadPool _pool;
+    std::vector<unsigned char> _request;
+    std::vector<std::vector<unsigned char>> _replies;
+    std::vector<size_t> _reply_sizes;
+    std::vector<char> _node_ok;
+};
+
+RemoteGallery::RemoteGallery(GalleryTransport* const* nodes, size_t number_of_nodes) :
+    _impl {new RemoteGalleryImpl(nodes, number_of_nodes)}
+{
+}
+
+RemoteGallery::~RemoteGallery()
+{
+    try
+    {
+        delete _impl;
+    }
+    catch (...)
+    {
+    }
+}
+
+Status RemoteGallery::Add(const char* user_id, const Faceprints& faceprints)
+{
+    return _impl->Add(user_id, faceprints);
+}
+
+Status RemoteGallery::Remove(const char* user_id)
+{
+    return _impl->Remove(user_id);
+}
+
+Status RemoteGallery::Clear()
+{
+    return _impl->Clear();
+}
+
+Status RemoteGallery::QuerySize(size_t& number_of_users)
+{
+    return _impl->QuerySize(number_of_users);
+}
+
+void RemoteGallery::Prefetch() const
+{
+    _impl->Prefetch();
+}
+
+HostGalleryMatch RemoteGallery::Match(const Faceprints& new_faceprints, Faceprints& updated_faceprints)
+{
+    HostGalleryMatch result;
+    _impl->MatchBatch(&new_faceprints, 1, &result, &updated_faceprints);
+    return result;
+}
+
+Status RemoteGallery::MatchBatch(const Faceprints* new_faceprints, size_t number_of_probes, HostGalleryMatch* results,
+                                 Faceprints* updated_faceprints)
+{
+    return _impl->MatchBatch(new_faceprints, number_of_probes, results, updated_faceprints);
+}
+
+Status RemoteGallery::MatchTopK(const Faceprints& new_faceprints, size_t k, HostGalleryMatch* results,
+                                size_t& number_of_results)
+{
+    return _impl->MatchTopK(new_faceprints, k, results, number_of_results);
+}
+} // namespace RealSenseID
@@ -0,0 +1,70 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#include "UsersChangeJournal.h"
+
+namespace RealSenseID
+{
+unsigned int UsersChangeJournal::Revision() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _revision;
+}
+
+void UsersChangeJournal::Reset()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _users.clear();
+    _base_revision = ++_revision;
+}
+
+void UsersChangeJournal::OnUserChanged(const char* user_id)
+{
+    if (user_id == nullptr)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    _users[user_id] = Entry {++_revision, false};
+}
+
+void UsersChangeJournal::OnUserRemoved(const char* user_id)
+{
+    if (user_id == nullptr)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    _users[user_id] = Entry {++_revision, true};
+}
+
+void UsersChangeJournal::OnAllUsersRemoved()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _users.clear();
+    _all_removed_revision = ++_revision;
+}
+
+bool UsersChangeJournal::ChangesSince(unsigned int revision, std::vector<std::string>& changed,
+                                      std::vector<std::string>& removed, bool& all_removed,
+                                      unsigned int& current_revision) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    changed.clear();
+    removed.clear();
+    current_revision = _revision;
+    if (revision < _base_revision || revision > _revision)
+    {
+        return false;
+    }
+    all_removed = _all_removed_revision > revision;
+    for (const auto& user : _users)
+    {
+        if (user.second.revision > revision)
+        {
+            (user.second.removed ? removed : changed).push_back(user.first);
+        }
+    }
+    return true;
+}
+} // namespace RealSenseID
@@ -0,0 +1,47 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace RealSenseID
+{
+// Per-user revisions of the device's DB, as seen by the host.
+// Every change made through the FaceAuthenticator (enroll, authenticate - which may update the adaptive
+// descriptors, remove, import) increments the revision and stamps the user with it.
+// The journal can only answer for revisions since its base revision: changes made before it (or by other hosts)
+// are unknown. Reset() (e.g. on connect) moves the base to the current revision.
+// Thread safe.
+class UsersChangeJournal
+{
+public:
+    unsigned int Revision() const;
+    void Reset();
+
+    void OnUserChanged(const char* user_id);
+    void OnUserRemoved(const char* user_id);
+    void OnAllUsersRemoved();
+
+    // users changed / removed after the given revision, and whether all users were removed after it.
+    // return false if the journal cannot tell (revision too old or unknown).
+    bool ChangesSince(unsigned int revision, std::vector<std::string>& changed, std::vector<std::string>& removed,
+                      bool& all_removed, unsigned int& current_revision) const;
+
+private:
+    struct Entry
+    {
+        unsigned int revision;
+        bool removed;
+    };
+
+    mutable std::mutex _mutex;
+    unsigned int _revision = 0;
+    unsigned int _base_revision = 0;
+    unsigned int _all_removed_revision = 0;
+    std::map<std::string, Entry> _users;
+};
+} // namespace RealSenseID
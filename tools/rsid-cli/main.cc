@@ -2,7 +2,9 @@
 // Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
 
 // Command line interface to RealSenseID device.
-// Usage: rsid-cli <port> <usb/uart>.
+// Usage: rsid-cli <port>
+//        rsid-cli <port> bench [options] (see run_bench())
+//        rsid-cli <port> batch [options] (see run_batch())
 
 #include "RealSenseID/FaceAuthenticator.h"
 #include "RealSenseID/Preview.h"
@@ -11,13 +13,22 @@
 #include "RealSenseID/Version.h"
 #include "RealSenseID/Logging.h"
 #include "RealSenseID/Faceprints.h"
+#include "RealSenseID/HostGallery.h"
+#include "RealSenseID/Metrics.h"
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <vector>
 #include <string>
 #include <iostream>
 #include <stdio.h>
 #include <stdlib.h>
 #include <cstring>
 #include <cstdio>
+#include <fstream>
+#include <sstream>
 #include <memory>
 #include <map>
 #include <set>
@@ -527,8 +538,694 @@ void authenticate_faceprints(const RealSenseID::SerialConfig& serial_config)
 void print_usage()
 {
     std::cout << "Usage: rsid-cli <port>" << std::endl;
+    std::cout << "       rsid-cli <port> bench [--iterations N] [--format csv|json] [--gallery-size N]"
+                 " [--hot-users N] [--persistent-session] [--device-match]"
+              << std::endl;
+    std::cout << "       rsid-cli <port> batch [--file <path>] [--stop-on-error]" << std::endl;
 }
 
+//
+// bench: latency harness for comparing devices and firmware versions.
+// Runs the ping, query number of users, authenticate (faceprints extraction) and host match phases for a number of
+// iterations and prints their p50/p95/p99 latencies as csv or json. The device time of the query and the
+// authentication is further broken down with the library metrics into session start, device processing (waiting for
+// the device's replies) and transfer (sending and receiving packets).
+// The host gallery holds the device's users (exported from the device), padded with random faceprints to the
+// requested size, optionally with a hot tier of frequently matched users (--hot-users). A user should stand in front
+// of the device while it runs.
+//
+
+struct BenchOptions
+{
+    int iterations = 20;
+    bool json = false;
+    unsigned int gallery_size = 0; // pad the gallery with random users up to this size
+    unsigned int hot_users = 0;    // hot tier of the gallery (0 - none)
+    bool persistent_session = false;
+    bool device_match = false; // Authenticate() on the device instead of extraction + host match
+};
+
+// latency samples of a phase
+struct BenchPhase
+{
+    const char* name;
+    std::vector<double> samples_ms;
+};
+
+static double percentile_ms(std::vector<double> samples_ms, double percentile)
+{
+    if (samples_ms.empty())
+    {
+        return 0;
+    }
+    std::sort(samples_ms.begin(), samples_ms.end());
+    // nearest rank
+    auto rank = static_cast<size_t>(std::ceil(percentile / 100.0 * samples_ms.size()));
+    return samples_ms[std::max<size_t>(rank, 1) - 1];
+}
+
+static double mean_ms(const std::vector<double>& samples_ms)
+{
+    if (samples_ms.empty())
+    {
+        return 0;
+    }
+    return std::accumulate(samples_ms.begin(), samples_ms.end(), 0.0) / samples_ms.size();
+}
+
+static double elapsed_ms(std::chrono::steady_clock::time_point since)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+class BenchExportClbk : public RealSenseID::FaceprintsExportCallback
+{
+public:
+    std::vector<RealSenseID::Faceprints> faceprints;
+
+    void OnFaceprints(const unsigned int user_index, const RealSenseID::Faceprints& user_faceprints) override
+    {
+        if (user_index >= faceprints.size())
+        {
+            faceprints.resize(user_index + 1);
+        }
+        faceprints[user_index] = user_faceprints;
+    }
+};
+
+class BenchExtractClbk : public RealSenseID::AuthFaceprintsExtractionCallback
+{
+public:
+    RealSenseID::AuthenticateStatus status = RealSenseID::AuthenticateStatus::Failure;
+    RealSenseID::Faceprints faceprints;
+
+    void OnResult(const RealSenseID::AuthenticateStatus result_status,
+                  const RealSenseID::Faceprints* result_faceprints) override
+    {
+        status = result_status;
+        if (result_faceprints != nullptr)
+        {
+            faceprints = *result_faceprints;
+        }
+    }
+
+    void OnHint(const RealSenseID::AuthenticateStatus hint) override
+    {
+        (void)hint;
+    }
+};
+
+class BenchAuthClbk : public RealSenseID::AuthenticationCallback
+{
+public:
+    RealSenseID::AuthenticateStatus status = RealSenseID::AuthenticateStatus::Failure;
+
+    void OnResult(const RealSenseID::AuthenticateStatus result_status, const char* user_id) override
+    {
+        (void)user_id;
+        status = result_status;
+    }
+
+    void OnHint(const RealSenseID::AuthenticateStatus hint) override
+    {
+        (void)hint;
+    }
+};
+
+// the device's users, then random users up to gallery_size
+static void load_bench_gallery(RealSenseID::FaceAuthenticator& authenticator, RealSenseID::HostGallery& gallery,
+                               unsigned int gallery_size)
+{
+    unsigned int number_of_users = 0;
+    auto status = authenticator.QueryNumberOfUsers(number_of_users);
+    if (status == RealSenseID::Status::Ok && number_of_users > 0)
+    {
+        std::vector<std::vector<char>> buffers(number_of_users,
+                                               std::vector<char>(RealSenseID::FaceAuthenticator::MAX_USERID_LENGTH));
+        std::vector<char*> user_ids(number_of_users);
+        for (unsigned int i = 0; i < number_of_users; i++)
+        {
+            user_ids[i] = buffers[i].data();
+        }
+        unsigned int number_of_ids = number_of_users;
+        BenchExportClbk export_clbk;
+        unsigned int number_exported = 0;
+        status = authenticator.QueryUserIds(user_ids.data(), number_of_ids);
+        if (status == RealSenseID::Status::Ok)
+        {
+            status = authenticator.GetUsersFaceprints(export_clbk, number_exported);
+        }
+        for (unsigned int i = 0; status == RealSenseID::Status::Ok && i < number_of_ids && i < number_exported; i++)
+        {
+            gallery.Add(user_ids[i], export_clbk.faceprints[i]);
+        }
+    }
+    if (status != RealSenseID::Status::Ok)
+    {
+        std::cerr << "Failed loading the device's users. Status: " << status << std::endl;
+    }
+
+    std::mt19937 random {1};
+    std::uniform_int_distribution<int> feature {-128, 127};
+    for (unsigned int i = 0; gallery.Size() < gallery_size; i++)
+    {
+        RealSenseID::Faceprints faceprints;
+        for (size_t f = 0; f < RealSenseID::NUM_OF_RECOGNITION_FEATURES; f++)
+        {
+            faceprints.enrollmentDescriptor[f] = static_cast<RealSenseID::feature_t>(feature(random));
+            faceprints.adaptiveDescriptorWithoutMask[f] = faceprints.enrollmentDescriptor[f];
+        }
+        auto user_id = "bench_" + std::to_string(i);
+        gallery.Add(user_id.c_str(), faceprints);
+    }
+}
+
+static void print_bench_report(const BenchOptions& options, const std::vector<BenchPhase>& phases, int failures,
+                               size_t gallery_size, const std::string& firmware_version,
+                               const std::string& serial_number)
+{
+    if (!options.json)
+    {
+        printf("phase,samples,p50_ms,p95_ms,p99_ms,mean_ms\n");
+        for (const auto& phase : phases)
+        {
+            printf("%s,%zu,%.3f,%.3f,%.3f,%.3f\n", phase.name, phase.samples_ms.size(),
+                   percentile_ms(phase.samples_ms, 50), percentile_ms(phase.samples_ms, 95),
+                   percentile_ms(phase.samples_ms, 99), mean_ms(phase.samples_ms));
+        }
+        return;
+    }
+
+    printf("{\n");
+    printf("  \"host_version\": \"%s\",\n", RealSenseID::Version());
+    printf("  \"firmware_version\": \"%s\",\n", firmware_version.c_str());
+    printf("  \"serial_number\": \"%s\",\n", serial_number.c_str());
+    printf("  \"iterations\": %d,\n", options.iterations);
+    printf("  \"failures\": %d,\n", failures);
+    printf("  \"gallery_size\": %zu,\n", gallery_size);
+    printf("  \"hot_users\": %u,\n", options.hot_users);
+    printf("  \"persistent_session\": %s,\n", options.persistent_session ? "true" : "false");
+    printf("  \"device_match\": %s,\n", options.device_match ? "true" : "false");
+    printf("  \"phases\": {\n");
+    for (size_t i = 0; i < phases.size(); i++)
+    {
+        const auto& samples_ms = phases[i].samples_ms;
+        printf("    \"%s\": {\"samples\": %zu, \"p50_ms\": %.3f, \"p95_ms\": %.3f, \"p99_ms\": %.3f, "
+               "\"mean_ms\": %.3f}%s\n",
+               phases[i].name, samples_ms.size(), percentile_ms(samples_ms, 50), percentile_ms(samples_ms, 95),
+               percentile_ms(samples_ms, 99), mean_ms(samples_ms), i + 1 < phases.size() ? "," : "");
+    }
+    printf("  }\n");
+    printf("}\n");
+}
+
+void run_bench(const RealSenseID::SerialConfig& serial_config, const BenchOptions& options)
+{
+    enum Phase
+    {
+        Ping,
+        QueryNumberOfUsers,
+        Authenticate,
+        Match,
+        Total,
+        SessionStart,
+        DeviceProcessing,
+        Transfer
+    };
+    // in the order of the enum
+    std::vector<BenchPhase> phases = {{"ping", {}},
+                                      {"query_number_of_users", {}},
+                                      {"authenticate", {}},
+                                      {"match", {}},
+                                      {"total", {}},
+                                      {"session_start", {}},
+                                      {"device_processing", {}},
+                                      {"transfer", {}}};
+
+    // ping and device info with the device controller (the authenticator is not connected meanwhile)
+    std::string firmware_version;
+    std::string serial_number;
+    {
+        RealSenseID::DeviceController device_controller;
+        auto connect_status = device_controller.Connect(serial_config);
+        if (connect_status != RealSenseID::Status::Ok)
+        {
+            std::cerr << "Failed connecting to port " << serial_config.port << " status:" << connect_status
+                      << std::endl;
+            std::exit(1);
+        }
+        device_controller.QueryFirmwareVersion(firmware_version);
+        device_controller.QuerySerialNumber(serial_number);
+        for (int i = 0; i < options.iterations; i++)
+        {
+            auto start_time = std::chrono::steady_clock::now();
+            if (device_controller.Ping() == RealSenseID::Status::Ok)
+            {
+                phases[Ping].samples_ms.push_back(elapsed_ms(start_time));
+            }
+        }
+    }
+
+#ifdef RSID_SECURE
+    RealSenseID::FaceAuthenticator authenticator {&s_signer};
+#else
+    RealSenseID::FaceAuthenticator authenticator;
+#endif // RSID_SECURE
+    auto connect_status = authenticator.Connect(serial_config);
+    if (connect_status != RealSenseID::Status::Ok)
+    {
+        std::cerr << "Failed connecting to port " << serial_config.port << " status:" << connect_status << std::endl;
+        std::exit(1);
+    }
+    authenticator.SetPersistentSession(options.persistent_session);
+
+    RealSenseID::HostGallery gallery {1, options.hot_users};
+    if (!options.device_match)
+    {
+        load_bench_gallery(authenticator, gallery, options.gallery_size);
+    }
+
+    int failures = 0;
+    for (int i = 0; i < options.iterations; i++)
+    {
+        RealSenseID::Metrics metrics_before;
+        RealSenseID::GetMetrics(metrics_before);
+        auto iteration_start = std::chrono::steady_clock::now();
+
+        auto start_time = iteration_start;
+        unsigned int number_of_users = 0;
+        auto status = authenticator.QueryNumberOfUsers(number_of_users);
+        auto query_ms = elapsed_ms(start_time);
+
+        bool success = status == RealSenseID::Status::Ok;
+        auto authenticate_status = RealSenseID::AuthenticateStatus::Failure;
+        double authenticate_ms = 0;
+        if (success)
+        {
+            start_time = std::chrono::steady_clock::now();
+            BenchExtractClbk extract_clbk;
+            if (options.device_match)
+            {
+                BenchAuthClbk auth_clbk;
+                status = authenticator.Authenticate(auth_clbk);
+                authenticate_status = auth_clbk.status;
+            }
+            else
+            {
+                status = authenticator.ExtractFaceprintsForAuth(extract_clbk);
+                authenticate_status = extract_clbk.status;
+            }
+            authenticate_ms = elapsed_ms(start_time);
+
+            if (!options.device_match && status == RealSenseID::Status::Ok &&
+                authenticate_status == RealSenseID::AuthenticateStatus::Success)
+            {
+                start_time = std::chrono::steady_clock::now();
+                RealSenseID::Faceprints updated_faceprints;
+                gallery.Match(extract_clbk.faceprints, updated_faceprints);
+                phases[Match].samples_ms.push_back(elapsed_ms(start_time));
+            }
+            // a forbidden user (e.g. not in the device's db) is a complete authentication
+            success = status == RealSenseID::Status::Ok &&
+                      (authenticate_status == RealSenseID::AuthenticateStatus::Success ||
+                       authenticate_status == RealSenseID::AuthenticateStatus::Forbidden);
+        }
+        auto total_ms = elapsed_ms(iteration_start);
+
+        RealSenseID::Metrics metrics_after;
+        RealSenseID::GetMetrics(metrics_after);
+
+        std::cerr << "Iteration " << (i + 1) << "/" << options.iterations << ": " << status << " "
+                  << authenticate_status << std::endl;
+        if (!success)
+        {
+            failures++;
+            continue;
+        }
+        phases[QueryNumberOfUsers].samples_ms.push_back(query_ms);
+        phases[Authenticate].samples_ms.push_back(authenticate_ms);
+        phases[Total].samples_ms.push_back(total_ms);
+        phases[SessionStart].samples_ms.push_back(
+            (metrics_after.session_start_time_us - metrics_before.session_start_time_us) / 1000.0);
+        phases[DeviceProcessing].samples_ms.push_back(
+            (metrics_after.serial_wait_time_us - metrics_before.serial_wait_time_us) / 1000.0);
+        phases[Transfer].samples_ms.push_back(
+            (metrics_after.serial_transfer_time_us - metrics_before.serial_transfer_time_us) / 1000.0);
+    }
+
+    print_bench_report(options, phases, failures, gallery.Size(), firmware_version, serial_number);
+}
+
+// parse the arguments following "bench"
+static BenchOptions bench_options_from_argv(int argc, char* argv[], int first)
+{
+    BenchOptions options;
+    for (int i = first; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--iterations" && has_value)
+        {
+            options.iterations = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--format" && has_value)
+        {
+            options.json = std::string(argv[++i]) == "json";
+        }
+        else if (arg == "--gallery-size" && has_value)
+        {
+            options.gallery_size = static_cast<unsigned int>(std::max(0, std::atoi(argv[++i])));
+        }
+        else if (arg == "--hot-users" && has_value)
+        {
+            options.hot_users = static_cast<unsigned int>(std::max(0, std::atoi(argv[++i])));
+        }
+        else if (arg == "--persistent-session")
+        {
+            options.persistent_session = true;
+        }
+        else if (arg == "--device-match")
+        {
+            options.device_match = true;
+        }
+        else
+        {
+            print_usage();
+            std::exit(1);
+        }
+    }
+    return options;
+}
+
+//
+// batch: scripted commands over a single connection, e.g. for provisioning.
+// Reads one command per line from stdin (or --file) and runs them all with one connected authenticator in persistent
+// session mode, so the connection and the session (in secure mode the key exchange) are set up once rather than per
+// command. Each command prints a json line with its status and results, and a summary line ends the run:
+//   {"line": 3, "command": "count", "status": "Ok", "number_of_users": 12, "elapsed_ms": 41.210}
+//   {"summary": {"commands": 5, "failures": 0, "connect_ms": 260.455, "total_ms": 9120.004}}
+// Commands (blank lines and lines starting with '#' are skipped):
+//   enroll <user_id>      authenticate          remove-user <user_id>   remove-all
+//   count                 users                 get-config              standby
+//   begin-bulk            commit-bulk           pair / unpair (secure builds)
+// The exit code is 1 if a command failed or was not understood, 0 otherwise. --stop-on-error stops at the first
+// failure.
+//
+
+struct BatchOptions
+{
+    std::string file; // stdin if empty
+    bool stop_on_error = false;
+};
+
+class BatchEnrollClbk : public RealSenseID::EnrollmentCallback
+{
+public:
+    RealSenseID::EnrollStatus status = RealSenseID::EnrollStatus::Failure;
+
+    void OnResult(const RealSenseID::EnrollStatus result_status) override
+    {
+        status = result_status;
+    }
+
+    void OnProgress(const RealSenseID::FacePose pose) override
+    {
+        (void)pose;
+    }
+
+    void OnHint(const RealSenseID::EnrollStatus hint) override
+    {
+        (void)hint;
+    }
+};
+
+class BatchAuthClbk : public RealSenseID::AuthenticationCallback
+{
+public:
+    RealSenseID::AuthenticateStatus status = RealSenseID::AuthenticateStatus::Failure;
+    std::string user_id;
+
+    void OnResult(const RealSenseID::AuthenticateStatus result_status, const char* result_user_id) override
+    {
+        status = result_status;
+        user_id = result_user_id != nullptr ? result_user_id : "";
+    }
+
+    void OnHint(const RealSenseID::AuthenticateStatus hint) override
+    {
+        (void)hint;
+    }
+};
+
+// quoted json string
+static std::string json_string(const std::string& value)
+{
+    std::string quoted = "\"";
+    for (unsigned char c : value)
+    {
+        if (c == '"' || c == '\\')
+        {
+            quoted += '\\';
+            quoted += static_cast<char>(c);
+        }
+        else if (c < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            quoted += escaped;
+        }
+        else
+        {
+            quoted += static_cast<char>(c);
+        }
+    }
+    return quoted + "\"";
+}
+
+// run a command line. fields gets the command's results as json members (", \"name\": value" each).
+// returns false if the command failed or is unknown
+static bool run_batch_command(RealSenseID::FaceAuthenticator& authenticator, const std::vector<std::string>& args,
+                              std::string& status_out, std::string& fields)
+{
+    using RealSenseID::Status;
+    const auto& command = args[0];
+    Status status = Status::Error;
+    bool success = false;
+    if (command == "enroll" && args.size() == 2)
+    {
+        BatchEnrollClbk clbk;
+        status = authenticator.Enroll(clbk, args[1].c_str());
+        fields += ", \"result\": " + json_string(RealSenseID::Description(clbk.status));
+        success = status == Status::Ok && clbk.status == RealSenseID::EnrollStatus::Success;
+    }
+    else if (command == "authenticate" && args.size() == 1)
+    {
+        BatchAuthClbk clbk;
+        status = authenticator.Authenticate(clbk);
+        fields += ", \"result\": " + json_string(RealSenseID::Description(clbk.status));
+        if (clbk.status == RealSenseID::AuthenticateStatus::Success)
+        {
+            fields += ", \"user_id\": " + json_string(clbk.user_id);
+        }
+        // a forbidden user is a completed authentication
+        success = status == Status::Ok && (clbk.status == RealSenseID::AuthenticateStatus::Success ||
+                                           clbk.status == RealSenseID::AuthenticateStatus::Forbidden);
+    }
+    else if (command == "remove-user" && args.size() == 2)
+    {
+        status = authenticator.RemoveUser(args[1].c_str());
+        success = status == Status::Ok;
+    }
+    else if (command == "remove-all" && args.size() == 1)
+    {
+        status = authenticator.RemoveAll();
+        success = status == Status::Ok;
+    }
+    else if (command == "count" && args.size() == 1)
+    {
+        unsigned int number_of_users = 0;
+        status = authenticator.QueryNumberOfUsers(number_of_users);
+        success = status == Status::Ok;
+        if (success)
+        {
+            fields += ", \"number_of_users\": " + std::to_string(number_of_users);
+        }
+    }
+    else if (command == "users" && args.size() == 1)
+    {
+        unsigned int number_of_users = 0;
+        status = authenticator.QueryNumberOfUsers(number_of_users);
+        const size_t id_size = RealSenseID::FaceAuthenticator::MAX_USERID_LENGTH;
+        std::vector<char> user_ids(number_of_users * id_size);
+        if (status == Status::Ok && number_of_users > 0)
+        {
+            status = authenticator.QueryUserIdsToBuffer(user_ids.data(), number_of_users);
+        }
+        success = status == Status::Ok;
+        if (success)
+        {
+            fields += ", \"user_ids\": [";
+            for (unsigned int i = 0; i < number_of_users; i++)
+            {
+                // the ids are null terminated within their MAX_USERID_LENGTH bytes
+                fields += (i > 0 ? ", " : "") + json_string(&user_ids[i * id_size]);
+            }
+            fields += "]";
+        }
+    }
+    else if (command == "get-config" && args.size() == 1)
+    {
+        RealSenseID::DeviceConfig device_config;
+        status = authenticator.QueryDeviceConfig(device_config);
+        success = status == Status::Ok;
+        if (success)
+        {
+            fields += ", \"camera_rotation\": " + json_string(RealSenseID::Description(device_config.camera_rotation));
+            fields += ", \"security_level\": " + json_string(RealSenseID::Description(device_config.security_level));
+            fields += ", \"preview_mode\": " + json_string(RealSenseID::Description(device_config.preview_mode));
+            fields += ", \"algo_flow\": " + json_string(RealSenseID::Description(device_config.algo_flow));
+            fields += ", \"face_selection_policy\": " +
+                      json_string(RealSenseID::Description(device_config.face_selection_policy));
+        }
+    }
+    else if (command == "standby" && args.size() == 1)
+    {
+        status = authenticator.Standby();
+        success = status == Status::Ok;
+    }
+    else if (command == "begin-bulk" && args.size() == 1)
+    {
+        status = authenticator.BeginBulkUpdate();
+        success = status == Status::Ok;
+    }
+    else if (command == "commit-bulk" && args.size() == 1)
+    {
+        status = authenticator.CommitBulkUpdate();
+        success = status == Status::Ok;
+    }
+#ifdef RSID_SECURE
+    else if (command == "pair" && args.size() == 1)
+    {
+        char* host_pubkey = (char*)s_signer.GetHostPubKey();
+        char host_pubkey_signature[32] = {0};
+        char device_pubkey[64] = {0};
+        status = authenticator.Pair(host_pubkey, host_pubkey_signature, device_pubkey);
+        success = status == Status::Ok;
+        if (success)
+        {
+            s_signer.UpdateDevicePubKey((unsigned char*)device_pubkey);
+        }
+    }
+    else if (command == "unpair" && args.size() == 1)
+    {
+        status = authenticator.Unpair();
+        success = status == Status::Ok;
+    }
+#endif // RSID_SECURE
+    else
+    {
+        status_out = "UnknownCommand";
+        return false;
+    }
+    status_out = RealSenseID::Description(status);
+    return success;
+}
+
+// returns the process exit code
+int run_batch(const RealSenseID::SerialConfig& serial_config, const BatchOptions& options)
+{
+    std::ifstream file;
+    if (!options.file.empty())
+    {
+        file.open(options.file);
+        if (!file)
+        {
+            std::cerr << "Failed opening " << options.file << std::endl;
+            return 1;
+        }
+    }
+    std::istream& input = options.file.empty() ? std::cin : file;
+
+    auto batch_start = std::chrono::steady_clock::now();
+#ifdef RSID_SECURE
+    RealSenseID::FaceAuthenticator authenticator {&s_signer};
+#else
+    RealSenseID::FaceAuthenticator authenticator;
+#endif // RSID_SECURE
+    auto connect_status = authenticator.Connect(serial_config);
+    if (connect_status != RealSenseID::Status::Ok)
+    {
+        std::cerr << "Failed connecting to port " << serial_config.port << " status:" << connect_status << std::endl;
+        return 1;
+    }
+    authenticator.SetPersistentSession(true);
+    auto connect_ms = elapsed_ms(batch_start);
+
+    int commands = 0;
+    int failures = 0;
+    std::string line;
+    for (int line_number = 1; std::getline(input, line); line_number++)
+    {
+        std::istringstream words {line};
+        std::vector<std::string> args;
+        for (std::string word; words >> word;)
+        {
+            args.push_back(word);
+        }
+        if (args.empty() || args[0][0] == '#')
+        {
+            continue;
+        }
+
+        commands++;
+        auto start_time = std::chrono::steady_clock::now();
+        std::string status;
+        std::string fields;
+        bool success = run_batch_command(authenticator, args, status, fields);
+        printf("{\"line\": %d, \"command\": %s, \"status\": %s%s, \"elapsed_ms\": %.3f}\n", line_number,
+               json_string(args[0]).c_str(), json_string(status).c_str(), fields.c_str(), elapsed_ms(start_time));
+        fflush(stdout); // stream the results to the script
+        if (!success)
+        {
+            failures++;
+            if (options.stop_on_error)
+            {
+                break;
+            }
+        }
+    }
+    authenticator.Disconnect();
+
+    printf("{\"summary\": {\"commands\": %d, \"failures\": %d, \"connect_ms\": %.3f, \"total_ms\": %.3f}}\n", commands,
+           failures, connect_ms, elapsed_ms(batch_start));
+    return failures > 0 ? 1 : 0;
+}
+
+// parse the arguments following "batch"
+static BatchOptions batch_options_from_argv(int argc, char* argv[], int first)
+{
+    BatchOptions options;
+    for (int i = first; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--file" && i + 1 < argc)
+        {
+            options.file = argv[++i];
+        }
+        else if (arg == "--stop-on-error")
+        {
+            options.stop_on_error = true;
+        }
+        else
+        {
+            print_usage();
+            std::exit(1);
+        }
+    }
+    return options;
+}
+
+
 RealSenseID::SerialConfig config_from_argv(int argc, char* argv[])
 {
     RealSenseID::SerialConfig config;
@@ -763,6 +1460,15 @@ void sample_loop(const RealSenseID::SerialConfig& serial_config)
 int main(int argc, char* argv[])
 {
     auto config = config_from_argv(argc, argv);
+    if (argc > 2 && std::string(argv[2]) == "bench")
+    {
+        run_bench(config, bench_options_from_argv(argc, argv, 3));
+        return 0;
+    }
+    if (argc > 2 && std::string(argv[2]) == "batch")
+    {
+        return run_batch(config, batch_options_from_argv(argc, argv, 3));
+    }
     sample_loop(config);
     return 0;
 }
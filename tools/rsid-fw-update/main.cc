@@ -11,6 +11,10 @@
 #include <cstring>
 #include <utility>
 #include <vector>
+#include <mutex>
+#include <map>
+#include <algorithm>
+#include <cstdlib>
 
 
 static constexpr int SUCCESS_MAIN = 0;
@@ -21,6 +25,7 @@ struct DeviceMetadata
     std::string serial_number = "Unknown";
     std::string fw_version = "Unknown";
     std::string recognition_version = "Unknown";
+    std::string full_version; // as reported by QueryFirmwareVersion
 };
 
 struct FullDeviceInfo
@@ -113,9 +118,17 @@ struct CommandLineArgs
     bool is_valid = false;        // was parsing successful
     bool force_version = false;   // force non-compatible versions
     bool force_full = false;      // force update of all modules even if already exist in the fw
+    bool pipeline = false;        // send blocks while the device writes the previous one
+    bool compress = false;        // send compressed blocks if the device takes them
+    bool adaptive_block = false;  // block size by the link, if the device takes it
+    bool skip_current = false;    // skip devices already running the firmware file
+    bool fast_baud = false;       // negotiate a faster baud rate for the transfer
     bool is_interactive = false;  // ask user for approval
+    bool all_devices = false;     // update all detected devices concurrently
+    unsigned int jobs = 4;        // devices updated at the same time with all_devices
     std::string fw_file = "";     // path to firmware update binary
     std::string serial_port = ""; // serial port
+    std::string journal = "";     // resume journal file
 };
 
 static CommandLineArgs ParseCommandLineArgs(int argc, char* argv[])
@@ -125,7 +138,9 @@ static CommandLineArgs ParseCommandLineArgs(int argc, char* argv[])
     if (argc < 2)
     {
         std::cout << "usage: " << argv[0]
-                  << " --file <bin path> [--port <COM#>] [--force-version] [--force-full] [--interactive]\n";
+                  << " --file <bin path> [--port <COM#>] [--force-version] [--force-full] [--pipeline] [--interactive]"
+                  << " [--all [--jobs <n>]] [--journal <path>] [--skip-current] [--compress]"
+                  << " [--adaptive-block] [--fast-baud]\n";
         return args;
     }
 
@@ -145,6 +160,26 @@ static CommandLineArgs ParseCommandLineArgs(int argc, char* argv[])
         {
             args.force_full = true;
         }
+        else if (strcmp(argv[i], "--pipeline") == 0)
+        {
+            args.pipeline = true;
+        }
+        else if (strcmp(argv[i], "--adaptive-block") == 0)
+        {
+            args.adaptive_block = true;
+        }
+        else if (strcmp(argv[i], "--compress") == 0)
+        {
+            args.compress = true;
+        }
+        else if (strcmp(argv[i], "--skip-current") == 0)
+        {
+            args.skip_current = true;
+        }
+        else if (strcmp(argv[i], "--fast-baud") == 0)
+        {
+            args.fast_baud = true;
+        }
         else if (strcmp(argv[i], "--force-version") == 0)
         {
             args.force_version = true;
@@ -153,6 +188,20 @@ static CommandLineArgs ParseCommandLineArgs(int argc, char* argv[])
         {
             args.is_interactive = true;
         }
+        else if (strcmp(argv[i], "--all") == 0)
+        {
+            args.all_devices = true;
+        }
+        else if (strcmp(argv[i], "--journal") == 0)
+        {
+            if (i + 1 < argc)
+                args.journal = argv[++i];
+        }
+        else if (strcmp(argv[i], "--jobs") == 0)
+        {
+            if (i + 1 < argc)
+                args.jobs = static_cast<unsigned int>(std::max(1, std::atoi(argv[++i])));
+        }
     }
 
     // Make sure all required options are available.
@@ -174,6 +223,7 @@ static DeviceMetadata QueryDeviceMetadata(const RealSenseID::SerialConfig& seria
     device_controller.QueryFirmwareVersion(fw_version);
     if (!fw_version.empty())
     {
+        metadata.full_version = fw_version;
         metadata.fw_version = ParseFirmwareVersion(fw_version);
         metadata.recognition_version = ParseRecognitionVersion(fw_version);
     }
@@ -205,6 +255,111 @@ struct FwUpdaterCliEventHandler : public RealSenseID::FwUpdater::EventHandler
     }
 };
 
+struct FwUpdaterCliFleetEventHandler : public RealSenseID::FwUpdater::FleetEventHandler
+{
+    virtual void OnProgress(const char* port, float progress) override
+    {
+        // report every 10%
+        std::lock_guard<std::mutex> lock {_mutex};
+        int step = static_cast<int>(progress * 10);
+        auto& last_step = _last_steps[port];
+        if (step > last_step)
+        {
+            last_step = step;
+            std::cout << port << ": " << step * 10 << " %\n";
+        }
+    }
+
+    virtual void OnDeviceDone(const char* port, RealSenseID::Status status) override
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        std::cout << port << ": " << (status == RealSenseID::Status::Ok ? "done" : "FAILED") << "\n";
+        if (status != RealSenseID::Status::Ok)
+            failed_ports.push_back(port);
+    }
+
+    std::vector<std::string> failed_ports;
+
+private:
+    std::mutex _mutex;
+    std::map<std::string, int> _last_steps;
+};
+
+// update all detected devices concurrently, without user interaction
+static int UpdateAllDevices(const CommandLineArgs& args, const std::vector<FullDeviceInfo>& devices_info)
+{
+    RealSenseID::FwUpdater fw_updater;
+    std::string new_fw_version;
+    std::string new_recognition_version;
+    if (!fw_updater.ExtractFwVersion(args.fw_file.c_str(), new_fw_version, new_recognition_version))
+    {
+        std::cout << "Invalid firmware file !\n";
+        return FAILURE_MAIN;
+    }
+    if (!RealSenseID::IsFwCompatibleWithHost(new_fw_version) && !args.force_version)
+    {
+        std::cout << "Version is incompatible with the current host version!\n";
+        std::cout << "Use --force-version to force the update.\n ";
+        return FAILURE_MAIN;
+    }
+
+    // preserve the faceprints databases if any device has a different recognition version
+    bool exclude_recognition = false;
+    for (const auto& device : devices_info)
+        exclude_recognition |= device.metadata->recognition_version != new_recognition_version;
+
+    std::vector<const FullDeviceInfo*> to_update;
+    for (const auto& device : devices_info)
+    {
+        if (args.skip_current && !args.force_full &&
+            fw_updater.IsUpToDate(args.fw_file.c_str(), device.metadata->full_version.c_str(), exclude_recognition))
+        {
+            std::cout << " * " << device.config->serialPort << " S/N: " << device.metadata->serial_number
+                      << " already runs " << new_fw_version << ", skipped\n";
+            continue;
+        }
+        to_update.push_back(&device);
+    }
+    if (to_update.empty())
+    {
+        std::cout << "\nAll devices are up to date\n";
+        return SUCCESS_MAIN;
+    }
+
+    std::vector<const char*> ports;
+    std::cout << "Updating " << to_update.size() << " devices, " << args.jobs << " at a time:\n";
+    for (const auto* device_ptr : to_update)
+    {
+        const auto& device = *device_ptr;
+        std::cout << " * " << device.config->serialPort << " S/N: " << device.metadata->serial_number
+                  << " OPFW: " << device.metadata->fw_version << " -> " << new_fw_version << "\n";
+        ports.push_back(device.config->serialPort);
+    }
+    if (exclude_recognition)
+        std::cout << "Recognition module is not updated, to preserve the faceprints databases\n";
+    std::cout << "\n";
+
+    FwUpdaterCliFleetEventHandler event_handler;
+    RealSenseID::FwUpdater::Settings settings;
+    settings.force_full = args.force_full;
+    settings.pipeline_blocks = args.pipeline;
+    settings.compress_blocks = args.compress;
+    settings.adaptive_block_size = args.adaptive_block;
+    settings.skip_up_to_date = args.skip_current;
+    settings.fast_baud_rate = args.fast_baud;
+    if (!args.journal.empty())
+        settings.journal_path = args.journal.c_str();
+    auto success = fw_updater.UpdateFleet(&event_handler, settings, args.fw_file.c_str(), exclude_recognition,
+                                          ports.data(), static_cast<unsigned int>(ports.size()),
+                                          args.jobs) == RealSenseID::Status::Ok;
+
+    std::cout << "\n";
+    std::cout << "Firmware update" << (success ? " finished successfully " : " failed ") << "\n";
+    for (const auto& port : event_handler.failed_ports)
+        std::cout << " * Failed: " << port << "\n";
+    return success ? SUCCESS_MAIN : FAILURE_MAIN;
+}
+
 int main(int argc, char* argv[])
 {
     // parse cli args
@@ -214,7 +369,7 @@ int main(int argc, char* argv[])
 
     // populate device list
     std::vector<FullDeviceInfo> devices_info;
-    bool auto_detect = args.serial_port.empty();
+    bool auto_detect = args.serial_port.empty() || args.all_devices;
     if (auto_detect)
     {
         std::cout << "Using device auto detection...\n\n";
@@ -251,6 +406,9 @@ int main(int argc, char* argv[])
         return FAILURE_MAIN;
     }
 
+    if (args.all_devices)
+        return UpdateAllDevices(args, devices_info);
+
     // if more than one device exists - ask user to select
     auto id = devices_info.size() == 1 ? 0 : UserDeviceSelection(devices_info);
     const auto& selected_device = devices_info.at(id);
@@ -321,6 +479,17 @@ int main(int argc, char* argv[])
     RealSenseID::FwUpdater::Settings settings;
     settings.port = selected_device.config->serialPort;
     settings.force_full = args.force_full;
+    settings.pipeline_blocks = args.pipeline;
+    settings.compress_blocks = args.compress;
+    settings.adaptive_block_size = args.adaptive_block;
+    settings.skip_up_to_date = args.skip_current;
+    settings.fast_baud_rate = args.fast_baud;
+    if (!args.journal.empty())
+    {
+        settings.journal_path = args.journal.c_str();
+        if (selected_device.metadata->serial_number != "Unknown") // otherwise the journal uses the port
+            settings.serial_number = selected_device.metadata->serial_number.c_str();
+    }
 
     // attempt firmware update and return succcess/failure according to result
     auto success = fw_updater.Update(event_handler.get(), settings, args.fw_file.c_str(), exclude_recognition) ==
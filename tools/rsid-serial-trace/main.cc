@@ -0,0 +1,292 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+// Decode a serial trace file (RealSenseID::DumpSerialTrace) to text:
+// one line per recorded transfer, followed by the packets and text completed by it.
+// The bytes of each channel and direction are reassembled, so packets split over several transfers are decoded too.
+
+#include "SerialTrace.h"
+#include "SerialPacket.h"
+#include "Crc16.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace RealSenseID::PacketManager;
+
+static constexpr int SUCCESS_MAIN = 0;
+static constexpr int FAILURE_MAIN = 1;
+
+static constexpr size_t HeaderSize = sizeof(SerialPacket::header);
+static constexpr size_t MaxPayloadSize = sizeof(SerialPacket::payload);
+static constexpr size_t HmacSize = sizeof(SerialPacket::hmac);
+static constexpr size_t CrcSize = sizeof(SerialPacket::crc);
+
+static const char* MsgIdName(char id)
+{
+    switch (static_cast<MsgId>(id))
+    {
+    case MsgId::Authenticate:
+        return "Authenticate";
+    case MsgId::DetectSpoof:
+        return "DetectSpoof";
+    case MsgId::RemoveAllUsers:
+        return "RemoveAllUsers";
+    case MsgId::RemoveUser:
+        return "RemoveUser";
+    case MsgId::Enroll:
+        return "Enroll";
+    case MsgId::Hint:
+        return "Hint";
+    case MsgId::SecureFaceprintsEnroll:
+        return "SecureFaceprintsEnroll";
+    case MsgId::SecureFaceprintsAuthenticate:
+        return "SecureFaceprintsAuthenticate";
+    case MsgId::Progress:
+        return "Progress";
+    case MsgId::Result:
+        return "Result";
+    case MsgId::EnrollFaceprintsExtraction:
+        return "EnrollFaceprintsExtraction";
+    case MsgId::AuthenticateFaceprintsExtraction:
+        return "AuthenticateFaceprintsExtraction";
+    case MsgId::Reply:
+        return "Reply";
+    case MsgId::HostEcdsaKey:
+        return "HostEcdsaKey";
+    case MsgId::DeviceEcdsaKey:
+        return "DeviceEcdsaKey";
+    case MsgId::HostEcdhKey:
+        return "HostEcdhKey";
+    case MsgId::DeviceEcdhKey:
+        return "DeviceEcdhKey";
+    case MsgId::Faceprints:
+        return "Faceprints";
+    case MsgId::FaceDetected:
+        return "FaceDetected";
+    case MsgId::GetNumberOfUsers:
+        return "GetNumberOfUsers";
+    case MsgId::StartSession:
+        return "StartSession";
+    case MsgId::Ping:
+        return "Ping";
+    case MsgId::QueryDeviceConfig:
+        return "QueryDeviceConfig";
+    case MsgId::SetDeviceConfig:
+        return "SetDeviceConfig";
+    case MsgId::StandBy:
+        return "StandBy";
+    case MsgId::GetUserIds:
+        return "GetUserIds";
+    case MsgId::SecureFaceprintsBeginSecureSession:
+        return "SecureFaceprintsBeginSecureSession";
+    case MsgId::SecureFaceprintsEndSecureSession:
+        return "SecureFaceprintsEndSecureSession";
+    case MsgId::SecureFaceprintsOnSecureSessionReady:
+        return "SecureFaceprintsOnSecureSessionReady";
+    case MsgId::SecureFaceprintsOnSecureSessionCmd:
+        return "SecureFaceprintsOnSecureSessionCmd";
+    case MsgId::SecureFaceprintsOnSecureSessionCmdResp:
+        return "SecureFaceprintsOnSecureSessionCmdResp";
+    case MsgId::SecureFaceprintsFaceprintsReady:
+        return "SecureFaceprintsFaceprintsReady";
+    case MsgId::SetUserFeatures:
+        return "SetUserFeatures";
+    case MsgId::GetUserFeatures:
+        return "GetUserFeatures";
+    default:
+        return "Unknown";
+    }
+}
+
+static std::string Escape(const std::string& bytes)
+{
+    std::ostringstream os;
+    for (unsigned char c : bytes)
+    {
+        if (c == '\r')
+            os << "\\r";
+        else if (c == '\n')
+            os << "\\n";
+        else if (c == '\\')
+            os << "\\\\";
+        else if (c >= 0x20 && c < 0x7f)
+            os << c;
+        else
+            os << "\\x" << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(c) << std::dec;
+    }
+    return os.str();
+}
+
+static bool IsPacketStart(const std::string& bytes, size_t pos)
+{
+    return bytes.size() >= pos + 3 && bytes[pos] == static_cast<char>(SyncByte::Sync1) &&
+           bytes[pos + 1] == static_cast<char>(SyncByte::Sync2) &&
+           static_cast<unsigned char>(bytes[pos + 2]) == ProtocolVer;
+}
+
+// the bytes of one channel and direction, decoded as they arrive
+class Stream
+{
+public:
+    void Append(const char* data, size_t size)
+    {
+        _pending.append(data, size);
+    }
+
+    // the recorded bytes were cut, the rest of the current packet is lost
+    void Gap(size_t missing)
+    {
+        std::cout << "      (" << missing << " bytes not recorded)\n";
+        _pending.clear();
+    }
+
+    // decode all complete packets and text
+    void Decode()
+    {
+        while (!_pending.empty())
+        {
+            size_t start = 0;
+            while (start < _pending.size() && !IsPacketStart(_pending, start))
+                ++start;
+            if (start == _pending.size() && _pending.back() == static_cast<char>(SyncByte::Sync1))
+                --start; // may be the start of the next packet
+            if (start == _pending.size() && start >= 2 && IsPartialStart(start - 2))
+                start -= 2;
+            if (start > 0)
+            {
+                PrintText(_pending.substr(0, start));
+                _pending.erase(0, start);
+                continue;
+            }
+            if (!DecodePacket())
+                return; // wait for the rest of the packet
+        }
+    }
+
+private:
+    static void PrintText(const std::string& text)
+    {
+        static constexpr size_t max_shown = 128;
+        std::cout << "      text \"" << Escape(text.substr(0, max_shown)) << '"';
+        if (text.size() > max_shown)
+            std::cout << " ... (" << text.size() << " bytes)";
+        std::cout << '\n';
+    }
+
+    bool IsPartialStart(size_t pos) const
+    {
+        return _pending[pos] == static_cast<char>(SyncByte::Sync1) &&
+               _pending[pos + 1] == static_cast<char>(SyncByte::Sync2);
+    }
+
+    // decode the packet at the start of _pending. false if not complete yet
+    bool DecodePacket()
+    {
+        if (_pending.size() < 3 || !IsPacketStart(_pending, 0))
+            return false;
+        if (_pending.size() < HeaderSize)
+            return false;
+
+        uint16_t payload_size;
+        ::memcpy(&payload_size, _pending.data() + HeaderSize - sizeof(payload_size), sizeof(payload_size));
+        const char id = _pending[3];
+        if (payload_size > MaxPayloadSize)
+        {
+            std::cout << "      invalid packet '" << id << "': payload size " << payload_size << '\n';
+            _pending.erase(0, 1); // resync
+            return true;
+        }
+        const size_t packet_size = HeaderSize + payload_size + HmacSize + CrcSize;
+        if (_pending.size() < packet_size)
+            return false;
+
+        const char* packet = _pending.data();
+        auto crc = Crc16(packet, HeaderSize + payload_size);
+        crc = Crc16Zeros(crc, MaxPayloadSize - payload_size);
+        crc = Crc16(crc, packet + HeaderSize + payload_size, HmacSize);
+        uint16_t packet_crc;
+        ::memcpy(&packet_crc, packet + HeaderSize + payload_size + HmacSize, sizeof(packet_crc));
+
+        std::cout << "      packet '" << id << "' " << MsgIdName(id) << " payload=" << payload_size;
+        if (payload_size >= sizeof(uint32_t))
+        {
+            uint32_t sequence_number;
+            ::memcpy(&sequence_number, packet + HeaderSize, sizeof(sequence_number));
+            std::cout << " seq=" << sequence_number;
+        }
+        if (crc == packet_crc)
+            std::cout << " crc ok\n";
+        else
+            std::cout << " crc MISMATCH (expected " << crc << ", got " << packet_crc << ")\n";
+
+        _pending.erase(0, packet_size);
+        return true;
+    }
+
+    std::string _pending;
+};
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2)
+    {
+        std::cout << "Usage: " << argv[0] << " <trace file>\n";
+        return FAILURE_MAIN;
+    }
+
+    std::ifstream file(argv[1], std::ios::binary);
+    if (!file)
+    {
+        std::cout << "Failed to open " << argv[1] << '\n';
+        return FAILURE_MAIN;
+    }
+
+    SerialTrace::FileHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        ::memcmp(header.magic, SerialTrace::FileMagic, sizeof(header.magic)) != 0)
+    {
+        std::cout << "Not a serial trace file: " << argv[1] << '\n';
+        return FAILURE_MAIN;
+    }
+
+    std::cout << header.record_count << " records\n";
+    std::cout << "    time[ms] thread channel dir    bytes\n";
+
+    std::map<std::pair<uint32_t, uint8_t>, Stream> streams;
+    std::vector<char> data(SerialTrace::MaxRecordBytes);
+    uint64_t first_time = 0;
+    for (uint32_t i = 0; i < header.record_count; ++i)
+    {
+        SerialTrace::RecordHeader record;
+        if (!file.read(reinterpret_cast<char*>(&record), sizeof(record)) ||
+            record.stored_size > SerialTrace::MaxRecordBytes || record.stored_size > record.size ||
+            !file.read(data.data(), record.stored_size))
+        {
+            std::cout << "Truncated trace file, " << i << " of " << header.record_count << " records read\n";
+            return FAILURE_MAIN;
+        }
+        if (i == 0)
+            first_time = record.time_us;
+
+        const bool is_send = record.direction == static_cast<uint8_t>(SerialTrace::Direction::Send);
+        std::cout << std::fixed << std::setprecision(3) << std::setw(12)
+                  << static_cast<double>(record.time_us - first_time) / 1000.0 << std::setw(7) << record.thread
+                  << std::setw(8) << std::hex << record.channel << std::dec << (is_send ? " send " : " recv ")
+                  << std::setw(8) << record.size << '\n';
+
+        auto& stream = streams[std::make_pair(record.channel, record.direction)];
+        stream.Append(data.data(), record.stored_size);
+        stream.Decode();
+        if (record.stored_size < record.size)
+            stream.Gap(record.size - record.stored_size);
+    }
+    return SUCCESS_MAIN;
+}
@@ -50,6 +50,7 @@ namespace rsid_wrapper_csharp
         private rsid.Preview _preview;
         private WriteableBitmap _previewBitmap;
         private byte[] _previewBuffer = new byte[0]; // store latest frame from the preview callback
+        private rsid.PreviewFrame _previewFrame; // latest mjpeg frame, drawn from its native buffer instead of _previewBuffer
         // tuple of (Face,IsAuthenticated,UserId) in current session
         private List<(rsid.FaceRect, rsid.AuthStatus?, string userId)> _detectedFaces = new List<(rsid.FaceRect, rsid.AuthStatus?, string)>();
         private List<UInt32> _detectedFacesTs = new List<UInt32>();
@@ -936,7 +937,10 @@ namespace rsid_wrapper_csharp
             Int32Rect sourceRect = new Int32Rect(0, 0, image.width, image.height);
             lock (_previewMutex)
             {
-                _previewBitmap.WritePixels(sourceRect, _previewBuffer, image.stride, 0);
+                if (_previewFrame != null)
+                    _previewBitmap.WritePixels(sourceRect, _previewFrame.Image.buffer, _previewFrame.Image.size, image.stride);
+                else
+                    _previewBitmap.WritePixels(sourceRect, _previewBuffer, image.stride, 0);
             }
         }
 
@@ -959,6 +963,16 @@ namespace rsid_wrapper_csharp
             return true;
         }
 
+        // the native frame must not be drawn once its preview is recreated
+        private void ReleasePreviewFrame()
+        {
+            lock (_previewMutex)
+            {
+                _previewFrame?.Dispose();
+                _previewFrame = null;
+            }
+        }
+
         // Handle preview callback.         
         private void OnPreview(rsid.PreviewImage image, IntPtr ctx)
         {
@@ -979,6 +993,9 @@ namespace rsid_wrapper_csharp
                     Console.WriteLine("Creating preview buffer");
                     _previewBuffer = new byte[preview_image.size];
                 }
+                // the frame drawn last is no longer needed
+                _previewFrame?.Dispose();
+                _previewFrame = null;
                 // convert raw to rgb for preview
                 if (_deviceState.PreviewConfig.previewMode == rsid.PreviewMode.RAW10_1080P)
                 {
@@ -988,7 +1005,10 @@ namespace rsid_wrapper_csharp
                 else
                 {
                     preview_image = image;
-                    Marshal.Copy(preview_image.buffer, _previewBuffer, 0, preview_image.size);
+                    // keep the native frame for drawing, copy only if all the preview buffers are held
+                    _previewFrame = _preview.AcquireFrame(image);
+                    if (_previewFrame == null)
+                        Marshal.Copy(preview_image.buffer, _previewBuffer, 0, preview_image.size);
                 }
 
                 /// calculate FPS
@@ -1621,7 +1641,10 @@ namespace rsid_wrapper_csharp
                 if (_preview == null)
                     _preview = new rsid.Preview(_deviceState.PreviewConfig);
                 else
+                {
+                    ReleasePreviewFrame();
                     _preview.UpdateConfig(_deviceState.PreviewConfig);
+                }
                 _preview.Start(OnPreview);
                 if (_flowMode == FlowMode.Server)
                     RefreshUserListServer();
@@ -2044,6 +2067,7 @@ namespace rsid_wrapper_csharp
                     {
                         // restart preview
                         _deviceState.PreviewConfig = new rsid.PreviewConfig { cameraNumber = Settings.Default.CameraNumber, previewMode = (rsid.PreviewMode)deviceConfig.previewMode };
+                        ReleasePreviewFrame();
                         _preview.UpdateConfig(_deviceState.PreviewConfig);
                     }
                     ShowLog("Detected changes. Updating settings on device...");
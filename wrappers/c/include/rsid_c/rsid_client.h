@@ -17,6 +17,9 @@
 
 #define RSID_MAX_FACES                              10 // max number of detected faces in single frame
 
+#define RSID_METRICS_LATENCY_BUCKETS                12 // see RealSenseID::MetricsLatencyBoundsMs
+#define RSID_GALLERY_MAX_MESSAGE_SIZE               4096 // see RealSenseID::GalleryTransport::MaxMessageSize
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -121,6 +124,35 @@ extern "C"
         void* ctx;                                  /* user defined context (optional) */
     } rsid_auth_args;
 
+    /* timing breakdown of an authentication (microseconds), see rsid_set_timing_clbk() */
+    typedef struct
+    {
+        unsigned long long session_start_us;       /* session start (with the key exchange in secure mode) */
+        unsigned long long request_send_us;        /* sending the request packet */
+        unsigned long long until_face_detected_us; /* from the request until the first detected faces arrived */
+        unsigned long long until_result_us;        /* from the request until the result arrived */
+        unsigned long long faceprints_transfer_us; /* from the result until the faceprints arrived (host mode) */
+        unsigned long long host_match_us;          /* gallery match on the host (gallery authentication) */
+        unsigned long long total_us;               /* the whole operation */
+    } rsid_operation_timing;
+
+    /* valid only during the call */
+    typedef void (*rsid_timing_clbk)(const rsid_operation_timing* timing, void* ctx);
+
+    /* users listing and export */
+    /* user ids listing callback */
+    typedef void (*rsid_user_id_clbk)(unsigned int user_index, const char* user_id, void* ctx);
+    /* users export callback: the user's id and faceprints, valid only during the call */
+    typedef void (*rsid_user_export_clbk)(unsigned int user_index, const char* user_id,
+                                          const rsid_faceprints* faceprints, void* ctx);
+    /* position of a paginated listing or export, zero initialize to start from the first user */
+    typedef struct
+    {
+        unsigned int next_index;      /* DB index of the next user to deliver */
+        unsigned int number_of_users; /* number of users in the device's DB when the last page was read */
+        int done;                     /* set once the last user of the DB was delivered */
+    } rsid_users_cursor;
+
     /* rsid_enroll() args */
     typedef void (*rsid_enroll_status_clbk)(rsid_enroll_status status, void* ctx);
     typedef void (*rsid_enroll_progress_clbk)(rsid_face_pose face_pose, void* ctx);
@@ -168,9 +200,136 @@ extern "C"
         rsid_faceprints updated_faceprints;
     } rsid_match_args;
 
+    /* host mode users gallery, kept in native memory (see RealSenseID/HostGallery.h) */
+    typedef struct
+    {
+        void* _impl;
+    } rsid_gallery;
+
+    /* users gallery partitioned across gallery nodes on other hosts (see RealSenseID/RemoteGallery.h) */
+    typedef struct
+    {
+        void* _impl;
+    } rsid_remote_gallery;
+
+    /* one shard of a remote gallery, serving the requests of its clients (see RealSenseID/GalleryNode.h) */
+    typedef struct
+    {
+        void* _impl;
+    } rsid_gallery_node;
+
+    /*
+     * Send the request to a gallery node (to rsid_gallery_node_handle_request() on its host) and write its reply, of
+     * up to RSID_GALLERY_MAX_MESSAGE_SIZE bytes. Called concurrently for the different nodes of a remote gallery.
+     */
+    typedef rsid_status (*rsid_gallery_transport_clbk)(const unsigned char* request, unsigned int request_size,
+                                                       unsigned char* reply, unsigned int* reply_size, void* ctx);
+
+    /* link from a remote gallery to one of its nodes */
+    typedef struct
+    {
+        rsid_gallery_transport_clbk clbk;
+        void* ctx;
+    } rsid_gallery_transport;
+
+    /* authentication events queue, polled by the application (see RealSenseID/AuthEventQueue.h) */
+    typedef struct
+    {
+        void* _impl;
+    } rsid_auth_event_queue;
+
+    typedef enum
+    {
+        RSID_AuthEvent_FaceDetected,
+        RSID_AuthEvent_Hint,
+        RSID_AuthEvent_Result
+    } rsid_auth_event_type;
+
+    /* authentication event, as delivered to the rsid_auth_args callbacks */
+    typedef struct
+    {
+        rsid_auth_event_type type;
+        rsid_auth_status status;              /* hint and result */
+        char user_id[31];                     /* result (valid only if status is RSID_Auth_Success) */
+        unsigned int ts;                      /* face detected */
+        unsigned int n_faces;                 /* face detected */
+        rsid_face_rect faces[RSID_MAX_FACES]; /* face detected. first item is the selected one */
+    } rsid_auth_event;
+
+    /* rsid_gallery_match() result */
+    typedef struct
+    {
+        rsid_match_result match_result;
+        char user_id[31]; /* matched user id with null char (valid only if match_result.success) */
+    } rsid_gallery_match_result;
+
+    /* rsid_authenticate_with_gallery() result of a single face */
+    typedef struct
+    {
+        rsid_face_rect face;                          /* the face's rectangle (zeros if the device sent none) */
+        rsid_auth_status status;                      /* faceprints extraction status on the device */
+        rsid_gallery_match_result match;              /* gallery match (valid only if status is RSID_Auth_Success) */
+        const rsid_faceprints* updated_faceprints;    /* matched user's updated faceprints (null unless
+                                                         match.match_result.should_update) */
+    } rsid_gallery_face_result;
+
+    /* results of all the faces of a frame, in the order of the detected faces. valid only during the call. */
+    typedef void (*rsid_gallery_auth_clbk)(const rsid_gallery_face_result results[], unsigned int n_results,
+                                           unsigned int ts, void* ctx);
+
     /* log callback */
     typedef void (*rsid_log_clbk)(rsid_log_level log_level, const char* msg);
 
+    /* structured log callback: the logging module's tag and the unformatted message (size bytes, null terminated).
+     * valid only during the call. */
+    typedef void (*rsid_structured_log_clbk)(rsid_log_level log_level, const char* tag, const char* msg, size_t size,
+                                             void* ctx);
+
+    /* a background loop of the library, given to the executor callback */
+    typedef struct rsid_task rsid_task;
+
+    /* executor callback: run the task with rsid_run_task() on a thread of the host, not in the calling thread. the
+     * task blocks its thread until stopped by the library (see RealSenseID/Executor.h). */
+    typedef void (*rsid_execute_clbk)(rsid_task* task, void* ctx);
+
+    /* operations with a latency histogram in rsid_metrics */
+    typedef enum
+    {
+        RSID_MetricsOp_Enroll,
+        RSID_MetricsOp_Authenticate,
+        RSID_MetricsOp_QueryUserIds,
+        RSID_MetricsOp_QueryNumberOfUsers,
+        RSID_MetricsOp_QueryDeviceConfig,
+        RSID_MetricsOp_Count
+    } rsid_metrics_operation;
+
+    typedef struct
+    {
+        unsigned long long buckets[RSID_METRICS_LATENCY_BUCKETS]; /* not cumulative, upper bounds in ms:
+                                                                     5,10,25,50,100,250,500,1000,2500,5000,10000,inf */
+        unsigned long long count;
+        unsigned long long sum_us;
+    } rsid_latency_histogram;
+
+    /* library metrics since load or since rsid_reset_metrics(), see RealSenseID/Metrics.h */
+    typedef struct
+    {
+        unsigned long long packets_sent[128];     /* indexed by message id character */
+        unsigned long long packets_received[128]; /* indexed by message id character */
+        unsigned long long crc_errors;
+        unsigned long long timeouts;
+        unsigned long long sync_retries;
+        unsigned long long serial_transfer_time_us;
+        unsigned long long serial_wait_time_us;
+        unsigned long long session_starts;
+        unsigned long long session_start_time_us;
+        rsid_latency_histogram latency[RSID_MetricsOp_Count]; /* indexed by rsid_metrics_operation */
+        unsigned long long matcher_searches;
+        unsigned long long matcher_candidates;
+        unsigned long long matcher_time_us;
+        unsigned long long preview_frames_dropped;
+    } rsid_metrics;
+
     /* return new authenticator pointer (or null on failure) */
 #ifdef RSID_SECURE
     RSID_C_API rsid_authenticator* rsid_create_authenticator(rsid_signature_clbk* signature_clbk);
@@ -222,6 +381,34 @@ RSID_C_API rsid_authenticator* rsid_create_authenticator();
     /* authenticate in an infinite loop until rsid_cancel is called */
     RSID_C_API rsid_status rsid_authenticate_loop(rsid_authenticator* authenticator, const rsid_auth_args* args);
 
+    /* set the callback called with the timing of each authentication of the authenticator (rsid_authenticate(),
+     * rsid_authenticate_loop(), rsid_extract_faceprints_for_auth(_loop)() and the gallery authentications), after its
+     * result, when the operation ends with the device's reply. NULL clbk to remove it. May be called while an operation
+     * runs: the change applies from the next operation. */
+    RSID_C_API void rsid_set_timing_clbk(rsid_authenticator* authenticator, rsid_timing_clbk clbk, void* ctx);
+
+    /* return new auth event queue of the given capacity (or null on failure) */
+    RSID_C_API rsid_auth_event_queue* rsid_create_auth_event_queue(unsigned int capacity);
+
+    /* destroy the queue and free its memory */
+    RSID_C_API void rsid_destroy_auth_event_queue(rsid_auth_event_queue* queue);
+
+    /* take the oldest event without waiting. return 1 if an event was taken, 0 if the queue is empty */
+    RSID_C_API int rsid_poll_auth_event(rsid_auth_event_queue* queue, rsid_auth_event* event);
+
+    /* number of events dropped so far because the queue was full */
+    RSID_C_API unsigned int rsid_auth_event_queue_dropped(rsid_auth_event_queue* queue);
+
+    /*
+     * authenticate a user, queueing the events instead of calling callbacks.
+     * events are queued and polled without allocations. poll them from a single thread while this call blocks.
+     */
+    RSID_C_API rsid_status rsid_authenticate_to_queue(rsid_authenticator* authenticator, rsid_auth_event_queue* queue);
+
+    /* authenticate in an infinite loop until rsid_cancel is called, queueing the events */
+    RSID_C_API rsid_status rsid_authenticate_loop_to_queue(rsid_authenticator* authenticator,
+                                                           rsid_auth_event_queue* queue);
+
     /* detect spoof attempt */
     RSID_C_API rsid_status rsid_detect_spoof(rsid_authenticator* authenticator, const rsid_auth_args* args);
 
@@ -245,6 +432,29 @@ RSID_C_API rsid_authenticator* rsid_create_authenticator();
     /* set log callback to be called when log with at least min_level is available */
     RSID_C_API void rsid_set_log_clbk(rsid_log_clbk clbk, rsid_log_level min_level, int do_formatting);
 
+    /* set structured log callback, called by the logging thread with no formatting. null clbk to remove it */
+    RSID_C_API void rsid_set_structured_log_clbk(rsid_structured_log_clbk clbk, rsid_log_level min_level, void* ctx);
+
+    /* sample the tag's log messages below warning level: one in every one_in, at most max_per_second per second
+     * (0 for no limit) */
+    RSID_C_API void rsid_set_log_sampling(const char* tag, unsigned int one_in, unsigned int max_per_second);
+
+    /* remove the sampling of all tags */
+    RSID_C_API void rsid_clear_log_sampling();
+
+    /* run the library's background loops with the given callback (NULL - threads of the library), for the loops
+     * started afterwards */
+    RSID_C_API void rsid_set_executor(rsid_execute_clbk clbk, void* ctx);
+
+    /* run a task given to the executor callback, once */
+    RSID_C_API void rsid_run_task(rsid_task* task);
+
+    /* copy the library metrics */
+    RSID_C_API void rsid_get_metrics(rsid_metrics* metrics);
+
+    /* zero the library metrics */
+    RSID_C_API void rsid_reset_metrics();
+
 
     /*
      * Query ids of all enrolled users from device.
@@ -261,11 +471,21 @@ RSID_C_API rsid_authenticator* rsid_create_authenticator();
      * On successfull operation, the result copied into the result_buf and number_of_users is updated accordingly.
      * The result buf will contain all user ids (31 byte chunks).
      * Note: result_buf must be allocted with size of at least (number_of_users * 31)
+     *       No memory is allocated for the listing.
      */
 
     RSID_C_API rsid_status rsid_query_user_ids_to_buf(rsid_authenticator* authenticator, char* result_buf,
                                                       unsigned int* number_of_users);
 
+    /*
+     * Query ids of all enrolled users from device, streaming them to the given callback.
+     * The callback is called once for each user (up to number_of_users), in DB order, with the user's index and
+     * null terminated id (valid only during the call). No memory is allocated for the listing.
+     * On successfull operation, number_of_users is updated to the number of users listed.
+     */
+    RSID_C_API rsid_status rsid_query_user_ids_clbk(rsid_authenticator* authenticator, rsid_user_id_clbk clbk,
+                                                    void* ctx, unsigned int* number_of_users);
+
     /*
      * Get number of enrolled users from device.
      * On successfull operation, the result is placed in number_of_users.
@@ -278,6 +498,29 @@ RSID_C_API rsid_authenticator* rsid_create_authenticator();
      */
     RSID_C_API rsid_status rsid_get_users_faceprints(rsid_authenticator* authenticator, rsid_faceprints* user_features);
 
+    /*
+     * Export the id and faceprints of each user together, in a single pass over the device's DB.
+     * The callback is called once for each user, in DB order. No array for all the users is allocated.
+     * On successfull operation, number_of_users is updated to the number of users exported.
+     */
+    RSID_C_API rsid_status rsid_export_users(rsid_authenticator* authenticator, rsid_user_export_clbk clbk, void* ctx,
+                                             unsigned int* number_of_users);
+
+    /*
+     * Export the next page of users (at most page_size, not zero) from the cursor on, as rsid_export_users() does.
+     * The cursor advances past each user delivered, also when the page fails, so calling again resumes the export.
+     * Call until cursor->done is set; host memory is bounded by the page size, for a DB of any size.
+     */
+    RSID_C_API rsid_status rsid_export_users_page(rsid_authenticator* authenticator, rsid_users_cursor* cursor,
+                                                  unsigned int page_size, rsid_user_export_clbk clbk, void* ctx);
+
+    /*
+     * Query the ids of the next page of users (at most page_size, not zero) from the cursor on, as
+     * rsid_export_users_page() does.
+     */
+    RSID_C_API rsid_status rsid_query_user_ids_page(rsid_authenticator* authenticator, rsid_users_cursor* cursor,
+                                                    unsigned int page_size, rsid_user_id_clbk clbk, void* ctx);
+
      /*
      * Insert (or update) all the users from the given array to the device's database.
      * On successful operation, each user's features are updated (if the user pre-existed), or the user is newly enrolled,
@@ -285,6 +528,13 @@ RSID_C_API rsid_authenticator* rsid_create_authenticator();
     RSID_C_API rsid_status rsid_set_users_faceprints(rsid_authenticator* authenticator,
                                                   rsid_user_faceprints* user_features, const unsigned int number_of_users);
 
+    /*
+     * Bulk update of the device's database: until rsid_commit_bulk_update(), rsid_set_users_faceprints() does not
+     * persist the database to flash and the session stays open between the calls. The commit persists it once.
+     */
+    RSID_C_API rsid_status rsid_begin_bulk_update(rsid_authenticator* authenticator);
+    RSID_C_API rsid_status rsid_commit_bulk_update(rsid_authenticator* authenticator);
+
     /* Prepare device to standby */
     RSID_C_API rsid_status rsid_standby(rsid_authenticator* authenticator);
 
@@ -329,6 +579,16 @@ RSID_C_API rsid_authenticator* rsid_create_authenticator();
     RSID_C_API rsid_status rsid_extract_faceprints_for_enroll(rsid_authenticator* authenticator,
                                                               rsid_enroll_ext_args* args);
 
+    /*
+     * extract faceprints using enrollment flow, and look for the enrollee in the gallery in the background meanwhile
+     * (the gallery is not changed). duplicate is set when the call returns: duplicate->match_result.success is set if
+     * the enrollee matched a gallery user (duplicate->user_id).
+     */
+    RSID_C_API rsid_status rsid_extract_faceprints_for_enroll_with_gallery(rsid_authenticator* authenticator,
+                                                                           rsid_gallery* gallery,
+                                                                           rsid_enroll_ext_args* args,
+                                                                           rsid_gallery_match_result* duplicate);
+
     /* extract faceprints using authentication flow */
     RSID_C_API rsid_status rsid_extract_faceprints_for_auth(rsid_authenticator* authenticator,
                                                             rsid_faceprints_ext_args* args);
@@ -339,6 +599,154 @@ RSID_C_API rsid_authenticator* rsid_create_authenticator();
 
     RSID_C_API rsid_match_result rsid_match_faceprints(rsid_authenticator* authenticator, rsid_match_args* args);
 
+    /* return new gallery pointer (or null on failure) */
+    RSID_C_API rsid_gallery* rsid_create_gallery();
+
+    /* return new gallery pointer searching large galleries with search_threads threads (or null on failure) */
+    RSID_C_API rsid_gallery* rsid_create_gallery_with_threads(unsigned int search_threads);
+
+    /* return new gallery pointer with a hot tier of up to hot_users frequently matched users, searched first
+     * (or null on failure) */
+    RSID_C_API rsid_gallery* rsid_create_tiered_gallery(unsigned int search_threads, unsigned int hot_users);
+
+    /* destroy the gallery and free its memory */
+    RSID_C_API void rsid_destroy_gallery(rsid_gallery* gallery);
+
+    /* add user to the gallery, or replace its faceprints if the user is already in it */
+    RSID_C_API rsid_status rsid_gallery_add(rsid_gallery* gallery, const char* user_id,
+                                            const rsid_faceprints* faceprints);
+
+    /* remove user from the gallery */
+    RSID_C_API rsid_status rsid_gallery_remove(rsid_gallery* gallery, const char* user_id);
+
+    /* remove all users from the gallery */
+    RSID_C_API void rsid_gallery_clear(rsid_gallery* gallery);
+
+    /* number of users in the gallery */
+    RSID_C_API unsigned int rsid_gallery_size(rsid_gallery* gallery);
+
+    /* save the gallery to a gallery file */
+    RSID_C_API rsid_status rsid_gallery_save(rsid_gallery* gallery, const char* path);
+
+    /* replace the gallery contents with a gallery file written by rsid_gallery_save() (memory mapped) */
+    RSID_C_API rsid_status rsid_gallery_load(rsid_gallery* gallery, const char* path);
+
+    /* replace the gallery contents with number_of_users users, validated and indexed in parallel. invalid entries are
+     * skipped, a repeated user id gets its last entry. number_loaded (optional) gets the number of users loaded */
+    RSID_C_API rsid_status rsid_gallery_load_users(rsid_gallery* gallery, const char* const* user_ids,
+                                                   const rsid_faceprints* faceprints, unsigned int number_of_users,
+                                                   unsigned int* number_loaded);
+
+    /* score the recent_users users matched last before searching the gallery (0 - off, the default), so repeated
+     * authentications of the same person skip the search */
+    RSID_C_API void rsid_gallery_set_recent_first(rsid_gallery* gallery, unsigned int recent_users);
+
+    /*
+     * Match faceprints against all the users in the gallery.
+     * If result->match_result.should_update is set, the matched user was updated in the gallery and its updated
+     * faceprints are copied to updated_faceprints (optional, may be null), to be saved in the host's database.
+     */
+    RSID_C_API rsid_status rsid_gallery_match(rsid_gallery* gallery, const rsid_faceprints* new_faceprints,
+                                              rsid_gallery_match_result* result, rsid_faceprints* updated_faceprints);
+
+    /* find the user that faceprints match, as rsid_gallery_match() does, without updating the gallery (e.g. to check
+     * that a new enrollee is not enrolled already) */
+    RSID_C_API rsid_status rsid_gallery_find_user(rsid_gallery* gallery, const rsid_faceprints* faceprints,
+                                                  rsid_gallery_match_result* result);
+
+    /* set the access groups of a user (bit g for group g, 64 groups), for rsid_gallery_match_groups(). users have no
+     * groups until set, and the groups are reset by rsid_gallery_clear() and the loads */
+    RSID_C_API rsid_status rsid_gallery_set_user_groups(rsid_gallery* gallery, const char* user_id,
+                                                        unsigned long long access_groups);
+
+    /*
+     * Match faceprints against the users of the given access groups only, as rsid_gallery_match(), so one gallery
+     * serves doors admitting different groups. The search skips the other users, 64 at a time.
+     */
+    RSID_C_API rsid_status rsid_gallery_match_groups(rsid_gallery* gallery, const rsid_faceprints* new_faceprints,
+                                                     unsigned long long access_groups,
+                                                     rsid_gallery_match_result* result,
+                                                     rsid_faceprints* updated_faceprints);
+
+    /*
+     * Match number_of_probes faceprints against the gallery in a single pass over it.
+     * results[i] and updated_faceprints[i] are as in rsid_gallery_match() for new_faceprints[i]
+     * (updated_faceprints is optional, may be null).
+     */
+    RSID_C_API rsid_status rsid_gallery_match_batch(rsid_gallery* gallery, const rsid_faceprints* new_faceprints,
+                                                    unsigned int number_of_probes, rsid_gallery_match_result* results,
+                                                    rsid_faceprints* updated_faceprints);
+
+    /*
+     * Authenticate all the faces of a frame (up to 5 with the "all" face selection policy) against the gallery.
+     * Their faceprints are matched in a single batch, and clbk is called once with the results.
+     */
+    RSID_C_API rsid_status rsid_authenticate_with_gallery(rsid_authenticator* authenticator, rsid_gallery* gallery,
+                                                          rsid_gallery_auth_clbk clbk, void* ctx);
+
+    /* return new gallery node pointer (or null on failure) */
+    RSID_C_API rsid_gallery_node* rsid_create_gallery_node();
+
+    /* destroy the gallery node and free its memory */
+    RSID_C_API void rsid_destroy_gallery_node(rsid_gallery_node* node);
+
+    /* handle a request received from a remote gallery and write the reply to send back to it */
+    RSID_C_API rsid_status rsid_gallery_node_handle_request(rsid_gallery_node* node, const unsigned char* request,
+                                                            unsigned int request_size, unsigned char* reply,
+                                                            unsigned int* reply_size);
+
+    /* number of users in the node */
+    RSID_C_API unsigned int rsid_gallery_node_size(rsid_gallery_node* node);
+
+    /* save the node's users to a gallery file */
+    RSID_C_API rsid_status rsid_gallery_node_save(rsid_gallery_node* node, const char* path);
+
+    /* replace the node's users with a gallery file written by rsid_gallery_node_save() (memory mapped) */
+    RSID_C_API rsid_status rsid_gallery_node_load(rsid_gallery_node* node, const char* path);
+
+    /*
+     * return new remote gallery pointer over number_of_nodes nodes (or null on failure).
+     * all the clients of a gallery must be created with the same nodes in the same order.
+     */
+    RSID_C_API rsid_remote_gallery* rsid_create_remote_gallery(const rsid_gallery_transport* nodes,
+                                                               unsigned int number_of_nodes);
+
+    /* destroy the remote gallery and free its memory */
+    RSID_C_API void rsid_destroy_remote_gallery(rsid_remote_gallery* gallery);
+
+    /* add user to its node, or replace its faceprints if the user is already in it */
+    RSID_C_API rsid_status rsid_remote_gallery_add(rsid_remote_gallery* gallery, const char* user_id,
+                                                   const rsid_faceprints* faceprints);
+
+    /* remove user from its node */
+    RSID_C_API rsid_status rsid_remote_gallery_remove(rsid_remote_gallery* gallery, const char* user_id);
+
+    /* remove all users from all the nodes */
+    RSID_C_API rsid_status rsid_remote_gallery_clear(rsid_remote_gallery* gallery);
+
+    /* number of users in all the nodes */
+    RSID_C_API rsid_status rsid_remote_gallery_size(rsid_remote_gallery* gallery, unsigned int* number_of_users);
+
+    /* as rsid_gallery_match(), matching the best scoring user of all the nodes */
+    RSID_C_API rsid_status rsid_remote_gallery_match(rsid_remote_gallery* gallery,
+                                                     const rsid_faceprints* new_faceprints,
+                                                     rsid_gallery_match_result* result,
+                                                     rsid_faceprints* updated_faceprints);
+
+    /*
+     * Find the k best scoring users (up to 64) for the probe, without updating them, sorted by descending score.
+     * On successfull operation, number_of_results is updated to the number of results written.
+     */
+    RSID_C_API rsid_status rsid_remote_gallery_match_topk(rsid_remote_gallery* gallery,
+                                                          const rsid_faceprints* new_faceprints, unsigned int k,
+                                                          rsid_gallery_match_result* results,
+                                                          unsigned int* number_of_results);
+
+    /* as rsid_authenticate_with_gallery(), against a remote gallery */
+    RSID_C_API rsid_status rsid_authenticate_with_remote_gallery(rsid_authenticator* authenticator,
+                                                                 rsid_remote_gallery* gallery,
+                                                                 rsid_gallery_auth_clbk clbk, void* ctx);
+
 #ifdef __cplusplus
 }
 #endif //__cplusplus
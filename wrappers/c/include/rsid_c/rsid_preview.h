@@ -21,6 +21,7 @@ extern "C"
     {
         int camera_number;
         rsid_preview_mode preview_mode;
+        rsid_preview_quality preview_quality; /* decode of the MJPEG modes */
     } rsid_preview_config;
 
     typedef struct
@@ -71,9 +72,42 @@ extern "C"
     /* stop streaming of images. return 0 on error, 1 on sucess */
     RSID_C_API int rsid_stop_preview(rsid_preview* preview_handle);
 
+    /* keep the camera open and streaming with the frames dropped, so the next start or resume delivers the camera's
+     * next frame (see Preview::StandbyPreview). closed by rsid_stop_preview. return 0 on error, 1 on sucess */
+    RSID_C_API int rsid_standby_preview(rsid_preview* preview_handle);
+
+    /* start streaming of images in mailbox mode, for clients that render at their own rate: no callback, only the
+     * newest frame is kept, to be taken with rsid_preview_acquire_latest (e.g. from the render loop). frames that are
+     * not taken are dropped without being copied. stop with rsid_stop_preview. return 0 on error, 1 on sucess */
+    RSID_C_API int rsid_start_preview_mailbox(rsid_preview* preview_handle);
+
+    /* take the newest frame received since the last call. its buffer stays valid until rsid_preview_release, which
+     * must be called before the preview is destroyed. hold one frame at a time: of the 3 preview buffers one is
+     * decoding and one keeps the newest frame, so frames are dropped while the client holds more.
+     * return 1 if there is a new frame, 0 otherwise */
+    RSID_C_API int rsid_preview_acquire_latest(rsid_preview* preview_handle, rsid_image* image);
+
+    /* release a frame of rsid_preview_acquire_latest. return 0 on error, 1 on sucess */
+    RSID_C_API int rsid_preview_release(rsid_preview* preview_handle, const rsid_image* image);
+
+    /* keep the buffer of an image received in the preview callback valid after the callback returns, so it can be used
+     * without copying. must be called during the callback and matched by rsid_release_preview_image before the preview
+     * is destroyed. return 0 on error, 1 on sucess */
+    RSID_C_API int rsid_acquire_preview_image(rsid_preview* preview_handle, const rsid_image* image);
+
+    /* release an image acquired with rsid_acquire_preview_image, its buffer may be reused for new frames.
+     * return 0 on error, 1 on sucess */
+    RSID_C_API int rsid_release_preview_image(rsid_preview* preview_handle, const rsid_image* image);
+
     /* convert raw to rgb. return 0 on error, 1 on sucess */
     RSID_C_API int rsid_raw_to_rgb(rsid_preview* preview_handle,const rsid_image* in, rsid_image* out);
 
+    /* convert raw to 8 bit grayscale, binning (0 or 1) halves both dimensions. return 0 on error, 1 on sucess */
+    RSID_C_API int rsid_raw_to_gray(rsid_preview* preview_handle, const rsid_image* in, rsid_image* out, int binning);
+
+    /* unpack raw to 16 bit pixels with the full 10 bit values. return 0 on error, 1 on sucess */
+    RSID_C_API int rsid_raw_to_raw16(rsid_preview* preview_handle, const rsid_image* in, rsid_image* out);
+
 #ifdef __cplusplus
 }
 #endif //__cplusplus
@@ -38,9 +38,16 @@ extern "C"
     {
         MJPEG_1080P = 0,
         MJPEG_720P = 1,
-        RAW10_1080P = 2
+        RAW10_1080P = 2,
+        YUY2_720P = 3
     } rsid_preview_mode;
 
+    typedef enum
+    {
+        RSID_PreviewQuality_Full = 0, // default
+        RSID_PreviewQuality_Fast = 1  // faster jpeg decode of lower quality, for on-screen preview
+    } rsid_preview_quality;
+
     typedef enum
     {
         RSID_Ok = 100,
@@ -5,15 +5,25 @@
 #include "RealSenseID/EnrollmentCallback.h"
 #include "RealSenseID/AuthenticationCallback.h"
 #include "RealSenseID/FaceAuthenticator.h"
+#include "RealSenseID/HostGallery.h"
+#include "RealSenseID/RemoteGallery.h"
+#include "RealSenseID/GalleryNode.h"
+#include "RealSenseID/AuthEventQueue.h"
 #include "RealSenseID/DeviceConfig.h"
 #include "RealSenseID/Version.h"
 #include "RealSenseID/Logging.h"
+#include "RealSenseID/Metrics.h"
+#include "RealSenseID/Executor.h"
 #include "RealSenseID/Faceprints.h"
 #include "RealSenseID/UserFaceprints.h"
 #include "RealSenseID/AuthFaceprintsExtractionCallback.h"
 #include "RealSenseID/EnrollFaceprintsExtractionCallback.h"
 #include "rsid_c/rsid_client.h"
 #include <memory>
+#include <mutex>
+#include <vector>
+#include <type_traits>
+#include <cstddef>
 #include <string.h>
 #include <stdexcept>
 
@@ -30,10 +40,10 @@ static const std::string LOG_TAG = "rsid_c_client";
 
 
 // copy FaceRects to give c array of rsid_face_rects and return number the faces copied
-size_t to_c_faces(const std::vector<RealSenseID::FaceRect>& faces, rsid_face_rect target[], size_t target_size)
+size_t to_c_faces(const RealSenseID::FaceRect* faces, size_t n_faces, rsid_face_rect target[], size_t target_size)
 {
     size_t i;
-    for (i = 0; i < faces.size() && i < target_size; i++)
+    for (i = 0; i < n_faces && i < target_size; i++)
     {
         auto& face = faces[i];
         target[i] = {face.x, face.y, face.w, face.h};
@@ -41,15 +51,15 @@ size_t to_c_faces(const std::vector<RealSenseID::FaceRect>& faces, rsid_face_rec
     return i;
 }
 
-// helper to convert the face vector to c array of rsid_face_rect structs and call the c callbeck
-static void handle_face_detected_clbk(rsid_face_detected_clbk user_clbk,
-                                      const std::vector<RealSenseID::FaceRect>& faces, const unsigned int ts, void* ctx)
+// helper to convert the faces to c array of rsid_face_rect structs and call the c callbeck
+static void handle_face_detected_clbk(rsid_face_detected_clbk user_clbk, const RealSenseID::FaceRect* faces,
+                                      const size_t n_faces, const unsigned int ts, void* ctx)
 {
-    if (user_clbk != nullptr && !faces.empty())
+    if (user_clbk != nullptr && n_faces > 0)
     {
         rsid_face_rect c_faces[RSID_MAX_FACES];
-        auto n_faces = to_c_faces(faces, c_faces, RSID_MAX_FACES);
-        user_clbk(c_faces, n_faces, ts, ctx);
+        auto n_c_faces = to_c_faces(faces, n_faces, c_faces, RSID_MAX_FACES);
+        user_clbk(c_faces, n_c_faces, ts, ctx);
     }
 }
 
@@ -80,18 +90,63 @@ public:
             _enroll_args.hint_clbk(static_cast<rsid_enroll_status>(hint), _enroll_args.ctx);
     }
 
-    void OnFaceDetected(const std::vector<RealSenseID::FaceRect>& faces, const unsigned int ts) override
+    void OnFaceDetected(const RealSenseID::FaceRect* faces, const size_t n_faces, const unsigned int ts) override
     {
-        handle_face_detected_clbk(_enroll_args.face_detected_clbk, faces, ts, _enroll_args.ctx);
+        handle_face_detected_clbk(_enroll_args.face_detected_clbk, faces, n_faces, ts, _enroll_args.ctx);
+    }
+};
+
+// the authenticator's timing callback (see rsid_set_timing_clbk), called by the authentication callbacks below
+struct TimingClbk
+{
+    rsid_timing_clbk clbk = nullptr;
+    void* ctx = nullptr;
+
+    void operator()(const RealSenseID::OperationTiming& timing) const
+    {
+        if (clbk == nullptr)
+            return;
+        rsid_operation_timing c_timing;
+        c_timing.session_start_us = timing.session_start_us;
+        c_timing.request_send_us = timing.request_send_us;
+        c_timing.until_face_detected_us = timing.until_face_detected_us;
+        c_timing.until_result_us = timing.until_result_us;
+        c_timing.faceprints_transfer_us = timing.faceprints_transfer_us;
+        c_timing.host_match_us = timing.host_match_us;
+        c_timing.total_us = timing.total_us;
+        clbk(&c_timing, ctx);
+    }
+};
+
+// the timing callback of an authenticator, set while operations may be starting. each operation copies it at its
+// start, so a change applies from the next operation.
+class SharedTimingClbk
+{
+    std::mutex _mutex;
+    TimingClbk _clbk;
+
+public:
+    void Set(rsid_timing_clbk clbk, void* ctx)
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        _clbk.clbk = clbk;
+        _clbk.ctx = ctx;
+    }
+
+    TimingClbk Get()
+    {
+        std::lock_guard<std::mutex> lock {_mutex};
+        return _clbk;
     }
 };
 
 class AuthClbk : public RealSenseID::AuthenticationCallback
 {
     rsid_auth_args _auth_args;
+    TimingClbk _timing_clbk;
 
 public:
-    explicit AuthClbk(rsid_auth_args args) : _auth_args {args}
+    AuthClbk(rsid_auth_args args, const TimingClbk& timing_clbk) : _auth_args {args}, _timing_clbk {timing_clbk}
     {
     }
 
@@ -107,47 +162,62 @@ public:
             _auth_args.hint_clbk(static_cast<rsid_auth_status>(hint), _auth_args.ctx);
     }
 
-    void OnFaceDetected(const std::vector<RealSenseID::FaceRect>& faces, const unsigned int ts) override
+    void OnFaceDetected(const RealSenseID::FaceRect* faces, const size_t n_faces, const unsigned int ts) override
     {
-        handle_face_detected_clbk(_auth_args.face_detected_clbk, faces, ts, _auth_args.ctx);
+        handle_face_detected_clbk(_auth_args.face_detected_clbk, faces, n_faces, ts, _auth_args.ctx);
+    }
+
+    void OnTiming(const RealSenseID::OperationTiming& timing) override
+    {
+        _timing_clbk(timing);
     }
 };
 
-static void copy_to_c_faceprints(const RealSenseID::Faceprints& faceprints, rsid_faceprints* c_faceprints)
+// rsid_faceprints and Faceprints have the same layout, so faceprints are passed between the c api and the library
+// as views, without copying the descriptors.
+static_assert(std::is_standard_layout<Faceprints>::value, "Faceprints must be standard layout");
+static_assert(sizeof(rsid_faceprints) == sizeof(Faceprints), "faceprints sizes does not match");
+static_assert(offsetof(rsid_faceprints, reserved) == offsetof(Faceprints, reserved), "reserved offsets does not match");
+static_assert(offsetof(rsid_faceprints, version) == offsetof(Faceprints, version), "version offsets does not match");
+static_assert(offsetof(rsid_faceprints, featuresType) == offsetof(Faceprints, featuresType),
+              "featuresType offsets does not match");
+static_assert(sizeof(rsid_faceprints::featuresType) == sizeof(Faceprints::featuresType),
+              "featuresType sizes does not match");
+static_assert(offsetof(rsid_faceprints, flags) == offsetof(Faceprints, flags), "flags offsets does not match");
+static_assert(offsetof(rsid_faceprints, adaptive_without_mask_descriptor) ==
+                  offsetof(Faceprints, adaptiveDescriptorWithoutMask),
+              "adaptive faceprints (without mask) offsets does not match");
+static_assert(offsetof(rsid_faceprints, adaptive_with_mask_descriptor) ==
+                  offsetof(Faceprints, adaptiveDescriptorWithMask),
+              "adaptive faceprints (with mask) offsets does not match");
+static_assert(offsetof(rsid_faceprints, enrollement_descriptor) == offsetof(Faceprints, enrollmentDescriptor),
+              "enrollment faceprints offsets does not match");
+static_assert(sizeof(rsid_faceprints::enrollement_descriptor) == sizeof(Faceprints::enrollmentDescriptor),
+              "enrollment faceprints sizes does not match");
+
+static const rsid_faceprints* as_c_faceprints(const Faceprints* faceprints)
 {
-    c_faceprints->version = faceprints.version;
-    c_faceprints->featuresType = (FaceprintsTypeEnum)faceprints.featuresType;
-
-    static_assert(sizeof(c_faceprints->adaptive_without_mask_descriptor) == sizeof(faceprints.adaptiveDescriptorWithoutMask), "adaptive faceprints (without mask) sizes does not match");
-    ::memcpy(c_faceprints->adaptive_without_mask_descriptor, faceprints.adaptiveDescriptorWithoutMask, sizeof(faceprints.adaptiveDescriptorWithoutMask));
-
-    static_assert(sizeof(c_faceprints->adaptive_with_mask_descriptor) == sizeof(faceprints.adaptiveDescriptorWithMask), "adaptive faceprints (with mask) sizes does not match");
-    ::memcpy(c_faceprints->adaptive_with_mask_descriptor, faceprints.adaptiveDescriptorWithMask, sizeof(faceprints.adaptiveDescriptorWithMask));
-
-    static_assert(sizeof(c_faceprints->enrollement_descriptor) == sizeof(faceprints.enrollmentDescriptor), "enrollment faceprints sizes does not match");
-    ::memcpy(c_faceprints->enrollement_descriptor, faceprints.enrollmentDescriptor, sizeof(faceprints.enrollmentDescriptor));
+    return reinterpret_cast<const rsid_faceprints*>(faceprints);
 }
 
-static void copy_to_cpp_faceprints(const rsid_faceprints* c_faceprints, RealSenseID::Faceprints& faceprints)
+static Faceprints* as_cpp_faceprints(rsid_faceprints* c_faceprints)
 {
-    faceprints.version = c_faceprints->version;
-
-    static_assert(sizeof(c_faceprints->adaptive_without_mask_descriptor) == sizeof(faceprints.adaptiveDescriptorWithoutMask), "adaptive faceprints sizes (without mask) does not match");
-    ::memcpy(faceprints.adaptiveDescriptorWithoutMask, c_faceprints->adaptive_without_mask_descriptor, sizeof(c_faceprints->adaptive_without_mask_descriptor));
-
-    static_assert(sizeof(c_faceprints->adaptive_with_mask_descriptor) == sizeof(faceprints.adaptiveDescriptorWithMask), "adaptive faceprints sizes (with mask) does not match");
-    ::memcpy(faceprints.adaptiveDescriptorWithMask, c_faceprints->adaptive_with_mask_descriptor, sizeof(c_faceprints->adaptive_with_mask_descriptor));
+    return reinterpret_cast<Faceprints*>(c_faceprints);
+}
 
-    static_assert(sizeof(c_faceprints->enrollement_descriptor) == sizeof(faceprints.enrollmentDescriptor), "enrollment faceprints sizes does not match");
-    ::memcpy(faceprints.enrollmentDescriptor, c_faceprints->enrollement_descriptor, sizeof(c_faceprints->enrollement_descriptor));
+static const Faceprints* as_cpp_faceprints(const rsid_faceprints* c_faceprints)
+{
+    return reinterpret_cast<const Faceprints*>(c_faceprints);
 }
 
 class AuthFaceprintsExtClbk : public RealSenseID::AuthFaceprintsExtractionCallback
 {
     rsid_faceprints_ext_args _faceprints_ext_args;
+    TimingClbk _timing_clbk;
 
 public:
-    explicit AuthFaceprintsExtClbk(rsid_faceprints_ext_args args) : _faceprints_ext_args {args}
+    AuthFaceprintsExtClbk(rsid_faceprints_ext_args args, const TimingClbk& timing_clbk) :
+        _faceprints_ext_args {args}, _timing_clbk {timing_clbk}
     {
     }
 
@@ -155,12 +225,9 @@ public:
     {
         if (_faceprints_ext_args.result_clbk)
         {
-            rsid_faceprints c_faceprints;
-
             if (status == RealSenseID::AuthenticateStatus::Success)
             {
-                copy_to_c_faceprints(*faceprints, &c_faceprints);
-                _faceprints_ext_args.result_clbk(static_cast<rsid_auth_status>(status), &c_faceprints,
+                _faceprints_ext_args.result_clbk(static_cast<rsid_auth_status>(status), as_c_faceprints(faceprints),
                                                  _faceprints_ext_args.ctx);
             }
             else
@@ -175,19 +242,27 @@ public:
             _faceprints_ext_args.hint_clbk(static_cast<rsid_auth_status>(hint), _faceprints_ext_args.ctx);
     }
 
-    void OnFaceDetected(const std::vector<RealSenseID::FaceRect>& faces, const unsigned int ts) override
+    void OnFaceDetected(const RealSenseID::FaceRect* faces, const size_t n_faces, const unsigned int ts) override
     {
-        handle_face_detected_clbk(_faceprints_ext_args.face_detected_clbk, faces, ts, _faceprints_ext_args.ctx);
+        handle_face_detected_clbk(_faceprints_ext_args.face_detected_clbk, faces, n_faces, ts,
+                                  _faceprints_ext_args.ctx);
+    }
+
+    void OnTiming(const RealSenseID::OperationTiming& timing) override
+    {
+        _timing_clbk(timing);
     }
 };
 
 class AuthLoopFaceprintsExtClbk : public RealSenseID::AuthFaceprintsExtractionCallback
 {
     rsid_faceprints_ext_args _faceprints_ext_args;
+    TimingClbk _timing_clbk;
     Faceprints _faceprints;
 
 public:
-    explicit AuthLoopFaceprintsExtClbk(rsid_faceprints_ext_args args) : _faceprints_ext_args {args}
+    AuthLoopFaceprintsExtClbk(rsid_faceprints_ext_args args, const TimingClbk& timing_clbk) :
+        _faceprints_ext_args {args}, _timing_clbk {timing_clbk}
     {
     }
 
@@ -195,12 +270,9 @@ public:
     {
         if (_faceprints_ext_args.result_clbk)
         {
-            rsid_faceprints c_faceprints;
-
             if (status == RealSenseID::AuthenticateStatus::Success)
             {
-                copy_to_c_faceprints(*faceprints, &c_faceprints);
-                _faceprints_ext_args.result_clbk(static_cast<rsid_auth_status>(status), &c_faceprints,
+                _faceprints_ext_args.result_clbk(static_cast<rsid_auth_status>(status), as_c_faceprints(faceprints),
                                                  _faceprints_ext_args.ctx);
             }
             else
@@ -215,9 +287,15 @@ public:
             _faceprints_ext_args.hint_clbk(static_cast<rsid_auth_status>(hint), _faceprints_ext_args.ctx);
     }
 
-    void OnFaceDetected(const std::vector<RealSenseID::FaceRect>& faces, const unsigned int ts) override
+    void OnFaceDetected(const RealSenseID::FaceRect* faces, const size_t n_faces, const unsigned int ts) override
     {
-        handle_face_detected_clbk(_faceprints_ext_args.face_detected_clbk, faces, ts, _faceprints_ext_args.ctx);
+        handle_face_detected_clbk(_faceprints_ext_args.face_detected_clbk, faces, n_faces, ts,
+                                  _faceprints_ext_args.ctx);
+    }
+
+    void OnTiming(const RealSenseID::OperationTiming& timing) override
+    {
+        _timing_clbk(timing);
     }
 };
 
@@ -234,12 +312,9 @@ public:
     {
         if (_enroll_ext_args.status_clbk)
         {
-            rsid_faceprints c_faceprints;
-
             if (status == RealSenseID::EnrollStatus::Success)
             {
-                copy_to_c_faceprints(*faceprints, &c_faceprints);
-                _enroll_ext_args.status_clbk(static_cast<rsid_enroll_status>(status), &c_faceprints,
+                _enroll_ext_args.status_clbk(static_cast<rsid_enroll_status>(status), as_c_faceprints(faceprints),
                                              _enroll_ext_args.ctx);
             }
             else
@@ -259,12 +334,84 @@ public:
             _enroll_ext_args.hint_clbk(static_cast<rsid_enroll_status>(hint), _enroll_ext_args.ctx);
     }
 
-    void OnFaceDetected(const std::vector<RealSenseID::FaceRect>& faces, const unsigned int ts) override
+    void OnFaceDetected(const RealSenseID::FaceRect* faces, const size_t n_faces, const unsigned int ts) override
+    {
+        handle_face_detected_clbk(_enroll_ext_args.face_detected_clbk, faces, n_faces, ts, _enroll_ext_args.ctx);
+    }
+};
+
+// faceprints extraction with the duplicate check - keeps the duplicate for the caller
+class EnrollFaceprintsDedupeClbk : public EnrollFaceprintsExtClbk
+{
+public:
+    RealSenseID::HostGalleryMatch duplicate;
+
+    explicit EnrollFaceprintsDedupeClbk(rsid_enroll_ext_args args) : EnrollFaceprintsExtClbk {args}
+    {
+    }
+
+    using EnrollFaceprintsExtClbk::OnResult;
+
+    void OnResult(const RealSenseID::EnrollStatus status, const Faceprints* faceprints,
+                  const RealSenseID::HostGalleryMatch* duplicate_user) override
+    {
+        if (duplicate_user != nullptr)
+        {
+            duplicate = *duplicate_user;
+        }
+        OnResult(status, faceprints);
+    }
+};
+
+// user ids listing callback - hands each id to the user's callback
+class UserIdsClbk : public RealSenseID::UserIdsCallback
+{
+    rsid_user_id_clbk _user_clbk;
+    void* _ctx;
+
+public:
+    UserIdsClbk(rsid_user_id_clbk clbk, void* ctx) : _user_clbk {clbk}, _ctx {ctx}
+    {
+    }
+
+    void OnUserId(const unsigned int user_index, const char* user_id) override
+    {
+        _user_clbk(user_index, user_id, _ctx);
+    }
+};
+
+class UsersExportClbk : public RealSenseID::UsersExportCallback
+{
+    rsid_user_export_clbk _user_clbk;
+    void* _ctx;
+
+public:
+    UsersExportClbk(rsid_user_export_clbk clbk, void* ctx) : _user_clbk {clbk}, _ctx {ctx}
+    {
+    }
+
+    void OnUser(const unsigned int user_index, const char* user_id, const Faceprints& faceprints) override
     {
-        handle_face_detected_clbk(_enroll_ext_args.face_detected_clbk, faces, ts, _enroll_ext_args.ctx);
+        _user_clbk(user_index, user_id, as_c_faceprints(&faceprints), _ctx);
     }
 };
 
+static RealSenseID::UsersCursor as_cpp_cursor(const rsid_users_cursor* cursor)
+{
+    RealSenseID::UsersCursor users_cursor;
+    users_cursor.next_index = cursor->next_index;
+    users_cursor.number_of_users = cursor->number_of_users;
+    users_cursor.done = cursor->done != 0;
+    return users_cursor;
+}
+
+static void set_c_cursor(const RealSenseID::UsersCursor& users_cursor, rsid_users_cursor* cursor)
+{
+    cursor->next_index = users_cursor.next_index;
+    cursor->number_of_users = users_cursor.number_of_users;
+    cursor->done = users_cursor.done ? 1 : 0;
+}
+
 // Signature callbacks - called by the lib to sign outcoming messaages to the device,
 // and to verify incoming messages from the device.
 class WrapperSignatureClbk : public RealSenseID::SignatureCallback
@@ -306,6 +453,8 @@ class SecureAuthContext
     std::unique_ptr<RealSenseID::FaceAuthenticator> _authenticator;
 
 public:
+    SharedTimingClbk timing_clbk;
+
     SecureAuthContext(rsid_signature_clbk* clbk) :
         _signature_callback {std::make_unique<WrapperSignatureClbk>(clbk)},
         _authenticator {std::make_unique<RealSenseID::FaceAuthenticator>(_signature_callback.get())}
@@ -331,6 +480,8 @@ class AuthContext
     std::unique_ptr<RealSenseID::FaceAuthenticator> _authenticator;
 
 public:
+    SharedTimingClbk timing_clbk;
+
     AuthContext() : _authenticator {std::make_unique<RealSenseID::FaceAuthenticator>()}
     {
     }
@@ -369,6 +520,11 @@ RealSenseID::FaceAuthenticator* get_auth_impl(rsid_authenticator* authenticator)
     auto* auth_ctx = static_cast<auth_context_t*>(authenticator->_impl);
     return auth_ctx->authenticator();
 }
+
+TimingClbk get_timing_clbk(rsid_authenticator* authenticator)
+{
+    return static_cast<auth_context_t*>(authenticator->_impl)->timing_clbk.Get();
+}
 } // namespace
 
 #ifdef RSID_SECURE
@@ -517,31 +673,15 @@ rsid_status rsid_enroll(rsid_authenticator* authenticator, const rsid_enroll_arg
 rsid_status rsid_authenticate(rsid_authenticator* authenticator, const rsid_auth_args* args)
 {
     auto* auth_impl = get_auth_impl(authenticator);
-    AuthClbk authCallback(*args);
+    AuthClbk authCallback(*args, get_timing_clbk(authenticator));
     auto status = auth_impl->Authenticate(authCallback);
     return static_cast<rsid_status>(status);
 }
 
-
-static RealSenseID::Faceprints convert_to_cpp_faceprints(rsid_faceprints* rsid_faceprints_instance)
+void rsid_set_timing_clbk(rsid_authenticator* authenticator, rsid_timing_clbk clbk, void* ctx)
 {
-    RealSenseID::Faceprints faceprints;
-    faceprints.version = rsid_faceprints_instance->version;
-    faceprints.featuresType = (RealSenseID::FaceprintsTypeEnum)rsid_faceprints_instance->featuresType;
-
-    static_assert(sizeof(faceprints.adaptiveDescriptorWithoutMask) == sizeof(rsid_faceprints_instance->adaptive_without_mask_descriptor), "updated faceprints (without mask) sizes does not match");
-    ::memcpy(&faceprints.adaptiveDescriptorWithoutMask[0], &rsid_faceprints_instance->adaptive_without_mask_descriptor[0],
-             sizeof(faceprints.adaptiveDescriptorWithoutMask));
-
-    static_assert(sizeof(faceprints.adaptiveDescriptorWithMask) == sizeof(rsid_faceprints_instance->adaptive_with_mask_descriptor), "updated faceprints (with mask) sizes does not match");
-    ::memcpy(&faceprints.adaptiveDescriptorWithMask[0], &rsid_faceprints_instance->adaptive_with_mask_descriptor[0],
-             sizeof(faceprints.adaptiveDescriptorWithMask));
-
-    static_assert(sizeof(faceprints.enrollmentDescriptor) == sizeof(rsid_faceprints_instance->enrollement_descriptor), "enrollment faceprints sizes does not match");
-    ::memcpy(&faceprints.enrollmentDescriptor[0], &rsid_faceprints_instance->enrollement_descriptor[0],
-             sizeof(faceprints.enrollmentDescriptor));
-
-    return faceprints;
+    auto* auth_ctx = static_cast<auth_context_t*>(authenticator->_impl);
+    auth_ctx->timing_clbk.Set(clbk, ctx);
 }
 
 rsid_status rsid_extract_faceprints_for_enroll(rsid_authenticator* authenticator, rsid_enroll_ext_args* args)
@@ -555,7 +695,7 @@ rsid_status rsid_extract_faceprints_for_enroll(rsid_authenticator* authenticator
 rsid_status rsid_extract_faceprints_for_auth(rsid_authenticator* authenticator, rsid_faceprints_ext_args* args)
 {
     auto* auth_impl = get_auth_impl(authenticator);
-    AuthFaceprintsExtClbk auth_callback(*args);
+    AuthFaceprintsExtClbk auth_callback(*args, get_timing_clbk(authenticator));
     auto status = auth_impl->ExtractFaceprintsForAuth(auth_callback);
     // TODO: verify why the average faceprint is a bit different compared to the one in FAImpl
     return static_cast<rsid_status>(status);
@@ -564,7 +704,7 @@ rsid_status rsid_extract_faceprints_for_auth(rsid_authenticator* authenticator,
 rsid_status rsid_extract_faceprints_for_auth_loop(rsid_authenticator* authenticator, rsid_faceprints_ext_args* args)
 {
     auto* auth_impl = get_auth_impl(authenticator);
-    AuthLoopFaceprintsExtClbk auth_callback(*args);
+    AuthLoopFaceprintsExtClbk auth_callback(*args, get_timing_clbk(authenticator));
     auto status = auth_impl->ExtractFaceprintsForAuthLoop(auth_callback);
     return static_cast<rsid_status>(status);
 }
@@ -573,11 +713,11 @@ rsid_match_result rsid_match_faceprints(rsid_authenticator* authenticator, rsid_
 {
     auto* auth_impl = get_auth_impl(authenticator);
 
-    Faceprints new_faceprints = convert_to_cpp_faceprints(&args->new_faceprints);
-    Faceprints existing_faceprints = convert_to_cpp_faceprints(&args->existing_faceprints);
-    Faceprints updated_faceprints = convert_to_cpp_faceprints(&args->updated_faceprints);
-
-    auto result = auth_impl->MatchFaceprints(new_faceprints, existing_faceprints, updated_faceprints);
+    // the probe and the stored faceprints are matched in place. the updated faceprints are built by the matcher only
+    // when an update is due, so they are not read from args
+    Faceprints updated_faceprints;
+    auto result = auth_impl->MatchFaceprints(*as_cpp_faceprints(&args->new_faceprints),
+                                             *as_cpp_faceprints(&args->existing_faceprints), updated_faceprints);
 
     rsid_match_result match_result;
     match_result.should_update = result.should_update;
@@ -589,28 +729,590 @@ rsid_match_result rsid_match_faceprints(rsid_authenticator* authenticator, rsid_
     if (result.success && result.should_update)
     {
         // write the updated avg faceprints on the args->updated_faceprints so Authenticator.cs will have the updated vector!
-        rsid_faceprints* rsid_updated_faceprints = &args->updated_faceprints;
+        Faceprints* target = as_cpp_faceprints(&args->updated_faceprints);
 
         // TODO yossidan - handle with/without mask vectors properly (if/as needed).
-        
-        static_assert(sizeof(rsid_updated_faceprints->adaptive_without_mask_descriptor) == sizeof(updated_faceprints.adaptiveDescriptorWithoutMask),"adaptive faceprints (without mask) sizes does not match");
-        ::memcpy(&rsid_updated_faceprints->adaptive_without_mask_descriptor[0], &updated_faceprints.adaptiveDescriptorWithoutMask[0], sizeof(updated_faceprints.adaptiveDescriptorWithoutMask));
-        
-        static_assert(sizeof(rsid_updated_faceprints->enrollement_descriptor) == sizeof(updated_faceprints.enrollmentDescriptor),"enrollment faceprints sizes does not match");
-        ::memcpy(&rsid_updated_faceprints->enrollement_descriptor[0], &updated_faceprints.enrollmentDescriptor[0], sizeof(updated_faceprints.enrollmentDescriptor));
+        ::memcpy(target->adaptiveDescriptorWithoutMask, updated_faceprints.adaptiveDescriptorWithoutMask,
+                 sizeof(updated_faceprints.adaptiveDescriptorWithoutMask));
+        ::memcpy(target->enrollmentDescriptor, updated_faceprints.enrollmentDescriptor,
+                 sizeof(updated_faceprints.enrollmentDescriptor));
     }
 
     return match_result;
 }
 
+static RealSenseID::HostGallery* get_gallery_impl(rsid_gallery* gallery)
+{
+    return static_cast<RealSenseID::HostGallery*>(gallery->_impl);
+}
+
+static void to_c_gallery_match(const RealSenseID::HostGalleryMatch& gallery_match, rsid_gallery_match_result* result)
+{
+    result->match_result.success = gallery_match.result.success;
+    result->match_result.should_update = gallery_match.result.should_update;
+    result->match_result.score = (int)gallery_match.result.score;
+    result->match_result.confidence = (int)gallery_match.result.confidence;
+    static_assert(sizeof(result->user_id) == sizeof(gallery_match.user_id), "user id sizes does not match");
+    ::memcpy(result->user_id, gallery_match.user_id, sizeof(result->user_id));
+}
+
+rsid_gallery* rsid_create_gallery()
+{
+    return rsid_create_gallery_with_threads(1);
+}
+
+rsid_gallery* rsid_create_gallery_with_threads(unsigned int search_threads)
+{
+    try
+    {
+        auto* rv = new rsid_gallery();
+        rv->_impl = static_cast<void*>(new RealSenseID::HostGallery(search_threads));
+        return rv;
+    }
+    catch (...)
+    {
+        return nullptr;
+    }
+}
+
+rsid_gallery* rsid_create_tiered_gallery(unsigned int search_threads, unsigned int hot_users)
+{
+    try
+    {
+        auto* rv = new rsid_gallery();
+        rv->_impl = static_cast<void*>(new RealSenseID::HostGallery(search_threads, hot_users));
+        return rv;
+    }
+    catch (...)
+    {
+        return nullptr;
+    }
+}
+
+void rsid_destroy_gallery(rsid_gallery* gallery)
+{
+    if (gallery == nullptr)
+    {
+        return;
+    }
+    try
+    {
+        delete get_gallery_impl(gallery);
+        delete gallery;
+    }
+    catch (...)
+    {
+    }
+}
+
+rsid_status rsid_gallery_add(rsid_gallery* gallery, const char* user_id, const rsid_faceprints* faceprints)
+{
+    if (faceprints == nullptr)
+    {
+        return RSID_Error;
+    }
+    auto status = get_gallery_impl(gallery)->Add(user_id, *as_cpp_faceprints(faceprints));
+    return static_cast<rsid_status>(status);
+}
+
+rsid_status rsid_gallery_remove(rsid_gallery* gallery, const char* user_id)
+{
+    return static_cast<rsid_status>(get_gallery_impl(gallery)->Remove(user_id));
+}
+
+void rsid_gallery_clear(rsid_gallery* gallery)
+{
+    get_gallery_impl(gallery)->Clear();
+}
+
+unsigned int rsid_gallery_size(rsid_gallery* gallery)
+{
+    return static_cast<unsigned int>(get_gallery_impl(gallery)->Size());
+}
+
+rsid_status rsid_gallery_save(rsid_gallery* gallery, const char* path)
+{
+    return static_cast<rsid_status>(get_gallery_impl(gallery)->Save(path));
+}
+
+rsid_status rsid_gallery_load(rsid_gallery* gallery, const char* path)
+{
+    return static_cast<rsid_status>(get_gallery_impl(gallery)->Load(path));
+}
+
+rsid_status rsid_gallery_load_users(rsid_gallery* gallery, const char* const* user_ids,
+                                    const rsid_faceprints* faceprints, unsigned int number_of_users,
+                                    unsigned int* number_loaded)
+{
+    size_t loaded = 0;
+    auto status = get_gallery_impl(gallery)->Load(user_ids, as_cpp_faceprints(faceprints), number_of_users, loaded);
+    if (number_loaded != nullptr)
+    {
+        *number_loaded = static_cast<unsigned int>(loaded);
+    }
+    return static_cast<rsid_status>(status);
+}
+
+void rsid_gallery_set_recent_first(rsid_gallery* gallery, unsigned int recent_users)
+{
+    get_gallery_impl(gallery)->SetRecentUsersFirst(recent_users);
+}
+
+rsid_status rsid_gallery_match(rsid_gallery* gallery, const rsid_faceprints* new_faceprints,
+                               rsid_gallery_match_result* result, rsid_faceprints* updated_faceprints)
+{
+    if (new_faceprints == nullptr || result == nullptr)
+    {
+        return RSID_Error;
+    }
+
+    // the matcher writes the updated faceprints only when an update is due, so a caller's buffer is used as is
+    Faceprints local_updated;
+    Faceprints* updated = updated_faceprints ? as_cpp_faceprints(updated_faceprints) : &local_updated;
+    auto gallery_match = get_gallery_impl(gallery)->Match(*as_cpp_faceprints(new_faceprints), *updated);
+    to_c_gallery_match(gallery_match, result);
+    return RSID_Ok;
+}
+
+rsid_status rsid_gallery_find_user(rsid_gallery* gallery, const rsid_faceprints* faceprints,
+                                   rsid_gallery_match_result* result)
+{
+    if (faceprints == nullptr || result == nullptr)
+    {
+        return RSID_Error;
+    }
+    to_c_gallery_match(get_gallery_impl(gallery)->FindUser(*as_cpp_faceprints(faceprints)), result);
+    return RSID_Ok;
+}
+
+rsid_status rsid_gallery_set_user_groups(rsid_gallery* gallery, const char* user_id, unsigned long long access_groups)
+{
+    return static_cast<rsid_status>(get_gallery_impl(gallery)->SetUserGroups(user_id, access_groups));
+}
+
+rsid_status rsid_gallery_match_groups(rsid_gallery* gallery, const rsid_faceprints* new_faceprints,
+                                      unsigned long long access_groups, rsid_gallery_match_result* result,
+                                      rsid_faceprints* updated_faceprints)
+{
+    if (new_faceprints == nullptr || result == nullptr)
+    {
+        return RSID_Error;
+    }
+
+    Faceprints local_updated;
+    Faceprints* updated = updated_faceprints ? as_cpp_faceprints(updated_faceprints) : &local_updated;
+    auto gallery_match = get_gallery_impl(gallery)->Match(*as_cpp_faceprints(new_faceprints), access_groups, *updated);
+    to_c_gallery_match(gallery_match, result);
+    return RSID_Ok;
+}
+
+rsid_status rsid_gallery_match_batch(rsid_gallery* gallery, const rsid_faceprints* new_faceprints,
+                                     unsigned int number_of_probes, rsid_gallery_match_result* results,
+                                     rsid_faceprints* updated_faceprints)
+{
+    if (new_faceprints == nullptr || results == nullptr)
+    {
+        return RSID_Error;
+    }
+
+    std::vector<RealSenseID::HostGalleryMatch> gallery_matches(number_of_probes);
+    std::vector<Faceprints> local_updated;
+    Faceprints* updated = nullptr;
+    if (updated_faceprints)
+    {
+        updated = as_cpp_faceprints(updated_faceprints);
+    }
+    else
+    {
+        local_updated.resize(number_of_probes);
+        updated = local_updated.data();
+    }
+
+    auto status = get_gallery_impl(gallery)->MatchBatch(as_cpp_faceprints(new_faceprints), number_of_probes,
+                                                        gallery_matches.data(), updated);
+    for (unsigned int i = 0; i < number_of_probes; i++)
+    {
+        to_c_gallery_match(gallery_matches[i], &results[i]);
+    }
+    return static_cast<rsid_status>(status);
+}
+
+// converts the results of a frame to the c results and calls the c callback
+class GalleryAuthClbk : public RealSenseID::GalleryAuthCallback
+{
+    rsid_gallery_auth_clbk _user_clbk;
+    void* _ctx;
+    TimingClbk _timing_clbk;
+
+public:
+    GalleryAuthClbk(rsid_gallery_auth_clbk clbk, void* ctx, const TimingClbk& timing_clbk) :
+        _user_clbk {clbk}, _ctx {ctx}, _timing_clbk {timing_clbk}
+    {
+    }
+
+    void OnResult(const RealSenseID::GalleryFaceResult* results, const size_t n_results, const unsigned int ts) override
+    {
+        rsid_gallery_face_result c_results[RSID_MAX_FACES];
+        size_t i;
+        for (i = 0; i < n_results && i < RSID_MAX_FACES; i++)
+        {
+            const auto& result = results[i];
+            c_results[i].face = {result.face.x, result.face.y, result.face.w, result.face.h};
+            c_results[i].status = static_cast<rsid_auth_status>(result.status);
+            to_c_gallery_match(result.match, &c_results[i].match);
+            c_results[i].updated_faceprints = as_c_faceprints(result.updated_faceprints);
+        }
+        _user_clbk(c_results, static_cast<unsigned int>(i), ts, _ctx);
+    }
+
+    void OnTiming(const RealSenseID::OperationTiming& timing) override
+    {
+        _timing_clbk(timing);
+    }
+};
+
+rsid_status rsid_authenticate_with_gallery(rsid_authenticator* authenticator, rsid_gallery* gallery,
+                                           rsid_gallery_auth_clbk clbk, void* ctx)
+{
+    if (gallery == nullptr || clbk == nullptr)
+    {
+        return RSID_Error;
+    }
+    auto* auth_impl = get_auth_impl(authenticator);
+    GalleryAuthClbk gallery_clbk {clbk, ctx, get_timing_clbk(authenticator)};
+    return static_cast<rsid_status>(auth_impl->AuthenticateWithGallery(*get_gallery_impl(gallery), gallery_clbk));
+}
+
+rsid_status rsid_extract_faceprints_for_enroll_with_gallery(rsid_authenticator* authenticator, rsid_gallery* gallery,
+                                                            rsid_enroll_ext_args* args,
+                                                            rsid_gallery_match_result* duplicate)
+{
+    if (gallery == nullptr || duplicate == nullptr)
+    {
+        return RSID_Error;
+    }
+    auto* auth_impl = get_auth_impl(authenticator);
+    EnrollFaceprintsDedupeClbk enroll_callback(*args);
+    auto status = auth_impl->ExtractFaceprintsForEnroll(*get_gallery_impl(gallery), enroll_callback);
+    to_c_gallery_match(enroll_callback.duplicate, duplicate);
+    return static_cast<rsid_status>(status);
+}
+
+static_assert(RSID_GALLERY_MAX_MESSAGE_SIZE == RealSenseID::GalleryTransport::MaxMessageSize, "message size mismatch");
+
+static RealSenseID::GalleryNode* get_gallery_node_impl(rsid_gallery_node* node)
+{
+    return static_cast<RealSenseID::GalleryNode*>(node->_impl);
+}
+
+rsid_gallery_node* rsid_create_gallery_node()
+{
+    try
+    {
+        auto* rv = new rsid_gallery_node();
+        rv->_impl = static_cast<void*>(new RealSenseID::GalleryNode());
+        return rv;
+    }
+    catch (...)
+    {
+        return nullptr;
+    }
+}
+
+void rsid_destroy_gallery_node(rsid_gallery_node* node)
+{
+    if (node == nullptr)
+    {
+        return;
+    }
+    try
+    {
+        delete get_gallery_node_impl(node);
+        delete node;
+    }
+    catch (...)
+    {
+    }
+}
+
+rsid_status rsid_gallery_node_handle_request(rsid_gallery_node* node, const unsigned char* request,
+                                             unsigned int request_size, unsigned char* reply,
+                                             unsigned int* reply_size)
+{
+    if (reply_size == nullptr)
+    {
+        return RSID_Error;
+    }
+    size_t size = 0;
+    auto status = get_gallery_node_impl(node)->HandleRequest(request, request_size, reply, size);
+    *reply_size = static_cast<unsigned int>(size);
+    return static_cast<rsid_status>(status);
+}
+
+unsigned int rsid_gallery_node_size(rsid_gallery_node* node)
+{
+    return static_cast<unsigned int>(get_gallery_node_impl(node)->Size());
+}
+
+rsid_status rsid_gallery_node_save(rsid_gallery_node* node, const char* path)
+{
+    return static_cast<rsid_status>(get_gallery_node_impl(node)->Save(path));
+}
+
+rsid_status rsid_gallery_node_load(rsid_gallery_node* node, const char* path)
+{
+    return static_cast<rsid_status>(get_gallery_node_impl(node)->Load(path));
+}
+
+// calls the c transport callback
+class GalleryTransportClbk : public RealSenseID::GalleryTransport
+{
+    rsid_gallery_transport _transport;
+
+public:
+    explicit GalleryTransportClbk(const rsid_gallery_transport& transport) : _transport {transport}
+    {
+    }
+
+    RealSenseID::Status Call(const unsigned char* request, size_t request_size, unsigned char* reply,
+                             size_t& reply_size) override
+    {
+        unsigned int size = 0;
+        auto status = _transport.clbk(request, static_cast<unsigned int>(request_size), reply, &size, _transport.ctx);
+        reply_size = size;
+        return static_cast<RealSenseID::Status>(status);
+    }
+};
+
+// remote gallery with the adapters of its c transports
+struct RemoteGalleryWithTransports
+{
+    std::vector<std::unique_ptr<GalleryTransportClbk>> transports;
+    std::unique_ptr<RealSenseID::RemoteGallery> gallery;
+};
+
+static RealSenseID::RemoteGallery* get_remote_gallery_impl(rsid_remote_gallery* gallery)
+{
+    return static_cast<RemoteGalleryWithTransports*>(gallery->_impl)->gallery.get();
+}
+
+rsid_remote_gallery* rsid_create_remote_gallery(const rsid_gallery_transport* nodes, unsigned int number_of_nodes)
+{
+    if (nodes == nullptr || number_of_nodes == 0)
+    {
+        return nullptr;
+    }
+    try
+    {
+        std::unique_ptr<RemoteGalleryWithTransports> impl {new RemoteGalleryWithTransports()};
+        std::vector<RealSenseID::GalleryTransport*> transports;
+        for (unsigned int i = 0; i < number_of_nodes; i++)
+        {
+            if (nodes[i].clbk == nullptr)
+            {
+                return nullptr;
+            }
+            impl->transports.emplace_back(new GalleryTransportClbk(nodes[i]));
+            transports.push_back(impl->transports.back().get());
+        }
+        impl->gallery.reset(new RealSenseID::RemoteGallery(transports.data(), transports.size()));
+        auto* rv = new rsid_remote_gallery();
+        rv->_impl = static_cast<void*>(impl.release());
+        return rv;
+    }
+    catch (...)
+    {
+        return nullptr;
+    }
+}
+
+void rsid_destroy_remote_gallery(rsid_remote_gallery* gallery)
+{
+    if (gallery == nullptr)
+    {
+        return;
+    }
+    try
+    {
+        delete static_cast<RemoteGalleryWithTransports*>(gallery->_impl);
+        delete gallery;
+    }
+    catch (...)
+    {
+    }
+}
+
+rsid_status rsid_remote_gallery_add(rsid_remote_gallery* gallery, const char* user_id,
+                                    const rsid_faceprints* faceprints)
+{
+    if (faceprints == nullptr)
+    {
+        return RSID_Error;
+    }
+    auto status = get_remote_gallery_impl(gallery)->Add(user_id, *as_cpp_faceprints(faceprints));
+    return static_cast<rsid_status>(status);
+}
+
+rsid_status rsid_remote_gallery_remove(rsid_remote_gallery* gallery, const char* user_id)
+{
+    return static_cast<rsid_status>(get_remote_gallery_impl(gallery)->Remove(user_id));
+}
+
+rsid_status rsid_remote_gallery_clear(rsid_remote_gallery* gallery)
+{
+    return static_cast<rsid_status>(get_remote_gallery_impl(gallery)->Clear());
+}
+
+rsid_status rsid_remote_gallery_size(rsid_remote_gallery* gallery, unsigned int* number_of_users)
+{
+    if (number_of_users == nullptr)
+    {
+        return RSID_Error;
+    }
+    size_t size = 0;
+    auto status = get_remote_gallery_impl(gallery)->QuerySize(size);
+    *number_of_users = static_cast<unsigned int>(size);
+    return static_cast<rsid_status>(status);
+}
+
+rsid_status rsid_remote_gallery_match(rsid_remote_gallery* gallery, const rsid_faceprints* new_faceprints,
+                                      rsid_gallery_match_result* result, rsid_faceprints* updated_faceprints)
+{
+    if (new_faceprints == nullptr || result == nullptr)
+    {
+        return RSID_Error;
+    }
+
+    Faceprints local_updated;
+    Faceprints* updated = updated_faceprints ? as_cpp_faceprints(updated_faceprints) : &local_updated;
+    RealSenseID::HostGalleryMatch gallery_match;
+    auto status = get_remote_gallery_impl(gallery)->MatchBatch(as_cpp_faceprints(new_faceprints), 1, &gallery_match,
+                                                               updated);
+    to_c_gallery_match(gallery_match, result);
+    return static_cast<rsid_status>(status);
+}
+
+rsid_status rsid_remote_gallery_match_topk(rsid_remote_gallery* gallery, const rsid_faceprints* new_faceprints,
+                                           unsigned int k, rsid_gallery_match_result* results,
+                                           unsigned int* number_of_results)
+{
+    if (new_faceprints == nullptr || results == nullptr || number_of_results == nullptr ||
+        k > RealSenseID::RemoteGallery::MaxTopK)
+    {
+        return RSID_Error;
+    }
+
+    RealSenseID::HostGalleryMatch gallery_matches[RealSenseID::RemoteGallery::MaxTopK];
+    size_t n_results = 0;
+    auto status =
+        get_remote_gallery_impl(gallery)->MatchTopK(*as_cpp_faceprints(new_faceprints), k, gallery_matches, n_results);
+    for (size_t i = 0; i < n_results; i++)
+    {
+        to_c_gallery_match(gallery_matches[i], &results[i]);
+    }
+    *number_of_results = static_cast<unsigned int>(n_results);
+    return static_cast<rsid_status>(status);
+}
+
+rsid_status rsid_authenticate_with_remote_gallery(rsid_authenticator* authenticator, rsid_remote_gallery* gallery,
+                                                  rsid_gallery_auth_clbk clbk, void* ctx)
+{
+    if (gallery == nullptr || clbk == nullptr)
+    {
+        return RSID_Error;
+    }
+    auto* auth_impl = get_auth_impl(authenticator);
+    GalleryAuthClbk gallery_clbk {clbk, ctx, get_timing_clbk(authenticator)};
+    return static_cast<rsid_status>(
+        auth_impl->AuthenticateWithGallery(*get_remote_gallery_impl(gallery), gallery_clbk));
+}
+
 rsid_status rsid_authenticate_loop(rsid_authenticator* authenticator, const rsid_auth_args* args)
 {
     auto* auth_impl = get_auth_impl(authenticator);
-    AuthClbk authCallback(*args);
+    AuthClbk authCallback(*args, get_timing_clbk(authenticator));
     auto status = auth_impl->AuthenticateLoop(authCallback);
     return static_cast<rsid_status>(status);
 }
 
+static_assert(RSID_MAX_FACES == RealSenseID::AuthEvent::MAX_FACES, "max faces mismatch");
+static_assert(RSID_AuthEvent_Result == static_cast<int>(RealSenseID::AuthEventType::Result), "event types mismatch");
+
+static RealSenseID::AuthEventQueue* get_queue_impl(rsid_auth_event_queue* queue)
+{
+    return static_cast<RealSenseID::AuthEventQueue*>(queue->_impl);
+}
+
+rsid_auth_event_queue* rsid_create_auth_event_queue(unsigned int capacity)
+{
+    try
+    {
+        auto* rv = new rsid_auth_event_queue();
+        rv->_impl = static_cast<void*>(new RealSenseID::AuthEventQueue(capacity));
+        return rv;
+    }
+    catch (...)
+    {
+        return nullptr;
+    }
+}
+
+void rsid_destroy_auth_event_queue(rsid_auth_event_queue* queue)
+{
+    if (queue == nullptr)
+    {
+        return;
+    }
+    try
+    {
+        delete get_queue_impl(queue);
+        delete queue;
+    }
+    catch (...)
+    {
+    }
+}
+
+int rsid_poll_auth_event(rsid_auth_event_queue* queue, rsid_auth_event* event)
+{
+    RealSenseID::AuthEvent source;
+    if (!get_queue_impl(queue)->Poll(source))
+    {
+        return 0;
+    }
+    event->type = static_cast<rsid_auth_event_type>(source.type);
+    event->status = static_cast<rsid_auth_status>(source.status);
+    static_assert(sizeof(event->user_id) == sizeof(source.user_id), "user id sizes does not match");
+    ::memcpy(event->user_id, source.user_id, sizeof(event->user_id));
+    event->ts = source.ts;
+    event->n_faces = static_cast<unsigned int>(source.n_faces);
+    for (size_t i = 0; i < source.n_faces; i++)
+    {
+        const auto& face = source.faces[i];
+        event->faces[i] = {face.x, face.y, face.w, face.h};
+    }
+    return 1;
+}
+
+unsigned int rsid_auth_event_queue_dropped(rsid_auth_event_queue* queue)
+{
+    return static_cast<unsigned int>(get_queue_impl(queue)->Dropped());
+}
+
+rsid_status rsid_authenticate_to_queue(rsid_authenticator* authenticator, rsid_auth_event_queue* queue)
+{
+    auto* auth_impl = get_auth_impl(authenticator);
+    auto status = auth_impl->Authenticate(*get_queue_impl(queue));
+    return static_cast<rsid_status>(status);
+}
+
+rsid_status rsid_authenticate_loop_to_queue(rsid_authenticator* authenticator, rsid_auth_event_queue* queue)
+{
+    auto* auth_impl = get_auth_impl(authenticator);
+    auto status = auth_impl->AuthenticateLoop(*get_queue_impl(queue));
+    return static_cast<rsid_status>(status);
+}
+
 rsid_status rsid_cancel(rsid_authenticator* authenticator)
 {
     auto* auth_impl = get_auth_impl(authenticator);
@@ -691,55 +1393,144 @@ void rsid_set_log_clbk(rsid_log_clbk clbk, rsid_log_level min_level, int do_form
     RealSenseID::SetLogCallback(log_clbk, required_level, required_formatting);
 }
 
-rsid_status rsid_query_user_ids(rsid_authenticator* authenticator, char** user_ids, unsigned int* number_of_users)
+void rsid_set_structured_log_clbk(rsid_structured_log_clbk clbk, rsid_log_level min_level, void* ctx)
 {
-    auto* auth_impl = get_auth_impl(authenticator);
-    return static_cast<rsid_status>(auth_impl->QueryUserIds(user_ids, *number_of_users));
+    RealSenseID::StructuredLogCallback log_clbk;
+    if (clbk != nullptr)
+    {
+        log_clbk = [clbk, ctx](const RealSenseID::LogRecord& record) {
+            clbk(static_cast<rsid_log_level>(record.level), record.tag, record.message, record.message_size, ctx);
+        };
+    }
+    RealSenseID::SetStructuredLogCallback(log_clbk, static_cast<RealSenseID::LogLevel>(min_level));
 }
 
-// concat user ids to single buffer for easier usage from managed languages
-// result buf size must be number_of_users * 31
-rsid_status rsid_query_user_ids_to_buf(rsid_authenticator* authenticator, char* result_buf,
-                                       unsigned int* number_of_users)
+void rsid_set_log_sampling(const char* tag, unsigned int one_in, unsigned int max_per_second)
 {
-    auto* auth_impl = get_auth_impl(authenticator);
+    RealSenseID::SetLogSampling(tag, one_in, max_per_second);
+}
+
+void rsid_clear_log_sampling()
+{
+    RealSenseID::ClearLogSampling();
+}
+
+struct rsid_task
+{
+    std::function<void()> loop;
+};
 
-    // allocate needed array of user ids
-    char** user_ids = new char*[*number_of_users];
-    for (unsigned i = 0; i < *number_of_users; i++)
+namespace
+{
+class CExecutor : public RealSenseID::Executor
+{
+public:
+    CExecutor(rsid_execute_clbk clbk, void* ctx) : _clbk {clbk}, _ctx {ctx}
     {
-        user_ids[i] = new char[RealSenseID::FaceAuthenticator::MAX_USERID_LENGTH];
     }
-    unsigned int nusers_in_out = *number_of_users;
-    auto status = auth_impl->QueryUserIds(user_ids, nusers_in_out);
-    if (status != RealSenseID::Status::Ok)
+
+    void Execute(std::function<void()> task) override
     {
-        // free allocated memory and return on error
-        for (unsigned int i = 0; i < *number_of_users; i++)
-        {
-            delete user_ids[i];
-        }
-        delete[] user_ids;
-        *number_of_users = 0;
-        return static_cast<rsid_status>(status);
+        _clbk(new rsid_task {std::move(task)}, _ctx);
     }
-    // concat to the output buffer
-    for (unsigned int i = 0; i < nusers_in_out; i++)
+
+private:
+    rsid_execute_clbk _clbk;
+    void* _ctx;
+};
+} // namespace
+
+void rsid_set_executor(rsid_execute_clbk clbk, void* ctx)
+{
+    // the loops started with an executor may still use it, so the executors are kept until unload
+    static std::mutex executors_mutex;
+    static std::vector<std::unique_ptr<CExecutor>> executors;
+    RealSenseID::Executor* executor = nullptr;
+    if (clbk != nullptr)
     {
-        ::memcpy((char*)&result_buf[i * RealSenseID::FaceAuthenticator::MAX_USERID_LENGTH], user_ids[i],
-                 RealSenseID::FaceAuthenticator::MAX_USERID_LENGTH);
+        std::lock_guard<std::mutex> lock {executors_mutex};
+        executors.push_back(std::make_unique<CExecutor>(clbk, ctx));
+        executor = executors.back().get();
     }
+    RealSenseID::SetExecutor(executor);
+}
 
-    // free allocated memory
-    for (unsigned int i = 0; i < *number_of_users; i++)
+void rsid_run_task(rsid_task* task)
+{
+    if (task == nullptr)
     {
-        delete user_ids[i];
+        return;
     }
-    delete[] user_ids;
-    *number_of_users = nusers_in_out;
-    return rsid_status::RSID_Ok;
+    std::unique_ptr<rsid_task> owned {task};
+    owned->loop();
+}
+
+static_assert(RSID_METRICS_LATENCY_BUCKETS == RealSenseID::MetricsLatencyBuckets, "latency buckets mismatch");
+static_assert(RSID_MetricsOp_Count == static_cast<int>(RealSenseID::MetricsOperation::Count), "operations mismatch");
+
+void rsid_get_metrics(rsid_metrics* metrics)
+{
+    if (metrics == nullptr)
+    {
+        return;
+    }
+    RealSenseID::Metrics source;
+    RealSenseID::GetMetrics(source);
+
+    static_assert(sizeof(metrics->packets_sent) == sizeof(source.packets_sent), "packets_sent size mismatch");
+    ::memcpy(metrics->packets_sent, source.packets_sent, sizeof(metrics->packets_sent));
+    ::memcpy(metrics->packets_received, source.packets_received, sizeof(metrics->packets_received));
+    metrics->crc_errors = source.crc_errors;
+    metrics->timeouts = source.timeouts;
+    metrics->sync_retries = source.sync_retries;
+    metrics->serial_transfer_time_us = source.serial_transfer_time_us;
+    metrics->serial_wait_time_us = source.serial_wait_time_us;
+    metrics->session_starts = source.session_starts;
+    metrics->session_start_time_us = source.session_start_time_us;
+    for (int op = 0; op < RSID_MetricsOp_Count; op++)
+    {
+        ::memcpy(metrics->latency[op].buckets, source.latency[op].buckets, sizeof(metrics->latency[op].buckets));
+        metrics->latency[op].count = source.latency[op].count;
+        metrics->latency[op].sum_us = source.latency[op].sum_us;
+    }
+    metrics->matcher_searches = source.matcher_searches;
+    metrics->matcher_candidates = source.matcher_candidates;
+    metrics->matcher_time_us = source.matcher_time_us;
+    metrics->preview_frames_dropped = source.preview_frames_dropped;
+}
+
+void rsid_reset_metrics()
+{
+    RealSenseID::ResetMetrics();
+}
+
+rsid_status rsid_query_user_ids(rsid_authenticator* authenticator, char** user_ids, unsigned int* number_of_users)
+{
+    auto* auth_impl = get_auth_impl(authenticator);
+    return static_cast<rsid_status>(auth_impl->QueryUserIds(user_ids, *number_of_users));
 }
 
+// user ids in a single buffer for easier usage from managed languages
+// result buf size must be number_of_users * 31
+rsid_status rsid_query_user_ids_to_buf(rsid_authenticator* authenticator, char* result_buf,
+                                       unsigned int* number_of_users)
+{
+    auto* auth_impl = get_auth_impl(authenticator);
+    return static_cast<rsid_status>(auth_impl->QueryUserIdsToBuffer(result_buf, *number_of_users));
+}
+
+rsid_status rsid_query_user_ids_clbk(rsid_authenticator* authenticator, rsid_user_id_clbk clbk, void* ctx,
+                                     unsigned int* number_of_users)
+{
+    if (clbk == nullptr)
+    {
+        *number_of_users = 0;
+        return RSID_Error;
+    }
+    auto* auth_impl = get_auth_impl(authenticator);
+    UserIdsClbk user_ids_clbk {clbk, ctx};
+    return static_cast<rsid_status>(auth_impl->QueryUserIds(user_ids_clbk, *number_of_users));
+}
 
 rsid_status rsid_query_number_of_users(rsid_authenticator* authenticator, unsigned int* number_of_users)
 {
@@ -750,30 +1541,79 @@ rsid_status rsid_query_number_of_users(rsid_authenticator* authenticator, unsign
 rsid_status rsid_get_users_faceprints(rsid_authenticator* authenticator, rsid_faceprints* user_features)
 {
     auto* auth_impl = get_auth_impl(authenticator);
-    RealSenseID::Faceprints user_descriptors[1000]; //@TODO  use a max_users macro
+    // written straight into the caller's array
     unsigned int num_of_users = 0;
-    auto status = static_cast<rsid_status>(auth_impl->GetUsersFaceprints(user_descriptors, num_of_users));
-    for (unsigned int i = 0; i < num_of_users; i++)
+    return static_cast<rsid_status>(auth_impl->GetUsersFaceprints(as_cpp_faceprints(user_features), num_of_users));
+}
+
+rsid_status rsid_export_users(rsid_authenticator* authenticator, rsid_user_export_clbk clbk, void* ctx,
+                              unsigned int* number_of_users)
+{
+    if (clbk == nullptr)
     {
-        copy_to_c_faceprints(user_descriptors[i], &user_features[i]);
+        *number_of_users = 0;
+        return RSID_Error;
     }
-    return status;
+    auto* auth_impl = get_auth_impl(authenticator);
+    UsersExportClbk export_clbk {clbk, ctx};
+    return static_cast<rsid_status>(auth_impl->ExportUsers(export_clbk, *number_of_users));
+}
+
+rsid_status rsid_export_users_page(rsid_authenticator* authenticator, rsid_users_cursor* cursor, unsigned int page_size,
+                                   rsid_user_export_clbk clbk, void* ctx)
+{
+    if (cursor == nullptr || clbk == nullptr)
+    {
+        return RSID_Error;
+    }
+    auto* auth_impl = get_auth_impl(authenticator);
+    UsersExportClbk export_clbk {clbk, ctx};
+    auto users_cursor = as_cpp_cursor(cursor);
+    auto status = auth_impl->ExportUsers(users_cursor, page_size, export_clbk);
+    set_c_cursor(users_cursor, cursor);
+    return static_cast<rsid_status>(status);
+}
+
+rsid_status rsid_query_user_ids_page(rsid_authenticator* authenticator, rsid_users_cursor* cursor,
+                                     unsigned int page_size, rsid_user_id_clbk clbk, void* ctx)
+{
+    if (cursor == nullptr || clbk == nullptr)
+    {
+        return RSID_Error;
+    }
+    auto* auth_impl = get_auth_impl(authenticator);
+    UserIdsClbk user_ids_clbk {clbk, ctx};
+    auto users_cursor = as_cpp_cursor(cursor);
+    auto status = auth_impl->QueryUserIds(users_cursor, page_size, user_ids_clbk);
+    set_c_cursor(users_cursor, cursor);
+    return static_cast<rsid_status>(status);
 }
 
 rsid_status rsid_set_users_faceprints(rsid_authenticator* authenticator, rsid_user_faceprints* user_features,
                                    const unsigned int number_of_users)
 {
     auto* auth_impl = get_auth_impl(authenticator);
-    RealSenseID::UserFaceprints user_descriptors[1000]; //@TODO  use a max_users macro
+    std::vector<RealSenseID::UserFaceprints> user_descriptors(number_of_users);
     for (unsigned int i = 0; i < number_of_users; i++)
     {
-        copy_to_cpp_faceprints(&user_features[i].faceprints, user_descriptors[i].faceprints);
+        user_descriptors[i].faceprints = *as_cpp_faceprints(&user_features[i].faceprints);
         user_descriptors[i].user_id = user_features[i].user_id;
     }
-    auto status = static_cast<rsid_status>(auth_impl->SetUsersFaceprints (user_descriptors, number_of_users));
+    auto status = static_cast<rsid_status>(auth_impl->SetUsersFaceprints(user_descriptors.data(), number_of_users));
     return status;
 }
 
+rsid_status rsid_begin_bulk_update(rsid_authenticator* authenticator)
+{
+    auto* auth_impl = get_auth_impl(authenticator);
+    return static_cast<rsid_status>(auth_impl->BeginBulkUpdate());
+}
+
+rsid_status rsid_commit_bulk_update(rsid_authenticator* authenticator)
+{
+    auto* auth_impl = get_auth_impl(authenticator);
+    return static_cast<rsid_status>(auth_impl->CommitBulkUpdate());
+}
 
 rsid_status rsid_standby(rsid_authenticator* authenticator)
 {
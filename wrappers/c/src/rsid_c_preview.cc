@@ -4,6 +4,7 @@
 #include "RealSenseID/Preview.h"
 #include "rsid_c/rsid_preview.h"
 #include <memory>
+#include <mutex>
 
 namespace
 {
@@ -61,16 +62,93 @@ private:
     rsid_preview_clbk m_callback;
     void* m_ctx;
 };
-} // namespace
 
-static std::unique_ptr<PreviewClbk> s_preview_clbk;
+// Mailbox mode: keeps only the newest frame, acquired from the preview, until the client takes it with
+// rsid_preview_acquire_latest or a newer frame replaces it. With the default 3 preview buffers one is decoding, one is
+// the latest frame and one is held by the client, so frames are never copied or marshalled unless taken.
+class PreviewMailbox : public RealSenseID::PreviewImageReadyCallback
+{
+public:
+    explicit PreviewMailbox(RealSenseID::Preview& preview) : m_preview {preview}
+    {
+    }
+
+    void OnPreviewImageReady(const RealSenseID::Image image) override
+    {
+        if (image.buffer == nullptr || !m_preview.AcquireImage(image))
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> lock {m_mutex};
+        if (m_has_latest)
+        {
+            m_preview.ReleaseImage(m_latest);
+        }
+        m_latest = image;
+        m_has_latest = true;
+    }
+
+    bool TakeLatest(RealSenseID::Image& image)
+    {
+        std::lock_guard<std::mutex> lock {m_mutex};
+        if (!m_has_latest)
+        {
+            return false;
+        }
+        image = m_latest;
+        m_has_latest = false;
+        return true;
+    }
+
+    // release the frame no one took
+    void Clear()
+    {
+        std::lock_guard<std::mutex> lock {m_mutex};
+        if (m_has_latest)
+        {
+            m_preview.ReleaseImage(m_latest);
+            m_has_latest = false;
+        }
+    }
+
+private:
+    RealSenseID::Preview& m_preview;
+    std::mutex m_mutex;
+    RealSenseID::Image m_latest;
+    bool m_has_latest = false;
+};
+
+// what rsid_preview::_impl points to
+struct PreviewHandle
+{
+    explicit PreviewHandle(const RealSenseID::PreviewConfig& config) : preview {config}, mailbox {preview}
+    {
+    }
+
+    ~PreviewHandle()
+    {
+        preview.StopPreview();
+        mailbox.Clear();
+    }
+
+    RealSenseID::Preview preview;
+    std::unique_ptr<PreviewClbk> clbk;
+    PreviewMailbox mailbox;
+};
+
+RealSenseID::Preview* get_preview(rsid_preview* preview_handle)
+{
+    return &static_cast<PreviewHandle*>(preview_handle->_impl)->preview;
+}
+} // namespace
 
 rsid_preview* rsid_create_preview(const rsid_preview_config* preview_config)
 {
     RealSenseID::PreviewConfig config;
     config.cameraNumber = preview_config->camera_number;
     config.previewMode = static_cast<RealSenseID::PreviewMode>(preview_config->preview_mode);
-    auto* preview_impl = new RealSenseID::Preview(config);
+    config.previewQuality = static_cast<RealSenseID::PreviewQuality>(preview_config->preview_quality);
+    auto* preview_impl = new PreviewHandle(config);
 
     if (preview_impl == nullptr)
     {
@@ -89,9 +167,8 @@ void rsid_destroy_preview(rsid_preview* preview_handle)
 
     try
     {
-        auto* preview_impl = static_cast<RealSenseID::Preview*>(preview_handle->_impl);
+        auto* preview_impl = static_cast<PreviewHandle*>(preview_handle->_impl);
         delete preview_impl;
-        s_preview_clbk.reset();
     }
     catch (...)
     {
@@ -109,9 +186,29 @@ int rsid_start_preview(rsid_preview* preview_handle, rsid_preview_clbk clbk, voi
 
     try
     {
-        auto* preview_impl = static_cast<RealSenseID::Preview*>(preview_handle->_impl);
-        s_preview_clbk = std::make_unique<PreviewClbk>(clbk, ctx);
-        bool ok = preview_impl->StartPreview(*s_preview_clbk);
+        auto* handle_impl = static_cast<PreviewHandle*>(preview_handle->_impl);
+        handle_impl->clbk = std::make_unique<PreviewClbk>(clbk, ctx);
+        bool ok = handle_impl->preview.StartPreview(*handle_impl->clbk);
+        return static_cast<int>(ok);
+    }
+    catch (...)
+    {
+        return 0;
+    }
+}
+
+int rsid_start_preview_mailbox(rsid_preview* preview_handle)
+{
+    if (!preview_handle)
+        return 0;
+
+    if (!preview_handle->_impl)
+        return 0;
+
+    try
+    {
+        auto* handle_impl = static_cast<PreviewHandle*>(preview_handle->_impl);
+        bool ok = handle_impl->preview.StartPreview(handle_impl->mailbox);
         return static_cast<int>(ok);
     }
     catch (...)
@@ -120,6 +217,36 @@ int rsid_start_preview(rsid_preview* preview_handle, rsid_preview_clbk clbk, voi
     }
 }
 
+int rsid_preview_acquire_latest(rsid_preview* preview_handle, rsid_image* image)
+{
+    if (!preview_handle || !image)
+        return 0;
+
+    if (!preview_handle->_impl)
+        return 0;
+
+    try
+    {
+        auto* handle_impl = static_cast<PreviewHandle*>(preview_handle->_impl);
+        RealSenseID::Image latest;
+        if (!handle_impl->mailbox.TakeLatest(latest))
+        {
+            return 0;
+        }
+        *image = api_image_to_c_img(&latest);
+        return 1;
+    }
+    catch (...)
+    {
+        return 0;
+    }
+}
+
+int rsid_preview_release(rsid_preview* preview_handle, const rsid_image* image)
+{
+    return rsid_release_preview_image(preview_handle, image);
+}
+
 
 int rsid_pause_preview(rsid_preview* preview_handle)
 {
@@ -131,7 +258,7 @@ int rsid_pause_preview(rsid_preview* preview_handle)
 
     try
     {
-        auto* preview_impl = static_cast<RealSenseID::Preview*>(preview_handle->_impl);
+        auto* preview_impl = get_preview(preview_handle);
         bool ok = preview_impl->PausePreview();
         return static_cast<int>(ok);
     }
@@ -151,7 +278,7 @@ int rsid_resume_preview(rsid_preview* preview_handle)
 
     try
     {
-        auto* preview_impl = static_cast<RealSenseID::Preview*>(preview_handle->_impl);
+        auto* preview_impl = get_preview(preview_handle);
         bool ok = preview_impl->ResumePreview();
         return static_cast<int>(ok);
     }
@@ -161,6 +288,26 @@ int rsid_resume_preview(rsid_preview* preview_handle)
     }
 }
 
+int rsid_standby_preview(rsid_preview* preview_handle)
+{
+    if (!preview_handle)
+        return 0;
+
+    if (!preview_handle->_impl)
+        return 0;
+
+    try
+    {
+        auto* preview_impl = get_preview(preview_handle);
+        bool ok = preview_impl->StandbyPreview();
+        return static_cast<int>(ok);
+    }
+    catch (...)
+    {
+        return 0;
+    }
+}
+
 int rsid_stop_preview(rsid_preview* preview_handle)
 {
     if (!preview_handle)
@@ -171,8 +318,49 @@ int rsid_stop_preview(rsid_preview* preview_handle)
 
     try
     {
-        auto* preview_impl = static_cast<RealSenseID::Preview*>(preview_handle->_impl);
-        bool ok = preview_impl->StopPreview();
+        auto* handle_impl = static_cast<PreviewHandle*>(preview_handle->_impl);
+        bool ok = handle_impl->preview.StopPreview();
+        handle_impl->mailbox.Clear();
+        return static_cast<int>(ok);
+    }
+    catch (...)
+    {
+        return 0;
+    }
+}
+
+int rsid_acquire_preview_image(rsid_preview* preview_handle, const rsid_image* image)
+{
+    if (!preview_handle || !image)
+        return 0;
+
+    if (!preview_handle->_impl)
+        return 0;
+
+    try
+    {
+        auto* preview_impl = get_preview(preview_handle);
+        bool ok = preview_impl->AcquireImage(c_img_to_api_image(image));
+        return static_cast<int>(ok);
+    }
+    catch (...)
+    {
+        return 0;
+    }
+}
+
+int rsid_release_preview_image(rsid_preview* preview_handle, const rsid_image* image)
+{
+    if (!preview_handle || !image)
+        return 0;
+
+    if (!preview_handle->_impl)
+        return 0;
+
+    try
+    {
+        auto* preview_impl = get_preview(preview_handle);
+        bool ok = preview_impl->ReleaseImage(c_img_to_api_image(image));
         return static_cast<int>(ok);
     }
     catch (...)
@@ -191,7 +379,7 @@ int rsid_raw_to_rgb(rsid_preview* preview_handle,const rsid_image* in_c_img, rsi
 
     try
     {
-        auto* preview_impl = static_cast<RealSenseID::Preview*>(preview_handle->_impl);
+        auto* preview_impl = get_preview(preview_handle);
         RealSenseID::Image out_image = c_img_to_api_image(out_c_img);
         bool ok = preview_impl->RawToRgb(c_img_to_api_image(in_c_img), out_image);
         *out_c_img = api_image_to_c_img(&out_image);
@@ -202,3 +390,47 @@ int rsid_raw_to_rgb(rsid_preview* preview_handle,const rsid_image* in_c_img, rsi
         return 0;
     }
 }
+
+int rsid_raw_to_gray(rsid_preview* preview_handle, const rsid_image* in_c_img, rsid_image* out_c_img, int binning)
+{
+    if (!preview_handle)
+        return 0;
+
+    if (!preview_handle->_impl)
+        return 0;
+
+    try
+    {
+        auto* preview_impl = get_preview(preview_handle);
+        RealSenseID::Image out_image = c_img_to_api_image(out_c_img);
+        bool ok = preview_impl->RawToGray(c_img_to_api_image(in_c_img), out_image, binning != 0);
+        *out_c_img = api_image_to_c_img(&out_image);
+        return static_cast<int>(ok);
+    }
+    catch (...)
+    {
+        return 0;
+    }
+}
+
+int rsid_raw_to_raw16(rsid_preview* preview_handle, const rsid_image* in_c_img, rsid_image* out_c_img)
+{
+    if (!preview_handle)
+        return 0;
+
+    if (!preview_handle->_impl)
+        return 0;
+
+    try
+    {
+        auto* preview_impl = get_preview(preview_handle);
+        RealSenseID::Image out_image = c_img_to_api_image(out_c_img);
+        bool ok = preview_impl->RawToRaw16(c_img_to_api_image(in_c_img), out_image);
+        *out_c_img = api_image_to_c_img(&out_image);
+        return static_cast<int>(ok);
+    }
+    catch (...)
+    {
+        return 0;
+    }
+}
@@ -525,6 +525,17 @@ namespace rsid
             return (status == Status.Ok);
         }
 
+        // Bulk update of the device's DB: SetUsersFaceprints() calls in between are persisted once, by the commit
+        public Status BeginBulkUpdate()
+        {
+            return rsid_begin_bulk_update(_handle);
+        }
+
+        public Status CommitBulkUpdate()
+        {
+            return rsid_commit_bulk_update(_handle);
+        }
+
         private IntPtr _handle;
         private bool _disposed = false;
 
@@ -627,6 +638,12 @@ namespace rsid
 
         [DllImport(Shared.DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
         static extern Status rsid_set_users_faceprints(IntPtr rsid_authenticator, rsid.UserFaceprints[] user_features, int n_users);
+
+        [DllImport(Shared.DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        static extern Status rsid_begin_bulk_update(IntPtr rsid_authenticator);
+
+        [DllImport(Shared.DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        static extern Status rsid_commit_bulk_update(IntPtr rsid_authenticator);
     }
 
 }
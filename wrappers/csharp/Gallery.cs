@@ -0,0 +1,130 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2020-2021 Intel Corporation. All Rights Reserved.
+
+using System;
+using System.Runtime.InteropServices;
+
+namespace rsid
+{
+    [StructLayout(LayoutKind.Sequential, CharSet = CharSet.Ansi)]
+    public struct GalleryMatchResult
+    {
+        public MatchResult matchResult;
+
+        // matched user id (valid only if matchResult.success)
+        [MarshalAs(UnmanagedType.ByValTStr, SizeConst = 31)]
+        public string userId;
+    }
+
+    // Host mode users gallery, kept in native memory.
+    // Match() matches faceprints against all the users in a single call.
+    public class Gallery : IDisposable
+    {
+        public Gallery()
+        {
+            _handle = rsid_create_gallery();
+            if (_handle == IntPtr.Zero) throw new Exception("Error creating gallery");
+        }
+
+        ~Gallery()
+        {
+            Dispose(false);
+        }
+
+        // add user to the gallery, or replace its faceprints if the user is already in it.
+        public Status Add(string userId, ref Faceprints faceprints)
+        {
+            return rsid_gallery_add(_handle, userId, ref faceprints);
+        }
+
+        public Status Remove(string userId)
+        {
+            return rsid_gallery_remove(_handle, userId);
+        }
+
+        public void Clear()
+        {
+            rsid_gallery_clear(_handle);
+        }
+
+        public uint Size()
+        {
+            return rsid_gallery_size(_handle);
+        }
+
+        // if result.matchResult.shouldUpdate is set, the matched user was updated in the gallery and its updated
+        // faceprints are returned in updatedFaceprints, to be saved in the database.
+        public GalleryMatchResult Match(ref Faceprints newFaceprints, ref Faceprints updatedFaceprints)
+        {
+            var result = new GalleryMatchResult();
+            rsid_gallery_match(_handle, ref newFaceprints, ref result, ref updatedFaceprints);
+            return result;
+        }
+
+        // set the access groups of a user (bit g for group g, 64 groups), for MatchGroups(). users have no groups until
+        // set.
+        public Status SetUserGroups(string userId, ulong accessGroups)
+        {
+            return rsid_gallery_set_user_groups(_handle, userId, accessGroups);
+        }
+
+        // match against the users of the given access groups only, as Match(), so one gallery serves every door.
+        public GalleryMatchResult MatchGroups(ref Faceprints newFaceprints, ulong accessGroups,
+                                              ref Faceprints updatedFaceprints)
+        {
+            var result = new GalleryMatchResult();
+            rsid_gallery_match_groups(_handle, ref newFaceprints, accessGroups, ref result, ref updatedFaceprints);
+            return result;
+        }
+
+        public void Dispose()
+        {
+            Dispose(true);
+            // prevent finalization code for this object
+            // from executing a second time.
+            GC.SuppressFinalize(this);
+        }
+
+        protected virtual void Dispose(bool disposing)
+        {
+            if (!_disposed)
+            {
+                rsid_destroy_gallery(_handle);
+                _handle = IntPtr.Zero;
+                _disposed = true;
+            }
+        }
+        private IntPtr _handle;
+        private bool _disposed = false;
+
+        [DllImport(Shared.DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        static extern IntPtr rsid_create_gallery();
+
+        [DllImport(Shared.DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        static extern void rsid_destroy_gallery(IntPtr rsid_gallery);
+
+        [DllImport(Shared.DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        static extern Status rsid_gallery_add(IntPtr rsid_gallery, string userId, ref Faceprints faceprints);
+
+        [DllImport(Shared.DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        static extern Status rsid_gallery_remove(IntPtr rsid_gallery, string userId);
+
+        [DllImport(Shared.DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        static extern void rsid_gallery_clear(IntPtr rsid_gallery);
+
+        [DllImport(Shared.DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        static extern uint rsid_gallery_size(IntPtr rsid_gallery);
+
+        [DllImport(Shared.DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        static extern Status rsid_gallery_match(IntPtr rsid_gallery, ref Faceprints newFaceprints,
+                                                ref GalleryMatchResult result, ref Faceprints updatedFaceprints);
+
+        [DllImport(Shared.DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        static extern Status rsid_gallery_set_user_groups(IntPtr rsid_gallery, string userId, ulong accessGroups);
+
+        [DllImport(Shared.DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        static extern Status rsid_gallery_match_groups(IntPtr rsid_gallery, ref Faceprints newFaceprints,
+                                                       ulong accessGroups, ref GalleryMatchResult result,
+                                                       ref Faceprints updatedFaceprints);
+    }
+}
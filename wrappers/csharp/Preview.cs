@@ -13,7 +13,14 @@ namespace rsid
     {
         MJPEG_1080P = 0, // default
         MJPEG_720P = 1,
-        RAW10_1080P = 2 // dump all frames
+        RAW10_1080P = 2, // dump all frames
+        YUY2_720P = 3 // uncompressed, no jpeg decode
+    };
+
+    public enum PreviewQuality
+    {
+        Full = 0, // default
+        Fast = 1 // faster jpeg decode of lower quality, for on-screen preview
     };
 
     [StructLayout(LayoutKind.Sequential)]
@@ -21,6 +28,7 @@ namespace rsid
     {
         public int cameraNumber;
         public PreviewMode previewMode;
+        public PreviewQuality previewQuality;
     }
 
     [StructLayout(LayoutKind.Sequential, Pack = 0)]
@@ -56,6 +64,28 @@ namespace rsid
 
     public delegate void PreviewCallback(PreviewImage image, IntPtr ctx);
 
+    // Preview image whose native buffer stays valid until disposed, so it can be used without copying
+    // (e.g. WriteableBitmap.WritePixels with the buffer pointer). See Preview.AcquireFrame.
+    public sealed class PreviewFrame : IDisposable
+    {
+        internal PreviewFrame(Preview preview, PreviewImage image)
+        {
+            _preview = preview;
+            Image = image;
+        }
+
+        public PreviewImage Image { get; }
+
+        public void Dispose()
+        {
+            if (_preview != null)
+                _preview.ReleaseFrame(this);
+            _preview = null;
+        }
+
+        private Preview _preview;
+    }
+
     public class Preview : IDisposable
     {
         PreviewCallback _clbkDelegate;
@@ -72,7 +102,10 @@ namespace rsid
             try
             {
                 if (_handle != IntPtr.Zero)
+                {
+                    ReleaseFrames();
                     rsid_destroy_preview(_handle);
+                }
                 _handle = rsid_create_preview(ref _config);
             }
             catch (TypeLoadException)
@@ -98,6 +131,32 @@ namespace rsid
         }
 
 
+        // Start in mailbox mode: no callback, the newest frame is kept for AcquireLatestFrame (e.g. from the render
+        // loop). Frames that are not taken are dropped without being marshalled.
+        public bool StartMailbox()
+        {
+            if (_handle == IntPtr.Zero)
+                return false;
+            return rsid_start_preview_mailbox(_handle) != 0;
+        }
+
+        // The newest frame received since the last call in mailbox mode, null if there is none. Dispose it when done
+        // (hold one frame at a time, or frames are dropped). Frames not disposed are released with the preview.
+        public PreviewFrame AcquireLatestFrame()
+        {
+            if (_handle == IntPtr.Zero)
+                return null;
+            lock (_frames)
+            {
+                var image = new PreviewImage();
+                if (rsid_preview_acquire_latest(_handle, ref image) == 0)
+                    return null;
+                var frame = new PreviewFrame(this, image);
+                _frames.Add(frame);
+                return frame;
+            }
+        }
+
         public bool Pause()
         {
             if (_handle == IntPtr.Zero)
@@ -112,6 +171,14 @@ namespace rsid
             return rsid_resume_preview(_handle) != 0;
         }
 
+        // keep the camera open and streaming, so the next Start or Resume shows the camera's next frame
+        public bool Standby()
+        {
+            if (_handle == IntPtr.Zero)
+                return false;
+            return rsid_standby_preview(_handle) != 0;
+        }
+
         public bool Stop()
         {
             if (_handle == IntPtr.Zero)
@@ -127,6 +194,50 @@ namespace rsid
             GC.SuppressFinalize(this);
         }
 
+        // Keep the native buffer of an image received in the preview callback after the callback returns.
+        // Must be called during the callback. The frame's buffer is not reused for new frames until the frame is disposed,
+        // so holding all the preview buffers drops frames. Frames not disposed are released with the preview.
+        // Returns null on failure.
+        public PreviewFrame AcquireFrame(PreviewImage image)
+        {
+            if (_handle == IntPtr.Zero)
+                return null;
+            lock (_frames)
+            {
+                if (rsid_acquire_preview_image(_handle, ref image) == 0)
+                    return null;
+                var frame = new PreviewFrame(this, image);
+                _frames.Add(frame);
+                return frame;
+            }
+        }
+
+        internal void ReleaseFrame(PreviewFrame frame)
+        {
+            lock (_frames)
+            {
+                if (!_frames.Remove(frame))
+                    return; // already released with the preview
+                var image = frame.Image;
+                if (_handle != IntPtr.Zero)
+                    rsid_release_preview_image(_handle, ref image);
+            }
+        }
+
+        // release the acquired frames, before their native preview is destroyed
+        private void ReleaseFrames()
+        {
+            lock (_frames)
+            {
+                foreach (var frame in _frames)
+                {
+                    var image = frame.Image;
+                    rsid_release_preview_image(_handle, ref image);
+                }
+                _frames.Clear();
+            }
+        }
+
         public bool RawToRgb(ref PreviewImage in_img,ref PreviewImage out_img)
         {
             if (_handle == IntPtr.Zero)
@@ -136,13 +247,17 @@ namespace rsid
 
         private IntPtr _handle = IntPtr.Zero;
         private bool _disposed = false;
+        private readonly HashSet<PreviewFrame> _frames = new HashSet<PreviewFrame>();
 
         protected virtual void Dispose(bool disposing)
         {
             if (!_disposed)
             {
                 if (_handle != IntPtr.Zero)
+                {
+                    ReleaseFrames();
                     rsid_destroy_preview(_handle);
+                }
                 _handle = IntPtr.Zero;
                 _disposed = true;
             }
@@ -157,6 +272,12 @@ namespace rsid
         [DllImport(Shared.DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
         static extern int rsid_start_preview(IntPtr rsid_preview, PreviewCallback clbk, IntPtr ctx);
 
+        [DllImport(Shared.DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        static extern int rsid_start_preview_mailbox(IntPtr rsid_preview);
+
+        [DllImport(Shared.DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        static extern int rsid_preview_acquire_latest(IntPtr rsid_preview, ref PreviewImage image);
+
         [DllImport(Shared.DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
         static extern int rsid_pause_preview(IntPtr rsid_preview);
 
@@ -166,6 +287,15 @@ namespace rsid
         [DllImport(Shared.DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
         static extern int rsid_stop_preview(IntPtr rsid_preview);
 
+        [DllImport(Shared.DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        static extern int rsid_standby_preview(IntPtr rsid_preview);
+
+        [DllImport(Shared.DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        static extern int rsid_acquire_preview_image(IntPtr rsid_preview, ref PreviewImage image);
+
+        [DllImport(Shared.DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        static extern int rsid_release_preview_image(IntPtr rsid_preview, ref PreviewImage image);
+
         [DllImport(Shared.DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
         static extern int rsid_raw_to_rgb(IntPtr rsid_preview, ref PreviewImage in_img,ref PreviewImage out_img);
     }